@@ -541,7 +541,7 @@ function setupIpcHandlers(): void {
   });
 
   // ── Viewer ──────────────────────────────────────────────────────────
-  ipcMain.handle('viewer:start', (_event, config: ViewerConfig) => {
+  ipcMain.handle('viewer:start', async (_event, config: ViewerConfig) => {
     try {
       const viewer = loadViewer();
 
@@ -558,8 +558,11 @@ function setupIpcHandlers(): void {
       }
       console.log(`[main] Starting viewer: codec=${config.codec}, hwDecode=${config.hardwareDecode}, mode=${config.gamingMode}`);
 
-      viewer.start(config);
-      return { success: true };
+      const timing = await viewer.start(config);
+      console.log(`[main] Viewer started in ${timing.totalMs.toFixed(1)} ms ` +
+        `(renderer ${timing.rendererMs.toFixed(1)}, decoder ${timing.decoderMs.toFixed(1)}, ` +
+        `transport ${timing.transportMs.toFixed(1)}, audio ${timing.audioMs.toFixed(1)})`);
+      return { success: true, timing };
     } catch (err) {
       const message = err instanceof Error ? err.message : 'Failed to start viewer';
       return { success: false, error: message };
@@ -0,0 +1,179 @@
+// ---------------------------------------------------------------------------
+// Reader for the viewer addon's stats buffer (viewer.statsBuffer())
+//
+// The native viewer writes its stats snapshot and a ring of per-frame
+// timings into one ArrayBuffer; this reads them without calling into the
+// addon or allocating, so an overlay can poll it every animation frame.
+// Offsets and field order mirror libs/nvremote-viewer/src/qos/stats_ring.h
+// and must change with it (the header's version word guards against a
+// mismatched build).
+// ---------------------------------------------------------------------------
+
+const MAGIC = 0x52535343; // "CSSR"
+const VERSION = 1;
+const HEADER_BYTES = 64;
+
+// Header words (u32)
+const H_MAGIC = 0;
+const H_VERSION = 1;
+const H_STATS_FIELDS = 2;
+const H_FRAME_FIELDS = 3;
+const H_FRAME_CAPACITY = 4;
+const H_STATS_SEQ = 5;
+const H_FRAME_HEAD = 6;
+
+const MAX_SEQLOCK_RETRIES = 4;
+
+/** Snapshot fields, in buffer order (StatsField). */
+export const STATS_FIELDS = [
+  'updatedUs',
+  'bitrate',
+  'fps',
+  'packetLoss',
+  'jitter',
+  'rtt',
+  'width',
+  'height',
+  'decodeTimeMs',
+  'renderTimeMs',
+  'presentLatencyMs',
+  'presentToPhotonMs',
+  'framesDecoded',
+  'framesDropped',
+  'packetsReceived',
+  'bytesReceived',
+  'fecRecovered',
+  'fecUnrecoverable',
+  'jitterBufferMs',
+  'lateFrames',
+  'renderDroppedFrames',
+  'pathMigrations',
+  'audioOutputLatencyMs',
+  'audioBufferMs',
+  'audioFecRecovered',
+  'audioConcealed',
+  'audioUnderruns',
+  'avOffsetMs',
+  'avAudioDelayMs',
+  'avVideoDelayMs',
+  'clockSynced',
+  'clockErrorMs',
+  'firstPacketP50Ms',
+  'firstPacketP99Ms',
+  'frameCompleteP50Ms',
+  'frameCompleteP99Ms',
+  'glassToGlassP50Ms',
+  'glassToGlassP99Ms',
+  'inputToPhotonP50Ms',
+  'inputToPhotonP99Ms',
+] as const;
+
+export type StatsFieldName = (typeof STATS_FIELDS)[number];
+
+/** Index of each snapshot field in the Float64Array readStats() fills. */
+export const StatsIndex = Object.fromEntries(
+  STATS_FIELDS.map((name, i) => [name, i]),
+) as { readonly [K in StatsFieldName]: number };
+
+/** Frame record fields, in buffer order (FrameField); -1 = unknown. */
+export const FrameIndex = {
+  Seq: 0,
+  CaptureTsUs: 1,
+  PresentedUs: 2,
+  FirstPacketMs: 3,
+  FrameCompleteMs: 4,
+  GlassToGlassMs: 5,
+  PresentLatencyMs: 6,
+  RenderMs: 7,
+} as const;
+
+export class StatsRingReader {
+  private readonly header: Uint32Array;
+  private readonly stats: Float64Array;
+  private readonly frames: Float64Array;
+  private readonly statsFields: number;
+  private readonly frameFields: number;
+  private readonly capacity: number;
+  private lastSeq = 0;
+  private nextFrame = 0;
+
+  /** Throws if |buffer| is not a stats buffer this reader understands. */
+  constructor(buffer: ArrayBuffer) {
+    this.header = new Uint32Array(buffer, 0, HEADER_BYTES / 4);
+    if (this.header[H_MAGIC] !== MAGIC || this.header[H_VERSION] !== VERSION) {
+      throw new Error('Unrecognized viewer stats buffer');
+    }
+    this.statsFields = this.header[H_STATS_FIELDS];
+    this.frameFields = this.header[H_FRAME_FIELDS];
+    this.capacity = this.header[H_FRAME_CAPACITY];
+    if (this.statsFields !== STATS_FIELDS.length) {
+      throw new Error('Viewer stats buffer does not match this reader');
+    }
+    this.stats = new Float64Array(buffer, HEADER_BYTES, this.statsFields);
+    this.frames = new Float64Array(
+      buffer,
+      HEADER_BYTES + this.statsFields * 8,
+      this.capacity * this.frameFields,
+    );
+    // Start from the records already written
+    this.nextFrame = this.header[H_FRAME_HEAD];
+  }
+
+  /** A Float64Array of STATS_FIELDS.length entries, for readStats(). */
+  createStatsArray(): Float64Array {
+    return new Float64Array(this.statsFields);
+  }
+
+  /**
+   * Copy the latest snapshot into |out| (index it with StatsIndex).
+   * Returns false if there is none yet, none newer than the last one read,
+   * or the writer kept it busy.
+   */
+  readStats(out: Float64Array): boolean {
+    for (let attempt = 0; attempt < MAX_SEQLOCK_RETRIES; attempt++) {
+      const before = this.header[H_STATS_SEQ];
+      if (before === 0 || before === this.lastSeq) return false;
+      if (before & 1) continue;
+      out.set(this.stats);
+      if (this.header[H_STATS_SEQ] === before) {
+        this.lastSeq = before;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Call |visit| with each frame record written since the last call, oldest
+   * first; |record| is reused between calls (index it with FrameIndex).
+   * Records overwritten before they were read are skipped.  Returns the
+   * number visited.
+   */
+  readFrames(record: Float64Array, visit: (record: Float64Array) => void): number {
+    const head = this.header[H_FRAME_HEAD];
+    let n = this.nextFrame;
+    let backlog = (head - n) >>> 0;
+    if (backlog > this.capacity) {
+      n = (head - this.capacity) >>> 0;
+      backlog = this.capacity;
+    }
+
+    let visited = 0;
+    for (; backlog > 0; backlog--, n = (n + 1) >>> 0) {
+      const base = (n % this.capacity) * this.frameFields;
+      const expected = n + 1;
+      if (this.frames[base + FrameIndex.Seq] !== expected) continue;
+      for (let i = 0; i < this.frameFields; i++) record[i] = this.frames[base + i];
+      if (this.frames[base + FrameIndex.Seq] !== expected) continue;
+      visit(record);
+      visited++;
+    }
+    this.nextFrame = head;
+    return visited;
+  }
+
+  /** A Float64Array sized for one frame record, for readFrames(). */
+  createFrameRecord(): Float64Array {
+    return new Float64Array(this.frameFields);
+  }
+}
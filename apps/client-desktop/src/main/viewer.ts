@@ -34,6 +34,16 @@ export interface StreamStats {
   gamingMode: string;
 }
 
+/** Time each phase of viewer start took, in milliseconds. */
+export interface StartTiming {
+  rendererMs: number;
+  decoderMs: number;
+  audioMs: number;
+  transportMs: number;
+  inputMs: number;
+  totalMs: number;
+}
+
 export interface IceCandidate {
   type: 'host' | 'srflx' | 'relay';
   ip: string;
@@ -44,7 +54,7 @@ export interface IceCandidate {
 }
 
 export interface ViewerModule {
-  start(config: ViewerConfig): void;
+  start(config: ViewerConfig): Promise<StartTiming>;
   stop(): void;
   getStats(): StreamStats;
   onDisconnect(callback: () => void): void;
@@ -54,6 +64,8 @@ export interface ViewerModule {
   addRemoteCandidate(candidate: IceCandidate): void;
   connectP2P(config: { dtlsFingerprint: string }): Promise<{ connectionType: string }>;
   disconnectP2P(): void;
+  /** Stats and per-frame timings, read with StatsRingReader (native only). */
+  statsBuffer?(): ArrayBuffer;
 }
 
 // ---------------------------------------------------------------------------
@@ -124,10 +136,11 @@ function createMockViewer(): ViewerModule {
   let disconnectCallback: (() => void) | null = null;
 
   return {
-    start(config: ViewerConfig): void {
+    async start(config: ViewerConfig): Promise<StartTiming> {
       running = true;
       currentGamingMode = config.gamingMode;
       currentCodec = config.codec;
+      return { rendererMs: 0, decoderMs: 0, audioMs: 0, transportMs: 0, inputMs: 0, totalMs: 0 };
     },
 
     stop(): void {
@@ -0,0 +1,177 @@
+///////////////////////////////////////////////////////////////////////////////
+// crypto_bench.cpp -- Per-packet encryption: DTLS records and MediaCipher
+//
+// A client and server DtlsContext complete a real handshake over two UDP
+// sockets on loopback once per process; the benchmarks then drive records
+// between them in memory.  MediaCipher is keyed from that session's
+// exporter, as the host and viewer key it.
+//
+// Both receivers reject replays, so open/decrypt cannot be timed on one
+// packet over and over: the *RoundTrip benchmarks seal and open a fresh
+// packet per iteration, and the open cost is the difference to *Seal.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cs/common.h>
+#include <cs/transport/dtls_context.h>
+#include <cs/transport/media_cipher.h>
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// ---------------------------------------------------------------------------
+// Loopback session
+// ---------------------------------------------------------------------------
+
+struct Session {
+    std::unique_ptr<cs::DtlsContext> client;
+    std::unique_ptr<cs::DtlsContext> server;
+    cs::MediaCipher                  client_cipher;
+    cs::MediaCipher                  server_cipher;
+    int                              fds[2] = {-1, -1};
+    bool                             ok = false;
+
+    Session() {
+        cs::globalLogLevel() = cs::LogLevel::WARN;
+
+        sockaddr_in addrs[2] = {};
+        for (int i = 0; i < 2; ++i) {
+            fds[i] = static_cast<int>(::socket(AF_INET, SOCK_DGRAM, 0));
+            addrs[i].sin_family      = AF_INET;
+            addrs[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t len = sizeof(addrs[i]);
+            if (fds[i] < 0 ||
+                ::bind(fds[i], reinterpret_cast<sockaddr*>(&addrs[i]), sizeof(addrs[i])) != 0 ||
+                ::getsockname(fds[i], reinterpret_cast<sockaddr*>(&addrs[i]), &len) != 0) {
+                return;
+            }
+        }
+
+        server = std::make_unique<cs::DtlsContext>(true);
+        client = std::make_unique<cs::DtlsContext>(false);
+
+        bool server_ok = false;
+        std::thread accept([&] {
+            server_ok = server->handshake(fds[0], reinterpret_cast<sockaddr*>(&addrs[1]),
+                                          sizeof(addrs[1]));
+        });
+        bool client_ok = client->handshake(fds[1], reinterpret_cast<sockaddr*>(&addrs[0]),
+                                           sizeof(addrs[0]));
+        accept.join();
+        if (!server_ok || !client_ok) return;
+
+        uint8_t material[cs::MediaCipher::KEYING_MATERIAL_LEN];
+        ok = client->exportKeyingMaterial(cs::MediaCipher::EXPORTER_LABEL,
+                                          material, sizeof(material)) &&
+             client_cipher.initialize(material, sizeof(material), false) &&
+             server_cipher.initialize(material, sizeof(material), true);
+    }
+
+    ~Session() {
+        // The contexts send their shutdown alerts through the sockets
+        client.reset();
+        server.reset();
+        for (int fd : fds) {
+            if (fd >= 0) cs_close_socket(fd);
+        }
+    }
+};
+
+Session& session() {
+    static Session s;
+    return s;
+}
+
+// ---------------------------------------------------------------------------
+// DTLS records -- Arg(0) is the plaintext size
+// ---------------------------------------------------------------------------
+
+void BM_DtlsEncrypt(benchmark::State& state) {
+    Session& s = session();
+    if (!s.ok) {
+        state.SkipWithError("loopback DTLS handshake failed");
+        return;
+    }
+    const size_t len = static_cast<size_t>(state.range(0));
+    std::vector<uint8_t> plain(len, 0x42);
+    std::vector<uint8_t> record(len + 256);
+
+    for (auto _ : state) {
+        size_t out_len = 0;
+        benchmark::DoNotOptimize(s.client->encrypt(plain.data(), len, record.data(), &out_len));
+        benchmark::DoNotOptimize(out_len);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * len));
+}
+BENCHMARK(BM_DtlsEncrypt)->Arg(64)->Arg(1200);
+
+void BM_DtlsRoundTrip(benchmark::State& state) {
+    Session& s = session();
+    if (!s.ok) {
+        state.SkipWithError("loopback DTLS handshake failed");
+        return;
+    }
+    const size_t len = static_cast<size_t>(state.range(0));
+    std::vector<uint8_t> plain(len, 0x42);
+    std::vector<uint8_t> record(len + 256);
+    std::vector<uint8_t> opened(len + 256);
+
+    for (auto _ : state) {
+        size_t record_len = 0;
+        size_t opened_len = 0;
+        s.client->encrypt(plain.data(), len, record.data(), &record_len);
+        benchmark::DoNotOptimize(
+            s.server->decrypt(record.data(), record_len, opened.data(), &opened_len));
+        benchmark::DoNotOptimize(opened_len);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * len));
+}
+BENCHMARK(BM_DtlsRoundTrip)->Arg(64)->Arg(1200);
+
+// ---------------------------------------------------------------------------
+// MediaCipher -- the per-datagram AEAD on the media path
+// ---------------------------------------------------------------------------
+
+void BM_MediaSeal(benchmark::State& state) {
+    Session& s = session();
+    if (!s.ok) {
+        state.SkipWithError("loopback DTLS handshake failed");
+        return;
+    }
+    const size_t len = static_cast<size_t>(state.range(0));
+    std::vector<uint8_t> buf(len + cs::MediaCipher::OVERHEAD);
+
+    for (auto _ : state) {
+        std::memset(buf.data() + cs::MediaCipher::HEADER_LEN, 0x42, len);
+        benchmark::DoNotOptimize(s.client_cipher.seal(buf.data(), len));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * len));
+}
+BENCHMARK(BM_MediaSeal)->Arg(64)->Arg(1200)->Arg(8192);
+
+void BM_MediaRoundTrip(benchmark::State& state) {
+    Session& s = session();
+    if (!s.ok) {
+        state.SkipWithError("loopback DTLS handshake failed");
+        return;
+    }
+    const size_t len = static_cast<size_t>(state.range(0));
+    std::vector<uint8_t> buf(len + cs::MediaCipher::OVERHEAD);
+
+    for (auto _ : state) {
+        std::memset(buf.data() + cs::MediaCipher::HEADER_LEN, 0x42, len);
+        size_t sealed = s.client_cipher.seal(buf.data(), len);
+        size_t plain_len = 0;
+        benchmark::DoNotOptimize(s.server_cipher.open(buf.data(), sealed, &plain_len));
+        benchmark::DoNotOptimize(plain_len);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * len));
+}
+BENCHMARK(BM_MediaRoundTrip)->Arg(64)->Arg(1200)->Arg(8192);
+
+} // namespace
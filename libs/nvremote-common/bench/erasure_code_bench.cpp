@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+// erasure_code_bench.cpp -- Cauchy Reed-Solomon kernels
+//
+// Raw ErasureCode encode / decode for k data shards of MTU-sized symbols
+// with m = ceil(k / 5) parity (the host's default 20% redundancy), and the
+// GF(2^8) region kernel they are built on.  Decode loses as many data
+// shards as there is parity -- the most expensive case it has to handle.
+// Bytes processed are data bytes, so results read as FEC throughput.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cs/transport/erasure_code.h>
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+namespace {
+
+constexpr size_t SYMBOL_LEN = 1200;
+
+size_t parityFor(size_t k) {
+    return (k + 4) / 5;
+}
+
+struct Group {
+    std::vector<std::vector<uint8_t>> storage;   // k data shards, then m parity
+    std::vector<uint8_t*>             shards;
+    std::vector<size_t>               lengths;
+
+    Group(size_t k, size_t m) : storage(k + m, std::vector<uint8_t>(SYMBOL_LEN)),
+                                lengths(k, SYMBOL_LEN) {
+        uint32_t seed = 0x1234567u;
+        for (size_t i = 0; i < k; ++i) {
+            for (auto& b : storage[i]) {
+                seed = seed * 1664525u + 1013904223u;
+                b = static_cast<uint8_t>(seed >> 24);
+            }
+        }
+        for (auto& s : storage) shards.push_back(s.data());
+    }
+};
+
+void BM_ErasureEncode(benchmark::State& state) {
+    const size_t k = static_cast<size_t>(state.range(0));
+    const size_t m = parityFor(k);
+    Group g(k, m);
+
+    for (auto _ : state) {
+        bool ok = cs::ErasureCode::encode(g.shards.data(), g.lengths.data(), k,
+                                          g.shards.data() + k, m, SYMBOL_LEN);
+        benchmark::DoNotOptimize(ok);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * k * SYMBOL_LEN));
+    state.SetLabel(cs::ErasureCode::kernelName());
+}
+BENCHMARK(BM_ErasureEncode)->Arg(4)->Arg(10)->Arg(20)->Arg(50)->Arg(100);
+
+void BM_ErasureDecode(benchmark::State& state) {
+    const size_t k = static_cast<size_t>(state.range(0));
+    const size_t m = parityFor(k);
+    Group g(k, m);
+    cs::ErasureCode::encode(g.shards.data(), g.lengths.data(), k,
+                            g.shards.data() + k, m, SYMBOL_LEN);
+
+    // Lose the first m data shards
+    std::unique_ptr<bool[]> present(new bool[k + m]);
+    for (size_t i = 0; i < k + m; ++i) present[i] = i >= m;
+
+    for (auto _ : state) {
+        bool ok = cs::ErasureCode::decode(g.shards.data(), present.get(), k, m, SYMBOL_LEN);
+        benchmark::DoNotOptimize(ok);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * k * SYMBOL_LEN));
+    state.SetLabel(cs::ErasureCode::kernelName());
+}
+BENCHMARK(BM_ErasureDecode)->Arg(4)->Arg(10)->Arg(20)->Arg(50)->Arg(100);
+
+void BM_MulAddRegion(benchmark::State& state) {
+    const size_t len = static_cast<size_t>(state.range(0));
+    std::vector<uint8_t> src(len, 0x5A);
+    std::vector<uint8_t> dst(len, 0xA5);
+
+    for (auto _ : state) {
+        cs::ErasureCode::mulAddRegion(dst.data(), src.data(), 0x8E, len);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * len));
+    state.SetLabel(cs::ErasureCode::kernelName());
+}
+BENCHMARK(BM_MulAddRegion)->Arg(64)->Arg(1200)->Arg(9000);
+
+} // namespace
@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////
+// log_bench.cpp -- Cost of CS_LOG on the calling thread
+//
+// Three paths a media thread can take through the logger: a level that is
+// filtered out, a call site over its rate limit, and a message that is
+// formatted and queued for the logger thread.  Output goes nowhere (stderr
+// off, no file) so only the caller's side is timed; the queued case resets
+// its site's rate limit every iteration, and a ring the logger thread has
+// not yet drained drops the message, as it would in production.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cs/common.h>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+void quietLogger() {
+    cs::setLogToStderr(false);
+    cs::globalLogLevel() = cs::LogLevel::INFO;
+}
+
+void BM_LogFiltered(benchmark::State& state) {
+    quietLogger();
+    int frame = 0;
+    for (auto _ : state) {
+        CS_LOG(DEBUG, "frame %d: %u fragments, %zu bytes", frame, 12u, static_cast<size_t>(14000));
+        benchmark::DoNotOptimize(++frame);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogFiltered);
+
+void BM_LogRateLimited(benchmark::State& state) {
+    quietLogger();
+    int frame = 0;
+    for (auto _ : state) {
+        CS_LOG(INFO, "frame %d: %u fragments, %zu bytes", frame, 12u, static_cast<size_t>(14000));
+        benchmark::DoNotOptimize(++frame);
+    }
+    cs::flushLog();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogRateLimited);
+
+void BM_LogQueued(benchmark::State& state) {
+    quietLogger();
+    cs::LogSite site;
+    int frame = 0;
+    for (auto _ : state) {
+        site.count.store(0, std::memory_order_relaxed);
+        cs::logMessage(cs::LogLevel::INFO, __FILE__, __LINE__, site,
+                       "frame %d: %u fragments, %zu bytes", frame, 12u,
+                       static_cast<size_t>(14000));
+        benchmark::DoNotOptimize(++frame);
+    }
+    cs::flushLog();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogQueued);
+
+} // namespace
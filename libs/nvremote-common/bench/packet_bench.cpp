@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////////////////////////////////
+// packet_bench.cpp -- Wire header encode / decode and packet classification
+//
+// Every media datagram goes through one of these on each side, so they are
+// measured per header: video (both layouts), FEC and audio headers, and
+// identifyPacket() over a mix shaped like a video stream.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cs/transport/packet.h>
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+cs::VideoPacketHeaderV2 makeVideoHeader(uint8_t version) {
+    cs::VideoPacketHeaderV2 h{};
+    h.setVersion(version);
+    h.codec           = 1;
+    h.sequence_number = 4242;
+    h.timestamp_us    = 123456789;
+    h.frame_number    = 777;
+    h.fragment_index  = 3;
+    h.fragment_total  = 9;
+    h.payload_length  = 1180;
+    return h;
+}
+
+// ---------------------------------------------------------------------------
+// Video header -- Arg(0) is the header version (1 = 16-byte layout)
+// ---------------------------------------------------------------------------
+
+void BM_VideoHeaderSerialize(benchmark::State& state) {
+    cs::VideoPacketHeaderV2 h = makeVideoHeader(static_cast<uint8_t>(state.range(0)));
+    uint8_t out[sizeof(cs::VideoPacketHeaderV2)];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(h);
+        benchmark::DoNotOptimize(h.serializeTo(out));
+        benchmark::ClobberMemory();
+        ++h.sequence_number;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VideoHeaderSerialize)->Arg(1)->Arg(2)->Arg(3);
+
+void BM_VideoHeaderParse(benchmark::State& state) {
+    const cs::VideoPacketHeaderV2 h = makeVideoHeader(static_cast<uint8_t>(state.range(0)));
+    uint8_t wire[sizeof(cs::VideoPacketHeaderV2)];
+    h.serializeTo(wire);
+
+    cs::VideoPacketHeaderV2 out;
+    size_t header_len = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(wire);
+        benchmark::DoNotOptimize(cs::parseVideoHeader(wire, sizeof(wire), out, &header_len));
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VideoHeaderParse)->Arg(1)->Arg(2)->Arg(3);
+
+// ---------------------------------------------------------------------------
+// FEC / audio headers
+// ---------------------------------------------------------------------------
+
+void BM_FecHeaderRoundTrip(benchmark::State& state) {
+    cs::FecPacketHeader h{};
+    h.type          = static_cast<uint8_t>(cs::PacketType::FEC);
+    h.group_id      = 7;
+    h.data_count    = 10;
+    h.parity_count  = 2;
+    h.base_sequence = 1000;
+    h.symbol_length = 1200;
+
+    uint8_t wire[sizeof(cs::FecPacketHeader)];
+    cs::FecPacketHeader out;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(h);
+        h.serializeTo(wire);
+        benchmark::DoNotOptimize(cs::FecPacketHeader::deserialize(wire, sizeof(wire), out));
+        benchmark::DoNotOptimize(out);
+        ++h.sequence_number;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FecHeaderRoundTrip);
+
+void BM_AudioHeaderRoundTrip(benchmark::State& state) {
+    cs::AudioPacketHeader h{};
+    h.setVersion(1);
+    h.timestamp_us = 987654321;
+
+    uint8_t wire[sizeof(cs::AudioPacketHeader)];
+    cs::AudioPacketHeader out;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(h);
+        h.serializeTo(wire);
+        benchmark::DoNotOptimize(cs::AudioPacketHeader::deserialize(wire, sizeof(wire), out));
+        benchmark::DoNotOptimize(out);
+        ++h.sequence_number;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AudioHeaderRoundTrip);
+
+// ---------------------------------------------------------------------------
+// identifyPacket -- video-heavy mix with FEC, audio and control packets
+// ---------------------------------------------------------------------------
+
+void BM_IdentifyPacket(benchmark::State& state) {
+    std::vector<std::array<uint8_t, 64>> packets;
+    auto add = [&packets](const uint8_t* bytes, size_t len) {
+        std::array<uint8_t, 64> p{};
+        std::memcpy(p.data(), bytes, len);
+        packets.push_back(p);
+    };
+
+    uint8_t buf[64] = {};
+    const cs::VideoPacketHeaderV2 video = makeVideoHeader(3);
+    video.serializeTo(buf);
+    for (int i = 0; i < 12; ++i) add(buf, sizeof(buf));
+
+    cs::FecPacketHeader fec{};
+    fec.type = static_cast<uint8_t>(cs::PacketType::FEC);
+    fec.serializeTo(buf);
+    add(buf, sizeof(buf));
+    add(buf, sizeof(buf));
+
+    cs::AudioPacketHeader audio{};
+    audio.setVersion(1);
+    audio.setType(static_cast<uint8_t>(cs::PacketType::AUDIO));
+    audio.serializeTo(buf);
+    add(buf, sizeof(buf));
+
+    buf[0] = static_cast<uint8_t>(cs::PacketType::NACK);
+    add(buf, sizeof(buf));
+
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto& p = packets[i];
+        benchmark::DoNotOptimize(cs::identifyPacket(p.data(), p.size()));
+        i = (i + 1) % packets.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IdentifyPacket);
+
+} // namespace
@@ -0,0 +1,229 @@
+///////////////////////////////////////////////////////////////////////////////
+// buffer_pool.h -- Size-classed, refcounted byte buffers shared by the
+//                  host and viewer media paths
+//
+// Media components that hold packet bytes beyond the call that delivered
+// them (the pacer's copied lanes, FEC parity, sealed one-off datagrams)
+// take a PooledBuffer from BufferPool::shared() instead of owning a
+// std::vector.  Blocks come in a few size classes, each block starting on
+// a cache line, and go back to the pool when the last handle to them is
+// dropped -- on whichever thread that happens.
+//
+// Each thread keeps a small cache of free blocks per class, so acquiring
+// and releasing on one thread takes no lock; a cache that runs empty or
+// overflows trades a batch with the pool's central free list under its
+// mutex.  Blocks are only ever allocated from the system when a class has
+// none free, so once a session reaches its steady state (and after
+// reserve() at start, from its first packet) nothing is malloc'ed.  The
+// pool never returns memory to the system; stats() reports its high-water
+// mark so that footprint stays visible.
+//
+// Requests larger than the biggest class are served by a one-off
+// allocation that is freed on release, and counted.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace cs {
+
+class BufferPool;
+
+namespace detail {
+
+/// Header in front of every block's bytes (one cache line, so the bytes
+/// that follow are cache-line aligned too).
+struct alignas(64) PoolBlock {
+    std::atomic<uint32_t> refs{0};
+    uint8_t               size_class = 0;   // BufferPool::OVERSIZE_CLASS if unpooled
+    size_t                capacity   = 0;
+    PoolBlock*            next       = nullptr;   // Free-list link
+
+    uint8_t* bytes() { return reinterpret_cast<uint8_t*>(this + 1); }
+};
+
+} // namespace detail
+
+// ---------------------------------------------------------------------------
+// PooledBuffer -- refcounted handle to one block
+// ---------------------------------------------------------------------------
+
+/// A handle to a pool block holding size() bytes.  Copies share the block
+/// (the count is atomic, so copies may live on other threads); the block
+/// returns to the pool when the last one goes.  A default-constructed
+/// handle is empty.
+class PooledBuffer {
+public:
+    PooledBuffer() = default;
+    ~PooledBuffer() { release(); }
+
+    PooledBuffer(const PooledBuffer& other) : block_(other.block_), size_(other.size_) {
+        if (block_) block_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    PooledBuffer& operator=(const PooledBuffer& other) {
+        if (this != &other) {
+            if (other.block_) other.block_->refs.fetch_add(1, std::memory_order_relaxed);
+            release();
+            block_ = other.block_;
+            size_  = other.size_;
+        }
+        return *this;
+    }
+    PooledBuffer(PooledBuffer&& other) noexcept : block_(other.block_), size_(other.size_) {
+        other.block_ = nullptr;
+        other.size_  = 0;
+    }
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept {
+        if (this != &other) {
+            release();
+            block_ = other.block_;
+            size_  = other.size_;
+            other.block_ = nullptr;
+            other.size_  = 0;
+        }
+        return *this;
+    }
+
+    explicit operator bool() const { return block_ != nullptr; }
+    bool     empty()    const { return size_ == 0; }
+
+    uint8_t* data()     const { return block_ ? block_->bytes() : nullptr; }
+    size_t   size()     const { return size_; }
+    size_t   capacity() const { return block_ ? block_->capacity : 0; }
+
+    /// Change size() within capacity().  Returns false (and leaves the
+    /// size alone) if |size| does not fit.
+    bool resize(size_t size) {
+        if (size > capacity()) return false;
+        size_ = size;
+        return true;
+    }
+
+    /// Handles sharing this block, this one included (0 if empty).
+    uint32_t useCount() const {
+        return block_ ? block_->refs.load(std::memory_order_relaxed) : 0;
+    }
+
+    /// Drop this handle's reference now.
+    void reset() { release(); }
+
+private:
+    friend class BufferPool;
+    PooledBuffer(detail::PoolBlock* block, size_t size) : block_(block), size_(size) {}
+
+    void release();
+
+    detail::PoolBlock* block_ = nullptr;
+    size_t             size_  = 0;
+};
+
+// ---------------------------------------------------------------------------
+// BufferPool
+// ---------------------------------------------------------------------------
+
+class BufferPool {
+public:
+    /// Block capacities: tiny control packets, one datagram, a jumbo
+    /// frame's fragment run, and up to keyframe-sized buffers.
+    static constexpr size_t CLASS_COUNT = 6;
+    static constexpr std::array<size_t, CLASS_COUNT> CLASS_SIZES = {
+        256, 2048, 16 * 1024, 128 * 1024, 1024 * 1024, 8 * 1024 * 1024,
+    };
+    static constexpr uint8_t OVERSIZE_CLASS = 0xFF;
+
+    /// Free blocks a thread keeps per class before handing half back.
+    static constexpr std::array<uint32_t, CLASS_COUNT> THREAD_CACHE_LIMITS = {
+        128, 64, 16, 4, 2, 1,
+    };
+
+    struct ClassStats {
+        size_t   block_size      = 0;
+        uint64_t blocks          = 0;   // Blocks allocated from the system (never freed)
+        uint64_t in_use          = 0;   // Blocks held by handles
+        uint64_t high_water      = 0;   // Most blocks in use at once
+    };
+
+    struct Stats {
+        std::array<ClassStats, CLASS_COUNT> classes{};
+        uint64_t reserved_bytes   = 0;   // Block bytes allocated from the system
+        uint64_t in_use_bytes     = 0;   // Block bytes held by handles
+        uint64_t high_water_bytes = 0;   // Sum of the classes' high-water marks
+        uint64_t system_allocs    = 0;   // Pooled blocks allocated, all time
+        uint64_t oversize_allocs  = 0;   // Requests above the largest class
+    };
+
+    /// The process-wide pool (never destroyed, so handles may outlive
+    /// static destruction order).
+    static BufferPool& shared();
+
+    /// A buffer of |size| bytes (contents undefined).  Empty only if the
+    /// system is out of memory.
+    PooledBuffer acquire(size_t size);
+
+    /// As acquire(), holding a copy of |data|.
+    PooledBuffer copyOf(const uint8_t* data, size_t size);
+
+    /// Make sure at least |count| blocks that fit |size| bytes exist, so a
+    /// component can warm the pool for its steady state up front.
+    void reserve(size_t size, size_t count);
+
+    Stats stats() const;
+
+    /// Class that serves |size| bytes, or OVERSIZE_CLASS.
+    static uint8_t classFor(size_t size);
+
+    // Non-copyable
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+private:
+    friend class PooledBuffer;
+    struct ThreadCache;
+
+    BufferPool() = default;
+
+    /// This thread's free-block cache, or null once it has been destroyed.
+    static ThreadCache* threadCache();
+
+    /// Take a block whose refs is already 0 back (any thread).
+    void recycle(detail::PoolBlock* block);
+
+    detail::PoolBlock* allocateBlock(uint8_t size_class);
+
+    /// Move up to |count| free blocks of |size_class| from the central
+    /// list into |cache|; returns how many moved.
+    uint32_t refill(ThreadCache& cache, uint8_t size_class, uint32_t count);
+
+    /// Pop one free block of |size_class| from the central list (or null).
+    detail::PoolBlock* takeCentral(uint8_t size_class);
+
+    /// Push a chain of |count| blocks onto the central list.
+    void giveBack(uint8_t size_class, detail::PoolBlock* head, detail::PoolBlock* tail,
+                  uint32_t count);
+
+    struct alignas(64) Central {
+        std::mutex            mutex;
+        detail::PoolBlock*    free   = nullptr;
+        uint64_t              free_count = 0;
+        std::atomic<uint64_t> blocks{0};
+        std::atomic<uint64_t> in_use{0};
+        std::atomic<uint64_t> high_water{0};
+    };
+
+    std::array<Central, CLASS_COUNT> central_;
+    std::atomic<uint64_t>            oversize_allocs_{0};
+};
+
+inline void PooledBuffer::release() {
+    if (block_ && block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        BufferPool::shared().recycle(block_);
+    }
+    block_ = nullptr;
+    size_  = 0;
+}
+
+} // namespace cs
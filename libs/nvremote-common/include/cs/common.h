@@ -3,13 +3,14 @@
 //
 // Provides:
 //   - Platform socket abstraction (Winsock2 on Windows, POSIX elsewhere)
-//   - Printf-based logging macro with timestamp and severity
+//   - Printf-based logging macro with timestamp and severity (cs/log.h)
 //   - High-resolution microsecond timestamp helper
 //   - Local network interface enumeration
 //   - RAII Winsock initializer
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
 #include <cstdarg>
@@ -19,6 +20,8 @@
 #include <vector>
 #include <mutex>
 
+#include "cs/log.h"
+
 // ---------------------------------------------------------------------------
 // Platform socket headers
 // ---------------------------------------------------------------------------
@@ -72,76 +75,6 @@
 
 namespace cs {
 
-// ---------------------------------------------------------------------------
-// Log levels
-// ---------------------------------------------------------------------------
-enum class LogLevel : int {
-    TRACE = 0,
-    DEBUG = 1,
-    INFO  = 2,
-    WARN  = 3,
-    ERR   = 4   // "ERROR" collides with Windows macros
-};
-
-/// Current global log level.  Messages below this level are suppressed.
-/// Defaults to INFO; callers may lower it for debugging.
-inline LogLevel& globalLogLevel() {
-    static LogLevel level = LogLevel::INFO;
-    return level;
-}
-
-inline const char* logLevelStr(LogLevel lv) {
-    switch (lv) {
-        case LogLevel::TRACE: return "TRACE";
-        case LogLevel::DEBUG: return "DEBUG";
-        case LogLevel::INFO:  return "INFO ";
-        case LogLevel::WARN:  return "WARN ";
-        case LogLevel::ERR:   return "ERROR";
-    }
-    return "?????";
-}
-
-/// Thread-safe printf-style log.  Called via CS_LOG macro below.
-inline void logMessage(LogLevel level, const char* file, int line,
-                       const char* fmt, ...) {
-    if (level < globalLogLevel()) return;
-
-    // Timestamp: seconds since epoch with microsecond fraction
-    auto now  = std::chrono::system_clock::now();
-    auto usec = std::chrono::duration_cast<std::chrono::microseconds>(
-                    now.time_since_epoch()).count();
-    long sec  = static_cast<long>(usec / 1'000'000);
-    long frac = static_cast<long>(usec % 1'000'000);
-
-    // Extract just the filename from path
-    const char* base = file;
-    for (const char* p = file; *p; ++p) {
-        if (*p == '/' || *p == '\\') base = p + 1;
-    }
-
-    // Serialize output so lines don't interleave
-    static std::mutex mtx;
-    std::lock_guard<std::mutex> lock(mtx);
-
-    std::fprintf(stderr, "[%ld.%06ld] [%s] %s:%d  ",
-                 sec, frac, logLevelStr(level), base, line);
-
-    va_list args;
-    va_start(args, fmt);
-    std::vfprintf(stderr, fmt, args);
-    va_end(args);
-
-    std::fputc('\n', stderr);
-    std::fflush(stderr);
-}
-
-// ---------------------------------------------------------------------------
-// CS_LOG macro
-// Usage: CS_LOG(INFO, "received %d bytes from %s", n, addr.c_str());
-// ---------------------------------------------------------------------------
-#define CS_LOG(level, fmt, ...) \
-    ::cs::logMessage(::cs::LogLevel::level, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-
 // ---------------------------------------------------------------------------
 // Error codes returned by library functions
 // ---------------------------------------------------------------------------
@@ -162,11 +95,22 @@ enum class ErrorCode : int {
 // ---------------------------------------------------------------------------
 // High-resolution microsecond timestamp (monotonic clock)
 // ---------------------------------------------------------------------------
+
+/// Added to every getTimestampUs() reading.  Zero except in offline replay
+/// (nvremote-viewer/tools/packet_replay), which moves it forward so the
+/// receive pipeline's timers follow a recording's clock at full speed.
+/// Only ever increased, so timestamps stay monotonic.
+inline std::atomic<uint64_t>& timestampOffsetUs() {
+    static std::atomic<uint64_t> offset{0};
+    return offset;
+}
+
 inline uint64_t getTimestampUs() {
     auto now = std::chrono::steady_clock::now();
     return static_cast<uint64_t>(
         std::chrono::duration_cast<std::chrono::microseconds>(
-            now.time_since_epoch()).count());
+            now.time_since_epoch()).count()) +
+        timestampOffsetUs().load(std::memory_order_relaxed);
 }
 
 // ---------------------------------------------------------------------------
@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+// latency_histogram.h -- Fixed-size latency histogram for pipeline stages
+//
+// Log-linear buckets: 1 us wide up to 16 us, then four per power of two,
+// so every bucket is within 25% of the values in it, out to ~16 s.  One
+// thread records; any thread may read the percentiles, which are only as
+// consistent as a snapshot taken while samples keep arriving.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace cs {
+
+class LatencyHistogram {
+    static constexpr size_t   LINEAR_BUCKETS = 16;     // 0 .. 15 us, one each
+    static constexpr uint32_t SUB_BUCKETS    = 4;      // Per power of two above
+    static constexpr uint32_t MAX_EXPONENT   = 24;     // 2^24 us: ~16.8 s
+
+public:
+    static constexpr size_t NUM_BUCKETS = LINEAR_BUCKETS + (MAX_EXPONENT - 4) * SUB_BUCKETS;
+
+    /// Bucket counts, to take percentiles over several histograms at once.
+    using Counts = std::array<uint64_t, NUM_BUCKETS>;
+
+    LatencyHistogram() { reset(); }
+
+    // Non-copyable
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    /// Count one sample of |us| microseconds.
+    void record(uint64_t us) {
+        buckets_[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Forget every sample.
+    void reset() {
+        for (auto& b : buckets_) b.store(0, std::memory_order_relaxed);
+    }
+
+    /// Add this histogram's counts to |counts|.
+    void addTo(Counts& counts) const {
+        for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+            counts[i] += buckets_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    /// The |p|-th percentile (0..1) in milliseconds, as the upper edge of
+    /// its bucket; 0 with no samples.
+    float percentileMs(float p) const {
+        Counts counts{};
+        addTo(counts);
+        return percentileMs(counts, p);
+    }
+
+    /// The |p|-th percentile of |counts|, as percentileMs(p).
+    static float percentileMs(const Counts& counts, float p) {
+        uint64_t total = 0;
+        for (uint64_t c : counts) total += c;
+        if (total == 0) return 0.0f;
+
+        const uint64_t rank = static_cast<uint64_t>(p * static_cast<float>(total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen >= rank) return static_cast<float>(upperEdge(i)) / 1000.0f;
+        }
+        return static_cast<float>(upperEdge(NUM_BUCKETS - 1)) / 1000.0f;
+    }
+
+private:
+    static size_t bucketOf(uint64_t us) {
+        if (us < LINEAR_BUCKETS) return static_cast<size_t>(us);
+        uint32_t exponent = 63;
+        while (!(us >> exponent)) --exponent;
+        if (exponent >= MAX_EXPONENT) return NUM_BUCKETS - 1;
+        const uint32_t sub = static_cast<uint32_t>(us >> (exponent - 2)) & (SUB_BUCKETS - 1);
+        return LINEAR_BUCKETS + (exponent - 4) * SUB_BUCKETS + sub;
+    }
+
+    static uint64_t upperEdge(size_t bucket) {
+        if (bucket < LINEAR_BUCKETS) return bucket + 1;
+        const uint32_t exponent = static_cast<uint32_t>((bucket - LINEAR_BUCKETS) / SUB_BUCKETS) + 4;
+        const uint64_t sub      = (bucket - LINEAR_BUCKETS) % SUB_BUCKETS;
+        return (1ull << exponent) + (sub + 1) * (1ull << (exponent - 2));
+    }
+
+    std::array<std::atomic<uint32_t>, NUM_BUCKETS> buckets_;
+};
+
+} // namespace cs
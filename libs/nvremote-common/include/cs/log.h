@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+// log.h -- Asynchronous logging behind CS_LOG
+//
+// A log call never takes a lock or touches a file on the calling thread:
+// the message is formatted into a slot of that thread's own ring and a
+// background thread adds the timestamp prefix, merges the rings in call
+// order and writes them out -- to stderr, and optionally to a file that is
+// rotated when it grows too large.  A full ring drops the message (and
+// says so later) rather than stall a streaming thread.
+//
+// Each CS_LOG call site is rate limited: past LOG_SITE_BURST messages in a
+// second the rest are counted, and the count is appended to the next one
+// that goes out.  TRACE calls are compiled out of release builds; define
+// CS_LOG_COMPILED_LEVEL to choose another floor.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Lowest level compiled in (0 = TRACE ... 4 = ERR)
+#ifndef CS_LOG_COMPILED_LEVEL
+  #ifdef NDEBUG
+    #define CS_LOG_COMPILED_LEVEL 1
+  #else
+    #define CS_LOG_COMPILED_LEVEL 0
+  #endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define CS_LOG_PRINTF(fmt_idx, arg_idx) __attribute__((format(printf, fmt_idx, arg_idx)))
+#else
+  #define CS_LOG_PRINTF(fmt_idx, arg_idx)
+#endif
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// Log levels
+// ---------------------------------------------------------------------------
+enum class LogLevel : int {
+    TRACE = 0,
+    DEBUG = 1,
+    INFO  = 2,
+    WARN  = 3,
+    ERR   = 4   // "ERROR" collides with Windows macros
+};
+
+/// Current global log level.  Messages below this level are suppressed.
+/// Defaults to INFO; callers may lower it for debugging.
+inline LogLevel& globalLogLevel() {
+    static LogLevel level = LogLevel::INFO;
+    return level;
+}
+
+inline const char* logLevelStr(LogLevel lv) {
+    switch (lv) {
+        case LogLevel::TRACE: return "TRACE";
+        case LogLevel::DEBUG: return "DEBUG";
+        case LogLevel::INFO:  return "INFO ";
+        case LogLevel::WARN:  return "WARN ";
+        case LogLevel::ERR:   return "ERROR";
+    }
+    return "?????";
+}
+
+// ---------------------------------------------------------------------------
+// Per-call-site rate limit
+// ---------------------------------------------------------------------------
+struct LogSite {
+    std::atomic<uint64_t> window_us{0};    // Start of the current second
+    std::atomic<uint32_t> count{0};        // Messages in it
+    std::atomic<uint32_t> suppressed{0};   // Dropped since the last one out
+};
+
+constexpr uint32_t LOG_SITE_BURST     = 20;
+constexpr uint64_t LOG_SITE_WINDOW_US = 1'000'000;
+
+// ---------------------------------------------------------------------------
+// Logging
+// ---------------------------------------------------------------------------
+
+/// Queue one message from a CS_LOG call site.  Called via CS_LOG below.
+void logMessage(LogLevel level, const char* file, int line, LogSite& site,
+                const char* fmt, ...) CS_LOG_PRINTF(5, 6);
+
+/// Also write the log to |path|, starting a new file once it reaches
+/// |max_bytes| and keeping |max_files| old ones (path.1 is the newest).
+/// An empty path goes back to stderr only.  Returns false if the file
+/// cannot be opened.
+bool setLogFile(const std::string& path, uint64_t max_bytes = 16ull << 20,
+                uint32_t max_files = 4);
+
+/// Whether to write the log to stderr (default true).
+void setLogToStderr(bool enabled);
+
+/// Write out everything logged so far before returning.
+void flushLog();
+
+// ---------------------------------------------------------------------------
+// CS_LOG macro
+// Usage: CS_LOG(INFO, "received %d bytes from %s", n, addr.c_str());
+// Arguments are not evaluated for a suppressed level.
+// ---------------------------------------------------------------------------
+#define CS_LOG(level, fmt, ...)                                                         \
+    do {                                                                                \
+        if constexpr (static_cast<int>(::cs::LogLevel::level) >= CS_LOG_COMPILED_LEVEL) { \
+            if (::cs::LogLevel::level >= ::cs::globalLogLevel()) {                      \
+                static ::cs::LogSite cs_log_site_;                                      \
+                ::cs::logMessage(::cs::LogLevel::level, __FILE__, __LINE__,             \
+                                 cs_log_site_, fmt, ##__VA_ARGS__);                     \
+            }                                                                           \
+        }                                                                               \
+    } while (0)
+
+} // namespace cs
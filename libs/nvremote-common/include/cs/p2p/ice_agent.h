@@ -14,11 +14,22 @@
 // The probe protocol is deliberately simple: we send a 4-byte magic value
 // (0x43 0x53 0x49 0x43 -- "CSIC") to each remote candidate from each
 // local candidate, and wait for the same magic to come back.
+//
+// Checks follow RFC 8445's pacing: all pairs are checked in parallel,
+// highest priority first, one check every CHECK_PACING_MS, each pair
+// retransmitted on its own backoff; every socket is read in one select()
+// loop.  Nomination is aggressive: the first pair a probe arrives on wins,
+// and the winner is confirmed back to the peer.  With TURN configured the
+// relay is allocated alongside the direct checks, and its pairs join them
+// once it is ready, so a peer behind a symmetric NAT connects through it
+// without first waiting out the direct checks.  With a TurnPool the relay
+// is one the pool allocated ahead, and only needs its permissions.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include "cs/p2p/stun_client.h"
 #include "cs/p2p/turn_client.h"
+#include "cs/p2p/turn_pool.h"
 
 #include <cstdint>
 #include <memory>
@@ -27,6 +38,7 @@
 #include <functional>
 #include <mutex>
 #include <atomic>
+#include <chrono>
 #include <thread>
 #include <utility>
 
@@ -64,8 +76,21 @@ public:
     /// Phase 1: gather local candidates.
     /// Enumerates host interfaces and queries STUN servers for srflx addresses.
     /// Returns the full list of gathered local candidates (host + srflx).
+    /// Every interface asks all STUN servers at once and takes the first
+    /// answer; an interface whose mapping is cached (StunClient) is not
+    /// asked at all.
     std::vector<IceCandidate> gatherCandidates();
 
+    /// Register a callback fired with each local candidate as it is
+    /// gathered (trickle), so signaling can start before gathering ends.
+    /// Called on the gathering threads, one candidate at a time.
+    void setOnCandidate(std::function<void(const IceCandidate&)> cb);
+
+    /// Take the relay from \p pool when it has a spare on the first TURN
+    /// server, instead of allocating one.  The pool must outlive the
+    /// agent's checks; call before startConnectivityChecks().
+    void setTurnPool(TurnPool* pool) { turn_pool_ = pool; }
+
     /// Phase 2 (signaling): add a remote candidate received from the peer.
     void addRemoteCandidate(const IceCandidate& candidate);
 
@@ -96,6 +121,17 @@ public:
     /// Returns true if the connection is using a TURN relay.
     bool isRelayed() const;
 
+    /// How the last connectivity checks went.  Times are from
+    /// startConnectivityChecks(); -1 = did not happen.
+    struct ConnectStats {
+        std::string type;                // Winning pair: the remote's type ("host",
+                                         // "srflx", "prflx"), or "relay"
+        int32_t     connect_ms     = -1;
+        int32_t     relay_ready_ms = -1; // TURN allocated and permitted
+        uint32_t    checks_sent    = 0;
+    };
+    ConnectStats getConnectStats() const;
+
     /// Stop the agent: cancel any in-progress checks and close sockets.
     void stop();
 
@@ -103,13 +139,26 @@ private:
     /// Background thread entry point for connectivity checks.
     void connectivityCheckLoop();
 
+    /// Add a gathered local candidate on |sock| and trickle it.  Returns
+    /// false for a duplicate.  Caller holds gather_mutex_.
+    bool addLocalCandidate(const IceCandidate& candidate, int sock);
+
     /// Compute ICE priority for a candidate.
     static uint32_t computePriority(const std::string& type,
                                     uint16_t localPref,
                                     uint16_t component);
 
-    /// Attempt TURN relay allocation after P2P checks fail.
-    void attemptTurnFallback();
+    /// Allocate a TURN relay (unless it came from the pool) and permit the
+    /// remote candidates (turn_thread_), while the direct checks run.
+    void allocateRelay(std::vector<IceCandidate> remotes);
+
+    /// Select |local| / |remote| on |sock| (the relay's if |relayed|),
+    /// confirm it to the peer and notify the caller (check thread).
+    void nominate(const IceCandidate& local, const IceCandidate& remote, int sock,
+                  bool relayed);
+
+    /// RFC 8445 section 6.1.2.3 pair priority.
+    static uint64_t pairPriority(uint32_t local, uint32_t remote);
 
     // STUN server list (host:port pairs; port defaults to 3478)
     std::vector<std::string> stun_servers_;
@@ -118,12 +167,16 @@ private:
     // TURN server configuration for relay fallback
     std::vector<TurnConfig> turn_configs_;
     std::unique_ptr<TurnClient> turn_client_;
+    TurnPool*         turn_pool_ = nullptr;    // Spare allocations, or null
+    std::thread       turn_thread_;
+    std::atomic<bool> relay_ready_{false};     // turn_client_ allocated and permitted
     std::atomic<bool> relayed_{false};
 
     // Gathered local candidates and their associated sockets.
     // local_sockets_[i] is the UDP socket bound for local_candidates_[i].
     std::vector<IceCandidate> local_candidates_;
     std::vector<int>          local_sockets_;
+    std::mutex                gather_mutex_;       // The two, while STUN queries run
 
     // Remote candidates supplied via addRemoteCandidate().
     mutable std::mutex         remote_mutex_;
@@ -136,6 +189,7 @@ private:
     int                   selected_socket_ = -1;
 
     // Callbacks
+    std::function<void(const IceCandidate&)> on_candidate_;
     std::function<void(const IceCandidate&, const IceCandidate&)> on_connected_;
     std::function<void()> on_failed_;
 
@@ -144,6 +198,20 @@ private:
     std::atomic<bool> running_{false};
     std::atomic<bool> connected_{false};
 
+    // Check timing (stats_ under result_mutex_)
+    std::chrono::steady_clock::time_point check_start_;
+    ConnectStats     stats_;
+
+    // Check schedule.  The pacing is RFC 8445's Ta at its 5 ms floor; with
+    // a handful of pairs that gets every pair its first check in a few ms.
+    // Relay pairs wait RELAY_HOLDOFF_MS so a direct pair that works wins.
+    static constexpr uint32_t CHECK_TIMEOUT_MS  = 5000;
+    static constexpr uint32_t CHECK_PACING_MS   = 5;
+    static constexpr uint32_t CHECK_RTO_MS      = 100;      // First retransmit
+    static constexpr uint32_t CHECK_RTO_MAX_MS  = 400;      // Backoff cap
+    static constexpr uint32_t RELAY_HOLDOFF_MS  = 300;
+    static constexpr int      NOMINATE_REPEATS  = 3;        // Probes back to the peer
+
     // 4-byte magic for probe packets: "CSIC"
     static constexpr uint8_t PROBE_MAGIC[4] = {0x43, 0x53, 0x49, 0x43};
 };
@@ -8,11 +8,17 @@
 // Thread-safe: multiple threads may call discoverPublicEndpoint() on
 // different StunClient instances (or even the same one, since the method
 // is effectively stateless -- it only touches the provided socket).
+//
+// discoverFirst() asks several servers at once and takes the first answer.
+// Discovered mappings are cached per local interface for CACHE_TTL_MS: a
+// socket bound again to the same interface and port within that time is
+// still behind the same NAT mapping, and needs no query.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace cs {
 
@@ -23,6 +29,13 @@ struct StunResult {
     bool        success     = false;
 };
 
+/// A STUN server with its address resolved.
+struct StunServer {
+    std::string name;           // As configured, for logs
+    std::string ip;             // IPv4, numeric
+    uint16_t    port = 3478;
+};
+
 class StunClient {
 public:
     StunClient()  = default;
@@ -40,6 +53,32 @@ public:
                                       uint16_t stun_port,
                                       int local_socket) const;
 
+    /// Resolve "host" or "host:port" entries (|default_port| if none), all
+    /// at once.  Servers that do not resolve are left out.
+    static std::vector<StunServer> resolveServers(const std::vector<std::string>& servers,
+                                                  uint16_t default_port);
+
+    /// Send a Binding Request to every server in \p servers from
+    /// \p local_socket together, and return the first answer.  Each server
+    /// is retransmitted on its own backoff from RETRANSMIT_MS and given up
+    /// after SERVER_TIMEOUT_MS; the call fails once all are.
+    StunResult discoverFirst(const std::vector<StunServer>& servers,
+                             int local_socket) const;
+
+    /// The mapping last discovered from interface \p local_ip, if younger
+    /// than CACHE_TTL_MS: the local port it was for in \p local_port, the
+    /// public endpoint in \p result.
+    static bool getCachedMapping(const std::string& local_ip, uint16_t& local_port,
+                                 StunResult& result);
+
+    /// Remember the mapping of \p local_ip : \p local_port.
+    static void cacheMapping(const std::string& local_ip, uint16_t local_port,
+                             const StunResult& result);
+
+    static constexpr int      RETRANSMIT_MS     = 250;    // Doubling per retransmit
+    static constexpr int      SERVER_TIMEOUT_MS = 1500;
+    static constexpr uint32_t CACHE_TTL_MS      = 30000;  // Well inside NAT UDP timeouts
+
 private:
     /// Build a 20-byte STUN Binding Request.
     /// Layout (RFC 5389 section 6):
@@ -8,9 +8,18 @@
 // Lifecycle:
 //   1. Create TurnClient with server address and credentials
 //   2. Call allocate() to obtain a relay address
-//   3. Call createPermission() for each peer address
+//   3. Call createPermission() for each peer address, and bindChannel()
+//      for each peer endpoint data goes to
 //   4. Use the relay socket for sending/receiving relayed data
 //   5. Call refresh(0) or destroy to deallocate
+//
+// Allocations can also be made ahead and kept refreshed in a TurnPool
+// (turn_pool.h), so a session's relay is ready without an Allocate.
+//
+// Data to a peer with a channel travels as ChannelData (RFC 5766 section
+// 11): a 4-byte header instead of a Send indication's 36 bytes of STUN
+// header and attributes, and received without STUN parsing.  Without one
+// it falls back to Send / Data indications.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
@@ -18,6 +27,9 @@
 #include <string>
 #include <functional>
 #include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
 
 namespace cs {
 
@@ -70,10 +82,23 @@ public:
     /// Must be called after a successful allocate().
     bool createPermission(const std::string& peer_ip);
 
-    /// Refresh the allocation lifetime. Pass 0 to deallocate.
+    /// Permit every address in \p peer_ips with one CreatePermission
+    /// request: one round trip however many there are.  All or none are
+    /// permitted.
+    bool createPermissions(const std::vector<std::string>& peer_ips);
+
+    /// Bind a channel to \p peer_ip : \p peer_port (ChannelBind, which
+    /// also permits the peer), so data to and from it goes as ChannelData.
+    /// Rebinding a bound peer refreshes its binding.
+    bool bindChannel(const std::string& peer_ip, uint16_t peer_port);
+
+    /// Refresh the allocation lifetime. Pass 0 to deallocate.  A refresh
+    /// also rebinds channels older than CHANNEL_REFRESH_S, so a caller
+    /// refreshing on the allocation's schedule keeps them alive too.
     bool refresh(uint32_t lifetime = 600);
 
-    /// Send data through the relay to a permitted peer.
+    /// Send data through the relay to a permitted peer: as ChannelData if
+    /// the peer has a channel, else in a Send indication.
     bool sendData(const uint8_t* data, size_t len,
                   const std::string& peer_ip, uint16_t peer_port);
 
@@ -81,6 +106,15 @@ public:
     void setOnData(std::function<void(const uint8_t*, size_t,
                                        const std::string&, uint16_t)> cb);
 
+    /// Take the payload out of a datagram read from the relay socket: if
+    /// |data| is ChannelData on a bound channel or a Data indication, point
+    /// |payload| / |payload_len| into it and return the peer it came from.
+    /// False for anything else.  ChannelData is recognized by its first
+    /// byte, before any STUN parsing.
+    bool unwrapData(const uint8_t* data, size_t len,
+                    const uint8_t*& payload, size_t& payload_len,
+                    std::string& peer_ip, uint16_t& peer_port) const;
+
     /// Get the relay socket fd (for select/poll integration).
     int getSocket() const { return allocation_.socket_fd; }
 
@@ -91,6 +125,9 @@ public:
     /// Check if allocation is active.
     bool isAllocated() const { return allocated_.load(); }
 
+    /// The server and credentials this client allocates with.
+    const TurnConfig& getConfig() const { return config_; }
+
     /// Deallocate and clean up.
     void close();
 
@@ -98,14 +135,41 @@ private:
     TurnConfig config_;
     TurnAllocation allocation_;
     std::atomic<bool> allocated_{false};
+    std::string nonce_;        // From the Allocate's 401 challenge, sent with later requests
     std::function<void(const uint8_t*, size_t,
                         const std::string&, uint16_t)> on_data_;
 
+    // Server address, resolved once by allocate() (IPv4, network order)
+    uint32_t server_addr_ = 0;
+    uint16_t server_port_ = 0;
+
+    // Channel bindings.  Numbers are handed out from CHANNEL_FIRST up, so
+    // a number's index is number - CHANNEL_FIRST.
+    struct Channel {
+        std::string peer_ip;
+        uint16_t    peer_port = 0;
+        std::chrono::steady_clock::time_point bound;
+    };
+    mutable std::mutex   channels_mutex_;
+    std::vector<Channel> channels_;
+    static constexpr uint16_t CHANNEL_FIRST     = 0x4000;
+    static constexpr uint16_t CHANNEL_LAST      = 0x7FFF;
+    static constexpr uint32_t CHANNEL_REFRESH_S = 300;   // Bindings last 600 s
+
+    /// Send a ChannelBind for \p number.
+    bool sendChannelBind(uint16_t number, const std::string& peer_ip, uint16_t peer_port);
+
     // Internal: build and send TURN messages
     int createSocket();
     bool sendAllocateRequest(int sock, const std::string& nonce = "");
     bool parseAllocateResponse(const uint8_t* data, size_t len);
-    bool sendCreatePermission(const std::string& peer_ip);
+    bool sendCreatePermission(const std::vector<std::string>& peer_ips);
+
+    /// Send an authenticated \p type request with \p attrs to the server
+    /// and wait for the answer into \p resp (again with the new nonce if
+    /// the server says the old one went stale).  False on no answer.
+    bool transact(uint16_t type, const std::vector<uint8_t>& attrs,
+                  uint8_t* resp, size_t resp_size, int& resp_len);
 };
 
 } // namespace cs
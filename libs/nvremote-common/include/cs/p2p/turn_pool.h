@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+// turn_pool.h -- TURN allocations made ahead, kept refreshed
+//
+// An Allocate costs two round trips to the TURN server (the unauthenticated
+// request and its 401 challenge, then the authenticated one) before the
+// relay can even be permitted for the peer -- a few hundred ms that a
+// session behind a symmetric NAT spends waiting for its only path.  The
+// pool keeps SPARE_ALLOCATIONS allocated on a background thread and
+// refreshes each one every REFRESH_INTERVAL_S, well inside its lifetime, so
+// a session's IceAgent takes one that is live and authenticated, and its
+// relay is ready after the one CreatePermission round trip.  A spare whose
+// refresh fails (expired credentials, a restarted server) is dropped and a
+// new one allocated in its place.
+//
+// A spare keeps the credentials it was allocated with: a session's own
+// TURN credentials only pick the server.  Credentials handed to start()
+// again are used for the allocations made from then on.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "cs/p2p/turn_client.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cs {
+
+class TurnPool {
+public:
+    TurnPool() = default;
+    ~TurnPool();
+
+    // Non-copyable
+    TurnPool(const TurnPool&) = delete;
+    TurnPool& operator=(const TurnPool&) = delete;
+
+    /// Keep spares allocated on \p config's server, with its credentials,
+    /// starting the background thread if it is not running.  Spares on
+    /// another server are released.
+    void start(const TurnConfig& config);
+
+    /// Stop the background thread and release the spares.
+    void stop();
+
+    /// A spare allocated on \p config's server and port, or nullptr if none
+    /// is ready; the pool allocates another in its place.  Thread-safe.
+    std::unique_ptr<TurnClient> acquire(const TurnConfig& config);
+
+private:
+    struct Spare {
+        std::unique_ptr<TurnClient>           client;
+        std::chrono::steady_clock::time_point refreshed;
+    };
+
+    void maintainLoop();
+
+    static bool sameServer(const TurnConfig& a, const TurnConfig& b) {
+        return a.server == b.server && a.port == b.port;
+    }
+
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    TurnConfig              config_;
+    std::vector<Spare>      spares_;
+    std::thread             thread_;
+    bool                    stop_ = false;
+
+    static constexpr size_t   SPARE_ALLOCATIONS  = 2;
+    static constexpr uint32_t LIFETIME_S         = 600;   // Asked for on every refresh
+    // A refresh a minute hands a session a spare with at least nine of its
+    // ten minutes left.
+    static constexpr uint32_t REFRESH_INTERVAL_S = 60;
+    static constexpr uint32_t RETRY_S            = 10;    // After a failed Allocate
+};
+
+} // namespace cs
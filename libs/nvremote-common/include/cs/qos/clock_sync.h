@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+// clock_sync.h -- NTP-style clock offset and drift estimation
+//
+// Each side's cs::getTimestampUs() is a local steady clock with its own
+// epoch and rate.  An RTT probe exchange gives the four NTP timestamps:
+// the probe leaves here at t1, reaches the peer at t2 (its clock), is
+// answered after hold_us and the answer arrives here at t4.  Then
+//
+//   rtt    = t4 - t1 - hold_us
+//   offset = t2 - t1 - rtt / 2        (peer clock minus ours)
+//
+// which is exact when both directions take equally long, and off by at
+// most rtt / 2 otherwise.  Queuing only ever adds delay, so as NTP's clock
+// filter does, only the exchanges whose round trip is within RTT_SLACK of
+// the shortest in the window are trusted.  A straight line fitted through
+// those over time gives the drift between the clocks as well, so the
+// offset is extrapolated between exchanges instead of stepping.
+//
+// Timestamps are the low 32 bits the wire carries; offsets are modulo
+// 2^32 and apply to 32-bit timestamps.  Thread-safe.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace cs {
+
+class ClockSync {
+public:
+    ClockSync() = default;
+
+    // Non-copyable
+    ClockSync(const ClockSync&) = delete;
+    ClockSync& operator=(const ClockSync&) = delete;
+
+    /// Take one exchange (see above); |t4| is |now_us|'s low 32 bits.
+    /// Returns false if it was discarded as inconsistent.
+    bool addExchange(uint32_t t1, uint32_t t2, uint32_t hold_us, uint64_t now_us);
+
+    /// True once an offset has been estimated.
+    bool hasEstimate() const;
+
+    /// Peer clock minus ours at |now_us|, modulo 2^32: a local timestamp
+    /// plus this is the same instant on the peer's clock.
+    uint32_t offsetUs(uint64_t now_us) const;
+
+    /// Bound on the offset's error: half the shortest trusted round trip.
+    uint32_t errorUs() const;
+
+    /// Peer clock rate relative to ours, in parts per million.
+    double driftPpm() const;
+
+    /// Forget every exchange (the peer restarted, or a new session).
+    void reset();
+
+private:
+    struct Sample {
+        uint64_t at_us     = 0;   // Our clock, midway through the exchange
+        int32_t  offset_us = 0;   // Relative to ref_
+        uint32_t rtt_us    = 0;
+    };
+
+    /// Refit the model to the trusted samples (mutex_ held).
+    void refit();
+
+    mutable std::mutex mutex_;
+
+    static constexpr size_t WINDOW_SAMPLES = 256;  // ~50 s of 200 ms exchanges
+    std::array<Sample, WINDOW_SAMPLES> samples_{};
+    size_t   count_ = 0;
+    size_t   next_  = 0;
+
+    // Offsets are kept relative to the first, so they stay small despite
+    // the unrelated 32-bit clocks.
+    bool     have_ref_ = false;
+    uint32_t ref_      = 0;
+
+    // offset(t) = model_offset_us_ + drift_ * (t - model_at_us_), over ref_
+    bool     have_model_      = false;
+    uint64_t model_at_us_     = 0;
+    double   model_offset_us_ = 0.0;
+    double   drift_           = 0.0;
+    uint32_t error_us_        = 0;
+
+    static constexpr uint32_t RTT_SLACK_US       = 1'000;       // Over the shortest round trip
+    static constexpr uint64_t MIN_DRIFT_SPAN_US  = 5'000'000;   // Trusted samples apart before fitting
+    static constexpr size_t   MIN_DRIFT_SAMPLES  = 4;
+    static constexpr double   MAX_DRIFT          = 500e-6;      // Beyond any crystal: a bad fit
+    static constexpr uint32_t MAX_RTT_US         = 2'000'000;
+};
+
+} // namespace cs
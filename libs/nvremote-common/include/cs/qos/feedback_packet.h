@@ -3,6 +3,18 @@
 //
 // Provides serialize/deserialize for the QoS feedback sent from client to host
 // every ~200ms. The host QoS controller uses this to adapt encode parameters.
+//
+// A report may also echo the host's most recent RttProbePacket: the probe's
+// send timestamp and how long the viewer held it before replying.  The host
+// subtracts both from its clock to get one round-trip sample per report.
+//
+// With the echo goes the viewer's clock when the probe arrived, the third
+// NTP timestamp: the host estimates the offset between the two clocks from
+// it (cs/qos/clock_sync.h) and sends the estimate back in its probes.
+//
+// It also carries the newest long-term reference frame the viewer decoded,
+// repeated in every report, so the host knows which LTR is safe to
+// recover from.
 ////////////////////////////////////////////////////////////////////////////////
 
 #pragma once
@@ -22,6 +34,25 @@ static constexpr size_t QOS_FEEDBACK_BASE_NACKS = 2;
 // Extended NACK packet can carry more (sent separately if needed)
 static constexpr size_t QOS_FEEDBACK_EXT_MAX_NACKS = 64;
 
+// QosFeedbackPacket::flags: an RTT echo follows the base packet
+static constexpr uint8_t QOS_FLAG_ECHO = 0x01;
+
+// QosFeedbackPacket::flags: an LTR acknowledgement follows the RTT echo
+static constexpr uint8_t QOS_FLAG_LTR_ACK = 0x02;
+
+// QosFeedbackPacket::flags: the viewer's probe arrival time ends the report
+// (after any extended NACKs, where hosts that predate it do not look)
+static constexpr uint8_t QOS_FLAG_CLOCK = 0x04;
+
+// RTT echo: echo_timestamp_us (u32) + echo_hold_us (u32), network order
+static constexpr size_t QOS_FEEDBACK_ECHO_LEN = 8;
+
+// LTR acknowledgement: ltr_ack_frame (u32), network order
+static constexpr size_t QOS_FEEDBACK_LTR_ACK_LEN = 4;
+
+// Probe arrival: echo_recv_us (u32), network order
+static constexpr size_t QOS_FEEDBACK_CLOCK_LEN = 4;
+
 struct QosFeedback {
     uint16_t last_seq_received    = 0;
     uint32_t estimated_bw_kbps   = 0;
@@ -30,19 +61,45 @@ struct QosFeedback {
     int32_t  delay_gradient_us   = 0;     // signed — positive = increasing delay
     std::vector<uint16_t> nack_seqs;      // Sequence numbers to retransmit
 
+    // RTT echo of the last RttProbePacket (valid if has_echo)
+    bool     has_echo            = false;
+    uint32_t echo_timestamp_us   = 0;     // Probe send_time_us, host clock
+    uint32_t echo_hold_us        = 0;     // Time the viewer held the probe
+
+    // When the echoed probe arrived (valid if has_clock; needs has_echo)
+    bool     has_clock           = false;
+    uint32_t echo_recv_us        = 0;     // Viewer clock, low 32 bits
+
+    // Newest long-term reference frame decoded (valid if has_ltr_ack)
+    bool     has_ltr_ack         = false;
+    uint32_t ltr_ack_frame       = 0;     // Video header frame number
+
     // Current client-side stats for display
     uint32_t decode_time_us      = 0;
     uint32_t render_time_us      = 0;
     uint32_t frames_decoded      = 0;
     uint32_t frames_dropped      = 0;
 
+    /// Largest report serializeTo() writes.
+    static constexpr size_t MAX_WIRE_SIZE =
+        sizeof(QosFeedbackPacket) + QOS_FEEDBACK_ECHO_LEN + QOS_FEEDBACK_LTR_ACK_LEN +
+        (QOS_FEEDBACK_EXT_MAX_NACKS - QOS_FEEDBACK_BASE_NACKS) * sizeof(uint16_t) +
+        QOS_FEEDBACK_CLOCK_LEN;
+
     // ------------------------------------------------------------------
-    // Serialize to wire format (20 bytes base + optional extended NACKs)
+    // Serialize to wire format (22 bytes base + optional RTT echo +
+    // optional LTR acknowledgement + optional extended NACKs + optional
+    // probe arrival time), in place into |out|.  Returns the number of
+    // bytes written, or 0 if |out| is too small (MAX_WIRE_SIZE always
+    // suffices).
     // ------------------------------------------------------------------
-    std::vector<uint8_t> serialize() const {
+    size_t serializeTo(ByteSpan out) const {
         QosFeedbackPacket pkt{};
         pkt.type                  = static_cast<uint8_t>(PacketType::QOS_FEEDBACK);
-        pkt.flags                 = 0;
+        const bool with_clock     = has_echo && has_clock;
+        pkt.flags                 = static_cast<uint8_t>((has_echo ? QOS_FLAG_ECHO : 0) |
+                                                         (has_ltr_ack ? QOS_FLAG_LTR_ACK : 0) |
+                                                         (with_clock ? QOS_FLAG_CLOCK : 0));
         pkt.last_seq_received     = last_seq_received;
         pkt.estimated_bw_kbps    = estimated_bw_kbps;
         pkt.packet_loss_x100     = packet_loss_x100;
@@ -57,21 +114,51 @@ struct QosFeedback {
         if (nack_seqs.size() > 0) pkt.nack_seq_0 = nack_seqs[0];
         if (nack_seqs.size() > 1) pkt.nack_seq_1 = nack_seqs[1];
 
+        const size_t extra = nack_n > QOS_FEEDBACK_BASE_NACKS
+                                 ? nack_n - QOS_FEEDBACK_BASE_NACKS : 0;
+        const size_t total = sizeof(QosFeedbackPacket) +
+                             (has_echo ? QOS_FEEDBACK_ECHO_LEN : 0) +
+                             (has_ltr_ack ? QOS_FEEDBACK_LTR_ACK_LEN : 0) +
+                             extra * sizeof(uint16_t) +
+                             (with_clock ? QOS_FEEDBACK_CLOCK_LEN : 0);
+        if (out.size() < total) return 0;
+
         // Base packet
-        std::vector<uint8_t> buf(sizeof(QosFeedbackPacket));
-        std::memcpy(buf.data(), &pkt, sizeof(pkt));
+        uint8_t* p = out.data();
+        p += encodeHeader(pkt, out);
+
+        auto put32 = [&p](uint32_t v) {
+            v = wire::networkOrder(v);
+            std::memcpy(p, &v, 4);
+            p += 4;
+        };
+
+        // RTT echo
+        if (has_echo) {
+            put32(echo_timestamp_us);
+            put32(echo_hold_us);
+        }
+
+        // LTR acknowledgement
+        if (has_ltr_ack) put32(ltr_ack_frame);
 
         // Extended NACKs (if more than 2)
-        if (nack_n > QOS_FEEDBACK_BASE_NACKS) {
-            size_t extra = nack_n - QOS_FEEDBACK_BASE_NACKS;
-            size_t ext_size = extra * sizeof(uint16_t);
-            buf.resize(sizeof(QosFeedbackPacket) + ext_size);
-            for (size_t i = 0; i < extra; ++i) {
-                uint16_t seq = nack_seqs[i + QOS_FEEDBACK_BASE_NACKS];
-                std::memcpy(buf.data() + sizeof(QosFeedbackPacket) + i * 2, &seq, 2);
-            }
+        for (size_t i = 0; i < extra; ++i) {
+            uint16_t seq = wire::networkOrder(nack_seqs[i + QOS_FEEDBACK_BASE_NACKS]);
+            std::memcpy(p, &seq, 2);
+            p += 2;
         }
 
+        // Probe arrival time
+        if (with_clock) put32(echo_recv_us);
+
+        return total;
+    }
+
+    /// serializeTo() into a new buffer.
+    std::vector<uint8_t> serialize() const {
+        std::vector<uint8_t> buf(MAX_WIRE_SIZE);
+        buf.resize(serializeTo(buf));
         return buf;
     }
 
@@ -84,7 +171,7 @@ struct QosFeedback {
         if (len < sizeof(QosFeedbackPacket)) return fb;
 
         QosFeedbackPacket pkt{};
-        std::memcpy(&pkt, data, sizeof(pkt));
+        if (!QosFeedbackPacket::deserialize(data, len, pkt)) return fb;
 
         fb.last_seq_received  = pkt.last_seq_received;
         fb.estimated_bw_kbps = pkt.estimated_bw_kbps;
@@ -92,20 +179,51 @@ struct QosFeedback {
         fb.avg_jitter_us     = pkt.avg_jitter_us;
         fb.delay_gradient_us = pkt.delay_gradient_us;
 
+        // Probe arrival time, at the very end
+        if ((pkt.flags & QOS_FLAG_CLOCK) && (pkt.flags & QOS_FLAG_ECHO) &&
+            len >= sizeof(QosFeedbackPacket) + QOS_FEEDBACK_ECHO_LEN + QOS_FEEDBACK_CLOCK_LEN) {
+            uint32_t recv = 0;
+            len -= QOS_FEEDBACK_CLOCK_LEN;
+            std::memcpy(&recv, data + len, 4);
+            fb.has_clock    = true;
+            fb.echo_recv_us = ntohl(recv);
+        }
+
+        // RTT echo
+        size_t ext_off = sizeof(QosFeedbackPacket);
+        if ((pkt.flags & QOS_FLAG_ECHO) && len >= ext_off + QOS_FEEDBACK_ECHO_LEN) {
+            uint32_t ts = 0, hold = 0;
+            std::memcpy(&ts, data + ext_off, 4);
+            std::memcpy(&hold, data + ext_off + 4, 4);
+            fb.has_echo          = true;
+            fb.echo_timestamp_us = ntohl(ts);
+            fb.echo_hold_us      = ntohl(hold);
+            ext_off += QOS_FEEDBACK_ECHO_LEN;
+        }
+
+        // LTR acknowledgement
+        if ((pkt.flags & QOS_FLAG_LTR_ACK) && len >= ext_off + QOS_FEEDBACK_LTR_ACK_LEN) {
+            uint32_t frame = 0;
+            std::memcpy(&frame, data + ext_off, 4);
+            fb.has_ltr_ack   = true;
+            fb.ltr_ack_frame = ntohl(frame);
+            ext_off += QOS_FEEDBACK_LTR_ACK_LEN;
+        }
+
         // Base NACKs
         if (pkt.nack_count > 0) fb.nack_seqs.push_back(pkt.nack_seq_0);
         if (pkt.nack_count > 1) fb.nack_seqs.push_back(pkt.nack_seq_1);
 
         // Extended NACKs
-        if (pkt.nack_count > QOS_FEEDBACK_BASE_NACKS) {
+        if (pkt.nack_count > QOS_FEEDBACK_BASE_NACKS && len > ext_off) {
             size_t extra = std::min(
                 static_cast<size_t>(pkt.nack_count - QOS_FEEDBACK_BASE_NACKS),
-                (len - sizeof(QosFeedbackPacket)) / sizeof(uint16_t)
+                (len - ext_off) / sizeof(uint16_t)
             );
             for (size_t i = 0; i < extra; ++i) {
                 uint16_t seq = 0;
-                std::memcpy(&seq, data + sizeof(QosFeedbackPacket) + i * 2, 2);
-                fb.nack_seqs.push_back(seq);
+                std::memcpy(&seq, data + ext_off + i * 2, 2);
+                fb.nack_seqs.push_back(ntohs(seq));
             }
         }
 
@@ -127,6 +245,17 @@ struct QosFeedback {
         return static_cast<float>(delay_gradient_us) / 1000.0f;
     }
 
+    /// Round-trip time for the echoed probe given the host's clock now
+    /// (low 32 bits, same base as RttProbePacket::send_time_us).  Returns 0
+    /// if there is no echo or the sample is implausible (> 10 s).
+    uint32_t rttFromEcho(uint32_t now_us) const {
+        if (!has_echo) return 0;
+        uint32_t elapsed = now_us - echo_timestamp_us;   // Wraps correctly
+        if (elapsed <= echo_hold_us) return 0;
+        uint32_t rtt = elapsed - echo_hold_us;
+        return rtt < 10'000'000 ? rtt : 0;
+    }
+
     // ------------------------------------------------------------------
     // Human-readable summary for logging / debugging
     // ------------------------------------------------------------------
@@ -115,6 +115,7 @@ inline GamingMode gamingModeFromString(const std::string& name) {
 //   - Bitrate range
 //   - Jitter buffer depth
 //   - FEC overhead budget
+//   - Send pacing rate and burst allowance
 //   - Priority weights for the adaptive algorithm
 // ---------------------------------------------------------------------------
 // Preferred codec hint for the QoS engine
@@ -173,12 +174,31 @@ struct QosPreset {
     // How aggressively to recover when conditions improve
     float recovery_speed;        // 0.0 = slow (conservative), 1.0 = fast (aggressive)
 
+    // Send pacing: the host drains each frame at bitrate x pacing_factor
+    // through a token bucket holding pacing_burst_ms worth of bytes.
+    // A factor of 0 disables pacing (packets go out back-to-back).
+    float    pacing_factor   = 2.0f;
+    uint32_t pacing_burst_ms = 5;
+
+    // Largest UDP datagram (wire bytes) the host probes for after the DTLS
+    // handshake.  1472 fills a standard Ethernet frame; larger values need
+    // jumbo frames end-to-end and fall back to what the path carries.
+    uint32_t max_datagram_bytes = 1472;
+
+    // Opus frame duration: 2500, 5000, 10000 or 20000 us.  Shorter frames
+    // take audio latency down at a higher packet rate.
+    uint32_t audio_frame_us = 10000;
+
     // Codec preference
     PreferredCodec preferred_codec = PreferredCodec::Auto;
 
     // Chroma subsampling
     ChromaMode chroma = ChromaMode::YUV420;
 
+    // Coded bit depth (8 or 10).  Ten bits keep smooth gradients from
+    // banding; the host uses them where it cannot code 4:4:4.
+    uint32_t bit_depth = 8;
+
     // VPN-aware QoS adjustments (applied automatically when VPN detected)
     bool vpn_mode = false;
 };
@@ -227,6 +247,9 @@ inline QosPreset getPreset(GamingMode mode, Resolution native_res = Resolutions:
         p.jitter_buffer_ms = 1;         // Near-zero buffer
         p.max_fec_ratio    = 0.15f;     // Low FEC — save bandwidth for frames
         p.min_fec_ratio    = 0.02f;
+        p.pacing_factor    = 2.5f;      // Drain a frame well inside its 4ms slot
+        p.pacing_burst_ms  = 2;
+        p.audio_frame_us   = 2500;      // 400 packets/s -- audio as prompt as the video
 
         // Prioritize FPS and latency over visual quality
         p.fps_weight     = 0.9f;
@@ -277,6 +300,8 @@ inline QosPreset getPreset(GamingMode mode, Resolution native_res = Resolutions:
         p.jitter_buffer_ms = 8;         // Smooth playback
         p.max_fec_ratio    = 0.25f;     // Higher FEC — protect quality
         p.min_fec_ratio    = 0.05f;
+        p.pacing_factor    = 1.5f;      // Large frames; smoothness over burst speed
+        p.pacing_burst_ms  = 8;
 
         // Prioritize quality over FPS
         p.fps_weight     = 0.2f;
@@ -322,6 +347,8 @@ inline QosPreset getPreset(GamingMode mode, Resolution native_res = Resolutions:
         p.jitter_buffer_ms = 4;
         p.max_fec_ratio    = 0.20f;
         p.min_fec_ratio    = 0.03f;
+        p.pacing_factor    = 2.0f;
+        p.pacing_burst_ms  = 5;
 
         // Equal-ish weights
         p.fps_weight     = 0.6f;
@@ -368,6 +395,8 @@ inline QosPreset getPreset(GamingMode mode, Resolution native_res = Resolutions:
         p.jitter_buffer_ms = 8;
         p.max_fec_ratio    = 0.20f;
         p.min_fec_ratio    = 0.05f;
+        p.pacing_factor    = 1.5f;
+        p.pacing_burst_ms  = 8;
 
         // Heavily prioritize quality
         p.fps_weight     = 0.2f;
@@ -377,6 +406,7 @@ inline QosPreset getPreset(GamingMode mode, Resolution native_res = Resolutions:
         p.recovery_speed     = 0.3f;    // Very conservative recovery
         p.preferred_codec    = PreferredCodec::HEVC;
         p.chroma             = ChromaMode::YUV444;
+        p.bit_depth          = 10;
         break;
 
     // -----------------------------------------------------------------
@@ -415,6 +445,8 @@ inline QosPreset getPreset(GamingMode mode, Resolution native_res = Resolutions:
         p.jitter_buffer_ms = 10;         // Can tolerate more buffering
         p.max_fec_ratio    = 0.25f;
         p.min_fec_ratio    = 0.05f;
+        p.pacing_factor    = 1.5f;
+        p.pacing_burst_ms  = 8;
 
         // Heavily prioritize quality and resolution sharpness
         p.fps_weight     = 0.1f;
@@ -456,6 +488,8 @@ inline QosPreset getPreset(GamingMode mode, Resolution native_res = Resolutions:
         p.jitter_buffer_ms = 8;
         p.max_fec_ratio    = 0.30f;     // Higher FEC — cellular has more loss
         p.min_fec_ratio    = 0.10f;
+        p.pacing_factor    = 1.25f;     // Shallow LTE/Wi-Fi buffers -- keep bursts small
+        p.pacing_burst_ms  = 3;
 
         // Balanced — save bandwidth wherever possible
         p.fps_weight     = 0.5f;
@@ -506,6 +540,9 @@ inline QosPreset getPreset(GamingMode mode, Resolution native_res = Resolutions:
         p.jitter_buffer_ms = 1;         // Near-zero
         p.max_fec_ratio    = 0.05f;     // Minimal FEC — LAN is reliable
         p.min_fec_ratio    = 0.01f;
+        p.pacing_factor    = 0.0f;      // Pacing off -- switched LAN absorbs bursts
+        p.pacing_burst_ms  = 0;
+        p.max_datagram_bytes = 8972;    // Jumbo frames when the LAN has them
 
         // Everything maxed
         p.fps_weight     = 0.8f;
@@ -520,6 +557,30 @@ inline QosPreset getPreset(GamingMode mode, Resolution native_res = Resolutions:
     return p;
 }
 
+// ---------------------------------------------------------------------------
+// Reference resolution ladder
+//
+// A preset's resolution_ladder names standard 16:9 sizes whatever the
+// desktop is.  The ladder a session walks starts at the size it codes,
+// |top|, and steps down through the preset's sizes below that, to its
+// min_resolution, by height: each step keeps |top|'s aspect ratio, with
+// the width rounded to even so 4:2:0 chroma stays whole.  The host scales
+// frames to a step as it converts them, so a change completes within one
+// frame.
+// ---------------------------------------------------------------------------
+inline std::vector<Resolution> resolutionLadder(const QosPreset& preset, Resolution top) {
+    std::vector<Resolution> ladder = {top};
+    if (top.width == 0 || top.height == 0) return ladder;
+
+    for (const Resolution& step : preset.resolution_ladder) {
+        if (step.height >= ladder.back().height) continue;
+        if (step.height < preset.min_resolution.height) break;
+        const uint64_t width = static_cast<uint64_t>(step.height) * top.width / top.height;
+        ladder.push_back({static_cast<uint32_t>(width + 1) & ~1u, step.height});
+    }
+    return ladder;
+}
+
 // ---------------------------------------------------------------------------
 // QoS adaptation decision
 //
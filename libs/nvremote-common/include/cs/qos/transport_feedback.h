@@ -0,0 +1,228 @@
+////////////////////////////////////////////////////////////////////////////////
+// NVRemote — Transport-wide Congestion Control Feedback (TWCC-style)
+//
+// Every sealed media datagram (video, FEC and audio alike) carries a 64-bit
+// AEAD packet counter; its low 16 bits are the transport-wide sequence
+// number.  The viewer records when each one arrives and reports the arrival
+// times back in compact TransportFeedback messages (~every 50 ms), so the
+// host's BandwidthEstimator can pair them with its own send times and
+// measure the real delivery rate and delay trend.
+//
+// Wire layout (network byte order):
+//   [0]     type = 0xFA
+//   [1]     feedback_seq        (increments per message; gaps = lost reports)
+//   [2-3]   base_seq            (first transport seq covered)
+//   [4-5]   status_count        (seqs base_seq .. base_seq + status_count - 1)
+//   [6-9]   reference_time      (receiver clock, TWCC_DELTA_TICK_US ticks)
+//   [10..]  status chunks       (2 bytes each, until status_count is covered)
+//   [..]    receive deltas      (1 byte per "small", 2 bytes per "large")
+//
+// Packet status symbols:
+//   0 = not received, 1 = received (delta 0..255 ticks, 1 byte),
+//   2 = received (signed 16-bit delta, 2 bytes; reordering or long gaps)
+//
+// Status chunks:
+//   0 S S R R R R R R R R R R R R R   run of 13-bit length R of symbol SS
+//   1 0 b b b b b b b b b b b b b b   14 one-bit symbols (0 / 1 only)
+//   1 1 s s s s s s s s s s s s s s   7 two-bit symbols
+//
+// Each delta is relative to the previous received packet's (quantized)
+// arrival time; the first is relative to reference_time.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "cs/transport/packet.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace cs {
+
+/// Arrival-time resolution of the receive deltas.
+static constexpr uint64_t TWCC_DELTA_TICK_US = 250;
+
+/// Most packets described by one message: keeps the worst case (all large
+/// deltas) under ~1200 bytes so a report never needs fragmenting.
+static constexpr size_t TWCC_MAX_PACKETS_PER_FEEDBACK = 500;
+
+/// Tracking state for one transport-wide sequence number.
+struct PacketArrival {
+    uint16_t seq        = 0;
+    bool     received   = false;
+    uint64_t arrival_us = 0;    // Receiver clock; meaningful only if received
+};
+
+struct TransportFeedback {
+    static constexpr size_t HEADER_LEN = 10;
+
+    uint8_t  feedback_seq = 0;
+    uint16_t base_seq     = 0;
+    std::vector<PacketArrival> packets;   // base_seq, base_seq + 1, ... in order
+
+    // ------------------------------------------------------------------
+    // Serialize to wire format
+    // ------------------------------------------------------------------
+    std::vector<uint8_t> serialize() const {
+        const size_t count = std::min(packets.size(), TWCC_MAX_PACKETS_PER_FEEDBACK);
+
+        // Quantize arrivals and pick a symbol for each packet.
+        std::vector<uint8_t> symbols(count, 0);
+        std::vector<int32_t> deltas;
+        deltas.reserve(count);
+
+        uint64_t reference = 0;
+        bool have_reference = false;
+        int64_t prev_ticks = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (!packets[i].received) continue;
+            int64_t ticks = static_cast<int64_t>(packets[i].arrival_us / TWCC_DELTA_TICK_US);
+            if (!have_reference) {
+                reference = static_cast<uint64_t>(ticks);
+                prev_ticks = ticks;
+                have_reference = true;
+            }
+            int64_t delta = std::clamp<int64_t>(ticks - prev_ticks, INT16_MIN, INT16_MAX);
+            symbols[i] = (delta >= 0 && delta <= 0xFF) ? 1 : 2;
+            deltas.push_back(static_cast<int32_t>(delta));
+            prev_ticks += delta;
+        }
+
+        std::vector<uint8_t> buf(HEADER_LEN);
+        buf[0] = static_cast<uint8_t>(PacketType::TRANSPORT_FEEDBACK);
+        buf[1] = feedback_seq;
+        putU16(buf.data() + 2, base_seq);
+        putU16(buf.data() + 4, static_cast<uint16_t>(count));
+        uint32_t ref32 = static_cast<uint32_t>(reference);
+        buf[6] = static_cast<uint8_t>(ref32 >> 24);
+        buf[7] = static_cast<uint8_t>(ref32 >> 16);
+        buf[8] = static_cast<uint8_t>(ref32 >> 8);
+        buf[9] = static_cast<uint8_t>(ref32);
+
+        // Status chunks: greedy run-length / vector choice.
+        size_t i = 0;
+        while (i < count) {
+            size_t run = 1;
+            while (i + run < count && symbols[i + run] == symbols[i] && run < 0x1FFF) ++run;
+
+            uint16_t chunk;
+            if (run >= 7) {
+                chunk = static_cast<uint16_t>((symbols[i] << 13) | run);
+                i += run;
+            } else {
+                size_t n1 = std::min<size_t>(14, count - i);
+                bool one_bit = true;
+                for (size_t j = 0; j < n1; ++j) one_bit &= symbols[i + j] <= 1;
+                if (one_bit) {
+                    chunk = 0x8000;
+                    for (size_t j = 0; j < n1; ++j) {
+                        chunk |= static_cast<uint16_t>(symbols[i + j] << (13 - j));
+                    }
+                    i += n1;
+                } else {
+                    size_t n2 = std::min<size_t>(7, count - i);
+                    chunk = 0xC000;
+                    for (size_t j = 0; j < n2; ++j) {
+                        chunk |= static_cast<uint16_t>(symbols[i + j] << (12 - 2 * j));
+                    }
+                    i += n2;
+                }
+            }
+            size_t at = buf.size();
+            buf.resize(at + 2);
+            putU16(buf.data() + at, chunk);
+        }
+
+        // Receive deltas, in packet order.
+        size_t d = 0;
+        for (size_t k = 0; k < count; ++k) {
+            if (symbols[k] == 1) {
+                buf.push_back(static_cast<uint8_t>(deltas[d++]));
+            } else if (symbols[k] == 2) {
+                size_t at = buf.size();
+                buf.resize(at + 2);
+                putU16(buf.data() + at, static_cast<uint16_t>(static_cast<int16_t>(deltas[d++])));
+            }
+        }
+
+        return buf;
+    }
+
+    // ------------------------------------------------------------------
+    // Deserialize from wire format.  Arrival times are rebuilt on the
+    // receiver's clock (reference_time ticks + accumulated deltas).
+    // ------------------------------------------------------------------
+    static bool deserialize(const uint8_t* data, size_t len, TransportFeedback& out) {
+        if (len < HEADER_LEN ||
+            data[0] != static_cast<uint8_t>(PacketType::TRANSPORT_FEEDBACK)) {
+            return false;
+        }
+
+        out.feedback_seq = data[1];
+        out.base_seq     = getU16(data + 2);
+        const size_t count = getU16(data + 4);
+        const uint32_t ref32 = (static_cast<uint32_t>(data[6]) << 24) |
+                               (static_cast<uint32_t>(data[7]) << 16) |
+                               (static_cast<uint32_t>(data[8]) << 8)  |
+                                static_cast<uint32_t>(data[9]);
+
+        // Expand status chunks into one symbol per packet.
+        std::vector<uint8_t> symbols;
+        symbols.reserve(count);
+        size_t pos = HEADER_LEN;
+        while (symbols.size() < count) {
+            if (pos + 2 > len) return false;
+            uint16_t chunk = getU16(data + pos);
+            pos += 2;
+
+            if ((chunk & 0x8000) == 0) {
+                uint8_t sym = static_cast<uint8_t>((chunk >> 13) & 0x03);
+                size_t run = std::min<size_t>(chunk & 0x1FFF, count - symbols.size());
+                symbols.insert(symbols.end(), run, sym);
+            } else if ((chunk & 0x4000) == 0) {
+                for (int j = 0; j < 14 && symbols.size() < count; ++j) {
+                    symbols.push_back(static_cast<uint8_t>((chunk >> (13 - j)) & 0x01));
+                }
+            } else {
+                for (int j = 0; j < 7 && symbols.size() < count; ++j) {
+                    symbols.push_back(static_cast<uint8_t>((chunk >> (12 - 2 * j)) & 0x03));
+                }
+            }
+        }
+
+        // Walk the deltas.
+        out.packets.clear();
+        out.packets.reserve(count);
+        int64_t ticks = ref32;
+        for (size_t i = 0; i < count; ++i) {
+            PacketArrival pa;
+            pa.seq = static_cast<uint16_t>(out.base_seq + i);
+            if (symbols[i] == 1) {
+                if (pos + 1 > len) return false;
+                ticks += data[pos++];
+                pa.received = true;
+            } else if (symbols[i] == 2) {
+                if (pos + 2 > len) return false;
+                ticks += static_cast<int16_t>(getU16(data + pos));
+                pos += 2;
+                pa.received = true;
+            }
+            if (pa.received) {
+                pa.arrival_us = static_cast<uint64_t>(ticks) * TWCC_DELTA_TICK_US;
+            }
+            out.packets.push_back(pa);
+        }
+        return true;
+    }
+
+private:
+    static void putU16(uint8_t* p, uint16_t v) {
+        p[0] = static_cast<uint8_t>(v >> 8);
+        p[1] = static_cast<uint8_t>(v);
+    }
+    static uint16_t getU16(const uint8_t* p) {
+        return static_cast<uint16_t>((p[0] << 8) | p[1]);
+    }
+};
+
+} // namespace cs
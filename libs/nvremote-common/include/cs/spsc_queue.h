@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////////
+// spsc_queue.h -- Bounded single-producer / single-consumer slot queue
+//
+// Connects the stages of a pipeline: on the host capture, encode and send,
+// on the viewer the receive and audio threads.  The N slots are
+// allocated once, with the queue; the producer fills a slot in place and
+// publishes it, the consumer works on it in place and hands it back, so
+// nothing is allocated or copied per item.  Pushing and popping are a
+// pair of atomic counters, one written by each side, on their own cache
+// lines.
+//
+// A consumer with nothing to do may block in waitForData().  The producer
+// only touches the mutex when a consumer is actually asleep, so a stage
+// that keeps up never does.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace cs {
+
+template <typename T, size_t N>
+class SpscQueue {
+public:
+    static_assert(N > 0, "SpscQueue needs at least one slot");
+
+    SpscQueue() = default;
+
+    // Non-copyable
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    static constexpr size_t capacity() { return N; }
+
+    // -----------------------------------------------------------------------
+    // Producer
+    // -----------------------------------------------------------------------
+
+    /// The slot the next push publishes, or null while the queue is full.
+    /// It holds whatever it held when it was last popped.
+    T* beginPush() {
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= N) return nullptr;
+        return &slots_[tail % N];
+    }
+
+    /// Publish the slot from beginPush(), waking the consumer if it sleeps.
+    void commitPush() {
+        // Sequentially consistent with the consumer's waiting_ store, so
+        // either the consumer sees this slot or the load below sees it
+        // asleep.
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+        if (waiting_.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+            wait_cv_.notify_one();
+        }
+    }
+
+    // -----------------------------------------------------------------------
+    // Consumer
+    // -----------------------------------------------------------------------
+
+    /// The oldest published slot, or null while the queue is empty.
+    T* front() {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        if (tail_.load(std::memory_order_acquire) == head) return nullptr;
+        return &slots_[head % N];
+    }
+
+    /// Hand the slot from front() back to the producer.
+    void pop() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /// Slots published and not yet popped.  Exact on the consumer side;
+    /// from the producer, an upper bound.
+    size_t size() const {
+        return static_cast<size_t>(tail_.load(std::memory_order_acquire) -
+                                   head_.load(std::memory_order_acquire));
+    }
+
+    bool empty() const { return size() == 0; }
+
+    /// Wait up to |timeout| for a slot.  Returns false if there is none,
+    /// including after wake().
+    template <typename Rep, typename Period>
+    bool waitForData(std::chrono::duration<Rep, Period> timeout) {
+        if (!empty()) return true;
+
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        waiting_.store(true, std::memory_order_seq_cst);
+        wait_cv_.wait_for(lock, timeout, [this]() {
+            // Ordered after the waiting_ store (see commitPush())
+            return woken_ || tail_.load(std::memory_order_seq_cst) !=
+                             head_.load(std::memory_order_relaxed);
+        });
+        waiting_.store(false, std::memory_order_relaxed);
+        woken_ = false;
+        return !empty();
+    }
+
+    /// Release a consumer blocked in waitForData() (any thread).
+    void wake() {
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        woken_ = true;
+        wait_cv_.notify_one();
+    }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    alignas(CACHE_LINE) std::atomic<uint64_t> tail_{0};   // Written by the producer
+    alignas(CACHE_LINE) std::atomic<uint64_t> head_{0};   // Written by the consumer
+    alignas(CACHE_LINE) std::atomic<bool>     waiting_{false};
+
+    std::mutex              wait_mutex_;
+    std::condition_variable wait_cv_;
+    bool                    woken_ = false;
+
+    std::array<T, N>        slots_{};
+};
+
+} // namespace cs
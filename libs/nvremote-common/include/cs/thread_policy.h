@@ -0,0 +1,117 @@
+///////////////////////////////////////////////////////////////////////////////
+// thread_policy.h -- Scheduling priority and CPU affinity by thread role
+//
+// Every thread on the media path names its role when it starts
+// (ScopedThreadRole), and the role's policy, set process-wide from the
+// session's configuration, decides how it is scheduled: a priority, on
+// Windows optionally an MMCSS task class, and the CPUs it may run on.  A
+// deployment can so keep the media path off the cores a game's own
+// threads use, and raise it above them, without code changes.
+//
+// Priorities map to each platform's nearest equivalent:
+//   role priority  Windows                         Linux               macOS
+//   normal         (unchanged)                     (unchanged)         (unchanged)
+//   above_normal   THREAD_PRIORITY_ABOVE_NORMAL    nice -5             USER_INITIATED
+//   high           THREAD_PRIORITY_HIGHEST         nice -10            USER_INTERACTIVE
+//   realtime       THREAD_PRIORITY_TIME_CRITICAL   SCHED_FIFO          USER_INTERACTIVE
+// With MMCSS the thread joins its role's task class ("Pro Audio" for
+// audio, "Capture" for capture, "Playback" for decode and render, "Games"
+// for the rest) at the matching AVRT priority instead, falling back to
+// plain priority where the service refuses it.  Negative nice values and
+// SCHED_FIFO need CAP_SYS_NICE (or RLIMIT_NICE / RLIMIT_RTPRIO); without
+// it the thread keeps running as it was, which is logged once.  macOS has
+// no affinity: CPUs are ignored there.
+//
+// A spec is comma-separated entries, each replacing its role's default:
+//   <role>=<priority>[:mmcss][@<cpus>]
+// with <cpus> a '+'-joined list of CPU numbers and ranges below 64, e.g.
+//   receive=high@2,decode=high@3,render=realtime:mmcss@4-5,audio=realtime:mmcss
+// Roles: capture, encode, send (host), receive, decode, render (viewer),
+// audio, feedback (QoS feedback, NACK timers), input, network (ICE).
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// ThreadRole / ThreadPriority / ThreadPolicy
+// ---------------------------------------------------------------------------
+enum class ThreadRole : uint8_t {
+    CAPTURE,    // Host: capture (and the single-threaded pipeline)
+    ENCODE,     // Host: encode stage, encoder output
+    SEND,       // Host: send stage, pacer, send shards
+    RECEIVE,    // Viewer: socket receive
+    DECODE,     // Viewer: decode
+    RENDER,     // Viewer: render and present
+    AUDIO,      // Audio capture / playback
+    FEEDBACK,   // QoS feedback and NACK timers
+    INPUT,      // Viewer: input flush, controller polling
+    NETWORK,    // ICE connectivity checks
+    COUNT,
+};
+
+static constexpr size_t THREAD_ROLE_COUNT = static_cast<size_t>(ThreadRole::COUNT);
+
+enum class ThreadPriority : uint8_t {
+    NORMAL,
+    ABOVE_NORMAL,
+    HIGH,
+    REALTIME,
+};
+
+struct ThreadPolicy {
+    ThreadPriority priority = ThreadPriority::NORMAL;
+    bool           mmcss    = false;   // Windows: join the role's MMCSS task class
+    uint64_t       cpus     = 0;       // Bit n = CPU n (0 = any)
+};
+
+using ThreadPolicies = std::array<ThreadPolicy, THREAD_ROLE_COUNT>;
+
+/// The policies a session gets with no spec: the capture, encode and send
+/// stages and the viewer's receive, decode and render threads at high
+/// priority, audio realtime in MMCSS, feedback and input above normal, on
+/// any CPU.
+ThreadPolicies defaultThreadPolicies();
+
+/// Apply a spec (see above) to |policies|, each entry replacing its role's
+/// policy.  On failure returns false, leaves |policies| as it was and
+/// describes the first bad entry in |error| if given.
+bool parseThreadPolicies(const std::string& spec, ThreadPolicies& policies,
+                         std::string* error = nullptr);
+
+/// The role's name in a spec.
+const char* threadRoleName(ThreadRole role);
+
+/// Set the process-wide policies threads started from now on get (threads
+/// already running keep theirs).  Thread-safe.
+void setThreadPolicies(const ThreadPolicies& policies);
+
+/// The process-wide policy for |role|.  Thread-safe.
+ThreadPolicy getThreadPolicy(ThreadRole role);
+
+// ---------------------------------------------------------------------------
+// ScopedThreadRole -- schedule the calling thread as |role|, for its scope
+// ---------------------------------------------------------------------------
+class ScopedThreadRole {
+public:
+    /// Apply |role|'s policy to the calling thread; constructed at the top
+    /// of the thread's function.
+    explicit ScopedThreadRole(ThreadRole role);
+
+    /// Leave the MMCSS task class, if one was joined.
+    ~ScopedThreadRole();
+
+    // Non-copyable
+    ScopedThreadRole(const ScopedThreadRole&) = delete;
+    ScopedThreadRole& operator=(const ScopedThreadRole&) = delete;
+
+private:
+    void* mmcss_ = nullptr;   // AVRT handle (Windows)
+};
+
+} // namespace cs
@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+// trace.h -- Per-frame pipeline trace: lock-free per-thread event rings
+//
+// A flight recorder for finding the frame that stalled.  Every thread that
+// records gets its own fixed ring of compact events (stage, frame id, and
+// begin / end in CPU timestamp-counter ticks), written without locks or
+// allocation; the oldest events are overwritten.  Any thread may export the
+// rings as Chrome trace JSON (chrome://tracing, ui.perfetto.dev) while the
+// pipeline keeps running.
+//
+// A frame is identified at every stage, on host and viewer alike, by the
+// low 32 bits of its capture timestamp: the timestamp_us the wire carries.
+// A scope given no id takes the one of the scope it is nested in, so a
+// packet sent from within a frame's send is attributed to that frame.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  #include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#else
+  #include <chrono>
+#endif
+
+namespace cs::trace {
+
+// ---------------------------------------------------------------------------
+// Stages
+// ---------------------------------------------------------------------------
+enum class Stage : uint8_t {
+    // Host
+    CAPTURE        = 0,    // captureFrame()
+    CONVERT        = 1,    // Colour conversion of a GPU frame
+    ENCODE         = 2,    // Synchronous encode, submit to output
+    ENCODE_SUBMIT  = 3,    // Frame handed to an asynchronous encoder
+    ENCODE_OUTPUT  = 4,    // Waiting for and reading the bitstream
+    SEND           = 5,    // Fragmenting, protecting and queuing a frame
+    PACKET_SEND    = 6,    // One datagram out (id: the enclosing frame)
+    PACKET_BATCH   = 7,    // A batch of fragments cached and handed out
+
+    // Viewer
+    PACKET_RECV    = 16,   // One receive batch dispatched (id: datagrams)
+    FRAME_COMPLETE = 17,   // Last fragment in (instant)
+    FRAME_POP      = 18,   // Released by the jitter buffer (instant)
+    DECODE_SUBMIT  = 19,   // Handed to the decoder
+    DECODED        = 20,   // Picture out of the decoder (instant)
+    RENDER         = 21,   // Drawn and presented
+};
+
+/// Short name of |stage| for the exported trace.
+const char* stageName(Stage stage);
+
+// ---------------------------------------------------------------------------
+// Clock
+// ---------------------------------------------------------------------------
+
+/// Current timestamp-counter value.  On targets without one, steady-clock
+/// nanoseconds; either way converted to microseconds only on export.
+inline uint64_t ticks() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Recording
+// ---------------------------------------------------------------------------
+
+/// Turn recording on or off for every thread (on by default).
+void setEnabled(bool enabled);
+bool isEnabled();
+
+/// Label the calling thread's track in the trace.  Threads that never
+/// call this are shown by number.
+void setThreadName(const char* name);
+
+/// Record a span on the calling thread.  A zero |id| takes the id of the
+/// innermost open Scope.
+void record(Stage stage, uint32_t id, uint64_t begin, uint64_t end);
+
+/// Record a zero-length event.
+inline void instant(Stage stage, uint32_t id = 0) {
+    const uint64_t now = ticks();
+    record(stage, id, now, now);
+}
+
+/// Records its lifetime as a span.  Nested scopes without an id of their
+/// own inherit this one's.
+class Scope {
+public:
+    explicit Scope(Stage stage, uint32_t id = 0);
+    ~Scope();
+
+    // Non-copyable
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    /// Set the id once it is known (e.g. after the capture returns).
+    void setId(uint32_t id);
+
+private:
+    Stage    stage_;
+    uint32_t id_;
+    uint32_t outer_id_;
+    uint64_t begin_;
+};
+
+// ---------------------------------------------------------------------------
+// Export
+// ---------------------------------------------------------------------------
+
+/// Every event still in the rings, as a Chrome trace JSON object, on the
+/// cs::getTimestampUs() clock.  |process_name| and |pid| label this
+/// process, so host and viewer traces can be loaded side by side.
+/// |events| receives the number exported.
+std::string exportChromeJson(const char* process_name, uint32_t pid,
+                             size_t* events = nullptr);
+
+/// exportChromeJson() written to |path|.  Returns false if it cannot be.
+bool writeChromeTrace(const std::string& path, const char* process_name,
+                      uint32_t pid, size_t* events = nullptr);
+
+} // namespace cs::trace
@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////////////
+// clipboard_transfer.h -- Chunked clipboard transfer, shared by both sides
+//
+// A clipboard change is sent as one transfer of ClipboardChunkHeader
+// datagrams (cs/transport/packet.h) on the bulk lane, so a large paste
+// never arrives as one oversized burst beside the video:
+//
+//   - Dedup: the content hash of the last clipboard both sides hold is
+//     kept; a transfer of the same content is not started, and a receiver
+//     that already holds what a transfer carries acks all of it at once.
+//   - Compression: text of at least MIN_COMPRESS_BYTES is LZ4-compressed
+//     when that saves at least 1/16.
+//   - Window: at most WINDOW_CHUNKS chunks past the first unacked one are
+//     in flight; the receiver acks with a cumulative index and a mask of
+//     the chunks after it (ClipboardWindowAckPacket), and a chunk unacked
+//     for a retransmission timeout (from the acks' RTT) is sent again.
+//   - Rate: a token bucket caps the transfer at the rate set with
+//     setRateLimitKbps() -- on the host, the QoS headroom left beside the
+//     video.
+//
+// Both directions run at once; each side owns one ClipboardTransfer that
+// sends in its own direction and receives in the other.  send() and poll()
+// are called from the clipboard thread, onChunk() and onAck() from the
+// receive thread.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cs/transport/packet.h>
+#include <cs/transport/sequence.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cs {
+
+class ClipboardTransfer {
+public:
+    /// Callback to send a serialized chunk or ack over the transport.
+    using SendFunc = std::function<void(const std::vector<uint8_t>& data)>;
+
+    /// Sends transfers in direction |outgoing|, accepts the other one.
+    ClipboardTransfer(ClipboardDirection outgoing, SendFunc send_func);
+    ~ClipboardTransfer();
+
+    // Non-copyable
+    ClipboardTransfer(const ClipboardTransfer&) = delete;
+    ClipboardTransfer& operator=(const ClipboardTransfer&) = delete;
+
+    /// Largest clipboard text transferred.
+    static constexpr size_t MAX_TRANSFER_BYTES = 8 * 1024 * 1024;
+
+    /// Cap the outgoing transfer at |kbps| (at least MIN_RATE_KBPS).
+    void setRateLimitKbps(uint32_t kbps);
+
+    /// Start sending |text|, superseding any transfer in progress.  Returns
+    /// false if the peer already holds it or it is too large.
+    bool send(const std::string& text);
+
+    /// Send what the window, the rate cap and the retransmission timer
+    /// allow.  Returns true while a transfer is in progress (poll again
+    /// within a few milliseconds).
+    bool poll();
+
+    /// Called when a ClipboardChunkHeader packet arrives.  Returns true if it
+    /// completed a transfer of new content, which is then in |text|.
+    bool onChunk(const uint8_t* data, size_t len, std::string& text);
+
+    /// Called when a ClipboardWindowAckPacket arrives.
+    void onAck(const uint8_t* data, size_t len);
+
+    /// Mark |text| as held by both sides (it came by a legacy packet).
+    void noteShared(const std::string& text);
+
+    /// FNV-1a 64 of |len| bytes at |data|.
+    static uint64_t contentHash(const uint8_t* data, size_t len);
+
+private:
+    struct Outgoing {
+        bool                  active      = false;
+        ClipboardChunkHeader  hdr{};                  // Host order; chunk_index per send
+        std::vector<uint8_t>  data;                   // Encoded
+        std::vector<uint8_t>  acked;                  // Per chunk
+        std::vector<uint8_t>  transmissions;          // Per chunk (saturating)
+        std::vector<uint64_t> sent_us;                // Per chunk, last send
+        uint16_t              cumulative  = 0;        // Chunks below all acked
+        uint64_t              start_us    = 0;
+        uint64_t              progress_us = 0;        // Last new ack (or start)
+    };
+
+    struct Incoming {
+        bool                  active     = false;     // A transfer seen
+        bool                  done       = false;
+        ClipboardChunkHeader  hdr{};                  // Host order, from its first chunk
+        std::vector<uint8_t>  data;
+        std::vector<uint8_t>  have;                   // Per chunk
+        uint16_t              cumulative = 0;
+        uint16_t              unacked    = 0;         // New chunks since the last ack
+    };
+
+    /// Bytes of chunk |index| of a transfer of |encoded_length| bytes.
+    static size_t chunkBytes(uint32_t encoded_length, uint16_t index);
+
+    /// Send chunk |index| of the outgoing transfer (mutex_ held).
+    void sendChunkLocked(uint16_t index, uint64_t now_us);
+
+    /// Ack the incoming transfer's state (mutex_ held).
+    void sendAckLocked();
+
+    static constexpr size_t   MIN_COMPRESS_BYTES  = 256;
+    static constexpr size_t   WINDOW_CHUNKS       = 32;         // Ack mask covers the rest
+    static constexpr uint16_t ACK_EVERY_CHUNKS    = 2;          // In order; gaps ack at once
+    static constexpr uint32_t DEFAULT_RATE_KBPS   = 2'000;
+    static constexpr uint32_t MIN_RATE_KBPS       = 256;
+    static constexpr size_t   BURST_CHUNKS        = 8;          // Token bucket depth
+    static constexpr uint64_t INITIAL_RTO_US      = 250'000;
+    static constexpr uint64_t MIN_RTO_US          = 50'000;
+    static constexpr uint64_t MAX_RTO_US          = 1'000'000;
+    static constexpr uint64_t GIVE_UP_US          = 5'000'000;  // Without a new ack
+
+    const ClipboardDirection outgoing_;
+    SendFunc send_func_;
+
+    std::atomic<uint32_t> rate_kbps_{DEFAULT_RATE_KBPS};
+
+    // Content both sides hold (mutex_ held)
+    bool     have_shared_   = false;
+    uint64_t shared_hash_   = 0;
+    uint32_t shared_length_ = 0;
+
+    Outgoing out_;
+    uint16_t next_transfer_ = 0;
+    double   tokens_        = 0.0;   // Bytes
+    uint64_t last_refill_us_ = 0;
+    uint64_t srtt_us_       = 0;     // 0 = no sample yet
+    uint64_t rto_us_        = INITIAL_RTO_US;
+
+    Incoming in_;
+
+    std::vector<uint8_t> packet_;    // Reused for every chunk / ack
+    std::mutex mutex_;
+};
+
+} // namespace cs
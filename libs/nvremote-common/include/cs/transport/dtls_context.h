@@ -3,25 +3,34 @@
 //
 // Wraps OpenSSL's DTLS implementation to encrypt / decrypt datagrams over
 // a UDP socket.  Each DtlsContext holds:
-//   - A self-signed EC (prime256v1) certificate + private key generated at
-//     construction time.
+//   - A DtlsIdentity: self-signed EC (prime256v1) certificate + private
+//     key, taken from a DtlsIdentityPool or generated at construction.
 //   - An OpenSSL SSL_CTX and SSL object configured for DTLS 1.2 with the
 //     cipher TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256.
 //   - A BIO pair that bridges OpenSSL's record-layer I/O to the actual
 //     UDP socket in a non-blocking fashion.
 //
 // Typical flow:
-//   1. Construct DtlsContext(is_server).
+//   1. Construct DtlsContext(is_server, identity).
 //   2. Exchange getFingerprint() with the remote peer via signaling.
 //   3. Call handshake(udp_socket, peer_addr) -- blocks until done or timeout.
+//      A client that offers the wire versions as ALPN protocols ("CS06",
+//      "CS05", ...) has the newest shared one picked in the handshake
+//      (getHandshakeWireVersion()); others exchange version tags after it.
 //   4. Use encrypt() / decrypt() for application data.
+//      (Media can instead use a MediaCipher keyed with
+//      exportKeyingMaterial(), see media_cipher.h.)
 //   5. Call shutdown() when finished.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <condition_variable>
 #include <cstdint>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 // Platform socket headers -- must be included before any namespace to avoid
 // unqualified sockaddr / sockaddr_storage being captured by cs::.
@@ -42,11 +51,88 @@ typedef struct bio_st      BIO;
 
 namespace cs {
 
+// ---------------------------------------------------------------------------
+// DtlsIdentity -- key pair, self-signed certificate and session-ticket keys
+// ---------------------------------------------------------------------------
+struct DtlsIdentity {
+    static constexpr size_t TICKET_KEYS_LEN = 80;   // Key name, HMAC and AES keys
+
+    EVP_PKEY*   key  = nullptr;
+    X509*       cert = nullptr;
+    std::string fingerprint;              // SHA-256 of the certificate, as getFingerprint()
+    uint8_t     ticket_keys[TICKET_KEYS_LEN] = {};   // RFC 5077 tickets of servers using it
+    uint64_t    created_us = 0;
+
+    DtlsIdentity() = default;
+    ~DtlsIdentity();
+    DtlsIdentity(const DtlsIdentity&) = delete;
+    DtlsIdentity& operator=(const DtlsIdentity&) = delete;
+
+    /// Generate an EC P-256 key, a certificate valid for 24 hours and
+    /// fresh ticket keys.  nullptr on failure.
+    static std::shared_ptr<DtlsIdentity> generate();
+};
+
+// ---------------------------------------------------------------------------
+// DtlsIdentityPool -- identities generated ahead, reused for a while
+// ---------------------------------------------------------------------------
+// Generating and self-signing a key takes milliseconds of a core (more on
+// an embedded one) -- time a session should not wait for.  The pool keeps
+// SPARE_IDENTITIES generated on a background thread, and hands out the same
+// identity for a reuse window: a viewer reconnecting within it sees the
+// fingerprint it knows, and the ticket keys that go with the identity let
+// it resume the DTLS session instead of running the full handshake.
+class DtlsIdentityPool {
+public:
+    DtlsIdentityPool() = default;
+    ~DtlsIdentityPool();
+
+    DtlsIdentityPool(const DtlsIdentityPool&) = delete;
+    DtlsIdentityPool& operator=(const DtlsIdentityPool&) = delete;
+
+    /// Start generating spares in the background.
+    void start();
+
+    /// Stop the generator thread.
+    void stop();
+
+    /// The identity handed out last if it was first handed out less than
+    /// \p reuse_window_us ago, else the next spare (generated here if none
+    /// is ready).  A window of 0 always takes a new one.  Thread-safe;
+    /// nullptr only if an identity cannot be generated.
+    std::shared_ptr<const DtlsIdentity> acquire(uint64_t reuse_window_us);
+
+private:
+    void generateLoop();
+
+    std::mutex                                       mutex_;
+    std::condition_variable                          cv_;
+    std::vector<std::shared_ptr<const DtlsIdentity>> spares_;
+    std::shared_ptr<const DtlsIdentity>              current_;
+    uint64_t                                         current_since_us_ = 0;
+    std::thread                                      thread_;
+    bool                                             stop_ = false;
+
+    static constexpr size_t   SPARE_IDENTITIES = 2;
+    // Certificates are valid for 24 hours from generation: no identity is
+    // handed out, or reused, past half of it.
+    static constexpr uint64_t MAX_AGE_US       = 12ULL * 3600 * 1'000'000;
+};
+
+/// Retransmit a lost handshake flight after 100 ms, doubling up to 2 s,
+/// instead of OpenSSL's 1 s start.  Either role; set before the handshake.
+void setFastDtlsRetransmit(SSL* ssl);
+
+// ---------------------------------------------------------------------------
+// DtlsContext
+// ---------------------------------------------------------------------------
 class DtlsContext {
 public:
     /// Create a DTLS context.  If \p is_server is true the context will
     /// wait for a ClientHello; otherwise it will initiate the handshake.
-    explicit DtlsContext(bool is_server);
+    /// It presents \p identity, or one generated here if that is null.
+    explicit DtlsContext(bool is_server,
+                         std::shared_ptr<const DtlsIdentity> identity = nullptr);
     ~DtlsContext();
 
     // Non-copyable, movable
@@ -60,6 +146,9 @@ public:
     /// verify the peer.
     std::string getFingerprint() const;
 
+    /// The identity presented (shared by every context built from it).
+    std::shared_ptr<const DtlsIdentity> getIdentity() const { return identity_; }
+
     /// Perform the DTLS handshake over the given UDP socket with the remote
     /// peer at \p peer.  Blocks until the handshake completes or a 5-second
     /// timeout elapses.  Returns true on success.
@@ -76,18 +165,25 @@ public:
     bool decrypt(const uint8_t* data, size_t len,
                  uint8_t* out, size_t* out_len);
 
+    /// Derive |len| bytes of keying material from the handshake (RFC 5705)
+    /// under |label|, with no context value.  Both peers obtain the same
+    /// bytes.  Only valid after a successful handshake.
+    bool exportKeyingMaterial(const char* label, uint8_t* out, size_t len) const;
+
     /// Send a DTLS shutdown alert and free resources.
     void shutdown();
 
     /// True after a successful handshake and before shutdown.
     bool isEstablished() const { return established_; }
 
-private:
-    /// Generate an EC P-256 key pair.
-    static EVP_PKEY* generateKey();
+    /// Wire version the handshake settled through ALPN, or 0 if the peer
+    /// offered none (the version tags are then exchanged after it).
+    uint8_t getHandshakeWireVersion() const;
 
-    /// Create a self-signed X509 certificate from \p key.
-    static X509* generateCert(EVP_PKEY* key);
+    /// True if the handshake resumed an earlier session.
+    bool isResumed() const;
+
+private:
 
     /// Flush any pending data from the network BIO out to the real UDP socket.
     bool flushBioToSocket();
@@ -100,8 +196,7 @@ private:
 
     SSL_CTX*    ctx_         = nullptr;
     SSL*        ssl_         = nullptr;
-    EVP_PKEY*   key_         = nullptr;
-    X509*       cert_        = nullptr;
+    std::shared_ptr<const DtlsIdentity> identity_;
 
     // BIO pair: ssl_ writes/reads through bio_internal_, and we shuttle
     // bytes between bio_network_ and the real UDP socket.
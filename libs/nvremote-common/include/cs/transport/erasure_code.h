@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////////////////////
+// erasure_code.h -- Systematic Cauchy Reed-Solomon erasure code over GF(2^8)
+//
+// Shared by the host FEC encoder and the viewer FEC decoder.  A group of
+// k data shards is extended with m parity shards; any k of the k+m shards
+// are sufficient to rebuild every missing data shard.
+//
+// Generator matrix:
+//   rows 0..k-1     identity (data shards are sent unmodified)
+//   rows k..k+m-1   Cauchy matrix  C[i][j] = 1 / (x_i ^ y_j)
+//                   with x_i = k + i, y_j = j
+//
+// Every square sub-matrix of a Cauchy matrix is non-singular, so the code
+// is MDS for any k + m <= 256.
+//
+// The inner loop (dst ^= c * src over a region) is implemented with
+// split-nibble table lookups using AVX2 / SSSE3 shuffles on x86 and TBL on
+// AArch64 NEON, selected at runtime, with a scalar log/exp fallback.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cs {
+
+class ErasureCode {
+public:
+    /// Maximum total shard count (data + parity) per group.
+    static constexpr size_t MAX_SHARDS = 256;
+
+    /// Compute \p m parity shards from \p k data shards.
+    ///
+    /// \p data[i] points at data shard i of length \p data_len[i]; shards
+    /// shorter than \p symbol_len are treated as zero-padded.  Each
+    /// \p parity[j] must point at \p symbol_len writable bytes.
+    /// Returns false if the parameters are out of range.
+    static bool encode(const uint8_t* const* data, const size_t* data_len,
+                       size_t k, uint8_t* const* parity, size_t m,
+                       size_t symbol_len);
+
+    /// Rebuild missing data shards in place.
+    ///
+    /// \p shards holds k + m pointers, each to \p symbol_len bytes: data
+    /// shards first, then parity shards.  \p present[i] says whether shard
+    /// i was received.  Missing data shards are overwritten with their
+    /// reconstructed contents.  Returns false if fewer than k shards are
+    /// present (nothing is modified in that case).
+    static bool decode(uint8_t* const* shards, const bool* present,
+                       size_t k, size_t m, size_t symbol_len);
+
+    /// dst[0..len) ^= c * src[0..len) in GF(2^8).
+    static void mulAddRegion(uint8_t* dst, const uint8_t* src, uint8_t c,
+                             size_t len);
+
+    /// Scalar GF(2^8) helpers (polynomial 0x11D).
+    static uint8_t mul(uint8_t a, uint8_t b);
+    static uint8_t inv(uint8_t a);
+
+    /// Name of the region kernel selected at runtime ("avx2", "ssse3",
+    /// "neon" or "scalar").  Useful for startup logging.
+    static const char* kernelName();
+};
+
+} // namespace cs
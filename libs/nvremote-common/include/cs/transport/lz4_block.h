@@ -0,0 +1,41 @@
+///////////////////////////////////////////////////////////////////////////////
+// lz4_block.h -- LZ4 block format compressor / decompressor
+//
+// A self-contained implementation of the LZ4 block format (no frame
+// header, no checksums): output is readable by LZ4_decompress_safe(), and
+// anything LZ4_compress_default() writes is accepted here.  Used for
+// clipboard transfers, where text typically shrinks by half or more.
+//
+// The compressor is the greedy single-probe variant: a 4 KB-entry hash of
+// 4-byte sequences, matches up to 64 KB back, and a skip that speeds up
+// through incompressible runs.  The decompressor checks every length and
+// offset against both buffers, so corrupt input cannot write out of bounds.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cs {
+
+class Lz4Block {
+public:
+    /// Largest output compress() can produce for |len| input bytes.
+    static constexpr size_t compressBound(size_t len) {
+        return len + len / 255 + 16;
+    }
+
+    /// Compress |len| bytes from |src| into |dst|, which holds |capacity|
+    /// bytes.  Returns the compressed size, or 0 if it would not fit (a
+    /// capacity below |len| thus doubles as "only if it saves that much").
+    static size_t compress(const uint8_t* src, size_t len,
+                           uint8_t* dst, size_t capacity);
+
+    /// Decompress |len| bytes from |src| into exactly |raw_len| bytes at
+    /// |dst|.  Returns false if the input is malformed or does not
+    /// decompress to exactly |raw_len| bytes.
+    static bool decompress(const uint8_t* src, size_t len,
+                           uint8_t* dst, size_t raw_len);
+};
+
+} // namespace cs
@@ -0,0 +1,185 @@
+///////////////////////////////////////////////////////////////////////////////
+// media_cipher.h -- Stateless AEAD data plane keyed from the DTLS handshake
+//
+// DTLS-SRTP style media protection: once the DTLS handshake completes both
+// peers export keying material (RFC 5705) and seal each media datagram
+// independently with AES-128-GCM or ChaCha20-Poly1305.  There is no record
+// state machine, no BIO copy and no shared SSL object, so the hot path is
+// one EVP AEAD call per packet, performed in place in the packet buffer.
+//
+// Sealed datagram layout:
+//   [0]      marker: 0xE0 | cipher id   (no PacketType uses 0xE0-0xEF)
+//   [1-8]    64-bit packet counter, network order (nonce + replay index)
+//   [9..]    ciphertext (same length as the plaintext packet)
+//   [-16..]  authentication tag
+//
+// The 9-byte header is authenticated as AAD.  The 12-byte nonce is the
+// 4-byte per-direction salt followed by the 8-byte counter, so a nonce is
+// never reused under one key.  A sliding window rejects replayed counters;
+// retransmissions resend the original sealed bytes, which the window
+// accepts as long as the first copy never arrived.
+//
+// Key material layout (EXPORTER_LABEL, KEYING_MATERIAL_LEN bytes):
+//   client_key[32] | server_key[32] | client_salt[4] | server_salt[4]
+// AES-128-GCM uses the first 16 bytes of each key slot.
+//
+// Only media (video, FEC, audio) is sealed this way; control traffic stays
+// on the DTLS record layer.
+//
+// seal() serializes on one context.  Senders that seal on several threads
+// take a SealContext each (a copy of the keyed send context) and reserve
+// blocks of counters up front, so the threads share nothing per packet.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Forward-declare OpenSSL types so consumers don't need OpenSSL headers.
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+namespace cs {
+
+/// AEAD algorithm; the value is carried in the low bits of the marker byte.
+enum class AeadCipher : uint8_t {
+    AES_128_GCM       = 0x01,
+    CHACHA20_POLY1305 = 0x02,
+};
+
+class MediaCipher {
+public:
+    static constexpr uint8_t MARKER          = 0xE0;   // High nibble of byte 0
+    static constexpr uint8_t MARKER_MASK     = 0xF0;
+    static constexpr size_t  HEADER_LEN      = 9;      // marker + counter
+    static constexpr size_t  TAG_LEN         = 16;
+    static constexpr size_t  OVERHEAD        = HEADER_LEN + TAG_LEN;
+    static constexpr size_t  KEY_SLOT_LEN    = 32;
+    static constexpr size_t  SALT_LEN        = 4;
+    static constexpr size_t  KEYING_MATERIAL_LEN = 2 * KEY_SLOT_LEN + 2 * SALT_LEN;
+    static constexpr const char* EXPORTER_LABEL = "EXTRACTOR-nvremote-media-v1";
+
+    MediaCipher();
+    ~MediaCipher();
+
+    // Non-copyable
+    MediaCipher(const MediaCipher&) = delete;
+    MediaCipher& operator=(const MediaCipher&) = delete;
+
+    /// Install keys from |material| (KEYING_MATERIAL_LEN bytes exported
+    /// under EXPORTER_LABEL).  |is_server| selects which half is ours.
+    /// |send_cipher| is the algorithm used by seal(); open() accepts
+    /// either algorithm, as announced by the marker byte.
+    bool initialize(const uint8_t* material, size_t len, bool is_server,
+                    AeadCipher send_cipher = preferredCipher());
+
+    /// True once initialize() has succeeded.
+    bool isReady() const { return ready_; }
+
+    /// Seal one packet in place.  The plaintext must already be at
+    /// |buf| + HEADER_LEN, and |buf| must have room for
+    /// |plain_len| + OVERHEAD bytes.  Returns the sealed length, or 0 on
+    /// failure.  Thread-safe.
+    size_t seal(uint8_t* buf, size_t plain_len);
+
+    /// A send context of one thread's own, for sealing in parallel with
+    /// other threads.  Not thread-safe itself.
+    class SealContext {
+    public:
+        ~SealContext();
+
+        // Non-copyable
+        SealContext(const SealContext&) = delete;
+        SealContext& operator=(const SealContext&) = delete;
+
+        /// Seal one packet in place as seal() does, with |counter|, which
+        /// must come from reserveCounters().
+        size_t seal(uint8_t* buf, size_t plain_len, uint64_t counter);
+
+    private:
+        friend class MediaCipher;
+        SealContext() = default;
+
+        EVP_CIPHER_CTX* ctx_    = nullptr;
+        AeadCipher      cipher_ = AeadCipher::AES_128_GCM;
+        uint8_t         salt_[SALT_LEN] = {};
+    };
+
+    /// Create a SealContext keyed like seal()'s, or nullptr before
+    /// initialize() or on failure.
+    std::unique_ptr<SealContext> createSealContext();
+
+    /// Reserve |count| consecutive packet counters for SealContext::seal()
+    /// and return the first.  Thread-safe.
+    uint64_t reserveCounters(size_t count);
+
+    /// Authenticate and decrypt a sealed datagram in place.  On success the
+    /// plaintext is at |buf| + HEADER_LEN and |*plain_len| is its length.
+    /// Forged, corrupted and replayed packets return false.  Must be called
+    /// from a single thread.
+    bool open(uint8_t* buf, size_t len, size_t* plain_len);
+
+    /// True if |data| carries the sealed-media marker.
+    static bool isSealed(const uint8_t* data, size_t len) {
+        return len >= OVERHEAD && (data[0] & MARKER_MASK) == MARKER;
+    }
+
+    /// Packet counter of a sealed datagram (header bytes 1-8).  It increases
+    /// by one per sealed packet across all media, so its low 16 bits serve
+    /// as the transport-wide sequence number for congestion feedback.
+    static uint64_t packetCounter(const uint8_t* sealed) {
+        uint64_t counter = 0;
+        for (size_t i = 1; i < HEADER_LEN; ++i) {
+            counter = (counter << 8) | sealed[i];
+        }
+        return counter;
+    }
+
+    /// AES-128-GCM when the CPU has AES instructions, else ChaCha20-Poly1305.
+    static AeadCipher preferredCipher();
+
+    /// Name of an algorithm, for logging.
+    static const char* cipherName(AeadCipher cipher);
+
+    // --- Statistics ---
+    uint64_t getAuthFailures() const { return auth_failures_.load(); }
+    uint64_t getReplayDrops()  const { return replay_drops_.load(); }
+
+private:
+    /// Create an AEAD context for |cipher| keyed with |key_slot|.
+    static EVP_CIPHER_CTX* createContext(AeadCipher cipher, const uint8_t* key_slot,
+                                         bool encrypt);
+
+    /// Replay window check / update for |counter| (open() thread only).
+    bool checkReplay(uint64_t counter) const;
+    void markReceived(uint64_t counter);
+
+    bool ready_ = false;
+
+    // Send direction (guarded by send_mutex_).
+    std::mutex      send_mutex_;
+    EVP_CIPHER_CTX* send_ctx_      = nullptr;
+    AeadCipher      send_cipher_   = AeadCipher::AES_128_GCM;
+    uint64_t        send_counter_  = 0;
+    uint8_t         send_salt_[SALT_LEN] = {};
+
+    // Receive direction: one context per algorithm, created on first use.
+    EVP_CIPHER_CTX* recv_ctx_[2]   = {nullptr, nullptr};
+    uint8_t         recv_key_[KEY_SLOT_LEN] = {};
+    uint8_t         recv_salt_[SALT_LEN]    = {};
+
+    // Sliding replay window over the peer's counter.
+    static constexpr size_t WINDOW_BITS  = 4096;   // > 1 RTT of packets at 100+ Mbps
+    static constexpr size_t WINDOW_WORDS = WINDOW_BITS / 64;
+    std::array<uint64_t, WINDOW_WORDS> window_ = {};
+    uint64_t        highest_counter_ = 0;
+    bool            any_received_    = false;
+
+    std::atomic<uint64_t> auth_failures_{0};
+    std::atomic<uint64_t> replay_drops_{0};
+};
+
+} // namespace cs
@@ -0,0 +1,190 @@
+///////////////////////////////////////////////////////////////////////////////
+// network_impairment.h -- Built-in network emulator for QoS validation
+//
+// Sits between a transport and its socket and does to datagrams what a
+// bad network would, in netem's order: Gilbert-Elliott burst loss, then a
+// rate-limited link with a tail-drop queue, then delay with jitter, with a
+// share of packets let through undelayed so they overtake the rest
+// (reordering).  The link rate can follow a script of capacity changes.
+// Every random draw comes from one seeded generator, so the same spec and
+// the same traffic give the same impairment, for A/B runs of congestion
+// control and FEC settings.
+//
+// The sending side (UdpTransport) hands datagrams over and lets the
+// emulator's own thread put them on the socket when due; the receiving
+// side (UdpReceiver) takes due datagrams back on its receive thread.
+//
+// A spec is comma-separated key=value pairs, e.g.
+//   loss=1,burst=5:30,delay=40,jitter=8,dist=pareto,reorder=2,
+//   rate=20000,queue=200,steps=10000:5000/20000:20000,seed=7
+// with percentages for loss / burst / reorder, milliseconds for delay /
+// jitter and kbps for rate:
+//   loss=<pct>          loss in the good state (independent loss)
+//   burst=<p>:<r>[:<h>] good->bad and bad->good transition chances per
+//                       packet, and loss in the bad state (default 100)
+//   delay=<ms>          fixed one-way delay
+//   jitter=<ms>         delay variation, shaped by dist:
+//   dist=<name>         uniform (+/- jitter, the default), normal (jitter
+//                       the standard deviation, cut off at 4x) or pareto
+//                       (one-sided, jitter the mean, at most 8 x jitter)
+//   reorder=<pct>       packets that skip the delay
+//   rate=<kbps>         link capacity (0 = unlimited)
+//   queue=<packets>     link queue before tail drop
+//   steps=<ms>:<kbps>/...  capacity from |ms| after the first packet on
+//   seed=<n>
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "cs/buffer_pool.h"
+#include "cs/common.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// ImpairmentConfig
+// ---------------------------------------------------------------------------
+enum class JitterDistribution : uint8_t {
+    UNIFORM,
+    NORMAL,
+    PARETO,
+};
+
+struct CapacityStep {
+    uint32_t at_ms     = 0;   // From the first datagram
+    uint32_t rate_kbps = 0;   // 0 = unlimited
+};
+
+struct ImpairmentConfig {
+    // Gilbert-Elliott loss: chances per packet, 0..1
+    float    loss_good      = 0.0f;
+    float    loss_bad       = 1.0f;
+    float    p_good_to_bad  = 0.0f;
+    float    p_bad_to_good  = 1.0f;
+
+    uint32_t delay_ms       = 0;
+    uint32_t jitter_ms      = 0;
+    JitterDistribution jitter_dist = JitterDistribution::UNIFORM;
+    float    reorder        = 0.0f;
+
+    uint32_t rate_kbps      = 0;
+    uint32_t queue_packets  = 1000;
+    std::vector<CapacityStep> steps;
+
+    uint32_t seed           = 1;
+
+    /// True if any impairment is configured.
+    bool enabled() const {
+        return loss_good > 0.0f || p_good_to_bad > 0.0f || delay_ms > 0 || jitter_ms > 0 ||
+               reorder > 0.0f || rate_kbps > 0 || !steps.empty();
+    }
+};
+
+/// Parse a spec (see above) into |config|.  On failure returns false and
+/// describes the first bad pair in |error| if given.
+bool parseImpairmentSpec(const std::string& spec, ImpairmentConfig& config,
+                         std::string* error = nullptr);
+
+/// One-line summary of |config|, for the log.
+std::string describeImpairment(const ImpairmentConfig& config);
+
+// ---------------------------------------------------------------------------
+// NetworkImpairment
+// ---------------------------------------------------------------------------
+class NetworkImpairment {
+public:
+    /// A datagram held by the emulator until it is due.
+    struct Datagram {
+        PooledBuffer  buf;
+        size_t        len    = 0;
+        ::sockaddr_in to     = {};   // Where the sender addressed it
+        uint64_t      due_us = 0;
+        uint64_t      order  = 0;    // Submission order, breaks due ties
+    };
+
+    struct Stats {
+        uint64_t submitted     = 0;
+        uint64_t delivered     = 0;
+        uint64_t lost          = 0;   // Gilbert-Elliott
+        uint64_t queue_drops   = 0;   // Link queue full
+        uint64_t reordered     = 0;
+        uint32_t rate_kbps     = 0;   // Link capacity now (0 = unlimited)
+    };
+
+    explicit NetworkImpairment(const ImpairmentConfig& config);
+    ~NetworkImpairment();
+
+    // Non-copyable
+    NetworkImpairment(const NetworkImpairment&) = delete;
+    NetworkImpairment& operator=(const NetworkImpairment&) = delete;
+
+    /// Offer a datagram at |now_us|.  Returns false if the network dropped
+    /// it; one that survives is copied.  Thread-safe.
+    bool submit(const uint8_t* data, size_t len, uint64_t now_us,
+                const ::sockaddr_in* to = nullptr);
+
+    /// Append the datagrams due by |now_us| to |out|, in arrival order.
+    /// Returns how many were appended.
+    size_t takeDue(uint64_t now_us, std::vector<Datagram>& out);
+
+    /// When the next held datagram falls due (UINT64_MAX if none).
+    uint64_t nextDueUs() const;
+
+    /// Deliver due datagrams from a thread of the emulator's own, through
+    /// |deliver|, until stop().  For a sender, whose caller cannot wait.
+    using DeliverFunc = std::function<void(const Datagram& dgram)>;
+    void start(DeliverFunc deliver);
+
+    /// Stop the delivery thread; datagrams still held are discarded.
+    void stop();
+
+    Stats getStats() const;
+
+private:
+    struct Later {
+        bool operator()(const Datagram& a, const Datagram& b) const {
+            return a.due_us != b.due_us ? a.due_us > b.due_us : a.order > b.order;
+        }
+    };
+
+    /// Gilbert-Elliott step: true if this packet is lost (mutex_ held).
+    bool drawLoss();
+
+    /// Delay variation for one packet, microseconds (mutex_ held).
+    int64_t drawJitterUs();
+
+    /// Link capacity at |now_us| under the script (mutex_ held).
+    uint32_t rateAt(uint64_t now_us) const;
+
+    void deliveryLoop();
+
+    const ImpairmentConfig config_;
+
+    mutable std::mutex      mutex_;
+    std::condition_variable cv_;
+    std::minstd_rand        rng_;
+    std::vector<Datagram>   held_;              // Heap, earliest due on top
+    std::deque<uint64_t>    link_departures_;   // Departure times of queued packets
+    bool                    bad_state_     = false;
+    uint64_t                start_us_      = 0;
+    uint64_t                link_free_us_  = 0;   // When the link finishes its queue
+    uint64_t                last_due_us_   = 0;   // Latest in-order due time
+    uint64_t                next_order_    = 0;
+    Stats                   stats_;
+
+    DeliverFunc             deliver_;
+    std::thread             thread_;
+    bool                    stopping_      = false;
+};
+
+} // namespace cs
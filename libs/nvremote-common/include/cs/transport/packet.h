@@ -7,19 +7,38 @@
 // helpers perform the necessary swaps.
 //
 // Packet type byte (first byte after DTLS decryption) disambiguates:
-//   0x10 = video   (VideoPacketHeader follows)
+//   0x10 = video   (VideoPacketHeader / VideoPacketHeaderV2 follows)
 //   0x20 = audio   (AudioPacketHeader follows)
 //   0x30 = input   (InputPacketHeader follows)
+//   0x09 = controller state ack (host -> viewer)
+//   0x0A = clipboard window ack (ClipboardWindowAckPacket)
+//   0x0B = clipboard chunk (ClipboardChunkHeader follows)
+//   0x40 = controller state, legacy full-state packet (viewer -> host)
+//   0x50 = clipboard, single packet (legacy; still accepted)
+//   0x51 = clipboard ack, legacy (ClipboardAckPacket)
+//   0x0C = cursor position (host -> viewer)
+//   0x0D = cursor shape chunk (host -> viewer)
+//   0x0E = cursor shape request (viewer -> host)
+//   0x0F = input echo (host -> viewer, input shown from this frame on)
+//   0xF3 = padding (host -> viewer, sealed bandwidth probe; ignored)
+//   0xF4 = path challenge (viewer -> host, sealed)
+//   0xF5 = path response (host -> viewer, sealed)
+//   0xF6 = frame loss report (client -> host, unrecoverable frames)
+//   0xF7 = RTT probe (host timestamp, echoed in QoS feedback)
+//   0xFA = transport-wide feedback (cs/qos/transport_feedback.h)
 //   0xFB = QoS feedback
 //   0xFC = FEC
 //   0xFD = NACK
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <cstring>
 #include <vector>
 
+#include "cs/transport/wire.h"
+
 #ifdef _WIN32
   #include <WinSock2.h>   // htons / ntohs / htonl / ntohl
 #else
@@ -30,10 +49,51 @@ namespace cs {
 
 // ---------------------------------------------------------------------------
 // Protocol version -- exchanged immediately after DTLS handshake.
-// Both sides send this 4-byte tag; a mismatch means incompatible wire formats.
+// The host sends the tag of the newest wire format it speaks; the viewer
+// answers with the newest format both sides support, which then applies to
+// the whole session.  An unknown tag means incompatible wire formats.
+//
+//   CS01 -- VideoPacketHeader   (8-bit fragment fields, 16-bit frame number)
+//   CS02 -- VideoPacketHeaderV2 (16-bit fragment fields, 32-bit frame number)
+//   CS03 -- VideoPacketHeaderV2, and fragment_total may be 0 in fragments
+//           sent while the frame is still being encoded (slice streaming);
+//           the frame's last fragment always carries the real total
+//   CS04 -- CS03, and the host may leave the cursor out of the video and
+//           send it as cursor packets for the viewer to draw
+//   CS05 -- CS04, and the host may send several displays, each its own
+//           video stream, told apart by the stream ID in the video header
+//   CS06 -- CS05, and the host answers path challenges, so the viewer can
+//           check consent and move the session to another path
 // ---------------------------------------------------------------------------
-constexpr uint8_t PROTOCOL_VERSION_TAG[4] = { 'C', 'S', '0', '1' };
-constexpr size_t  PROTOCOL_VERSION_TAG_LEN = 4;
+constexpr uint8_t PROTOCOL_VERSION_TAG[4]    = { 'C', 'S', '0', '1' };
+constexpr uint8_t PROTOCOL_VERSION_TAG_V2[4] = { 'C', 'S', '0', '2' };
+constexpr uint8_t PROTOCOL_VERSION_TAG_V3[4] = { 'C', 'S', '0', '3' };
+constexpr uint8_t PROTOCOL_VERSION_TAG_V4[4] = { 'C', 'S', '0', '4' };
+constexpr uint8_t PROTOCOL_VERSION_TAG_V5[4] = { 'C', 'S', '0', '5' };
+constexpr uint8_t PROTOCOL_VERSION_TAG_V6[4] = { 'C', 'S', '0', '6' };
+constexpr size_t  PROTOCOL_VERSION_TAG_LEN   = 4;
+constexpr uint8_t PROTOCOL_WIRE_VERSION_MAX  = 6;
+
+/// Video streams a CS05 session can carry (the stream ID is 4 bits).
+constexpr uint8_t MAX_VIDEO_STREAMS = 16;
+
+/// Tag announcing wire |version| (1 to 6).
+inline const uint8_t* protocolVersionTag(uint8_t version) {
+    if (version >= 6) return PROTOCOL_VERSION_TAG_V6;
+    if (version == 5) return PROTOCOL_VERSION_TAG_V5;
+    if (version == 4) return PROTOCOL_VERSION_TAG_V4;
+    if (version == 3) return PROTOCOL_VERSION_TAG_V3;
+    return version == 2 ? PROTOCOL_VERSION_TAG_V2 : PROTOCOL_VERSION_TAG;
+}
+
+/// Wire version announced by a received "CS0n" tag (which may be newer
+/// than PROTOCOL_WIRE_VERSION_MAX), or 0 if it is not a version tag.
+inline uint8_t parseProtocolVersionTag(const uint8_t* data, size_t len) {
+    if (len != PROTOCOL_VERSION_TAG_LEN) return 0;
+    if (std::memcmp(data, PROTOCOL_VERSION_TAG, 3) != 0) return 0;
+    if (data[3] < '1' || data[3] > '9') return 0;
+    return static_cast<uint8_t>(data[3] - '0');
+}
 
 // ---------------------------------------------------------------------------
 // Enums
@@ -48,12 +108,27 @@ enum class CodecType : uint8_t {
 
 /// Top-level packet type tag (first disambiguating byte or embedded in header)
 enum class PacketType : uint8_t {
+    CONTROLLER_ACK = 0x09,
+    CLIP_WINDOW_ACK = 0x0A,
+    CLIP_CHUNK   = 0x0B,
+    CURSOR_POS   = 0x0C,
+    CURSOR_SHAPE = 0x0D,
+    CURSOR_REQUEST = 0x0E,
+    INPUT_ECHO   = 0x0F,
     VIDEO        = 0x10,
     AUDIO        = 0x20,
     INPUT        = 0x30,
     CONTROLLER   = 0x40,
     CLIPBOARD    = 0x50,
     CLIP_ACK     = 0x51,
+    PADDING      = 0xF3,
+    FRAME_LOSS   = 0xF6,
+    RTT_PROBE    = 0xF7,
+    PATH_CHALLENGE = 0xF4,
+    PATH_RESPONSE  = 0xF5,
+    PMTU_PROBE   = 0xF8,
+    PMTU_ACK     = 0xF9,
+    TRANSPORT_FEEDBACK = 0xFA,
     QOS_FEEDBACK = 0xFB,
     FEC          = 0xFC,
     NACK         = 0xFD,
@@ -65,6 +140,8 @@ enum class InputType : uint8_t {
     MOUSE_BUTTON = 2,
     KEY          = 3,
     SCROLL       = 4,
+    BATCH        = 5,   // InputBatchHeader + InputBatchEvent records
+    CONTROLLER_STATE = 6,   // Controller state records (delta or full)
 };
 
 // ---------------------------------------------------------------------------
@@ -76,7 +153,7 @@ enum class InputType : uint8_t {
 /// Video packet header -- 16 bytes on the wire.
 ///
 /// Byte layout:
-///   [0]   version(2) | frame_type(1) | keyframe(1) | reserved(4)
+///   [0]   version(2) | frame_type(1) | keyframe(1) | recovery(1) | ltr(1) | temporal_layer(2)
 ///   [1]   codec
 ///   [2-3] sequence_number   (network order)
 ///   [4-7] timestamp_us      (network order, lower 32 bits)
@@ -84,8 +161,18 @@ enum class InputType : uint8_t {
 ///   [10]  fragment_index
 ///   [11]  fragment_total
 ///   [12-15] payload_length  (network order)
+///
+/// The recovery bit marks the first frame encoded after the host answered
+/// a FrameLossPacket by invalidating the lost references: it predicts only
+/// from frames the client decoded, so decoding can resume there without
+/// waiting for a keyframe.  The ltr bit marks a long-term reference frame;
+/// the client acknowledges each one it decodes in its QoS feedback.
+/// temporal_layer is the frame's temporal SVC layer: 0 is the base layer,
+/// and nothing references a frame above it, so the host does not
+/// retransmit such a frame and the client may drop it without a decode
+/// error.  Streams without temporal layers send 0.
 struct VideoPacketHeader {
-    uint8_t  flags;             // version(2)|frame_type(1)|keyframe(1)|reserved(4)
+    uint8_t  flags;             // version(2)|frame_type(1)|keyframe(1)|recovery(1)|ltr(1)|temporal_layer(2)
     uint8_t  codec;             // CodecType
     uint16_t sequence_number;
     uint32_t timestamp_us;
@@ -99,54 +186,179 @@ struct VideoPacketHeader {
     uint8_t version()    const { return (flags >> 6) & 0x03; }
     uint8_t frameType()  const { return (flags >> 5) & 0x01; }
     bool    keyframe()   const { return ((flags >> 4) & 0x01) != 0; }
+    bool    recovery()   const { return ((flags >> 3) & 0x01) != 0; }
+    bool    ltr()        const { return ((flags >> 2) & 0x01) != 0; }
+    uint8_t temporalLayer() const { return flags & 0x03; }
 
     void setVersion(uint8_t v)    { flags = (flags & 0x3F) | ((v & 0x03) << 6); }
     void setFrameType(uint8_t t)  { flags = (flags & 0xDF) | ((t & 0x01) << 5); }
     void setKeyframe(bool k)      { flags = (flags & 0xEF) | ((k ? 1u : 0u) << 4); }
+    void setRecovery(bool r)      { flags = (flags & 0xF7) | ((r ? 1u : 0u) << 3); }
+    void setLtr(bool l)           { flags = (flags & 0xFB) | ((l ? 1u : 0u) << 2); }
+    void setTemporalLayer(uint8_t t) { flags = (flags & 0xFC) | (t & 0x03); }
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&VideoPacketHeader::flags, &VideoPacketHeader::codec,
+                            &VideoPacketHeader::sequence_number,
+                            &VideoPacketHeader::timestamp_us,
+                            &VideoPacketHeader::frame_number,
+                            &VideoPacketHeader::fragment_index,
+                            &VideoPacketHeader::fragment_total,
+                            &VideoPacketHeader::payload_length>;
 
     // --- Serialize to network byte order (in place) ---
-    void toNetwork() {
-        sequence_number = htons(sequence_number);
-        timestamp_us    = htonl(timestamp_us);
-        frame_number    = htons(frame_number);
-        payload_length  = htonl(payload_length);
-    }
+    void toNetwork() { Wire::swap(*this); }
 
     // --- Deserialize from network byte order (in place) ---
-    void toHost() {
-        sequence_number = ntohs(sequence_number);
-        timestamp_us    = ntohl(timestamp_us);
-        frame_number    = ntohs(frame_number);
-        payload_length  = ntohl(payload_length);
-    }
+    void toHost() { Wire::swap(*this); }
 
-    /// Serialize this header + optional payload into a byte vector ready for
-    /// transmission.  The header is converted to network byte order; the
-    /// payload is copied verbatim after it.
-    std::vector<uint8_t> serialize(const uint8_t* payload = nullptr,
-                                   size_t payloadLen = 0) const {
-        VideoPacketHeader net = *this;
-        net.toNetwork();
-
-        std::vector<uint8_t> buf(sizeof(VideoPacketHeader) + payloadLen);
-        std::memcpy(buf.data(), &net, sizeof(net));
-        if (payload && payloadLen > 0) {
-            std::memcpy(buf.data() + sizeof(net), payload, payloadLen);
-        }
-        return buf;
+    /// Write this header in network byte order to |out| (which must hold
+    /// sizeof(VideoPacketHeader) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(VideoPacketHeader)));
     }
 
     /// Deserialize from a raw buffer.  Returns false if the buffer is too
     /// small.  On success *this is populated in host byte order.
     static bool deserialize(const uint8_t* data, size_t len,
                             VideoPacketHeader& out) {
-        if (len < sizeof(VideoPacketHeader)) return false;
-        std::memcpy(&out, data, sizeof(VideoPacketHeader));
-        out.toHost();
-        return true;
+        return decodeHeader(ConstByteSpan(data, len), out);
     }
 };
 static_assert(sizeof(VideoPacketHeader) == 16, "VideoPacketHeader must be 16 bytes");
+static_assert(checkWireSchema<VideoPacketHeader>(), "VideoPacketHeader::Wire must list every field");
+
+/// Video packet header, wire versions 2 and 3 -- 20 bytes on the wire.
+///
+/// Same flags byte as VideoPacketHeader (version bits = 2 or 3), with
+/// fragment fields wide enough for multi-megabyte keyframes:
+///   [0]     version(2) | frame_type(1) | keyframe(1) | recovery(1) | ltr(1) | temporal_layer(2)
+///   [1]     codec
+///   [2-3]   sequence_number (network order)
+///   [4-7]   timestamp_us    (network order, lower 32 bits)
+///   [8-11]  frame_number    (network order)
+///   [12-13] fragment_index  (network order)
+///   [14-15] fragment_total  (network order; 0 = not known yet, version 3)
+///   [16-19] payload_length  (network order)
+///
+/// From CS05 the codec byte's high nibble is the stream ID: 0 for the
+/// session's main display, 1 to MAX_VIDEO_STREAMS - 1 for the others.
+/// Each stream has its own frame numbers; sequence numbers (and so NACK
+/// and FEC) are shared by all of them.
+///
+/// The viewer uses this struct as its in-memory header for both versions;
+/// parseVideoHeader() widens a version-1 header into it.
+struct VideoPacketHeaderV2 {
+    uint8_t  flags;             // version(2)|frame_type(1)|keyframe(1)|recovery(1)|ltr(1)|temporal_layer(2)
+    uint8_t  codec;             // CodecType
+    uint16_t sequence_number;
+    uint32_t timestamp_us;
+    uint32_t frame_number;
+    uint16_t fragment_index;
+    uint16_t fragment_total;
+    uint32_t payload_length;
+
+    uint8_t version()    const { return (flags >> 6) & 0x03; }
+    uint8_t frameType()  const { return (flags >> 5) & 0x01; }
+    bool    keyframe()   const { return ((flags >> 4) & 0x01) != 0; }
+    bool    recovery()   const { return ((flags >> 3) & 0x01) != 0; }
+    bool    ltr()        const { return ((flags >> 2) & 0x01) != 0; }
+    uint8_t temporalLayer() const { return flags & 0x03; }
+    uint8_t codecType()  const { return codec & 0x0F; }
+    uint8_t streamId()   const { return codec >> 4; }
+
+    void setVersion(uint8_t v)    { flags = (flags & 0x3F) | ((v & 0x03) << 6); }
+    void setFrameType(uint8_t t)  { flags = (flags & 0xDF) | ((t & 0x01) << 5); }
+    void setKeyframe(bool k)      { flags = (flags & 0xEF) | ((k ? 1u : 0u) << 4); }
+    void setRecovery(bool r)      { flags = (flags & 0xF7) | ((r ? 1u : 0u) << 3); }
+    void setLtr(bool l)           { flags = (flags & 0xFB) | ((l ? 1u : 0u) << 2); }
+    void setTemporalLayer(uint8_t t) { flags = (flags & 0xFC) | (t & 0x03); }
+    void setStreamId(uint8_t id)  { codec = static_cast<uint8_t>((codec & 0x0F) | (id << 4)); }
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&VideoPacketHeaderV2::flags, &VideoPacketHeaderV2::codec,
+                            &VideoPacketHeaderV2::sequence_number,
+                            &VideoPacketHeaderV2::timestamp_us,
+                            &VideoPacketHeaderV2::frame_number,
+                            &VideoPacketHeaderV2::fragment_index,
+                            &VideoPacketHeaderV2::fragment_total,
+                            &VideoPacketHeaderV2::payload_length>;
+
+    void toNetwork() { Wire::swap(*this); }
+
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this header to |out| in the layout selected by version():
+    /// 16 bytes for version 1 (fragment fields and frame number truncated),
+    /// otherwise 20 bytes.  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        if (version() == 1) {
+            VideoPacketHeader v1;
+            v1.flags           = flags;
+            v1.codec           = codec;
+            v1.sequence_number = sequence_number;
+            v1.timestamp_us    = timestamp_us;
+            v1.frame_number    = static_cast<uint16_t>(frame_number);
+            v1.fragment_index  = static_cast<uint8_t>(fragment_index);
+            v1.fragment_total  = static_cast<uint8_t>(fragment_total);
+            v1.payload_length  = payload_length;
+            return v1.serializeTo(out);
+        }
+        return encodeHeader(*this, ByteSpan(out, sizeof(VideoPacketHeaderV2)));
+    }
+
+    /// On-wire size of a header with this version.
+    size_t wireSize() const {
+        return version() == 1 ? sizeof(VideoPacketHeader) : sizeof(VideoPacketHeaderV2);
+    }
+
+    /// Deserialize a version-2 header.  Returns false if the buffer is too
+    /// small.  On success *this is populated in host byte order.
+    static bool deserialize(const uint8_t* data, size_t len,
+                            VideoPacketHeaderV2& out) {
+        return decodeHeader(ConstByteSpan(data, len), out);
+    }
+};
+static_assert(sizeof(VideoPacketHeaderV2) == 20, "VideoPacketHeaderV2 must be 20 bytes");
+static_assert(checkWireSchema<VideoPacketHeaderV2>(), "VideoPacketHeaderV2::Wire must list every field");
+
+/// Version bits of the video headers sent in a wire |version| session.
+/// The field holds 1 to 3; later wire versions keep the CS03 video layout.
+inline uint8_t videoHeaderVersion(uint8_t version) {
+    return version > 3 ? 3 : version;
+}
+
+/// On-wire video header size for a negotiated wire |version|.
+inline size_t videoHeaderSize(uint8_t version) {
+    return version == 1 ? sizeof(VideoPacketHeader) : sizeof(VideoPacketHeaderV2);
+}
+
+/// Parse a video header of either version, picking the layout from the
+/// version bits of the flags byte.  On success |out| holds the header in
+/// host byte order and |*header_len| its on-wire size.
+inline bool parseVideoHeader(const uint8_t* data, size_t len,
+                             VideoPacketHeaderV2& out, size_t* header_len) {
+    if (len == 0) return false;
+
+    if (((data[0] >> 6) & 0x03) != 1) {
+        if (!VideoPacketHeaderV2::deserialize(data, len, out)) return false;
+        if (header_len) *header_len = sizeof(VideoPacketHeaderV2);
+        return true;
+    }
+
+    VideoPacketHeader v1;
+    if (!VideoPacketHeader::deserialize(data, len, v1)) return false;
+    out.flags           = v1.flags;
+    out.codec           = v1.codec;
+    out.sequence_number = v1.sequence_number;
+    out.timestamp_us    = v1.timestamp_us;
+    out.frame_number    = v1.frame_number;
+    out.fragment_index  = v1.fragment_index;
+    out.fragment_total  = v1.fragment_total;
+    out.payload_length  = v1.payload_length;
+    if (header_len) *header_len = sizeof(VideoPacketHeader);
+    return true;
+}
 
 /// Audio packet header -- 8 bytes on the wire.
 ///
@@ -166,36 +378,27 @@ struct AudioPacketHeader {
     void setVersion(uint8_t v) { ver_type = (ver_type & 0x3F) | ((v & 0x03) << 6); }
     void setType(uint8_t t)    { ver_type = (ver_type & 0xC0) | (t & 0x3F); }
 
-    void toNetwork() {
-        sequence_number = htons(sequence_number);
-        timestamp_us    = htonl(timestamp_us);
-    }
-    void toHost() {
-        sequence_number = ntohs(sequence_number);
-        timestamp_us    = ntohl(timestamp_us);
-    }
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&AudioPacketHeader::ver_type, &AudioPacketHeader::channel_id,
+                            &AudioPacketHeader::sequence_number,
+                            &AudioPacketHeader::timestamp_us>;
 
-    std::vector<uint8_t> serialize(const uint8_t* payload = nullptr,
-                                   size_t payloadLen = 0) const {
-        AudioPacketHeader net = *this;
-        net.toNetwork();
-        std::vector<uint8_t> buf(sizeof(AudioPacketHeader) + payloadLen);
-        std::memcpy(buf.data(), &net, sizeof(net));
-        if (payload && payloadLen > 0) {
-            std::memcpy(buf.data() + sizeof(net), payload, payloadLen);
-        }
-        return buf;
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this header in network byte order to |out| (which must hold
+    /// sizeof(AudioPacketHeader) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(AudioPacketHeader)));
     }
 
     static bool deserialize(const uint8_t* data, size_t len,
                             AudioPacketHeader& out) {
-        if (len < sizeof(AudioPacketHeader)) return false;
-        std::memcpy(&out, data, sizeof(AudioPacketHeader));
-        out.toHost();
-        return true;
+        return decodeHeader(ConstByteSpan(data, len), out);
     }
 };
 static_assert(sizeof(AudioPacketHeader) == 8, "AudioPacketHeader must be 8 bytes");
+static_assert(checkWireSchema<AudioPacketHeader>(), "AudioPacketHeader::Wire must list every field");
 
 /// Input packet header -- 4 bytes on the wire.
 ///
@@ -213,30 +416,20 @@ struct InputPacketHeader {
     void setVersion(uint8_t v) { ver_type = (ver_type & 0x3F) | ((v & 0x03) << 6); }
     void setType(uint8_t t)    { ver_type = (ver_type & 0xC0) | (t & 0x3F); }
 
-    void toNetwork() { payload_length = htons(payload_length); }
-    void toHost()    { payload_length = ntohs(payload_length); }
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&InputPacketHeader::ver_type, &InputPacketHeader::input_type,
+                            &InputPacketHeader::payload_length>;
 
-    std::vector<uint8_t> serialize(const uint8_t* payload = nullptr,
-                                   size_t payloadLen = 0) const {
-        InputPacketHeader net = *this;
-        net.toNetwork();
-        std::vector<uint8_t> buf(sizeof(InputPacketHeader) + payloadLen);
-        std::memcpy(buf.data(), &net, sizeof(net));
-        if (payload && payloadLen > 0) {
-            std::memcpy(buf.data() + sizeof(net), payload, payloadLen);
-        }
-        return buf;
-    }
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
 
     static bool deserialize(const uint8_t* data, size_t len,
                             InputPacketHeader& out) {
-        if (len < sizeof(InputPacketHeader)) return false;
-        std::memcpy(&out, data, sizeof(InputPacketHeader));
-        out.toHost();
-        return true;
+        return decodeHeader(ConstByteSpan(data, len), out);
     }
 };
 static_assert(sizeof(InputPacketHeader) == 4, "InputPacketHeader must be 4 bytes");
+static_assert(checkWireSchema<InputPacketHeader>(), "InputPacketHeader::Wire must list every field");
 
 /// QoS feedback packet -- 22 bytes on the wire.
 ///
@@ -253,7 +446,10 @@ static_assert(sizeof(InputPacketHeader) == 4, "InputPacketHeader must be 4 bytes
 ///   [20-21] nack_seq_1                (network order)
 ///
 /// The first 2 NACKs are inlined; additional NACKs are appended as
-/// extended uint16_t entries after the base packet.
+/// extended uint16_t entries after the base packet.  If flags has
+/// QOS_FLAG_ECHO set, an 8-byte RTT echo (see cs/qos/feedback_packet.h)
+/// sits between the base packet and the extended NACKs, followed by a
+/// 4-byte LTR acknowledgement if QOS_FLAG_LTR_ACK is set.
 
 struct QosFeedbackPacket {
     uint8_t  type;                        // 0xFB
@@ -267,45 +463,78 @@ struct QosFeedbackPacket {
     uint16_t nack_seq_0;                  // first inline NACK
     uint16_t nack_seq_1;                  // second inline NACK
 
-    void toNetwork() {
-        last_seq_received  = htons(last_seq_received);
-        estimated_bw_kbps  = htonl(estimated_bw_kbps);
-        packet_loss_x100   = htons(packet_loss_x100);
-        avg_jitter_us      = htons(avg_jitter_us);
-        delay_gradient_us  = static_cast<int32_t>(htonl(static_cast<uint32_t>(delay_gradient_us)));
-        nack_count         = htons(nack_count);
-        nack_seq_0         = htons(nack_seq_0);
-        nack_seq_1         = htons(nack_seq_1);
-    }
-    void toHost() {
-        last_seq_received  = ntohs(last_seq_received);
-        estimated_bw_kbps  = ntohl(estimated_bw_kbps);
-        packet_loss_x100   = ntohs(packet_loss_x100);
-        avg_jitter_us      = ntohs(avg_jitter_us);
-        delay_gradient_us  = static_cast<int32_t>(ntohl(static_cast<uint32_t>(delay_gradient_us)));
-        nack_count         = ntohs(nack_count);
-        nack_seq_0         = ntohs(nack_seq_0);
-        nack_seq_1         = ntohs(nack_seq_1);
-    }
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&QosFeedbackPacket::type, &QosFeedbackPacket::flags,
+                            &QosFeedbackPacket::last_seq_received,
+                            &QosFeedbackPacket::estimated_bw_kbps,
+                            &QosFeedbackPacket::packet_loss_x100,
+                            &QosFeedbackPacket::avg_jitter_us,
+                            &QosFeedbackPacket::delay_gradient_us,
+                            &QosFeedbackPacket::nack_count, &QosFeedbackPacket::nack_seq_0,
+                            &QosFeedbackPacket::nack_seq_1>;
 
-    std::vector<uint8_t> serialize() const {
-        QosFeedbackPacket net = *this;
-        net.toNetwork();
-        std::vector<uint8_t> buf(sizeof(QosFeedbackPacket));
-        std::memcpy(buf.data(), &net, sizeof(net));
-        return buf;
-    }
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
 
     static bool deserialize(const uint8_t* data, size_t len,
                             QosFeedbackPacket& out) {
-        if (len < sizeof(QosFeedbackPacket)) return false;
-        std::memcpy(&out, data, sizeof(QosFeedbackPacket));
-        out.toHost();
-        return true;
+        return decodeHeader(ConstByteSpan(data, len), out);
     }
 };
 static_assert(sizeof(QosFeedbackPacket) == 22,
               "QosFeedbackPacket base is 22 bytes");
+static_assert(checkWireSchema<QosFeedbackPacket>(), "QosFeedbackPacket::Wire must list every field");
+
+/// FEC packet header -- 13 bytes on the wire, followed by one parity shard.
+///
+///   [0]     type = 0xFC
+///   [1-2]   sequence_number    (network order, shares the video seq space)
+///   [3]     group_id
+///   [4]     data_count         (k data packets protected by this group)
+///   [5]     parity_count       (m parity packets in this group)
+///   [6]     parity_index       (0 .. m-1)
+///   [7-8]   frame_number       (network order)
+///   [9-10]  base_sequence      (network order, seq of the group's first data packet)
+///   [11-12] symbol_length      (network order, parity shard length)
+///
+/// The protected data packets are the serialized video packets (header +
+/// payload) with sequence numbers base_sequence .. base_sequence + k - 1,
+/// zero-padded to symbol_length.  A recovered shard carries its own video
+/// header, so its true length is the header's wire size + payload_length.
+struct FecPacketHeader {
+    uint8_t  type;              // 0xFC
+    uint16_t sequence_number;
+    uint8_t  group_id;
+    uint8_t  data_count;
+    uint8_t  parity_count;
+    uint8_t  parity_index;
+    uint16_t frame_number;
+    uint16_t base_sequence;
+    uint16_t symbol_length;
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&FecPacketHeader::type, &FecPacketHeader::sequence_number,
+                            &FecPacketHeader::group_id, &FecPacketHeader::data_count,
+                            &FecPacketHeader::parity_count, &FecPacketHeader::parity_index,
+                            &FecPacketHeader::frame_number, &FecPacketHeader::base_sequence,
+                            &FecPacketHeader::symbol_length>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this header in network byte order to |out| (which must hold
+    /// sizeof(FecPacketHeader) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(FecPacketHeader)));
+    }
+
+    static bool deserialize(const uint8_t* data, size_t len,
+                            FecPacketHeader& out) {
+        return decodeHeader(ConstByteSpan(data, len), out);
+    }
+};
+static_assert(sizeof(FecPacketHeader) == 13, "FecPacketHeader must be 13 bytes");
+static_assert(checkWireSchema<FecPacketHeader>(), "FecPacketHeader::Wire must list every field");
 
 // ---------------------------------------------------------------------------
 // Input event payloads
@@ -316,12 +545,15 @@ struct MouseMoveEvent {
     int16_t dy;
     uint8_t buttons;       // bitmask of currently held buttons
 
-    void toNetwork() { dx = static_cast<int16_t>(htons(static_cast<uint16_t>(dx)));
-                       dy = static_cast<int16_t>(htons(static_cast<uint16_t>(dy))); }
-    void toHost()    { dx = static_cast<int16_t>(ntohs(static_cast<uint16_t>(dx)));
-                       dy = static_cast<int16_t>(ntohs(static_cast<uint16_t>(dy))); }
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&MouseMoveEvent::dx, &MouseMoveEvent::dy,
+                            &MouseMoveEvent::buttons>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
 };
 static_assert(sizeof(MouseMoveEvent) == 5, "MouseMoveEvent must be 5 bytes");
+static_assert(checkWireSchema<MouseMoveEvent>(), "MouseMoveEvent::Wire must list every field");
 
 struct MouseButtonEvent {
     uint8_t button;        // 0=left, 1=right, 2=middle, ...
@@ -334,27 +566,103 @@ struct KeyEvent {
     uint8_t  action;       // 0=release, 1=press
     uint8_t  modifiers;    // bitmask: 1=Shift, 2=Ctrl, 4=Alt, 8=Meta
 
-    void toNetwork() { keycode = htons(keycode); }
-    void toHost()    { keycode = ntohs(keycode); }
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&KeyEvent::keycode, &KeyEvent::action, &KeyEvent::modifiers>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
 };
 static_assert(sizeof(KeyEvent) == 4, "KeyEvent must be 4 bytes");
+static_assert(checkWireSchema<KeyEvent>(), "KeyEvent::Wire must list every field");
 
 struct ScrollEvent {
     int16_t dx;
     int16_t dy;
 
-    void toNetwork() { dx = static_cast<int16_t>(htons(static_cast<uint16_t>(dx)));
-                       dy = static_cast<int16_t>(htons(static_cast<uint16_t>(dy))); }
-    void toHost()    { dx = static_cast<int16_t>(ntohs(static_cast<uint16_t>(dx)));
-                       dy = static_cast<int16_t>(ntohs(static_cast<uint16_t>(dy))); }
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&ScrollEvent::dx, &ScrollEvent::dy>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
 };
 static_assert(sizeof(ScrollEvent) == 4, "ScrollEvent must be 4 bytes");
+static_assert(checkWireSchema<ScrollEvent>(), "ScrollEvent::Wire must list every field");
+
+// ---------------------------------------------------------------------------
+// Input batch -- a send interval's input in one packet (InputType::BATCH)
+//
+// Relative mouse motion is summed over the interval, and the previous
+// batch's sum rides along so that one lost batch costs no motion.
+// Buttons, keys and scrolls go out at once and again in the next few
+// batches; the host applies each once, by sequence number, from whichever
+// copy arrives first.  A batch is injected as a unit: its motion, then its
+// events in order.
+//
+//   [0-1]   batch_seq    (network order)
+//   [2-5]   timestamp_us viewer clock when sent, low 32 bits (network order)
+//   [6-7]   dx           summed motion (int16, network order)
+//   [8-9]   dy
+//   [10-11] prev_dx      the previous batch's motion
+//   [12-13] prev_dy
+//   [14]    buttons      held at the end of the interval
+//   [15]    event_count  InputBatchEvent records that follow
+// ---------------------------------------------------------------------------
+struct InputBatchHeader {
+    uint16_t batch_seq;
+    uint32_t timestamp_us;
+    int16_t  dx;
+    int16_t  dy;
+    int16_t  prev_dx;
+    int16_t  prev_dy;
+    uint8_t  buttons;
+    uint8_t  event_count;
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&InputBatchHeader::batch_seq, &InputBatchHeader::timestamp_us,
+                            &InputBatchHeader::dx, &InputBatchHeader::dy,
+                            &InputBatchHeader::prev_dx, &InputBatchHeader::prev_dy,
+                            &InputBatchHeader::buttons, &InputBatchHeader::event_count>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+};
+static_assert(sizeof(InputBatchHeader) == 16, "InputBatchHeader must be 16 bytes");
+static_assert(checkWireSchema<InputBatchHeader>(), "InputBatchHeader::Wire must list every field");
+
+/// One discrete event in a batch -- 12 bytes.
+///
+///   [0-1]  seq           per-event sequence (network order)
+///   [2]    input_type    MOUSE_BUTTON, KEY or SCROLL
+///   [3]    reserved
+///   [4-7]  timestamp_us  viewer clock when captured (network order)
+///   [8-11] data          the MouseButtonEvent / KeyEvent / ScrollEvent, as
+///                        on the wire alone, zero-padded
+struct InputBatchEvent {
+    uint16_t seq;
+    uint8_t  input_type;
+    uint8_t  reserved;
+    uint32_t timestamp_us;
+    uint8_t  data[4];
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&InputBatchEvent::seq, &InputBatchEvent::input_type,
+                            &InputBatchEvent::reserved, &InputBatchEvent::timestamp_us,
+                            &InputBatchEvent::data>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+};
+static_assert(sizeof(InputBatchEvent) == 12, "InputBatchEvent must be 12 bytes");
+static_assert(checkWireSchema<InputBatchEvent>(), "InputBatchEvent::Wire must list every field");
+
+constexpr size_t INPUT_BATCH_MAX_EVENTS = 8;
 
 // ---------------------------------------------------------------------------
 // Controller state packet -- 15 bytes on the wire.
 //
-// Full-state (not delta) so lost packets are self-healing.
-// Sent on-change only, polled at up to 120Hz on the viewer side.
+// Full-state (not delta) so lost packets are self-healing.  Sent on its own
+// by older viewers; current ones send the state stream below, and this
+// struct holds a controller's state at either end.
 //
 //   [0]   type = 0x40
 //   [1]   controller_id (0-3, XInput limit)
@@ -379,45 +687,179 @@ struct ControllerPacket {
     int16_t  thumb_rx;
     int16_t  thumb_ry;
 
-    void toNetwork() {
-        sequence = htons(sequence);
-        buttons  = htons(buttons);
-        thumb_lx = static_cast<int16_t>(htons(static_cast<uint16_t>(thumb_lx)));
-        thumb_ly = static_cast<int16_t>(htons(static_cast<uint16_t>(thumb_ly)));
-        thumb_rx = static_cast<int16_t>(htons(static_cast<uint16_t>(thumb_rx)));
-        thumb_ry = static_cast<int16_t>(htons(static_cast<uint16_t>(thumb_ry)));
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&ControllerPacket::type, &ControllerPacket::controller_id,
+                            &ControllerPacket::sequence, &ControllerPacket::buttons,
+                            &ControllerPacket::left_trigger,
+                            &ControllerPacket::right_trigger, &ControllerPacket::thumb_lx,
+                            &ControllerPacket::thumb_ly, &ControllerPacket::thumb_rx,
+                            &ControllerPacket::thumb_ry>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    static bool deserialize(const uint8_t* data, size_t len,
+                            ControllerPacket& out) {
+        return decodeHeader(ConstByteSpan(data, len), out);
     }
-    void toHost() {
-        sequence = ntohs(sequence);
-        buttons  = ntohs(buttons);
-        thumb_lx = static_cast<int16_t>(ntohs(static_cast<uint16_t>(thumb_lx)));
-        thumb_ly = static_cast<int16_t>(ntohs(static_cast<uint16_t>(thumb_ly)));
-        thumb_rx = static_cast<int16_t>(ntohs(static_cast<uint16_t>(thumb_rx)));
-        thumb_ry = static_cast<int16_t>(ntohs(static_cast<uint16_t>(thumb_ry)));
+};
+static_assert(sizeof(ControllerPacket) == 16, "ControllerPacket must be 16 bytes");
+static_assert(checkWireSchema<ControllerPacket>(), "ControllerPacket::Wire must list every field");
+
+// ---------------------------------------------------------------------------
+// Controller state stream (InputType::CONTROLLER_STATE)
+//
+// The viewer polls its controllers at a fixed rate and sends, in one input
+// packet per poll, a record for each controller whose state the host has
+// not acknowledged: only the fields that differ from the last acked state,
+// or the whole state when there is no ack to build on and periodically as
+// a keyframe.  A state the host already has is not sent again, so an idle
+// controller costs nothing; an unacked one is resent every poll, so a loss
+// is repaired within one poll interval of the next packet getting through.
+//
+// Record -- 6 bytes, then the fields present in mask order:
+//   [0]    controller_id (bits 0-1) | CONTROLLER_STATE_FULL
+//   [1]    fields present (CONTROLLER_FIELD_*)
+//   [2-3]  seq       this state's sequence, per controller (network order)
+//   [4-5]  base_seq  acked state the fields are relative to (delta only)
+//   [..]   buttons(2) left_trigger(1) right_trigger(1) thumb_lx(2)
+//          thumb_ly(2) thumb_rx(2) thumb_ry(2), network order
+//
+// Ack (0x09) -- 10 bytes:
+//   [0]     type = 0x09
+//   [1]     controllers acked (bit n = controller n)
+//   [2-9]   four seq fields, the last state applied per controller
+// ---------------------------------------------------------------------------
+constexpr uint8_t CONTROLLER_STATE_FULL   = 0x80;
+constexpr uint8_t CONTROLLER_FIELD_BUTTONS = 0x01;
+constexpr uint8_t CONTROLLER_FIELD_LT      = 0x02;
+constexpr uint8_t CONTROLLER_FIELD_RT      = 0x04;
+constexpr uint8_t CONTROLLER_FIELD_LX      = 0x08;
+constexpr uint8_t CONTROLLER_FIELD_LY      = 0x10;
+constexpr uint8_t CONTROLLER_FIELD_RX      = 0x20;
+constexpr uint8_t CONTROLLER_FIELD_RY      = 0x40;
+constexpr uint8_t CONTROLLER_FIELDS_ALL    = 0x7F;
+constexpr size_t  CONTROLLER_MAX          = 4;      // XInput limit
+constexpr size_t  CONTROLLER_RECORD_MAX   = 6 + 12; // Full record
+
+struct ControllerStateRecord {
+    uint8_t  id_flags;
+    uint8_t  fields;
+    uint16_t seq;
+    uint16_t base_seq;
+
+    /// Fields in which |a| and |b| differ.
+    static uint8_t diff(const ControllerPacket& a, const ControllerPacket& b) {
+        uint8_t f = 0;
+        if (a.buttons       != b.buttons)       f |= CONTROLLER_FIELD_BUTTONS;
+        if (a.left_trigger  != b.left_trigger)  f |= CONTROLLER_FIELD_LT;
+        if (a.right_trigger != b.right_trigger) f |= CONTROLLER_FIELD_RT;
+        if (a.thumb_lx      != b.thumb_lx)      f |= CONTROLLER_FIELD_LX;
+        if (a.thumb_ly      != b.thumb_ly)      f |= CONTROLLER_FIELD_LY;
+        if (a.thumb_rx      != b.thumb_rx)      f |= CONTROLLER_FIELD_RX;
+        if (a.thumb_ry      != b.thumb_ry)      f |= CONTROLLER_FIELD_RY;
+        return f;
     }
 
-    std::vector<uint8_t> serialize() const {
-        ControllerPacket net = *this;
+    /// Write |state| to |out| (CONTROLLER_RECORD_MAX bytes): every field
+    /// with |base| null, else those differing from |base|.  Returns the
+    /// number of bytes written.
+    static size_t encode(const ControllerPacket& state, const ControllerPacket* base,
+                         uint8_t* out) {
+        ControllerStateRecord rec;
+        rec.id_flags = static_cast<uint8_t>(state.controller_id & 0x03) |
+                       (base ? 0 : CONTROLLER_STATE_FULL);
+        rec.fields   = base ? diff(state, *base) : CONTROLLER_FIELDS_ALL;
+        rec.seq      = htons(state.sequence);
+        rec.base_seq = htons(base ? base->sequence : 0);
+        std::memcpy(out, &rec, sizeof(rec));
+
+        ControllerPacket net = state;
         net.toNetwork();
-        std::vector<uint8_t> buf(sizeof(ControllerPacket));
-        std::memcpy(buf.data(), &net, sizeof(net));
-        return buf;
+        size_t n = sizeof(rec);
+        auto put = [&](uint8_t bit, const void* field, size_t size) {
+            if (rec.fields & bit) { std::memcpy(out + n, field, size); n += size; }
+        };
+        put(CONTROLLER_FIELD_BUTTONS, &net.buttons, 2);
+        put(CONTROLLER_FIELD_LT, &net.left_trigger, 1);
+        put(CONTROLLER_FIELD_RT, &net.right_trigger, 1);
+        put(CONTROLLER_FIELD_LX, &net.thumb_lx, 2);
+        put(CONTROLLER_FIELD_LY, &net.thumb_ly, 2);
+        put(CONTROLLER_FIELD_RX, &net.thumb_rx, 2);
+        put(CONTROLLER_FIELD_RY, &net.thumb_ry, 2);
+        return n;
+    }
+
+    /// Read the record at |data| into |rec| and its fields over |state|
+    /// (the base state for a delta).  Returns the record's length, or 0 if
+    /// |len| is too short for it.
+    static size_t decode(const uint8_t* data, size_t len, ControllerStateRecord& rec,
+                         ControllerPacket& state) {
+        if (len < sizeof(ControllerStateRecord)) return 0;
+        std::memcpy(&rec, data, sizeof(rec));
+        rec.seq      = ntohs(rec.seq);
+        rec.base_seq = ntohs(rec.base_seq);
+
+        ControllerPacket net = state;
+        net.toNetwork();
+        size_t n = sizeof(rec);
+        bool ok = true;
+        auto get = [&](uint8_t bit, void* field, size_t size) {
+            if (!(rec.fields & bit)) return;
+            if (n + size > len) { ok = false; return; }
+            std::memcpy(field, data + n, size);
+            n += size;
+        };
+        get(CONTROLLER_FIELD_BUTTONS, &net.buttons, 2);
+        get(CONTROLLER_FIELD_LT, &net.left_trigger, 1);
+        get(CONTROLLER_FIELD_RT, &net.right_trigger, 1);
+        get(CONTROLLER_FIELD_LX, &net.thumb_lx, 2);
+        get(CONTROLLER_FIELD_LY, &net.thumb_ly, 2);
+        get(CONTROLLER_FIELD_RX, &net.thumb_rx, 2);
+        get(CONTROLLER_FIELD_RY, &net.thumb_ry, 2);
+        if (!ok) return 0;
+
+        net.toHost();
+        state = net;
+        state.type          = static_cast<uint8_t>(PacketType::CONTROLLER);
+        state.controller_id = rec.id_flags & 0x03;
+        state.sequence      = rec.seq;
+        return n;
+    }
+};
+static_assert(sizeof(ControllerStateRecord) == 6, "ControllerStateRecord must be 6 bytes");
+
+struct ControllerAckPacket {
+    uint8_t  type;          // 0x09
+    uint8_t  mask;
+    uint16_t seq[CONTROLLER_MAX];
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&ControllerAckPacket::type, &ControllerAckPacket::mask,
+                            &ControllerAckPacket::seq>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this packet in network byte order to |out| (which must hold
+    /// sizeof(ControllerAckPacket) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(ControllerAckPacket)));
     }
 
     static bool deserialize(const uint8_t* data, size_t len,
-                            ControllerPacket& out) {
-        if (len < sizeof(ControllerPacket)) return false;
-        std::memcpy(&out, data, sizeof(ControllerPacket));
-        out.toHost();
-        return true;
+                            ControllerAckPacket& out) {
+        return decodeHeader(ConstByteSpan(data, len), out);
     }
 };
-static_assert(sizeof(ControllerPacket) == 16, "ControllerPacket must be 16 bytes");
+static_assert(sizeof(ControllerAckPacket) == 10, "ControllerAckPacket must be 10 bytes");
+static_assert(checkWireSchema<ControllerAckPacket>(), "ControllerAckPacket::Wire must list every field");
 
 // ---------------------------------------------------------------------------
-// Clipboard packet -- 8 byte header + variable payload.
+// Clipboard packet -- 12 byte header + variable payload.
 //
-// Text-only in v1. Sent reliably via ACK + retry (3x at 200ms).
+// Legacy single-packet form, text only: still accepted and acked, but
+// clipboard changes are now sent as chunked transfers (below).
 //
 //   [0]   type = 0x50 (or 0x51 for ACK)
 //   [1]   direction: 0=viewer->host, 1=host->viewer
@@ -443,14 +885,15 @@ struct ClipboardPacketHeader {
     uint8_t  reserved[3];
     uint32_t length;            // payload length in bytes
 
-    void toNetwork() {
-        sequence = htons(sequence);
-        length   = htonl(length);
-    }
-    void toHost() {
-        sequence = ntohs(sequence);
-        length   = ntohl(length);
-    }
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&ClipboardPacketHeader::type, &ClipboardPacketHeader::direction,
+                            &ClipboardPacketHeader::sequence,
+                            &ClipboardPacketHeader::format,
+                            &ClipboardPacketHeader::reserved,
+                            &ClipboardPacketHeader::length>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
 
     std::vector<uint8_t> serialize(const uint8_t* payload = nullptr,
                                    size_t payloadLen = 0) const {
@@ -466,25 +909,27 @@ struct ClipboardPacketHeader {
 
     static bool deserialize(const uint8_t* data, size_t len,
                             ClipboardPacketHeader& out) {
-        if (len < sizeof(ClipboardPacketHeader)) return false;
-        std::memcpy(&out, data, sizeof(ClipboardPacketHeader));
-        out.toHost();
-        return true;
+        return decodeHeader(ConstByteSpan(data, len), out);
     }
 };
 static_assert(sizeof(ClipboardPacketHeader) == 12, "ClipboardPacketHeader must be 12 bytes");
+static_assert(checkWireSchema<ClipboardPacketHeader>(), "ClipboardPacketHeader::Wire must list every field");
 
-/// Clipboard ACK -- 4 bytes on the wire.
+/// Clipboard ACK -- 4 bytes on the wire (legacy single-packet form).
 ///   [0]   type = 0x51
-///   [1]   reserved
+///   [1]   reserved (0; ClipboardWindowAckPacket sets its WINDOW flag here)
 ///   [2-3] ack_sequence (network order)
 struct ClipboardAckPacket {
     uint8_t  type;          // 0x51
     uint8_t  reserved;
     uint16_t ack_sequence;
 
-    void toNetwork() { ack_sequence = htons(ack_sequence); }
-    void toHost()    { ack_sequence = ntohs(ack_sequence); }
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&ClipboardAckPacket::type, &ClipboardAckPacket::reserved,
+                            &ClipboardAckPacket::ack_sequence>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
 
     std::vector<uint8_t> serialize() const {
         ClipboardAckPacket net = *this;
@@ -496,13 +941,534 @@ struct ClipboardAckPacket {
 
     static bool deserialize(const uint8_t* data, size_t len,
                             ClipboardAckPacket& out) {
-        if (len < sizeof(ClipboardAckPacket)) return false;
-        std::memcpy(&out, data, sizeof(ClipboardAckPacket));
+        return decodeHeader(ConstByteSpan(data, len), out);
+    }
+};
+static_assert(sizeof(ClipboardAckPacket) == 4, "ClipboardAckPacket must be 4 bytes");
+static_assert(checkWireSchema<ClipboardAckPacket>(), "ClipboardAckPacket::Wire must list every field");
+
+// ---------------------------------------------------------------------------
+// Clipboard chunk -- 28 byte header + up to CLIPBOARD_CHUNK_BYTES of payload.
+//
+// A clipboard change is one transfer: the text, LZ4-compressed when that
+// pays (cs/transport/lz4_block.h), cut into fixed-size chunks that are
+// each sent in their own datagram on the bulk lane.  Every chunk repeats
+// the transfer's description, so whichever arrives first opens it.  The
+// content hash (FNV-1a 64 of the uncompressed text) lets a side that
+// already holds the content acknowledge the whole transfer at once.
+//
+//   [0]     type = 0x0B
+//   [1]     direction: 0=viewer->host, 1=host->viewer
+//   [2-3]   transfer (network order; a newer one supersedes)
+//   [4]     format: 1=UTF-8 text
+//   [5]     flags (bit 0: LZ4)
+//   [6-7]   chunk index (network order)
+//   [8-9]   chunk count (network order)
+//   [10-11] reserved
+//   [12-15] raw length (network order, uncompressed)
+//   [16-19] encoded length (network order, sum of all chunk payloads)
+//   [20-27] content hash (network order, high word first)
+// ---------------------------------------------------------------------------
+constexpr size_t  CLIPBOARD_CHUNK_BYTES = 1024;  // Payload of every chunk but the last
+constexpr uint8_t CLIPBOARD_FLAG_LZ4    = 0x01;
+
+struct ClipboardChunkHeader {
+    uint8_t  type;              // 0x0B
+    uint8_t  direction;         // ClipboardDirection
+    uint16_t transfer;
+    uint8_t  format;            // ClipboardFormat
+    uint8_t  flags;
+    uint16_t chunk_index;
+    uint16_t chunk_count;
+    uint16_t reserved;
+    uint32_t raw_length;
+    uint32_t encoded_length;
+    uint32_t hash_hi;
+    uint32_t hash_lo;
+
+    uint64_t contentHash() const {
+        return (static_cast<uint64_t>(hash_hi) << 32) | hash_lo;
+    }
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&ClipboardChunkHeader::type, &ClipboardChunkHeader::direction,
+                            &ClipboardChunkHeader::transfer, &ClipboardChunkHeader::format,
+                            &ClipboardChunkHeader::flags,
+                            &ClipboardChunkHeader::chunk_index,
+                            &ClipboardChunkHeader::chunk_count,
+                            &ClipboardChunkHeader::reserved,
+                            &ClipboardChunkHeader::raw_length,
+                            &ClipboardChunkHeader::encoded_length,
+                            &ClipboardChunkHeader::hash_hi, &ClipboardChunkHeader::hash_lo>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write the header to |out| (which must hold sizeof(ClipboardChunkHeader)
+    /// bytes) in network order.  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(ClipboardChunkHeader)));
+    }
+
+    static bool deserialize(const uint8_t* data, size_t len,
+                            ClipboardChunkHeader& out) {
+        return decodeHeader(ConstByteSpan(data, len), out);
+    }
+};
+static_assert(sizeof(ClipboardChunkHeader) == 28, "ClipboardChunkHeader must be 28 bytes");
+static_assert(checkWireSchema<ClipboardChunkHeader>(), "ClipboardChunkHeader::Wire must list every field");
+
+/// Clipboard window ACK -- 12 bytes on the wire.  The chunked form of
+/// CLIP_ACK, with its own type byte: the WINDOW flag sits in the byte a
+/// legacy ack leaves reserved, and the transfer where it carries its
+/// sequence, so one is never taken for the other.
+///   [0]     type = 0x0A
+///   [1]     flags (bit 0: WINDOW)
+///   [2-3]   transfer (network order)
+///   [4-5]   cumulative: chunks below this index have all arrived
+///   [6-7]   reserved
+///   [8-11]  mask: bit i set = chunk cumulative + 1 + i has arrived
+/// A completed transfer is acked with cumulative = chunk count.
+struct ClipboardWindowAckPacket {
+    uint8_t  type;          // 0x0A
+    uint8_t  flags;
+    uint16_t transfer;
+    uint16_t cumulative;
+    uint16_t reserved;
+    uint32_t mask;
+
+    static constexpr uint8_t FLAG_WINDOW = 0x01;
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&ClipboardWindowAckPacket::type,
+                            &ClipboardWindowAckPacket::flags,
+                            &ClipboardWindowAckPacket::transfer,
+                            &ClipboardWindowAckPacket::cumulative,
+                            &ClipboardWindowAckPacket::reserved,
+                            &ClipboardWindowAckPacket::mask>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this packet to |out| (which must hold
+    /// sizeof(ClipboardWindowAckPacket) bytes) in network order.
+    /// Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(ClipboardWindowAckPacket)));
+    }
+
+    /// False for a legacy ClipboardAckPacket.
+    static bool deserialize(const uint8_t* data, size_t len,
+                            ClipboardWindowAckPacket& out) {
+        return decodeHeader(ConstByteSpan(data, len), out) && (out.flags & FLAG_WINDOW);
+    }
+};
+static_assert(sizeof(ClipboardWindowAckPacket) == 12, "ClipboardWindowAckPacket must be 12 bytes");
+static_assert(checkWireSchema<ClipboardWindowAckPacket>(), "ClipboardWindowAckPacket::Wire must list every field");
+
+// ---------------------------------------------------------------------------
+// Path MTU probe / ack -- 6 bytes on the wire.
+//
+// The host pads each probe with zeros to the datagram size being tested
+// (probe_size, counted on the wire including any AEAD overhead) and sends
+// it with DF set.  The viewer answers every probe that arrives intact with
+// a 6-byte ack echoing probe_id and probe_size; the largest acked size
+// becomes the session's datagram limit.
+//
+//   [0]   type = 0xF8 (probe) or 0xF9 (ack)
+//   [1]   reserved
+//   [2-3] probe_id   (network order)
+//   [4-5] probe_size (network order)
+// ---------------------------------------------------------------------------
+struct PathProbePacket {
+    uint8_t  type;          // 0xF8 / 0xF9
+    uint8_t  reserved;
+    uint16_t probe_id;
+    uint16_t probe_size;
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&PathProbePacket::type, &PathProbePacket::reserved,
+                            &PathProbePacket::probe_id, &PathProbePacket::probe_size>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this packet in network byte order to |out| (which must hold
+    /// sizeof(PathProbePacket) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(PathProbePacket)));
+    }
+
+    static bool deserialize(const uint8_t* data, size_t len,
+                            PathProbePacket& out) {
+        return decodeHeader(ConstByteSpan(data, len), out);
+    }
+};
+static_assert(sizeof(PathProbePacket) == 6, "PathProbePacket must be 6 bytes");
+static_assert(checkWireSchema<PathProbePacket>(), "PathProbePacket::Wire must list every field");
+
+// ---------------------------------------------------------------------------
+// Path challenge / response -- 10 bytes on the wire, always sealed.
+//
+// The viewer sends a challenge on every path it holds once a consent
+// interval (RFC 7675 consent freshness): on the active one to learn it
+// still reaches the host, on a standby one to keep it validated and its
+// NAT binding open.  The host answers each challenge that opens with the
+// session's media keys, to the address it came from, echoing nonce and
+// flags.  Sealing proves the viewer sent a challenge, not that the address
+// it came from reaches the viewer (a source can be rewritten on the way).
+//
+// A challenge with MIGRATE set also moves the host's stream to the address
+// it came from, once that address has answered a challenge the host sends
+// there in turn (path validation, as in QUIC); the viewer answers those on
+// the socket they arrive on.  The viewer switches once the response to its
+// own challenge arrives there, and reads the old socket for a while after.
+// The DTLS session, media keys and sequence spaces carry over, so no
+// handshake or keyframe is needed.
+//
+//   [0]     type = 0xF4 (challenge) or 0xF5 (response)
+//   [1]     flags (bit 0: MIGRATE)
+//   [2-9]   nonce (opaque, echoed as is)
+// ---------------------------------------------------------------------------
+struct PathChallengePacket {
+    uint8_t  type;          // 0xF4 / 0xF5
+    uint8_t  flags;
+    uint64_t nonce;
+
+    static constexpr uint8_t FLAG_MIGRATE = 0x01;
+
+    bool migrate() const { return (flags & FLAG_MIGRATE) != 0; }
+
+    /// Write this packet to |out| (which must hold
+    /// sizeof(PathChallengePacket) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        std::memcpy(out, this, sizeof(*this));
+        return sizeof(*this);
+    }
+
+    static bool deserialize(const uint8_t* data, size_t len,
+                            PathChallengePacket& out) {
+        if (len < sizeof(PathChallengePacket)) return false;
+        std::memcpy(&out, data, sizeof(PathChallengePacket));
+        return true;
+    }
+};
+static_assert(sizeof(PathChallengePacket) == 10, "PathChallengePacket must be 10 bytes");
+
+// ---------------------------------------------------------------------------
+// RTT probe -- 14 bytes on the wire.
+//
+// The host answers each QoS feedback report with a probe stamped with its
+// own clock.  The viewer echoes send_time_us in its next report together
+// with how long it held the probe, so the host measures
+//   rtt = now - send_time_us - hold_time
+// without the two clocks having to agree.  The host's current smoothed RTT
+// and variance ride along so the viewer can time its NACK retries.
+//
+// Once the host has estimated the offset between its clock and the
+// viewer's (the echo also carries when the probe arrived), it sets
+// RTT_PROBE_FLAG_CLOCK and appends an RttProbeClock: the viewer then maps
+// host timestamps onto its own clock.
+//
+//   [0]     type = 0xF7
+//   [1]     flags (RTT_PROBE_FLAG_*; 0 from older hosts)
+//   [2-5]   send_time_us  (host clock, low 32 bits; network order)
+//   [6-9]   srtt_us       (network order; 0 = no estimate yet)
+//   [10-13] rttvar_us     (network order)
+//   [14-21] RttProbeClock, if RTT_PROBE_FLAG_CLOCK
+// ---------------------------------------------------------------------------
+static constexpr uint8_t RTT_PROBE_FLAG_CLOCK = 0x01;
+
+struct RttProbePacket {
+    uint8_t  type;          // 0xF7
+    uint8_t  flags;         // RTT_PROBE_FLAG_*
+    uint32_t send_time_us;
+    uint32_t srtt_us;
+    uint32_t rttvar_us;
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&RttProbePacket::type, &RttProbePacket::flags,
+                            &RttProbePacket::send_time_us, &RttProbePacket::srtt_us,
+                            &RttProbePacket::rttvar_us>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this packet in network byte order to |out| (which must hold
+    /// sizeof(RttProbePacket) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(RttProbePacket)));
+    }
+
+    static bool deserialize(const uint8_t* data, size_t len,
+                            RttProbePacket& out) {
+        return decodeHeader(ConstByteSpan(data, len), out);
+    }
+};
+static_assert(sizeof(RttProbePacket) == 14, "RttProbePacket must be 14 bytes");
+static_assert(checkWireSchema<RttProbePacket>(), "RttProbePacket::Wire must list every field");
+
+/// Clock estimate following an RttProbePacket -- 8 bytes on the wire.
+///
+///   [0-3]   offset_us  (viewer clock minus host clock, modulo 2^32; network order)
+///   [4-7]   error_us   (bound on the offset's error; network order)
+struct RttProbeClock {
+    uint32_t offset_us;
+    uint32_t error_us;
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&RttProbeClock::offset_us, &RttProbeClock::error_us>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this trailer in network byte order to |out| (which must hold
+    /// sizeof(RttProbeClock) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(RttProbeClock)));
+    }
+
+    /// Read the trailer of the probe at |data| (|len| bytes in all).
+    /// False if it has none.
+    static bool deserialize(const uint8_t* data, size_t len, RttProbeClock& out) {
+        if (len < sizeof(RttProbePacket) + sizeof(RttProbeClock) ||
+            !(data[1] & RTT_PROBE_FLAG_CLOCK)) {
+            return false;
+        }
+        std::memcpy(&out, data + sizeof(RttProbePacket), sizeof(RttProbeClock));
         out.toHost();
         return true;
     }
 };
-static_assert(sizeof(ClipboardAckPacket) == 4, "ClipboardAckPacket must be 4 bytes");
+static_assert(sizeof(RttProbeClock) == 8, "RttProbeClock must be 8 bytes");
+static_assert(checkWireSchema<RttProbeClock>(), "RttProbeClock::Wire must list every field");
+
+// ---------------------------------------------------------------------------
+// Frame loss report -- 10 bytes on the wire.
+//
+// Sent by the client when frames are lost for good (NACK and FEC could not
+// repair them in time) and again every retry interval until a keyframe or
+// a recovery-flagged frame newer than last_frame arrives.  The host
+// invalidates the encoder references from first_frame on, so the next frame
+// predicts from the last frame the client holds; if the encoder cannot do
+// that it falls back to an IDR.
+//
+// Frame numbers are the video header's; a version-1 session only carries
+// their low 16 bits, which the host unwraps against its own counter.  From
+// CS05 the flags byte's high nibble names the video stream they belong to.
+//
+//   [0]     type = 0xF6
+//   [1]     stream ID (4, high bits) | reserved (4, 0)
+//   [2-5]   first_frame   (network order)
+//   [6-9]   last_frame    (network order, inclusive)
+// ---------------------------------------------------------------------------
+struct FrameLossPacket {
+    uint8_t  type;          // 0xF6
+    uint8_t  flags;         // Stream ID (high nibble)
+    uint32_t first_frame;
+    uint32_t last_frame;
+
+    uint8_t streamId() const      { return flags >> 4; }
+    void setStreamId(uint8_t id)  { flags = static_cast<uint8_t>((flags & 0x0F) | (id << 4)); }
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&FrameLossPacket::type, &FrameLossPacket::flags,
+                            &FrameLossPacket::first_frame, &FrameLossPacket::last_frame>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this packet in network byte order to |out| (which must hold
+    /// sizeof(FrameLossPacket) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(FrameLossPacket)));
+    }
+
+    static bool deserialize(const uint8_t* data, size_t len,
+                            FrameLossPacket& out) {
+        return decodeHeader(ConstByteSpan(data, len), out);
+    }
+};
+static_assert(sizeof(FrameLossPacket) == 10, "FrameLossPacket must be 10 bytes");
+static_assert(checkWireSchema<FrameLossPacket>(), "FrameLossPacket::Wire must list every field");
+
+// ---------------------------------------------------------------------------
+// Cursor channel (wire v4) -- the pointer travels beside the video.
+//
+// The host samples the pointer far more often than it encodes frames and
+// sends a 12-byte position whenever it moves (and every few hundred ms
+// regardless, so a lost one is soon replaced).  Positions name the shape
+// by hash; a shape is sent once, when the pointer first takes it, in
+// chunks the viewer reassembles and caches by hash.  A viewer that sees a
+// hash it has no complete shape for asks for it again.
+//
+// Type bytes below 0x40 cannot be mistaken for video: every video header
+// the host sends has a non-zero version in the top two bits.
+//
+// Cursor position -- 12 bytes:
+//   [0]     type = 0x0C
+//   [1]     flags: bit 0 = visible
+//   [2-3]   sequence   (network order; older positions are ignored)
+//   [4-5]   x          (int16, network order; hotspot, video pixels)
+//   [6-7]   y          (int16, network order)
+//   [8-11]  shape_hash (network order)
+//
+// Cursor shape chunk -- 16 byte header + up to CURSOR_CHUNK_BYTES of the
+// shape's pixels (width * height BGRA8, straight alpha, rows top down):
+//   [0]     type = 0x0D
+//   [1]     chunk_index
+//   [2]     chunk_count
+//   [3]     reserved
+//   [4-5]   width      (network order)
+//   [6-7]   height     (network order)
+//   [8-9]   hotspot_x  (network order)
+//   [10-11] hotspot_y  (network order)
+//   [12-15] shape_hash (network order)
+//
+// Cursor shape request -- 8 bytes:
+//   [0]     type = 0x0E
+//   [1-3]   reserved
+//   [4-7]   shape_hash (network order)
+// ---------------------------------------------------------------------------
+constexpr size_t   CURSOR_CHUNK_BYTES = 1024;          // Pixels per shape chunk
+constexpr uint32_t CURSOR_MAX_EDGE    = 128;           // Largest shape sent, pixels
+constexpr uint8_t  CURSOR_FLAG_VISIBLE = 0x01;
+
+struct CursorPositionPacket {
+    uint8_t  type;          // 0x0C
+    uint8_t  flags;
+    uint16_t sequence;
+    int16_t  x;
+    int16_t  y;
+    uint32_t shape_hash;
+
+    bool visible() const { return (flags & CURSOR_FLAG_VISIBLE) != 0; }
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&CursorPositionPacket::type, &CursorPositionPacket::flags,
+                            &CursorPositionPacket::sequence, &CursorPositionPacket::x,
+                            &CursorPositionPacket::y, &CursorPositionPacket::shape_hash>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this packet in network byte order to |out| (which must hold
+    /// sizeof(CursorPositionPacket) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(CursorPositionPacket)));
+    }
+
+    static bool deserialize(const uint8_t* data, size_t len,
+                            CursorPositionPacket& out) {
+        return decodeHeader(ConstByteSpan(data, len), out);
+    }
+};
+static_assert(sizeof(CursorPositionPacket) == 12, "CursorPositionPacket must be 12 bytes");
+static_assert(checkWireSchema<CursorPositionPacket>(), "CursorPositionPacket::Wire must list every field");
+
+struct CursorShapeHeader {
+    uint8_t  type;          // 0x0D
+    uint8_t  chunk_index;
+    uint8_t  chunk_count;
+    uint8_t  reserved;
+    uint16_t width;
+    uint16_t height;
+    uint16_t hotspot_x;
+    uint16_t hotspot_y;
+    uint32_t shape_hash;
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&CursorShapeHeader::type, &CursorShapeHeader::chunk_index,
+                            &CursorShapeHeader::chunk_count, &CursorShapeHeader::reserved,
+                            &CursorShapeHeader::width, &CursorShapeHeader::height,
+                            &CursorShapeHeader::hotspot_x, &CursorShapeHeader::hotspot_y,
+                            &CursorShapeHeader::shape_hash>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this header in network byte order to |out| (which must hold
+    /// sizeof(CursorShapeHeader) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(CursorShapeHeader)));
+    }
+
+    static bool deserialize(const uint8_t* data, size_t len,
+                            CursorShapeHeader& out) {
+        return decodeHeader(ConstByteSpan(data, len), out);
+    }
+};
+static_assert(sizeof(CursorShapeHeader) == 16, "CursorShapeHeader must be 16 bytes");
+static_assert(checkWireSchema<CursorShapeHeader>(), "CursorShapeHeader::Wire must list every field");
+
+struct CursorRequestPacket {
+    uint8_t  type;          // 0x0E
+    uint8_t  reserved[3];
+    uint32_t shape_hash;
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&CursorRequestPacket::type, &CursorRequestPacket::reserved,
+                            &CursorRequestPacket::shape_hash>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this packet in network byte order to |out| (which must hold
+    /// sizeof(CursorRequestPacket) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(CursorRequestPacket)));
+    }
+
+    static bool deserialize(const uint8_t* data, size_t len,
+                            CursorRequestPacket& out) {
+        return decodeHeader(ConstByteSpan(data, len), out);
+    }
+};
+static_assert(sizeof(CursorRequestPacket) == 8, "CursorRequestPacket must be 8 bytes");
+static_assert(checkWireSchema<CursorRequestPacket>(), "CursorRequestPacket::Wire must list every field");
+
+// ---------------------------------------------------------------------------
+// Input echo -- closes the input-to-photon loop (host -> viewer)
+//
+// Sent with the first frame captured after an input batch was injected:
+// every batch up to |batch_seq| went in before that frame was grabbed, so
+// once the viewer presents it (or a later frame) it knows how long that
+// input took to reach the screen.  The application's own reaction time is
+// in there only as far as it had drawn by the capture.
+//
+// Input echo -- 8 bytes:
+//   [0]     type = 0x0F
+//   [1]     reserved
+//   [2-3]   batch_seq          last InputBatchHeader::batch_seq injected (network order)
+//   [4-7]   frame_timestamp_us the frame's capture timestamp, low 32 bits (network order)
+// ---------------------------------------------------------------------------
+struct InputEchoPacket {
+    uint8_t  type;          // 0x0F
+    uint8_t  reserved;
+    uint16_t batch_seq;
+    uint32_t frame_timestamp_us;
+
+    // Wire fields, every byte of the struct (see cs/transport/wire.h)
+    using Wire = WireFields<&InputEchoPacket::type, &InputEchoPacket::reserved,
+                            &InputEchoPacket::batch_seq,
+                            &InputEchoPacket::frame_timestamp_us>;
+
+    void toNetwork() { Wire::swap(*this); }
+    void toHost() { Wire::swap(*this); }
+
+    /// Write this packet in network byte order to |out| (which must hold
+    /// sizeof(InputEchoPacket) bytes).  Returns the number of bytes written.
+    size_t serializeTo(uint8_t* out) const {
+        return encodeHeader(*this, ByteSpan(out, sizeof(InputEchoPacket)));
+    }
+
+    static bool deserialize(const uint8_t* data, size_t len,
+                            InputEchoPacket& out) {
+        return decodeHeader(ConstByteSpan(data, len), out);
+    }
+};
+static_assert(sizeof(InputEchoPacket) == 8, "InputEchoPacket must be 8 bytes");
+static_assert(checkWireSchema<InputEchoPacket>(), "InputEchoPacket::Wire must list every field");
 
 #pragma pack(pop)
 
@@ -510,38 +1476,96 @@ static_assert(sizeof(ClipboardAckPacket) == 4, "ClipboardAckPacket must be 4 byt
 // Quick packet-type detection from the first byte(s) of a decrypted datagram
 // ---------------------------------------------------------------------------
 
-/// Identify the packet type from a raw decrypted buffer.
+namespace detail {
+
+/// What the first byte of a datagram can mean.  A dedicated type byte is
+/// tried first; if the datagram is too short for it, the byte is tried as
+/// an audio / input header (type in the low six bits), then as video.
+struct PacketRule {
+    uint8_t type;               // Dedicated PacketType, 0 = none
+    uint8_t min_len;
+    uint8_t embedded;           // Audio / input PacketType, 0 = none
+    uint8_t embedded_min_len;
+};
+
+constexpr std::array<PacketRule, 256> makePacketRules() {
+    std::array<PacketRule, 256> rules{};
+    for (size_t b = 0; b < rules.size(); ++b) {
+        const uint8_t type6 = static_cast<uint8_t>(b & 0x3F);
+        if (type6 == 0x20) {
+            rules[b].embedded         = static_cast<uint8_t>(PacketType::AUDIO);
+            rules[b].embedded_min_len = sizeof(AudioPacketHeader);
+        } else if (type6 == 0x30) {
+            rules[b].embedded         = static_cast<uint8_t>(PacketType::INPUT);
+            rules[b].embedded_min_len = sizeof(InputPacketHeader);
+        }
+    }
+    auto dedicated = [&rules](PacketType type, size_t min_len) {
+        rules[static_cast<uint8_t>(type)].type    = static_cast<uint8_t>(type);
+        rules[static_cast<uint8_t>(type)].min_len = static_cast<uint8_t>(min_len);
+    };
+    dedicated(PacketType::QOS_FEEDBACK,       1);
+    dedicated(PacketType::FEC,                1);
+    dedicated(PacketType::NACK,               1);
+    dedicated(PacketType::CONTROLLER,         sizeof(ControllerPacket));
+    dedicated(PacketType::CONTROLLER_ACK,     sizeof(ControllerAckPacket));
+    dedicated(PacketType::CLIPBOARD,          sizeof(ClipboardPacketHeader));
+    dedicated(PacketType::CLIP_ACK,           sizeof(ClipboardAckPacket));
+    dedicated(PacketType::CLIP_WINDOW_ACK,    sizeof(ClipboardWindowAckPacket));
+    dedicated(PacketType::CLIP_CHUNK,         sizeof(ClipboardChunkHeader));
+    dedicated(PacketType::PADDING,            1);
+    dedicated(PacketType::PATH_CHALLENGE,     sizeof(PathChallengePacket));
+    dedicated(PacketType::PATH_RESPONSE,      sizeof(PathChallengePacket));
+    dedicated(PacketType::PMTU_PROBE,         sizeof(PathProbePacket));
+    dedicated(PacketType::PMTU_ACK,           sizeof(PathProbePacket));
+    dedicated(PacketType::TRANSPORT_FEEDBACK, 10);
+    dedicated(PacketType::RTT_PROBE,          sizeof(RttProbePacket));
+    dedicated(PacketType::FRAME_LOSS,         sizeof(FrameLossPacket));
+    dedicated(PacketType::CURSOR_POS,         sizeof(CursorPositionPacket));
+    dedicated(PacketType::CURSOR_SHAPE,       sizeof(CursorShapeHeader));
+    dedicated(PacketType::CURSOR_REQUEST,     sizeof(CursorRequestPacket));
+    dedicated(PacketType::INPUT_ECHO,         sizeof(InputEchoPacket));
+    return rules;
+}
+
+inline constexpr std::array<PacketRule, 256> PACKET_RULES = makePacketRules();
+
+/// True if |data| can be a video header: long enough for the smaller
+/// layout, and the codec nibble is H264 / H265 / AV1 (1-3).  The high
+/// nibble is the stream ID (CS05).
+inline bool isVideoHeader(const uint8_t* data, size_t len) {
+    return len >= sizeof(VideoPacketHeader) &&
+           static_cast<uint8_t>((data[1] & 0x0F) - static_cast<uint8_t>(CodecType::H264)) <= 2;
+}
+
+} // namespace detail
+
+/// Identify the packet type from a raw decrypted buffer: one table lookup
+/// on the first byte, then the video check.
+///
+/// |wire_version| is the session's wire version on the side that receives
+/// video (the viewer), 0 on the other.  A CS01 video header's flags byte
+/// (version bits 1, frame_type 0) is 0x40 - 0x5F, where the legacy
+/// controller and clipboard types also sit; in a CS01 session a valid
+/// codec byte there makes the datagram video.  Later versions never send
+/// video in that range.
 /// Returns PacketType or 0 if unrecognized.
-inline PacketType identifyPacket(const uint8_t* data, size_t len) {
+inline PacketType identifyPacket(const uint8_t* data, size_t len, uint8_t wire_version = 0) {
     if (len == 0) return static_cast<PacketType>(0);
 
-    // Dedicated type byte for control/data packets
-    uint8_t first = data[0];
-    if (first == static_cast<uint8_t>(PacketType::QOS_FEEDBACK)) return PacketType::QOS_FEEDBACK;
-    if (first == static_cast<uint8_t>(PacketType::FEC))          return PacketType::FEC;
-    if (first == static_cast<uint8_t>(PacketType::NACK))         return PacketType::NACK;
-    if (first == static_cast<uint8_t>(PacketType::CONTROLLER) && len >= sizeof(ControllerPacket))
-        return PacketType::CONTROLLER;
-    if (first == static_cast<uint8_t>(PacketType::CLIPBOARD) && len >= sizeof(ClipboardPacketHeader))
-        return PacketType::CLIPBOARD;
-    if (first == static_cast<uint8_t>(PacketType::CLIP_ACK) && len >= sizeof(ClipboardAckPacket))
-        return PacketType::CLIP_ACK;
-
-    // Video / Audio / Input embed the type in the upper bits of byte 0.
-    uint8_t type6 = first & 0x3F;
-    if (type6 == 0x20 && len >= sizeof(AudioPacketHeader)) return PacketType::AUDIO;
-    if (type6 == 0x30 && len >= sizeof(InputPacketHeader)) return PacketType::INPUT;
-
-    // Default to video if the buffer is large enough and codec byte is valid
-    if (len >= sizeof(VideoPacketHeader)) {
-        uint8_t codec = data[1];
-        if (codec == static_cast<uint8_t>(CodecType::H264) ||
-            codec == static_cast<uint8_t>(CodecType::H265) ||
-            codec == static_cast<uint8_t>(CodecType::AV1)) {
-            return PacketType::VIDEO;
-        }
+    if (wire_version == 1 && (data[0] & 0xE0) == 0x40 && detail::isVideoHeader(data, len)) {
+        return PacketType::VIDEO;
+    }
+
+    const detail::PacketRule& rule = detail::PACKET_RULES[data[0]];
+    if (rule.type && len >= rule.min_len) return static_cast<PacketType>(rule.type);
+    if (rule.embedded && len >= rule.embedded_min_len) {
+        return static_cast<PacketType>(rule.embedded);
     }
 
+    // Default to video if the buffer can be a video header
+    if (detail::isVideoHeader(data, len)) return PacketType::VIDEO;
+
     return static_cast<PacketType>(0);
 }
 
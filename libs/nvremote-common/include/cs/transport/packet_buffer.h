@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+// packet_buffer.h -- Pre-allocated packet slots for allocation-free send paths
+//
+// PacketSlab is one contiguous, cache-line aligned allocation divided into
+// fixed-size slots, each large enough for a full datagram.  PacketBuffer is
+// a non-owning writable view of one slot: wire headers are written in place
+// at the front (see the serializeTo() helpers in packet.h) and the payload
+// is copied directly behind them, so a packet is built with exactly one
+// copy of its payload and no heap allocation.
+//
+// Slabs are allocated once (typically by the transport that also uses them
+// as its retransmission cache) and reused for the lifetime of the session.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// PacketBuffer -- writable view of one packet slot
+// ---------------------------------------------------------------------------
+struct PacketBuffer {
+    uint8_t* data     = nullptr;
+    size_t   capacity = 0;
+
+    explicit operator bool() const { return data != nullptr; }
+
+    /// Pointer to the payload region that follows a header of type |Header|.
+    template <typename Header>
+    uint8_t* payload() const { return data + sizeof(Header); }
+
+    /// Payload capacity remaining after a header of type |Header|.
+    template <typename Header>
+    size_t payloadCapacity() const {
+        return capacity > sizeof(Header) ? capacity - sizeof(Header) : 0;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// PacketSlab -- fixed-stride arena of packet slots
+// ---------------------------------------------------------------------------
+class PacketSlab {
+public:
+    static constexpr size_t ALIGNMENT = 64;   // cache line
+
+    PacketSlab(size_t slot_count, size_t slot_size)
+        : count_(slot_count)
+        , slot_size_(slot_size)
+        , stride_((slot_size + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+        , storage_(new uint8_t[stride_ * slot_count + ALIGNMENT])
+    {
+        auto addr = reinterpret_cast<uintptr_t>(storage_.get());
+        base_ = storage_.get() + ((ALIGNMENT - (addr & (ALIGNMENT - 1))) & (ALIGNMENT - 1));
+    }
+
+    // Non-copyable (views point into the storage)
+    PacketSlab(const PacketSlab&) = delete;
+    PacketSlab& operator=(const PacketSlab&) = delete;
+
+    /// Reallocate with a new geometry.  Every outstanding view and slot
+    /// pointer is invalidated, so only call this while the slab is idle.
+    void resize(size_t slot_count, size_t slot_size) {
+        count_     = slot_count;
+        slot_size_ = slot_size;
+        stride_    = (slot_size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        storage_.reset(new uint8_t[stride_ * slot_count + ALIGNMENT]);
+        auto addr = reinterpret_cast<uintptr_t>(storage_.get());
+        base_ = storage_.get() + ((ALIGNMENT - (addr & (ALIGNMENT - 1))) & (ALIGNMENT - 1));
+    }
+
+    /// Writable view of slot |index| (wraps modulo the slot count).
+    PacketBuffer buffer(size_t index) const {
+        return PacketBuffer{ slot(index), slot_size_ };
+    }
+
+    /// Raw pointer to slot |index| (wraps modulo the slot count).
+    uint8_t* slot(size_t index) const {
+        return base_ + (index % count_) * stride_;
+    }
+
+    size_t slotCount() const { return count_; }
+    size_t slotSize()  const { return slot_size_; }
+
+private:
+    size_t                     count_;
+    size_t                     slot_size_;
+    size_t                     stride_;
+    std::unique_ptr<uint8_t[]> storage_;
+    uint8_t*                   base_ = nullptr;
+};
+
+} // namespace cs
@@ -0,0 +1,197 @@
+///////////////////////////////////////////////////////////////////////////////
+// packet_recorder.h -- Memory-mapped session packet recording and replay input
+//
+// Records every datagram a transport sends or receives, after decryption
+// (before sealing on the way out), with its timestamp and direction, so a
+// user's stutter report can come with the session itself and be replayed
+// through the viewer's receive pipeline offline (tools/packet_replay).
+//
+// The file is append-only and memory-mapped: a 64 KiB file header, then
+// fixed-size chunks (the last cut to its fill on close), each opening
+// with a RecordingChunkHeader that gives its time range and fill.  Chunk
+// |i| is at a known offset, so the chunk headers are the index -- a reader
+// finds a point in time by binary search over them without reading
+// records.  Records never cross a chunk:
+//
+//   [RecordHeader][payload, padded to 8 bytes][RecordHeader][payload]...
+//
+// Recording is a memcpy into the mapped chunk and a header update, under
+// one lock, on the thread that sent or received the datagram -- no
+// syscall except one ftruncate / remap per chunk.  The chunk header is
+// updated after the record is complete, so a file left by a crashed
+// process (whose pages the OS still writes back) reads up to the last
+// whole record.
+//
+// Fields are in host byte order: recordings are read on the machine that
+// made them or one like it (x86 / ARM, both little-endian).
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "cs/common.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// File format
+// ---------------------------------------------------------------------------
+constexpr uint32_t RECORDING_MAGIC       = 0x43525343;   // "CSRC"
+constexpr uint32_t RECORDING_CHUNK_MAGIC = 0x4B4E4843;   // "CHNK"
+constexpr uint16_t RECORDING_VERSION     = 1;
+
+/// Header region ahead of chunk 0.  Chunk offsets are multiples of 64 KiB,
+/// the Windows mapping granularity (and a multiple of every page size).
+constexpr size_t RECORDING_FILE_HEADER_BYTES   = 64 * 1024;
+constexpr size_t RECORDING_CHUNK_ALIGN         = 64 * 1024;
+constexpr size_t RECORDING_DEFAULT_CHUNK_BYTES = 4 * 1024 * 1024;
+
+enum class RecordingRole : uint8_t {
+    HOST   = 0,
+    VIEWER = 1,
+};
+
+enum class RecordDirection : uint8_t {
+    SENT     = 0,
+    RECEIVED = 1,
+};
+
+struct RecordingFileHeader {
+    uint32_t magic;             // RECORDING_MAGIC
+    uint16_t version;           // RECORDING_VERSION
+    uint8_t  role;              // RecordingRole
+    uint8_t  reserved;
+    uint32_t chunk_bytes;       // Every chunk's size, header included
+    uint32_t chunk_count;       // Chunks started (the last may be part-filled)
+    uint64_t created_us;        // getTimestampUs() at open: record times' clock
+    uint64_t created_unix_ms;   // Wall clock at open, to pair host and viewer files
+};
+
+struct RecordingChunkHeader {
+    uint32_t magic;             // RECORDING_CHUNK_MAGIC
+    uint32_t index;
+    uint64_t first_us;          // Timestamp of the first record
+    uint64_t last_us;           // Timestamp of the last record
+    uint32_t record_count;
+    uint32_t used_bytes;        // Header included; records end here
+};
+
+struct RecordHeader {
+    uint64_t timestamp_us;
+    uint32_t length;            // Payload bytes, before padding
+    uint8_t  direction;         // RecordDirection
+    uint8_t  reserved[3];
+};
+
+static_assert(sizeof(RecordingFileHeader) == 32, "RecordingFileHeader layout");
+static_assert(sizeof(RecordingChunkHeader) == 32, "RecordingChunkHeader layout");
+static_assert(sizeof(RecordHeader) == 16, "RecordHeader layout");
+
+// ---------------------------------------------------------------------------
+// PacketRecorder -- the writer
+// ---------------------------------------------------------------------------
+class PacketRecorder {
+public:
+    PacketRecorder() = default;
+    ~PacketRecorder();
+
+    // Non-copyable
+    PacketRecorder(const PacketRecorder&) = delete;
+    PacketRecorder& operator=(const PacketRecorder&) = delete;
+
+    /// Create (or truncate) |path| and start recording into it.
+    /// |chunk_bytes| is rounded up to RECORDING_CHUNK_ALIGN.
+    bool open(const std::string& path, RecordingRole role,
+              size_t chunk_bytes = RECORDING_DEFAULT_CHUNK_BYTES);
+
+    /// Flush and close the file.  Safe to call when not open.
+    void close();
+
+    bool isOpen() const;
+
+    /// Append one datagram.  Thread-safe.  Returns false if not open, the
+    /// datagram does not fit a chunk, or the file cannot grow (in which
+    /// case recording stops and the file keeps what it has).
+    bool record(RecordDirection direction, const uint8_t* data, size_t len,
+                uint64_t timestamp_us);
+    bool record(RecordDirection direction, const uint8_t* data, size_t len) {
+        return record(direction, data, len, getTimestampUs());
+    }
+
+    uint64_t getRecordCount() const;
+    uint64_t getRecordedBytes() const;
+    const std::string& getPath() const { return path_; }
+
+private:
+    bool mapChunk(uint32_t index);   // Grow the file and map chunk |index|
+    void unmapChunk();
+    void closeLocked();
+
+    mutable std::mutex   mutex_;
+    std::string          path_;
+    intptr_t             file_           = -1;        // fd, or a HANDLE on Windows
+    void*                header_map_     = nullptr;   // Windows mapping handles
+    void*                chunk_map_      = nullptr;
+    RecordingFileHeader* header_         = nullptr;   // Mapped file header
+    uint8_t*             chunk_          = nullptr;   // Mapped current chunk
+    size_t               chunk_bytes_    = 0;
+    uint32_t             chunk_index_    = 0;
+    uint64_t             record_count_   = 0;
+    uint64_t             recorded_bytes_ = 0;
+};
+
+// ---------------------------------------------------------------------------
+// RecordingReader -- sequential and seekable reads of a recording
+// ---------------------------------------------------------------------------
+
+/// One record; |data| points into the reader's mapping.
+struct PacketRecord {
+    uint64_t        timestamp_us = 0;
+    RecordDirection direction    = RecordDirection::RECEIVED;
+    const uint8_t*  data         = nullptr;
+    size_t          len          = 0;
+};
+
+class RecordingReader {
+public:
+    RecordingReader() = default;
+    ~RecordingReader();
+
+    // Non-copyable
+    RecordingReader(const RecordingReader&) = delete;
+    RecordingReader& operator=(const RecordingReader&) = delete;
+
+    /// Map |path| read-only and validate its header.  Chunks past the last
+    /// valid one (an unfinished file) are ignored.
+    bool open(const std::string& path);
+    void close();
+
+    const RecordingFileHeader& header() const { return *header_; }
+    uint32_t chunkCount() const { return chunk_count_; }
+    const RecordingChunkHeader& chunk(uint32_t index) const;
+
+    /// Position at the first record, or the first record at or after
+    /// |timestamp_us| (found through the chunk index).
+    void rewind();
+    void seek(uint64_t timestamp_us);
+
+    /// Read the next record.  Returns false at the end of the recording.
+    bool next(PacketRecord& out);
+
+private:
+    const uint8_t* chunkBase(uint32_t index) const;
+
+    const uint8_t* base_        = nullptr;
+    size_t         size_        = 0;
+    intptr_t       file_        = -1;
+    void*          map_         = nullptr;
+    const RecordingFileHeader* header_ = nullptr;
+    uint32_t       chunk_count_ = 0;
+    uint32_t       cur_chunk_   = 0;
+    size_t         cur_offset_  = 0;     // Within cur_chunk_
+};
+
+} // namespace cs
@@ -0,0 +1,20 @@
+///////////////////////////////////////////////////////////////////////////////
+// sequence.h -- Comparisons in wrapping 16-bit sequence spaces
+//
+// Input batch, controller state and clipboard transfer sequences are 16
+// bits on the wire and wrap.  Two of them are ordered by their signed
+// distance (RFC 1982 serial number arithmetic), which holds while they are
+// less than 32768 apart.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstdint>
+
+namespace cs {
+
+/// Whether |a| comes after |b| in 16-bit sequence space.
+inline bool seqNewer(uint16_t a, uint16_t b) {
+    return static_cast<int16_t>(a - b) > 0;
+}
+
+} // namespace cs
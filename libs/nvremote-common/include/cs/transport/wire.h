@@ -0,0 +1,188 @@
+///////////////////////////////////////////////////////////////////////////////
+// wire.h -- Byte spans and compile-time field schemas for wire headers
+//
+// A header in packet.h lists its fields once, as a WireFields schema.  The
+// schema swaps them between host and network byte order -- a byte swap
+// per multi-byte field, selected at compile time, with no htons() calls --
+// and checkWireSchema() fails the build if the fields do not cover the
+// whole packed struct, so a field added to a header but not to its schema
+// cannot go out in host order.
+//
+// encodeHeader() / decodeHeader() move any such header in and out of a
+// caller's buffer without allocating: a ByteSpan is checked at run time,
+// a fixed-size array at compile time.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// Spans over caller-owned bytes
+// ---------------------------------------------------------------------------
+
+class ByteSpan {
+public:
+    constexpr ByteSpan() = default;
+    constexpr ByteSpan(uint8_t* data, size_t size) : data_(data), size_(size) {}
+    template <size_t N>
+    constexpr ByteSpan(uint8_t (&bytes)[N]) : data_(bytes), size_(N) {}
+    template <size_t N>
+    constexpr ByteSpan(std::array<uint8_t, N>& bytes) : data_(bytes.data()), size_(N) {}
+    ByteSpan(std::vector<uint8_t>& bytes) : data_(bytes.data()), size_(bytes.size()) {}
+
+    constexpr uint8_t* data() const { return data_; }
+    constexpr size_t   size() const { return size_; }
+
+    /// The bytes from |offset| on (empty past the end).
+    constexpr ByteSpan subspan(size_t offset) const {
+        return offset < size_ ? ByteSpan(data_ + offset, size_ - offset) : ByteSpan();
+    }
+
+private:
+    uint8_t* data_ = nullptr;
+    size_t   size_ = 0;
+};
+
+class ConstByteSpan {
+public:
+    constexpr ConstByteSpan() = default;
+    constexpr ConstByteSpan(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+    constexpr ConstByteSpan(ByteSpan bytes) : data_(bytes.data()), size_(bytes.size()) {}
+    template <size_t N>
+    constexpr ConstByteSpan(const uint8_t (&bytes)[N]) : data_(bytes), size_(N) {}
+    template <size_t N>
+    constexpr ConstByteSpan(const std::array<uint8_t, N>& bytes) : data_(bytes.data()), size_(N) {}
+    ConstByteSpan(const std::vector<uint8_t>& bytes) : data_(bytes.data()), size_(bytes.size()) {}
+
+    constexpr const uint8_t* data() const { return data_; }
+    constexpr size_t         size() const { return size_; }
+
+    /// The bytes from |offset| on (empty past the end).
+    constexpr ConstByteSpan subspan(size_t offset) const {
+        return offset < size_ ? ConstByteSpan(data_ + offset, size_ - offset) : ConstByteSpan();
+    }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t         size_ = 0;
+};
+
+// ---------------------------------------------------------------------------
+// Byte order
+// ---------------------------------------------------------------------------
+
+namespace wire {
+
+#if defined(_WIN32) || \
+    (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+constexpr bool LITTLE_ENDIAN_HOST = true;
+#else
+constexpr bool LITTLE_ENDIAN_HOST = false;
+#endif
+
+/// |v| with its bytes reversed (the compilers emit one bswap / rev).
+template <typename T>
+constexpr T byteSwap(T v) {
+    static_assert(std::is_integral_v<T>, "Only integers have a byte order");
+    using U = std::make_unsigned_t<T>;
+    U in  = static_cast<U>(v);
+    U out = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out = static_cast<U>((out << 8) | (in & 0xFF));
+        in  = static_cast<U>(in >> 8);
+    }
+    return static_cast<T>(out);
+}
+
+/// |v| between host and network order (the same swap both ways).
+template <typename T>
+constexpr T networkOrder(T v) {
+    if constexpr (LITTLE_ENDIAN_HOST && sizeof(T) > 1) {
+        return byteSwap(v);
+    } else {
+        return v;
+    }
+}
+
+namespace detail {
+
+template <typename M> struct Member;
+template <typename C, typename T> struct Member<T C::*> {
+    using Class = C;
+    using Type  = T;
+};
+
+template <typename T>
+constexpr void swapValue(T& value) {
+    if constexpr (std::is_array_v<T>) {
+        for (auto& element : value) swapValue(element);
+    } else {
+        value = networkOrder(value);
+    }
+}
+
+} // namespace detail
+} // namespace wire
+
+/// The fields of a packed wire header, as pointers to its members.  Every
+/// field is listed, single bytes included, so the schema's SIZE can be
+/// checked against the struct (checkWireSchema()).
+template <auto... Fields>
+struct WireFields {
+    static constexpr size_t SIZE =
+        (sizeof(typename wire::detail::Member<decltype(Fields)>::Type) + ... + 0);
+
+    /// Swap every multi-byte field of |h| between host and network order.
+    template <typename H>
+    static constexpr void swap(H& h) {
+        (wire::detail::swapValue(h.*Fields), ...);
+    }
+};
+
+/// True if H::Wire lists every byte of H.  Use in a static_assert after
+/// the struct.
+template <typename H>
+constexpr bool checkWireSchema() {
+    return H::Wire::SIZE == sizeof(H) && std::alignment_of_v<H> == 1;
+}
+
+// ---------------------------------------------------------------------------
+// Encode / decode into caller buffers
+// ---------------------------------------------------------------------------
+
+/// Write |h| in network order to the start of |out|.  Returns sizeof(H),
+/// or 0 if |out| is too small.
+template <typename H>
+size_t encodeHeader(const H& h, ByteSpan out) {
+    if (out.size() < sizeof(H)) return 0;
+    H net = h;
+    H::Wire::swap(net);
+    std::memcpy(out.data(), &net, sizeof(H));
+    return sizeof(H);
+}
+
+/// As above into an array known to be large enough at compile time.
+template <typename H, size_t N>
+size_t encodeHeader(const H& h, uint8_t (&out)[N]) {
+    static_assert(N >= sizeof(H), "Buffer too small for this header");
+    return encodeHeader(h, ByteSpan(out, N));
+}
+
+/// Read a header from the start of |in| into |out| in host order.
+/// Returns false if |in| is too small.
+template <typename H>
+bool decodeHeader(ConstByteSpan in, H& out) {
+    if (in.size() < sizeof(H)) return false;
+    std::memcpy(&out, in.data(), sizeof(H));
+    H::Wire::swap(out);
+    return true;
+}
+
+} // namespace cs
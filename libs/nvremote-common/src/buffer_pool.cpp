@@ -0,0 +1,276 @@
+///////////////////////////////////////////////////////////////////////////////
+// buffer_pool.cpp -- Size-classed, refcounted byte buffers
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cs/buffer_pool.h"
+
+#include <cstring>
+#include <new>
+
+namespace cs {
+
+static_assert(sizeof(detail::PoolBlock) == 64, "Block bytes must start on a cache line");
+static_assert(BufferPool::CLASS_COUNT < BufferPool::OVERSIZE_CLASS, "Class index must fit a byte");
+
+// ---------------------------------------------------------------------------
+// Per-thread free-block cache
+// ---------------------------------------------------------------------------
+
+struct BufferPool::ThreadCache {
+    struct List {
+        detail::PoolBlock* head  = nullptr;
+        uint32_t           count = 0;
+    };
+    std::array<List, CLASS_COUNT> lists{};
+
+    ~ThreadCache();
+
+    void push(uint8_t size_class, detail::PoolBlock* block) {
+        List& list  = lists[size_class];
+        block->next = list.head;
+        list.head   = block;
+        ++list.count;
+    }
+
+    detail::PoolBlock* pop(uint8_t size_class) {
+        List& list = lists[size_class];
+        detail::PoolBlock* block = list.head;
+        if (block) {
+            list.head = block->next;
+            --list.count;
+        }
+        return block;
+    }
+};
+
+namespace {
+
+// Set once the thread's cache is destroyed, so a handle released later in
+// thread teardown (e.g. by another thread_local) goes straight to the
+// central list.  A plain bool, so it outlives every destructor.
+thread_local bool t_cache_gone = false;
+
+void raiseHighWater(std::atomic<uint64_t>& high_water, uint64_t value) {
+    uint64_t seen = high_water.load(std::memory_order_relaxed);
+    while (value > seen &&
+           !high_water.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+} // namespace
+
+BufferPool::ThreadCache* BufferPool::threadCache() {
+    thread_local ThreadCache cache;
+    return t_cache_gone ? nullptr : &cache;
+}
+
+BufferPool::ThreadCache::~ThreadCache() {
+    t_cache_gone = true;
+    for (size_t c = 0; c < CLASS_COUNT; ++c) {
+        List& list = lists[c];
+        if (!list.head) continue;
+        detail::PoolBlock* tail = list.head;
+        while (tail->next) tail = tail->next;
+        BufferPool::shared().giveBack(static_cast<uint8_t>(c), list.head, tail, list.count);
+        list = List{};
+    }
+}
+
+// ---------------------------------------------------------------------------
+// shared / classFor
+// ---------------------------------------------------------------------------
+
+BufferPool& BufferPool::shared() {
+    // Leaked on purpose: thread caches flush into it during thread exit,
+    // which may come after static destructors have run.
+    static BufferPool* pool = new BufferPool();
+    return *pool;
+}
+
+uint8_t BufferPool::classFor(size_t size) {
+    for (size_t c = 0; c < CLASS_COUNT; ++c) {
+        if (size <= CLASS_SIZES[c]) return static_cast<uint8_t>(c);
+    }
+    return OVERSIZE_CLASS;
+}
+
+// ---------------------------------------------------------------------------
+// acquire / copyOf
+// ---------------------------------------------------------------------------
+
+PooledBuffer BufferPool::acquire(size_t size) {
+    const uint8_t size_class = classFor(size);
+
+    detail::PoolBlock* block = nullptr;
+    if (size_class == OVERSIZE_CLASS) {
+        void* mem = ::operator new(sizeof(detail::PoolBlock) + size,
+                                   std::align_val_t{alignof(detail::PoolBlock)}, std::nothrow);
+        if (!mem) return PooledBuffer();
+        block = new (mem) detail::PoolBlock();
+        block->size_class = OVERSIZE_CLASS;
+        block->capacity   = size;
+        oversize_allocs_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        ThreadCache* cache = threadCache();
+        if (cache) {
+            block = cache->pop(size_class);
+            if (!block && refill(*cache, size_class, THREAD_CACHE_LIMITS[size_class] / 2 + 1)) {
+                block = cache->pop(size_class);
+            }
+        } else {
+            block = takeCentral(size_class);
+        }
+        if (!block) block = allocateBlock(size_class);
+        if (!block) return PooledBuffer();
+
+        Central& central = central_[size_class];
+        raiseHighWater(central.high_water,
+                       central.in_use.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+
+    block->next = nullptr;
+    block->refs.store(1, std::memory_order_relaxed);
+    return PooledBuffer(block, size);
+}
+
+PooledBuffer BufferPool::copyOf(const uint8_t* data, size_t size) {
+    PooledBuffer buf = acquire(size);
+    if (buf && size > 0) std::memcpy(buf.data(), data, size);
+    return buf;
+}
+
+// ---------------------------------------------------------------------------
+// reserve
+// ---------------------------------------------------------------------------
+
+void BufferPool::reserve(size_t size, size_t count) {
+    const uint8_t size_class = classFor(size);
+    if (size_class == OVERSIZE_CLASS) return;
+
+    Central& central = central_[size_class];
+    while (central.blocks.load(std::memory_order_relaxed) < count) {
+        detail::PoolBlock* block = allocateBlock(size_class);
+        if (!block) return;
+        giveBack(size_class, block, block, 1);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// stats
+// ---------------------------------------------------------------------------
+
+BufferPool::Stats BufferPool::stats() const {
+    Stats s;
+    for (size_t c = 0; c < CLASS_COUNT; ++c) {
+        const Central& central = central_[c];
+        ClassStats& cls = s.classes[c];
+        cls.block_size = CLASS_SIZES[c];
+        cls.blocks     = central.blocks.load(std::memory_order_relaxed);
+        cls.in_use     = central.in_use.load(std::memory_order_relaxed);
+        cls.high_water = central.high_water.load(std::memory_order_relaxed);
+
+        s.reserved_bytes   += cls.blocks * cls.block_size;
+        s.in_use_bytes     += cls.in_use * cls.block_size;
+        s.high_water_bytes += cls.high_water * cls.block_size;
+        s.system_allocs    += cls.blocks;
+    }
+    s.oversize_allocs = oversize_allocs_.load(std::memory_order_relaxed);
+    return s;
+}
+
+// ---------------------------------------------------------------------------
+// recycle
+// ---------------------------------------------------------------------------
+
+void BufferPool::recycle(detail::PoolBlock* block) {
+    const uint8_t size_class = block->size_class;
+    if (size_class == OVERSIZE_CLASS) {
+        block->~PoolBlock();
+        ::operator delete(block, std::align_val_t{alignof(detail::PoolBlock)});
+        return;
+    }
+
+    central_[size_class].in_use.fetch_sub(1, std::memory_order_relaxed);
+
+    ThreadCache* cache = threadCache();
+    if (!cache) {
+        giveBack(size_class, block, block, 1);
+        return;
+    }
+
+    cache->push(size_class, block);
+
+    // Over the limit: hand half of this class back in one batch, so a
+    // thread that only releases (a consumer) feeds the threads that acquire
+    auto& list = cache->lists[size_class];
+    if (list.count > THREAD_CACHE_LIMITS[size_class]) {
+        const uint32_t keep = THREAD_CACHE_LIMITS[size_class] / 2;
+        detail::PoolBlock* last_kept = list.head;
+        for (uint32_t i = 1; i < keep; ++i) last_kept = last_kept->next;
+
+        detail::PoolBlock* head = keep ? last_kept->next : list.head;
+        detail::PoolBlock* tail = head;
+        while (tail->next) tail = tail->next;
+        const uint32_t count = list.count - keep;
+
+        if (keep) {
+            last_kept->next = nullptr;
+        } else {
+            list.head = nullptr;
+        }
+        list.count = keep;
+        giveBack(size_class, head, tail, count);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Central free lists
+// ---------------------------------------------------------------------------
+
+detail::PoolBlock* BufferPool::allocateBlock(uint8_t size_class) {
+    void* mem = ::operator new(sizeof(detail::PoolBlock) + CLASS_SIZES[size_class],
+                               std::align_val_t{alignof(detail::PoolBlock)}, std::nothrow);
+    if (!mem) return nullptr;
+    auto* block       = new (mem) detail::PoolBlock();
+    block->size_class = size_class;
+    block->capacity   = CLASS_SIZES[size_class];
+    central_[size_class].blocks.fetch_add(1, std::memory_order_relaxed);
+    return block;
+}
+
+uint32_t BufferPool::refill(ThreadCache& cache, uint8_t size_class, uint32_t count) {
+    Central& central = central_[size_class];
+    std::lock_guard<std::mutex> lock(central.mutex);
+
+    uint32_t moved = 0;
+    while (moved < count && central.free) {
+        detail::PoolBlock* block = central.free;
+        central.free = block->next;
+        --central.free_count;
+        cache.push(size_class, block);
+        ++moved;
+    }
+    return moved;
+}
+
+detail::PoolBlock* BufferPool::takeCentral(uint8_t size_class) {
+    Central& central = central_[size_class];
+    std::lock_guard<std::mutex> lock(central.mutex);
+    detail::PoolBlock* block = central.free;
+    if (block) {
+        central.free = block->next;
+        --central.free_count;
+    }
+    return block;
+}
+
+void BufferPool::giveBack(uint8_t size_class, detail::PoolBlock* head,
+                          detail::PoolBlock* tail, uint32_t count) {
+    Central& central = central_[size_class];
+    std::lock_guard<std::mutex> lock(central.mutex);
+    tail->next   = central.free;
+    central.free = head;
+    central.free_count += count;
+}
+
+} // namespace cs
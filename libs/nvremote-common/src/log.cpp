@@ -0,0 +1,378 @@
+///////////////////////////////////////////////////////////////////////////////
+// log.cpp -- Asynchronous logging behind CS_LOG
+//
+// Every logging thread gets a single-producer ring of fixed-size records
+// the first time it logs; the logger thread is their one consumer.  The
+// message text is formatted on the calling thread -- a va_list cannot
+// outlive the call, and the %s strings it points at may not either -- but
+// the prefix, the merge and all I/O are deferred.  A message too long for
+// a record, or one logged before the logger starts or after it stops, is
+// written directly instead.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cs/common.h"
+#include "cs/spsc_queue.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+
+namespace cs {
+
+namespace {
+
+constexpr size_t LOG_TEXT_LEN     = 400;    // Longer messages are written directly
+constexpr size_t LOG_RING_RECORDS = 64;     // Per thread
+constexpr size_t LOG_MAX_RINGS    = 64;     // Threads beyond this log directly
+constexpr auto   LOG_FLUSH_INTERVAL = std::chrono::milliseconds(20);
+
+struct LogRecord {
+    uint64_t    seq        = 0;        // Call order across threads
+    uint64_t    wall_us    = 0;
+    const char* file       = nullptr;  // __FILE__: a literal, safe to keep
+    int         line       = 0;
+    LogLevel    level      = LogLevel::INFO;
+    uint32_t    suppressed = 0;
+    char        text[LOG_TEXT_LEN] = {};
+};
+
+struct LogRing {
+    SpscQueue<LogRecord, LOG_RING_RECORDS> queue;
+    std::atomic<uint32_t> dropped{0};  // Found the ring full
+    bool in_use = false;               // Logger::rings_mutex_ held
+};
+
+uint64_t wallClockUs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+const char* baseName(const char* file) {
+    const char* base = file;
+    for (const char* p = file; *p; ++p) {
+        if (*p == '/' || *p == '\\') base = p + 1;
+    }
+    return base;
+}
+
+/// Append one formatted log line to |out|.
+void appendLine(std::string& out, uint64_t wall_us, LogLevel level, const char* file,
+                int line, const char* text, uint32_t suppressed) {
+    char prefix[128];
+    std::snprintf(prefix, sizeof(prefix), "[%ld.%06ld] [%s] %s:%d  ",
+                  static_cast<long>(wall_us / 1'000'000), static_cast<long>(wall_us % 1'000'000),
+                  logLevelStr(level), baseName(file), line);
+    out += prefix;
+    out += text;
+    if (suppressed > 0) {
+        char note[48];
+        std::snprintf(note, sizeof(note), " [%u similar suppressed]", suppressed);
+        out += note;
+    }
+    out += '\n';
+}
+
+// ---------------------------------------------------------------------------
+// Logger
+// ---------------------------------------------------------------------------
+
+class Logger {
+public:
+    /// Never destroyed: threads may still log while the process exits.
+    static Logger& instance() {
+        static Logger* logger = new Logger();
+        return *logger;
+    }
+
+    bool running() const { return running_.load(std::memory_order_acquire); }
+
+    LogRing* acquireRing() {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        const size_t count = ring_count_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < count; ++i) {
+            if (!rings_[i]->in_use) {
+                rings_[i]->in_use = true;
+                return rings_[i].get();
+            }
+        }
+        if (count == LOG_MAX_RINGS) return nullptr;
+        rings_[count] = std::make_unique<LogRing>();
+        rings_[count]->in_use = true;
+        ring_count_.store(count + 1, std::memory_order_release);
+        return rings_[count].get();
+    }
+
+    void releaseRing(LogRing* ring) {
+        // What it still holds is written out in the ordinary way
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        ring->in_use = false;
+    }
+
+    uint64_t nextSeq() { return seq_.fetch_add(1, std::memory_order_relaxed); }
+
+    void wake() {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        woken_ = true;
+        wake_cv_.notify_one();
+    }
+
+    /// Drain the rings on the calling thread.
+    void flush() {
+        std::lock_guard<std::mutex> lock(drain_mutex_);
+        drain();
+    }
+
+    /// Write |text| straight to the sinks.
+    void writeOut(const std::string& text) {
+        std::lock_guard<std::mutex> lock(sink_mutex_);
+        writeLocked(text);
+    }
+
+    bool setFile(const std::string& path, uint64_t max_bytes, uint32_t max_files) {
+        std::lock_guard<std::mutex> lock(sink_mutex_);
+        if (file_) std::fclose(file_);
+        file_ = nullptr;
+        file_path_ = path;
+        max_bytes_ = max_bytes;
+        max_files_ = max_files;
+        if (path.empty()) return true;
+
+        file_ = std::fopen(path.c_str(), "ab");
+        if (!file_) return false;
+        std::fseek(file_, 0, SEEK_END);
+        const long size = std::ftell(file_);
+        file_bytes_ = size > 0 ? static_cast<uint64_t>(size) : 0;
+        return true;
+    }
+
+    void setStderr(bool enabled) { to_stderr_.store(enabled); }
+
+private:
+    Logger() {
+        running_.store(true, std::memory_order_release);
+        thread_ = std::thread(&Logger::run, this);
+        std::atexit([]() { Logger::instance().shutdown(); });
+    }
+
+    void run() {
+        while (!stop_.load()) {
+            {
+                std::unique_lock<std::mutex> lock(wake_mutex_);
+                wake_cv_.wait_for(lock, LOG_FLUSH_INTERVAL, [this]() { return woken_; });
+                woken_ = false;
+            }
+            flush();
+        }
+    }
+
+    void shutdown() {
+        stop_.store(true);
+        wake();
+        if (thread_.joinable()) thread_.join();
+        running_.store(false, std::memory_order_release);
+
+        // The logger thread may have been ended mid-drain as the process
+        // exits; then what it was writing is lost rather than waited for.
+        std::unique_lock<std::mutex> lock(drain_mutex_, std::try_to_lock);
+        if (lock.owns_lock()) drain();
+    }
+
+    /// Merge the rings in call order and write them out (drain_mutex_ held).
+    void drain() {
+        const size_t count = ring_count_.load(std::memory_order_acquire);
+        batch_.clear();
+
+        for (;;) {
+            LogRing*   next = nullptr;
+            LogRecord* rec  = nullptr;
+            for (size_t i = 0; i < count; ++i) {
+                LogRecord* front = rings_[i]->queue.front();
+                if (front && (!rec || front->seq < rec->seq)) {
+                    next = rings_[i].get();
+                    rec  = front;
+                }
+            }
+            if (!rec) break;
+            appendLine(batch_, rec->wall_us, rec->level, rec->file, rec->line,
+                       rec->text, rec->suppressed);
+            next->queue.pop();
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (const uint32_t dropped = rings_[i]->dropped.exchange(0)) {
+                char text[64];
+                std::snprintf(text, sizeof(text), "%u log messages dropped (ring full)", dropped);
+                appendLine(batch_, wallClockUs(), LogLevel::WARN, __FILE__, __LINE__, text, 0);
+            }
+        }
+
+        if (!batch_.empty()) writeOut(batch_);
+    }
+
+    /// Write to stderr and the file, rotating it when full (sink_mutex_ held).
+    void writeLocked(const std::string& text) {
+        if (to_stderr_.load()) {
+            std::fwrite(text.data(), 1, text.size(), stderr);
+            std::fflush(stderr);
+        }
+        if (!file_) return;
+
+        std::fwrite(text.data(), 1, text.size(), file_);
+        std::fflush(file_);
+        file_bytes_ += text.size();
+        if (file_bytes_ >= max_bytes_) rotateLocked();
+    }
+
+    void rotateLocked() {
+        std::fclose(file_);
+        file_ = nullptr;
+        if (max_files_ > 0) {
+            std::remove((file_path_ + "." + std::to_string(max_files_)).c_str());
+            for (uint32_t i = max_files_; i > 1; --i) {
+                std::rename((file_path_ + "." + std::to_string(i - 1)).c_str(),
+                            (file_path_ + "." + std::to_string(i)).c_str());
+            }
+            std::rename(file_path_.c_str(), (file_path_ + ".1").c_str());
+        }
+        file_ = std::fopen(file_path_.c_str(), "wb");
+        file_bytes_ = 0;
+    }
+
+    // Rings: created once, never freed, so the drain reads them unlocked
+    std::mutex rings_mutex_;
+    std::array<std::unique_ptr<LogRing>, LOG_MAX_RINGS> rings_;
+    std::atomic<size_t>   ring_count_{0};
+    std::atomic<uint64_t> seq_{0};
+
+    std::thread             thread_;
+    std::atomic<bool>       running_{false};
+    std::atomic<bool>       stop_{false};
+    std::mutex              wake_mutex_;
+    std::condition_variable wake_cv_;
+    bool                    woken_ = false;
+
+    std::mutex  drain_mutex_;
+    std::string batch_;                   // drain_mutex_ held
+
+    std::mutex  sink_mutex_;
+    std::atomic<bool> to_stderr_{true};
+    std::FILE*  file_       = nullptr;
+    std::string file_path_;
+    uint64_t    file_bytes_ = 0;
+    uint64_t    max_bytes_  = 0;
+    uint32_t    max_files_  = 0;
+};
+
+/// The calling thread's ring, taken on its first message and given back
+/// when it exits.
+struct ThreadLogRing {
+    LogRing* ring  = nullptr;
+    bool     tried = false;
+
+    ~ThreadLogRing() {
+        if (ring) Logger::instance().releaseRing(ring);
+    }
+
+    LogRing* get() {
+        if (!tried) {
+            tried = true;
+            ring  = Logger::instance().acquireRing();
+        }
+        return ring;
+    }
+};
+
+thread_local ThreadLogRing t_log_ring;
+
+/// Let |site| through unless it is over its burst for this second;
+/// |suppressed| is how many were held back since it last got through.
+bool admit(LogSite& site, uint64_t now_us, uint32_t& suppressed) {
+    uint64_t window = site.window_us.load(std::memory_order_relaxed);
+    if (now_us - window >= LOG_SITE_WINDOW_US &&
+        site.window_us.compare_exchange_strong(window, now_us, std::memory_order_relaxed)) {
+        site.count.store(0, std::memory_order_relaxed);
+    }
+    if (site.count.fetch_add(1, std::memory_order_relaxed) >= LOG_SITE_BURST) {
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// logMessage
+// ---------------------------------------------------------------------------
+
+void logMessage(LogLevel level, const char* file, int line, LogSite& site,
+                const char* fmt, ...) {
+    const uint64_t wall_us = wallClockUs();
+    uint32_t suppressed = 0;
+    if (!admit(site, wall_us, suppressed)) return;
+
+    Logger& logger = Logger::instance();
+    LogRing* ring = logger.running() ? t_log_ring.get() : nullptr;
+    if (ring) {
+        LogRecord* rec = ring->queue.beginPush();
+        if (!rec) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        va_list args;
+        va_start(args, fmt);
+        const int n = std::vsnprintf(rec->text, LOG_TEXT_LEN, fmt, args);
+        va_end(args);
+
+        if (n >= 0 && static_cast<size_t>(n) < LOG_TEXT_LEN) {
+            rec->seq        = logger.nextSeq();
+            rec->wall_us    = wall_us;
+            rec->file       = file;
+            rec->line       = line;
+            rec->level      = level;
+            rec->suppressed = suppressed;
+            ring->queue.commitPush();
+            if (level >= LogLevel::WARN) logger.wake();
+            return;
+        }
+        // Too long for a record: the slot stays unpublished
+    }
+
+    // Written directly
+    va_list args;
+    va_start(args, fmt);
+    va_list copy;
+    va_copy(copy, args);
+    const int n = std::vsnprintf(nullptr, 0, fmt, copy);
+    va_end(copy);
+    std::string text(n > 0 ? static_cast<size_t>(n) : 0, '\0');
+    if (n > 0) std::vsnprintf(&text[0], text.size() + 1, fmt, args);
+    va_end(args);
+
+    std::string out;
+    appendLine(out, wall_us, level, file, line, text.c_str(), suppressed);
+    if (logger.running()) logger.flush();   // After what was queued before it
+    logger.writeOut(out);
+}
+
+// ---------------------------------------------------------------------------
+// Sinks
+// ---------------------------------------------------------------------------
+
+bool setLogFile(const std::string& path, uint64_t max_bytes, uint32_t max_files) {
+    return Logger::instance().setFile(path, max_bytes, max_files);
+}
+
+void setLogToStderr(bool enabled) {
+    Logger::instance().setStderr(enabled);
+}
+
+void flushLog() {
+    Logger::instance().flush();
+}
+
+} // namespace cs
@@ -4,10 +4,13 @@
 
 #include "cs/p2p/ice_agent.h"
 #include "cs/common.h"
+#include "cs/thread_policy.h"
 
 #include <cstring>
 #include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <thread>
 
 #ifdef _WIN32
   #include <WinSock2.h>
@@ -32,6 +35,13 @@ IceAgent::IceAgent(const std::vector<std::string>& stun_servers)
 {
 }
 
+IceAgent::IceAgent(const std::vector<std::string>& stun_servers,
+                   const std::vector<TurnConfig>& turn_servers)
+    : stun_servers_(stun_servers),
+      turn_configs_(turn_servers)
+{
+}
+
 IceAgent::~IceAgent() {
     stop();
 }
@@ -72,9 +82,18 @@ std::vector<IceCandidate> IceAgent::gatherCandidates() {
 
     uint16_t localPrefCounter = 65535;
 
+    // Host sockets still waiting for their srflx candidate
+    struct PendingQuery {
+        int         sock;
+        std::string ip;
+        uint16_t    port;
+    };
+    std::vector<PendingQuery> queries;
+
     for (const auto& ip : localIps) {
-        // Create a UDP socket and bind to the interface IP with port 0
-        // (let the OS pick a free port)
+        // Create a UDP socket and bind to the interface IP.  The port the
+        // cached mapping was for is tried first: its NAT mapping is likely
+        // still open.  Otherwise port 0 (let the OS pick a free port).
         int sock = static_cast<int>(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
         if (sock < 0) {
             CS_LOG(WARN, "ICE: socket() failed for %s: %d", ip.c_str(), cs_socket_error());
@@ -91,7 +110,18 @@ std::vector<IceCandidate> IceAgent::gatherCandidates() {
         bindAddr.sin_port   = 0;  // OS-assigned
         ::inet_pton(AF_INET, ip.c_str(), &bindAddr.sin_addr);
 
-        if (::bind(sock, reinterpret_cast<sockaddr*>(&bindAddr),
+        uint16_t   cachedPort = 0;
+        StunResult cached;
+        bool haveCached = StunClient::getCachedMapping(ip, cachedPort, cached);
+        if (haveCached) {
+            bindAddr.sin_port = htons(cachedPort);
+            if (::bind(sock, reinterpret_cast<sockaddr*>(&bindAddr), sizeof(bindAddr)) != 0) {
+                haveCached = false;
+                bindAddr.sin_port = 0;
+            }
+        }
+        if (!haveCached &&
+            ::bind(sock, reinterpret_cast<sockaddr*>(&bindAddr),
                    sizeof(bindAddr)) != 0) {
             CS_LOG(WARN, "ICE: bind failed on %s: %d", ip.c_str(), cs_socket_error());
             cs_close_socket(sock);
@@ -111,65 +141,75 @@ std::vector<IceCandidate> IceAgent::gatherCandidates() {
         cand.priority   = computePriority("host", localPrefCounter--, 1);
         cand.foundation = "host_" + ip;
 
-        local_candidates_.push_back(cand);
-        local_sockets_.push_back(sock);
-
+        std::lock_guard<std::mutex> lock(gather_mutex_);
+        addLocalCandidate(cand, sock);
         CS_LOG(INFO, "ICE: host candidate %s:%u (fd=%d)",
                ip.c_str(), boundPort, sock);
-    }
-
-    // -- 2. Gather server-reflexive candidates via STUN --
-    StunClient stun;
-
-    for (const auto& server : stun_servers_) {
-        // Parse optional port from "host:port" format
-        std::string host = server;
-        uint16_t    port = DEFAULT_STUN_PORT;
 
-        auto colon = server.rfind(':');
-        if (colon != std::string::npos) {
-            host = server.substr(0, colon);
-            port = static_cast<uint16_t>(std::stoi(server.substr(colon + 1)));
-        }
-
-        // Query from each local socket
-        for (size_t i = 0; i < local_sockets_.size(); ++i) {
-            auto result = stun.discoverPublicEndpoint(host, port,
-                                                      local_sockets_[i]);
-            if (!result.success) continue;
-
-            // Avoid duplicates
-            bool dup = false;
-            for (const auto& c : local_candidates_) {
-                if (c.ip == result.public_ip && c.port == result.public_port) {
-                    dup = true;
-                    break;
-                }
+        if (haveCached) {
+            IceCandidate srflx;
+            srflx.type       = "srflx";
+            srflx.ip         = cached.public_ip;
+            srflx.port       = cached.public_port;
+            srflx.priority   = computePriority("srflx", localPrefCounter--, 1);
+            srflx.foundation = "srflx_" + cached.public_ip;
+            if (addLocalCandidate(srflx, sock)) {
+                CS_LOG(INFO, "ICE: srflx candidate %s:%u (cached, fd=%d)",
+                       cached.public_ip.c_str(), cached.public_port, sock);
             }
-            if (dup) continue;
+        } else {
+            queries.push_back({sock, ip, boundPort});
+        }
+    }
 
+    // -- 2. Gather server-reflexive candidates via STUN --
+    // Every interface asks every server at once; the first answer counts.
+    if (queries.empty() || stun_servers_.empty()) return local_candidates_;
+
+    const std::vector<StunServer> servers =
+        StunClient::resolveServers(stun_servers_, DEFAULT_STUN_PORT);
+    if (servers.empty()) return local_candidates_;
+
+    std::vector<std::thread> workers;
+    for (const PendingQuery& query : queries) {
+        workers.emplace_back([this, &servers, &localPrefCounter, query] {
+            StunClient stun;
+            StunResult result = stun.discoverFirst(servers, query.sock);
+            if (!result.success) return;
+            StunClient::cacheMapping(query.ip, query.port, result);
+
+            std::lock_guard<std::mutex> lock(gather_mutex_);
             IceCandidate cand;
             cand.type       = "srflx";
             cand.ip         = result.public_ip;
             cand.port       = result.public_port;
             cand.priority   = computePriority("srflx", localPrefCounter--, 1);
             cand.foundation = "srflx_" + result.public_ip;
-
-            local_candidates_.push_back(cand);
             // srflx candidates share the socket of the host candidate that
             // generated them.  We store the same socket fd; it will only be
             // closed once (tracked by the host entry index).
-            local_sockets_.push_back(local_sockets_[i]);
-
-            CS_LOG(INFO, "ICE: srflx candidate %s:%u (via %s, fd=%d)",
-                   result.public_ip.c_str(), result.public_port,
-                   server.c_str(), local_sockets_[i]);
-        }
+            if (addLocalCandidate(cand, query.sock)) {
+                CS_LOG(INFO, "ICE: srflx candidate %s:%u (fd=%d)",
+                       result.public_ip.c_str(), result.public_port, query.sock);
+            }
+        });
     }
+    for (auto& worker : workers) worker.join();
 
     return local_candidates_;
 }
 
+bool IceAgent::addLocalCandidate(const IceCandidate& candidate, int sock) {
+    // Avoid duplicates (interfaces behind one NAT can map alike)
+    for (const auto& c : local_candidates_) {
+        if (c.ip == candidate.ip && c.port == candidate.port) return false;
+    }
+    local_candidates_.push_back(candidate);
+    local_sockets_.push_back(sock);
+    if (on_candidate_) on_candidate_(candidate);
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 // addRemoteCandidate
 // ---------------------------------------------------------------------------
@@ -193,24 +233,115 @@ bool IceAgent::startConnectivityChecks() {
         CS_LOG(WARN, "ICE: checks already running");
         return false;
     }
+    if (worker_.joinable()) worker_.join();
+    if (turn_thread_.joinable()) turn_thread_.join();
 
+    {
+        std::lock_guard<std::mutex> result_lock(result_mutex_);
+        stats_ = ConnectStats();
+    }
+    check_start_ = std::chrono::steady_clock::now();
     running_.store(true);
     connected_.store(false);
+    relayed_.store(false);
+    relay_ready_.store(false);
+
+    // The relay is allocated while the direct checks run, so it is ready
+    // by the time they would have failed.
+    if (!turn_configs_.empty()) {
+        if (turn_client_) turn_client_->close();
+        turn_client_ = turn_pool_ ? turn_pool_->acquire(turn_configs_.front()) : nullptr;
+        if (!turn_client_) turn_client_ = std::make_unique<TurnClient>(turn_configs_.front());
+        turn_thread_ = std::thread(&IceAgent::allocateRelay, this, remote_candidates_);
+    }
     worker_ = std::thread(&IceAgent::connectivityCheckLoop, this);
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// allocateRelay -- TURN allocation, alongside the direct checks
+// ---------------------------------------------------------------------------
+void IceAgent::allocateRelay(std::vector<IceCandidate> remotes) {
+    const bool pooled = turn_client_->isAllocated();
+    if (!pooled && !turn_client_->allocate().success) {
+        CS_LOG(WARN, "ICE: TURN allocation failed -- direct checks only");
+        return;
+    }
+
+    // A permission covers an IP, whatever the port.  All of them go in one
+    // request; if the server refuses it (one bad address refuses them all),
+    // each is asked for on its own.
+    std::vector<std::string> ips;
+    for (const auto& remote : remotes) {
+        if (std::find(ips.begin(), ips.end(), remote.ip) == ips.end()) ips.push_back(remote.ip);
+    }
+    std::vector<std::string> permitted;
+    if (turn_client_->createPermissions(ips)) {
+        permitted = ips;
+    } else {
+        for (const auto& ip : ips) {
+            if (!running_.load()) return;
+            if (turn_client_->createPermission(ip)) permitted.push_back(ip);
+        }
+    }
+    if (permitted.empty()) {
+        CS_LOG(WARN, "ICE: TURN relay has no permitted peer");
+        return;
+    }
+
+    // Channels are bound before the relay is handed to the check loop, so
+    // no transaction here reads the relay socket once it does.  A peer
+    // without one is still reached with Send indications.
+    for (const auto& remote : remotes) {
+        if (!running_.load()) return;
+        if (std::find(permitted.begin(), permitted.end(), remote.ip) == permitted.end()) continue;
+        turn_client_->bindChannel(remote.ip, remote.port);
+    }
+
+    const auto ready_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - check_start_).count();
+    {
+        std::lock_guard<std::mutex> lock(result_mutex_);
+        stats_.relay_ready_ms = static_cast<int32_t>(ready_ms);
+    }
+    relay_ready_.store(true);
+    CS_LOG(INFO, "ICE: relay %s:%u%s ready after %lld ms",
+           turn_client_->getRelayIp().c_str(), turn_client_->getRelayPort(),
+           pooled ? " (pooled)" : "", static_cast<long long>(ready_ms));
+}
+
+// ---------------------------------------------------------------------------
+// pairPriority (RFC 8445 section 6.1.2.3)
+//
+//   priority = 2^32 * min(G, D) + 2 * max(G, D) + (G > D ? 1 : 0)
+//
+// with this agent's candidate as G.
+// ---------------------------------------------------------------------------
+uint64_t IceAgent::pairPriority(uint32_t local, uint32_t remote) {
+    const uint64_t lo = std::min(local, remote);
+    const uint64_t hi = std::max(local, remote);
+    return (lo << 32) + 2 * hi + (local > remote ? 1 : 0);
+}
+
 // ---------------------------------------------------------------------------
 // connectivityCheckLoop -- background thread
 //
-// Strategy: for each (local, remote) pair, send a probe packet every 200 ms.
-// Simultaneously listen on all local sockets for incoming probes.  The first
-// pair to receive a valid probe response wins.
+// Strategy: every (local socket, remote) pair is checked, highest priority
+// first, one check per CHECK_PACING_MS; a pair is re-checked after its
+// own timeout, doubling from CHECK_RTO_MS to CHECK_RTO_MAX_MS, since hole
+// punching needs both sides sending.  All sockets, and the relay's once it
+// is ready, are read in one select() that sleeps until the next check is
+// due.  The first pair to receive a valid probe wins.
 // ---------------------------------------------------------------------------
 void IceAgent::connectivityCheckLoop() {
+    ScopedThreadRole role(ThreadRole::NETWORK);
+    using Clock = std::chrono::steady_clock;
+    using std::chrono::milliseconds;
+
     CS_LOG(INFO, "ICE: connectivity check thread started");
 
-    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    const auto start    = check_start_;
+    const auto deadline = start + milliseconds(CHECK_TIMEOUT_MS);
 
     // Snapshot remote candidates (they shouldn't change during checks, but
     // holding the lock for 5 seconds is undesirable).
@@ -220,73 +351,174 @@ void IceAgent::connectivityCheckLoop() {
         remotes = remote_candidates_;
     }
 
-    // Put all local sockets into non-blocking mode
-    for (int s : local_sockets_) {
+    // Precompute destination sockaddrs for each remote candidate
+    std::vector<struct sockaddr_in> dests(remotes.size());
+    for (size_t ri = 0; ri < remotes.size(); ++ri) {
+        std::memset(&dests[ri], 0, sizeof(dests[ri]));
+        dests[ri].sin_family = AF_INET;
+        dests[ri].sin_port   = htons(remotes[ri].port);
+        ::inet_pton(AF_INET, remotes[ri].ip.c_str(), &dests[ri].sin_addr);
+    }
+
+    // One entry per socket: srflx candidates share their host candidate's
+    // socket, and a check from it tests both.
+    std::vector<size_t> socket_owner;       // local_candidates_ index
+    for (size_t li = 0; li < local_sockets_.size(); ++li) {
+        const int s = local_sockets_[li];
+        bool seen = false;
+        for (size_t owner : socket_owner) {
+            if (local_sockets_[owner] == s) seen = true;
+        }
+        if (seen) continue;
         cs_set_nonblocking(s);
+        socket_owner.push_back(li);
     }
 
-    // Precompute destination sockaddrs for each remote candidate
-    struct RemoteAddr {
-        struct sockaddr_in addr;
-        size_t remoteIdx;
+    // The check list
+    static constexpr size_t RELAY = SIZE_MAX;
+    struct CheckPair {
+        size_t            local;            // socket_owner entry, or RELAY
+        size_t            remote;
+        uint64_t          priority;
+        Clock::time_point next_check;
+        uint32_t          rto_ms;
     };
-    std::vector<RemoteAddr> dests;
-    for (size_t ri = 0; ri < remotes.size(); ++ri) {
-        RemoteAddr ra;
-        std::memset(&ra.addr, 0, sizeof(ra.addr));
-        ra.addr.sin_family = AF_INET;
-        ra.addr.sin_port   = htons(remotes[ri].port);
-        ::inet_pton(AF_INET, remotes[ri].ip.c_str(), &ra.addr.sin_addr);
-        ra.remoteIdx = ri;
-        dests.push_back(ra);
+    std::vector<CheckPair> pairs;
+    for (size_t si = 0; si < socket_owner.size(); ++si) {
+        for (size_t ri = 0; ri < remotes.size(); ++ri) {
+            pairs.push_back({si, ri,
+                             pairPriority(local_candidates_[socket_owner[si]].priority,
+                                          remotes[ri].priority),
+                             start, CHECK_RTO_MS});
+        }
     }
+    std::stable_sort(pairs.begin(), pairs.end(),
+                     [](const CheckPair& a, const CheckPair& b) { return a.priority > b.priority; });
 
-    auto lastSend = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+    IceCandidate relay_local;
+    int          relay_sock = -1;
+    uint32_t     checks_sent = 0;
+    auto         next_tick = start;
 
     while (running_.load() && !connected_.load()) {
-        auto now = std::chrono::steady_clock::now();
+        auto now = Clock::now();
 
         // Check timeout
         if (now >= deadline) {
-            CS_LOG(WARN, "ICE: connectivity checks timed out after 5 s");
+            CS_LOG(WARN, "ICE: connectivity checks timed out after %u ms (%u checks)",
+                   CHECK_TIMEOUT_MS, checks_sent);
+            {
+                std::lock_guard<std::mutex> lock(result_mutex_);
+                stats_.checks_sent = checks_sent;
+            }
             running_.store(false);
             if (on_failed_) on_failed_();
             return;
         }
 
-        // Send probes every 200 ms from each local socket to each remote addr
-        if (now - lastSend >= std::chrono::milliseconds(200)) {
-            lastSend = now;
-            for (size_t li = 0; li < local_sockets_.size(); ++li) {
-                for (const auto& dest : dests) {
-                    ::sendto(local_sockets_[li],
+        // Relay pairs join once the relay is up.  Their priority is the
+        // lowest, so they go at the end of the list.
+        if (relay_sock < 0 && relay_ready_.load() &&
+            now - start >= milliseconds(RELAY_HOLDOFF_MS)) {
+            relay_sock = turn_client_->getSocket();
+            cs_set_nonblocking(relay_sock);
+
+            relay_local.type       = "relay";
+            relay_local.ip         = turn_client_->getRelayIp();
+            relay_local.port       = turn_client_->getRelayPort();
+            relay_local.priority   = computePriority("relay", 65535, 1);
+            relay_local.foundation = "relay_" + relay_local.ip;
+            for (size_t ri = 0; ri < remotes.size(); ++ri) {
+                pairs.push_back({RELAY, ri, pairPriority(relay_local.priority, remotes[ri].priority),
+                                 now, CHECK_RTO_MS});
+            }
+        }
+
+        // One check per tick: the highest-priority pair that is due
+        if (now >= next_tick) {
+            for (CheckPair& pair : pairs) {
+                if (pair.next_check > now) continue;
+                if (pair.local == RELAY) {
+                    turn_client_->sendData(PROBE_MAGIC, sizeof(PROBE_MAGIC),
+                                           remotes[pair.remote].ip, remotes[pair.remote].port);
+                } else {
+                    ::sendto(local_sockets_[socket_owner[pair.local]],
                              reinterpret_cast<const char*>(PROBE_MAGIC),
                              sizeof(PROBE_MAGIC), 0,
-                             reinterpret_cast<const sockaddr*>(&dest.addr),
-                             sizeof(dest.addr));
+                             reinterpret_cast<const sockaddr*>(&dests[pair.remote]),
+                             sizeof(dests[pair.remote]));
                 }
+                pair.next_check = now + milliseconds(pair.rto_ms);
+                pair.rto_ms = std::min(pair.rto_ms * 2, CHECK_RTO_MAX_MS);
+                ++checks_sent;
+                next_tick = now + milliseconds(CHECK_PACING_MS);
+                break;
             }
         }
 
-        // Build fd_set for all local sockets and poll for 50 ms
+        // Sleep until the next check can go out, at most 50 ms
+        auto wake = now + milliseconds(50);
+        for (const CheckPair& pair : pairs) {
+            if (pair.next_check < wake) wake = pair.next_check;
+        }
+        if (wake < next_tick) wake = next_tick;
+        const auto wait_us = std::chrono::duration_cast<std::chrono::microseconds>(wake - now).count();
+
+        // Build fd_set for all local sockets (and the relay's)
         fd_set rfds;
         FD_ZERO(&rfds);
         int maxfd = 0;
-        for (int s : local_sockets_) {
+        for (size_t owner : socket_owner) {
+            const int s = local_sockets_[owner];
             FD_SET(static_cast<unsigned int>(s), &rfds);
             if (s > maxfd) maxfd = s;
         }
+        if (relay_sock >= 0) {
+            FD_SET(static_cast<unsigned int>(relay_sock), &rfds);
+            if (relay_sock > maxfd) maxfd = relay_sock;
+        }
 
         struct timeval tv;
         tv.tv_sec  = 0;
-        tv.tv_usec = 50'000; // 50 ms
+        tv.tv_usec = static_cast<long>(std::max<long long>(wait_us, 0));
 
         int sel = ::select(maxfd + 1, &rfds, nullptr, nullptr, &tv);
         if (sel <= 0) continue;
 
+        // Through the relay, the probe comes in a Data indication
+        if (relay_sock >= 0 && FD_ISSET(static_cast<unsigned int>(relay_sock), &rfds)) {
+            uint8_t buf[2048];
+            int n = ::recv(relay_sock, reinterpret_cast<char*>(buf), sizeof(buf), 0);
+            const uint8_t* payload = nullptr;
+            size_t         payload_len = 0;
+            std::string    peer_ip;
+            uint16_t       peer_port = 0;
+            if (n > 0 &&
+                turn_client_->unwrapData(buf, static_cast<size_t>(n), payload, payload_len,
+                                         peer_ip, peer_port) &&
+                payload_len >= sizeof(PROBE_MAGIC) &&
+                std::memcmp(payload, PROBE_MAGIC, sizeof(PROBE_MAGIC)) == 0) {
+                IceCandidate remote;
+                remote.type       = "prflx";
+                remote.ip         = peer_ip;
+                remote.port       = peer_port;
+                remote.priority   = computePriority("srflx", 1, 1);
+                remote.foundation = "prflx_" + peer_ip;
+                for (const auto& r : remotes) {
+                    if (r.ip == peer_ip && r.port == peer_port) remote = r;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(result_mutex_);
+                    stats_.checks_sent = checks_sent;
+                }
+                nominate(relay_local, remote, relay_sock, true);
+                return;
+            }
+        }
+
         // Check which socket(s) have data
-        for (size_t li = 0; li < local_sockets_.size(); ++li) {
-            int s = local_sockets_[li];
+        for (size_t owner : socket_owner) {
+            int s = local_sockets_[owner];
             if (!FD_ISSET(static_cast<unsigned int>(s), &rfds)) continue;
 
             uint8_t buf[64];
@@ -304,64 +536,33 @@ void IceAgent::connectivityCheckLoop() {
             ::inet_ntop(AF_INET, &from.sin_addr, fromIp, sizeof(fromIp));
             uint16_t fromPort = ntohs(from.sin_port);
 
-            for (size_t ri = 0; ri < remotes.size(); ++ri) {
-                if (remotes[ri].ip == fromIp && remotes[ri].port == fromPort) {
-                    // We have a winning pair!
-                    {
-                        std::lock_guard<std::mutex> lock(result_mutex_);
-                        selected_local_  = local_candidates_[li];
-                        selected_remote_ = remotes[ri];
-                        selected_socket_ = s;
-                    }
-                    connected_.store(true);
-                    running_.store(false);
-
-                    CS_LOG(INFO, "ICE: connected! local %s:%u <-> remote %s:%u (fd=%d)",
-                           local_candidates_[li].ip.c_str(),
-                           local_candidates_[li].port,
-                           remotes[ri].ip.c_str(), remotes[ri].port, s);
-
-                    // Connect the socket to the peer so the caller can just
-                    // use send()/recv() without specifying the address.
-                    ::connect(s, reinterpret_cast<const sockaddr*>(&from),
-                              sizeof(from));
-
-                    if (on_connected_) {
-                        on_connected_(local_candidates_[li], remotes[ri]);
-                    }
-                    return;
-                }
-            }
-
             // Probe came from an unknown source -- possibly the peer is
             // using a port we haven't been told about.  Accept it anyway
-            // as a "peer-reflexive" match against the first remote candidate
-            // (best-effort).
-            CS_LOG(INFO, "ICE: probe from unknown source %s:%u -- treating as peer-reflexive",
-                   fromIp, fromPort);
-
-            IceCandidate prflxRemote;
-            prflxRemote.type       = "prflx";
-            prflxRemote.ip         = fromIp;
-            prflxRemote.port       = fromPort;
-            prflxRemote.priority   = computePriority("srflx", 1, 1);
-            prflxRemote.foundation = "prflx_" + std::string(fromIp);
+            // as a "peer-reflexive" candidate (best-effort).
+            IceCandidate remote;
+            remote.type       = "prflx";
+            remote.ip         = fromIp;
+            remote.port       = fromPort;
+            remote.priority   = computePriority("srflx", 1, 1);
+            remote.foundation = "prflx_" + std::string(fromIp);
+            bool known = false;
+            for (const auto& r : remotes) {
+                if (r.ip == fromIp && r.port == fromPort) {
+                    remote = r;
+                    known = true;
+                    break;
+                }
+            }
+            if (!known) {
+                CS_LOG(INFO, "ICE: probe from unknown source %s:%u -- treating as peer-reflexive",
+                       fromIp, fromPort);
+            }
 
             {
                 std::lock_guard<std::mutex> lock(result_mutex_);
-                selected_local_  = local_candidates_[li];
-                selected_remote_ = prflxRemote;
-                selected_socket_ = s;
-            }
-            connected_.store(true);
-            running_.store(false);
-
-            ::connect(s, reinterpret_cast<const sockaddr*>(&from),
-                      sizeof(from));
-
-            if (on_connected_) {
-                on_connected_(local_candidates_[li], prflxRemote);
+                stats_.checks_sent = checks_sent;
             }
+            nominate(local_candidates_[owner], remote, s, false);
             return;
         }
     }
@@ -372,6 +573,54 @@ void IceAgent::connectivityCheckLoop() {
     }
 }
 
+// ---------------------------------------------------------------------------
+// nominate -- select the first pair that worked
+// ---------------------------------------------------------------------------
+void IceAgent::nominate(const IceCandidate& local, const IceCandidate& remote, int sock,
+                        bool relayed) {
+    const auto connect_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - check_start_).count();
+    {
+        std::lock_guard<std::mutex> lock(result_mutex_);
+        selected_local_  = local;
+        selected_remote_ = remote;
+        selected_socket_ = sock;
+        stats_.type       = relayed ? "relay" : remote.type;
+        stats_.connect_ms = static_cast<int32_t>(connect_ms);
+    }
+    relayed_.store(relayed);
+    connected_.store(true);
+    running_.store(false);
+
+    CS_LOG(INFO, "ICE: connected via %s in %lld ms! local %s:%u <-> remote %s:%u (fd=%d)",
+           relayed ? "relay" : remote.type.c_str(), static_cast<long long>(connect_ms),
+           local.ip.c_str(), local.port, remote.ip.c_str(), remote.port, sock);
+
+    // The peer may have stopped checking on a probe of its own; a few more
+    // of ours make sure the pair works in its direction too.
+    if (relayed) {
+        for (int i = 0; i < NOMINATE_REPEATS; ++i) {
+            turn_client_->sendData(PROBE_MAGIC, sizeof(PROBE_MAGIC), remote.ip, remote.port);
+        }
+    } else {
+        struct sockaddr_in peer = {};
+        peer.sin_family = AF_INET;
+        peer.sin_port   = htons(remote.port);
+        ::inet_pton(AF_INET, remote.ip.c_str(), &peer.sin_addr);
+
+        // Connect the socket to the peer so the caller can just use
+        // send()/recv() without specifying the address.
+        ::connect(sock, reinterpret_cast<const sockaddr*>(&peer), sizeof(peer));
+        for (int i = 0; i < NOMINATE_REPEATS; ++i) {
+            ::send(sock, reinterpret_cast<const char*>(PROBE_MAGIC), sizeof(PROBE_MAGIC), 0);
+        }
+    }
+
+    if (on_connected_) {
+        on_connected_(local, remote);
+    }
+}
+
 // ---------------------------------------------------------------------------
 // getSelectedPair
 // ---------------------------------------------------------------------------
@@ -400,6 +649,22 @@ void IceAgent::setOnFailed(std::function<void()> cb) {
     on_failed_ = std::move(cb);
 }
 
+void IceAgent::setOnCandidate(std::function<void(const IceCandidate&)> cb) {
+    on_candidate_ = std::move(cb);
+}
+
+// ---------------------------------------------------------------------------
+// isRelayed / getConnectStats
+// ---------------------------------------------------------------------------
+bool IceAgent::isRelayed() const {
+    return relayed_.load();
+}
+
+IceAgent::ConnectStats IceAgent::getConnectStats() const {
+    std::lock_guard<std::mutex> lock(result_mutex_);
+    return stats_;
+}
+
 // ---------------------------------------------------------------------------
 // stop
 // ---------------------------------------------------------------------------
@@ -409,6 +674,17 @@ void IceAgent::stop() {
         worker_.join();
     }
 
+    // An allocation in progress runs to its own timeout
+    if (turn_thread_.joinable()) {
+        turn_thread_.join();
+    }
+    if (turn_client_) {
+        turn_client_->close();
+        turn_client_.reset();
+    }
+    relay_ready_.store(false);
+    relayed_.store(false);
+
     // Close all local sockets (deduplicate, since srflx entries share a fd)
     std::vector<int> closed;
     for (int s : local_sockets_) {
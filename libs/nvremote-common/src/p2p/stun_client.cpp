@@ -5,9 +5,13 @@
 #include "cs/p2p/stun_client.h"
 #include "cs/common.h"
 
+#include <algorithm>
 #include <cstring>
 #include <random>
 #include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #ifdef _WIN32
   #include <WinSock2.h>
@@ -272,4 +276,196 @@ StunResult StunClient::discoverPublicEndpoint(const std::string& stun_server,
     return result;
 }
 
+// ---------------------------------------------------------------------------
+// resolveServers -- every server's address, looked up in parallel
+// ---------------------------------------------------------------------------
+std::vector<StunServer> StunClient::resolveServers(const std::vector<std::string>& servers,
+                                                   uint16_t default_port) {
+    std::vector<StunServer> resolved(servers.size());
+    std::vector<std::thread> lookups;
+    for (size_t i = 0; i < servers.size(); ++i) {
+        lookups.emplace_back([&servers, &resolved, default_port, i] {
+            // Parse optional port from "host:port" format
+            std::string host = servers[i];
+            uint16_t    port = default_port;
+            auto colon = host.rfind(':');
+            if (colon != std::string::npos) {
+                port = static_cast<uint16_t>(std::atoi(host.c_str() + colon + 1));
+                host.resize(colon);
+            }
+
+            struct addrinfo hints = {};
+            hints.ai_family   = AF_INET;
+            hints.ai_socktype = SOCK_DGRAM;
+
+            struct addrinfo* res = nullptr;
+            int gai = ::getaddrinfo(host.c_str(), nullptr, &hints, &res);
+            if (gai != 0 || !res) {
+                CS_LOG(WARN, "STUN: failed to resolve %s: %s", host.c_str(), gai_strerror(gai));
+                return;
+            }
+            char ipStr[INET_ADDRSTRLEN] = {};
+            ::inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(res->ai_addr)->sin_addr,
+                        ipStr, sizeof(ipStr));
+            ::freeaddrinfo(res);
+
+            resolved[i].name = servers[i];
+            resolved[i].ip   = ipStr;
+            resolved[i].port = port;
+        });
+    }
+    for (auto& lookup : lookups) lookup.join();
+
+    resolved.erase(std::remove_if(resolved.begin(), resolved.end(),
+                                  [](const StunServer& server) { return server.ip.empty(); }),
+                   resolved.end());
+    return resolved;
+}
+
+// ---------------------------------------------------------------------------
+// discoverFirst -- all servers at once, first answer wins
+// ---------------------------------------------------------------------------
+StunResult StunClient::discoverFirst(const std::vector<StunServer>& servers,
+                                     int local_socket) const {
+    using Clock = std::chrono::steady_clock;
+    using std::chrono::milliseconds;
+
+    StunResult result;
+    result.success = false;
+
+    struct Query {
+        const StunServer*   server;
+        struct sockaddr_in  addr;
+        uint8_t             request[20];
+        uint8_t             txnId[12];
+        Clock::time_point   next_send;
+        Clock::time_point   give_up;
+        int                 rto_ms;
+    };
+    const auto start = Clock::now();
+    std::vector<Query> queries(servers.size());
+    for (size_t i = 0; i < servers.size(); ++i) {
+        Query& q = queries[i];
+        q.server = &servers[i];
+        std::memset(&q.addr, 0, sizeof(q.addr));
+        q.addr.sin_family = AF_INET;
+        q.addr.sin_port   = htons(servers[i].port);
+        ::inet_pton(AF_INET, servers[i].ip.c_str(), &q.addr.sin_addr);
+        buildBindingRequest(q.request, q.txnId);
+        q.next_send = start;
+        q.give_up   = start + milliseconds(SERVER_TIMEOUT_MS);
+        q.rto_ms    = RETRANSMIT_MS;
+    }
+
+    for (;;) {
+        auto now = Clock::now();
+
+        // (Re)send what is due; the wait ends at the next send or timeout
+        bool any_live = false;
+        auto wake = now + milliseconds(SERVER_TIMEOUT_MS);
+        for (Query& q : queries) {
+            if (now >= q.give_up) continue;
+            any_live = true;
+            if (now >= q.next_send) {
+                int sent = ::sendto(local_socket,
+                                    reinterpret_cast<const char*>(q.request), 20, 0,
+                                    reinterpret_cast<const sockaddr*>(&q.addr),
+                                    sizeof(q.addr));
+                if (sent != 20) {
+                    CS_LOG(WARN, "STUN: sendto %s failed: %d",
+                           q.server->name.c_str(), cs_socket_error());
+                }
+                q.next_send = now + milliseconds(q.rto_ms);
+                q.rto_ms *= 2;
+            }
+            wake = std::min({wake, q.next_send, q.give_up});
+        }
+        if (!any_live) break;
+
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(static_cast<unsigned int>(local_socket), &rfds);
+
+        const auto wait_us = std::chrono::duration_cast<std::chrono::microseconds>(wake - now).count();
+        struct timeval tv;
+        tv.tv_sec  = static_cast<long>(std::max<long long>(wait_us, 0) / 1'000'000);
+        tv.tv_usec = static_cast<long>(std::max<long long>(wait_us, 0) % 1'000'000);
+
+        int sel = ::select(local_socket + 1, &rfds, nullptr, nullptr, &tv);
+        if (sel <= 0) continue;
+
+        uint8_t buf[1024];
+        struct sockaddr_storage from;
+        socklen_t fromLen = sizeof(from);
+        int n = ::recvfrom(local_socket, reinterpret_cast<char*>(buf),
+                           sizeof(buf), 0,
+                           reinterpret_cast<sockaddr*>(&from), &fromLen);
+        if (n <= 0) {
+            CS_LOG(WARN, "STUN: recvfrom failed: %d", cs_socket_error());
+            continue;
+        }
+
+        // The transaction ID says which query it answers
+        for (const Query& q : queries) {
+            std::string ip;
+            uint16_t port = 0;
+            if (n >= 20 && std::memcmp(buf + 8, q.txnId, 12) == 0 &&
+                parseBindingResponse(buf, static_cast<size_t>(n), q.txnId, ip, port)) {
+                result.public_ip   = ip;
+                result.public_port = port;
+                result.success     = true;
+                CS_LOG(INFO, "STUN: discovered %s:%u via %s in %lld ms",
+                       ip.c_str(), port, q.server->name.c_str(),
+                       static_cast<long long>(std::chrono::duration_cast<milliseconds>(
+                           Clock::now() - start).count()));
+                return result;
+            }
+        }
+    }
+
+    CS_LOG(DEBUG, "STUN: no answer from %zu server(s)", servers.size());
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Mapping cache, per local interface
+// ---------------------------------------------------------------------------
+namespace {
+
+struct CachedMapping {
+    uint16_t                              local_port = 0;
+    StunResult                            result;
+    std::chrono::steady_clock::time_point discovered;
+};
+
+std::mutex                            g_cache_mutex;
+std::map<std::string, CachedMapping>  g_cache;      // By local interface IP
+
+} // anonymous namespace
+
+bool StunClient::getCachedMapping(const std::string& local_ip, uint16_t& local_port,
+                                  StunResult& result) {
+    std::lock_guard<std::mutex> lock(g_cache_mutex);
+    auto it = g_cache.find(local_ip);
+    if (it == g_cache.end()) return false;
+    if (std::chrono::steady_clock::now() - it->second.discovered >
+        std::chrono::milliseconds(CACHE_TTL_MS)) {
+        g_cache.erase(it);
+        return false;
+    }
+    local_port = it->second.local_port;
+    result     = it->second.result;
+    return true;
+}
+
+void StunClient::cacheMapping(const std::string& local_ip, uint16_t local_port,
+                              const StunResult& result) {
+    if (!result.success) return;
+    std::lock_guard<std::mutex> lock(g_cache_mutex);
+    CachedMapping& entry = g_cache[local_ip];
+    entry.local_port = local_port;
+    entry.result     = result;
+    entry.discovered = std::chrono::steady_clock::now();
+}
+
 } // namespace cs
@@ -1,7 +1,8 @@
 ///////////////////////////////////////////////////////////////////////////////
 // turn_client.cpp -- TURN relay client (RFC 5766)
 //
-// Implements TURN Allocate, CreatePermission, Refresh, Send/Data Indication.
+// Implements TURN Allocate, CreatePermission, Refresh, ChannelBind,
+// ChannelData and Send/Data Indication.
 // Uses HMAC-SHA1 long-term credential mechanism compatible with coturn's
 // --use-auth-secret mode.
 //
@@ -25,6 +26,7 @@
   #include <arpa/inet.h>
   #include <netdb.h>
   #include <sys/select.h>
+  #include <sys/uio.h>
 #endif
 
 // OpenSSL for HMAC-SHA1 message integrity
@@ -50,6 +52,7 @@ static constexpr uint16_t PERMISSION_RESPONSE = 0x0108;
 static constexpr uint16_t SEND_INDICATION     = 0x0016;
 static constexpr uint16_t DATA_INDICATION     = 0x0017;
 static constexpr uint16_t CHANNEL_BIND        = 0x0009;
+static constexpr uint16_t CHANNEL_BIND_RESPONSE = 0x0109;
 
 // STUN magic cookie
 static constexpr uint32_t MAGIC_COOKIE = 0x2112A442;
@@ -59,6 +62,7 @@ static constexpr uint16_t ATTR_MAPPED_ADDRESS      = 0x0001;
 static constexpr uint16_t ATTR_USERNAME             = 0x0006;
 static constexpr uint16_t ATTR_MESSAGE_INTEGRITY    = 0x0008;
 static constexpr uint16_t ATTR_ERROR_CODE           = 0x0009;
+static constexpr uint16_t ATTR_CHANNEL_NUMBER       = 0x000C;
 static constexpr uint16_t ATTR_LIFETIME             = 0x000D;
 static constexpr uint16_t ATTR_XOR_PEER_ADDRESS     = 0x0012;
 static constexpr uint16_t ATTR_DATA                 = 0x0013;
@@ -121,6 +125,38 @@ static uint32_t readU32(const uint8_t* p) {
             static_cast<uint32_t>(p[3]);
 }
 
+// ---------------------------------------------------------------------------
+// Helper: the TURN server's socket address
+// ---------------------------------------------------------------------------
+static struct sockaddr_in serverSockaddr(uint32_t addr, uint16_t port) {
+    struct sockaddr_in sa = {};
+    sa.sin_family      = AF_INET;
+    sa.sin_addr.s_addr = addr;
+    sa.sin_port        = port;
+    return sa;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: XOR-PEER-ADDRESS value (RFC 5766 section 14.3)
+// ---------------------------------------------------------------------------
+static bool xorPeerAddress(const std::string& peer_ip, uint16_t peer_port, uint8_t out[8]) {
+    struct in_addr inAddr;
+    if (::inet_pton(AF_INET, peer_ip.c_str(), &inAddr) != 1) return false;
+
+    std::memset(out, 0, 8);
+    out[1] = ADDR_FAMILY_IPV4;
+    uint16_t xPort = peer_port ^ static_cast<uint16_t>(MAGIC_COOKIE >> 16);
+    out[2] = static_cast<uint8_t>(xPort >> 8);
+    out[3] = static_cast<uint8_t>(xPort & 0xFF);
+    uint8_t rawAddr[4];
+    std::memcpy(rawAddr, &inAddr, 4);
+    out[4] = rawAddr[0] ^ static_cast<uint8_t>(MAGIC_COOKIE >> 24);
+    out[5] = rawAddr[1] ^ static_cast<uint8_t>(MAGIC_COOKIE >> 16);
+    out[6] = rawAddr[2] ^ static_cast<uint8_t>(MAGIC_COOKIE >> 8);
+    out[7] = rawAddr[3] ^ static_cast<uint8_t>(MAGIC_COOKIE);
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 // Helper: append a STUN/TURN attribute to a buffer
 // ---------------------------------------------------------------------------
@@ -455,6 +491,12 @@ TurnAllocation TurnClient::allocate() {
     allocation_.socket_fd = sock;
     allocation_.success = true;
     allocated_.store(true);
+    nonce_ = nonce;
+
+    // Data goes to the server without a lookup per datagram
+    const auto* serverAddr = reinterpret_cast<const sockaddr_in*>(res->ai_addr);
+    server_addr_ = serverAddr->sin_addr.s_addr;
+    server_port_ = serverAddr->sin_port;
 
     CS_LOG(INFO, "TURN: allocation successful — relay=%s:%u, mapped=%s:%u, lifetime=%us",
            allocation_.relay_ip.c_str(), allocation_.relay_port,
@@ -543,76 +585,82 @@ bool TurnClient::parseAllocateResponse(const uint8_t* data, size_t len) {
 }
 
 // ---------------------------------------------------------------------------
-// createPermission() -- TURN CreatePermission (RFC 5766 section 9)
+// transact() -- an authenticated request on the allocation's socket
+//
+// Requests after the Allocate carry the nonce its 401 challenge gave.  A
+// nonce the server has since expired gets a 438 (Stale Nonce) with a new
+// one, and the request is sent once more with it.
+// ---------------------------------------------------------------------------
+bool TurnClient::transact(uint16_t type, const std::vector<uint8_t>& attrs,
+                          uint8_t* resp, size_t resp_size, int& resp_len) {
+    const struct sockaddr_in server = serverSockaddr(server_addr_, server_port_);
+    for (int round = 0; round < 2; ++round) {
+        uint8_t txnId[12];
+        generateTxnId(txnId);
+        auto msg = buildAuthMessage(type, txnId, attrs,
+                                     config_.username, config_.realm, nonce_,
+                                     config_.credential);
+        if (!sendAndReceive(allocation_.socket_fd, reinterpret_cast<const sockaddr*>(&server),
+                            sizeof(server), msg, resp, resp_size, resp_len)) {
+            return false;
+        }
+        if (extractErrorCode(resp, static_cast<size_t>(resp_len)) != 438) return true;
+
+        std::string nonce = extractNonce(resp, static_cast<size_t>(resp_len));
+        if (nonce.empty()) return true;
+        CS_LOG(DEBUG, "TURN: stale nonce, retrying with the new one");
+        nonce_ = std::move(nonce);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// createPermission() / createPermissions() -- TURN CreatePermission
+// (RFC 5766 section 9)
 // ---------------------------------------------------------------------------
 bool TurnClient::createPermission(const std::string& peer_ip) {
+    return createPermissions({peer_ip});
+}
+
+bool TurnClient::createPermissions(const std::vector<std::string>& peer_ips) {
     if (!allocated_.load()) {
         CS_LOG(WARN, "TURN: createPermission called without allocation");
         return false;
     }
-    return sendCreatePermission(peer_ip);
+    if (peer_ips.empty()) return false;
+    return sendCreatePermission(peer_ips);
 }
 
 // ---------------------------------------------------------------------------
-// sendCreatePermission() -- build and send CreatePermission request
+// sendCreatePermission() -- one CreatePermission request for all of |peer_ips|
+//
+// A request may carry any number of XOR-PEER-ADDRESS attributes; the
+// server installs them all or, refusing one, none (section 9.2).
 // ---------------------------------------------------------------------------
-bool TurnClient::sendCreatePermission(const std::string& peer_ip) {
-    struct in_addr inAddr;
-    if (::inet_pton(AF_INET, peer_ip.c_str(), &inAddr) != 1) {
-        CS_LOG(ERR, "TURN: invalid peer IP for permission: %s", peer_ip.c_str());
-        return false;
-    }
-
-    // Build XOR-PEER-ADDRESS (port=0 for permissions — only IP matters)
-    uint8_t peerAddr[8] = {};
-    peerAddr[1] = ADDR_FAMILY_IPV4;
-    writeU16(peerAddr + 2, static_cast<uint16_t>(MAGIC_COOKIE >> 16)); // XOR with 0 = magic>>16
-    uint8_t rawAddr[4];
-    std::memcpy(rawAddr, &inAddr, 4);
-    peerAddr[4] = rawAddr[0] ^ static_cast<uint8_t>(MAGIC_COOKIE >> 24);
-    peerAddr[5] = rawAddr[1] ^ static_cast<uint8_t>(MAGIC_COOKIE >> 16);
-    peerAddr[6] = rawAddr[2] ^ static_cast<uint8_t>(MAGIC_COOKIE >> 8);
-    peerAddr[7] = rawAddr[3] ^ static_cast<uint8_t>(MAGIC_COOKIE);
-
+bool TurnClient::sendCreatePermission(const std::vector<std::string>& peer_ips) {
     std::vector<uint8_t> attrs;
-    appendAttribute(attrs, ATTR_XOR_PEER_ADDRESS, peerAddr, 8);
-
-    uint8_t txnId[12];
-    generateTxnId(txnId);
-
-    // Resolve server
-    struct addrinfo hints = {};
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_DGRAM;
-    char portStr[8];
-    std::snprintf(portStr, sizeof(portStr), "%u", config_.port);
-
-    struct addrinfo* res = nullptr;
-    if (::getaddrinfo(config_.server.c_str(), portStr, &hints, &res) != 0 || !res) {
-        CS_LOG(ERR, "TURN: failed to resolve server for CreatePermission");
-        return false;
+    for (const std::string& peer_ip : peer_ips) {
+        // Port 0: a permission covers the IP, whatever the port
+        uint8_t peerAddr[8];
+        if (!xorPeerAddress(peer_ip, 0, peerAddr)) {
+            CS_LOG(ERR, "TURN: invalid peer IP for permission: %s", peer_ip.c_str());
+            return false;
+        }
+        appendAttribute(attrs, ATTR_XOR_PEER_ADDRESS, peerAddr, 8);
     }
 
-    auto msg = buildAuthMessage(PERMISSION_REQUEST, txnId, attrs,
-                                 config_.username, config_.realm, "",
-                                 config_.credential);
-
     uint8_t respBuf[2048];
     int respLen = 0;
 
-    bool ok = sendAndReceive(allocation_.socket_fd, res->ai_addr,
-                              static_cast<socklen_t>(res->ai_addrlen),
-                              msg, respBuf, sizeof(respBuf), respLen);
-    ::freeaddrinfo(res);
-
-    if (!ok) {
+    if (!transact(PERMISSION_REQUEST, attrs, respBuf, sizeof(respBuf), respLen)) {
         CS_LOG(ERR, "TURN: no response to CreatePermission");
         return false;
     }
 
     uint16_t respType = readU16(respBuf);
     if (respType == PERMISSION_RESPONSE) {
-        CS_LOG(INFO, "TURN: permission created for peer %s", peer_ip.c_str());
+        CS_LOG(INFO, "TURN: permission created for %zu peer(s), first %s",
+               peer_ips.size(), peer_ips.front().c_str());
         return true;
     }
 
@@ -636,33 +684,10 @@ bool TurnClient::refresh(uint32_t lifetime) {
     std::vector<uint8_t> attrs;
     appendAttribute(attrs, ATTR_LIFETIME, lifetimeBuf, 4);
 
-    uint8_t txnId[12];
-    generateTxnId(txnId);
-
-    struct addrinfo hints = {};
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_DGRAM;
-    char portStr[8];
-    std::snprintf(portStr, sizeof(portStr), "%u", config_.port);
-
-    struct addrinfo* res = nullptr;
-    if (::getaddrinfo(config_.server.c_str(), portStr, &hints, &res) != 0 || !res) {
-        return false;
-    }
-
-    auto msg = buildAuthMessage(REFRESH_REQUEST, txnId, attrs,
-                                 config_.username, config_.realm, "",
-                                 config_.credential);
-
     uint8_t respBuf[2048];
     int respLen = 0;
 
-    bool ok = sendAndReceive(allocation_.socket_fd, res->ai_addr,
-                              static_cast<socklen_t>(res->ai_addrlen),
-                              msg, respBuf, sizeof(respBuf), respLen);
-    ::freeaddrinfo(res);
-
-    if (!ok) {
+    if (!transact(REFRESH_REQUEST, attrs, respBuf, sizeof(respBuf), respLen)) {
         CS_LOG(ERR, "TURN: no response to Refresh");
         return false;
     }
@@ -673,8 +698,23 @@ bool TurnClient::refresh(uint32_t lifetime) {
             CS_LOG(INFO, "TURN: allocation deallocated via refresh(0)");
             allocated_.store(false);
         } else {
-            CS_LOG(INFO, "TURN: allocation refreshed (lifetime=%us)", lifetime);
+            CS_LOG(DEBUG, "TURN: allocation refreshed (lifetime=%us)", lifetime);
             allocation_.lifetime = lifetime;
+
+            // Channel bindings expire on their own 10-minute clock
+            const auto now = std::chrono::steady_clock::now();
+            std::vector<Channel> stale;
+            {
+                std::lock_guard<std::mutex> lock(channels_mutex_);
+                for (const Channel& ch : channels_) {
+                    if (now - ch.bound >= std::chrono::seconds(CHANNEL_REFRESH_S)) {
+                        stale.push_back(ch);
+                    }
+                }
+            }
+            for (const Channel& ch : stale) {
+                bindChannel(ch.peer_ip, ch.peer_port);
+            }
         }
         return true;
     }
@@ -685,7 +725,74 @@ bool TurnClient::refresh(uint32_t lifetime) {
 }
 
 // ---------------------------------------------------------------------------
-// sendData() -- TURN Send Indication (RFC 5766 section 10)
+// bindChannel() -- TURN ChannelBind (RFC 5766 section 11)
+// ---------------------------------------------------------------------------
+bool TurnClient::bindChannel(const std::string& peer_ip, uint16_t peer_port) {
+    if (!allocated_.load()) {
+        CS_LOG(WARN, "TURN: bindChannel called without allocation");
+        return false;
+    }
+
+    // A bound peer keeps its number; another gets the next free one
+    size_t index = 0;
+    {
+        std::lock_guard<std::mutex> lock(channels_mutex_);
+        while (index < channels_.size() &&
+               !(channels_[index].peer_ip == peer_ip && channels_[index].peer_port == peer_port)) {
+            ++index;
+        }
+        if (index >= static_cast<size_t>(CHANNEL_LAST - CHANNEL_FIRST) + 1) {
+            CS_LOG(WARN, "TURN: no channel number left for %s:%u", peer_ip.c_str(), peer_port);
+            return false;
+        }
+    }
+
+    const auto number = static_cast<uint16_t>(CHANNEL_FIRST + index);
+    if (!sendChannelBind(number, peer_ip, peer_port)) return false;
+
+    std::lock_guard<std::mutex> lock(channels_mutex_);
+    if (index == channels_.size()) {
+        channels_.push_back({peer_ip, peer_port, {}});
+    }
+    channels_[index].bound = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool TurnClient::sendChannelBind(uint16_t number, const std::string& peer_ip, uint16_t peer_port) {
+    uint8_t peerAddr[8];
+    if (!xorPeerAddress(peer_ip, peer_port, peerAddr)) {
+        CS_LOG(ERR, "TURN: invalid peer IP for channel: %s", peer_ip.c_str());
+        return false;
+    }
+
+    uint8_t channelNumber[4] = {};      // Number + 2 bytes RFFU
+    writeU16(channelNumber, number);
+
+    std::vector<uint8_t> attrs;
+    appendAttribute(attrs, ATTR_CHANNEL_NUMBER, channelNumber, 4);
+    appendAttribute(attrs, ATTR_XOR_PEER_ADDRESS, peerAddr, 8);
+
+    uint8_t respBuf[2048];
+    int respLen = 0;
+
+    if (!transact(CHANNEL_BIND, attrs, respBuf, sizeof(respBuf), respLen)) {
+        CS_LOG(ERR, "TURN: no response to ChannelBind");
+        return false;
+    }
+
+    uint16_t respType = readU16(respBuf);
+    if (respType == CHANNEL_BIND_RESPONSE) {
+        CS_LOG(INFO, "TURN: channel 0x%04X bound to peer %s:%u", number, peer_ip.c_str(), peer_port);
+        return true;
+    }
+
+    int err = extractErrorCode(respBuf, static_cast<size_t>(respLen));
+    CS_LOG(ERR, "TURN: ChannelBind failed, error=%d", err);
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// sendData() -- ChannelData, or a TURN Send Indication (RFC 5766 section 10)
 // Send Indications carry data to a peer through the relay. No response
 // is expected (indications are fire-and-forget).
 // ---------------------------------------------------------------------------
@@ -696,23 +803,63 @@ bool TurnClient::sendData(const uint8_t* payload, size_t len,
         return false;
     }
 
-    struct in_addr inAddr;
-    if (::inet_pton(AF_INET, peer_ip.c_str(), &inAddr) != 1) {
-        CS_LOG(ERR, "TURN: invalid peer IP: %s", peer_ip.c_str());
-        return false;
+    const struct sockaddr_in server = serverSockaddr(server_addr_, server_port_);
+
+    // Hot path: a bound channel's 4-byte header, gathered with the payload
+    // (over UDP the padding to 4 bytes is optional and left out)
+    int channel = -1;
+    {
+        std::lock_guard<std::mutex> lock(channels_mutex_);
+        for (size_t i = 0; i < channels_.size(); ++i) {
+            if (channels_[i].peer_port == peer_port && channels_[i].peer_ip == peer_ip) {
+                channel = static_cast<int>(CHANNEL_FIRST + i);
+                break;
+            }
+        }
+    }
+    if (channel >= 0 && len <= 0xFFFF) {
+        uint8_t header[4];
+        writeU16(header, static_cast<uint16_t>(channel));
+        writeU16(header + 2, static_cast<uint16_t>(len));
+
+#ifdef _WIN32
+        WSABUF bufs[2];
+        bufs[0].buf = reinterpret_cast<CHAR*>(header);
+        bufs[0].len = sizeof(header);
+        bufs[1].buf = reinterpret_cast<CHAR*>(const_cast<uint8_t*>(payload));
+        bufs[1].len = static_cast<ULONG>(len);
+        DWORD sent = 0;
+        if (::WSASendTo(static_cast<SOCKET>(allocation_.socket_fd), bufs, 2, &sent, 0,
+                        reinterpret_cast<const sockaddr*>(&server), sizeof(server),
+                        nullptr, nullptr) != 0) {
+            CS_LOG(WARN, "TURN: ChannelData send failed: %d", cs_socket_error());
+            return false;
+        }
+#else
+        struct iovec iov[2];
+        iov[0].iov_base = header;
+        iov[0].iov_len  = sizeof(header);
+        iov[1].iov_base = const_cast<uint8_t*>(payload);
+        iov[1].iov_len  = len;
+        struct msghdr mh = {};
+        mh.msg_name    = const_cast<sockaddr_in*>(&server);
+        mh.msg_namelen = sizeof(server);
+        mh.msg_iov     = iov;
+        mh.msg_iovlen  = 2;
+        if (::sendmsg(allocation_.socket_fd, &mh, 0) <= 0) {
+            CS_LOG(WARN, "TURN: ChannelData send failed: %d", cs_socket_error());
+            return false;
+        }
+#endif
+        return true;
     }
 
     // Build XOR-PEER-ADDRESS with actual peer port
-    uint8_t peerAddr[8] = {};
-    peerAddr[1] = ADDR_FAMILY_IPV4;
-    uint16_t xPort = peer_port ^ static_cast<uint16_t>(MAGIC_COOKIE >> 16);
-    writeU16(peerAddr + 2, xPort);
-    uint8_t rawAddr[4];
-    std::memcpy(rawAddr, &inAddr, 4);
-    peerAddr[4] = rawAddr[0] ^ static_cast<uint8_t>(MAGIC_COOKIE >> 24);
-    peerAddr[5] = rawAddr[1] ^ static_cast<uint8_t>(MAGIC_COOKIE >> 16);
-    peerAddr[6] = rawAddr[2] ^ static_cast<uint8_t>(MAGIC_COOKIE >> 8);
-    peerAddr[7] = rawAddr[3] ^ static_cast<uint8_t>(MAGIC_COOKIE);
+    uint8_t peerAddr[8];
+    if (!xorPeerAddress(peer_ip, peer_port, peerAddr)) {
+        CS_LOG(ERR, "TURN: invalid peer IP: %s", peer_ip.c_str());
+        return false;
+    }
 
     // Build Send Indication (no MESSAGE-INTEGRITY needed for indications)
     std::vector<uint8_t> msg;
@@ -729,23 +876,10 @@ bool TurnClient::sendData(const uint8_t* payload, size_t len,
     // Final message length
     writeU16(&msg[2], static_cast<uint16_t>(msg.size() - 20));
 
-    // Resolve server and send
-    struct addrinfo hints = {};
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_DGRAM;
-    char portStr[8];
-    std::snprintf(portStr, sizeof(portStr), "%u", config_.port);
-
-    struct addrinfo* res = nullptr;
-    if (::getaddrinfo(config_.server.c_str(), portStr, &hints, &res) != 0 || !res) {
-        return false;
-    }
-
     int sent = ::sendto(allocation_.socket_fd,
                         reinterpret_cast<const char*>(msg.data()),
                         static_cast<int>(msg.size()), 0,
-                        res->ai_addr, static_cast<int>(res->ai_addrlen));
-    ::freeaddrinfo(res);
+                        reinterpret_cast<const sockaddr*>(&server), sizeof(server));
 
     if (sent <= 0) {
         CS_LOG(WARN, "TURN: sendData failed: %d", cs_socket_error());
@@ -755,6 +889,74 @@ bool TurnClient::sendData(const uint8_t* payload, size_t len,
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// unwrapData() -- TURN Data Indication (RFC 5766 section 10.4)
+// ---------------------------------------------------------------------------
+bool TurnClient::unwrapData(const uint8_t* data, size_t len,
+                            const uint8_t*& payload, size_t& payload_len,
+                            std::string& peer_ip, uint16_t& peer_port) const {
+    // ChannelData: the first two bits are 01, where a STUN message's are 00
+    if (len >= 4 && (data[0] & 0xC0) == 0x40) {
+        const uint16_t number = readU16(data);
+        const size_t   length = readU16(data + 2);
+        if (length > len - 4) return false;
+
+        std::lock_guard<std::mutex> lock(channels_mutex_);
+        const size_t index = number - CHANNEL_FIRST;
+        if (index >= channels_.size()) return false;
+        peer_ip     = channels_[index].peer_ip;
+        peer_port   = channels_[index].peer_port;
+        payload     = data + 4;
+        payload_len = length;
+        return true;
+    }
+
+    if (len < 20 || readU16(data) != DATA_INDICATION || readU32(data + 4) != MAGIC_COOKIE) {
+        return false;
+    }
+
+    uint16_t msgLen = readU16(data + 2);
+    size_t offset = 20;
+    size_t end = 20 + msgLen;
+    if (end > len) end = len;
+
+    bool foundPeer = false;
+    bool foundData = false;
+
+    while (offset + 4 <= end) {
+        uint16_t attrType = readU16(data + offset);
+        uint16_t attrLen = readU16(data + offset + 2);
+        offset += 4;
+        if (offset + attrLen > end) break;
+
+        if (attrType == ATTR_XOR_PEER_ADDRESS && attrLen >= 8 &&
+            data[offset + 1] == ADDR_FAMILY_IPV4) {
+            peer_port = readU16(data + offset + 2) ^ static_cast<uint16_t>(MAGIC_COOKIE >> 16);
+
+            uint8_t xaddr[4];
+            xaddr[0] = data[offset + 4] ^ static_cast<uint8_t>(MAGIC_COOKIE >> 24);
+            xaddr[1] = data[offset + 5] ^ static_cast<uint8_t>(MAGIC_COOKIE >> 16);
+            xaddr[2] = data[offset + 6] ^ static_cast<uint8_t>(MAGIC_COOKIE >> 8);
+            xaddr[3] = data[offset + 7] ^ static_cast<uint8_t>(MAGIC_COOKIE);
+
+            char ipStr[INET_ADDRSTRLEN] = {};
+            struct in_addr addr;
+            std::memcpy(&addr, xaddr, 4);
+            ::inet_ntop(AF_INET, &addr, ipStr, sizeof(ipStr));
+            peer_ip = ipStr;
+            foundPeer = true;
+        } else if (attrType == ATTR_DATA) {
+            payload     = data + offset;
+            payload_len = attrLen;
+            foundData   = true;
+        }
+
+        offset += (attrLen + 3) & ~3u;
+    }
+
+    return foundPeer && foundData;
+}
+
 // ---------------------------------------------------------------------------
 // setOnData() -- register callback for relayed data
 // ---------------------------------------------------------------------------
@@ -782,6 +984,9 @@ void TurnClient::close() {
         cs_close_socket(allocation_.socket_fd);
         allocation_.socket_fd = -1;
     }
+
+    std::lock_guard<std::mutex> lock(channels_mutex_);
+    channels_.clear();
 }
 
 } // namespace cs
@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////////////////////////////////
+// turn_pool.cpp -- TURN allocations made ahead, kept refreshed
+//
+// One background thread does all of the pool's network work: it allocates
+// spares up to SPARE_ALLOCATIONS and refreshes the one refreshed longest
+// ago once it is due.  A spare is taken out of spares_ while it is
+// refreshed, so acquire() never hands out one whose socket is in use, and
+// the mutex is never held across a round trip.  Releasing an allocation
+// (TurnClient::close(), a Refresh with lifetime 0) is a round trip too, so
+// released spares are destroyed outside the lock.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cs/p2p/turn_pool.h"
+#include "cs/common.h"
+#include "cs/thread_policy.h"
+
+#include <algorithm>
+
+namespace cs {
+
+TurnPool::~TurnPool() {
+    stop();
+}
+
+// ---------------------------------------------------------------------------
+// start / stop
+// ---------------------------------------------------------------------------
+void TurnPool::start(const TurnConfig& config) {
+    std::vector<Spare> released;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        config_ = config;
+        for (auto it = spares_.begin(); it != spares_.end();) {
+            if (sameServer(it->client->getConfig(), config_)) {
+                ++it;
+            } else {
+                released.push_back(std::move(*it));
+                it = spares_.erase(it);
+            }
+        }
+        if (!thread_.joinable()) {
+            stop_ = false;
+            thread_ = std::thread(&TurnPool::maintainLoop, this);
+        }
+    }
+    cv_.notify_one();
+    CS_LOG(INFO, "TURN pool: keeping %zu allocations on %s:%u",
+           SPARE_ALLOCATIONS, config.server.c_str(), config.port);
+}
+
+void TurnPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+
+    std::vector<Spare> released;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        released.swap(spares_);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// acquire
+// ---------------------------------------------------------------------------
+std::unique_ptr<TurnClient> TurnPool::acquire(const TurnConfig& config) {
+    std::unique_ptr<TurnClient> client;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find_if(spares_.begin(), spares_.end(), [&config](const Spare& spare) {
+            return sameServer(spare.client->getConfig(), config) && spare.client->isAllocated();
+        });
+        if (it == spares_.end()) return nullptr;
+        client = std::move(it->client);
+        spares_.erase(it);
+    }
+    cv_.notify_one();
+
+    CS_LOG(INFO, "TURN pool: handing out relay %s:%u",
+           client->getRelayIp().c_str(), client->getRelayPort());
+    return client;
+}
+
+// ---------------------------------------------------------------------------
+// maintainLoop -- allocate spares, refresh them when due
+// ---------------------------------------------------------------------------
+void TurnPool::maintainLoop() {
+    ScopedThreadRole role(ThreadRole::NETWORK);
+    using std::chrono::steady_clock;
+    const auto refresh_interval = std::chrono::seconds(REFRESH_INTERVAL_S);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    steady_clock::time_point retry_at;
+    while (!stop_) {
+        const auto now = steady_clock::now();
+
+        // The spare refreshed longest ago, if it is due
+        auto oldest = std::min_element(spares_.begin(), spares_.end(),
+                                       [](const Spare& a, const Spare& b) {
+                                           return a.refreshed < b.refreshed;
+                                       });
+        if (oldest != spares_.end() && now - oldest->refreshed >= refresh_interval) {
+            Spare spare = std::move(*oldest);
+            spares_.erase(oldest);
+            lock.unlock();
+            const bool refreshed = spare.client->refresh(LIFETIME_S);
+            lock.lock();
+            if (refreshed && sameServer(spare.client->getConfig(), config_)) {
+                spare.refreshed = steady_clock::now();
+                spares_.push_back(std::move(spare));
+            } else {
+                if (!refreshed) CS_LOG(WARN, "TURN pool: refresh failed -- replacing the allocation");
+                lock.unlock();
+                spare.client.reset();
+                lock.lock();
+            }
+            continue;
+        }
+
+        if (spares_.size() < SPARE_ALLOCATIONS && now >= retry_at) {
+            const TurnConfig config = config_;
+            lock.unlock();
+            auto client = std::make_unique<TurnClient>(config);
+            const bool allocated = client->allocate().success;
+            lock.lock();
+            if (!allocated) {
+                CS_LOG(WARN, "TURN pool: allocation on %s:%u failed -- retrying in %us",
+                       config.server.c_str(), config.port, RETRY_S);
+                retry_at = steady_clock::now() + std::chrono::seconds(RETRY_S);
+            } else if (sameServer(config, config_) && spares_.size() < SPARE_ALLOCATIONS) {
+                spares_.push_back({std::move(client), steady_clock::now()});
+            }
+            if (client) {
+                lock.unlock();
+                client.reset();
+                lock.lock();
+            }
+            continue;
+        }
+
+        auto wake = now + refresh_interval;
+        if (oldest != spares_.end()) wake = oldest->refreshed + refresh_interval;
+        if (spares_.size() < SPARE_ALLOCATIONS) wake = std::min(wake, retry_at);
+        cv_.wait_until(lock, wake);
+    }
+}
+
+} // namespace cs
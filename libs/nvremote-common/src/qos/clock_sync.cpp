@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////
+// clock_sync.cpp -- NTP-style clock offset and drift estimation
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cs/qos/clock_sync.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// addExchange
+// ---------------------------------------------------------------------------
+
+bool ClockSync::addExchange(uint32_t t1, uint32_t t2, uint32_t hold_us, uint64_t now_us) {
+    const uint32_t t4    = static_cast<uint32_t>(now_us);
+    const uint32_t total = t4 - t1;
+    if (hold_us > total || total - hold_us > MAX_RTT_US) return false;   // Stale or garbled echo
+    const uint32_t rtt    = total - hold_us;
+    const uint32_t offset = t2 - t1 - rtt / 2;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!have_ref_) {
+        ref_      = offset;
+        have_ref_ = true;
+    }
+
+    Sample& s   = samples_[next_];
+    s.at_us     = now_us - total / 2;
+    s.offset_us = static_cast<int32_t>(offset - ref_);
+    s.rtt_us    = rtt;
+    next_ = (next_ + 1) % WINDOW_SAMPLES;
+    if (count_ < WINDOW_SAMPLES) count_++;
+
+    refit();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// refit -- line through the trusted samples
+// ---------------------------------------------------------------------------
+
+void ClockSync::refit() {
+    uint32_t min_rtt = UINT32_MAX;
+    for (size_t i = 0; i < count_; ++i) min_rtt = std::min(min_rtt, samples_[i].rtt_us);
+    const uint32_t limit = min_rtt + RTT_SLACK_US;
+
+    // Least squares of offset over time, about the trusted samples' centroid
+    size_t   n       = 0;
+    uint64_t base_us = 0;
+    uint64_t first_us = UINT64_MAX, last_us = 0;
+    double   sum_t = 0.0, sum_o = 0.0;
+    for (size_t i = 0; i < count_; ++i) {
+        const Sample& s = samples_[i];
+        if (s.rtt_us > limit) continue;
+        if (n == 0) base_us = s.at_us;
+        sum_t += static_cast<double>(static_cast<int64_t>(s.at_us - base_us));
+        sum_o += s.offset_us;
+        first_us = std::min(first_us, s.at_us);
+        last_us  = std::max(last_us, s.at_us);
+        n++;
+    }
+    const double mean_t = sum_t / static_cast<double>(n);
+    const double mean_o = sum_o / static_cast<double>(n);
+
+    double drift = 0.0;
+    if (n >= MIN_DRIFT_SAMPLES && last_us - first_us >= MIN_DRIFT_SPAN_US) {
+        double stt = 0.0, sto = 0.0;
+        for (size_t i = 0; i < count_; ++i) {
+            const Sample& s = samples_[i];
+            if (s.rtt_us > limit) continue;
+            const double dt = static_cast<double>(static_cast<int64_t>(s.at_us - base_us)) - mean_t;
+            stt += dt * dt;
+            sto += dt * (s.offset_us - mean_o);
+        }
+        if (stt > 0.0) drift = std::clamp(sto / stt, -MAX_DRIFT, MAX_DRIFT);
+    }
+
+    model_at_us_     = base_us + static_cast<uint64_t>(static_cast<int64_t>(mean_t));
+    model_offset_us_ = mean_o;
+    drift_           = drift;
+    error_us_        = min_rtt / 2;
+    have_model_      = true;
+}
+
+// ---------------------------------------------------------------------------
+// Queries
+// ---------------------------------------------------------------------------
+
+bool ClockSync::hasEstimate() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return have_model_;
+}
+
+uint32_t ClockSync::offsetUs(uint64_t now_us) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!have_model_) return 0;
+    const double dt  = static_cast<double>(static_cast<int64_t>(now_us - model_at_us_));
+    const double rel = model_offset_us_ + drift_ * dt;
+    return ref_ + static_cast<uint32_t>(static_cast<int64_t>(std::llround(rel)));
+}
+
+uint32_t ClockSync::errorUs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return error_us_;
+}
+
+double ClockSync::driftPpm() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return drift_ * 1e6;
+}
+
+void ClockSync::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    count_      = 0;
+    next_       = 0;
+    have_ref_   = false;
+    have_model_ = false;
+    drift_      = 0.0;
+    error_us_   = 0;
+}
+
+} // namespace cs
@@ -0,0 +1,310 @@
+///////////////////////////////////////////////////////////////////////////////
+// thread_policy.cpp -- Thread role policies and their platform mappings
+//
+// The policy table is read once per thread start, under a mutex; nothing
+// here runs per frame.  A platform call the process lacks the right for
+// is logged once per role, at the first thread it fails on.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cs/thread_policy.h"
+#include "cs/common.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <avrt.h>
+#elif defined(__APPLE__)
+  #include <pthread.h>
+  #include <pthread/qos.h>
+#else
+  #include <pthread.h>
+  #include <sched.h>
+  #include <sys/resource.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+namespace cs {
+
+namespace {
+
+constexpr const char* ROLE_NAMES[THREAD_ROLE_COUNT] = {
+    "capture", "encode", "send", "receive", "decode", "render",
+    "audio", "feedback", "input", "network",
+};
+
+constexpr size_t PRIORITY_COUNT = 4;
+constexpr const char* PRIORITY_NAMES[PRIORITY_COUNT] = {
+    "normal", "above_normal", "high", "realtime",
+};
+
+constexpr int MAX_CPUS = 64;   // One affinity word (one Windows processor group)
+
+std::mutex     g_mutex;
+ThreadPolicies g_policies = defaultThreadPolicies();
+std::array<std::atomic<bool>, THREAD_ROLE_COUNT> g_warned{};
+
+std::string trim(const std::string& s) {
+    const size_t first = s.find_first_not_of(" \t");
+    if (first == std::string::npos) return {};
+    const size_t last = s.find_last_not_of(" \t");
+    return s.substr(first, last - first + 1);
+}
+
+std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    for (;;) {
+        const size_t end = s.find(sep, start);
+        parts.push_back(trim(s.substr(start, end - start)));
+        if (end == std::string::npos) break;
+        start = end + 1;
+    }
+    return parts;
+}
+
+bool parseCpu(const std::string& s, int& out) {
+    if (s.empty()) return false;
+    char* end = nullptr;
+    const long v = std::strtol(s.c_str(), &end, 10);
+    if (!end || *end != '\0' || v < 0 || v >= MAX_CPUS) return false;
+    out = static_cast<int>(v);
+    return true;
+}
+
+/// "2-3+6" -> bits 2, 3 and 6.
+bool parseCpus(const std::string& s, uint64_t& out) {
+    uint64_t mask = 0;
+    for (const std::string& range : split(s, '+')) {
+        const size_t dash = range.find('-');
+        int first = 0, last = 0;
+        if (dash == std::string::npos) {
+            if (!parseCpu(range, first)) return false;
+            last = first;
+        } else if (!parseCpu(trim(range.substr(0, dash)), first) ||
+                   !parseCpu(trim(range.substr(dash + 1)), last) || last < first) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) mask |= uint64_t(1) << cpu;
+    }
+    out = mask;
+    return mask != 0;
+}
+
+/// Log |what| for |role| the first time it goes wrong.
+void warnOnce(ThreadRole role, const char* what, long code) {
+    if (g_warned[static_cast<size_t>(role)].exchange(true)) return;
+    CS_LOG(WARN, "Thread %s: %s (%ld) -- left as it was", threadRoleName(role), what, code);
+}
+
+#ifdef _WIN32
+
+const wchar_t* mmcssTaskClass(ThreadRole role) {
+    switch (role) {
+        case ThreadRole::AUDIO:   return L"Pro Audio";
+        case ThreadRole::CAPTURE: return L"Capture";
+        case ThreadRole::DECODE:
+        case ThreadRole::RENDER:  return L"Playback";
+        default:                  return L"Games";
+    }
+}
+
+AVRT_PRIORITY avrtPriority(ThreadPriority priority) {
+    switch (priority) {
+        case ThreadPriority::NORMAL:       return AVRT_PRIORITY_NORMAL;
+        case ThreadPriority::ABOVE_NORMAL:
+        case ThreadPriority::HIGH:         return AVRT_PRIORITY_HIGH;
+        case ThreadPriority::REALTIME:     return AVRT_PRIORITY_CRITICAL;
+    }
+    return AVRT_PRIORITY_NORMAL;
+}
+
+int win32Priority(ThreadPriority priority) {
+    switch (priority) {
+        case ThreadPriority::NORMAL:       return THREAD_PRIORITY_NORMAL;
+        case ThreadPriority::ABOVE_NORMAL: return THREAD_PRIORITY_ABOVE_NORMAL;
+        case ThreadPriority::HIGH:         return THREAD_PRIORITY_HIGHEST;
+        case ThreadPriority::REALTIME:     return THREAD_PRIORITY_TIME_CRITICAL;
+    }
+    return THREAD_PRIORITY_NORMAL;
+}
+
+#elif !defined(__APPLE__)
+
+constexpr int REALTIME_PRIORITY = 10;   // SCHED_FIFO 1..99: low, under the audio server's own
+
+int niceValue(ThreadPriority priority) {
+    switch (priority) {
+        case ThreadPriority::NORMAL:       return 0;
+        case ThreadPriority::ABOVE_NORMAL: return -5;
+        case ThreadPriority::HIGH:
+        case ThreadPriority::REALTIME:     return -10;   // REALTIME without SCHED_FIFO
+    }
+    return 0;
+}
+
+#endif
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Policies
+// ---------------------------------------------------------------------------
+
+ThreadPolicies defaultThreadPolicies() {
+    ThreadPolicies policies{};
+    auto set = [&policies](ThreadRole role, ThreadPriority priority, bool mmcss = false) {
+        policies[static_cast<size_t>(role)].priority = priority;
+        policies[static_cast<size_t>(role)].mmcss    = mmcss;
+    };
+    set(ThreadRole::CAPTURE,  ThreadPriority::HIGH);
+    set(ThreadRole::ENCODE,   ThreadPriority::HIGH);
+    set(ThreadRole::SEND,     ThreadPriority::HIGH);
+    set(ThreadRole::RECEIVE,  ThreadPriority::HIGH);
+    set(ThreadRole::DECODE,   ThreadPriority::HIGH);
+    set(ThreadRole::RENDER,   ThreadPriority::HIGH);
+    set(ThreadRole::AUDIO,    ThreadPriority::REALTIME, true);
+    set(ThreadRole::FEEDBACK, ThreadPriority::ABOVE_NORMAL);
+    set(ThreadRole::INPUT,    ThreadPriority::ABOVE_NORMAL);
+    set(ThreadRole::NETWORK,  ThreadPriority::NORMAL);
+    return policies;
+}
+
+bool parseThreadPolicies(const std::string& spec, ThreadPolicies& policies,
+                         std::string* error) {
+    ThreadPolicies parsed = policies;
+    auto fail = [error](const std::string& what) {
+        if (error) *error = what;
+        return false;
+    };
+
+    for (const std::string& entry : split(spec, ',')) {
+        if (entry.empty()) continue;
+        const size_t eq = entry.find('=');
+        if (eq == std::string::npos) return fail("expected role=priority: '" + entry + "'");
+        const std::string name  = trim(entry.substr(0, eq));
+        std::string       value = trim(entry.substr(eq + 1));
+        const std::string bad   = "bad policy for '" + name + "': '" + value + "'";
+
+        size_t role = 0;
+        while (role < THREAD_ROLE_COUNT && name != ROLE_NAMES[role]) ++role;
+        if (role == THREAD_ROLE_COUNT) return fail("unknown thread role '" + name + "'");
+
+        ThreadPolicy policy;
+        const size_t at = value.find('@');
+        if (at != std::string::npos) {
+            if (!parseCpus(trim(value.substr(at + 1)), policy.cpus)) return fail(bad);
+            value = trim(value.substr(0, at));
+        }
+        const size_t colon = value.find(':');
+        if (colon != std::string::npos) {
+            if (trim(value.substr(colon + 1)) != "mmcss") return fail(bad);
+            policy.mmcss = true;
+            value = trim(value.substr(0, colon));
+        }
+        size_t priority = 0;
+        while (priority < PRIORITY_COUNT && value != PRIORITY_NAMES[priority]) ++priority;
+        if (priority == PRIORITY_COUNT) return fail(bad);
+        policy.priority = static_cast<ThreadPriority>(priority);
+
+        parsed[role] = policy;
+    }
+
+    policies = parsed;
+    return true;
+}
+
+const char* threadRoleName(ThreadRole role) {
+    const size_t i = static_cast<size_t>(role);
+    return i < THREAD_ROLE_COUNT ? ROLE_NAMES[i] : "unknown";
+}
+
+void setThreadPolicies(const ThreadPolicies& policies) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_policies = policies;
+}
+
+ThreadPolicy getThreadPolicy(ThreadRole role) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    return g_policies[static_cast<size_t>(role)];
+}
+
+// ---------------------------------------------------------------------------
+// ScopedThreadRole
+// ---------------------------------------------------------------------------
+
+ScopedThreadRole::ScopedThreadRole(ThreadRole role) {
+    const ThreadPolicy policy = getThreadPolicy(role);
+
+#ifdef _WIN32
+    if (policy.mmcss) {
+        DWORD task_index = 0;
+        HANDLE task = AvSetMmThreadCharacteristicsW(mmcssTaskClass(role), &task_index);
+        if (task) {
+            AvSetMmThreadPriority(task, avrtPriority(policy.priority));
+            mmcss_ = task;
+        } else {
+            warnOnce(role, "MMCSS registration failed", static_cast<long>(GetLastError()));
+        }
+    }
+    if (!mmcss_ && policy.priority != ThreadPriority::NORMAL &&
+        !SetThreadPriority(GetCurrentThread(), win32Priority(policy.priority))) {
+        warnOnce(role, "SetThreadPriority failed", static_cast<long>(GetLastError()));
+    }
+    if (policy.cpus != 0 &&
+        SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(policy.cpus)) == 0) {
+        warnOnce(role, "SetThreadAffinityMask failed", static_cast<long>(GetLastError()));
+    }
+#elif defined(__APPLE__)
+    if (policy.priority != ThreadPriority::NORMAL) {
+        const qos_class_t qos = policy.priority == ThreadPriority::ABOVE_NORMAL
+                                    ? QOS_CLASS_USER_INITIATED : QOS_CLASS_USER_INTERACTIVE;
+        const int err = pthread_set_qos_class_self_np(qos, 0);
+        if (err != 0) warnOnce(role, "pthread_set_qos_class_self_np failed", err);
+    }
+#else
+    bool scheduled = policy.priority == ThreadPriority::NORMAL;
+    if (policy.priority == ThreadPriority::REALTIME) {
+        sched_param param{};
+        param.sched_priority = REALTIME_PRIORITY;
+        const int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err == 0) {
+            scheduled = true;
+        } else {
+            warnOnce(role, "SCHED_FIFO refused, using nice instead", err);
+        }
+    }
+    if (!scheduled) {
+        const id_t tid = static_cast<id_t>(syscall(SYS_gettid));
+        if (setpriority(PRIO_PROCESS, tid, niceValue(policy.priority)) != 0) {
+            warnOnce(role, "setpriority failed", errno);
+        }
+    }
+    if (policy.cpus != 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < MAX_CPUS && cpu < CPU_SETSIZE; ++cpu) {
+            if (policy.cpus & (uint64_t(1) << cpu)) CPU_SET(cpu, &set);
+        }
+        const int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) warnOnce(role, "pthread_setaffinity_np failed", err);
+    }
+#endif
+
+    CS_LOG(DEBUG, "Thread %s: %s priority%s, CPUs 0x%llx (0 = any)", threadRoleName(role),
+           PRIORITY_NAMES[static_cast<size_t>(policy.priority)],
+           policy.mmcss ? " (MMCSS)" : "", static_cast<unsigned long long>(policy.cpus));
+}
+
+ScopedThreadRole::~ScopedThreadRole() {
+#ifdef _WIN32
+    if (mmcss_) AvRevertMmThreadCharacteristics(static_cast<HANDLE>(mmcss_));
+#endif
+}
+
+} // namespace cs
@@ -0,0 +1,333 @@
+///////////////////////////////////////////////////////////////////////////////
+// trace.cpp -- Per-frame pipeline trace: lock-free per-thread event rings
+//
+// Each ring has a single writer, its thread.  An event is claimed, written
+// and then published; an exporter copies the published events and, from
+// the claim count read after the copy, discards any that may have been
+// overwritten under it.  The registry mutex is taken only when a thread
+// first records and on export.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cs/trace.h"
+#include "cs/common.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cs::trace {
+
+namespace {
+
+constexpr size_t RING_EVENTS = 4096;   // Per thread: a few seconds of frames
+constexpr size_t MAX_RINGS   = 64;     // Threads beyond this go unrecorded
+constexpr size_t NAME_LEN    = 24;
+
+struct Slot {
+    std::atomic<uint64_t> begin{0};
+    std::atomic<uint64_t> end{0};
+    std::atomic<uint64_t> meta{0};     // id << 8 | stage
+};
+
+struct Ring {
+    std::array<Slot, RING_EVENTS> slots;
+    std::atomic<uint64_t> claimed{0};  // Events begun
+    std::atomic<uint64_t> head{0};     // Events finished
+    bool     in_use = false;           // Registry mutex held
+    char     name[NAME_LEN] = {};      // Registry mutex held
+    uint32_t track = 0;
+    uint32_t current_id = 0;           // Owner thread only
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::array<std::unique_ptr<Ring>, MAX_RINGS> rings;
+    size_t count = 0;
+
+    // Tick / microsecond pair the export converts from
+    uint64_t tick0 = ticks();
+    uint64_t us0   = getTimestampUs();
+};
+
+Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+std::atomic<bool> g_enabled{true};
+
+/// A free ring for a thread called |name|: preferably the one an earlier
+/// thread of that name left, so its events stay under the right label.
+Ring* acquireRing(const char* name) {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    Ring* any_free = nullptr;
+    for (size_t i = 0; i < reg.count; ++i) {
+        Ring* r = reg.rings[i].get();
+        if (r->in_use) continue;
+        if (std::strncmp(r->name, name, NAME_LEN - 1) == 0) {
+            r->in_use = true;
+            return r;
+        }
+        if (!any_free) any_free = r;
+    }
+
+    Ring* r = any_free;
+    if (r) {
+        // Another thread's events: gone, rather than shown under this name
+        r->claimed.store(0, std::memory_order_relaxed);
+        r->head.store(0, std::memory_order_relaxed);
+    } else {
+        if (reg.count == MAX_RINGS) return nullptr;
+        reg.rings[reg.count] = std::make_unique<Ring>();
+        r = reg.rings[reg.count].get();
+        r->track = static_cast<uint32_t>(reg.count + 1);
+        reg.count++;
+    }
+    std::snprintf(r->name, NAME_LEN, "%s", name);
+    r->in_use = true;
+    return r;
+}
+
+void releaseRing(Ring* ring) {
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    ring->in_use = false;
+}
+
+/// The calling thread's ring, acquired on first use and given back when
+/// the thread exits.
+struct ThreadRing {
+    Ring* ring     = nullptr;
+    bool  tried    = false;
+
+    ~ThreadRing() {
+        if (ring) releaseRing(ring);
+    }
+
+    Ring* get() {
+        if (!tried) {
+            tried = true;
+            ring  = acquireRing("");
+        }
+        return ring;
+    }
+};
+
+thread_local ThreadRing t_ring;
+
+struct Event {
+    uint64_t begin;
+    uint64_t end;
+    uint64_t meta;
+};
+
+/// Copy the events still in |ring| that were not overwritten meanwhile.
+void snapshot(const Ring& ring, std::vector<Event>& out) {
+    const uint64_t head  = ring.head.load(std::memory_order_acquire);
+    const uint64_t first = head > RING_EVENTS ? head - RING_EVENTS : 0;
+
+    const size_t base = out.size();
+    for (uint64_t n = first; n < head; ++n) {
+        const Slot& s = ring.slots[n % RING_EVENTS];
+        out.push_back(Event{s.begin.load(std::memory_order_relaxed),
+                            s.end.load(std::memory_order_relaxed),
+                            s.meta.load(std::memory_order_relaxed)});
+    }
+
+    // Anything the writer had claimed by now may have been torn
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t claimed = ring.claimed.load(std::memory_order_relaxed);
+    const uint64_t valid   = claimed > RING_EVENTS ? claimed - RING_EVENTS : 0;
+    if (valid > first) {
+        const size_t torn = static_cast<size_t>(std::min(valid, head) - first);
+        out.erase(out.begin() + static_cast<std::ptrdiff_t>(base),
+                  out.begin() + static_cast<std::ptrdiff_t>(base + torn));
+    }
+}
+
+/// Copy |name| with anything that would need escaping in JSON replaced.
+std::string jsonSafe(const char* name) {
+    std::string s(name);
+    for (char& c : s) {
+        if (c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20) c = '_';
+    }
+    return s;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// stageName
+// ---------------------------------------------------------------------------
+
+const char* stageName(Stage stage) {
+    switch (stage) {
+        case Stage::CAPTURE:        return "capture";
+        case Stage::CONVERT:        return "convert";
+        case Stage::ENCODE:         return "encode";
+        case Stage::ENCODE_SUBMIT:  return "encode_submit";
+        case Stage::ENCODE_OUTPUT:  return "encode_output";
+        case Stage::SEND:           return "send";
+        case Stage::PACKET_SEND:    return "packet_send";
+        case Stage::PACKET_BATCH:   return "packet_batch";
+        case Stage::PACKET_RECV:    return "packet_recv";
+        case Stage::FRAME_COMPLETE: return "frame_complete";
+        case Stage::FRAME_POP:      return "frame_pop";
+        case Stage::DECODE_SUBMIT:  return "decode_submit";
+        case Stage::DECODED:        return "decoded";
+        case Stage::RENDER:         return "render";
+    }
+    return "unknown";
+}
+
+// ---------------------------------------------------------------------------
+// Recording
+// ---------------------------------------------------------------------------
+
+void setEnabled(bool enabled) {
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool isEnabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+void setThreadName(const char* name) {
+    if (t_ring.ring) releaseRing(t_ring.ring);
+    t_ring.ring  = acquireRing(name ? name : "");
+    t_ring.tried = true;
+}
+
+void record(Stage stage, uint32_t id, uint64_t begin, uint64_t end) {
+    if (!g_enabled.load(std::memory_order_relaxed)) return;
+    Ring* ring = t_ring.get();
+    if (!ring) return;
+    if (id == 0) id = ring->current_id;
+
+    // Claimed before the slot is touched: see snapshot()
+    const uint64_t n = ring->claimed.load(std::memory_order_relaxed);
+    ring->claimed.store(n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Slot& s = ring->slots[n % RING_EVENTS];
+    s.begin.store(begin, std::memory_order_relaxed);
+    s.end.store(end, std::memory_order_relaxed);
+    s.meta.store(static_cast<uint64_t>(id) << 8 | static_cast<uint8_t>(stage),
+                 std::memory_order_relaxed);
+    ring->head.store(n + 1, std::memory_order_release);
+}
+
+Scope::Scope(Stage stage, uint32_t id)
+    : stage_(stage), id_(id), outer_id_(0), begin_(ticks()) {
+    if (Ring* ring = t_ring.get()) {
+        outer_id_ = ring->current_id;
+        if (id_ == 0) id_ = outer_id_;
+        ring->current_id = id_;
+    }
+}
+
+Scope::~Scope() {
+    record(stage_, id_, begin_, ticks());
+    if (t_ring.ring) t_ring.ring->current_id = outer_id_;
+}
+
+void Scope::setId(uint32_t id) {
+    id_ = id;
+    if (t_ring.ring) t_ring.ring->current_id = id;
+}
+
+// ---------------------------------------------------------------------------
+// Export
+// ---------------------------------------------------------------------------
+
+std::string exportChromeJson(const char* process_name, uint32_t pid, size_t* events) {
+    Registry& reg = registry();
+
+    // Ticks per microsecond over everything recorded so far
+    uint64_t tick1 = ticks();
+    uint64_t us1   = getTimestampUs();
+    if (us1 - reg.us0 < 10'000) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        tick1 = ticks();
+        us1   = getTimestampUs();
+    }
+    const double ticks_per_us = static_cast<double>(tick1 - reg.tick0) /
+                                static_cast<double>(us1 - reg.us0);
+    auto toUs = [&](uint64_t t) {
+        return static_cast<double>(reg.us0) +
+               static_cast<double>(static_cast<int64_t>(t - reg.tick0)) / ticks_per_us;
+    };
+
+    std::string out;
+    size_t total = 0;
+    char buf[256];
+
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    std::snprintf(buf, sizeof(buf),
+                  "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,"
+                  "\"args\":{\"name\":\"%s\"}}",
+                  pid, jsonSafe(process_name).c_str());
+    out += buf;
+
+    std::vector<Event> copy;
+    copy.reserve(RING_EVENTS);
+    for (size_t i = 0; i < reg.count; ++i) {
+        const Ring& ring = *reg.rings[i];
+        copy.clear();
+        snapshot(ring, copy);
+        if (copy.empty()) continue;
+
+        if (ring.name[0] != '\0') {
+            std::snprintf(buf, sizeof(buf),
+                          ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,"
+                          "\"args\":{\"name\":\"%s\"}}",
+                          pid, ring.track, jsonSafe(ring.name).c_str());
+            out += buf;
+        }
+
+        for (const Event& e : copy) {
+            const char* name = stageName(static_cast<Stage>(e.meta & 0xFF));
+            const auto  id   = static_cast<uint32_t>(e.meta >> 8);
+            const double ts  = toUs(e.begin);
+            if (e.end == e.begin) {
+                std::snprintf(buf, sizeof(buf),
+                              ",{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"i\",\"s\":\"t\","
+                              "\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"args\":{\"id\":%u}}",
+                              name, pid, ring.track, ts, id);
+            } else {
+                std::snprintf(buf, sizeof(buf),
+                              ",{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\","
+                              "\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                              "\"args\":{\"id\":%u}}",
+                              name, pid, ring.track, ts, toUs(e.end) - ts, id);
+            }
+            out += buf;
+        }
+        total += copy.size();
+    }
+    out += "]}";
+
+    if (events) *events = total;
+    return out;
+}
+
+bool writeChromeTrace(const std::string& path, const char* process_name,
+                      uint32_t pid, size_t* events) {
+    const std::string json = exportChromeJson(process_name, pid, events);
+
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    const bool ok = std::fwrite(json.data(), 1, json.size(), f) == json.size();
+    return std::fclose(f) == 0 && ok;
+}
+
+} // namespace cs::trace
@@ -0,0 +1,354 @@
+///////////////////////////////////////////////////////////////////////////////
+// clipboard_transfer.cpp -- Chunked clipboard transfer implementation
+//
+// Sender: chunks from the first unacked one up to WINDOW_CHUNKS past it are
+// sent lowest first, as tokens allow; one that has gone unacked for the
+// retransmission timeout (doubling per copy, up to 8x) is sent again.  RTT
+// samples come only from chunks acked after a single transmission (Karn).
+//
+// Receiver: every second in-order chunk is acked; a gap, a duplicate and
+// the last chunk are acked at once, so the sender learns of a loss within
+// one chunk of it and never waits on a delayed ack to finish.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cs/transport/clipboard_transfer.h"
+#include "cs/transport/lz4_block.h"
+#include "cs/common.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// Construction / destruction
+// ---------------------------------------------------------------------------
+
+ClipboardTransfer::ClipboardTransfer(ClipboardDirection outgoing, SendFunc send_func)
+    : outgoing_(outgoing)
+    , send_func_(std::move(send_func)) {}
+
+ClipboardTransfer::~ClipboardTransfer() = default;
+
+void ClipboardTransfer::setRateLimitKbps(uint32_t kbps) {
+    rate_kbps_.store(std::max(kbps, MIN_RATE_KBPS));
+}
+
+uint64_t ClipboardTransfer::contentHash(const uint8_t* data, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= data[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+size_t ClipboardTransfer::chunkBytes(uint32_t encoded_length, uint16_t index) {
+    const size_t offset = static_cast<size_t>(index) * CLIPBOARD_CHUNK_BYTES;
+    if (offset >= encoded_length) return 0;
+    return std::min(CLIPBOARD_CHUNK_BYTES, encoded_length - offset);
+}
+
+void ClipboardTransfer::noteShared(const std::string& text) {
+    const uint64_t hash = contentHash(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+    std::lock_guard<std::mutex> lock(mutex_);
+    have_shared_   = true;
+    shared_hash_   = hash;
+    shared_length_ = static_cast<uint32_t>(text.size());
+}
+
+// ---------------------------------------------------------------------------
+// Sending
+// ---------------------------------------------------------------------------
+
+bool ClipboardTransfer::send(const std::string& text) {
+    if (text.size() > MAX_TRANSFER_BYTES) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            have_shared_ = false;   // This side no longer holds it
+        }
+        CS_LOG(WARN, "Clipboard: %zu bytes is over the %zu byte limit, not sent",
+               text.size(), MAX_TRANSFER_BYTES);
+        return false;
+    }
+
+    const auto*    raw    = reinterpret_cast<const uint8_t*>(text.data());
+    const uint32_t length = static_cast<uint32_t>(text.size());
+    const uint64_t hash   = contentHash(raw, text.size());
+
+    auto unchanged = [&] {
+        return (have_shared_ && shared_hash_ == hash && shared_length_ == length) ||
+               (out_.active && out_.hdr.contentHash() == hash && out_.hdr.raw_length == length);
+    };
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (unchanged()) return false;
+    }
+
+    // Encode outside the lock: a large paste takes milliseconds
+    std::vector<uint8_t> data;
+    uint8_t flags = 0;
+    if (text.size() >= MIN_COMPRESS_BYTES) {
+        data.resize(text.size() - text.size() / 16);
+        const size_t n = Lz4Block::compress(raw, text.size(), data.data(), data.size());
+        if (n > 0) {
+            data.resize(n);
+            flags = CLIPBOARD_FLAG_LZ4;
+        }
+    }
+    if (!flags) data.assign(raw, raw + text.size());
+
+    const size_t count = data.empty()
+        ? 1 : (data.size() + CLIPBOARD_CHUNK_BYTES - 1) / CLIPBOARD_CHUNK_BYTES;
+    const uint64_t now = getTimestampUs();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (unchanged()) return false;
+
+    ClipboardChunkHeader& hdr = out_.hdr;
+    hdr = {};
+    hdr.type           = static_cast<uint8_t>(PacketType::CLIP_CHUNK);
+    hdr.direction      = static_cast<uint8_t>(outgoing_);
+    hdr.transfer       = next_transfer_++;
+    hdr.format         = static_cast<uint8_t>(ClipboardFormat::TEXT_UTF8);
+    hdr.flags          = flags;
+    hdr.chunk_count    = static_cast<uint16_t>(count);
+    hdr.raw_length     = length;
+    hdr.encoded_length = static_cast<uint32_t>(data.size());
+    hdr.hash_hi        = static_cast<uint32_t>(hash >> 32);
+    hdr.hash_lo        = static_cast<uint32_t>(hash);
+
+    have_shared_     = false;   // Until the peer acks this
+    out_.active      = true;
+    out_.data        = std::move(data);
+    out_.acked.assign(count, 0);
+    out_.transmissions.assign(count, 0);
+    out_.sent_us.assign(count, 0);
+    out_.cumulative  = 0;
+    out_.start_us    = now;
+    out_.progress_us = now;
+
+    CS_LOG(DEBUG, "Clipboard: transfer %u started (%u bytes, %u encoded, %zu chunks)",
+           hdr.transfer, length, hdr.encoded_length, count);
+    return true;
+}
+
+bool ClipboardTransfer::poll() {
+    const uint64_t now = getTimestampUs();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!out_.active) return false;
+
+    if (now - out_.progress_us > GIVE_UP_US) {
+        CS_LOG(WARN, "Clipboard: transfer %u abandoned with %u of %u chunks acked",
+               out_.hdr.transfer, out_.cumulative, out_.hdr.chunk_count);
+        out_.active = false;
+        std::vector<uint8_t>().swap(out_.data);
+        return false;
+    }
+
+    // Token bucket
+    const double burst        = BURST_CHUNKS * double(sizeof(ClipboardChunkHeader) + CLIPBOARD_CHUNK_BYTES);
+    const double bytes_per_us = rate_kbps_.load() / 8000.0;
+    tokens_ = std::min(burst, tokens_ + double(now - last_refill_us_) * bytes_per_us);
+    last_refill_us_ = now;
+
+    const size_t count = out_.hdr.chunk_count;
+    const size_t end   = std::min(count, size_t(out_.cumulative) + WINDOW_CHUNKS);
+    for (size_t i = out_.cumulative; i < end; ++i) {
+        if (out_.acked[i]) continue;
+        if (out_.transmissions[i] > 0) {
+            const uint64_t backoff = uint64_t(1) << std::min<int>(out_.transmissions[i] - 1, 3);
+            if (now - out_.sent_us[i] < rto_us_ * backoff) continue;
+        }
+        const size_t bytes = sizeof(ClipboardChunkHeader) +
+                             chunkBytes(out_.hdr.encoded_length, static_cast<uint16_t>(i));
+        if (tokens_ < double(bytes)) break;
+        tokens_ -= double(bytes);
+        sendChunkLocked(static_cast<uint16_t>(i), now);
+    }
+    return true;
+}
+
+void ClipboardTransfer::sendChunkLocked(uint16_t index, uint64_t now_us) {
+    ClipboardChunkHeader hdr = out_.hdr;
+    hdr.chunk_index = index;
+
+    const size_t n = chunkBytes(hdr.encoded_length, index);
+    packet_.resize(sizeof(ClipboardChunkHeader) + n);
+    hdr.serializeTo(packet_.data());
+    if (n > 0) {
+        std::memcpy(packet_.data() + sizeof(ClipboardChunkHeader),
+                    out_.data.data() + static_cast<size_t>(index) * CLIPBOARD_CHUNK_BYTES, n);
+    }
+    if (send_func_) send_func_(packet_);
+
+    out_.sent_us[index] = now_us;
+    if (out_.transmissions[index] < 255) out_.transmissions[index]++;
+}
+
+void ClipboardTransfer::onAck(const uint8_t* data, size_t len) {
+    ClipboardWindowAckPacket ack;
+    if (!ClipboardWindowAckPacket::deserialize(data, len, ack)) return;
+
+    const uint64_t now = getTimestampUs();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!out_.active || ack.transfer != out_.hdr.transfer) return;
+
+    const uint16_t count = out_.hdr.chunk_count;
+    bool progress = false;
+    auto mark = [&](size_t i) {
+        if (out_.acked[i]) return;
+        out_.acked[i] = 1;
+        progress = true;
+        if (out_.transmissions[i] == 1) {
+            const uint64_t sample = now - out_.sent_us[i];
+            srtt_us_ = srtt_us_ ? (7 * srtt_us_ + sample) / 8 : sample;
+            rto_us_  = std::clamp(2 * srtt_us_, MIN_RTO_US, MAX_RTO_US);
+        }
+    };
+
+    const uint16_t cumulative = std::min(ack.cumulative, count);
+    for (size_t i = out_.cumulative; i < cumulative; ++i) mark(i);
+    for (unsigned b = 0; b < 32; ++b) {
+        const size_t i = size_t(cumulative) + 1 + b;
+        if (i >= count) break;
+        if (ack.mask & (1u << b)) mark(i);
+    }
+    while (out_.cumulative < count && out_.acked[out_.cumulative]) out_.cumulative++;
+    if (progress) out_.progress_us = now;
+
+    if (out_.cumulative == count) {
+        CS_LOG(DEBUG, "Clipboard: transfer %u done (%u bytes in %llu ms)",
+               out_.hdr.transfer, out_.hdr.raw_length,
+               static_cast<unsigned long long>((now - out_.start_us) / 1000));
+        have_shared_   = true;
+        shared_hash_   = out_.hdr.contentHash();
+        shared_length_ = out_.hdr.raw_length;
+        out_.active    = false;
+        std::vector<uint8_t>().swap(out_.data);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Receiving
+// ---------------------------------------------------------------------------
+
+bool ClipboardTransfer::onChunk(const uint8_t* data, size_t len, std::string& text) {
+    ClipboardChunkHeader hdr;
+    if (!ClipboardChunkHeader::deserialize(data, len, hdr)) return false;
+
+    const auto incoming = outgoing_ == ClipboardDirection::HOST_TO_VIEWER
+        ? ClipboardDirection::VIEWER_TO_HOST : ClipboardDirection::HOST_TO_VIEWER;
+    if (hdr.direction != static_cast<uint8_t>(incoming)) return false;
+    if (hdr.format != static_cast<uint8_t>(ClipboardFormat::TEXT_UTF8)) return false;
+
+    const bool   lz4      = (hdr.flags & CLIPBOARD_FLAG_LZ4) != 0;
+    const size_t expected = hdr.encoded_length == 0
+        ? 1 : (size_t(hdr.encoded_length) + CLIPBOARD_CHUNK_BYTES - 1) / CLIPBOARD_CHUNK_BYTES;
+    if (hdr.raw_length > MAX_TRANSFER_BYTES || hdr.chunk_count != expected ||
+        hdr.chunk_index >= hdr.chunk_count ||
+        (lz4 ? hdr.encoded_length > Lz4Block::compressBound(hdr.raw_length)
+             : hdr.encoded_length != hdr.raw_length) ||
+        len - sizeof(ClipboardChunkHeader) != chunkBytes(hdr.encoded_length, hdr.chunk_index)) {
+        CS_LOG(WARN, "Clipboard: malformed chunk %u of transfer %u", hdr.chunk_index, hdr.transfer);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!in_.active || hdr.transfer != in_.hdr.transfer) {
+        if (in_.active && !seqNewer(hdr.transfer, in_.hdr.transfer)) return false;   // Superseded
+
+        in_.active     = true;
+        in_.done       = false;
+        in_.hdr        = hdr;
+        in_.cumulative = 0;
+        in_.unacked    = 0;
+        in_.have.assign(hdr.chunk_count, 0);
+
+        // Already held here: ack all of it without taking any more
+        if (have_shared_ && shared_hash_ == hdr.contentHash() && shared_length_ == hdr.raw_length) {
+            in_.done       = true;
+            in_.cumulative = hdr.chunk_count;
+            sendAckLocked();
+            return false;
+        }
+        in_.data.resize(hdr.encoded_length);
+    } else if (hdr.chunk_count != in_.hdr.chunk_count || hdr.flags != in_.hdr.flags ||
+               hdr.raw_length != in_.hdr.raw_length ||
+               hdr.encoded_length != in_.hdr.encoded_length ||
+               hdr.contentHash() != in_.hdr.contentHash()) {
+        CS_LOG(WARN, "Clipboard: chunk %u does not match transfer %u", hdr.chunk_index, hdr.transfer);
+        return false;
+    }
+
+    // Our ack was lost, or this copy crossed it
+    if (in_.done || in_.have[hdr.chunk_index]) {
+        sendAckLocked();
+        return false;
+    }
+
+    const size_t n = len - sizeof(ClipboardChunkHeader);
+    if (n > 0) {
+        std::memcpy(in_.data.data() + size_t(hdr.chunk_index) * CLIPBOARD_CHUNK_BYTES,
+                    data + sizeof(ClipboardChunkHeader), n);
+    }
+    in_.have[hdr.chunk_index] = 1;
+    in_.unacked++;
+
+    const bool in_order = hdr.chunk_index == in_.cumulative;
+    while (in_.cumulative < in_.hdr.chunk_count && in_.have[in_.cumulative]) in_.cumulative++;
+
+    if (in_.cumulative < in_.hdr.chunk_count) {
+        if (!in_order || in_.unacked >= ACK_EVERY_CHUNKS) sendAckLocked();
+        return false;
+    }
+
+    // Complete
+    in_.done = true;
+    sendAckLocked();
+
+    bool ok;
+    if (lz4) {
+        text.resize(in_.hdr.raw_length);
+        ok = Lz4Block::decompress(in_.data.data(), in_.data.size(),
+                                  reinterpret_cast<uint8_t*>(&text[0]), text.size());
+    } else {
+        text.assign(reinterpret_cast<const char*>(in_.data.data()), in_.data.size());
+        ok = true;
+    }
+    std::vector<uint8_t>().swap(in_.data);
+
+    if (!ok || contentHash(reinterpret_cast<const uint8_t*>(text.data()), text.size()) !=
+               in_.hdr.contentHash()) {
+        CS_LOG(WARN, "Clipboard: transfer %u failed to decode", in_.hdr.transfer);
+        return false;
+    }
+
+    have_shared_   = true;
+    shared_hash_   = in_.hdr.contentHash();
+    shared_length_ = in_.hdr.raw_length;
+    return true;
+}
+
+void ClipboardTransfer::sendAckLocked() {
+    ClipboardWindowAckPacket ack = {};
+    ack.type       = static_cast<uint8_t>(PacketType::CLIP_WINDOW_ACK);
+    ack.flags      = ClipboardWindowAckPacket::FLAG_WINDOW;
+    ack.transfer   = in_.hdr.transfer;
+    ack.cumulative = in_.cumulative;
+    for (unsigned b = 0; b < 32; ++b) {
+        const size_t i = size_t(in_.cumulative) + 1 + b;
+        if (i >= in_.have.size()) break;
+        if (in_.have[i]) ack.mask |= 1u << b;
+    }
+
+    packet_.resize(sizeof(ClipboardWindowAckPacket));
+    ack.serializeTo(packet_.data());
+    if (send_func_) send_func_(packet_);
+    in_.unacked = 0;
+}
+
+} // namespace cs
@@ -4,6 +4,7 @@
 
 #include "cs/transport/dtls_context.h"
 #include "cs/common.h"
+#include "cs/transport/packet.h"
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -14,6 +15,7 @@
 #include <openssl/bio.h>
 #include <openssl/rand.h>
 
+#include <algorithm>
 #include <cstring>
 #include <chrono>
 #include <thread>
@@ -45,22 +47,235 @@ static void logSslErrors(const char* context) {
     }
 }
 
+// ---------------------------------------------------------------------------
+// Helper: pick the newest wire version both sides speak from the client's
+// ALPN offer ("CS06", "CS05", ...)
+// ---------------------------------------------------------------------------
+static int selectWireVersion(SSL* /*ssl*/, const unsigned char** out, unsigned char* outlen,
+                             const unsigned char* in, unsigned int inlen, void* /*arg*/) {
+    const unsigned char* best = nullptr;
+    uint8_t best_version = 0;
+    for (unsigned int i = 0; i < inlen; ) {
+        const unsigned int len = in[i];
+        if (i + 1 + len > inlen) break;
+        const uint8_t version = parseProtocolVersionTag(in + i + 1, len);
+        if (version > best_version && version <= PROTOCOL_WIRE_VERSION_MAX) {
+            best = in + i + 1;
+            best_version = version;
+        }
+        i += 1 + len;
+    }
+    if (!best) return SSL_TLSEXT_ERR_NOACK;
+    *out    = best;
+    *outlen = static_cast<unsigned char>(PROTOCOL_VERSION_TAG_LEN);
+    return SSL_TLSEXT_ERR_OK;
+}
+
+// ---------------------------------------------------------------------------
+// setFastDtlsRetransmit
+// ---------------------------------------------------------------------------
+static unsigned int fastRetransmitTimer(SSL* /*ssl*/, unsigned int timer_us) {
+    if (timer_us == 0) return 100'000;
+    return std::min(timer_us * 2, 2'000'000u);
+}
+
+void setFastDtlsRetransmit(SSL* ssl) {
+    DTLS_set_timer_cb(ssl, fastRetransmitTimer);
+}
+
+// ---------------------------------------------------------------------------
+// generateKey -- EC P-256
+// ---------------------------------------------------------------------------
+static EVP_PKEY* generateKey() {
+    EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    if (!pctx) { logSslErrors("EVP_PKEY_CTX_new_id"); return nullptr; }
+
+    EVP_PKEY* pkey = nullptr;
+    bool ok = (EVP_PKEY_keygen_init(pctx) == 1) &&
+              (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1) == 1) &&
+              (EVP_PKEY_keygen(pctx, &pkey) == 1);
+
+    EVP_PKEY_CTX_free(pctx);
+    if (!ok) {
+        logSslErrors("generateKey");
+        if (pkey) EVP_PKEY_free(pkey);
+        return nullptr;
+    }
+    return pkey;
+}
+
+// ---------------------------------------------------------------------------
+// generateCert -- self-signed X509, valid for 24 hours
+// ---------------------------------------------------------------------------
+static X509* generateCert(EVP_PKEY* key) {
+    if (!key) return nullptr;
+
+    X509* x = X509_new();
+    if (!x) return nullptr;
+
+    // Serial number: random 64-bit value
+    ASN1_INTEGER_set(X509_get_serialNumber(x),
+                     static_cast<long>(std::chrono::steady_clock::now()
+                         .time_since_epoch().count() & 0x7FFFFFFF));
+
+    // Validity: now to +24h
+    X509_gmtime_adj(X509_getm_notBefore(x), 0);
+    X509_gmtime_adj(X509_getm_notAfter(x), 86400);
+
+    X509_set_pubkey(x, key);
+
+    // Minimal subject
+    X509_NAME* name = X509_get_subject_name(x);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               reinterpret_cast<const unsigned char*>("NVRemote"),
+                               -1, -1, 0);
+    X509_set_issuer_name(x, name);  // self-signed
+
+    // Sign with SHA-256
+    if (X509_sign(x, key, EVP_sha256()) == 0) {
+        logSslErrors("X509_sign");
+        X509_free(x);
+        return nullptr;
+    }
+    return x;
+}
+
+// ---------------------------------------------------------------------------
+// DtlsIdentity
+// ---------------------------------------------------------------------------
+DtlsIdentity::~DtlsIdentity() {
+    if (cert) X509_free(cert);
+    if (key)  EVP_PKEY_free(key);
+}
+
+std::shared_ptr<DtlsIdentity> DtlsIdentity::generate() {
+    ensureOpenSslInit();
+
+    auto identity = std::make_shared<DtlsIdentity>();
+    identity->key  = generateKey();
+    identity->cert = generateCert(identity->key);
+    if (!identity->key || !identity->cert ||
+        RAND_bytes(identity->ticket_keys, sizeof(identity->ticket_keys)) != 1) {
+        CS_LOG(ERR, "Failed to generate DTLS key/cert");
+        return nullptr;
+    }
+
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int  mdLen = 0;
+    if (X509_digest(identity->cert, EVP_sha256(), md, &mdLen) != 1) {
+        logSslErrors("X509_digest");
+        return nullptr;
+    }
+
+    // Format as colon-separated hex
+    identity->fingerprint.reserve(mdLen * 3);
+    for (unsigned int i = 0; i < mdLen; ++i) {
+        char hex[4];
+        std::snprintf(hex, sizeof(hex), "%02X", md[i]);
+        if (i > 0) identity->fingerprint += ':';
+        identity->fingerprint += hex;
+    }
+
+    identity->created_us = getTimestampUs();
+    return identity;
+}
+
+// ---------------------------------------------------------------------------
+// DtlsIdentityPool
+// ---------------------------------------------------------------------------
+DtlsIdentityPool::~DtlsIdentityPool() {
+    stop();
+}
+
+void DtlsIdentityPool::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thread_.joinable()) return;
+    stop_ = false;
+    thread_ = std::thread(&DtlsIdentityPool::generateLoop, this);
+}
+
+void DtlsIdentityPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+std::shared_ptr<const DtlsIdentity> DtlsIdentityPool::acquire(uint64_t reuse_window_us) {
+    const uint64_t now = getTimestampUs();
+    std::shared_ptr<const DtlsIdentity> next;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_ && reuse_window_us > 0 &&
+            now - current_since_us_ < reuse_window_us &&
+            now - current_->created_us < MAX_AGE_US) {
+            return current_;
+        }
+        spares_.erase(std::remove_if(spares_.begin(), spares_.end(),
+                          [now](const std::shared_ptr<const DtlsIdentity>& spare) {
+                              return now - spare->created_us >= MAX_AGE_US;
+                          }),
+                      spares_.end());
+        if (!spares_.empty()) {
+            next = spares_.front();
+            spares_.erase(spares_.begin());
+        }
+    }
+    cv_.notify_one();
+
+    if (!next) {
+        CS_LOG(DEBUG, "No spare DTLS identity ready -- generating one");
+        next = DtlsIdentity::generate();
+        if (!next) return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    current_ = next;
+    current_since_us_ = now;
+    return next;
+}
+
+void DtlsIdentityPool::generateLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        // Spares age too; the check comes round at least every few minutes
+        const uint64_t now = getTimestampUs();
+        spares_.erase(std::remove_if(spares_.begin(), spares_.end(),
+                          [now](const std::shared_ptr<const DtlsIdentity>& spare) {
+                              return now - spare->created_us >= MAX_AGE_US;
+                          }),
+                      spares_.end());
+        if (spares_.size() >= SPARE_IDENTITIES) {
+            cv_.wait_for(lock, std::chrono::minutes(5));
+            continue;
+        }
+
+        lock.unlock();
+        std::shared_ptr<const DtlsIdentity> identity = DtlsIdentity::generate();
+        lock.lock();
+        if (!identity) {
+            cv_.wait_for(lock, std::chrono::seconds(1));
+            continue;
+        }
+        spares_.push_back(std::move(identity));
+    }
+}
+
 // ---------------------------------------------------------------------------
 // DtlsContext constructor
 // ---------------------------------------------------------------------------
-DtlsContext::DtlsContext(bool is_server)
-    : is_server_(is_server)
+DtlsContext::DtlsContext(bool is_server, std::shared_ptr<const DtlsIdentity> identity)
+    : is_server_(is_server),
+      identity_(std::move(identity))
 {
     ensureOpenSslInit();
     std::memset(&peer_addr_, 0, sizeof(peer_addr_));
 
-    // --- Generate EC key + self-signed cert ---
-    key_  = generateKey();
-    cert_ = generateCert(key_);
-    if (!key_ || !cert_) {
-        CS_LOG(ERR, "Failed to generate DTLS key/cert");
-        return;
-    }
+    // --- EC key + self-signed cert ---
+    if (!identity_) identity_ = DtlsIdentity::generate();
+    if (!identity_) return;
 
     // --- Create SSL_CTX ---
     const SSL_METHOD* method = is_server_ ? DTLS_server_method()
@@ -81,10 +296,10 @@ DtlsContext::DtlsContext(bool is_server)
     }
 
     // Load our key + cert into the context
-    if (SSL_CTX_use_certificate(ctx_, cert_) != 1) {
+    if (SSL_CTX_use_certificate(ctx_, identity_->cert) != 1) {
         logSslErrors("use_certificate");
     }
-    if (SSL_CTX_use_PrivateKey(ctx_, key_) != 1) {
+    if (SSL_CTX_use_PrivateKey(ctx_, identity_->key) != 1) {
         logSslErrors("use_PrivateKey");
     }
     if (SSL_CTX_check_private_key(ctx_) != 1) {
@@ -95,6 +310,22 @@ DtlsContext::DtlsContext(bool is_server)
     // accept any peer certificate here.
     SSL_CTX_set_verify(ctx_, SSL_VERIFY_NONE, nullptr);
 
+    if (is_server_) {
+        // Every context of the identity seals tickets with its keys, so a
+        // client reconnecting within the identity's reuse window resumes
+        // (RFC 5077): one round trip and no key exchange.  No server-side
+        // session cache is kept.
+        const unsigned char sid_ctx[] = "NVRemote";
+        SSL_CTX_set_session_id_context(ctx_, sid_ctx, sizeof(sid_ctx) - 1);
+        SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_OFF);
+        SSL_CTX_set_timeout(ctx_, 12L * 3600);    // An identity's longest reuse
+        SSL_CTX_set_tlsext_ticket_keys(ctx_, const_cast<uint8_t*>(identity_->ticket_keys),
+                                       sizeof(identity_->ticket_keys));
+
+        // The wire version rides in the handshake for clients that offer it
+        SSL_CTX_set_alpn_select_cb(ctx_, selectWireVersion, nullptr);
+    }
+
     // --- Create SSL object ---
     ssl_ = SSL_new(ctx_);
     if (!ssl_) {
@@ -120,6 +351,7 @@ DtlsContext::DtlsContext(bool is_server)
     // DTLS needs MTU hints
     SSL_set_options(ssl_, SSL_OP_NO_QUERY_MTU);
     DTLS_set_link_mtu(ssl_, 1400);
+    setFastDtlsRetransmit(ssl_);
 
     CS_LOG(DEBUG, "DtlsContext created (is_server=%d)", (int)is_server_);
 }
@@ -133,8 +365,7 @@ DtlsContext::~DtlsContext() {
     if (ssl_)  { SSL_free(ssl_);   ssl_ = nullptr; }
     if (ctx_)  { SSL_CTX_free(ctx_); ctx_ = nullptr; }
     if (bio_network_) { BIO_free(bio_network_); bio_network_ = nullptr; }
-    if (cert_) { X509_free(cert_);  cert_ = nullptr; }
-    if (key_)  { EVP_PKEY_free(key_); key_ = nullptr; }
+    identity_.reset();
 }
 
 // ---------------------------------------------------------------------------
@@ -150,15 +381,12 @@ DtlsContext& DtlsContext::operator=(DtlsContext&& other) noexcept {
         if (ssl_)  SSL_free(ssl_);
         if (ctx_)  SSL_CTX_free(ctx_);
         if (bio_network_) BIO_free(bio_network_);
-        if (cert_) X509_free(cert_);
-        if (key_)  EVP_PKEY_free(key_);
 
         is_server_      = other.is_server_;
         established_    = other.established_;
         ctx_            = other.ctx_;
         ssl_            = other.ssl_;
-        key_            = other.key_;
-        cert_           = other.cert_;
+        identity_       = std::move(other.identity_);
         bio_internal_   = other.bio_internal_;
         bio_network_    = other.bio_network_;
         udp_socket_     = other.udp_socket_;
@@ -167,8 +395,6 @@ DtlsContext& DtlsContext::operator=(DtlsContext&& other) noexcept {
 
         other.ctx_          = nullptr;
         other.ssl_          = nullptr;
-        other.key_          = nullptr;
-        other.cert_         = nullptr;
         other.bio_internal_ = nullptr;
         other.bio_network_  = nullptr;
         other.established_  = false;
@@ -180,25 +406,22 @@ DtlsContext& DtlsContext::operator=(DtlsContext&& other) noexcept {
 // getFingerprint -- SHA-256 of the DER-encoded certificate
 // ---------------------------------------------------------------------------
 std::string DtlsContext::getFingerprint() const {
-    if (!cert_) return {};
+    return identity_ ? identity_->fingerprint : std::string();
+}
 
-    unsigned char md[EVP_MAX_MD_SIZE];
-    unsigned int  mdLen = 0;
-    if (X509_digest(cert_, EVP_sha256(), md, &mdLen) != 1) {
-        logSslErrors("X509_digest");
-        return {};
-    }
+// ---------------------------------------------------------------------------
+// getHandshakeWireVersion / isResumed
+// ---------------------------------------------------------------------------
+uint8_t DtlsContext::getHandshakeWireVersion() const {
+    if (!established_ || !ssl_) return 0;
+    const unsigned char* proto = nullptr;
+    unsigned int len = 0;
+    SSL_get0_alpn_selected(ssl_, &proto, &len);
+    return proto ? parseProtocolVersionTag(proto, len) : 0;
+}
 
-    // Format as colon-separated hex
-    std::string result;
-    result.reserve(mdLen * 3);
-    for (unsigned int i = 0; i < mdLen; ++i) {
-        char hex[4];
-        std::snprintf(hex, sizeof(hex), "%02X", md[i]);
-        if (i > 0) result += ':';
-        result += hex;
-    }
-    return result;
+bool DtlsContext::isResumed() const {
+    return established_ && ssl_ && SSL_session_reused(ssl_) == 1;
 }
 
 // ---------------------------------------------------------------------------
@@ -229,8 +452,15 @@ bool DtlsContext::handshake(int udp_socket, const ::sockaddr* peer, int peer_len
         }
 
         if (ret == 1) {
+            // Our last flight (the server's Finished) goes out now, not
+            // with the first application record
+            if (!flushBioToSocket()) {
+                CS_LOG(ERR, "Failed to flush BIO during handshake");
+                return false;
+            }
             established_ = true;
-            CS_LOG(INFO, "DTLS handshake completed (is_server=%d)", (int)is_server_);
+            CS_LOG(INFO, "DTLS handshake completed (is_server=%d%s)", (int)is_server_,
+                   SSL_session_reused(ssl_) == 1 ? ", resumed" : "");
             return true;
         }
 
@@ -253,7 +483,9 @@ bool DtlsContext::handshake(int udp_socket, const ::sockaddr* peer, int peer_len
             return false;
         }
 
-        // Wait for incoming UDP data using select()
+        // Wait for incoming UDP data using select(), no longer than the
+        // retransmit timer: OpenSSL does not see it expire through a BIO
+        // pair, so a lost flight is resent from here.
         fd_set rfds;
         FD_ZERO(&rfds);
         FD_SET(static_cast<unsigned int>(udp_socket_), &rfds);
@@ -261,12 +493,20 @@ bool DtlsContext::handshake(int udp_socket, const ::sockaddr* peer, int peer_len
         struct timeval tv;
         tv.tv_sec  = 0;
         tv.tv_usec = 100'000;  // 100 ms poll
+        struct timeval timer;
+        if (DTLSv1_get_timeout(ssl_, &timer) == 1 &&
+            (timer.tv_sec < tv.tv_sec ||
+             (timer.tv_sec == tv.tv_sec && timer.tv_usec < tv.tv_usec))) {
+            tv = timer;
+        }
 
         int sel = ::select(udp_socket_ + 1, &rfds, nullptr, nullptr, &tv);
         if (sel > 0) {
             if (!feedBioFromSocket()) {
                 CS_LOG(WARN, "feedBioFromSocket failed during handshake");
             }
+        } else if (sel == 0 && DTLSv1_handle_timeout(ssl_) < 0) {
+            logSslErrors("DTLSv1_handle_timeout");
         }
     }
 }
@@ -295,6 +535,21 @@ bool DtlsContext::encrypt(const uint8_t* data, size_t len,
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// exportKeyingMaterial -- RFC 5705 exporter (keys for the media AEAD)
+// ---------------------------------------------------------------------------
+bool DtlsContext::exportKeyingMaterial(const char* label, uint8_t* out,
+                                       size_t len) const {
+    if (!established_ || !ssl_ || !label || !out) return false;
+
+    if (SSL_export_keying_material(ssl_, out, len, label, std::strlen(label),
+                                   nullptr, 0, 0) != 1) {
+        logSslErrors("SSL_export_keying_material");
+        return false;
+    }
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 // decrypt -- feed a received DTLS record into the SSL object and read
 //            the plaintext back out
@@ -340,63 +595,6 @@ void DtlsContext::shutdown() {
     }
 }
 
-// ---------------------------------------------------------------------------
-// generateKey -- EC P-256
-// ---------------------------------------------------------------------------
-EVP_PKEY* DtlsContext::generateKey() {
-    EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
-    if (!pctx) { logSslErrors("EVP_PKEY_CTX_new_id"); return nullptr; }
-
-    EVP_PKEY* pkey = nullptr;
-    bool ok = (EVP_PKEY_keygen_init(pctx) == 1) &&
-              (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1) == 1) &&
-              (EVP_PKEY_keygen(pctx, &pkey) == 1);
-
-    EVP_PKEY_CTX_free(pctx);
-    if (!ok) {
-        logSslErrors("generateKey");
-        if (pkey) EVP_PKEY_free(pkey);
-        return nullptr;
-    }
-    return pkey;
-}
-
-// ---------------------------------------------------------------------------
-// generateCert -- self-signed X509, valid for 24 hours
-// ---------------------------------------------------------------------------
-X509* DtlsContext::generateCert(EVP_PKEY* key) {
-    if (!key) return nullptr;
-
-    X509* x = X509_new();
-    if (!x) return nullptr;
-
-    // Serial number: random 64-bit value
-    ASN1_INTEGER_set(X509_get_serialNumber(x),
-                     static_cast<long>(std::chrono::steady_clock::now()
-                         .time_since_epoch().count() & 0x7FFFFFFF));
-
-    // Validity: now to +24h
-    X509_gmtime_adj(X509_getm_notBefore(x), 0);
-    X509_gmtime_adj(X509_getm_notAfter(x), 86400);
-
-    X509_set_pubkey(x, key);
-
-    // Minimal subject
-    X509_NAME* name = X509_get_subject_name(x);
-    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
-                               reinterpret_cast<const unsigned char*>("NVRemote"),
-                               -1, -1, 0);
-    X509_set_issuer_name(x, name);  // self-signed
-
-    // Sign with SHA-256
-    if (X509_sign(x, key, EVP_sha256()) == 0) {
-        logSslErrors("X509_sign");
-        X509_free(x);
-        return nullptr;
-    }
-    return x;
-}
-
 // ---------------------------------------------------------------------------
 // flushBioToSocket -- send any pending BIO data out on the real UDP socket
 // ---------------------------------------------------------------------------
@@ -0,0 +1,369 @@
+///////////////////////////////////////////////////////////////////////////////
+// erasure_code.cpp -- Cauchy Reed-Solomon erasure code implementation
+//
+// GF(2^8) arithmetic uses the primitive polynomial x^8+x^4+x^3+x^2+1 (0x11D)
+// with log/exp tables built once on first use.
+//
+// Region multiply-accumulate (the only hot path) splits each source byte
+// into two nibbles and looks both up in 16-entry product tables for the
+// constant, which maps directly onto PSHUFB / VPSHUFB / TBL.
+//
+// Decoding solves only for the missing shards: each parity shard used for
+// recovery has the contribution of the received data shards subtracted
+// (XORed out), leaving an e x e Cauchy system over the e erasures.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cs/transport/erasure_code.h"
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  #define CS_EC_X86 1
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #define CS_EC_NEON 1
+  #include <arm_neon.h>
+#endif
+
+// GCC / Clang need per-function target attributes to emit SIMD code that
+// the baseline -march does not guarantee.  MSVC allows the intrinsics
+// unconditionally.
+#if defined(__GNUC__) || defined(__clang__)
+  #define CS_EC_TARGET(isa) __attribute__((target(isa)))
+#else
+  #define CS_EC_TARGET(isa)
+#endif
+
+namespace cs {
+
+namespace {
+
+// ---------------------------------------------------------------------------
+// GF(2^8) tables
+// ---------------------------------------------------------------------------
+struct GfTables {
+    uint8_t exp[512];
+    uint8_t log[256];
+
+    GfTables() {
+        unsigned x = 1;
+        for (int i = 0; i < 255; ++i) {
+            exp[i] = static_cast<uint8_t>(x);
+            log[x] = static_cast<uint8_t>(i);
+            x <<= 1;
+            if (x & 0x100) x ^= 0x11D;
+        }
+        // Duplicate so exp[log a + log b] never needs a modulo.
+        for (int i = 255; i < 512; ++i) {
+            exp[i] = exp[i - 255];
+        }
+        log[0] = 0;   // undefined; callers special-case zero
+    }
+};
+
+const GfTables& gf() {
+    static const GfTables tables;
+    return tables;
+}
+
+/// Cauchy coefficient for parity row |row| and data column |col|.
+inline uint8_t cauchyCoeff(size_t k, size_t row, size_t col) {
+    return ErasureCode::inv(static_cast<uint8_t>((k + row) ^ col));
+}
+
+/// Build the low/high nibble product tables for constant |c|.
+inline void buildNibbleTables(uint8_t c, uint8_t lo[16], uint8_t hi[16]) {
+    for (unsigned n = 0; n < 16; ++n) {
+        lo[n] = ErasureCode::mul(c, static_cast<uint8_t>(n));
+        hi[n] = ErasureCode::mul(c, static_cast<uint8_t>(n << 4));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Region kernels.  Each returns the number of bytes processed; the caller
+// finishes the tail with the scalar table loop.
+// ---------------------------------------------------------------------------
+enum class Kernel { SCALAR, SSSE3, AVX2, NEON };
+
+#if CS_EC_X86
+CS_EC_TARGET("ssse3")
+size_t mulAddSsse3(uint8_t* dst, const uint8_t* src,
+                   const uint8_t lo[16], const uint8_t hi[16], size_t len) {
+    const __m128i tlo  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lo));
+    const __m128i thi  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi));
+    const __m128i mask = _mm_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i l = _mm_and_si128(s, mask);
+        __m128i h = _mm_and_si128(_mm_srli_epi64(s, 4), mask);
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(tlo, l),
+                                  _mm_shuffle_epi8(thi, h));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(d, p));
+    }
+    return i;
+}
+
+CS_EC_TARGET("avx2")
+size_t mulAddAvx2(uint8_t* dst, const uint8_t* src,
+                  const uint8_t lo[16], const uint8_t hi[16], size_t len) {
+    const __m256i tlo = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(lo)));
+    const __m256i thi = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi)));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i l = _mm256_and_si256(s, mask);
+        __m256i h = _mm256_and_si256(_mm256_srli_epi64(s, 4), mask);
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, l),
+                                     _mm256_shuffle_epi8(thi, h));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm256_xor_si256(d, p));
+    }
+    return i;
+}
+#endif
+
+#if CS_EC_NEON
+size_t mulAddNeon(uint8_t* dst, const uint8_t* src,
+                  const uint8_t lo[16], const uint8_t hi[16], size_t len) {
+    const uint8x16_t tlo  = vld1q_u8(lo);
+    const uint8x16_t thi  = vld1q_u8(hi);
+    const uint8x16_t mask = vdupq_n_u8(0x0F);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t s = vld1q_u8(src + i);
+        uint8x16_t p = veorq_u8(vqtbl1q_u8(tlo, vandq_u8(s, mask)),
+                                vqtbl1q_u8(thi, vshrq_n_u8(s, 4)));
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), p));
+    }
+    return i;
+}
+#endif
+
+Kernel detectKernel() {
+#if CS_EC_X86
+  #if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))  return Kernel::AVX2;
+    if (__builtin_cpu_supports("ssse3")) return Kernel::SSSE3;
+  #elif defined(_MSC_VER)
+    int info[4] = {};
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    __cpuid(info, 1);
+    bool ssse3   = (info[2] & (1 << 9))  != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx     = (info[2] & (1 << 28)) != 0;
+    bool avx2    = false;
+    if (max_leaf >= 7 && osxsave && avx &&
+        (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    if (avx2)  return Kernel::AVX2;
+    if (ssse3) return Kernel::SSSE3;
+  #endif
+    return Kernel::SCALAR;
+#elif CS_EC_NEON
+    return Kernel::NEON;   // mandatory on AArch64
+#else
+    return Kernel::SCALAR;
+#endif
+}
+
+Kernel activeKernel() {
+    static const Kernel k = detectKernel();
+    return k;
+}
+
+/// Invert an n x n matrix in place (row-major).  Returns false if singular.
+bool invertMatrix(std::vector<uint8_t>& a, size_t n) {
+    std::vector<uint8_t> inv_m(n * n, 0);
+    for (size_t i = 0; i < n; ++i) inv_m[i * n + i] = 1;
+
+    for (size_t col = 0; col < n; ++col) {
+        // Find a pivot
+        size_t pivot = col;
+        while (pivot < n && a[pivot * n + col] == 0) ++pivot;
+        if (pivot == n) return false;
+
+        if (pivot != col) {
+            for (size_t j = 0; j < n; ++j) {
+                std::swap(a[pivot * n + j], a[col * n + j]);
+                std::swap(inv_m[pivot * n + j], inv_m[col * n + j]);
+            }
+        }
+
+        // Normalize pivot row
+        uint8_t pinv = ErasureCode::inv(a[col * n + col]);
+        for (size_t j = 0; j < n; ++j) {
+            a[col * n + j]     = ErasureCode::mul(a[col * n + j], pinv);
+            inv_m[col * n + j] = ErasureCode::mul(inv_m[col * n + j], pinv);
+        }
+
+        // Eliminate the column from every other row
+        for (size_t row = 0; row < n; ++row) {
+            if (row == col) continue;
+            uint8_t f = a[row * n + col];
+            if (f == 0) continue;
+            for (size_t j = 0; j < n; ++j) {
+                a[row * n + j]     ^= ErasureCode::mul(f, a[col * n + j]);
+                inv_m[row * n + j] ^= ErasureCode::mul(f, inv_m[col * n + j]);
+            }
+        }
+    }
+
+    a.swap(inv_m);
+    return true;
+}
+
+} // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Scalar field helpers
+// ---------------------------------------------------------------------------
+
+uint8_t ErasureCode::mul(uint8_t a, uint8_t b) {
+    if (a == 0 || b == 0) return 0;
+    const GfTables& t = gf();
+    return t.exp[t.log[a] + t.log[b]];
+}
+
+uint8_t ErasureCode::inv(uint8_t a) {
+    if (a == 0) return 0;
+    const GfTables& t = gf();
+    return t.exp[255 - t.log[a]];
+}
+
+const char* ErasureCode::kernelName() {
+    switch (activeKernel()) {
+        case Kernel::AVX2:   return "avx2";
+        case Kernel::SSSE3:  return "ssse3";
+        case Kernel::NEON:   return "neon";
+        case Kernel::SCALAR: break;
+    }
+    return "scalar";
+}
+
+// ---------------------------------------------------------------------------
+// mulAddRegion -- dst ^= c * src
+// ---------------------------------------------------------------------------
+
+void ErasureCode::mulAddRegion(uint8_t* dst, const uint8_t* src, uint8_t c,
+                               size_t len) {
+    if (c == 0 || len == 0) return;
+
+    if (c == 1) {
+        for (size_t i = 0; i < len; ++i) dst[i] ^= src[i];
+        return;
+    }
+
+    uint8_t lo[16], hi[16];
+    buildNibbleTables(c, lo, hi);
+
+    size_t done = 0;
+    switch (activeKernel()) {
+#if CS_EC_X86
+        case Kernel::AVX2:  done = mulAddAvx2(dst, src, lo, hi, len);  break;
+        case Kernel::SSSE3: done = mulAddSsse3(dst, src, lo, hi, len); break;
+#endif
+#if CS_EC_NEON
+        case Kernel::NEON:  done = mulAddNeon(dst, src, lo, hi, len);  break;
+#endif
+        default: break;
+    }
+
+    for (size_t i = done; i < len; ++i) {
+        uint8_t s = src[i];
+        dst[i] ^= static_cast<uint8_t>(lo[s & 0x0F] ^ hi[s >> 4]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// encode
+// ---------------------------------------------------------------------------
+
+bool ErasureCode::encode(const uint8_t* const* data, const size_t* data_len,
+                         size_t k, uint8_t* const* parity, size_t m,
+                         size_t symbol_len) {
+    if (!data || !data_len || !parity) return false;
+    if (k == 0 || m == 0 || k + m > MAX_SHARDS) return false;
+
+    for (size_t row = 0; row < m; ++row) {
+        std::memset(parity[row], 0, symbol_len);
+        for (size_t col = 0; col < k; ++col) {
+            size_t len = data_len[col] < symbol_len ? data_len[col] : symbol_len;
+            mulAddRegion(parity[row], data[col], cauchyCoeff(k, row, col), len);
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// decode
+// ---------------------------------------------------------------------------
+
+bool ErasureCode::decode(uint8_t* const* shards, const bool* present,
+                         size_t k, size_t m, size_t symbol_len) {
+    if (!shards || !present) return false;
+    if (k == 0 || k + m > MAX_SHARDS) return false;
+
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < k; ++i) {
+        if (!present[i]) missing.push_back(i);
+    }
+    if (missing.empty()) return true;
+
+    // Pick the first |e| received parity shards.
+    const size_t e = missing.size();
+    std::vector<size_t> rows;
+    for (size_t j = 0; j < m && rows.size() < e; ++j) {
+        if (present[k + j]) rows.push_back(j);
+    }
+    if (rows.size() < e) return false;
+
+    // Syndromes: parity minus the contribution of the received data shards.
+    std::vector<uint8_t> syndrome(e * symbol_len);
+    for (size_t r = 0; r < e; ++r) {
+        uint8_t* s = syndrome.data() + r * symbol_len;
+        std::memcpy(s, shards[k + rows[r]], symbol_len);
+        for (size_t col = 0; col < k; ++col) {
+            if (!present[col]) continue;
+            mulAddRegion(s, shards[col], cauchyCoeff(k, rows[r], col), symbol_len);
+        }
+    }
+
+    // e x e Cauchy sub-matrix over the erased columns.
+    std::vector<uint8_t> a(e * e);
+    for (size_t r = 0; r < e; ++r) {
+        for (size_t c = 0; c < e; ++c) {
+            a[r * e + c] = cauchyCoeff(k, rows[r], missing[c]);
+        }
+    }
+    if (!invertMatrix(a, e)) return false;
+
+    for (size_t i = 0; i < e; ++i) {
+        uint8_t* out = shards[missing[i]];
+        std::memset(out, 0, symbol_len);
+        for (size_t r = 0; r < e; ++r) {
+            mulAddRegion(out, syndrome.data() + r * symbol_len, a[i * e + r],
+                         symbol_len);
+        }
+    }
+    return true;
+}
+
+} // namespace cs
@@ -0,0 +1,187 @@
+///////////////////////////////////////////////////////////////////////////////
+// lz4_block.cpp -- LZ4 block format implementation
+//
+// A block is a run of sequences, each:
+//   token        high nibble: literal count, low nibble: match length - 4
+//                (15 = more length bytes follow, each 255 = keep reading)
+//   literals
+//   offset       16-bit little-endian distance back to the match
+//   match length extension bytes
+// The last sequence is literals only.  The format requires the last 5
+// bytes to be literals and no match to start within the last 12.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cs/transport/lz4_block.h"
+
+#include <cstring>
+
+namespace cs {
+
+namespace {
+
+constexpr size_t   MIN_MATCH     = 4;
+constexpr size_t   LAST_LITERALS = 5;
+constexpr size_t   MF_LIMIT      = 12;
+constexpr size_t   MAX_OFFSET    = 65535;
+constexpr unsigned HASH_LOG      = 12;
+constexpr unsigned SKIP_TRIGGER  = 6;    // Misses before the search step grows
+
+uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hashSequence(uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - HASH_LOG);
+}
+
+/// Write the length extension bytes for |rest| (length - 15).
+void writeLength(uint8_t*& op, size_t rest) {
+    while (rest >= 255) {
+        *op++ = 255;
+        rest -= 255;
+    }
+    *op++ = static_cast<uint8_t>(rest);
+}
+
+/// Append one sequence; |match_len| 0 = the closing literal-only one.
+/// Returns false if it does not fit before |oend|.
+bool emitSequence(uint8_t*& op, const uint8_t* oend,
+                  const uint8_t* literals, size_t literal_len,
+                  size_t offset, size_t match_len) {
+    size_t need = 1 + literal_len + literal_len / 255 + 1;
+    if (match_len) need += 2 + (match_len - MIN_MATCH) / 255 + 1;
+    if (static_cast<size_t>(oend - op) < need) return false;
+
+    uint8_t* token = op++;
+    uint8_t  tok   = static_cast<uint8_t>((literal_len >= 15 ? 15 : literal_len) << 4);
+    if (literal_len >= 15) writeLength(op, literal_len - 15);
+    if (literal_len) std::memcpy(op, literals, literal_len);
+    op += literal_len;
+
+    if (match_len) {
+        *op++ = static_cast<uint8_t>(offset & 0xFF);
+        *op++ = static_cast<uint8_t>(offset >> 8);
+        const size_t m = match_len - MIN_MATCH;
+        tok |= static_cast<uint8_t>(m >= 15 ? 15 : m);
+        if (m >= 15) writeLength(op, m - 15);
+    }
+    *token = tok;
+    return true;
+}
+
+/// Read a length extension into |value|.  Returns false past |len|.
+bool readLength(const uint8_t* src, size_t len, size_t& ip, size_t& value) {
+    uint8_t b;
+    do {
+        if (ip >= len) return false;
+        b = src[ip++];
+        value += b;
+    } while (b == 255);
+    return true;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// compress
+// ---------------------------------------------------------------------------
+
+size_t Lz4Block::compress(const uint8_t* src, size_t len,
+                          uint8_t* dst, size_t capacity) {
+    uint8_t*       op     = dst;
+    const uint8_t* oend   = dst + capacity;
+    size_t         anchor = 0;
+
+    if (len > MF_LIMIT) {
+        uint32_t table[1u << HASH_LOG] = {};   // Position + 1 (0 = empty)
+        const size_t match_limit = len - LAST_LITERALS;
+        const size_t mf_limit    = len - MF_LIMIT;   // Last position a match may start at
+        size_t ip     = 0;
+        size_t misses = 0;
+
+        while (ip <= mf_limit) {
+            const uint32_t seq = read32(src + ip);
+            const uint32_t h   = hashSequence(seq);
+            size_t ref = table[h];
+            table[h] = static_cast<uint32_t>(ip + 1);
+
+            if (ref == 0 || ip - (ref - 1) > MAX_OFFSET || read32(src + ref - 1) != seq) {
+                ip += 1 + (misses++ >> SKIP_TRIGGER);
+                continue;
+            }
+            ref -= 1;
+
+            // Grow the match backwards into the pending literals, then forwards
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                --ip;
+                --ref;
+            }
+            size_t end = ip + MIN_MATCH;
+            size_t r   = ref + MIN_MATCH;
+            while (end < match_limit && src[end] == src[r]) {
+                ++end;
+                ++r;
+            }
+
+            if (!emitSequence(op, oend, src + anchor, ip - anchor, ip - ref, end - ip)) return 0;
+            ip     = end;
+            anchor = end;
+            misses = 0;
+            if (ip - 2 <= mf_limit) {
+                table[hashSequence(read32(src + ip - 2))] = static_cast<uint32_t>(ip - 1);
+            }
+        }
+    }
+
+    if (!emitSequence(op, oend, src + anchor, len - anchor, 0, 0)) return 0;
+    return static_cast<size_t>(op - dst);
+}
+
+// ---------------------------------------------------------------------------
+// decompress
+// ---------------------------------------------------------------------------
+
+bool Lz4Block::decompress(const uint8_t* src, size_t len,
+                          uint8_t* dst, size_t raw_len) {
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < len) {
+        const uint8_t token = src[ip++];
+
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !readLength(src, len, ip, literal_len)) return false;
+        if (literal_len > len - ip || literal_len > raw_len - op) return false;
+        if (literal_len) std::memcpy(dst + op, src + ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+
+        if (ip == len) break;   // The last sequence has no match
+
+        if (len - ip < 2) return false;
+        const size_t offset = src[ip] | (static_cast<size_t>(src[ip + 1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        size_t match_len = token & 0x0F;
+        if (match_len == 15 && !readLength(src, len, ip, match_len)) return false;
+        match_len += MIN_MATCH;
+        if (match_len > raw_len - op) return false;
+
+        uint8_t* out = dst + op;
+        if (offset >= match_len) {
+            std::memcpy(out, out - offset, match_len);
+        } else {
+            // Overlapping: the match repeats bytes it is writing
+            const uint8_t* from = out - offset;
+            for (size_t i = 0; i < match_len; ++i) out[i] = from[i];
+        }
+        op += match_len;
+    }
+
+    return op == raw_len;
+}
+
+} // namespace cs
@@ -0,0 +1,316 @@
+///////////////////////////////////////////////////////////////////////////////
+// media_cipher.cpp -- Stateless AEAD data plane implementation
+//
+// Each direction keeps one EVP_CIPHER_CTX that is keyed once; per packet
+// only the IV is reset, so the AES key schedule is not repeated.  With
+// AES-NI / ARMv8 crypto extensions OpenSSL runs AES-GCM at several GB/s
+// per core.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cs/transport/media_cipher.h"
+#include "cs/common.h"
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  #define CS_MC_X86 1
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+#elif defined(__aarch64__) && defined(__linux__)
+  #define CS_MC_ARM_LINUX 1
+  #include <sys/auxv.h>
+  #include <asm/hwcap.h>
+#endif
+
+namespace cs {
+
+namespace {
+
+constexpr size_t NONCE_LEN = MediaCipher::SALT_LEN + 8;
+
+/// Index into recv_ctx_ for a cipher id (or -1 if unknown).
+int cipherIndex(uint8_t id) {
+    switch (static_cast<AeadCipher>(id)) {
+        case AeadCipher::AES_128_GCM:       return 0;
+        case AeadCipher::CHACHA20_POLY1305: return 1;
+    }
+    return -1;
+}
+
+void buildNonce(uint8_t nonce[NONCE_LEN], const uint8_t* salt, const uint8_t* counter_be) {
+    std::memcpy(nonce, salt, MediaCipher::SALT_LEN);
+    std::memcpy(nonce + MediaCipher::SALT_LEN, counter_be, 8);
+}
+
+void writeCounter(uint8_t* out, uint64_t counter) {
+    for (int i = 7; i >= 0; --i) {
+        out[i] = static_cast<uint8_t>(counter & 0xFF);
+        counter >>= 8;
+    }
+}
+
+/// Seal |buf| in place under |ctx| with |counter| (see MediaCipher::seal).
+size_t sealWith(EVP_CIPHER_CTX* ctx, AeadCipher cipher, const uint8_t* salt,
+                uint8_t* buf, size_t plain_len, uint64_t counter) {
+    buf[0] = static_cast<uint8_t>(MediaCipher::MARKER | static_cast<uint8_t>(cipher));
+    writeCounter(buf + 1, counter);
+
+    uint8_t nonce[NONCE_LEN];
+    buildNonce(nonce, salt, buf + 1);
+
+    uint8_t* text = buf + MediaCipher::HEADER_LEN;
+    int out_len = 0;
+    if (EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) != 1 ||
+        EVP_EncryptUpdate(ctx, nullptr, &out_len, buf,
+                          static_cast<int>(MediaCipher::HEADER_LEN)) != 1 ||
+        EVP_EncryptUpdate(ctx, text, &out_len, text,
+                          static_cast<int>(plain_len)) != 1 ||
+        EVP_EncryptFinal_ex(ctx, text + out_len, &out_len) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG,
+                            static_cast<int>(MediaCipher::TAG_LEN), text + plain_len) != 1) {
+        CS_LOG(WARN, "MediaCipher: seal failed");
+        return 0;
+    }
+    return plain_len + MediaCipher::OVERHEAD;
+}
+
+} // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Constructor / Destructor
+// ---------------------------------------------------------------------------
+
+MediaCipher::MediaCipher() = default;
+
+MediaCipher::~MediaCipher() {
+    if (send_ctx_) EVP_CIPHER_CTX_free(send_ctx_);
+    for (auto* ctx : recv_ctx_) {
+        if (ctx) EVP_CIPHER_CTX_free(ctx);
+    }
+    OPENSSL_cleanse(recv_key_, sizeof(recv_key_));
+}
+
+// ---------------------------------------------------------------------------
+// preferredCipher / cipherName
+// ---------------------------------------------------------------------------
+
+AeadCipher MediaCipher::preferredCipher() {
+#if CS_MC_X86
+  #if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul")) {
+        return AeadCipher::AES_128_GCM;
+    }
+  #elif defined(_MSC_VER)
+    int info[4] = {0};
+    __cpuid(info, 1);
+    bool aes    = (info[2] & (1 << 25)) != 0;
+    bool pclmul = (info[2] & (1 << 1)) != 0;
+    if (aes && pclmul) return AeadCipher::AES_128_GCM;
+  #endif
+    return AeadCipher::CHACHA20_POLY1305;
+#elif CS_MC_ARM_LINUX
+    return (getauxval(AT_HWCAP) & HWCAP_AES) ? AeadCipher::AES_128_GCM
+                                             : AeadCipher::CHACHA20_POLY1305;
+#elif defined(__APPLE__) && defined(__aarch64__)
+    return AeadCipher::AES_128_GCM;   // All Apple silicon has AES instructions
+#else
+    return AeadCipher::CHACHA20_POLY1305;
+#endif
+}
+
+const char* MediaCipher::cipherName(AeadCipher cipher) {
+    switch (cipher) {
+        case AeadCipher::AES_128_GCM:       return "AES-128-GCM";
+        case AeadCipher::CHACHA20_POLY1305: return "ChaCha20-Poly1305";
+    }
+    return "unknown";
+}
+
+// ---------------------------------------------------------------------------
+// createContext
+// ---------------------------------------------------------------------------
+
+EVP_CIPHER_CTX* MediaCipher::createContext(AeadCipher cipher, const uint8_t* key_slot,
+                                           bool encrypt) {
+    const EVP_CIPHER* evp = cipher == AeadCipher::AES_128_GCM
+        ? EVP_aes_128_gcm() : EVP_chacha20_poly1305();
+
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) return nullptr;
+
+    int ok = encrypt
+        ? EVP_EncryptInit_ex(ctx, evp, nullptr, nullptr, nullptr)
+        : EVP_DecryptInit_ex(ctx, evp, nullptr, nullptr, nullptr);
+    ok = ok && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN,
+                                   static_cast<int>(NONCE_LEN), nullptr);
+    ok = ok && (encrypt
+        ? EVP_EncryptInit_ex(ctx, nullptr, nullptr, key_slot, nullptr)
+        : EVP_DecryptInit_ex(ctx, nullptr, nullptr, key_slot, nullptr));
+    if (!ok) {
+        EVP_CIPHER_CTX_free(ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+// ---------------------------------------------------------------------------
+// initialize
+// ---------------------------------------------------------------------------
+
+bool MediaCipher::initialize(const uint8_t* material, size_t len, bool is_server,
+                             AeadCipher send_cipher) {
+    if (!material || len < KEYING_MATERIAL_LEN) return false;
+
+    const uint8_t* client_key  = material;
+    const uint8_t* server_key  = material + KEY_SLOT_LEN;
+    const uint8_t* client_salt = material + 2 * KEY_SLOT_LEN;
+    const uint8_t* server_salt = client_salt + SALT_LEN;
+
+    const uint8_t* send_key = is_server ? server_key : client_key;
+    std::memcpy(send_salt_, is_server ? server_salt : client_salt, SALT_LEN);
+    std::memcpy(recv_key_,  is_server ? client_key : server_key, KEY_SLOT_LEN);
+    std::memcpy(recv_salt_, is_server ? client_salt : server_salt, SALT_LEN);
+
+    send_ctx_ = createContext(send_cipher, send_key, true);
+    if (!send_ctx_) {
+        CS_LOG(ERR, "MediaCipher: failed to create %s context", cipherName(send_cipher));
+        return false;
+    }
+    send_cipher_  = send_cipher;
+    send_counter_ = 1;
+    ready_        = true;
+
+    CS_LOG(INFO, "MediaCipher: ready (%s, role=%s)",
+           cipherName(send_cipher), is_server ? "server" : "client");
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// seal -- encrypt one packet in place
+// ---------------------------------------------------------------------------
+
+size_t MediaCipher::seal(uint8_t* buf, size_t plain_len) {
+    if (!ready_ || !buf) return 0;
+
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    return sealWith(send_ctx_, send_cipher_, send_salt_, buf, plain_len, send_counter_++);
+}
+
+// ---------------------------------------------------------------------------
+// SealContext / createSealContext / reserveCounters
+// ---------------------------------------------------------------------------
+
+MediaCipher::SealContext::~SealContext() {
+    if (ctx_) EVP_CIPHER_CTX_free(ctx_);
+}
+
+size_t MediaCipher::SealContext::seal(uint8_t* buf, size_t plain_len, uint64_t counter) {
+    if (!buf) return 0;
+    return sealWith(ctx_, cipher_, salt_, buf, plain_len, counter);
+}
+
+std::unique_ptr<MediaCipher::SealContext> MediaCipher::createSealContext() {
+    if (!ready_) return nullptr;
+
+    std::unique_ptr<SealContext> context(new SealContext());
+    context->ctx_ = EVP_CIPHER_CTX_new();
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (!context->ctx_ || EVP_CIPHER_CTX_copy(context->ctx_, send_ctx_) != 1) {
+        CS_LOG(WARN, "MediaCipher: failed to copy the send context");
+        return nullptr;
+    }
+    context->cipher_ = send_cipher_;
+    std::memcpy(context->salt_, send_salt_, SALT_LEN);
+    return context;
+}
+
+uint64_t MediaCipher::reserveCounters(size_t count) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    const uint64_t first = send_counter_;
+    send_counter_ += count;
+    return first;
+}
+
+// ---------------------------------------------------------------------------
+// open -- authenticate and decrypt one packet in place
+// ---------------------------------------------------------------------------
+
+bool MediaCipher::open(uint8_t* buf, size_t len, size_t* plain_len) {
+    if (!ready_ || !isSealed(buf, len)) return false;
+
+    int idx = cipherIndex(buf[0] & ~MARKER_MASK);
+    if (idx < 0) return false;
+
+    uint64_t counter = packetCounter(buf);
+    if (!checkReplay(counter)) {
+        replay_drops_.fetch_add(1);
+        return false;
+    }
+
+    EVP_CIPHER_CTX*& ctx = recv_ctx_[idx];
+    if (!ctx) {
+        ctx = createContext(static_cast<AeadCipher>(buf[0] & ~MARKER_MASK),
+                            recv_key_, false);
+        if (!ctx) return false;
+    }
+
+    uint8_t nonce[NONCE_LEN];
+    buildNonce(nonce, recv_salt_, buf + 1);
+
+    size_t   text_len = len - OVERHEAD;
+    uint8_t* text     = buf + HEADER_LEN;
+    int out_len = 0;
+    if (EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) != 1 ||
+        EVP_DecryptUpdate(ctx, nullptr, &out_len, buf,
+                          static_cast<int>(HEADER_LEN)) != 1 ||
+        EVP_DecryptUpdate(ctx, text, &out_len, text,
+                          static_cast<int>(text_len)) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, static_cast<int>(TAG_LEN),
+                            text + text_len) != 1 ||
+        EVP_DecryptFinal_ex(ctx, text + out_len, &out_len) != 1) {
+        auth_failures_.fetch_add(1);
+        return false;
+    }
+
+    markReceived(counter);
+    *plain_len = text_len;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Replay window
+// ---------------------------------------------------------------------------
+
+bool MediaCipher::checkReplay(uint64_t counter) const {
+    if (!any_received_ || counter > highest_counter_) return true;
+    if (highest_counter_ - counter >= WINDOW_BITS) return false;   // Too old
+
+    size_t bit = static_cast<size_t>(counter % WINDOW_BITS);
+    return ((window_[bit / 64] >> (bit % 64)) & 1) == 0;
+}
+
+void MediaCipher::markReceived(uint64_t counter) {
+    if (!any_received_ || counter > highest_counter_) {
+        uint64_t advance = any_received_ ? counter - highest_counter_ : WINDOW_BITS;
+        if (advance >= WINDOW_BITS) {
+            window_.fill(0);
+        } else {
+            for (uint64_t c = highest_counter_ + 1; c < counter; ++c) {
+                size_t bit = static_cast<size_t>(c % WINDOW_BITS);
+                window_[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+            }
+        }
+        highest_counter_ = counter;
+        any_received_    = true;
+    }
+
+    size_t bit = static_cast<size_t>(counter % WINDOW_BITS);
+    window_[bit / 64] |= uint64_t(1) << (bit % 64);
+}
+
+} // namespace cs
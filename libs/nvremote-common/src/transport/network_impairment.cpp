@@ -0,0 +1,385 @@
+///////////////////////////////////////////////////////////////////////////////
+// network_impairment.cpp -- Built-in network emulator for QoS validation
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cs/transport/network_impairment.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+namespace cs {
+
+namespace {
+
+// Pareto shape for one-sided jitter: heavy-tailed, finite variance
+constexpr double PARETO_SHAPE = 2.5;
+
+// Jitter draws are bounded as netem's tables bound them, in multiples of
+// the configured jitter: one outlier holds back every packet behind it,
+// so an unbounded tail would stall the stream rather than jitter it.
+constexpr double NORMAL_MAX_SIGMAS    = 4.0;
+constexpr double PARETO_MAX_MULTIPLE  = 8.0;
+
+std::string trim(const std::string& s) {
+    const size_t first = s.find_first_not_of(" \t");
+    if (first == std::string::npos) return std::string();
+    const size_t last = s.find_last_not_of(" \t");
+    return s.substr(first, last - first + 1);
+}
+
+std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    for (;;) {
+        const size_t end = s.find(sep, start);
+        parts.push_back(trim(s.substr(start, end - start)));
+        if (end == std::string::npos) break;
+        start = end + 1;
+    }
+    return parts;
+}
+
+bool parseNumber(const std::string& s, double& out) {
+    if (s.empty()) return false;
+    char* end = nullptr;
+    out = std::strtod(s.c_str(), &end);
+    return end && *end == '\0' && std::isfinite(out) && out >= 0.0;
+}
+
+/// A percentage (a trailing '%' is allowed) as a 0..1 chance.
+bool parsePercent(std::string s, float& out) {
+    if (!s.empty() && s.back() == '%') s.pop_back();
+    double v = 0.0;
+    if (!parseNumber(s, v) || v > 100.0) return false;
+    out = static_cast<float>(v / 100.0);
+    return true;
+}
+
+bool parseUint(const std::string& s, uint32_t& out) {
+    double v = 0.0;
+    if (!parseNumber(s, v) || v > std::numeric_limits<uint32_t>::max()) return false;
+    out = static_cast<uint32_t>(v);
+    return true;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// parseImpairmentSpec
+// ---------------------------------------------------------------------------
+
+bool parseImpairmentSpec(const std::string& spec, ImpairmentConfig& config,
+                         std::string* error) {
+    ImpairmentConfig cfg;
+    auto fail = [error](const std::string& what) {
+        if (error) *error = what;
+        return false;
+    };
+
+    for (const std::string& pair : split(spec, ',')) {
+        if (pair.empty()) continue;
+        const size_t eq = pair.find('=');
+        if (eq == std::string::npos) return fail("expected key=value: '" + pair + "'");
+        const std::string key   = trim(pair.substr(0, eq));
+        const std::string value = trim(pair.substr(eq + 1));
+        const std::string bad   = "bad value for '" + key + "': '" + value + "'";
+
+        if (key == "loss") {
+            if (!parsePercent(value, cfg.loss_good)) return fail(bad);
+        } else if (key == "burst") {
+            const auto parts = split(value, ':');
+            if (parts.size() < 2 || parts.size() > 3 ||
+                !parsePercent(parts[0], cfg.p_good_to_bad) ||
+                !parsePercent(parts[1], cfg.p_bad_to_good) ||
+                (parts.size() == 3 && !parsePercent(parts[2], cfg.loss_bad))) {
+                return fail(bad);
+            }
+        } else if (key == "delay") {
+            if (!parseUint(value, cfg.delay_ms)) return fail(bad);
+        } else if (key == "jitter") {
+            if (!parseUint(value, cfg.jitter_ms)) return fail(bad);
+        } else if (key == "dist") {
+            if      (value == "uniform") cfg.jitter_dist = JitterDistribution::UNIFORM;
+            else if (value == "normal")  cfg.jitter_dist = JitterDistribution::NORMAL;
+            else if (value == "pareto")  cfg.jitter_dist = JitterDistribution::PARETO;
+            else return fail(bad);
+        } else if (key == "reorder") {
+            if (!parsePercent(value, cfg.reorder)) return fail(bad);
+        } else if (key == "rate") {
+            if (!parseUint(value, cfg.rate_kbps)) return fail(bad);
+        } else if (key == "queue") {
+            if (!parseUint(value, cfg.queue_packets) || cfg.queue_packets == 0) return fail(bad);
+        } else if (key == "steps") {
+            for (const std::string& step : split(value, '/')) {
+                const auto parts = split(step, ':');
+                CapacityStep s;
+                if (parts.size() != 2 || !parseUint(parts[0], s.at_ms) ||
+                    !parseUint(parts[1], s.rate_kbps)) {
+                    return fail(bad);
+                }
+                cfg.steps.push_back(s);
+            }
+            std::stable_sort(cfg.steps.begin(), cfg.steps.end(),
+                             [](const CapacityStep& a, const CapacityStep& b) {
+                                 return a.at_ms < b.at_ms;
+                             });
+        } else if (key == "seed") {
+            if (!parseUint(value, cfg.seed)) return fail(bad);
+        } else {
+            return fail("unknown key '" + key + "'");
+        }
+    }
+
+    config = std::move(cfg);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// describeImpairment
+// ---------------------------------------------------------------------------
+
+std::string describeImpairment(const ImpairmentConfig& c) {
+    if (!c.enabled()) return "none";
+
+    std::string out;
+    char buf[128];
+    auto add = [&out](const char* part) {
+        if (!out.empty()) out += ", ";
+        out += part;
+    };
+
+    if (c.loss_good > 0.0f || c.p_good_to_bad > 0.0f) {
+        std::snprintf(buf, sizeof(buf), "loss %.2f%%", c.loss_good * 100.0f);
+        add(buf);
+        if (c.p_good_to_bad > 0.0f) {
+            std::snprintf(buf, sizeof(buf), "bursts %.2f%%/%.2f%% at %.0f%% loss",
+                          c.p_good_to_bad * 100.0f, c.p_bad_to_good * 100.0f,
+                          c.loss_bad * 100.0f);
+            add(buf);
+        }
+    }
+    if (c.delay_ms > 0 || c.jitter_ms > 0) {
+        static const char* const DISTS[] = {"uniform", "normal", "pareto"};
+        std::snprintf(buf, sizeof(buf), "delay %u ms, jitter %u ms %s", c.delay_ms, c.jitter_ms,
+                      DISTS[static_cast<size_t>(c.jitter_dist)]);
+        add(buf);
+    }
+    if (c.reorder > 0.0f) {
+        std::snprintf(buf, sizeof(buf), "reorder %.2f%%", c.reorder * 100.0f);
+        add(buf);
+    }
+    if (c.rate_kbps > 0 || !c.steps.empty()) {
+        std::snprintf(buf, sizeof(buf), "rate %u kbps, queue %u, %zu steps",
+                      c.rate_kbps, c.queue_packets, c.steps.size());
+        add(buf);
+    }
+    std::snprintf(buf, sizeof(buf), "seed %u", c.seed);
+    add(buf);
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+// Construction / destruction
+// ---------------------------------------------------------------------------
+
+NetworkImpairment::NetworkImpairment(const ImpairmentConfig& config)
+    : config_(config),
+      rng_(config.seed) {}
+
+NetworkImpairment::~NetworkImpairment() {
+    stop();
+}
+
+// ---------------------------------------------------------------------------
+// Random draws (mutex_ held)
+// ---------------------------------------------------------------------------
+
+bool NetworkImpairment::drawLoss() {
+    std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+
+    if (config_.p_good_to_bad > 0.0f) {
+        const float p = bad_state_ ? config_.p_bad_to_good : config_.p_good_to_bad;
+        if (chance(rng_) < p) bad_state_ = !bad_state_;
+    }
+    const float loss = bad_state_ ? config_.loss_bad : config_.loss_good;
+    return loss > 0.0f && chance(rng_) < loss;
+}
+
+int64_t NetworkImpairment::drawJitterUs() {
+    if (config_.jitter_ms == 0) return 0;
+    const double j = static_cast<double>(config_.jitter_ms) * 1000.0;
+
+    switch (config_.jitter_dist) {
+        case JitterDistribution::UNIFORM:
+            return static_cast<int64_t>(std::uniform_real_distribution<double>(-j, j)(rng_));
+        case JitterDistribution::NORMAL:
+            return static_cast<int64_t>(std::clamp(std::normal_distribution<double>(0.0, j)(rng_),
+                                                   -NORMAL_MAX_SIGMAS * j, NORMAL_MAX_SIGMAS * j));
+        case JitterDistribution::PARETO: {
+            // Pareto with minimum xm, less xm: mean xm / (shape - 1) = j
+            const double xm = j * (PARETO_SHAPE - 1.0);
+            const double u  = std::uniform_real_distribution<double>(
+                std::numeric_limits<double>::min(), 1.0)(rng_);
+            return static_cast<int64_t>(std::min(xm * (std::pow(u, -1.0 / PARETO_SHAPE) - 1.0),
+                                                 PARETO_MAX_MULTIPLE * j));
+        }
+    }
+    return 0;
+}
+
+uint32_t NetworkImpairment::rateAt(uint64_t now_us) const {
+    uint32_t rate = config_.rate_kbps;
+    const uint64_t elapsed_ms = (now_us - start_us_) / 1000;
+    for (const CapacityStep& step : config_.steps) {
+        if (elapsed_ms < step.at_ms) break;
+        rate = step.rate_kbps;
+    }
+    return rate;
+}
+
+// ---------------------------------------------------------------------------
+// submit
+// ---------------------------------------------------------------------------
+
+bool NetworkImpairment::submit(const uint8_t* data, size_t len, uint64_t now_us,
+                               const ::sockaddr_in* to) {
+    if (!data || len == 0) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stats_.submitted++ == 0) start_us_ = now_us;
+
+    if (drawLoss()) {
+        ++stats_.lost;
+        return false;
+    }
+
+    // The link: serialized at its rate behind what is already queued
+    uint64_t departure_us = now_us;
+    const uint32_t rate = rateAt(now_us);
+    stats_.rate_kbps = rate;
+    if (rate > 0) {
+        while (!link_departures_.empty() && link_departures_.front() <= now_us) {
+            link_departures_.pop_front();
+        }
+        if (link_departures_.size() >= config_.queue_packets) {
+            ++stats_.queue_drops;
+            return false;
+        }
+        link_free_us_ = std::max(link_free_us_, now_us) + len * 8000 / rate;
+        departure_us  = link_free_us_;
+        link_departures_.push_back(departure_us);
+    }
+
+    // Propagation: delay and jitter keep packets in order, except those
+    // picked for reordering, which skip the delay and overtake
+    uint64_t due_us = departure_us;
+    std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+    if (config_.reorder > 0.0f && config_.delay_ms > 0 && chance(rng_) < config_.reorder) {
+        ++stats_.reordered;
+    } else {
+        const int64_t delay_us = static_cast<int64_t>(config_.delay_ms) * 1000 + drawJitterUs();
+        due_us = std::max(departure_us + static_cast<uint64_t>(std::max<int64_t>(delay_us, 0)),
+                          last_due_us_);
+        last_due_us_ = due_us;
+    }
+
+    Datagram dgram;
+    dgram.buf = BufferPool::shared().copyOf(data, len);
+    if (!dgram.buf) return false;
+    dgram.len    = len;
+    dgram.due_us = due_us;
+    dgram.order  = next_order_++;
+    if (to) dgram.to = *to;
+
+    held_.push_back(std::move(dgram));
+    std::push_heap(held_.begin(), held_.end(), Later());
+    cv_.notify_one();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// takeDue / nextDueUs
+// ---------------------------------------------------------------------------
+
+size_t NetworkImpairment::takeDue(uint64_t now_us, std::vector<Datagram>& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t taken = 0;
+    while (!held_.empty() && held_.front().due_us <= now_us) {
+        std::pop_heap(held_.begin(), held_.end(), Later());
+        out.push_back(std::move(held_.back()));
+        held_.pop_back();
+        ++taken;
+    }
+    stats_.delivered += taken;
+    return taken;
+}
+
+uint64_t NetworkImpairment::nextDueUs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return held_.empty() ? std::numeric_limits<uint64_t>::max() : held_.front().due_us;
+}
+
+// ---------------------------------------------------------------------------
+// Delivery thread
+// ---------------------------------------------------------------------------
+
+void NetworkImpairment::start(DeliverFunc deliver) {
+    stop();
+    deliver_ = std::move(deliver);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = false;
+    }
+    thread_ = std::thread(&NetworkImpairment::deliveryLoop, this);
+}
+
+void NetworkImpairment::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_.clear();
+    link_departures_.clear();
+}
+
+void NetworkImpairment::deliveryLoop() {
+    std::vector<Datagram> due;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (held_.empty()) {
+            cv_.wait(lock);
+            continue;
+        }
+        const uint64_t now_us  = getTimestampUs();
+        const uint64_t next_us = held_.front().due_us;
+        if (next_us > now_us) {
+            cv_.wait_for(lock, std::chrono::microseconds(next_us - now_us));
+            continue;
+        }
+
+        lock.unlock();
+        takeDue(now_us, due);
+        for (const Datagram& dgram : due) deliver_(dgram);
+        due.clear();
+        lock.lock();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// getStats
+// ---------------------------------------------------------------------------
+
+NetworkImpairment::Stats NetworkImpairment::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace cs
@@ -0,0 +1,470 @@
+///////////////////////////////////////////////////////////////////////////////
+// packet_recorder.cpp -- Memory-mapped session packet recording and replay input
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cs/transport/packet_recorder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <Windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace cs {
+
+namespace {
+
+size_t padded(size_t len) {
+    return (len + 7) & ~static_cast<size_t>(7);
+}
+
+// ---------------------------------------------------------------------------
+// File and mapping helpers -- |file| is an fd, or a HANDLE on Windows
+// ---------------------------------------------------------------------------
+
+constexpr intptr_t NO_FILE = -1;
+
+intptr_t openFile(const std::string& path, bool writable) {
+#ifdef _WIN32
+    // Readers share write access so a live recording can be inspected
+    HANDLE h = writable
+        ? CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                      CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr)
+        : CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    return h == INVALID_HANDLE_VALUE ? NO_FILE : reinterpret_cast<intptr_t>(h);
+#else
+    int fd = writable ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)
+                      : ::open(path.c_str(), O_RDONLY);
+    return fd < 0 ? NO_FILE : static_cast<intptr_t>(fd);
+#endif
+}
+
+void closeFile(intptr_t file) {
+    if (file == NO_FILE) return;
+#ifdef _WIN32
+    CloseHandle(reinterpret_cast<HANDLE>(file));
+#else
+    ::close(static_cast<int>(file));
+#endif
+}
+
+uint64_t fileSize(intptr_t file) {
+#ifdef _WIN32
+    LARGE_INTEGER size = {};
+    return GetFileSizeEx(reinterpret_cast<HANDLE>(file), &size)
+        ? static_cast<uint64_t>(size.QuadPart) : 0;
+#else
+    struct stat st = {};
+    return ::fstat(static_cast<int>(file), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+#endif
+}
+
+bool setFileSize(intptr_t file, uint64_t size) {
+#ifdef _WIN32
+    LARGE_INTEGER pos;
+    pos.QuadPart = static_cast<LONGLONG>(size);
+    HANDLE h = reinterpret_cast<HANDLE>(file);
+    return SetFilePointerEx(h, pos, nullptr, FILE_BEGIN) && SetEndOfFile(h);
+#else
+    return ::ftruncate(static_cast<int>(file), static_cast<off_t>(size)) == 0;
+#endif
+}
+
+/// Map |bytes| at |offset|.  Writable mappings grow the file to cover
+/// them.  |mapping| receives the Windows mapping handle for unmapView().
+void* mapView(intptr_t file, uint64_t offset, size_t bytes, bool writable, void** mapping) {
+    *mapping = nullptr;
+#ifdef _WIN32
+    const uint64_t end = writable ? offset + bytes : 0;   // 0 = the whole file
+    HANDLE m = CreateFileMappingA(reinterpret_cast<HANDLE>(file), nullptr,
+                                  writable ? PAGE_READWRITE : PAGE_READONLY,
+                                  static_cast<DWORD>(end >> 32), static_cast<DWORD>(end),
+                                  nullptr);
+    if (!m) return nullptr;
+    void* view = MapViewOfFile(m, writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+                               static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset),
+                               bytes);
+    if (!view) {
+        CloseHandle(m);
+        return nullptr;
+    }
+    *mapping = m;
+    return view;
+#else
+    if (writable && fileSize(file) < offset + bytes && !setFileSize(file, offset + bytes)) {
+        return nullptr;
+    }
+    void* view = ::mmap(nullptr, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                        MAP_SHARED, static_cast<int>(file), static_cast<off_t>(offset));
+    return view == MAP_FAILED ? nullptr : view;
+#endif
+}
+
+void unmapView(void* view, size_t bytes, void* mapping, bool flush) {
+    if (!view) return;
+#ifdef _WIN32
+    (void)bytes;
+    if (flush) FlushViewOfFile(view, 0);
+    UnmapViewOfFile(view);
+    if (mapping) CloseHandle(static_cast<HANDLE>(mapping));
+#else
+    (void)mapping;
+    if (flush) ::msync(view, bytes, MS_ASYNC);
+    ::munmap(view, bytes);
+#endif
+}
+
+} // namespace
+
+// ===========================================================================
+// PacketRecorder
+// ===========================================================================
+
+PacketRecorder::~PacketRecorder() {
+    close();
+}
+
+// ---------------------------------------------------------------------------
+// open
+// ---------------------------------------------------------------------------
+
+bool PacketRecorder::open(const std::string& path, RecordingRole role, size_t chunk_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closeLocked();
+
+    chunk_bytes_ = std::max(chunk_bytes, RECORDING_CHUNK_ALIGN);
+    chunk_bytes_ = (chunk_bytes_ + RECORDING_CHUNK_ALIGN - 1) / RECORDING_CHUNK_ALIGN *
+                   RECORDING_CHUNK_ALIGN;
+
+    file_ = openFile(path, true);
+    if (file_ == NO_FILE) {
+        CS_LOG(ERR, "PacketRecorder: cannot create %s", path.c_str());
+        return false;
+    }
+    header_ = static_cast<RecordingFileHeader*>(
+        mapView(file_, 0, RECORDING_FILE_HEADER_BYTES, true, &header_map_));
+    if (!header_) {
+        CS_LOG(ERR, "PacketRecorder: cannot map %s", path.c_str());
+        closeFile(file_);
+        file_ = NO_FILE;
+        return false;
+    }
+
+    header_->magic           = RECORDING_MAGIC;
+    header_->version         = RECORDING_VERSION;
+    header_->role            = static_cast<uint8_t>(role);
+    header_->chunk_bytes     = static_cast<uint32_t>(chunk_bytes_);
+    header_->chunk_count     = 0;
+    header_->created_us      = getTimestampUs();
+    header_->created_unix_ms = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+
+    path_           = path;
+    record_count_   = 0;
+    recorded_bytes_ = 0;
+    if (!mapChunk(0)) {
+        CS_LOG(ERR, "PacketRecorder: cannot grow %s", path.c_str());
+        closeLocked();
+        return false;
+    }
+
+    CS_LOG(INFO, "PacketRecorder: recording %s datagrams to %s (%zu KiB chunks)",
+           role == RecordingRole::HOST ? "host" : "viewer", path.c_str(), chunk_bytes_ / 1024);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// close
+// ---------------------------------------------------------------------------
+
+void PacketRecorder::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closeLocked();
+}
+
+void PacketRecorder::closeLocked() {
+    if (file_ == NO_FILE) return;
+
+    // Cut the last chunk to its fill: the file ends at the last record
+    uint64_t end = 0;
+    if (chunk_) {
+        end = RECORDING_FILE_HEADER_BYTES + static_cast<uint64_t>(chunk_index_) * chunk_bytes_ +
+              reinterpret_cast<const RecordingChunkHeader*>(chunk_)->used_bytes;
+    }
+    unmapChunk();
+    unmapView(header_, RECORDING_FILE_HEADER_BYTES, header_map_, true);
+    header_     = nullptr;
+    header_map_ = nullptr;
+    if (end > 0) setFileSize(file_, end);
+    closeFile(file_);
+    file_ = NO_FILE;
+
+    CS_LOG(INFO, "PacketRecorder: %s closed, %llu datagrams (%llu bytes)", path_.c_str(),
+           static_cast<unsigned long long>(record_count_),
+           static_cast<unsigned long long>(recorded_bytes_));
+}
+
+bool PacketRecorder::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return chunk_ != nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// mapChunk / unmapChunk
+// ---------------------------------------------------------------------------
+
+bool PacketRecorder::mapChunk(uint32_t index) {
+    unmapChunk();
+    const uint64_t offset =
+        RECORDING_FILE_HEADER_BYTES + static_cast<uint64_t>(index) * chunk_bytes_;
+    chunk_ = static_cast<uint8_t*>(mapView(file_, offset, chunk_bytes_, true, &chunk_map_));
+    if (!chunk_) return false;
+
+    auto* ch = reinterpret_cast<RecordingChunkHeader*>(chunk_);
+    ch->magic        = RECORDING_CHUNK_MAGIC;
+    ch->index        = index;
+    ch->first_us     = 0;
+    ch->last_us      = 0;
+    ch->record_count = 0;
+    ch->used_bytes   = sizeof(RecordingChunkHeader);
+
+    chunk_index_         = index;
+    header_->chunk_count = index + 1;
+    return true;
+}
+
+void PacketRecorder::unmapChunk() {
+    unmapView(chunk_, chunk_bytes_, chunk_map_, true);
+    chunk_     = nullptr;
+    chunk_map_ = nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// record
+// ---------------------------------------------------------------------------
+
+bool PacketRecorder::record(RecordDirection direction, const uint8_t* data, size_t len,
+                            uint64_t timestamp_us) {
+    const size_t need = sizeof(RecordHeader) + padded(len);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!chunk_ || need > chunk_bytes_ - sizeof(RecordingChunkHeader)) return false;
+
+    auto* ch = reinterpret_cast<RecordingChunkHeader*>(chunk_);
+    if (ch->used_bytes + need > chunk_bytes_) {
+        if (!mapChunk(chunk_index_ + 1)) {
+            CS_LOG(WARN, "PacketRecorder: cannot grow %s, recording stopped", path_.c_str());
+            closeLocked();
+            return false;
+        }
+        ch = reinterpret_cast<RecordingChunkHeader*>(chunk_);
+    }
+
+    uint8_t* p = chunk_ + ch->used_bytes;
+    RecordHeader rh = {};
+    rh.timestamp_us = timestamp_us;
+    rh.length       = static_cast<uint32_t>(len);
+    rh.direction    = static_cast<uint8_t>(direction);
+    std::memcpy(p, &rh, sizeof(rh));
+    if (len > 0) std::memcpy(p + sizeof(rh), data, len);
+
+    // Times are taken before the lock, so they can arrive slightly out of
+    // order across threads; the chunk keeps the range
+    if (ch->record_count == 0) {
+        ch->first_us = timestamp_us;
+        ch->last_us  = timestamp_us;
+    } else {
+        ch->first_us = std::min(ch->first_us, timestamp_us);
+        ch->last_us  = std::max(ch->last_us, timestamp_us);
+    }
+    ++ch->record_count;
+
+    // The record is whole before it is counted
+    std::atomic_signal_fence(std::memory_order_release);
+    ch->used_bytes += static_cast<uint32_t>(need);
+
+    ++record_count_;
+    recorded_bytes_ += len;
+    return true;
+}
+
+uint64_t PacketRecorder::getRecordCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return record_count_;
+}
+
+uint64_t PacketRecorder::getRecordedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return recorded_bytes_;
+}
+
+// ===========================================================================
+// RecordingReader
+// ===========================================================================
+
+RecordingReader::~RecordingReader() {
+    close();
+}
+
+// ---------------------------------------------------------------------------
+// open / close
+// ---------------------------------------------------------------------------
+
+bool RecordingReader::open(const std::string& path) {
+    close();
+
+    file_ = openFile(path, false);
+    if (file_ == NO_FILE) {
+        CS_LOG(ERR, "RecordingReader: cannot open %s", path.c_str());
+        return false;
+    }
+    size_ = static_cast<size_t>(fileSize(file_));
+    if (size_ < RECORDING_FILE_HEADER_BYTES) {
+        CS_LOG(ERR, "RecordingReader: %s is not a recording", path.c_str());
+        close();
+        return false;
+    }
+    base_ = static_cast<const uint8_t*>(mapView(file_, 0, size_, false, &map_));
+    if (!base_) {
+        CS_LOG(ERR, "RecordingReader: cannot map %s", path.c_str());
+        close();
+        return false;
+    }
+
+    header_ = reinterpret_cast<const RecordingFileHeader*>(base_);
+    if (header_->magic != RECORDING_MAGIC || header_->version != RECORDING_VERSION ||
+        header_->chunk_bytes < RECORDING_CHUNK_ALIGN ||
+        header_->chunk_bytes % RECORDING_CHUNK_ALIGN != 0) {
+        CS_LOG(ERR, "RecordingReader: %s has a bad header", path.c_str());
+        close();
+        return false;
+    }
+
+    // Count the chunks that are whole up to their fill
+    chunk_count_ = 0;
+    while (chunk_count_ < header_->chunk_count) {
+        const size_t offset =
+            RECORDING_FILE_HEADER_BYTES + static_cast<size_t>(chunk_count_) * header_->chunk_bytes;
+        if (offset + sizeof(RecordingChunkHeader) > size_) break;
+        const auto* ch = reinterpret_cast<const RecordingChunkHeader*>(base_ + offset);
+        if (ch->magic != RECORDING_CHUNK_MAGIC || ch->index != chunk_count_ ||
+            ch->used_bytes < sizeof(RecordingChunkHeader) ||
+            ch->used_bytes > header_->chunk_bytes || offset + ch->used_bytes > size_) {
+            break;
+        }
+        ++chunk_count_;
+    }
+    if (chunk_count_ < header_->chunk_count) {
+        CS_LOG(WARN, "RecordingReader: %s is truncated (%u of %u chunks readable)",
+               path.c_str(), chunk_count_, header_->chunk_count);
+    }
+
+    rewind();
+    return true;
+}
+
+void RecordingReader::close() {
+    unmapView(const_cast<uint8_t*>(base_), size_, map_, false);
+    closeFile(file_);
+    base_        = nullptr;
+    map_         = nullptr;
+    file_        = NO_FILE;
+    header_      = nullptr;
+    size_        = 0;
+    chunk_count_ = 0;
+    cur_chunk_   = 0;
+    cur_offset_  = 0;
+}
+
+// ---------------------------------------------------------------------------
+// chunk access
+// ---------------------------------------------------------------------------
+
+const uint8_t* RecordingReader::chunkBase(uint32_t index) const {
+    return base_ + RECORDING_FILE_HEADER_BYTES +
+           static_cast<size_t>(index) * header_->chunk_bytes;
+}
+
+const RecordingChunkHeader& RecordingReader::chunk(uint32_t index) const {
+    return *reinterpret_cast<const RecordingChunkHeader*>(chunkBase(index));
+}
+
+// ---------------------------------------------------------------------------
+// rewind / seek
+// ---------------------------------------------------------------------------
+
+void RecordingReader::rewind() {
+    cur_chunk_  = 0;
+    cur_offset_ = sizeof(RecordingChunkHeader);
+}
+
+void RecordingReader::seek(uint64_t timestamp_us) {
+    // The first chunk that reaches |timestamp_us|, then records within it
+    uint32_t lo = 0;
+    uint32_t hi = chunk_count_;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (chunk(mid).last_us < timestamp_us) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    cur_chunk_  = lo;
+    cur_offset_ = sizeof(RecordingChunkHeader);
+
+    PacketRecord rec;
+    for (;;) {
+        const uint32_t chunk_at  = cur_chunk_;
+        const size_t   offset_at = cur_offset_;
+        if (!next(rec)) return;
+        if (rec.timestamp_us >= timestamp_us) {
+            cur_chunk_  = chunk_at;
+            cur_offset_ = offset_at;
+            return;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// next
+// ---------------------------------------------------------------------------
+
+bool RecordingReader::next(PacketRecord& out) {
+    while (cur_chunk_ < chunk_count_) {
+        const uint8_t* base = chunkBase(cur_chunk_);
+        const size_t   used = chunk(cur_chunk_).used_bytes;
+
+        if (cur_offset_ + sizeof(RecordHeader) <= used) {
+            RecordHeader rh;
+            std::memcpy(&rh, base + cur_offset_, sizeof(rh));
+            const size_t end = cur_offset_ + sizeof(RecordHeader) + padded(rh.length);
+            if (end <= used) {
+                out.timestamp_us = rh.timestamp_us;
+                out.direction    = static_cast<RecordDirection>(rh.direction);
+                out.data         = base + cur_offset_ + sizeof(RecordHeader);
+                out.len          = rh.length;
+                cur_offset_      = end;
+                return true;
+            }
+        }
+        ++cur_chunk_;
+        cur_offset_ = sizeof(RecordingChunkHeader);
+    }
+    return false;
+}
+
+} // namespace cs
@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////////////
+// lz4_block_test.cpp -- LZ4 block round trips and decoder bounds
+//
+// Clipboard chunks come from the network, so the decoder must turn down
+// anything malformed without reading or writing past either buffer.
+// Decodes go into a buffer with a guard tail that must come through
+// untouched.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cs/transport/lz4_block.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t  GUARD_BYTES = 64;
+constexpr uint8_t GUARD       = 0xEE;
+
+std::vector<uint8_t> sampleText() {
+    std::string text;
+    for (int i = 0; i < 200; ++i) {
+        text += "The quick brown fox jumps over the lazy dog ";
+        text += std::to_string(i);
+        text += '\n';
+    }
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+std::vector<uint8_t> compressed(const std::vector<uint8_t>& raw) {
+    std::vector<uint8_t> out(cs::Lz4Block::compressBound(raw.size()));
+    const size_t n = cs::Lz4Block::compress(raw.data(), raw.size(), out.data(), out.size());
+    out.resize(n);
+    return out;
+}
+
+/// Decode |src| into |raw_len| bytes; the guard tail must survive.
+bool decodeGuarded(const std::vector<uint8_t>& src, size_t raw_len,
+                   std::vector<uint8_t>* out = nullptr) {
+    std::vector<uint8_t> dst(raw_len + GUARD_BYTES, GUARD);
+    const bool ok = cs::Lz4Block::decompress(src.data(), src.size(), dst.data(), raw_len);
+    for (size_t i = raw_len; i < dst.size(); ++i) {
+        EXPECT_EQ(dst[i], GUARD) << "wrote past the output at " << i;
+    }
+    if (out) out->assign(dst.begin(), dst.begin() + raw_len);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Round trips
+// ---------------------------------------------------------------------------
+
+TEST(Lz4Block, RoundTrip) {
+    const std::vector<uint8_t> raw = sampleText();
+    const std::vector<uint8_t> packed = compressed(raw);
+    ASSERT_GT(packed.size(), 0u);
+    EXPECT_LT(packed.size(), raw.size() / 2);
+
+    std::vector<uint8_t> out;
+    ASSERT_TRUE(decodeGuarded(packed, raw.size(), &out));
+    EXPECT_EQ(out, raw);
+}
+
+TEST(Lz4Block, CompressRespectsCapacity) {
+    const std::vector<uint8_t> raw = sampleText();
+    std::vector<uint8_t> dst(16);
+    EXPECT_EQ(cs::Lz4Block::compress(raw.data(), raw.size(), dst.data(), dst.size()), 0u);
+}
+
+// ---------------------------------------------------------------------------
+// Decoder bounds
+// ---------------------------------------------------------------------------
+
+TEST(Lz4Block, TruncatedInputIsRejected) {
+    const std::vector<uint8_t> raw = sampleText();
+    const std::vector<uint8_t> packed = compressed(raw);
+    for (size_t len = 0; len < packed.size(); ++len) {
+        const std::vector<uint8_t> cut(packed.begin(), packed.begin() + len);
+        EXPECT_FALSE(decodeGuarded(cut, raw.size())) << "length " << len;
+    }
+}
+
+TEST(Lz4Block, WrongRawLengthIsRejected) {
+    const std::vector<uint8_t> raw = sampleText();
+    const std::vector<uint8_t> packed = compressed(raw);
+    EXPECT_FALSE(decodeGuarded(packed, raw.size() - 1));   // Would overflow the output
+    EXPECT_FALSE(decodeGuarded(packed, raw.size() / 2));
+    EXPECT_FALSE(decodeGuarded(packed, 0));
+    EXPECT_FALSE(decodeGuarded(packed, raw.size() + 1));   // Comes up short
+}
+
+TEST(Lz4Block, LiteralRunPastTheInputIsRejected) {
+    // Token says 15 + 255 + 10 literals; only 4 follow
+    const std::vector<uint8_t> src = {0xF0, 255, 10, 'a', 'b', 'c', 'd'};
+    EXPECT_FALSE(decodeGuarded(src, 280));
+}
+
+TEST(Lz4Block, LiteralRunPastTheOutputIsRejected) {
+    const std::vector<uint8_t> src = {0x80, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h'};
+    EXPECT_FALSE(decodeGuarded(src, 4));
+    EXPECT_TRUE(decodeGuarded(src, 8));
+}
+
+TEST(Lz4Block, BadMatchOffsetIsRejected) {
+    // Four literals, then a match of 4 + 4 bytes
+    std::vector<uint8_t> src = {0x44, 'a', 'b', 'c', 'd', 0x00, 0x00};
+    EXPECT_FALSE(decodeGuarded(src, 12));   // Offset 0
+    src[5] = 5;
+    EXPECT_FALSE(decodeGuarded(src, 12));   // Before the start of the output
+    src[5] = 0xFF;
+    src[6] = 0xFF;
+    EXPECT_FALSE(decodeGuarded(src, 12));
+
+    src[5] = 4;
+    src[6] = 0;
+    std::vector<uint8_t> out;
+    ASSERT_TRUE(decodeGuarded(src, 12, &out));   // Offset 4: valid, overlapping
+    EXPECT_EQ(std::string(out.begin(), out.end()), "abcdabcdabcd");
+}
+
+TEST(Lz4Block, MatchPastTheOutputIsRejected) {
+    // Match length 15 + 255 + 4 from a one-byte literal
+    const std::vector<uint8_t> src = {0x1F, 'x', 0x01, 0x00, 255, 0};
+    EXPECT_FALSE(decodeGuarded(src, 100));
+    EXPECT_TRUE(decodeGuarded(src, 1 + 15 + 255 + 4));
+}
+
+TEST(Lz4Block, UnterminatedLengthIsRejected) {
+    const std::vector<uint8_t> src = {0xF0, 255, 255, 255};
+    EXPECT_FALSE(decodeGuarded(src, 1024));
+}
+
+} // namespace
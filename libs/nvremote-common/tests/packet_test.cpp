@@ -0,0 +1,214 @@
+///////////////////////////////////////////////////////////////////////////////
+// packet_test.cpp -- Wire header round trips and packet classification
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cs/transport/packet.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+cs::VideoPacketHeaderV2 makeVideoHeader(uint8_t version) {
+    cs::VideoPacketHeaderV2 h{};
+    h.setVersion(version);
+    h.codec           = static_cast<uint8_t>(cs::CodecType::H264);
+    h.sequence_number = 4242;
+    h.timestamp_us    = 123456789;
+    h.frame_number    = 777;
+    h.fragment_index  = 3;
+    h.fragment_total  = 9;
+    h.payload_length  = 1180;
+    return h;
+}
+
+// ---------------------------------------------------------------------------
+// identifyPacket() -- video
+// ---------------------------------------------------------------------------
+
+// The codec byte's high nibble is the stream ID (CS05), so every stream of
+// every codec must still read as video.
+TEST(IdentifyPacket, VideoV2WithStreamId) {
+    const cs::CodecType codecs[] = {cs::CodecType::H264, cs::CodecType::H265,
+                                    cs::CodecType::AV1};
+    for (cs::CodecType codec : codecs) {
+        for (uint8_t stream = 0; stream < 4; ++stream) {
+            cs::VideoPacketHeaderV2 h = makeVideoHeader(3);
+            h.codec = static_cast<uint8_t>(codec);
+            h.setStreamId(stream);
+            h.setKeyframe(stream % 2 == 0);
+
+            uint8_t wire[sizeof(cs::VideoPacketHeaderV2)];
+            ASSERT_EQ(h.serializeTo(wire), sizeof(wire));
+            EXPECT_EQ(cs::identifyPacket(wire, sizeof(wire)), cs::PacketType::VIDEO)
+                << "codec " << int(codec) << " stream " << int(stream);
+
+            cs::VideoPacketHeaderV2 parsed{};
+            size_t header_len = 0;
+            ASSERT_TRUE(cs::parseVideoHeader(wire, sizeof(wire), parsed, &header_len));
+            EXPECT_EQ(header_len, sizeof(wire));
+            EXPECT_EQ(parsed.streamId(), stream);
+            EXPECT_EQ(parsed.codecType(), static_cast<uint8_t>(codec));
+            EXPECT_EQ(parsed.frame_number, h.frame_number);
+            EXPECT_EQ(parsed.payload_length, h.payload_length);
+        }
+    }
+}
+
+// A CS01 header's flags byte shares 0x40 - 0x5F with the legacy controller
+// and clipboard types; in a CS01 session every flags combination the host
+// sends must still read as video.
+TEST(IdentifyPacket, VideoV1EveryFlagsByte) {
+    for (uint8_t bits = 0; bits < 32; ++bits) {
+        cs::VideoPacketHeaderV2 h = makeVideoHeader(1);
+        h.setKeyframe((bits & 0x10) != 0);
+        h.setRecovery((bits & 0x08) != 0);
+        h.setLtr((bits & 0x04) != 0);
+        h.setTemporalLayer(bits & 0x03);
+
+        uint8_t wire[sizeof(cs::VideoPacketHeader)];
+        ASSERT_EQ(h.serializeTo(wire), sizeof(wire));
+        EXPECT_EQ(cs::identifyPacket(wire, sizeof(wire), 1), cs::PacketType::VIDEO)
+            << "flags 0x" << std::hex << int(wire[0]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// identifyPacket() -- dedicated type bytes
+// ---------------------------------------------------------------------------
+
+TEST(IdentifyPacket, ControllerAckIsNeverVideo) {
+    cs::ControllerAckPacket ack{};
+    ack.type   = static_cast<uint8_t>(cs::PacketType::CONTROLLER_ACK);
+    ack.mask   = 0x03;
+    ack.seq[0] = 0x0102;   // Bytes that look like a codec
+    uint8_t wire[sizeof(cs::ControllerAckPacket)];
+    ASSERT_EQ(ack.serializeTo(wire), sizeof(wire));
+    EXPECT_LT(wire[0], 0x40);   // Below every video flags byte
+    for (uint8_t version = 0; version <= cs::PROTOCOL_WIRE_VERSION_MAX; ++version) {
+        EXPECT_EQ(cs::identifyPacket(wire, sizeof(wire), version),
+                  cs::PacketType::CONTROLLER_ACK);
+    }
+    EXPECT_EQ(cs::identifyPacket(wire, sizeof(wire) - 1), static_cast<cs::PacketType>(0));
+}
+
+// The host receives no video, so a legacy controller packet (whose
+// controller ID looks like a codec byte) stays a controller packet there.
+TEST(IdentifyPacket, LegacyControllerOnTheHost) {
+    uint8_t wire[sizeof(cs::ControllerPacket)] = {};
+    wire[0] = static_cast<uint8_t>(cs::PacketType::CONTROLLER);
+    for (uint8_t id = 0; id < 4; ++id) {
+        wire[1] = id;
+        EXPECT_EQ(cs::identifyPacket(wire, sizeof(wire)), cs::PacketType::CONTROLLER);
+    }
+}
+
+TEST(IdentifyPacket, ClipboardChunkAndAckAreNeverVideo) {
+    cs::ClipboardChunkHeader chunk{};
+    chunk.type      = static_cast<uint8_t>(cs::PacketType::CLIP_CHUNK);
+    chunk.direction = static_cast<uint8_t>(cs::ClipboardDirection::HOST_TO_VIEWER);
+    uint8_t chunk_wire[sizeof(cs::ClipboardChunkHeader)];
+    ASSERT_EQ(chunk.serializeTo(chunk_wire), sizeof(chunk_wire));
+
+    cs::ClipboardWindowAckPacket ack{};
+    ack.type       = static_cast<uint8_t>(cs::PacketType::CLIP_WINDOW_ACK);
+    ack.flags      = cs::ClipboardWindowAckPacket::FLAG_WINDOW;
+    ack.transfer   = 7;
+    ack.cumulative = 3;
+    uint8_t ack_wire[sizeof(cs::ClipboardWindowAckPacket)];
+    ASSERT_EQ(ack.serializeTo(ack_wire), sizeof(ack_wire));
+
+    EXPECT_LT(chunk_wire[0], 0x40);
+    EXPECT_LT(ack_wire[0], 0x40);
+    for (uint8_t version = 0; version <= cs::PROTOCOL_WIRE_VERSION_MAX; ++version) {
+        EXPECT_EQ(cs::identifyPacket(chunk_wire, sizeof(chunk_wire), version),
+                  cs::PacketType::CLIP_CHUNK);
+        EXPECT_EQ(cs::identifyPacket(ack_wire, sizeof(ack_wire), version),
+                  cs::PacketType::CLIP_WINDOW_ACK);
+    }
+
+    cs::ClipboardWindowAckPacket parsed{};
+    ASSERT_TRUE(cs::ClipboardWindowAckPacket::deserialize(ack_wire, sizeof(ack_wire), parsed));
+    EXPECT_EQ(parsed.transfer, 7);
+    EXPECT_EQ(parsed.cumulative, 3);
+}
+
+// A legacy ack's reserved byte is 0, never a codec, so it still reads as
+// an ack in a CS01 session.
+TEST(IdentifyPacket, LegacyClipboardAck) {
+    cs::ClipboardAckPacket ack{};
+    ack.type         = static_cast<uint8_t>(cs::PacketType::CLIP_ACK);
+    ack.ack_sequence = 0x0102;
+    const std::vector<uint8_t> wire = ack.serialize();
+    EXPECT_EQ(cs::identifyPacket(wire.data(), wire.size(), 1), cs::PacketType::CLIP_ACK);
+    EXPECT_EQ(cs::identifyPacket(wire.data(), wire.size()), cs::PacketType::CLIP_ACK);
+}
+
+TEST(IdentifyPacket, UnknownCodecIsNotVideo) {
+    cs::VideoPacketHeaderV2 h = makeVideoHeader(3);
+    h.codec = 0x04;
+    h.setStreamId(1);
+    uint8_t wire[sizeof(cs::VideoPacketHeaderV2)];
+    h.serializeTo(wire);
+    EXPECT_EQ(cs::identifyPacket(wire, sizeof(wire)), static_cast<cs::PacketType>(0));
+}
+
+TEST(IdentifyPacket, EmptyAndShortBuffers) {
+    uint8_t wire[sizeof(cs::VideoPacketHeaderV2)];
+    makeVideoHeader(3).serializeTo(wire);
+    EXPECT_EQ(cs::identifyPacket(wire, 0), static_cast<cs::PacketType>(0));
+    EXPECT_EQ(cs::identifyPacket(wire, sizeof(cs::VideoPacketHeader) - 1),
+              static_cast<cs::PacketType>(0));
+}
+
+// ---------------------------------------------------------------------------
+// FecPacketHeader
+// ---------------------------------------------------------------------------
+
+TEST(FecPacketHeader, RoundTrip) {
+    cs::FecPacketHeader h{};
+    h.type            = static_cast<uint8_t>(cs::PacketType::FEC);
+    h.sequence_number = 0xFFFE;   // About to wrap
+    h.group_id        = 0xA5;
+    h.data_count      = 10;
+    h.parity_count    = 4;
+    h.parity_index    = 3;
+    h.frame_number    = 0x1234;
+    h.base_sequence   = 0xFFF0;
+    h.symbol_length   = 1200;
+
+    uint8_t wire[sizeof(cs::FecPacketHeader)];
+    ASSERT_EQ(h.serializeTo(wire), sizeof(wire));
+
+    // Offsets and byte order as documented
+    const uint8_t expected[] = {0xFC, 0xFF, 0xFE, 0xA5, 10, 4, 3,
+                                0x12, 0x34, 0xFF, 0xF0, 0x04, 0xB0};
+    ASSERT_EQ(sizeof(expected), sizeof(wire));
+    for (size_t i = 0; i < sizeof(wire); ++i) {
+        EXPECT_EQ(wire[i], expected[i]) << "byte " << i;
+    }
+
+    EXPECT_EQ(cs::identifyPacket(wire, sizeof(wire)), cs::PacketType::FEC);
+
+    cs::FecPacketHeader parsed{};
+    ASSERT_TRUE(cs::FecPacketHeader::deserialize(wire, sizeof(wire), parsed));
+    EXPECT_EQ(parsed.type, h.type);
+    EXPECT_EQ(parsed.sequence_number, h.sequence_number);
+    EXPECT_EQ(parsed.group_id, h.group_id);
+    EXPECT_EQ(parsed.data_count, h.data_count);
+    EXPECT_EQ(parsed.parity_count, h.parity_count);
+    EXPECT_EQ(parsed.parity_index, h.parity_index);
+    EXPECT_EQ(parsed.frame_number, h.frame_number);
+    EXPECT_EQ(parsed.base_sequence, h.base_sequence);
+    EXPECT_EQ(parsed.symbol_length, h.symbol_length);
+}
+
+TEST(FecPacketHeader, ShortBufferIsRejected) {
+    uint8_t wire[sizeof(cs::FecPacketHeader)] = {0xFC};
+    cs::FecPacketHeader parsed{};
+    EXPECT_FALSE(cs::FecPacketHeader::deserialize(wire, sizeof(wire) - 1, parsed));
+}
+
+} // namespace
@@ -0,0 +1,25 @@
+///////////////////////////////////////////////////////////////////////////////
+// sequence_test.cpp -- 16-bit sequence ordering across the wrap
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cs/transport/sequence.h>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+TEST(SeqNewer, Ordering) {
+    EXPECT_TRUE(cs::seqNewer(2, 1));
+    EXPECT_FALSE(cs::seqNewer(1, 2));
+    EXPECT_FALSE(cs::seqNewer(7, 7));
+}
+
+TEST(SeqNewer, AcrossTheWrap) {
+    EXPECT_TRUE(cs::seqNewer(0, 0xFFFF));
+    EXPECT_TRUE(cs::seqNewer(5, 0xFFF0));
+    EXPECT_FALSE(cs::seqNewer(0xFFFF, 0));
+    EXPECT_TRUE(cs::seqNewer(0x7FFF, 0));    // Furthest ahead still newer
+    EXPECT_FALSE(cs::seqNewer(0x8000, 0));   // Half the space away: older
+}
+
+} // namespace
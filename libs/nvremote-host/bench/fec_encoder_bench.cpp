@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// fec_encoder_bench.cpp -- FecEncoder at the group sizes a frame produces
+//
+// Arg(0) is the data packet count of one group, up to the encoder's cap of
+// 48; parity follows the default 20% redundancy.  The zero-copy overload
+// is what the send path uses; the vector overload is measured alongside it
+// to keep its allocations visible.  Bytes processed are data bytes per group.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "transport/fec.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+namespace {
+
+constexpr size_t PACKET_LEN = 1200;
+
+std::vector<std::vector<uint8_t>> makePackets(size_t count) {
+    std::vector<std::vector<uint8_t>> packets(count, std::vector<uint8_t>(PACKET_LEN));
+    uint32_t seed = 0xC0FFEEu;
+    for (auto& p : packets) {
+        for (auto& b : p) {
+            seed = seed * 1664525u + 1013904223u;
+            b = static_cast<uint8_t>(seed >> 24);
+        }
+    }
+    // The last fragment of a frame is usually short
+    packets.back().resize(PACKET_LEN / 3);
+    return packets;
+}
+
+void BM_FecEncodeZeroCopy(benchmark::State& state) {
+    const size_t k = static_cast<size_t>(state.range(0));
+    cs::host::FecEncoder encoder;
+    encoder.setGroupSize(static_cast<int>(k));
+    const size_t m = static_cast<size_t>(encoder.parityCountFor(static_cast<int>(k)));
+
+    auto packets = makePackets(k);
+    std::vector<const uint8_t*> data;
+    std::vector<size_t>         lengths;
+    for (const auto& p : packets) {
+        data.push_back(p.data());
+        lengths.push_back(p.size());
+    }
+    std::vector<std::vector<uint8_t>> parity(m, std::vector<uint8_t>(PACKET_LEN));
+    std::vector<uint8_t*> parity_ptrs;
+    for (auto& p : parity) parity_ptrs.push_back(p.data());
+
+    for (auto _ : state) {
+        bool ok = encoder.encode(data.data(), lengths.data(), k,
+                                 parity_ptrs.data(), m, PACKET_LEN);
+        benchmark::DoNotOptimize(ok);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * k * PACKET_LEN));
+    state.counters["parity"] = static_cast<double>(m);
+}
+BENCHMARK(BM_FecEncodeZeroCopy)->Arg(4)->Arg(8)->Arg(16)->Arg(32)->Arg(48);
+
+void BM_FecEncodeVector(benchmark::State& state) {
+    const size_t k = static_cast<size_t>(state.range(0));
+    cs::host::FecEncoder encoder;
+    encoder.setGroupSize(static_cast<int>(k));
+    auto packets = makePackets(k);
+
+    for (auto _ : state) {
+        auto parity = encoder.encode(packets);
+        benchmark::DoNotOptimize(parity.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * k * PACKET_LEN));
+}
+BENCHMARK(BM_FecEncodeVector)->Arg(4)->Arg(16)->Arg(48);
+
+} // namespace
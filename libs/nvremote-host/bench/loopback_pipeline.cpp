@@ -0,0 +1,494 @@
+///////////////////////////////////////////////////////////////////////////////
+// loopback_pipeline.cpp -- The whole media path over localhost, no GPU
+//
+// Synthetic capture and encoder feed a host ViewerLink (DTLS handshake,
+// path MTU probe, fragmentation, FEC, pacing, NACK cache, QoS feedback),
+// which streams over 127.0.0.1 to the viewer's own receive path:
+// UdpReceiver, FecDecoder, NackSender, StatsReporter and JitterBuffer,
+// wired as Viewer wires them.  A decode thread pops frames as the decoder
+// would and checks each payload.
+//
+// SessionManager is not used: its capture, audio and ICE setup are bound
+// to Windows APIs.  ViewerLink is the same per-viewer send path without
+// them.
+//
+// Reports packets per second, process CPU time per megabit delivered and the
+// capture-to-popFrame latency percentiles, on stdout and, with --out, as
+// a JSON object.  Options (--name=value):
+//   seconds, fps, width, height, bitrate_kbps, gop, keyframe_ratio,
+//   jitter, mode (a GamingMode name), out, impair (a network_impairment.h
+//   spec applied to the host's egress, e.g. impair=loss=1,delay=20),
+//   record (a file to record the viewer side's packets to, for
+//   nvremote-viewer/tools/packet_replay)
+///////////////////////////////////////////////////////////////////////////////
+
+#include "capture/synthetic_capture.h"
+#include "encode/synthetic_encoder.h"
+#include "ipc/simple_json.h"
+#include "session/viewer_link.h"
+
+#include "transport/fec_decoder.h"
+#include "transport/jitter_buffer.h"
+#include "transport/nack_sender.h"
+#include "transport/udp_receiver.h"
+#include "qos/stats_reporter.h"
+
+#include "cs/common.h"
+#include "cs/latency_histogram.h"
+#include "cs/qos/gaming_modes.h"
+#include "cs/transport/packet_recorder.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace cs;
+using namespace cs::host;
+
+namespace {
+
+// ---------------------------------------------------------------------------
+// Options
+// ---------------------------------------------------------------------------
+struct Options {
+    double      seconds        = 5.0;
+    uint32_t    fps            = 60;
+    uint32_t    width          = 1280;
+    uint32_t    height         = 720;
+    uint32_t    bitrate_kbps   = 20000;
+    uint32_t    gop            = 120;
+    float       keyframe_ratio = 8.0f;
+    float       jitter         = 0.25f;
+    std::string mode           = "Balanced";
+    std::string out;
+    std::string record;
+    ImpairmentConfig impair;
+};
+
+bool parseOptions(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const size_t eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            std::fprintf(stderr, "Unrecognized argument: %s\n", arg.c_str());
+            return false;
+        }
+        const std::string name  = arg.substr(2, eq - 2);
+        const std::string value = arg.substr(eq + 1);
+        const char* v = value.c_str();
+
+        if      (name == "seconds")        opt.seconds        = std::atof(v);
+        else if (name == "fps")            opt.fps            = static_cast<uint32_t>(std::atoi(v));
+        else if (name == "width")          opt.width          = static_cast<uint32_t>(std::atoi(v));
+        else if (name == "height")         opt.height         = static_cast<uint32_t>(std::atoi(v));
+        else if (name == "bitrate_kbps")   opt.bitrate_kbps   = static_cast<uint32_t>(std::atoi(v));
+        else if (name == "gop")            opt.gop            = static_cast<uint32_t>(std::atoi(v));
+        else if (name == "keyframe_ratio") opt.keyframe_ratio = static_cast<float>(std::atof(v));
+        else if (name == "jitter")         opt.jitter         = static_cast<float>(std::atof(v));
+        else if (name == "mode")           opt.mode           = value;
+        else if (name == "out")            opt.out            = value;
+        else if (name == "record")         opt.record         = value;
+        else if (name == "impair") {
+            std::string error;
+            if (!parseImpairmentSpec(value, opt.impair, &error)) {
+                std::fprintf(stderr, "Bad --impair spec: %s\n", error.c_str());
+                return false;
+            }
+        }
+        else {
+            std::fprintf(stderr, "Unknown option: --%s\n", name.c_str());
+            return false;
+        }
+    }
+    if (opt.seconds <= 0.0 || opt.fps == 0 || opt.bitrate_kbps == 0) {
+        std::fprintf(stderr, "seconds, fps and bitrate_kbps must be positive\n");
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Process CPU time (user + system), microseconds
+// ---------------------------------------------------------------------------
+uint64_t processCpuUs() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!::GetProcessTimes(::GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0;
+    auto us = [](const FILETIME& ft) {
+        return ((static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) / 10;
+    };
+    return us(kernel) + us(user);
+#else
+    struct rusage ru;
+    if (::getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+    auto us = [](const struct timeval& tv) {
+        return static_cast<uint64_t>(tv.tv_sec) * 1000000 + static_cast<uint64_t>(tv.tv_usec);
+    };
+    return us(ru.ru_utime) + us(ru.ru_stime);
+#endif
+}
+
+/// A UDP socket bound to 127.0.0.1 on an OS-chosen port, and that port.
+int bindLoopback(uint16_t& port) {
+    int fd = static_cast<int>(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+    if (fd < 0) return -1;
+
+    ::sockaddr_in addr = {};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (::bind(fd, reinterpret_cast<::sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::getsockname(fd, reinterpret_cast<::sockaddr*>(&addr), &len) < 0) {
+        cs_close_socket(fd);
+        return -1;
+    }
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+// ---------------------------------------------------------------------------
+// ViewerSide -- the viewer's receive path, wired as Viewer wires it
+// ---------------------------------------------------------------------------
+class ViewerSide {
+public:
+    ~ViewerSide() { stop(); }
+
+    /// Receive on |socket| (connected to the host at |host|), verifying
+    /// the host against |fingerprint|.
+    bool start(int socket, const ::sockaddr_in& host, const std::string& fingerprint,
+               PacketRecorder* recorder) {
+        socket_ = socket;
+        const auto* peer = reinterpret_cast<const ::sockaddr*>(&host);
+        const int peer_len = static_cast<int>(sizeof(host));
+
+        // Performance preset: frames go out as soon as they are complete
+        jitter_.setImmediateRelease(true);
+        jitter_.setDepthRangeMs(0, 10);
+
+        nack_.setJitterBuffer(&jitter_);
+        nack_.setRecorder(recorder);
+        nack_.initialize(socket_, const_cast<::sockaddr*>(peer), peer_len);
+        nack_.start();
+
+        fec_.setRecoveryCallback([this](const uint8_t* data, size_t len) {
+            VideoPacketHeaderV2 header;
+            size_t header_len = 0;
+            if (!parseVideoHeader(data, len, header, &header_len)) return;
+            if (len - header_len != header.payload_length) return;
+            deliver(header, data + header_len, len - header_len);
+        });
+
+        stats_.setRecorder(recorder);
+        stats_.initialize(socket_, peer, peer_len);
+        stats_.setNackSender(&nack_);
+        stats_.setFecDecoder(&fec_);
+        stats_.start();
+
+        if (!receiver_.initialize(socket_, fingerprint, 4 * 1024 * 1024)) return false;
+        receiver_.setRecorder(recorder);
+        receiver_.setArrivalCallback([this](const PacketArrival* arrivals, size_t count) {
+            stats_.onTransportArrivals(arrivals, count);
+        });
+
+        running_.store(true);
+        decode_thread_ = std::thread(&ViewerSide::decodeLoop, this);
+
+        return receiver_.start([this](PacketType type, const uint8_t* data, size_t len) {
+            switch (type) {
+                case PacketType::VIDEO:    onVideo(data, len); break;
+                case PacketType::FEC:      onFec(data, len); break;
+                case PacketType::RTT_PROBE: stats_.onRttProbe(data, len); break;
+                default: break;
+            }
+        });
+    }
+
+    void stop() {
+        running_.store(false);
+        jitter_.interrupt();
+        if (decode_thread_.joinable()) decode_thread_.join();
+        receiver_.stop();
+        stats_.stop();
+        nack_.stop();
+    }
+
+    /// Start counting afresh (after warm-up).
+    void resetCounters() {
+        latency_.reset();
+        frames_.store(0);
+        bytes_.store(0);
+        packets_base_ = receiver_.getPacketsReceived();
+    }
+
+    LatencyHistogram& latency() { return latency_; }
+    uint64_t frames() const { return frames_.load(); }
+    uint64_t frameBytes() const { return bytes_.load(); }
+    uint64_t corruptFrames() const { return corrupt_.load(); }
+    uint64_t packets() const { return receiver_.getPacketsReceived() - packets_base_; }
+    uint64_t nacksSent() const { return nack_.getNacksSent(); }
+    uint64_t fecRecovered() const { return fec_.getRecoveredCount(); }
+    uint64_t fecUnrecoverable() const { return fec_.getUnrecoverableCount(); }
+
+private:
+    void onVideo(const uint8_t* data, size_t len) {
+        VideoPacketHeaderV2 header;
+        size_t header_len = 0;
+        if (!parseVideoHeader(data, len, header, &header_len)) return;
+        if (len - header_len != header.payload_length) return;
+
+        stats_.onPacketReceived(header, getTimestampUs());
+        fec_.onVideoPacket(header.sequence_number, data, len);
+        deliver(header, data + header_len, len - header_len);
+    }
+
+    void onFec(const uint8_t* data, size_t len) {
+        FecPacketHeader fh;
+        if (!FecPacketHeader::deserialize(data, len, fh)) return;
+        stats_.onFecPacketReceived(fh.sequence_number, len, getTimestampUs());
+        nack_.onPacketReceived(fh.sequence_number);
+        fec_.onFecPacket(data, len);
+    }
+
+    void deliver(const VideoPacketHeaderV2& header, const uint8_t* payload, size_t len) {
+        nack_.onPacketReceived(header.sequence_number);
+        jitter_.pushPacket(header, payload, len);
+    }
+
+    /// Pop frames as the decode thread does; the decoder's place is taken
+    /// by the payload check.
+    void decodeLoop() {
+        JitterBuffer::FrameView frame;
+        VideoPacketHeaderV2 header;
+        while (running_.load()) {
+            jitter_.waitForFrame(20);
+            while (jitter_.popFrame(frame, header)) {
+                // Header timestamps are the capture clock's low 32 bits;
+                // both ends share the clock here.
+                const uint32_t now = static_cast<uint32_t>(getTimestampUs() & 0xFFFFFFFF);
+                latency_.record(static_cast<uint32_t>(now - header.timestamp_us));
+
+                if (!SyntheticEncoder::checkPayload(frame.data, frame.size)) {
+                    corrupt_.fetch_add(1);
+                }
+                frames_.fetch_add(1);
+                bytes_.fetch_add(frame.size);
+
+                uint32_t first = 0;
+                uint32_t last  = 0;
+                if (jitter_.takeLostFrames(first, last)) {
+                    nack_.reportFrameLoss(first, last);
+                }
+            }
+        }
+    }
+
+    int                   socket_ = -1;
+    JitterBuffer          jitter_;
+    NackSender            nack_;
+    FecDecoder            fec_;
+    StatsReporter         stats_;
+    UdpReceiver           receiver_;
+    LatencyHistogram      latency_;
+    std::atomic<bool>     running_{false};
+    std::atomic<uint64_t> frames_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> corrupt_{0};
+    uint64_t              packets_base_ = 0;
+    std::thread           decode_thread_;
+};
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// main
+// ---------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) return 2;
+
+    WinsockGuard winsock;
+    globalLogLevel() = LogLevel::WARN;
+
+    // --- Sockets: the viewer's, and a free port for the host to bind ---
+    uint16_t viewer_port = 0;
+    uint16_t host_port   = 0;
+    int viewer_fd = bindLoopback(viewer_port);
+    int probe_fd  = bindLoopback(host_port);
+    if (viewer_fd < 0 || probe_fd < 0) {
+        std::fprintf(stderr, "Failed to bind loopback sockets\n");
+        return 1;
+    }
+    cs_close_socket(probe_fd);
+
+    ::sockaddr_in host_addr = {};
+    host_addr.sin_family      = AF_INET;
+    host_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    host_addr.sin_port        = htons(host_port);
+    if (::connect(viewer_fd, reinterpret_cast<::sockaddr*>(&host_addr), sizeof(host_addr)) < 0) {
+        std::fprintf(stderr, "Failed to connect the viewer socket\n");
+        return 1;
+    }
+
+    // --- Host: synthetic capture and encoder ---
+    EncoderConfig base;
+    base.width        = opt.width;
+    base.height       = opt.height;
+    base.bitrate_kbps = opt.bitrate_kbps;
+    base.fps          = opt.fps;
+    base.gop_length   = opt.gop;
+
+    SyntheticFrameSizes sizes;
+    sizes.keyframe_ratio = opt.keyframe_ratio;
+    sizes.jitter         = opt.jitter;
+
+    SyntheticCapture capture(opt.width, opt.height, opt.fps);
+    SyntheticEncoder encoder(sizes);
+    if (!capture.initialize() || !encoder.initialize(base)) {
+        std::fprintf(stderr, "Failed to initialize synthetic capture / encoder\n");
+        return 1;
+    }
+
+    ViewerLink link("loopback", nullptr);
+    std::atomic<bool> idr_requested{false};
+    link.setKeyframeCallback([&idr_requested]() { idr_requested.store(true); });
+    link.setImpairment(opt.impair);
+
+    // --- Viewer: its handshake runs on the receive thread, while the
+    // host's runs in ViewerLink::start() ---
+    PacketRecorder recorder;
+    if (!opt.record.empty() && !recorder.open(opt.record, RecordingRole::VIEWER)) {
+        std::fprintf(stderr, "Cannot record to %s\n", opt.record.c_str());
+        return 1;
+    }
+
+    ViewerSide viewer;
+    if (!viewer.start(viewer_fd, host_addr, link.getFingerprint(),
+                      opt.record.empty() ? nullptr : &recorder)) {
+        std::fprintf(stderr, "Failed to start the viewer side\n");
+        return 1;
+    }
+
+    QosPreset preset = getPreset(gamingModeFromString(opt.mode));
+    PeerInfo peer;
+    peer.ip         = "127.0.0.1";
+    peer.port       = viewer_port;
+    peer.local_port = host_port;
+    if (!link.start(peer, preset, base, cs::CodecType::H264)) {
+        std::fprintf(stderr, "Failed to connect the host to the viewer\n");
+        return 1;
+    }
+
+    // --- Stream: one warm-up second, then the measured run ---
+    auto stream = [&](double seconds) {
+        const auto end = std::chrono::steady_clock::now() +
+                         std::chrono::microseconds(static_cast<int64_t>(seconds * 1e6));
+        CapturedFrame frame;
+        EncodedPacket packet;
+        while (std::chrono::steady_clock::now() < end) {
+            if (!capture.captureFrame(frame)) break;
+            if (idr_requested.exchange(false)) encoder.forceIdr();
+            if (!encoder.encode(frame, packet)) break;
+
+            LinkFrame lf;
+            lf.data         = packet.bytes();
+            lf.size         = packet.size();
+            lf.timestamp_us = packet.timestamp_us;
+            lf.keyframe     = packet.is_keyframe;
+            lf.ltr          = packet.is_ltr;
+            lf.layer        = packet.temporal_layer;
+            link.sendFrame(lf);
+        }
+    };
+
+    stream(1.0);
+    viewer.resetCounters();
+    const ViewerLink::Stats sent_before = link.getStats();
+    const uint64_t cpu_before  = processCpuUs();
+    const uint64_t wall_before = getTimestampUs();
+
+    stream(opt.seconds);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));   // Let the tail arrive
+
+    const uint64_t wall_us = getTimestampUs() - wall_before;
+    const uint64_t cpu_us  = processCpuUs() - cpu_before;
+    const ViewerLink::Stats sent = link.getStats();
+
+    // --- Report ---
+    const double secs        = static_cast<double>(wall_us) / 1e6;
+    const double mbps        = static_cast<double>(viewer.frameBytes()) * 8.0 / secs / 1e6;
+    const double pps         = static_cast<double>(viewer.packets()) / secs;
+    const double cpu_cores   = static_cast<double>(cpu_us) / static_cast<double>(wall_us);
+    const double mbits       = static_cast<double>(viewer.frameBytes()) * 8.0 / 1e6;
+    const double cpu_ms_per_mbit = mbits > 0.0 ? static_cast<double>(cpu_us) / 1e3 / mbits : 0.0;
+    const uint64_t frames_sent = sent.frames_sent - sent_before.frames_sent;
+
+    LatencyHistogram& latency = viewer.latency();
+    const float p50 = latency.percentileMs(0.50f);
+    const float p95 = latency.percentileMs(0.95f);
+    const float p99 = latency.percentileMs(0.99f);
+
+    std::printf("loopback pipeline: %u kbps @ %u fps, %s preset, %.1f s\n",
+                opt.bitrate_kbps, opt.fps, opt.mode.c_str(), secs);
+    if (opt.impair.enabled()) {
+        std::printf("  impair    %s\n", describeImpairment(opt.impair).c_str());
+    }
+    std::printf("  frames    %llu sent, %llu received, %llu corrupt, %llu keyframe requests\n",
+                static_cast<unsigned long long>(frames_sent),
+                static_cast<unsigned long long>(viewer.frames()),
+                static_cast<unsigned long long>(viewer.corruptFrames()),
+                static_cast<unsigned long long>(sent.keyframe_requests));
+    std::printf("  packets   %.0f /s, %.2f Mbps delivered\n", pps, mbps);
+    std::printf("  repair    %llu NACKs, %llu FEC recovered, %llu unrecoverable\n",
+                static_cast<unsigned long long>(viewer.nacksSent()),
+                static_cast<unsigned long long>(viewer.fecRecovered()),
+                static_cast<unsigned long long>(viewer.fecUnrecoverable()));
+    std::printf("  cpu       %.1f%% of a core, %.2f ms per Mbit\n", cpu_cores * 100.0, cpu_ms_per_mbit);
+    std::printf("  latency   p50 %.2f ms, p95 %.2f ms, p99 %.2f ms\n", p50, p95, p99);
+
+    if (!opt.out.empty()) {
+        JsonObjectWriter json;
+        json.addUint("bitrate_kbps", opt.bitrate_kbps);
+        json.addUint("fps", opt.fps);
+        json.addString("mode", opt.mode);
+        json.addString("impairment", describeImpairment(opt.impair));
+        json.addFloat("seconds", secs);
+        json.addUint("frames_sent", frames_sent);
+        json.addUint("frames_received", viewer.frames());
+        json.addUint("frames_corrupt", viewer.corruptFrames());
+        json.addUint("keyframe_requests", sent.keyframe_requests);
+        json.addFloat("packets_per_sec", pps);
+        json.addFloat("delivered_mbps", mbps);
+        json.addUint("nacks_sent", viewer.nacksSent());
+        json.addUint("fec_recovered", viewer.fecRecovered());
+        json.addFloat("cpu_core_pct", cpu_cores * 100.0);
+        json.addFloat("cpu_ms_per_mbit", cpu_ms_per_mbit);
+        json.addFloat("latency_p50_ms", p50);
+        json.addFloat("latency_p95_ms", p95);
+        json.addFloat("latency_p99_ms", p99);
+
+        FILE* f = std::fopen(opt.out.c_str(), "w");
+        if (!f) {
+            std::fprintf(stderr, "Cannot write %s\n", opt.out.c_str());
+        } else {
+            std::fprintf(f, "%s\n", json.finish().c_str());
+            std::fclose(f);
+        }
+    }
+
+    link.stop();
+    viewer.stop();
+    cs_close_socket(viewer_fd);
+
+    // A run that delivered nothing, or damaged a frame, fails
+    return viewer.corruptFrames() == 0 && viewer.frames() > 0 ? 0 : 1;
+}
@@ -0,0 +1,1172 @@
+///////////////////////////////////////////////////////////////////////////////
+// qos_simulator.cpp -- QosController against a simulated link, offline
+//
+// Runs the host's rate control against a simulated network instead of a
+// socket, so a controller change can be checked against a corpus of traces
+// before it ships.  The controller is the real one: QosController with its
+// BandwidthEstimator (Kalman filter, overuse detector), loss model and FEC
+// planning.  Frames come from the SyntheticEncoder at whatever bitrate,
+// frame rate and resolution the controller picks, are cut into datagrams
+// and FEC groups as ViewerLink cuts them, and travel
+//
+//   pacer model -> network impairment -> trace bottleneck -> receiver model
+//
+// The receiver model sends the feedback StatsReporter sends (transport-wide
+// feedback every 50 ms, QoS feedback every 200 ms), which reaches the
+// controller after the spec's one-way delay.  Nothing is encrypted or put
+// on a socket.
+//
+// Time is simulated: the loop steps a virtual clock STEP_US at a time and
+// moves the process clock (cs::timestampOffsetUs()) along, so the
+// controller's own getTimestampUs() reads agree with the simulation and a
+// minute of streaming takes a fraction of a second.
+//
+// The link:
+//   - trace: a Mahimahi trace, one line per delivery opportunity giving its
+//     time in milliseconds.  An opportunity carries up to 1504 bytes (part
+//     of a larger packet carries over), an unused one is lost, and the trace
+//     repeats after its last line.  Packets wait for it in a tail-drop queue
+//     of the spec's queue= packets.
+//   - impair: a network_impairment.h spec applied ahead of the trace, or on
+//     its own: loss, delay, jitter, reordering, rate and rate steps.  Its
+//     delay= is also the feedback path's delay.
+// The controller's bandwidth probes are padding packets the pacer model
+// releases at the probe rate, on top of the video; they cross the link and
+// are reported like any packet, and count as sent bytes.
+//
+// Lost packets are not retransmitted (NACK repair is the loopback
+// pipeline's to measure): a frame FEC cannot complete is lost, and brings
+// a keyframe request as the viewer's frame loss report does.  The picture
+// is frozen from then until a keyframe completes.
+//
+// Reports, per GamingMode and trace: achieved bitrate, one-way and queueing
+// delay, losses, frame latency and freezes, and the controller's quality
+// switches, on stdout and, with --out, as a JSON array.  Options
+// (--name=value):
+//   seconds, modes (comma-separated GamingMode names; default all), trace
+//   (comma-separated Mahimahi trace files), impair, gop, layers (temporal
+//   layers, 1-3), keyframe_ratio, jitter, probing (0 = no bandwidth probes),
+//   verbose (1 = controller log), out
+///////////////////////////////////////////////////////////////////////////////
+
+#include "encode/synthetic_encoder.h"
+#include "ipc/simple_json.h"
+#include "qos/qos_controller.h"
+#include "session/viewer_link.h"
+#include "transport/fec.h"
+
+#include "cs/common.h"
+#include "cs/qos/gaming_modes.h"
+#include "cs/qos/transport_feedback.h"
+#include "cs/transport/network_impairment.h"
+#include "cs/transport/packet.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace cs;
+using namespace cs::host;
+
+namespace {
+
+constexpr uint64_t STEP_US                    = 250;       // Pacer timer granularity
+constexpr size_t   MAHIMAHI_OPPORTUNITY_BYTES = 1504;      // Mahimahi's PACKET_SIZE
+constexpr uint64_t TRANSPORT_FEEDBACK_US      = 50'000;    // As StatsReporter
+constexpr uint64_t QOS_FEEDBACK_US            = 200'000;
+constexpr uint64_t MIN_LOSS_REPORT_US         = 20'000;    // As NackSender
+
+// ---------------------------------------------------------------------------
+// Options
+// ---------------------------------------------------------------------------
+struct Options {
+    double                   seconds        = 60.0;
+    std::vector<GamingMode>  modes;
+    std::vector<std::string> traces;
+    ImpairmentConfig         impair;
+    uint32_t                 gop            = 120;
+    uint32_t                 layers         = 1;
+    float                    keyframe_ratio = 8.0f;
+    float                    jitter         = 0.25f;
+    bool                     probing        = true;
+    bool                     verbose        = false;
+    std::string              out;
+};
+
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= list.size()) {
+        const size_t comma = std::min(list.find(',', start), list.size());
+        if (comma > start) items.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return items;
+}
+
+bool parseOptions(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const size_t eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            std::fprintf(stderr, "Unrecognized argument: %s\n", arg.c_str());
+            return false;
+        }
+        const std::string name  = arg.substr(2, eq - 2);
+        const std::string value = arg.substr(eq + 1);
+        const char* v = value.c_str();
+
+        if      (name == "seconds")        opt.seconds        = std::atof(v);
+        else if (name == "gop")            opt.gop            = static_cast<uint32_t>(std::atoi(v));
+        else if (name == "layers")         opt.layers         = static_cast<uint32_t>(std::atoi(v));
+        else if (name == "keyframe_ratio") opt.keyframe_ratio = static_cast<float>(std::atof(v));
+        else if (name == "jitter")         opt.jitter         = static_cast<float>(std::atof(v));
+        else if (name == "probing")        opt.probing        = std::atoi(v) != 0;
+        else if (name == "verbose")        opt.verbose        = std::atoi(v) != 0;
+        else if (name == "out")            opt.out            = value;
+        else if (name == "trace")          opt.traces         = splitList(value);
+        else if (name == "modes") {
+            for (const std::string& mode : splitList(value)) {
+                // gamingModeFromString() falls back to Balanced
+                GamingMode m = gamingModeFromString(mode);
+                if (m == GamingMode::Balanced && mode != "Balanced" && mode != "balanced") {
+                    std::fprintf(stderr, "Unknown mode: %s\n", mode.c_str());
+                    return false;
+                }
+                opt.modes.push_back(m);
+            }
+        }
+        else if (name == "impair") {
+            std::string error;
+            if (!parseImpairmentSpec(value, opt.impair, &error)) {
+                std::fprintf(stderr, "Bad --impair spec: %s\n", error.c_str());
+                return false;
+            }
+        }
+        else {
+            std::fprintf(stderr, "Unknown option: --%s\n", name.c_str());
+            return false;
+        }
+    }
+    if (opt.seconds <= 0.0 || opt.layers < 1 || opt.layers > 3) {
+        std::fprintf(stderr, "seconds must be positive and layers 1-3\n");
+        return false;
+    }
+    if (opt.modes.empty()) {
+        for (uint8_t m = 0; m <= static_cast<uint8_t>(GamingMode::LAN); ++m) {
+            opt.modes.push_back(static_cast<GamingMode>(m));
+        }
+    }
+    return true;
+}
+
+/// Move the process clock forward to |t_us|: QosController reads
+/// getTimestampUs() itself, and the simulation runs ahead of the wall clock.
+void advanceClockTo(uint64_t t_us) {
+    const uint64_t now = getTimestampUs();
+    if (t_us > now) timestampOffsetUs().fetch_add(t_us - now, std::memory_order_relaxed);
+}
+
+/// The |p|-th percentile (0..1) of |samples| (microseconds), in milliseconds.
+float percentileMs(std::vector<uint64_t>& samples, double p) {
+    if (samples.empty()) return 0.0f;
+    const size_t rank = static_cast<size_t>(p * static_cast<double>(samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return static_cast<float>(samples[rank]) / 1000.0f;
+}
+
+// ---------------------------------------------------------------------------
+// Trace -- a Mahimahi delivery-opportunity trace
+// ---------------------------------------------------------------------------
+struct Trace {
+    std::string           name;                // File name, for the report
+    std::vector<uint32_t> opportunities_ms;    // Ascending
+    uint32_t              period_ms = 0;       // The trace repeats after this
+};
+
+bool loadTrace(const std::string& path, Trace& trace) {
+    std::ifstream in(path);
+    if (!in) {
+        std::fprintf(stderr, "Cannot read trace %s\n", path.c_str());
+        return false;
+    }
+    const size_t slash = path.find_last_of("/\\");
+    trace.name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        char* end = nullptr;
+        const unsigned long ms = std::strtoul(line.c_str(), &end, 10);
+        if (end == line.c_str() ||
+            (!trace.opportunities_ms.empty() && ms < trace.opportunities_ms.back())) {
+            std::fprintf(stderr, "Trace %s: bad line '%s'\n", path.c_str(), line.c_str());
+            return false;
+        }
+        trace.opportunities_ms.push_back(static_cast<uint32_t>(ms));
+    }
+    if (trace.opportunities_ms.empty() || trace.opportunities_ms.back() == 0) {
+        std::fprintf(stderr, "Trace %s: no delivery opportunities\n", path.c_str());
+        return false;
+    }
+    trace.period_ms = trace.opportunities_ms.back();
+    return true;
+}
+
+/// A packet leaving the simulated network.
+struct Arrival {
+    uint32_t id         = 0;
+    uint64_t arrival_us = 0;
+};
+
+// ---------------------------------------------------------------------------
+// TraceLink -- the bottleneck a trace describes, with a tail-drop queue
+// ---------------------------------------------------------------------------
+class TraceLink {
+public:
+    TraceLink(const Trace& trace, size_t queue_packets, uint64_t start_us)
+        : trace_(trace), queue_limit_(queue_packets), start_us_(start_us) {}
+
+    /// Queue datagram |id| of |bytes|.  Returns false if the queue is full.
+    bool enqueue(uint32_t id, size_t bytes) {
+        if (queue_.size() >= queue_limit_) return false;
+        queue_.push_back({id, bytes, 0});
+        return true;
+    }
+
+    /// Spend the opportunities up to |now_us| and append what they deliver.
+    void advance(uint64_t now_us, std::vector<Arrival>& out) {
+        for (uint64_t at = opportunityUs(next_); at <= now_us; at = opportunityUs(++next_)) {
+            offered_bytes_ += MAHIMAHI_OPPORTUNITY_BYTES;
+            size_t credit = MAHIMAHI_OPPORTUNITY_BYTES;
+            while (!queue_.empty() && credit > 0) {
+                Queued& head = queue_.front();
+                const size_t take = std::min(credit, head.bytes - head.sent);
+                head.sent += take;
+                credit    -= take;
+                if (head.sent < head.bytes) break;
+                out.push_back({head.id, at});
+                queue_.pop_front();
+            }
+        }
+    }
+
+    /// Bytes the opportunities so far could have carried.
+    uint64_t offeredBytes() const { return offered_bytes_; }
+
+private:
+    struct Queued {
+        uint32_t id    = 0;
+        size_t   bytes = 0;
+        size_t   sent  = 0;   // Carried by earlier opportunities
+    };
+
+    uint64_t opportunityUs(uint64_t n) const {
+        const size_t   count = trace_.opportunities_ms.size();
+        const uint64_t round = n / count;
+        return start_us_ + (round * trace_.period_ms + trace_.opportunities_ms[n % count]) * 1000;
+    }
+
+    const Trace&       trace_;
+    const size_t       queue_limit_;
+    const uint64_t     start_us_;
+    std::deque<Queued> queue_;
+    uint64_t           next_          = 0;   // Next opportunity to spend
+    uint64_t           offered_bytes_ = 0;
+};
+
+// ---------------------------------------------------------------------------
+// PacerModel -- the Pacer's VIDEO lane and probes on the simulated clock
+// ---------------------------------------------------------------------------
+class PacerModel {
+public:
+    /// As Pacer::setRate(); a rate of 0 is unlimited.
+    void setRate(uint32_t rate_kbps, size_t burst_bytes, uint64_t now_us) {
+        refill(now_us);
+        bytes_per_us_ = static_cast<double>(rate_kbps) / 8000.0;
+        burst_bytes_  = static_cast<double>(burst_bytes);
+        tokens_       = std::min(tokens_, burst_bytes_);
+    }
+
+    void enqueue(uint32_t id, size_t bytes) {
+        queue_.push_back({id, bytes});
+        queued_bytes_ += bytes;
+    }
+
+    /// As Pacer::enqueueProbe(): released at |rate_kbps|, outside the bucket.
+    void enqueueProbe(uint32_t id, size_t bytes, uint32_t rate_kbps, uint64_t now_us) {
+        if (probes_.empty()) probe_next_us_ = now_us;
+        probes_.push_back({id, bytes, static_cast<double>(rate_kbps) / 8000.0});
+    }
+
+    /// Take the next packet the probe clock or the token bucket lets out
+    /// at |now_us|.
+    bool release(uint64_t now_us, uint32_t& id) {
+        if (!probes_.empty() && probe_next_us_ <= now_us) {
+            const Probe head = probes_.front();
+            probes_.pop_front();
+            probe_next_us_ += static_cast<uint64_t>(static_cast<double>(head.bytes) /
+                                                    head.bytes_per_us);
+            id = head.id;
+            return true;
+        }
+        if (queue_.empty()) return false;
+        refill(now_us);
+        if (bytes_per_us_ > 0.0 && tokens_ <= 0.0) return false;
+
+        const Queued head = queue_.front();
+        queue_.pop_front();
+        queued_bytes_ -= head.bytes;
+        if (bytes_per_us_ > 0.0) tokens_ -= static_cast<double>(head.bytes);
+        id = head.id;
+        return true;
+    }
+
+    size_t queuedBytes() const { return queued_bytes_; }
+
+private:
+    struct Queued {
+        uint32_t id    = 0;
+        size_t   bytes = 0;
+    };
+
+    void refill(uint64_t now_us) {
+        if (now_us > last_refill_us_ && bytes_per_us_ > 0.0) {
+            tokens_ = std::min(burst_bytes_, tokens_ +
+                               static_cast<double>(now_us - last_refill_us_) * bytes_per_us_);
+        }
+        last_refill_us_ = now_us;
+    }
+
+    struct Probe {
+        uint32_t id           = 0;
+        size_t   bytes        = 0;
+        double   bytes_per_us = 0.0;
+    };
+
+    std::deque<Queued> queue_;
+    std::deque<Probe>  probes_;
+    uint64_t           probe_next_us_  = 0;
+    size_t             queued_bytes_   = 0;
+    double             tokens_         = 0.0;
+    double             bytes_per_us_   = 0.0;
+    double             burst_bytes_    = 0.0;
+    uint64_t           last_refill_us_ = 0;
+};
+
+// ---------------------------------------------------------------------------
+// RunResult -- one mode over one link
+// ---------------------------------------------------------------------------
+struct RunResult {
+    std::string mode;
+    std::string trace;
+    double   capacity_kbps        = 0.0;   // Trace links only
+    double   sent_kbps            = 0.0;
+    double   goodput_kbps         = 0.0;   // Completed frames
+    double   mean_target_kbps     = 0.0;
+    double   fec_overhead_pct     = 0.0;
+    double   probe_overhead_pct   = 0.0;
+    double   ramp_ms              = 0.0;   // Until the target first reached 90% of its peak
+    float    owd_p50_ms = 0, owd_p95_ms = 0, owd_p99_ms = 0;
+    float    queue_p50_ms = 0, queue_p95_ms = 0, queue_p99_ms = 0;
+    float    frame_p50_ms = 0, frame_p95_ms = 0, frame_p99_ms = 0;
+    uint64_t packets_sent         = 0;
+    uint64_t packets_lost         = 0;     // Impairment loss and queue drops
+    uint64_t frames_encoded       = 0;
+    uint64_t frames_complete      = 0;
+    uint64_t frames_fec_recovered = 0;
+    uint64_t frames_lost          = 0;
+    uint64_t frames_shed          = 0;     // Temporal layers over the limit
+    uint64_t frames_skipped       = 0;     // Frame budget exhausted
+    uint64_t keyframes            = 0;
+    uint64_t keyframe_requests    = 0;
+    double   freeze_ms            = 0.0;
+    uint32_t resolution_switches  = 0;
+    uint32_t fps_switches         = 0;
+    uint32_t bitrate_cuts         = 0;
+    uint32_t min_height           = 0;
+    uint32_t min_fps              = 0;
+    uint32_t final_bitrate_kbps   = 0;
+    uint32_t probe_clusters       = 0;
+};
+
+// ---------------------------------------------------------------------------
+// Simulation -- one controller, encoder and link, stepped to the end
+// ---------------------------------------------------------------------------
+class Simulation {
+public:
+    Simulation(const Options& opt, GamingMode mode, const Trace* trace)
+        : opt_(opt)
+        , preset_(getPreset(mode))
+        , trace_(trace)
+        , encoder_(frameSizes(opt))
+        , qos_(&encoder_, nullptr, &fec_)
+    {
+        result_.mode  = gamingModeToString(mode);
+        result_.trace = trace ? trace->name : "";
+    }
+
+    // Non-copyable
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    bool run(RunResult& out) {
+        const uint64_t start_us = getTimestampUs();
+        const uint64_t end_us   = start_us + static_cast<uint64_t>(opt_.seconds * 1e6);
+        if (!setUp(start_us)) return false;
+
+        for (uint64_t now = start_us; now < end_us; now += STEP_US) {
+            advanceClockTo(now);
+            deliverFeedback(now);
+            if (now >= next_frame_us_) produceFrame(now);
+            sendPaced(now);
+            carry(now);
+            sendFeedback(now);
+        }
+        finish(start_us, end_us);
+        out = result_;
+        return true;
+    }
+
+private:
+    /// Feedback on its way back to the host.
+    struct Feedback {
+        enum Kind : uint8_t { TRANSPORT, QOS, KEYFRAME };
+        Kind                    kind   = TRANSPORT;
+        uint64_t                due_us = 0;
+        TransportFeedback       transport;
+        host::QosFeedbackPacket qos;   // Not the wire struct of the same name
+        uint32_t                lost_frame = 0;   // KEYFRAME: newest frame lost
+    };
+
+    struct SimPacket {
+        uint32_t group      = 0;
+        size_t   bytes      = 0;
+        bool     parity     = false;
+        bool     padding    = false;   // A bandwidth probe
+        bool     received   = false;
+        uint64_t send_us    = 0;
+        uint64_t arrival_us = 0;
+    };
+
+    struct SimGroup {
+        uint32_t frame         = 0;
+        uint32_t data          = 0;   // Any |data| of the group's packets rebuild it
+        uint32_t received      = 0;
+        uint32_t data_received = 0;
+        bool     done          = false;
+    };
+
+    struct SimFrame {
+        uint64_t capture_us   = 0;
+        size_t   bytes        = 0;
+        bool     keyframe     = false;
+        uint32_t group_count  = 0;
+        uint32_t groups_done  = 0;
+        bool     recovered    = false;   // Completed with FEC's help
+        bool     complete     = false;
+        bool     lost         = false;
+    };
+
+    static SyntheticFrameSizes frameSizes(const Options& opt) {
+        SyntheticFrameSizes sizes;
+        sizes.keyframe_ratio = opt.keyframe_ratio;
+        sizes.jitter         = opt.jitter;
+        return sizes;
+    }
+
+    // -----------------------------------------------------------------------
+    // Set-up, as ViewerLink::start() wires a viewer's controller
+    // -----------------------------------------------------------------------
+    bool setUp(uint64_t start_us) {
+        EncoderConfig base;
+        base.width            = preset_.target_resolution.width;
+        base.height           = preset_.target_resolution.height;
+        base.fps              = preset_.target_fps;
+        base.bitrate_kbps     = preset_.target_bitrate_kbps;
+        base.max_bitrate_kbps = preset_.max_bitrate_kbps;
+        base.min_bitrate_kbps = preset_.min_bitrate_kbps;
+        base.gop_length       = opt_.gop;
+        base.temporal_layers  = opt_.layers;
+        if (!encoder_.initialize(base)) return false;
+        encoder_.forceIdr();
+
+        fec_.setGroupSize(static_cast<int>(fecGroupFor(DEFAULT_FRAGMENT_PAYLOAD)));
+        fec_.setRedundancyRatio(preset_.min_fec_ratio);
+
+        qos_.applyPreset(preset_);
+        qos_.setBaseConfig(base);
+        qos_.setPacingProfile(preset_.pacing_factor, preset_.pacing_burst_ms);
+        // Both clocks are the simulation's: one-way delay is known exactly.
+        qos_.getBandwidthEstimator().setClockOffsetUs(0);
+
+        qos_.setResolutionChangeCallback([this](uint32_t, uint32_t height) {
+            result_.resolution_switches++;
+            result_.min_height = std::min(result_.min_height, height);
+        });
+        qos_.setBitrateCallback([this](uint32_t kbps) {
+            if (kbps < bitrate_kbps_) result_.bitrate_cuts++;
+            if (kbps != bitrate_kbps_) targets_.emplace_back(cs::getTimestampUs(), kbps);
+            bitrate_kbps_ = kbps;
+            updatePacing(cs::getTimestampUs());
+        });
+        qos_.setProbingEnabled(opt_.probing);
+        qos_.setProbeSender([this](uint32_t rate_kbps, size_t bytes,
+                                   std::vector<uint16_t>& seqs) {
+            sendProbeCluster(rate_kbps, bytes, seqs);
+            return true;
+        });
+
+        const QosStats stats = qos_.getStats();
+        bitrate_kbps_       = stats.bitrate_kbps;
+        targets_.emplace_back(start_us, bitrate_kbps_);
+        fps_                = stats.fps;
+        result_.min_height  = stats.height;
+        result_.min_fps     = stats.fps;
+        updatePacing(start_us);
+
+        if (opt_.impair.enabled()) {
+            impairment_ = std::make_unique<NetworkImpairment>(opt_.impair);
+        }
+        if (trace_) {
+            link_ = std::make_unique<TraceLink>(*trace_, opt_.impair.queue_packets, start_us);
+        }
+        return_delay_us_ = static_cast<uint64_t>(opt_.impair.delay_ms) * 1000;
+        scratch_.resize(MAX_MTU_SIZE);
+
+        next_frame_us_ = start_us;
+        next_twcc_us_  = start_us + TRANSPORT_FEEDBACK_US;
+        next_qos_us_   = start_us + QOS_FEEDBACK_US;
+        return true;
+    }
+
+    /// Pace at bitrate x the preset's factor, as QosController::updatePacing().
+    void updatePacing(uint64_t now_us) {
+        if (preset_.pacing_factor <= 0.0f) {
+            pacer_.setRate(0, 0, now_us);
+            return;
+        }
+        const uint32_t rate_kbps = static_cast<uint32_t>(
+            static_cast<float>(bitrate_kbps_) * preset_.pacing_factor);
+        const size_t burst = std::max(static_cast<size_t>(rate_kbps) * preset_.pacing_burst_ms / 8,
+                                      2 * MAX_MTU_SIZE);
+        pacer_.setRate(rate_kbps, burst, now_us);
+    }
+
+    // -----------------------------------------------------------------------
+    // Host: encode, packetize, pace
+    // -----------------------------------------------------------------------
+    void produceFrame(uint64_t now) {
+        const QosStats stats = qos_.getStats();
+        if (stats.fps != fps_) {
+            result_.fps_switches++;
+            fps_ = stats.fps;
+            result_.min_fps = std::min(result_.min_fps, fps_);
+        }
+        next_frame_us_ += 1'000'000 / std::max(fps_, 1u);
+        target_kbps_sum_ += stats.bitrate_kbps;
+        target_samples_++;
+
+        if (keyframe_requested_) {
+            encoder_.forceIdr();
+            keyframe_requested_ = false;
+        }
+
+        // As SessionManager: no frame while the pacer's queue is over the bound
+        const size_t queued = pacer_.queuedBytes();
+        const size_t budget = qos_.getFrameBudgetBytes(false, queued);
+        if (budget == 0) {
+            result_.frames_skipped++;
+            return;
+        }
+        encoder_.setFrameBudget(budget, qos_.getFrameBudgetBytes(true, queued));
+
+        CapturedFrame frame;
+        frame.width        = stats.width;
+        frame.height       = stats.height;
+        frame.timestamp_us = now;
+        EncodedPacket packet;
+        if (!encoder_.encode(frame, packet)) return;
+        result_.frames_encoded++;
+        if (packet.is_keyframe) result_.keyframes++;
+
+        if (packet.temporal_layer > qos_.getMaxTemporalLayer()) {
+            result_.frames_shed++;
+            return;
+        }
+        const int fec_layer = encoder_.getTemporalLayers() > 1 ? packet.temporal_layer : -1;
+        packetize(packet.size(), packet.is_keyframe, fec_layer, now);
+    }
+
+    /// Fragments and FEC groups as ViewerLink::sendFragments() cuts them.
+    void packetize(size_t size, bool keyframe, int fec_layer, uint64_t now) {
+        const uint32_t frame_index = static_cast<uint32_t>(frames_.size());
+        SimFrame frame;
+        frame.capture_us = now;
+        frame.bytes      = size;
+        frame.keyframe   = keyframe;
+
+        const size_t frag_payload = DEFAULT_FRAGMENT_PAYLOAD;
+        const size_t frag_total   = std::max<size_t>(1, (size + frag_payload - 1) / frag_payload);
+
+        for (size_t batch_first = 0; batch_first < frag_total;
+             batch_first += MAX_BATCH_FRAGMENTS) {
+            const size_t batch_end  = std::min(frag_total, batch_first + MAX_BATCH_FRAGMENTS);
+            const size_t data_total = batch_end - batch_first;
+
+            std::vector<size_t> lens;
+            for (size_t frag = batch_first; frag < batch_end; ++frag) {
+                const size_t chunk = std::min(frag_payload, size - frag * frag_payload);
+                lens.push_back(sizeof(VideoPacketHeaderV2) + chunk);
+            }
+
+            size_t max_group = data_total;
+            FecPlan plan;
+            bool planned = false;
+            if (data_total > 1) {
+                max_group = static_cast<size_t>(fec_.getGroupSize());
+                planned = qos_.planFec(data_total, keyframe, fec_layer, max_group, plan);
+                if (planned) max_group = plan.group_size;
+            }
+            const size_t num_groups = (data_total + max_group - 1) / max_group;
+            const size_t base_size  = data_total / num_groups;
+            const size_t remainder  = data_total % num_groups;
+
+            // Data first, then each group's parity, in one batch
+            std::vector<std::pair<uint32_t, size_t>> parity;   // group, symbol bytes
+            size_t first = 0;
+            for (size_t g = 0; g < num_groups; ++g) {
+                const size_t count = base_size + (g < remainder ? 1 : 0);
+                size_t parity_count = 0;
+                if (data_total > 1) {
+                    parity_count = planned
+                        ? std::min(plan.parity_count, count)
+                        : static_cast<size_t>(fec_.parityCountFor(static_cast<int>(count)));
+                }
+
+                const uint32_t group = static_cast<uint32_t>(groups_.size());
+                groups_.push_back({frame_index, static_cast<uint32_t>(count), 0, 0, false});
+                size_t symbol = 0;
+                for (size_t i = first; i < first + count; ++i) {
+                    addPacket(group, lens[i], false);
+                    symbol = std::max(symbol, lens[i]);
+                }
+                for (size_t i = 0; i < parity_count; ++i) {
+                    parity.emplace_back(group, sizeof(FecPacketHeader) + symbol);
+                }
+                frame.group_count++;
+                first += count;
+            }
+            for (const auto& p : parity) addPacket(p.first, p.second, true);
+        }
+        if (keyframe) {
+            last_keyframe_sent_ = frame_index;
+            have_keyframe_sent_ = true;
+        }
+        frames_.push_back(frame);
+    }
+
+    void addPacket(uint32_t group, size_t bytes, bool parity) {
+        const uint32_t id = static_cast<uint32_t>(packets_.size());
+        SimPacket packet;
+        packet.group  = group;
+        packet.bytes  = bytes;
+        packet.parity = parity;
+        packets_.push_back(packet);
+        pacer_.enqueue(id, bytes);
+        if (parity) parity_bytes_ += bytes;
+    }
+
+    /// A probe cluster of full-sized padding packets, as
+    /// UdpTransport::sendProbeCluster() builds it.
+    void sendProbeCluster(uint32_t rate_kbps, size_t bytes, std::vector<uint16_t>& seqs) {
+        seqs.clear();
+        const uint64_t now = cs::getTimestampUs();
+        for (size_t queued = 0; queued < bytes; queued += MAX_MTU_SIZE) {
+            const uint32_t id = static_cast<uint32_t>(packets_.size());
+            SimPacket packet;
+            packet.bytes   = MAX_MTU_SIZE;
+            packet.padding = true;
+            packets_.push_back(packet);
+            pacer_.enqueueProbe(id, packet.bytes, rate_kbps, now);
+            seqs.push_back(static_cast<uint16_t>(id));
+            probe_bytes_ += packet.bytes;
+        }
+    }
+
+    /// Release what the pacer allows; the transport sequence number is the
+    /// packet's index, as the counter is taken when a packet is sealed,
+    /// before it is queued.
+    void sendPaced(uint64_t now) {
+        uint32_t id = 0;
+        while (pacer_.release(now, id)) {
+            SimPacket& packet = packets_[id];
+            packet.send_us = now;
+            sent_bytes_ += packet.bytes;
+            result_.packets_sent++;
+            qos_.getBandwidthEstimator().onPacketSent(static_cast<uint16_t>(id),
+                                                      packet.bytes, now);
+            qos_.getProbeController().onPacketSent(static_cast<uint16_t>(id),
+                                                   packet.bytes, now);
+            if (impairment_) {
+                // The emulator copies datagrams; the id is all this one holds
+                std::memcpy(scratch_.data(), &id, sizeof(id));
+                impairment_->submit(scratch_.data(), packet.bytes, now);
+            } else {
+                toBottleneck(id, now);
+            }
+        }
+    }
+
+    // -----------------------------------------------------------------------
+    // Network
+    // -----------------------------------------------------------------------
+    void toBottleneck(uint32_t id, uint64_t at_us) {
+        if (!link_) {
+            arrive(id, at_us);
+        } else if (!link_->enqueue(id, packets_[id].bytes)) {
+            trace_drops_++;
+        }
+    }
+
+    void carry(uint64_t now) {
+        if (impairment_) {
+            due_.clear();
+            impairment_->takeDue(now, due_);
+            for (const NetworkImpairment::Datagram& dgram : due_) {
+                uint32_t id = 0;
+                std::memcpy(&id, dgram.buf.data(), sizeof(id));
+                toBottleneck(id, dgram.due_us);
+            }
+        }
+        if (link_) {
+            arrivals_.clear();
+            link_->advance(now, arrivals_);
+            for (const Arrival& a : arrivals_) arrive(a.id, a.arrival_us);
+        }
+    }
+
+    // -----------------------------------------------------------------------
+    // Viewer: reassembly, FEC, loss detection and feedback
+    // -----------------------------------------------------------------------
+    void arrive(uint32_t id, uint64_t at_us) {
+        SimPacket& packet = packets_[id];
+        if (packet.received) return;
+        packet.received   = true;
+        packet.arrival_us = at_us;
+        received_++;
+        if (!any_arrived_ || id > highest_arrived_) highest_arrived_ = id;
+        any_arrived_ = true;
+        if (packet.padding) return;   // Dropped on arrival: no delay, jitter or frame
+
+        const uint64_t owd = at_us - packet.send_us;
+        owd_us_.push_back(owd);
+        last_owd_us_ = owd;
+
+        // RFC 3550 interarrival jitter
+        if (have_transit_) {
+            const int64_t d = static_cast<int64_t>(owd) - static_cast<int64_t>(last_transit_us_);
+            jitter_us_ += (static_cast<double>(d < 0 ? -d : d) - jitter_us_) / 16.0;
+        }
+        last_transit_us_ = owd;
+        have_transit_    = true;
+
+        SimGroup& group = groups_[packet.group];
+        if (group.done) return;
+        group.received++;
+        if (!packet.parity) group.data_received++;
+        if (group.received < group.data) return;
+
+        group.done = true;
+        SimFrame& frame = frames_[group.frame];
+        if (group.data_received < group.data) frame.recovered = true;
+        if (++frame.groups_done == frame.group_count) completeFrame(group.frame, at_us);
+    }
+
+    void completeFrame(uint32_t index, uint64_t at_us) {
+        SimFrame& frame = frames_[index];
+        if (frame.lost) return;   // Given up on already
+        frame.complete = true;
+        result_.frames_complete++;
+        if (frame.recovered) result_.frames_fec_recovered++;
+        frame_latency_us_.push_back(at_us - frame.capture_us);
+        goodput_bytes_ += frame.bytes;
+
+        // Frames still open behind a complete one will not be shown: the
+        // jitter buffer moves past them and the viewer reports the loss.
+        bool new_loss = false;
+        for (; oldest_open_ < index; ++oldest_open_) {
+            SimFrame& old = frames_[oldest_open_];
+            if (old.complete || old.lost) continue;
+            old.lost = true;
+            result_.frames_lost++;
+            if (!frozen_) {
+                frozen_       = true;
+                frozen_since_ = at_us;
+            }
+            loss_pending_    = true;
+            loss_last_frame_ = oldest_open_;
+            new_loss         = true;
+        }
+        if (oldest_open_ == index) oldest_open_++;
+        if (new_loss) sendLossReport(at_us);
+
+        if (frame.keyframe) {
+            loss_pending_ = false;
+            if (frozen_) {
+                freeze_us_ += at_us - frozen_since_;
+                frozen_ = false;
+            }
+        }
+    }
+
+    /// A frame loss report, repeated until a keyframe arrives: the first
+    /// copy, or the host's keyframe, may be lost.
+    void sendLossReport(uint64_t now) {
+        loss_sent_us_ = now;
+        Feedback fb;
+        fb.kind       = Feedback::KEYFRAME;
+        fb.due_us     = now + return_delay_us_;
+        fb.lost_frame = loss_last_frame_;
+        feedback_.push_back(fb);
+    }
+
+    void sendFeedback(uint64_t now) {
+        const uint64_t rtt_us = last_owd_us_ + return_delay_us_;
+        if (loss_pending_ && now - loss_sent_us_ >= std::max(rtt_us, MIN_LOSS_REPORT_US)) {
+            sendLossReport(now);
+        }
+        if (now >= next_twcc_us_) {
+            next_twcc_us_ += TRANSPORT_FEEDBACK_US;
+            sendTransportFeedback(now);
+        }
+        if (now >= next_qos_us_) {
+            next_qos_us_ += QOS_FEEDBACK_US;
+            Feedback fb;
+            fb.kind   = Feedback::QOS;
+            fb.due_us = now + return_delay_us_;
+            fb.qos.received_packets = static_cast<uint32_t>(period_received_);
+            fb.qos.lost_packets     = static_cast<uint32_t>(period_lost_);
+            fb.qos.jitter_us        = static_cast<uint32_t>(jitter_us_);
+            fb.qos.last_seq         = static_cast<uint16_t>(highest_arrived_);
+            // The echoed probe crossed the link like the video did
+            fb.qos.rtt_us           = static_cast<uint32_t>(rtt_us);
+            feedback_.push_back(fb);
+            period_received_ = 0;
+            period_lost_     = 0;
+        }
+    }
+
+    /// Report every packet up to the newest arrival, through the wire
+    /// format (its arrival quantization included).
+    void sendTransportFeedback(uint64_t now) {
+        if (!any_arrived_) return;
+        while (next_report_ <= highest_arrived_) {
+            const uint32_t last = std::min<uint32_t>(
+                highest_arrived_,
+                next_report_ + static_cast<uint32_t>(TWCC_MAX_PACKETS_PER_FEEDBACK) - 1);
+            TransportFeedback tf;
+            tf.feedback_seq = feedback_seq_++;
+            tf.base_seq     = static_cast<uint16_t>(next_report_);
+            for (uint32_t id = next_report_; id <= last; ++id) {
+                PacketArrival arrival;
+                arrival.seq        = static_cast<uint16_t>(id);
+                arrival.received   = packets_[id].received;
+                arrival.arrival_us = packets_[id].arrival_us;
+                tf.packets.push_back(arrival);
+                if (arrival.received) period_received_++;
+                else                  period_lost_++;
+            }
+            next_report_ = last + 1;
+
+            const std::vector<uint8_t> wire = tf.serialize();
+            Feedback fb;
+            fb.kind   = Feedback::TRANSPORT;
+            fb.due_us = now + return_delay_us_;
+            if (TransportFeedback::deserialize(wire.data(), wire.size(), fb.transport)) {
+                feedback_.push_back(std::move(fb));
+            }
+        }
+    }
+
+    /// Hand the controller the feedback that has reached the host.  The
+    /// return delay is fixed, so the queue is in due order.
+    void deliverFeedback(uint64_t now) {
+        while (!feedback_.empty() && feedback_.front().due_us <= now) {
+            const Feedback& fb = feedback_.front();
+            switch (fb.kind) {
+                case Feedback::TRANSPORT: qos_.onTransportFeedback(fb.transport); break;
+                case Feedback::QOS:       qos_.onFeedbackReceived(fb.qos); break;
+                case Feedback::KEYFRAME:
+                    // As ViewerLink::onFrameLoss(): a keyframe sent since
+                    // the loss, or one already asked for, answers it
+                    if (have_keyframe_sent_ && last_keyframe_sent_ > fb.lost_frame) break;
+                    if (keyframe_requested_) break;
+                    keyframe_requested_ = true;
+                    result_.keyframe_requests++;
+                    break;
+            }
+            feedback_.pop_front();
+        }
+    }
+
+    // -----------------------------------------------------------------------
+    // Report
+    // -----------------------------------------------------------------------
+    void finish(uint64_t start_us, uint64_t end_us) {
+        const double secs = static_cast<double>(end_us - start_us) / 1e6;
+        result_.sent_kbps        = static_cast<double>(sent_bytes_) * 8.0 / 1000.0 / secs;
+        result_.goodput_kbps     = static_cast<double>(goodput_bytes_) * 8.0 / 1000.0 / secs;
+        result_.mean_target_kbps = target_samples_ > 0
+            ? static_cast<double>(target_kbps_sum_) / static_cast<double>(target_samples_) : 0.0;
+        result_.fec_overhead_pct = sent_bytes_ > 0
+            ? 100.0 * static_cast<double>(parity_bytes_) / static_cast<double>(sent_bytes_) : 0.0;
+        result_.probe_overhead_pct = sent_bytes_ > 0
+            ? 100.0 * static_cast<double>(probe_bytes_) / static_cast<double>(sent_bytes_) : 0.0;
+
+        uint32_t peak_kbps = 0;
+        for (const auto& t : targets_) peak_kbps = std::max(peak_kbps, t.second);
+        for (const auto& t : targets_) {
+            if (static_cast<double>(t.second) >= 0.9 * static_cast<double>(peak_kbps)) {
+                result_.ramp_ms = static_cast<double>(t.first - start_us) / 1000.0;
+                break;
+            }
+        }
+        if (link_) {
+            result_.capacity_kbps = static_cast<double>(link_->offeredBytes()) * 8.0 / 1000.0 / secs;
+        }
+
+        result_.packets_lost = trace_drops_;
+        if (impairment_) {
+            const NetworkImpairment::Stats stats = impairment_->getStats();
+            result_.packets_lost += stats.lost + stats.queue_drops;
+        }
+        if (frozen_) freeze_us_ += end_us - frozen_since_;
+        result_.freeze_ms          = static_cast<double>(freeze_us_) / 1000.0;
+        const QosStats stats = qos_.getStats();
+        result_.final_bitrate_kbps = stats.bitrate_kbps;
+        result_.probe_clusters     = stats.probe_clusters;
+
+        result_.owd_p50_ms = percentileMs(owd_us_, 0.50);
+        result_.owd_p95_ms = percentileMs(owd_us_, 0.95);
+        result_.owd_p99_ms = percentileMs(owd_us_, 0.99);
+
+        // Queueing delay: one-way delay over the least the path gave
+        if (!owd_us_.empty()) {
+            const uint64_t floor = *std::min_element(owd_us_.begin(), owd_us_.end());
+            for (uint64_t& owd : owd_us_) owd -= floor;
+        }
+        result_.queue_p50_ms = percentileMs(owd_us_, 0.50);
+        result_.queue_p95_ms = percentileMs(owd_us_, 0.95);
+        result_.queue_p99_ms = percentileMs(owd_us_, 0.99);
+
+        result_.frame_p50_ms = percentileMs(frame_latency_us_, 0.50);
+        result_.frame_p95_ms = percentileMs(frame_latency_us_, 0.95);
+        result_.frame_p99_ms = percentileMs(frame_latency_us_, 0.99);
+    }
+
+    const Options&   opt_;
+    const QosPreset  preset_;
+    const Trace*     trace_;
+
+    SyntheticEncoder encoder_;
+    FecEncoder       fec_;
+    QosController    qos_;
+    PacerModel       pacer_;
+
+    std::unique_ptr<NetworkImpairment> impairment_;
+    std::unique_ptr<TraceLink>         link_;
+    std::vector<NetworkImpairment::Datagram> due_;
+    std::vector<Arrival>               arrivals_;
+    std::vector<uint8_t>               scratch_;
+    uint64_t                           return_delay_us_ = 0;
+    uint64_t                           trace_drops_     = 0;
+
+    std::vector<SimPacket> packets_;
+    std::vector<SimGroup>  groups_;
+    std::vector<SimFrame>  frames_;
+
+    // Host
+    uint64_t next_frame_us_      = 0;
+    uint32_t fps_                = 0;
+    uint32_t bitrate_kbps_       = 0;
+    bool     keyframe_requested_ = false;
+    bool     have_keyframe_sent_ = false;
+    uint32_t last_keyframe_sent_ = 0;
+    uint64_t sent_bytes_         = 0;
+    uint64_t parity_bytes_       = 0;
+    uint64_t probe_bytes_        = 0;
+    uint64_t target_kbps_sum_    = 0;
+    uint64_t target_samples_     = 0;
+    std::vector<std::pair<uint64_t, uint32_t>> targets_;   // (time, kbps) at each change
+
+    // Viewer
+    std::deque<Feedback> feedback_;
+    uint64_t next_twcc_us_     = 0;
+    uint64_t next_qos_us_      = 0;
+    uint8_t  feedback_seq_     = 0;
+    uint32_t next_report_      = 0;
+    uint32_t highest_arrived_  = 0;
+    bool     any_arrived_      = false;
+    uint64_t received_         = 0;
+    uint64_t period_received_  = 0;
+    uint64_t period_lost_      = 0;
+    uint64_t last_owd_us_      = 0;
+    uint64_t last_transit_us_  = 0;
+    bool     have_transit_     = false;
+    double   jitter_us_        = 0.0;
+    uint32_t oldest_open_      = 0;
+    bool     loss_pending_     = false;
+    uint32_t loss_last_frame_  = 0;
+    uint64_t loss_sent_us_     = 0;
+    bool     frozen_           = false;
+    uint64_t frozen_since_     = 0;
+    uint64_t freeze_us_        = 0;
+    uint64_t goodput_bytes_    = 0;
+    std::vector<uint64_t> owd_us_;
+    std::vector<uint64_t> frame_latency_us_;
+
+    RunResult result_;
+};
+
+void printResult(const RunResult& r) {
+    std::printf("%s%s%s\n", r.mode.c_str(), r.trace.empty() ? "" : " / ", r.trace.c_str());
+    if (r.capacity_kbps > 0.0) {
+        std::printf("  link      %.0f kbps offered\n", r.capacity_kbps);
+    }
+    std::printf("  bitrate   %.0f kbps sent, %.0f kbps goodput, %.0f kbps mean target, "
+                "%u kbps final, FEC %.1f%%\n",
+                r.sent_kbps, r.goodput_kbps, r.mean_target_kbps, r.final_bitrate_kbps,
+                r.fec_overhead_pct);
+    std::printf("  delay     one-way p50 %.1f / p95 %.1f / p99 %.1f ms, "
+                "queueing p50 %.1f / p95 %.1f / p99 %.1f ms\n",
+                r.owd_p50_ms, r.owd_p95_ms, r.owd_p99_ms,
+                r.queue_p50_ms, r.queue_p95_ms, r.queue_p99_ms);
+    std::printf("  packets   %llu sent, %llu lost\n",
+                static_cast<unsigned long long>(r.packets_sent),
+                static_cast<unsigned long long>(r.packets_lost));
+    std::printf("  frames    %llu encoded, %llu complete (%llu with FEC), %llu lost, "
+                "%llu shed, %llu skipped, %llu keyframes (%llu requested)\n",
+                static_cast<unsigned long long>(r.frames_encoded),
+                static_cast<unsigned long long>(r.frames_complete),
+                static_cast<unsigned long long>(r.frames_fec_recovered),
+                static_cast<unsigned long long>(r.frames_lost),
+                static_cast<unsigned long long>(r.frames_shed),
+                static_cast<unsigned long long>(r.frames_skipped),
+                static_cast<unsigned long long>(r.keyframes),
+                static_cast<unsigned long long>(r.keyframe_requests));
+    std::printf("  latency   frame p50 %.1f / p95 %.1f / p99 %.1f ms, %.0f ms frozen\n",
+                r.frame_p50_ms, r.frame_p95_ms, r.frame_p99_ms, r.freeze_ms);
+    std::printf("  switches  %u resolution (lowest %up), %u fps (lowest %u), %u bitrate cuts\n",
+                r.resolution_switches, r.min_height, r.fps_switches, r.min_fps, r.bitrate_cuts);
+    std::printf("  ramp-up   %.0f ms to 90%% of peak target, %u probe clusters (%.1f%% of bytes)\n",
+                r.ramp_ms, r.probe_clusters, r.probe_overhead_pct);
+}
+
+std::string resultJson(const RunResult& r, const Options& opt) {
+    JsonObjectWriter json;
+    json.addString("mode", r.mode);
+    json.addString("trace", r.trace);
+    json.addString("impairment", describeImpairment(opt.impair));
+    json.addFloat("seconds", opt.seconds);
+    json.addFloat("capacity_kbps", r.capacity_kbps);
+    json.addFloat("sent_kbps", r.sent_kbps);
+    json.addFloat("goodput_kbps", r.goodput_kbps);
+    json.addFloat("mean_target_kbps", r.mean_target_kbps);
+    json.addUint("final_bitrate_kbps", r.final_bitrate_kbps);
+    json.addFloat("fec_overhead_pct", r.fec_overhead_pct);
+    json.addFloat("probe_overhead_pct", r.probe_overhead_pct);
+    json.addFloat("ramp_ms", r.ramp_ms);
+    json.addUint("probe_clusters", r.probe_clusters);
+    json.addFloat("owd_p50_ms", r.owd_p50_ms);
+    json.addFloat("owd_p95_ms", r.owd_p95_ms);
+    json.addFloat("owd_p99_ms", r.owd_p99_ms);
+    json.addFloat("queue_delay_p50_ms", r.queue_p50_ms);
+    json.addFloat("queue_delay_p95_ms", r.queue_p95_ms);
+    json.addFloat("queue_delay_p99_ms", r.queue_p99_ms);
+    json.addUint("packets_sent", r.packets_sent);
+    json.addUint("packets_lost", r.packets_lost);
+    json.addUint("frames_encoded", r.frames_encoded);
+    json.addUint("frames_complete", r.frames_complete);
+    json.addUint("frames_fec_recovered", r.frames_fec_recovered);
+    json.addUint("frames_lost", r.frames_lost);
+    json.addUint("frames_shed", r.frames_shed);
+    json.addUint("frames_skipped", r.frames_skipped);
+    json.addUint("keyframes", r.keyframes);
+    json.addUint("keyframe_requests", r.keyframe_requests);
+    json.addFloat("frame_latency_p50_ms", r.frame_p50_ms);
+    json.addFloat("frame_latency_p95_ms", r.frame_p95_ms);
+    json.addFloat("frame_latency_p99_ms", r.frame_p99_ms);
+    json.addFloat("freeze_ms", r.freeze_ms);
+    json.addUint("resolution_switches", r.resolution_switches);
+    json.addUint("min_height", r.min_height);
+    json.addUint("fps_switches", r.fps_switches);
+    json.addUint("min_fps", r.min_fps);
+    json.addUint("bitrate_cuts", r.bitrate_cuts);
+    return json.finish();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) return 2;
+    if (!opt.verbose) globalLogLevel() = LogLevel::ERR;
+
+    std::vector<Trace> traces(opt.traces.size());
+    for (size_t i = 0; i < opt.traces.size(); ++i) {
+        if (!loadTrace(opt.traces[i], traces[i])) return 2;
+    }
+    if (traces.empty() && !opt.impair.enabled()) {
+        std::fprintf(stderr, "Nothing to simulate: give --trace and / or --impair\n");
+        return 2;
+    }
+
+    std::printf("qos simulator: %.0f s per run", opt.seconds);
+    if (opt.impair.enabled()) std::printf(", impair %s", describeImpairment(opt.impair).c_str());
+    std::printf("\n");
+
+    std::vector<RunResult> results;
+    const size_t links = std::max<size_t>(traces.size(), 1);
+    for (size_t t = 0; t < links; ++t) {
+        const Trace* trace = traces.empty() ? nullptr : &traces[t];
+        for (GamingMode mode : opt.modes) {
+            Simulation sim(opt, mode, trace);
+            RunResult result;
+            if (!sim.run(result)) {
+                std::fprintf(stderr, "%s: set-up failed\n", gamingModeToString(mode).c_str());
+                return 1;
+            }
+            printResult(result);
+            results.push_back(result);
+        }
+    }
+
+    if (!opt.out.empty()) {
+        FILE* f = std::fopen(opt.out.c_str(), "w");
+        if (!f) {
+            std::fprintf(stderr, "Cannot write %s\n", opt.out.c_str());
+            return 1;
+        }
+        std::fprintf(f, "[\n");
+        for (size_t i = 0; i < results.size(); ++i) {
+            std::fprintf(f, "  %s%s\n", resultJson(results[i], opt).c_str(),
+                         i + 1 < results.size() ? "," : "");
+        }
+        std::fprintf(f, "]\n");
+        std::fclose(f);
+    }
+
+    // A run that delivered nothing is a broken controller or link
+    for (const RunResult& r : results) {
+        if (r.frames_complete == 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+// simple_json_bench.cpp -- IPC message parsing and reply formatting
+//
+// The pipe server parses every command with SimpleJson and pushes a stats
+// reply to each subscriber several times a second.  Measured here: parsing
+// a typical command, building a small reply with SimpleJson, and building
+// a stats-sized reply with JsonObjectWriter.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ipc/simple_json.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+namespace {
+
+using cs::host::JsonObjectWriter;
+using cs::host::SimpleJson;
+
+void BM_SimpleJsonParse(benchmark::State& state) {
+    const std::string message =
+        "{\"command\": \"set_bitrate\", \"bitrate_kbps\": 25000, "
+        "\"session_id\": \"4f9c2e1a-77b0-4d1e-9d2a-0c5e3b8a6f11\", "
+        "\"interval_ms\": 250, \"reason\": \"user \\\"override\\\"\"}";
+    for (auto _ : state) {
+        SimpleJson json;
+        benchmark::DoNotOptimize(json.parse(message));
+        benchmark::DoNotOptimize(json.getUint("bitrate_kbps"));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * message.size()));
+}
+BENCHMARK(BM_SimpleJsonParse);
+
+void BM_SimpleJsonSerialize(benchmark::State& state) {
+    for (auto _ : state) {
+        SimpleJson json;
+        json.setString("status", "ok");
+        json.setUint("interval_ms", 250);
+        json.setInt("offset", -12);
+        json.setFloat("rtt_ms", 3.25);
+        std::string out = json.serialize();
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SimpleJsonSerialize);
+
+void BM_JsonWriterStats(benchmark::State& state) {
+    // Roughly the field mix of the host's stats reply
+    uint64_t bytes_sent = 1;
+    for (auto _ : state) {
+        JsonObjectWriter w;
+        for (int i = 0; i < 8; ++i) {
+            w.addUint("bitrate_kbps", 25000);
+            w.addFloat("packet_loss_percent", 0.37);
+            w.addUint("bytes_sent", bytes_sent);
+            w.addString("codec", "h265");
+            w.addBool("hdr", false);
+        }
+        std::string out = w.finish();
+        benchmark::DoNotOptimize(out.data());
+        bytes_sent += 1200;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_JsonWriterStats);
+
+} // namespace
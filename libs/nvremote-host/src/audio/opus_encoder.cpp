@@ -22,15 +22,28 @@ OpusEncoderWrapper::~OpusEncoderWrapper() {
 // initialize -- create and configure the Opus encoder
 // ---------------------------------------------------------------------------
 
-bool OpusEncoderWrapper::initialize(uint32_t sample_rate, uint16_t channels, uint32_t bitrate) {
+bool OpusEncoderWrapper::initialize(uint32_t sample_rate, uint16_t channels, uint32_t bitrate,
+                                    uint32_t frame_us) {
     if (encoder_) release();
 
     sample_rate_ = sample_rate;
     channels_    = channels;
     bitrate_     = bitrate;
 
-    // Frame size: 10 ms at the given sample rate.
-    frame_size_ = sample_rate / 100;  // 480 samples for 48 kHz
+    // Frame size: |frame_us| at the given sample rate (480 samples for
+    // 10 ms at 48 kHz)
+    frame_size_ = frameSizeFor(frame_us);
+    if (frame_size_ == 0) {
+        CS_LOG(ERR, "Opus: cannot code %u us frames at %u Hz", frame_us, sample_rate);
+        return false;
+    }
+
+    // The stream accumulator holds a frame of the longest duration, so a
+    // later setFrameDuration() never allocates
+    pending_.assign(static_cast<size_t>(frameSizeFor(MAX_FRAME_US)) * channels, 0.0f);
+    pending_frames_ = 0;
+    packet_.resize(MAX_PACKET_SIZE);
+    next_frame_size_.store(0);
 
     int error = 0;
     encoder_ = opus_encoder_create(
@@ -107,6 +120,48 @@ bool OpusEncoderWrapper::encode(const float* pcm, size_t frame_count,
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// encodeFrame -- one frame of the stream into packet_
+// ---------------------------------------------------------------------------
+
+size_t OpusEncoderWrapper::encodeFrame(const float* pcm) {
+    opus_int32 encoded = opus_encode_float(
+        encoder_,
+        pcm,
+        static_cast<int>(frame_size_),
+        packet_.data(),
+        static_cast<opus_int32>(packet_.size())
+    );
+
+    if (encoded < 0) {
+        CS_LOG(ERR, "Opus: opus_encode_float failed (error=%d: %s)",
+               encoded, opus_strerror(encoded));
+        return 0;
+    }
+    return static_cast<size_t>(encoded);
+}
+
+// ---------------------------------------------------------------------------
+// setFrameDuration / frameSizeFor
+// ---------------------------------------------------------------------------
+
+bool OpusEncoderWrapper::setFrameDuration(uint32_t frame_us) {
+    const uint32_t size = frameSizeFor(frame_us);
+    if (size == 0) return false;
+    next_frame_size_.store(size);
+    CS_LOG(DEBUG, "Opus: frame duration set to %u us", frame_us);
+    return true;
+}
+
+uint32_t OpusEncoderWrapper::frameSizeFor(uint32_t frame_us) const {
+    if (frame_us != 2500 && frame_us != 5000 && frame_us != 10000 && frame_us != 20000) {
+        return 0;
+    }
+    const uint64_t scaled = static_cast<uint64_t>(sample_rate_) * frame_us;
+    if (scaled % 1'000'000 != 0) return 0;
+    return static_cast<uint32_t>(scaled / 1'000'000);
+}
+
 // ---------------------------------------------------------------------------
 // setBitrate -- dynamically adjust the audio bitrate
 // ---------------------------------------------------------------------------
@@ -7,12 +7,23 @@
 //   - 48 kHz sample rate (native Opus rate)
 //   - Stereo (2 channels)
 //   - 128 kbps default bitrate
-//   - 10 ms frame size (480 samples at 48 kHz)
+//   - 10 ms frame size (480 samples at 48 kHz) by default; 2.5, 5 and
+//     20 ms frames too (setFrameDuration())
 //   - OPUS_APPLICATION_RESTRICTED_LOWDELAY for minimum latency
+//
+// The capture delivers whatever its period holds, which need not be a
+// whole number of Opus frames.  encodeStream() carries what is left of
+// one delivery over to the next, so every sample is coded once and in
+// order; the frame accumulator and the packet buffer are allocated once.
+// Each packet carries the capture time of its first sample, so a frame
+// completed across two deliveries is stamped from the first.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <cstring>
 #include <vector>
 
 // Forward-declare the opaque Opus encoder type.
@@ -29,9 +40,11 @@ public:
     /// |sample_rate|: typically 48000.
     /// |channels|:    1 (mono) or 2 (stereo).
     /// |bitrate|:     target bitrate in bps (default 128000).
+    /// |frame_us|:    Opus frame duration (2500, 5000, 10000 or 20000).
     bool initialize(uint32_t sample_rate = 48000,
                     uint16_t channels = 2,
-                    uint32_t bitrate = 128000);
+                    uint32_t bitrate = 128000,
+                    uint32_t frame_us = 10000);
 
     /// Encode a frame of float32 PCM samples.
     /// |pcm|:         pointer to interleaved float samples.
@@ -41,6 +54,20 @@ public:
     /// Returns true on success.
     bool encode(const float* pcm, size_t frame_count, std::vector<uint8_t>& out);
 
+    /// Encode a stream of interleaved float32 PCM delivered in arbitrary
+    /// chunks.  Every Opus frame the |frame_count| frames at |pcm| complete
+    /// is encoded and handed to |on_packet(data, len, capture_us)| -- |data|
+    /// is valid for the call only, |capture_us| is when the frame's first
+    /// sample was captured, given |capture_us| for the chunk's first -- and
+    /// the remainder is kept for the next call.  Called from one thread.
+    template <typename OnPacket>
+    void encodeStream(const float* pcm, size_t frame_count, uint64_t capture_us,
+                      OnPacket&& on_packet);
+
+    /// Code frames of |frame_us| (2500, 5000, 10000 or 20000) from the next
+    /// frame boundary on.  Thread-safe.  False for any other duration.
+    bool setFrameDuration(uint32_t frame_us);
+
     /// Dynamically change the bitrate.
     void setBitrate(uint32_t bitrate);
 
@@ -56,12 +83,73 @@ public:
     /// Release encoder resources.
     void release();
 
+    /// Longest packet an encode produces.
+    static constexpr size_t MAX_PACKET_SIZE = 4000;    // As opus_demo; 1275 per frame
+
 private:
+    /// Encode one frame_size_ frame at |pcm| into packet_.  Returns the
+    /// packet length, 0 on failure.
+    size_t encodeFrame(const float* pcm);
+
+    /// Frames per channel of |frame_us| at sample_rate_, 0 if Opus does
+    /// not code that duration.
+    uint32_t frameSizeFor(uint32_t frame_us) const;
+
     OpusEncoder* encoder_      = nullptr;
     uint32_t     sample_rate_  = 48000;
     uint16_t     channels_     = 2;
     uint32_t     bitrate_      = 128000;
     uint32_t     frame_size_   = 480;   // 10 ms at 48 kHz
+
+    // encodeStream() (capture thread)
+    std::vector<float>    pending_;             // One frame at the largest size
+    size_t                pending_frames_ = 0;  // Of the frame being filled
+    uint64_t              pending_start_us_ = 0; // Capture time of its first sample
+    std::vector<uint8_t>  packet_;              // Output of the last encode
+    std::atomic<uint32_t> next_frame_size_{0};  // Applied at a frame boundary (0 = none)
+
+    static constexpr uint32_t MAX_FRAME_US    = 20000;
 };
 
+// ---------------------------------------------------------------------------
+// encodeStream()
+// ---------------------------------------------------------------------------
+template <typename OnPacket>
+void OpusEncoderWrapper::encodeStream(const float* pcm, size_t frame_count,
+                                      uint64_t capture_us, OnPacket&& on_packet) {
+    if (!encoder_) return;
+
+    size_t offset = 0;   // Frames of the chunk consumed
+    while (frame_count > offset) {
+        if (pending_frames_ == 0) {
+            if (const uint32_t next = next_frame_size_.exchange(0)) frame_size_ = next;
+        }
+        const uint64_t at_us = capture_us + offset * 1'000'000 / sample_rate_;
+
+        // A whole frame at the start of the chunk is coded where it lies
+        const float* frame = nullptr;
+        uint64_t frame_us = at_us;
+        if (pending_frames_ == 0 && frame_count - offset >= frame_size_) {
+            frame = pcm + offset * channels_;
+            offset += frame_size_;
+        } else {
+            if (pending_frames_ == 0) pending_start_us_ = at_us;
+            const size_t take = std::min(frame_count - offset,
+                                         static_cast<size_t>(frame_size_) - pending_frames_);
+            std::memcpy(pending_.data() + pending_frames_ * channels_, pcm + offset * channels_,
+                        take * channels_ * sizeof(float));
+            pending_frames_ += take;
+            offset          += take;
+            if (pending_frames_ < frame_size_) break;
+            frame = pending_.data();
+            frame_us = pending_start_us_;
+            pending_frames_ = 0;
+        }
+
+        if (const size_t len = encodeFrame(frame)) {
+            on_packet(static_cast<const uint8_t*>(packet_.data()), len, frame_us);
+        }
+    }
+}
+
 } // namespace cs::host
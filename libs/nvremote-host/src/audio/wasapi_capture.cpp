@@ -2,12 +2,13 @@
 // wasapi_capture.cpp -- WASAPI loopback audio capture implementation
 //
 // Uses the WASAPI shared-mode loopback to capture the system audio output.
-// A dedicated thread waits on the WASAPI event and delivers PCM data via
-// the user callback.
+// A dedicated MMCSS thread waits on the WASAPI event and delivers PCM data
+// via the user callback.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "wasapi_capture.h"
 #include <cs/common.h>
+#include <cs/thread_policy.h>
 
 #ifndef WIN32_LEAN_AND_MEAN
 #  define WIN32_LEAN_AND_MEAN
@@ -126,6 +127,16 @@ bool WasapiCapture::initialize(const std::string& /*device_id*/) {
         CS_LOG(ERR, "WASAPI: GetBufferSize failed (0x%08lX)", hr);
         return false;
     }
+    silence_.assign(static_cast<size_t>(buffer_frames_) * channels_, 0.0f);
+
+    // A packet is captured one engine period after the render endpoint
+    // mixed it, plus whatever the stream itself holds.
+    REFERENCE_TIME stream_latency = 0;
+    REFERENCE_TIME default_period = 0;
+    REFERENCE_TIME min_period     = 0;
+    audio_client_->GetStreamLatency(&stream_latency);
+    audio_client_->GetDevicePeriod(&default_period, &min_period);
+    latency_us_ = static_cast<uint64_t>(stream_latency + default_period) / 10;
 
     // Get the capture client interface.
     hr = audio_client_->GetService(IID_IAudioCaptureClient_local,
@@ -135,8 +146,8 @@ bool WasapiCapture::initialize(const std::string& /*device_id*/) {
         return false;
     }
 
-    CS_LOG(INFO, "WASAPI: initialized (buffer=%u frames, rate=%u Hz, ch=%u)",
-           buffer_frames_, sample_rate_, channels_);
+    CS_LOG(INFO, "WASAPI: initialized (buffer=%u frames, rate=%u Hz, ch=%u, latency=%.1f ms)",
+           buffer_frames_, sample_rate_, channels_, latency_us_ / 1000.0);
     return true;
 }
 
@@ -205,6 +216,34 @@ void WasapiCapture::stop() {
     CS_LOG(INFO, "WASAPI: capture stopped and resources released");
 }
 
+// ---------------------------------------------------------------------------
+// captureTimeUs -- QPC capture position onto the media clock
+// ---------------------------------------------------------------------------
+
+uint64_t WasapiCapture::captureTimeUs(uint64_t qpc_position, uint32_t frames,
+                                      bool position_valid) const {
+    const uint64_t now_us = cs::getTimestampUs();
+    const uint64_t span_us = static_cast<uint64_t>(frames) * 1'000'000 / sample_rate_;
+
+    LARGE_INTEGER freq, qpc;
+    if (!position_valid || !QueryPerformanceFrequency(&freq) ||
+        !QueryPerformanceCounter(&qpc) || freq.QuadPart <= 0) {
+        // No usable position: the packet has just completed
+        return now_us - span_us;
+    }
+
+    // QPC now in 100 ns units, split to keep the product in range
+    const uint64_t f = static_cast<uint64_t>(freq.QuadPart);
+    const uint64_t q = static_cast<uint64_t>(qpc.QuadPart);
+    const uint64_t qpc_now = (q / f) * 10'000'000 + (q % f) * 10'000'000 / f;
+    if (qpc_position > qpc_now) return now_us;
+
+    // The age of the first frame is the same on either clock
+    const uint64_t age_us = (qpc_now - qpc_position) / 10;
+    if (age_us > 1'000'000) return now_us - span_us;   // Implausible: ignore
+    return now_us - age_us;
+}
+
 // ---------------------------------------------------------------------------
 // captureThread -- runs on dedicated thread, delivers audio via callback
 // ---------------------------------------------------------------------------
@@ -212,8 +251,9 @@ void WasapiCapture::stop() {
 void WasapiCapture::captureThread() {
     CS_LOG(DEBUG, "WASAPI: capture thread started");
 
-    // Set thread priority for low-latency audio.
-    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+    // By default MMCSS schedules the thread with the audio engine's own;
+    // plain priority is the fallback where the service is unavailable.
+    cs::ScopedThreadRole role(cs::ThreadRole::AUDIO);
 
     while (!stop_flag_.load()) {
         // Wait for WASAPI to signal that data is available.
@@ -248,19 +288,26 @@ void WasapiCapture::captureThread() {
                 break;
             }
 
+            const uint64_t capture_us = captureTimeUs(
+                qpcPosition, framesAvail, !(flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR));
+
             // If the buffer is silent, we still deliver silence (zeroes).
             if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
-                // Deliver silence as zero-filled float buffer.
+                // Deliver silence as zero-filled float buffer (a packet is
+                // never larger than the endpoint buffer it was sized for).
                 size_t total_samples = static_cast<size_t>(framesAvail) * channels_;
-                std::vector<float> silence(total_samples, 0.0f);
+                if (silence_.size() < total_samples) {
+                    silence_.assign(total_samples, 0.0f);
+                }
                 if (callback_) {
-                    callback_(silence.data(), framesAvail, sample_rate_, channels_);
+                    callback_(silence_.data(), framesAvail, sample_rate_, channels_,
+                              capture_us);
                 }
             } else {
                 // Deliver actual audio data.
                 if (callback_) {
                     callback_(reinterpret_cast<const float*>(data),
-                              framesAvail, sample_rate_, channels_);
+                              framesAvail, sample_rate_, channels_, capture_us);
                 }
             }
 
@@ -2,14 +2,22 @@
 // wasapi_capture.h -- WASAPI loopback audio capture
 //
 // Captures the system audio output (loopback) via the Windows Audio Session
-// API (WASAPI).  The capture runs on a dedicated thread and delivers PCM
-// samples via a callback.
+// API (WASAPI).  The capture runs on a dedicated thread, registered with
+// MMCSS as "Pro Audio", and delivers PCM samples via a callback.
+//
+// Loopback is only offered in plain shared mode: neither exclusive mode nor
+// IAudioClient3's low-latency streams can capture it.  Packets arrive once
+// per engine period of the render endpoint, and getLatencyUs() reports how
+// far behind the speakers they are.  Each packet is stamped with the time
+// its first frame was captured (from the QPC position WASAPI reports),
+// moved onto the session's media clock so that audio and video timestamps
+// compare.
 //
 // Configuration:
 //   - 48 kHz sample rate (native for Opus)
 //   - Stereo (2 channels)
 //   - 32-bit float samples
-//   - 10 ms buffer period (low latency)
+//   - 10 ms buffer, drained each engine period
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
@@ -18,6 +26,7 @@
 #include <string>
 #include <thread>
 #include <atomic>
+#include <vector>
 
 // Forward-declare COM interfaces to avoid pulling Windows headers into
 // every translation unit that includes this header.
@@ -27,11 +36,13 @@ struct IMMDevice;
 
 namespace cs::host {
 
-/// Callback signature: (samples, frame_count, sample_rate, channels).
-/// |samples| points to interleaved float32 PCM data.
+/// Callback signature: (samples, frame_count, sample_rate, channels,
+/// capture_us).  |samples| points to interleaved float32 PCM data;
+/// |capture_us| is when its first frame was captured, on the media clock
+/// video is stamped with (cs::getTimestampUs()).
 using AudioCallback = std::function<void(
     const float* samples, size_t frame_count,
-    uint32_t sample_rate, uint16_t channels)>;
+    uint32_t sample_rate, uint16_t channels, uint64_t capture_us)>;
 
 class WasapiCapture {
 public:
@@ -57,9 +68,17 @@ public:
     /// Get the number of channels.
     uint16_t getChannels() const { return channels_; }
 
+    /// Capture latency in microseconds: one engine period plus the stream
+    /// latency WASAPI reports.  Valid after initialize().
+    uint64_t getLatencyUs() const { return latency_us_; }
+
 private:
     void captureThread();
 
+    /// Media-clock time of a packet's first frame from the QPC position
+    /// GetBuffer() reported (100 ns units), |frames| long.
+    uint64_t captureTimeUs(uint64_t qpc_position, uint32_t frames, bool position_valid) const;
+
     IAudioClient*         audio_client_   = nullptr;
     IAudioCaptureClient*  capture_client_ = nullptr;
     IMMDevice*            device_         = nullptr;
@@ -67,8 +86,10 @@ private:
     uint32_t              sample_rate_    = 48000;
     uint16_t              channels_       = 2;
     uint32_t              buffer_frames_  = 0;
+    uint64_t              latency_us_     = 0;
 
     AudioCallback         callback_;
+    std::vector<float>    silence_;       // Delivered for silent buffers (capture thread)
     std::thread           thread_;
     std::atomic<bool>     running_{false};
     std::atomic<bool>     stop_flag_{false};
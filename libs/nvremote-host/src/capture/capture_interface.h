@@ -9,6 +9,26 @@
 // The session manager probes backends in order:
 //   Windows: NvFBC → DXGI
 //   Linux ARM64: NvFBC (DGX Spark only) → DRM/KMS
+//
+// A backend that captures into GPU memory reports the device its frames
+// live on, so the encoder can be opened on the same device and read them
+// in place.
+//
+// A backend that can convert on the GPU as it captures (NvFBC's ToCUDA
+// path) hands out YUV frames, in a layout chosen with setOutputFormat();
+// the others hand out what the desktop is in, BGRA, which the session
+// converts on the GPU itself or leaves to the encoder.  The same
+// backends can scale as they capture (setOutputSize()); the session
+// scales the others' frames as it converts them.
+//
+// A backend that knows which parts of the desktop were redrawn attaches a
+// change map to the frame: one byte per square block, non-zero where the
+// block changed since the backend's previous frame.  The encoder spends
+// its bits where they changed.
+//
+// A backend that can capture any of the GPU's displays captures one of
+// them, chosen with selectOutput() before initialize(); the session opens
+// one backend per display it streams.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
@@ -24,19 +44,44 @@ enum class FrameFormat {
     BGRA8,   // 32-bit BGRA (DXGI default)
     NV12,    // Semi-planar 4:2:0 (NVENC native input)
     ARGB8,   // 32-bit ARGB
+    YUV444,  // Planar 4:4:4: Y, U, V planes of |height| rows each
+    AYUV,    // Packed 4:4:4, 32 bits per pixel (D3D11 textures)
+    P010,    // Semi-planar 4:2:0, 10 bits in the high bits of 16
+};
+
+// ---------------------------------------------------------------------------
+// FrameMemory -- what CapturedFrame::gpu_ptr points at
+// ---------------------------------------------------------------------------
+enum class FrameMemory {
+    SYSTEM,  // CPU-readable pixels
+    CUDA,    // CUdeviceptr in the capture device's CUDA context
+    D3D11,   // ID3D11Texture2D* on the capture device's D3D11 device
+    DMABUF,  // CPU mapping of |dmabuf_fd|'s pixels, or null where it cannot be mapped
 };
 
 // ---------------------------------------------------------------------------
 // CapturedFrame -- one captured desktop frame
 // ---------------------------------------------------------------------------
 struct CapturedFrame {
-    void*       gpu_ptr        = nullptr;  // GPU memory (CUDA device ptr or D3D11 texture)
+    void*       gpu_ptr        = nullptr;  // Frame pixels, as described by |memory|
+    FrameMemory memory         = FrameMemory::SYSTEM;
     uint32_t    width          = 0;
     uint32_t    height         = 0;
     uint32_t    pitch          = 0;        // Row pitch in bytes
     FrameFormat format         = FrameFormat::BGRA8;
     uint64_t    timestamp_us   = 0;        // Capture timestamp (steady clock, microseconds)
     bool        is_new_frame   = true;     // False if the desktop hasn't changed since last grab
+    int         dmabuf_fd      = -1;       // DMA-BUF of the pixels (DMABUF frames), owned by
+                                           // the capture; -1 if it could not be exported
+
+    // Change map (null = unknown: treat every block as changed).  Lives
+    // with the frame's surface, so it is valid as long as the pixels are.
+    const uint8_t* change_map  = nullptr;
+    uint32_t    change_block   = 0;        // Block edge in pixels
+    uint32_t    change_cols    = 0;        // Blocks per row
+    uint32_t    change_rows    = 0;
+    uint32_t    change_seq     = 0;        // Counts the backend's new frames; a map only
+                                           // says what changed since change_seq - 1
 };
 
 // ---------------------------------------------------------------------------
@@ -57,6 +102,60 @@ public:
     /// Release all internal resources.
     virtual void release() = 0;
 
+    /// Where captured frames live.  Valid once initialized.
+    virtual FrameMemory getFrameMemory() const { return FrameMemory::SYSTEM; }
+
+    /// The device GPU frames live on: the CUcontext for CUDA frames, the
+    /// ID3D11Device* for D3D11 ones, null for system memory and DMA-BUFs.
+    virtual void* getFrameDevice() const { return nullptr; }
+
+    /// GPU surfaces frames are captured into, used in turn: a frame's
+    /// surface is written again that many captures later, so no more GPU
+    /// frames than this may be held at once.  An encoder copies a
+    /// system-memory frame before returning from encode() / submit(), but
+    /// its pixels are just as short-lived: a frame queued for an encoder
+    /// on another thread counts against this too.
+    virtual uint32_t getSurfaceCount() const { return 1; }
+
+    /// True if captureFrame() can block until the desktop next changes,
+    /// so frames may be captured as they are drawn instead of on a timer.
+    virtual bool waitsForUpdates() const { return false; }
+
+    /// How long captureFrame() may wait for the desktop to change before
+    /// it reports a duplicate frame (0 = return at once).  Only backends
+    /// that waitsForUpdates() wait at all.
+    virtual void setUpdateWait(uint32_t max_wait_ms) { (void)max_wait_ms; }
+
+    /// Whether frames include the cursor (the default where the backend
+    /// can draw it).  Turned off while the viewer draws the cursor from
+    /// the cursor channel.  Backends that never draw it ignore this.
+    /// Returns false if the capture could not be switched over.
+    virtual bool setCursorComposited(bool composited) { (void)composited; return true; }
+
+    /// Have frames converted to |format| on the GPU as they are captured.
+    /// Returns false if the backend cannot produce it; frames then keep
+    /// the format they had.
+    virtual bool setOutputFormat(FrameFormat format) { (void)format; return false; }
+
+    /// Have frames scaled to |width| x |height| on the GPU as they are
+    /// captured (0 x 0 = the desktop's size).  Returns false if the
+    /// backend cannot scale; frames then keep the size they had.
+    virtual bool setOutputSize(uint32_t width, uint32_t height) {
+        (void)width; (void)height;
+        return false;
+    }
+
+    /// Displays attached to the GPU this backend can capture.  Valid once
+    /// initialized.
+    virtual uint32_t getOutputCount() const { return 1; }
+
+    /// Capture display |index| (0 = the primary).  Call before initialize();
+    /// false if the backend captures only the primary.
+    virtual bool selectOutput(uint32_t index) { return index == 0; }
+
+    /// Most encoder sessions the platform runs at once (0 = no known limit).
+    virtual int getMaxEncodeSessions() const { return 0; }
+
     /// Human-readable name for this capture backend (e.g. "NvFBC", "DXGI").
     virtual std::string getName() const = 0;
 };
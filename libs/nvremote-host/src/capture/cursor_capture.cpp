@@ -0,0 +1,328 @@
+///////////////////////////////////////////////////////////////////////////////
+// cursor_capture.cpp -- Pointer capture for the cursor channel
+//
+// The pointer is read with GetCursorInfo(); its image is read back from
+// the cursor's bitmaps only when the cursor handle changes.  Colour
+// cursors with an alpha channel keep it; others take their alpha from the
+// AND mask.  Pixels a monochrome or masked cursor inverts (XOR) cannot be
+// drawn over a video the viewer composites later, so they are drawn black.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cursor_capture.h"
+
+#include <cs/common.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#ifdef _WIN32
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <Windows.h>
+#endif
+
+namespace cs::host {
+
+namespace {
+
+#ifdef _WIN32
+/// FNV-1a over the shape's geometry and pixels.
+uint32_t hashShape(const CursorShape& shape) {
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const uint8_t* data, size_t len) {
+        for (size_t i = 0; i < len; ++i) {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+    };
+    const uint16_t geometry[4] = { shape.width, shape.height, shape.hotspot_x, shape.hotspot_y };
+    mix(reinterpret_cast<const uint8_t*>(geometry), sizeof(geometry));
+    mix(shape.bgra.data(), shape.bgra.size());
+    return hash != 0 ? hash : 1;   // 0 means "no shape" on the wire
+}
+
+/// Read |cursor|'s image into |shape| (all but the hash).
+bool readCursorShape(HCURSOR cursor, CursorShape& shape) {
+    ICONINFO info = {};
+    if (!GetIconInfo(cursor, &info)) return false;
+
+    // GetIconInfo() hands back copies of the bitmaps, owned by the caller
+    struct BitmapGuard {
+        ICONINFO& info;
+        ~BitmapGuard() {
+            if (info.hbmColor) DeleteObject(info.hbmColor);
+            if (info.hbmMask)  DeleteObject(info.hbmMask);
+        }
+    } guard{info};
+
+    BITMAP mask_bm = {};
+    if (!info.hbmMask || !GetObject(info.hbmMask, sizeof(mask_bm), &mask_bm)) return false;
+
+    // A monochrome cursor stacks its AND and XOR masks in one bitmap
+    const bool mono   = info.hbmColor == nullptr;
+    const int  width  = mask_bm.bmWidth;
+    const int  height = mono ? mask_bm.bmHeight / 2 : mask_bm.bmHeight;
+    if (width <= 0 || height <= 0) return false;
+
+    HDC dc = GetDC(nullptr);
+    auto readBits = [&](HBITMAP bitmap, int rows, std::vector<uint32_t>& out) {
+        BITMAPINFO bi = {};
+        bi.bmiHeader.biSize        = sizeof(BITMAPINFOHEADER);
+        bi.bmiHeader.biWidth       = width;
+        bi.bmiHeader.biHeight      = -rows;   // Top down
+        bi.bmiHeader.biPlanes      = 1;
+        bi.bmiHeader.biBitCount    = 32;
+        bi.bmiHeader.biCompression = BI_RGB;
+        out.resize(static_cast<size_t>(width) * rows);
+        return GetDIBits(dc, bitmap, 0, rows, out.data(), &bi, DIB_RGB_COLORS) == rows;
+    };
+    std::vector<uint32_t> mask;
+    std::vector<uint32_t> color;
+    bool ok = readBits(info.hbmMask, mono ? height * 2 : height, mask);
+    if (ok && !mono) ok = readBits(info.hbmColor, height, color);
+    ReleaseDC(nullptr, dc);
+    if (!ok) return false;
+
+    const bool has_alpha = !mono && std::any_of(color.begin(), color.end(),
+                                                [](uint32_t px) { return (px >> 24) != 0; });
+
+    const int out_w = std::min(width,  static_cast<int>(cs::CURSOR_MAX_EDGE));
+    const int out_h = std::min(height, static_cast<int>(cs::CURSOR_MAX_EDGE));
+    shape.width     = static_cast<uint16_t>(out_w);
+    shape.height    = static_cast<uint16_t>(out_h);
+    shape.hotspot_x = static_cast<uint16_t>(std::min<DWORD>(info.xHotspot, out_w - 1));
+    shape.hotspot_y = static_cast<uint16_t>(std::min<DWORD>(info.yHotspot, out_h - 1));
+    shape.bgra.resize(static_cast<size_t>(out_w) * out_h * 4);
+
+    uint8_t* out = shape.bgra.data();
+    for (int y = 0; y < out_h; ++y) {
+        for (int x = 0; x < out_w; ++x, out += 4) {
+            const size_t i = static_cast<size_t>(y) * width + x;
+            const bool and_bit = (mask[i] & 0x00FFFFFF) != 0;
+            uint32_t px;
+            if (mono) {
+                const bool xor_bit = (mask[static_cast<size_t>(height) * width + i] & 0x00FFFFFF) != 0;
+                if (and_bit && !xor_bit) px = 0x00000000;          // Transparent
+                else if (!and_bit && xor_bit) px = 0xFFFFFFFF;     // White
+                else px = 0xFF000000;                              // Black, or inverted
+            } else if (has_alpha) {
+                px = color[i];
+            } else {
+                // Opaque where the AND mask is clear; where it is set a
+                // non-zero colour inverts the screen
+                px = (!and_bit || (color[i] & 0x00FFFFFF) != 0) ? (color[i] | 0xFF000000)
+                                                                 : 0x00000000;
+            }
+            out[0] = static_cast<uint8_t>(px);
+            out[1] = static_cast<uint8_t>(px >> 8);
+            out[2] = static_cast<uint8_t>(px >> 16);
+            out[3] = static_cast<uint8_t>(px >> 24);
+        }
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Construction / destruction
+// ---------------------------------------------------------------------------
+
+CursorCapture::CursorCapture() = default;
+
+CursorCapture::~CursorCapture() {
+    stop();
+}
+
+// ---------------------------------------------------------------------------
+// initialize / start / stop
+// ---------------------------------------------------------------------------
+
+bool CursorCapture::initialize() {
+#ifdef _WIN32
+    CURSORINFO info = {};
+    info.cbSize = sizeof(info);
+    available_ = GetCursorInfo(&info) != FALSE;
+    if (!available_) {
+        CS_LOG(WARN, "Cursor: GetCursorInfo failed (%lu) -- cursor stays in the video",
+               GetLastError());
+    }
+#else
+    available_ = false;
+#endif
+    return available_;
+}
+
+bool CursorCapture::start(SendFunc send_func) {
+    if (!available_ || running_.load()) return false;
+
+    send_func_   = std::move(send_func);
+    last_handle_ = nullptr;
+    current_     = 0;
+    next_slot_   = 0;
+    shapes_.fill(CursorShape{});
+    requested_hash_.store(0);
+    positions_sent_.store(0);
+    shapes_sent_.store(0);
+
+    running_.store(true);
+    poll_thread_ = std::thread(&CursorCapture::pollThread, this);
+    CS_LOG(INFO, "Cursor channel started");
+    return true;
+}
+
+void CursorCapture::stop() {
+    running_.store(false);
+    if (poll_thread_.joinable()) {
+        poll_thread_.join();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// onShapeRequest -- the viewer lacks a shape (receive thread)
+// ---------------------------------------------------------------------------
+
+void CursorCapture::onShapeRequest(const uint8_t* data, size_t len) {
+    cs::CursorRequestPacket request;
+    if (!cs::CursorRequestPacket::deserialize(data, len, request)) return;
+    if (request.shape_hash != 0) {
+        requested_hash_.store(request.shape_hash, std::memory_order_relaxed);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// pollThread
+// ---------------------------------------------------------------------------
+
+void CursorCapture::pollThread() {
+    int32_t  last_x       = INT32_MIN;
+    int32_t  last_y       = INT32_MIN;
+    bool     last_visible = false;
+    uint32_t last_hash    = 0;
+    auto     next_refresh = std::chrono::steady_clock::now();
+
+    while (running_.load()) {
+        int32_t x = 0;
+        int32_t y = 0;
+        bool visible = false;
+        bool shape_changed = false;
+        if (samplePointer(x, y, visible, shape_changed)) {
+            const CursorShape& shape = shapes_[current_];
+            if (shape_changed) sendShape(shape);
+
+            const auto now = std::chrono::steady_clock::now();
+            if (x != last_x || y != last_y || visible != last_visible ||
+                shape.hash != last_hash || now >= next_refresh) {
+                cs::CursorPositionPacket pos = {};
+                pos.type       = static_cast<uint8_t>(cs::PacketType::CURSOR_POS);
+                pos.flags      = visible ? cs::CURSOR_FLAG_VISIBLE : 0;
+                pos.sequence   = sequence_++;
+                pos.x          = static_cast<int16_t>(std::clamp<int32_t>(x, INT16_MIN, INT16_MAX));
+                pos.y          = static_cast<int16_t>(std::clamp<int32_t>(y, INT16_MIN, INT16_MAX));
+                pos.shape_hash = shape.hash;
+
+                uint8_t buf[sizeof(cs::CursorPositionPacket)];
+                send_func_(buf, pos.serializeTo(buf));
+                positions_sent_.fetch_add(1, std::memory_order_relaxed);
+
+                last_x       = x;
+                last_y       = y;
+                last_visible = visible;
+                last_hash    = shape.hash;
+                next_refresh = now + REFRESH_INTERVAL;
+            }
+        }
+
+        const uint32_t requested = requested_hash_.exchange(0, std::memory_order_relaxed);
+        if (requested != 0) {
+            if (const CursorShape* shape = findShape(requested)) sendShape(*shape);
+        }
+
+        std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// samplePointer
+// ---------------------------------------------------------------------------
+
+bool CursorCapture::samplePointer(int32_t& x, int32_t& y, bool& visible, bool& shape_changed) {
+    shape_changed = false;
+#ifdef _WIN32
+    CURSORINFO info = {};
+    info.cbSize = sizeof(info);
+    if (!GetCursorInfo(&info)) return false;
+
+    x       = info.ptScreenPos.x;
+    y       = info.ptScreenPos.y;
+    visible = (info.flags & CURSOR_SHOWING) != 0 && info.hCursor != nullptr;
+
+    if (visible && info.hCursor != last_handle_) {
+        CursorShape shape;
+        if (readCursorShape(info.hCursor, shape)) {
+            last_handle_ = info.hCursor;
+            shape.hash = hashShape(shape);
+            // A shape already sent is only named again
+            for (size_t i = 0; i < SHAPE_CACHE; ++i) {
+                if (shapes_[i].hash == shape.hash) {
+                    current_ = i;
+                    return true;
+                }
+            }
+            current_ = next_slot_;
+            next_slot_ = (next_slot_ + 1) % SHAPE_CACHE;
+            shapes_[current_] = std::move(shape);
+            shape_changed = true;
+        }
+    }
+    return true;
+#else
+    (void)x; (void)y; (void)visible;
+    return false;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// sendShape / findShape
+// ---------------------------------------------------------------------------
+
+void CursorCapture::sendShape(const CursorShape& shape) {
+    if (shape.hash == 0 || shape.bgra.empty()) return;
+
+    const size_t total  = shape.bgra.size();
+    const size_t chunks = (total + cs::CURSOR_CHUNK_BYTES - 1) / cs::CURSOR_CHUNK_BYTES;
+
+    cs::CursorShapeHeader hdr = {};
+    hdr.type        = static_cast<uint8_t>(cs::PacketType::CURSOR_SHAPE);
+    hdr.chunk_count = static_cast<uint8_t>(chunks);
+    hdr.width       = shape.width;
+    hdr.height      = shape.height;
+    hdr.hotspot_x   = shape.hotspot_x;
+    hdr.hotspot_y   = shape.hotspot_y;
+    hdr.shape_hash  = shape.hash;
+
+    uint8_t buf[sizeof(cs::CursorShapeHeader) + cs::CURSOR_CHUNK_BYTES];
+    for (size_t i = 0; i < chunks; ++i) {
+        const size_t offset = i * cs::CURSOR_CHUNK_BYTES;
+        const size_t len    = std::min(cs::CURSOR_CHUNK_BYTES, total - offset);
+        hdr.chunk_index = static_cast<uint8_t>(i);
+        const size_t hdr_len = hdr.serializeTo(buf);
+        std::memcpy(buf + hdr_len, shape.bgra.data() + offset, len);
+        send_func_(buf, hdr_len + len);
+    }
+    shapes_sent_.fetch_add(1, std::memory_order_relaxed);
+    CS_LOG(DEBUG, "Cursor: sent shape %08x (%ux%u, %zu chunks)",
+           shape.hash, shape.width, shape.height, chunks);
+}
+
+const CursorShape* CursorCapture::findShape(uint32_t hash) const {
+    for (const CursorShape& shape : shapes_) {
+        if (shape.hash == hash) return &shape;
+    }
+    return nullptr;
+}
+
+} // namespace cs::host
@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+// cursor_capture.h -- Pointer capture for the cursor channel (host side)
+//
+// Samples the pointer's position and shape on its own thread, well above
+// the video frame rate, and sends them to the viewer as cursor packets
+// (wire v4, see cs/transport/packet.h) so it can draw the cursor itself.
+// The capture backend then leaves the cursor out of the video: moving the
+// mouse costs a 12-byte position instead of an encoded frame, and the
+// cursor keeps up with the viewer's display rather than the video pipe.
+//
+// Shapes are hashed and each is sent once, when the pointer takes it; the
+// few most recent are kept to answer a viewer that missed a chunk.
+//
+// Positions are in desktop pixels of the primary display, which is the
+// output both capture backends grab.  Windows only; elsewhere
+// initialize() fails and the cursor stays in the video.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cs/transport/packet.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// CursorShape -- one pointer image
+// ---------------------------------------------------------------------------
+struct CursorShape {
+    uint32_t             hash      = 0;
+    uint16_t             width     = 0;
+    uint16_t             height    = 0;
+    uint16_t             hotspot_x = 0;
+    uint16_t             hotspot_y = 0;
+    std::vector<uint8_t> bgra;             // width * height BGRA8, straight alpha
+};
+
+class CursorCapture {
+public:
+    CursorCapture();
+    ~CursorCapture();
+
+    // Non-copyable
+    CursorCapture(const CursorCapture&) = delete;
+    CursorCapture& operator=(const CursorCapture&) = delete;
+
+    /// Callback to send one serialized cursor packet over the transport.
+    using SendFunc = std::function<void(const uint8_t* data, size_t len)>;
+
+    /// True if the pointer can be sampled on this system.
+    bool initialize();
+
+    /// Start sampling and sending.
+    bool start(SendFunc send_func);
+
+    /// Stop.
+    void stop();
+
+    /// Called when a shape request arrives from the viewer.
+    void onShapeRequest(const uint8_t* data, size_t len);
+
+    /// Positions and shape chunks sent so far.
+    uint64_t getPositionsSent() const { return positions_sent_.load(std::memory_order_relaxed); }
+    uint64_t getShapesSent() const { return shapes_sent_.load(std::memory_order_relaxed); }
+
+private:
+    // Sampling period: 4 ms keeps pace with a 240 Hz viewer display.
+    static constexpr auto POLL_INTERVAL    = std::chrono::milliseconds(4);
+    // An unchanged position is repeated this often, replacing a lost one.
+    static constexpr auto REFRESH_INTERVAL = std::chrono::milliseconds(250);
+    static constexpr size_t SHAPE_CACHE    = 8;
+
+    void pollThread();
+
+    /// Read the current pointer (Windows).  |shape_changed| is set when
+    /// it took a different image, which is then in shapes_[current_].
+    bool samplePointer(int32_t& x, int32_t& y, bool& visible, bool& shape_changed);
+
+    /// Send |shape| as chunks.
+    void sendShape(const CursorShape& shape);
+
+    /// A cached shape by hash, or null.
+    const CursorShape* findShape(uint32_t hash) const;
+
+    SendFunc          send_func_;
+    std::thread       poll_thread_;
+    std::atomic<bool> running_{false};
+    bool              available_ = false;
+
+    // Polling-thread state
+    std::array<CursorShape, SHAPE_CACHE> shapes_{};
+    size_t            current_     = 0;          // Slot of the pointer's shape
+    size_t            next_slot_   = 0;          // Slot the next new shape takes
+    void*             last_handle_ = nullptr;    // HCURSOR last read
+    uint16_t          sequence_    = 0;
+
+    // Shape the viewer asked for (0 = none); set by the receive thread
+    std::atomic<uint32_t> requested_hash_{0};
+
+    std::atomic<uint64_t> positions_sent_{0};
+    std::atomic<uint64_t> shapes_sent_{0};
+};
+
+} // namespace cs::host
@@ -18,6 +18,7 @@
 // DRM/KMS headers (provided by libdrm-dev on Jetson)
 #include <fcntl.h>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/mman.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -143,30 +144,78 @@ bool DrmCapture::initialize(int gpu_index) {
         return false;
     }
 
-    if (!mapFramebuffer()) {
+    current_ = acquireBuffer(fb_id_);
+    if (!current_) {
         release();
         return false;
     }
 
-    // Enable NVMM zero-copy if available on this platform
-    nvmm_enabled_ = platform_info_.has_nvmm;
+    // Zero-copy to NVMM once the scanout buffer is exported
+    nvmm_enabled_ = current_->dmabuf_fd >= 0;
+
+    // A relative wait for vblank 0 returns at once, and fails where the
+    // CRTC has no vblank interrupt to pace captures by.
+    drmVBlank vbl = {};
+    vbl.request.type = static_cast<drmVBlankSeqType>(DRM_VBLANK_RELATIVE | vblankPipeBits());
+    vbl.request.sequence = 0;
+    vblank_ok_ = drmWaitVBlank(drm_fd_, &vbl) == 0;
 
     return true;
 }
 
 bool DrmCapture::captureFrame(CapturedFrame& frame) {
-    if (drm_fd_ < 0 || !mapped_buffer_) {
+    if (drm_fd_ < 0 || !current_) {
         return false;
     }
 
-    // On DRM, the framebuffer is memory-mapped and continuously updated
-    // by the display controller. We just read the current state.
-    frame.gpu_ptr      = mapped_buffer_;
+    // The display controller scans out whichever framebuffer the
+    // compositor last flipped to; a flip is a new frame.  Without one,
+    // wait vblank by vblank for it, up to the update wait.  A display
+    // that has never flipped is drawn in place, so each vblank of it
+    // counts as new.
+    uint32_t fb_id = queryScanoutFb();
+    if (fb_id == 0) {
+        return false;  // CRTC switched off
+    }
+    bool is_new = fb_id != fb_id_;
+    if (!is_new && vblank_ok_ && update_wait_ms_ > 0) {
+        const auto deadline = std::chrono::steady_clock::now() +
+                              std::chrono::milliseconds(update_wait_ms_);
+        for (;;) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0 || !waitForVblank(static_cast<uint32_t>(left))) break;
+
+            fb_id = queryScanoutFb();
+            if (fb_id == 0) return false;
+            if (fb_id != fb_id_ || !flips_seen_) {
+                is_new = true;
+                break;
+            }
+        }
+    } else if (!is_new) {
+        is_new = !flips_seen_;
+    }
+
+    if (fb_id != fb_id_) {
+        ScanoutBuffer* buffer = acquireBuffer(fb_id);
+        if (!buffer) return false;
+        current_ = buffer;
+        fb_id_ = fb_id;
+        flips_seen_ = true;
+    }
+    current_->last_used = ++capture_count_;
+    if (is_new) ++change_seq_;
+
+    frame.gpu_ptr      = current_->mapped;
+    frame.memory       = getFrameMemory();
+    frame.dmabuf_fd    = current_->dmabuf_fd;
     frame.width        = buffer_width_;
     frame.height       = buffer_height_;
-    frame.pitch        = buffer_pitch_;
+    frame.pitch        = current_->pitch;
     frame.format       = FrameFormat::BGRA8;  // DRM typically provides XRGB8888
-    frame.is_new_frame = true;  // TODO: compare with previous frame hash for skip
+    frame.is_new_frame = is_new;
+    frame.change_seq   = change_seq_;
 
     // Timestamp from steady clock
     auto now = std::chrono::steady_clock::now();
@@ -178,10 +227,11 @@ bool DrmCapture::captureFrame(CapturedFrame& frame) {
 }
 
 void DrmCapture::release() {
-    if (mapped_buffer_) {
-        munmap(mapped_buffer_, buffer_height_ * buffer_pitch_);
-        mapped_buffer_ = nullptr;
+    for (ScanoutBuffer& buffer : buffers_) {
+        releaseBuffer(buffer);
     }
+    current_ = nullptr;
+    nvmm_enabled_ = false;
 
     if (drm_fd_ >= 0) {
         close(drm_fd_);
@@ -189,11 +239,15 @@ void DrmCapture::release() {
     }
 
     crtc_id_ = 0;
+    crtc_pipe_ = 0;
     connector_id_ = 0;
     fb_id_ = 0;
     buffer_width_ = 0;
     buffer_height_ = 0;
-    buffer_pitch_ = 0;
+    vblank_ok_ = false;
+    vblank_pending_ = false;
+    flips_seen_ = false;
+    capture_count_ = 0;
 }
 
 std::string DrmCapture::getName() const {
@@ -261,6 +315,14 @@ bool DrmCapture::setupCrtc() {
         drmModeFreeEncoder(encoder);
     }
 
+    // Vblank requests name the CRTC by its index
+    for (int i = 0; i < resources->count_crtcs; ++i) {
+        if (resources->crtcs[i] == crtc_id_) {
+            crtc_pipe_ = static_cast<uint32_t>(i);
+            break;
+        }
+    }
+
     // Get the current framebuffer from the CRTC
     if (crtc_id_) {
         drmModeCrtc* crtc = drmModeGetCrtc(drm_fd_, crtc_id_);
@@ -278,36 +340,131 @@ bool DrmCapture::setupCrtc() {
     return crtc_id_ != 0 && fb_id_ != 0;
 }
 
-bool DrmCapture::mapFramebuffer() {
-    if (fb_id_ == 0) return false;
+uint32_t DrmCapture::vblankPipeBits() const {
+    if (crtc_pipe_ == 0) return 0;
+    if (crtc_pipe_ == 1) return DRM_VBLANK_SECONDARY;
+    return (crtc_pipe_ << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK;
+}
+
+bool DrmCapture::waitForVblank(uint32_t timeout_ms) {
+    // Ask for an event at the next vblank, unless one asked for earlier
+    // is still to come, and wait for it on the KMS fd.
+    if (!vblank_pending_) {
+        drmVBlank vbl = {};
+        vbl.request.type = static_cast<drmVBlankSeqType>(
+            DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT | vblankPipeBits());
+        vbl.request.sequence = 1;
+        vbl.request.signal = reinterpret_cast<unsigned long>(this);
+        if (drmWaitVBlank(drm_fd_, &vbl) != 0) {
+            return false;
+        }
+        vblank_pending_ = true;
+    }
 
-    drmModeFB* fb = drmModeGetFB(drm_fd_, fb_id_);
+    struct pollfd pfd = {};
+    pfd.fd = drm_fd_;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, static_cast<int>(timeout_ms)) <= 0) {
+        return false;
+    }
+
+    drmEventContext events = {};
+    events.version = 2;
+    events.vblank_handler = [](int, unsigned int, unsigned int, unsigned int, void* user_data) {
+        static_cast<DrmCapture*>(user_data)->vblank_pending_ = false;
+    };
+    drmHandleEvent(drm_fd_, &events);
+    return !vblank_pending_;
+}
+
+uint32_t DrmCapture::queryScanoutFb() const {
+    drmModeCrtc* crtc = drmModeGetCrtc(drm_fd_, crtc_id_);
+    if (!crtc) return 0;
+    const uint32_t fb_id = crtc->buffer_id;
+    drmModeFreeCrtc(crtc);
+    return fb_id;
+}
+
+DrmCapture::ScanoutBuffer* DrmCapture::acquireBuffer(uint32_t fb_id) {
+    // Reuse the framebuffer's mapping if it has been scanned out before,
+    // else take a free slot or the one longest out of use.
+    for (ScanoutBuffer& buffer : buffers_) {
+        if (buffer.fb_id == fb_id) return &buffer;
+    }
+    ScanoutBuffer* slot = &buffers_[0];
+    for (ScanoutBuffer& buffer : buffers_) {
+        if (slot->fb_id == 0) break;
+        if (buffer.fb_id == 0 || buffer.last_used < slot->last_used) slot = &buffer;
+    }
+
+    releaseBuffer(*slot);
+    if (!mapFramebuffer(fb_id, *slot)) {
+        releaseBuffer(*slot);
+        return nullptr;
+    }
+    slot->fb_id = fb_id;
+    return slot;
+}
+
+bool DrmCapture::mapFramebuffer(uint32_t fb_id, ScanoutBuffer& buffer) {
+    if (fb_id == 0) return false;
+
+    drmModeFB* fb = drmModeGetFB(drm_fd_, fb_id);
     if (!fb) return false;
 
-    buffer_pitch_ = fb->pitch;
+    buffer.pitch = fb->pitch;
+    const uint32_t handle = fb->handle;
+    drmModeFreeFB(fb);
+
+    // Export the buffer for the encoder to import, then map it for CPU
+    // readers.  Either is enough to capture: the Jetson scanout is not
+    // always a dumb buffer that can be mapped.
+    exportFramebuffer(handle, buffer);
 
     // Create a dumb buffer map to read the framebuffer
     struct drm_mode_map_dumb map_req = {};
-    map_req.handle = fb->handle;
-
-    if (drmIoctl(drm_fd_, DRM_IOCTL_MODE_MAP_DUMB, &map_req) != 0) {
-        drmModeFreeFB(fb);
-        return false;
+    map_req.handle = handle;
+
+    if (drmIoctl(drm_fd_, DRM_IOCTL_MODE_MAP_DUMB, &map_req) == 0) {
+        size_t map_size = static_cast<size_t>(buffer_height_) * buffer.pitch;
+        void* mapped = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, drm_fd_, map_req.offset);
+        if (mapped != MAP_FAILED) {
+            buffer.mapped = mapped;
+            buffer.map_size = map_size;
+        }
     }
 
-    size_t map_size = static_cast<size_t>(buffer_height_) * buffer_pitch_;
-    mapped_buffer_ = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, drm_fd_, map_req.offset);
+    // The export and the mapping each hold the buffer; the handle
+    // drmModeGetFB() opened is no longer needed.
+    struct drm_gem_close close_req = {};
+    close_req.handle = handle;
+    drmIoctl(drm_fd_, DRM_IOCTL_GEM_CLOSE, &close_req);
 
-    drmModeFreeFB(fb);
+    return buffer.mapped != nullptr || buffer.dmabuf_fd >= 0;
+}
+
+bool DrmCapture::exportFramebuffer(uint32_t handle, ScanoutBuffer& buffer) {
+    // Only NVMM platforms have an encoder that imports DMA-BUFs.
+    if (!platform_info_.has_nvmm) return false;
 
-    if (mapped_buffer_ == MAP_FAILED) {
-        mapped_buffer_ = nullptr;
+    int fd = -1;
+    if (drmPrimeHandleToFD(drm_fd_, handle, DRM_CLOEXEC, &fd) != 0 || fd < 0) {
         return false;
     }
-
+    buffer.dmabuf_fd = fd;
     return true;
 }
 
+void DrmCapture::releaseBuffer(ScanoutBuffer& buffer) {
+    if (buffer.mapped) {
+        munmap(buffer.mapped, buffer.map_size);
+    }
+    if (buffer.dmabuf_fd >= 0) {
+        close(buffer.dmabuf_fd);
+    }
+    buffer = ScanoutBuffer{};
+}
+
 } // namespace cs::host
 
 #endif // __aarch64__
@@ -7,8 +7,12 @@
 // is not available.
 //
 // Key features:
-//   - Zero-copy path to NVMM buffers when available (Jetson unified memory)
+//   - Zero-copy path to NVMM buffers when available (Jetson unified memory):
+//     the scanout buffer is exported as a DMA-BUF (PRIME) fd that the
+//     encoder imports, so its pixels never pass through the CPU
 //   - Supports headless capture via DRM dumb buffers
+//   - Paced by vblank events on the KMS fd; a frame is new when the CRTC
+//     has flipped to another framebuffer
 //   - Cursor overlay via DRM plane or software compositing
 //   - Falls back to GStreamer nvvidconv pipeline if DRM is unavailable
 //
@@ -56,6 +60,19 @@ public:
     bool captureFrame(CapturedFrame& frame) override;
     void release() override;
     std::string getName() const override;
+    int getMaxEncodeSessions() const override { return platform_info_.max_nvenc_sessions; }
+
+    /// DMA-BUF frames once the scanout buffer is exported, else the
+    /// CPU mapping alone.
+    FrameMemory getFrameMemory() const override {
+        return nvmm_enabled_ ? FrameMemory::DMABUF : FrameMemory::SYSTEM;
+    }
+
+    /// Where the driver has vblank events, captures are taken at vblank:
+    /// captureFrame() waits vblank by vblank for the CRTC to flip to
+    /// another framebuffer, which is what makes a frame new.
+    bool waitsForUpdates() const override { return vblank_ok_; }
+    void setUpdateWait(uint32_t max_wait_ms) override { update_wait_ms_ = max_wait_ms; }
 
     /// Get the detected platform info.
     const JetsonPlatformInfo& getPlatformInfo() const { return platform_info_; }
@@ -67,14 +84,33 @@ private:
     // DRM file descriptor and resources
     int         drm_fd_       = -1;
     uint32_t    crtc_id_      = 0;
+    uint32_t    crtc_pipe_    = 0;         // Index of the CRTC, for vblank requests
     uint32_t    connector_id_ = 0;
-    uint32_t    fb_id_        = 0;
+    uint32_t    fb_id_        = 0;         // Framebuffer last captured
 
-    // Captured frame buffer
-    void*       mapped_buffer_  = nullptr;
+    // Framebuffers the CRTC scans out.  A compositor flips between two or
+    // three, so each is mapped and exported once and kept while in use.
+    struct ScanoutBuffer {
+        uint32_t fb_id     = 0;            // 0 = free slot
+        void*    mapped    = nullptr;      // CPU mapping, or null
+        size_t   map_size  = 0;
+        uint32_t pitch     = 0;
+        int      dmabuf_fd = -1;           // PRIME export, or -1
+        uint64_t last_used = 0;            // Capture count when last scanned out
+    };
+    static constexpr uint32_t MAX_SCANOUT_BUFFERS = 4;
+    ScanoutBuffer buffers_[MAX_SCANOUT_BUFFERS] = {};
+    ScanoutBuffer* current_       = nullptr;
     uint32_t    buffer_width_   = 0;
     uint32_t    buffer_height_  = 0;
-    uint32_t    buffer_pitch_   = 0;
+
+    // Vblank pacing
+    bool        vblank_ok_        = false; // The driver delivers vblank events
+    uint32_t    update_wait_ms_   = 0;
+    bool        vblank_pending_   = false; // An event is requested and not yet read
+    bool        flips_seen_       = false; // The CRTC has changed framebuffer
+    uint64_t    capture_count_    = 0;
+    uint32_t    change_seq_       = 0;
 
     // Platform detection
     JetsonPlatformInfo platform_info_;
@@ -83,7 +119,13 @@ private:
     // Internal helpers
     bool openDrmDevice(int gpu_index);
     bool setupCrtc();
-    bool mapFramebuffer();
+    uint32_t vblankPipeBits() const;
+    bool waitForVblank(uint32_t timeout_ms);
+    uint32_t queryScanoutFb() const;
+    ScanoutBuffer* acquireBuffer(uint32_t fb_id);
+    bool mapFramebuffer(uint32_t fb_id, ScanoutBuffer& buffer);
+    bool exportFramebuffer(uint32_t handle, ScanoutBuffer& buffer);
+    void releaseBuffer(ScanoutBuffer& buffer);
 };
 
 } // namespace cs::host
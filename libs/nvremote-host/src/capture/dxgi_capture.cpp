@@ -3,7 +3,8 @@
 //
 // Creates a D3D11 device, obtains the primary output, and uses
 // IDXGIOutputDuplication to capture the desktop.  The captured GPU texture
-// is copied into a CPU-readable staging texture so the encoder can read it.
+// is copied into the next of a small ring of textures on the same device;
+// the pixels never leave video memory.
 //
 // Handles DXGI_ERROR_ACCESS_LOST gracefully by recreating the duplication.
 ///////////////////////////////////////////////////////////////////////////////
@@ -11,6 +12,8 @@
 #include "dxgi_capture.h"
 #include <cs/common.h>
 
+#include <algorithm>
+
 #include <dxgi.h>
 
 #pragma comment(lib, "d3d11.lib")
@@ -88,11 +91,18 @@ bool DxgiCapture::initialize(int gpu_index) {
 
     CS_LOG(INFO, "DXGI: D3D11 device created (feature level 0x%X)", (unsigned)selectedLevel);
 
-    // --- Get the primary output (monitor 0) ---------------------------------
+    // --- Get the output to duplicate ----------------------------------------
+    output_count_ = 0;
+    ComPtr<IDXGIOutput> probe;
+    while (SUCCEEDED(adapter->EnumOutputs(output_count_, probe.ReleaseAndGetAddressOf()))) {
+        ++output_count_;
+    }
+
     ComPtr<IDXGIOutput> output;
-    hr = adapter->EnumOutputs(0, output.GetAddressOf());
+    hr = adapter->EnumOutputs(output_index_, output.GetAddressOf());
     if (FAILED(hr)) {
-        CS_LOG(ERR, "DXGI: EnumOutputs(0) failed (0x%08lX) -- no monitors?", hr);
+        CS_LOG(ERR, "DXGI: EnumOutputs(%u) failed (0x%08lX) -- %u monitor(s)",
+               output_index_, hr, output_count_);
         return false;
     }
 
@@ -108,38 +118,58 @@ bool DxgiCapture::initialize(int gpu_index) {
                                      outputDesc.DesktopCoordinates.left);
     height_ = static_cast<uint32_t>(outputDesc.DesktopCoordinates.bottom -
                                      outputDesc.DesktopCoordinates.top);
-    CS_LOG(INFO, "DXGI: output resolution %ux%u", width_, height_);
+    CS_LOG(INFO, "DXGI: output %u of %u, resolution %ux%u",
+           output_index_, output_count_, width_, height_);
 
     // --- Create the duplication ---------------------------------------------
     if (!createDuplication()) {
         return false;
     }
 
-    // --- Create staging texture for CPU readback ----------------------------
-    D3D11_TEXTURE2D_DESC stagingDesc = {};
-    stagingDesc.Width              = width_;
-    stagingDesc.Height             = height_;
-    stagingDesc.MipLevels          = 1;
-    stagingDesc.ArraySize          = 1;
-    stagingDesc.Format             = DXGI_FORMAT_B8G8R8A8_UNORM;
-    stagingDesc.SampleDesc.Count   = 1;
-    stagingDesc.SampleDesc.Quality = 0;
-    stagingDesc.Usage              = D3D11_USAGE_STAGING;
-    stagingDesc.CPUAccessFlags     = D3D11_CPU_ACCESS_READ;
-    stagingDesc.BindFlags          = 0;
-    stagingDesc.MiscFlags          = 0;
-
-    hr = device_->CreateTexture2D(&stagingDesc, nullptr, staging_.GetAddressOf());
-    if (FAILED(hr)) {
-        CS_LOG(ERR, "DXGI: CreateTexture2D (staging) failed (0x%08lX)", hr);
-        return false;
+    // --- Create the frame textures the encoder reads -----------------------
+    // NVENC registers a D3D11 input as a render-target-capable texture;
+    // the session's colour converter samples it from a shader.
+    D3D11_TEXTURE2D_DESC surfaceDesc = {};
+    surfaceDesc.Width              = width_;
+    surfaceDesc.Height             = height_;
+    surfaceDesc.MipLevels          = 1;
+    surfaceDesc.ArraySize          = 1;
+    surfaceDesc.Format             = DXGI_FORMAT_B8G8R8A8_UNORM;
+    surfaceDesc.SampleDesc.Count   = 1;
+    surfaceDesc.SampleDesc.Quality = 0;
+    surfaceDesc.Usage              = D3D11_USAGE_DEFAULT;
+    surfaceDesc.CPUAccessFlags     = 0;
+    surfaceDesc.BindFlags          = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+    surfaceDesc.MiscFlags          = 0;
+
+    for (int i = 0; i < NUM_SURFACES; ++i) {
+        hr = device_->CreateTexture2D(&surfaceDesc, nullptr, surfaces_[i].GetAddressOf());
+        if (FAILED(hr)) {
+            CS_LOG(ERR, "DXGI: CreateTexture2D (frame %d) failed (0x%08lX)", i, hr);
+            return false;
+        }
     }
+    next_surface_ = 0;
+
+    change_cols_ = (width_  + CHANGE_BLOCK - 1) / CHANGE_BLOCK;
+    change_rows_ = (height_ + CHANGE_BLOCK - 1) / CHANGE_BLOCK;
+    for (auto& map : change_maps_) map.assign(change_cols_ * change_rows_, 0);
 
     initialized_ = true;
     CS_LOG(INFO, "DXGI: Desktop Duplication initialized (%ux%u)", width_, height_);
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// selectOutput -- choose the adapter output to duplicate
+// ---------------------------------------------------------------------------
+
+bool DxgiCapture::selectOutput(uint32_t index) {
+    if (initialized_) return index == output_index_;
+    output_index_ = index;
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 // createDuplication -- (re)create the IDXGIOutputDuplication
 // ---------------------------------------------------------------------------
@@ -159,6 +189,9 @@ bool DxgiCapture::createDuplication() {
         return false;
     }
 
+    // A new duplication's rects do not follow on from the last frame's
+    ++change_seq_;
+
     CS_LOG(DEBUG, "DXGI: DuplicateOutput succeeded");
     return true;
 }
@@ -170,17 +203,12 @@ bool DxgiCapture::createDuplication() {
 bool DxgiCapture::captureFrame(CapturedFrame& frame) {
     if (!initialized_) return false;
 
-    // If we had a mapped resource from last call, unmap it.
-    if (mapped_ptr_) {
-        context_->Unmap(staging_.Get(), 0);
-        mapped_ptr_ = nullptr;
-        mapped_pitch_ = 0;
-    }
-
-    // Acquire the next frame with a short timeout.
+    // Acquire the next frame, waiting for the desktop to change for at
+    // most the update wait.
     ComPtr<IDXGIResource> desktopResource;
     DXGI_OUTDUPL_FRAME_INFO frameInfo = {};
-    HRESULT hr = duplication_->AcquireNextFrame(100, &frameInfo, desktopResource.GetAddressOf());
+    HRESULT hr = duplication_->AcquireNextFrame(update_wait_ms_, &frameInfo,
+                                                desktopResource.GetAddressOf());
 
     if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
         // No new frame.  Report duplicate.
@@ -201,7 +229,8 @@ bool DxgiCapture::captureFrame(CapturedFrame& frame) {
             return false;
         }
         // Try once more.
-        hr = duplication_->AcquireNextFrame(100, &frameInfo, desktopResource.GetAddressOf());
+        hr = duplication_->AcquireNextFrame(update_wait_ms_, &frameInfo,
+                                            desktopResource.GetAddressOf());
         if (FAILED(hr)) {
             CS_LOG(DEBUG, "DXGI: AcquireNextFrame still failing after recreate (0x%08lX)", hr);
             return false;
@@ -220,47 +249,111 @@ bool DxgiCapture::captureFrame(CapturedFrame& frame) {
         return false;
     }
 
-    // Copy the desktop texture into our staging texture.
-    context_->CopyResource(staging_.Get(), desktopTex.Get());
+    // GPU copy into the next frame texture.  The flush submits it now
+    // rather than whenever the context next fills up, so the encoder's
+    // read of the texture is not held behind it.
+    const int        index   = next_surface_;
+    ID3D11Texture2D* surface = surfaces_[index].Get();
+    next_surface_ = (next_surface_ + 1) % NUM_SURFACES;
+    context_->CopyResource(surface, desktopTex.Get());
+    context_->Flush();
+
+    // The rects are only readable while the frame is held.
+    const bool have_map = buildChangeMap(frameInfo, change_maps_[index]);
+    ++change_seq_;
 
     // Release the DXGI frame as soon as we've copied it.
     duplication_->ReleaseFrame();
 
-    // Map the staging texture for CPU read access.
-    D3D11_MAPPED_SUBRESOURCE mapped = {};
-    hr = context_->Map(staging_.Get(), 0, D3D11_MAP_READ, 0, &mapped);
-    if (FAILED(hr)) {
-        CS_LOG(ERR, "DXGI: Map staging texture failed (0x%08lX)", hr);
-        return false;
-    }
-
-    mapped_ptr_   = mapped.pData;
-    mapped_pitch_ = mapped.RowPitch;
-
     // Fill the output frame.
-    frame.gpu_ptr      = mapped_ptr_;
+    frame.gpu_ptr      = surface;
+    frame.memory       = FrameMemory::D3D11;
     frame.width        = width_;
     frame.height       = height_;
-    frame.pitch        = mapped_pitch_;
+    frame.pitch        = 0;           // Texture: no CPU row pitch
     frame.format       = FrameFormat::BGRA8;
     frame.timestamp_us = cs::getTimestampUs();
     frame.is_new_frame = true;
+    frame.change_map   = have_map ? change_maps_[index].data() : nullptr;
+    frame.change_block = CHANGE_BLOCK;
+    frame.change_cols  = change_cols_;
+    frame.change_rows  = change_rows_;
+    frame.change_seq   = change_seq_;
 
     return true;
 }
 
 // ---------------------------------------------------------------------------
-// release -- tear down all D3D11 / DXGI resources
+// buildChangeMap -- rasterize the frame's dirty and move rects
 // ---------------------------------------------------------------------------
 
-void DxgiCapture::release() {
-    if (mapped_ptr_ && staging_ && context_) {
-        context_->Unmap(staging_.Get(), 0);
-        mapped_ptr_ = nullptr;
+bool DxgiCapture::buildChangeMap(const DXGI_OUTDUPL_FRAME_INFO& info,
+                                 std::vector<uint8_t>& map) {
+    std::fill(map.begin(), map.end(), 0);
+
+    // Only the pointer moved: the image is unchanged.
+    if (info.LastPresentTime.QuadPart == 0) return true;
+    if (info.TotalMetadataBufferSize == 0) return false;
+
+    if (metadata_.size() < info.TotalMetadataBufferSize) {
+        metadata_.resize(info.TotalMetadataBufferSize);
     }
 
+    UINT move_bytes = 0;
+    HRESULT hr = duplication_->GetFrameMoveRects(
+        info.TotalMetadataBufferSize,
+        reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(metadata_.data()), &move_bytes);
+    if (FAILED(hr)) return false;
+
+    UINT dirty_bytes = 0;
+    hr = duplication_->GetFrameDirtyRects(
+        info.TotalMetadataBufferSize - move_bytes,
+        reinterpret_cast<RECT*>(metadata_.data() + move_bytes), &dirty_bytes);
+    if (FAILED(hr)) return false;
+
+    auto mark = [&](const RECT& r) {
+        const LONG left   = std::max<LONG>(r.left, 0);
+        const LONG top    = std::max<LONG>(r.top, 0);
+        const LONG right  = std::min<LONG>(r.right,  static_cast<LONG>(width_));
+        const LONG bottom = std::min<LONG>(r.bottom, static_cast<LONG>(height_));
+        if (right <= left || bottom <= top) return;
+        const uint32_t col_end = (static_cast<uint32_t>(right) + CHANGE_BLOCK - 1) / CHANGE_BLOCK;
+        const uint32_t row_end = (static_cast<uint32_t>(bottom) + CHANGE_BLOCK - 1) / CHANGE_BLOCK;
+        for (uint32_t row = static_cast<uint32_t>(top) / CHANGE_BLOCK; row < row_end; ++row) {
+            uint8_t* line = map.data() + row * change_cols_;
+            for (uint32_t col = static_cast<uint32_t>(left) / CHANGE_BLOCK; col < col_end; ++col) {
+                line[col] = 1;
+            }
+        }
+    };
+
+    // A move only changes where the pixels land; the area they left is
+    // reported among the dirty rects.
+    const auto* moves = reinterpret_cast<const DXGI_OUTDUPL_MOVE_RECT*>(metadata_.data());
+    for (UINT i = 0; i < move_bytes / sizeof(DXGI_OUTDUPL_MOVE_RECT); ++i) {
+        const RECT dest = {
+            moves[i].DestinationPoint.x,
+            moves[i].DestinationPoint.y,
+            moves[i].DestinationPoint.x + (moves[i].SourceRect.right - moves[i].SourceRect.left),
+            moves[i].DestinationPoint.y + (moves[i].SourceRect.bottom - moves[i].SourceRect.top),
+        };
+        mark(dest);
+    }
+
+    const auto* dirty = reinterpret_cast<const RECT*>(metadata_.data() + move_bytes);
+    for (UINT i = 0; i < dirty_bytes / sizeof(RECT); ++i) {
+        mark(dirty[i]);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// release -- tear down all D3D11 / DXGI resources
+// ---------------------------------------------------------------------------
+
+void DxgiCapture::release() {
     duplication_.Reset();
-    staging_.Reset();
+    for (auto& surface : surfaces_) surface.Reset();
     output1_.Reset();
     context_.Reset();
     device_.Reset();
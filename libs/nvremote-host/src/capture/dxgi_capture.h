@@ -5,8 +5,17 @@
 // capture the desktop.  This works on any Windows 8+ system with a D3D11
 // capable GPU.  It's the universal fallback when NvFBC is not available.
 //
-// The captured frame is a D3D11 staging texture mapped into system memory.
-// Output format is always BGRA8.
+// Each desktop image is copied on the GPU into one of a few D3D11 textures
+// the capture owns, so the duplication frame can be released at once and
+// the encoder, opened on the same device, reads the copy in place.
+// Output format is always BGRA8; the session converts it to YUV on the
+// GPU (see encode/color_converter.h).
+//
+// The duplication's dirty and move rects are rasterized into a per-surface
+// change map (CHANGE_BLOCK pixel blocks) that travels with the frame.
+//
+// Any of the adapter's outputs can be duplicated (selectOutput()); each
+// DxgiCapture has a device and duplication of its own.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
@@ -20,6 +29,8 @@
 #include <dxgi1_2.h>
 #include <wrl/client.h>   // Microsoft::WRL::ComPtr
 
+#include <vector>
+
 namespace cs::host {
 
 using Microsoft::WRL::ComPtr;
@@ -34,25 +45,47 @@ public:
     void release() override;
     std::string getName() const override { return "DXGI"; }
 
+    FrameMemory getFrameMemory() const override { return FrameMemory::D3D11; }
+    void* getFrameDevice() const override { return device_.Get(); }
+    uint32_t getSurfaceCount() const override { return NUM_SURFACES; }
+    bool waitsForUpdates() const override { return true; }
+    void setUpdateWait(uint32_t max_wait_ms) override { update_wait_ms_ = max_wait_ms; }
+    uint32_t getOutputCount() const override { return output_count_; }
+    bool selectOutput(uint32_t index) override;
+
 private:
     /// (Re-)create the duplication object.  Called on init and after
     /// DXGI_ERROR_ACCESS_LOST (desktop switch, UAC, lock screen, etc.).
     bool createDuplication();
 
+    /// Fill |map| from the acquired frame's dirty and move rects.  False
+    /// if they could not be read, so what changed is unknown.
+    bool buildChangeMap(const DXGI_OUTDUPL_FRAME_INFO& info, std::vector<uint8_t>& map);
+
     ComPtr<ID3D11Device>            device_;
     ComPtr<ID3D11DeviceContext>     context_;
     ComPtr<IDXGIOutputDuplication>  duplication_;
     ComPtr<IDXGIOutput1>           output1_;
 
-    /// Staging texture used to copy GPU frames to CPU-readable memory.
-    ComPtr<ID3D11Texture2D>         staging_;
+    /// Textures frames are handed out in, used in turn: one being written
+    /// while the encoder may still hold the previous ones.
+    static constexpr int NUM_SURFACES = 3;
+    ComPtr<ID3D11Texture2D>         surfaces_[NUM_SURFACES];
+    int                             next_surface_ = 0;
+
+    /// Change map granularity: one H.264 macroblock.
+    static constexpr uint32_t CHANGE_BLOCK = 16;
+    std::vector<uint8_t>            change_maps_[NUM_SURFACES];
+    std::vector<uint8_t>            metadata_;   // Move + dirty rects of a frame
+    uint32_t                        change_cols_ = 0;
+    uint32_t                        change_rows_ = 0;
+    uint32_t                        change_seq_  = 0;
     uint32_t                        width_   = 0;
     uint32_t                        height_  = 0;
+    uint32_t                        update_wait_ms_ = 100;   // AcquireNextFrame() timeout
+    uint32_t                        output_index_ = 0;       // Adapter output duplicated
+    uint32_t                        output_count_ = 1;       // Outputs on the adapter
     bool                            initialized_ = false;
-
-    /// Pointer to the mapped staging texture data (valid between capture calls).
-    void*                           mapped_ptr_  = nullptr;
-    uint32_t                        mapped_pitch_ = 0;
 };
 
 } // namespace cs::host
@@ -133,12 +133,17 @@ bool NvfbcCapture::captureFrame(CapturedFrame& frame) {
     NVFBC_FRAME_GRAB_INFO grabInfo = {};
     NvFBCStatus st;
 
+    // With no update wait the grab takes whatever is on screen now;
+    // otherwise it returns at once with a new frame, or waits for one.
+    const bool wait = update_wait_ms_ > 0;
+
     if (use_cuda_) {
         NVFBC_TOCUDA_GRAB_FRAME_PARAMS params = {};
         params.dwVersion       = NVFBC_STRUCT_VERSION(NVFBC_TOCUDA_GRAB_FRAME_PARAMS, 1);
-        params.dwFlags         = NVFBC_TOCUDA_GRAB_FLAGS_NOWAIT_IF_NEW;
+        params.dwFlags         = wait ? NVFBC_TOCUDA_GRAB_FLAGS_NOWAIT_IF_NEW
+                                      : NVFBC_TOCUDA_GRAB_FLAGS_NOWAIT;
         params.pFrameGrabInfo  = &grabInfo;
-        params.dwTimeoutMs     = 100;
+        params.dwTimeoutMs     = update_wait_ms_;
 
         st = api_.nvFBCToCudaGrabFrame(handle_, &params);
         if (st != NVFBC_SUCCESS) {
@@ -151,15 +156,17 @@ bool NvfbcCapture::captureFrame(CapturedFrame& frame) {
 
         cuda_buffer_ = params.pCUDADeviceBuffer;
         frame.gpu_ptr      = cuda_buffer_;
-        frame.format       = FrameFormat::NV12;
-        // Pitch for NV12: width bytes for luma plane
+        frame.memory       = FrameMemory::CUDA;
+        frame.format       = cuda_format_;
+        // One byte per pixel in each plane (NV12 or planar 4:4:4)
         frame.pitch        = grabInfo.dwWidth;
     } else {
         NVFBC_TOSYS_GRAB_FRAME_PARAMS params = {};
         params.dwVersion       = NVFBC_STRUCT_VERSION(NVFBC_TOSYS_GRAB_FRAME_PARAMS, 1);
-        params.dwFlags         = NVFBC_TOSYS_GRAB_FLAGS_NOWAIT_IF_NEW;
+        params.dwFlags         = wait ? NVFBC_TOSYS_GRAB_FLAGS_NOWAIT_IF_NEW
+                                      : NVFBC_TOSYS_GRAB_FLAGS_NOWAIT;
         params.pFrameGrabInfo  = &grabInfo;
-        params.dwTimeoutMs     = 100;
+        params.dwTimeoutMs     = update_wait_ms_;
 
         st = api_.nvFBCToSysGrabFrame(handle_, &params);
         if (st != NVFBC_SUCCESS) {
@@ -171,8 +178,18 @@ bool NvfbcCapture::captureFrame(CapturedFrame& frame) {
         }
 
         frame.gpu_ptr      = sys_buffer_;
+        frame.memory       = FrameMemory::SYSTEM;
         frame.format       = FrameFormat::BGRA8;
         frame.pitch        = grabInfo.dwWidth * 4;  // 4 bytes per pixel for BGRA
+
+        // The diff map covers the changes since the previous grab
+        if (grabInfo.bIsNewFrame) ++change_seq_;
+        frame.change_map   = grabInfo.bIsNewFrame ? static_cast<const uint8_t*>(diff_map_)
+                                                  : nullptr;
+        frame.change_block = DIFF_MAP_BLOCK;
+        frame.change_cols  = (grabInfo.dwWidth  + DIFF_MAP_BLOCK - 1) / DIFF_MAP_BLOCK;
+        frame.change_rows  = (grabInfo.dwHeight + DIFF_MAP_BLOCK - 1) / DIFF_MAP_BLOCK;
+        frame.change_seq   = change_seq_;
     }
 
     frame.width        = grabInfo.dwWidth;
@@ -186,6 +203,95 @@ bool NvfbcCapture::captureFrame(CapturedFrame& frame) {
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// setCursorComposited -- the cursor is fixed when the session is created
+// ---------------------------------------------------------------------------
+
+bool NvfbcCapture::setCursorComposited(bool composited) {
+    if (composited == with_cursor_) return true;
+    with_cursor_ = composited;
+    if (!initialized_) return true;
+
+    if (!recreateSession()) {
+        CS_LOG(WARN, "NvFBC: cannot capture %s the cursor -- keeping the previous mode",
+               composited ? "with" : "without");
+        with_cursor_ = !composited;
+        if (!recreateSession()) {
+            CS_LOG(ERR, "NvFBC: failed to recreate the capture session");
+            initialized_ = false;
+        }
+        return false;
+    }
+    CS_LOG(INFO, "NvFBC: capturing %s the cursor", composited ? "with" : "without");
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// setOutputFormat -- NvFBC converts ToCUDA frames to NV12 or planar 4:4:4
+// ---------------------------------------------------------------------------
+
+bool NvfbcCapture::setOutputFormat(FrameFormat format) {
+    if (!use_cuda_) return format == FrameFormat::BGRA8;
+    if (format != FrameFormat::NV12 && format != FrameFormat::YUV444) return false;
+    if (format == cuda_format_) return true;
+
+    const FrameFormat previous = cuda_format_;
+    cuda_format_ = format;
+    if (!initialized_) return true;
+
+    if (!recreateSession()) {
+        CS_LOG(WARN, "NvFBC: cannot capture %s -- keeping the previous format",
+               format == FrameFormat::YUV444 ? "4:4:4" : "NV12");
+        cuda_format_ = previous;
+        if (!recreateSession()) {
+            CS_LOG(ERR, "NvFBC: failed to recreate the capture session");
+            initialized_ = false;
+        }
+        return false;
+    }
+    CS_LOG(INFO, "NvFBC: capturing %s", format == FrameFormat::YUV444 ? "4:4:4" : "NV12");
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// setOutputSize -- NvFBC scales as it grabs, to the session's frame size
+// ---------------------------------------------------------------------------
+
+bool NvfbcCapture::setOutputSize(uint32_t width, uint32_t height) {
+    if (width == out_width_ && height == out_height_) return true;
+
+    const uint32_t previous_width  = out_width_;
+    const uint32_t previous_height = out_height_;
+    out_width_  = width;
+    out_height_ = height;
+    if (!initialized_) return true;
+
+    if (!recreateSession()) {
+        CS_LOG(WARN, "NvFBC: cannot capture at %ux%u -- keeping the previous size", width, height);
+        out_width_  = previous_width;
+        out_height_ = previous_height;
+        if (!recreateSession()) {
+            CS_LOG(ERR, "NvFBC: failed to recreate the capture session");
+            initialized_ = false;
+        }
+        return false;
+    }
+    CS_LOG(INFO, "NvFBC: capturing at %ux%u", width, height);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// recreateSession -- new capture session on the same handle
+// ---------------------------------------------------------------------------
+
+bool NvfbcCapture::recreateSession() {
+    NVFBC_DESTROY_CAPTURE_SESSION_PARAMS destroyParams = {};
+    destroyParams.dwVersion = NVFBC_STRUCT_VERSION(NVFBC_DESTROY_CAPTURE_SESSION_PARAMS, 1);
+    api_.nvFBCDestroyCaptureSession(handle_, &destroyParams);
+
+    return createCaptureSession() && (use_cuda_ ? setupToCuda() : setupToSys());
+}
+
 // ---------------------------------------------------------------------------
 // release -- tear down NvFBC session, handle, and unload DLL
 // ---------------------------------------------------------------------------
@@ -209,7 +315,21 @@ void NvfbcCapture::release() {
         dll_ = nullptr;
     }
 
+#ifdef CS_HAS_CUDA
+    if (cuda_ctx_) {
+        cuDevicePrimaryCtxRelease(static_cast<CUdevice>(cuda_dev_));
+        cuda_ctx_ = nullptr;
+    }
+#endif
+
+    use_cuda_      = false;
+    push_model_    = false;
+    with_cursor_   = true;
+    cuda_format_   = FrameFormat::NV12;
+    out_width_     = 0;
+    out_height_    = 0;
     sys_buffer_    = nullptr;
+    diff_map_      = nullptr;
     cuda_buffer_   = nullptr;
     initialized_   = false;
     createInstance_ = nullptr;
@@ -270,20 +390,26 @@ bool NvfbcCapture::createCaptureSession() {
     NVFBC_CREATE_CAPTURE_SESSION_PARAMS params = {};
     params.dwVersion       = NVFBC_STRUCT_VERSION(NVFBC_CREATE_CAPTURE_SESSION_PARAMS, 1);
     params.eCaptureType    = use_cuda_ ? NVFBC_CAPTURE_TO_CUDA : NVFBC_CAPTURE_TO_SYS;
-    params.bWithCursor     = 1;
-    params.frameSize_w     = 0;   // Native resolution
-    params.frameSize_h     = 0;
-    params.dwSamplingRateMs = 16;  // ~60 fps ceiling
-    params.bPushModel      = 0;
+    params.bWithCursor     = with_cursor_ ? 1 : 0;
+    params.frameSize_w     = out_width_;   // 0 = native resolution
+    params.frameSize_h     = out_height_;
+    params.dwSamplingRateMs = 16;  // ~60 fps ceiling (sampled model only)
+    params.bPushModel      = 1;
 
     NvFBCStatus st = api_.nvFBCCreateCaptureSession(handle_, &params);
+    if (st == NVFBC_ERR_UNSUPPORTED || st == NVFBC_ERR_INVALID_PARAM) {
+        // Fall back to NvFBC sampling the desktop itself
+        params.bPushModel = 0;
+        st = api_.nvFBCCreateCaptureSession(handle_, &params);
+    }
     if (st != NVFBC_SUCCESS) {
         CS_LOG(ERR, "NvFBC: CreateCaptureSession failed: %s", nvfbcStatusString(st));
         return false;
     }
+    push_model_ = params.bPushModel != 0;
 
-    CS_LOG(DEBUG, "NvFBC: capture session created (type=%s)",
-           use_cuda_ ? "ToCUDA" : "ToSys");
+    CS_LOG(DEBUG, "NvFBC: capture session created (type=%s, %s model)",
+           use_cuda_ ? "ToCUDA" : "ToSys", push_model_ ? "push" : "sampled");
     return true;
 }
 
@@ -292,14 +418,30 @@ bool NvfbcCapture::setupToSys() {
     params.dwVersion     = NVFBC_STRUCT_VERSION(NVFBC_TOSYS_SETUP_PARAMS, 1);
     params.eBufferFormat = NVFBC_BUFFER_FORMAT_BGRA;
     params.ppBuffer      = &sys_buffer_;
+    params.bWithDiffMap  = 1;
+    params.ppDiffMap     = &diff_map_;
+    params.dwDiffMapScalingFactor = DIFF_MAP_BLOCK;
 
+    diff_map_ = nullptr;
     NvFBCStatus st = api_.nvFBCToSysSetUp(handle_, &params);
+    if (st == NVFBC_ERR_UNSUPPORTED || st == NVFBC_ERR_INVALID_PARAM) {
+        CS_LOG(INFO, "NvFBC: no diff map (%s), frames carry no change map",
+               nvfbcStatusString(st));
+        params.bWithDiffMap = 0;
+        params.ppDiffMap    = nullptr;
+        st = api_.nvFBCToSysSetUp(handle_, &params);
+    }
     if (st != NVFBC_SUCCESS) {
         CS_LOG(ERR, "NvFBC: ToSys setup failed: %s", nvfbcStatusString(st));
         return false;
     }
+    if (!params.bWithDiffMap) diff_map_ = nullptr;
+
+    // A fresh session's first map does not follow on from the last frame
+    ++change_seq_;
 
-    CS_LOG(DEBUG, "NvFBC: ToSys setup complete, buffer=%p", sys_buffer_);
+    CS_LOG(DEBUG, "NvFBC: ToSys setup complete, buffer=%p, diff map=%p",
+           sys_buffer_, diff_map_);
     return true;
 }
 
@@ -319,27 +461,38 @@ bool NvfbcCapture::setupToCuda() {
         return false;
     }
 
-    CUcontext cuCtx;
-    cr = cuDevicePrimaryCtxRetain(&cuCtx, cuDev);
+    // A recreated session reuses the context still retained from the
+    // first setup.
+    const bool retained = cuda_ctx_ != nullptr;
+    CUcontext cuCtx = static_cast<CUcontext>(cuda_ctx_);
+    if (!retained) {
+        cr = cuDevicePrimaryCtxRetain(&cuCtx, cuDev);
+    }
     if (cr == CUDA_SUCCESS) {
         cr = cuCtxSetCurrent(cuCtx);
     }
     if (cr != CUDA_SUCCESS) {
         CS_LOG(WARN, "NvFBC: cuDevicePrimaryCtxRetain failed (%d)", (int)cr);
+        if (!retained && cuCtx) cuDevicePrimaryCtxRelease(cuDev);
         return false;
     }
 
     NVFBC_TOCUDA_SETUP_PARAMS params = {};
     params.dwVersion     = NVFBC_STRUCT_VERSION(NVFBC_TOCUDA_SETUP_PARAMS, 1);
-    params.eBufferFormat = NVFBC_BUFFER_FORMAT_NV12;
+    params.eBufferFormat = cuda_format_ == FrameFormat::YUV444 ? NVFBC_BUFFER_FORMAT_YUV444P
+                                                               : NVFBC_BUFFER_FORMAT_NV12;
 
     NvFBCStatus st = api_.nvFBCToCudaSetUp(handle_, &params);
     if (st != NVFBC_SUCCESS) {
         CS_LOG(WARN, "NvFBC: ToCUDA setup failed: %s", nvfbcStatusString(st));
-        cuCtxDestroy(cuCtx);
+        if (!retained) cuDevicePrimaryCtxRelease(cuDev);
         return false;
     }
 
+    // Kept until release(): the encoder opens its session on this context.
+    cuda_ctx_ = cuCtx;
+    cuda_dev_ = static_cast<int>(cuDev);
+
     CS_LOG(DEBUG, "NvFBC: ToCUDA setup complete");
     return true;
 #else
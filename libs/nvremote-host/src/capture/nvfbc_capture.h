@@ -7,8 +7,17 @@
 // don't need to link against any .lib file.
 //
 // If CUDA is available (CS_HAS_CUDA), we use NvFBCToCUDA for zero-copy
-// capture to a CUDA device pointer that NVENC can consume directly.
+// capture to a CUDA device pointer that NVENC can consume directly; the
+// primary context it lives in is reported through getFrameDevice().
 // Otherwise we fall back to NvFBCToSys (system memory copy).
+//
+// The capture session is created in push model where the driver allows
+// it: NvFBC is told of each desktop update instead of sampling on its own
+// timer, so a grab that waits for a new frame returns as soon as one is
+// drawn.
+//
+// ToSys asks the driver for a diff map alongside each grab and hands it on
+// as the frame's change map.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
@@ -59,11 +68,12 @@ enum NvFBCCaptureType : uint32_t {
     NVFBC_CAPTURE_TO_CUDA          = 3,
 };
 
-/// Buffer format for ToSys capture.
+/// Buffer format for ToSys / ToCUDA capture.
 enum NvFBCBufferFormat : uint32_t {
     NVFBC_BUFFER_FORMAT_ARGB       = 0,
     NVFBC_BUFFER_FORMAT_RGB        = 1,
     NVFBC_BUFFER_FORMAT_NV12       = 4,
+    NVFBC_BUFFER_FORMAT_YUV444P    = 5,     // Planar Y, U, V
     NVFBC_BUFFER_FORMAT_BGRA       = 8,
 };
 
@@ -230,6 +240,16 @@ public:
     void release() override;
     std::string getName() const override { return "NvFBC"; }
 
+    FrameMemory getFrameMemory() const override {
+        return use_cuda_ ? FrameMemory::CUDA : FrameMemory::SYSTEM;
+    }
+    void* getFrameDevice() const override { return use_cuda_ ? cuda_ctx_ : nullptr; }
+    bool waitsForUpdates() const override { return push_model_; }
+    void setUpdateWait(uint32_t max_wait_ms) override { update_wait_ms_ = max_wait_ms; }
+    bool setCursorComposited(bool composited) override;
+    bool setOutputFormat(FrameFormat format) override;
+    bool setOutputSize(uint32_t width, uint32_t height) override;
+
 private:
     bool loadLibrary();
     bool createHandle();
@@ -237,19 +257,38 @@ private:
     bool setupToSys();
     bool setupToCuda();
 
+    /// Recreate the capture session with the current settings (cursor,
+    /// ToCUDA format, output size).  The CUDA context the encoder was opened on stays
+    /// retained.
+    bool recreateSession();
+
     HMODULE                             dll_           = nullptr;
     NvFBC_CreateInstance_t              createInstance_ = nullptr;
     NVFBC_API_FUNCTION_LIST             api_           = {};
     NVFBC_SESSION_HANDLE                handle_        = 0;
 
     bool                                use_cuda_      = false;
+    bool                                push_model_    = false;   // Session told of updates
+    bool                                with_cursor_   = true;    // bWithCursor of the session
     bool                                initialized_   = false;
+    uint32_t                            update_wait_ms_ = 100;    // Grab timeout for a new frame
+    uint32_t                            out_width_     = 0;       // frameSize of the session (0 = native)
+    uint32_t                            out_height_    = 0;
 
     // ToSys state
     void*                               sys_buffer_    = nullptr;
+    void*                               diff_map_      = nullptr;  // One byte per DIFF_MAP_BLOCK square; null if off
+    uint32_t                            change_seq_    = 0;
+
+    /// Diff map granularity, passed as dwDiffMapScalingFactor: the map has
+    /// one byte per scaling factor x scaling factor pixel block.
+    static constexpr uint32_t DIFF_MAP_BLOCK = 16;
 
     // ToCUDA state
     void*                               cuda_buffer_   = nullptr;  // CUdeviceptr
+    void*                               cuda_ctx_      = nullptr;  // Retained primary CUcontext
+    FrameFormat                         cuda_format_   = FrameFormat::NV12;   // Converted by NvFBC
+    int                                 cuda_dev_      = 0;        // CUdevice it belongs to
 
     // Cached frame dimensions from last grab
     uint32_t                            last_width_    = 0;
@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////////
+// synthetic_capture.cpp -- Generated frames at a fixed rate, no GPU
+///////////////////////////////////////////////////////////////////////////////
+
+#include "synthetic_capture.h"
+
+#include "cs/common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// Construction / destruction
+// ---------------------------------------------------------------------------
+
+SyntheticCapture::SyntheticCapture(uint32_t width, uint32_t height, uint32_t fps,
+                                   uint32_t scroll_px)
+    : width_(std::max<uint32_t>(width, 1)),
+      height_(std::max<uint32_t>(height, 1)),
+      interval_us_(1000000 / std::max<uint32_t>(fps, 1)),
+      scroll_px_(scroll_px) {}
+
+SyntheticCapture::~SyntheticCapture() {
+    release();
+}
+
+// ---------------------------------------------------------------------------
+// initialize
+// ---------------------------------------------------------------------------
+
+bool SyntheticCapture::initialize(int /*gpu_index*/) {
+    const size_t frame_bytes = static_cast<size_t>(width_) * height_ * 4;
+
+    if (scroll_px_ == 0) {
+        // A diagonal gradient; captureFrame() then rewrites one row per frame
+        pixels_.resize(frame_bytes);
+        for (uint32_t y = 0; y < height_; ++y) {
+            uint8_t* row = pixels_.data() + static_cast<size_t>(y) * width_ * 4;
+            for (uint32_t x = 0; x < width_; ++x) {
+                row[x * 4 + 0] = static_cast<uint8_t>(x + y);
+                row[x * 4 + 1] = static_cast<uint8_t>(x);
+                row[x * 4 + 2] = static_cast<uint8_t>(y);
+                row[x * 4 + 3] = 0xFF;
+            }
+        }
+    } else {
+        // Text-like detail: 8x16 cells of hashed dots on a gradient, the
+        // image twice over so any window of height_ rows is one frame
+        pixels_.resize(frame_bytes * 2);
+        for (uint32_t y = 0; y < height_; ++y) {
+            uint8_t* row = pixels_.data() + static_cast<size_t>(y) * width_ * 4;
+            for (uint32_t x = 0; x < width_; ++x) {
+                uint32_t h = (x / 8) * 73856093u ^ (y / 16) * 19349663u ^ (x % 8) * 83492791u ^
+                             (y % 16) * 2654435761u;
+                h ^= h >> 13;
+                const bool ink = (h & 7) == 0 && (y % 16) < 12;
+                const uint8_t base = static_cast<uint8_t>(200 + (y * 40) / height_);
+                row[x * 4 + 0] = ink ? static_cast<uint8_t>(h >> 8) : base;
+                row[x * 4 + 1] = ink ? static_cast<uint8_t>(h >> 16) : base;
+                row[x * 4 + 2] = ink ? 30 : static_cast<uint8_t>(base - (x * 30) / width_);
+                row[x * 4 + 3] = 0xFF;
+            }
+        }
+        std::memcpy(pixels_.data() + frame_bytes, pixels_.data(), frame_bytes);
+    }
+
+    next_due_us_     = getTimestampUs();
+    frames_captured_ = 0;
+    frames_skipped_  = 0;
+
+    CS_LOG(INFO, "SyntheticCapture: %ux%u every %llu us, scrolling %u px", width_, height_,
+           static_cast<unsigned long long>(interval_us_), scroll_px_);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// captureFrame
+// ---------------------------------------------------------------------------
+
+bool SyntheticCapture::captureFrame(CapturedFrame& frame) {
+    if (pixels_.empty()) return false;
+
+    uint64_t now = getTimestampUs();
+    if (now < next_due_us_) {
+        std::this_thread::sleep_for(std::chrono::microseconds(next_due_us_ - now));
+        now = getTimestampUs();
+    }
+
+    // Late by whole intervals: drop those ticks, as a missed vsync would
+    const uint64_t late = (now - next_due_us_) / interval_us_;
+    frames_skipped_ += late;
+    next_due_us_    += (late + 1) * interval_us_;
+
+    uint8_t* pixels = pixels_.data();
+    if (scroll_px_ == 0) {
+        const uint32_t y = static_cast<uint32_t>(frames_captured_ % height_);
+        std::memset(pixels + static_cast<size_t>(y) * width_ * 4,
+                    static_cast<int>(frames_captured_ & 0xFF), static_cast<size_t>(width_) * 4);
+    } else {
+        const uint64_t top = (frames_captured_ * scroll_px_) % height_;
+        pixels += static_cast<size_t>(top) * width_ * 4;
+    }
+    ++frames_captured_;
+
+    frame = CapturedFrame();
+    frame.gpu_ptr      = pixels;
+    frame.memory       = FrameMemory::SYSTEM;
+    frame.width        = width_;
+    frame.height       = height_;
+    frame.pitch        = width_ * 4;
+    frame.format       = FrameFormat::BGRA8;
+    frame.timestamp_us = now;
+    frame.is_new_frame = true;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// release
+// ---------------------------------------------------------------------------
+
+void SyntheticCapture::release() {
+    pixels_.clear();
+    pixels_.shrink_to_fit();
+}
+
+} // namespace cs::host
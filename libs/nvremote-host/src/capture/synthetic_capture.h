@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////
+// synthetic_capture.h -- Generated frames at a fixed rate, no GPU
+//
+// Stands in for a real capture backend where there is no display or GPU
+// (CI containers, the loopback pipeline benchmark): captureFrame() waits
+// for the next tick of a steady clock at the configured frame rate and
+// hands out a small BGRA frame in system memory whose pixels change every
+// frame.  A capture that falls behind skips the ticks it missed rather
+// than bursting to catch up, as a vsync-paced desktop would.
+//
+// Optionally the frame scrolls instead, a few rows a frame over textured
+// content, like a page scrolling in a browser: enough motion and detail
+// to give an encoder real work (the encode benchmark), at no copy cost.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "capture_interface.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cs::host {
+
+class SyntheticCapture : public ICaptureDevice {
+public:
+    /// Frames of |width| x |height| at |fps| frames per second, scrolling
+    /// up |scroll_px| rows a frame (0 = a still image with one row
+    /// rewritten per frame).
+    SyntheticCapture(uint32_t width, uint32_t height, uint32_t fps, uint32_t scroll_px = 0);
+    ~SyntheticCapture() override;
+
+    // Non-copyable
+    SyntheticCapture(const SyntheticCapture&) = delete;
+    SyntheticCapture& operator=(const SyntheticCapture&) = delete;
+
+    // ICaptureDevice interface
+    bool initialize(int gpu_index = 0) override;
+    bool captureFrame(CapturedFrame& frame) override;
+    void release() override;
+    std::string getName() const override { return "Synthetic"; }
+
+    /// captureFrame() blocks until the next frame is due.
+    bool waitsForUpdates() const override { return true; }
+
+    /// Frames handed out, and ticks skipped because the caller was late.
+    uint64_t getFramesCaptured() const { return frames_captured_; }
+    uint64_t getFramesSkipped() const { return frames_skipped_; }
+
+private:
+    uint32_t             width_;
+    uint32_t             height_;
+    uint64_t             interval_us_;
+    uint32_t             scroll_px_;
+    uint64_t             next_due_us_     = 0;
+    uint64_t             frames_captured_ = 0;
+    uint64_t             frames_skipped_  = 0;
+    std::vector<uint8_t> pixels_;   // Two copies of the image when scrolling
+};
+
+} // namespace cs::host
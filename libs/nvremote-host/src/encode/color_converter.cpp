@@ -0,0 +1,415 @@
+///////////////////////////////////////////////////////////////////////////////
+// color_converter.cpp -- GPU colour conversion between capture and encode
+//
+// The shaders sample the capture at each output pixel's centre, so one
+// code path converts at the capture's size and resamples for any other.
+// A 4:2:0 thread writes a 2x2 block of luma and the chroma sample that
+// covers it, averaged from the four.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "color_converter.h"
+#include <cs/common.h>
+
+#include <algorithm>
+
+#include <d3dcompiler.h>
+
+#pragma comment(lib, "d3dcompiler.lib")
+
+namespace cs::host {
+
+namespace {
+
+// BT.709 limited range.  P010 keeps its 10 bits in the top of each 16.
+const char kConvertShader[] = R"(
+cbuffer Params : register(b0) {
+    float2 texel;      // 1 / output size
+    uint2  out_size;
+};
+
+Texture2D<float4>     src     : register(t0);
+SamplerState          linear_ : register(s0);
+RWTexture2D<float>    outY    : register(u0);
+RWTexture2D<float2>   outUV   : register(u1);
+RWTexture2D<float4>   outAYUV : register(u2);
+
+static const float3 kLuma = float3(0.2126, 0.7152, 0.0722);
+
+float3 fetch(uint2 p) {
+    return src.SampleLevel(linear_, (float2(p) + 0.5) * texel, 0).rgb;
+}
+
+float lumaOf(float3 rgb) {
+    return dot(rgb, kLuma) * (219.0 / 255.0) + 16.0 / 255.0;
+}
+
+float2 chromaOf(float3 rgb) {
+    float y = dot(rgb, kLuma);
+    float2 uv = float2((rgb.b - y) / 1.8556, (rgb.r - y) / 1.5748);
+    return uv * (224.0 / 255.0) + 128.0 / 255.0;
+}
+
+float tenBit(float v) {
+    return round(saturate(v) * 1023.0) * 64.0 / 65535.0;
+}
+
+[numthreads(8, 8, 1)]
+void cs_nv12(uint3 id : SV_DispatchThreadID) {
+    uint2 p = id.xy * 2;
+    if (p.x >= out_size.x || p.y >= out_size.y) return;
+    float3 c00 = fetch(p);
+    float3 c10 = fetch(p + uint2(1, 0));
+    float3 c01 = fetch(p + uint2(0, 1));
+    float3 c11 = fetch(p + uint2(1, 1));
+    outY[p]               = lumaOf(c00);
+    outY[p + uint2(1, 0)] = lumaOf(c10);
+    outY[p + uint2(0, 1)] = lumaOf(c01);
+    outY[p + uint2(1, 1)] = lumaOf(c11);
+    outUV[id.xy] = chromaOf((c00 + c10 + c01 + c11) * 0.25);
+}
+
+[numthreads(8, 8, 1)]
+void cs_p010(uint3 id : SV_DispatchThreadID) {
+    uint2 p = id.xy * 2;
+    if (p.x >= out_size.x || p.y >= out_size.y) return;
+    float3 c00 = fetch(p);
+    float3 c10 = fetch(p + uint2(1, 0));
+    float3 c01 = fetch(p + uint2(0, 1));
+    float3 c11 = fetch(p + uint2(1, 1));
+    outY[p]               = tenBit(lumaOf(c00));
+    outY[p + uint2(1, 0)] = tenBit(lumaOf(c10));
+    outY[p + uint2(0, 1)] = tenBit(lumaOf(c01));
+    outY[p + uint2(1, 1)] = tenBit(lumaOf(c11));
+    float2 uv = chromaOf((c00 + c10 + c01 + c11) * 0.25);
+    outUV[id.xy] = float2(tenBit(uv.x), tenBit(uv.y));
+}
+
+[numthreads(8, 8, 1)]
+void cs_ayuv(uint3 id : SV_DispatchThreadID) {
+    if (id.x >= out_size.x || id.y >= out_size.y) return;
+    float3 c = fetch(id.xy);
+    float2 uv = chromaOf(c);
+    outAYUV[id.xy] = float4(uv.y, uv.x, lumaOf(c), 1.0);   // Viewed as RGBA: V U Y A
+}
+)";
+
+constexpr UINT UAV_SLOTS = 3;
+
+struct ShaderParams {
+    float    texel[2];
+    uint32_t out_size[2];
+};
+static_assert(sizeof(ShaderParams) == 16, "constant buffers are whole 16-byte registers");
+
+const char* formatName(FrameFormat format) {
+    switch (format) {
+        case FrameFormat::NV12: return "NV12";
+        case FrameFormat::AYUV: return "AYUV";
+        case FrameFormat::P010: return "P010";
+        default:                return "?";
+    }
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Construction / destruction
+// ---------------------------------------------------------------------------
+
+ColorConverter::ColorConverter() = default;
+
+ColorConverter::~ColorConverter() {
+    release();
+}
+
+// ---------------------------------------------------------------------------
+// initialize -- compile the shaders on the capture's device
+// ---------------------------------------------------------------------------
+
+bool ColorConverter::initialize(void* device) {
+    if (initialized_) return true;
+
+    auto* d3d = static_cast<ID3D11Device*>(device);
+    if (!d3d) return false;
+
+    // Plane views of NV12 / P010 need D3D11.3
+    HRESULT hr = d3d->QueryInterface(__uuidof(ID3D11Device3),
+                                     reinterpret_cast<void**>(device_.GetAddressOf()));
+    if (FAILED(hr)) {
+        CS_LOG(WARN, "ColorConverter: device lacks D3D11.3 (0x%08lX)", hr);
+        return false;
+    }
+    device_->GetImmediateContext(context_.GetAddressOf());
+
+    auto compile = [this](const char* entry, ComPtr<ID3D11ComputeShader>& shader) {
+        ComPtr<ID3DBlob> blob;
+        ComPtr<ID3DBlob> errors;
+        HRESULT chr = D3DCompile(kConvertShader, sizeof(kConvertShader) - 1, "convert",
+                                 nullptr, nullptr, entry, "cs_5_0",
+                                 D3DCOMPILE_OPTIMIZATION_LEVEL3, 0,
+                                 blob.GetAddressOf(), errors.GetAddressOf());
+        if (FAILED(chr)) {
+            CS_LOG(WARN, "ColorConverter: %s compilation failed: %s", entry,
+                   errors ? static_cast<const char*>(errors->GetBufferPointer()) : "unknown");
+            return false;
+        }
+        chr = device_->CreateComputeShader(blob->GetBufferPointer(), blob->GetBufferSize(),
+                                           nullptr, shader.GetAddressOf());
+        if (FAILED(chr)) {
+            CS_LOG(WARN, "ColorConverter: CreateComputeShader(%s) failed (0x%08lX)", entry, chr);
+            return false;
+        }
+        return true;
+    };
+    if (!compile("cs_nv12", nv12_cs_) || !compile("cs_ayuv", ayuv_cs_) ||
+        !compile("cs_p010", p010_cs_)) {
+        release();
+        return false;
+    }
+
+    D3D11_SAMPLER_DESC sd = {};
+    sd.Filter         = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+    sd.AddressU       = D3D11_TEXTURE_ADDRESS_CLAMP;
+    sd.AddressV       = D3D11_TEXTURE_ADDRESS_CLAMP;
+    sd.AddressW       = D3D11_TEXTURE_ADDRESS_CLAMP;
+    sd.ComparisonFunc = D3D11_COMPARISON_NEVER;
+    sd.MaxLOD         = D3D11_FLOAT32_MAX;
+    hr = device_->CreateSamplerState(&sd, sampler_.GetAddressOf());
+
+    if (SUCCEEDED(hr)) {
+        D3D11_BUFFER_DESC bd = {};
+        bd.ByteWidth = sizeof(ShaderParams);
+        bd.Usage     = D3D11_USAGE_DEFAULT;
+        bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        hr = device_->CreateBuffer(&bd, nullptr, params_.GetAddressOf());
+    }
+    if (FAILED(hr)) {
+        CS_LOG(WARN, "ColorConverter: sampler / constant buffer creation failed (0x%08lX)", hr);
+        release();
+        return false;
+    }
+
+    initialized_ = true;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// configure -- output format, size and texture ring
+// ---------------------------------------------------------------------------
+
+bool ColorConverter::configure(FrameFormat format, uint32_t width, uint32_t height,
+                               uint32_t surfaces) {
+    if (!initialized_ || width == 0 || height == 0) return false;
+
+    DXGI_FORMAT texture_format;
+    DXGI_FORMAT luma_format;
+    DXGI_FORMAT chroma_format = DXGI_FORMAT_UNKNOWN;
+    switch (format) {
+        case FrameFormat::NV12:
+            texture_format = DXGI_FORMAT_NV12;
+            luma_format    = DXGI_FORMAT_R8_UNORM;
+            chroma_format  = DXGI_FORMAT_R8G8_UNORM;
+            break;
+        case FrameFormat::P010:
+            texture_format = DXGI_FORMAT_P010;
+            luma_format    = DXGI_FORMAT_R16_UNORM;
+            chroma_format  = DXGI_FORMAT_R16G16_UNORM;
+            break;
+        case FrameFormat::AYUV:
+            texture_format = DXGI_FORMAT_AYUV;
+            luma_format    = DXGI_FORMAT_R8G8B8A8_UNORM;
+            break;
+        default:
+            return false;
+    }
+
+    UINT support = 0;
+    if (FAILED(device_->CheckFormatSupport(texture_format, &support)) ||
+        !(support & D3D11_FORMAT_SUPPORT_TYPED_UNORDERED_ACCESS_VIEW)) {
+        CS_LOG(WARN, "ColorConverter: the device cannot write %s from a shader", formatName(format));
+        return false;
+    }
+
+    outputs_.clear();
+    next_output_ = 0;
+
+    // NVENC registers a D3D11 input as a render-target-capable texture.
+    D3D11_TEXTURE2D_DESC td = {};
+    td.Width            = width;
+    td.Height           = height;
+    td.MipLevels        = 1;
+    td.ArraySize        = 1;
+    td.Format           = texture_format;
+    td.SampleDesc.Count = 1;
+    td.Usage            = D3D11_USAGE_DEFAULT;
+    td.BindFlags        = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_RENDER_TARGET;
+
+    outputs_.resize(std::max(surfaces, 1u));
+    for (Output& out : outputs_) {
+        HRESULT hr = device_->CreateTexture2D(&td, nullptr, out.texture.GetAddressOf());
+
+        D3D11_UNORDERED_ACCESS_VIEW_DESC1 ud = {};
+        ud.ViewDimension      = D3D11_UAV_DIMENSION_TEXTURE2D;
+        ud.Format             = luma_format;
+        ud.Texture2D.MipSlice = 0;
+        ud.Texture2D.PlaneSlice = 0;
+        if (SUCCEEDED(hr)) {
+            hr = device_->CreateUnorderedAccessView1(out.texture.Get(), &ud, out.luma.GetAddressOf());
+        }
+        if (SUCCEEDED(hr) && chroma_format != DXGI_FORMAT_UNKNOWN) {
+            ud.Format               = chroma_format;
+            ud.Texture2D.PlaneSlice = 1;
+            hr = device_->CreateUnorderedAccessView1(out.texture.Get(), &ud, out.chroma.GetAddressOf());
+        }
+        if (FAILED(hr)) {
+            CS_LOG(WARN, "ColorConverter: %s %ux%u output creation failed (0x%08lX)",
+                   formatName(format), width, height, hr);
+            outputs_.clear();
+            return false;
+        }
+    }
+
+    format_     = format;
+    width_      = width;
+    height_     = height;
+    max_width_  = width;
+    max_height_ = height;
+    updateParams();
+    CS_LOG(INFO, "ColorConverter: BGRA -> %s at %ux%u on the GPU", formatName(format), width, height);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// setOutputSize -- scale into part of the output textures
+// ---------------------------------------------------------------------------
+
+bool ColorConverter::setOutputSize(uint32_t width, uint32_t height) {
+    if (outputs_.empty() || width == 0 || height == 0 ||
+        width > max_width_ || height > max_height_) {
+        return false;
+    }
+    if (width == width_ && height == height_) return true;
+
+    width_  = width;
+    height_ = height;
+    updateParams();
+    CS_LOG(INFO, "ColorConverter: scaling to %ux%u", width, height);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// convert -- one frame into the next output texture
+// ---------------------------------------------------------------------------
+
+bool ColorConverter::convert(const CapturedFrame& in, CapturedFrame& out) {
+    if (outputs_.empty() || in.memory != FrameMemory::D3D11 ||
+        in.format != FrameFormat::BGRA8 || !in.gpu_ptr) {
+        return false;
+    }
+
+    ID3D11ShaderResourceView* srv = inputView(static_cast<ID3D11Texture2D*>(in.gpu_ptr));
+    if (!srv) return false;
+
+    Output& target = outputs_[next_output_];
+    next_output_ = (next_output_ + 1) % outputs_.size();
+
+    // Planes at u0 / u1, a packed AYUV texture at u2
+    ID3D11UnorderedAccessView* uavs[UAV_SLOTS] = {};
+    if (format_ == FrameFormat::AYUV) {
+        uavs[2] = target.luma.Get();
+    } else {
+        uavs[0] = target.luma.Get();
+        uavs[1] = target.chroma.Get();
+    }
+    context_->CSSetShader(shader(), nullptr, 0);
+    context_->CSSetShaderResources(0, 1, &srv);
+    context_->CSSetSamplers(0, 1, sampler_.GetAddressOf());
+    context_->CSSetConstantBuffers(0, 1, params_.GetAddressOf());
+    context_->CSSetUnorderedAccessViews(0, UAV_SLOTS, uavs, nullptr);
+
+    const uint32_t span = GROUP_EDGE * (format_ == FrameFormat::AYUV ? 1 : 2);
+    context_->Dispatch((width_ + span - 1) / span, (height_ + span - 1) / span, 1);
+
+    // Unbound, so the encoder may read the output and the capture may
+    // reuse its texture; the flush submits the work now, as the capture's
+    // own copy does.
+    ID3D11UnorderedAccessView* no_uavs[UAV_SLOTS] = {};
+    ID3D11ShaderResourceView*  no_srv             = nullptr;
+    context_->CSSetUnorderedAccessViews(0, UAV_SLOTS, no_uavs, nullptr);
+    context_->CSSetShaderResources(0, 1, &no_srv);
+    context_->Flush();
+
+    const bool resized = in.width != width_ || in.height != height_;
+    CapturedFrame result = in;
+    result.gpu_ptr = target.texture.Get();
+    result.format  = format_;
+    result.width   = width_;
+    result.height  = height_;
+    result.pitch   = 0;
+    if (resized) result.change_map = nullptr;   // Blocks are in capture pixels
+    out = result;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// inputView / shader / updateParams
+// ---------------------------------------------------------------------------
+
+ID3D11ShaderResourceView* ColorConverter::inputView(ID3D11Texture2D* texture) {
+    for (const Input& input : inputs_) {
+        if (input.texture == texture) return input.view.Get();
+    }
+    if (inputs_.size() >= MAX_INPUTS) inputs_.clear();
+
+    Input input;
+    input.texture = texture;
+    HRESULT hr = device_->CreateShaderResourceView(texture, nullptr, input.view.GetAddressOf());
+    if (FAILED(hr)) {
+        CS_LOG(WARN, "ColorConverter: CreateShaderResourceView failed (0x%08lX)", hr);
+        return nullptr;
+    }
+    inputs_.push_back(input);
+    return inputs_.back().view.Get();
+}
+
+ID3D11ComputeShader* ColorConverter::shader() const {
+    switch (format_) {
+        case FrameFormat::AYUV: return ayuv_cs_.Get();
+        case FrameFormat::P010: return p010_cs_.Get();
+        default:                return nv12_cs_.Get();
+    }
+}
+
+void ColorConverter::updateParams() {
+    // The shaders only address the top-left width_ x height_ of a texture
+    ShaderParams params = {};
+    params.texel[0]    = 1.0f / static_cast<float>(width_);
+    params.texel[1]    = 1.0f / static_cast<float>(height_);
+    params.out_size[0] = width_;
+    params.out_size[1] = height_;
+    context_->UpdateSubresource(params_.Get(), 0, nullptr, &params, 0, 0);
+}
+
+// ---------------------------------------------------------------------------
+// release
+// ---------------------------------------------------------------------------
+
+void ColorConverter::release() {
+    outputs_.clear();
+    inputs_.clear();
+    next_output_ = 0;
+    params_.Reset();
+    sampler_.Reset();
+    nv12_cs_.Reset();
+    ayuv_cs_.Reset();
+    p010_cs_.Reset();
+    context_.Reset();
+    device_.Reset();
+    width_       = 0;
+    height_      = 0;
+    max_width_   = 0;
+    max_height_  = 0;
+    initialized_ = false;
+}
+
+} // namespace cs::host
@@ -0,0 +1,126 @@
+///////////////////////////////////////////////////////////////////////////////
+// color_converter.h -- GPU colour conversion between capture and encode
+//
+// Turns the BGRA textures DXGI Desktop Duplication captures into the YUV
+// layout the encoder codes, on the capture's own D3D11 device, with a
+// compute shader per output format:
+//   NV12   8-bit 4:2:0
+//   AYUV   8-bit 4:4:4, packed
+//   P010   10-bit 4:2:0
+// The output may be smaller or larger than the capture; the shader
+// resamples bilinearly as it converts, so the encoder can code a lower
+// resolution without a pass of its own.  The output textures are made at
+// the largest size configured; setOutputSize() converts into a smaller
+// corner of them from the next frame on, with nothing reallocated.
+//
+// Colours are BT.709, limited range, which is what the viewer's decode
+// path assumes.  The encoder reads the result in place, as it would the
+// capture texture; the converter rotates through as many output textures
+// as the capture has surfaces, so a converted frame lives as long as a
+// captured one would.
+//
+// Conversion runs on the immediate context, on the thread that captures.
+// Windows only (the CUDA capture path has NvFBC convert as it grabs).
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "capture/capture_interface.h"
+
+#ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#include <d3d11_3.h>
+#include <wrl/client.h>   // Microsoft::WRL::ComPtr
+
+#include <cstdint>
+#include <vector>
+
+namespace cs::host {
+
+using Microsoft::WRL::ComPtr;
+
+class ColorConverter {
+public:
+    ColorConverter();
+    ~ColorConverter();
+
+    // Non-copyable
+    ColorConverter(const ColorConverter&) = delete;
+    ColorConverter& operator=(const ColorConverter&) = delete;
+
+    /// Open on |device| (an ID3D11Device*, see ICaptureDevice::getFrameDevice()).
+    /// False if the device cannot run the conversion shaders.
+    bool initialize(void* device);
+
+    /// Convert to |format| at |width| x |height| from now on, rotating
+    /// through |surfaces| output textures.  False if the device cannot
+    /// write that format from a shader.
+    bool configure(FrameFormat format, uint32_t width, uint32_t height, uint32_t surfaces);
+
+    /// Scale to |width| x |height| from the next frame on.  False (and the
+    /// size unchanged) if it is larger than configure() allocated.
+    bool setOutputSize(uint32_t width, uint32_t height);
+
+    /// Convert |in| (a BGRA8 D3D11 frame) into the next output texture and
+    /// describe it in |out|, which may be |in|.  A resized frame loses its
+    /// change map.
+    bool convert(const CapturedFrame& in, CapturedFrame& out);
+
+    FrameFormat getFormat() const { return format_; }
+    uint32_t getWidth() const { return width_; }
+    uint32_t getHeight() const { return height_; }
+
+    /// Release all D3D11 resources.
+    void release();
+
+private:
+    /// One output texture and the views its planes are written through.
+    struct Output {
+        ComPtr<ID3D11Texture2D>            texture;
+        ComPtr<ID3D11UnorderedAccessView1> luma;     // Y (or the whole AYUV texture)
+        ComPtr<ID3D11UnorderedAccessView1> chroma;   // Interleaved UV (NV12 / P010)
+    };
+
+    /// A capture texture and the view the shader reads it through.
+    struct Input {
+        ID3D11Texture2D*                 texture = nullptr;
+        ComPtr<ID3D11ShaderResourceView> view;
+    };
+
+    /// The cached view on |texture|, created the first time it is seen.
+    ID3D11ShaderResourceView* inputView(ID3D11Texture2D* texture);
+
+    /// Current shader for format_.
+    ID3D11ComputeShader* shader() const;
+
+    /// Point the shaders at a width_ x height_ output.
+    void updateParams();
+
+    // Capture surfaces seen; past this many (a mode change) all are dropped.
+    static constexpr size_t MAX_INPUTS = 8;
+    // Output pixels each thread group covers along each axis (8 x 8 threads,
+    // two pixels a thread for 4:2:0)
+    static constexpr uint32_t GROUP_EDGE = 8;
+
+    ComPtr<ID3D11Device3>         device_;
+    ComPtr<ID3D11DeviceContext>   context_;
+    ComPtr<ID3D11ComputeShader>   nv12_cs_;
+    ComPtr<ID3D11ComputeShader>   ayuv_cs_;
+    ComPtr<ID3D11ComputeShader>   p010_cs_;
+    ComPtr<ID3D11SamplerState>    sampler_;
+    ComPtr<ID3D11Buffer>          params_;
+
+    std::vector<Output>           outputs_;
+    size_t                        next_output_ = 0;
+    std::vector<Input>            inputs_;
+
+    FrameFormat                   format_ = FrameFormat::NV12;
+    uint32_t                      width_  = 0;
+    uint32_t                      height_ = 0;
+    uint32_t                      max_width_  = 0;   // Size of the output textures
+    uint32_t                      max_height_ = 0;
+    bool                          initialized_ = false;
+};
+
+} // namespace cs::host
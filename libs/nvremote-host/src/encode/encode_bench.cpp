@@ -0,0 +1,323 @@
+///////////////////////////////////////////////////////////////////////////////
+// encode_bench.cpp -- Encoder benchmark matrix (nvremote-host --encode-bench)
+///////////////////////////////////////////////////////////////////////////////
+
+#include "encode_bench.h"
+#include "gpu_monitor.h"
+
+#include "capture/synthetic_capture.h"
+#include "ipc/simple_json.h"
+
+#include "cs/common.h"
+#include "cs/qos/gaming_modes.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace cs::host {
+
+namespace {
+
+// H.264 is spec-limited to 4096 pixels a side
+constexpr uint32_t H264_MAX_DIMENSION = 4096;
+
+const cs::GamingMode BENCH_MODES[] = {
+    cs::GamingMode::Competitive, cs::GamingMode::Balanced, cs::GamingMode::Cinematic,
+    cs::GamingMode::Creative,    cs::GamingMode::CAD,      cs::GamingMode::MobileSaver,
+    cs::GamingMode::LAN,
+};
+
+const cs::Resolution BENCH_RESOLUTIONS[] = {
+    cs::Resolutions::RES_720P, cs::Resolutions::RES_1080P,
+    cs::Resolutions::RES_1440P, cs::Resolutions::RES_4K,
+};
+
+// ---------------------------------------------------------------------------
+// The matrix
+// ---------------------------------------------------------------------------
+
+struct BenchCase {
+    std::string   mode;
+    const char*   axis = "baseline";   // The setting swept away from the baseline
+    EncoderConfig config;
+};
+
+const char* refreshName(const EncoderConfig& c) {
+    if (c.enable_ltr) return "ltr";
+    return c.enable_intra_refresh ? "intra_refresh" : "gop";
+}
+
+EncoderConfig baselineConfig(CodecType codec, const cs::QosPreset& preset) {
+    EncoderConfig c;
+    c.codec            = codec;
+    c.width            = preset.target_resolution.width;
+    c.height           = preset.target_resolution.height;
+    c.fps              = preset.target_fps;
+    c.bitrate_kbps     = preset.target_bitrate_kbps;
+    c.min_bitrate_kbps = preset.min_bitrate_kbps;
+    c.max_bitrate_kbps = preset.max_bitrate_kbps;
+    c.gop_length       = preset.target_fps * 2;
+    c.yuv444           = preset.chroma == cs::ChromaMode::YUV444;
+    c.bit_depth        = preset.bit_depth;
+    c.input_format     = FrameFormat::BGRA8;
+    return c;
+}
+
+std::vector<BenchCase> buildMatrix(IEncoder& encoder) {
+    std::vector<BenchCase> cases;
+    for (CodecType codec : {CodecType::H264, CodecType::HEVC, CodecType::AV1}) {
+        if (!encoder.isCodecSupported(codec)) {
+            CS_LOG(INFO, "Encode bench: %s not supported, skipped", codecTypeName(codec));
+            continue;
+        }
+        for (cs::GamingMode mode : BENCH_MODES) {
+            const cs::QosPreset preset = cs::getPreset(mode);
+            const std::string name = cs::gamingModeToString(mode);
+            const EncoderConfig base = baselineConfig(codec, preset);
+            cases.push_back({name, "baseline", base});
+
+            for (uint32_t p = 2; p <= 7; ++p) {
+                BenchCase c{name, "preset", base};
+                c.config.preset = p;
+                cases.push_back(c);
+            }
+
+            BenchCase vbr{name, "rate_control", base};
+            vbr.config.rate_control = RateControlMode::VBR;
+            cases.push_back(vbr);
+
+            BenchCase gop{name, "refresh", base};
+            gop.config.enable_intra_refresh = false;
+            cases.push_back(gop);
+
+            BenchCase ltr{name, "refresh", base};
+            ltr.config.enable_intra_refresh = false;
+            ltr.config.enable_ltr           = true;
+            ltr.config.gop_length           = INFINITE_GOP;
+            cases.push_back(ltr);
+
+            if (codec != CodecType::H264) {
+                for (SplitEncode split : {SplitEncode::OFF, SplitEncode::TWO, SplitEncode::THREE}) {
+                    BenchCase c{name, "split", base};
+                    c.config.split_encode = split;
+                    cases.push_back(c);
+                }
+            }
+
+            for (const cs::Resolution& res : BENCH_RESOLUTIONS) {
+                if (res.width == base.width && res.height == base.height) continue;
+                if (codec == CodecType::H264 && res.width > H264_MAX_DIMENSION) continue;
+                BenchCase c{name, "resolution", base};
+                c.config.width  = res.width;
+                c.config.height = res.height;
+                cases.push_back(c);
+            }
+        }
+    }
+    return cases;
+}
+
+// ---------------------------------------------------------------------------
+// Statistics
+// ---------------------------------------------------------------------------
+
+/// Nearest-rank percentile |p| (0..1) of |values|, which it sorts.
+template <typename T>
+T percentile(std::vector<T>& values, double p) {
+    if (values.empty()) return T();
+    std::sort(values.begin(), values.end());
+    const size_t rank = static_cast<size_t>(p * static_cast<double>(values.size() - 1) + 0.5);
+    return values[std::min(rank, values.size() - 1)];
+}
+
+template <typename T>
+double mean(const std::vector<T>& values) {
+    if (values.empty()) return 0.0;
+    double sum = 0.0;
+    for (T v : values) sum += static_cast<double>(v);
+    return sum / static_cast<double>(values.size());
+}
+
+// ---------------------------------------------------------------------------
+// One configuration
+// ---------------------------------------------------------------------------
+
+/// Open |encoder| for |config|, stepping down to 4:2:0 8-bit if the
+/// picture format is refused, as SessionManager::openEncoder() does.
+bool openEncoder(IEncoder& encoder, EncoderConfig& config) {
+    encoder.setInputDevice(FrameMemory::SYSTEM, nullptr);
+    if (encoder.initialize(config)) return true;
+    if (!config.yuv444 && config.bit_depth <= 8) return false;
+    config.yuv444    = false;
+    config.bit_depth = 8;
+    return encoder.initialize(config);
+}
+
+bool runCase(IEncoder& encoder, BenchCase& bc, const GpuMonitor& gpu, bool gpu_ok,
+             const EncodeBenchOptions& opts, std::string& json) {
+    EncoderConfig& cfg = bc.config;
+    if (!openEncoder(encoder, cfg)) {
+        CS_LOG(WARN, "Encode bench: %s %s %ux%u (%s) failed to initialize",
+               codecTypeName(cfg.codec), bc.mode.c_str(), cfg.width, cfg.height, bc.axis);
+        return false;
+    }
+
+    const uint32_t engines    = encoder.getEngines();
+    const uint32_t split_ways = encoder.getSplitWays();
+
+    SyntheticCapture capture(cfg.width, cfg.height, cfg.fps, opts.scroll_px);
+    if (!capture.initialize()) {
+        encoder.release();
+        return false;
+    }
+
+    const uint32_t total       = opts.warmup + opts.frames;
+    const uint32_t idr_at      = opts.warmup + opts.frames / 2;
+    const uint32_t sample_every = std::max<uint32_t>(cfg.fps / 4, 1);
+
+    std::vector<float>    encode_ms;
+    std::vector<size_t>   delta_bytes;
+    std::vector<size_t>   key_bytes;
+    std::vector<uint32_t> gpu_pct;
+    std::vector<uint32_t> enc_pct;
+    encode_ms.reserve(opts.frames);
+    delta_bytes.reserve(opts.frames);
+    uint64_t total_bytes = 0;
+    uint32_t failures    = 0;
+    uint64_t late_before = 0;
+
+    EncodedPacket packet;
+    for (uint32_t i = 0; i < total; ++i) {
+        if (i == opts.warmup) late_before = capture.getFramesSkipped();
+
+        CapturedFrame frame;
+        if (!capture.captureFrame(frame)) break;
+        if (i == idr_at) encoder.forceIdr();
+
+        const uint64_t start_us = getTimestampUs();
+        const bool ok = encoder.encode(frame, packet);
+        const uint64_t end_us = getTimestampUs();
+
+        if (i >= opts.warmup) {
+            if (!ok) {
+                ++failures;
+            } else {
+                encode_ms.push_back(static_cast<float>(end_us - start_us) / 1000.0f);
+                (packet.is_keyframe ? key_bytes : delta_bytes).push_back(packet.size());
+                total_bytes += packet.size();
+            }
+            GpuUtilization util;
+            if (gpu_ok && (i - opts.warmup) % sample_every == 0 && gpu.sample(util)) {
+                gpu_pct.push_back(util.gpu_pct);
+                enc_pct.push_back(util.encoder_pct);
+            }
+        }
+        packet.release();
+    }
+    const uint64_t frames_late = capture.getFramesSkipped() - late_before;
+    encoder.flush();
+    encoder.release();
+
+    const double seconds      = static_cast<double>(opts.frames) / cfg.fps;
+    const double achieved     = static_cast<double>(total_bytes) * 8.0 / seconds / 1000.0;
+    const double delta_mean   = mean(delta_bytes);
+    const double key_mean     = mean(key_bytes);
+    const float  mean_ms      = static_cast<float>(mean(encode_ms));
+
+    JsonObjectWriter w;
+    w.addString("gpu",            gpu.getName());
+    w.addString("codec",          codecTypeName(cfg.codec));
+    w.addString("mode",           bc.mode);
+    w.addString("axis",           bc.axis);
+    w.addUint("width",            cfg.width);
+    w.addUint("height",           cfg.height);
+    w.addUint("fps",              cfg.fps);
+    w.addUint("preset",           cfg.preset);
+    w.addString("rate_control",   rateControlName(cfg.rate_control));
+    w.addString("refresh",        refreshName(cfg));
+    w.addString("chroma",         cfg.yuv444 ? "4:4:4" : "4:2:0");
+    w.addUint("bit_depth",        cfg.bit_depth);
+    w.addString("split_encode",   splitEncodeName(cfg.split_encode));
+    w.addUint("engines",          engines);
+    w.addUint("split_ways",       split_ways);
+    w.addUint("target_kbps",      cfg.bitrate_kbps);
+    w.addFloat("achieved_kbps",   achieved);
+    w.addUint("frames",           encode_ms.size());
+    w.addUint("failures",         failures);
+    w.addUint("frames_late",      frames_late);
+    w.addFloat("encode_ms_mean",  mean_ms);
+    w.addFloat("encode_ms_p50",   percentile(encode_ms, 0.50));
+    w.addFloat("encode_ms_p95",   percentile(encode_ms, 0.95));
+    w.addFloat("encode_ms_p99",   percentile(encode_ms, 0.99));
+    w.addFloat("encode_ms_max",   percentile(encode_ms, 1.0));
+    w.addFloat("delta_bytes_mean", delta_mean);
+    w.addUint("delta_bytes_p50",  percentile(delta_bytes, 0.50));
+    w.addUint("delta_bytes_p95",  percentile(delta_bytes, 0.95));
+    w.addUint("delta_bytes_max",  percentile(delta_bytes, 1.0));
+    w.addUint("keyframes",        key_bytes.size());
+    w.addFloat("keyframe_bytes_mean", key_mean);
+    w.addUint("keyframe_bytes_max", percentile(key_bytes, 1.0));
+    w.addFloat("keyframe_ratio",  delta_mean > 0.0 ? key_mean / delta_mean : 0.0);
+    w.addBool("gpu_sampled",      !gpu_pct.empty());
+    w.addFloat("gpu_pct_mean",    mean(gpu_pct));
+    w.addUint("gpu_pct_max",      percentile(gpu_pct, 1.0));
+    w.addFloat("nvenc_pct_mean",  mean(enc_pct));
+    w.addUint("nvenc_pct_max",    percentile(enc_pct, 1.0));
+    json = w.finish();
+
+    CS_LOG(INFO, "Encode bench: %s %-11s %-12s %ux%u@%u P%u %s %s -- enc p50 %.2f ms "
+           "p99 %.2f ms, %.0f/%u kbps, key %.1fx, nvenc %.0f%%",
+           codecTypeName(cfg.codec), bc.mode.c_str(), bc.axis, cfg.width, cfg.height, cfg.fps,
+           cfg.preset, rateControlName(cfg.rate_control), refreshName(cfg),
+           percentile(encode_ms, 0.50), percentile(encode_ms, 0.99), achieved,
+           cfg.bitrate_kbps, delta_mean > 0.0 ? key_mean / delta_mean : 0.0, mean(enc_pct));
+    return true;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// runEncodeBench
+// ---------------------------------------------------------------------------
+
+int runEncodeBench(IEncoder& encoder, const EncodeBenchOptions& options) {
+    GpuMonitor gpu;
+    const bool gpu_ok = gpu.initialize();
+    if (!gpu_ok) {
+        CS_LOG(WARN, "Encode bench: NVML unavailable, no GPU utilization figures");
+    }
+
+    std::vector<BenchCase> cases = buildMatrix(encoder);
+    CS_LOG(INFO, "=== Encode bench: %zu configurations x %u frames -> %s ===",
+           cases.size(), options.frames, options.out_path.c_str());
+
+    std::string out = "[\n";
+    size_t done = 0;
+    for (BenchCase& bc : cases) {
+        std::string json;
+        if (!runCase(encoder, bc, gpu, gpu_ok, options, json)) continue;
+        if (done++ > 0) out += ",\n";
+        out += json;
+    }
+    out += "\n]\n";
+
+    if (done == 0) {
+        CS_LOG(ERR, "Encode bench: no configuration could be run");
+        return 1;
+    }
+
+    FILE* f = std::fopen(options.out_path.c_str(), "wb");
+    if (!f) {
+        CS_LOG(ERR, "Encode bench: cannot write %s", options.out_path.c_str());
+        return 1;
+    }
+    std::fwrite(out.data(), 1, out.size(), f);
+    std::fclose(f);
+
+    CS_LOG(INFO, "=== Encode bench complete: %zu of %zu configurations -> %s ===",
+           done, cases.size(), options.out_path.c_str());
+    return 0;
+}
+
+} // namespace cs::host
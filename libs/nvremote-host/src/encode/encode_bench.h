@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////////////
+// encode_bench.h -- Encoder benchmark matrix (nvremote-host --encode-bench)
+//
+// Runs the host's encoder over a matrix of configurations and writes one
+// JSON object per configuration, as a JSON array, so per-GPU defaults for
+// getPreset() can be read off measurements instead of hand-written.
+//
+// Each supported codec (isCodecSupported) is run at the settings each
+// GamingMode's QosPreset gives it (resolution, frame rate, bitrate,
+// chroma, bit depth), and then with one setting at a time swept around
+// that baseline: the NVENC preset (P1-P7), the rate control mode, the
+// refresh scheme (periodic IDR, intra refresh, LTR with no periodic IDR),
+// split-frame encoding across NVENC engines (HEVC / AV1) and the
+// resolution.  Sweeping one axis at a time keeps the run to minutes where
+// the full product would take hours.
+//
+// Frames come from a scrolling SyntheticCapture at the configuration's
+// size and frame rate, in system memory, so every size can be measured
+// on any desktop.  Halfway through each run an IDR is forced, so every
+// configuration reports a keyframe mid-stream (what loss recovery costs),
+// not only the first picture.
+//
+// Per configuration: encode latency percentiles, delta frame and keyframe
+// size distributions, the bitrate achieved against the target, and GPU /
+// NVENC utilization from NVML where the driver provides it.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "encoder_interface.h"
+
+#include <cstdint>
+#include <string>
+
+namespace cs::host {
+
+struct EncodeBenchOptions {
+    std::string out_path     = "encode_bench.json";
+    uint32_t    frames       = 120;   // Encoded per configuration, after the warm-up
+    uint32_t    warmup       = 10;    // Frames encoded first and not measured
+    uint32_t    scroll_px    = 4;     // Content motion, rows per frame
+};
+
+/// Run the matrix on |encoder| (re-initialized for every configuration)
+/// and write the results to options.out_path.  Returns 0 on success, 1 if
+/// no configuration could be run or the file cannot be written.
+int runEncodeBench(IEncoder& encoder, const EncodeBenchOptions& options);
+
+} // namespace cs::host
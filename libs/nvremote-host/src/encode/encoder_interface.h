@@ -7,13 +7,37 @@
 //
 // The interface supports dynamic reconfiguration of bitrate and framerate
 // without tearing down the encode session -- critical for adaptive QoS.
+//
+// An encoder that writes a picture as several independently decodable
+// slices can hand each one out through encodeSliced() as soon as it is
+// written, so packetization overlaps with the rest of the encode.
+//
+// An encoder may lend a finished frame's bitstream in place, out of its own
+// output buffer, instead of copying it into EncodedPacket::data; the
+// buffer goes back to the encoder when the packet releases it.
+//
+// An encoder that cannot code the chroma format or bit depth a config asks
+// for fails initialize(), so the caller can step down to a plainer one.
+//
+// An encoder that canResize() codes each frame at the frame's own size,
+// up to the size it was initialized at: a scaler ahead of it changes the
+// coded resolution from one frame to the next, without re-initializing.
+// The first frame at a new size is an IDR, which carries the new size.
+//
+// An encoder that can keep several frames in flight also takes them
+// through submit() once startAsync() has set up its output: the next
+// frame is queued while earlier ones are still encoding, and each
+// finished one is handed to the callback on the encoder's own thread.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include "capture/capture_interface.h"
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace cs::host {
@@ -36,9 +60,78 @@ inline const char* codecTypeName(CodecType ct) {
     return "Unknown";
 }
 
+// ---------------------------------------------------------------------------
+// RateControlMode -- how the encoder holds the bitrate
+// ---------------------------------------------------------------------------
+enum class RateControlMode {
+    CBR,   // Constant: each frame near bitrate / fps (streaming default)
+    VBR,   // Variable: averages the bitrate, peaks up to max_bitrate_kbps
+};
+
+inline const char* rateControlName(RateControlMode rc) {
+    return rc == RateControlMode::VBR ? "VBR" : "CBR";
+}
+
+// ---------------------------------------------------------------------------
+// SplitEncode -- one picture coded across several encoder engines
+//
+// A GPU with more than one NVENC engine can code each picture as strips
+// on several of them at once and hand back a single bitstream, for rates
+// one engine cannot sustain (4K well above 60 fps, 8K).  HEVC and AV1
+// only.
+// ---------------------------------------------------------------------------
+enum class SplitEncode {
+    AUTO,    // Split when the pixel rate is over what one engine sustains
+    OFF,     // One engine per picture
+    TWO,     // Across two engines (or as many as there are, if fewer)
+    THREE,   // Across three
+};
+
+inline const char* splitEncodeName(SplitEncode split) {
+    switch (split) {
+        case SplitEncode::AUTO:  return "auto";
+        case SplitEncode::OFF:   return "off";
+        case SplitEncode::TWO:   return "two";
+        case SplitEncode::THREE: return "three";
+    }
+    return "auto";
+}
+
+// ---------------------------------------------------------------------------
+// ContentClass -- what the picture shows, as the session's classifier
+// sees it (qos/content_classifier.h)
+// ---------------------------------------------------------------------------
+enum class ContentClass : uint8_t {
+    UNKNOWN,   // Not classified yet
+    MOTION,    // Most of the picture moving: games, full-screen animation
+    TEXT,      // Small scattered updates: typing, scrolling, a desktop
+    VIDEO,     // Film-rate playback, or one region changing steadily
+    STATIC,    // Next to nothing changing
+};
+
+inline const char* contentClassName(ContentClass cls) {
+    switch (cls) {
+        case ContentClass::UNKNOWN: return "unknown";
+        case ContentClass::MOTION:  return "motion";
+        case ContentClass::TEXT:    return "text";
+        case ContentClass::VIDEO:   return "video";
+        case ContentClass::STATIC:  return "static";
+    }
+    return "unknown";
+}
+
 // ---------------------------------------------------------------------------
 // EncoderConfig -- parameters for encoder initialization / reconfiguration
 // ---------------------------------------------------------------------------
+
+/// gop_length value for "no periodic IDR".  Only honoured with LTR active,
+/// since acknowledged long-term references are then the recovery points;
+/// other encoders fall back to a 2-second GOP.
+static constexpr uint32_t INFINITE_GOP = 0xFFFFFFFF;
+
+/// Most frames an encoder keeps in flight through submit().
+static constexpr uint32_t MAX_ASYNC_DEPTH = 6;
+
 struct EncoderConfig {
     CodecType codec              = CodecType::H264;
     uint32_t  width              = 1920;
@@ -48,21 +141,109 @@ struct EncoderConfig {
     uint32_t  min_bitrate_kbps   = 1000;        // 1 Mbps floor
     uint32_t  fps                = 60;
     uint32_t  gop_length         = 120;          // 2 seconds at 60fps
+    uint32_t  preset             = 1;            // Speed / quality: 1 (fastest) - 7 (NVENC P1-P7)
+    RateControlMode rate_control = RateControlMode::CBR;
     bool      enable_intra_refresh = true;
     uint32_t  intra_refresh_period = 60;         // Spread IDR over 60 frames
+    bool      enable_ltr         = false;        // Long-term references (if supported)
+    uint32_t  ltr_interval       = 30;           // Frames between LTR marks
+    uint32_t  temporal_layers    = 1;            // Temporal SVC layers (1 = off; 2-3, HEVC / AV1)
+    uint32_t  slices             = 1;            // Slices per picture (1 = whole-frame output)
+    uint32_t  async_depth        = 3;            // Frames in flight with submit() (3-MAX_ASYNC_DEPTH)
+    SplitEncode split_encode     = SplitEncode::AUTO;   // Pictures across encoder engines
+    bool      use_change_map     = true;         // Favour changed regions (CapturedFrame::change_map)
+    bool      yuv444             = false;        // Full-resolution chroma (else 4:2:0)
+    uint32_t  bit_depth          = 8;            // Coded bit depth: 8 or 10
+    FrameFormat input_format     = FrameFormat::BGRA8;   // What frames arrive in
 };
 
 // ---------------------------------------------------------------------------
 // EncodedPacket -- one encoded video frame (NAL units / OBUs)
+//
+// The bitstream is either owned (data) or borrowed from the encoder
+// (borrow()); bytes() / size() cover both.  A borrowed buffer stays valid,
+// and out of the encoder's hands, until release(), the next borrow() or
+// the packet's destruction -- release it before the encoder needs the
+// buffer again (before the next encode of the same buffer, or before
+// release() of the encoder).
 // ---------------------------------------------------------------------------
 struct EncodedPacket {
-    std::vector<uint8_t> data;                   // Encoded bitstream
+    std::vector<uint8_t> data;                   // Encoded bitstream, when owned
     uint64_t             timestamp_us   = 0;     // PTS from capture
     uint32_t             frame_number   = 0;     // Monotonic frame counter
     bool                 is_keyframe    = false;  // True for IDR / CRA / Key
+    bool                 is_ltr         = false;  // Marked as a long-term reference
+    uint8_t              temporal_layer = 0;      // Temporal SVC layer (0 = base, never dropped)
     CodecType            codec          = CodecType::H264;
+
+    EncodedPacket() = default;
+    ~EncodedPacket() { release(); }
+
+    // Non-copyable (a borrowed buffer has one owner); movable
+    EncodedPacket(const EncodedPacket&) = delete;
+    EncodedPacket& operator=(const EncodedPacket&) = delete;
+    EncodedPacket(EncodedPacket&& other) noexcept { *this = std::move(other); }
+    EncodedPacket& operator=(EncodedPacket&& other) noexcept {
+        if (this == &other) return *this;
+        release();
+        data           = std::move(other.data);
+        timestamp_us   = other.timestamp_us;
+        frame_number   = other.frame_number;
+        is_keyframe    = other.is_keyframe;
+        is_ltr         = other.is_ltr;
+        temporal_layer = other.temporal_layer;
+        codec          = other.codec;
+        view_          = other.view_;
+        view_size_     = other.view_size_;
+        release_       = std::move(other.release_);
+        other.view_      = nullptr;
+        other.view_size_ = 0;
+        other.release_   = nullptr;
+        return *this;
+    }
+
+    /// The bitstream, wherever it lives.
+    const uint8_t* bytes() const { return view_ ? view_ : data.data(); }
+    size_t size() const { return view_ ? view_size_ : data.size(); }
+    bool isBorrowed() const { return view_ != nullptr; }
+
+    /// Point the packet at |len| bytes of the encoder's own buffer, which
+    /// |on_release| hands back.  Drops whatever the packet held before.
+    void borrow(const uint8_t* ptr, size_t len, std::function<void()> on_release) {
+        release();
+        data.clear();
+        view_      = ptr;
+        view_size_ = len;
+        release_   = std::move(on_release);
+    }
+
+    /// Give a borrowed buffer back to the encoder (no-op if owned).
+    void release() {
+        view_      = nullptr;
+        view_size_ = 0;
+        if (release_) {
+            std::function<void()> on_release = std::move(release_);
+            release_ = nullptr;
+            on_release();
+        }
+    }
+
+private:
+    const uint8_t*        view_      = nullptr;
+    size_t                view_size_ = 0;
+    std::function<void()> release_;
 };
 
+/// Called by encodeSliced() each time more of the frame is final:
+/// packet.data[0, |ready_bytes|) will not change again, though packet.data
+/// itself may be reallocated before the next call.
+using SliceCallback = std::function<void(size_t ready_bytes)>;
+
+/// Called on the encoder's output thread with each frame submit() took,
+/// in submission order.  |ok| is false if that frame failed to encode;
+/// |packet| is only valid during the call.
+using PacketCallback = std::function<void(EncodedPacket& packet, bool ok)>;
+
 // ---------------------------------------------------------------------------
 // IEncoder -- abstract encoder interface
 // ---------------------------------------------------------------------------
@@ -74,17 +255,102 @@ public:
     /// Must be called before encode().
     virtual bool initialize(const EncoderConfig& config) = 0;
 
+    /// Frames will arrive in |memory| on |device| (see
+    /// ICaptureDevice::getFrameDevice()).  Takes effect at the next
+    /// initialize(), which opens the encoder on that device so GPU frames
+    /// are read in place.  Encoders that only read system memory ignore it.
+    virtual void setInputDevice(FrameMemory /*memory*/, void* /*device*/) {}
+
     /// Encode a single captured frame.
     /// Returns true on success; the encoded bitstream is written to |packet|.
     virtual bool encode(const CapturedFrame& frame, EncodedPacket& packet) = 0;
 
+    /// Like encode(), but reports slices through |on_slice| while the rest
+    /// of the picture is still being encoded.  Every field of |packet| but
+    /// data is set before the first call and stays valid for the frame.
+    /// The last call covers the whole frame.  Encoders that write whole
+    /// frames call it once, after encoding.
+    virtual bool encodeSliced(const CapturedFrame& frame, EncodedPacket& packet,
+                              const SliceCallback& on_slice) {
+        if (!encode(frame, packet)) return false;
+        on_slice(packet.data.size());
+        return true;
+    }
+
+    /// Slices per picture the encoder actually produces (1 = whole frames,
+    /// which encodeSliced() cannot start sending early).
+    virtual uint32_t getSliceCount() const { return 1; }
+
+    /// Start handing finished frames from submit() to |on_packet|.  Returns
+    /// false if the encoder only encodes synchronously, which encode()
+    /// then stays the way to use it.  encode() is not available while
+    /// asynchronous output runs.
+    virtual bool startAsync(PacketCallback /*on_packet*/) { return false; }
+
+    /// Queue |frame| for encoding.  Blocks while EncoderConfig::async_depth
+    /// frames (at least 3) are already in flight.  Frame data is read before the frame
+    /// comes back through the callback, so a GPU surface must stay
+    /// untouched until then; system memory is copied before returning.
+    virtual bool submit(const CapturedFrame& /*frame*/) { return false; }
+
+    /// Wait for every submitted frame to come out, then stop the output.
+    virtual void stopAsync() {}
+
+    /// Frames submitted and not yet handed to the callback.
+    virtual uint32_t getInFlight() const { return 0; }
+
     /// Dynamically reconfigure the encoder (bitrate / fps / GOP).
     /// Does NOT require session recreation -- uses NvEncReconfigureEncoder.
+    /// The coded size follows the frames (see canResize()), not |config|.
     virtual bool reconfigure(const EncoderConfig& config) = 0;
 
+    /// Start a new coded stream with |config| on the open session, as a
+    /// fresh initialize() would but without reopening it: the next frame
+    /// is an IDR, and no reference, acknowledgement or frame number carries
+    /// over.  Only the rate (bitrate, frame rate, LTR interval) may differ
+    /// from the open session; returns false for anything else, or if the
+    /// encoder is not open, and the caller then initialize()s.
+    virtual bool restart(const EncoderConfig& /*config*/) { return false; }
+
+    /// Whether frames smaller than the initialized size are coded at
+    /// their own size.  Where not, every frame must be that size.
+    virtual bool canResize() const { return false; }
+
     /// Force the next encoded frame to be an IDR keyframe.
     virtual void forceIdr() = 0;
 
+    /// Mark encoded frames |first_frame| .. |last_frame| (EncodedPacket
+    /// frame numbers, inclusive) as lost, so the next frame predicts only
+    /// from older references still held by the decoder.  Returns false if
+    /// the encoder cannot do that (no support, or no older reference is
+    /// left); the caller should then fall back to forceIdr().
+    virtual bool invalidateRefFrames(uint32_t /*first_frame*/, uint32_t /*last_frame*/) {
+        return false;
+    }
+
+    /// The client decoded long-term reference frame |frame| (EncodedPacket
+    /// frame number).  In LTR mode it becomes the frame invalidateRefFrames()
+    /// recovers from.
+    virtual void acknowledgeFrame(uint32_t /*frame*/) {}
+
+    /// Temporal layers the encoder actually produces (1 = none), which may
+    /// be fewer than EncoderConfig::temporal_layers asked for.
+    virtual uint32_t getTemporalLayers() const { return 1; }
+
+    /// Encoder engines the device has, and how many each picture is split
+    /// across (1 = one engine codes it whole; see SplitEncode).
+    virtual uint32_t getEngines() const { return 1; }
+    virtual uint32_t getSplitWays() const { return 1; }
+
+    /// Cap the size of the next frame at |delta_bytes|, or |keyframe_bytes|
+    /// if it is a keyframe (0 = only the rate control's own limit).
+    /// Encoders without per-frame size control ignore it.
+    virtual void setFrameBudget(size_t /*delta_bytes*/, size_t /*keyframe_bytes*/) {}
+
+    /// Tune for |cls| from the next frame on, with nothing that needs a
+    /// keyframe.  Thread-safe; encoders with nothing to tune ignore it.
+    virtual void setContentClass(ContentClass /*cls*/) {}
+
     /// Flush any pending frames from the encoder pipeline.
     virtual void flush() = 0;
 
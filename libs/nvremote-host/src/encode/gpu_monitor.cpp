@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpu_monitor.cpp -- GPU and NVENC utilization through NVML
+///////////////////////////////////////////////////////////////////////////////
+
+#include "gpu_monitor.h"
+
+#include "cs/common.h"
+
+#ifdef _WIN32
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <Windows.h>
+#else
+#  include <dlfcn.h>
+#endif
+
+namespace cs::host {
+
+namespace {
+
+constexpr int NVML_SUCCESS = 0;
+
+// nvmlUtilization_t
+struct NvmlUtilization {
+    unsigned gpu;
+    unsigned memory;
+};
+
+void* loadNvml() {
+#ifdef _WIN32
+    return reinterpret_cast<void*>(LoadLibraryA("nvml.dll"));
+#else
+    return dlopen("libnvidia-ml.so.1", RTLD_NOW);
+#endif
+}
+
+void* nvmlSymbol(void* lib, const char* name) {
+#ifdef _WIN32
+    return reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(lib), name));
+#else
+    return dlsym(lib, name);
+#endif
+}
+
+void unloadNvml(void* lib) {
+#ifdef _WIN32
+    FreeLibrary(static_cast<HMODULE>(lib));
+#else
+    dlclose(lib);
+#endif
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Construction / destruction
+// ---------------------------------------------------------------------------
+
+GpuMonitor::~GpuMonitor() {
+    release();
+}
+
+// ---------------------------------------------------------------------------
+// initialize
+// ---------------------------------------------------------------------------
+
+bool GpuMonitor::initialize(unsigned gpu_index) {
+    release();
+
+    lib_ = loadNvml();
+    if (!lib_) {
+        CS_LOG(DEBUG, "GpuMonitor: NVML not available");
+        return false;
+    }
+
+    auto init      = reinterpret_cast<NvmlInit_t>(nvmlSymbol(lib_, "nvmlInit_v2"));
+    auto getHandle = reinterpret_cast<NvmlGetHandle_t>(
+        nvmlSymbol(lib_, "nvmlDeviceGetHandleByIndex_v2"));
+    auto getName   = reinterpret_cast<NvmlGetName_t>(nvmlSymbol(lib_, "nvmlDeviceGetName"));
+    shutdown_      = reinterpret_cast<NvmlShutdown_t>(nvmlSymbol(lib_, "nvmlShutdown"));
+    get_util_      = reinterpret_cast<NvmlGetUtil_t>(
+        nvmlSymbol(lib_, "nvmlDeviceGetUtilizationRates"));
+    get_enc_util_  = reinterpret_cast<NvmlGetEncUtil_t>(
+        nvmlSymbol(lib_, "nvmlDeviceGetEncoderUtilization"));
+
+    if (!init || !getHandle || !shutdown_ || !get_util_ || !get_enc_util_) {
+        CS_LOG(WARN, "GpuMonitor: NVML exports missing");
+        unloadNvml(lib_);
+        lib_      = nullptr;
+        shutdown_ = nullptr;
+        return false;
+    }
+
+    if (init() != NVML_SUCCESS) {
+        CS_LOG(WARN, "GpuMonitor: nvmlInit failed");
+        unloadNvml(lib_);
+        lib_      = nullptr;
+        shutdown_ = nullptr;
+        return false;
+    }
+    if (getHandle(gpu_index, &device_) != NVML_SUCCESS) {
+        CS_LOG(WARN, "GpuMonitor: no GPU %u", gpu_index);
+        release();
+        return false;
+    }
+
+    char name[96] = {};
+    if (getName && getName(device_, name, sizeof(name)) == NVML_SUCCESS) {
+        name_ = name;
+    }
+    CS_LOG(INFO, "GpuMonitor: %s", name_.empty() ? "GPU" : name_.c_str());
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// release
+// ---------------------------------------------------------------------------
+
+void GpuMonitor::release() {
+    if (lib_) {
+        if (shutdown_) shutdown_();
+        unloadNvml(lib_);
+    }
+    lib_          = nullptr;
+    device_       = nullptr;
+    shutdown_     = nullptr;
+    get_util_     = nullptr;
+    get_enc_util_ = nullptr;
+    name_.clear();
+}
+
+// ---------------------------------------------------------------------------
+// sample
+// ---------------------------------------------------------------------------
+
+bool GpuMonitor::sample(GpuUtilization& out) const {
+    if (!device_) return false;
+
+    NvmlUtilization util = {};
+    unsigned enc = 0;
+    unsigned period_us = 0;
+    if (get_util_(device_, &util) != NVML_SUCCESS ||
+        get_enc_util_(device_, &enc, &period_us) != NVML_SUCCESS) {
+        return false;
+    }
+    out.gpu_pct     = util.gpu;
+    out.memory_pct  = util.memory;
+    out.encoder_pct = enc;
+    return true;
+}
+
+} // namespace cs::host
@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpu_monitor.h -- GPU and NVENC utilization through NVML
+//
+// NVML ships with the NVIDIA driver and is loaded dynamically at runtime
+// (nvml.dll / libnvidia-ml.so.1), like NVENC itself, so the host starts
+// without it.  Without the library, or on a GPU it cannot query,
+// initialize() fails and the caller goes without utilization figures.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// GpuUtilization -- one sample, percentages over NVML's sampling period
+// ---------------------------------------------------------------------------
+struct GpuUtilization {
+    uint32_t gpu_pct     = 0;   // Graphics / compute engines
+    uint32_t memory_pct  = 0;   // Memory controller
+    uint32_t encoder_pct = 0;   // NVENC
+};
+
+// ---------------------------------------------------------------------------
+// GpuMonitor
+// ---------------------------------------------------------------------------
+class GpuMonitor {
+public:
+    GpuMonitor() = default;
+    ~GpuMonitor();
+
+    // Non-copyable
+    GpuMonitor(const GpuMonitor&) = delete;
+    GpuMonitor& operator=(const GpuMonitor&) = delete;
+
+    /// Load NVML and open GPU |gpu_index|.  Returns false if either fails.
+    bool initialize(unsigned gpu_index = 0);
+
+    /// Unload NVML.
+    void release();
+
+    /// Read the current utilization.  Returns false if not initialized or
+    /// the query failed.
+    bool sample(GpuUtilization& out) const;
+
+    /// The GPU's marketing name ("NVIDIA GeForce RTX 4080"), or empty.
+    const std::string& getName() const { return name_; }
+
+private:
+    using NvmlInit_t       = int (*)();
+    using NvmlShutdown_t   = int (*)();
+    using NvmlGetHandle_t  = int (*)(unsigned index, void** device);
+    using NvmlGetName_t    = int (*)(void* device, char* name, unsigned length);
+    using NvmlGetUtil_t    = int (*)(void* device, void* utilization);
+    using NvmlGetEncUtil_t = int (*)(void* device, unsigned* utilization,
+                                     unsigned* sampling_period_us);
+
+    void*            lib_          = nullptr;   // HMODULE / dlopen handle
+    void*            device_       = nullptr;   // nvmlDevice_t
+    NvmlShutdown_t   shutdown_     = nullptr;
+    NvmlGetUtil_t    get_util_     = nullptr;
+    NvmlGetEncUtil_t get_enc_util_ = nullptr;
+    std::string      name_;
+};
+
+} // namespace cs::host
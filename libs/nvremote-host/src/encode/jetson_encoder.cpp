@@ -9,6 +9,7 @@
 #ifdef __aarch64__
 
 #include "jetson_encoder.h"
+#include <cs/common.h>
 
 #include <cstring>
 #include <fstream>
@@ -22,6 +23,10 @@
 #include <sys/mman.h>
 #include <linux/videodev2.h>
 
+// NVIDIA Multimedia API (JetPack)
+#include <nvbufsurface.h>
+#include <nvbufsurftransform.h>
+
 namespace cs::host {
 
 // ---------------------------------------------------------------------------
@@ -62,8 +67,21 @@ bool JetsonEncoder::initializeJetson(const JetsonEncoderConfig& config) {
         release();
     }
 
+    // The V4L2 encoder codes 8-bit 4:2:0 only.
+    if (config.yuv444 || config.bit_depth > 8) {
+        return false;
+    }
+
     config_ = config;
     platform_info_ = detectJetsonPlatform();
+
+    // No long-term references or temporal layers on this backend, so IDRs
+    // stay periodic and every frame is base layer.
+    if (config_.gop_length == INFINITE_GOP) {
+        config_.gop_length = config_.fps * 2;
+    }
+    config_.enable_ltr = false;
+    config_.temporal_layers = 1;
     nvmm_enabled_ = config.use_nvmm && platform_info_.has_nvmm;
 
     // Adapt encoder settings based on power mode and thermals
@@ -80,11 +98,11 @@ bool JetsonEncoder::initializeJetson(const JetsonEncoderConfig& config) {
         return false;
     }
 
-    if (nvmm_enabled_) {
-        if (!allocateNvmmBuffers()) {
-            // Non-fatal: fall back to CPU buffer path
-            nvmm_enabled_ = false;
-        }
+    // Every picture reaches the encoder in an NVMM surface; only where it
+    // is converted from differs.
+    if (!allocateNvmmBuffers()) {
+        release();
+        return false;
     }
 
     // Open thermal zone for monitoring
@@ -108,25 +126,28 @@ bool JetsonEncoder::encode(const CapturedFrame& frame, EncodedPacket& packet) {
         reconfigure(throttled);
     }
 
-    // Queue the input buffer (capture frame → V4L2 output plane)
+    // Convert the frame into the next output surface the encoder is done
+    // with, on the VIC.
+    reclaimOutputBuffers();
+    const uint32_t slot = next_output_;
+    if (output_queued_[slot] || !convertFrame(frame, output_surfs_[slot])) {
+        return false;
+    }
+    next_output_ = (slot + 1) % NUM_OUTPUT_BUFFERS;
+
+    // Queue the surface to the V4L2 output plane by its DMA-BUF fd
+    const NvBufSurfaceParams& surf = output_surfs_[slot]->surfaceList[0];
     struct v4l2_buffer buf_out = {};
     buf_out.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
-    buf_out.memory = nvmm_enabled_ ? V4L2_MEMORY_DMABUF : V4L2_MEMORY_MMAP;
-    buf_out.index = frame_counter_ % 4;  // Circular buffer (4 buffers)
+    buf_out.memory = V4L2_MEMORY_DMABUF;
+    buf_out.index = slot;
 
-    struct v4l2_plane planes_out[1] = {};
+    struct v4l2_plane planes_out[NV12_PLANES] = {};
     buf_out.m.planes = planes_out;
-    buf_out.length = 1;
-
-    if (nvmm_enabled_ && frame.gpu_ptr) {
-        // NVMM zero-copy: pass the DMABUF fd directly
-        // In a real implementation, frame.gpu_ptr would be an NvBufSurface*
-        // and we'd extract the DMABUF fd from it.
-        planes_out[0].m.fd = -1;  // TODO: Extract DMABUF fd from NVMM surface
-        planes_out[0].bytesused = frame.height * frame.pitch;
-    } else {
-        // CPU copy path: memcpy frame data into V4L2 mmap buffer
-        planes_out[0].bytesused = frame.height * frame.pitch;
+    buf_out.length = NV12_PLANES;
+    for (uint32_t p = 0; p < NV12_PLANES; ++p) {
+        planes_out[p].m.fd = static_cast<int>(surf.bufferDesc);
+        planes_out[p].bytesused = surf.planeParams.psize[p];
     }
 
     // Handle force IDR request
@@ -141,6 +162,7 @@ bool JetsonEncoder::encode(const CapturedFrame& frame, EncodedPacket& packet) {
     if (ioctl(encoder_fd_, VIDIOC_QBUF, &buf_out) < 0) {
         return false;
     }
+    output_queued_[slot] = true;
 
     // Dequeue encoded output buffer (V4L2 capture plane)
     struct v4l2_buffer buf_cap = {};
@@ -155,11 +177,17 @@ bool JetsonEncoder::encode(const CapturedFrame& frame, EncodedPacket& packet) {
         return false;
     }
 
-    // Copy encoded data to packet
-    uint32_t encoded_size = planes_cap[0].bytesused;
-    packet.data.resize(encoded_size);
-    // In a real implementation, copy from the mmap'd capture buffer
-    // memcpy(packet.data.data(), capture_buffers_[buf_cap.index], encoded_size);
+    // Lend the mapped capture buffer to the packet; it is queued back to
+    // the encoder when the packet releases it.
+    const uint32_t index = buf_cap.index;
+    const uint32_t offset = planes_cap[0].data_offset;
+    uint32_t encoded_size = planes_cap[0].bytesused > offset ? planes_cap[0].bytesused - offset : 0;
+    if (index < NUM_CAPTURE_BUFFERS && capture_bufs_[index].addr) {
+        packet.borrow(static_cast<const uint8_t*>(capture_bufs_[index].addr) + offset,
+                      encoded_size, [this, index]() { queueCaptureBuffer(index); });
+    } else {
+        packet.data.resize(encoded_size);
+    }
 
     packet.timestamp_us = frame.timestamp_us;
     packet.frame_number = frame_counter_++;
@@ -196,13 +224,17 @@ bool JetsonEncoder::reconfigure(const EncoderConfig& config) {
     }
 
     // Update GOP length
-    if (config.gop_length != config_.gop_length) {
+    uint32_t gop = config.gop_length == INFINITE_GOP ? config.fps * 2 : config.gop_length;
+    if (gop != config_.gop_length) {
         ctrl.id = V4L2_CID_MPEG_VIDEO_GOP_SIZE;
-        ctrl.value = static_cast<int>(config.gop_length);
+        ctrl.value = static_cast<int>(gop);
         ioctl(encoder_fd_, VIDIOC_S_CTRL, &ctrl);
     }
 
     config_ = config;
+    config_.gop_length = gop;
+    config_.enable_ltr = false;
+    config_.temporal_layers = 1;
     return true;
 }
 
@@ -210,6 +242,15 @@ void JetsonEncoder::forceIdr() {
     force_idr_ = true;
 }
 
+bool JetsonEncoder::invalidateRefFrames(uint32_t first_frame, uint32_t last_frame) {
+    // The V4L2 stateful encoder interface has no control for dropping
+    // frames from the reference list, so loss recovery on this backend is
+    // the IDR fallback.
+    (void)first_frame;
+    (void)last_frame;
+    return false;
+}
+
 void JetsonEncoder::flush() {
     if (encoder_fd_ >= 0) {
         // V4L2 stream off/on to flush pipeline
@@ -220,6 +261,15 @@ void JetsonEncoder::flush() {
         type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
         ioctl(encoder_fd_, VIDIOC_STREAMOFF, &type);
         ioctl(encoder_fd_, VIDIOC_STREAMON, &type);
+
+        // STREAMOFF took every capture buffer back; a packet still holding
+        // one fails to queue it again, harmlessly.
+        for (uint32_t i = 0; i < NUM_CAPTURE_BUFFERS; ++i) {
+            queueCaptureBuffer(i);
+        }
+        for (bool& queued : output_queued_) {
+            queued = false;
+        }
     }
 }
 
@@ -229,9 +279,11 @@ void JetsonEncoder::release() {
         ioctl(encoder_fd_, VIDIOC_STREAMOFF, &type);
         type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
         ioctl(encoder_fd_, VIDIOC_STREAMOFF, &type);
+        unmapCaptureBuffers();
         close(encoder_fd_);
         encoder_fd_ = -1;
     }
+    freeNvmmBuffers();
 
     if (thermal_zone_fd_ >= 0) {
         close(thermal_zone_fd_);
@@ -321,7 +373,7 @@ bool JetsonEncoder::configureV4l2Encoder() {
     fmt_out.fmt.pix_mp.width = config_.width;
     fmt_out.fmt.pix_mp.height = config_.height;
     fmt_out.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_NV12M;  // NV12 multiplanar
-    fmt_out.fmt.pix_mp.num_planes = 1;
+    fmt_out.fmt.pix_mp.num_planes = NV12_PLANES;
 
     if (ioctl(encoder_fd_, VIDIOC_S_FMT, &fmt_out) < 0) {
         return false;
@@ -379,9 +431,35 @@ bool JetsonEncoder::configureV4l2Encoder() {
 }
 
 bool JetsonEncoder::allocateNvmmBuffers() {
+    // NV12 surfaces the encoder reads, and a BGRx one CPU frames are
+    // copied into for the VIC to convert from
+    NvBufSurfaceCreateParams params = {};
+    params.gpuId = 0;
+    params.width = config_.width;
+    params.height = config_.height;
+    params.layout = NVBUF_LAYOUT_PITCH;
+    params.memType = NVBUF_MEM_SURFACE_ARRAY;
+
+    params.colorFormat = NVBUF_COLOR_FORMAT_NV12;
+    for (NvBufSurface*& surf : output_surfs_) {
+        if (NvBufSurfaceCreate(&surf, 1, &params) != 0) {
+            surf = nullptr;
+            return false;
+        }
+    }
+
+    params.colorFormat = NVBUF_COLOR_FORMAT_BGRx;  // DRM XRGB8888 in memory order
+    if (NvBufSurfaceCreate(&staging_surf_, 1, &params) != 0) {
+        staging_surf_ = nullptr;
+        return false;
+    }
+    if (NvBufSurfaceMap(staging_surf_, 0, 0, NVBUF_MAP_WRITE) != 0) {
+        return false;
+    }
+
     // Request V4L2 buffers with DMABUF memory type for NVMM zero-copy
     struct v4l2_requestbuffers req_out = {};
-    req_out.count = 4;  // 4 buffer circular queue
+    req_out.count = NUM_OUTPUT_BUFFERS;
     req_out.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
     req_out.memory = V4L2_MEMORY_DMABUF;
 
@@ -397,6 +475,9 @@ bool JetsonEncoder::allocateNvmmBuffers() {
     if (ioctl(encoder_fd_, VIDIOC_REQBUFS, &req_cap) < 0) {
         return false;
     }
+    if (!mapCaptureBuffers()) {
+        return false;
+    }
 
     // Start streaming on both planes
     int type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
@@ -412,6 +493,155 @@ bool JetsonEncoder::allocateNvmmBuffers() {
     return true;
 }
 
+void JetsonEncoder::freeNvmmBuffers() {
+    for (NvBufSurface*& surf : output_surfs_) {
+        if (surf) NvBufSurfaceDestroy(surf);
+        surf = nullptr;
+    }
+    for (bool& queued : output_queued_) {
+        queued = false;
+    }
+    next_output_ = 0;
+
+    if (staging_surf_) {
+        NvBufSurfaceUnMap(staging_surf_, 0, 0);
+        NvBufSurfaceDestroy(staging_surf_);
+        staging_surf_ = nullptr;
+    }
+
+    import_warned_ = false;
+}
+
+bool JetsonEncoder::convertFrame(const CapturedFrame& frame, NvBufSurface* dst) {
+    // Zero-copy where the capture exported its buffer; otherwise the CPU
+    // pixels are copied into the staging surface.
+    NvBufSurface* src = nullptr;
+    if (nvmm_enabled_ && frame.memory == FrameMemory::DMABUF && frame.dmabuf_fd >= 0) {
+        src = importFrame(frame.dmabuf_fd);
+    }
+    if (!src) {
+        src = stageFrame(frame);
+    }
+    if (!src || !dst) {
+        return false;
+    }
+
+    // Transform sessions are per thread, so name the VIC on each call:
+    // it converts (and would scale) without taking the GPU from anything.
+    NvBufSurfTransformConfigParams session = {};
+    session.compute_mode = NvBufSurfTransformCompute_VIC;
+    session.gpu_id = 0;
+    NvBufSurfTransformSetSessionParams(&session);
+
+    NvBufSurfTransformParams transform = {};
+    transform.transform_flag = 0;  // Colour conversion only
+    return NvBufSurfTransform(src, dst, &transform) == NvBufSurfTransformError_Success;
+}
+
+NvBufSurface* JetsonEncoder::importFrame(int dmabuf_fd) {
+    // Looked up every frame: the capture flips between several scanout
+    // buffers and closes the fds of ones it stops seeing, so a number
+    // may come back naming another buffer.
+    NvBufSurface* surf = nullptr;
+    if (NvBufSurfaceFromFd(dmabuf_fd, reinterpret_cast<void**>(&surf)) == 0 && surf) {
+        return surf;
+    }
+    if (!import_warned_) {
+        import_warned_ = true;
+        CS_LOG(WARN, "Jetson encoder: cannot import DMA-BUF %d -- copying frames", dmabuf_fd);
+    }
+    return nullptr;
+}
+
+NvBufSurface* JetsonEncoder::stageFrame(const CapturedFrame& frame) {
+    if (!staging_surf_ || !frame.gpu_ptr || frame.format != FrameFormat::BGRA8) {
+        return nullptr;
+    }
+
+    const NvBufSurfaceParams& surf = staging_surf_->surfaceList[0];
+    auto* dst = static_cast<uint8_t*>(surf.mappedAddr.addr[0]);
+    if (!dst) return nullptr;
+
+    const auto* src = static_cast<const uint8_t*>(frame.gpu_ptr);
+    const uint32_t dst_pitch = surf.planeParams.pitch[0];
+    const size_t   row_bytes = std::min<size_t>(static_cast<size_t>(frame.width) * 4, dst_pitch);
+    const uint32_t rows      = std::min(frame.height, surf.planeParams.height[0]);
+    for (uint32_t y = 0; y < rows; ++y) {
+        std::memcpy(dst + static_cast<size_t>(y) * dst_pitch,
+                    src + static_cast<size_t>(y) * frame.pitch, row_bytes);
+    }
+    NvBufSurfaceSyncForDevice(staging_surf_, 0, 0);
+    return staging_surf_;
+}
+
+void JetsonEncoder::reclaimOutputBuffers() {
+    // The device is non-blocking: DQBUF hands back each surface the
+    // encoder has finished reading, then fails with EAGAIN.
+    for (;;) {
+        struct v4l2_plane planes[NV12_PLANES] = {};
+        struct v4l2_buffer buf = {};
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        buf.memory = V4L2_MEMORY_DMABUF;
+        buf.m.planes = planes;
+        buf.length = NV12_PLANES;
+        if (ioctl(encoder_fd_, VIDIOC_DQBUF, &buf) < 0) break;
+        if (buf.index < NUM_OUTPUT_BUFFERS) output_queued_[buf.index] = false;
+    }
+}
+
+bool JetsonEncoder::mapCaptureBuffers() {
+    for (uint32_t i = 0; i < NUM_CAPTURE_BUFFERS; ++i) {
+        struct v4l2_plane plane = {};
+        struct v4l2_buffer buf = {};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        buf.m.planes = &plane;
+        buf.length = 1;
+
+        if (ioctl(encoder_fd_, VIDIOC_QUERYBUF, &buf) < 0) {
+            unmapCaptureBuffers();
+            return false;
+        }
+
+        void* addr = mmap(nullptr, plane.length, PROT_READ, MAP_SHARED,
+                          encoder_fd_, plane.m.mem_offset);
+        if (addr == MAP_FAILED) {
+            unmapCaptureBuffers();
+            return false;
+        }
+        capture_bufs_[i].addr = addr;
+        capture_bufs_[i].length = plane.length;
+
+        if (!queueCaptureBuffer(i)) {
+            unmapCaptureBuffers();
+            return false;
+        }
+    }
+    return true;
+}
+
+void JetsonEncoder::unmapCaptureBuffers() {
+    for (CaptureBuffer& cb : capture_bufs_) {
+        if (cb.addr) munmap(cb.addr, cb.length);
+        cb = CaptureBuffer{};
+    }
+}
+
+bool JetsonEncoder::queueCaptureBuffer(uint32_t index) {
+    // A packet released after the encoder went away has nothing to return.
+    if (encoder_fd_ < 0 || !capture_bufs_[index].addr) return false;
+
+    struct v4l2_plane plane = {};
+    struct v4l2_buffer buf = {};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    buf.m.planes = &plane;
+    buf.length = 1;
+    return ioctl(encoder_fd_, VIDIOC_QBUF, &buf) == 0;
+}
+
 int JetsonEncoder::readThermalZone() const {
     if (thermal_zone_fd_ < 0) return 0;
 
@@ -13,13 +13,19 @@
 //
 // Key differences from desktop NVENC:
 //   - Uses V4L2-based NvVideoEncoder API (part of JetPack Multimedia API)
-//   - Supports NVMM zero-copy from DRM capture to encoder (no CPU memcpy)
+//   - NVMM zero-copy from DRM capture to encoder: the capture's DMA-BUF is
+//     imported as an NvBufSurface and the VIC converts it straight into
+//     the NV12 NVMM surfaces queued to the encoder (V4L2_MEMORY_DMABUF);
+//     frames only in CPU memory are copied into an NVMM staging surface
+//     first
+//   - Encoded frames are lent out of the mmap'd V4L2 capture-plane
+//     buffers; a buffer is queued back when the packet releases it
 //   - Power-aware: reads power mode and thermal zone to adapt quality
 //   - Encode API is /dev/nvhost-msenc (Jetson) not libnvidia-encode.so
 //
 // Compile requirements:
 //   - JetPack SDK >= 5.0
-//   - libnvbuf_utils (NVMM buffer management)
+//   - libnvbufsurface / libnvbufsurftransform (NVMM buffers, VIC transform)
 //   - libv4l2 (V4L2 video encoder interface)
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
@@ -31,13 +37,15 @@
 #include <vector>
 #include <atomic>
 
+struct NvBufSurface;
+
 namespace cs::host {
 
 // ---------------------------------------------------------------------------
 // JetsonEncoderConfig -- extended config for Jetson-specific features
 // ---------------------------------------------------------------------------
 struct JetsonEncoderConfig : public EncoderConfig {
-    bool     use_nvmm       = true;      // Use NVMM zero-copy buffers (Jetson unified memory)
+    bool     use_nvmm       = true;      // Import DMA-BUF frames in place (else copy on the CPU)
     bool     power_aware    = true;      // Adapt to power mode / thermal throttling
     int      v4l2_device_fd = -1;        // Pre-opened V4L2 encoder device (or -1 for auto-detect)
     uint32_t max_perf_mode  = 0;         // NVENC performance level (0=auto)
@@ -56,6 +64,7 @@ public:
     bool encode(const CapturedFrame& frame, EncodedPacket& packet) override;
     bool reconfigure(const EncoderConfig& config) override;
     void forceIdr() override;
+    bool invalidateRefFrames(uint32_t first_frame, uint32_t last_frame) override;
     void flush() override;
     void release() override;
     std::string getCodecName() const override;
@@ -81,10 +90,25 @@ private:
     EncoderConfig   config_;
     JetsonPlatformInfo platform_info_;
 
-    // NVMM buffer management
-    bool            nvmm_enabled_  = false;
-    int             nvmm_capture_plane_fd_ = -1;
-    int             nvmm_output_plane_fd_  = -1;
+    // NVMM buffer management.  Output-plane (picture) buffers are NV12
+    // surfaces each frame is converted into, queued by DMA-BUF fd and
+    // returned once the encoder has read them.
+    bool            nvmm_enabled_  = false;   // DMA-BUF frames are imported
+    static constexpr uint32_t NUM_OUTPUT_BUFFERS = 4;
+    static constexpr uint32_t NV12_PLANES        = 2;
+    NvBufSurface*   output_surfs_[NUM_OUTPUT_BUFFERS] = {};
+    bool            output_queued_[NUM_OUTPUT_BUFFERS] = {};
+    uint32_t        next_output_   = 0;
+    NvBufSurface*   staging_surf_  = nullptr;  // BGRx copy of CPU-memory frames
+    bool            import_warned_ = false;    // A DMA-BUF would not import
+
+    // Capture-plane (bitstream) buffers, mapped so packets can borrow them
+    struct CaptureBuffer {
+        void*  addr   = nullptr;
+        size_t length = 0;
+    };
+    static constexpr uint32_t NUM_CAPTURE_BUFFERS = 4;
+    CaptureBuffer   capture_bufs_[NUM_CAPTURE_BUFFERS] = {};
 
     // Encode state
     uint32_t        frame_counter_ = 0;
@@ -98,6 +122,14 @@ private:
     bool openEncoderDevice();
     bool configureV4l2Encoder();
     bool allocateNvmmBuffers();
+    void freeNvmmBuffers();
+    bool convertFrame(const CapturedFrame& frame, NvBufSurface* dst);
+    NvBufSurface* importFrame(int dmabuf_fd);
+    NvBufSurface* stageFrame(const CapturedFrame& frame);
+    void reclaimOutputBuffers();
+    bool mapCaptureBuffers();
+    void unmapCaptureBuffers();
+    bool queueCaptureBuffer(uint32_t index);
     int  readThermalZone() const;
     bool adaptForThermal(EncoderConfig& config);
     bool adaptForPowerMode(EncoderConfig& config);
@@ -7,9 +7,13 @@
 
 #include "nvenc_encoder.h"
 #include <cs/common.h>
+#include <cs/thread_policy.h>
+#include <cs/trace.h>
 
 #include <d3d11.h>
+#include <algorithm>
 #include <cstring>
+#include <thread>
 
 #pragma comment(lib, "d3d11.lib")
 
@@ -89,10 +93,53 @@ bool NvencEncoder::loadLibrary() {
 }
 
 // ---------------------------------------------------------------------------
-// openSession -- create a D3D11 device and open an NVENC encode session
+// openSession -- open an NVENC encode session on the input device
 // ---------------------------------------------------------------------------
 
 bool NvencEncoder::openSession() {
+    NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS sessParams = {};
+    sessParams.version    = NVENC_STRUCT_VERSION(NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS, 1);
+    sessParams.apiVersion = NVENCAPI_VERSION;
+
+    // CUDA frames: the session runs on the capture's context.
+    if (input_memory_ == FrameMemory::CUDA && input_device_) {
+        sessParams.deviceType = NV_ENC_DEVICE_TYPE_CUDA;
+        sessParams.device     = input_device_;
+
+        NVENCSTATUS st = api_.nvEncOpenEncodeSessionEx(&sessParams, &encoder_);
+        if (st != NV_ENC_SUCCESS) {
+            CS_LOG(ERR, "NVENC: OpenEncodeSessionEx (CUDA) failed: %s", nvencStatusString(st));
+            return false;
+        }
+        CS_LOG(DEBUG, "NVENC: encode session opened on CUDA context %p", input_device_);
+        return true;
+    }
+
+    // D3D11 frames: the session shares the capture's device.
+    if (input_memory_ == FrameMemory::D3D11 && input_device_) {
+        auto* dev = static_cast<ID3D11Device*>(input_device_);
+        dev->AddRef();
+        d3d_device_ = dev;
+    } else if (!createDevice()) {
+        return false;
+    }
+
+    sessParams.deviceType = NV_ENC_DEVICE_TYPE_DIRECTX;
+    sessParams.device     = d3d_device_;
+
+    NVENCSTATUS st = api_.nvEncOpenEncodeSessionEx(&sessParams, &encoder_);
+    if (st != NV_ENC_SUCCESS) {
+        CS_LOG(ERR, "NVENC: OpenEncodeSessionEx failed: %s", nvencStatusString(st));
+        reinterpret_cast<ID3D11Device*>(d3d_device_)->Release();
+        d3d_device_ = nullptr;
+        return false;
+    }
+
+    CS_LOG(DEBUG, "NVENC: encode session opened (encoder=%p)", encoder_);
+    return true;
+}
+
+bool NvencEncoder::createDevice() {
     // Create a private D3D11 device for the encoder.
     // NVENC needs a D3D11 device (or CUDA context) to work with.
     ID3D11Device* dev = nullptr;
@@ -113,24 +160,16 @@ bool NvencEncoder::openSession() {
         return false;
     }
     d3d_device_ = dev;
+    return true;
+}
 
-    // Open encode session.
-    NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS sessParams = {};
-    sessParams.version    = NVENC_STRUCT_VERSION(NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS, 1);
-    sessParams.deviceType = NV_ENC_DEVICE_TYPE_DIRECTX;
-    sessParams.device     = d3d_device_;
-    sessParams.apiVersion = NVENCAPI_VERSION;
-
-    NVENCSTATUS st = api_.nvEncOpenEncodeSessionEx(&sessParams, &encoder_);
-    if (st != NV_ENC_SUCCESS) {
-        CS_LOG(ERR, "NVENC: OpenEncodeSessionEx failed: %s", nvencStatusString(st));
-        reinterpret_cast<ID3D11Device*>(d3d_device_)->Release();
-        d3d_device_ = nullptr;
-        return false;
-    }
+// ---------------------------------------------------------------------------
+// setInputDevice -- where frames will arrive from the next initialize() on
+// ---------------------------------------------------------------------------
 
-    CS_LOG(DEBUG, "NVENC: encode session opened (encoder=%p)", encoder_);
-    return true;
+void NvencEncoder::setInputDevice(FrameMemory memory, void* device) {
+    input_memory_ = device ? memory : FrameMemory::SYSTEM;
+    input_device_ = device;
 }
 
 // ---------------------------------------------------------------------------
@@ -176,7 +215,11 @@ bool NvencEncoder::initialize(const EncoderConfig& config) {
     CS_LOG(INFO, "NVENC: codec %s is supported", codecTypeName(config.codec));
 
     NV_ENC_GUID encodeGuid = codecToGuid(config.codec);
-    NV_ENC_GUID presetGuid = NV_ENC_PRESET_P1_GUID;  // Lowest latency
+    if (!checkPictureFormat(config, encodeGuid)) {
+        release();
+        return false;
+    }
+    NV_ENC_GUID presetGuid = presetToGuid(config.preset);   // P1 = lowest latency
 
     // Get the preset configuration as a starting point.
     NV_ENC_PRESET_CONFIG presetConfig = {};
@@ -196,43 +239,184 @@ bool NvencEncoder::initialize(const EncoderConfig& config) {
         CS_LOG(WARN, "NVENC: GetEncodePresetConfig failed: %s -- using defaults", nvencStatusString(st));
     }
 
+    // Long-term references (H.264 / HEVC only).
+    ltr_enabled_ = false;
+    if (config.enable_ltr && config.codec != CodecType::AV1 && api_.nvEncGetEncodeCaps) {
+        NV_ENC_CAPS_PARAM caps = {};
+        caps.version     = NVENC_STRUCT_VERSION(NV_ENC_CAPS_PARAM, 1);
+        caps.capsToQuery = NV_ENC_CAPS_NUM_MAX_LTR_FRAMES;
+        int max_ltr = 0;
+        if (api_.nvEncGetEncodeCaps(encoder_, encodeGuid, &caps, &max_ltr) == NV_ENC_SUCCESS &&
+            max_ltr >= static_cast<int>(NUM_LTR_SLOTS)) {
+            ltr_enabled_ = true;
+        }
+    }
+    if (config.enable_ltr && !ltr_enabled_) {
+        CS_LOG(WARN, "NVENC: long-term references not supported for %s", codecTypeName(config.codec));
+    }
+
+    // Temporal SVC (HEVC / AV1 only).
+    svc_layers_ = 1;
+    if (config.temporal_layers > 1 && config.codec != CodecType::H264 && api_.nvEncGetEncodeCaps) {
+        NV_ENC_CAPS_PARAM caps = {};
+        caps.version     = NVENC_STRUCT_VERSION(NV_ENC_CAPS_PARAM, 1);
+        caps.capsToQuery = NV_ENC_CAPS_NUM_MAX_TEMPORAL_LAYERS;
+        int max_layers = 0;
+        if (api_.nvEncGetEncodeCaps(encoder_, encodeGuid, &caps, &max_layers) == NV_ENC_SUCCESS &&
+            max_layers > 1) {
+            svc_layers_ = std::min({config.temporal_layers, MAX_TEMPORAL_LAYERS,
+                                    static_cast<uint32_t>(max_layers)});
+        }
+    }
+    if (config.temporal_layers > 1 && svc_layers_ == 1) {
+        CS_LOG(WARN, "NVENC: temporal layers not supported for %s", codecTypeName(config.codec));
+    }
+
+    // Frames below the initialized size, from the session's scaler.
+    dyn_res_ = false;
+    if (api_.nvEncGetEncodeCaps) {
+        NV_ENC_CAPS_PARAM caps = {};
+        caps.version     = NVENC_STRUCT_VERSION(NV_ENC_CAPS_PARAM, 1);
+        caps.capsToQuery = NV_ENC_CAPS_SUPPORT_DYN_RES_CHANGE;
+        int supported = 0;
+        dyn_res_ = api_.nvEncGetEncodeCaps(encoder_, encodeGuid, &caps, &supported) == NV_ENC_SUCCESS &&
+                   supported;
+    }
+
+    // Split-frame encoding across the GPU's NVENC engines.
+    engines_ = 1;
+    if (api_.nvEncGetEncodeCaps) {
+        NV_ENC_CAPS_PARAM caps = {};
+        caps.version     = NVENC_STRUCT_VERSION(NV_ENC_CAPS_PARAM, 1);
+        caps.capsToQuery = NV_ENC_CAPS_NUM_ENCODER_ENGINES;
+        int engines = 0;
+        if (api_.nvEncGetEncodeCaps(encoder_, encodeGuid, &caps, &engines) == NV_ENC_SUCCESS &&
+            engines > 1) {
+            engines_ = static_cast<uint32_t>(engines);
+        }
+    }
+    split_ways_ = splitWays(config, engines_);
+    if ((config.split_encode == SplitEncode::TWO || config.split_encode == SplitEncode::THREE) &&
+        split_ways_ == 1) {
+        CS_LOG(WARN, "NVENC: split-frame encoding not available for %s on %u engine(s)",
+               codecTypeName(config.codec), engines_);
+    }
+
+    // Without LTR there is no recovery point but an IDR; keep them periodic.
+    uint32_t gop = config.gop_length;
+    if (gop == INFINITE_GOP && !ltr_enabled_) {
+        gop = config.fps * 2;
+    }
+
+    // Slices (H.264 / HEVC only; AV1 would need tiles).  Sliced frames are
+    // labelled before NVENC reports their picture type, so the periodic
+    // IDRs are scheduled here instead.
+    slices_       = 1;
+    idr_interval_ = 0;
+    if (config.slices > 1) {
+        if (config.codec == CodecType::AV1) {
+            CS_LOG(WARN, "NVENC: sliced output not supported for AV1");
+        } else {
+            slices_ = std::min(config.slices, MAX_SLICES);
+        }
+    }
+    if (slices_ > 1 && gop != INFINITE_GOP) {
+        idr_interval_ = gop;
+        gop = INFINITE_GOP;
+    }
+
+    // Asynchronous encode, where the GPU supports it: each picture signals
+    // an event when written, so several can be in flight.  Whole frames
+    // only; sliced output polls the bitstream as it is written instead.
+    async_ = false;
+    if (slices_ == 1 && api_.nvEncRegisterAsyncEvent && api_.nvEncGetEncodeCaps) {
+        NV_ENC_CAPS_PARAM caps = {};
+        caps.version     = NVENC_STRUCT_VERSION(NV_ENC_CAPS_PARAM, 1);
+        caps.capsToQuery = NV_ENC_CAPS_ASYNC_ENCODE_SUPPORT;
+        int supported = 0;
+        if (api_.nvEncGetEncodeCaps(encoder_, encodeGuid, &caps, &supported) == NV_ENC_SUCCESS &&
+            supported) {
+            async_ = true;
+        }
+    }
+    num_buffers_ = async_ ? std::clamp(static_cast<int>(config.async_depth), MIN_ASYNC_DEPTH, MAX_BUFFERS)
+                          : 2;
+
     // Build the encoder config.
     encConfig_ = presetConfig.presetCfg;
     encConfig_.version = NVENC_STRUCT_VERSION(NV_ENC_CONFIG, 1);
 
     // GOP: all P-frames, no B-frames.
-    encConfig_.gopLength       = config.gop_length;
+    encConfig_.gopLength       = gop;
     encConfig_.frameIntervalP  = 1;   // No B-frames (P-frames only)
 
-    // Rate control: CBR for streaming.
-    encConfig_.rcParams.rateControlMode = NV_ENC_PARAMS_RC_CBR;
+    // Rate control: CBR for streaming, VBR to let hard frames peak.
+    encConfig_.rcParams.rateControlMode = config.rate_control == RateControlMode::VBR
+                                        ? NV_ENC_PARAMS_RC_VBR : NV_ENC_PARAMS_RC_CBR;
     encConfig_.rcParams.averageBitRate  = config.bitrate_kbps * 1000;
     encConfig_.rcParams.maxBitRate      = config.max_bitrate_kbps * 1000;
     encConfig_.rcParams.vbvBufferSize   = config.bitrate_kbps * 1000 / config.fps;
     encConfig_.rcParams.vbvInitialDelay = encConfig_.rcParams.vbvBufferSize;
 
-    // Codec-specific settings.
+    // Per-block QP offsets from the capture's change map.  The map's block
+    // is the codec's coding block.
+    qp_map_enabled_ = config.use_change_map;
+    encConfig_.rcParams.qpMapMode = qp_map_enabled_ ? NV_ENC_QP_MAP_DELTA : NV_ENC_QP_MAP_DISABLED;
+    qp_block_ = config.codec == CodecType::H264 ? 16 : config.codec == CodecType::HEVC ? 32 : 64;
+    qp_cols_  = 0;
+    qp_rows_  = 0;
+    have_change_seq_ = false;
+
+    // Codec-specific settings.  An 8-bit input coded at 10 bits is
+    // widened by the encoder.
+    const NV_ENC_BIT_DEPTH input_depth  = config.input_format == FrameFormat::P010
+                                            ? NV_ENC_BIT_DEPTH_10 : NV_ENC_BIT_DEPTH_8;
+    const NV_ENC_BIT_DEPTH output_depth = config.bit_depth > 8 ? NV_ENC_BIT_DEPTH_10
+                                                               : NV_ENC_BIT_DEPTH_8;
     if (config.codec == CodecType::H264) {
         auto& h264 = encConfig_.encodeCodecConfig_h264;
-        h264.idrPeriod         = config.gop_length;
+        h264.idrPeriod         = gop;
         h264.repeatSPSPPS      = 1;   // Repeat SPS/PPS before each IDR
         h264.enableIntraRefresh = config.enable_intra_refresh ? 1 : 0;
         h264.intraRefreshPeriod = config.intra_refresh_period;
-        h264.intraRefreshCnt    = 5;   // Number of intra-refresh frames
-        h264.maxNumRefFrames    = 1;   // Minimize latency
-        encConfig_.profileGUID  = NV_ENC_H264_PROFILE_HIGH_GUID;
+        h264.intraRefreshCnt    = INTRA_REFRESH_CNT;
+        // P-only, so extra references add no delay; they give
+        // invalidateRefFrames() an older frame to predict from.
+        h264.maxNumRefFrames    = MAX_REF_FRAMES;
+        h264.enableLTR          = ltr_enabled_ ? 1 : 0;
+        h264.ltrNumFrames       = ltr_enabled_ ? NUM_LTR_SLOTS : 0;
+        h264.ltrTrustMode       = 0;   // Marked LTRs are references at once
+        h264.sliceMode          = slices_ > 1 ? NV_ENC_SLICE_MODE_NUM_SLICES : 0;
+        h264.sliceModeData      = slices_ > 1 ? slices_ : 0;
+        h264.chromaFormatIDC    = config.yuv444 ? 3 : 1;
     } else if (config.codec == CodecType::HEVC) {
         auto& hevc = encConfig_.encodeCodecConfig_hevc;
-        hevc.idrPeriod         = config.gop_length;
+        hevc.idrPeriod         = gop;
         hevc.repeatSPSPPS      = 1;
         hevc.enableIntraRefresh = config.enable_intra_refresh ? 1 : 0;
         hevc.intraRefreshPeriod = config.intra_refresh_period;
-        hevc.intraRefreshCnt    = 5;
-        encConfig_.profileGUID  = NV_ENC_HEVC_PROFILE_MAIN_GUID;
+        hevc.intraRefreshCnt    = INTRA_REFRESH_CNT;
+        hevc.maxNumRefFramesInDPB = MAX_REF_FRAMES;
+        hevc.enableLTR          = ltr_enabled_ ? 1 : 0;
+        hevc.ltrNumFrames       = ltr_enabled_ ? NUM_LTR_SLOTS : 0;
+        hevc.ltrTrustMode       = 0;
+        hevc.enableTemporalSVC  = svc_layers_ > 1 ? 1 : 0;
+        hevc.numTemporalLayers  = svc_layers_;
+        hevc.sliceMode          = slices_ > 1 ? NV_ENC_SLICE_MODE_NUM_SLICES : 0;
+        hevc.sliceModeData      = slices_ > 1 ? slices_ : 0;
+        hevc.chromaFormatIDC    = config.yuv444 ? 3 : 1;
+        hevc.inputBitDepth      = input_depth;
+        hevc.outputBitDepth     = output_depth;
     } else {
         // AV1
-        encConfig_.profileGUID = NV_ENC_AV1_PROFILE_MAIN_GUID;
+        auto& av1 = encConfig_.encodeCodecConfig_av1;
+        av1.idrPeriod          = gop;
+        av1.enableTemporalSVC  = svc_layers_ > 1 ? 1 : 0;
+        av1.numTemporalLayers  = svc_layers_;
+        av1.inputBitDepth      = input_depth;
+        av1.outputBitDepth     = output_depth;
     }
+    encConfig_.profileGUID = profileGuid(config);
 
     // Initialize parameters.
     memset(&initParams_, 0, sizeof(initParams_));
@@ -245,41 +429,88 @@ bool NvencEncoder::initialize(const EncoderConfig& config) {
     initParams_.darHeight      = config.height;
     initParams_.frameRateNum   = config.fps;
     initParams_.frameRateDen   = 1;
-    initParams_.enableEncodeAsync = 0;  // Synchronous mode for simplicity
+    initParams_.enableEncodeAsync = async_ ? 1 : 0;
     initParams_.enablePTD      = 1;     // Let NVENC decide picture types
     initParams_.encodeConfig   = &encConfig_;
     initParams_.maxEncodeWidth = config.width;
     initParams_.maxEncodeHeight= config.height;
     initParams_.tuningInfo     = NV_ENC_TUNING_INFO_ULTRA_LOW_LATENCY;
+    initParams_.reportSliceOffsets  = slices_ > 1 ? 1 : 0;
+    initParams_.enableSubFrameWrite = slices_ > 1 ? 1 : 0;   // Slices readable as written
+    initParams_.splitEncodeMode = split_ways_ == 3 ? NV_ENC_SPLIT_THREE_FORCED_MODE
+                                : split_ways_ == 2 ? NV_ENC_SPLIT_TWO_FORCED_MODE
+                                                   : NV_ENC_SPLIT_DISABLE_MODE;
 
     st = api_.nvEncInitializeEncoder(encoder_, &initParams_);
+    if (st != NV_ENC_SUCCESS && split_ways_ > 1) {
+        // The driver, or the split with this session's other settings, may
+        // not be supported; one engine then codes each picture.
+        CS_LOG(WARN, "NVENC: %u-way split-frame encoding rejected (%s) -- one engine",
+               split_ways_, nvencStatusString(st));
+        split_ways_ = 1;
+        initParams_.splitEncodeMode = NV_ENC_SPLIT_DISABLE_MODE;
+        st = api_.nvEncInitializeEncoder(encoder_, &initParams_);
+    }
+    if (st != NV_ENC_SUCCESS && slices_ > 1) {
+        // Sub-frame readback needs driver and GPU support; fall back to
+        // whole frames with NVENC's own IDR schedule.
+        CS_LOG(WARN, "NVENC: sliced output rejected (%s) -- encoding whole frames",
+               nvencStatusString(st));
+        const uint32_t whole_gop = idr_interval_ ? idr_interval_ : gop;
+        slices_       = 1;
+        idr_interval_ = 0;
+        encConfig_.gopLength = whole_gop;
+        if (config.codec == CodecType::H264) {
+            encConfig_.encodeCodecConfig_h264.idrPeriod     = whole_gop;
+            encConfig_.encodeCodecConfig_h264.sliceMode     = 0;
+            encConfig_.encodeCodecConfig_h264.sliceModeData = 0;
+        } else {
+            encConfig_.encodeCodecConfig_hevc.idrPeriod     = whole_gop;
+            encConfig_.encodeCodecConfig_hevc.sliceMode     = 0;
+            encConfig_.encodeCodecConfig_hevc.sliceModeData = 0;
+        }
+        initParams_.reportSliceOffsets  = 0;
+        initParams_.enableSubFrameWrite = 0;
+        st = api_.nvEncInitializeEncoder(encoder_, &initParams_);
+    }
     if (st != NV_ENC_SUCCESS) {
         CS_LOG(ERR, "NVENC: InitializeEncoder failed: %s", nvencStatusString(st));
         release();
         return false;
     }
 
-    CS_LOG(INFO, "NVENC: encoder initialized -- %s %ux%u @ %u fps, %u kbps CBR",
+    CS_LOG(INFO, "NVENC: encoder initialized -- %s %ux%u @ %u fps, %u kbps %s P%u%s, "
+           "%u temporal layer(s), %u slice(s), %s %u-bit, %u of %u engine(s)",
            codecTypeName(config.codec), config.width, config.height,
-           config.fps, config.bitrate_kbps);
-
-    // Create input and output buffers.
-    for (int i = 0; i < NUM_BUFFERS; ++i) {
+           config.fps, config.bitrate_kbps, rateControlName(config.rate_control),
+           std::clamp<uint32_t>(config.preset, 1, 7), ltr_enabled_ ? ", LTR" : "", svc_layers_, slices_,
+           config.yuv444 ? "4:4:4" : "4:2:0", config.bit_depth > 8 ? 10u : 8u,
+           split_ways_, engines_);
+
+    // The offsets array must cover one entry per macroblock.
+    slice_offsets_.assign(slices_ > 1 ? ((config.width + 15) / 16) * ((config.height + 15) / 16)
+                                      : 0, 0);
+
+    // Create input and output buffers.  GPU frames are mapped in place
+    // and need no input buffer.
+    for (int i = 0; i < num_buffers_; ++i) {
         // Input buffer.
-        NV_ENC_CREATE_INPUT_BUFFER inBuf = {};
-        inBuf.version   = NVENC_STRUCT_VERSION(NV_ENC_CREATE_INPUT_BUFFER, 1);
-        inBuf.width     = config.width;
-        inBuf.height    = config.height;
-        inBuf.bufferFmt = NV_ENC_BUFFER_FORMAT_ARGB;  // BGRA is ARGB with swizzle
-        inBuf.memoryHeap = NV_ENC_MEMORY_HEAP_AUTOSELECT;
-
-        st = api_.nvEncCreateInputBuffer(encoder_, &inBuf);
-        if (st != NV_ENC_SUCCESS) {
-            CS_LOG(ERR, "NVENC: CreateInputBuffer[%d] failed: %s", i, nvencStatusString(st));
-            release();
-            return false;
+        if (input_memory_ == FrameMemory::SYSTEM) {
+            NV_ENC_CREATE_INPUT_BUFFER inBuf = {};
+            inBuf.version   = NVENC_STRUCT_VERSION(NV_ENC_CREATE_INPUT_BUFFER, 1);
+            inBuf.width     = config.width;
+            inBuf.height    = config.height;
+            inBuf.bufferFmt = frameFormatToNvenc(config.input_format);
+            inBuf.memoryHeap = NV_ENC_MEMORY_HEAP_AUTOSELECT;
+
+            st = api_.nvEncCreateInputBuffer(encoder_, &inBuf);
+            if (st != NV_ENC_SUCCESS) {
+                CS_LOG(ERR, "NVENC: CreateInputBuffer[%d] failed: %s", i, nvencStatusString(st));
+                release();
+                return false;
+            }
+            input_bufs_[i] = inBuf.inputBuffer;
         }
-        input_bufs_[i] = inBuf.inputBuffer;
 
         // Output (bitstream) buffer.
         NV_ENC_CREATE_BITSTREAM_BUFFER outBuf = {};
@@ -295,11 +526,25 @@ bool NvencEncoder::initialize(const EncoderConfig& config) {
         output_bufs_[i] = outBuf.bitstreamBuffer;
     }
 
+    if (async_ && !registerEvents(static_cast<uint32_t>(num_buffers_))) {
+        release();
+        return false;
+    }
+
     initialized_ = true;
+    open_memory_ = input_memory_;
+    open_device_ = input_device_;
     frame_num_   = 0;
     force_idr_   = false;
-
-    CS_LOG(INFO, "NVENC: ready (double-buffered, %d input/output pairs)", NUM_BUFFERS);
+    for (RefFrame& ref : ref_history_) ref = RefFrame{};
+    resetLtr();
+    svc_anchor_  = 0;
+    last_idr_    = 0;
+
+    CS_LOG(INFO, "NVENC: ready (%s, %d input/output pairs, %s input)",
+           async_ ? "async" : "sync", num_buffers_,
+           input_memory_ == FrameMemory::CUDA  ? "CUDA" :
+           input_memory_ == FrameMemory::D3D11 ? "D3D11" : "system memory");
     return true;
 }
 
@@ -308,10 +553,348 @@ bool NvencEncoder::initialize(const EncoderConfig& config) {
 // ---------------------------------------------------------------------------
 
 bool NvencEncoder::encode(const CapturedFrame& frame, EncodedPacket& packet) {
+    return encodeFrame(frame, packet, nullptr);
+}
+
+bool NvencEncoder::encodeSliced(const CapturedFrame& frame, EncodedPacket& packet,
+                                const SliceCallback& on_slice) {
+    if (slices_ <= 1) return IEncoder::encodeSliced(frame, packet, on_slice);
+    return encodeFrame(frame, packet, &on_slice);
+}
+
+bool NvencEncoder::encodeFrame(const CapturedFrame& frame, EncodedPacket& packet,
+                               const SliceCallback* on_slice) {
     if (!initialized_) return false;
+    if (output_thread_.joinable()) {
+        CS_LOG(ERR, "NVENC: encode() while asynchronous output is running");
+        return false;
+    }
+
+    cs::trace::Scope trace(cs::trace::Stage::ENCODE, static_cast<uint32_t>(frame.timestamp_us));
+    int idx = 0;
+    if (!submitFrame(frame, idx)) return false;
+    return completeFrame(idx, packet, on_slice);
+}
+
+// ---------------------------------------------------------------------------
+// startAsync / submit / stopAsync -- frames in flight on the output thread
+// ---------------------------------------------------------------------------
+
+bool NvencEncoder::startAsync(PacketCallback on_packet) {
+    if (!initialized_ || !async_) return false;
+    stopAsync();
+
+    on_packet_   = std::move(on_packet);
+    output_stop_ = false;
+    output_thread_ = std::thread(&NvencEncoder::outputLoop, this);
+    CS_LOG(INFO, "NVENC: asynchronous output started (%d frames in flight)", num_buffers_);
+    return true;
+}
 
-    int idx = cur_buf_;
-    cur_buf_ = (cur_buf_ + 1) % NUM_BUFFERS;
+bool NvencEncoder::submit(const CapturedFrame& frame) {
+    if (!output_thread_.joinable()) return false;
+    cs::trace::Scope trace(cs::trace::Stage::ENCODE_SUBMIT,
+                           static_cast<uint32_t>(frame.timestamp_us));
+
+    // Slots are used in turn, so the next one is free once fewer than
+    // num_buffers_ are queued.
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        free_cv_.wait(lock, [this]() {
+            return static_cast<int>(queue_.size()) < num_buffers_;
+        });
+    }
+
+    int idx = 0;
+    if (!submitFrame(frame, idx)) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        queue_.push_back(idx);
+    }
+    queue_cv_.notify_one();
+    return true;
+}
+
+void NvencEncoder::stopAsync() {
+    if (!output_thread_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        output_stop_ = true;
+    }
+    queue_cv_.notify_all();
+    output_thread_.join();
+    on_packet_ = nullptr;
+    CS_LOG(DEBUG, "NVENC: asynchronous output stopped");
+}
+
+uint32_t NvencEncoder::getInFlight() const {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return static_cast<uint32_t>(queue_.size());
+}
+
+void NvencEncoder::outputLoop() {
+    cs::ScopedThreadRole role(cs::ThreadRole::ENCODE);
+    cs::trace::setThreadName("encode_output");
+    for (;;) {
+        int idx = 0;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_cv_.wait(lock, [this]() { return !queue_.empty() || output_stop_; });
+            if (queue_.empty()) break;     // Stopping, and everything is out
+            idx = queue_.front();
+        }
+
+        const bool ok = completeFrame(idx, out_packet_, nullptr);
+        on_packet_(out_packet_, ok);
+        out_packet_.release();      // The slot's bitstream, before the slot is reused
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            queue_.pop_front();
+        }
+        free_cv_.notify_one();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// submitFrame -- hand one frame to the hardware
+// ---------------------------------------------------------------------------
+
+bool NvencEncoder::submitFrame(const CapturedFrame& frame, int& idx) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+
+    idx = cur_buf_;
+    cur_buf_ = (cur_buf_ + 1) % num_buffers_;
+    PendingFrame& pending = pending_[idx];
+    pending = PendingFrame{};
+
+    // System-memory frames are copied into an input buffer; GPU frames
+    // are mapped where the capture left them.
+    void*                input      = nullptr;
+    uint32_t             inputPitch = 0;
+    NV_ENC_BUFFER_FORMAT inputFmt   = frameFormatToNvenc(frame.format);
+    if (frame.memory == FrameMemory::SYSTEM) {
+        if (!copyToInputBuffer(idx, frame, inputPitch)) return false;
+        input = input_bufs_[idx];
+    } else {
+        input = mapInput(frame, inputFmt);
+        if (!input) return false;
+        inputPitch = frame.pitch;
+        pending.mapped_input = input;
+    }
+
+    // A frame at a new size (the session's scaler moved) restarts the
+    // stream at that size.
+    if (frame.width != initParams_.encodeWidth || frame.height != initParams_.encodeHeight) {
+        if (!resize(frame.width, frame.height)) {
+            unmapInput(pending.mapped_input);
+            return false;
+        }
+    }
+
+    // Set up the encode picture params.
+    NV_ENC_PIC_PARAMS picParams = {};
+    picParams.version         = NVENC_STRUCT_VERSION(NV_ENC_PIC_PARAMS, 1);
+    picParams.inputWidth      = frame.width;
+    picParams.inputHeight     = frame.height;
+    picParams.inputPitch      = inputPitch;
+    picParams.inputBuffer     = input;
+    picParams.outputBitstream = output_bufs_[idx];
+    picParams.completionEvent = async_ ? events_[idx] : nullptr;
+    picParams.bufferFmt       = inputFmt;
+    picParams.frameIdx        = frame_num_;
+    picParams.inputTimeStamp  = frame.timestamp_us;
+    picParams.pictureType     = NV_ENC_PIC_TYPE_UNKNOWN;  // Let PTD decide
+
+    // With slices the IDR schedule is ours (see initialize()).
+    if (slices_ > 1 &&
+        (frame_num_ == 0 || (idr_interval_ > 0 && frame_num_ - last_idr_ >= idr_interval_))) {
+        force_idr_ = true;
+    }
+
+    const bool idr = force_idr_;
+    applyFrameBudget(idr);
+    if (int8_t* qp_map = buildQpMap(frame, idr, idx)) {
+        picParams.qpDeltaMap     = qp_map;
+        picParams.qpDeltaMapSize = qp_cols_ * qp_rows_;
+    }
+    if (force_idr_) {
+        picParams.encodePicFlags = NV_ENC_PIC_FLAG_FORCEIDR | NV_ENC_PIC_FLAG_OUTPUT_SPSPPS;
+        force_idr_ = false;
+        CS_LOG(DEBUG, "NVENC: forcing IDR frame at frame %u", frame_num_);
+    }
+
+    // Long-term references: recover from an acknowledged one if asked to,
+    // and mark a new one every ltr_interval frames (and on every IDR,
+    // which flushes the old ones).  Only base-layer frames are marked: a
+    // marked enhancement frame would become a reference and could no
+    // longer be dropped.
+    const uint32_t layer = idr ? 0 : expectedTemporalLayer();
+    bool     mark_ltr  = false;
+    uint32_t ltr_slot  = 0;
+    if (ltr_enabled_) {
+        if (ltr_use_slot_ >= 0 && !idr) {
+            picParams.codecPicParams.ltrUseFrames      = 1;
+            picParams.codecPicParams.ltrUseFrameBitmap = 1u << ltr_use_slot_;
+            CS_LOG(DEBUG, "NVENC: frame %u predicts from LTR frame %u",
+                   frame_num_, ltr_slots_[ltr_use_slot_].frame_num);
+        }
+        ltr_use_slot_ = -1;
+
+        if (layer == 0 &&
+            (idr || !ltr_marked_ || frame_num_ - last_ltr_mark_ >= config_.ltr_interval)) {
+            if (idr) resetLtr();
+            mark_ltr = true;
+            ltr_slot = nextLtrSlot();
+            picParams.codecPicParams.ltrMarkFrame    = 1;
+            picParams.codecPicParams.ltrMarkFrameIdx = ltr_slot;
+        }
+    }
+
+    // Encode.
+    NVENCSTATUS st = api_.nvEncEncodePicture(encoder_, &picParams);
+    if (st != NV_ENC_SUCCESS) {
+        if (st == NV_ENC_ERR_NEED_MORE_INPUT) {
+            // Shouldn't happen without B-frames.
+            CS_LOG(DEBUG, "NVENC: encoder needs more input");
+        } else {
+            CS_LOG(ERR, "NVENC: EncodePicture failed: %s", nvencStatusString(st));
+        }
+        unmapInput(pending.mapped_input);
+        return false;
+    }
+
+    // The frame is in the encoder from here on, whatever happens to its
+    // output: later frames may reference it, so it is recorded now.
+    pending.timestamp_us = frame.timestamp_us;
+    pending.frame_num    = frame_num_;
+    pending.idr          = idr;
+    pending.mark_ltr     = mark_ltr;
+    pending.layer        = (svc_layers_ > 1 && !mark_ltr) ? static_cast<uint8_t>(layer) : 0;
+
+    RefFrame& ref = ref_history_[frame_num_ % MAX_REF_FRAMES];
+    ref.frame_num = frame_num_;
+    ref.timestamp = picParams.inputTimeStamp;
+    ref.valid     = true;
+
+    if (idr) last_idr_ = frame_num_;
+    if (mark_ltr) {
+        ltr_slots_[ltr_slot] = LtrSlot{frame_num_, true, false};
+        ltr_marked_    = true;
+        last_ltr_mark_ = frame_num_;
+    }
+
+    // Follow the encoder's layer pattern from its base-layer frames; the
+    // pattern is fixed, so the next frame's layer need not wait for this
+    // one's output.
+    if (svc_layers_ > 1 && layer == 0) svc_anchor_ = frame_num_;
+
+    frame_num_++;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// completeFrame -- read one slot's bitstream
+// ---------------------------------------------------------------------------
+
+bool NvencEncoder::completeFrame(int idx, EncodedPacket& packet, const SliceCallback* on_slice) {
+    PendingFrame& pending = pending_[idx];
+    cs::trace::Scope trace(cs::trace::Stage::ENCODE_OUTPUT,
+                           static_cast<uint32_t>(pending.timestamp_us));
+
+    // Everything about the frame but its size is known already; a sliced
+    // frame goes out under these labels while it is still being written.
+    packet.timestamp_us   = pending.timestamp_us;
+    packet.frame_number   = pending.frame_num;
+    packet.codec          = config_.codec;
+    packet.is_keyframe    = pending.idr;
+    packet.is_ltr         = pending.mark_ltr;
+    packet.temporal_layer = pending.layer;
+    packet.release();
+    packet.data.clear();
+
+    // An asynchronous slot is ready once its event fires; LockBitstream
+    // then returns at once.
+    if (async_ && WaitForSingleObject(events_[idx], ASYNC_WAIT_MS) != WAIT_OBJECT_0) {
+        CS_LOG(ERR, "NVENC: frame %u not finished after %lu ms", pending.frame_num,
+               static_cast<unsigned long>(ASYNC_WAIT_MS));
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        unmapInput(pending.mapped_input);
+        return false;
+    }
+
+    NV_ENC_LOCK_BITSTREAM lockBits = {};
+    if (on_slice) {
+        if (!readSlices(idx, packet, *on_slice, lockBits)) {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            unmapInput(pending.mapped_input);
+            return false;
+        }
+    } else {
+        // Lock the bitstream and lend it to the packet as it stands: the
+        // send path packetizes straight out of the output buffer, which
+        // stays locked until the packet releases it.
+        lockBits.version          = NVENC_STRUCT_VERSION(NV_ENC_LOCK_BITSTREAM, 1);
+        lockBits.outputBitstream  = output_bufs_[idx];
+
+        NVENCSTATUS st = api_.nvEncLockBitstream(encoder_, &lockBits);
+        if (st != NV_ENC_SUCCESS) {
+            CS_LOG(ERR, "NVENC: LockBitstream failed: %s", nvencStatusString(st));
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            unmapInput(pending.mapped_input);
+            return false;
+        }
+
+        void* bitstream = output_bufs_[idx];
+        packet.borrow(static_cast<const uint8_t*>(lockBits.bitstreamBufferPtr),
+                      lockBits.bitstreamSizeInBytes, [this, bitstream]() {
+                          if (encoder_) api_.nvEncUnlockBitstream(encoder_, bitstream);
+                      });
+        packet.is_keyframe  = (lockBits.pictureType == NV_ENC_PIC_TYPE_IDR ||
+                               lockBits.pictureType == NV_ENC_PIC_TYPE_I);
+        // A frame something still references is always reported as base layer.
+        packet.temporal_layer = (svc_layers_ > 1 && !packet.is_keyframe && !pending.mark_ltr)
+                                  ? static_cast<uint8_t>(lockBits.temporalId) : 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+
+        // The picture is written; the capture may reuse its surface.
+        unmapInput(pending.mapped_input);
+
+        // An IDR the encoder chose itself restarts the layer pattern and
+        // drops every LTR marked before it.  Frames submitted since keep
+        // theirs.
+        if (lockBits.pictureType == NV_ENC_PIC_TYPE_IDR && !pending.idr) {
+            if (pending.frame_num > last_idr_) last_idr_ = pending.frame_num;
+            if (svc_layers_ > 1 && pending.frame_num > svc_anchor_) svc_anchor_ = pending.frame_num;
+            if (ltr_enabled_) {
+                for (LtrSlot& slot : ltr_slots_) {
+                    if (slot.valid && slot.frame_num < pending.frame_num) slot = LtrSlot{};
+                }
+                if (ltr_use_slot_ >= 0 && !ltr_slots_[ltr_use_slot_].valid) ltr_use_slot_ = -1;
+            }
+        }
+    }
+
+    CS_LOG(TRACE, "NVENC: encoded frame %u, %u bytes, keyframe=%d, layer=%u",
+           packet.frame_number, (uint32_t)packet.size(), packet.is_keyframe,
+           packet.temporal_layer);
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// copyToInputBuffer -- system-memory input
+// ---------------------------------------------------------------------------
+
+bool NvencEncoder::copyToInputBuffer(int idx, const CapturedFrame& frame, uint32_t& pitch) {
+    if (!input_bufs_[idx]) {
+        CS_LOG(ERR, "NVENC: system-memory frame on a session opened for GPU input");
+        return false;
+    }
 
     // Lock the input buffer and copy frame data into it.
     NV_ENC_LOCK_INPUT_BUFFER lockIn = {};
@@ -325,7 +908,7 @@ bool NvencEncoder::encode(const CapturedFrame& frame, EncodedPacket& packet) {
     }
 
     // Copy the captured frame into the NVENC input buffer.
-    // The source may be BGRA from DXGI capture or NV12 from NvFBC.
+    // The source is BGRA (NvFBC ToSys) or NV12 in system memory.
     if (frame.format == FrameFormat::BGRA8 || frame.format == FrameFormat::ARGB8) {
         // Row-by-row copy (source pitch may differ from destination pitch).
         uint32_t rowBytes = frame.width * 4;
@@ -354,78 +937,327 @@ bool NvencEncoder::encode(const CapturedFrame& frame, EncodedPacket& packet) {
         for (uint32_t y = 0; y < frame.height / 2; ++y) {
             memcpy(dstChroma + y * dstPitch, srcChroma + y * srcPitch, frame.width);
         }
+    } else if (frame.format == FrameFormat::YUV444) {
+        // Three full-size planes, one after the other.
+        const uint8_t* src = static_cast<const uint8_t*>(frame.gpu_ptr);
+        uint8_t* dst = static_cast<uint8_t*>(lockIn.bufferDataPtr);
+        for (uint32_t y = 0; y < frame.height * 3; ++y) {
+            memcpy(dst + y * lockIn.pitch, src + y * frame.pitch, frame.width);
+        }
     }
 
     api_.nvEncUnlockInputBuffer(encoder_, input_bufs_[idx]);
+    pitch = lockIn.pitch;
+    return true;
+}
 
-    // Set up the encode picture params.
-    NV_ENC_PIC_PARAMS picParams = {};
-    picParams.version         = NVENC_STRUCT_VERSION(NV_ENC_PIC_PARAMS, 1);
-    picParams.inputWidth      = frame.width;
-    picParams.inputHeight     = frame.height;
-    picParams.inputPitch      = lockIn.pitch;
-    picParams.inputBuffer     = input_bufs_[idx];
-    picParams.outputBitstream = output_bufs_[idx];
-    picParams.bufferFmt       = frameFormatToNvenc(frame.format);
-    picParams.frameIdx        = frame_num_;
-    picParams.inputTimeStamp  = frame.timestamp_us;
-    picParams.pictureType     = NV_ENC_PIC_TYPE_UNKNOWN;  // Let PTD decide
+// ---------------------------------------------------------------------------
+// mapInput / unmapInput / unregisterInputs -- GPU input
+// ---------------------------------------------------------------------------
 
-    if (force_idr_) {
-        picParams.encodePicFlags = NV_ENC_PIC_FLAG_FORCEIDR | NV_ENC_PIC_FLAG_OUTPUT_SPSPPS;
-        force_idr_ = false;
-        CS_LOG(DEBUG, "NVENC: forcing IDR frame at frame %u", frame_num_);
+void* NvencEncoder::mapInput(const CapturedFrame& frame, NV_ENC_BUFFER_FORMAT& fmt) {
+    if (frame.memory != input_memory_ || !frame.gpu_ptr) {
+        CS_LOG(ERR, "NVENC: frame is not on the device the session was opened on");
+        return nullptr;
     }
 
-    // Encode.
-    st = api_.nvEncEncodePicture(encoder_, &picParams);
-    if (st != NV_ENC_SUCCESS && st != NV_ENC_ERR_NEED_MORE_INPUT) {
-        CS_LOG(ERR, "NVENC: EncodePicture failed: %s", nvencStatusString(st));
-        return false;
+    RegisteredInput* entry = nullptr;
+    for (RegisteredInput& reg : registered_) {
+        if (reg.resource == frame.gpu_ptr && reg.width == frame.width &&
+            reg.height == frame.height && reg.pitch == frame.pitch &&
+            reg.format == frame.format) {
+            entry = &reg;
+            break;
+        }
     }
 
-    if (st == NV_ENC_ERR_NEED_MORE_INPUT) {
-        // Encoder needs more input (shouldn't happen with sync mode + no B-frames).
-        CS_LOG(DEBUG, "NVENC: encoder needs more input");
-        return false;
+    if (!entry) {
+        // Frames still in flight keep their registrations until they are out.
+        bool in_use = false;
+        for (const PendingFrame& pending : pending_) in_use |= pending.mapped_input != nullptr;
+        if (registered_.size() >= MAX_REGISTERED && !in_use) unregisterInputs();
+
+        NV_ENC_REGISTER_RESOURCE reg = {};
+        reg.version            = NVENC_STRUCT_VERSION(NV_ENC_REGISTER_RESOURCE, 1);
+        reg.resourceType       = frame.memory == FrameMemory::CUDA
+                                   ? NV_ENC_INPUT_RESOURCE_TYPE_CUDADEVICEPTR
+                                   : NV_ENC_INPUT_RESOURCE_TYPE_DIRECTX;
+        reg.width              = frame.width;
+        reg.height             = frame.height;
+        reg.pitch              = frame.pitch;        // Ignored for textures
+        reg.resourceToRegister = frame.gpu_ptr;
+        reg.bufferFormat       = frameFormatToNvenc(frame.format);
+        reg.bufferUsage        = NV_ENC_INPUT_IMAGE;
+
+        NVENCSTATUS st = api_.nvEncRegisterResource(encoder_, &reg);
+        if (st != NV_ENC_SUCCESS) {
+            CS_LOG(ERR, "NVENC: RegisterResource failed: %s", nvencStatusString(st));
+            return nullptr;
+        }
+
+        RegisteredInput added;
+        added.resource   = frame.gpu_ptr;
+        added.registered = reg.registeredResource;
+        added.width      = frame.width;
+        added.height     = frame.height;
+        added.pitch      = frame.pitch;
+        added.format     = frame.format;
+        registered_.push_back(added);
+        entry = &registered_.back();
+
+        CS_LOG(DEBUG, "NVENC: registered capture surface %p (%ux%u), %zu in use",
+               frame.gpu_ptr, frame.width, frame.height, registered_.size());
     }
 
-    // Lock the bitstream and retrieve the encoded data.
-    NV_ENC_LOCK_BITSTREAM lockBits = {};
-    lockBits.version          = NVENC_STRUCT_VERSION(NV_ENC_LOCK_BITSTREAM, 1);
-    lockBits.outputBitstream  = output_bufs_[idx];
+    NV_ENC_MAP_INPUT_RESOURCE map = {};
+    map.version            = NVENC_STRUCT_VERSION(NV_ENC_MAP_INPUT_RESOURCE, 1);
+    map.registeredResource = entry->registered;
 
-    st = api_.nvEncLockBitstream(encoder_, &lockBits);
+    NVENCSTATUS st = api_.nvEncMapInputResource(encoder_, &map);
     if (st != NV_ENC_SUCCESS) {
-        CS_LOG(ERR, "NVENC: LockBitstream failed: %s", nvencStatusString(st));
-        return false;
+        CS_LOG(ERR, "NVENC: MapInputResource failed: %s", nvencStatusString(st));
+        return nullptr;
     }
 
-    // Copy bitstream to output packet.
-    packet.data.resize(lockBits.bitstreamSizeInBytes);
-    memcpy(packet.data.data(), lockBits.bitstreamBufferPtr, lockBits.bitstreamSizeInBytes);
-    packet.timestamp_us = frame.timestamp_us;
-    packet.frame_number = frame_num_;
-    packet.codec        = config_.codec;
-    packet.is_keyframe  = (lockBits.pictureType == NV_ENC_PIC_TYPE_IDR ||
-                           lockBits.pictureType == NV_ENC_PIC_TYPE_I);
+    fmt = map.mappedBufferFmt;
+    return map.mappedResource;
+}
 
-    api_.nvEncUnlockBitstream(encoder_, output_bufs_[idx]);
+void NvencEncoder::unmapInput(void*& mapped) {
+    if (!mapped) return;
+    api_.nvEncUnmapInputResource(encoder_, mapped);
+    mapped = nullptr;
+}
 
-    frame_num_++;
+void NvencEncoder::unregisterInputs() {
+    for (PendingFrame& pending : pending_) unmapInput(pending.mapped_input);
+    for (const RegisteredInput& reg : registered_) {
+        api_.nvEncUnregisterResource(encoder_, reg.registered);
+    }
+    registered_.clear();
+}
 
-    CS_LOG(TRACE, "NVENC: encoded frame %u, %u bytes, keyframe=%d",
-           packet.frame_number, (uint32_t)packet.data.size(), packet.is_keyframe);
+// ---------------------------------------------------------------------------
+// buildQpMap -- per-block QP deltas from the capture's change map
+// ---------------------------------------------------------------------------
+
+int8_t* NvencEncoder::buildQpMap(const CapturedFrame& frame, bool idr, int idx) {
+    if (!qp_map_enabled_) return nullptr;
+
+    const uint32_t cols = (frame.width  + qp_block_ - 1) / qp_block_;
+    const uint32_t rows = (frame.height + qp_block_ - 1) / qp_block_;
+    if (cols != qp_cols_ || rows != qp_rows_) {
+        qp_cols_ = cols;
+        qp_rows_ = rows;
+        block_age_.assign(static_cast<size_t>(cols) * rows, 0);
+    }
 
+    // A map only covers the changes since the capture's previous frame:
+    // if that one never reached the encoder, what it changed is unknown,
+    // so every block counts as changed.
+    const bool known = frame.change_map && frame.change_block > 0 && frame.change_cols > 0 &&
+                       frame.change_rows > 0 && have_change_seq_ &&
+                       frame.change_seq == last_change_seq_ + 1;
+    last_change_seq_ = frame.change_seq;
+    have_change_seq_ = frame.change_map != nullptr;
+
+    for (uint32_t row = 0; row < rows; ++row) {
+        for (uint32_t col = 0; col < cols; ++col) {
+            bool changed = true;
+            if (known) {
+                // Capture blocks overlapping this one
+                const uint32_t x0 = col * qp_block_ / frame.change_block;
+                const uint32_t y0 = row * qp_block_ / frame.change_block;
+                const uint32_t x1 = std::min(((col + 1) * qp_block_ - 1) / frame.change_block,
+                                             frame.change_cols - 1);
+                const uint32_t y1 = std::min(((row + 1) * qp_block_ - 1) / frame.change_block,
+                                             frame.change_rows - 1);
+                changed = false;
+                for (uint32_t y = y0; y <= y1 && !changed; ++y) {
+                    const uint8_t* line = frame.change_map + static_cast<size_t>(y) * frame.change_cols;
+                    for (uint32_t x = x0; x <= x1; ++x) {
+                        if (line[x]) { changed = true; break; }
+                    }
+                }
+            }
+            uint8_t& age = block_age_[static_cast<size_t>(row) * cols + col];
+            age = changed ? 0 : static_cast<uint8_t>(std::min<uint32_t>(age + 1u, 255u));
+        }
+    }
+
+    // An IDR codes every block afresh at the normal QP.
+    if (idr) return nullptr;
+
+    // NVENC starts a refresh wave every intra_refresh_period frames; it is
+    // taken to run from the last IDR, which is where the encoder restarts
+    // its count.
+    const bool refreshing = config_.enable_intra_refresh && config_.intra_refresh_period > 0 &&
+                            (frame_num_ - last_idr_) % config_.intra_refresh_period <
+                                INTRA_REFRESH_CNT;
+
+    int8_t changed_delta = QP_CHANGED_DELTA;
+    int8_t static_delta  = QP_STATIC_DELTA;
+    qpDeltas(content_class_, changed_delta, static_delta);
+    if (refreshing) static_delta = 0;
+
+    std::vector<int8_t>& map = qp_maps_[idx];
+    map.resize(block_age_.size());
+    for (size_t i = 0; i < block_age_.size(); ++i) {
+        map[i] = block_age_[i] < QP_SETTLE_FRAMES ? changed_delta : static_delta;
+    }
+    return map.data();
+}
+
+void NvencEncoder::qpDeltas(ContentClass cls, int8_t& changed, int8_t& still) {
+    switch (cls) {
+        case ContentClass::MOTION:
+            // Nearly every block is changed: lowering them all only fights
+            // the rate control, and the QP swings from frame to frame
+            changed = 0;
+            still   = QP_STATIC_DELTA;
+            break;
+        case ContentClass::TEXT:
+            // Glyph edges show a QP a game hides: new text sharpens at
+            // once, and settles at the normal QP, not a coarser one
+            changed = QP_CHANGED_DELTA * 2;
+            still   = 0;
+            break;
+        case ContentClass::VIDEO:
+            // The bits go to the playing region, away from the frame around it
+            changed = QP_CHANGED_DELTA;
+            still   = QP_STATIC_DELTA + 2;
+            break;
+        case ContentClass::STATIC:
+            // The few changes there are (a cursor, a clock) get the bits
+            changed = QP_CHANGED_DELTA - 1;
+            still   = QP_STATIC_DELTA;
+            break;
+        case ContentClass::UNKNOWN:
+            changed = QP_CHANGED_DELTA;
+            still   = QP_STATIC_DELTA;
+            break;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// setContentClass -- QP map tuning for the content class
+// ---------------------------------------------------------------------------
+
+void NvencEncoder::setContentClass(ContentClass cls) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    if (cls == content_class_) return;
+    content_class_ = cls;
+    if (qp_map_enabled_) {
+        int8_t changed = 0, still = 0;
+        qpDeltas(cls, changed, still);
+        CS_LOG(DEBUG, "NVENC: %s content -- QP deltas %+d changed, %+d static",
+               contentClassName(cls), changed, still);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// registerEvents / unregisterEvents -- completion events for async mode
+// ---------------------------------------------------------------------------
+
+bool NvencEncoder::registerEvents(uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        events_[i] = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+        if (!events_[i]) {
+            CS_LOG(ERR, "NVENC: CreateEvent failed (%lu)", GetLastError());
+            return false;
+        }
+
+        NV_ENC_EVENT_PARAMS ev = {};
+        ev.version         = NVENC_STRUCT_VERSION(NV_ENC_EVENT_PARAMS, 1);
+        ev.completionEvent = events_[i];
+        NVENCSTATUS st = api_.nvEncRegisterAsyncEvent(encoder_, &ev);
+        if (st != NV_ENC_SUCCESS) {
+            CS_LOG(ERR, "NVENC: RegisterAsyncEvent[%u] failed: %s", i, nvencStatusString(st));
+            CloseHandle(events_[i]);
+            events_[i] = nullptr;
+            return false;
+        }
+    }
     return true;
 }
 
+void NvencEncoder::unregisterEvents() {
+    for (HANDLE& event : events_) {
+        if (!event) continue;
+        if (encoder_ && api_.nvEncUnregisterAsyncEvent) {
+            NV_ENC_EVENT_PARAMS ev = {};
+            ev.version         = NVENC_STRUCT_VERSION(NV_ENC_EVENT_PARAMS, 1);
+            ev.completionEvent = event;
+            api_.nvEncUnregisterAsyncEvent(encoder_, &ev);
+        }
+        CloseHandle(event);
+        event = nullptr;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// readSlices -- sub-frame readback
+// ---------------------------------------------------------------------------
+
+bool NvencEncoder::readSlices(int idx, EncodedPacket& packet, const SliceCallback& on_slice,
+                              NV_ENC_LOCK_BITSTREAM& lockBits) {
+    packet.data.clear();
+    const uint64_t deadline = getTimestampUs() + SLICE_READ_TIMEOUT_US;
+
+    for (;;) {
+        lockBits = {};
+        lockBits.version         = NVENC_STRUCT_VERSION(NV_ENC_LOCK_BITSTREAM, 1);
+        lockBits.outputBitstream = output_bufs_[idx];
+        lockBits.doNotWait       = 1;
+        lockBits.sliceOffsets    = slice_offsets_.data();
+
+        NVENCSTATUS st = api_.nvEncLockBitstream(encoder_, &lockBits);
+        if (st != NV_ENC_SUCCESS && st != NV_ENC_ERR_LOCK_BUSY) {
+            CS_LOG(ERR, "NVENC: LockBitstream (sub-frame) failed: %s", nvencStatusString(st));
+            return false;
+        }
+
+        bool   done = false;
+        size_t have = packet.data.size();
+        if (st == NV_ENC_SUCCESS) {
+            done = lockBits.hwEncodeStatus == NV_ENC_HW_ENCODE_COMPLETE;
+
+            // A slice is final once the next one has begun, or the picture
+            // is done; the newest reported slice may still be growing.
+            size_t end = have;
+            if (done) {
+                end = lockBits.bitstreamSizeInBytes;
+            } else if (lockBits.numSlices > 1) {
+                const size_t last = std::min<size_t>(lockBits.numSlices, slice_offsets_.size()) - 1;
+                end = std::max<size_t>(end, slice_offsets_[last]);
+            }
+            if (end > have) {
+                packet.data.resize(end);
+                memcpy(packet.data.data() + have,
+                       static_cast<const uint8_t*>(lockBits.bitstreamBufferPtr) + have, end - have);
+            }
+            api_.nvEncUnlockBitstream(encoder_, output_bufs_[idx]);
+        }
+
+        if (done || packet.data.size() > have) on_slice(packet.data.size());
+        if (done) return true;
+
+        if (getTimestampUs() > deadline) {
+            CS_LOG(ERR, "NVENC: frame %u not finished after %u ms", packet.frame_number,
+                   static_cast<unsigned>(SLICE_READ_TIMEOUT_US / 1000));
+            return false;
+        }
+        std::this_thread::yield();
+    }
+}
+
 // ---------------------------------------------------------------------------
 // reconfigure -- change bitrate/fps without recreating the session
 // ---------------------------------------------------------------------------
 
 bool NvencEncoder::reconfigure(const EncoderConfig& config) {
     if (!initialized_) return false;
+    std::lock_guard<std::mutex> lock(state_mutex_);
 
     // Clamp bitrate to bounds.
     uint32_t newBitrate = config.bitrate_kbps;
@@ -460,15 +1292,241 @@ bool NvencEncoder::reconfigure(const EncoderConfig& config) {
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// restart -- a new stream on the open session
+// ---------------------------------------------------------------------------
+
+bool NvencEncoder::restart(const EncoderConfig& config) {
+    if (!initialized_) return false;
+
+    // Everything fixed at initialize(): the session, its buffers and the
+    // surfaces registered with it stay as they are.
+    const bool same_session =
+        config.codec == config_.codec &&
+        config.width == initParams_.maxEncodeWidth &&
+        config.height == initParams_.maxEncodeHeight &&
+        config.gop_length == config_.gop_length &&
+        config.enable_intra_refresh == config_.enable_intra_refresh &&
+        config.intra_refresh_period == config_.intra_refresh_period &&
+        config.enable_ltr == config_.enable_ltr &&
+        config.temporal_layers == config_.temporal_layers &&
+        config.slices == config_.slices &&
+        config.async_depth == config_.async_depth &&
+        config.split_encode == config_.split_encode &&
+        config.use_change_map == config_.use_change_map &&
+        config.yuv444 == config_.yuv444 &&
+        config.bit_depth == config_.bit_depth &&
+        config.input_format == config_.input_format &&
+        input_memory_ == open_memory_ && input_device_ == open_device_;
+    if (!same_session) return false;
+
+    stopAsync();
+    std::lock_guard<std::mutex> lock(state_mutex_);
+
+    uint32_t bitrate = config.bitrate_kbps;
+    if (bitrate < config.min_bitrate_kbps) bitrate = config.min_bitrate_kbps;
+    if (bitrate > config.max_bitrate_kbps) bitrate = config.max_bitrate_kbps;
+    encConfig_.rcParams.averageBitRate  = bitrate * 1000;
+    encConfig_.rcParams.maxBitRate      = config.max_bitrate_kbps * 1000;
+    encConfig_.rcParams.vbvBufferSize   = bitrate * 1000 / config.fps;
+    encConfig_.rcParams.vbvInitialDelay = encConfig_.rcParams.vbvBufferSize;
+
+    // Back to the full size (the last stream may have been scaled), with
+    // the references of the last stream dropped.
+    NV_ENC_RECONFIGURE_PARAMS reconfParams = {};
+    reconfParams.version            = NVENC_STRUCT_VERSION(NV_ENC_RECONFIGURE_PARAMS, 1);
+    reconfParams.reInitEncodeParams = initParams_;
+    reconfParams.reInitEncodeParams.encodeWidth  = config.width;
+    reconfParams.reInitEncodeParams.encodeHeight = config.height;
+    reconfParams.reInitEncodeParams.darWidth     = config.width;
+    reconfParams.reInitEncodeParams.darHeight    = config.height;
+    reconfParams.reInitEncodeParams.frameRateNum = config.fps;
+    reconfParams.reInitEncodeParams.frameRateDen = 1;
+    reconfParams.resetEncoder       = 1;
+    reconfParams.forceIDR           = 1;
+
+    NVENCSTATUS st = api_.nvEncReconfigureEncoder(encoder_, &reconfParams);
+    if (st != NV_ENC_SUCCESS) {
+        CS_LOG(WARN, "NVENC: restart failed: %s", nvencStatusString(st));
+        return false;
+    }
+    initParams_ = reconfParams.reInitEncodeParams;
+
+    config_ = config;
+    config_.bitrate_kbps = bitrate;
+    frame_num_   = 0;                   // Frame 0 is an IDR
+    force_idr_   = false;
+    cur_buf_     = 0;
+    for (PendingFrame& pending : pending_) pending = PendingFrame{};
+    for (RefFrame& ref : ref_history_) ref = RefFrame{};
+    resetLtr();
+    svc_anchor_  = 0;
+    last_idr_    = 0;
+    have_change_seq_    = false;
+    budget_delta_bytes_ = 0;
+    budget_key_bytes_   = 0;
+
+    CS_LOG(INFO, "NVENC: restarted -- %s %ux%u @ %u fps, %u kbps",
+           codecTypeName(config.codec), config.width, config.height, config.fps, bitrate);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// resize -- code another size within the session's maximum
+// ---------------------------------------------------------------------------
+
+bool NvencEncoder::resize(uint32_t width, uint32_t height) {
+    if (!dyn_res_ || width == 0 || height == 0 ||
+        width > initParams_.maxEncodeWidth || height > initParams_.maxEncodeHeight) {
+        CS_LOG(ERR, "NVENC: cannot code a %ux%u frame in a %ux%u session",
+               width, height, initParams_.maxEncodeWidth, initParams_.maxEncodeHeight);
+        return false;
+    }
+
+    NV_ENC_RECONFIGURE_PARAMS reconfParams = {};
+    reconfParams.version            = NVENC_STRUCT_VERSION(NV_ENC_RECONFIGURE_PARAMS, 1);
+    reconfParams.reInitEncodeParams = initParams_;
+    reconfParams.reInitEncodeParams.encodeWidth  = width;
+    reconfParams.reInitEncodeParams.encodeHeight = height;
+    reconfParams.reInitEncodeParams.darWidth     = width;
+    reconfParams.reInitEncodeParams.darHeight    = height;
+    reconfParams.resetEncoder       = 1;    // References at the old size are gone
+    reconfParams.forceIDR           = 1;
+
+    NVENCSTATUS st = api_.nvEncReconfigureEncoder(encoder_, &reconfParams);
+    if (st != NV_ENC_SUCCESS) {
+        CS_LOG(ERR, "NVENC: resize to %ux%u failed: %s", width, height, nvencStatusString(st));
+        return false;
+    }
+
+    CS_LOG(INFO, "NVENC: coding %ux%u (was %ux%u)", width, height,
+           initParams_.encodeWidth, initParams_.encodeHeight);
+    initParams_   = reconfParams.reInitEncodeParams;
+    config_.width  = width;
+    config_.height = height;
+    for (RefFrame& ref : ref_history_) ref = RefFrame{};
+    force_idr_ = true;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// setFrameBudget / applyFrameBudget -- per-frame size cap through the VBV
+// ---------------------------------------------------------------------------
+
+void NvencEncoder::setFrameBudget(size_t delta_bytes, size_t keyframe_bytes) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    budget_delta_bytes_ = delta_bytes;
+    budget_key_bytes_   = keyframe_bytes;
+}
+
+void NvencEncoder::applyFrameBudget(bool idr) {
+    const size_t budget = idr ? budget_key_bytes_ : budget_delta_bytes_;
+    uint32_t vbv = encConfig_.rcParams.averageBitRate / std::max(config_.fps, 1u);
+    if (budget > 0) {
+        vbv = static_cast<uint32_t>(std::min<size_t>(budget * 8, UINT32_MAX));
+    }
+
+    const uint32_t cur = encConfig_.rcParams.vbvBufferSize;
+    const uint32_t diff = vbv > cur ? vbv - cur : cur - vbv;
+    if (diff <= cur / VBV_RETUNE_FRACTION) return;
+
+    encConfig_.rcParams.vbvBufferSize   = vbv;
+    encConfig_.rcParams.vbvInitialDelay = vbv;
+
+    NV_ENC_RECONFIGURE_PARAMS reconfParams = {};
+    reconfParams.version            = NVENC_STRUCT_VERSION(NV_ENC_RECONFIGURE_PARAMS, 1);
+    reconfParams.reInitEncodeParams = initParams_;
+    reconfParams.resetEncoder       = 0;
+    reconfParams.forceIDR           = 0;
+
+    NVENCSTATUS st = api_.nvEncReconfigureEncoder(encoder_, &reconfParams);
+    if (st != NV_ENC_SUCCESS) {
+        CS_LOG(WARN, "NVENC: frame budget reconfigure failed: %s", nvencStatusString(st));
+        encConfig_.rcParams.vbvBufferSize   = cur;
+        encConfig_.rcParams.vbvInitialDelay = cur;
+        return;
+    }
+    CS_LOG(TRACE, "NVENC: frame budget %u -> %u bytes", cur / 8, vbv / 8);
+}
+
 // ---------------------------------------------------------------------------
 // forceIdr -- set flag to force IDR on next encode call
 // ---------------------------------------------------------------------------
 
 void NvencEncoder::forceIdr() {
+    std::lock_guard<std::mutex> lock(state_mutex_);
     force_idr_ = true;
     CS_LOG(DEBUG, "NVENC: IDR requested for next frame");
 }
 
+// ---------------------------------------------------------------------------
+// invalidateRefFrames -- drop lost frames from the reference list
+// ---------------------------------------------------------------------------
+
+bool NvencEncoder::invalidateRefFrames(uint32_t first_frame, uint32_t last_frame) {
+    if (!initialized_) return false;
+    std::lock_guard<std::mutex> lock(state_mutex_);
+
+    // In LTR mode, predict the next frame from the newest acknowledged LTR
+    // older than the loss.  Setting ltrUseFrames also drops the short-term
+    // references, so nothing after the LTR is referenced again.
+    if (ltr_enabled_) {
+        int best = -1;
+        for (uint32_t i = 0; i < NUM_LTR_SLOTS; ++i) {
+            const LtrSlot& slot = ltr_slots_[i];
+            if (!slot.valid || !slot.acked || slot.frame_num >= first_frame) continue;
+            if (best < 0 || slot.frame_num > ltr_slots_[best].frame_num) best = static_cast<int>(i);
+        }
+        if (best >= 0) {
+            // LTRs marked from the loss on reference lost frames.
+            for (LtrSlot& slot : ltr_slots_) {
+                if (slot.valid && slot.frame_num >= first_frame) slot = LtrSlot{};
+            }
+            ltr_use_slot_ = best;
+            CS_LOG(DEBUG, "NVENC: recovering from LTR frame %u (lost %u-%u)",
+                   ltr_slots_[best].frame_num, first_frame, last_frame);
+            return true;
+        }
+    }
+
+    if (!api_.nvEncInvalidateRefFrames) return false;
+    if (frame_num_ == 0 || last_frame >= frame_num_) last_frame = frame_num_ - 1;
+    if (first_frame > last_frame) return false;
+
+    // The frame just before the loss must still be in the DPB, or nothing
+    // valid would be left to predict from.
+    if (first_frame == 0 || frame_num_ - first_frame >= MAX_REF_FRAMES) {
+        CS_LOG(DEBUG, "NVENC: frame %u is outside the %u-frame reference window",
+               first_frame, MAX_REF_FRAMES);
+        return false;
+    }
+
+    for (uint32_t f = first_frame; f <= last_frame; ++f) {
+        const RefFrame& ref = ref_history_[f % MAX_REF_FRAMES];
+        if (!ref.valid || ref.frame_num != f) return false;
+
+        NVENCSTATUS st = api_.nvEncInvalidateRefFrames(encoder_, ref.timestamp);
+        if (st != NV_ENC_SUCCESS) {
+            CS_LOG(WARN, "NVENC: InvalidateRefFrames(%u) failed: %s", f, nvencStatusString(st));
+            return false;
+        }
+    }
+
+    CS_LOG(DEBUG, "NVENC: invalidated reference frames %u-%u", first_frame, last_frame);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// acknowledgeFrame -- the client holds this LTR frame
+// ---------------------------------------------------------------------------
+
+void NvencEncoder::acknowledgeFrame(uint32_t frame) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    for (LtrSlot& slot : ltr_slots_) {
+        if (slot.valid && slot.frame_num == frame) slot.acked = true;
+    }
+}
+
 // ---------------------------------------------------------------------------
 // flush -- send EOS to drain any pending frames
 // ---------------------------------------------------------------------------
@@ -476,11 +1534,18 @@ void NvencEncoder::forceIdr() {
 void NvencEncoder::flush() {
     if (!initialized_ || !encoder_) return;
 
+    // Frames still in flight come out first.
+    stopAsync();
+
     NV_ENC_PIC_PARAMS eosParams = {};
-    eosParams.version        = NVENC_STRUCT_VERSION(NV_ENC_PIC_PARAMS, 1);
-    eosParams.encodePicFlags = NV_ENC_PIC_FLAG_EOS;
+    eosParams.version         = NVENC_STRUCT_VERSION(NV_ENC_PIC_PARAMS, 1);
+    eosParams.encodePicFlags  = NV_ENC_PIC_FLAG_EOS;
+    eosParams.completionEvent = async_ ? events_[0] : nullptr;
 
     NVENCSTATUS st = api_.nvEncEncodePicture(encoder_, &eosParams);
+    if (st == NV_ENC_SUCCESS && async_) {
+        WaitForSingleObject(events_[0], ASYNC_WAIT_MS);
+    }
     if (st != NV_ENC_SUCCESS) {
         CS_LOG(WARN, "NVENC: flush (EOS) returned: %s", nvencStatusString(st));
     } else {
@@ -493,9 +1558,16 @@ void NvencEncoder::flush() {
 // ---------------------------------------------------------------------------
 
 void NvencEncoder::release() {
+    stopAsync();
+
     if (encoder_) {
+        // Capture surfaces and events go before the session they are
+        // registered with.
+        unregisterInputs();
+        unregisterEvents();
+
         // Destroy input buffers.
-        for (int i = 0; i < NUM_BUFFERS; ++i) {
+        for (int i = 0; i < MAX_BUFFERS; ++i) {
             if (input_bufs_[i]) {
                 api_.nvEncDestroyInputBuffer(encoder_, input_bufs_[i]);
                 input_bufs_[i] = nullptr;
@@ -524,6 +1596,14 @@ void NvencEncoder::release() {
     frame_num_   = 0;
     force_idr_   = false;
     cur_buf_     = 0;
+    num_buffers_ = 2;
+    async_       = false;
+    dyn_res_     = false;
+    for (PendingFrame& pending : pending_) pending = PendingFrame{};
+    for (RefFrame& ref : ref_history_) ref = RefFrame{};
+    resetLtr();
+    svc_layers_  = 1;
+    svc_anchor_  = 0;
 
     CS_LOG(DEBUG, "NVENC: resources released");
 }
@@ -540,6 +1620,50 @@ std::string NvencEncoder::getCodecName() const {
 // Private helpers
 // ---------------------------------------------------------------------------
 
+uint32_t NvencEncoder::nextLtrSlot() const {
+    // Protect the newest acknowledged LTR; otherwise replace the oldest.
+    int keep = -1;
+    for (uint32_t i = 0; i < NUM_LTR_SLOTS; ++i) {
+        const LtrSlot& slot = ltr_slots_[i];
+        if (slot.valid && slot.acked &&
+            (keep < 0 || slot.frame_num > ltr_slots_[keep].frame_num)) {
+            keep = static_cast<int>(i);
+        }
+    }
+
+    uint32_t best = 0;
+    for (uint32_t i = 0; i < NUM_LTR_SLOTS; ++i) {
+        if (static_cast<int>(i) == keep) continue;
+        if (!ltr_slots_[i].valid) return i;
+        if (static_cast<int>(best) == keep ||
+            ltr_slots_[i].frame_num < ltr_slots_[best].frame_num) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+void NvencEncoder::resetLtr() {
+    for (LtrSlot& slot : ltr_slots_) slot = LtrSlot{};
+    ltr_marked_   = false;
+    ltr_use_slot_ = -1;
+}
+
+uint32_t NvencEncoder::expectedTemporalLayer() const {
+    if (svc_layers_ <= 1) return 0;
+
+    // Dyadic pattern: with 3 layers, positions 0..3 are T0 T2 T1 T2.
+    const uint32_t period = 1u << (svc_layers_ - 1);
+    uint32_t pos = (frame_num_ - svc_anchor_) % period;
+    if (pos == 0) return 0;
+    uint32_t layer = svc_layers_ - 1;
+    while ((pos & 1u) == 0) {
+        pos >>= 1;
+        --layer;
+    }
+    return layer;
+}
+
 NV_ENC_GUID NvencEncoder::codecToGuid(CodecType codec) const {
     switch (codec) {
         case CodecType::H264: return NV_ENC_CODEC_H264_GUID;
@@ -549,20 +1673,98 @@ NV_ENC_GUID NvencEncoder::codecToGuid(CodecType codec) const {
     return NV_ENC_CODEC_H264_GUID;
 }
 
-NV_ENC_GUID NvencEncoder::profileGuid(CodecType codec) const {
-    switch (codec) {
-        case CodecType::H264: return NV_ENC_H264_PROFILE_HIGH_GUID;
-        case CodecType::HEVC: return NV_ENC_HEVC_PROFILE_MAIN_GUID;
-        case CodecType::AV1:  return NV_ENC_AV1_PROFILE_MAIN_GUID;
+NV_ENC_GUID NvencEncoder::presetToGuid(uint32_t preset) const {
+    switch (preset) {
+        case 2: return NV_ENC_PRESET_P2_GUID;
+        case 3: return NV_ENC_PRESET_P3_GUID;
+        case 4: return NV_ENC_PRESET_P4_GUID;
+        case 5: return NV_ENC_PRESET_P5_GUID;
+        case 6: return NV_ENC_PRESET_P6_GUID;
+        case 7: return NV_ENC_PRESET_P7_GUID;
+    }
+    return NV_ENC_PRESET_P1_GUID;
+}
+
+NV_ENC_GUID NvencEncoder::profileGuid(const EncoderConfig& config) const {
+    switch (config.codec) {
+        case CodecType::H264:
+            return config.yuv444 ? NV_ENC_H264_PROFILE_HIGH_444_GUID : NV_ENC_H264_PROFILE_HIGH_GUID;
+        case CodecType::HEVC:
+            return config.yuv444       ? NV_ENC_HEVC_PROFILE_FREXT_GUID
+                 : config.bit_depth > 8 ? NV_ENC_HEVC_PROFILE_MAIN10_GUID
+                                        : NV_ENC_HEVC_PROFILE_MAIN_GUID;
+        case CodecType::AV1:
+            return NV_ENC_AV1_PROFILE_MAIN_GUID;    // 8- and 10-bit 4:2:0
     }
     return NV_ENC_H264_PROFILE_HIGH_GUID;
 }
 
+uint32_t NvencEncoder::splitWays(const EncoderConfig& config, uint32_t engines) {
+    if (config.codec == CodecType::H264 || engines < 2) return 1;
+
+    uint32_t ways = 1;
+    switch (config.split_encode) {
+        case SplitEncode::OFF:   return 1;
+        case SplitEncode::TWO:   ways = 2; break;
+        case SplitEncode::THREE: ways = 3; break;
+        case SplitEncode::AUTO: {
+            const uint64_t pixel_rate = static_cast<uint64_t>(config.width) * config.height * config.fps;
+            ways = static_cast<uint32_t>((pixel_rate + ENGINE_PIXEL_RATE - 1) / ENGINE_PIXEL_RATE);
+            break;
+        }
+    }
+    return std::clamp(ways, 1u, std::min(engines, MAX_SPLIT_WAYS));
+}
+
+bool NvencEncoder::checkPictureFormat(const EncoderConfig& config, const NV_ENC_GUID& encodeGuid) {
+    auto cap = [&](NV_ENC_CAPS which) {
+        if (!api_.nvEncGetEncodeCaps) return 0;
+        NV_ENC_CAPS_PARAM caps = {};
+        caps.version     = NVENC_STRUCT_VERSION(NV_ENC_CAPS_PARAM, 1);
+        caps.capsToQuery = which;
+        int value = 0;
+        return api_.nvEncGetEncodeCaps(encoder_, encodeGuid, &caps, &value) == NV_ENC_SUCCESS
+                   ? value : 0;
+    };
+
+    const FrameFormat in = config.input_format;
+    const bool rgb_in = in == FrameFormat::BGRA8 || in == FrameFormat::ARGB8;
+
+    if (config.yuv444) {
+        // NVENC's AV1 is 4:2:0 only (Main profile)
+        if (config.codec == CodecType::AV1 || !cap(NV_ENC_CAPS_SUPPORT_YUV444_ENCODE)) {
+            CS_LOG(WARN, "NVENC: 4:4:4 not supported for %s", codecTypeName(config.codec));
+            return false;
+        }
+        if (config.bit_depth > 8) {
+            CS_LOG(WARN, "NVENC: 10-bit 4:4:4 not supported");
+            return false;
+        }
+        if (!rgb_in && in != FrameFormat::YUV444 && in != FrameFormat::AYUV) {
+            CS_LOG(WARN, "NVENC: 4:4:4 needs 4:4:4 or RGB input");
+            return false;
+        }
+    }
+    if (config.bit_depth > 8 &&
+        (config.codec == CodecType::H264 || !cap(NV_ENC_CAPS_SUPPORT_10BIT_ENCODE))) {
+        CS_LOG(WARN, "NVENC: 10-bit not supported for %s", codecTypeName(config.codec));
+        return false;
+    }
+    if (in == FrameFormat::P010 && config.bit_depth <= 8) {
+        CS_LOG(WARN, "NVENC: 10-bit input needs a 10-bit encode");
+        return false;
+    }
+    return true;
+}
+
 NV_ENC_BUFFER_FORMAT NvencEncoder::frameFormatToNvenc(FrameFormat fmt) const {
     switch (fmt) {
         case FrameFormat::BGRA8: return NV_ENC_BUFFER_FORMAT_ARGB;   // BGRA maps to ARGB in NVENC
         case FrameFormat::ARGB8: return NV_ENC_BUFFER_FORMAT_ARGB;
         case FrameFormat::NV12:  return NV_ENC_BUFFER_FORMAT_NV12;
+        case FrameFormat::YUV444: return NV_ENC_BUFFER_FORMAT_YUV444;
+        case FrameFormat::AYUV:  return NV_ENC_BUFFER_FORMAT_AYUV;
+        case FrameFormat::P010:  return NV_ENC_BUFFER_FORMAT_YUV420_10BIT;
     }
     return NV_ENC_BUFFER_FORMAT_ARGB;
 }
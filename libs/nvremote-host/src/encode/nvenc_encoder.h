@@ -9,7 +9,16 @@
 //   - CBR rate control for streaming
 //   - Dynamic reconfiguration of bitrate/fps without session recreation
 //   - On-demand IDR frame insertion
-//   - Async encode with double-buffered input/output
+//   - Async encode: a ring of 3-6 input/output pairs, each signalling a
+//     completion event, drained in order by a dedicated output thread
+//   - Zero-copy input: opened on the capture's CUDA context or D3D11
+//     device, the capture surfaces are registered once and mapped per
+//     frame; only system-memory frames are copied into an input buffer
+//   - 4:4:4 (H.264 High 4:4:4, HEVC RExt) and 10-bit (HEVC Main10, AV1)
+//     where the GPU reports them; initialize() fails otherwise
+//   - Split-frame encoding (HEVC, AV1): on a GPU with several NVENC
+//     engines each picture is coded as strips on two or three of them and
+//     comes back as one bitstream, for 4K at high refresh and 8K
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
@@ -20,7 +29,11 @@
 #endif
 #include <Windows.h>
 
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace cs::host {
@@ -86,16 +99,32 @@ static const NV_ENC_GUID NV_ENC_CODEC_AV1_GUID =
 // Profile GUIDs
 static const NV_ENC_GUID NV_ENC_H264_PROFILE_HIGH_GUID =
     { 0xE7CBC309, 0x4F7A, 0x4B89, { 0xAF, 0x2A, 0xD5, 0x37, 0xC9, 0x2B, 0xE3, 0x10 } };
+static const NV_ENC_GUID NV_ENC_H264_PROFILE_HIGH_444_GUID =
+    { 0x7AC663CB, 0xA598, 0x4960, { 0xB8, 0x44, 0x33, 0x9B, 0x26, 0x1A, 0x7D, 0x52 } };
 static const NV_ENC_GUID NV_ENC_HEVC_PROFILE_MAIN_GUID =
     { 0xB514C39A, 0x09A3, 0x4978, { 0x92, 0x80, 0x15, 0x62, 0xF1, 0x14, 0x6E, 0xF1 } };
+static const NV_ENC_GUID NV_ENC_HEVC_PROFILE_MAIN10_GUID =
+    { 0xFA4D2B6C, 0x3A5B, 0x411A, { 0x80, 0x18, 0x0A, 0x3F, 0x5E, 0x3C, 0x9B, 0xE5 } };
+static const NV_ENC_GUID NV_ENC_HEVC_PROFILE_FREXT_GUID =    // 4:4:4
+    { 0x51EC32B5, 0x1B4C, 0x453C, { 0x9C, 0xBD, 0xB6, 0x16, 0xBD, 0x62, 0x13, 0x41 } };
 static const NV_ENC_GUID NV_ENC_AV1_PROFILE_MAIN_GUID =
     { 0x5F2A39F5, 0xF14E, 0x4F95, { 0x9A, 0x39, 0x69, 0x69, 0xA5, 0xB1, 0xC6, 0xC4 } };
 
-// Preset GUIDs (SDK 12.x style)
+// Preset GUIDs (SDK 12.x style): P1 fastest .. P7 slowest, best quality
 static const NV_ENC_GUID NV_ENC_PRESET_P1_GUID =
     { 0xFC0A8D3E, 0x45F8, 0x4CF8, { 0x80, 0xC7, 0x29, 0x88, 0x71, 0x59, 0x0E, 0xBF } };
+static const NV_ENC_GUID NV_ENC_PRESET_P2_GUID =
+    { 0xF581CFB8, 0x88D6, 0x4381, { 0x93, 0xF0, 0xDF, 0x13, 0xF9, 0xC2, 0x7D, 0xAB } };
 static const NV_ENC_GUID NV_ENC_PRESET_P3_GUID =
-    { 0x36850110, 0x3A07, 0x441F, { 0x94, 0xD5, 0x3E, 0x73, 0x71, 0xA2, 0x2E, 0x68 } };
+    { 0x36850110, 0x3A07, 0x441F, { 0x94, 0xD5, 0x36, 0x70, 0x63, 0x1F, 0x91, 0xF6 } };
+static const NV_ENC_GUID NV_ENC_PRESET_P4_GUID =
+    { 0x90A7B826, 0xDF06, 0x4862, { 0xB9, 0xD2, 0xCD, 0x6D, 0x73, 0xA0, 0x86, 0x81 } };
+static const NV_ENC_GUID NV_ENC_PRESET_P5_GUID =
+    { 0x21C6E6B4, 0x297A, 0x4CBA, { 0x99, 0x8F, 0xB6, 0xCB, 0xDE, 0x72, 0xAD, 0xE3 } };
+static const NV_ENC_GUID NV_ENC_PRESET_P6_GUID =
+    { 0x8E75C279, 0x6299, 0x4AB6, { 0x83, 0x02, 0x0B, 0x21, 0x5A, 0x33, 0x5C, 0xF5 } };
+static const NV_ENC_GUID NV_ENC_PRESET_P7_GUID =
+    { 0x84848C12, 0x6F71, 0x4C13, { 0x93, 0x1B, 0x53, 0xE2, 0x83, 0xF5, 0x79, 0x74 } };
 
 // Tuning info
 enum NV_ENC_TUNING_INFO : uint32_t {
@@ -115,6 +144,14 @@ enum NV_ENC_PARAMS_RC_MODE : uint32_t {
     NV_ENC_PARAMS_RC_CBR_HQ     = 0x200,
 };
 
+// What NV_ENC_PIC_PARAMS::qpDeltaMap holds
+enum NV_ENC_QP_MAP_MODE : uint32_t {
+    NV_ENC_QP_MAP_DISABLED      = 0x0,
+    NV_ENC_QP_MAP_EMPHASIS      = 0x1,
+    NV_ENC_QP_MAP_DELTA         = 0x2,
+    NV_ENC_QP_MAP               = 0x3,
+};
+
 // Picture type
 enum NV_ENC_PIC_TYPE : uint32_t {
     NV_ENC_PIC_TYPE_P           = 0,
@@ -134,8 +171,19 @@ enum NV_ENC_BUFFER_FORMAT : uint32_t {
     NV_ENC_BUFFER_FORMAT_YV12           = 0x00000010,
     NV_ENC_BUFFER_FORMAT_IYUV           = 0x00000100,
     NV_ENC_BUFFER_FORMAT_YUV444         = 0x00001000,
-    NV_ENC_BUFFER_FORMAT_ARGB           = 0x00100000,
-    NV_ENC_BUFFER_FORMAT_ABGR           = 0x01000000,
+    NV_ENC_BUFFER_FORMAT_YUV420_10BIT   = 0x00010000,   // P010
+    NV_ENC_BUFFER_FORMAT_YUV444_10BIT   = 0x00100000,
+    NV_ENC_BUFFER_FORMAT_ARGB           = 0x01000000,
+    NV_ENC_BUFFER_FORMAT_ARGB10         = 0x02000000,
+    NV_ENC_BUFFER_FORMAT_AYUV           = 0x04000000,
+    NV_ENC_BUFFER_FORMAT_ABGR           = 0x10000000,
+};
+
+// Bit depth of the input / the coded stream
+enum NV_ENC_BIT_DEPTH : uint32_t {
+    NV_ENC_BIT_DEPTH_INVALID    = 0,
+    NV_ENC_BIT_DEPTH_8          = 8,
+    NV_ENC_BIT_DEPTH_10         = 10,
 };
 
 // Encode device type
@@ -152,6 +200,37 @@ enum NV_ENC_PIC_FLAGS : uint32_t {
     NV_ENC_PIC_FLAG_EOS                 = 0x8,
 };
 
+// Capabilities queried with nvEncGetEncodeCaps (subset of NV_ENC_CAPS)
+enum NV_ENC_CAPS : uint32_t {
+    NV_ENC_CAPS_NUM_MAX_TEMPORAL_LAYERS = 10,
+    NV_ENC_CAPS_SUPPORT_DYN_RES_CHANGE  = 19,
+    NV_ENC_CAPS_ASYNC_ENCODE_SUPPORT    = 30,
+    NV_ENC_CAPS_SUPPORT_YUV444_ENCODE   = 33,
+    NV_ENC_CAPS_SUPPORT_10BIT_ENCODE    = 39,
+    NV_ENC_CAPS_NUM_MAX_LTR_FRAMES      = 40,
+    NV_ENC_CAPS_NUM_ENCODER_ENGINES     = 49,
+};
+
+// NV_ENC_INITIALIZE_PARAMS::splitEncodeMode (SDK 12.1+, HEVC and AV1)
+enum NV_ENC_SPLIT_ENCODE_MODE : uint32_t {
+    NV_ENC_SPLIT_AUTO_MODE         = 0,    // The driver decides
+    NV_ENC_SPLIT_AUTO_FORCED_MODE  = 1,
+    NV_ENC_SPLIT_TWO_FORCED_MODE   = 2,
+    NV_ENC_SPLIT_THREE_FORCED_MODE = 3,
+    NV_ENC_SPLIT_DISABLE_MODE      = 15,
+};
+
+// Resource types for nvEncRegisterResource
+enum NV_ENC_INPUT_RESOURCE_TYPE : uint32_t {
+    NV_ENC_INPUT_RESOURCE_TYPE_DIRECTX       = 0,
+    NV_ENC_INPUT_RESOURCE_TYPE_CUDADEVICEPTR = 1,
+};
+
+// Registered resource usage
+enum NV_ENC_BUFFER_USAGE : uint32_t {
+    NV_ENC_INPUT_IMAGE = 0,
+};
+
 // Memory heap (unused on modern drivers, kept for struct compat)
 enum NV_ENC_MEMORY_HEAP : uint32_t {
     NV_ENC_MEMORY_HEAP_AUTOSELECT = 0,
@@ -207,8 +286,9 @@ struct NV_ENC_RC_PARAMS {
     uint32_t                vbvInitialDelay      = 0;
     uint32_t                enableMinQP          = 0;
     uint32_t                enableMaxQP          = 0;
+    NV_ENC_QP_MAP_MODE      qpMapMode            = NV_ENC_QP_MAP_DISABLED;
     // Remaining fields are zero-initialized via reserved.
-    uint32_t                reserved[256]        = {};
+    uint32_t                reserved[255]        = {};
 };
 
 struct NV_ENC_CONFIG_H264 {
@@ -243,7 +323,10 @@ struct NV_ENC_CONFIG_H264 {
     uint32_t numRefL1                  = 0;
     uint32_t intraRefreshPeriod        = 0;
     uint32_t intraRefreshCnt           = 0;
-    uint32_t reserved[236]             = {};
+    uint32_t ltrNumFrames              = 0;
+    uint32_t ltrTrustMode              = 0;
+    uint32_t chromaFormatIDC           = 1;   // 1 = 4:2:0, 3 = 4:4:4
+    uint32_t reserved[233]             = {};
 };
 
 struct NV_ENC_CONFIG_HEVC {
@@ -258,7 +341,34 @@ struct NV_ENC_CONFIG_HEVC {
     uint32_t repeatSPSPPS             = 1;
     uint32_t enableSAO                 = 0;
     uint32_t maxNumRefFramesInDPB      = 0;
-    uint32_t reserved[252]             = {};
+    uint32_t enableLTR                 = 0;
+    uint32_t ltrNumFrames              = 0;
+    uint32_t ltrTrustMode              = 0;
+    uint32_t enableTemporalSVC         = 0;
+    uint32_t numTemporalLayers         = 0;
+    uint32_t sliceMode                 = 0;
+    uint32_t sliceModeData             = 0;
+    uint32_t chromaFormatIDC           = 1;
+    NV_ENC_BIT_DEPTH inputBitDepth     = NV_ENC_BIT_DEPTH_8;
+    NV_ENC_BIT_DEPTH outputBitDepth    = NV_ENC_BIT_DEPTH_8;
+    uint32_t reserved[242]             = {};
+};
+
+struct NV_ENC_CONFIG_AV1 {
+    uint32_t level                     = 0;
+    uint32_t tier                      = 0;
+    uint32_t idrPeriod                 = 120;
+    uint32_t repeatSeqHdr              = 1;
+    uint32_t enableIntraRefresh        = 0;
+    uint32_t intraRefreshPeriod        = 0;
+    uint32_t intraRefreshCnt           = 0;
+    uint32_t maxNumRefFramesInDPB      = 0;
+    uint32_t enableTemporalSVC         = 0;
+    uint32_t numTemporalLayers         = 0;
+    uint32_t chromaFormatIDC           = 1;
+    NV_ENC_BIT_DEPTH inputBitDepth     = NV_ENC_BIT_DEPTH_8;
+    NV_ENC_BIT_DEPTH outputBitDepth    = NV_ENC_BIT_DEPTH_8;
+    uint32_t reserved[243]             = {};
 };
 
 struct NV_ENC_CONFIG {
@@ -274,6 +384,7 @@ struct NV_ENC_CONFIG {
     // In practice, only one of these is active.
     NV_ENC_CONFIG_H264  encodeCodecConfig_h264 = {};
     NV_ENC_CONFIG_HEVC  encodeCodecConfig_hevc = {};
+    NV_ENC_CONFIG_AV1   encodeCodecConfig_av1  = {};
     uint32_t            reserved[188]   = {};
 };
 
@@ -337,25 +448,33 @@ struct NV_ENC_LOCK_INPUT_BUFFER {
     uint32_t reserved[62] = {};
 };
 
+// Slice mode 3: sliceModeData is the number of slices per picture.
+constexpr uint32_t NV_ENC_SLICE_MODE_NUM_SLICES = 3;
+
+// NV_ENC_LOCK_BITSTREAM::hwEncodeStatus for a finished picture (sub-frame
+// readback with doNotWait).
+constexpr uint32_t NV_ENC_HW_ENCODE_COMPLETE = 2;
+
 struct NV_ENC_LOCK_BITSTREAM {
     uint32_t           version            = 0;
     uint32_t           doNotWait          = 0;
     void*              outputBitstream    = nullptr;
     void*              sliceOffsets       = nullptr;
     uint32_t           frameIdx           = 0;
-    uint32_t           hwEncodeStatus     = 0;
+    uint32_t           hwEncodeStatus     = 0;   // NV_ENC_HW_ENCODE_COMPLETE once fully written
     uint32_t           numSlices          = 0;
     uint32_t           bitstreamSizeInBytes = 0;
     uint64_t           outputTimeStamp    = 0;
     uint64_t           outputDuration     = 0;
     void*              bitstreamBufferPtr = nullptr;
     NV_ENC_PIC_TYPE    pictureType        = NV_ENC_PIC_TYPE_UNKNOWN;
-    uint32_t           reserved[62]       = {};
+    uint32_t           temporalId         = 0;   // Temporal layer with temporal SVC
+    uint32_t           reserved[61]       = {};
 };
 
 struct NV_ENC_REGISTER_RESOURCE {
     uint32_t             version           = 0;
-    uint32_t             resourceType      = 0;   // 0 = DIRECTX, 1 = CUDA, etc.
+    uint32_t             resourceType      = 0;   // NV_ENC_INPUT_RESOURCE_TYPE
     uint32_t             width             = 0;
     uint32_t             height            = 0;
     uint32_t             pitch             = 0;
@@ -363,7 +482,7 @@ struct NV_ENC_REGISTER_RESOURCE {
     void*                resourceToRegister= nullptr;
     void*                registeredResource= nullptr;
     NV_ENC_BUFFER_FORMAT bufferFormat      = NV_ENC_BUFFER_FORMAT_UNDEFINED;
-    uint32_t             bufferUsage       = 0;
+    uint32_t             bufferUsage       = NV_ENC_INPUT_IMAGE;
     void*                pInputFencePoint  = nullptr;
     void*                pOutputFencePoint = nullptr;
     uint32_t             reserved[248]     = {};
@@ -379,6 +498,15 @@ struct NV_ENC_MAP_INPUT_RESOURCE {
     uint32_t reserved[62]        = {};
 };
 
+// Per-picture codec parameters -- only the long-term reference controls.
+struct NV_ENC_PIC_PARAMS_LTR {
+    uint32_t                ltrMarkFrame      = 0;   // Store this frame as an LTR
+    uint32_t                ltrMarkFrameIdx   = 0;   // LTR slot to store it in
+    uint32_t                ltrUseFrames      = 0;   // Predict only from ltrUseFrameBitmap
+    uint32_t                ltrUseFrameBitmap = 0;   // One bit per LTR slot
+    uint32_t                reserved[252]     = {};
+};
+
 struct NV_ENC_PIC_PARAMS {
     uint32_t                version           = 0;
     uint32_t                inputWidth        = 0;
@@ -393,7 +521,19 @@ struct NV_ENC_PIC_PARAMS {
     void*                   completionEvent   = nullptr;
     NV_ENC_BUFFER_FORMAT    bufferFmt         = NV_ENC_BUFFER_FORMAT_UNDEFINED;
     NV_ENC_PIC_TYPE         pictureType       = NV_ENC_PIC_TYPE_UNKNOWN;
-    uint32_t                reserved[256]     = {};
+    // Codec-specific picture params (H.264 / HEVC share the LTR layout).
+    NV_ENC_PIC_PARAMS_LTR   codecPicParams    = {};
+    int8_t*                 qpDeltaMap        = nullptr;   // One signed delta per block
+    uint32_t                qpDeltaMapSize    = 0;
+    uint32_t                reserved[252]     = {};
+};
+
+struct NV_ENC_EVENT_PARAMS {
+    uint32_t                version           = 0;
+    uint32_t                reserved          = 0;
+    void*                   completionEvent   = nullptr;   // Win32 event HANDLE
+    uint32_t                reserved1[253]    = {};
+    void*                   reserved2[64]     = {};
 };
 
 struct NV_ENC_RECONFIGURE_PARAMS {
@@ -440,6 +580,9 @@ struct NV_ENCODE_API_FUNCTION_LIST {
     NVENCSTATUS (*nvEncMapInputResource)(void* encoder, NV_ENC_MAP_INPUT_RESOURCE* params)       = nullptr;
     NVENCSTATUS (*nvEncUnmapInputResource)(void* encoder, void* mappedResource)                   = nullptr;
     NVENCSTATUS (*nvEncDestroyEncoder)(void* encoder)                                             = nullptr;
+    NVENCSTATUS (*nvEncRegisterAsyncEvent)(void* encoder, NV_ENC_EVENT_PARAMS* params)          = nullptr;
+    NVENCSTATUS (*nvEncUnregisterAsyncEvent)(void* encoder, NV_ENC_EVENT_PARAMS* params)        = nullptr;
+    NVENCSTATUS (*nvEncInvalidateRefFrames)(void* encoder, uint64_t invalidRefFrameTimeStamp)     = nullptr;
     NVENCSTATUS (*nvEncReconfigureEncoder)(void* encoder, NV_ENC_RECONFIGURE_PARAMS* params)     = nullptr;
     NVENCSTATUS (*nvEncOpenEncodeSessionEx)(void* params, void** encoder)                         = nullptr;
 
@@ -458,9 +601,26 @@ public:
     ~NvencEncoder() override;
 
     bool initialize(const EncoderConfig& config) override;
+    void setInputDevice(FrameMemory memory, void* device) override;
     bool encode(const CapturedFrame& frame, EncodedPacket& packet) override;
+    bool encodeSliced(const CapturedFrame& frame, EncodedPacket& packet,
+                      const SliceCallback& on_slice) override;
+    uint32_t getSliceCount() const override { return slices_; }
+    bool startAsync(PacketCallback on_packet) override;
+    bool submit(const CapturedFrame& frame) override;
+    void stopAsync() override;
+    uint32_t getInFlight() const override;
     bool reconfigure(const EncoderConfig& config) override;
+    bool restart(const EncoderConfig& config) override;
+    bool canResize() const override { return dyn_res_; }
     void forceIdr() override;
+    bool invalidateRefFrames(uint32_t first_frame, uint32_t last_frame) override;
+    void acknowledgeFrame(uint32_t frame) override;
+    uint32_t getTemporalLayers() const override { return svc_layers_; }
+    uint32_t getEngines() const override { return engines_; }
+    uint32_t getSplitWays() const override { return split_ways_; }
+    void setFrameBudget(size_t delta_bytes, size_t keyframe_bytes) override;
+    void setContentClass(ContentClass cls) override;
     void flush() override;
     void release() override;
     std::string getCodecName() const override;
@@ -471,10 +631,57 @@ public:
 private:
     bool loadLibrary();
     bool openSession();
+    bool createDevice();
     NV_ENC_GUID codecToGuid(CodecType codec) const;
-    NV_ENC_GUID profileGuid(CodecType codec) const;
+    NV_ENC_GUID presetToGuid(uint32_t preset) const;
+    NV_ENC_GUID profileGuid(const EncoderConfig& config) const;
+
+    /// Whether the GPU codes |config|'s chroma format and bit depth from
+    /// its input_format.  Logs why not.
+    bool checkPictureFormat(const EncoderConfig& config, const NV_ENC_GUID& encodeGuid);
     NV_ENC_BUFFER_FORMAT frameFormatToNvenc(FrameFormat fmt) const;
 
+    /// encode() / encodeSliced(): |on_slice| is null for whole-frame output.
+    bool encodeFrame(const CapturedFrame& frame, EncodedPacket& packet,
+                     const SliceCallback* on_slice);
+
+    /// Queue |frame| on the next slot and record what is known about it
+    /// ahead of the output.  Returns the slot in |idx|.
+    bool submitFrame(const CapturedFrame& frame, int& idx);
+
+    /// Wait for slot |idx|, read its bitstream into |packet| and release
+    /// the slot's input.
+    bool completeFrame(int idx, EncodedPacket& packet, const SliceCallback* on_slice);
+
+    /// Output thread: completes submitted slots in order.
+    void outputLoop();
+
+    /// Create / destroy the completion events of the first |count| slots.
+    bool registerEvents(uint32_t count);
+    void unregisterEvents();
+
+    /// Sub-frame readback of output buffer |idx|: poll the bitstream and
+    /// append each finished slice to |packet|.  Returns the final lock
+    /// (unlocked) for the picture type.
+    bool readSlices(int idx, EncodedPacket& packet, const SliceCallback& on_slice,
+                    NV_ENC_LOCK_BITSTREAM& lockBits);
+
+    /// Copy a system-memory frame into input buffer |idx|.
+    bool copyToInputBuffer(int idx, const CapturedFrame& frame, uint32_t& pitch);
+
+    /// Map a GPU frame for encoding, registering its surface the first
+    /// time it is seen.  Returns the mapped input, unmapped by unmapInput().
+    void* mapInput(const CapturedFrame& frame, NV_ENC_BUFFER_FORMAT& fmt);
+    void unmapInput(void*& mapped);
+
+    /// Unregister every capture surface.
+    void unregisterInputs();
+
+    /// Age the blocks by |frame|'s change map and, unless |idr|, fill slot
+    /// |idx|'s QP delta map from them.  Returns the map, or null to encode
+    /// without one.
+    int8_t* buildQpMap(const CapturedFrame& frame, bool idr, int idx);
+
     HMODULE                           dll_          = nullptr;
     NvEncodeAPICreateInstance_t       createInst_   = nullptr;
     NV_ENCODE_API_FUNCTION_LIST       api_          = {};
@@ -488,13 +695,184 @@ private:
     bool                              force_idr_    = false;
     uint32_t                          frame_num_    = 0;
 
-    // Input / output buffers (double-buffered)
-    static constexpr int NUM_BUFFERS = 2;
-    void*                             input_bufs_[NUM_BUFFERS]  = {};
-    void*                             output_bufs_[NUM_BUFFERS] = {};
+    // Reference history for nvEncInvalidateRefFrames, which names frames by
+    // their inputTimeStamp.  Sized to the DPB: a frame older than that is
+    // no longer a reference and needs no invalidation.
+    static constexpr uint32_t MAX_REF_FRAMES = 8;
+    struct RefFrame {
+        uint32_t frame_num = 0;
+        uint64_t timestamp = 0;
+        bool     valid     = false;
+    };
+    RefFrame                          ref_history_[MAX_REF_FRAMES] = {};
+
+    // Long-term references.  A new LTR is marked every ltr_interval frames
+    // into the slot not holding the newest acknowledged one, so a safe
+    // recovery point always survives until a newer one is acknowledged.
+    static constexpr uint32_t NUM_LTR_SLOTS = 2;
+    struct LtrSlot {
+        uint32_t frame_num = 0;
+        bool     valid     = false;
+        bool     acked     = false;
+    };
+    LtrSlot                           ltr_slots_[NUM_LTR_SLOTS] = {};
+    bool                              ltr_enabled_   = false;
+    bool                              ltr_marked_    = false;   // Any mark since the last IDR
+    uint32_t                          last_ltr_mark_ = 0;
+    int                               ltr_use_slot_  = -1;      // Recover from this slot next
+
+    /// Pick the slot for the next LTR mark.
+    uint32_t nextLtrSlot() const;
+
+    /// Forget all long-term references (after an IDR or on release).
+    void resetLtr();
+
+    // Temporal SVC (HEVC / AV1).  With N layers the encoder repeats a
+    // 2^(N-1) frame pattern starting at each base-layer frame; nothing
+    // references an enhancement-layer frame, so any of them can be dropped.
+    static constexpr uint32_t MAX_TEMPORAL_LAYERS = 3;
+    uint32_t                          svc_layers_    = 1;
+    uint32_t                          svc_anchor_    = 0;       // Last base-layer frame
+
+    /// Layer the encoder's pattern puts the current frame in.
+    uint32_t expectedTemporalLayer() const;
+
+    // Per-frame size budget, applied as the VBV size: with a VBV of B bits
+    // no frame exceeds B.  Only re-applied when it moves by more than
+    // 1 / VBV_RETUNE_FRACTION, since each change is a reconfigure.
+    static constexpr uint32_t VBV_RETUNE_FRACTION = 4;
+    size_t                            budget_delta_bytes_ = 0;
+    size_t                            budget_key_bytes_   = 0;
+
+    /// Set the VBV for the next frame from the budget (0 = one frame at
+    /// the average bitrate).
+    void applyFrameBudget(bool idr);
+
+    // Dynamic resolution.  The session is opened with its initialized size
+    // as maxEncodeWidth / maxEncodeHeight; a frame of another size up to
+    // that is coded at its own size from an IDR on, through a reconfigure
+    // that keeps every buffer and registration.
+    bool                              dyn_res_       = false;
+
+    /// Code |width| x |height| from the next picture on.  Caller holds
+    /// state_mutex_.
+    bool resize(uint32_t width, uint32_t height);
+
+    // Slice output.  Sliced frames carry their metadata before they are
+    // finished, so the encoder must know a keyframe in advance: NVENC's
+    // own IDR schedule is turned off and idr_interval_ is kept here.
+    static constexpr uint32_t MAX_SLICES = 16;
+    uint32_t                          slices_        = 1;
+    uint32_t                          idr_interval_  = 0;       // 0 = IDRs only on request
+    uint32_t                          last_idr_      = 0;
+    std::vector<uint32_t>             slice_offsets_;           // One entry per macroblock
+    static constexpr uint64_t SLICE_READ_TIMEOUT_US = 100'000;
+
+    // Split-frame encoding.  AUTO splits a picture into as many strips as
+    // its pixel rate needs at ENGINE_PIXEL_RATE each, up to the engines
+    // the GPU has and MAX_SPLIT_WAYS; the split is fixed at initialize().
+    static constexpr uint64_t ENGINE_PIXEL_RATE = 3840ULL * 2160 * 60;   // 4K60 per engine
+    static constexpr uint32_t MAX_SPLIT_WAYS    = 3;
+    uint32_t                          engines_       = 1;
+    uint32_t                          split_ways_    = 1;
+
+    /// Strips |config|'s pictures are split into on |engines| engines.
+    static uint32_t splitWays(const EncoderConfig& config, uint32_t engines);
+
+    // Frames each intra refresh wave is spread over
+    static constexpr uint32_t INTRA_REFRESH_CNT = 5;
+
+    // Change-driven QP.  Each block of the encoder's QP map (macroblock,
+    // CTB or superblock) counts the frames since the capture last saw it
+    // change.  Blocks changed within QP_SETTLE_FRAMES get QP_CHANGED_DELTA,
+    // so new content sharpens quickly; blocks static for longer get
+    // QP_STATIC_DELTA, so the bits go where the picture moves.  Static
+    // blocks keep the normal QP while an intra refresh wave may be
+    // re-coding them, so the refresh does not blur them.
+    static constexpr uint32_t QP_SETTLE_FRAMES = 8;
+    static constexpr int8_t   QP_CHANGED_DELTA = -2;
+    static constexpr int8_t   QP_STATIC_DELTA  = 3;
+    bool                              qp_map_enabled_ = false;
+    uint32_t                          qp_block_      = 16;
+    uint32_t                          qp_cols_       = 0;
+    uint32_t                          qp_rows_       = 0;
+    std::vector<uint8_t>              block_age_;               // Saturates at 255
+    uint32_t                          last_change_seq_ = 0;
+    bool                              have_change_seq_ = false;
+
+    // The deltas follow the content class (setContentClass()), which only
+    // changes the map, never the sequence.  See qpDeltas().
+    ContentClass                      content_class_ = ContentClass::UNKNOWN;
+
+    /// QP deltas for changed and static blocks in |cls|.
+    static void qpDeltas(ContentClass cls, int8_t& changed, int8_t& still);
+
+    // Input / output buffer pairs, used in turn.  The input buffers are
+    // only created for system-memory frames.  A synchronous session uses
+    // two; an asynchronous one async_depth, each with a completion event
+    // NVENC signals once the slot's picture is written.
+    static constexpr int MIN_ASYNC_DEPTH = 3;
+    static constexpr int MAX_BUFFERS     = static_cast<int>(MAX_ASYNC_DEPTH);
+    void*                             input_bufs_[MAX_BUFFERS]  = {};
+    void*                             output_bufs_[MAX_BUFFERS] = {};
+    HANDLE                            events_[MAX_BUFFERS]      = {};
+    int                               num_buffers_              = 2;
     int                               cur_buf_                  = 0;
-
-    // D3D11 device for NVENC session (if using D3D11 device type)
+    bool                              async_                    = false;
+    static constexpr DWORD ASYNC_WAIT_MS = 1000;
+
+    // What submitFrame() decided about the frame in each slot.  All but
+    // the size and the encoder's own picture type is known at submit.
+    struct PendingFrame {
+        uint64_t timestamp_us = 0;
+        uint32_t frame_num    = 0;
+        bool     idr          = false;
+        bool     mark_ltr     = false;
+        uint8_t  layer        = 0;          // Expected temporal layer
+        void*    mapped_input = nullptr;    // Mapped GPU input, if any
+    };
+    PendingFrame                      pending_[MAX_BUFFERS] = {};
+    std::vector<int8_t>               qp_maps_[MAX_BUFFERS];    // Read by NVENC until the slot completes
+
+    // Guards the frame and reference state above against the output
+    // thread and the control calls made while frames are in flight.
+    mutable std::mutex                state_mutex_;
+
+    // Asynchronous output (startAsync() .. stopAsync()).  queue_ holds the
+    // submitted slots oldest first; a slot is free again once popped.
+    PacketCallback                    on_packet_;
+    std::thread                       output_thread_;
+    mutable std::mutex                queue_mutex_;
+    std::condition_variable           queue_cv_;        // Slot submitted / stop
+    std::condition_variable           free_cv_;         // Slot completed
+    std::deque<int>                   queue_;
+    bool                              output_stop_ = false;
+    EncodedPacket                     out_packet_;
+
+    // Where frames arrive (setInputDevice()).  The session is opened on
+    // that CUDA context or D3D11 device so its surfaces can be mapped.
+    FrameMemory                       input_memory_ = FrameMemory::SYSTEM;
+    void*                             input_device_ = nullptr;
+    FrameMemory                       open_memory_  = FrameMemory::SYSTEM;   // The two at
+    void*                             open_device_  = nullptr;               // initialize()
+
+    // Capture surfaces registered with the session.  Capture backends
+    // rotate through a few, so each is registered once and then only
+    // mapped; past MAX_REGISTERED (a mode change) all are dropped.
+    static constexpr size_t MAX_REGISTERED = 8;
+    struct RegisteredInput {
+        void*       resource   = nullptr;   // CUdeviceptr or ID3D11Texture2D*
+        void*       registered = nullptr;
+        uint32_t    width      = 0;
+        uint32_t    height     = 0;
+        uint32_t    pitch      = 0;
+        FrameFormat format     = FrameFormat::BGRA8;
+    };
+    std::vector<RegisteredInput>      registered_;
+
+    // D3D11 device for NVENC session (if using D3D11 device type); a
+    // reference to the capture's device, or a private one for system
+    // memory input
     void*                             d3d_device_   = nullptr;
 };
 
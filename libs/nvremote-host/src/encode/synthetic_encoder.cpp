@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////////////
+// synthetic_encoder.cpp -- Encoder stand-in with realistic frame sizes
+///////////////////////////////////////////////////////////////////////////////
+
+#include "synthetic_encoder.h"
+
+#include "cs/common.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// Construction / destruction
+// ---------------------------------------------------------------------------
+
+SyntheticEncoder::SyntheticEncoder(const SyntheticFrameSizes& sizes)
+    : sizes_(sizes),
+      rng_(sizes.seed) {}
+
+SyntheticEncoder::~SyntheticEncoder() {
+    release();
+}
+
+// ---------------------------------------------------------------------------
+// initialize / reconfigure
+// ---------------------------------------------------------------------------
+
+bool SyntheticEncoder::initialize(const EncoderConfig& config) {
+    config_          = config;
+    temporal_layers_ = std::clamp<uint32_t>(config.temporal_layers, 1, 3);
+    frame_number_    = 0;
+    since_keyframe_  = 0;
+    force_idr_       = true;
+    rng_.seed(sizes_.seed);
+    updateMeans();
+    initialized_ = true;
+
+    CS_LOG(INFO, "SyntheticEncoder: %u kbps @ %u fps, delta ~%.0f B, keyframe ~%.0f B",
+           config_.bitrate_kbps, config_.fps, delta_mean_, keyframe_mean_);
+    return true;
+}
+
+bool SyntheticEncoder::reconfigure(const EncoderConfig& config) {
+    if (!initialized_) return false;
+    config_.bitrate_kbps = config.bitrate_kbps;
+    config_.fps          = config.fps;
+    config_.gop_length   = config.gop_length;
+    updateMeans();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// updateMeans -- split a GOP's bytes between its keyframe and delta frames
+// ---------------------------------------------------------------------------
+
+void SyntheticEncoder::updateMeans() {
+    const double frame_bytes = static_cast<double>(config_.bitrate_kbps) * 1000.0 / 8.0
+                             / std::max<uint32_t>(config_.fps, 1);
+    const double ratio = std::max(1.0f, sizes_.keyframe_ratio);
+
+    if (config_.gop_length == INFINITE_GOP || config_.gop_length <= 1) {
+        delta_mean_ = frame_bytes;
+    } else {
+        const double gop = config_.gop_length;
+        delta_mean_ = frame_bytes * gop / (gop - 1.0 + ratio);
+    }
+    keyframe_mean_ = delta_mean_ * ratio;
+}
+
+// ---------------------------------------------------------------------------
+// encode
+// ---------------------------------------------------------------------------
+
+bool SyntheticEncoder::encode(const CapturedFrame& frame, EncodedPacket& packet) {
+    if (!initialized_) return false;
+
+    const bool gop_due = config_.gop_length != INFINITE_GOP &&
+                         since_keyframe_ >= config_.gop_length;
+    const bool keyframe = force_idr_ || gop_due;
+    force_idr_ = false;
+    since_keyframe_ = keyframe ? 1 : since_keyframe_ + 1;
+
+    // Temporal layer from the position in the keyframe's pattern: every
+    // other frame is layer 1 with two layers, every fourth layer 0 with three
+    uint8_t layer = 0;
+    const uint32_t pos = since_keyframe_ - 1;
+    if (!keyframe && temporal_layers_ == 2) {
+        layer = pos % 2 ? 1 : 0;
+    } else if (!keyframe && temporal_layers_ == 3) {
+        layer = pos % 2 ? 2 : (pos % 4 ? 1 : 0);
+    }
+
+    std::uniform_real_distribution<double> spread(1.0 - sizes_.jitter, 1.0 + sizes_.jitter);
+    size_t size = static_cast<size_t>((keyframe ? keyframe_mean_ : delta_mean_) * spread(rng_));
+    const size_t budget = keyframe ? keyframe_budget_ : delta_budget_;
+    if (budget > 0) size = std::min(size, budget);
+    size = std::max(size, PREAMBLE_BYTES + 1);
+
+    packet.release();
+    packet.data.resize(size);
+    uint8_t* out = packet.data.data();
+    const uint32_t fn  = frame_number_;
+    const uint32_t len = static_cast<uint32_t>(size);
+    std::memcpy(out, &fn, sizeof(fn));
+    std::memcpy(out + sizeof(fn), &len, sizeof(len));
+    for (size_t i = PREAMBLE_BYTES; i < size; ++i) {
+        out[i] = patternByte(fn, i);
+    }
+
+    packet.timestamp_us   = frame.timestamp_us;
+    packet.frame_number   = frame_number_++;
+    packet.is_keyframe    = keyframe;
+    packet.is_ltr         = false;
+    packet.temporal_layer = layer;
+    packet.codec          = config_.codec;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// checkPayload
+// ---------------------------------------------------------------------------
+
+bool SyntheticEncoder::checkPayload(const uint8_t* data, size_t size) {
+    if (!data || size <= PREAMBLE_BYTES) return false;
+
+    uint32_t fn  = 0;
+    uint32_t len = 0;
+    std::memcpy(&fn, data, sizeof(fn));
+    std::memcpy(&len, data + sizeof(fn), sizeof(len));
+    if (len != size) return false;
+
+    const size_t mid = std::max(PREAMBLE_BYTES, size / 2);
+    return data[PREAMBLE_BYTES] == patternByte(fn, PREAMBLE_BYTES) &&
+           data[mid]            == patternByte(fn, mid) &&
+           data[size - 1]       == patternByte(fn, size - 1);
+}
+
+// ---------------------------------------------------------------------------
+// getCodecName
+// ---------------------------------------------------------------------------
+
+std::string SyntheticEncoder::getCodecName() const {
+    return std::string("Synthetic ") + codecTypeName(config_.codec);
+}
+
+} // namespace cs::host
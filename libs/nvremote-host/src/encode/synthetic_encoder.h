@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+// synthetic_encoder.h -- Encoder stand-in with realistic frame sizes, no GPU
+//
+// Produces no bitstream, only frames of the sizes a real encoder would
+// emit at the configured bitrate and frame rate: keyframes at the GOP
+// length (or on forceIdr()) several times the size of a delta frame,
+// with the delta frames sized so the average over a GOP meets the
+// bitrate, and every frame varied at random around its mean.  That is
+// what the transport sees of an encoder, so the send path can be
+// exercised and measured end to end (the loopback pipeline benchmark)
+// without NVENC.
+//
+// The payload is a pattern the receiver can check with checkPayload():
+// the frame number and size up front, then bytes derived from both.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "encoder_interface.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// SyntheticFrameSizes -- the frame size distribution
+// ---------------------------------------------------------------------------
+struct SyntheticFrameSizes {
+    float    keyframe_ratio = 8.0f;    // Keyframe size over the mean delta frame size
+    float    jitter         = 0.25f;   // Each frame uniform within +/- this fraction of its mean
+    uint32_t seed           = 1;       // Random sequence (same seed, same sizes)
+};
+
+// ---------------------------------------------------------------------------
+// SyntheticEncoder
+// ---------------------------------------------------------------------------
+class SyntheticEncoder : public IEncoder {
+public:
+    explicit SyntheticEncoder(const SyntheticFrameSizes& sizes = SyntheticFrameSizes());
+    ~SyntheticEncoder() override;
+
+    // Non-copyable
+    SyntheticEncoder(const SyntheticEncoder&) = delete;
+    SyntheticEncoder& operator=(const SyntheticEncoder&) = delete;
+
+    // IEncoder interface
+    bool initialize(const EncoderConfig& config) override;
+    bool encode(const CapturedFrame& frame, EncodedPacket& packet) override;
+    bool reconfigure(const EncoderConfig& config) override;
+    bool canResize() const override { return true; }
+    void forceIdr() override { force_idr_ = true; }
+    uint32_t getTemporalLayers() const override { return temporal_layers_; }
+    void setFrameBudget(size_t delta_bytes, size_t keyframe_bytes) override {
+        delta_budget_    = delta_bytes;
+        keyframe_budget_ = keyframe_bytes;
+    }
+    void flush() override {}
+    void release() override { initialized_ = false; }
+    bool isCodecSupported(CodecType /*codec*/) override { return true; }
+    std::string getCodecName() const override;
+
+    /// True if |data| is a whole, unaltered frame this encoder produced.
+    /// Checks the size and the pattern's ends, not every byte.
+    static bool checkPayload(const uint8_t* data, size_t size);
+
+    /// Bytes of the frame number and size that start every payload.
+    static constexpr size_t PREAMBLE_BYTES = 8;
+
+private:
+    /// Mean delta and keyframe sizes for the current rate.
+    void updateMeans();
+
+    /// Pattern byte |index| of frame |frame_number|.
+    static uint8_t patternByte(uint32_t frame_number, size_t index) {
+        return static_cast<uint8_t>(frame_number * 131u + static_cast<uint32_t>(index));
+    }
+
+    SyntheticFrameSizes sizes_;
+    EncoderConfig       config_;
+    std::minstd_rand    rng_;
+    bool                initialized_     = false;
+    bool                force_idr_       = false;
+    uint32_t            frame_number_    = 0;
+    uint32_t            since_keyframe_  = 0;
+    uint32_t            temporal_layers_ = 1;
+    double              delta_mean_      = 0.0;
+    double              keyframe_mean_   = 0.0;
+    size_t              delta_budget_    = 0;
+    size_t              keyframe_budget_ = 0;
+};
+
+} // namespace cs::host
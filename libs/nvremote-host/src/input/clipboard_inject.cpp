@@ -2,7 +2,9 @@
 // clipboard_inject.cpp -- Clipboard text injection (host side)
 //
 // Mirrors the viewer-side clipboard_sync.cpp with reversed direction.
-// Host → Viewer uses HOST_TO_VIEWER direction.
+// Host → Viewer uses HOST_TO_VIEWER direction.  The monitor thread checks
+// the clipboard every 200ms and, while a transfer is in flight, ticks it
+// every 2ms.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "clipboard_inject.h"
@@ -17,7 +19,11 @@
 
 namespace cs::host {
 
-ClipboardInjector::ClipboardInjector() = default;
+ClipboardInjector::ClipboardInjector()
+    : transfer_(cs::ClipboardDirection::HOST_TO_VIEWER,
+                [this](const std::vector<uint8_t>& data) {
+                    if (send_func_) send_func_(data);
+                }) {}
 
 ClipboardInjector::~ClipboardInjector() {
     stop();
@@ -46,10 +52,19 @@ void ClipboardInjector::stop() {
 }
 
 void ClipboardInjector::monitorThread() {
+    auto last_check = std::chrono::steady_clock::now();
+    bool sending = false;
+
     while (running_.load()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        std::this_thread::sleep_for(sending ? kTransferTick : kPollInterval);
         if (!running_.load()) break;
 
+        sending = transfer_.poll();
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_check < kPollInterval) continue;
+        last_check = now;
+
         std::string current = getClipboardText();
 
         std::lock_guard<std::mutex> lock(mutex_);
@@ -63,51 +78,26 @@ void ClipboardInjector::monitorThread() {
 
             last_text_ = current;
 
-            if (!current.empty() && current.size() <= kMaxClipboardBytes) {
-                sendToViewer(current);
-            }
-        }
-
-        // Retry logic
-        if (waiting_ack_.load() && retry_count_ < kMaxRetries) {
-            auto now = std::chrono::steady_clock::now();
-            if (now - last_send_time_ >= kRetryInterval) {
-                if (send_func_ && !pending_packet_.empty()) {
-                    send_func_(pending_packet_);
-                }
-                last_send_time_ = now;
-                retry_count_++;
+            if (!current.empty() && transfer_.send(current)) {
+                sending = transfer_.poll();
             }
-        } else if (waiting_ack_.load() && retry_count_ >= kMaxRetries) {
-            waiting_ack_.store(false);
-            pending_packet_.clear();
         }
     }
 }
 
-void ClipboardInjector::sendToViewer(const std::string& text) {
-    cs::ClipboardPacketHeader hdr = {};
-    hdr.type      = static_cast<uint8_t>(cs::PacketType::CLIPBOARD);
-    hdr.direction = static_cast<uint8_t>(cs::ClipboardDirection::HOST_TO_VIEWER);
-    hdr.sequence  = send_seq_++;
-    hdr.format    = static_cast<uint8_t>(cs::ClipboardFormat::TEXT_UTF8);
-    std::memset(hdr.reserved, 0, sizeof(hdr.reserved));
-    hdr.length    = static_cast<uint32_t>(text.size());
-
-    pending_packet_ = hdr.serialize(
-        reinterpret_cast<const uint8_t*>(text.data()), text.size());
-
-    pending_ack_seq_ = hdr.sequence;
-    waiting_ack_.store(true);
-    retry_count_ = 0;
-    last_send_time_ = std::chrono::steady_clock::now();
+void ClipboardInjector::onClipboardReceived(const uint8_t* data, size_t len) {
+    if (len == 0) return;
 
-    if (send_func_) {
-        send_func_(pending_packet_);
+    if (data[0] == static_cast<uint8_t>(cs::PacketType::CLIP_CHUNK)) {
+        std::string text;
+        if (transfer_.onChunk(data, len, text)) {
+            CS_LOG(DEBUG, "Host clipboard: received %zu bytes from viewer", text.size());
+            applyRemote(text);
+        }
+        return;
     }
-}
 
-void ClipboardInjector::onClipboardReceived(const uint8_t* data, size_t len) {
+    // Legacy single packet
     cs::ClipboardPacketHeader hdr;
     if (!cs::ClipboardPacketHeader::deserialize(data, len, hdr)) return;
 
@@ -116,17 +106,11 @@ void ClipboardInjector::onClipboardReceived(const uint8_t* data, size_t len) {
 
     size_t payload_offset = sizeof(cs::ClipboardPacketHeader);
     if (len < payload_offset + hdr.length) return;
-    if (hdr.length > kMaxClipboardBytes) return;
+    if (hdr.length > kMaxLegacyBytes) return;
 
     std::string text(reinterpret_cast<const char*>(data + payload_offset), hdr.length);
-
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        last_origin_ = Origin::REMOTE;
-        last_text_ = text;
-    }
-
-    setClipboardText(text);
+    transfer_.noteShared(text);
+    applyRemote(text);
 
     // Send ACK
     cs::ClipboardAckPacket ack = {};
@@ -141,15 +125,19 @@ void ClipboardInjector::onClipboardReceived(const uint8_t* data, size_t len) {
     CS_LOG(DEBUG, "Host clipboard: received %u bytes from viewer", hdr.length);
 }
 
-void ClipboardInjector::onAckReceived(const uint8_t* data, size_t len) {
-    cs::ClipboardAckPacket ack;
-    if (!cs::ClipboardAckPacket::deserialize(data, len, ack)) return;
-
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (waiting_ack_.load() && ack.ack_sequence == pending_ack_seq_) {
-        waiting_ack_.store(false);
-        pending_packet_.clear();
+void ClipboardInjector::applyRemote(const std::string& text) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_origin_ = Origin::REMOTE;
+        last_text_ = text;
     }
+
+    setClipboardText(text);
+}
+
+void ClipboardInjector::onAckReceived(const uint8_t* data, size_t len) {
+    // Legacy acks answer nothing this side sends any more
+    transfer_.onAck(data, len);
 }
 
 // ---------------------------------------------------------------------------
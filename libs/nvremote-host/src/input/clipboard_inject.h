@@ -4,10 +4,13 @@
 // Receives clipboard text from the viewer and sets it on the host clipboard.
 // Also monitors the host clipboard for changes and sends them to the viewer.
 //
-// Text-only in v1, max 64KB, with ACK-based reliable delivery.
+// Text only, up to ClipboardTransfer::MAX_TRANSFER_BYTES, sent as a chunked,
+// compressed transfer (cs/transport/clipboard_transfer.h) capped at the
+// rate the session grants it from the QoS headroom.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <cs/transport/clipboard_transfer.h>
 #include <cs/transport/packet.h>
 
 #include <cstdint>
@@ -39,17 +42,23 @@ public:
     /// Stop.
     void stop();
 
-    /// Called when a clipboard packet arrives from the viewer.
+    /// Called when a clipboard packet (chunk, or legacy single packet)
+    /// arrives from the viewer.
     void onClipboardReceived(const uint8_t* data, size_t len);
 
     /// Called when a clipboard ACK arrives from the viewer.
     void onAckReceived(const uint8_t* data, size_t len);
 
+    /// Cap host -> viewer transfers at |kbps| (feedback thread).
+    void setRateLimitKbps(uint32_t kbps) { transfer_.setRateLimitKbps(kbps); }
+
 private:
     void monitorThread();
     std::string getClipboardText();
     void setClipboardText(const std::string& text);
-    void sendToViewer(const std::string& text);
+
+    /// Take |text| from the viewer as the host clipboard.
+    void applyRemote(const std::string& text);
 
     SendFunc send_func_;
     std::thread monitor_thread_;
@@ -60,17 +69,11 @@ private:
     enum class Origin { LOCAL, REMOTE };
     Origin last_origin_ = Origin::LOCAL;
 
-    uint16_t send_seq_ = 0;
-
-    std::atomic<bool> waiting_ack_{false};
-    uint16_t pending_ack_seq_ = 0;
-    std::chrono::steady_clock::time_point last_send_time_;
-    int retry_count_ = 0;
-    std::vector<uint8_t> pending_packet_;
+    cs::ClipboardTransfer transfer_;
 
-    static constexpr size_t kMaxClipboardBytes = 65536;
-    static constexpr int kMaxRetries = 3;
-    static constexpr auto kRetryInterval = std::chrono::milliseconds(200);
+    static constexpr size_t kMaxLegacyBytes = 65536;
+    static constexpr auto kPollInterval = std::chrono::milliseconds(200);
+    static constexpr auto kTransferTick = std::chrono::milliseconds(2);
 
     std::mutex mutex_;
 };
@@ -164,11 +164,13 @@ bool ControllerInjector::createController(uint8_t index) {
 #endif
 }
 
-void ControllerInjector::inject(const cs::ControllerPacket& pkt) {
-#ifdef _WIN32
+void ControllerInjector::setAckFunc(SendFunc send_func) {
     std::lock_guard<std::mutex> lock(mutex_);
+    ack_func_ = std::move(send_func);
+}
 
-    if (!available_ || !client_) return;
+void ControllerInjector::inject(const cs::ControllerPacket& pkt) {
+    std::lock_guard<std::mutex> lock(mutex_);
 
     uint8_t idx = pkt.controller_id;
     if (idx >= 4) return;
@@ -181,6 +183,71 @@ void ControllerInjector::inject(const cs::ControllerPacket& pkt) {
     last_seq_[idx] = pkt.sequence;
     seq_initialized_[idx] = true;
 
+    applyLocked(pkt);
+}
+
+void ControllerInjector::onStatePacket(const uint8_t* data, size_t len) {
+    cs::InputPacketHeader hdr;
+    if (!cs::InputPacketHeader::deserialize(data, len, hdr)) return;
+    if (hdr.payload_length > len - sizeof(cs::InputPacketHeader)) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const uint8_t* p = data + sizeof(cs::InputPacketHeader);
+    size_t remaining = hdr.payload_length;
+    while (remaining >= sizeof(cs::ControllerStateRecord)) {
+        const uint8_t idx  = p[0] & 0x03;
+        const bool    full = (p[0] & cs::CONTROLLER_STATE_FULL) != 0;
+        uint16_t base_seq;
+        std::memcpy(&base_seq, p + 4, 2);
+        base_seq = ntohs(base_seq);
+
+        // A delta applies to the base it names; without it the record is
+        // only skipped over (a keyframe or a newer base follows)
+        const cs::ControllerPacket& base = states_[idx][base_seq % STATE_HISTORY];
+        const bool base_ok = full || (base.type != 0 && base.sequence == base_seq);
+        cs::ControllerPacket state = full || !base_ok ? cs::ControllerPacket{} : base;
+
+        cs::ControllerStateRecord rec;
+        const size_t n = cs::ControllerStateRecord::decode(p, remaining, rec, state);
+        if (n == 0) break;
+        p += n;
+        remaining -= n;
+        if (!base_ok) continue;
+
+        states_[idx][rec.seq % STATE_HISTORY] = state;
+        if (stream_applied_[idx] &&
+            static_cast<int16_t>(rec.seq - stream_seq_[idx]) <= 0) {
+            continue;   // Late: a newer state is already applied
+        }
+        stream_applied_[idx] = true;
+        stream_seq_[idx]     = rec.seq;
+        ack_pending_         = true;
+        applyLocked(state);
+    }
+
+    const uint64_t now = cs::getTimestampUs();
+    if (!ack_pending_ || !ack_func_ || now - last_ack_us_ < ACK_INTERVAL_US) return;
+
+    cs::ControllerAckPacket ack{};
+    ack.type = static_cast<uint8_t>(cs::PacketType::CONTROLLER_ACK);
+    for (uint8_t i = 0; i < 4; i++) {
+        if (!stream_applied_[i]) continue;
+        ack.mask  |= static_cast<uint8_t>(1u << i);
+        ack.seq[i] = stream_seq_[i];
+    }
+    uint8_t buf[sizeof(cs::ControllerAckPacket)];
+    ack_func_(buf, ack.serializeTo(buf));
+    ack_pending_ = false;
+    last_ack_us_ = now;
+}
+
+void ControllerInjector::applyLocked(const cs::ControllerPacket& pkt) {
+#ifdef _WIN32
+    if (!available_ || !client_) return;
+
+    const uint8_t idx = pkt.controller_id;
+
     // Create virtual controller on first use
     if (!targets_[idx]) {
         if (!createController(idx)) return;
@@ -7,12 +7,18 @@
 //
 // Graceful degradation: if ViGEmBus is not installed, logs a warning
 // and silently drops controller packets.
+//
+// State arrives as the viewer's controller state stream (delta records
+// against the last state acked here, see ControllerStateRecord) or, from
+// older viewers, as standalone full-state packets.  Acks go back at most
+// every ACK_INTERVAL_US while the state keeps changing.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include <cs/transport/packet.h>
 
 #include <cstdint>
+#include <functional>
 #include <mutex>
 #include <array>
 
@@ -30,10 +36,21 @@ public:
     /// Initialize ViGEmBus client. Returns false if ViGEm is not installed.
     bool initialize();
 
+    /// Callback to send a serialized ack over the transport.
+    using SendFunc = std::function<void(const uint8_t* data, size_t len)>;
+
+    /// Send state stream acks through |send_func| (called from the thread
+    /// that calls onStatePacket()).
+    void setAckFunc(SendFunc send_func);
+
     /// Inject a controller state update. Creates the virtual controller
     /// on first use for the given controller_id.
     void inject(const cs::ControllerPacket& pkt);
 
+    /// Called with a CONTROLLER_STATE input packet (InputPacketHeader +
+    /// records) from the viewer.
+    void onStatePacket(const uint8_t* data, size_t len);
+
     /// Release all virtual controllers and disconnect from ViGEmBus.
     void release();
 
@@ -44,6 +61,12 @@ private:
     /// Create a virtual X360 controller for the given slot.
     bool createController(uint8_t index);
 
+    /// Hand |pkt| to its virtual controller (mutex_ held).
+    void applyLocked(const cs::ControllerPacket& pkt);
+
+    static constexpr size_t   STATE_HISTORY   = 32;      // States kept as delta bases
+    static constexpr uint64_t ACK_INTERVAL_US = 8'000;
+
     // ViGEmBus client handle (PVIGEM_CLIENT)
     void* client_ = nullptr;
 
@@ -54,6 +77,14 @@ private:
     std::array<uint16_t, 4> last_seq_ = {0, 0, 0, 0};
     std::array<bool, 4>     seq_initialized_ = {false, false, false, false};
 
+    // State stream: states by sequence (type 0 = empty) and the last applied
+    std::array<std::array<cs::ControllerPacket, STATE_HISTORY>, 4> states_{};
+    std::array<uint16_t, 4> stream_seq_     = {0, 0, 0, 0};
+    std::array<bool, 4>     stream_applied_ = {false, false, false, false};
+    bool     ack_pending_ = false;
+    uint64_t last_ack_us_ = 0;
+    SendFunc ack_func_;
+
     bool available_ = false;
     std::mutex mutex_;
 };
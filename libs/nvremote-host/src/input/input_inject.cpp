@@ -0,0 +1,335 @@
+///////////////////////////////////////////////////////////////////////////////
+// input_inject.cpp -- Mouse and keyboard injection via SendInput
+//
+// A batch is applied as:
+//   1. the previous batch's motion, if exactly that batch went missing;
+//   2. events first sent in an earlier batch (their copy here is the
+//      first to arrive), which happened before this batch's motion;
+//   3. this batch's motion;
+//   4. events first sent in this batch -- the viewer sends a batch as soon
+//      as an event arrives, so these were stamped with the batch's own
+//      timestamp and came after its motion.
+// Events already applied from an earlier copy are skipped by sequence.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "input_inject.h"
+
+#include <cs/common.h>
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// Construction / destruction
+// ---------------------------------------------------------------------------
+
+InputInjector::InputInjector() {
+    actions_.reserve(2 + INPUT_BATCH_MAX_EVENTS);
+}
+
+InputInjector::~InputInjector() = default;
+
+// ---------------------------------------------------------------------------
+// onInputPacket
+// ---------------------------------------------------------------------------
+
+void InputInjector::onInputPacket(const uint8_t* data, size_t len) {
+    InputPacketHeader hdr;
+    if (!InputPacketHeader::deserialize(data, len, hdr)) return;
+
+    const uint8_t* payload = data + sizeof(InputPacketHeader);
+    const size_t payload_len = len - sizeof(InputPacketHeader);
+    if (hdr.payload_length > payload_len) {
+        CS_LOG(WARN, "InputInjector: truncated input packet (%zu / %u bytes)",
+               payload_len, hdr.payload_length);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto type = static_cast<InputType>(hdr.input_type);
+    if (type == InputType::BATCH) {
+        applyBatch(payload, hdr.payload_length);
+        return;
+    }
+
+    // Single events from viewers that do not batch
+    actions_.clear();
+    switch (type) {
+        case InputType::MOUSE_MOVE: {
+            if (hdr.payload_length < sizeof(MouseMoveEvent)) return;
+            MouseMoveEvent mv;
+            std::memcpy(&mv, payload, sizeof(mv));
+            mv.toHost();
+            actions_.push_back({type, mv.dx, mv.dy, 0});
+            break;
+        }
+        case InputType::MOUSE_BUTTON: {
+            if (hdr.payload_length < sizeof(MouseButtonEvent)) return;
+            MouseButtonEvent btn;
+            std::memcpy(&btn, payload, sizeof(btn));
+            actions_.push_back({type, btn.button, btn.action, 0});
+            break;
+        }
+        case InputType::KEY: {
+            if (hdr.payload_length < sizeof(KeyEvent)) return;
+            KeyEvent key;
+            std::memcpy(&key, payload, sizeof(key));
+            key.toHost();
+            actions_.push_back({type, key.keycode, key.action, 0});
+            break;
+        }
+        case InputType::SCROLL: {
+            if (hdr.payload_length < sizeof(ScrollEvent)) return;
+            ScrollEvent scr;
+            std::memcpy(&scr, payload, sizeof(scr));
+            scr.toHost();
+            actions_.push_back({type, scr.dx, scr.dy, 0});
+            break;
+        }
+        default:
+            CS_LOG(WARN, "InputInjector: unknown input type %u", hdr.input_type);
+            return;
+    }
+    inject(actions_);
+}
+
+// ---------------------------------------------------------------------------
+// applyBatch
+// ---------------------------------------------------------------------------
+
+void InputInjector::applyBatch(const uint8_t* payload, size_t len) {
+    if (len < sizeof(InputBatchHeader)) return;
+
+    InputBatchHeader batch;
+    std::memcpy(&batch, payload, sizeof(batch));
+    batch.toHost();
+
+    if (batch.event_count > INPUT_BATCH_MAX_EVENTS ||
+        len < sizeof(InputBatchHeader) + batch.event_count * sizeof(InputBatchEvent)) {
+        CS_LOG(WARN, "InputInjector: malformed batch (%u events in %zu bytes)",
+               batch.event_count, len);
+        return;
+    }
+
+    // Late or duplicate: its motion is already in a newer batch's past, and
+    // its events rode in the newer batches too
+    if (have_batch_ && !seqNewer(batch.batch_seq, last_batch_seq_)) {
+        batches_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    actions_.clear();
+
+    // 1. Exactly one batch lost: its motion is repeated here
+    if (have_batch_ && static_cast<uint16_t>(batch.batch_seq - last_batch_seq_) == 2 &&
+        (batch.prev_dx != 0 || batch.prev_dy != 0)) {
+        actions_.push_back({InputType::MOUSE_MOVE, batch.prev_dx, batch.prev_dy, 0});
+    }
+    have_batch_     = true;
+    last_batch_seq_ = batch.batch_seq;
+
+    // Events not applied before, in order
+    const uint8_t* p = payload + sizeof(InputBatchHeader);
+    InputBatchEvent events[INPUT_BATCH_MAX_EVENTS];
+    size_t count = 0;
+    for (uint8_t i = 0; i < batch.event_count; ++i, p += sizeof(InputBatchEvent)) {
+        InputBatchEvent ev;
+        std::memcpy(&ev, p, sizeof(ev));
+        ev.toHost();
+        if (have_event_ && !seqNewer(ev.seq, last_event_seq_)) continue;
+        have_event_     = true;
+        last_event_seq_ = ev.seq;
+        events[count++] = ev;
+    }
+
+    auto pushEvent = [&](const InputBatchEvent& ev) {
+        const auto type   = static_cast<InputType>(ev.input_type);
+        const auto age_ms = (batch.timestamp_us - ev.timestamp_us) / 1000;
+        switch (type) {
+            case InputType::MOUSE_BUTTON: {
+                MouseButtonEvent btn;
+                std::memcpy(&btn, ev.data, sizeof(btn));
+                actions_.push_back({type, btn.button, btn.action, age_ms});
+                break;
+            }
+            case InputType::KEY: {
+                KeyEvent key;
+                std::memcpy(&key, ev.data, sizeof(key));
+                key.toHost();
+                actions_.push_back({type, key.keycode, key.action, age_ms});
+                break;
+            }
+            case InputType::SCROLL: {
+                ScrollEvent scr;
+                std::memcpy(&scr, ev.data, sizeof(scr));
+                scr.toHost();
+                actions_.push_back({type, scr.dx, scr.dy, age_ms});
+                break;
+            }
+            default:
+                break;
+        }
+    };
+
+    // 2. Events from earlier batches, 3. this batch's motion, 4. its own events
+    for (size_t i = 0; i < count; ++i) {
+        if (events[i].timestamp_us != batch.timestamp_us) pushEvent(events[i]);
+    }
+    if (batch.dx != 0 || batch.dy != 0) {
+        actions_.push_back({InputType::MOUSE_MOVE, batch.dx, batch.dy, 0});
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (events[i].timestamp_us == batch.timestamp_us) pushEvent(events[i]);
+    }
+
+    batches_applied_.fetch_add(1, std::memory_order_relaxed);
+    if (actions_.empty()) return;
+    inject(actions_);
+
+    echo_pending_ = true;
+    injected_seq_ = batch.batch_seq;
+    injected_us_  = getTimestampUs();
+}
+
+// ---------------------------------------------------------------------------
+// takeInjectedBefore
+// ---------------------------------------------------------------------------
+
+bool InputInjector::takeInjectedBefore(uint64_t capture_us, uint16_t& batch_seq) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!echo_pending_ || injected_us_ > capture_us) return false;
+    echo_pending_ = false;
+    batch_seq     = injected_seq_;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// inject
+// ---------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+namespace {
+
+/// Keys that need KEYEVENTF_EXTENDEDKEY to be told apart from their
+/// numpad twins.
+bool isExtendedKey(WORD vk) {
+    switch (vk) {
+        case VK_INSERT: case VK_DELETE: case VK_HOME: case VK_END:
+        case VK_PRIOR:  case VK_NEXT:
+        case VK_LEFT:   case VK_RIGHT:  case VK_UP:   case VK_DOWN:
+        case VK_RCONTROL: case VK_RMENU: case VK_LWIN: case VK_RWIN: case VK_APPS:
+        case VK_DIVIDE: case VK_NUMLOCK: case VK_SNAPSHOT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+void InputInjector::inject(const std::vector<Action>& actions) {
+    INPUT inputs[2 * (2 + INPUT_BATCH_MAX_EVENTS)];   // A scroll may take two
+    UINT n = 0;
+    const DWORD now_ms = GetTickCount();
+
+    for (const Action& a : actions) {
+        INPUT& in = inputs[n];
+        std::memset(&in, 0, sizeof(in));
+        // Zero lets the system stamp it; older events keep their spacing
+        const DWORD time = a.age_ms ? now_ms - a.age_ms : 0;
+
+        switch (a.type) {
+            case InputType::MOUSE_MOVE:
+                in.type       = INPUT_MOUSE;
+                in.mi.dx      = a.a;
+                in.mi.dy      = a.b;
+                in.mi.dwFlags = MOUSEEVENTF_MOVE;
+                in.mi.time    = time;
+                n++;
+                break;
+
+            case InputType::MOUSE_BUTTON: {
+                const bool down = a.b != 0;
+                in.type    = INPUT_MOUSE;
+                in.mi.time = time;
+                switch (a.a) {
+                    case 0: in.mi.dwFlags = down ? MOUSEEVENTF_LEFTDOWN   : MOUSEEVENTF_LEFTUP;   break;
+                    case 1: in.mi.dwFlags = down ? MOUSEEVENTF_RIGHTDOWN  : MOUSEEVENTF_RIGHTUP;  break;
+                    case 2: in.mi.dwFlags = down ? MOUSEEVENTF_MIDDLEDOWN : MOUSEEVENTF_MIDDLEUP; break;
+                    case 3:
+                    case 4:
+                        in.mi.dwFlags   = down ? MOUSEEVENTF_XDOWN : MOUSEEVENTF_XUP;
+                        in.mi.mouseData = a.a == 3 ? XBUTTON1 : XBUTTON2;
+                        break;
+                    default:
+                        continue;
+                }
+                n++;
+                break;
+            }
+
+            case InputType::KEY: {
+                const auto vk = static_cast<WORD>(a.a);
+                in.type       = INPUT_KEYBOARD;
+                in.ki.wVk     = vk;
+                in.ki.wScan   = static_cast<WORD>(MapVirtualKeyW(vk, MAPVK_VK_TO_VSC));
+                in.ki.dwFlags = (a.b ? 0 : KEYEVENTF_KEYUP) |
+                                (isExtendedKey(vk) ? KEYEVENTF_EXTENDEDKEY : 0);
+                in.ki.time    = time;
+                n++;
+                break;
+            }
+
+            case InputType::SCROLL:
+                // The viewer sends wheel ticks
+                if (a.b != 0) {
+                    in.type         = INPUT_MOUSE;
+                    in.mi.dwFlags   = MOUSEEVENTF_WHEEL;
+                    in.mi.mouseData = static_cast<DWORD>(a.b * WHEEL_DELTA);
+                    in.mi.time      = time;
+                    n++;
+                }
+                if (a.a != 0) {
+                    INPUT& h = inputs[n];
+                    std::memset(&h, 0, sizeof(h));
+                    h.type         = INPUT_MOUSE;
+                    h.mi.dwFlags   = MOUSEEVENTF_HWHEEL;
+                    h.mi.mouseData = static_cast<DWORD>(a.a * WHEEL_DELTA);
+                    h.mi.time      = time;
+                    n++;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if (n == 0) return;
+    const UINT sent = SendInput(n, inputs, sizeof(INPUT));
+    if (sent != n) {
+        // Typically UIPI: the foreground window runs at a higher integrity level
+        CS_LOG(WARN, "InputInjector: SendInput injected %u of %u inputs (error %lu)",
+               sent, n, GetLastError());
+    }
+}
+
+#else
+
+void InputInjector::inject(const std::vector<Action>& /*actions*/) {
+    if (!warned_) {
+        warned_ = true;
+        CS_LOG(WARN, "InputInjector: input injection is not supported on this platform");
+    }
+}
+
+#endif
+
+} // namespace cs::host
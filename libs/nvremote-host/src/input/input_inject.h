@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////
+// input_inject.h -- Mouse and keyboard injection (host side)
+//
+// Applies the viewer's input packets to the host desktop with SendInput.
+// Batches (InputType::BATCH) carry a send interval's summed mouse motion
+// and its buttons, keys and scrolls; each batch is injected in a single
+// SendInput call so no local input lands in the middle of it, with the
+// events' original spacing kept in their timestamps.
+//
+// Batches are applied in sequence order and a late one is dropped.  One
+// missing batch is made up from the motion its successor repeats, and the
+// discrete events are repeated by the viewer, so each is applied once --
+// from whichever copy arrives first.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cs/transport/packet.h>
+#include <cs/transport/sequence.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace cs::host {
+
+class InputInjector {
+public:
+    InputInjector();
+    ~InputInjector();
+
+    // Non-copyable
+    InputInjector(const InputInjector&) = delete;
+    InputInjector& operator=(const InputInjector&) = delete;
+
+    /// Called when an input packet (InputPacketHeader + payload) arrives
+    /// from the viewer.
+    void onInputPacket(const uint8_t* data, size_t len);
+
+    /// The last batch injected at or before |capture_us| (getTimestampUs()
+    /// clock) that no frame has been tagged with yet, in |batch_seq|; false
+    /// if there is none.  Called from the capture thread for each new frame.
+    bool takeInjectedBefore(uint64_t capture_us, uint16_t& batch_seq);
+
+    /// Batches applied / dropped as late or duplicate.
+    uint64_t getBatchesApplied() const { return batches_applied_.load(std::memory_order_relaxed); }
+    uint64_t getBatchesDropped() const { return batches_dropped_.load(std::memory_order_relaxed); }
+
+private:
+    /// One input to inject.  |age_ms| is how long before the batch was
+    /// sent it happened.
+    struct Action {
+        InputType type;
+        int32_t   a;        // dx / button / keycode / scroll dx
+        int32_t   b;        // dy / action / scroll dy
+        uint32_t  age_ms;
+    };
+
+    void applyBatch(const uint8_t* payload, size_t len);
+
+    /// Inject |actions| as one unit.
+    void inject(const std::vector<Action>& actions);
+
+    bool     have_batch_      = false;
+    uint16_t last_batch_seq_  = 0;
+    bool     have_event_      = false;
+    uint16_t last_event_seq_  = 0;
+    bool     warned_          = false;
+
+    // Last batch injected, until a frame captured after it is tagged
+    bool     echo_pending_    = false;
+    uint16_t injected_seq_    = 0;
+    uint64_t injected_us_     = 0;
+    std::atomic<uint64_t> batches_applied_{0};
+    std::atomic<uint64_t> batches_dropped_{0};
+
+    std::vector<Action> actions_;   // Reused across batches
+
+    std::mutex mutex_;
+};
+
+} // namespace cs::host
@@ -1,20 +1,18 @@
 ///////////////////////////////////////////////////////////////////////////////
 // pipe_server.cpp -- Windows Named Pipe IPC server implementation
 //
-// Creates a named pipe with overlapped I/O and processes newline-delimited
-// JSON messages from a single client at a time.  The server runs on its own
-// thread and dispatches parsed commands to a registered handler callback.
+// Serves newline-delimited JSON messages on up to MAX_CLIENTS named pipe
+// instances from one thread.  Every connect, read and write is overlapped
+// and signals a per-instance event; the thread waits on all of them (and on
+// the next stats subscription deadline), handles what completed, and
+// always keeps one instance listening for the next client.  Parsed commands
+// go to a registered handler callback.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "pipe_server.h"
 #include "cs/common.h"
 
 #include <algorithm>
-#include <cctype>
-#include <cstdio>
-#include <cstdlib>
-#include <cstring>
-#include <sstream>
 
 #ifdef _WIN32
 #include <sddl.h>
@@ -22,292 +20,10 @@
 
 namespace cs::host {
 
-// ===========================================================================
-// SimpleJson implementation
-// ===========================================================================
-
-size_t SimpleJson::skipWs(const std::string& s, size_t pos) {
-    while (pos < s.size() && std::isspace(static_cast<unsigned char>(s[pos]))) {
-        ++pos;
-    }
-    return pos;
-}
-
-std::string SimpleJson::parseString(const std::string& s, size_t& pos) {
-    // pos should point to the opening quote
-    if (pos >= s.size() || s[pos] != '"') return "";
-    ++pos; // skip opening quote
-
-    std::string result;
-    result.reserve(64);
-
-    while (pos < s.size()) {
-        char c = s[pos++];
-        if (c == '"') {
-            return result;
-        }
-        if (c == '\\' && pos < s.size()) {
-            char esc = s[pos++];
-            switch (esc) {
-                case '"':  result += '"';  break;
-                case '\\': result += '\\'; break;
-                case '/':  result += '/';  break;
-                case 'b':  result += '\b'; break;
-                case 'f':  result += '\f'; break;
-                case 'n':  result += '\n'; break;
-                case 'r':  result += '\r'; break;
-                case 't':  result += '\t'; break;
-                case 'u':
-                    // Skip 4 hex digits (minimal handling -- store as-is)
-                    if (pos + 4 <= s.size()) {
-                        result += "\\u";
-                        result += s.substr(pos, 4);
-                        pos += 4;
-                    }
-                    break;
-                default:
-                    result += esc;
-                    break;
-            }
-        } else {
-            result += c;
-        }
-    }
-    return result; // unterminated string -- return what we have
-}
-
-std::string SimpleJson::parseValue(const std::string& s, size_t& pos) {
-    pos = skipWs(s, pos);
-    if (pos >= s.size()) return "";
-
-    char c = s[pos];
-
-    // String value
-    if (c == '"') {
-        return parseString(s, pos);
-    }
-
-    // Number (integer or float, possibly negative)
-    if (c == '-' || (c >= '0' && c <= '9')) {
-        size_t start = pos;
-        if (c == '-') ++pos;
-        while (pos < s.size() && ((s[pos] >= '0' && s[pos] <= '9') ||
-               s[pos] == '.' || s[pos] == 'e' || s[pos] == 'E' ||
-               s[pos] == '+' || s[pos] == '-')) {
-            // Avoid consuming '-' after the first character unless after e/E
-            if (s[pos] == '-' && pos > start + 1 && s[pos - 1] != 'e' && s[pos - 1] != 'E') {
-                break;
-            }
-            ++pos;
-        }
-        return s.substr(start, pos - start);
-    }
-
-    // Boolean: true
-    if (c == 't' && pos + 4 <= s.size() && s.substr(pos, 4) == "true") {
-        pos += 4;
-        return "true";
-    }
-
-    // Boolean: false
-    if (c == 'f' && pos + 5 <= s.size() && s.substr(pos, 5) == "false") {
-        pos += 5;
-        return "false";
-    }
-
-    // Null
-    if (c == 'n' && pos + 4 <= s.size() && s.substr(pos, 4) == "null") {
-        pos += 4;
-        return "";
-    }
-
-    // Skip nested objects and arrays (store as raw string)
-    if (c == '{' || c == '[') {
-        char open  = c;
-        char close = (c == '{') ? '}' : ']';
-        int depth = 1;
-        size_t start = pos;
-        ++pos;
-        bool in_string = false;
-        while (pos < s.size() && depth > 0) {
-            char ch = s[pos];
-            if (in_string) {
-                if (ch == '\\') { ++pos; } // skip escaped char
-                else if (ch == '"') { in_string = false; }
-            } else {
-                if (ch == '"') { in_string = true; }
-                else if (ch == open) { ++depth; }
-                else if (ch == close) { --depth; }
-            }
-            ++pos;
-        }
-        return s.substr(start, pos - start);
-    }
-
-    return "";
-}
-
-bool SimpleJson::parse(const std::string& json) {
-    entries_.clear();
-
-    size_t pos = skipWs(json, 0);
-    if (pos >= json.size() || json[pos] != '{') return false;
-    ++pos; // skip '{'
-
-    while (pos < json.size()) {
-        pos = skipWs(json, pos);
-        if (pos >= json.size()) return false;
-
-        // End of object
-        if (json[pos] == '}') {
-            return true;
-        }
-
-        // Skip comma between entries
-        if (json[pos] == ',') {
-            ++pos;
-            pos = skipWs(json, pos);
-        }
-
-        // Parse key
-        if (pos >= json.size() || json[pos] != '"') return false;
-        std::string key = parseString(json, pos);
-
-        // Expect colon
-        pos = skipWs(json, pos);
-        if (pos >= json.size() || json[pos] != ':') return false;
-        ++pos;
-
-        // Parse value
-        std::string value = parseValue(json, pos);
-
-        entries_[key] = value;
-    }
-
-    return false; // unterminated object
-}
-
-bool SimpleJson::hasKey(const std::string& key) const {
-    return entries_.find(key) != entries_.end();
-}
-
-std::string SimpleJson::getString(const std::string& key) const {
-    auto it = entries_.find(key);
-    if (it == entries_.end()) return "";
-    return it->second;
-}
-
-int64_t SimpleJson::getInt(const std::string& key) const {
-    auto it = entries_.find(key);
-    if (it == entries_.end()) return 0;
-    try {
-        return std::stoll(it->second);
-    } catch (...) {
-        return 0;
-    }
-}
-
-uint64_t SimpleJson::getUint(const std::string& key) const {
-    auto it = entries_.find(key);
-    if (it == entries_.end()) return 0;
-    try {
-        return std::stoull(it->second);
-    } catch (...) {
-        return 0;
-    }
-}
-
-void SimpleJson::setString(const std::string& key, const std::string& value) {
-    entries_[key] = value;
-}
-
-void SimpleJson::setInt(const std::string& key, int64_t value) {
-    entries_[key] = std::to_string(value);
-}
-
-void SimpleJson::setUint(const std::string& key, uint64_t value) {
-    entries_[key] = std::to_string(value);
-}
-
-void SimpleJson::setFloat(const std::string& key, double value) {
-    char buf[64];
-    std::snprintf(buf, sizeof(buf), "%.2f", value);
-    entries_[key] = buf;
-}
-
-std::string SimpleJson::escapeString(const std::string& s) {
-    std::string out;
-    out.reserve(s.size() + 8);
-    for (char c : s) {
-        switch (c) {
-            case '"':  out += "\\\""; break;
-            case '\\': out += "\\\\"; break;
-            case '\b': out += "\\b";  break;
-            case '\f': out += "\\f";  break;
-            case '\n': out += "\\n";  break;
-            case '\r': out += "\\r";  break;
-            case '\t': out += "\\t";  break;
-            default:   out += c;      break;
-        }
-    }
-    return out;
-}
-
-std::string SimpleJson::serialize() const {
-    std::string out = "{";
-    bool first = true;
-    for (auto& [key, value] : entries_) {
-        if (!first) out += ",";
-        first = false;
-        out += "\"" + escapeString(key) + "\":";
-
-        // Determine if value looks numeric, boolean, or null
-        bool is_number = false;
-        bool is_bool_or_null = (value == "true" || value == "false" || value.empty());
-        if (!is_bool_or_null && !value.empty()) {
-            // Check if value is a valid number
-            const char* p = value.c_str();
-            if (*p == '-') ++p;
-            bool has_digit = false;
-            bool has_dot = false;
-            while (*p) {
-                if (*p >= '0' && *p <= '9') { has_digit = true; ++p; }
-                else if (*p == '.' && !has_dot) { has_dot = true; ++p; }
-                else if ((*p == 'e' || *p == 'E') && has_digit) {
-                    ++p;
-                    if (*p == '+' || *p == '-') ++p;
-                }
-                else break;
-            }
-            is_number = has_digit && (*p == '\0');
-        }
-
-        // Check if value is a raw JSON object/array
-        bool is_raw_json = (!value.empty() && (value[0] == '{' || value[0] == '['));
-
-        if (is_number || is_raw_json) {
-            out += value;
-        } else if (value == "true") {
-            out += "true";
-        } else if (value == "false") {
-            out += "false";
-        } else if (value.empty()) {
-            out += "null";
-        } else {
-            out += "\"" + escapeString(value) + "\"";
-        }
-    }
-    out += "}";
-    return out;
-}
-
 // ===========================================================================
 // PipeServer implementation
 // ===========================================================================
 
-static constexpr DWORD PIPE_BUFFER_SIZE = 8192;
-static constexpr DWORD PIPE_TIMEOUT_MS  = 5000;
-
 #ifdef _WIN32
 /// Create a SECURITY_ATTRIBUTES that restricts pipe access to the current user.
 /// Uses an SDDL string: "D:(A;;GA;;;$USER_SID)" = allow Generic All to current user.
@@ -352,6 +68,14 @@ static bool createCurrentUserSecurityAttributes(SECURITY_ATTRIBUTES& sa) {
 }
 #endif
 
+namespace {
+
+uint64_t nowMs() {
+    return cs::getTimestampUs() / 1000;
+}
+
+} // namespace
+
 PipeServer::PipeServer(const std::string& pipe_name)
     : pipe_name_(pipe_name)
 {
@@ -366,15 +90,19 @@ void PipeServer::setHandler(PipeCommandHandler handler) {
     handler_ = std::move(handler);
 }
 
+void PipeServer::setStatsSource(PipeStatsSource source) {
+    stats_source_ = std::move(source);
+}
+
 bool PipeServer::start() {
     if (running_.load()) {
         CS_LOG(WARN, "Pipe server already running");
         return false;
     }
 
-    // Create overlapped event for cancellable ConnectNamedPipe
-    overlap_event_ = CreateEventA(nullptr, TRUE, FALSE, nullptr);
-    if (overlap_event_ == INVALID_HANDLE_VALUE || overlap_event_ == nullptr) {
+    // Wakes the server thread out of its wait to stop
+    stop_event_ = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    if (stop_event_ == nullptr) {
         CS_LOG(ERR, "CreateEvent failed: %lu", GetLastError());
         return false;
     }
@@ -393,35 +121,21 @@ void PipeServer::stop() {
 
     CS_LOG(INFO, "Stopping pipe server...");
     stop_flag_.store(true);
+    SetEvent(stop_event_);
 
-    // Signal the overlapped event to unblock ConnectNamedPipe
-    if (overlap_event_ != INVALID_HANDLE_VALUE) {
-        SetEvent(overlap_event_);
-    }
-
-    // Close the pipe to wake up any blocked reads
-    if (pipe_handle_ != INVALID_HANDLE_VALUE) {
-        CancelIoEx(pipe_handle_, nullptr);
-        DisconnectNamedPipe(pipe_handle_);
-        CloseHandle(pipe_handle_);
-        pipe_handle_ = INVALID_HANDLE_VALUE;
-    }
-
-    // Join the thread
+    // The thread cancels and closes every instance on its way out
     if (thread_.joinable()) {
         thread_.join();
     }
 
-    if (overlap_event_ != INVALID_HANDLE_VALUE) {
-        CloseHandle(overlap_event_);
-        overlap_event_ = INVALID_HANDLE_VALUE;
-    }
+    CloseHandle(stop_event_);
+    stop_event_ = nullptr;
 
     running_.store(false);
     CS_LOG(INFO, "Pipe server stopped");
 }
 
-bool PipeServer::createPipeInstance() {
+bool PipeServer::listen() {
     // Create security attributes restricting access to the current user.
     SECURITY_ATTRIBUTES sa = {};
     PSECURITY_DESCRIPTOR pSD = nullptr;
@@ -435,11 +149,11 @@ bool PipeServer::createPipeInstance() {
                       "falling back to default (error=%lu)", GetLastError());
     }
 
-    pipe_handle_ = CreateNamedPipeA(
+    HANDLE pipe = CreateNamedPipeA(
         full_pipe_path_.c_str(),
         PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
         PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
-        1,                    // max instances
+        static_cast<DWORD>(MAX_CLIENTS),   // max instances
         PIPE_BUFFER_SIZE,     // output buffer size
         PIPE_BUFFER_SIZE,     // input buffer size
         PIPE_TIMEOUT_MS,      // default timeout
@@ -450,151 +164,265 @@ bool PipeServer::createPipeInstance() {
         LocalFree(pSD);
     }
 
-    if (pipe_handle_ == INVALID_HANDLE_VALUE) {
+    if (pipe == INVALID_HANDLE_VALUE) {
         CS_LOG(ERR, "CreateNamedPipe failed: %lu", GetLastError());
         return false;
     }
+
+    auto c = std::make_unique<Client>();
+    c->pipe = pipe;
+    c->read_ov.hEvent  = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    c->write_ov.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    if (c->read_ov.hEvent == nullptr || c->write_ov.hEvent == nullptr) {
+        CS_LOG(ERR, "CreateEvent failed: %lu", GetLastError());
+        closeClient(*c);
+        return false;
+    }
+
+    // Wait for a client to connect using overlapped I/O
+    if (!ConnectNamedPipe(pipe, &c->read_ov)) {
+        DWORD err = GetLastError();
+        if (err == ERROR_PIPE_CONNECTED) {
+            // Client connected between CreateNamedPipe and ConnectNamedPipe;
+            // nothing will signal the event, so start serving it now
+            c->connecting = false;
+            CS_LOG(INFO, "Client connected to pipe");
+            startRead(*c);
+        } else if (err != ERROR_IO_PENDING) {
+            CS_LOG(ERR, "ConnectNamedPipe error: %lu", err);
+            closeClient(*c);
+            return false;
+        }
+    }
+
+    clients_.push_back(std::move(c));
     return true;
 }
 
 void PipeServer::serverThread() {
     CS_LOG(DEBUG, "Pipe server thread started");
 
-    while (!stop_flag_.load()) {
-        // Create a new pipe instance for each client connection
-        if (!createPipeInstance()) {
-            CS_LOG(ERR, "Failed to create pipe instance, retrying in 1s");
-            Sleep(1000);
-            continue;
-        }
-
-        // Wait for a client to connect using overlapped I/O
-        OVERLAPPED overlap = {};
-        overlap.hEvent = overlap_event_;
-        ResetEvent(overlap_event_);
-
-        BOOL connected = ConnectNamedPipe(pipe_handle_, &overlap);
-        DWORD err = GetLastError();
+    std::vector<HANDLE> handles;
+    handles.reserve(1 + 2 * MAX_CLIENTS);
 
-        if (!connected) {
-            if (err == ERROR_IO_PENDING) {
-                // Wait for connection or stop signal
-                DWORD wait = WaitForSingleObject(overlap_event_, INFINITE);
-                if (stop_flag_.load()) {
-                    CloseHandle(pipe_handle_);
-                    pipe_handle_ = INVALID_HANDLE_VALUE;
-                    break;
-                }
-                if (wait != WAIT_OBJECT_0) {
-                    CS_LOG(WARN, "WaitForSingleObject returned %lu", wait);
-                    CloseHandle(pipe_handle_);
-                    pipe_handle_ = INVALID_HANDLE_VALUE;
-                    continue;
-                }
-                // Check if ConnectNamedPipe completed successfully
-                DWORD bytes_transferred = 0;
-                if (!GetOverlappedResult(pipe_handle_, &overlap,
-                                          &bytes_transferred, FALSE)) {
-                    DWORD ovr_err = GetLastError();
-                    if (ovr_err != ERROR_PIPE_CONNECTED) {
-                        CS_LOG(WARN, "GetOverlappedResult error: %lu", ovr_err);
-                        CloseHandle(pipe_handle_);
-                        pipe_handle_ = INVALID_HANDLE_VALUE;
-                        continue;
-                    }
-                }
-            } else if (err == ERROR_PIPE_CONNECTED) {
-                // Client connected between CreateNamedPipe and ConnectNamedPipe
-                // This is fine, proceed.
-            } else {
-                CS_LOG(ERR, "ConnectNamedPipe error: %lu", err);
-                CloseHandle(pipe_handle_);
-                pipe_handle_ = INVALID_HANDLE_VALUE;
-                continue;
+    while (!stop_flag_.load()) {
+        // Keep one instance listening for the next client
+        bool listening = std::any_of(clients_.begin(), clients_.end(),
+                                     [](const auto& c) { return c->connecting; });
+        if (!listening && clients_.size() < MAX_CLIENTS) {
+            listening = listen();
+            if (!listening) {
+                CS_LOG(ERR, "Failed to create pipe instance, retrying in 1s");
             }
         }
 
-        if (stop_flag_.load()) {
-            CloseHandle(pipe_handle_);
-            pipe_handle_ = INVALID_HANDLE_VALUE;
-            break;
+        handles.clear();
+        handles.push_back(stop_event_);
+        for (const auto& c : clients_) {
+            handles.push_back(c->read_ov.hEvent);
+            handles.push_back(c->write_ov.hEvent);
         }
 
-        CS_LOG(INFO, "Client connected to pipe");
+        DWORD wait = WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(),
+                                            FALSE, waitTimeoutMs(nowMs(), listening));
+        if (stop_flag_.load()) break;
+        if (wait == WAIT_FAILED) {
+            CS_LOG(WARN, "WaitForMultipleObjects failed: %lu", GetLastError());
+            Sleep(LISTEN_RETRY_MS);
+            continue;
+        }
 
-        // Handle this client (blocking, one at a time)
-        handleClient();
+        for (const auto& c : clients_) {
+            serviceClient(*c);
+        }
+        pushStats(nowMs());
+        for (const auto& c : clients_) {
+            if (!c->closed && !c->writing && !c->out.empty()) startWrite(*c);
+        }
 
-        // Disconnect and close pipe for next client
-        DisconnectNamedPipe(pipe_handle_);
-        CloseHandle(pipe_handle_);
-        pipe_handle_ = INVALID_HANDLE_VALUE;
+        // Drop what disconnected
+        for (auto it = clients_.begin(); it != clients_.end();) {
+            if ((*it)->closed) {
+                closeClient(**it);
+                it = clients_.erase(it);
+                CS_LOG(INFO, "Client disconnected");
+            } else {
+                ++it;
+            }
+        }
+    }
 
-        CS_LOG(INFO, "Client disconnected");
+    for (const auto& c : clients_) {
+        closeClient(*c);
     }
+    clients_.clear();
 
     CS_LOG(DEBUG, "Pipe server thread exiting");
 }
 
-void PipeServer::handleClient() {
-    std::string buffer;
-    buffer.reserve(PIPE_BUFFER_SIZE);
-
-    char read_buf[PIPE_BUFFER_SIZE];
+DWORD PipeServer::waitTimeoutMs(uint64_t now_ms, bool listening) const {
+    uint64_t timeout = listening ? INFINITE : LISTEN_RETRY_MS;
+    for (const auto& c : clients_) {
+        if (c->closed || c->stats_interval_ms == 0) continue;
+        timeout = std::min<uint64_t>(timeout, c->next_stats_ms > now_ms ? c->next_stats_ms - now_ms : 0);
+    }
+    return static_cast<DWORD>(timeout);
+}
 
-    while (!stop_flag_.load()) {
-        DWORD bytes_read = 0;
-        BOOL ok = ReadFile(pipe_handle_, read_buf, sizeof(read_buf) - 1,
-                           &bytes_read, nullptr);
+void PipeServer::serviceClient(Client& c) {
+    if (c.closed) return;
+    DWORD bytes = 0;
+
+    if (c.connecting) {
+        if (!HasOverlappedIoCompleted(&c.read_ov)) return;
+        c.connecting = false;
+        ResetEvent(c.read_ov.hEvent);
+        if (!GetOverlappedResult(c.pipe, &c.read_ov, &bytes, FALSE) &&
+            GetLastError() != ERROR_PIPE_CONNECTED) {
+            CS_LOG(WARN, "GetOverlappedResult error: %lu", GetLastError());
+            c.closed = true;
+            return;
+        }
+        CS_LOG(INFO, "Client connected to pipe");
+        if (!startRead(c)) return;
+    }
 
-        if (!ok || bytes_read == 0) {
+    if (c.reading && HasOverlappedIoCompleted(&c.read_ov)) {
+        c.reading = false;
+        ResetEvent(c.read_ov.hEvent);
+        if (!GetOverlappedResult(c.pipe, &c.read_ov, &bytes, FALSE) || bytes == 0) {
             DWORD err = GetLastError();
             if (err == ERROR_BROKEN_PIPE || err == ERROR_NO_DATA) {
                 CS_LOG(DEBUG, "Pipe client disconnected (error %lu)", err);
-                return;
+            } else if (err != ERROR_OPERATION_ABORTED) {
+                CS_LOG(WARN, "ReadFile error: %lu", err);
             }
-            if (err == ERROR_OPERATION_ABORTED) {
-                // Cancelled by stop()
-                return;
-            }
-            CS_LOG(WARN, "ReadFile error: %lu", err);
+            c.closed = true;
             return;
         }
 
         // Append received data to buffer
-        buffer.append(read_buf, bytes_read);
+        c.buffer.append(c.read_buf, bytes);
+        processLines(c);
+        if (!startRead(c)) return;
+    }
 
-        // Process complete newline-delimited messages
-        size_t newline_pos;
-        while ((newline_pos = buffer.find('\n')) != std::string::npos) {
-            std::string message = buffer.substr(0, newline_pos);
-            buffer.erase(0, newline_pos + 1);
+    if (c.writing && HasOverlappedIoCompleted(&c.write_ov)) {
+        c.writing = false;
+        ResetEvent(c.write_ov.hEvent);
+        if (!GetOverlappedResult(c.pipe, &c.write_ov, &bytes, FALSE)) {
+            CS_LOG(DEBUG, "Pipe write failed (error %lu)", GetLastError());
+            c.closed = true;
+            return;
+        }
+        c.out.pop_front();
+    }
+}
 
-            // Trim trailing \r if present
-            if (!message.empty() && message.back() == '\r') {
-                message.pop_back();
+bool PipeServer::startRead(Client& c) {
+    if (!ReadFile(c.pipe, c.read_buf, PIPE_BUFFER_SIZE, nullptr, &c.read_ov)) {
+        DWORD err = GetLastError();
+        if (err != ERROR_IO_PENDING) {
+            if (err == ERROR_BROKEN_PIPE || err == ERROR_NO_DATA) {
+                CS_LOG(DEBUG, "Pipe client disconnected (error %lu)", err);
+            } else {
+                CS_LOG(WARN, "ReadFile error: %lu", err);
             }
+            c.closed = true;
+            return false;
+        }
+    }
+    // Completed or pending: either way the event is signalled when done
+    c.reading = true;
+    return true;
+}
+
+void PipeServer::startWrite(Client& c) {
+    const std::string& data = c.out.front();
+    if (!WriteFile(c.pipe, data.data(), static_cast<DWORD>(data.size()), nullptr, &c.write_ov)) {
+        DWORD err = GetLastError();
+        if (err != ERROR_IO_PENDING) {
+            CS_LOG(DEBUG, "Pipe write failed (error %lu)", err);
+            c.closed = true;
+            return;
+        }
+    }
+    c.writing = true;
+}
+
+void PipeServer::closeClient(Client& c) {
+    if (c.pipe != INVALID_HANDLE_VALUE) {
+        // The OVERLAPPED structures must outlive whatever is still pending
+        if (c.connecting || c.reading || c.writing) {
+            CancelIoEx(c.pipe, nullptr);
+            DWORD bytes = 0;
+            if (c.connecting || c.reading) GetOverlappedResult(c.pipe, &c.read_ov, &bytes, TRUE);
+            if (c.writing)                 GetOverlappedResult(c.pipe, &c.write_ov, &bytes, TRUE);
+        }
+        if (!c.connecting) DisconnectNamedPipe(c.pipe);
+        CloseHandle(c.pipe);
+        c.pipe = INVALID_HANDLE_VALUE;
+    }
+    if (c.read_ov.hEvent)  CloseHandle(c.read_ov.hEvent);
+    if (c.write_ov.hEvent) CloseHandle(c.write_ov.hEvent);
+    c.read_ov.hEvent  = nullptr;
+    c.write_ov.hEvent = nullptr;
+    c.connecting = c.reading = c.writing = false;
+    if (c.stats_skipped > 0) {
+        CS_LOG(DEBUG, "Pipe client skipped %llu stats frames",
+               static_cast<unsigned long long>(c.stats_skipped));
+    }
+}
+
+void PipeServer::processLines(Client& c) {
+    // Process complete newline-delimited messages
+    size_t newline_pos;
+    while ((newline_pos = c.buffer.find('\n')) != std::string::npos) {
+        std::string message = c.buffer.substr(0, newline_pos);
+        c.buffer.erase(0, newline_pos + 1);
 
-            if (message.empty()) continue;
+        // Trim trailing \r if present
+        if (!message.empty() && message.back() == '\r') {
+            message.pop_back();
+        }
+
+        if (message.empty()) continue;
+
+        CS_LOG(DEBUG, "Pipe recv: %s", message.c_str());
 
-            CS_LOG(DEBUG, "Pipe recv: %s", message.c_str());
+        // Process and queue response
+        std::string response = processMessage(c, message);
+        CS_LOG(DEBUG, "Pipe send: %s", response.c_str());
+        response += "\n";
+        c.out.push_back(std::move(response));
+    }
+}
 
-            // Process and send response
-            std::string response = processMessage(message);
-            response += "\n";
+void PipeServer::pushStats(uint64_t now_ms) {
+    if (!stats_source_) return;
 
-            DWORD bytes_written = 0;
-            WriteFile(pipe_handle_, response.c_str(),
-                      static_cast<DWORD>(response.size()),
-                      &bytes_written, nullptr);
-            FlushFileBuffers(pipe_handle_);
+    std::string frame;   // Built once for every subscriber due now
+    for (const auto& c : clients_) {
+        if (c->closed || c->stats_interval_ms == 0 || now_ms < c->next_stats_ms) continue;
+        c->next_stats_ms = now_ms + c->stats_interval_ms;
 
-            CS_LOG(DEBUG, "Pipe send: %s", response.c_str());
+        // A reader that has fallen behind gets the next frame, not a backlog
+        if (c->out.size() >= MAX_QUEUED_WRITES) {
+            c->stats_skipped++;
+            continue;
+        }
+        if (frame.empty()) {
+            frame  = "{\"event\":\"stats\",\"seq\":";
+            frame += std::to_string(stats_seq_++);
+            frame += ",\"data\":";
+            frame += stats_source_();
+            frame += "}\n";
         }
+        c->out.push_back(frame);
     }
 }
 
-std::string PipeServer::processMessage(const std::string& message) {
+std::string PipeServer::processMessage(Client& c, const std::string& message) {
     // Parse the JSON message
     SimpleJson json;
     if (!json.parse(message)) {
@@ -611,6 +439,26 @@ std::string PipeServer::processMessage(const std::string& message) {
         return makeErrorResponse("Missing 'command' field");
     }
 
+    // Subscriptions belong to the connection, not to the handler
+    if (command == "subscribe_stats") {
+        if (!stats_source_) {
+            return makeErrorResponse("Stats subscriptions are not available");
+        }
+        uint64_t interval = json.hasKey("interval_ms") ? json.getUint("interval_ms")
+                                                       : DEFAULT_STATS_INTERVAL_MS;
+        interval = std::clamp<uint64_t>(interval, MIN_STATS_INTERVAL_MS, MAX_STATS_INTERVAL_MS);
+        c.stats_interval_ms = static_cast<uint32_t>(interval);
+        c.next_stats_ms     = nowMs();   // First frame right after the reply
+
+        SimpleJson data;
+        data.setUint("interval_ms", interval);
+        return makeOkResponse(data);
+    }
+    if (command == "unsubscribe_stats") {
+        c.stats_interval_ms = 0;
+        return makeOkResponse();
+    }
+
     // Dispatch to handler
     if (!handler_) {
         return makeErrorResponse("No command handler registered");
@@ -2,32 +2,48 @@
 // pipe_server.h -- Windows Named Pipe IPC server for host-agent communication
 //
 // Listens on a named pipe (e.g. \\.\pipe\nvremote-host) for JSON
-// commands from the host-agent Go binary.  Each message is a JSON object
-// terminated by a newline.
+// commands from the host-agent Go binary and other local clients
+// (diagnostics, tray UI).  Each message is a JSON object terminated by a
+// newline.  Up to MAX_CLIENTS clients are served at once from one thread
+// with overlapped I/O; commands run one at a time, in arrival order.
 //
 // Supported commands:
-//   prepare_session  { session_id, codec, bitrate_kbps, fps, width, height, gaming_mode }
+//   prepare_session  { session_id, codec, bitrate_kbps, fps, width, height, gaming_mode,
+//                      displays (0 = all) }
 //   start_session    { session_id, peer_ip, peer_port, dtls_fingerprint }
 //   stop_session     { session_id }
+//   add_viewer       { viewer_id } -> { viewer_id, dtls_fingerprint }
+//   start_viewer     { viewer_id, peer_ip, peer_port }
+//   remove_viewer    { viewer_id }
 //   get_stats        -> returns QoS statistics
+//   subscribe_stats  { interval_ms } -> then pushes the same statistics every
+//                      interval as { "event": "stats", "seq": N, "data": {...} }
+//                      lines until unsubscribe_stats or disconnect
+//   unsubscribe_stats
 //   force_idr        -> force a keyframe
 //   reconfigure      { bitrate_kbps, fps, width, height }
 //   set_gaming_mode  { mode: "competitive"|"balanced"|"cinematic" }
+//   dump_trace       { path } -> writes the pipeline trace as Chrome trace JSON
 //
 // Responses:
 //   { "status": "ok", "data": {...} }
 //   { "status": "error", "message": "..." }
 //
-// JSON parsing uses a minimal built-in implementation (no external deps).
+// JSON parsing uses the minimal built-in implementation in simple_json.h.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include <cstdint>
+#include <deque>
 #include <functional>
+#include <memory>
 #include <string>
 #include <map>
 #include <thread>
 #include <atomic>
+#include <vector>
+
+#include "simple_json.h"
 
 #ifndef WIN32_LEAN_AND_MEAN
 #  define WIN32_LEAN_AND_MEAN
@@ -36,66 +52,6 @@
 
 namespace cs::host {
 
-// ---------------------------------------------------------------------------
-// SimpleJson -- minimal JSON key-value store (string values only)
-//
-// Supports flat objects: { "key": "value", "num": "123" }
-// Callers use getString() / getInt() / getUint() for typed access.
-// ---------------------------------------------------------------------------
-class SimpleJson {
-public:
-    SimpleJson() = default;
-
-    /// Parse a JSON object string.  Returns true on success.
-    bool parse(const std::string& json);
-
-    /// Check if a key exists.
-    bool hasKey(const std::string& key) const;
-
-    /// Get a string value (returns empty string if not found).
-    std::string getString(const std::string& key) const;
-
-    /// Get an integer value (returns 0 if not found or not numeric).
-    int64_t getInt(const std::string& key) const;
-
-    /// Get an unsigned integer value.
-    uint64_t getUint(const std::string& key) const;
-
-    /// Set a string value.
-    void setString(const std::string& key, const std::string& value);
-
-    /// Set a numeric value.
-    void setInt(const std::string& key, int64_t value);
-
-    /// Set an unsigned numeric value.
-    void setUint(const std::string& key, uint64_t value);
-
-    /// Set a floating-point value.
-    void setFloat(const std::string& key, double value);
-
-    /// Serialize to a JSON string.
-    std::string serialize() const;
-
-    /// Access the underlying map.
-    const std::map<std::string, std::string>& entries() const { return entries_; }
-
-private:
-    /// Skip whitespace in the input starting at pos.
-    static size_t skipWs(const std::string& s, size_t pos);
-
-    /// Parse a JSON string literal starting at pos (including quotes).
-    /// Returns the parsed string and advances pos past the closing quote.
-    static std::string parseString(const std::string& s, size_t& pos);
-
-    /// Parse a JSON value (string, number, bool, null) starting at pos.
-    static std::string parseValue(const std::string& s, size_t& pos);
-
-    /// Escape a string for JSON output.
-    static std::string escapeString(const std::string& s);
-
-    std::map<std::string, std::string> entries_;
-};
-
 // ---------------------------------------------------------------------------
 // Command handler callback
 // ---------------------------------------------------------------------------
@@ -104,6 +60,9 @@ private:
 using PipeCommandHandler = std::function<std::string(
     const std::string& command, const SimpleJson& params)>;
 
+/// Returns the current statistics as a JSON object, for stats subscriptions.
+using PipeStatsSource = std::function<std::string()>;
+
 // ---------------------------------------------------------------------------
 // PipeServer
 // ---------------------------------------------------------------------------
@@ -121,6 +80,9 @@ public:
     /// Set the command handler.
     void setHandler(PipeCommandHandler handler);
 
+    /// Set the source of subscription stats frames (before start()).
+    void setStatsSource(PipeStatsSource source);
+
     /// Start the pipe server (creates thread, listens for connections).
     bool start();
 
@@ -131,22 +93,69 @@ public:
     bool isRunning() const { return running_.load(); }
 
 private:
+    static constexpr DWORD    PIPE_BUFFER_SIZE      = 8192;
+    static constexpr DWORD    PIPE_TIMEOUT_MS       = 5000;
+    static constexpr size_t   MAX_CLIENTS           = 8;       // Pipe instances, one listening
+    static constexpr size_t   MAX_QUEUED_WRITES     = 4;       // Beyond this, stats frames are skipped
+    static constexpr uint32_t DEFAULT_STATS_INTERVAL_MS = 1000;
+    static constexpr uint32_t MIN_STATS_INTERVAL_MS = 50;
+    static constexpr uint32_t MAX_STATS_INTERVAL_MS = 60000;
+    static constexpr DWORD    LISTEN_RETRY_MS       = 1000;
+
+    /// One pipe instance: listening until a client connects, then serving it.
+    struct Client {
+        HANDLE      pipe        = INVALID_HANDLE_VALUE;
+        OVERLAPPED  read_ov     = {};      // Also carries ConnectNamedPipe
+        OVERLAPPED  write_ov    = {};
+        bool        connecting  = true;
+        bool        reading     = false;
+        bool        writing     = false;
+        bool        closed      = false;
+        std::string buffer;                // Partial line
+        std::deque<std::string> out;       // Replies and frames; front is being written
+        uint32_t    stats_interval_ms = 0; // 0 = not subscribed
+        uint64_t    next_stats_ms     = 0;
+        uint64_t    stats_skipped     = 0; // Frames dropped behind a slow reader
+        char        read_buf[PIPE_BUFFER_SIZE];
+    };
+
     void serverThread();
-    bool createPipeInstance();
-    void handleClient();
-    std::string processMessage(const std::string& message);
+
+    /// Create a pipe instance and start waiting for a client on it.
+    bool listen();
+
+    /// Handle whatever completed on |c|'s connect, read and write.
+    void serviceClient(Client& c);
+
+    bool startRead(Client& c);
+    void startWrite(Client& c);
+    void closeClient(Client& c);
+
+    /// Run each complete line in |c|'s buffer, queueing the replies.
+    void processLines(Client& c);
+    std::string processMessage(Client& c, const std::string& message);
+
+    /// Queue a stats frame for every subscriber due at |now_ms|.
+    void pushStats(uint64_t now_ms);
+
+    /// How long the server thread may wait for I/O at |now_ms|.
+    DWORD waitTimeoutMs(uint64_t now_ms, bool listening) const;
 
     std::string          pipe_name_;
     std::string          full_pipe_path_;
-    HANDLE               pipe_handle_ = INVALID_HANDLE_VALUE;
 
     PipeCommandHandler   handler_;
+    PipeStatsSource      stats_source_;
     std::thread          thread_;
     std::atomic<bool>    running_{false};
     std::atomic<bool>    stop_flag_{false};
 
-    // Overlapped I/O event for cancellable waits.
-    HANDLE               overlap_event_ = INVALID_HANDLE_VALUE;
+    // Server thread only
+    std::vector<std::unique_ptr<Client>> clients_;
+    uint64_t             stats_seq_ = 0;
+
+    // Signalled by stop() to wake the server thread.
+    HANDLE               stop_event_ = nullptr;
 };
 
 // ---------------------------------------------------------------------------
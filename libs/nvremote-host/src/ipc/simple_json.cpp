@@ -0,0 +1,349 @@
+///////////////////////////////////////////////////////////////////////////////
+// simple_json.cpp -- Minimal flat JSON for the host's IPC messages
+///////////////////////////////////////////////////////////////////////////////
+
+#include "simple_json.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+
+namespace cs::host {
+
+// ===========================================================================
+// SimpleJson implementation
+// ===========================================================================
+
+size_t SimpleJson::skipWs(const std::string& s, size_t pos) {
+    while (pos < s.size() && std::isspace(static_cast<unsigned char>(s[pos]))) {
+        ++pos;
+    }
+    return pos;
+}
+
+std::string SimpleJson::parseString(const std::string& s, size_t& pos) {
+    // pos should point to the opening quote
+    if (pos >= s.size() || s[pos] != '"') return "";
+    ++pos; // skip opening quote
+
+    std::string result;
+    result.reserve(64);
+
+    while (pos < s.size()) {
+        char c = s[pos++];
+        if (c == '"') {
+            return result;
+        }
+        if (c == '\\' && pos < s.size()) {
+            char esc = s[pos++];
+            switch (esc) {
+                case '"':  result += '"';  break;
+                case '\\': result += '\\'; break;
+                case '/':  result += '/';  break;
+                case 'b':  result += '\b'; break;
+                case 'f':  result += '\f'; break;
+                case 'n':  result += '\n'; break;
+                case 'r':  result += '\r'; break;
+                case 't':  result += '\t'; break;
+                case 'u':
+                    // Skip 4 hex digits (minimal handling -- store as-is)
+                    if (pos + 4 <= s.size()) {
+                        result += "\\u";
+                        result += s.substr(pos, 4);
+                        pos += 4;
+                    }
+                    break;
+                default:
+                    result += esc;
+                    break;
+            }
+        } else {
+            result += c;
+        }
+    }
+    return result; // unterminated string -- return what we have
+}
+
+std::string SimpleJson::parseValue(const std::string& s, size_t& pos) {
+    pos = skipWs(s, pos);
+    if (pos >= s.size()) return "";
+
+    char c = s[pos];
+
+    // String value
+    if (c == '"') {
+        return parseString(s, pos);
+    }
+
+    // Number (integer or float, possibly negative)
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        size_t start = pos;
+        if (c == '-') ++pos;
+        while (pos < s.size() && ((s[pos] >= '0' && s[pos] <= '9') ||
+               s[pos] == '.' || s[pos] == 'e' || s[pos] == 'E' ||
+               s[pos] == '+' || s[pos] == '-')) {
+            // Avoid consuming '-' after the first character unless after e/E
+            if (s[pos] == '-' && pos > start + 1 && s[pos - 1] != 'e' && s[pos - 1] != 'E') {
+                break;
+            }
+            ++pos;
+        }
+        return s.substr(start, pos - start);
+    }
+
+    // Boolean: true
+    if (c == 't' && pos + 4 <= s.size() && s.substr(pos, 4) == "true") {
+        pos += 4;
+        return "true";
+    }
+
+    // Boolean: false
+    if (c == 'f' && pos + 5 <= s.size() && s.substr(pos, 5) == "false") {
+        pos += 5;
+        return "false";
+    }
+
+    // Null
+    if (c == 'n' && pos + 4 <= s.size() && s.substr(pos, 4) == "null") {
+        pos += 4;
+        return "";
+    }
+
+    // Skip nested objects and arrays (store as raw string)
+    if (c == '{' || c == '[') {
+        char open  = c;
+        char close = (c == '{') ? '}' : ']';
+        int depth = 1;
+        size_t start = pos;
+        ++pos;
+        bool in_string = false;
+        while (pos < s.size() && depth > 0) {
+            char ch = s[pos];
+            if (in_string) {
+                if (ch == '\\') { ++pos; } // skip escaped char
+                else if (ch == '"') { in_string = false; }
+            } else {
+                if (ch == '"') { in_string = true; }
+                else if (ch == open) { ++depth; }
+                else if (ch == close) { --depth; }
+            }
+            ++pos;
+        }
+        return s.substr(start, pos - start);
+    }
+
+    return "";
+}
+
+bool SimpleJson::parse(const std::string& json) {
+    entries_.clear();
+
+    size_t pos = skipWs(json, 0);
+    if (pos >= json.size() || json[pos] != '{') return false;
+    ++pos; // skip '{'
+
+    while (pos < json.size()) {
+        pos = skipWs(json, pos);
+        if (pos >= json.size()) return false;
+
+        // End of object
+        if (json[pos] == '}') {
+            return true;
+        }
+
+        // Skip comma between entries
+        if (json[pos] == ',') {
+            ++pos;
+            pos = skipWs(json, pos);
+        }
+
+        // Parse key
+        if (pos >= json.size() || json[pos] != '"') return false;
+        std::string key = parseString(json, pos);
+
+        // Expect colon
+        pos = skipWs(json, pos);
+        if (pos >= json.size() || json[pos] != ':') return false;
+        ++pos;
+
+        // Parse value
+        std::string value = parseValue(json, pos);
+
+        entries_[key] = value;
+    }
+
+    return false; // unterminated object
+}
+
+bool SimpleJson::hasKey(const std::string& key) const {
+    return entries_.find(key) != entries_.end();
+}
+
+std::string SimpleJson::getString(const std::string& key) const {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return "";
+    return it->second;
+}
+
+int64_t SimpleJson::getInt(const std::string& key) const {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return 0;
+    try {
+        return std::stoll(it->second);
+    } catch (...) {
+        return 0;
+    }
+}
+
+uint64_t SimpleJson::getUint(const std::string& key) const {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return 0;
+    try {
+        return std::stoull(it->second);
+    } catch (...) {
+        return 0;
+    }
+}
+
+void SimpleJson::setString(const std::string& key, const std::string& value) {
+    entries_[key] = value;
+}
+
+void SimpleJson::setInt(const std::string& key, int64_t value) {
+    entries_[key] = std::to_string(value);
+}
+
+void SimpleJson::setUint(const std::string& key, uint64_t value) {
+    entries_[key] = std::to_string(value);
+}
+
+void SimpleJson::setFloat(const std::string& key, double value) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.2f", value);
+    entries_[key] = buf;
+}
+
+std::string SimpleJson::escapeString(const std::string& s) {
+    std::string out;
+    out.reserve(s.size() + 8);
+    for (char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b";  break;
+            case '\f': out += "\\f";  break;
+            case '\n': out += "\\n";  break;
+            case '\r': out += "\\r";  break;
+            case '\t': out += "\\t";  break;
+            default:   out += c;      break;
+        }
+    }
+    return out;
+}
+
+std::string SimpleJson::serialize() const {
+    std::string out = "{";
+    bool first = true;
+    for (auto& [key, value] : entries_) {
+        if (!first) out += ",";
+        first = false;
+        out += "\"" + escapeString(key) + "\":";
+
+        // Determine if value looks numeric, boolean, or null
+        bool is_number = false;
+        bool is_bool_or_null = (value == "true" || value == "false" || value.empty());
+        if (!is_bool_or_null && !value.empty()) {
+            // Check if value is a valid number
+            const char* p = value.c_str();
+            if (*p == '-') ++p;
+            bool has_digit = false;
+            bool has_dot = false;
+            while (*p) {
+                if (*p >= '0' && *p <= '9') { has_digit = true; ++p; }
+                else if (*p == '.' && !has_dot) { has_dot = true; ++p; }
+                else if ((*p == 'e' || *p == 'E') && has_digit) {
+                    ++p;
+                    if (*p == '+' || *p == '-') ++p;
+                }
+                else break;
+            }
+            is_number = has_digit && (*p == '\0');
+        }
+
+        // Check if value is a raw JSON object/array
+        bool is_raw_json = (!value.empty() && (value[0] == '{' || value[0] == '['));
+
+        if (is_number || is_raw_json) {
+            out += value;
+        } else if (value == "true") {
+            out += "true";
+        } else if (value == "false") {
+            out += "false";
+        } else if (value.empty()) {
+            out += "null";
+        } else {
+            out += "\"" + escapeString(value) + "\"";
+        }
+    }
+    out += "}";
+    return out;
+}
+
+// ===========================================================================
+// JsonObjectWriter implementation
+// ===========================================================================
+
+JsonObjectWriter::JsonObjectWriter() {
+    out_.reserve(2048);
+    out_ += '{';
+}
+
+void JsonObjectWriter::addKey(const char* key) {
+    if (!first_) out_ += ',';
+    first_ = false;
+    out_ += '"';
+    out_ += key;
+    out_ += "\":";
+}
+
+void JsonObjectWriter::addUint(const char* key, uint64_t value) {
+    addKey(key);
+    char buf[24];
+    std::snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(value));
+    out_ += buf;
+}
+
+void JsonObjectWriter::addFloat(const char* key, double value) {
+    addKey(key);
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.2f", std::isfinite(value) ? value : 0.0);
+    out_ += buf;
+}
+
+void JsonObjectWriter::addString(const char* key, const std::string& value) {
+    addKey(key);
+    out_ += '"';
+    for (char c : value) {
+        switch (c) {
+            case '"':  out_ += "\\\""; break;
+            case '\\': out_ += "\\\\"; break;
+            case '\n': out_ += "\\n";  break;
+            case '\r': out_ += "\\r";  break;
+            case '\t': out_ += "\\t";  break;
+            default:   out_ += c;      break;
+        }
+    }
+    out_ += '"';
+}
+
+void JsonObjectWriter::addBool(const char* key, bool value) {
+    addKey(key);
+    out_ += value ? "true" : "false";
+}
+
+std::string JsonObjectWriter::finish() {
+    out_ += '}';
+    return std::move(out_);
+}
+
+} // namespace cs::host
@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////
+// simple_json.h -- Minimal flat JSON for the host's IPC messages
+//
+// The pipe server's commands and replies are flat JSON objects, so the
+// host carries its own small reader/writer instead of a JSON library:
+// SimpleJson parses and builds them as string key/value maps, and
+// JsonObjectWriter formats the larger, frequent replies (stats) straight
+// into a string.  Platform independent, unlike the pipe server itself.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// SimpleJson -- minimal JSON key-value store (string values only)
+//
+// Supports flat objects: { "key": "value", "num": "123" }
+// Callers use getString() / getInt() / getUint() for typed access.
+// ---------------------------------------------------------------------------
+class SimpleJson {
+public:
+    SimpleJson() = default;
+
+    /// Parse a JSON object string.  Returns true on success.
+    bool parse(const std::string& json);
+
+    /// Check if a key exists.
+    bool hasKey(const std::string& key) const;
+
+    /// Get a string value (returns empty string if not found).
+    std::string getString(const std::string& key) const;
+
+    /// Get an integer value (returns 0 if not found or not numeric).
+    int64_t getInt(const std::string& key) const;
+
+    /// Get an unsigned integer value.
+    uint64_t getUint(const std::string& key) const;
+
+    /// Set a string value.
+    void setString(const std::string& key, const std::string& value);
+
+    /// Set a numeric value.
+    void setInt(const std::string& key, int64_t value);
+
+    /// Set an unsigned numeric value.
+    void setUint(const std::string& key, uint64_t value);
+
+    /// Set a floating-point value.
+    void setFloat(const std::string& key, double value);
+
+    /// Serialize to a JSON string.
+    std::string serialize() const;
+
+    /// Access the underlying map.
+    const std::map<std::string, std::string>& entries() const { return entries_; }
+
+private:
+    /// Skip whitespace in the input starting at pos.
+    static size_t skipWs(const std::string& s, size_t pos);
+
+    /// Parse a JSON string literal starting at pos (including quotes).
+    /// Returns the parsed string and advances pos past the closing quote.
+    static std::string parseString(const std::string& s, size_t& pos);
+
+    /// Parse a JSON value (string, number, bool, null) starting at pos.
+    static std::string parseValue(const std::string& s, size_t& pos);
+
+    /// Escape a string for JSON output.
+    static std::string escapeString(const std::string& s);
+
+    std::map<std::string, std::string> entries_;
+};
+
+// ---------------------------------------------------------------------------
+// JsonObjectWriter -- flat JSON object appended straight into a string
+//
+// For replies built many times a second (stats): fields are formatted once,
+// in the order they are added, with no map and no re-parsing of values.
+// ---------------------------------------------------------------------------
+class JsonObjectWriter {
+public:
+    JsonObjectWriter();
+
+    void addUint(const char* key, uint64_t value);
+    void addFloat(const char* key, double value);   // Two decimals, as setFloat()
+    void addString(const char* key, const std::string& value);
+    void addBool(const char* key, bool value);
+
+    /// Close the object and return it.  The writer is empty afterwards.
+    std::string finish();
+
+private:
+    void addKey(const char* key);
+
+    std::string out_;
+    bool        first_ = true;
+};
+
+} // namespace cs::host
@@ -4,8 +4,16 @@
 // Command-line options:
 //   --ipc-pipe <name>     Run as IPC server on named pipe \\.\pipe\<name>
 //   --config <path>       Load session config from JSON file (not yet implemented)
+//   --log-file <path>     Also log to <path>, rotated at 16 MB (4 kept)
 //   --capture-test        Capture 10 frames and log timing, then exit
 //   --encode-test         Capture + encode 100 frames to test.h264, then exit
+//   --encode-bench <path> Run the encoder benchmark matrix, write JSON to
+//                         <path>, then exit (see encode/encode_bench.h)
+//   --impair <spec>       Emulate a bad network on egress, e.g.
+//                         loss=1,burst=5:30,delay=40,jitter=8,rate=20000
+//                         (keys in cs/transport/network_impairment.h)
+//   --record <path>       Record every session's packets to <path> for
+//                         replay (see cs/transport/packet_recorder.h)
 //   --help                Show usage information
 //
 // If --ipc-pipe is given, the host operates as a service controlled by the
@@ -13,9 +21,13 @@
 // mode and waits for 'q' + Enter to quit.
 ///////////////////////////////////////////////////////////////////////////////
 
+#include "cs/buffer_pool.h"
 #include "cs/common.h"
 #include "cs/qos/gaming_modes.h"
+#include "cs/trace.h"
+#include "cs/transport/network_impairment.h"
 
+#include "encode/encode_bench.h"
 #include "session/session_manager.h"
 #include "ipc/pipe_server.h"
 
@@ -81,8 +93,13 @@ static void printUsage(const char* argv0) {
         "Options:\n"
         "  --ipc-pipe <name>     Run as IPC service on \\\\.\\.\\pipe\\<name>\n"
         "  --config <path>       Load session config from JSON file\n"
+        "  --log-file <path>     Also log to <path>, rotated at 16 MB\n"
         "  --capture-test        Capture 10 frames, log timing, exit\n"
         "  --encode-test         Capture + encode 100 frames to test.h264, exit\n"
+        "  --encode-bench <path> Benchmark encoder settings, write JSON to <path>, exit\n"
+        "  --impair <spec>       Emulate a bad network on egress (QoS testing),\n"
+        "                        e.g. loss=1,burst=5:30,delay=40,jitter=8,rate=20000\n"
+        "  --record <path>       Record session packets to <path> for replay\n"
         "  --help                Show this help\n"
         "\n"
         "Without --ipc-pipe, runs in standalone mode (press 'q' + Enter to quit).\n",
@@ -93,9 +110,7 @@ static void printUsage(const char* argv0) {
 // Parse GamingMode from string
 // ---------------------------------------------------------------------------
 static cs::GamingMode parseGamingMode(const std::string& s) {
-    if (s == "competitive" || s == "Competitive") return cs::GamingMode::Competitive;
-    if (s == "cinematic"   || s == "Cinematic")   return cs::GamingMode::Cinematic;
-    return cs::GamingMode::Balanced;
+    return cs::gamingModeFromString(s);   // Creative and CAD included
 }
 
 // ---------------------------------------------------------------------------
@@ -107,6 +122,147 @@ static CodecType parseCodec(const std::string& s) {
     return CodecType::H264;
 }
 
+// ---------------------------------------------------------------------------
+// Parse PipelineMode / OverloadPolicy / PacingMode from string
+// ---------------------------------------------------------------------------
+static PipelineMode parsePipelineMode(const std::string& s) {
+    if (s == "single" || s == "single_thread") return PipelineMode::SINGLE_THREAD;
+    if (s == "staged")                         return PipelineMode::STAGED;
+    return PipelineMode::AUTO;
+}
+
+static OverloadPolicy parseOverloadPolicy(const std::string& s) {
+    if (s == "skip_stale") return OverloadPolicy::SKIP_STALE;
+    return OverloadPolicy::SKIP_CAPTURE;
+}
+
+static PacingMode parsePacingMode(const std::string& s) {
+    if (s == "timer")   return PacingMode::TIMER;
+    if (s == "capture") return PacingMode::CAPTURE;
+    return PacingMode::AUTO;
+}
+
+static SplitEncode parseSplitEncode(const std::string& s) {
+    if (s == "off")   return SplitEncode::OFF;
+    if (s == "two")   return SplitEncode::TWO;
+    if (s == "three") return SplitEncode::THREE;
+    return SplitEncode::AUTO;
+}
+
+static MultipathPolicy parseMultipath(const std::string& s) {
+    if (s == "duplicate") return MultipathPolicy::duplicate();
+    if (s == "split")     return MultipathPolicy::split();
+    return MultipathPolicy();
+}
+
+static PeerInfo parsePeer(const SimpleJson& params) {
+    PeerInfo peer;
+    // Accept both "peer_ip"/"peer_port" and "ip"/"port" for compatibility
+    // with different host-agent versions.
+    peer.ip = params.getString("peer_ip");
+    if (peer.ip.empty()) {
+        peer.ip = params.getString("ip");
+    }
+    uint16_t port = static_cast<uint16_t>(params.getUint("peer_port"));
+    if (port == 0) {
+        port = static_cast<uint16_t>(params.getUint("port"));
+    }
+    peer.port = port;
+    peer.dtls_fingerprint = params.getString("dtls_fingerprint");
+    return peer;
+}
+
+static cs::TurnConfig parseTurn(const SimpleJson& params) {
+    cs::TurnConfig turn;
+    turn.server     = params.getString("turn_server");
+    if (params.hasKey("turn_port")) turn.port = static_cast<uint16_t>(params.getUint("turn_port"));
+    turn.username   = params.getString("turn_username");
+    turn.credential = params.getString("turn_credential");
+    turn.realm      = params.getString("turn_realm");
+    return turn;
+}
+
+// ---------------------------------------------------------------------------
+// Session statistics as a JSON object (get_stats, stats subscriptions)
+// ---------------------------------------------------------------------------
+static std::string formatStats(SessionManager& session) {
+    SessionStats st = session.getStats();
+    JsonObjectWriter w;
+    w.addUint("bitrate_kbps",              st.bitrate_kbps);
+    w.addUint("fps",                       st.fps);
+    w.addUint("width",                     st.width);
+    w.addUint("height",                    st.height);
+    w.addString("codec",                   st.codec);
+    w.addString("gaming_mode",             st.gaming_mode);
+    w.addFloat("packet_loss_percent",      st.packet_loss_percent);
+    w.addFloat("jitter_ms",                st.jitter_ms);
+    w.addFloat("rtt_ms",                   st.rtt_ms);
+    w.addFloat("capture_time_ms",          st.capture_time_ms);
+    w.addFloat("encode_time_ms",           st.encode_time_ms);
+    w.addUint("bytes_sent",                st.bytes_sent);
+    w.addUint("frames_sent",               st.frames_sent);
+    w.addFloat("fec_ratio",                st.fec_ratio);
+    w.addUint("loss_invalidations",        st.loss_invalidations);
+    w.addUint("loss_idrs",                 st.loss_idrs);
+    w.addUint("frames_shed",               st.frames_shed);
+    w.addUint("frames_skipped",            st.frames_skipped);
+    w.addUint("frames_dropped_oversize",   st.frames_dropped_oversize);
+    w.addUint("frame_budget_bytes",        st.frame_budget_bytes);
+    w.addUint("nack_hits",                 st.nack_hits);
+    w.addUint("nack_misses",               st.nack_misses);
+    w.addUint("nack_expired",              st.nack_expired);
+    w.addUint("path_migrations",           st.path_migrations);
+    w.addBool("secondary_path",            st.secondary_path);
+    w.addUint("secondary_packets",         st.secondary_packets);
+    w.addUint("secondary_rescued",         st.secondary_rescued);
+    w.addFloat("secondary_loss_percent",   st.secondary_loss_percent);
+    w.addFloat("secondary_rtt_ms",         st.secondary_rtt_ms);
+    w.addUint("probe_clusters",            st.probe_clusters);
+    w.addUint("probed_kbps",               st.probed_kbps);
+    w.addUint("frames_overrun",            st.frames_overrun);
+    w.addUint("frames_stale",              st.frames_stale);
+    w.addFloat("capture_p50_ms",           st.capture_p50_ms);
+    w.addFloat("capture_p99_ms",           st.capture_p99_ms);
+    w.addFloat("encode_p50_ms",            st.encode_p50_ms);
+    w.addFloat("encode_p99_ms",            st.encode_p99_ms);
+    w.addFloat("send_p50_ms",              st.send_p50_ms);
+    w.addFloat("send_p99_ms",              st.send_p99_ms);
+    w.addString("pacing_mode",             st.pacing_mode);
+    w.addFloat("pacing_late_ms",           st.pacing_late_ms);
+    w.addFloat("pacing_cpu_percent",       st.pacing_cpu_percent);
+    w.addString("connection_type",         st.connection_type);
+    w.addUint("viewers",                   st.viewers);
+    w.addUint("displays",                  st.displays);
+    w.addString("thermal_state",           st.thermal_state);
+    w.addFloat("soc_temp_c",               st.soc_temp_c);
+    w.addFloat("soc_temp_predicted_c",     st.soc_temp_predicted_c);
+    w.addUint("encoder_load_percent",      st.encoder_load_percent);
+    w.addUint("encoder_engines",           st.encoder_engines);
+    w.addUint("encoder_split_ways",        st.encoder_split_ways);
+    w.addString("content_class",           st.content_class);
+    w.addUint("content_transitions",       st.content_transitions);
+    w.addUint("content_fps_cap",           st.content_fps_cap);
+    w.addFloat("content_coverage",         st.content_coverage);
+    w.addBool("warm_start",                st.warm_start);
+    w.addFloat("encoder_open_ms",          st.encoder_open_ms);
+    w.addFloat("time_to_first_frame_ms",   st.time_to_first_frame_ms);
+    w.addFloat("audio_capture_latency_ms", st.audio_capture_latency_ms);
+    w.addBool("clock_synced",              st.clock_synced);
+    w.addFloat("clock_error_ms",           st.clock_error_ms);
+    w.addFloat("clock_drift_ppm",          st.clock_drift_ppm);
+    w.addFloat("one_way_p50_ms",           st.one_way_p50_ms);
+    w.addFloat("one_way_p99_ms",           st.one_way_p99_ms);
+    w.addBool("streaming",                 session.isStreaming());
+
+    // Packet buffer pool (process-wide)
+    const cs::BufferPool::Stats pool = cs::BufferPool::shared().stats();
+    w.addUint("pool_reserved_bytes",       pool.reserved_bytes);
+    w.addUint("pool_in_use_bytes",         pool.in_use_bytes);
+    w.addUint("pool_high_water_bytes",     pool.high_water_bytes);
+    w.addUint("pool_system_allocs",        pool.system_allocs + pool.oversize_allocs);
+    return w.finish();
+}
+
 // ---------------------------------------------------------------------------
 // IPC command handler
 // ---------------------------------------------------------------------------
@@ -123,12 +279,40 @@ static std::string handlePipeCommand(const std::string& command,
         cfg.width         = static_cast<uint32_t>(params.getUint("width"));
         cfg.height        = static_cast<uint32_t>(params.getUint("height"));
         cfg.gaming_mode   = parseGamingMode(params.getString("gaming_mode"));
+        const std::string chroma = params.getString("chroma");   // What the viewer decodes
+        cfg.max_chroma    = (chroma == "yuv444" || chroma == "444") ? cs::ChromaMode::YUV444
+                                                                    : cs::ChromaMode::YUV420;
+        cfg.max_bit_depth = params.getUint("bit_depth") >= 10 ? 10 : 8;
+        cfg.temporal_layers = static_cast<uint32_t>(params.getUint("temporal_layers"));
+        cfg.slices          = static_cast<uint32_t>(params.getUint("slices"));   // 0 = auto
+        cfg.encode_depth    = static_cast<uint32_t>(params.getUint("encode_depth"));
+        cfg.split_encode    = parseSplitEncode(params.getString("split_encode"));   // auto, off, two, three
+        cfg.pipeline        = parsePipelineMode(params.getString("pipeline"));
+        cfg.overload        = parseOverloadPolicy(params.getString("overload"));
+        cfg.pacing          = parsePacingMode(params.getString("pacing"));
+        cfg.multipath       = parseMultipath(params.getString("multipath"));   // off, duplicate, split
+        if (params.hasKey("capture_core")) cfg.capture_core = static_cast<int>(params.getInt("capture_core"));
+        if (params.hasKey("encode_core"))  cfg.encode_core  = static_cast<int>(params.getInt("encode_core"));
+        if (params.hasKey("send_core"))    cfg.send_core    = static_cast<int>(params.getInt("send_core"));
+        cfg.threads         = params.getString("threads");   // e.g. encode=high@2,send=high@3
+        if (params.hasKey("displays"))     cfg.displays     = static_cast<uint32_t>(params.getUint("displays"));   // 0 = all
+        if (params.hasKey("send_shards"))  cfg.send_shards  = static_cast<uint32_t>(params.getUint("send_shards"));   // 0 = auto
+        if (params.hasKey("send_shard_sockets")) cfg.send_shard_sockets = params.getString("send_shard_sockets") == "true";
+        if (params.hasKey("bandwidth_probing"))  cfg.bandwidth_probing  = params.getString("bandwidth_probing") != "false";
+        if (params.hasKey("content_adaptive"))   cfg.content_adaptive   = params.getString("content_adaptive") != "false";
+        if (params.hasKey("dtls_identity_reuse_s")) {
+            cfg.dtls_identity_reuse_s = static_cast<uint32_t>(params.getUint("dtls_identity_reuse_s"));
+        }
+        const cs::TurnConfig turn = parseTurn(params);
+        if (!turn.server.empty()) cfg.turn_servers.push_back(turn);
 
         // Defaults
         if (cfg.bitrate_kbps == 0) cfg.bitrate_kbps = 20000;
         if (cfg.fps == 0)          cfg.fps = 60;
         if (cfg.width == 0)        cfg.width = 1920;
         if (cfg.height == 0)       cfg.height = 1080;
+        if (cfg.temporal_layers == 0) cfg.temporal_layers = 2;
+        if (cfg.encode_depth == 0)    cfg.encode_depth = 3;
 
         if (!session.prepareSession(cfg)) {
             return makeErrorResponse("Failed to prepare session");
@@ -136,25 +320,13 @@ static std::string handlePipeCommand(const std::string& command,
 
         SimpleJson data;
         data.setString("session_id", cfg.session_id);
+        data.setString("dtls_fingerprint", session.getFingerprint());
         return makeOkResponse(data);
     }
 
     // ---- start_session ----
     if (command == "start_session") {
-        PeerInfo peer;
-        // Accept both "peer_ip"/"peer_port" and "ip"/"port" for compatibility
-        // with different host-agent versions.
-        peer.ip = params.getString("peer_ip");
-        if (peer.ip.empty()) {
-            peer.ip = params.getString("ip");
-        }
-        uint16_t port = static_cast<uint16_t>(params.getUint("peer_port"));
-        if (port == 0) {
-            port = static_cast<uint16_t>(params.getUint("port"));
-        }
-        peer.port = port;
-        peer.dtls_fingerprint = params.getString("dtls_fingerprint");
-
+        PeerInfo peer = parsePeer(params);
         if (peer.ip.empty() || peer.port == 0) {
             return makeErrorResponse("Missing peer IP or port");
         }
@@ -165,33 +337,62 @@ static std::string handlePipeCommand(const std::string& command,
         return makeOkResponse();
     }
 
+    // ---- add_viewer ----
+    if (command == "add_viewer") {
+        std::string viewer_id = params.getString("viewer_id");
+        if (viewer_id.empty()) {
+            return makeErrorResponse("Missing viewer_id");
+        }
+        std::string fingerprint;
+        if (!session.addViewer(viewer_id, fingerprint)) {
+            return makeErrorResponse("Failed to add viewer");
+        }
+        SimpleJson data;
+        data.setString("viewer_id", viewer_id);
+        data.setString("dtls_fingerprint", fingerprint);
+        return makeOkResponse(data);
+    }
+
+    // ---- start_viewer ----
+    if (command == "start_viewer") {
+        std::string viewer_id = params.getString("viewer_id");
+        PeerInfo peer = parsePeer(params);
+        if (viewer_id.empty() || peer.ip.empty() || peer.port == 0) {
+            return makeErrorResponse("Missing viewer_id, peer IP or port");
+        }
+        if (!session.startViewer(viewer_id, peer)) {
+            return makeErrorResponse("Failed to start viewer");
+        }
+        return makeOkResponse();
+    }
+
+    // ---- remove_viewer ----
+    if (command == "remove_viewer") {
+        session.removeViewer(params.getString("viewer_id"));
+        return makeOkResponse();
+    }
+
     // ---- stop_session ----
     if (command == "stop_session") {
         session.stopSession();
         return makeOkResponse();
     }
 
+    // ---- set_warm_standby ----
+    if (command == "set_warm_standby") {
+        session.setWarmStandby(params.getString("enabled") != "false");
+        return makeOkResponse();
+    }
+
+    // ---- set_turn_pool ----
+    if (command == "set_turn_pool") {
+        session.setTurnPool(parseTurn(params));   // Empty turn_server stops it
+        return makeOkResponse();
+    }
+
     // ---- get_stats ----
     if (command == "get_stats") {
-        SessionStats st = session.getStats();
-        SimpleJson data;
-        data.setUint("bitrate_kbps",        st.bitrate_kbps);
-        data.setUint("fps",                 st.fps);
-        data.setUint("width",               st.width);
-        data.setUint("height",              st.height);
-        data.setString("codec",             st.codec);
-        data.setString("gaming_mode",       st.gaming_mode);
-        data.setFloat("packet_loss_percent", st.packet_loss_percent);
-        data.setFloat("jitter_ms",          st.jitter_ms);
-        data.setFloat("rtt_ms",             st.rtt_ms);
-        data.setFloat("capture_time_ms",    st.capture_time_ms);
-        data.setFloat("encode_time_ms",     st.encode_time_ms);
-        data.setUint("bytes_sent",          st.bytes_sent);
-        data.setUint("frames_sent",         st.frames_sent);
-        data.setFloat("fec_ratio",          st.fec_ratio);
-        data.setString("connection_type",   st.connection_type);
-        data.setString("streaming",         session.isStreaming() ? "true" : "false");
-        return makeOkResponseRaw(data.serialize());
+        return makeOkResponseRaw(formatStats(session));
     }
 
     // ---- force_idr ----
@@ -260,6 +461,24 @@ static std::string handlePipeCommand(const std::string& command,
         return makeOkResponseRaw(data.serialize());
     }
 
+    // ---- dump_trace ----
+    if (command == "dump_trace") {
+        const std::string path = params.getString("path");
+        if (path.empty()) {
+            return makeErrorResponse("Missing 'path' parameter");
+        }
+        size_t events = 0;
+        if (!cs::trace::writeChromeTrace(path, "nvremote-host", 1, &events)) {
+            return makeErrorResponse("Cannot write trace to " + path);
+        }
+        CS_LOG(INFO, "Wrote %zu trace events to %s", events, path.c_str());
+
+        SimpleJson data;
+        data.setString("path", path);
+        data.setUint("events", events);
+        return makeOkResponse(data);
+    }
+
     // ---- shutdown ----
     if (command == "shutdown") {
         CS_LOG(INFO, "Shutdown command received via IPC");
@@ -372,12 +591,12 @@ static int runEncodeTest(SessionManager& session) {
         total_encode_ms += enc_ms;
 
         // Write to file
-        outfile.write(reinterpret_cast<const char*>(packet.data.data()),
-                      static_cast<std::streamsize>(packet.data.size()));
+        outfile.write(reinterpret_cast<const char*>(packet.bytes()),
+                      static_cast<std::streamsize>(packet.size()));
         ++frames_encoded;
 
         CS_LOG(INFO, "Frame %d: %zu bytes  keyframe=%s  cap=%.2f ms  enc=%.2f ms",
-               i, packet.data.size(),
+               i, packet.size(),
                packet.is_keyframe ? "yes" : "no",
                cap_ms, enc_ms);
     }
@@ -404,8 +623,12 @@ int main(int argc, char* argv[]) {
     // ---- Parse command-line arguments ----
     std::string ipc_pipe_name;
     std::string config_path;
+    std::string log_path;
     bool capture_test = false;
     bool encode_test  = false;
+    std::string encode_bench_path;
+    cs::ImpairmentConfig impairment;
+    std::string record_path;
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -422,6 +645,10 @@ int main(int argc, char* argv[]) {
             config_path = argv[++i];
             continue;
         }
+        if (arg == "--log-file" && i + 1 < argc) {
+            log_path = argv[++i];
+            continue;
+        }
         if (arg == "--capture-test") {
             capture_test = true;
             continue;
@@ -430,6 +657,23 @@ int main(int argc, char* argv[]) {
             encode_test = true;
             continue;
         }
+        if (arg == "--encode-bench" && i + 1 < argc) {
+            encode_bench_path = argv[++i];
+            continue;
+        }
+        if (arg == "--impair" && i + 1 < argc) {
+            std::string error;
+            if (!cs::parseImpairmentSpec(argv[++i], impairment, &error)) {
+                std::fprintf(stderr, "Bad --impair spec: %s\n", error.c_str());
+                printUsage(argv[0]);
+                return 1;
+            }
+            continue;
+        }
+        if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+            continue;
+        }
 
         std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
         printUsage(argv[0]);
@@ -454,6 +698,9 @@ int main(int argc, char* argv[]) {
 
     // ---- Set up logging ----
     cs::globalLogLevel() = cs::LogLevel::INFO;
+    if (!log_path.empty() && !cs::setLogFile(log_path)) {
+        std::fprintf(stderr, "Cannot open log file %s\n", log_path.c_str());
+    }
     CS_LOG(INFO, "nvremote-host starting...");
 
     // ---- Install signal handlers ----
@@ -466,6 +713,14 @@ int main(int argc, char* argv[]) {
     // ---- Create SessionManager ----
     SessionManager session;
     g_session_manager = &session;
+    if (impairment.enabled()) {
+        CS_LOG(WARN, "Network impairment on egress: %s",
+               cs::describeImpairment(impairment).c_str());
+        session.setImpairment(impairment);
+    }
+    if (!record_path.empty()) {
+        session.setRecordPath(record_path);
+    }
 
     if (!session.initialize()) {
         CS_LOG(ERR, "Failed to initialize session manager");
@@ -497,6 +752,24 @@ int main(int argc, char* argv[]) {
         return ret;
     }
 
+    // ---- Encode bench mode ----
+    if (!encode_bench_path.empty()) {
+        int ret = 1;
+        if (auto* enc = session.getEncoder()) {
+            EncodeBenchOptions bench;
+            bench.out_path = encode_bench_path;
+            ret = runEncodeBench(*enc, bench);
+        } else {
+            CS_LOG(ERR, "Encoder not available");
+        }
+        session.stopSession();
+        g_session_manager = nullptr;
+#ifdef _WIN32
+        CoUninitialize();
+#endif
+        return ret;
+    }
+
     // ---- IPC pipe mode ----
     if (!ipc_pipe_name.empty()) {
         CS_LOG(INFO, "Starting IPC pipe server: %s", ipc_pipe_name.c_str());
@@ -506,6 +779,7 @@ int main(int argc, char* argv[]) {
                                     const SimpleJson& params) -> std::string {
             return handlePipeCommand(cmd, params, session);
         });
+        pipe.setStatsSource([&session] { return formatStats(session); });
 
         if (!pipe.start()) {
             CS_LOG(ERR, "Failed to start pipe server");
@@ -1,19 +1,20 @@
 ///////////////////////////////////////////////////////////////////////////////
 // bandwidth_estimator.cpp -- Bandwidth estimation implementation
 //
-// Estimates available bandwidth by tracking per-packet send/receive
-// timestamps.  A 1-second sliding window of completed timing pairs is
-// maintained.  Bandwidth = total_bytes_acked / window_duration.
+// Estimates available bandwidth from per-packet send timestamps (host
+// clock) and arrival timestamps reported by the client (client clock).  A
+// 1-second sliding window of acknowledged packets gives the receive rate:
+// bandwidth = bytes_acked / arrival_span.
 //
-// A Kalman-filtered delay gradient detects congestion by measuring the
-// trend in one-way delay over time.
+// Congestion is detected from delay: for consecutive 5 ms send groups, the
+// growth of the arrival spacing over the send spacing is the change in
+// one-way delay.  It is Kalman-filtered and handed to the overuse detector.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "bandwidth_estimator.h"
 #include <cs/common.h>
 
 #include <algorithm>
-#include <numeric>
 
 namespace cs::host {
 
@@ -25,20 +26,29 @@ BandwidthEstimator::BandwidthEstimator()
 // onPacketSent -- record that we sent a packet
 // ---------------------------------------------------------------------------
 
-void BandwidthEstimator::onPacketSent(uint16_t seq, size_t bytes, uint64_t send_time_us) {
+void BandwidthEstimator::onPacketSent(uint16_t transport_seq, size_t bytes,
+                                      uint64_t send_time_us) {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    SentPacketInfo info;
-    info.seq         = seq;
-    info.bytes       = bytes;
+    // A retransmission reuses the original sealed bytes (and so the same
+    // transport sequence number); the latest send time is the relevant one.
+    SentPacketInfo& info = pending_[transport_seq];
+    info.bytes        = bytes;
     info.send_time_us = send_time_us;
 
-    pending_[seq] = info;
+    if (send_time_us - last_prune_us_ > PRUNE_INTERVAL_US) {
+        prunePending(send_time_us);
+        last_prune_us_ = send_time_us;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// prunePending -- forget packets the client never reported
+// ---------------------------------------------------------------------------
 
-    // Prune stale entries (packets we never got ACKs for, > 5 seconds old).
-    auto now = cs::getTimestampUs();
+void BandwidthEstimator::prunePending(uint64_t now_us) {
     for (auto it = pending_.begin(); it != pending_.end(); ) {
-        if (now - it->second.send_time_us > 5'000'000) {
+        if (now_us - it->second.send_time_us > PENDING_TIMEOUT_US) {
             it = pending_.erase(it);
         } else {
             ++it;
@@ -47,69 +57,62 @@ void BandwidthEstimator::onPacketSent(uint16_t seq, size_t bytes, uint64_t send_
 }
 
 // ---------------------------------------------------------------------------
-// onAckReceived -- match with a sent packet and update estimates
+// onPacketArrival -- match with a sent packet and update estimates
 // ---------------------------------------------------------------------------
 
-void BandwidthEstimator::onAckReceived(uint16_t seq, uint64_t recv_time_us) {
+void BandwidthEstimator::onPacketArrival(uint16_t transport_seq, uint64_t arrival_us) {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    auto it = pending_.find(seq);
+    auto it = pending_.find(transport_seq);
     if (it == pending_.end()) {
-        // Already expired or duplicate ACK.
+        // Already expired or duplicate report.
         return;
     }
+    const SentPacketInfo sent = it->second;
+    pending_.erase(it);
 
-    const SentPacketInfo& sent = it->second;
-
-    // Compute RTT.
-    uint64_t rtt_us = recv_time_us - sent.send_time_us;
-    latest_rtt_us_ = rtt_us;
-
-    // Estimate one-way delay as RTT/2 (rough approximation without clock sync).
-    int64_t owd_us = static_cast<int64_t>(rtt_us / 2);
+    // --- One-way delay (arrival on our clock, modulo 2^32) ----------------
+    if (have_clock_offset_) {
+        const uint32_t arrival_local = static_cast<uint32_t>(arrival_us) - clock_offset_us_;
+        const int32_t  owd = static_cast<int32_t>(arrival_local -
+                                                  static_cast<uint32_t>(sent.send_time_us));
+        // Below zero only within the offset's error: call it no delay
+        one_way_delay_.record(static_cast<uint64_t>(std::max<int32_t>(owd, 0)));
+    }
 
-    // Compute delay gradient: change in OWD over time.
-    if (last_owd_time_us_ > 0) {
-        int64_t delta_owd_us  = owd_us - last_owd_us_;
-        uint64_t delta_time_us = recv_time_us - last_owd_time_us_;
-        if (delta_time_us > 0) {
-            // Gradient in ms per second.
-            double gradient = (static_cast<double>(delta_owd_us) / 1000.0) /
-                              (static_cast<double>(delta_time_us) / 1'000'000.0);
-            delay_filter_.update(gradient);
-        }
+    // --- Delay gradient over send groups ----------------------------------
+    if (current_group_.valid &&
+        sent.send_time_us - current_group_.first_send_us > GROUP_SPAN_US) {
+        completeGroup();
     }
-    last_owd_us_      = owd_us;
-    last_owd_time_us_ = recv_time_us;
+    if (!current_group_.valid) {
+        current_group_.first_send_us = sent.send_time_us;
+        current_group_.valid         = true;
+    }
+    current_group_.last_send_us = std::max(current_group_.last_send_us, sent.send_time_us);
+    current_group_.last_recv_us = std::max(current_group_.last_recv_us, arrival_us);
 
-    // Add to the timing window.
+    // --- Receive-rate window ----------------------------------------------
     TimingPair pair;
     pair.send_time_us = sent.send_time_us;
-    pair.recv_time_us = recv_time_us;
+    pair.recv_time_us = arrival_us;
     pair.bytes        = sent.bytes;
     window_.push_back(pair);
+    window_bytes_ += sent.bytes;
 
-    // Remove from pending.
-    pending_.erase(it);
-
-    // Trim the window to the last WINDOW_DURATION_US.
-    uint64_t cutoff = recv_time_us > WINDOW_DURATION_US
-                        ? recv_time_us - WINDOW_DURATION_US
+    uint64_t cutoff = arrival_us > WINDOW_DURATION_US
+                        ? arrival_us - WINDOW_DURATION_US
                         : 0;
     while (!window_.empty() && window_.front().recv_time_us < cutoff) {
+        window_bytes_ -= window_.front().bytes;
         window_.pop_front();
     }
 
-    // Update bandwidth estimate.
     if (window_.size() >= 2) {
         uint64_t time_span = window_.back().recv_time_us - window_.front().recv_time_us;
         if (time_span > 0) {
-            size_t total_bytes = 0;
-            for (const auto& p : window_) {
-                total_bytes += p.bytes;
-            }
             // bytes/us -> kbps: (bytes * 8 * 1e6) / (time_span * 1000)
-            double bw = (static_cast<double>(total_bytes) * 8.0 * 1'000'000.0) /
+            double bw = (static_cast<double>(window_bytes_) * 8.0 * 1'000'000.0) /
                         (static_cast<double>(time_span) * 1000.0);
             estimated_bw_kbps_ = static_cast<uint32_t>(bw);
         }
@@ -117,7 +120,29 @@ void BandwidthEstimator::onAckReceived(uint16_t seq, uint64_t recv_time_us) {
 }
 
 // ---------------------------------------------------------------------------
-// getEstimatedBandwidthKbps
+// completeGroup -- one-way delay change between two send groups
+// ---------------------------------------------------------------------------
+
+void BandwidthEstimator::completeGroup() {
+    if (previous_group_.valid) {
+        int64_t send_delta = static_cast<int64_t>(current_group_.last_send_us -
+                                                  previous_group_.last_send_us);
+        int64_t recv_delta = static_cast<int64_t>(current_group_.last_recv_us -
+                                                  previous_group_.last_recv_us);
+        if (send_delta > 0) {
+            double variation_ms = static_cast<double>(recv_delta - send_delta) / 1000.0;
+            double offset_ms    = delay_filter_.update(variation_ms);
+            num_deltas_++;
+            detector_.detect(offset_ms, static_cast<double>(send_delta) / 1000.0,
+                             num_deltas_, current_group_.last_recv_us);
+        }
+    }
+    previous_group_ = current_group_;
+    current_group_  = SendGroup{};
+}
+
+// ---------------------------------------------------------------------------
+// getEstimatedBandwidthKbps / hasEstimate
 // ---------------------------------------------------------------------------
 
 uint32_t BandwidthEstimator::getEstimatedBandwidthKbps() const {
@@ -125,13 +150,44 @@ uint32_t BandwidthEstimator::getEstimatedBandwidthKbps() const {
     return estimated_bw_kbps_;
 }
 
+bool BandwidthEstimator::hasEstimate() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return window_.size() >= MIN_ESTIMATE_PACKETS &&
+           window_.back().recv_time_us - window_.front().recv_time_us >= MIN_ESTIMATE_SPAN_US;
+}
+
 // ---------------------------------------------------------------------------
-// getDelayGradient -- smoothed delay gradient in ms/s
+// Delay-based signal accessors
 // ---------------------------------------------------------------------------
 
-double BandwidthEstimator::getDelayGradient() const {
+double BandwidthEstimator::getDelayTrendMs() const {
     std::lock_guard<std::mutex> lock(mutex_);
     return delay_filter_.getEstimate();
 }
 
+BandwidthUsage BandwidthEstimator::getBandwidthUsage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return detector_.getState();
+}
+
+double BandwidthEstimator::getOveruseThresholdMs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return detector_.getThresholdMs();
+}
+
+void BandwidthEstimator::setOveruseThresholdScale(double scale) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    detector_.setThresholdScale(scale);
+}
+
+// ---------------------------------------------------------------------------
+// setClockOffsetUs
+// ---------------------------------------------------------------------------
+
+void BandwidthEstimator::setClockOffsetUs(uint32_t offset_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    clock_offset_us_   = offset_us;
+    have_clock_offset_ = true;
+}
+
 } // namespace cs::host
@@ -1,13 +1,24 @@
 ///////////////////////////////////////////////////////////////////////////////
 // bandwidth_estimator.h -- Bandwidth estimation via send/receive timing
 //
-// Tracks packet send and receive timestamps to estimate the available
-// bandwidth.  Uses a sliding window over the last 1 second of data to
-// compute the rate, and detects congestion via delay gradient trends.
+// Tracks the send time of every sealed datagram by its transport-wide
+// sequence number and pairs it with the arrival time the client reports in
+// TransportFeedback messages.  The receive rate over a 1-second sliding
+// window is the acknowledged bitrate.  The change in one-way delay between
+// consecutive 5 ms send groups is Kalman-filtered and classified by an
+// OveruseDetector; that usage state is the delay-based congestion signal.
+//
+// Send and arrival times are on different clocks.  Only differences of
+// one-way delay are used, so the unknown clock offset cancels out.  Once
+// the session has estimated that offset (setClockOffsetUs()), each pair
+// also gives the absolute one-way delay, kept in a histogram.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include "kalman_filter.h"
+#include "overuse_detector.h"
+
+#include "cs/latency_histogram.h"
 
 #include <cstdint>
 #include <deque>
@@ -21,27 +32,46 @@ public:
     BandwidthEstimator();
     ~BandwidthEstimator() = default;
 
-    /// Record that a packet was sent.
-    void onPacketSent(uint16_t seq, size_t bytes, uint64_t send_time_us);
+    /// Record that a packet left the socket.  Thread-safe.
+    void onPacketSent(uint16_t transport_seq, size_t bytes, uint64_t send_time_us);
 
-    /// Record that an ACK was received for a packet.
-    void onAckReceived(uint16_t seq, uint64_t recv_time_us);
+    /// Record that the client received |transport_seq| at |arrival_us|
+    /// (client clock).  Call in transport sequence order.  Packets reported
+    /// missing stay pending, since a retransmission may still arrive.
+    void onPacketArrival(uint16_t transport_seq, uint64_t arrival_us);
 
     /// Get the estimated available bandwidth in kbps.
     uint32_t getEstimatedBandwidthKbps() const;
 
-    /// Get the smoothed one-way delay gradient (ms/s).
-    /// Positive = increasing delay (congestion).
-    double getDelayGradient() const;
+    /// True once enough packets have been acknowledged for
+    /// getEstimatedBandwidthKbps() to reflect the measured receive rate.
+    bool hasEstimate() const;
+
+    /// Get the Kalman-filtered inter-group delay variation (ms per group).
+    /// Positive = increasing delay (queues building).
+    double getDelayTrendMs() const;
+
+    /// Get the overuse detector's current state.
+    BandwidthUsage getBandwidthUsage() const;
 
-    /// Get the latest RTT measurement in microseconds.
-    uint64_t getLatestRttUs() const { return latest_rtt_us_; }
+    /// Get the overuse detector's adaptive threshold (ms).
+    double getOveruseThresholdMs() const;
+
+    /// Make the overuse detector more (scale > 1) or less tolerant.
+    void setOveruseThresholdScale(double scale);
+
+    /// The client's clock minus ours (modulo 2^32), from ClockSync: from
+    /// now on arrivals are also measured as one-way delays.  Thread-safe.
+    void setClockOffsetUs(uint32_t offset_us);
+
+    /// The |p|-th percentile (0..1) of one-way delay, send to arrival, in
+    /// milliseconds; 0 before the clock offset is known.
+    float getOneWayDelayMs(float p) const { return one_way_delay_.percentileMs(p); }
 
 private:
-    /// Information about a sent packet, kept until ACK.
+    /// Information about a sent packet, kept until it is reported.
     struct SentPacketInfo {
-        uint16_t seq         = 0;
-        size_t   bytes       = 0;
+        size_t   bytes        = 0;
         uint64_t send_time_us = 0;
     };
 
@@ -52,27 +82,55 @@ private:
         size_t   bytes        = 0;
     };
 
+    /// Packets sent within GROUP_SPAN_US of each other, compared as a unit
+    /// so pacing bursts do not register as delay jitter.
+    struct SendGroup {
+        uint64_t first_send_us = 0;
+        uint64_t last_send_us  = 0;
+        uint64_t last_recv_us  = 0;
+        bool     valid         = false;
+    };
+
+    /// Drop sent packets that were never reported (mutex_ held).
+    void prunePending(uint64_t now_us);
+
+    /// Fold a completed send group into the delay filter and the overuse
+    /// detector (mutex_ held).
+    void completeGroup();
+
     mutable std::mutex          mutex_;
 
-    // Sent packets awaiting ACK (keyed by sequence number).
+    // Sent packets awaiting feedback (keyed by transport sequence number).
     std::unordered_map<uint16_t, SentPacketInfo> pending_;
+    uint64_t                    last_prune_us_ = 0;
 
-    // Completed timing pairs in the sliding window.
+    // Completed timing pairs in the sliding window, and their byte total.
     std::deque<TimingPair>      window_;
+    size_t                      window_bytes_  = 0;
 
-    // Sliding window duration.
-    static constexpr uint64_t WINDOW_DURATION_US = 1'000'000;  // 1 second
+    // Delay-gradient grouping.
+    SendGroup                   current_group_;
+    SendGroup                   previous_group_;
 
-    // Kalman filter for delay gradient smoothing.
-    KalmanFilter                delay_filter_;
+    static constexpr uint64_t WINDOW_DURATION_US  = 1'000'000;  // 1 second
+    static constexpr uint64_t PENDING_TIMEOUT_US  = 2'000'000;  // Unreported after 2 s = gone
+    static constexpr uint64_t PRUNE_INTERVAL_US   = 250'000;
+    static constexpr uint64_t GROUP_SPAN_US       = 5'000;      // 5 ms send bursts
+    static constexpr uint64_t MIN_ESTIMATE_SPAN_US = 100'000;   // 100 ms of arrivals
+    static constexpr size_t   MIN_ESTIMATE_PACKETS = 20;
 
-    // Last one-way delay (for computing gradient).
-    int64_t                     last_owd_us_       = 0;
-    uint64_t                    last_owd_time_us_  = 0;
-    uint64_t                    latest_rtt_us_     = 0;
+    // Kalman filter over inter-group delay variation, and its classifier.
+    KalmanFilter                delay_filter_;
+    OveruseDetector             detector_;
+    uint32_t                    num_deltas_ = 0;
 
     // Cached bandwidth estimate.
-    mutable uint32_t            estimated_bw_kbps_ = 20000;
+    uint32_t                    estimated_bw_kbps_ = 20000;
+
+    // One-way delay, once the clocks are related.
+    bool                        have_clock_offset_ = false;
+    uint32_t                    clock_offset_us_   = 0;
+    cs::LatencyHistogram        one_way_delay_;
 };
 
 } // namespace cs::host
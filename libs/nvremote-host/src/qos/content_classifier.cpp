@@ -0,0 +1,187 @@
+///////////////////////////////////////////////////////////////////////////////
+// content_classifier.cpp -- What kind of picture the session is streaming
+//
+// A frame costs one pass over its change map: a byte per capture block, a
+// few thousand at 1080p.  Each changed block is also marked in the
+// window's own map, whose count is the share changed at all.  The measures
+// are only turned into a class once per window.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "content_classifier.h"
+
+#include "cs/common.h"
+
+#include <algorithm>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// observe() -- count one frame, classify the window when it is over
+// ---------------------------------------------------------------------------
+bool ContentClassifier::observe(const CapturedFrame& frame, uint64_t now_us) {
+    if (window_start_us_ == 0) window_start_us_ = now_us;
+
+    bool changed = false;
+    if (frame.is_new_frame) {
+        // As in the encoder's QP map: a map only says what changed since
+        // the backend's previous frame, so one after a gap is not counted.
+        const bool mapped = frame.change_map && frame.change_cols > 0 && frame.change_rows > 0 &&
+                            have_seq_ && frame.change_seq == last_seq_ + 1;
+        last_seq_ = frame.change_seq;
+        have_seq_ = frame.change_map != nullptr;
+
+        uint32_t blocks = 0;
+        if (!mapped) {
+            ++changed_frames_;
+            blocks = static_cast<uint32_t>(touched_.size());   // Could be anything
+        } else {
+            if (frame.change_cols != cols_ || frame.change_rows != rows_) {
+                cols_ = frame.change_cols;
+                rows_ = frame.change_rows;
+                touched_.assign(static_cast<size_t>(cols_) * rows_, 0);
+                touched_count_ = 0;
+            }
+            for (size_t i = 0; i < touched_.size(); ++i) {
+                if (!frame.change_map[i]) continue;
+                ++blocks;
+                if (!touched_[i]) {
+                    touched_[i] = 1;
+                    ++touched_count_;
+                }
+            }
+            if (blocks > 0) {
+                ++changed_frames_;
+                ++mapped_frames_;
+                changed_blocks_ += blocks;
+            }
+        }
+
+        // A pause ends with the first change big enough to matter, or
+        // the second within a window
+        if (class_.load() == ContentClass::STATIC && (!mapped || blocks > 0) &&
+            (blocks >= static_cast<uint32_t>(WAKE_AREA * touched_.size()) ||
+             changed_frames_ >= WAKE_FRAMES)) {
+            candidate_windows_ = 0;
+            transition(before_static_ != ContentClass::UNKNOWN ? before_static_
+                                                                : ContentClass::TEXT,
+                       "woken");
+            changed = true;
+        }
+    }
+
+    if (now_us - window_start_us_ < WINDOW_US) return changed;
+
+    // --- Classify the window ---
+    // Changes with no map to measure them by leave the class as it is
+    const bool measurable = mapped_frames_ > 0 || changed_frames_ == 0;
+    const float window_s   = static_cast<float>(now_us - window_start_us_) / 1e6f;
+    const float change_fps = static_cast<float>(changed_frames_) / window_s;
+    const float blocks     = static_cast<float>(touched_.size());
+    float coverage = 1.0f;
+    float concentration = 1.0f;
+    if (mapped_frames_ > 0 && blocks > 0.0f) {
+        coverage = static_cast<float>(changed_blocks_) / (mapped_frames_ * blocks);
+        const float area = static_cast<float>(touched_count_) / blocks;
+        concentration = area > 0.0f ? coverage / area : 0.0f;
+    } else {
+        coverage = 0.0f;   // Nothing changed
+    }
+    change_fps_.store(change_fps);
+    coverage_.store(coverage);
+    concentration_.store(concentration);
+
+    window_start_us_ = now_us;
+    changed_frames_  = 0;
+    changed_blocks_  = 0;
+    mapped_frames_   = 0;
+    std::fill(touched_.begin(), touched_.end(), 0);
+    touched_count_   = 0;
+
+    if (!measurable) return changed;
+
+    const ContentClass wanted = assess(change_fps, coverage, concentration);
+    const ContentClass current = class_.load();
+    if (wanted == current) {
+        candidate_windows_ = 0;
+        // Film keeps its cap only while it changes at film rate
+        if (current == ContentClass::VIDEO) {
+            fps_cap_.store(change_fps <= FILM_MAX_FPS ? FILM_FPS : 0);
+        }
+        return changed;
+    }
+    if (wanted != candidate_) {
+        candidate_         = wanted;
+        candidate_windows_ = 0;
+    }
+    if (++candidate_windows_ < HOLD_WINDOWS && current != ContentClass::UNKNOWN) return changed;
+
+    candidate_windows_ = 0;
+    transition(wanted, "window");
+    return true;
+}
+
+ContentClass ContentClassifier::assess(float change_fps, float coverage, float concentration) {
+    if (change_fps < STATIC_CHANGE_FPS) return ContentClass::STATIC;
+    if (coverage >= MOTION_AREA) {
+        return change_fps > FILM_MAX_FPS ? ContentClass::MOTION : ContentClass::VIDEO;
+    }
+    if (coverage >= VIDEO_MIN_AREA && concentration >= VIDEO_CONCENTRATION &&
+        change_fps >= VIDEO_MIN_FPS) {
+        return ContentClass::VIDEO;
+    }
+    return ContentClass::TEXT;
+}
+
+void ContentClassifier::transition(ContentClass next, const char* why) {
+    const ContentClass current = class_.load();
+    if (next == ContentClass::STATIC) before_static_ = current;
+
+    uint32_t cap = 0;
+    if (next == ContentClass::STATIC) {
+        cap = STATIC_FPS;
+    } else if (next == ContentClass::VIDEO && change_fps_.load() <= FILM_MAX_FPS) {
+        cap = FILM_FPS;
+    }
+    fps_cap_.store(cap);
+    class_.store(next);
+    transitions_.fetch_add(1);
+
+    CS_LOG(INFO, "Content: %s -> %s (%s; %.1f changing fps, %.0f%% coverage, "
+                 "%.0f%% concentration, fps cap %u)",
+           contentClassName(current), contentClassName(next), why, change_fps_.load(),
+           coverage_.load() * 100.0f, concentration_.load() * 100.0f, cap);
+}
+
+// ---------------------------------------------------------------------------
+// reset() / getStats()
+// ---------------------------------------------------------------------------
+void ContentClassifier::reset() {
+    window_start_us_   = 0;
+    changed_frames_    = 0;
+    changed_blocks_    = 0;
+    mapped_frames_     = 0;
+    std::fill(touched_.begin(), touched_.end(), 0);
+    touched_count_     = 0;
+    have_seq_          = false;
+    candidate_         = ContentClass::UNKNOWN;
+    candidate_windows_ = 0;
+    before_static_     = ContentClass::UNKNOWN;
+    class_.store(ContentClass::UNKNOWN);
+    fps_cap_.store(0);
+    transitions_.store(0);
+    change_fps_.store(0.0f);
+    coverage_.store(0.0f);
+    concentration_.store(0.0f);
+}
+
+ContentClassifier::Stats ContentClassifier::getStats() const {
+    Stats stats;
+    stats.cls           = class_.load();
+    stats.change_fps    = change_fps_.load();
+    stats.coverage      = coverage_.load();
+    stats.concentration = concentration_.load();
+    stats.transitions   = transitions_.load();
+    return stats;
+}
+
+} // namespace cs::host
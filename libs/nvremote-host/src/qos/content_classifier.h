@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////
+// content_classifier.h -- What kind of picture the session is streaming
+//
+// A gaming mode is picked once per session, but a session seldom shows one
+// kind of content: a game, then a browser, then a video playing in it.
+// The classifier watches the capture's change maps (CapturedFrame::
+// change_map, made by the capture backend on the GPU or by the desktop
+// compositor, so it costs nothing to have) and every WINDOW_US sorts the
+// window into a ContentClass from three measures:
+//
+//   change rate    frames that changed anything, per second
+//   coverage       mean share of the picture a changing frame changed
+//   concentration  coverage over the share changed at all in the window:
+//                  near 1 when the same region changes frame after frame
+//
+//   STATIC  next to nothing changes: under STATIC_CHANGE_FPS (a clock,
+//           a blinking cursor)
+//   MOTION  most of the picture changes, faster than film
+//   VIDEO   most of it at film rate, or one region at a steady rate
+//   TEXT    the rest: small, scattered, irregular updates -- typing,
+//           scrolling, a desktop
+//
+// Text itself is not looked for: telling glyphs from the blocks around
+// them needs the pixels, and reading them back would cost more than the
+// encoder saves.  Small scattered updates are what text editing and
+// browsing make.
+//
+// A class must win HOLD_WINDOWS windows in a row before the classifier
+// moves to it, so a menu opening in a game does not flip it.  The one
+// exception is STATIC: a frame changing WAKE_AREA of the picture, or
+// WAKE_FRAMES changing frames within a window, go back to the class
+// before it at once, so typing after a pause is not held at the static
+// frame rate for long.
+//
+// What a class changes is what can change without a keyframe: the
+// encoder's change-driven QP deltas (IEncoder::setContentClass()) and the
+// frame rate (fpsCap()).  4:4:4 chroma and the screen-content coding tools
+// are fixed per sequence, so they stay with the session's gaming mode.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "encode/encoder_interface.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// ContentClassifier
+// ---------------------------------------------------------------------------
+class ContentClassifier {
+public:
+    ContentClassifier() = default;
+    ~ContentClassifier() = default;
+
+    // Non-copyable
+    ContentClassifier(const ContentClassifier&) = delete;
+    ContentClassifier& operator=(const ContentClassifier&) = delete;
+
+    /// Count a new captured |frame|'s change map at |now_us|, classifying
+    /// the window when WINDOW_US has passed.  Returns true if the class
+    /// changed.  Called from one thread (capture).
+    bool observe(const CapturedFrame& frame, uint64_t now_us);
+
+    /// Start over at UNKNOWN (new session).  Same thread as observe().
+    void reset();
+
+    /// Current class.  Thread-safe.
+    ContentClass getClass() const { return class_.load(); }
+
+    /// Highest frame rate the class needs (0 = no cap).  Thread-safe.
+    uint32_t fpsCap() const { return fps_cap_.load(); }
+
+    struct Stats {
+        ContentClass cls          = ContentClass::UNKNOWN;
+        float        change_fps   = 0.0f;   // Last window
+        float        coverage     = 0.0f;   // 0 - 1
+        float        concentration = 0.0f;  // 0 - 1
+        uint32_t     transitions  = 0;      // Class changes this session
+    };
+
+    /// Latest window.  Thread-safe.
+    Stats getStats() const;
+
+private:
+    /// Class the window's measures call for.
+    static ContentClass assess(float change_fps, float coverage, float concentration);
+
+    /// Move to |next|, publishing it and its frame rate cap.
+    void transition(ContentClass next, const char* why);
+
+    // Window (observe() thread)
+    uint64_t             window_start_us_  = 0;
+    uint32_t             changed_frames_   = 0;   // Frames that changed any block
+    uint64_t             changed_blocks_   = 0;   // Summed over mapped frames
+    uint32_t             mapped_frames_    = 0;   // Changing frames with a usable map
+    std::vector<uint8_t> touched_;                // Blocks changed within the window
+    uint32_t             touched_count_    = 0;
+    uint32_t             cols_             = 0;
+    uint32_t             rows_             = 0;
+    uint32_t             last_seq_         = 0;
+    bool                 have_seq_         = false;
+    ContentClass         candidate_        = ContentClass::UNKNOWN;
+    uint32_t             candidate_windows_ = 0;
+    ContentClass         before_static_    = ContentClass::UNKNOWN;
+
+    // Published (any thread)
+    std::atomic<ContentClass> class_{ContentClass::UNKNOWN};
+    std::atomic<uint32_t>     fps_cap_{0};
+    std::atomic<uint32_t>     transitions_{0};
+    std::atomic<float>        change_fps_{0.0f};
+    std::atomic<float>        coverage_{0.0f};
+    std::atomic<float>        concentration_{0.0f};
+
+    static constexpr uint64_t WINDOW_US           = 250'000;
+    static constexpr uint32_t HOLD_WINDOWS        = 2;       // Windows a new class must win
+    static constexpr float    STATIC_CHANGE_FPS   = 2.0f;
+    static constexpr float    WAKE_AREA           = 0.02f;   // One frame's change that leaves STATIC
+    static constexpr uint32_t WAKE_FRAMES         = 2;       // Or changing frames in one window
+    static constexpr float    MOTION_AREA         = 0.5f;    // Mean coverage of a changing frame
+    static constexpr float    FILM_MAX_FPS        = 32.0f;   // Up to 30 fps film, with some jitter
+    static constexpr float    VIDEO_MIN_AREA      = 0.05f;
+    static constexpr float    VIDEO_MIN_FPS       = 20.0f;
+    static constexpr float    VIDEO_CONCENTRATION = 0.6f;
+    static constexpr uint32_t STATIC_FPS          = 15;      // Cap with nothing moving
+    static constexpr uint32_t FILM_FPS            = 30;      // Cap for film-rate video
+};
+
+} // namespace cs::host
@@ -0,0 +1,201 @@
+///////////////////////////////////////////////////////////////////////////////
+// loss_model.cpp -- Two-state burst loss model and FEC planner
+//
+// The loss-count distribution over n consecutive packets is computed with a
+// forward recursion over (chain state, losses so far), started from the
+// stationary distribution.  One pass up to MAX_BLOCK_PACKETS fills the
+// whole tail table, so plan() is only table lookups.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "loss_model.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cs::host {
+
+LossModel::LossModel() {
+    refresh();
+}
+
+// ---------------------------------------------------------------------------
+// onTransportFeedback -- count state transitions in the reported pattern
+// ---------------------------------------------------------------------------
+
+void LossModel::onTransportFeedback(const cs::TransportFeedback& feedback,
+                                    const std::vector<uint8_t>* skip) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // A lost or reordered report breaks the sequence; don't count a
+    // transition across the hole.
+    if (feedback.feedback_seq != next_fb_seq_ || feedback.base_seq != next_seq_) {
+        have_prev_ = false;
+    }
+    next_fb_seq_ = static_cast<uint8_t>(feedback.feedback_seq + 1);
+    next_seq_    = static_cast<uint16_t>(feedback.base_seq + feedback.packets.size());
+
+    for (size_t i = 0; i < feedback.packets.size(); ++i) {
+        if (skip && (*skip)[i]) continue;
+        const bool lost = !feedback.packets[i].received;
+        if (have_prev_) {
+            if (prev_lost_) {
+                bad_packets_ += 1.0;
+                if (!lost) bad_to_good_ += 1.0;
+            } else {
+                good_packets_ += 1.0;
+                if (lost) good_to_bad_ += 1.0;
+            }
+        }
+        prev_lost_ = lost;
+        have_prev_ = true;
+    }
+
+    if (good_packets_ + bad_packets_ > MODEL_WINDOW_PACKETS) {
+        good_packets_ *= 0.5;
+        good_to_bad_  *= 0.5;
+        bad_packets_  *= 0.5;
+        bad_to_good_  *= 0.5;
+    }
+
+    refresh();
+}
+
+// ---------------------------------------------------------------------------
+// refresh -- fit (p, r) and rebuild the tail table
+// ---------------------------------------------------------------------------
+
+void LossModel::refresh() {
+    // Half a transition of prior keeps an unseen event from being "impossible".
+    p_ = std::clamp((good_to_bad_ + 0.5) / (good_packets_ + 1.0), 1e-6, 1.0);
+    r_ = std::clamp((bad_to_good_ + 0.5) / (bad_packets_ + 0.5), 0.01, 1.0);
+
+    const double pi_bad = p_ / (p_ + r_);
+
+    // f_good[j] / f_bad[j]: P(last packet in that state, j losses so far).
+    std::array<double, MAX_BLOCK_PACKETS + 2> f_good{};
+    std::array<double, MAX_BLOCK_PACKETS + 2> f_bad{};
+    f_good[0] = 1.0 - pi_bad;
+    f_bad[1]  = pi_bad;
+
+    tail_[0].fill(0.0);
+    tail_[0][0] = 1.0;
+
+    for (size_t n = 1; n <= MAX_BLOCK_PACKETS; ++n) {
+        double acc = 0.0;
+        for (size_t j = n + 1; j-- > 0; ) {
+            acc += f_good[j] + f_bad[j];
+            tail_[n][j] = std::min(acc, 1.0);
+        }
+        for (size_t j = n + 1; j <= MAX_BLOCK_PACKETS; ++j) tail_[n][j] = 0.0;
+
+        if (n == MAX_BLOCK_PACKETS) break;
+
+        std::array<double, MAX_BLOCK_PACKETS + 2> g{};
+        std::array<double, MAX_BLOCK_PACKETS + 2> b{};
+        for (size_t j = 0; j <= n; ++j) {
+            g[j]     += f_good[j] * (1.0 - p_) + f_bad[j] * r_;
+            b[j + 1] += f_good[j] * p_         + f_bad[j] * (1.0 - r_);
+        }
+        f_good = g;
+        f_bad  = b;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// blockFailure -- P(more than m losses among n packets)
+// ---------------------------------------------------------------------------
+
+double LossModel::blockFailure(size_t n, size_t m) const {
+    n = std::min(n, MAX_BLOCK_PACKETS);
+    return m + 1 > n ? 0.0 : tail_[n][m + 1];
+}
+
+// ---------------------------------------------------------------------------
+// plan -- cheapest group layout that meets the frame loss target
+// ---------------------------------------------------------------------------
+
+FecPlan LossModel::plan(size_t data_count, size_t max_group, double target_loss,
+                        float min_ratio, float max_ratio) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    FecPlan best;
+    if (data_count == 0) return best;
+
+    max_group = std::clamp<size_t>(max_group, 1, MAX_BLOCK_PACKETS / 2);
+
+    bool   best_meets = false;
+    size_t best_cost  = 0;
+    size_t prev_groups = 0;
+
+    // Larger groups spread a burst over more parity; smaller groups cost
+    // more parity in total.  Try every distinct group count from the
+    // fewest groups up to groups a quarter of max_group.
+    const size_t min_group = std::min<size_t>(max_group, 4);
+    for (size_t g = max_group; g >= min_group; --g) {
+        const size_t groups = (data_count + g - 1) / g;
+        if (groups == prev_groups) continue;
+        prev_groups = groups;
+
+        const size_t k  = (data_count + groups - 1) / groups;   // Largest group
+        size_t m_lo = static_cast<size_t>(std::ceil(k * std::max(min_ratio, 0.0f)));
+        size_t m_hi = static_cast<size_t>(std::ceil(k * std::max(max_ratio, 0.0f)));
+        m_hi = std::min({std::max(m_hi, m_lo), k, MAX_BLOCK_PACKETS - k});
+        m_lo = std::min(m_lo, m_hi);
+
+        FecPlan cand;
+        cand.group_size = k;
+        bool meets = false;
+        for (size_t m = m_lo; m <= m_hi; ++m) {
+            cand.parity_count = m;
+            cand.frame_loss   = 1.0 - std::pow(1.0 - blockFailure(k + m, m),
+                                               static_cast<double>(groups));
+            if (cand.frame_loss <= target_loss) {
+                meets = true;
+                break;
+            }
+        }
+
+        const size_t cost = groups * cand.parity_count;
+        bool better;
+        if (best.group_size == 0)       better = true;
+        else if (meets != best_meets)   better = meets;
+        else if (meets)                 better = cost < best_cost;
+        else                            better = cand.frame_loss < best.frame_loss;
+
+        if (better) {
+            best       = cand;
+            best_meets = meets;
+            best_cost  = cost;
+        }
+        if (g == 1) break;
+    }
+    return best;
+}
+
+// ---------------------------------------------------------------------------
+// Accessors
+// ---------------------------------------------------------------------------
+
+bool LossModel::hasModel() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return good_packets_ + bad_packets_ >= MIN_MODEL_PACKETS;
+}
+
+double LossModel::getLossRate() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return p_ / (p_ + r_);
+}
+
+double LossModel::getMeanBurstLength() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return 1.0 / r_;
+}
+
+void LossModel::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    good_packets_ = good_to_bad_ = bad_packets_ = bad_to_good_ = 0.0;
+    have_prev_ = false;
+    refresh();
+}
+
+} // namespace cs::host
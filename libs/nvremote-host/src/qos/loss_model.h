@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+// loss_model.h -- Two-state burst loss model and FEC planner
+//
+// Packet loss on Wi-Fi and cellular links comes in bursts, which an average
+// loss rate cannot describe: 2% loss spread evenly and 2% lost in 10-packet
+// fades need very different protection.  LossModel fits a Gilbert model --
+// the Gilbert-Elliott chain with no loss in the GOOD state and certain loss
+// in the BAD state -- to the per-packet received / lost pattern carried by
+// transport-wide feedback:
+//
+//   p = P(GOOD -> BAD)  = good-to-lost transitions / packets received
+//   r = P(BAD -> GOOD)  = lost-to-good transitions / packets lost
+//   mean loss = p / (p + r),  mean burst length = 1 / r
+//
+// From (p, r) it tabulates P(more than m losses among n packets), which is
+// exactly the probability that a k + m = n Reed-Solomon group cannot be
+// repaired.  plan() then picks the FEC group size and parity count that
+// keep a frame's unrecoverable probability under a target at the least
+// parity overhead.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "cs/qos/transport_feedback.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// FecPlan -- FEC layout for one frame (or one batch of a frame)
+// ---------------------------------------------------------------------------
+struct FecPlan {
+    size_t group_size   = 0;     // Largest data group; groups are balanced
+    size_t parity_count = 0;     // Parity packets per group (0 = NACK only)
+    double frame_loss   = 0.0;   // Predicted P(frame not repairable by FEC)
+};
+
+class LossModel {
+public:
+    /// Longest group (data + parity) the loss tables cover.
+    static constexpr size_t MAX_BLOCK_PACKETS = 64;
+
+    LossModel();
+    ~LossModel() = default;
+
+    /// Fold the received / lost pattern of one transport-wide feedback
+    /// message into the model and refresh the loss tables.  Packets whose
+    /// entry in |skip| is nonzero (the secondary path's) are left out.
+    /// Thread-safe.
+    void onTransportFeedback(const cs::TransportFeedback& feedback,
+                             const std::vector<uint8_t>* skip = nullptr);
+
+    /// True once enough packets have been observed for plan() to be used.
+    bool hasModel() const;
+
+    /// Stationary loss rate p / (p + r).
+    double getLossRate() const;
+
+    /// Mean length of a loss burst in packets (1 / r).
+    double getMeanBurstLength() const;
+
+    /// Choose a layout for |data_count| data packets with groups of at most
+    /// |max_group| packets, such that the frame is unrecoverable with
+    /// probability <= |target_loss|.  Parity per group is kept within
+    /// [ceil(g * min_ratio), ceil(g * max_ratio)]; if the target cannot be
+    /// met within that range, the layout with the lowest loss is returned.
+    /// Thread-safe.
+    FecPlan plan(size_t data_count, size_t max_group, double target_loss,
+                 float min_ratio, float max_ratio) const;
+
+    /// Forget everything observed so far.
+    void reset();
+
+private:
+    /// Recompute p, r and tail_ from the transition counts (mutex_ held).
+    void refresh();
+
+    /// P(more than |m| losses among |n| packets) (mutex_ held).
+    double blockFailure(size_t n, size_t m) const;
+
+    mutable std::mutex mutex_;
+
+    // Transition counts, halved whenever they exceed MODEL_WINDOW_PACKETS
+    // so the model follows changing conditions.
+    double   good_packets_   = 0.0;
+    double   good_to_bad_    = 0.0;
+    double   bad_packets_    = 0.0;
+    double   bad_to_good_    = 0.0;
+
+    // Continuity across feedback messages.
+    bool     have_prev_      = false;
+    bool     prev_lost_      = false;
+    uint16_t next_seq_       = 0;
+    uint8_t  next_fb_seq_    = 0;
+
+    // Fitted parameters.
+    double   p_              = 0.0;
+    double   r_              = 1.0;
+
+    // tail_[n][j] = P(at least j losses among n packets), n, j <= MAX_BLOCK_PACKETS.
+    std::array<std::array<double, MAX_BLOCK_PACKETS + 1>, MAX_BLOCK_PACKETS + 1> tail_{};
+
+    static constexpr double MODEL_WINDOW_PACKETS = 20000.0;   // ~2-10 s of traffic
+    static constexpr double MIN_MODEL_PACKETS    = 500.0;
+};
+
+} // namespace cs::host
@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////////
+// overuse_detector.cpp -- Delay-based overuse detection implementation
+///////////////////////////////////////////////////////////////////////////////
+
+#include "overuse_detector.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// detect -- classify one filtered delay variation
+// ---------------------------------------------------------------------------
+
+BandwidthUsage OveruseDetector::detect(double offset_ms, double send_delta_ms,
+                                       uint32_t num_deltas, uint64_t now_us) {
+    if (num_deltas < 2) {
+        return BandwidthUsage::NORMAL;
+    }
+
+    const double trend     = offset_ms * std::min(num_deltas, MAX_TREND_DELTAS);
+    const double threshold = threshold_ms_ * threshold_scale_;
+
+    if (trend > threshold) {
+        if (time_over_using_ms_ < 0.0) {
+            // Assume the overuse started halfway between the two groups.
+            time_over_using_ms_ = send_delta_ms / 2.0;
+        } else {
+            time_over_using_ms_ += send_delta_ms;
+        }
+        overuse_count_++;
+        if (time_over_using_ms_ > OVERUSE_TIME_MS && overuse_count_ > 1 &&
+            offset_ms >= prev_offset_ms_) {
+            time_over_using_ms_ = 0.0;
+            overuse_count_      = 0;
+            state_              = BandwidthUsage::OVERUSE;
+        }
+    } else if (trend < -threshold) {
+        time_over_using_ms_ = -1.0;
+        overuse_count_      = 0;
+        state_              = BandwidthUsage::UNDERUSE;
+    } else {
+        time_over_using_ms_ = -1.0;
+        overuse_count_      = 0;
+        state_              = BandwidthUsage::NORMAL;
+    }
+
+    prev_offset_ms_ = offset_ms;
+    updateThreshold(trend, now_us);
+    return state_;
+}
+
+// ---------------------------------------------------------------------------
+// updateThreshold -- g(i) = g(i-1) + dt * k * (|T| - g(i-1))
+// ---------------------------------------------------------------------------
+
+void OveruseDetector::updateThreshold(double trend, uint64_t now_us) {
+    if (last_update_us_ == 0) {
+        last_update_us_ = now_us;
+    }
+
+    const double abs_trend = std::fabs(trend);
+    if (abs_trend > threshold_ms_ + MAX_ADAPT_OFFSET_MS) {
+        // A spike (e.g. a WiFi retransmission burst) -- don't let it move
+        // the threshold.
+        last_update_us_ = now_us;
+        return;
+    }
+
+    const double k = abs_trend < threshold_ms_ ? K_DOWN : K_UP;
+    const uint64_t dt_us = std::min(now_us - last_update_us_, MAX_TIME_DELTA_US);
+    threshold_ms_ += k * (abs_trend - threshold_ms_) * static_cast<double>(dt_us) / 1000.0;
+    threshold_ms_  = std::clamp(threshold_ms_, MIN_THRESHOLD_MS, MAX_THRESHOLD_MS);
+    last_update_us_ = now_us;
+}
+
+// ---------------------------------------------------------------------------
+// reset
+// ---------------------------------------------------------------------------
+
+void OveruseDetector::reset() {
+    state_              = BandwidthUsage::NORMAL;
+    threshold_ms_       = INITIAL_THRESHOLD_MS;
+    prev_offset_ms_     = 0.0;
+    time_over_using_ms_ = -1.0;
+    overuse_count_      = 0;
+    last_update_us_     = 0;
+}
+
+} // namespace cs::host
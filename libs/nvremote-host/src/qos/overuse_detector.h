@@ -0,0 +1,82 @@
+///////////////////////////////////////////////////////////////////////////////
+// overuse_detector.h -- Delay-based overuse detection with adaptive threshold
+//
+// Classifies the Kalman-filtered inter-group delay variation m(i) (how much
+// longer a send group took to arrive than to send, in ms) as overuse,
+// underuse or normal, following Google Congestion Control:
+//
+//   - The trend T = m(i) * min(groups, 60) is compared to a threshold g(i).
+//   - OVERUSE needs T > g(i) for at least 10 ms, without m(i) shrinking.
+//   - UNDERUSE is signalled as soon as T < -g(i).
+//   - g(i) adapts towards |T|: quickly upwards (k_u) so that a concurrent
+//     TCP flow does not starve us, slowly downwards (k_d).  It is clamped
+//     to [6, 600] ms and not adapted on outliers.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstdint>
+
+namespace cs::host {
+
+/// Network state as seen by the delay-based detector.
+enum class BandwidthUsage {
+    NORMAL,
+    UNDERUSE,   // Queues are draining
+    OVERUSE,    // Queues are building
+};
+
+inline const char* bandwidthUsageName(BandwidthUsage u) {
+    switch (u) {
+        case BandwidthUsage::NORMAL:   return "NORMAL";
+        case BandwidthUsage::UNDERUSE: return "UNDERUSE";
+        case BandwidthUsage::OVERUSE:  return "OVERUSE";
+    }
+    return "UNKNOWN";
+}
+
+class OveruseDetector {
+public:
+    OveruseDetector() = default;
+
+    /// Classify one filtered delay variation |offset_ms|.  |send_delta_ms|
+    /// is the send-time spacing of the group pair, |num_deltas| the number
+    /// of group pairs seen so far and |now_us| the current time.
+    BandwidthUsage detect(double offset_ms, double send_delta_ms,
+                          uint32_t num_deltas, uint64_t now_us);
+
+    /// Current state (last detect() result).
+    BandwidthUsage getState() const { return state_; }
+
+    /// Current adaptive threshold in ms.
+    double getThresholdMs() const { return threshold_ms_; }
+
+    /// Scale the threshold used for classification (>1 = more tolerant of
+    /// delay jitter, e.g. over a VPN).  Adaptation is unaffected.
+    void setThresholdScale(double scale) { threshold_scale_ = scale; }
+
+    /// Reset to the initial state.
+    void reset();
+
+private:
+    void updateThreshold(double trend, uint64_t now_us);
+
+    BandwidthUsage state_            = BandwidthUsage::NORMAL;
+    double         threshold_ms_     = INITIAL_THRESHOLD_MS;
+    double         threshold_scale_  = 1.0;
+    double         prev_offset_ms_   = 0.0;
+    double         time_over_using_ms_ = -1.0;
+    uint32_t       overuse_count_    = 0;
+    uint64_t       last_update_us_   = 0;
+
+    static constexpr double   INITIAL_THRESHOLD_MS = 12.5;
+    static constexpr double   MIN_THRESHOLD_MS     = 6.0;
+    static constexpr double   MAX_THRESHOLD_MS     = 600.0;
+    static constexpr double   K_UP                 = 0.01;
+    static constexpr double   K_DOWN               = 0.00018;
+    static constexpr double   MAX_ADAPT_OFFSET_MS  = 15.0;   // Outliers don't move g(i)
+    static constexpr double   OVERUSE_TIME_MS      = 10.0;
+    static constexpr uint32_t MAX_TREND_DELTAS     = 60;
+    static constexpr uint64_t MAX_TIME_DELTA_US    = 100'000;
+};
+
+} // namespace cs::host
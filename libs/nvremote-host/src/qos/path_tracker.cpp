@@ -0,0 +1,140 @@
+///////////////////////////////////////////////////////////////////////////////
+// path_tracker.cpp -- Secondary path loss and delay implementation
+///////////////////////////////////////////////////////////////////////////////
+
+#include "path_tracker.h"
+#include <cs/common.h>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// find / claim
+// ---------------------------------------------------------------------------
+
+PathTracker::Record* PathTracker::find(uint16_t seq) {
+    Record& rec = ring_[seq % RING_SIZE];
+    return rec.used && rec.seq == seq ? &rec : nullptr;
+}
+
+PathTracker::Record& PathTracker::claim(uint16_t seq, uint64_t now_us) {
+    Record& rec = ring_[seq % RING_SIZE];
+    if (!rec.used || rec.seq != seq || now_us - rec.created_us > RECORD_MAX_AGE_US) {
+        rec = Record();
+        rec.seq        = seq;
+        rec.used       = true;
+        rec.created_us = now_us;
+    }
+    return rec;
+}
+
+// ---------------------------------------------------------------------------
+// onPrimarySent / onSecondarySent
+// ---------------------------------------------------------------------------
+
+void PathTracker::onPrimarySent(uint16_t transport_seq, uint64_t send_time_us) {
+    if (!active_.load(std::memory_order_relaxed)) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // A paced primary leaves after its copy, whose send already made the
+    // record; a retransmission keeps the first send time.
+    Record& rec = claim(transport_seq, send_time_us);
+    if (rec.send_us == 0) rec.send_us = send_time_us;
+}
+
+void PathTracker::onSecondarySent(uint16_t transport_seq, int32_t twin_seq,
+                                  uint64_t send_time_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    active_.store(true, std::memory_order_relaxed);
+    ++sent_;
+
+    Record& rec = claim(transport_seq, send_time_us);
+    rec.secondary = true;
+    rec.send_us   = send_time_us;
+    if (twin_seq >= 0) {
+        const auto twin = static_cast<uint16_t>(twin_seq);
+        rec.partner = twin;
+        claim(twin, send_time_us).partner = transport_seq;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// onTransportFeedback -- split a report between the paths
+// ---------------------------------------------------------------------------
+
+size_t PathTracker::onTransportFeedback(const cs::TransportFeedback& feedback,
+                                        std::vector<uint8_t>& secondary) {
+    if (!active_.load(std::memory_order_relaxed)) return 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_t found = 0;
+    for (size_t i = 0; i < feedback.packets.size(); ++i) {
+        const cs::PacketArrival& pa = feedback.packets[i];
+        Record* rec = find(pa.seq);
+        if (!rec) continue;
+
+        if (rec->secondary) {
+            if (found == 0) secondary.assign(feedback.packets.size(), 0);
+            secondary[i] = 1;
+            ++found;
+        }
+        if (rec->reported) continue;   // First report wins
+        rec->reported   = true;
+        rec->received   = pa.received;
+        rec->arrival_us = pa.arrival_us;
+
+        if (rec->secondary) {
+            ++reported_;
+            (pa.received ? received_count_ : lost_count_) += 1.0;
+            if (received_count_ + lost_count_ > LOSS_WINDOW) {
+                received_count_ *= 0.5;
+                lost_count_     *= 0.5;
+            }
+        }
+
+        // The copy reported second completes the pair
+        if (rec->partner < 0) continue;
+        const Record* other = find(static_cast<uint16_t>(rec->partner));
+        if (!other || !other->reported || other->secondary == rec->secondary) continue;
+        if (rec->secondary) {
+            completePair(*other, *rec);
+        } else {
+            completePair(*rec, *other);
+        }
+    }
+    return found;
+}
+
+void PathTracker::completePair(const Record& primary, const Record& secondary) {
+    if (secondary.received && !primary.received) ++rescued_;
+    if (!secondary.received || !primary.received || primary.send_us == 0) return;
+
+    // (arrival - send) on each path: the clock offsets cancel in the difference
+    const double delta_us =
+        (static_cast<double>(secondary.arrival_us) - static_cast<double>(primary.arrival_us)) -
+        (static_cast<double>(secondary.send_us) - static_cast<double>(primary.send_us));
+    if (!has_delay_) {
+        delay_offset_us_ = delta_us;
+        has_delay_       = true;
+    } else {
+        delay_offset_us_ += DELAY_GAIN * (delta_us - delay_offset_us_);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// getStats
+// ---------------------------------------------------------------------------
+
+PathStats PathTracker::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PathStats stats;
+    stats.sent     = sent_;
+    stats.reported = reported_;
+    stats.rescued  = rescued_;
+    const double total = received_count_ + lost_count_;
+    stats.loss_rate       = total > 0.0 ? static_cast<float>(lost_count_ / total) : 0.0f;
+    stats.delay_offset_ms = static_cast<float>(delay_offset_us_ / 1000.0);
+    stats.has_delay       = has_delay_;
+    return stats;
+}
+
+} // namespace cs::host
@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+// path_tracker.h -- Loss and delay of the viewer's secondary path
+//
+// With a multipath policy (MultipathPolicy in transport/udp_transport.h)
+// some packets also go, or go instead, over the viewer's standby path.
+// Each copy is sealed with its own counter, so the transport-wide feedback
+// reports the two paths' packets side by side in one sequence space.
+// PathTracker remembers which sequence numbers went on the secondary path,
+// and which primary packet each copy duplicates, so that:
+//
+//   - the bandwidth estimator and loss model see the primary path alone
+//     (onTransportFeedback() marks the secondary's packets to skip);
+//   - the secondary's own loss rate is counted;
+//   - a pair whose copies both arrived gives the secondary's one-way delay
+//     relative to the primary: the two arrivals are on the same viewer
+//     clock, so its offset cancels;
+//   - a pair where only the secondary copy arrived is a packet the second
+//     path rescued.
+//
+// Nothing is recorded until the first secondary send.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "cs/qos/transport_feedback.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// PathStats -- the secondary path as the feedback shows it
+// ---------------------------------------------------------------------------
+struct PathStats {
+    uint64_t sent           = 0;      // Packets sent on the secondary path
+    uint64_t reported       = 0;      // Of those, reported received or lost
+    uint64_t rescued        = 0;      // Copies that arrived when the primary's did not
+    float    loss_rate      = 0.0f;   // Recent secondary loss, 0.0 to 1.0
+    float    delay_offset_ms = 0.0f;  // Secondary minus primary one-way delay (smoothed)
+    bool     has_delay      = false;  // delay_offset_ms has samples
+};
+
+class PathTracker {
+public:
+    PathTracker() = default;
+    ~PathTracker() = default;
+
+    // Non-copyable
+    PathTracker(const PathTracker&) = delete;
+    PathTracker& operator=(const PathTracker&) = delete;
+
+    /// Record that |transport_seq| left on the primary path.  Does nothing
+    /// before the first onSecondarySent().  Thread-safe.
+    void onPrimarySent(uint16_t transport_seq, uint64_t send_time_us);
+
+    /// Record that |transport_seq| left on the secondary path, duplicating
+    /// primary packet |twin_seq| (-1 = sent there alone).  Thread-safe.
+    void onSecondarySent(uint16_t transport_seq, int32_t twin_seq, uint64_t send_time_us);
+
+    /// Fold in one feedback message.  If any of its packets went on the
+    /// secondary path, sets |secondary|[i] to 1 for those (0 for the rest)
+    /// and returns how many; otherwise returns 0 and leaves |secondary| alone.
+    size_t onTransportFeedback(const cs::TransportFeedback& feedback,
+                               std::vector<uint8_t>& secondary);
+
+    /// True once anything has been sent on the secondary path.
+    bool isActive() const { return active_.load(std::memory_order_relaxed); }
+
+    /// Current secondary path statistics.
+    PathStats getStats() const;
+
+private:
+    /// One transport sequence number, primary or secondary.
+    struct Record {
+        uint16_t seq        = 0;
+        bool     used       = false;
+        bool     secondary  = false;
+        bool     reported   = false;
+        bool     received   = false;
+        int32_t  partner    = -1;     // The other copy's seq (-1 = none)
+        uint64_t created_us = 0;
+        uint64_t send_us    = 0;      // 0 = not sent yet (a paced primary)
+        uint64_t arrival_us = 0;
+    };
+
+    /// The live record for |seq|, or nullptr (mutex_ held).
+    Record* find(uint16_t seq);
+
+    /// The record slot for |seq|, reset unless it already holds a live
+    /// record for it (mutex_ held).
+    Record& claim(uint16_t seq, uint64_t now_us);
+
+    /// Both copies of a pair are reported (mutex_ held).
+    void completePair(const Record& primary, const Record& secondary);
+
+    static constexpr size_t   RING_SIZE      = 4096;         // Last sends kept
+    static constexpr uint64_t RECORD_MAX_AGE_US = 2'000'000; // Older = a wrapped seq
+    static constexpr double   LOSS_WINDOW    = 2000.0;       // Packets in the loss counts
+    static constexpr double   DELAY_GAIN     = 1.0 / 16.0;
+
+    mutable std::mutex            mutex_;
+    std::array<Record, RING_SIZE> ring_{};
+    std::atomic<bool>             active_{false};
+
+    uint64_t sent_     = 0;
+    uint64_t reported_ = 0;
+    uint64_t rescued_  = 0;
+    double   received_count_ = 0.0;    // Decayed, for loss_rate
+    double   lost_count_     = 0.0;
+    double   delay_offset_us_ = 0.0;
+    bool     has_delay_       = false;
+};
+
+} // namespace cs::host
@@ -0,0 +1,309 @@
+///////////////////////////////////////////////////////////////////////////////
+// probe_controller.cpp -- Bandwidth probing implementation
+///////////////////////////////////////////////////////////////////////////////
+
+#include "probe_controller.h"
+#include <cs/common.h>
+
+#include <algorithm>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// startInitial / onDrop / onRecovered -- what to probe for
+// ---------------------------------------------------------------------------
+
+void ProbeController::startInitial(uint32_t start_kbps, uint32_t max_kbps) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_kbps_ = max_kbps;
+    planned_kbps_.clear();
+    plan(start_kbps * INITIAL_FACTOR_1);
+    plan(start_kbps * INITIAL_FACTOR_2);
+}
+
+void ProbeController::onDrop(uint32_t rate_before_kbps) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The path is congested: what is still planned would only add to it
+    planned_kbps_.clear();
+    if (drop_from_kbps_ == 0) drop_from_kbps_ = rate_before_kbps;
+}
+
+void ProbeController::onRecovered(uint32_t current_kbps, uint32_t max_kbps) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (drop_from_kbps_ == 0) return;
+    const uint32_t target = std::min(drop_from_kbps_, max_kbps);
+    drop_from_kbps_ = 0;
+
+    if (static_cast<double>(target) < static_cast<double>(current_kbps) * RECOVERY_MARGIN) return;
+    if (in_flight_.load(std::memory_order_relaxed) || !planned_kbps_.empty()) return;
+    max_kbps_ = max_kbps;
+    plan(target);
+    CS_LOG(DEBUG, "Probe: congestion over at %u kbps, probing %u kbps", current_kbps, target);
+}
+
+void ProbeController::plan(uint32_t rate_kbps) {
+    rate_kbps = std::min(rate_kbps, max_kbps_);
+    if (rate_kbps == 0) return;
+    if (!planned_kbps_.empty() && planned_kbps_.back() >= rate_kbps) return;
+    planned_kbps_.push_back(rate_kbps);
+}
+
+bool ProbeController::isProbing() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_flight_.load(std::memory_order_relaxed) || !planned_kbps_.empty();
+}
+
+// ---------------------------------------------------------------------------
+// nextCluster / onClusterSent
+// ---------------------------------------------------------------------------
+
+bool ProbeController::nextCluster(uint64_t now_us, uint32_t media_kbps, ProbeCluster& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (in_flight_.load(std::memory_order_relaxed)) {
+        if (now_us - cluster_start_us_ < CLUSTER_TIMEOUT_US) return false;
+        // Whatever was reported is all there will be
+        finishCluster(measure());
+    }
+    if (planned_kbps_.empty()) return false;
+
+    cluster_id_       = next_id_++;
+    cluster_kbps_     = planned_kbps_.front();
+    cluster_start_us_ = now_us;
+    cluster_sent_     = false;
+    padding_count_    = 0;
+    padding_sent_     = 0;
+    reported_         = 0;
+    packets_.clear();
+    planned_kbps_.pop_front();
+    in_flight_.store(true, std::memory_order_relaxed);
+
+    // The padding tops the media up to the probed rate
+    const double target  = static_cast<double>(cluster_kbps_);
+    const double padding = std::max(target - static_cast<double>(media_kbps),
+                                    target * MIN_PADDING_SHARE);
+    out.id           = cluster_id_;
+    out.target_kbps  = cluster_kbps_;
+    out.padding_kbps = static_cast<uint32_t>(padding);
+    // kbps x us / 8000 = bytes
+    out.bytes        = std::max(static_cast<size_t>(padding * CLUSTER_DURATION_US / 8000.0),
+                                MIN_CLUSTER_PACKETS * PROBE_PACKET_BYTES);
+    return true;
+}
+
+void ProbeController::onClusterSent(uint32_t id, const std::vector<uint16_t>& seqs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!in_flight_.load(std::memory_order_relaxed) || id != cluster_id_) return;
+
+    // The pacer may have sent some already: those were kept as early sends
+    std::vector<Packet> early;
+    early.swap(packets_);
+    packets_.reserve(seqs.size() + early.size());
+    for (uint16_t seq : seqs) {
+        Packet p;
+        p.seq     = seq;
+        p.padding = true;
+        packets_.push_back(p);
+    }
+    padding_count_ = packets_.size();
+    cluster_sent_  = true;
+    if (packets_.empty()) {
+        finishCluster(0);   // Nothing went out
+        return;
+    }
+    stats_.clusters_sent++;
+
+    uint64_t first_us = UINT64_MAX, last_us = 0;
+    for (const Packet& e : early) {
+        Packet* p = findPadding(e.seq);
+        if (!p) continue;
+        p->bytes   = e.bytes;
+        p->send_us = e.send_us;
+        ++padding_sent_;
+        first_us = std::min(first_us, e.send_us);
+        last_us  = std::max(last_us, e.send_us);
+    }
+    // Media sent among the padding so far
+    for (const Packet& e : early) {
+        if (findPadding(e.seq) || e.send_us < first_us) continue;
+        if (padding_sent_ == padding_count_ && e.send_us > last_us) continue;
+        packets_.push_back(e);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// onPacketSent -- send times of the cluster in flight
+// ---------------------------------------------------------------------------
+
+void ProbeController::onPacketSent(uint16_t transport_seq, size_t bytes, uint64_t send_time_us) {
+    if (!in_flight_.load(std::memory_order_relaxed)) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!in_flight_.load(std::memory_order_relaxed)) return;
+    if (packets_.size() >= MAX_CLUSTER_PACKETS) return;
+
+    Packet sent;
+    sent.seq     = transport_seq;
+    sent.bytes   = bytes;
+    sent.send_us = send_time_us;
+    if (!cluster_sent_) {
+        // Sent before onClusterSent() named the padding: sorted out there
+        packets_.push_back(sent);
+        return;
+    }
+
+    if (Packet* p = findPadding(transport_seq)) {
+        if (p->send_us == 0) {
+            p->bytes   = bytes;
+            p->send_us = send_time_us;
+            ++padding_sent_;
+        }
+        return;
+    }
+    // Media between the first and the last padding packet
+    if (padding_sent_ > 0 && padding_sent_ < padding_count_) packets_.push_back(sent);
+}
+
+ProbeController::Packet* ProbeController::findPadding(uint16_t seq) {
+    if (padding_count_ == 0) return nullptr;
+    // The padding was sealed back to back: its seqs are almost always
+    // consecutive
+    const uint16_t offset = static_cast<uint16_t>(seq - packets_.front().seq);
+    if (offset < padding_count_ && packets_[offset].seq == seq) return &packets_[offset];
+    for (size_t i = 0; i < padding_count_; ++i) {
+        if (packets_[i].seq == seq) return &packets_[i];
+    }
+    return nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// onTransportFeedback -- pick out the probes, measure a finished cluster
+// ---------------------------------------------------------------------------
+
+size_t ProbeController::onTransportFeedback(const cs::TransportFeedback& feedback,
+                                            std::vector<uint8_t>& probes,
+                                            uint32_t* result_kbps) {
+    if (!in_flight_.load(std::memory_order_relaxed)) return 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!cluster_sent_ || packets_.empty()) return 0;
+
+    size_t found = 0;
+    for (size_t i = 0; i < feedback.packets.size(); ++i) {
+        const cs::PacketArrival& pa = feedback.packets[i];
+        Packet* p = findPadding(pa.seq);
+        if (p) {
+            if (found == 0) probes.assign(feedback.packets.size(), 0);
+            probes[i] = 1;
+            ++found;
+        } else {
+            for (size_t j = padding_count_; j < packets_.size(); ++j) {
+                if (packets_[j].seq == pa.seq) {
+                    p = &packets_[j];
+                    break;
+                }
+            }
+        }
+        if (!p || p->reported) continue;
+        p->reported   = true;
+        p->received   = pa.received;
+        p->arrival_us = pa.arrival_us;
+        ++reported_;
+    }
+
+    if (padding_sent_ == padding_count_ && reported_ == packets_.size()) {
+        const uint32_t result = measure();
+        finishCluster(result);
+        if (result_kbps) *result_kbps = result;
+    }
+    return found;
+}
+
+// ---------------------------------------------------------------------------
+// measure -- min(send rate, receive rate) of the cluster in flight
+// ---------------------------------------------------------------------------
+
+uint32_t ProbeController::measure() const {
+    size_t   received     = 0;
+    size_t   sent_bytes   = 0;
+    size_t   last_sent    = 0;    // Bytes of the last packet sent
+    size_t   recv_bytes   = 0;
+    size_t   first_recv   = 0;    // Bytes of the first packet received
+    uint64_t first_send   = UINT64_MAX, last_send = 0;
+    uint64_t first_arrival = UINT64_MAX, last_arrival = 0;
+
+    for (const Packet& p : packets_) {
+        if (p.send_us == 0 || !p.received) continue;
+        ++received;
+        sent_bytes += p.bytes;
+        recv_bytes += p.bytes;
+        first_send = std::min(first_send, p.send_us);
+        if (p.send_us >= last_send) {
+            last_send = p.send_us;
+            last_sent = p.bytes;
+        }
+        if (p.arrival_us < first_arrival) {
+            first_arrival = p.arrival_us;
+            first_recv    = p.bytes;
+        }
+        last_arrival = std::max(last_arrival, p.arrival_us);
+    }
+
+    if (received < MIN_CLUSTER_PACKETS ||
+        static_cast<double>(reported_) < MIN_REPORTED_RATIO * static_cast<double>(packets_.size())) {
+        return 0;
+    }
+    const uint64_t send_span = last_send - first_send;
+    if (send_span < MIN_SEND_SPAN_US) return 0;
+
+    // B/us x 8000 = kbps
+    const double send_kbps = static_cast<double>(sent_bytes - last_sent) * 8000.0 /
+                             static_cast<double>(send_span);
+    double kbps = send_kbps;
+    const uint64_t recv_span = last_arrival - first_arrival;
+    if (recv_span > 0) {
+        const double recv_kbps = static_cast<double>(recv_bytes - first_recv) * 8000.0 /
+                                 static_cast<double>(recv_span);
+        kbps = std::min(kbps, recv_kbps);
+    }
+    return static_cast<uint32_t>(kbps);
+}
+
+// ---------------------------------------------------------------------------
+// finishCluster -- plan what follows a result (mutex_ held)
+// ---------------------------------------------------------------------------
+
+void ProbeController::finishCluster(uint32_t result_kbps) {
+    in_flight_.store(false, std::memory_order_relaxed);
+    packets_.clear();
+
+    if (result_kbps == 0) {
+        stats_.clusters_failed++;
+        planned_kbps_.clear();
+        CS_LOG(DEBUG, "Probe: cluster %u at %u kbps could not be measured",
+               cluster_id_, cluster_kbps_);
+        return;
+    }
+    stats_.last_result_kbps = result_kbps;
+    CS_LOG(DEBUG, "Probe: cluster %u at %u kbps delivered %u kbps",
+           cluster_id_, cluster_kbps_, result_kbps);
+
+    if (static_cast<double>(result_kbps) <
+        PROBE_SUCCESS_RATIO * static_cast<double>(cluster_kbps_)) {
+        // The path did not keep up: that is its capacity
+        planned_kbps_.clear();
+        return;
+    }
+    if (planned_kbps_.empty() && cluster_kbps_ < max_kbps_) {
+        plan(static_cast<uint32_t>(static_cast<double>(result_kbps) * FURTHER_PROBE_FACTOR));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// getStats
+// ---------------------------------------------------------------------------
+
+ProbeStats ProbeController::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace cs::host
@@ -0,0 +1,178 @@
+///////////////////////////////////////////////////////////////////////////////
+// probe_controller.h -- Bandwidth probing for a fast ramp-up
+//
+// The delay-based controller grows its target ~8% a second, so a session
+// that starts at the preset's target on a link with many times that would
+// take tens of seconds to use it.  Probing finds the capacity directly:
+// short clusters of padding packets (PacketType::PADDING) are paced out on
+// top of the media, topping the two up to the rate being probed, and the
+// transport-wide feedback shows the rate the path delivered them at.  The
+// controller then jumps straight to that rate.
+//
+// The media sent while a cluster goes out shares the bottleneck with it,
+// so, as in WebRTC (which tags such packets with the cluster), they count
+// towards the cluster: the measurement covers every datagram sent between
+// the cluster's first and last padding packet.
+//
+// Clusters are planned:
+//   - at session start: at 3x and 6x the starting rate;
+//   - after a cluster the path kept up with (its delivered rate within
+//     PROBE_SUCCESS_RATIO of the probed one): at twice the delivered rate,
+//     until the ceiling;
+//   - after a congestion episode has been over for a while: at the rate
+//     before the first cut, which finds out at once whether the capacity
+//     has come back.
+// A cluster lasts CLUSTER_DURATION_US at its rate, and at least
+// MIN_CLUSTER_PACKETS packets.  Only one is in flight at a time; one with
+// no result after CLUSTER_TIMEOUT_US is given up on.
+//
+// As in WebRTC's probe estimator, the send rate leaves out the last
+// packet's bytes and the receive rate the first's (each is the edge of
+// its interval), and the result is the lower of the two: a path that
+// queued the cluster delivered it slower than it was sent.
+//
+// onPacketSent() comes from the sending thread and does nothing while no
+// cluster is in flight; the rest runs on the feedback thread.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "cs/qos/transport_feedback.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// ProbeCluster -- one burst of padding to send
+// ---------------------------------------------------------------------------
+struct ProbeCluster {
+    uint32_t id           = 0;
+    uint32_t target_kbps  = 0;   // Rate probed: padding and media together
+    uint32_t padding_kbps = 0;   // Pace the padding at this rate
+    size_t   bytes        = 0;   // Padding to send, in wire bytes
+};
+
+// ---------------------------------------------------------------------------
+// ProbeStats -- probing so far
+// ---------------------------------------------------------------------------
+struct ProbeStats {
+    uint32_t clusters_sent   = 0;
+    uint32_t clusters_failed  = 0;   // Timed out, or too few packets reported
+    uint32_t last_result_kbps = 0;   // Delivered rate of the last cluster (0 = none)
+};
+
+class ProbeController {
+public:
+    ProbeController() = default;
+    ~ProbeController() = default;
+
+    // Non-copyable
+    ProbeController(const ProbeController&) = delete;
+    ProbeController& operator=(const ProbeController&) = delete;
+
+    /// Plan the session-start clusters from |start_kbps|, probing no
+    /// higher than |max_kbps|.
+    void startInitial(uint32_t start_kbps, uint32_t max_kbps);
+
+    /// The target was cut from |rate_before_kbps|.  The first cut of an
+    /// episode sets the rate onRecovered() probes at.
+    void onDrop(uint32_t rate_before_kbps);
+
+    /// The congestion episode is over and the target is |current_kbps|:
+    /// probe at the rate before it, if that is well above the current one.
+    void onRecovered(uint32_t current_kbps, uint32_t max_kbps);
+
+    /// The next cluster to send, if one is planned and none is in flight,
+    /// with |media_kbps| of media going out alongside it.  The caller sends
+    /// it and then calls onClusterSent() with the packets that went out
+    /// (none if it could not send it).
+    bool nextCluster(uint64_t now_us, uint32_t media_kbps, ProbeCluster& out);
+
+    /// Cluster |id| went out as the padding packets |seqs| (transport-wide
+    /// sequence numbers).
+    void onClusterSent(uint32_t id, const std::vector<uint16_t>& seqs);
+
+    /// A datagram left; recorded if it is one of the cluster in flight's
+    /// padding packets or was sent among them.  Thread-safe.
+    void onPacketSent(uint16_t transport_seq, size_t bytes, uint64_t send_time_us);
+
+    /// Fold in one feedback message.  If any of its packets were probes,
+    /// sets |probes|[i] to 1 for those (0 for the rest) and returns how
+    /// many; otherwise returns 0 and leaves |probes| alone.  When the
+    /// message completes a cluster, |*result_kbps| is set to its delivered
+    /// rate (0 if the cluster could not be measured).
+    size_t onTransportFeedback(const cs::TransportFeedback& feedback,
+                               std::vector<uint8_t>& probes, uint32_t* result_kbps);
+
+    /// True while a cluster is in flight or planned.
+    bool isProbing() const;
+
+    /// Probing statistics.
+    ProbeStats getStats() const;
+
+private:
+    /// One datagram of the cluster in flight.
+    struct Packet {
+        uint16_t seq        = 0;
+        bool     padding    = false;   // Else media sent during the cluster
+        size_t   bytes      = 0;
+        uint64_t send_us    = 0;   // 0 = not sent yet
+        bool     reported   = false;
+        bool     received   = false;
+        uint64_t arrival_us = 0;
+    };
+
+    /// Queue a cluster at |rate_kbps| (mutex_ held).
+    void plan(uint32_t rate_kbps);
+
+    /// The cluster's padding packet |seq|, or nullptr (mutex_ held).
+    Packet* findPadding(uint16_t seq);
+
+    /// Delivered rate of the cluster in flight, or 0 (mutex_ held).
+    uint32_t measure() const;
+
+    /// The cluster in flight is done: plan what follows |result_kbps|
+    /// (mutex_ held).
+    void finishCluster(uint32_t result_kbps);
+
+    static constexpr uint64_t CLUSTER_DURATION_US  = 15'000;
+    static constexpr size_t   MIN_CLUSTER_PACKETS  = 5;
+    static constexpr size_t   PROBE_PACKET_BYTES   = 1200;     // Assumed, for MIN_CLUSTER_PACKETS
+    static constexpr double   MIN_PADDING_SHARE    = 0.25;     // Of the probed rate
+    static constexpr size_t   MAX_CLUSTER_PACKETS  = 8192;     // Padding and media recorded
+    static constexpr uint64_t CLUSTER_TIMEOUT_US   = 1'000'000;
+    static constexpr uint64_t MIN_SEND_SPAN_US     = 1'000;    // Shorter is timer noise
+    static constexpr double   MIN_REPORTED_RATIO   = 0.8;      // Of the cluster's packets
+    static constexpr double   PROBE_SUCCESS_RATIO  = 0.8;      // Delivered / probed
+    static constexpr double   FURTHER_PROBE_FACTOR = 2.0;
+    static constexpr double   RECOVERY_MARGIN      = 1.5;      // Before / current worth a probe
+    static constexpr uint32_t INITIAL_FACTOR_1     = 3;
+    static constexpr uint32_t INITIAL_FACTOR_2     = 6;
+
+    mutable std::mutex   mutex_;
+    std::atomic<bool>    in_flight_{false};   // onPacketSent() fast path
+
+    std::deque<uint32_t> planned_kbps_;
+    uint32_t             max_kbps_        = 0;
+    uint32_t             next_id_         = 1;
+    uint32_t             drop_from_kbps_  = 0;   // Rate before the episode's first cut
+
+    // The cluster in flight
+    uint32_t             cluster_id_      = 0;
+    uint32_t             cluster_kbps_    = 0;
+    uint64_t             cluster_start_us_ = 0;
+    bool                 cluster_sent_    = false;   // onClusterSent() seen
+    std::vector<Packet>  packets_;          // Padding first, then media
+    size_t               padding_count_   = 0;
+    size_t               padding_sent_    = 0;
+    size_t               reported_        = 0;
+
+    ProbeStats           stats_;
+};
+
+} // namespace cs::host
@@ -5,11 +5,15 @@
 // and FEC redundancy to maximize streaming quality while avoiding congestion.
 //
 // The controller integrates:
-//   - AIMD bitrate control (additive increase, multiplicative decrease)
+//   - Delay-based rate control (GCC): overuse detection on the filtered
+//     inter-group delay variation drives a multiplicative increase /
+//     decrease-to-acked-rate state machine
+//   - Loss-based rate control; the target is min(delay-based, loss-based)
 //   - Profile-aware resolution/FPS ladder walking
+//   - Temporal layer shedding on delay overuse
+//   - Bandwidth probing at session start and after congestion
 //   - Decode bottleneck detection (client-side)
 //   - VPN-aware tolerance adjustments
-//   - Kalman-filtered delay gradient for congestion detection
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "qos_controller.h"
@@ -24,7 +28,6 @@ QosController::QosController(IEncoder* encoder, UdpTransport* transport, FecEnco
     : encoder_(encoder)
     , transport_(transport)
     , fec_(fec)
-    , delay_filter_(1e-3, 0.1)
 {
 }
 
@@ -38,6 +41,9 @@ void QosController::setBaseConfig(const EncoderConfig& config) {
     current_fps_          = config.fps;
     current_width_        = config.width;
     current_height_       = config.height;
+    max_temporal_layer_   = static_cast<uint8_t>(
+        config.temporal_layers > 1 ? config.temporal_layers - 1 : 0);
+    resetRateTargets();
 }
 
 // ---------------------------------------------------------------------------
@@ -67,10 +73,23 @@ void QosController::applyPreset(const cs::QosPreset& preset) {
         current_bitrate_kbps_ = static_cast<uint32_t>(
             current_bitrate_kbps_ * VPN_BITRATE_MULTIPLIER);
     }
+    resetRateTargets();
 
     CS_LOG(INFO, "QoS: preset applied: %s (target: %ux%u @ %ufps, %ukbps)",
            cs::gamingModeToString(preset.mode).c_str(),
            current_width_, current_height_, current_fps_, current_bitrate_kbps_);
+
+    setPacingProfile(preset.pacing_factor, preset.pacing_burst_ms);
+}
+
+// ---------------------------------------------------------------------------
+// setPacingProfile -- pacing factor / burst allowance from the preset
+// ---------------------------------------------------------------------------
+
+void QosController::setPacingProfile(float factor, uint32_t burst_ms) {
+    pacing_factor_   = std::max(0.0f, factor);
+    pacing_burst_ms_ = burst_ms;
+    updatePacing();
 }
 
 // ---------------------------------------------------------------------------
@@ -79,46 +98,49 @@ void QosController::applyPreset(const cs::QosPreset& preset) {
 
 void QosController::setVpnMode(bool enabled) {
     vpn_mode_ = enabled;
+    // VPN tunnels add delay jitter; demand a clearer trend before backing off.
+    bw_estimator_.setOveruseThresholdScale(enabled ? VPN_JITTER_MULTIPLIER : 1.0);
     if (enabled) {
         // Reduce initial bitrate for VPN overhead
         current_bitrate_kbps_ = static_cast<uint32_t>(
             current_bitrate_kbps_ * VPN_BITRATE_MULTIPLIER);
+        resetRateTargets();
         CS_LOG(INFO, "QoS: VPN mode enabled — reduced bitrate to %u kbps", current_bitrate_kbps_);
     }
 }
 
 // ---------------------------------------------------------------------------
-// onFeedbackReceived -- main QoS decision point
+// onFeedbackReceived -- loss-based controller and encoder update
 // ---------------------------------------------------------------------------
 
 void QosController::onFeedbackReceived(const QosFeedbackPacket& feedback) {
     feedback_count_++;
 
     // --- Compute loss rate --------------------------------------------------
-    uint32_t total = feedback.received_packets + feedback.lost_packets;
-    float loss_rate = (total > 0) ? static_cast<float>(feedback.lost_packets) / total : 0.0f;
+    // Prefer the exact per-packet counts from transport-wide feedback.
+    uint32_t received = feedback.received_packets;
+    uint32_t lost     = feedback.lost_packets;
+    if (twcc_received_ + twcc_lost_ > 0) {
+        received = twcc_received_;
+        lost     = twcc_lost_;
+        twcc_received_ = 0;
+        twcc_lost_     = 0;
+    }
+    uint32_t total = received + lost;
+    float loss_rate = (total > 0) ? static_cast<float>(lost) / total : 0.0f;
 
     // Exponential moving average of loss rate (alpha = 0.3).
     smoothed_loss_ = 0.3f * loss_rate + 0.7f * smoothed_loss_;
 
-    // EMA of RTT, jitter, and decode time.
+    // RTT per RFC 6298; EMA of jitter and decode time.
     if (feedback.rtt_us > 0) {
-        smoothed_rtt_ = static_cast<uint32_t>(0.3 * feedback.rtt_us + 0.7 * smoothed_rtt_);
+        updateRtt(feedback.rtt_us);
     }
     smoothed_jitter_ = static_cast<uint32_t>(0.3 * feedback.jitter_us + 0.7 * smoothed_jitter_);
     if (feedback.decode_time_us > 0) {
         smoothed_decode_ = static_cast<uint32_t>(0.3 * feedback.decode_time_us + 0.7 * smoothed_decode_);
     }
 
-    // Apply VPN jitter tolerance
-    double effective_overuse_thresh = vpn_mode_
-        ? GRADIENT_OVERUSE * VPN_JITTER_MULTIPLIER
-        : GRADIENT_OVERUSE;
-
-    // --- Feed the delay gradient filter ------------------------------------
-    double gradient = bw_estimator_.getDelayGradient();
-    double filtered_gradient = delay_filter_.update(gradient);
-
     // --- Decode bottleneck detection ---------------------------------------
     // If client decode time exceeds threshold, reduce resolution (not bitrate)
     // because the client's decoder is the bottleneck, not the network.
@@ -131,95 +153,199 @@ void QosController::onFeedbackReceived(const QosFeedbackPacket& feedback) {
         tryReduceResolution();
     }
 
-    // --- State machine decisions -------------------------------------------
-    //
-    // Priority of signals:
-    //   1. High loss -> DECREASE (regardless of gradient)
-    //   2. Positive delay gradient (overuse) -> DECREASE
-    //   3. Low loss + negative gradient (underuse) -> INCREASE
-    //   4. Otherwise -> HOLD
-
-    if (smoothed_loss_ >= LOSS_THRESH_HIGH) {
-        // Significant loss -- back off aggressively.
-        if (state_ != QosState::DECREASE) {
-            CS_LOG(INFO, "QoS: entering DECREASE — loss=%.1f%%", smoothed_loss_ * 100.0f);
-        }
-        enterDecrease();
-
-        // If loss is extremely high, force an IDR so the client can resync.
-        if (smoothed_loss_ >= LOSS_THRESH_IDR && encoder_) {
-            CS_LOG(WARN, "QoS: loss=%.1f%% — forcing IDR frame", smoothed_loss_ * 100.0f);
-            encoder_->forceIdr();
-        }
-
-    } else if (filtered_gradient > effective_overuse_thresh) {
-        // Delay is increasing -- network is congested.
-        if (state_ != QosState::DECREASE) {
-            CS_LOG(INFO, "QoS: entering DECREASE — gradient=%.2f ms/s", filtered_gradient);
-        }
-        enterDecrease();
+    // --- Loss-based controller ---------------------------------------------
+    //   loss >  5%: A_s *= (1 - 0.5 * loss)
+    //   loss <  2%: A_s *= 1.05
+    //   otherwise:  hold
+    uint32_t min_bw = has_preset_ ? preset_.min_bitrate_kbps : config_.min_bitrate_kbps;
+    uint32_t max_bw = has_preset_ ? preset_.max_bitrate_kbps : config_.max_bitrate_kbps;
 
-    } else if (smoothed_loss_ <= LOSS_THRESH_LOW && filtered_gradient < GRADIENT_UNDERUSE) {
-        // Network is underutilized and loss is very low.
-        if (state_ != QosState::INCREASE) {
-            CS_LOG(INFO, "QoS: entering INCREASE — loss=%.1f%%, gradient=%.2f",
-                   smoothed_loss_ * 100.0f, filtered_gradient);
-        }
-        enterIncrease();
+    if (loss_rate > LOSS_THRESH_HIGH) {
+        probes_.onDrop(current_bitrate_kbps_);
+        last_cut_us_ = cs::getTimestampUs();
+        loss_based_kbps_ = static_cast<uint32_t>(loss_based_kbps_ * (1.0f - 0.5f * loss_rate));
+        CS_LOG(INFO, "QoS: loss=%.1f%% — loss-based target %u kbps",
+               loss_rate * 100.0f, loss_based_kbps_);
+    } else if (loss_rate < LOSS_THRESH_LOW) {
+        loss_based_kbps_ = static_cast<uint32_t>(loss_based_kbps_ * INCREASE_FACTOR);
+    }
+    loss_based_kbps_ = std::clamp(loss_based_kbps_, min_bw, std::max(min_bw, max_bw));
 
-    } else {
-        // Everything is stable.
-        if (state_ != QosState::HOLD) {
-            CS_LOG(INFO, "QoS: entering HOLD — loss=%.1f%%, gradient=%.2f",
-                   smoothed_loss_ * 100.0f, filtered_gradient);
-        }
-        enterHold();
+    // If loss is extremely high, force an IDR so the client can resync.
+    if (smoothed_loss_ >= LOSS_THRESH_IDR && encoder_) {
+        CS_LOG(WARN, "QoS: loss=%.1f%% — forcing IDR frame", smoothed_loss_ * 100.0f);
+        encoder_->forceIdr();
     }
 
     // --- Adjust FEC based on loss rate -------------------------------------
     adjustFec(smoothed_loss_);
 
-    // --- Apply bitrate/fps to encoder --------------------------------------
-    if (encoder_) {
-        EncoderConfig newCfg = config_;
-        newCfg.bitrate_kbps = current_bitrate_kbps_;
-        newCfg.fps          = current_fps_;
-        newCfg.width        = current_width_;
-        newCfg.height       = current_height_;
-        encoder_->reconfigure(newCfg);
-    }
+    // --- Push the combined target into the encoder and pacer ---------------
+    applyTarget(loss_rate > LOSS_THRESH_HIGH || state_ == QosState::DECREASE);
 
-    CS_LOG(TRACE, "QoS: state=%s bitrate=%u kbps fps=%u res=%ux%u loss=%.2f%% "
-                  "rtt=%u us gradient=%.2f decode=%uus",
-           qosStateName(state_), current_bitrate_kbps_, current_fps_,
+    CS_LOG(TRACE, "QoS: state=%s usage=%s bitrate=%u kbps (delay=%u loss=%u acked=%u) "
+                  "fps=%u res=%ux%u loss=%.2f%% rtt=%u us trend=%.2f ms decode=%uus",
+           qosStateName(state_), bandwidthUsageName(bw_estimator_.getBandwidthUsage()),
+           current_bitrate_kbps_, delay_based_kbps_, loss_based_kbps_,
+           bw_estimator_.getEstimatedBandwidthKbps(), current_fps_,
            current_width_, current_height_,
-           smoothed_loss_ * 100.0f, smoothed_rtt_, filtered_gradient,
+           smoothed_loss_ * 100.0f, srtt_us_, bw_estimator_.getDelayTrendMs(),
            smoothed_decode_);
 }
 
 // ---------------------------------------------------------------------------
-// enterIncrease -- additive increase: +5% bitrate, then recover FPS/res
+// onTransportFeedback -- per-packet arrivals drive the delay-based controller
 // ---------------------------------------------------------------------------
 
-void QosController::enterIncrease() {
-    state_ = QosState::INCREASE;
+void QosController::onTransportFeedback(const cs::TransportFeedback& feedback) {
+    uint32_t probe_result = 0;
+    const bool probes =
+        probes_.onTransportFeedback(feedback, probe_mask_, &probe_result) > 0;
+    const std::vector<uint8_t>* secondary =
+        path_tracker_.onTransportFeedback(feedback, path_mask_) > 0 ? &path_mask_ : nullptr;
+    for (size_t i = 0; i < feedback.packets.size(); ++i) {
+        if (secondary && (*secondary)[i]) continue;
+        const cs::PacketArrival& pkt = feedback.packets[i];
+        if (pkt.received) bw_estimator_.onPacketArrival(pkt.seq, pkt.arrival_us);
+        // A probe above capacity is meant to overflow: not path loss
+        if (probes && probe_mask_[i]) continue;
+        if (pkt.received) twcc_received_++;
+        else              twcc_lost_++;
+    }
+
+    // The loss model skips the probes and the secondary path alike
+    const std::vector<uint8_t>* skip = secondary;
+    if (probes && secondary) {
+        for (size_t i = 0; i < path_mask_.size(); ++i) path_mask_[i] |= probe_mask_[i];
+    } else if (probes) {
+        skip = &probe_mask_;
+    }
+    loss_model_.onTransportFeedback(feedback, skip);
+
+    // --- Delay-based rate control state machine ----------------------------
+    //
+    //               OVERUSE     NORMAL      UNDERUSE
+    //   HOLD        DECREASE    INCREASE    HOLD
+    //   INCREASE    DECREASE    INCREASE    HOLD
+    //   DECREASE    DECREASE    HOLD        HOLD
+    BandwidthUsage usage = bw_estimator_.getBandwidthUsage();
+
+    uint64_t now_us = cs::getTimestampUs();
+    QosState prev = state_;
+    switch (usage) {
+        case BandwidthUsage::OVERUSE:
+            enterDecrease(now_us);
+            break;
+        case BandwidthUsage::NORMAL:
+            if (state_ == QosState::DECREASE) enterHold();
+            else                              enterIncrease(now_us);
+            break;
+        case BandwidthUsage::UNDERUSE:
+            enterHold();
+            break;
+    }
+    last_delay_update_us_ = now_us;
+
+    if (state_ != prev) {
+        CS_LOG(INFO, "QoS: entering %s — usage=%s trend=%.2f ms threshold=%.1f ms "
+                     "acked=%u kbps",
+               qosStateName(state_), bandwidthUsageName(usage),
+               bw_estimator_.getDelayTrendMs(), bw_estimator_.getOveruseThresholdMs(),
+               bw_estimator_.getEstimatedBandwidthKbps());
+    }
+
+    // Back off immediately rather than at the next QoS feedback: the point
+    // of the delay signal is to react before the queue overflows.
+    if (state_ == QosState::DECREASE && prev != QosState::DECREASE) {
+        applyTarget(true);
+    }
+
+    // A cluster that overran into a delay overuse does not undo the cut
+    if (probe_result > 0 && state_ != QosState::DECREASE) onProbeResult(probe_result);
+    runProbes(now_us);
+}
+
+// ---------------------------------------------------------------------------
+// runProbes -- plan and send bandwidth probe clusters
+// ---------------------------------------------------------------------------
+
+void QosController::runProbes(uint64_t now_us) {
+    if (!probing_enabled_) return;
 
-    // Additive increase of bitrate.
     uint32_t max_bw = has_preset_ ? preset_.max_bitrate_kbps : config_.max_bitrate_kbps;
-    uint32_t new_bitrate = static_cast<uint32_t>(current_bitrate_kbps_ * INCREASE_FACTOR);
-    new_bitrate = std::min(new_bitrate, max_bw);
-    current_bitrate_kbps_ = new_bitrate;
+    if (!probing_started_) {
+        probing_started_ = true;
+        probes_.startInitial(current_bitrate_kbps_, max_bw);
+    } else if (last_cut_us_ > 0 && state_ != QosState::DECREASE &&
+               now_us - last_cut_us_ >= RECOVERY_PROBE_DELAY_US) {
+        probes_.onRecovered(current_bitrate_kbps_, max_bw);
+    }
 
-    // If bitrate has recovered past 60% of target, try recovering FPS
-    uint32_t target_bw = has_preset_ ? preset_.target_bitrate_kbps : config_.bitrate_kbps;
-    if (current_bitrate_kbps_ > static_cast<uint32_t>(target_bw * 0.6f)) {
-        tryRecoverFps();
+    // Never add to a queue that is building
+    if (state_ == QosState::DECREASE) return;
+
+    ProbeCluster cluster;
+    if (!probes_.nextCluster(now_us, current_bitrate_kbps_, cluster)) return;
+
+    bool sent = false;
+    if (probe_sender_) {
+        sent = probe_sender_(cluster.padding_kbps, cluster.bytes, probe_seqs_);
+    } else if (transport_) {
+        sent = transport_->sendProbeCluster(cluster.padding_kbps, cluster.bytes, probe_seqs_);
     }
+    if (!sent) probe_seqs_.clear();
+    probes_.onClusterSent(cluster.id, probe_seqs_);
+    CS_LOG(DEBUG, "QoS: probe cluster %u at %u kbps (%zu padding packets at %u kbps)",
+           cluster.id, cluster.target_kbps, probe_seqs_.size(), cluster.padding_kbps);
+}
 
-    // If bitrate has recovered past 80% of target, try recovering resolution
-    if (current_bitrate_kbps_ > static_cast<uint32_t>(target_bw * 0.8f)) {
-        tryRecoverResolution();
+// ---------------------------------------------------------------------------
+// onProbeResult -- jump to the probed capacity
+// ---------------------------------------------------------------------------
+
+void QosController::onProbeResult(uint32_t result_kbps) {
+    // The probe measured the whole wire rate; FEC, headers and keyframes
+    // ride on top of the target
+    uint32_t max_bw = has_preset_ ? preset_.max_bitrate_kbps : config_.max_bitrate_kbps;
+    const uint32_t target = std::min(static_cast<uint32_t>(
+        static_cast<float>(result_kbps) * PROBE_TARGET_FRACTION), max_bw);
+    // A small gap is left to the increase, which closes it gently
+    if (static_cast<float>(target) <
+        static_cast<float>(current_bitrate_kbps_) * PROBE_MIN_GAIN) return;
+
+    CS_LOG(INFO, "QoS: probe delivered %u kbps — target %u → %u kbps",
+           result_kbps, current_bitrate_kbps_, target);
+    delay_based_kbps_ = std::max(delay_based_kbps_, target);
+    loss_based_kbps_  = std::max(loss_based_kbps_, target);
+    applyTarget(false);
+}
+
+// ---------------------------------------------------------------------------
+// enterIncrease -- multiplicative increase of the delay-based target
+// ---------------------------------------------------------------------------
+
+void QosController::enterIncrease(uint64_t now_us) {
+    state_ = QosState::INCREASE;
+
+    // +8% per second of NORMAL, independent of the feedback rate.
+    double dt_s = last_delay_update_us_ > 0
+        ? std::min(static_cast<double>(now_us - last_delay_update_us_) / 1e6, 1.0)
+        : 0.0;
+    uint32_t new_bitrate = static_cast<uint32_t>(
+        delay_based_kbps_ * std::pow(DELAY_INCREASE_PER_SECOND, dt_s));
+    new_bitrate = std::max(new_bitrate, delay_based_kbps_ + 1);
+
+    // Do not run away from what the path has actually delivered.
+    if (bw_estimator_.hasEstimate()) {
+        uint32_t ceiling = static_cast<uint32_t>(
+            bw_estimator_.getEstimatedBandwidthKbps() * ACKED_RATE_HEADROOM);
+        new_bitrate = std::max(std::min(new_bitrate, ceiling), delay_based_kbps_);
     }
+
+    uint32_t max_bw = has_preset_ ? preset_.max_bitrate_kbps : config_.max_bitrate_kbps;
+    delay_based_kbps_ = std::min(new_bitrate, max_bw);
+
+    tryRestoreTemporalLayer(now_us);
 }
 
 // ---------------------------------------------------------------------------
@@ -232,44 +358,98 @@ void QosController::enterHold() {
 }
 
 // ---------------------------------------------------------------------------
-// enterDecrease -- multiplicative decrease: x0.85 bitrate, then degrade
+// enterDecrease -- A_d = 0.85 x acknowledged rate, once per interval
 // ---------------------------------------------------------------------------
 
-void QosController::enterDecrease() {
+void QosController::enterDecrease(uint64_t now_us) {
     state_ = QosState::DECREASE;
 
+    // The detector stays in OVERUSE until the queue drains; one cut per
+    // interval gives the previous cut time to take effect.
+    if (now_us - last_decrease_us_ < MIN_DECREASE_INTERVAL_US) return;
+    last_decrease_us_ = now_us;
+
+    // Dropping a layer takes effect with the next frame; the rate cut
+    // below needs the encoder's rate control to catch up.
+    shedTemporalLayer(now_us);
+    probes_.onDrop(current_bitrate_kbps_);
+    last_cut_us_ = now_us;
+
+    // Decrease from the acknowledged rate when it is lower: a congested link
+    // has already been delivering less than we send.
+    uint32_t base = delay_based_kbps_;
+    if (bw_estimator_.hasEstimate()) {
+        base = std::min(base, bw_estimator_.getEstimatedBandwidthKbps());
+    }
+
     uint32_t min_bw = has_preset_ ? preset_.min_bitrate_kbps : config_.min_bitrate_kbps;
+    delay_based_kbps_ = std::max(static_cast<uint32_t>(base * DECREASE_FACTOR), min_bw);
+}
+
+// ---------------------------------------------------------------------------
+// applyTarget -- min(delay-based, loss-based) into the encoder and pacer
+// ---------------------------------------------------------------------------
 
-    // Multiplicative decrease.
-    uint32_t new_bitrate = static_cast<uint32_t>(current_bitrate_kbps_ * DECREASE_FACTOR);
-    new_bitrate = std::max(new_bitrate, min_bw);
-    current_bitrate_kbps_ = new_bitrate;
+void QosController::applyTarget(bool congested) {
+    uint32_t min_bw = has_preset_ ? preset_.min_bitrate_kbps : config_.min_bitrate_kbps;
+    current_bitrate_kbps_ = std::max(std::min(delay_based_kbps_, loss_based_kbps_), min_bw);
 
-    // If bitrate is at the floor, use profile-aware degradation
-    if (current_bitrate_kbps_ <= min_bw && has_preset_) {
-        // Use the profile's priority weights to decide what to sacrifice
+    if (congested && current_bitrate_kbps_ <= min_bw && has_preset_) {
+        // At the floor: use the profile's priority weights to decide what
+        // to sacrifice next.
         if (preset_.fps_weight > preset_.quality_weight) {
             // Profile prioritizes FPS → sacrifice resolution first
             tryReduceResolution();
-            if (current_bitrate_kbps_ <= min_bw) {
-                tryReduceFps();
-            }
+            tryReduceFps();
         } else {
             // Profile prioritizes quality → sacrifice FPS first
             tryReduceFps();
-            if (current_bitrate_kbps_ <= min_bw) {
-                tryReduceResolution();
-            }
+            tryReduceResolution();
         }
-    } else if (current_bitrate_kbps_ <= min_bw) {
+    } else if (congested && current_bitrate_kbps_ <= min_bw) {
         // No preset — legacy behavior: drop FPS as last resort
-        uint32_t min_fps = has_preset_ ? preset_.min_fps : 30u;
+        uint32_t min_fps = 30u;
         if (current_fps_ > min_fps) {
             current_fps_ = min_fps;
             CS_LOG(WARN, "QoS: bitrate at floor (%u kbps) — reducing FPS to %u",
                    current_bitrate_kbps_, current_fps_);
         }
+    } else if (!congested) {
+        // If bitrate has recovered past 60% / 80% of target, walk FPS and
+        // resolution back up the ladder.
+        uint32_t target_bw = has_preset_ ? preset_.target_bitrate_kbps : config_.bitrate_kbps;
+        if (current_bitrate_kbps_ > static_cast<uint32_t>(target_bw * 0.6f)) {
+            tryRecoverFps();
+        }
+        if (current_bitrate_kbps_ > static_cast<uint32_t>(target_bw * 0.8f)) {
+            tryRecoverResolution();
+        }
     }
+
+    applyThermalFloors();
+
+    if (encoder_) {
+        EncoderConfig newCfg = config_;
+        newCfg.bitrate_kbps = std::max(static_cast<uint32_t>(
+            static_cast<float>(current_bitrate_kbps_) * encoder_share_), 1u);
+        newCfg.fps          = codedFps();
+        newCfg.width        = current_width_;
+        newCfg.height       = current_height_;
+        encoder_->reconfigure(newCfg);
+    }
+    if (bitrate_cb_) bitrate_cb_(current_bitrate_kbps_);
+
+    // Re-pace egress to the new bitrate.
+    updatePacing();
+}
+
+// ---------------------------------------------------------------------------
+// resetRateTargets -- restart both controllers from the current bitrate
+// ---------------------------------------------------------------------------
+
+void QosController::resetRateTargets() {
+    delay_based_kbps_ = current_bitrate_kbps_;
+    loss_based_kbps_  = current_bitrate_kbps_;
 }
 
 // ---------------------------------------------------------------------------
@@ -314,7 +494,7 @@ void QosController::tryReduceFps() {
 }
 
 void QosController::tryRecoverResolution() {
-    if (!has_preset_ || resolution_step_ == 0) return;
+    if (!has_preset_ || resolution_step_ <= thermal_res_floor_) return;
     if ((feedback_count_ - last_resolution_change_tick_) < RESOLUTION_CHANGE_COOLDOWN) return;
 
     // Only recover if the profile allows aggressive recovery
@@ -340,7 +520,7 @@ void QosController::tryRecoverResolution() {
 }
 
 void QosController::tryRecoverFps() {
-    if (!has_preset_ || fps_step_ == 0) return;
+    if (!has_preset_ || fps_step_ <= thermal_fps_floor_) return;
 
     uint32_t prev_step = fps_step_ - 1;
     uint32_t new_fps = preset_.fps_ladder[prev_step];
@@ -352,6 +532,78 @@ void QosController::tryRecoverFps() {
     current_fps_ = new_fps;
 }
 
+// ---------------------------------------------------------------------------
+// Thermal floors
+// ---------------------------------------------------------------------------
+
+void QosController::setThermalLevel(ThermalLevel level) {
+    thermal_level_ = level;
+
+    // Each level takes one more step of what the profile gives up first
+    // under congestion; from HOT on, the other follows a step behind.
+    const uint32_t n      = static_cast<uint32_t>(level);
+    const uint32_t first  = n;
+    const uint32_t second = n > 1 ? n - 1 : 0;
+    const bool fps_first  = !has_preset_ || preset_.fps_weight <= preset_.quality_weight;
+    thermal_fps_floor_ = fps_first ? first : second;
+    thermal_res_floor_ = fps_first ? second : first;
+
+    if (has_preset_) {
+        const uint32_t fps_steps = static_cast<uint32_t>(preset_.fps_ladder.size());
+        const uint32_t res_steps = static_cast<uint32_t>(preset_.resolution_ladder.size());
+        thermal_fps_floor_ = std::min(thermal_fps_floor_, fps_steps > 0 ? fps_steps - 1 : 0);
+        thermal_res_floor_ = std::min(thermal_res_floor_, res_steps > 0 ? res_steps - 1 : 0);
+    }
+}
+
+void QosController::applyThermalFloors() {
+    if (!has_preset_) {
+        // No ladders: hold the frame rate down like the bitrate floor does
+        if (thermal_level_ >= ThermalLevel::HOT && current_fps_ > THERMAL_FALLBACK_FPS) {
+            CS_LOG(WARN, "QoS: thermal %s — reducing FPS to %u",
+                   thermalLevelName(thermal_level_), THERMAL_FALLBACK_FPS);
+            current_fps_ = THERMAL_FALLBACK_FPS;
+        }
+        return;
+    }
+
+    // FPS steps at once; resolution one step per cooldown, as it needs
+    // the scaler and a keyframe.
+    while (fps_step_ < thermal_fps_floor_) {
+        tryReduceFps();
+    }
+    if (resolution_step_ < thermal_res_floor_) {
+        tryReduceResolution();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Temporal layer shedding
+// ---------------------------------------------------------------------------
+
+void QosController::shedTemporalLayer(uint64_t now_us) {
+    uint8_t layer = max_temporal_layer_.load();
+    if (layer == 0) return;
+
+    --layer;
+    max_temporal_layer_.store(layer);
+    last_layer_change_us_ = now_us;
+    CS_LOG(INFO, "QoS: shedding temporal layer %u (%u fps sent)",
+           layer + 1u, current_fps_ >> (config_.temporal_layers - 1 - layer));
+}
+
+void QosController::tryRestoreTemporalLayer(uint64_t now_us) {
+    uint8_t layer = max_temporal_layer_.load();
+    if (layer + 1u >= config_.temporal_layers) return;
+    if (now_us - last_layer_change_us_ < LAYER_RESTORE_DELAY_US) return;
+
+    ++layer;
+    max_temporal_layer_.store(layer);
+    last_layer_change_us_ = now_us;
+    CS_LOG(INFO, "QoS: restoring temporal layer %u (%u fps sent)",
+           static_cast<uint32_t>(layer), current_fps_ >> (config_.temporal_layers - 1 - layer));
+}
+
 // ---------------------------------------------------------------------------
 // adjustFec -- scale FEC redundancy based on loss rate
 // ---------------------------------------------------------------------------
@@ -378,9 +630,129 @@ void QosController::adjustFec(float loss_rate) {
         ratio = max_fec;
     }
 
+    // A NACK repair takes about one RTT.  If it would arrive after the
+    // frame is due, only FEC can save the frame; if there is time to
+    // spare, let NACK carry the repair and spend less on parity.
+    if (srtt_us_ > 0) {
+        uint64_t repair_us = nackRepairUs();
+        uint64_t budget_us = nackBudgetUs();
+        if (repair_us > budget_us) {
+            ratio = std::min(ratio * LATE_NACK_FEC_BOOST, max_fec);
+        } else if (repair_us * 2 < budget_us && loss_rate < LOSS_THRESH_HIGH) {
+            ratio = std::max(ratio * FAST_NACK_FEC_TRIM, min_fec);
+        }
+    }
+
     fec_->setRedundancyRatio(ratio);
 }
 
+// ---------------------------------------------------------------------------
+// planFec -- per-frame FEC layout from the burst loss model
+// ---------------------------------------------------------------------------
+
+bool QosController::planFec(size_t data_count, bool keyframe, int temporal_layer,
+                            size_t max_group, FecPlan& out) const {
+    if (!loss_model_.hasModel()) return false;
+
+    float max_fec = has_preset_ ? preset_.max_fec_ratio : 0.5f;
+    float min_fec = has_preset_ ? preset_.min_fec_ratio : 0.02f;
+    double target = FEC_TARGET_FRAME_LOSS;
+
+    if (keyframe) {
+        // Every later frame depends on it; a retransmit round is a stall.
+        target  = FEC_TARGET_KEYFRAME_LOSS;
+        max_fec = std::min(max_fec * KEYFRAME_FEC_BOOST, 1.0f);
+    } else if (temporal_layer > 0) {
+        // Enhancement layer: never retransmitted, and a loss only drops
+        // this one frame.
+        target  = FEC_TARGET_ENHANCEMENT;
+        min_fec = 0.0f;
+    } else if (temporal_layer == 0) {
+        // Base layer: fewer frames, each one referenced by every layer.
+        target = FEC_TARGET_BASE_LAYER;
+        uint64_t repair_us = nackRepairUs();
+        if (repair_us > 0 && repair_us * 2 < nackBudgetUs()) {
+            target = FEC_TARGET_FRAME_LOSS;
+        }
+    } else {
+        // If a NACK repair lands well before the frame is due, parity only
+        // has to spare most frames the retransmit; on a clean path NACK
+        // alone is the cheapest protection.
+        uint64_t repair_us = nackRepairUs();
+        if (repair_us > 0 && repair_us * 2 < nackBudgetUs()) {
+            target  = FEC_TARGET_NACK_ASSISTED;
+            min_fec = 0.0f;
+        }
+    }
+
+    out = loss_model_.plan(data_count, max_group, target, min_fec, max_fec);
+    return out.group_size > 0;
+}
+
+// ---------------------------------------------------------------------------
+// getFrameBudgetBytes -- bytes a frame may take within the queueing bound
+// ---------------------------------------------------------------------------
+
+size_t QosController::getFrameBudgetBytes(bool keyframe, size_t queued_bytes,
+                                         bool fresh_input) const {
+    // The queue drains at the pacing rate, or at what the path has been
+    // delivering if that is lower.
+    double rate_kbps = current_bitrate_kbps_;
+    if (pacing_factor_ > 0.0f) rate_kbps *= pacing_factor_;
+    if (bw_estimator_.hasEstimate()) {
+        rate_kbps = std::min(rate_kbps,
+                             static_cast<double>(bw_estimator_.getEstimatedBandwidthKbps()));
+    }
+    const double bytes_per_us = rate_kbps / 8000.0;
+    const uint32_t fps        = codedFps();
+    const double frame_us     = fps > 0 ? 1e6 / fps : 16'667.0;
+
+    const double bound_us = frame_us * (keyframe ? KEYFRAME_QUEUE_DELAY_FRAMES
+                                                 : MAX_QUEUE_DELAY_FRAMES);
+    const double budget = bytes_per_us * bound_us - static_cast<double>(queued_bytes);
+    const double floor  = bytes_per_us * frame_us * MIN_FRAME_BUDGET_FRACTION;
+    if (budget < floor) {
+        // Skipping a frame that answers the user's input would add a whole
+        // frame interval to what they feel; it goes out small instead
+        return (keyframe || fresh_input) ? static_cast<size_t>(floor) : 0;
+    }
+    return static_cast<size_t>(budget);
+}
+
+// ---------------------------------------------------------------------------
+// updateRtt -- RFC 6298 smoothed RTT and RTT variance
+// ---------------------------------------------------------------------------
+
+void QosController::updateRtt(uint32_t rtt_us) {
+    if (srtt_us_ == 0) {
+        srtt_us_   = rtt_us;
+        rttvar_us_ = rtt_us / 2;
+    } else {
+        uint32_t err = srtt_us_ > rtt_us ? srtt_us_ - rtt_us : rtt_us - srtt_us_;
+        rttvar_us_ = (3 * rttvar_us_ + err) / 4;       // beta  = 1/4
+        srtt_us_   = (7 * srtt_us_ + rtt_us) / 8;      // alpha = 1/8
+    }
+
+    // Repeated NACKs inside one RTT crossed our retransmit in flight.
+    if (transport_) transport_->setRetransmitHoldoffUs(srtt_us_);
+}
+
+// ---------------------------------------------------------------------------
+// nackBudgetUs -- time available to repair a lost packet
+// ---------------------------------------------------------------------------
+
+uint64_t QosController::nackBudgetUs() const {
+    uint64_t frame_us = current_fps_ > 0 ? 1'000'000ull / current_fps_ : 16'667;
+    uint32_t jitter_buffer_ms = has_preset_ ? preset_.jitter_buffer_ms
+                                            : DEFAULT_JITTER_BUFFER_MS;
+    return frame_us + static_cast<uint64_t>(jitter_buffer_ms) * 1000;
+}
+
+uint64_t QosController::nackRepairUs() const {
+    if (srtt_us_ == 0) return 0;
+    return static_cast<uint64_t>(srtt_us_) + 4ull * rttvar_us_;
+}
+
 // ---------------------------------------------------------------------------
 // getStats -- snapshot of current QoS state
 // ---------------------------------------------------------------------------
@@ -392,15 +764,39 @@ QosStats QosController::getStats() const {
     stats.width             = current_width_;
     stats.height            = current_height_;
     stats.loss_rate         = smoothed_loss_;
-    stats.rtt_us            = smoothed_rtt_;
+    stats.rtt_us            = srtt_us_;
+    stats.rtt_var_us        = rttvar_us_;
     stats.jitter_us         = smoothed_jitter_;
     stats.state             = state_;
     stats.fec_ratio         = fec_ ? fec_->getRedundancyRatio() : 0.0f;
     stats.estimated_bw_kbps = bw_estimator_.getEstimatedBandwidthKbps();
-    stats.delay_gradient    = delay_filter_.getEstimate();
+    stats.delay_based_kbps  = delay_based_kbps_;
+    stats.loss_based_kbps   = loss_based_kbps_;
+    stats.delay_trend_ms    = bw_estimator_.getDelayTrendMs();
+    stats.overuse_threshold_ms = bw_estimator_.getOveruseThresholdMs();
+    stats.usage             = bw_estimator_.getBandwidthUsage();
+    stats.burst_loss_rate   = loss_model_.getLossRate();
+    stats.mean_burst_packets = loss_model_.getMeanBurstLength();
     stats.decode_time_us    = smoothed_decode_;
     stats.resolution_step   = resolution_step_;
     stats.fps_step          = fps_step_;
+    stats.max_temporal_layer = max_temporal_layer_.load();
+
+    if (path_tracker_.isActive()) {
+        const PathStats path = path_tracker_.getStats();
+        stats.secondary_sent      = path.sent;
+        stats.secondary_rescued   = path.rescued;
+        stats.secondary_loss_rate = path.loss_rate;
+        // The offset is one-way; assume the return trip differs alike
+        if (path.has_delay && srtt_us_ > 0) {
+            const double rtt_us = srtt_us_ + 2000.0 * path.delay_offset_ms;
+            stats.secondary_rtt_us = static_cast<uint32_t>(std::max(rtt_us, 0.0));
+        }
+    }
+
+    const ProbeStats probe = probes_.getStats();
+    stats.probe_clusters = probe.clusters_sent;
+    stats.probed_kbps    = probe.last_result_kbps;
 
     if (has_preset_) {
         stats.profile_name = cs::gamingModeToString(preset_.mode);
@@ -413,4 +809,26 @@ QosStats QosController::getStats() const {
     return stats;
 }
 
+// ---------------------------------------------------------------------------
+// updatePacing -- pace the transport at bitrate x preset pacing factor
+// ---------------------------------------------------------------------------
+
+void QosController::updatePacing() {
+    if (!transport_) return;
+
+    if (pacing_factor_ <= 0.0f) {
+        transport_->setPacingRate(0, 0);
+        return;
+    }
+
+    uint32_t rate_kbps = static_cast<uint32_t>(
+        static_cast<float>(current_bitrate_kbps_) * pacing_factor_);
+
+    // kbps * ms / 8 = bytes
+    size_t burst_bytes = static_cast<size_t>(rate_kbps) * pacing_burst_ms_ / 8;
+    burst_bytes = std::max(burst_bytes, MIN_PACING_BURST_PACKETS * transport_->maxPacketSize());
+
+    transport_->setPacingRate(rate_kbps, burst_bytes);
+}
+
 } // namespace cs::host
@@ -1,31 +1,91 @@
 ///////////////////////////////////////////////////////////////////////////////
-// qos_controller.h -- Adaptive bitrate / QoS controller (GCC-inspired)
+// qos_controller.h -- Adaptive bitrate / QoS controller (GCC-style)
 //
-// Implements a state machine that adjusts encoder bitrate, FPS, resolution,
-// and FEC redundancy based on feedback from the client (packet loss, RTT,
-// jitter) and the active streaming profile.
+// Adjusts encoder bitrate, FPS, resolution, and FEC redundancy based on
+// feedback from the client (per-packet arrivals, packet loss, jitter,
+// decode time) and the active streaming profile.
 //
-// Algorithm (inspired by Google Congestion Control):
-//   - Kalman-filtered one-way delay gradient detects congestion.
-//   - AIMD: Additive Increase (+5%), Multiplicative Decrease (x0.85).
-//   - Loss thresholds:  >5% -> DECREASE,  >10% -> force IDR.
-//   - Resolution/FPS ladder walking based on profile priority weights.
-//   - FEC ratio scales with loss rate.
+// Two controllers run side by side, as in Google Congestion Control:
+//   - Delay-based (driven by transport-wide feedback, ~20 per second): the
+//     BandwidthEstimator's overuse detector classifies the Kalman-filtered
+//     inter-group delay variation against an adaptive threshold.
+//     OVERUSE cuts the target to 0.85 x the acknowledged receive rate;
+//     NORMAL grows it ~8% per second, capped at 1.5 x the acknowledged
+//     rate; UNDERUSE holds.  Queues are caught while they build, before
+//     routers start dropping.
+//   - Loss-based (driven by QoS feedback, ~5 per second): >5% loss scales
+//     the target by (1 - loss/2), <2% grows it by 5%.  >10% forces an IDR.
+// The encoder and pacer follow min(delay-based, loss-based), clamped to
+// the profile's range.  At the floor, the resolution/FPS ladder is walked
+// according to the profile's priority weights.
 //
-// The controller is driven by QoS feedback packets sent by the client
-// approximately 5 times per second.
+// FEC is planned per frame from a two-state burst loss model fitted to the
+// transport-wide feedback (see loss_model.h): group size and parity count
+// are chosen to keep the frame's unrecoverable probability under a target,
+// stricter for keyframes.  RTT is smoothed per RFC 6298 (SRTT / RTTVAR);
+// when a NACK repair (SRTT + 4 x RTTVAR) comfortably lands before the
+// frame is due, delta frames get a looser target and may rely on NACK
+// alone.  Until the model has data, the FEC ratio scales with average loss.
+// The transport's send pacer follows the target bitrate x the preset's
+// pacing factor, with a burst allowance of pacing_burst_ms.
+//
+// With temporal layers, base-layer frames get a stricter FEC target and
+// enhancement-layer frames (never retransmitted) a looser one.  A delay
+// overuse also sheds the top enhancement layer at once: the session stops
+// sending it, which cuts the frame rate without an encoder reconfigure
+// long before the FPS ladder would.  Layers come back one at a time after
+// a stretch without overuse.
+//
+// Each frame also gets a byte budget: what the path drains (the pacing
+// rate, or the acknowledged rate if lower) within a bound on queueing
+// delay, less what the pacer still holds.  The encoder caps the frame at
+// the budget, so a scene cut cannot sit in the pacer for several frame
+// intervals; when the queue alone exceeds the bound, the frame is skipped.
+//
+// The thermal governor's level (thermal_governor.h) sets floors on the
+// ladders: a hot SoC steps resolution or frame rate down, in the order the
+// profile sacrifices them under congestion, and neither recovers past the
+// floor until the level falls again.  The content classifier's frame rate
+// cap (content_classifier.h) is applied on top of the ladder, so a still
+// desktop's few frames each get more of the bitrate.
+//
+// With multipath redundancy the feedback also reports packets that went
+// over the viewer's secondary path.  The path tracker (path_tracker.h)
+// picks those out, so the estimator and loss model follow the primary
+// path alone, and keeps the secondary's own loss and delay for the stats.
+//
+// Bandwidth probing (probe_controller.h) gets the target to the path's
+// capacity without the additive climb: at the first transport feedback,
+// clusters of padding are sent at rising rates, and a cluster the path
+// delivered raises both controllers to PROBE_TARGET_FRACTION of the
+// delivered rate (within the profile's maximum) at once -- the rest is
+// headroom for FEC and keyframes.  A jump of less than PROBE_MIN_GAIN is
+// left to the increase.  A congestion episode that has been over for
+// RECOVERY_PROBE_DELAY_US probes at the rate before it, so capacity that
+// came back is used again within a round trip.  Probes are left out of
+// the loss counts and the loss model -- a cluster above capacity is meant
+// to overflow -- but their arrivals reach the estimator, whose delay
+// signal also guards the jump.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include "bandwidth_estimator.h"
+#include "loss_model.h"
+#include "path_tracker.h"
+#include "probe_controller.h"
+#include "thermal_governor.h"
 #include "encode/encoder_interface.h"
 #include "transport/udp_transport.h"
 #include "transport/fec.h"
 #include "cs/qos/gaming_modes.h"
+#include "cs/qos/transport_feedback.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <string>
+#include <vector>
 
 namespace cs::host {
 
@@ -38,7 +98,7 @@ struct QosFeedbackPacket {
     uint32_t jitter_us           = 0;  // Inter-arrival jitter (microseconds)
     uint64_t last_recv_time_us   = 0;  // Client's receive timestamp of last packet
     uint16_t last_seq            = 0;  // Highest sequence number received
-    uint32_t rtt_us              = 0;  // Round-trip time measured by client (if available)
+    uint32_t rtt_us              = 0;  // Round-trip sample from the echoed RTT probe (0 = none)
     uint32_t decode_time_us      = 0;  // Client-side decode time per frame
     uint32_t frames_dropped      = 0;  // Frames dropped on client since last report
 };
@@ -46,10 +106,11 @@ struct QosFeedbackPacket {
 // ---------------------------------------------------------------------------
 // QoS state machine states
 // ---------------------------------------------------------------------------
+// (delay-based rate controller)
 enum class QosState {
-    INCREASE,   // Network is underutilized, ramp up bitrate
-    HOLD,       // Network is stable, maintain current settings
-    DECREASE,   // Network is congested, reduce bitrate
+    INCREASE,   // Delay is stable, ramp up bitrate
+    HOLD,       // Queues are draining, or just after a decrease
+    DECREASE,   // Delay is building, reduce bitrate
 };
 
 inline const char* qosStateName(QosState s) {
@@ -70,15 +131,29 @@ struct QosStats {
     uint32_t  width              = 0;
     uint32_t  height             = 0;
     float     loss_rate          = 0.0f;   // 0.0 to 1.0
-    uint32_t  rtt_us             = 0;
+    uint32_t  rtt_us             = 0;      // Smoothed RTT (RFC 6298 SRTT)
+    uint32_t  rtt_var_us         = 0;      // RTTVAR
     uint32_t  jitter_us          = 0;
     QosState  state              = QosState::HOLD;
     float     fec_ratio          = 0.0f;
-    uint32_t  estimated_bw_kbps  = 0;
-    double    delay_gradient     = 0.0;
+    uint32_t  estimated_bw_kbps  = 0;      // Acknowledged receive rate
+    uint32_t  delay_based_kbps   = 0;
+    uint32_t  loss_based_kbps    = 0;
+    double    delay_trend_ms     = 0.0;    // Filtered inter-group delay variation
+    double    overuse_threshold_ms = 0.0;
+    BandwidthUsage usage         = BandwidthUsage::NORMAL;
+    double    burst_loss_rate    = 0.0;    // Loss model: stationary loss rate
+    double    mean_burst_packets = 0.0;    // Loss model: mean burst length
     uint32_t  decode_time_us     = 0;
     uint32_t  resolution_step    = 0;      // Index into resolution ladder
     uint32_t  fps_step           = 0;      // Index into FPS ladder
+    uint32_t  max_temporal_layer = 0;      // Highest temporal layer being sent
+    uint64_t  secondary_sent     = 0;      // Packets sent on the secondary path
+    uint64_t  secondary_rescued  = 0;      // Of those, copies of lost primary packets
+    float     secondary_loss_rate = 0.0f;  // 0.0 to 1.0
+    uint32_t  secondary_rtt_us   = 0;      // Estimated; 0 = no paired samples yet
+    uint32_t  probe_clusters     = 0;      // Bandwidth probe clusters sent
+    uint32_t  probed_kbps        = 0;      // Last probe's delivered rate (0 = none)
     std::string codec_name;
     std::string profile_name;
 };
@@ -88,6 +163,18 @@ struct QosStats {
 // ---------------------------------------------------------------------------
 using ResolutionChangeCallback = std::function<void(uint32_t width, uint32_t height)>;
 
+// ---------------------------------------------------------------------------
+// Bitrate callback: the whole target, each time it is applied
+// ---------------------------------------------------------------------------
+using BitrateCallback = std::function<void(uint32_t total_kbps)>;
+
+// ---------------------------------------------------------------------------
+// Probe sender: sends a cluster of padding at |rate_kbps|, filling |seqs|
+// with the transport-wide sequence numbers of the packets sent
+// ---------------------------------------------------------------------------
+using ProbeSender = std::function<bool(uint32_t rate_kbps, size_t bytes,
+                                       std::vector<uint16_t>& seqs)>;
+
 // ---------------------------------------------------------------------------
 // QosController
 // ---------------------------------------------------------------------------
@@ -96,47 +183,161 @@ public:
     QosController(IEncoder* encoder, UdpTransport* transport, FecEncoder* fec);
     ~QosController() = default;
 
-    /// Process a QoS feedback packet from the client.
-    /// This is the main entry point, called ~5 times per second.
+    /// Process a QoS feedback packet from the client (~5 times per second):
+    /// runs the loss-based controller and pushes the combined target into
+    /// the encoder and pacer.
     void onFeedbackReceived(const QosFeedbackPacket& feedback);
 
+    /// Process a transport-wide feedback message (~20 times per second):
+    /// hand every reported arrival to the bandwidth estimator, count
+    /// received / lost packets for the next onFeedbackReceived(), and step
+    /// the delay-based controller.  A new overuse is applied immediately.
+    /// Packets sent on the secondary path go to the path tracker instead.
+    void onTransportFeedback(const cs::TransportFeedback& feedback);
+
     /// Get the current QoS statistics.
     QosStats getStats() const;
 
+    /// Choose the FEC layout for |data_count| data packets of a frame, with
+    /// groups of at most |max_group| packets.  |temporal_layer| is the
+    /// frame's layer in a stream with temporal layers, or -1 without them.
+    /// Returns false until the loss model has seen enough traffic; the
+    /// caller then uses the FEC encoder's redundancy ratio.  Called from the
+    /// send thread.
+    bool planFec(size_t data_count, bool keyframe, int temporal_layer, size_t max_group,
+                 FecPlan& out) const;
+
+    /// Highest temporal layer the session should send; frames above it are
+    /// skipped.  Called from the send thread.
+    uint8_t getMaxTemporalLayer() const { return max_temporal_layer_.load(); }
+
+    /// Byte budget for the next frame with |queued_bytes| still waiting in
+    /// the pacer.  Returns 0 if the queue is already too deep for a delta
+    /// frame to be worth sending (skip it); keyframes, and frames that are
+    /// the first to show the viewer's latest input (|fresh_input|), always
+    /// get at least a minimal budget.  Called from the send thread.
+    size_t getFrameBudgetBytes(bool keyframe, size_t queued_bytes,
+                               bool fresh_input = false) const;
+
+    /// Smoothed RTT and its variance (RFC 6298), or 0 before the first sample.
+    uint32_t getSmoothedRttUs() const { return srtt_us_; }
+    uint32_t getRttVarUs() const { return rttvar_us_; }
+
     /// Get the bandwidth estimator (for transport-level packet tracking).
     BandwidthEstimator& getBandwidthEstimator() { return bw_estimator_; }
 
+    /// Get the secondary path tracker (fed by the transport's sent callbacks).
+    PathTracker& getPathTracker() { return path_tracker_; }
+
+    /// Get the bandwidth prober (fed by the transport's sent callback).
+    ProbeController& getProbeController() { return probes_; }
+
+    /// Probe for bandwidth at session start and after congestion (default
+    /// on).  Set before the first feedback.
+    void setProbingEnabled(bool enabled) { probing_enabled_ = enabled; }
+
+    /// Send probe clusters with |sender| instead of the transport's
+    /// sendProbeCluster() (the offline simulator has no socket).
+    void setProbeSender(ProbeSender sender) { probe_sender_ = std::move(sender); }
+
     /// Set the initial / baseline encoder config.
     void setBaseConfig(const EncoderConfig& config);
 
     /// Apply a streaming profile preset (gaming mode).
     void applyPreset(const cs::QosPreset& preset);
 
-    /// Set callback for resolution changes (so SessionManager can
-    /// reinitialize the capture device at the new resolution).
+    /// Set callback for resolution changes (so SessionManager can scale
+    /// frames to the new resolution ahead of the encoder).
     void setResolutionChangeCallback(ResolutionChangeCallback cb) {
         resolution_change_cb_ = std::move(cb);
     }
 
+    /// Code only |share| (0 - 1] of the target in the controller's encoder;
+    /// the rest goes to the session's other video streams, which the
+    /// bitrate callback hands it to.  Pacing and frame budgets follow the
+    /// whole target.
+    void setEncoderShare(float share) { encoder_share_ = share; }
+
+    /// Set callback for each bitrate target applied (feedback thread).
+    void setBitrateCallback(BitrateCallback cb) { bitrate_cb_ = std::move(cb); }
+
+    /// Set the send pacing profile: egress is paced at bitrate x |factor|
+    /// with |burst_ms| worth of burst allowance (factor 0 = no pacing).
+    /// applyPreset() sets this from the preset as well.
+    void setPacingProfile(float factor, uint32_t burst_ms);
+
     /// Enable VPN-aware QoS adjustments.
     void setVpnMode(bool enabled);
 
+    /// Hold the ladders down for thermal |level|; applied with the next
+    /// target (feedback thread).
+    void setThermalLevel(ThermalLevel level);
+
+    /// Code at no more than |fps| for the content being streamed (0 = no
+    /// cap; see content_classifier.h); applied with the next target
+    /// (feedback thread).  The ladders are left alone: the cap lifts as
+    /// soon as the content moves again.
+    void setContentFpsCap(uint32_t fps) { content_fps_cap_ = fps; }
+
 private:
-    void enterIncrease();
+    void enterIncrease(uint64_t now_us);
     void enterHold();
-    void enterDecrease();
+    void enterDecrease(uint64_t now_us);
+
+    /// Set the bitrate to min(delay-based, loss-based) and push it into the
+    /// encoder and pacer.  |congested| allows walking down the
+    /// resolution/FPS ladder at the floor; otherwise the ladder recovers.
+    void applyTarget(bool congested);
+
+    /// Restart both controllers from current_bitrate_kbps_.
+    void resetRateTargets();
+
+    /// Plan recovery probes and send the next due cluster (feedback thread).
+    void runProbes(uint64_t now_us);
+
+    /// A probe cluster delivered |result_kbps|: raise both controllers to it.
+    void onProbeResult(uint32_t result_kbps);
+
+    /// Fold one RTT sample into SRTT / RTTVAR (RFC 6298 section 2).
+    void updateRtt(uint32_t rtt_us);
+
+    /// Time a lost packet can take to be repaired and still be decoded on
+    /// time: one frame interval plus the client's jitter buffer.
+    uint64_t nackBudgetUs() const;
+
+    /// Time a NACK repair takes: SRTT + 4 x RTTVAR (0 = not measured yet).
+    uint64_t nackRepairUs() const;
+
     void adjustFec(float loss_rate);
+    void updatePacing();
     void tryReduceResolution();
     void tryReduceFps();
     void tryRecoverResolution();
     void tryRecoverFps();
+    void applyThermalFloors();
+    void shedTemporalLayer(uint64_t now_us);
+    void tryRestoreTemporalLayer(uint64_t now_us);
 
     IEncoder*           encoder_     = nullptr;
     UdpTransport*       transport_   = nullptr;
     FecEncoder*         fec_         = nullptr;
 
     BandwidthEstimator  bw_estimator_;
-    KalmanFilter        delay_filter_;
+    LossModel           loss_model_;
+    PathTracker         path_tracker_;
+    std::vector<uint8_t> path_mask_;      // Per feedback packet: 1 = secondary path
+
+    // Bandwidth probing
+    ProbeController     probes_;
+    ProbeSender         probe_sender_;
+    std::vector<uint8_t> probe_mask_;     // Per feedback packet: 1 = probe
+    std::vector<uint16_t> probe_seqs_;    // Scratch for the probe sender
+    bool                probing_enabled_  = true;
+    bool                probing_started_  = false;
+    uint64_t            last_cut_us_      = 0;   // Last delay- or loss-based decrease
+    static constexpr uint64_t RECOVERY_PROBE_DELAY_US = 1'000'000;   // Cut-free time
+    static constexpr float    PROBE_TARGET_FRACTION   = 0.8f;        // x probed wire rate
+    static constexpr float    PROBE_MIN_GAIN          = 1.25f;       // x current, worth a jump
 
     QosState            state_       = QosState::HOLD;
     EncoderConfig       config_;
@@ -146,28 +347,77 @@ private:
     bool                has_preset_  = false;
 
     // Current working values.
-    uint32_t            current_bitrate_kbps_ = 20000;
+    uint32_t            current_bitrate_kbps_ = 20000;   // min(delay, loss) target
+    uint32_t            delay_based_kbps_     = 20000;
+    uint32_t            loss_based_kbps_      = 20000;
+    uint64_t            last_delay_update_us_ = 0;
+    uint64_t            last_decrease_us_     = 0;
     uint32_t            current_fps_          = 60;
     uint32_t            current_width_        = 1920;
     uint32_t            current_height_       = 1080;
     uint32_t            resolution_step_      = 0;  // Index into preset resolution ladder
     uint32_t            fps_step_             = 0;  // Index into preset FPS ladder
 
+    // Temporal layer shedding
+    std::atomic<uint8_t> max_temporal_layer_{0};
+    uint64_t            last_layer_change_us_ = 0;
+    static constexpr uint64_t LAYER_RESTORE_DELAY_US = 2'000'000;  // Overuse-free time per layer
+
+    // Thermal floors: lowest ladder steps the governor's level allows
+    ThermalLevel        thermal_level_        = ThermalLevel::NORMAL;
+    uint32_t            thermal_fps_floor_    = 0;
+    uint32_t            thermal_res_floor_    = 0;
+    static constexpr uint32_t THERMAL_FALLBACK_FPS = 30;  // HOT and up, without a preset
+
+    // Content frame rate cap (0 = none)
+    uint32_t            content_fps_cap_      = 0;
+
+    /// Frame rate the encoder codes at: the ladder's, under the content cap.
+    uint32_t codedFps() const {
+        return content_fps_cap_ > 0 ? std::min(current_fps_, content_fps_cap_) : current_fps_;
+    }
+
     // VPN-aware adjustments
     bool                vpn_mode_             = false;
     static constexpr float VPN_JITTER_MULTIPLIER = 1.5f;
     static constexpr float VPN_BITRATE_MULTIPLIER = 0.85f;
 
-    // AIMD parameters.
-    static constexpr float INCREASE_FACTOR  = 1.05f;  // +5% per feedback cycle
-    static constexpr float DECREASE_FACTOR  = 0.85f;  // x0.85 on congestion
-    static constexpr float LOSS_THRESH_LOW  = 0.02f;  // 2% loss: enter HOLD
-    static constexpr float LOSS_THRESH_HIGH = 0.05f;  // 5% loss: enter DECREASE
+    // Rate control parameters.
+    static constexpr float INCREASE_FACTOR  = 1.05f;  // Loss-based: +5% per feedback cycle
+    static constexpr float DECREASE_FACTOR  = 0.85f;  // Delay-based: x0.85 acked rate on overuse
+    static constexpr double DELAY_INCREASE_PER_SECOND = 1.08;   // Delay-based: +8%/s
+    static constexpr uint64_t MIN_DECREASE_INTERVAL_US = 200'000;  // One cut per ~RTT
+    static constexpr float LOSS_THRESH_LOW  = 0.02f;  // <2% loss: loss-based increase
+    static constexpr float LOSS_THRESH_HIGH = 0.05f;  // >5% loss: loss-based decrease
     static constexpr float LOSS_THRESH_IDR  = 0.10f;  // 10% loss: force IDR
 
-    // Delay gradient thresholds (ms/s).
-    static constexpr double GRADIENT_OVERUSE  = 5.0;   // Positive trend = congestion
-    static constexpr double GRADIENT_UNDERUSE = -1.0;  // Negative trend = available bandwidth
+    // Never probe more than this far above the acknowledged receive rate.
+    static constexpr float ACKED_RATE_HEADROOM = 1.5f;
+
+    // FEC vs. NACK policy.
+    static constexpr uint32_t DEFAULT_JITTER_BUFFER_MS = 8;     // Without a preset
+    static constexpr float    LATE_NACK_FEC_BOOST      = 2.0f;  // NACK too slow: x2 FEC
+    static constexpr float    FAST_NACK_FEC_TRIM       = 0.5f;  // NACK in time: x0.5 FEC
+
+    // Planned FEC: target P(frame unrecoverable by FEC alone).
+    static constexpr double   FEC_TARGET_FRAME_LOSS    = 0.01;
+    static constexpr double   FEC_TARGET_KEYFRAME_LOSS = 0.001;  // Losing one costs a GOP
+    static constexpr double   FEC_TARGET_NACK_ASSISTED = 0.05;   // NACK repairs the rest
+    static constexpr double   FEC_TARGET_BASE_LAYER    = 0.005;  // Every layer above predicts from it
+    static constexpr double   FEC_TARGET_ENHANCEMENT   = 0.05;   // Not retransmitted; losing one drops a frame
+    static constexpr float    KEYFRAME_FEC_BOOST       = 2.0f;   // x max_fec_ratio
+
+    // Frame budget: bound on one frame's queueing delay, in frame intervals.
+    static constexpr double   MAX_QUEUE_DELAY_FRAMES      = 2.0;
+    static constexpr double   KEYFRAME_QUEUE_DELAY_FRAMES = 4.0;
+    static constexpr double   MIN_FRAME_BUDGET_FRACTION   = 0.25;  // x average frame; less = skip
+
+    // Send pacing profile
+    float               pacing_factor_        = 0.0f;   // 0 = pacing off
+    uint32_t            pacing_burst_ms_      = 0;
+
+    // Smallest pacing burst: two full datagrams, so a lone packet never waits.
+    static constexpr size_t MIN_PACING_BURST_PACKETS = 2;
 
     // Decode bottleneck threshold (microseconds).
     static constexpr uint32_t DECODE_BOTTLENECK_US = 20000;  // 20ms = decode is struggling
@@ -175,13 +425,22 @@ private:
     // Feedback tracking.
     uint32_t            feedback_count_  = 0;
     float               smoothed_loss_   = 0.0f;
-    uint32_t            smoothed_rtt_    = 0;
+    uint32_t            srtt_us_         = 0;
+    uint32_t            rttvar_us_       = 0;
     uint32_t            smoothed_jitter_ = 0;
     uint32_t            smoothed_decode_ = 0;
 
+    // Transport-wide feedback counts since the last onFeedbackReceived().
+    uint32_t            twcc_received_   = 0;
+    uint32_t            twcc_lost_       = 0;
+
     // Resolution change callback
     ResolutionChangeCallback resolution_change_cb_;
 
+    // Shared bitrate: the encoder's share of it, and who gets the rest
+    float               encoder_share_ = 1.0f;
+    BitrateCallback     bitrate_cb_;
+
     // Cooldown: prevent rapid resolution changes (min 2 seconds between changes)
     uint32_t            last_resolution_change_tick_ = 0;
     static constexpr uint32_t RESOLUTION_CHANGE_COOLDOWN = 10;  // ~2 seconds at 5 feedback/sec
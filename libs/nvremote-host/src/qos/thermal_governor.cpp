@@ -0,0 +1,221 @@
+///////////////////////////////////////////////////////////////////////////////
+// thermal_governor.cpp -- Predictive thermal / power governor
+//
+// Everything is read from sysfs, one small file per value, so a sample is a
+// handful of reads once a second.  The slope is taken per sample and
+// smoothed: a zone reads in whole or half degrees, which alone would make
+// the prediction jump.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "thermal_governor.h"
+
+#include "cs/common.h"
+
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <string>
+
+namespace cs::host {
+
+namespace {
+
+bool readInt(const std::string& path, long long& value) {
+    std::ifstream f(path);
+    if (!f.is_open()) return false;
+    return static_cast<bool>(f >> value);
+}
+
+std::string readWord(const std::string& path) {
+    std::ifstream f(path);
+    std::string word;
+    if (f.is_open()) f >> word;
+    return word;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// initialize() -- thermal zones and their passive trip point
+// ---------------------------------------------------------------------------
+bool ThermalGovernor::initialize() {
+    zones_.clear();
+
+    // A zone without a passive trip never throttles anything -- some read
+    // a fixed value (Jetson's PMIC-Die sits at 100 C) -- so only zones
+    // with one are watched, unless none has.
+    std::vector<std::string> untripped;
+    for (uint32_t i = 0; i < MAX_ZONES; ++i) {
+        const std::string zone = "/sys/class/thermal/thermal_zone" + std::to_string(i) + "/";
+        long long temp = 0;
+        if (!readInt(zone + "temp", temp)) continue;
+
+        int32_t lowest_trip = INT32_MAX;
+        for (uint32_t t = 0; ; ++t) {
+            const std::string trip = zone + "trip_point_" + std::to_string(t) + "_";
+            const std::string type = readWord(trip + "type");
+            if (type.empty()) break;
+            long long trip_temp = 0;
+            if (type == "passive" && readInt(trip + "temp", trip_temp) && trip_temp > 0) {
+                lowest_trip = std::min(lowest_trip, static_cast<int32_t>(trip_temp));
+            }
+        }
+        if (lowest_trip != INT32_MAX) {
+            zones_.push_back({zone + "temp", lowest_trip});
+        } else {
+            untripped.push_back(zone + "temp");
+        }
+    }
+    if (zones_.empty()) {
+        for (const std::string& path : untripped) {
+            zones_.push_back({path, DEFAULT_TRIP_MC});
+        }
+    }
+    if (zones_.empty()) return false;
+
+    last_sample_us_ = 0;
+    slope_mc_per_s_ = 0.0;
+    saturated_samples_ = 0;
+    clear_since_us_ = 0;
+    level_.store(ThermalLevel::NORMAL);
+
+    const int32_t lowest = std::min_element(zones_.begin(), zones_.end(),
+        [](const Zone& x, const Zone& y) { return x.trip_mc < y.trip_mc; })->trip_mc;
+    CS_LOG(INFO, "Thermal governor: %zu zones, first throttling at %d.%d C",
+           zones_.size(), lowest / 1000, (lowest % 1000) / 100);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// update() -- sample, predict, and move the level
+// ---------------------------------------------------------------------------
+bool ThermalGovernor::update(uint64_t now_us) {
+    if (zones_.empty()) return false;
+    if (last_sample_us_ != 0 && now_us - last_sample_us_ < SAMPLE_INTERVAL_US) return false;
+
+    int32_t temp = 0;
+    int32_t trip = 0;
+    if (!readNearestZone(temp, trip)) return false;
+    const int32_t headroom = trip - temp;
+
+    if (last_sample_us_ != 0) {
+        const double dt_s  = static_cast<double>(now_us - last_sample_us_) / 1e6;
+        const double slope = static_cast<double>(last_headroom_mc_ - headroom) / dt_s;
+        slope_mc_per_s_ = SLOPE_ALPHA * slope + (1.0 - SLOPE_ALPHA) * slope_mc_per_s_;
+    }
+    last_sample_us_   = now_us;
+    last_headroom_mc_ = headroom;
+
+    // Only heating is extrapolated: a falling slope says nothing about
+    // how far the zone will drop, and the level falls on the reading.
+    const int32_t heating = static_cast<int32_t>(std::max(slope_mc_per_s_, 0.0) * HORIZON_S);
+    const int32_t predicted_headroom = headroom - heating;
+
+    // In the capped power modes the encoder has less clock to spare
+    const uint32_t load = readEncoderLoad();
+    const uint32_t saturated_load = readLowPowerMode() ? SATURATED_LOAD_LOW_POWER
+                                                       : SATURATED_LOAD;
+    saturated_samples_ = load >= saturated_load ? saturated_samples_ + 1 : 0;
+
+    temp_mc_.store(temp);
+    predicted_mc_.store(temp + heating);
+    trip_mc_.store(trip);
+    encoder_load_.store(load);
+
+    const ThermalLevel current = level_.load();
+    const ThermalLevel wanted  = assess(headroom, predicted_headroom,
+                                        saturated_samples_ >= SATURATED_SAMPLES);
+    ThermalLevel next = current;
+    if (wanted > current) {
+        next = wanted;
+        clear_since_us_ = 0;
+    } else if (wanted < current) {
+        // Step down one level at a time, each after the zones have stayed
+        // clear of the trip point for the whole cool-down.
+        if (headroom < CLEAR_MARGIN_MC) {
+            clear_since_us_ = 0;
+        } else if (clear_since_us_ == 0) {
+            clear_since_us_ = now_us;
+        } else if (now_us - clear_since_us_ >= COOL_DOWN_US) {
+            next = static_cast<ThermalLevel>(static_cast<uint8_t>(current) - 1);
+            clear_since_us_ = now_us;
+        }
+    } else {
+        clear_since_us_ = 0;
+    }
+
+    if (next == current) return false;
+    level_.store(next);
+    CS_LOG(INFO, "Thermal governor: %s -> %s (%.1f C, %.1f C predicted, trip %.1f C, "
+                 "encoder %u%%)",
+           thermalLevelName(current), thermalLevelName(next),
+           temp / 1000.0, (temp + heating) / 1000.0, trip / 1000.0, load);
+    return true;
+}
+
+ThermalLevel ThermalGovernor::assess(int32_t headroom_mc, int32_t predicted_headroom_mc,
+                                     bool saturated) const {
+    if (headroom_mc <= 0)                         return ThermalLevel::CRITICAL;
+    if (predicted_headroom_mc <= 0)               return ThermalLevel::HOT;
+    if (predicted_headroom_mc <= WARM_MARGIN_MC)  return ThermalLevel::WARM;
+    if (saturated)                                return ThermalLevel::WARM;
+    return ThermalLevel::NORMAL;
+}
+
+// ---------------------------------------------------------------------------
+// getStats()
+// ---------------------------------------------------------------------------
+ThermalGovernor::Stats ThermalGovernor::getStats() const {
+    Stats stats;
+    stats.level        = level_.load();
+    stats.temp_mc      = temp_mc_.load();
+    stats.predicted_mc = predicted_mc_.load();
+    stats.trip_mc      = trip_mc_.load();
+    stats.encoder_load = encoder_load_.load();
+    return stats;
+}
+
+// ---------------------------------------------------------------------------
+// sysfs readers
+// ---------------------------------------------------------------------------
+bool ThermalGovernor::readNearestZone(int32_t& temp_mc, int32_t& trip_mc) const {
+    bool found = false;
+    for (const Zone& zone : zones_) {
+        long long temp = 0;
+        if (!readInt(zone.temp_path, temp)) continue;
+        const int32_t t = static_cast<int32_t>(temp);
+        if (!found || zone.trip_mc - t < trip_mc - temp_mc) {
+            temp_mc = t;
+            trip_mc = zone.trip_mc;
+            found = true;
+        }
+    }
+    return found;
+}
+
+uint32_t ThermalGovernor::readEncoderLoad() {
+    // NVENC, and the VIC that converts its input (as JetsonEncoder reads it)
+    static const char* const kLoadPaths[] = {
+        "/sys/devices/platform/host1x/154c0000.nvenc/load",
+        "/sys/devices/platform/host1x/15340000.vic/load",
+    };
+    uint32_t load = 0;
+    for (const char* path : kLoadPaths) {
+        long long value = 0;
+        if (readInt(path, value) && value > 0) {
+            load = std::max(load, static_cast<uint32_t>(std::min(value, 100LL)));
+        }
+    }
+    return load;
+}
+
+bool ThermalGovernor::readLowPowerMode() {
+    std::ifstream f("/var/lib/nvpmodel/status");
+    std::string status;
+    if (!f.is_open() || !std::getline(f, status)) return false;
+    return status.find("7W") != std::string::npos ||
+           status.find("10W") != std::string::npos ||
+           status.find("15W") != std::string::npos;
+}
+
+} // namespace cs::host
@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////////
+// thermal_governor.h -- Predictive thermal / power governor
+//
+// A fanless Jetson (Orin NX, Orin Nano) heats up over minutes of streaming
+// until the SoC's passive trip point clocks it down; encode time then jumps
+// and frames drop.  Reacting at the trip point is too late, and stepping
+// straight back up once it cools only starts the cycle again.
+//
+// ThermalGovernor samples the thermal zones that have a passive trip point
+// about once a second, takes the one nearest its trip, and keeps a smoothed
+// slope of that headroom to predict it HORIZON_S ahead.  Together with
+// encoder load and the nvpmodel power mode it picks a level:
+//
+//   NORMAL    predicted headroom more than WARM_MARGIN
+//   WARM      predicted within WARM_MARGIN of the trip, or encoder saturated
+//   HOT       predicted at or past the trip
+//   CRITICAL  already at it: the SoC is throttling
+//
+// The QoS controller trades resolution and frame rate down the preset's
+// ladders as the level rises (QosController::setThermalLevel()).  Levels
+// rise as soon as predicted and fall one at a time, only after the zones
+// have held clear under the trip point for COOL_DOWN_US.
+//
+// Where there are no thermal zones (anything but Linux) the governor stays
+// NORMAL and costs nothing.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// ThermalLevel -- how hard the governor is holding the encoder back
+// ---------------------------------------------------------------------------
+enum class ThermalLevel : uint8_t {
+    NORMAL   = 0,
+    WARM     = 1,
+    HOT      = 2,
+    CRITICAL = 3,
+};
+
+inline const char* thermalLevelName(ThermalLevel level) {
+    switch (level) {
+        case ThermalLevel::NORMAL:   return "NORMAL";
+        case ThermalLevel::WARM:     return "WARM";
+        case ThermalLevel::HOT:      return "HOT";
+        case ThermalLevel::CRITICAL: return "CRITICAL";
+    }
+    return "UNKNOWN";
+}
+
+// ---------------------------------------------------------------------------
+// ThermalGovernor
+// ---------------------------------------------------------------------------
+class ThermalGovernor {
+public:
+    ThermalGovernor() = default;
+    ~ThermalGovernor() = default;
+
+    /// Find the thermal zones and their passive trip points.  Returns false
+    /// if there are none; update() then does nothing.
+    bool initialize();
+
+    /// Take a sample if SAMPLE_INTERVAL_US has passed since the last one.
+    /// Returns true if the level changed.  Called from one thread.
+    bool update(uint64_t now_us);
+
+    /// Current level.  Thread-safe.
+    ThermalLevel getLevel() const { return level_.load(); }
+
+    struct Stats {
+        ThermalLevel level          = ThermalLevel::NORMAL;
+        int32_t      temp_mc        = 0;   // Zone nearest its trip, millidegrees C
+        int32_t      predicted_mc   = 0;   // That zone HORIZON_S ahead
+        int32_t      trip_mc        = 0;   // Its passive trip point
+        uint32_t     encoder_load   = 0;   // Percent
+    };
+
+    /// Latest sample.  Thread-safe.
+    Stats getStats() const;
+
+private:
+    /// Read the zone with the least headroom under its trip point into
+    /// |temp_mc| / |trip_mc|.  False if no zone could be read.
+    bool readNearestZone(int32_t& temp_mc, int32_t& trip_mc) const;
+
+    /// Encoder load (0 - 100) where the platform reports it, else 0.
+    static uint32_t readEncoderLoad();
+
+    /// True in the nvpmodel modes that cap the clocks (7 W, 10 W, 15 W).
+    static bool readLowPowerMode();
+
+    /// Level the sample calls for.
+    ThermalLevel assess(int32_t headroom_mc, int32_t predicted_headroom_mc,
+                        bool saturated) const;
+
+    struct Zone {
+        std::string temp_path;                // .../thermal_zoneN/temp
+        int32_t     trip_mc = 0;              // Lowest passive trip point
+    };
+    std::vector<Zone>        zones_;
+
+    // Sampling (update() thread)
+    uint64_t                 last_sample_us_  = 0;
+    int32_t                  last_headroom_mc_ = 0;
+    double                   slope_mc_per_s_  = 0.0;  // Headroom lost per second, smoothed
+    uint32_t                 saturated_samples_ = 0;
+    uint64_t                 clear_since_us_  = 0;    // 0 = not clear
+
+    // Published (any thread)
+    std::atomic<ThermalLevel> level_{ThermalLevel::NORMAL};
+    std::atomic<int32_t>     temp_mc_{0};
+    std::atomic<int32_t>     predicted_mc_{0};
+    std::atomic<int32_t>     trip_mc_{0};
+    std::atomic<uint32_t>    encoder_load_{0};
+
+    static constexpr uint32_t MAX_ZONES          = 32;
+    static constexpr int32_t  DEFAULT_TRIP_MC    = 85000;   // If no zone has a passive trip
+    static constexpr uint64_t SAMPLE_INTERVAL_US = 1'000'000;
+    static constexpr double   SLOPE_ALPHA        = 0.3;     // EWMA weight of a new slope
+    static constexpr double   HORIZON_S          = 20.0;    // Prediction look-ahead
+    static constexpr int32_t  WARM_MARGIN_MC     = 5000;    // WARM this far under the trip
+    static constexpr int32_t  CLEAR_MARGIN_MC    = 8000;    // Level falls only this far under
+    static constexpr uint64_t COOL_DOWN_US       = 15'000'000;
+    static constexpr uint32_t SATURATED_LOAD     = 90;      // Encoder load counted as saturated
+    static constexpr uint32_t SATURATED_LOAD_LOW_POWER = 80;
+    static constexpr uint32_t SATURATED_SAMPLES  = 3;       // Consecutive samples
+};
+
+} // namespace cs::host
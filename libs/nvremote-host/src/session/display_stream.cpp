@@ -0,0 +1,205 @@
+///////////////////////////////////////////////////////////////////////////////
+// display_stream.cpp -- One more display of a session, on its own encoder
+///////////////////////////////////////////////////////////////////////////////
+
+#include "display_stream.h"
+
+#include "cs/common.h"
+#include "cs/thread_policy.h"
+#include "session/frame_pacer.h"
+
+#include <algorithm>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// Construction / destruction
+// ---------------------------------------------------------------------------
+DisplayStream::DisplayStream(uint8_t stream_id, uint32_t output_index,
+                             std::unique_ptr<ICaptureDevice> capture,
+                             std::unique_ptr<IEncoder> encoder)
+    : stream_id_(stream_id),
+      output_index_(output_index),
+      capture_(std::move(capture)),
+      encoder_(std::move(encoder)) {}
+
+DisplayStream::~DisplayStream() {
+    stop();
+}
+
+// ---------------------------------------------------------------------------
+// open() -- capture the output and open its encoder
+// ---------------------------------------------------------------------------
+bool DisplayStream::open(int gpu_index, const EncoderConfig& base) {
+    if (!capture_->selectOutput(output_index_) || !capture_->initialize(gpu_index)) {
+        CS_LOG(ERR, "Display %u: cannot capture output %u",
+               static_cast<unsigned>(stream_id_), output_index_);
+        return false;
+    }
+
+    // Any capture, even one that finds the display unchanged, reports its
+    // size: the encoder codes the display at that.
+    CapturedFrame probe;
+    capture_->setUpdateWait(0);
+    if (!capture_->captureFrame(probe) || probe.width == 0 || probe.height == 0) {
+        CS_LOG(ERR, "Display %u: output %u has no picture",
+               static_cast<unsigned>(stream_id_), output_index_);
+        capture_->release();
+        return false;
+    }
+
+    config_ = base;
+    config_.width           = probe.width;
+    config_.height          = probe.height;
+    config_.gop_length      = INFINITE_GOP;     // Keyframes on loss only
+    config_.enable_intra_refresh = true;
+    config_.intra_refresh_period = std::max(base.fps, 1u);
+    config_.enable_ltr      = false;
+    config_.temporal_layers = 1;
+    config_.slices          = 1;
+    config_.async_depth     = 1;
+    config_.yuv444          = false;
+    config_.bit_depth       = 8;
+    config_.input_format    = FrameFormat::BGRA8;
+
+    encoder_->setInputDevice(capture_->getFrameMemory(), capture_->getFrameDevice());
+    if (!encoder_->initialize(config_)) {
+        CS_LOG(ERR, "Display %u: encoder did not open at %ux%u",
+               static_cast<unsigned>(stream_id_), config_.width, config_.height);
+        capture_->release();
+        return false;
+    }
+
+    CS_LOG(INFO, "Display %u: output %u, %ux%u %s @ %u kbps",
+           static_cast<unsigned>(stream_id_), output_index_, config_.width, config_.height,
+           encoder_->getCodecName().c_str(), config_.bitrate_kbps);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// start() / stop()
+// ---------------------------------------------------------------------------
+bool DisplayStream::start(SendFunc send) {
+    if (running_.load()) return true;
+
+    send_ = std::move(send);
+    frame_number_.store(0);
+    have_keyframe_.store(false);
+    force_idr_.store(true);
+    should_stop_.store(false);
+    running_.store(true);
+    thread_ = std::thread(&DisplayStream::streamLoop, this);
+    return true;
+}
+
+void DisplayStream::stop() {
+    should_stop_.store(true);
+    if (thread_.joinable()) thread_.join();
+    if (running_.exchange(false)) {
+        CS_LOG(INFO, "Display %u stopped after %llu frames", static_cast<unsigned>(stream_id_),
+               static_cast<unsigned long long>(frames_sent_.load()));
+    }
+    encoder_->release();
+    capture_->release();
+}
+
+// ---------------------------------------------------------------------------
+// onFrameLoss()
+// ---------------------------------------------------------------------------
+void DisplayStream::onFrameLoss(uint32_t first, uint32_t last) {
+    if (frame_number_.load() == 0) return;
+    if (static_cast<int32_t>(last - first) < 0) return;
+
+    // The viewer repeats a report until it is repaired; a keyframe sent
+    // since the loss, or one already asked for, does that.
+    if (have_keyframe_.load() && static_cast<int32_t>(last - last_keyframe_.load()) < 0) return;
+    if (force_idr_.exchange(true)) return;
+
+    keyframe_requests_.fetch_add(1);
+    CS_LOG(INFO, "Display %u lost frames %u-%u -- requesting IDR",
+           static_cast<unsigned>(stream_id_), first, last);
+}
+
+// ---------------------------------------------------------------------------
+// getStats()
+// ---------------------------------------------------------------------------
+DisplayStream::Stats DisplayStream::getStats() const {
+    Stats stats;
+    stats.frames_sent       = frames_sent_.load();
+    stats.keyframe_requests = keyframe_requests_.load();
+    return stats;
+}
+
+// ---------------------------------------------------------------------------
+// streamLoop() -- capture, encode and send one display
+// ---------------------------------------------------------------------------
+void DisplayStream::streamLoop() {
+    cs::ScopedThreadRole role(cs::ThreadRole::CAPTURE);
+
+    // Frames are taken as the display changes, at most one a frame
+    // interval; the capture waits for the change where it can.
+    const bool capture_driven = capture_->waitsForUpdates();
+    capture_->setUpdateWait(capture_driven ? UPDATE_WAIT_MS : 0);
+    const uint64_t frame_interval_us = 1'000'000ULL / std::max(config_.fps, 1u);
+
+    FramePacer    pacer;
+    CapturedFrame frame;
+    CapturedFrame last;             // Newest picture, re-encoded for a keyframe
+    bool          have_last = false;
+    EncodedPacket encoded;
+
+    while (!should_stop_.load()) {
+        const uint64_t frame_start_us = cs::getTimestampUs();
+
+        if (!capture_->captureFrame(frame)) {
+            pacer.sleepFor(frame_interval_us);
+            continue;
+        }
+        if (frame.is_new_frame) {
+            last = frame;
+            have_last = true;
+        }
+
+        // A keyframe is wanted even of a display that has not changed: it
+        // is coded from the picture last captured, whose surface the
+        // capture has not written since.
+        const bool idr = force_idr_.load();
+        if (have_last && (frame.is_new_frame || idr)) {
+            if (const uint32_t kbps = pending_bitrate_.exchange(0)) {
+                config_.bitrate_kbps = kbps;
+                encoder_->reconfigure(config_);
+            }
+            if (idr) encoder_->forceIdr();
+
+            const uint32_t number = frame_number_.load();
+            encoded.frame_number = number;
+            if (!encoder_->encode(last, encoded)) {
+                CS_LOG(WARN, "Display %u: encode failed for frame %u",
+                       static_cast<unsigned>(stream_id_), number);
+                force_idr_.store(true);
+            } else if (!send_(encoded, number)) {
+                force_idr_.store(true);
+            } else {
+                // The request stands until a keyframe is out, so reports
+                // repeated meanwhile ask for nothing more.
+                if (encoded.is_keyframe) {
+                    last_keyframe_.store(number);
+                    have_keyframe_.store(true);
+                    force_idr_.store(false);
+                }
+                frame_number_.store(number + 1);
+                frames_sent_.fetch_add(1);
+            }
+            encoded.release();
+        }
+
+        // Cap the rate at the session's frame rate.  On a timer-paced
+        // capture this is what spaces the captures.
+        const uint64_t now = cs::getTimestampUs();
+        if (now < frame_start_us + frame_interval_us) {
+            pacer.sleepFor(frame_start_us + frame_interval_us - now);
+        }
+    }
+}
+
+} // namespace cs::host
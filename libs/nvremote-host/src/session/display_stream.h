@@ -0,0 +1,108 @@
+///////////////////////////////////////////////////////////////////////////////
+// display_stream.h -- One more display of a session, on its own encoder
+//
+// A session streams its primary display through the SessionManager's own
+// capture and encoder.  Each further display is a DisplayStream: a
+// DxgiCapture of that output and an encoder session of its own, driven by
+// a thread of its own, so one display's encode never waits on another's.
+// On the wire each display is its own video stream, with the stream ID in
+// the video header (CS05) and frame numbers of its own; the session
+// packetizes every stream into the one sequence space, NACK cache and FEC.
+//
+// An extra display is kept simple: whole 4:2:0 frames, one temporal
+// layer, no long-term references, encoded as the desktop changes at up to
+// the session's frame rate.  A loss is answered with a keyframe.  Its
+// bitrate is its share of the QoS controller's budget (setBitrate()).
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "capture/capture_interface.h"
+#include "encode/encoder_interface.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace cs::host {
+
+class DisplayStream {
+public:
+    /// Display |output_index| of the GPU, sent as video stream |stream_id|.
+    DisplayStream(uint8_t stream_id, uint32_t output_index,
+                  std::unique_ptr<ICaptureDevice> capture,
+                  std::unique_ptr<IEncoder> encoder);
+    ~DisplayStream();
+
+    // Non-copyable
+    DisplayStream(const DisplayStream&) = delete;
+    DisplayStream& operator=(const DisplayStream&) = delete;
+
+    uint8_t getStreamId() const { return stream_id_; }
+
+    /// Open the capture of the output on GPU |gpu_index| and the encoder
+    /// on its device with |base| (codec, bitrate, frame rate; the size is
+    /// the display's).  False if either cannot be opened.
+    bool open(int gpu_index, const EncoderConfig& base);
+
+    /// Called (stream thread) with each encoded frame and its stream frame
+    /// number.  Returns false if the frame could not be sent; it then
+    /// takes no number and the next frame is a keyframe.
+    using SendFunc = std::function<bool(const EncodedPacket& packet, uint32_t frame_number)>;
+
+    /// Start capturing and encoding, handing frames to |send|.
+    bool start(SendFunc send);
+
+    /// Stop the thread and release the capture and encoder.
+    void stop();
+
+    /// Code at |kbps| from the next frame on.
+    void setBitrate(uint32_t kbps) { pending_bitrate_.store(kbps); }
+
+    /// Make the next frame a keyframe.
+    void forceIdr() { force_idr_.store(true); }
+
+    /// The viewer lost frames |first| .. |last| of this stream (feedback
+    /// thread).
+    void onFrameLoss(uint32_t first, uint32_t last);
+
+    /// Pixels per frame, to weigh the display's share of the bitrate.
+    uint64_t getArea() const { return static_cast<uint64_t>(config_.width) * config_.height; }
+
+    struct Stats {
+        uint64_t frames_sent       = 0;
+        uint64_t keyframe_requests = 0;
+    };
+    Stats getStats() const;
+
+private:
+    /// Capture, encode and send until stop() (thread_).
+    void streamLoop();
+
+    const uint8_t                     stream_id_;
+    const uint32_t                    output_index_;
+    std::unique_ptr<ICaptureDevice>   capture_;
+    std::unique_ptr<IEncoder>         encoder_;
+    EncoderConfig                     config_;
+    SendFunc                          send_;
+
+    std::thread                       thread_;
+    std::atomic<bool>                 running_{false};
+    std::atomic<bool>                 should_stop_{false};
+    std::atomic<bool>                 force_idr_{false};
+    std::atomic<uint32_t>             pending_bitrate_{0};   // 0 = unchanged
+
+    std::atomic<uint32_t>             frame_number_{0};      // Next stream frame
+    std::atomic<bool>                 have_keyframe_{false};
+    std::atomic<uint32_t>             last_keyframe_{0};
+
+    std::atomic<uint64_t>             frames_sent_{0};
+    std::atomic<uint64_t>             keyframe_requests_{0};
+
+    // Longest a capture waits for the display to change before the loop
+    // comes round again (stop, keyframe requests).
+    static constexpr uint32_t UPDATE_WAIT_MS = 100;
+};
+
+} // namespace cs::host
@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////////////
+// frame_pacer.cpp -- Frame interval timer implementation
+///////////////////////////////////////////////////////////////////////////////
+
+#include "frame_pacer.h"
+
+#include "cs/common.h"
+
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <Windows.h>
+#  ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#    define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#  endif
+#elif defined(__linux__)
+#  include <cerrno>
+#  include <time.h>
+#endif
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// Construction / destruction
+// ---------------------------------------------------------------------------
+
+FramePacer::FramePacer() {
+#ifdef _WIN32
+    timer_ = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                    TIMER_ALL_ACCESS);
+    high_res_ = timer_ != nullptr;
+    if (!timer_) {
+        timer_ = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+        CS_LOG(INFO, "FramePacer: no high-resolution timer, spinning the last %llu us",
+               static_cast<unsigned long long>(SPIN_US));
+    }
+#elif defined(__linux__)
+    high_res_ = true;
+#endif
+}
+
+FramePacer::~FramePacer() {
+#ifdef _WIN32
+    if (timer_) CloseHandle(timer_);
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// sleepFor
+// ---------------------------------------------------------------------------
+
+void FramePacer::sleepFor(uint64_t delay_us) {
+    if (delay_us == 0) return;
+
+#ifdef _WIN32
+    if (!timer_) {
+        std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+        return;
+    }
+
+    LARGE_INTEGER start;
+    LARGE_INTEGER freq;
+    QueryPerformanceCounter(&start);
+    QueryPerformanceFrequency(&freq);
+
+    uint64_t timed_us = delay_us;
+    if (!high_res_) timed_us = delay_us > SPIN_US ? delay_us - SPIN_US : 0;
+    if (timed_us > 0) {
+        LARGE_INTEGER due;
+        due.QuadPart = -static_cast<LONGLONG>(timed_us * 10);   // Relative, 100 ns units
+        if (SetWaitableTimer(timer_, &due, 0, nullptr, nullptr, FALSE)) {
+            WaitForSingleObject(timer_, INFINITE);
+        }
+    }
+    if (high_res_) return;
+
+    const LONGLONG end = start.QuadPart +
+        static_cast<LONGLONG>(delay_us) * freq.QuadPart / 1'000'000;
+    LARGE_INTEGER now;
+    do {
+        YieldProcessor();
+        QueryPerformanceCounter(&now);
+    } while (now.QuadPart < end);
+#elif defined(__linux__)
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec  += static_cast<time_t>(delay_us / 1'000'000);
+    deadline.tv_nsec += static_cast<long>(delay_us % 1'000'000) * 1000;
+    if (deadline.tv_nsec >= 1'000'000'000) {
+        deadline.tv_sec  += 1;
+        deadline.tv_nsec -= 1'000'000'000;
+    }
+    // Absolute, so a signal part way through does not stretch the wait
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+    }
+#else
+    std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// threadCpuTimeUs
+// ---------------------------------------------------------------------------
+
+uint64_t threadCpuTimeUs() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) return 0;
+    auto to100ns = [](const FILETIME& ft) {
+        return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    };
+    return (to100ns(kernel) + to100ns(user)) / 10;
+#elif defined(__linux__)
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+    return static_cast<uint64_t>(ts.tv_sec) * 1'000'000 +
+           static_cast<uint64_t>(ts.tv_nsec) / 1000;
+#else
+    return 0;
+#endif
+}
+
+} // namespace cs::host
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// frame_pacer.h -- Frame interval timer for the streaming loop
+//
+// Sleeps the capture thread until the next frame is due without spinning:
+//   - Windows: a high-resolution waitable timer
+//     (CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, Windows 10 1803+).  On older
+//     systems a plain waitable timer, which wakes on the scheduler tick, so
+//     only the last SPIN_US before the deadline are then spun.
+//   - Linux: clock_nanosleep() on CLOCK_MONOTONIC to an absolute deadline.
+//
+// Where the capture backend can block until the desktop changes, the loop
+// may instead be driven by the capture (PacingMode::CAPTURE) and the pacer
+// only holds frames to the target rate.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstdint>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// PacingMode -- what decides when the next frame is captured
+// ---------------------------------------------------------------------------
+enum class PacingMode {
+    AUTO,       // CAPTURE if the capture backend waits for updates, else TIMER
+    TIMER,      // Capture on a steady clock at the target frame rate
+    CAPTURE,    // Capture as the desktop changes, at most at the target rate
+};
+
+inline const char* pacingModeName(PacingMode mode) {
+    switch (mode) {
+        case PacingMode::AUTO:    return "auto";
+        case PacingMode::TIMER:   return "timer";
+        case PacingMode::CAPTURE: return "capture";
+    }
+    return "unknown";
+}
+
+// ---------------------------------------------------------------------------
+// FramePacer
+// ---------------------------------------------------------------------------
+class FramePacer {
+public:
+    FramePacer();
+    ~FramePacer();
+
+    // Non-copyable
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    /// Block the calling thread for |delay_us|.
+    void sleepFor(uint64_t delay_us);
+
+    /// True if sleepFor() wakes close to its deadline without spinning.
+    bool isHighResolution() const { return high_res_; }
+
+private:
+#ifdef _WIN32
+    // Tail of a wait spun without a high-resolution timer
+    static constexpr uint64_t SPIN_US = 1500;
+
+    void* timer_ = nullptr;     // HANDLE
+#endif
+    bool  high_res_ = false;
+};
+
+/// CPU time the calling thread has used, in microseconds (0 if unknown).
+uint64_t threadCpuTimeUs();
+
+} // namespace cs::host
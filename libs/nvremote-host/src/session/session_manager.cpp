@@ -7,11 +7,15 @@
 #include "cs/common.h"
 #include "cs/qos/gaming_modes.h"
 #include "cs/qos/feedback_packet.h"
+#include "cs/qos/transport_feedback.h"
+#include "cs/thread_policy.h"
+#include "cs/trace.h"
 #include "cs/transport/packet.h"
 
 #include "capture/nvfbc_capture.h"
 #include "capture/dxgi_capture.h"
 #include "encode/nvenc_encoder.h"
+#include "encode/color_converter.h"
 
 #include <algorithm>
 #include <cstring>
@@ -51,8 +55,36 @@ inline uint64_t hires_now_us() { return cs::getTimestampUs(); }
 // Exponential moving average factor for timing stats
 constexpr float EMA_ALPHA = 0.1f;
 
-// Maximum UDP payload for a single video fragment
-constexpr size_t MAX_FRAGMENT_PAYLOAD = MAX_VIDEO_PAYLOAD;
+// Longest a capture-driven capture waits for the desktop to change before
+// the loop comes round again (liveness, IDR requests) with a duplicate.
+constexpr uint32_t CAPTURE_UPDATE_WAIT_MS = 100;
+
+// Window over which the pacing thread's CPU use is measured.
+constexpr uint64_t PACING_CPU_WINDOW_US = 1'000'000;
+
+// Slices per frame when the session does not ask for a number.  Below
+// 1440p a frame takes too little time on the wire and in the encoder for
+// streaming it in slices to pay for their coding cost.
+constexpr uint32_t AUTO_SLICES       = 4;
+constexpr uint32_t AUTO_SLICE_HEIGHT = 1440;
+
+// Send shards when the session does not ask for a number: from about
+// 100 Mbps one thread sealing and writing every datagram falls behind a
+// frame interval, so up to AUTO_SEND_SHARDS take a share of each frame --
+// one per two cores, leaving room for capture and encode.
+constexpr uint32_t AUTO_SEND_SHARDS      = 4;
+constexpr uint32_t AUTO_SEND_SHARDS_KBPS = 100000;
+
+// The |n|th session's recording: |path|, then "name-2.ext", "name-3.ext"...
+std::string recordingPath(const std::string& path, uint32_t n) {
+    if (n <= 1) return path;
+    const size_t slash = path.find_last_of("/\\");
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        dot = path.size();
+    }
+    return path.substr(0, dot) + "-" + std::to_string(n) + path.substr(dot);
+}
 
 // Convert host CodecType to wire cs::CodecType
 cs::CodecType toWireCodec(CodecType ct) {
@@ -64,6 +96,24 @@ cs::CodecType toWireCodec(CodecType ct) {
     return cs::CodecType::H264;
 }
 
+// The thread policies |config| asks for: its spec over the defaults, and
+// each stage's core as its role's CPUs where the spec names none.
+cs::ThreadPolicies threadPolicies(const SessionConfig& config) {
+    cs::ThreadPolicies policies = cs::defaultThreadPolicies();
+    std::string error;
+    if (!cs::parseThreadPolicies(config.threads, policies, &error)) {
+        CS_LOG(WARN, "Ignoring thread policy spec: %s", error.c_str());
+    }
+    auto pin = [&policies](cs::ThreadRole role, int core) {
+        cs::ThreadPolicy& policy = policies[static_cast<size_t>(role)];
+        if (core >= 0 && core < 64 && policy.cpus == 0) policy.cpus = uint64_t(1) << core;
+    };
+    pin(cs::ThreadRole::CAPTURE, config.capture_core);
+    pin(cs::ThreadRole::ENCODE,  config.encode_core);
+    pin(cs::ThreadRole::SEND,    config.send_core);
+    return policies;
+}
+
 } // anonymous namespace
 
 // ---------------------------------------------------------------------------
@@ -122,6 +172,12 @@ bool SessionManager::initialize() {
     }
 
     encoder_ = std::move(nvenc);
+    if (!gpu_.initialize()) {
+        CS_LOG(INFO, "NVML not available -- no encoder utilization in stats");
+    }
+
+    // The first session's DTLS identity is generated while nothing waits
+    identities_.start();
 
     initialized_ = true;
     CS_LOG(INFO, "SessionManager initialized successfully");
@@ -142,6 +198,15 @@ bool SessionManager::prepareSession(const SessionConfig& config) {
     }
 
     current_config_ = config;
+    prepare_start_us_ = cs::getTimestampUs();
+
+    // Applies to the threads the session starts from here on
+    cs::setThreadPolicies(threadPolicies(config));
+
+    // --- Gaming mode preset ---
+    cs::Resolution native_res = {config.width, config.height};
+    current_preset_ = cs::getPreset(config.gaming_mode, native_res);
+    CS_LOG(INFO, "Gaming mode: %s", cs::gamingModeToString(config.gaming_mode).c_str());
 
     // --- Configure encoder ---
     EncoderConfig enc_cfg;
@@ -150,24 +215,54 @@ bool SessionManager::prepareSession(const SessionConfig& config) {
     enc_cfg.height       = config.height;
     enc_cfg.bitrate_kbps = config.bitrate_kbps;
     enc_cfg.fps          = config.fps;
-    enc_cfg.gop_length   = config.fps * 2;  // 2 seconds of GOP
+    enc_cfg.gop_length   = INFINITE_GOP;    // Acked LTRs replace periodic IDRs
     enc_cfg.enable_intra_refresh = true;
     enc_cfg.intra_refresh_period = config.fps;
+    enc_cfg.enable_ltr   = true;
+    enc_cfg.ltr_interval = std::max(config.fps / 2, 1u);
+    enc_cfg.temporal_layers = config.temporal_layers;
+    enc_cfg.slices       = config.slices ? config.slices
+                         : (config.height >= AUTO_SLICE_HEIGHT ? AUTO_SLICES : 1);
+    enc_cfg.async_depth  = config.encode_depth;
+    enc_cfg.split_encode = config.split_encode;
+
+    // Open the encoder on the device the capture writes to, so GPU frames
+    // go to it without a copy.  The capture may have been released by the
+    // last session; initialize() is a no-op if it was not.
+    if (!capture_->initialize(0)) {
+        CS_LOG(ERR, "Failed to initialize capture device");
+        return false;
+    }
+    encoder_->setInputDevice(capture_->getFrameMemory(), capture_->getFrameDevice());
 
-    if (!encoder_->initialize(enc_cfg)) {
+    // A standby encoder from the last session is restarted where it can be
+    const uint64_t open_start_us = cs::getTimestampUs();
+    bool warm = false;
+    if (!openEncoder(enc_cfg, warm)) {
         CS_LOG(ERR, "Failed to initialize encoder with %ux%u %s @ %u kbps",
                config.width, config.height,
                codecTypeName(config.codec), config.bitrate_kbps);
         return false;
     }
-    CS_LOG(INFO, "Encoder configured: %ux%u %s @ %u kbps, %u fps",
+    const float open_ms = static_cast<float>(cs::getTimestampUs() - open_start_us) / 1000.0f;
+    CS_LOG(INFO, "Encoder configured: %ux%u %s @ %u kbps, %u fps (%s in %.1f ms)",
            config.width, config.height,
-           codecTypeName(config.codec), config.bitrate_kbps, config.fps);
+           codecTypeName(config.codec), config.bitrate_kbps, config.fps,
+           warm ? "restarted" : "opened", open_ms);
+
+    // QoS may lower the resolution where something ahead of the encoder
+    // scales.  The capture goes back to the desktop's size (a previous
+    // session may have scaled it), which also tells whether it can.
+    pending_size_.store(0);
+    scalable_ = encoder_->canResize() &&
+                (converter_ != nullptr || capture_->setOutputSize(0, 0));
+    if (!scalable_) {
+        CS_LOG(INFO, "Frames cannot be scaled ahead of the encoder -- resolution stays %ux%u",
+               config.width, config.height);
+    }
 
-    // --- Gaming mode preset ---
-    cs::Resolution native_res = {config.width, config.height};
-    current_preset_ = cs::getPreset(config.gaming_mode, native_res);
-    CS_LOG(INFO, "Gaming mode: %s", cs::gamingModeToString(config.gaming_mode).c_str());
+    // --- Extra displays ---
+    openDisplays(enc_cfg);
 
     // --- FEC encoder ---
     fec_ = std::make_unique<FecEncoder>();
@@ -175,7 +270,8 @@ bool SessionManager::prepareSession(const SessionConfig& config) {
     CS_LOG(INFO, "FEC redundancy ratio: %.2f", fec_->getRedundancyRatio());
 
     // --- DTLS context (server role for host) ---
-    dtls_ = std::make_unique<cs::DtlsContext>(true);
+    dtls_ = std::make_unique<cs::DtlsContext>(
+        true, identities_.acquire(static_cast<uint64_t>(config.dtls_identity_reuse_s) * 1'000'000));
     CS_LOG(INFO, "DTLS fingerprint: %s", dtls_->getFingerprint().c_str());
 
     // --- ICE agent ---
@@ -183,7 +279,8 @@ bool SessionManager::prepareSession(const SessionConfig& config) {
     if (stun.empty()) {
         stun.push_back("stun.l.google.com");
     }
-    ice_ = std::make_unique<cs::IceAgent>(stun);
+    ice_ = std::make_unique<cs::IceAgent>(stun, config.turn_servers);
+    ice_->setTurnPool(&turn_pool_);
     auto candidates = ice_->gatherCandidates();
     CS_LOG(INFO, "ICE gathered %zu candidates", candidates.size());
 
@@ -195,9 +292,22 @@ bool SessionManager::prepareSession(const SessionConfig& config) {
     frame_number_ = 0;
     video_seq_    = 0;
     audio_seq_    = 0;
+    wire_version_ = 1;
     avg_capture_ms_ = 0.0f;
     avg_encode_ms_  = 0.0f;
 
+    // Reset loss recovery
+    {
+        std::lock_guard<std::mutex> lock(loss_mutex_);
+        loss_pending_    = false;
+        ltr_ack_pending_ = false;
+    }
+    sent_frames_.fill(SentFrame{});
+    have_recovery_ = false;
+    mark_recovery_ = false;
+    have_keyframe_ = false;
+    last_encoder_frame_ = 0;
+
     // Reset stats
     {
         std::lock_guard<std::mutex> lock(stats_mutex_);
@@ -208,8 +318,17 @@ bool SessionManager::prepareSession(const SessionConfig& config) {
         stats_.bitrate_kbps = config.bitrate_kbps;
         stats_.codec       = codecTypeName(config.codec);
         stats_.gaming_mode = cs::gamingModeToString(config.gaming_mode);
+        stats_.displays    = static_cast<uint32_t>(1 + displays_.size());
+        stats_.warm_start      = warm;
+        stats_.encoder_open_ms = open_ms;
+        stats_.encoder_engines    = encoder_->getEngines();
+        stats_.encoder_split_ways = encoder_->getSplitWays();
     }
 
+    // Each session starts unclassified, and a restarted encoder untuned
+    content_.reset();
+    encoder_->setContentClass(ContentClass::UNKNOWN);
+
     prepared_ = true;
     CS_LOG(INFO, "Session '%s' prepared successfully", config.session_id.c_str());
     return true;
@@ -228,116 +347,15 @@ bool SessionManager::startSession(const PeerInfo& peer) {
         return false;
     }
 
-    // --- Set up UDP socket ---
-    udp_socket_ = static_cast<int>(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
-    if (udp_socket_ < 0) {
-        CS_LOG(ERR, "Failed to create UDP socket: %d", cs_socket_error());
-        return false;
-    }
-
-    // Bind to any local address
-    struct sockaddr_in local_addr;
-    std::memset(&local_addr, 0, sizeof(local_addr));
-    local_addr.sin_family = AF_INET;
-    local_addr.sin_addr.s_addr = INADDR_ANY;
-    local_addr.sin_port = 0;  // OS picks a port
-
-    if (::bind(udp_socket_, reinterpret_cast<struct sockaddr*>(&local_addr),
-               sizeof(local_addr)) < 0) {
-        CS_LOG(ERR, "Failed to bind UDP socket: %d", cs_socket_error());
-        cs_close_socket(udp_socket_);
-        udp_socket_ = -1;
-        return false;
-    }
-
-    // Resolve peer address
-    std::memset(&peer_addr_, 0, sizeof(peer_addr_));
-    peer_addr_.sin_family = AF_INET;
-    peer_addr_.sin_port   = htons(peer.port);
-    if (::inet_pton(AF_INET, peer.ip.c_str(), &peer_addr_.sin_addr) != 1) {
-        CS_LOG(ERR, "Invalid peer IP address: %s", peer.ip.c_str());
-        cs_close_socket(udp_socket_);
-        udp_socket_ = -1;
+    // --- UDP socket, DTLS handshake, media keys ---
+    ViewerConnection conn;
+    if (!connectViewer(peer, dtls_.get(), conn)) {
         return false;
     }
-
-    CS_LOG(INFO, "Peer address: %s:%u", peer.ip.c_str(), peer.port);
-
-    // --- DTLS handshake ---
-    if (dtls_) {
-        CS_LOG(INFO, "Starting DTLS handshake...");
-        bool handshake_ok = dtls_->handshake(
-            udp_socket_,
-            reinterpret_cast<const struct sockaddr*>(&peer_addr_),
-            static_cast<int>(sizeof(peer_addr_)));
-
-        if (!handshake_ok) {
-            CS_LOG(ERR, "DTLS handshake failed");
-            cs_close_socket(udp_socket_);
-            udp_socket_ = -1;
-            return false;
-        }
-        CS_LOG(INFO, "DTLS handshake completed");
-
-        // Exchange protocol version tag (CS01) with the viewer.
-        // Host sends first, then waits for the viewer's response.
-        if (dtls_->isEstablished()) {
-            uint8_t enc_buf[cs::PROTOCOL_VERSION_TAG_LEN + 256];
-            size_t enc_len = 0;
-            if (!dtls_->encrypt(cs::PROTOCOL_VERSION_TAG,
-                                cs::PROTOCOL_VERSION_TAG_LEN, enc_buf, &enc_len)) {
-                CS_LOG(ERR, "Failed to send protocol version tag");
-                cs_close_socket(udp_socket_);
-                udp_socket_ = -1;
-                return false;
-            }
-            // Send encrypted version tag
-            if (enc_len > 0) {
-                ::sendto(udp_socket_, reinterpret_cast<const char*>(enc_buf),
-                         static_cast<int>(enc_len), 0,
-                         reinterpret_cast<const ::sockaddr*>(&peer_addr_),
-                         sizeof(peer_addr_));
-            }
-
-            // Wait for viewer's version tag (5 second timeout)
-            uint8_t recv_buf[64];
-            fd_set read_fds;
-            struct timeval tv;
-            tv.tv_sec = 5;
-            tv.tv_usec = 0;
-            FD_ZERO(&read_fds);
-            FD_SET(static_cast<unsigned int>(udp_socket_), &read_fds);
-
-            int sel = ::select(udp_socket_ + 1, &read_fds, nullptr, nullptr, &tv);
-            if (sel > 0) {
-                ::sockaddr_in from = {};
-                socklen_t fromLen = sizeof(from);
-                int n = ::recvfrom(udp_socket_, reinterpret_cast<char*>(recv_buf),
-                                   sizeof(recv_buf), 0,
-                                   reinterpret_cast<::sockaddr*>(&from), &fromLen);
-                if (n > 0) {
-                    uint8_t plain[64];
-                    size_t plain_len = 0;
-                    if (dtls_->decrypt(recv_buf, static_cast<size_t>(n), plain, &plain_len) &&
-                        plain_len == cs::PROTOCOL_VERSION_TAG_LEN &&
-                        std::memcmp(plain, cs::PROTOCOL_VERSION_TAG,
-                                    cs::PROTOCOL_VERSION_TAG_LEN) == 0) {
-                        CS_LOG(INFO, "Protocol version verified: CS01");
-                    } else {
-                        CS_LOG(ERR, "Protocol version mismatch from viewer");
-                        cs_close_socket(udp_socket_);
-                        udp_socket_ = -1;
-                        return false;
-                    }
-                }
-            } else {
-                CS_LOG(ERR, "Timeout waiting for viewer protocol version");
-                cs_close_socket(udp_socket_);
-                udp_socket_ = -1;
-                return false;
-            }
-        }
-    }
+    udp_socket_   = conn.socket;
+    peer_addr_    = conn.addr;
+    wire_version_ = conn.wire_version;
+    media_cipher_ = std::move(conn.cipher);
 
     // --- Initialize transport ---
     transport_ = std::make_unique<UdpTransport>();
@@ -347,6 +365,39 @@ bool SessionManager::startSession(const PeerInfo& peer) {
         udp_socket_ = -1;
         return false;
     }
+    transport_->setMediaCipher(media_cipher_.get());
+    transport_->setImpairment(impairment_);
+    if (!record_path_.empty()) {
+        recorder_ = std::make_unique<cs::PacketRecorder>();
+        if (recorder_->open(recordingPath(record_path_, ++recordings_), cs::RecordingRole::HOST)) {
+            transport_->setRecorder(recorder_.get());
+        } else {
+            recorder_.reset();
+        }
+    }
+
+    // --- Path MTU ---
+    // Probe up to the preset's datagram size; if the viewer does not answer
+    // probes the transport keeps its default packet size.
+    size_t pmtu = transport_->probePathMtu(current_preset_.max_datagram_bytes,
+                                           PMTU_PROBE_TIMEOUT_MS);
+    if (pmtu > 0) {
+        transport_->setMaxDatagramSize(pmtu);
+    }
+    applyPacketSize();
+    transport_->setCacheRetention(NACK_CACHE_RETENTION_MS,
+                                  std::max(current_preset_.max_bitrate_kbps,
+                                           current_config_.bitrate_kbps));
+
+    uint32_t send_shards = current_config_.send_shards;
+    if (send_shards == 0) {
+        const uint32_t peak_kbps = std::max(current_preset_.max_bitrate_kbps,
+                                            current_config_.bitrate_kbps);
+        send_shards = peak_kbps < AUTO_SEND_SHARDS_KBPS
+            ? 1 : std::clamp<uint32_t>(std::thread::hardware_concurrency() / 2, 1, AUTO_SEND_SHARDS);
+    }
+    transport_->setSendShards(send_shards, current_config_.send_shard_sockets);
+    transport_->setMultipathPolicy(current_config_.multipath);
 
     // --- Initialize QoS controller ---
     qos_ = std::make_unique<QosController>(encoder_.get(), transport_.get(), fec_.get());
@@ -356,15 +407,67 @@ bool SessionManager::startSession(const PeerInfo& peer) {
     base_cfg.height       = current_config_.height;
     base_cfg.bitrate_kbps = current_config_.bitrate_kbps;
     base_cfg.fps          = current_config_.fps;
+    base_cfg.gop_length   = INFINITE_GOP;
+    base_cfg.enable_ltr   = true;
+    base_cfg.temporal_layers = encoder_->getTemporalLayers();
+    qos_->applyPreset(qosPreset());
     qos_->setBaseConfig(base_cfg);
+    qos_->setResolutionChangeCallback([this](uint32_t width, uint32_t height) {
+        requestOutputSize(width, height);
+    });
+    qos_->setPacingProfile(current_preset_.pacing_factor,
+                           current_preset_.pacing_burst_ms);
+    qos_->setProbingEnabled(current_config_.bandwidth_probing);
+
+    // Thermal headroom (Jetson): the governor steps the ladders down ahead
+    // of throttling.  Without thermal zones it has nothing to do.
+    thermal_enabled_.store(thermal_.initialize());
+
+    // Every sealed datagram's send time feeds the bandwidth estimator; the
+    // viewer's transport-wide feedback supplies the matching arrivals.
+    // Copies on the secondary path go to the path tracker alone, which
+    // tells them apart in the feedback; the prober times its clusters.
+    BandwidthEstimator* bwe = &qos_->getBandwidthEstimator();
+    PathTracker* paths = &qos_->getPathTracker();
+    ProbeController* probes = &qos_->getProbeController();
+    transport_->setSentCallback([bwe, paths, probes](uint16_t transport_seq, size_t bytes,
+                                                     uint64_t send_time_us) {
+        bwe->onPacketSent(transport_seq, bytes, send_time_us);
+        paths->onPrimarySent(transport_seq, send_time_us);
+        probes->onPacketSent(transport_seq, bytes, send_time_us);
+    });
+    transport_->setPathSentCallback([paths](uint16_t transport_seq, int32_t twin_seq,
+                                            size_t /*bytes*/, uint64_t send_time_us) {
+        paths->onSecondarySent(transport_seq, twin_seq, send_time_us);
+    });
+
+    // --- Extra displays (CS05 viewers tell the streams apart) ---
+    if (!displays_.empty() && wire_version_ < 5) {
+        CS_LOG(WARN, "Viewer speaks wire v%u -- streaming the primary display only",
+               wire_version_);
+        displays_.clear();
+        primary_share_ = 1.0f;
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.displays = 1;
+    }
+    if (!displays_.empty()) {
+        // The QoS target covers every stream; the primary's encoder codes
+        // its share, and the rest is handed on to the displays.
+        qos_->setEncoderShare(primary_share_);
+        qos_->setBitrateCallback([this](uint32_t total_kbps) { shareBitrate(total_kbps); });
+        reconfigure(current_config_.bitrate_kbps, current_config_.fps);
+    }
 
     // --- Initialize audio ---
     if (audio_capture_->initialize()) {
         if (opus_encoder_->initialize(audio_capture_->getSampleRate(),
                                        audio_capture_->getChannels(),
-                                       128000)) {
+                                       128000, current_preset_.audio_frame_us)) {
             CS_LOG(INFO, "Audio pipeline ready: %u Hz, %u channels",
                    audio_capture_->getSampleRate(), audio_capture_->getChannels());
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            stats_.audio_capture_latency_ms =
+                static_cast<float>(audio_capture_->getLatencyUs()) / 1000.0f;
         } else {
             CS_LOG(WARN, "Opus encoder init failed -- audio disabled");
             opus_encoder_.reset();
@@ -384,12 +487,37 @@ bool SessionManager::startSession(const PeerInfo& peer) {
     clipboard_ = std::make_unique<ClipboardInjector>();
     clipboard_->start([this](const std::vector<uint8_t>& data) {
         if (transport_) {
-            // Use a dedicated sequence space (0) for clipboard — non-video
-            transport_->sendPacket(data, 0);
+            // Clipboard is not part of the video sequence space
+            transport_->sendUncached(data, PacingLane::BULK);
         }
     });
     CS_LOG(INFO, "Clipboard injector started");
 
+    // --- Mouse and keyboard injection ---
+    input_ = std::make_unique<InputInjector>();
+
+    // --- Controller injection (needs ViGEmBus; acks flow regardless) ---
+    controllers_ = std::make_unique<ControllerInjector>();
+    controllers_->initialize();
+    controllers_->setAckFunc([this](const uint8_t* data, size_t len) {
+        if (transport_) {
+            transport_->sendUncached(data, len, PacingLane::AUDIO);
+        }
+    });
+
+    // --- Start the cursor channel (CS04 viewers draw the cursor) ---
+    cursor_ = std::make_unique<CursorCapture>();
+    if (wire_version_ >= 4 && cursor_->initialize() && capture_->setCursorComposited(false)) {
+        cursor_->start([this](const uint8_t* data, size_t len) {
+            if (transport_) {
+                transport_->sendUncached(data, len, PacingLane::CONTROL);
+            }
+        });
+    } else {
+        cursor_.reset();
+        capture_->setCursorComposited(true);
+    }
+
     // --- Start streaming threads ---
     should_stop_.store(false);
     streaming_.store(true);
@@ -398,6 +526,12 @@ bool SessionManager::startSession(const PeerInfo& peer) {
 
     stream_thread_   = std::thread(&SessionManager::streamingLoop, this);
     feedback_thread_ = std::thread(&SessionManager::feedbackLoop, this);
+    for (const auto& display : displays_) {
+        const uint8_t stream = display->getStreamId();
+        display->start([this, stream](const EncodedPacket& packet, uint32_t frame_number) {
+            return sendDisplayFrame(stream, packet, frame_number);
+        });
+    }
 
     if (audio_capture_ && opus_encoder_) {
         audio_thread_ = std::thread(&SessionManager::audioLoop, this);
@@ -417,15 +551,37 @@ void SessionManager::stopSession() {
     should_stop_.store(true);
     streaming_.store(false);
 
+    // Watch-only viewers go first; nothing streams to them without the
+    // session.
+    std::vector<std::shared_ptr<ViewerLink>> links;
+    {
+        std::lock_guard<std::mutex> lock(viewers_mutex_);
+        links.swap(viewers_);
+    }
+    for (auto& link : links) {
+        link->stop();
+    }
+
     // Join threads
+    if (transport_) transport_->wakeup();   // Release feedbackLoop's wait
     if (stream_thread_.joinable())   stream_thread_.join();
     if (audio_thread_.joinable())    audio_thread_.join();
     if (feedback_thread_.joinable()) feedback_thread_.join();
 
-    // Stop clipboard
+    // Extra displays send on the transport; they stop before it goes
+    for (auto& display : displays_) {
+        display->stop();
+    }
+    displays_.clear();
+    primary_share_ = 1.0f;
+
+    // Stop clipboard and cursor
     if (clipboard_) {
         clipboard_->stop();
     }
+    if (cursor_) {
+        cursor_->stop();
+    }
 
     // Stop audio capture
     if (audio_capture_ && audio_capture_->isRunning()) {
@@ -437,17 +593,36 @@ void SessionManager::stopSession() {
         dtls_->shutdown();
     }
 
-    // Release encoder
+    // Drain the encoder.  On warm standby it and the capture stay open for
+    // the next session, back at the desktop's size with the cursor drawn in.
     if (encoder_) {
         encoder_->flush();
-        encoder_->release();
     }
-
-    // Release capture
-    if (capture_) {
-        capture_->release();
+    if (warm_standby_ && warm_valid_) {
+        if (converter_) {
+            converter_->setOutputSize(0, 0);
+        } else if (capture_) {
+            capture_->setOutputSize(0, 0);
+        }
+        if (capture_) {
+            capture_->setCursorComposited(true);
+        }
+        CS_LOG(INFO, "Capture and encoder kept on standby");
+    } else {
+        releaseStandby();
     }
 
+    // Release the transport first so its pacer drains onto a live socket
+    // (and into a live bandwidth estimator through the sent callback)
+    clipboard_.reset();
+    input_.reset();
+    controllers_.reset();
+    cursor_.reset();
+    transport_.reset();
+    recorder_.reset();
+    qos_.reset();
+    media_cipher_.reset();
+
     // Close UDP socket
     if (udp_socket_ >= 0) {
         cs_close_socket(udp_socket_);
@@ -455,9 +630,6 @@ void SessionManager::stopSession() {
     }
 
     // Reset component pointers that are per-session
-    clipboard_.reset();
-    transport_.reset();
-    qos_.reset();
     fec_.reset();
     ice_.reset();
     dtls_.reset();
@@ -468,11 +640,62 @@ void SessionManager::stopSession() {
     CS_LOG(INFO, "Session stopped");
 }
 
+// ---------------------------------------------------------------------------
+// setWarmStandby() / setTurnPool() / releaseStandby()
+// ---------------------------------------------------------------------------
+void SessionManager::setWarmStandby(bool enabled) {
+    warm_standby_ = enabled;
+    if (!enabled && !prepared_ && !streaming_.load()) {
+        releaseStandby();
+    }
+}
+
+void SessionManager::setTurnPool(const cs::TurnConfig& config) {
+    if (config.server.empty()) {
+        turn_pool_.stop();
+        CS_LOG(INFO, "TURN pool stopped");
+        return;
+    }
+    turn_pool_.start(config);
+}
+
+void SessionManager::releaseStandby() {
+    warm_valid_ = false;
+    if (encoder_) {
+        encoder_->release();
+    }
+
+    // The converter holds views of the capture's textures
+    converter_.reset();
+    if (capture_) {
+        capture_->release();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// applyPacketSize()
+// ---------------------------------------------------------------------------
+void SessionManager::applyPacketSize() {
+    max_fragment_payload_ = transport_->maxPacketSize()
+                          - cs::videoHeaderSize(wire_version_) - sizeof(cs::FecPacketHeader);
+
+    const size_t group = fecGroupFor(max_fragment_payload_);
+    if (fec_) {
+        fec_->setGroupSize(static_cast<int>(group));
+    }
+
+    CS_LOG(INFO, "Packetization: %zu-byte fragments, FEC groups of %zu",
+           max_fragment_payload_, group);
+}
+
 // ---------------------------------------------------------------------------
 // forceIdr()
 // ---------------------------------------------------------------------------
 void SessionManager::forceIdr() {
     force_idr_flag_.store(true);
+    for (const auto& display : displays_) {
+        display->forceIdr();
+    }
     CS_LOG(INFO, "IDR frame requested");
 }
 
@@ -486,9 +709,11 @@ void SessionManager::reconfigure(uint32_t bitrate_kbps, uint32_t fps) {
     cfg.codec        = current_config_.codec;
     cfg.width        = current_config_.width;
     cfg.height       = current_config_.height;
-    cfg.bitrate_kbps = bitrate_kbps;
+    cfg.bitrate_kbps = shareBitrate(bitrate_kbps);
     cfg.fps          = fps;
-    cfg.gop_length   = fps * 2;
+    cfg.gop_length   = INFINITE_GOP;
+    cfg.enable_ltr   = true;
+    cfg.temporal_layers = encoder_->getTemporalLayers();
 
     if (encoder_->reconfigure(cfg)) {
         current_config_.bitrate_kbps = bitrate_kbps;
@@ -519,6 +744,17 @@ void SessionManager::setGamingMode(cs::GamingMode mode) {
         fec_->setRedundancyRatio(current_preset_.min_fec_ratio);
     }
 
+    // Update send pacing
+    if (qos_) {
+        qos_->setPacingProfile(current_preset_.pacing_factor,
+                               current_preset_.pacing_burst_ms);
+    }
+
+    // And the audio frame duration, from the next frame on
+    if (opus_encoder_) {
+        opus_encoder_->setFrameDuration(current_preset_.audio_frame_us);
+    }
+
     {
         std::lock_guard<std::mutex> lock(stats_mutex_);
         stats_.gaming_mode = cs::gamingModeToString(mode);
@@ -531,8 +767,223 @@ void SessionManager::setGamingMode(cs::GamingMode mode) {
 // getStats()
 // ---------------------------------------------------------------------------
 SessionStats SessionManager::getStats() const {
-    std::lock_guard<std::mutex> lock(stats_mutex_);
-    return stats_;
+    SessionStats st;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        st = stats_;
+    }
+    st.capture_p50_ms = capture_latency_.percentileMs(0.50f);
+    st.capture_p99_ms = capture_latency_.percentileMs(0.99f);
+    st.encode_p50_ms  = encode_latency_.percentileMs(0.50f);
+    st.encode_p99_ms  = encode_latency_.percentileMs(0.99f);
+    st.send_p50_ms    = send_latency_.percentileMs(0.50f);
+    st.send_p99_ms    = send_latency_.percentileMs(0.99f);
+    if (thermal_enabled_.load()) {
+        const ThermalGovernor::Stats ts = thermal_.getStats();
+        st.thermal_state        = thermalLevelName(ts.level);
+        st.soc_temp_c           = static_cast<float>(ts.temp_mc) / 1000.0f;
+        st.soc_temp_predicted_c = static_cast<float>(ts.predicted_mc) / 1000.0f;
+        st.encoder_load_percent = ts.encoder_load;
+    } else {
+        GpuUtilization util;
+        if (gpu_.sample(util)) st.encoder_load_percent = util.encoder_pct;
+    }
+    if (current_config_.content_adaptive) {
+        const ContentClassifier::Stats content = content_.getStats();
+        st.content_class       = contentClassName(content.cls);
+        st.content_transitions = content.transitions;
+        st.content_fps_cap     = content_.fpsCap();
+        st.content_coverage    = content.coverage;
+    }
+
+    std::lock_guard<std::mutex> lock(viewers_mutex_);
+    for (const auto& link : viewers_) {
+        if (link->isRunning()) st.viewers++;
+    }
+    return st;
+}
+
+// ---------------------------------------------------------------------------
+// addViewer()
+// ---------------------------------------------------------------------------
+bool SessionManager::addViewer(const std::string& viewer_id, std::string& fingerprint) {
+    if (!prepared_) {
+        CS_LOG(ERR, "Session not prepared");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(viewers_mutex_);
+    for (const auto& link : viewers_) {
+        if (link->getId() == viewer_id) {
+            CS_LOG(ERR, "Viewer '%s' already added", viewer_id.c_str());
+            return false;
+        }
+    }
+    if (viewers_.size() >= MAX_VIEWERS) {
+        CS_LOG(ERR, "Session already has %zu viewers", viewers_.size());
+        return false;
+    }
+
+    auto link = std::make_shared<ViewerLink>(viewer_id, dtls_ ? dtls_->getIdentity() : nullptr);
+    fingerprint = link->getFingerprint();
+    link->setImpairment(impairment_);
+    viewers_.push_back(std::move(link));
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// startViewer()
+// ---------------------------------------------------------------------------
+bool SessionManager::startViewer(const std::string& viewer_id, const PeerInfo& peer) {
+    if (!streaming_.load()) {
+        CS_LOG(ERR, "Session not streaming");
+        return false;
+    }
+
+    std::shared_ptr<ViewerLink> link;
+    {
+        std::lock_guard<std::mutex> lock(viewers_mutex_);
+        for (const auto& l : viewers_) {
+            if (l->getId() == viewer_id) link = l;
+        }
+    }
+    if (!link) {
+        CS_LOG(ERR, "Unknown viewer '%s'", viewer_id.c_str());
+        return false;
+    }
+
+    // The link's QoS starts where the session's does, and sheds layers
+    // from there.
+    EncoderConfig base_cfg;
+    base_cfg.codec           = current_config_.codec;
+    base_cfg.width           = current_config_.width;
+    base_cfg.height          = current_config_.height;
+    base_cfg.bitrate_kbps    = current_config_.bitrate_kbps;
+    base_cfg.fps             = current_config_.fps;
+    base_cfg.gop_length      = INFINITE_GOP;
+    base_cfg.temporal_layers = encoder_->getTemporalLayers();
+
+    // Handshakes block; the sender keeps going meanwhile, skipping the
+    // link until it is running.
+    link->setKeyframeCallback([this]() { forceIdr(); });
+    if (!link->start(peer, qosPreset(), base_cfg, toWireCodec(current_config_.codec))) {
+        CS_LOG(ERR, "Viewer '%s' failed to connect", viewer_id.c_str());
+        return false;
+    }
+    forceIdr();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// removeViewer()
+// ---------------------------------------------------------------------------
+void SessionManager::removeViewer(const std::string& viewer_id) {
+    std::shared_ptr<ViewerLink> link;
+    {
+        std::lock_guard<std::mutex> lock(viewers_mutex_);
+        auto it = std::find_if(viewers_.begin(), viewers_.end(),
+                               [&](const auto& l) { return l->getId() == viewer_id; });
+        if (it == viewers_.end()) return;
+        link = std::move(*it);
+        viewers_.erase(it);
+    }
+    link->stop();
+}
+
+// ---------------------------------------------------------------------------
+// anyViewerAlive()
+// ---------------------------------------------------------------------------
+bool SessionManager::anyViewerAlive() const {
+    std::lock_guard<std::mutex> lock(viewers_mutex_);
+    for (const auto& link : viewers_) {
+        if (link->isAlive(kViewerTimeout)) return true;
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// openDisplays() -- a DisplayStream per extra display
+// ---------------------------------------------------------------------------
+void SessionManager::openDisplays(const EncoderConfig& base) {
+    displays_.clear();
+    primary_share_ = 1.0f;
+
+    // Every display is an encoder session; on a platform with a fixed
+    // number of them (Jetson) the primary takes one.
+    size_t limit = current_config_.displays == 0 ? MAX_VIDEO_STREAMS
+                 : std::min<size_t>(current_config_.displays, MAX_VIDEO_STREAMS);
+    const int max_sessions = capture_->getMaxEncodeSessions();
+    if (max_sessions > 0) {
+        limit = std::min(limit, static_cast<size_t>(max_sessions));
+    }
+    if (limit <= 1) return;
+
+    // Extra displays are duplicated with DXGI whatever captures the
+    // primary: NvFBC grabs one display.  The GPU has run out of displays
+    // (or encoder sessions) at the first that cannot be opened.
+    uint64_t total_area = static_cast<uint64_t>(base.width) * base.height;
+    for (size_t output = 1; output < limit; ++output) {
+        auto display = std::make_unique<DisplayStream>(
+            static_cast<uint8_t>(output), static_cast<uint32_t>(output),
+            std::make_unique<DxgiCapture>(), std::make_unique<NvencEncoder>());
+        if (!display->open(0, base)) break;
+        total_area += display->getArea();
+        displays_.push_back(std::move(display));
+    }
+    if (displays_.empty()) {
+        CS_LOG(INFO, "Streaming the primary display only");
+        return;
+    }
+
+    primary_share_ = static_cast<float>(static_cast<double>(base.width) * base.height /
+                                        static_cast<double>(total_area));
+    shareBitrate(base.bitrate_kbps);
+    CS_LOG(INFO, "Streaming %zu displays; primary gets %.0f%% of the bitrate",
+           displays_.size() + 1, primary_share_ * 100.0f);
+}
+
+// ---------------------------------------------------------------------------
+// shareBitrate() -- split the bitrate between the displays by area
+// ---------------------------------------------------------------------------
+uint32_t SessionManager::shareBitrate(uint32_t total_kbps) {
+    if (displays_.empty()) return total_kbps;
+
+    uint64_t primary_area = static_cast<uint64_t>(current_config_.width) * current_config_.height;
+    uint64_t total_area   = primary_area;
+    for (const auto& display : displays_) total_area += display->getArea();
+
+    for (const auto& display : displays_) {
+        const uint64_t kbps = static_cast<uint64_t>(total_kbps) * display->getArea() / total_area;
+        display->setBitrate(std::max<uint32_t>(static_cast<uint32_t>(kbps), 1));
+    }
+    return std::max<uint32_t>(static_cast<uint32_t>(
+        static_cast<uint64_t>(total_kbps) * primary_area / total_area), 1);
+}
+
+// ---------------------------------------------------------------------------
+// sendDisplayFrame() -- an extra display's frame onto the shared wire
+// ---------------------------------------------------------------------------
+bool SessionManager::sendDisplayFrame(uint8_t stream, const EncodedPacket& encoded,
+                                      uint32_t frame_number) {
+    if (!transport_) return false;
+
+    const size_t payload_len = encoded.size();
+    size_t frag_total = (payload_len + max_fragment_payload_ - 1) / max_fragment_payload_;
+    if (frag_total == 0) frag_total = 1;
+    if (frag_total > MAX_FRAGMENTS_V2) {
+        CS_LOG(WARN, "Display %u frame %u needs %zu fragments -- dropped",
+               static_cast<unsigned>(stream), frame_number, frag_total);
+        return false;
+    }
+
+    FrameSend fs;
+    fs.payload      = encoded.bytes();
+    fs.timestamp_us = encoded.timestamp_us;
+    fs.frame_number = frame_number;
+    fs.stream       = stream;
+    fs.keyframe     = encoded.is_keyframe;
+    sendFragments(fs, payload_len, frag_total, static_cast<uint16_t>(frag_total));
+    return true;
 }
 
 // ---------------------------------------------------------------------------
@@ -545,16 +996,16 @@ bool SessionManager::isStreaming() const {
 // ---------------------------------------------------------------------------
 // buildVideoHeader()
 // ---------------------------------------------------------------------------
-cs::VideoPacketHeader SessionManager::buildVideoHeader(
-    uint16_t seq, uint16_t frame_num,
-    uint8_t frag_idx, uint8_t frag_total,
+cs::VideoPacketHeaderV2 SessionManager::buildVideoHeader(
+    uint16_t seq, uint32_t frame_num,
+    uint16_t frag_idx, uint16_t frag_total,
     bool is_keyframe, uint32_t payload_len,
     uint64_t timestamp_us) const
 {
-    cs::VideoPacketHeader hdr;
+    cs::VideoPacketHeaderV2 hdr;
     std::memset(&hdr, 0, sizeof(hdr));
 
-    hdr.setVersion(1);
+    hdr.setVersion(cs::videoHeaderVersion(wire_version_));
     hdr.setFrameType(0);     // 0 = progressive
     hdr.setKeyframe(is_keyframe);
     hdr.codec            = static_cast<uint8_t>(toWireCodec(current_config_.codec));
@@ -568,16 +1019,713 @@ cs::VideoPacketHeader SessionManager::buildVideoHeader(
     return hdr;
 }
 
+// ---------------------------------------------------------------------------
+// describeFrame() -- wire labels for an encoded frame
+// ---------------------------------------------------------------------------
+void SessionManager::describeFrame(const EncodedPacket& encoded, const Submission& sub,
+                                   FrameSend& fs) const {
+    fs.timestamp_us = encoded.timestamp_us;
+    fs.frame_number = frame_number_;
+    fs.keyframe     = encoded.is_keyframe;
+    fs.ltr          = encoded.is_ltr;
+
+    // The first frame after an invalidation tells the client it can
+    // resume decoding there.  Frames already in the encoder when it
+    // happened still reference the loss.
+    fs.recovery = mark_recovery_ && sub.recovery_epoch == recovery_epoch_ &&
+                  !encoded.is_keyframe;
+
+    // Temporal layer: keyframes and recovery frames are what the client
+    // resumes from, so they always count as base layer.
+    fs.layer     = (encoded.is_keyframe || fs.recovery) ? 0 : encoded.temporal_layer;
+    fs.fec_layer = encoder_->getTemporalLayers() > 1 ? fs.layer : -1;
+}
+
+// ---------------------------------------------------------------------------
+// sendFragments() -- packetize, protect and send part of a frame
+// ---------------------------------------------------------------------------
+void SessionManager::sendFragments(FrameSend& fs, size_t len, size_t frag_end,
+                                   uint16_t frag_total) {
+    std::lock_guard<std::mutex> lock(wire_mutex_);
+    cs::trace::Scope trace(cs::trace::Stage::SEND, static_cast<uint32_t>(fs.timestamp_us));
+    const size_t frag_payload = max_fragment_payload_;
+    const bool droppable = fs.layer > 0;
+
+    // Fragments are serialized straight into the transport's packet
+    // slab (which doubles as the NACK cache), followed by their FEC
+    // packets.  Fragments are handed to the transport in batches of at
+    // most MAX_BATCH_FRAGMENTS data packets, so a multi-megabyte
+    // keyframe never claims more slab slots than the pacer can hold.
+    // The scratch vectors are members so their capacity is reused.
+    for (size_t batch_first = fs.sent; batch_first < frag_end;
+         batch_first += MAX_BATCH_FRAGMENTS) {
+        const size_t batch_end = std::min(frag_end, batch_first + MAX_BATCH_FRAGMENTS);
+
+        batch_.clear();
+        const uint16_t first_seq = video_seq_;
+        const PacketClass cls = (fs.keyframe || fs.recovery) ? PacketClass::KEYFRAME
+                                                             : PacketClass::DELTA;
+
+        for (size_t frag = batch_first; frag < batch_end; ++frag) {
+            size_t offset = frag * frag_payload;
+            size_t chunk_len = std::min(frag_payload, len - offset);
+
+            cs::VideoPacketHeaderV2 hdr = buildVideoHeader(
+                video_seq_, fs.frame_number,
+                static_cast<uint16_t>(frag), frag_total,
+                fs.keyframe,
+                static_cast<uint32_t>(chunk_len),
+                fs.timestamp_us);
+            hdr.setRecovery(fs.recovery);
+            hdr.setLtr(fs.ltr);
+            hdr.setTemporalLayer(fs.layer);
+            hdr.setStreamId(fs.stream);
+
+            // Write header + payload fragment in place
+            cs::PacketBuffer buf = transport_->acquireBuffer(video_seq_);
+            size_t hdr_len = hdr.serializeTo(buf.data);
+            std::memcpy(buf.data + hdr_len, fs.payload + offset, chunk_len);
+            batch_.push_back({buf.data, hdr_len + chunk_len, video_seq_, droppable, cls});
+            ++video_seq_;
+        }
+
+        // --- FEC ---
+        // Split the batch's packets into groups of at most group_size and
+        // protect each group with its own parity packets.  Groups are
+        // balanced so the last one is never a tiny remainder.  The QoS
+        // controller's loss model picks group size and parity count for
+        // this frame; until it has data, the redundancy ratio applies.
+        // Parity is computed directly into slab slots behind their
+        // FecPacketHeader.
+        const size_t data_total = batch_.size();
+        if (fec_ && data_total > 1) {
+            size_t max_group = static_cast<size_t>(fec_->getGroupSize());
+            FecPlan plan;
+            const bool planned = qos_ &&
+                qos_->planFec(data_total, fs.keyframe, fs.fec_layer, max_group, plan);
+            if (planned) max_group = plan.group_size;
+
+            size_t num_groups = (data_total + max_group - 1) / max_group;
+            size_t base_size = data_total / num_groups;
+            size_t remainder = data_total % num_groups;
+
+            size_t first = 0;
+            for (size_t g = 0; g < num_groups; ++g) {
+                size_t count = base_size + (g < remainder ? 1 : 0);
+                size_t parity_count = planned
+                    ? std::min(plan.parity_count, count)
+                    : static_cast<size_t>(fec_->parityCountFor(static_cast<int>(count)));
+                fs.parity += parity_count;
+
+                fec_data_.clear();
+                fec_len_.clear();
+                size_t symbol_len = 0;
+                for (size_t i = first; i < first + count; ++i) {
+                    fec_data_.push_back(batch_[i].data);
+                    fec_len_.push_back(batch_[i].len);
+                    symbol_len = std::max(symbol_len, batch_[i].len);
+                }
+
+                fec_parity_.clear();
+                uint16_t first_parity_seq = video_seq_;
+                for (size_t i = 0; i < parity_count; ++i) {
+                    cs::PacketBuffer buf = transport_->acquireBuffer(
+                        static_cast<uint16_t>(first_parity_seq + i));
+                    fec_parity_.push_back(buf.payload<cs::FecPacketHeader>());
+                }
+
+                if (parity_count > 0 &&
+                    fec_->encode(fec_data_.data(), fec_len_.data(), count,
+                                 fec_parity_.data(), parity_count, symbol_len)) {
+                    cs::FecPacketHeader fh;
+                    fh.type          = static_cast<uint8_t>(cs::PacketType::FEC);
+                    fh.group_id      = fec_->currentGroupId();
+                    fh.data_count    = static_cast<uint8_t>(count);
+                    fh.parity_count  = static_cast<uint8_t>(parity_count);
+                    fh.frame_number  = static_cast<uint16_t>(fs.frame_number & 0xFFFF);
+                    fh.base_sequence = static_cast<uint16_t>(first_seq + first);
+                    fh.symbol_length = static_cast<uint16_t>(symbol_len);
+
+                    for (size_t i = 0; i < parity_count; ++i) {
+                        fh.sequence_number = video_seq_++;
+                        fh.parity_index    = static_cast<uint8_t>(i);
+                        uint8_t* pkt = fec_parity_[i] - sizeof(cs::FecPacketHeader);
+                        fh.serializeTo(pkt);
+                        batch_.push_back({pkt, sizeof(cs::FecPacketHeader) + symbol_len,
+                                          fh.sequence_number, droppable, PacketClass::FEC});
+                    }
+                }
+                first += count;
+            }
+        }
+
+        // --- Send ---
+        transport_->sendBatch(batch_);
+    }
+    fs.sent = std::max(fs.sent, frag_end);
+}
+
+// ---------------------------------------------------------------------------
+// onFrameLoss() -- merge a client frame loss report into the pending range
+// ---------------------------------------------------------------------------
+void SessionManager::onFrameLoss(const cs::FrameLossPacket& report) {
+    if (static_cast<int32_t>(report.last_frame - report.first_frame) < 0) return;
+
+    // An extra display's loss is its own stream's to repair
+    if (const uint8_t stream = report.streamId()) {
+        if (stream <= displays_.size()) {
+            displays_[stream - 1]->onFrameLoss(report.first_frame, report.last_frame);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(loss_mutex_);
+    if (!loss_pending_) {
+        pending_loss_first_ = report.first_frame;
+        pending_loss_last_  = report.last_frame;
+        loss_pending_       = true;
+        return;
+    }
+    if (static_cast<int32_t>(report.first_frame - pending_loss_first_) < 0) {
+        pending_loss_first_ = report.first_frame;
+    }
+    if (static_cast<int32_t>(report.last_frame - pending_loss_last_) > 0) {
+        pending_loss_last_ = report.last_frame;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// acknowledgeLtr() -- tell the encoder which LTR the client holds
+// ---------------------------------------------------------------------------
+void SessionManager::acknowledgeLtr() {
+    uint32_t frame = 0;
+    {
+        std::lock_guard<std::mutex> lock(loss_mutex_);
+        if (!ltr_ack_pending_) return;
+        frame = pending_ltr_ack_;
+        ltr_ack_pending_ = false;
+    }
+    if (wire_version_ < 2) {
+        int16_t delta = static_cast<int16_t>(static_cast<uint16_t>(frame) -
+                                             static_cast<uint16_t>(frame_number_));
+        frame = frame_number_ + static_cast<uint32_t>(static_cast<int32_t>(delta));
+    }
+
+    const SentFrame& sf = sent_frames_[frame % SENT_FRAME_HISTORY];
+    if (sf.valid && sf.wire_frame == frame && sf.ltr) {
+        encoder_->acknowledgeFrame(sf.encoder_frame);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// recoverFromLoss() -- answer a frame loss report before the next encode
+// ---------------------------------------------------------------------------
+void SessionManager::recoverFromLoss() {
+    uint32_t first = 0;
+    uint32_t last  = 0;
+    {
+        std::lock_guard<std::mutex> lock(loss_mutex_);
+        if (!loss_pending_) return;
+        first = pending_loss_first_;
+        last  = pending_loss_last_;
+        loss_pending_ = false;
+    }
+    if (frame_number_ == 0) return;
+
+    // Version-1 headers carry 16-bit frame numbers; unwrap them against
+    // the frame counter.
+    if (wire_version_ < 2) {
+        auto unwrap = [this](uint32_t f) {
+            int16_t delta = static_cast<int16_t>(static_cast<uint16_t>(f) -
+                                                 static_cast<uint16_t>(frame_number_));
+            return frame_number_ + static_cast<uint32_t>(static_cast<int32_t>(delta));
+        };
+        first = unwrap(first);
+        last  = unwrap(last);
+    }
+
+    auto before = [](uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; };
+    const uint32_t newest = frame_number_ - 1;
+    if (before(newest, last)) last = newest;
+    if (before(last, first)) return;
+
+    // The client repeats a report until it sees the recovery, and a
+    // keyframe sent since the loss repairs it anyway.
+    if (have_keyframe_ && before(last, last_keyframe_)) return;
+    if (have_recovery_ && before(last, recovery_frame_) &&
+        (recovery_by_idr_ || !before(first, recovered_from_))) {
+        return;
+    }
+
+    // Every frame from the first lost one on references it, directly or
+    // through its successors.  Invalidation needs all of them in the
+    // history, and cannot repair a lost keyframe.
+    bool invalidated = false;
+    const SentFrame& lost = sent_frames_[first % SENT_FRAME_HISTORY];
+    const SentFrame& tip  = sent_frames_[newest % SENT_FRAME_HISTORY];
+    if (newest - first < SENT_FRAME_HISTORY && lost.valid && lost.wire_frame == first &&
+        tip.valid && tip.wire_frame == newest) {
+        bool lost_keyframe = false;
+        for (uint32_t f = first; f != last + 1; ++f) {
+            const SentFrame& sf = sent_frames_[f % SENT_FRAME_HISTORY];
+            if (sf.valid && sf.wire_frame == f && sf.keyframe) lost_keyframe = true;
+        }
+        // Frames still in the encoder or waiting to be sent follow the
+        // newest one finished, and reference the loss just the same.
+        uint32_t newest_encoded = tip.encoder_frame;
+        if (!submissions_.empty()) {
+            newest_encoded = last_encoder_frame_ + static_cast<uint32_t>(submissions_.size());
+        }
+        invalidated = !lost_keyframe &&
+            encoder_->invalidateRefFrames(lost.encoder_frame, newest_encoded);
+    }
+
+    have_recovery_   = true;
+    recovery_by_idr_ = !invalidated;
+    recovered_from_  = first;
+    recovery_frame_  = frame_number_;
+    mark_recovery_   = invalidated;
+    recovery_epoch_++;
+
+    if (!invalidated) {
+        encoder_->forceIdr();
+    }
+    CS_LOG(INFO, "Client lost frames %u-%u -- recovering with %s",
+           first, last, invalidated ? "reference invalidation" : "IDR");
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    if (invalidated) stats_.loss_invalidations++;
+    else             stats_.loss_idrs++;
+}
+
+// ---------------------------------------------------------------------------
+// finishFrame() -- send an encoded frame and record it
+// ---------------------------------------------------------------------------
+void SessionManager::finishFrame(EncodedPacket& encoded, FrameSend& fs, bool sliced,
+                                 bool shed, bool oversized, const Submission& sub) {
+    last_encoder_frame_ = encoded.frame_number;
+    const uint64_t enc_us = (sub.encoded_us ? sub.encoded_us : hires_now_us()) - sub.submit_us;
+    const float enc_ms = static_cast<float>(enc_us) / 1000.0f;
+    const size_t frag_payload = max_fragment_payload_;
+    encode_latency_.record(enc_us);
+
+    // Update timing averages
+    avg_capture_ms_ = avg_capture_ms_ * (1.0f - EMA_ALPHA) + sub.cap_ms * EMA_ALPHA;
+    avg_encode_ms_  = avg_encode_ms_  * (1.0f - EMA_ALPHA) + enc_ms * EMA_ALPHA;
+
+    if (!sliced) {
+        describeFrame(encoded, sub, fs);
+        shed = qos_ && fs.layer > qos_->getMaxTemporalLayer();
+    }
+
+    // Watch-only viewers get every frame and shed for their own paths.
+    {
+        std::lock_guard<std::mutex> lock(viewers_mutex_);
+        if (!viewers_.empty()) {
+            LinkFrame lf;
+            lf.data         = encoded.bytes();
+            lf.size         = encoded.size();
+            lf.timestamp_us = fs.timestamp_us;
+            lf.keyframe     = fs.keyframe;
+            lf.ltr          = fs.ltr;
+            lf.layer        = fs.layer;
+            lf.fec_layer    = fs.fec_layer;
+            for (const auto& link : viewers_) {
+                link->sendFrame(lf);
+            }
+        }
+    }
+
+    // Under congestion the QoS controller sheds the top layers.  Nothing
+    // references those frames, so they are simply not sent, and without
+    // a wire frame number the client sees no gap.
+    if (shed) {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.frames_shed++;
+        return;
+    }
+
+    // A delta frame far over budget would hold up every frame behind it.
+    // Drop it -- once, so a sustained overshoot still gets through --
+    // provided nothing will predict from it: the top temporal layer is
+    // never referenced, any other frame is invalidated in the encoder,
+    // which only helps while no later frame has gone in after it.
+    // The wire frame number is not consumed, so the client sees no gap.
+    // (A sliced frame is already on its way; its budget is only the
+    // encoder's VBV.)
+    if (!sliced && sub.frame_budget > 0 && !encoded.is_keyframe && !fs.recovery &&
+        !encoded.is_ltr && !last_frame_dropped_ &&
+        encoded.size() > sub.frame_budget * OVERSIZE_DROP_FACTOR &&
+        ((fs.layer > 0 && fs.layer + 1u >= encoder_->getTemporalLayers()) ||
+         (submissions_.empty() &&
+          encoder_->invalidateRefFrames(encoded.frame_number, encoded.frame_number)))) {
+        last_frame_dropped_ = true;
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.frames_dropped_oversize++;
+        return;
+    }
+    last_frame_dropped_ = false;
+
+    // --- Fragment and send ---
+    const size_t payload_len = encoded.size();
+    size_t frag_total = (payload_len + frag_payload - 1) / frag_payload;
+    if (frag_total == 0) frag_total = 1;
+
+    const size_t max_frags = wire_version_ >= 2 ? MAX_FRAGMENTS_V2 : MAX_FRAGMENTS_V1;
+    if (oversized || frag_total > max_frags) {
+        // Truncating the fragment count would hand the decoder a
+        // corrupt frame; drop it and recover with a keyframe instead.
+        CS_LOG(WARN, "Frame %u needs %zu fragments (wire v%u limit %zu) -- dropped",
+               frame_number_, frag_total, wire_version_, max_frags);
+        if (!encoded.is_keyframe) {
+            encoder_->forceIdr();
+        }
+        if (fs.sent > 0) ++frame_number_;
+        return;
+    }
+
+    // Fragments are read straight out of the encoder's buffer when it
+    // lends it.
+    fs.payload = encoded.bytes();
+    sendFragments(fs, payload_len, frag_total, static_cast<uint16_t>(frag_total));
+    const size_t frame_parity = fs.parity;
+
+    SentFrame& sent = sent_frames_[frame_number_ % SENT_FRAME_HISTORY];
+    sent.wire_frame    = frame_number_;
+    sent.encoder_frame = encoded.frame_number;
+    sent.keyframe      = encoded.is_keyframe;
+    sent.ltr           = encoded.is_ltr;
+    sent.valid         = true;
+    if (encoded.is_keyframe) {
+        have_keyframe_ = true;
+        last_keyframe_ = frame_number_;
+    }
+    mark_recovery_ = false;
+
+    ++frame_number_;
+
+    // --- Update stats ---
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        if (frame_number_ == 1) {
+            stats_.time_to_first_frame_ms =
+                static_cast<float>(cs::getTimestampUs() - prepare_start_us_) / 1000.0f;
+            CS_LOG(INFO, "First frame sent %.1f ms after prepare (%s encoder)",
+                   stats_.time_to_first_frame_ms, stats_.warm_start ? "warm" : "cold");
+        }
+        stats_.frames_sent    = frame_number_;
+        stats_.bytes_sent     = transport_->totalBytesSent();
+        stats_.capture_time_ms = avg_capture_ms_;
+        stats_.encode_time_ms  = avg_encode_ms_;
+        if (fec_) {
+            stats_.fec_ratio = static_cast<float>(frame_parity) /
+                               static_cast<float>(frag_total);
+        }
+        NackCacheStats ns = transport_->getNackCacheStats();
+        stats_.nack_hits    = ns.hits;
+        stats_.nack_misses  = ns.misses;
+        stats_.nack_expired = ns.expired;
+        stats_.path_migrations = transport_->pathMigrations();
+        stats_.secondary_path    = transport_->hasSecondaryPath();
+        stats_.secondary_packets = transport_->secondaryPackets();
+        if (qos_) {
+            QosStats qs = qos_->getStats();
+            stats_.bitrate_kbps        = qs.bitrate_kbps;
+            stats_.packet_loss_percent = qs.loss_rate * 100.0f;
+            stats_.jitter_ms           = static_cast<float>(qs.jitter_us) / 1000.0f;
+            stats_.rtt_ms              = static_cast<float>(qs.rtt_us) / 1000.0f;
+            stats_.secondary_rescued      = qs.secondary_rescued;
+            stats_.secondary_loss_percent = qs.secondary_loss_rate * 100.0f;
+            stats_.secondary_rtt_ms       = static_cast<float>(qs.secondary_rtt_us) / 1000.0f;
+            stats_.probe_clusters         = qs.probe_clusters;
+            stats_.probed_kbps            = qs.probed_kbps;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// tagFreshInput() -- the first frame to show injected input
+// ---------------------------------------------------------------------------
+void SessionManager::tagFreshInput(const CapturedFrame& frame, Submission& sub) {
+    uint16_t batch_seq = 0;
+    if (!input_ || !input_->takeInjectedBefore(frame.timestamp_us, batch_seq)) return;
+    sub.fresh_input = true;
+
+    cs::InputEchoPacket echo{};
+    echo.type               = static_cast<uint8_t>(cs::PacketType::INPUT_ECHO);
+    echo.batch_seq          = batch_seq;
+    echo.frame_timestamp_us = static_cast<uint32_t>(frame.timestamp_us);
+    uint8_t buf[sizeof(cs::InputEchoPacket)];
+    transport_->sendUncached(buf, echo.serializeTo(buf), PacingLane::AUDIO);
+}
+
+// ---------------------------------------------------------------------------
+// budgetFrame() -- per-frame bit budget before an encode
+// ---------------------------------------------------------------------------
+bool SessionManager::budgetFrame(Submission& sub) {
+    if (!qos_) return true;
+
+    // Size the frame to what the path drains within the queueing delay
+    // bound, counting what the pacer still holds.  If the queue alone is
+    // over the bound, encoding another frame would only add latency.
+    const size_t queued = transport_->pacerQueuedBytes();
+    sub.frame_budget = qos_->getFrameBudgetBytes(false, queued, sub.fresh_input);
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.frame_budget_bytes = sub.frame_budget;
+        if (sub.frame_budget == 0) stats_.frames_skipped++;
+    }
+    if (sub.frame_budget == 0) return false;
+
+    encoder_->setFrameBudget(sub.frame_budget, qos_->getFrameBudgetBytes(true, queued));
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// encodeAndSend() -- synchronous encode, then send
+// ---------------------------------------------------------------------------
+void SessionManager::encodeAndSend(const CapturedFrame& frame, EncodedPacket& encoded,
+                                   Submission& sub) {
+    // With slice streaming each finished slice is packetized while
+    // the encoder works on the next.  Only whole fragments go out
+    // early, labelled with fragment total 0: the count is unknown
+    // until the frame is done, and the last fragment (always sent
+    // afterwards) carries it.
+    FrameSend fs;
+    bool shed      = false;    // Top temporal layer, not sent (congestion)
+    bool oversized = false;    // Sliced frame past the fragment limit
+    const size_t frag_payload = max_fragment_payload_;
+
+    sub.submit_us      = hires_now_us();
+    sub.recovery_epoch = recovery_epoch_;
+    encoded.frame_number = frame_number_;
+    bool encoded_ok;
+    if (sliced_) {
+        encoded_ok = encoder_->encodeSliced(frame, encoded, [&](size_t ready) {
+            if (!fs.payload) {
+                describeFrame(encoded, sub, fs);
+                shed = qos_ && fs.layer > qos_->getMaxTemporalLayer();
+            }
+            if (shed || oversized || ready == 0) return;
+            fs.payload = encoded.bytes();
+
+            // Fragments wholly final with data after them: the frame's
+            // last fragment is never among them.
+            const size_t whole = (ready - 1) / frag_payload;
+            if (whole >= MAX_FRAGMENTS_V2) {
+                oversized = true;
+                return;
+            }
+            if (whole > fs.sent) {
+                sendFragments(fs, ready, whole, 0);
+            }
+        });
+    } else {
+        encoded_ok = encoder_->encode(frame, encoded);
+    }
+    if (!encoded_ok) {
+        CS_LOG(WARN, "Encode failed for frame %u", frame_number_);
+        // A sliced frame partly sent keeps its number; the client
+        // reports it lost.
+        if (fs.sent > 0) ++frame_number_;
+        return;
+    }
+
+    const uint64_t send_start = hires_now_us();
+    finishFrame(encoded, fs, sliced_, shed, oversized, sub);
+    send_latency_.record(hires_now_us() - send_start);
+    encoded.release();
+}
+
+// ---------------------------------------------------------------------------
+// completeSubmission() -- the oldest frame in flight came out
+// ---------------------------------------------------------------------------
+void SessionManager::completeSubmission(EncodedPacket& encoded, bool ok, uint64_t encoded_us) {
+    if (submissions_.empty()) {
+        CS_LOG(ERR, "Encoded frame %u with no submission in flight", encoded.frame_number);
+        return;
+    }
+    Submission sub = submissions_.front();
+    submissions_.pop_front();
+    submit_cv_.notify_one();
+    sub.encoded_us = encoded_us;
+
+    if (!ok) {
+        // Lost to the client but not necessarily to the encoder's
+        // references, so the frames after it could decode wrong; start
+        // over from a keyframe.
+        CS_LOG(WARN, "Encode failed for frame %u",
+               async_encode_ ? encoded.frame_number : frame_number_);
+        if (async_encode_) last_encoder_frame_ = encoded.frame_number;
+        encoder_->forceIdr();
+        return;
+    }
+
+    const uint64_t send_start = hires_now_us();
+    FrameSend fs;
+    finishFrame(encoded, fs, false, false, false, sub);
+    send_latency_.record(hires_now_us() - send_start);
+}
+
+// ---------------------------------------------------------------------------
+// onEncoded() -- asynchronous encode output
+// ---------------------------------------------------------------------------
+void SessionManager::onEncoded(EncodedPacket& encoded, bool ok) {
+    if (staged_) {
+        // Handed to the send stage, borrowed buffer and all.  The send
+        // stage releases it before its submission leaves submissions_,
+        // and no more than max_in_flight_ (at most the encoder's depth)
+        // are submitted and unsent at once, so the buffer is back before
+        // the encoder comes round to it again.  There is always a slot.
+        PacketSlot* slot = nullptr;
+        while (!(slot = packet_queue_.beginPush())) {
+            std::this_thread::yield();
+        }
+        slot->packet     = std::move(encoded);
+        slot->ok         = ok;
+        slot->encoded_us = hires_now_us();
+        packet_queue_.commitPush();
+
+        // A GPU frame was read in place until now
+        if (capture_->getFrameMemory() != FrameMemory::SYSTEM) {
+            frames_held_.fetch_sub(1);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    completeSubmission(encoded, ok, 0);
+}
+
+// ---------------------------------------------------------------------------
+// openEncoder() -- richest picture format the session can carry
+// ---------------------------------------------------------------------------
+bool SessionManager::openEncoder(EncoderConfig& enc_cfg, bool& warm) {
+    std::vector<PictureFormat> ladder;
+    if (current_preset_.chroma == cs::ChromaMode::YUV444 &&
+        current_config_.max_chroma == cs::ChromaMode::YUV444) {
+        ladder.push_back({true, 8});
+    }
+    if (current_preset_.bit_depth > 8 && current_config_.max_bit_depth > 8) {
+        ladder.push_back({false, 10});
+    }
+    ladder.push_back({false, 8});
+
+    warm = false;
+    if (warm_valid_ && ladder.front() == warm_top_) {
+        enc_cfg.yuv444       = warm_format_.yuv444;
+        enc_cfg.bit_depth    = warm_format_.bit_depth;
+        enc_cfg.input_format = setupColorConversion(enc_cfg);
+        warm = encoder_->restart(enc_cfg);
+        if (warm) return true;
+    }
+    warm_valid_ = false;
+
+    for (const PictureFormat& picture : ladder) {
+        enc_cfg.yuv444       = picture.yuv444;
+        enc_cfg.bit_depth    = picture.bit_depth;
+        enc_cfg.input_format = setupColorConversion(enc_cfg);
+        if (encoder_->initialize(enc_cfg)) {
+            warm_top_    = ladder.front();
+            warm_format_ = picture;
+            warm_valid_  = true;
+            return true;
+        }
+        if (picture.yuv444 || picture.bit_depth > 8) {
+            CS_LOG(INFO, "Encoder cannot code %s %u-bit -- stepping down",
+                   picture.yuv444 ? "4:4:4" : "4:2:0", picture.bit_depth);
+        }
+    }
+    converter_.reset();
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// setupColorConversion() -- frames in the layout the encoder codes from
+// ---------------------------------------------------------------------------
+FrameFormat SessionManager::setupColorConversion(const EncoderConfig& enc_cfg) {
+    switch (capture_->getFrameMemory()) {
+        case FrameMemory::CUDA: {
+            // NvFBC converts as it grabs; it has no 10-bit layout, so a
+            // 10-bit encode widens NV12.
+            converter_.reset();
+            const FrameFormat wanted = enc_cfg.yuv444 ? FrameFormat::YUV444 : FrameFormat::NV12;
+            return capture_->setOutputFormat(wanted) ? wanted : FrameFormat::NV12;
+        }
+
+        case FrameMemory::D3D11: {
+            const FrameFormat wanted = enc_cfg.yuv444        ? FrameFormat::AYUV
+                                     : enc_cfg.bit_depth > 8 ? FrameFormat::P010
+                                                             : FrameFormat::NV12;
+            if (!converter_) converter_ = std::make_unique<ColorConverter>();
+            if (converter_->initialize(capture_->getFrameDevice()) &&
+                converter_->configure(wanted, enc_cfg.width, enc_cfg.height,
+                                      capture_->getSurfaceCount())) {
+                return wanted;
+            }
+            // The encoder converts the capture's BGRA itself
+            CS_LOG(WARN, "GPU colour conversion unavailable -- encoding BGRA frames");
+            converter_.reset();
+            return FrameFormat::BGRA8;
+        }
+
+        case FrameMemory::DMABUF:     // The encoder converts on import
+        case FrameMemory::SYSTEM:
+            break;
+    }
+    converter_.reset();
+    return FrameFormat::BGRA8;
+}
+
+// ---------------------------------------------------------------------------
+// qosPreset() -- the preset with the session's own resolution ladder
+// ---------------------------------------------------------------------------
+cs::QosPreset SessionManager::qosPreset() const {
+    cs::QosPreset preset = current_preset_;
+    const cs::Resolution coded = {current_config_.width, current_config_.height};
+    preset.resolution_ladder = scalable_ ? cs::resolutionLadder(preset, coded)
+                                         : std::vector<cs::Resolution>{coded};
+    return preset;
+}
+
+// ---------------------------------------------------------------------------
+// requestOutputSize() / applyOutputSize() -- resolution ladder steps
+// ---------------------------------------------------------------------------
+void SessionManager::requestOutputSize(uint32_t width, uint32_t height) {
+    // Never above the size the encoder was opened at
+    width  = std::min(width, current_config_.width) & ~1u;
+    height = std::min(height, current_config_.height) & ~1u;
+    if (!scalable_ || width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF) return;
+    pending_size_.store(width << 16 | height);
+}
+
+void SessionManager::applyOutputSize() {
+    const uint32_t packed = pending_size_.exchange(0);
+    if (packed == 0) return;
+
+    const uint32_t width  = packed >> 16;
+    const uint32_t height = packed & 0xFFFF;
+    const bool scaled = converter_ ? converter_->setOutputSize(width, height)
+                                   : capture_->setOutputSize(width, height);
+    if (!scaled) {
+        CS_LOG(WARN, "Cannot scale frames to %ux%u", width, height);
+        return;
+    }
+    CS_LOG(INFO, "Streaming at %ux%u", width, height);
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.width  = width;
+    stats_.height = height;
+}
+
 // ---------------------------------------------------------------------------
 // streamingLoop() -- main video capture + encode + send loop
 // ---------------------------------------------------------------------------
 void SessionManager::streamingLoop() {
     CS_LOG(INFO, "Streaming loop started");
 
-#ifdef _WIN32
-    // Raise thread priority for consistent frame pacing
-    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
-#endif
+    // Raised (and pinned, if configured) for consistent frame pacing
+    cs::ScopedThreadRole role(cs::ThreadRole::CAPTURE);
 
     // Re-initialize capture device for the streaming session
     if (!capture_->initialize(0)) {
@@ -586,18 +1734,139 @@ void SessionManager::streamingLoop() {
         return;
     }
 
+    // Reused across frames so the steady-state send path does not allocate.
+    EncodedPacket encoded;
+    batch_.reserve(PACKET_CACHE_SIZE / 2);
+
+    // Fragments sent before their frame is complete need a client that
+    // takes an unknown fragment total (wire v3).
+    sliced_ = wire_version_ >= 3 && encoder_->getSliceCount() > 1;
+
+    // With the cores for it, capture, encode and send each get a thread,
+    // so a slow encode or sendto() burst no longer holds up the next
+    // capture.  A small device (a low-core Jetson) runs them in turn on
+    // this one.
+    const unsigned cores = std::thread::hardware_concurrency();
+    staged_ = current_config_.pipeline == PipelineMode::STAGED ||
+              (current_config_.pipeline == PipelineMode::AUTO && cores >= STAGED_MIN_CORES);
+    cs::trace::setThreadName(staged_ ? "capture" : "streaming");
+    capture_latency_.reset();
+    encode_latency_.reset();
+    send_latency_.reset();
+    clock_sync_.reset();
+
+    // Whole frames go through the encoder asynchronously where it can:
+    // the next frame is captured and submitted while earlier ones encode,
+    // and the encoder's output thread sends each as it comes out.  GPU
+    // frames stay on their capture surface until then.
+    submissions_.clear();
+    max_in_flight_ = std::min(std::max(current_config_.encode_depth, 1u), MAX_ASYNC_DEPTH);
+    if (capture_->getFrameMemory() != FrameMemory::SYSTEM) {
+        max_in_flight_ = std::min(max_in_flight_, capture_->getSurfaceCount());
+    }
+    async_encode_ = !sliced_ && current_config_.encode_depth > 1 &&
+        encoder_->startAsync([this](EncodedPacket& packet, bool ok) { onEncoded(packet, ok); });
+    if (staged_ && !async_encode_) {
+        max_in_flight_ = STAGED_SEND_DEPTH;
+    }
+    CS_LOG(INFO, "Video sent %s", sliced_ ? "slice by slice" :
+           async_encode_ ? "in whole frames, encoded asynchronously" : "in whole frames");
+    if (async_encode_) {
+        CS_LOG(INFO, "Up to %u frame(s) in flight in the encoder", max_in_flight_);
+    }
+
+    if (staged_) {
+        max_frames_held_ = capture_->getSurfaceCount();
+        frames_held_.store(0);
+        capture_done_.store(false);
+        encode_done_.store(false);
+        encode_thread_ = std::thread(&SessionManager::encodeStage, this);
+        if (!sliced_) {
+            send_thread_ = std::thread(&SessionManager::sendStage, this);
+        }
+        CS_LOG(INFO, "Staged pipeline (%u cores): %s; %s when encoding falls behind",
+               cores, sliced_ ? "capture | encode + send" : "capture | encode | send",
+               current_config_.overload == OverloadPolicy::SKIP_STALE
+                   ? "dropping stale frames" : "skipping captures");
+    }
+
+    // --- Frame pacing ---
+    // Capture-driven, the capture blocks until the desktop changes and
+    // the pacer only caps the rate; a static desktop costs nothing.  On
+    // the timer, captures follow a steady clock and take whatever is on
+    // screen then.
+    PacingMode pacing = current_config_.pacing;
+    if (pacing == PacingMode::AUTO) {
+        pacing = capture_->waitsForUpdates() ? PacingMode::CAPTURE : PacingMode::TIMER;
+    } else if (pacing == PacingMode::CAPTURE && !capture_->waitsForUpdates()) {
+        CS_LOG(WARN, "%s capture cannot wait for desktop updates -- pacing on the timer",
+               capture_->getName().c_str());
+        pacing = PacingMode::TIMER;
+    }
+    const bool capture_driven = pacing == PacingMode::CAPTURE;
+    capture_->setUpdateWait(capture_driven ? CAPTURE_UPDATE_WAIT_MS : 0);
+
+    FramePacer pacer;
+    uint64_t next_frame_us  = hires_now_us();
+    float    avg_late_ms    = 0.0f;
+    uint64_t cpu_window_us  = next_frame_us;        // Start of the CPU use window
+    uint64_t cpu_window_cpu = threadCpuTimeUs();
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.pacing_mode = pacingModeName(pacing);
+    }
+    CS_LOG(INFO, "Frames paced %s (%s timer)",
+           capture_driven ? "by desktop updates" : "on the timer",
+           pacer.isHighResolution() ? "high-resolution" : "coarse");
+
+    // Held around the send state in asynchronous mode (see send_mutex_).
+    std::unique_lock<std::mutex> send_lock(send_mutex_, std::defer_lock);
+
     while (!should_stop_.load()) {
         uint64_t frame_start_us = hires_now_us();
 
         // Target frame interval in microseconds
         uint32_t target_fps = current_config_.fps;
         if (target_fps == 0) target_fps = 60;
+        if (const uint32_t cap = content_.fpsCap()) target_fps = std::min(target_fps, cap);
         uint64_t frame_interval_us = 1'000'000ULL / target_fps;
 
+        // Sleep until the next frame is due: the next tick of the clock,
+        // or capture-driven, a frame interval after this capture began.
+        // A clock more than a frame behind starts over rather than
+        // capturing the missed frames back to back.
+        auto waitForNextFrame = [&]() {
+            const uint64_t now = hires_now_us();
+            if (capture_driven) {
+                next_frame_us = frame_start_us + frame_interval_us;
+            } else {
+                next_frame_us += frame_interval_us;
+                if (now > next_frame_us + frame_interval_us) next_frame_us = now;
+            }
+            if (now < next_frame_us) {
+                pacer.sleepFor(next_frame_us - now);
+                const uint64_t woke = hires_now_us();
+                const float late_ms = woke > next_frame_us
+                    ? static_cast<float>(woke - next_frame_us) / 1000.0f : 0.0f;
+                avg_late_ms = avg_late_ms * (1.0f - EMA_ALPHA) + late_ms * EMA_ALPHA;
+            }
+
+            if (now - cpu_window_us >= PACING_CPU_WINDOW_US) {
+                const uint64_t cpu = threadCpuTimeUs();
+                std::lock_guard<std::mutex> lock(stats_mutex_);
+                stats_.pacing_cpu_percent = 100.0f * static_cast<float>(cpu - cpu_window_cpu) /
+                                            static_cast<float>(now - cpu_window_us);
+                stats_.pacing_late_ms = avg_late_ms;
+                cpu_window_us  = now;
+                cpu_window_cpu = cpu;
+            }
+        };
+
         // --- Viewer liveness check: pause encoding if no QoS feedback ---
+        // (from any viewer: watch-only ones keep the stream going too)
         {
             auto now = std::chrono::steady_clock::now();
-            if (now - last_feedback_time_ > kViewerTimeout) {
+            if (now - last_feedback_time_ > kViewerTimeout && !anyViewerAlive()) {
                 if (viewer_alive_.exchange(false)) {
                     CS_LOG(WARN, "No QoS feedback for 15s — pausing encoding (viewer may be dead)");
                 }
@@ -608,17 +1877,59 @@ void SessionManager::streamingLoop() {
                 viewer_alive_.store(true);
                 CS_LOG(INFO, "Viewer feedback resumed — resuming encoding");
                 // Send an IDR frame on resume so viewer can recover quickly
-                encoder_->forceIdr();
+                force_idr_flag_.store(true);
             }
         }
 
-        // --- Check IDR request ---
-        if (force_idr_flag_.exchange(false)) {
-            encoder_->forceIdr();
+        if (staged_) {
+            // --- Room in the pipeline ---
+            // A capture now would overwrite a surface the encoder has yet
+            // to read.  Under SKIP_CAPTURE a frame still waiting for the
+            // encoder is enough: it is behind, and the next capture will be
+            // fresher than this one.
+            const bool room = frames_held_.load() < max_frames_held_ &&
+                (current_config_.overload == OverloadPolicy::SKIP_STALE ||
+                 frame_queue_.empty());
+            if (!room) {
+                {
+                    std::lock_guard<std::mutex> lock(stats_mutex_);
+                    stats_.frames_overrun++;
+                }
+                waitForNextFrame();
+                continue;
+            }
+        } else {
+            // --- Check IDR request ---
+            if (force_idr_flag_.exchange(false)) {
+                encoder_->forceIdr();
+            }
+
+            // --- Room in the encoder ---
+            // Waiting here, before the capture, keeps a capture surface from
+            // being overwritten while the encoder still reads it.
+            if (async_encode_) {
+                send_lock.lock();
+                const bool room = submit_cv_.wait_for(send_lock, kSubmitWait, [this]() {
+                    return submissions_.size() < max_in_flight_;
+                });
+                if (!room) {
+                    send_lock.unlock();
+                    continue;
+                }
+            }
+
+            // --- Answer client frame loss reports ---
+            acknowledgeLtr();
+            recoverFromLoss();
+            if (send_lock.owns_lock()) send_lock.unlock();
         }
 
+        // --- Resolution ladder step ---
+        applyOutputSize();
+
         // --- Capture ---
         uint64_t cap_start = hires_now_us();
+        const uint64_t cap_ticks = cs::trace::ticks();
         CapturedFrame frame;
         if (!capture_->captureFrame(frame)) {
             // Brief sleep on capture failure to avoid spinning
@@ -626,127 +1937,221 @@ void SessionManager::streamingLoop() {
             continue;
         }
         uint64_t cap_end = hires_now_us();
-        float cap_ms = static_cast<float>(cap_end - cap_start) / 1000.0f;
+        if (frame.is_new_frame) {
+            cs::trace::record(cs::trace::Stage::CAPTURE, static_cast<uint32_t>(frame.timestamp_us),
+                              cap_ticks, cs::trace::ticks());
+        }
+        capture_latency_.record(cap_end - cap_start);
+
+        // --- Content class ---
+        // Repeats count too: they are how a still picture shows up.
+        if (current_config_.content_adaptive && content_.observe(frame, cap_end)) {
+            encoder_->setContentClass(content_.getClass());
+        }
+
+        Submission sub;
+        sub.cap_ms = static_cast<float>(cap_end - cap_start) / 1000.0f;
 
         // Skip duplicate frames but still pace
         if (!frame.is_new_frame) {
-            uint64_t elapsed = hires_now_us() - frame_start_us;
-            if (elapsed < frame_interval_us) {
-                uint64_t sleep_us = frame_interval_us - elapsed;
-                std::this_thread::sleep_for(std::chrono::microseconds(sleep_us));
-            }
+            waitForNextFrame();
             continue;
         }
-
-        // --- Encode ---
-        uint64_t enc_start = hires_now_us();
-        EncodedPacket encoded;
-        encoded.frame_number = frame_number_;
-        if (!encoder_->encode(frame, encoded)) {
-            CS_LOG(WARN, "Encode failed for frame %u", frame_number_);
-            continue;
+        tagFreshInput(frame, sub);
+
+        // --- Colour conversion (D3D11 frames) ---
+        // Written to the converter's own textures, so the capture surface
+        // is free again as soon as the GPU has read it.
+        if (converter_ && frame.memory == FrameMemory::D3D11) {
+            cs::trace::Scope trace(cs::trace::Stage::CONVERT,
+                                   static_cast<uint32_t>(frame.timestamp_us));
+            if (!converter_->convert(frame, frame)) {
+                CS_LOG(WARN, "Colour conversion failed for frame %u", frame_number_);
+                waitForNextFrame();
+                continue;
+            }
         }
-        uint64_t enc_end = hires_now_us();
-        float enc_ms = static_cast<float>(enc_end - enc_start) / 1000.0f;
 
-        // Update timing averages
-        avg_capture_ms_ = avg_capture_ms_ * (1.0f - EMA_ALPHA) + cap_ms * EMA_ALPHA;
-        avg_encode_ms_  = avg_encode_ms_  * (1.0f - EMA_ALPHA) + enc_ms * EMA_ALPHA;
+        if (staged_) {
+            // --- Hand off to the encode stage ---
+            FrameSlot* slot = frame_queue_.beginPush();
+            if (slot) {
+                slot->frame = frame;
+                slot->sub   = sub;
+                frames_held_.fetch_add(1);
+                frame_queue_.commitPush();
+            } else {
+                std::lock_guard<std::mutex> lock(stats_mutex_);
+                stats_.frames_overrun++;
+            }
+        } else {
+            // --- Frame budget ---
+            if (!budgetFrame(sub)) {
+                waitForNextFrame();
+                continue;
+            }
 
-        // --- Fragment and send ---
-        const uint8_t* payload = encoded.data.data();
-        size_t payload_len = encoded.data.size();
-        uint8_t frag_total = static_cast<uint8_t>(
-            (payload_len + MAX_FRAGMENT_PAYLOAD - 1) / MAX_FRAGMENT_PAYLOAD);
-        if (frag_total == 0) frag_total = 1;
+            // --- Encode ---
+            if (async_encode_) {
+                // Queued before the submit so the output thread finds it; the
+                // lock keeps it from running ahead in the meantime.  There is
+                // room (checked above), so submit() does not block on it.
+                std::lock_guard<std::mutex> lock(send_mutex_);
+                sub.submit_us      = hires_now_us();
+                sub.recovery_epoch = recovery_epoch_;
+                submissions_.push_back(sub);
+                if (!encoder_->submit(frame)) {
+                    submissions_.pop_back();
+                    CS_LOG(WARN, "Encode submit failed for frame %u", frame_number_);
+                    continue;
+                }
+            } else {
+                encodeAndSend(frame, encoded, sub);
+            }
+        }
 
-        // Collect fragments for FEC
-        std::vector<std::vector<uint8_t>> data_packets;
+        waitForNextFrame();
+    }
 
-        for (uint8_t frag = 0; frag < frag_total; ++frag) {
-            size_t offset = static_cast<size_t>(frag) * MAX_FRAGMENT_PAYLOAD;
-            size_t chunk_len = std::min(MAX_FRAGMENT_PAYLOAD, payload_len - offset);
+    // Frames still in the encoder go out before the session winds down
+    // (in a staged pipeline, the encode stage sees to it).
+    if (staged_) {
+        capture_done_.store(true);
+        frame_queue_.wake();
+        if (encode_thread_.joinable()) encode_thread_.join();
+        if (send_thread_.joinable())   send_thread_.join();
+    } else if (async_encode_) {
+        encoder_->stopAsync();
+    }
+    async_encode_ = false;
 
-            cs::VideoPacketHeader hdr = buildVideoHeader(
-                video_seq_, static_cast<uint16_t>(frame_number_ & 0xFFFF),
-                frag, frag_total,
-                encoded.is_keyframe,
-                static_cast<uint32_t>(chunk_len),
-                encoded.timestamp_us);
+    CS_LOG(INFO, "Streaming loop stopped (sent %u frames)", frame_number_);
+}
 
-            // Serialize header + payload fragment
-            std::vector<uint8_t> pkt = hdr.serialize(payload + offset, chunk_len);
+// ---------------------------------------------------------------------------
+// encodeStage() -- staged pipeline: queued frame -> encoder
+// ---------------------------------------------------------------------------
+void SessionManager::encodeStage() {
+    cs::ScopedThreadRole role(cs::ThreadRole::ENCODE);
+    cs::trace::setThreadName("encode");
+
+    const bool gpu_frames = capture_->getFrameMemory() != FrameMemory::SYSTEM;
+    EncodedPacket encoded;   // Sliced frames, sent from here
+
+    while (!(capture_done_.load() && frame_queue_.empty())) {
+        if (!frame_queue_.waitForData(kSubmitWait)) continue;
+
+        // Under SKIP_STALE the capture stage queues what it catches while
+        // the encoder is busy; only the newest frame is worth encoding.
+        if (current_config_.overload == OverloadPolicy::SKIP_STALE) {
+            while (frame_queue_.size() > 1) {
+                frame_queue_.pop();
+                frames_held_.fetch_sub(1);
+                std::lock_guard<std::mutex> lock(stats_mutex_);
+                stats_.frames_stale++;
+            }
+        }
+        const FrameSlot* slot = frame_queue_.front();
+        const CapturedFrame frame = slot->frame;
+        Submission sub = slot->sub;
+        frame_queue_.pop();
 
-            // Send via transport (pre-serialized packet.h format)
-            transport_->sendPacket(pkt, video_seq_);
+        if (should_stop_.load()) {
+            frames_held_.fetch_sub(1);
+            continue;
+        }
 
-            data_packets.push_back(std::move(pkt));
-            ++video_seq_;
+        // --- Check IDR request ---
+        if (force_idr_flag_.exchange(false)) {
+            encoder_->forceIdr();
         }
 
-        // --- FEC ---
-        if (fec_ && data_packets.size() > 1) {
-            auto fec_payloads = fec_->encode(data_packets);
-            if (!fec_payloads.empty()) {
-                uint8_t group_id = fec_->currentGroupId();
-                for (size_t i = 0; i < fec_payloads.size(); ++i) {
-                    // Build FEC packet: [0xFC][seq:2][group_id][group_sz][fec_idx][frame_low][payload]
-                    std::vector<uint8_t> fec_pkt;
-                    fec_pkt.reserve(7 + fec_payloads[i].size());
-                    fec_pkt.push_back(static_cast<uint8_t>(cs::PacketType::FEC));
-                    uint16_t seq = video_seq_++;
-                    fec_pkt.push_back(static_cast<uint8_t>(seq >> 8));
-                    fec_pkt.push_back(static_cast<uint8_t>(seq & 0xFF));
-                    fec_pkt.push_back(group_id);
-                    fec_pkt.push_back(static_cast<uint8_t>(fec_payloads.size()));
-                    fec_pkt.push_back(static_cast<uint8_t>(i));
-                    fec_pkt.push_back(static_cast<uint8_t>(frame_number_ & 0xFF));
-                    fec_pkt.insert(fec_pkt.end(),
-                                   fec_payloads[i].begin(), fec_payloads[i].end());
-                    transport_->sendPacket(fec_pkt, seq);
-                }
-            }
+        // --- Frame budget ---
+        if (!budgetFrame(sub)) {
+            frames_held_.fetch_sub(1);
+            continue;
         }
 
-        ++frame_number_;
+        // Slices go out as they encode; this stage is the only sender.
+        if (sliced_) {
+            acknowledgeLtr();
+            recoverFromLoss();
+            encodeAndSend(frame, encoded, sub);
+            frames_held_.fetch_sub(1);
+            continue;
+        }
 
-        // --- Update stats ---
-        {
-            std::lock_guard<std::mutex> lock(stats_mutex_);
-            stats_.frames_sent    = frame_number_;
-            stats_.bytes_sent     = transport_->totalBytesSent();
-            stats_.capture_time_ms = avg_capture_ms_;
-            stats_.encode_time_ms  = avg_encode_ms_;
-            if (fec_) {
-                stats_.fec_ratio = fec_->getRedundancyRatio();
-            }
-            if (qos_) {
-                QosStats qs = qos_->getStats();
-                stats_.bitrate_kbps        = qs.bitrate_kbps;
-                stats_.packet_loss_percent = qs.loss_rate * 100.0f;
-                stats_.jitter_ms           = static_cast<float>(qs.jitter_us) / 1000.0f;
-                stats_.rtt_ms              = static_cast<float>(qs.rtt_us) / 1000.0f;
-            }
+        // --- Room for the frame until it is sent ---
+        std::unique_lock<std::mutex> send_lock(send_mutex_);
+        const bool room = submit_cv_.wait_for(send_lock, kSubmitWait, [this]() {
+            return submissions_.size() < max_in_flight_;
+        });
+        if (!room) {
+            frames_held_.fetch_sub(1);
+            continue;
         }
 
-        // --- Frame pacing ---
-        uint64_t frame_end_us = hires_now_us();
-        uint64_t elapsed_us = frame_end_us - frame_start_us;
-        if (elapsed_us < frame_interval_us) {
-            uint64_t sleep_us = frame_interval_us - elapsed_us;
-            // Spin-wait for the last 500us for precision
-            if (sleep_us > 500) {
-                std::this_thread::sleep_for(
-                    std::chrono::microseconds(sleep_us - 500));
-            }
-            // Busy-wait for remaining time
-            while (hires_now_us() - frame_start_us < frame_interval_us) {
-                // spin
+        // --- Answer client frame loss reports ---
+        acknowledgeLtr();
+        recoverFromLoss();
+
+        sub.submit_us      = hires_now_us();
+        sub.recovery_epoch = recovery_epoch_;
+        submissions_.push_back(sub);
+
+        if (async_encode_) {
+            // Under the lock, as in the single-threaded pipeline, so the
+            // send stage finds the submission for what comes out.
+            if (!encoder_->submit(frame)) {
+                submissions_.pop_back();
+                frames_held_.fetch_sub(1);
+                CS_LOG(WARN, "Encode submit failed for frame %u", frame_number_);
+                continue;
             }
+            // A GPU frame is read in place until it comes out (onEncoded())
+            if (!gpu_frames) frames_held_.fetch_sub(1);
+            continue;
+        }
+        send_lock.unlock();
+
+        // Every queued packet is one of submissions_, which was short of
+        // max_in_flight_, so there is a slot.
+        PacketSlot* out = nullptr;
+        while (!(out = packet_queue_.beginPush())) {
+            std::this_thread::yield();
         }
+        out->ok         = encoder_->encode(frame, out->packet);
+        out->encoded_us = hires_now_us();
+        frames_held_.fetch_sub(1);
+        packet_queue_.commitPush();
     }
 
-    CS_LOG(INFO, "Streaming loop stopped (sent %u frames)", frame_number_);
+    // Whatever is still in the encoder comes out to the send stage.
+    if (async_encode_) {
+        encoder_->stopAsync();
+    }
+    encode_done_.store(true);
+    packet_queue_.wake();
+}
+
+// ---------------------------------------------------------------------------
+// sendStage() -- staged pipeline: encoded frame -> wire
+// ---------------------------------------------------------------------------
+void SessionManager::sendStage() {
+    cs::ScopedThreadRole role(cs::ThreadRole::SEND);
+    cs::trace::setThreadName("send");
+
+    while (!(encode_done_.load() && packet_queue_.empty())) {
+        if (!packet_queue_.waitForData(kSubmitWait)) continue;
+
+        PacketSlot* slot = packet_queue_.front();
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        completeSubmission(slot->packet, slot->ok, slot->encoded_us);
+
+        // Back to the encoder before the submission's room is taken again
+        slot->packet.release();
+        packet_queue_.pop();
+    }
 }
 
 // ---------------------------------------------------------------------------
@@ -754,43 +2159,55 @@ void SessionManager::streamingLoop() {
 // ---------------------------------------------------------------------------
 void SessionManager::audioLoop() {
     CS_LOG(INFO, "Audio loop started");
+    cs::ScopedThreadRole role(cs::ThreadRole::AUDIO);
 
     if (!audio_capture_ || !opus_encoder_ || !transport_) {
         CS_LOG(WARN, "Audio components not available, audio loop exiting");
         return;
     }
 
-    // Start WASAPI capture with a callback that encodes and sends
-    audio_capture_->start([this](const float* samples, size_t frame_count,
-                                  uint32_t sample_rate, uint16_t channels) {
+    // Packets are built in one buffer: the capture thread sends each
+    // before the next is encoded
+    std::vector<uint8_t> audio_pkt(sizeof(cs::AudioPacketHeader) +
+                                   OpusEncoderWrapper::MAX_PACKET_SIZE);
+
+    // Start WASAPI capture with a callback that encodes and sends.  A
+    // capture period need not hold whole Opus frames; the encoder carries
+    // the rest over to the next one.
+    audio_capture_->start([this, &audio_pkt](const float* samples, size_t frame_count,
+                                             uint32_t /*sample_rate*/, uint16_t /*channels*/,
+                                             uint64_t capture_us) {
         if (should_stop_.load()) return;
 
-        // Opus expects a specific frame size (e.g., 480 samples for 10ms @ 48kHz)
-        uint32_t opus_frame_size = opus_encoder_->getFrameSize();
-
-        // Process complete Opus frames from the captured audio
-        size_t offset = 0;
-        while (offset + opus_frame_size <= frame_count && !should_stop_.load()) {
-            std::vector<uint8_t> opus_data;
-            if (opus_encoder_->encode(samples + offset * channels,
-                                       opus_frame_size, opus_data)) {
-                // Build audio packet using packet.h format
-                cs::AudioPacketHeader ahdr;
-                std::memset(&ahdr, 0, sizeof(ahdr));
-                ahdr.setVersion(1);
-                ahdr.setType(static_cast<uint8_t>(cs::PacketType::AUDIO) & 0x3F);
-                ahdr.channel_id      = 0;  // stereo channel 0
-                ahdr.sequence_number = audio_seq_;
-                ahdr.timestamp_us    = static_cast<uint32_t>(hires_now_us() & 0xFFFFFFFF);
-
-                std::vector<uint8_t> audio_pkt = ahdr.serialize(
-                    opus_data.data(), opus_data.size());
-
-                transport_->sendPacket(audio_pkt, audio_seq_);
-                ++audio_seq_;
+        opus_encoder_->encodeStream(samples, frame_count, capture_us,
+                                    [this, &audio_pkt](const uint8_t* opus_data, size_t opus_len,
+                                                       uint64_t frame_us) {
+            // Build audio packet using packet.h format
+            cs::AudioPacketHeader ahdr;
+            std::memset(&ahdr, 0, sizeof(ahdr));
+            ahdr.setVersion(1);
+            ahdr.setType(static_cast<uint8_t>(cs::PacketType::AUDIO) & 0x3F);
+            ahdr.channel_id      = 0;  // stereo channel 0
+            ahdr.sequence_number = audio_seq_;
+            // Capture time on the clock video frames are stamped with, so
+            // the viewer can line the two streams up
+            ahdr.timestamp_us    = static_cast<uint32_t>(frame_us & 0xFFFFFFFF);
+
+            const size_t hdr_len = ahdr.serializeTo(audio_pkt.data());
+            std::memcpy(audio_pkt.data() + hdr_len, opus_data, opus_len);
+            const size_t pkt_len = hdr_len + opus_len;
+
+            // Audio has its own sequence space and is never NACKed,
+            // so keep it out of the video retransmission cache.
+            transport_->sendUncached(audio_pkt.data(), pkt_len);
+            {
+                std::lock_guard<std::mutex> lock(viewers_mutex_);
+                for (const auto& link : viewers_) {
+                    link->sendAudio(audio_pkt.data(), pkt_len);
+                }
             }
-            offset += opus_frame_size;
-        }
+            ++audio_seq_;
+        });
     });
 
     // Wait for stop signal
@@ -811,6 +2228,7 @@ void SessionManager::audioLoop() {
 // ---------------------------------------------------------------------------
 void SessionManager::feedbackLoop() {
     CS_LOG(INFO, "Feedback loop started");
+    cs::ScopedThreadRole role(cs::ThreadRole::FEEDBACK);
 
     if (!transport_ || !qos_) {
         CS_LOG(WARN, "Transport or QoS not available, feedback loop exiting");
@@ -840,28 +2258,118 @@ void SessionManager::feedbackLoop() {
             QosFeedbackPacket ctrl_fb;
             ctrl_fb.jitter_us         = fb.avg_jitter_us;
             ctrl_fb.last_seq          = fb.last_seq_received;
-            ctrl_fb.rtt_us            = 0;  // Client-measured RTT if available
+            const uint64_t now_us     = cs::getTimestampUs();
+            ctrl_fb.rtt_us            = fb.rttFromEcho(static_cast<uint32_t>(now_us & 0xFFFFFFFF));
+
+            // The echo's arrival time relates the viewer's clock to ours
+            if (fb.has_clock &&
+                clock_sync_.addExchange(fb.echo_timestamp_us, fb.echo_recv_us,
+                                        fb.echo_hold_us, now_us)) {
+                BandwidthEstimator& bwe = qos_->getBandwidthEstimator();
+                bwe.setClockOffsetUs(clock_sync_.offsetUs(now_us));
+
+                std::lock_guard<std::mutex> lock(stats_mutex_);
+                stats_.clock_synced    = true;
+                stats_.clock_error_ms  = static_cast<float>(clock_sync_.errorUs()) / 1000.0f;
+                stats_.clock_drift_ppm = static_cast<float>(clock_sync_.driftPpm());
+                stats_.one_way_p50_ms  = bwe.getOneWayDelayMs(0.50f);
+                stats_.one_way_p99_ms  = bwe.getOneWayDelayMs(0.99f);
+            }
 
-            // Compute loss from x100 format
+            // Compute loss from x100 format.  Only a fallback: when
+            // transport-wide feedback is flowing the controller uses its
+            // exact per-packet counts instead.
             float loss = fb.getPacketLossPercent() / 100.0f;
-            // Approximate received/lost from loss rate
             ctrl_fb.received_packets  = 100;
             ctrl_fb.lost_packets      = static_cast<uint32_t>(loss * 100.0f);
 
+            // Sampled here, so a new thermal level lands in this target
+            if (thermal_enabled_.load() && thermal_.update(cs::getTimestampUs())) {
+                qos_->setThermalLevel(thermal_.getLevel());
+            }
+            qos_->setContentFpsCap(content_.fpsCap());
             qos_->onFeedbackReceived(ctrl_fb);
 
+            // Clipboard transfers get the headroom: what the target allows
+            // beyond the rate the viewer acknowledges receiving
+            if (clipboard_) {
+                const QosStats qs = qos_->getStats();
+                if (qs.estimated_bw_kbps > 0) {
+                    clipboard_->setRateLimitKbps(qs.bitrate_kbps > qs.estimated_bw_kbps
+                                                 ? qs.bitrate_kbps - qs.estimated_bw_kbps : 0);
+                }
+            }
+
+            if (fb.has_ltr_ack) {
+                std::lock_guard<std::mutex> lock(loss_mutex_);
+                pending_ltr_ack_ = fb.ltr_ack_frame;
+                ltr_ack_pending_ = true;
+            }
+
             // Handle NACKs
             if (!fb.nack_seqs.empty()) {
                 transport_->onNackReceived(fb.nack_seqs);
             }
-        } else if (ptype == cs::PacketType::CLIPBOARD) {
+
+            // Answer with a fresh RTT probe; the client echoes it in its
+            // next report.  It rides the audio lane so pacing cannot queue
+            // it behind video and inflate the sample.
+            cs::RttProbePacket probe{};
+            probe.type         = static_cast<uint8_t>(cs::PacketType::RTT_PROBE);
+            probe.send_time_us = static_cast<uint32_t>(cs::getTimestampUs() & 0xFFFFFFFF);
+            probe.srtt_us      = qos_->getSmoothedRttUs();
+            probe.rttvar_us    = qos_->getRttVarUs();
+            uint8_t probe_buf[sizeof(cs::RttProbePacket) + sizeof(cs::RttProbeClock)];
+            size_t  probe_len = 0;
+            if (clock_sync_.hasEstimate()) {
+                // With the clock estimate, so the viewer can place our
+                // timestamps on its own clock
+                cs::RttProbeClock clock{};
+                clock.offset_us = clock_sync_.offsetUs(cs::getTimestampUs());
+                clock.error_us  = clock_sync_.errorUs();
+                probe.flags |= cs::RTT_PROBE_FLAG_CLOCK;
+                probe_len = probe.serializeTo(probe_buf);
+                probe_len += clock.serializeTo(probe_buf + probe_len);
+            } else {
+                probe_len = probe.serializeTo(probe_buf);
+            }
+            transport_->sendUncached(probe_buf, probe_len, PacingLane::AUDIO);
+        } else if (ptype == cs::PacketType::FRAME_LOSS) {
+            cs::FrameLossPacket report;
+            if (cs::FrameLossPacket::deserialize(data, len, report)) {
+                onFrameLoss(report);
+            }
+        } else if (ptype == cs::PacketType::TRANSPORT_FEEDBACK) {
+            cs::TransportFeedback tf;
+            if (cs::TransportFeedback::deserialize(data, len, tf)) {
+                qos_->onTransportFeedback(tf);
+            }
+        } else if (ptype == cs::PacketType::INPUT) {
+            if (len > 1 && data[1] == static_cast<uint8_t>(cs::InputType::CONTROLLER_STATE)) {
+                if (controllers_) {
+                    controllers_->onStatePacket(data, len);
+                }
+            } else if (input_) {
+                input_->onInputPacket(data, len);
+            }
+        } else if (ptype == cs::PacketType::CONTROLLER) {
+            cs::ControllerPacket pkt;
+            if (controllers_ && cs::ControllerPacket::deserialize(data, len, pkt)) {
+                controllers_->inject(pkt);
+            }
+        } else if (ptype == cs::PacketType::CLIPBOARD || ptype == cs::PacketType::CLIP_CHUNK) {
             if (clipboard_) {
                 clipboard_->onClipboardReceived(data, len);
             }
-        } else if (ptype == cs::PacketType::CLIP_ACK) {
+        } else if (ptype == cs::PacketType::CLIP_ACK ||
+                   ptype == cs::PacketType::CLIP_WINDOW_ACK) {
             if (clipboard_) {
                 clipboard_->onAckReceived(data, len);
             }
+        } else if (ptype == cs::PacketType::CURSOR_REQUEST) {
+            if (cursor_) {
+                cursor_->onShapeRequest(data, len);
+            }
         } else if (ptype == cs::PacketType::NACK) {
             // Standalone NACK packets -- extract sequence numbers
             // NACK format: type(1) + count(2) + seq_list(count * 2)
@@ -884,11 +2392,15 @@ void SessionManager::feedbackLoop() {
         }
     });
 
-    // Poll for incoming packets
+    // Block on socket readiness, then drain everything pending so NACKs and
+    // feedback are serviced as soon as they arrive.  stopSession() wakes
+    // the wait; the timeout is only a backstop.
     while (!should_stop_.load()) {
-        if (!transport_->receiveOne()) {
-            // No packet ready -- sleep briefly to avoid busy-waiting
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (!transport_->waitReadable(FEEDBACK_WAIT_MS)) continue;
+
+        size_t drained = 0;
+        while (drained < FEEDBACK_MAX_DRAIN && transport_->receiveOne()) {
+            ++drained;
         }
     }
 
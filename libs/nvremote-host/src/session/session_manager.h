@@ -12,26 +12,62 @@
 //   4. stopSession()      -- tear down threads and release resources
 //
 // The streaming loop runs on a dedicated high-priority thread, capturing
-// frames at the target FPS using QueryPerformanceCounter for precise timing.
+// frames at the target FPS: on a waitable timer, or as the desktop changes
+// where the capture backend can wait for that (see PacingMode).
+// With enough cores it only captures, and hands frames to an encode and a
+// send stage on threads of their own (see PipelineMode).
+//
+// Watch-only viewers can join a streaming session (addViewer() /
+// startViewer()): each gets every encoded frame over a ViewerLink of its
+// own, while the session's viewer keeps control of the encoder.
+//
+// A session may stream several displays (SessionConfig::displays): the
+// primary through the session's own capture and encoder, each further one
+// as a DisplayStream with an encoder session of its own, sent as its own
+// video stream to a CS05 viewer.  The streams share the transport and the
+// QoS controller's bitrate, split by display area.
+//
+// The primary display's change maps also feed a content classifier
+// (SessionConfig::content_adaptive): as the picture turns from a game to a
+// desktop to a video, the encoder's QP map and the frame rate follow it,
+// within the gaming mode, without a keyframe.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include "cs/common.h"
+#include "cs/latency_histogram.h"
+#include "cs/qos/clock_sync.h"
 #include "cs/qos/gaming_modes.h"
+#include "cs/spsc_queue.h"
 #include "cs/p2p/ice_agent.h"
+#include "cs/p2p/turn_pool.h"
 #include "cs/transport/dtls_context.h"
+#include "cs/transport/media_cipher.h"
+#include "cs/transport/network_impairment.h"
 #include "cs/transport/packet.h"
+#include "cs/transport/packet_recorder.h"
 
 #include "capture/capture_interface.h"
+#include "capture/cursor_capture.h"
 #include "encode/encoder_interface.h"
+#include "encode/gpu_monitor.h"
 #include "transport/udp_transport.h"
 #include "transport/fec.h"
+#include "qos/content_classifier.h"
 #include "qos/qos_controller.h"
 #include "audio/wasapi_capture.h"
 #include "audio/opus_encoder.h"
 #include "input/clipboard_inject.h"
+#include "input/input_inject.h"
+#include "input/controller_inject.h"
+#include "session/frame_pacer.h"
+#include "session/viewer_link.h"
+#include "session/display_stream.h"
 
+#include <array>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -40,6 +76,29 @@
 
 namespace cs::host {
 
+class ColorConverter;
+
+// ---------------------------------------------------------------------------
+// PipelineMode -- how the video path is spread over threads
+// ---------------------------------------------------------------------------
+enum class PipelineMode {
+    AUTO,            // STAGED with at least STAGED_MIN_CORES cores, else SINGLE_THREAD
+    SINGLE_THREAD,   // Capture, encode and send one after another on one thread
+    STAGED,          // Capture, encode and send stages, each on its own thread
+};
+
+/// Hardware threads AUTO wants before it stages the pipeline.
+static constexpr unsigned STAGED_MIN_CORES = 4;
+
+// ---------------------------------------------------------------------------
+// OverloadPolicy -- what the staged pipeline gives up when encoding falls
+// behind capture
+// ---------------------------------------------------------------------------
+enum class OverloadPolicy {
+    SKIP_CAPTURE,    // Capture nothing while a frame is still waiting for the encoder
+    SKIP_STALE,      // Keep capturing; the encoder takes the newest frame and drops the rest
+};
+
 // ---------------------------------------------------------------------------
 // SessionConfig -- parameters for session preparation
 // ---------------------------------------------------------------------------
@@ -51,16 +110,32 @@ struct SessionConfig {
     uint32_t    width           = 1920;
     uint32_t    height          = 1080;
     cs::GamingMode gaming_mode  = cs::GamingMode::Balanced;
+    cs::ChromaMode max_chroma   = cs::ChromaMode::YUV420;   // Richest chroma the viewer decodes
+    uint32_t    max_bit_depth   = 8;      // Deepest the viewer decodes (8 or 10)
+    uint32_t    temporal_layers = 2;      // Temporal SVC layers (1 = off; HEVC / AV1 only)
+    uint32_t    slices          = 0;      // Slices per frame, streamed as encoded (0 = auto)
+    uint32_t    encode_depth    = 3;      // Whole frames in flight in the encoder (1 = synchronous)
+    SplitEncode split_encode    = SplitEncode::AUTO;   // Pictures across NVENC engines (HEVC / AV1)
+    PipelineMode   pipeline     = PipelineMode::AUTO;
+    OverloadPolicy overload     = OverloadPolicy::SKIP_CAPTURE;   // Staged pipeline only
+    PacingMode     pacing       = PacingMode::AUTO;
+    int         capture_core    = -1;     // Core each stage's thread is pinned to (-1 = any);
+    int         encode_core     = -1;     // a single-threaded pipeline uses capture_core.
+    int         send_core       = -1;     // A CPU list in |threads| takes precedence
+    std::string threads;                  // Priority, MMCSS and CPUs by thread role, a
+                                          // cs/thread_policy.h spec (empty = defaults)
+    uint32_t    displays        = 1;      // Displays streamed (0 = all there are); CS05 viewers only
+    uint32_t    send_shards     = 0;      // Threads sealing and sending each frame (1 = the send
+                                          // thread alone, 0 = auto: more at 100+ Mbps)
+    bool        send_shard_sockets = false;   // A socket per shard, where SO_REUSEPORT allows
+    MultipathPolicy multipath;            // What also goes over the viewer's standby path
+                                          // (default: nothing)
+    bool        bandwidth_probing = true;   // Probe for capacity at start and after congestion
+    bool        content_adaptive  = true;   // Tune QP and frame rate to the content class
+    uint32_t    dtls_identity_reuse_s = 3600;   // Sessions within this keep the host's DTLS
+                                                // identity, so viewers resume (0 = new each time)
     std::vector<std::string> stun_servers;
-};
-
-// ---------------------------------------------------------------------------
-// PeerInfo -- remote peer connection details
-// ---------------------------------------------------------------------------
-struct PeerInfo {
-    std::string ip;
-    uint16_t    port              = 0;
-    std::string dtls_fingerprint;
+    std::vector<cs::TurnConfig> turn_servers;   // Relay fallback; the first is used (empty = none)
 };
 
 // ---------------------------------------------------------------------------
@@ -81,7 +156,56 @@ struct SessionStats {
     uint64_t    bytes_sent          = 0;
     uint64_t    frames_sent         = 0;
     float       fec_ratio           = 0.0f;
+    uint64_t    loss_invalidations  = 0;   // Frame losses repaired by reference invalidation
+    uint64_t    loss_idrs           = 0;   // Frame losses repaired by an IDR
+    uint64_t    frames_shed         = 0;   // Enhancement-layer frames not sent (congestion)
+    uint64_t    frames_skipped      = 0;   // Not encoded: pacer queue over the delay bound
+    uint64_t    frames_dropped_oversize = 0;  // Encoded far over budget and not sent
+    uint64_t    frame_budget_bytes  = 0;   // Last delta-frame budget (0 = none)
+    uint64_t    nack_hits           = 0;   // NACKed packets retransmitted
+    uint64_t    nack_misses         = 0;   // NACKed packets already out of the cache
+    uint64_t    nack_expired        = 0;   // NACKed packets past the retention time
+    uint64_t    path_migrations     = 0;   // Times the viewer moved the stream to a new path
+    bool        secondary_path      = false;  // Multipath: the standby path is answering
+    uint64_t    secondary_packets   = 0;      // Datagrams sent on it, repairs included
+    uint64_t    secondary_rescued   = 0;      // Its copies that arrived when the primary's did not
+    float       secondary_loss_percent = 0.0f;
+    float       secondary_rtt_ms    = 0.0f;   // Estimated (0 = no paired samples yet)
+    uint32_t    probe_clusters      = 0;   // Bandwidth probe clusters sent
+    uint32_t    probed_kbps         = 0;   // Last probe's delivered rate (0 = none yet)
+    uint64_t    frames_overrun      = 0;   // Not captured: the pipeline was full
+    uint64_t    frames_stale        = 0;   // Captured, then dropped for a newer one
+    float       capture_p50_ms      = 0.0f;   // Per-stage latency percentiles: capture,
+    float       capture_p99_ms      = 0.0f;
+    float       encode_p50_ms       = 0.0f;   // submit to encoded,
+    float       encode_p99_ms       = 0.0f;
+    float       send_p50_ms         = 0.0f;   // and fragment + FEC + send
+    float       send_p99_ms         = 0.0f;
+    std::string pacing_mode;        // "timer" or "capture"
+    float       pacing_late_ms      = 0.0f;   // Average wake-up past the frame deadline
+    float       pacing_cpu_percent  = 0.0f;   // CPU use of the capture (pacing) thread
     std::string connection_type;    // "p2p" or "relay"
+    uint32_t    viewers             = 0;      // Watch-only viewers streaming
+    uint32_t    displays            = 1;      // Displays streaming, the primary included
+    std::string thermal_state;      // Governor level ("NORMAL" .. "CRITICAL"), empty if none
+    float       soc_temp_c          = 0.0f;   // Zone nearest its trip point
+    float       soc_temp_predicted_c = 0.0f;  // Its governor prediction
+    uint32_t    encoder_load_percent = 0;     // Thermal governor's, else NVML's (all engines)
+    uint32_t    encoder_engines     = 1;      // NVENC engines on the GPU
+    uint32_t    encoder_split_ways  = 1;      // Engines each picture is split across
+    std::string content_class;      // Classifier's view ("motion", "text", ...), empty if off
+    uint32_t    content_transitions = 0;      // Class changes this session
+    uint32_t    content_fps_cap     = 0;      // Frame rate the class holds to (0 = none)
+    float       content_coverage    = 0.0f;   // Share of the picture a changing frame changed
+    bool        warm_start          = false;  // Encoder restarted from standby, not reopened
+    float       encoder_open_ms     = 0.0f;   // Opening (or restarting) it in prepareSession()
+    float       time_to_first_frame_ms = 0.0f;   // prepareSession() to the first frame sent
+    float       audio_capture_latency_ms = 0.0f; // Loopback capture behind the speakers (0 = no audio)
+    bool        clock_synced        = false;  // Viewer clock offset estimated
+    float       clock_error_ms      = 0.0f;   // Bound on that offset's error
+    float       clock_drift_ppm     = 0.0f;   // Viewer clock rate against ours
+    float       one_way_p50_ms      = 0.0f;   // Packet send to arrival at the viewer,
+    float       one_way_p99_ms      = 0.0f;   // on one clock (0 until synced)
 };
 
 // ---------------------------------------------------------------------------
@@ -105,9 +229,29 @@ public:
     /// Perform DTLS handshake and start streaming/audio/feedback threads.
     bool startSession(const PeerInfo& peer);
 
-    /// Stop all threads and release session resources.
+    /// Stop all threads and release session resources.  With warm
+    /// standby the capture and encoder are kept open for the next session.
     void stopSession();
 
+    /// Keep the capture and encoder open between sessions (the default),
+    /// so a session like the last restarts the encoder instead of opening
+    /// one.  Turning it off releases them if no session is prepared.
+    void setWarmStandby(bool enabled);
+
+    /// Keep TURN allocations ready on |config|'s server (see turn_pool.h),
+    /// so a later session relayed through it does not wait for an
+    /// Allocate.  An empty server releases them.
+    void setTurnPool(const cs::TurnConfig& config);
+
+    /// Emulate a bad network on every session's and viewer's egress from
+    /// the next start on (see network_impairment.h); for QoS testing.
+    void setImpairment(const cs::ImpairmentConfig& config) { impairment_ = config; }
+
+    /// Record each session's packets from the next start on (see
+    /// packet_recorder.h): the first session to |path|, later ones to
+    /// |path| with "-2", "-3"... before the extension.  Empty stops.
+    void setRecordPath(const std::string& path) { record_path_ = path; }
+
     /// Force the encoder to produce an IDR keyframe.
     void forceIdr();
 
@@ -120,6 +264,21 @@ public:
     /// Get a snapshot of current streaming statistics.
     SessionStats getStats() const;
 
+    /// DTLS fingerprint of the prepared session, for the viewer to expect.
+    std::string getFingerprint() const { return dtls_ ? dtls_->getFingerprint() : std::string(); }
+
+    /// Make a watch-only viewer |viewer_id| for the prepared session and
+    /// return the DTLS fingerprint it should expect in |fingerprint|.
+    bool addViewer(const std::string& viewer_id, std::string& fingerprint);
+
+    /// Connect viewer |viewer_id| (from addViewer()) to |peer| and start
+    /// streaming to it from the next keyframe.  The session must be
+    /// streaming.
+    bool startViewer(const std::string& viewer_id, const PeerInfo& peer);
+
+    /// Disconnect and forget viewer |viewer_id|.
+    void removeViewer(const std::string& viewer_id);
+
     /// Returns true if streaming threads are active.
     bool isStreaming() const;
 
@@ -131,33 +290,185 @@ public:
 
 private:
     /// Main video capture + encode + send loop (runs on stream_thread_).
+    /// In a staged pipeline, the capture stage.
     void streamingLoop();
 
+    /// Staged pipeline: encode what the capture stage queued (runs on
+    /// encode_thread_).
+    void encodeStage();
+
+    /// Staged pipeline: send what the encode stage queued (runs on
+    /// send_thread_).
+    void sendStage();
+
     /// Audio capture + Opus encode + send loop (runs on audio_thread_).
     void audioLoop();
 
     /// QoS feedback receive loop (runs on feedback_thread_).
     void feedbackLoop();
 
-    /// Build a video packet header for the current frame fragment.
-    cs::VideoPacketHeader buildVideoHeader(uint16_t seq, uint16_t frame_num,
-                                           uint8_t frag_idx, uint8_t frag_total,
-                                           bool is_keyframe, uint32_t payload_len,
-                                           uint64_t timestamp_us) const;
+    /// A watch-only viewer has sent feedback within kViewerTimeout.
+    bool anyViewerAlive() const;
+
+    /// Open a DisplayStream for each display past the primary the session
+    /// asks for, as far as the GPU has displays and encoder sessions for
+    /// them, and split the bitrate between the streams by area.
+    void openDisplays(const EncoderConfig& base);
+
+    /// Split |total_kbps| between the primary and the extra displays: hand
+    /// each display its share and return the primary's.
+    uint32_t shareBitrate(uint32_t total_kbps);
+
+    /// Packetize and send an extra display's frame as |frame_number| of
+    /// video stream |stream| (display thread).  False if it is too large
+    /// for the wire.
+    bool sendDisplayFrame(uint8_t stream, const EncodedPacket& encoded, uint32_t frame_number);
+
+    /// Size video fragments and FEC groups for the transport's negotiated
+    /// packet size.
+    void applyPacketSize();
+
+    /// Build a video packet header for the current frame fragment, tagged
+    /// with the negotiated wire version (serializeTo() picks the layout).
+    cs::VideoPacketHeaderV2 buildVideoHeader(uint16_t seq, uint32_t frame_num,
+                                             uint16_t frag_idx, uint16_t frag_total,
+                                             bool is_keyframe, uint32_t payload_len,
+                                             uint64_t timestamp_us) const;
+
+    /// Record a client frame loss report (feedback thread).
+    void onFrameLoss(const cs::FrameLossPacket& report);
+
+    /// Pass the newest long-term reference the client acknowledged on to the
+    /// encoder (encoding thread, under send_mutex_ when pipelined).
+    void acknowledgeLtr();
+
+    /// Answer the pending frame loss report, if any, before the next encode:
+    /// invalidate the lost references, or force an IDR when the encoder
+    /// cannot (encoding thread, under send_mutex_ when pipelined).
+    void recoverFromLoss();
+
+    /// What the streaming thread knew about a frame when it went to the
+    /// encoder, for the send path once the frame comes out.
+    struct Submission {
+        size_t   frame_budget   = 0;       // Bytes (0 = no budget)
+        float    cap_ms         = 0.0f;    // Capture time
+        uint64_t submit_us      = 0;       // Encode start
+        uint64_t encoded_us     = 0;       // Encode end, if queued for sending (0 = now)
+        uint32_t recovery_epoch = 0;       // recovery_epoch_ at submission
+        bool     fresh_input    = false;   // Captured after input was injected
+    };
+
+    /// If viewer input was injected before |frame| was captured, tell the
+    /// viewer this frame is the first to show it (InputEchoPacket) and mark
+    /// |sub| so that the frame is not skipped.
+    void tagFreshInput(const CapturedFrame& frame, Submission& sub);
+
+    /// Size the frame about to be encoded from what the path drains within
+    /// the queueing delay bound.  Returns false, counting a skip, if the
+    /// pacer alone is over the bound and the frame should not be encoded.
+    bool budgetFrame(Submission& sub);
+
+    /// Open the encoder on the richest picture the preset asks for, the
+    /// viewer decodes and the GPU codes -- 4:4:4, then 10-bit 4:2:0, then
+    /// 8-bit 4:2:0 -- with frames converted to match.
+    /// A standby encoder from the last session is restarted instead when
+    /// the walk would end where that session's did; |warm| tells which.
+    bool openEncoder(EncoderConfig& enc_cfg, bool& warm);
+
+    /// Release the capture and encoder (and the converter holding views of
+    /// the capture's textures).
+    void releaseStandby();
+
+    /// Have frames converted on the GPU to what |enc_cfg| is best coded
+    /// from: by the capture backend, or by converter_ for D3D11 frames.
+    /// Returns the format frames will arrive in.
+    FrameFormat setupColorConversion(const EncoderConfig& enc_cfg);
+
+    /// The preset the QoS controller walks: current_preset_ with its
+    /// resolution ladder from the coded size down, or no steps at all if
+    /// the session cannot scale.
+    cs::QosPreset qosPreset() const;
+
+    /// QoS picked a step of the resolution ladder (feedback thread).
+    void requestOutputSize(uint32_t width, uint32_t height);
+
+    /// Scale frames to the size last requested, from the next capture on
+    /// (capturing thread): by converter_ for D3D11 frames, else by the
+    /// capture backend.  The encoder follows the frames' size.
+    void applyOutputSize();
+
+    /// The frame whose fragments are going out (one thread at a time; see
+    /// send_mutex_).
+    struct FrameSend {
+        const uint8_t* payload   = nullptr;   // Frame bitstream
+        uint64_t       timestamp_us = 0;
+        uint32_t       frame_number = 0;      // Wire frame number in its stream
+        uint8_t        stream    = 0;         // Video stream (0 = primary display)
+        bool           keyframe  = false;
+        bool           recovery  = false;
+        bool           ltr       = false;
+        uint8_t        layer     = 0;         // Temporal layer on the wire
+        int            fec_layer = -1;        // Layer for FEC planning (-1 = no SVC)
+        size_t         sent      = 0;         // Fragments handed to the transport
+        size_t         parity    = 0;         // FEC packets sent
+    };
+
+    /// Label |fs| from the encoder's metadata for the frame, submitted
+    /// as |sub|.
+    void describeFrame(const EncodedPacket& encoded, const Submission& sub,
+                       FrameSend& fs) const;
+
+    /// Packetize fragments fs.sent .. |frag_end| - 1 of a frame of which
+    /// the first |len| bytes are final, protect them with FEC and hand them
+    /// to the transport.  Every header carries |frag_total|: the frame's
+    /// fragment count, or 0 while the frame is still being encoded
+    /// (sender, or a display thread; serialized by wire_mutex_).
+    void sendFragments(FrameSend& fs, size_t len, size_t frag_end, uint16_t frag_total);
+
+    /// Everything after the encode: shed, drop or fragment and send
+    /// |encoded|, then record it and update the stats.  For a sliced frame
+    /// |fs| holds what went out while encoding and |shed| / |oversized|
+    /// what the slice callback decided; a whole frame is labelled here.
+    void finishFrame(EncodedPacket& encoded, FrameSend& fs, bool sliced,
+                     bool shed, bool oversized, const Submission& sub);
+
+    /// Synchronous encode of |frame|, sent slice by slice while it encodes
+    /// or whole once it is done (sender).
+    void encodeAndSend(const CapturedFrame& frame, EncodedPacket& encoded, Submission& sub);
+
+    /// The oldest submission came out of the encoder as |encoded|: send it,
+    /// or recover if the encode failed (under send_mutex_).
+    void completeSubmission(EncodedPacket& encoded, bool ok, uint64_t encoded_us);
+
+    /// Asynchronous encode output: the next frame submitted came out
+    /// (encoder output thread).
+    void onEncoded(EncodedPacket& encoded, bool ok);
 
     // -----------------------------------------------------------------------
     // Components
     // -----------------------------------------------------------------------
     std::unique_ptr<ICaptureDevice>       capture_;
     std::unique_ptr<IEncoder>             encoder_;
+    std::unique_ptr<cs::PacketRecorder>   recorder_;    // Outlives transport_
     std::unique_ptr<UdpTransport>         transport_;
     std::unique_ptr<FecEncoder>           fec_;
     std::unique_ptr<QosController>        qos_;
+    ThermalGovernor                       thermal_;
+    GpuMonitor                            gpu_;             // NVENC utilization, where NVML loads
+    std::atomic<bool>                     thermal_enabled_{false};   // Thermal zones found
+    ContentClassifier                     content_;         // Capture thread; see content_adaptive
     std::unique_ptr<WasapiCapture>        audio_capture_;
     std::unique_ptr<OpusEncoderWrapper>   opus_encoder_;
+    cs::DtlsIdentityPool                  identities_;     // Generated ahead, kept across sessions
+    cs::TurnPool                          turn_pool_;      // Relays allocated ahead, outlives ice_
     std::unique_ptr<cs::DtlsContext>      dtls_;
+    std::unique_ptr<cs::MediaCipher>      media_cipher_;   // Keyed from dtls_
     std::unique_ptr<cs::IceAgent>         ice_;
     std::unique_ptr<ClipboardInjector>    clipboard_;
+    std::unique_ptr<InputInjector>        input_;          // Mouse and keyboard from the viewer
+    std::unique_ptr<ControllerInjector>   controllers_;    // Gamepads from the viewer
+    std::unique_ptr<CursorCapture>        cursor_;         // Set while the viewer draws the cursor
+    std::unique_ptr<ColorConverter>       converter_;      // Set while D3D11 frames are converted
 
     // -----------------------------------------------------------------------
     // Threading state
@@ -165,7 +476,11 @@ private:
     std::atomic<bool> streaming_{false};
     std::atomic<bool> should_stop_{false};
     std::atomic<bool> force_idr_flag_{false};
+    std::atomic<uint32_t> pending_size_{0};          // width << 16 | height (0 = none)
+    bool              scalable_ = false;             // Frames can be scaled for the encoder
     std::thread       stream_thread_;
+    std::thread       encode_thread_;               // Staged pipeline only
+    std::thread       send_thread_;                 // Staged pipeline, whole frames only
     std::thread       audio_thread_;
     std::thread       feedback_thread_;
 
@@ -177,6 +492,113 @@ private:
     uint32_t           frame_number_  = 0;
     uint16_t           video_seq_     = 0;
     uint16_t           audio_seq_     = 0;
+    size_t             max_fragment_payload_ = 0;   // Set by applyPacketSize()
+    uint8_t            wire_version_  = 1;          // Negotiated video header version
+
+    // Asynchronous encode.  The streaming thread captures and submits
+    // while the encoder's output thread sends what comes out, so the send
+    // state below (frame and sequence numbers, scratch, history, recovery)
+    // is then only touched under send_mutex_.  submissions_ holds the
+    // frames in flight, oldest first; at most max_in_flight_, which GPU
+    // frames also bound by the capture's surface count.
+    bool                     async_encode_  = false;
+    std::mutex               send_mutex_;
+    std::condition_variable  submit_cv_;          // A submission came out
+    std::deque<Submission>   submissions_;
+    uint32_t                 max_in_flight_ = 1;
+    uint32_t                 last_encoder_frame_ = 0;   // Newest frame out of the encoder
+    static constexpr auto kSubmitWait = std::chrono::milliseconds(100);
+
+    // Staged pipeline.  The capture stage queues frames for the encode
+    // stage, which queues what comes out of the encoder (or the encoder's
+    // output thread does) for the send stage.  submissions_ then covers
+    // the frames from encode start until they are sent, and the send
+    // state is only touched under send_mutex_ as above.  A frame ties up
+    // its capture surface until the encoder is done with it; frames_held_
+    // counts those, at most max_frames_held_.  Sliced frames are sent by
+    // the encode stage as they encode, with no send stage.
+    struct FrameSlot {
+        CapturedFrame frame;
+        Submission    sub;
+    };
+    struct PacketSlot {
+        EncodedPacket packet;
+        bool          ok         = false;
+        uint64_t      encoded_us = 0;
+    };
+    static constexpr size_t FRAME_QUEUE_SLOTS  = 4;
+    static constexpr size_t PACKET_QUEUE_SLOTS = 8;
+    static_assert(PACKET_QUEUE_SLOTS >= MAX_ASYNC_DEPTH,
+                  "Every frame in flight needs a packet slot to come out to");
+    static constexpr uint32_t STAGED_SEND_DEPTH = 2;   // Synchronous: encoded frames waiting to send
+
+    bool                     staged_        = false;
+    bool                     sliced_        = false;   // Slices sent as they encode
+    SpscQueue<FrameSlot, FRAME_QUEUE_SLOTS>   frame_queue_;
+    SpscQueue<PacketSlot, PACKET_QUEUE_SLOTS> packet_queue_;
+    std::atomic<uint32_t>    frames_held_{0};
+    uint32_t                 max_frames_held_ = 1;
+    std::atomic<bool>        capture_done_{false};     // Nothing more for the encode stage
+    std::atomic<bool>        encode_done_{false};      // Nothing more for the send stage
+
+    // Per-stage latency (each recorded by one thread, read by getStats()).
+    LatencyHistogram         capture_latency_;
+    LatencyHistogram         encode_latency_;
+    LatencyHistogram         send_latency_;
+
+    // The viewer's clock against ours, from the RTT probe exchanges
+    // (feedback thread; the estimate rides back in each probe).
+    cs::ClockSync            clock_sync_;
+
+    // Per-frame packetization scratch (sender only; capacity is kept
+    // between frames so packetization does not allocate).  Every video
+    // stream shares the sequence space and FEC, so the sender and the
+    // display threads take wire_mutex_ to packetize.
+    std::mutex                  wire_mutex_;
+    std::vector<PacketView>     batch_;
+    std::vector<const uint8_t*> fec_data_;
+    std::vector<size_t>         fec_len_;
+    std::vector<uint8_t*>       fec_parity_;
+
+    // Frame loss recovery.  The feedback thread merges client reports into
+    // the pending range; the encoding thread answers it before encoding.
+    std::mutex         loss_mutex_;
+    bool               loss_pending_       = false;
+    uint32_t           pending_loss_first_ = 0;
+    uint32_t           pending_loss_last_  = 0;
+    bool               ltr_ack_pending_    = false;
+    uint32_t           pending_ltr_ack_    = 0;
+
+    // Recently sent frames (sender only), indexed by wire frame
+    // number modulo the history size, to map reports to encoder frames.
+    struct SentFrame {
+        uint32_t wire_frame    = 0;
+        uint32_t encoder_frame = 0;
+        bool     keyframe      = false;
+        bool     ltr           = false;
+        bool     valid         = false;
+    };
+    static constexpr size_t SENT_FRAME_HISTORY = 64;
+    std::array<SentFrame, SENT_FRAME_HISTORY> sent_frames_{};
+
+    // Last recovery (sender only): reports that end before recovery_frame_
+    // and that it already covered are retransmissions.  recovery_epoch_
+    // counts invalidations, so only frames submitted after the latest one
+    // carry its recovery flag.
+    bool               have_recovery_   = false;
+    bool               recovery_by_idr_ = false;
+    uint32_t           recovered_from_  = 0;   // First lost frame it answered
+    uint32_t           recovery_frame_  = 0;   // First frame encoded after it
+    bool               mark_recovery_   = false;  // Flag the next frame sent
+    uint32_t           recovery_epoch_  = 0;
+    bool               have_keyframe_   = false;
+    uint32_t           last_keyframe_   = 0;   // Wire number of the last keyframe sent
+
+    // Per-frame bit budget (sender only).  A delta frame that
+    // overshoots its budget by OVERSIZE_DROP_FACTOR is dropped rather than
+    // queued, at most once in a row so the picture keeps moving.
+    bool               last_frame_dropped_ = false;
+    static constexpr size_t OVERSIZE_DROP_FACTOR = 2;
 
     // Peer address for UDP transport
     struct sockaddr_in peer_addr_;
@@ -192,11 +614,42 @@ private:
     float              avg_capture_ms_ = 0.0f;
     float              avg_encode_ms_  = 0.0f;
 
+    // Watch-only viewers.  The sender hands each frame to every link under
+    // viewers_mutex_; a link leaves the list before it is stopped.
+    mutable std::mutex                       viewers_mutex_;
+    std::vector<std::shared_ptr<ViewerLink>> viewers_;
+    static constexpr size_t MAX_VIEWERS = 32;
+
+    // Extra displays, video streams 1.. in order.  Opened and dropped only
+    // while no session thread runs.
+    std::vector<std::unique_ptr<DisplayStream>> displays_;
+    float                                       primary_share_ = 1.0f;   // Of the bitrate
+
     // Viewer liveness tracking (for pause-on-timeout)
     std::atomic<bool>  viewer_alive_{true};
     std::chrono::steady_clock::time_point last_feedback_time_;
     static constexpr auto kViewerTimeout = std::chrono::seconds(15);
 
+    // Warm standby.  The encoder stays open after stopSession() with the
+    // picture format openEncoder() settled on, and the first rung it tried
+    // (the ladder's top): a session with the same top ends on the same
+    // format, so the open encoder can be restarted on it.
+    struct PictureFormat {
+        bool     yuv444    = false;
+        uint32_t bit_depth = 8;
+        bool operator==(const PictureFormat& o) const {
+            return yuv444 == o.yuv444 && bit_depth == o.bit_depth;
+        }
+    };
+    cs::ImpairmentConfig impairment_;              // Egress emulation (setImpairment)
+    std::string        record_path_;               // setRecordPath
+    uint32_t           recordings_ = 0;            // Sessions recorded so far
+    bool               warm_standby_ = true;
+    bool               warm_valid_   = false;      // encoder_ open with warm_format_
+    PictureFormat      warm_top_;
+    PictureFormat      warm_format_;
+    uint64_t           prepare_start_us_ = 0;      // For time_to_first_frame_ms
+
     // Initialization state
     bool               initialized_ = false;
     bool               prepared_    = false;
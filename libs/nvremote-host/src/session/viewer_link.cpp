@@ -0,0 +1,579 @@
+///////////////////////////////////////////////////////////////////////////////
+// viewer_link.cpp -- One more viewer of a session's stream
+///////////////////////////////////////////////////////////////////////////////
+
+#include "viewer_link.h"
+
+#include "cs/qos/feedback_packet.h"
+#include "cs/qos/transport_feedback.h"
+#include "cs/thread_policy.h"
+
+#include <openssl/crypto.h>
+
+#include <cstring>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// exchangeVersionTags() -- wire version of a viewer that offered none in
+// the handshake.  The host sends the newest version it speaks; the viewer
+// answers with the version both sides support (CS01 from viewers that
+// predate CS02).
+// ---------------------------------------------------------------------------
+static bool exchangeVersionTags(cs::DtlsContext* dtls, ViewerConnection& conn) {
+    uint8_t enc_buf[cs::PROTOCOL_VERSION_TAG_LEN + 256];
+    size_t enc_len = 0;
+    if (!dtls->encrypt(cs::protocolVersionTag(cs::PROTOCOL_WIRE_VERSION_MAX),
+                       cs::PROTOCOL_VERSION_TAG_LEN, enc_buf, &enc_len)) {
+        CS_LOG(ERR, "Failed to send protocol version tag");
+        return false;
+    }
+    // Send encrypted version tag
+    if (enc_len > 0) {
+        ::sendto(conn.socket, reinterpret_cast<const char*>(enc_buf),
+                 static_cast<int>(enc_len), 0,
+                 reinterpret_cast<const ::sockaddr*>(&conn.addr),
+                 sizeof(conn.addr));
+    }
+
+    // Wait for viewer's version tag (5 second timeout)
+    uint8_t recv_buf[64];
+    fd_set read_fds;
+    struct timeval tv;
+    tv.tv_sec = 5;
+    tv.tv_usec = 0;
+    FD_ZERO(&read_fds);
+    FD_SET(static_cast<unsigned int>(conn.socket), &read_fds);
+
+    int sel = ::select(conn.socket + 1, &read_fds, nullptr, nullptr, &tv);
+    if (sel > 0) {
+        ::sockaddr_in from = {};
+        socklen_t fromLen = sizeof(from);
+        int n = ::recvfrom(conn.socket, reinterpret_cast<char*>(recv_buf),
+                           sizeof(recv_buf), 0,
+                           reinterpret_cast<::sockaddr*>(&from), &fromLen);
+        if (n > 0) {
+            uint8_t plain[64];
+            size_t plain_len = 0;
+            uint8_t version = 0;
+            if (dtls->decrypt(recv_buf, static_cast<size_t>(n), plain, &plain_len)) {
+                version = cs::parseProtocolVersionTag(plain, plain_len);
+            }
+            if (version > 0 && version <= cs::PROTOCOL_WIRE_VERSION_MAX) {
+                conn.wire_version = version;
+                CS_LOG(INFO, "Protocol version negotiated: CS0%u", version);
+            } else {
+                CS_LOG(ERR, "Protocol version mismatch from viewer");
+                return false;
+            }
+        }
+    } else {
+        CS_LOG(ERR, "Timeout waiting for viewer protocol version");
+        return false;
+    }
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// connectViewer()
+// ---------------------------------------------------------------------------
+bool connectViewer(const PeerInfo& peer, cs::DtlsContext* dtls, ViewerConnection& conn) {
+    auto fail = [&conn]() {
+        conn.cipher.reset();
+        cs_close_socket(conn.socket);
+        conn.socket = -1;
+        return false;
+    };
+
+    // --- Set up UDP socket ---
+    conn.socket = static_cast<int>(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+    if (conn.socket < 0) {
+        CS_LOG(ERR, "Failed to create UDP socket: %d", cs_socket_error());
+        return false;
+    }
+
+    // Bind to any local address
+    struct sockaddr_in local_addr;
+    std::memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+    local_addr.sin_port = htons(peer.local_port);  // 0: OS picks a port
+
+    if (::bind(conn.socket, reinterpret_cast<struct sockaddr*>(&local_addr),
+               sizeof(local_addr)) < 0) {
+        CS_LOG(ERR, "Failed to bind UDP socket: %d", cs_socket_error());
+        return fail();
+    }
+
+    // Resolve peer address
+    std::memset(&conn.addr, 0, sizeof(conn.addr));
+    conn.addr.sin_family = AF_INET;
+    conn.addr.sin_port   = htons(peer.port);
+    if (::inet_pton(AF_INET, peer.ip.c_str(), &conn.addr.sin_addr) != 1) {
+        CS_LOG(ERR, "Invalid peer IP address: %s", peer.ip.c_str());
+        return fail();
+    }
+
+    CS_LOG(INFO, "Peer address: %s:%u", peer.ip.c_str(), peer.port);
+
+    if (!dtls) return true;
+
+    // --- DTLS handshake ---
+    CS_LOG(INFO, "Starting DTLS handshake...");
+    bool handshake_ok = dtls->handshake(
+        conn.socket,
+        reinterpret_cast<const struct sockaddr*>(&conn.addr),
+        static_cast<int>(sizeof(conn.addr)));
+
+    if (!handshake_ok) {
+        CS_LOG(ERR, "DTLS handshake failed");
+        return fail();
+    }
+    CS_LOG(INFO, "DTLS handshake completed");
+
+    if (!dtls->isEstablished()) return true;
+
+    // The wire version: settled in the handshake by viewers that offer it
+    // (ALPN), else exchanged as version tags after it
+    if (const uint8_t version = dtls->getHandshakeWireVersion()) {
+        conn.wire_version = version;
+        CS_LOG(INFO, "Protocol version negotiated in the handshake: CS0%u", version);
+    } else if (!exchangeVersionTags(dtls, conn)) {
+        return fail();
+    }
+
+    // Derive the media AEAD keys from the handshake (RFC 5705).
+    uint8_t km[cs::MediaCipher::KEYING_MATERIAL_LEN];
+    conn.cipher = std::make_unique<cs::MediaCipher>();
+    if (!dtls->exportKeyingMaterial(cs::MediaCipher::EXPORTER_LABEL, km, sizeof(km)) ||
+        !conn.cipher->initialize(km, sizeof(km), true)) {
+        CS_LOG(ERR, "Failed to derive media keys");
+        OPENSSL_cleanse(km, sizeof(km));
+        return fail();
+    }
+    OPENSSL_cleanse(km, sizeof(km));
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Construction / destruction
+// ---------------------------------------------------------------------------
+ViewerLink::ViewerLink(std::string viewer_id, std::shared_ptr<const cs::DtlsIdentity> identity)
+    : id_(std::move(viewer_id)),
+      dtls_(true, std::move(identity)) {}
+
+ViewerLink::~ViewerLink() {
+    stop();
+}
+
+// ---------------------------------------------------------------------------
+// start()
+// ---------------------------------------------------------------------------
+bool ViewerLink::start(const PeerInfo& peer, const cs::QosPreset& preset,
+                       const EncoderConfig& base, cs::CodecType codec) {
+    if (running_.load()) {
+        CS_LOG(ERR, "Viewer '%s' already started", id_.c_str());
+        return false;
+    }
+    if (!connectViewer(peer, &dtls_, conn_)) {
+        return false;
+    }
+    codec_ = codec;
+    clock_sync_.reset();
+
+    // --- Transport ---
+    transport_ = std::make_unique<UdpTransport>();
+    if (!transport_->initialize(conn_.socket, conn_.addr)) {
+        CS_LOG(ERR, "Failed to initialize UDP transport for viewer '%s'", id_.c_str());
+        stop();
+        return false;
+    }
+    transport_->setMediaCipher(conn_.cipher.get());
+    transport_->setImpairment(impairment_);
+
+    size_t pmtu = transport_->probePathMtu(preset.max_datagram_bytes, PMTU_PROBE_TIMEOUT_MS);
+    if (pmtu > 0) {
+        transport_->setMaxDatagramSize(pmtu);
+    }
+    fragment_payload_ = transport_->maxPacketSize()
+                      - cs::videoHeaderSize(conn_.wire_version) - sizeof(cs::FecPacketHeader);
+    transport_->setCacheRetention(NACK_CACHE_RETENTION_MS,
+                                  std::max(preset.max_bitrate_kbps, base.bitrate_kbps));
+
+    // --- FEC and QoS (no encoder: the link only decides what it sheds) ---
+    fec_ = std::make_unique<FecEncoder>();
+    fec_->setGroupSize(static_cast<int>(fecGroupFor(fragment_payload_)));
+    fec_->setRedundancyRatio(preset.min_fec_ratio);
+
+    qos_ = std::make_unique<QosController>(nullptr, transport_.get(), fec_.get());
+    qos_->applyPreset(preset);
+    qos_->setBaseConfig(base);
+    qos_->setPacingProfile(preset.pacing_factor, preset.pacing_burst_ms);
+
+    BandwidthEstimator* bwe = &qos_->getBandwidthEstimator();
+    ProbeController* probes = &qos_->getProbeController();
+    transport_->setSentCallback([bwe, probes](uint16_t transport_seq, size_t bytes,
+                                              uint64_t send_time_us) {
+        bwe->onPacketSent(transport_seq, bytes, send_time_us);
+        probes->onPacketSent(transport_seq, bytes, send_time_us);
+    });
+
+    // --- Start receiving ---
+    video_seq_ = 0;
+    frame_number_.store(0);
+    have_keyframe_.store(false);
+    keyframe_pending_.store(true);   // The session sends one on start
+    last_feedback_ns_.store(std::chrono::steady_clock::now().time_since_epoch().count());
+    should_stop_.store(false);
+    running_.store(true);
+    feedback_thread_ = std::thread(&ViewerLink::feedbackLoop, this);
+
+    CS_LOG(INFO, "Viewer '%s' joined (wire v%u, %zu-byte fragments)",
+           id_.c_str(), conn_.wire_version, fragment_payload_);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// stop()
+// ---------------------------------------------------------------------------
+void ViewerLink::stop() {
+    should_stop_.store(true);
+    if (transport_) transport_->wakeup();
+    if (feedback_thread_.joinable()) feedback_thread_.join();
+
+    const bool was_running = running_.exchange(false);
+
+    // The transport drains its pacer onto the socket and into the
+    // bandwidth estimator before either goes.
+    transport_.reset();
+    qos_.reset();
+    fec_.reset();
+    conn_.cipher.reset();
+    dtls_.shutdown();
+    if (conn_.socket >= 0) {
+        cs_close_socket(conn_.socket);
+        conn_.socket = -1;
+    }
+
+    if (was_running) {
+        CS_LOG(INFO, "Viewer '%s' left (%llu frames sent, %llu shed)", id_.c_str(),
+               static_cast<unsigned long long>(frames_sent_.load()),
+               static_cast<unsigned long long>(frames_shed_.load()));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// isAlive()
+// ---------------------------------------------------------------------------
+bool ViewerLink::isAlive(std::chrono::steady_clock::duration timeout) const {
+    if (!running_.load()) return false;
+    const auto last = std::chrono::steady_clock::time_point(
+        std::chrono::steady_clock::duration(last_feedback_ns_.load()));
+    return std::chrono::steady_clock::now() - last < timeout;
+}
+
+// ---------------------------------------------------------------------------
+// sendFrame()
+// ---------------------------------------------------------------------------
+void ViewerLink::sendFrame(const LinkFrame& frame) {
+    if (!running_.load()) return;
+
+    // Nothing decodes before a keyframe.
+    if (!have_keyframe_.load() && !frame.keyframe) return;
+
+    // Layers the path cannot carry are not sent, and take no number.
+    if (frame.layer > qos_->getMaxTemporalLayer()) {
+        frames_shed_.fetch_add(1);
+        return;
+    }
+
+    size_t frag_total = (frame.size + fragment_payload_ - 1) / fragment_payload_;
+    if (frag_total == 0) frag_total = 1;
+    const size_t max_frags = conn_.wire_version >= 2 ? MAX_FRAGMENTS_V2 : MAX_FRAGMENTS_V1;
+    if (frag_total > max_frags) {
+        CS_LOG(WARN, "Viewer '%s': frame needs %zu fragments (wire v%u limit %zu) -- dropped",
+               id_.c_str(), frag_total, conn_.wire_version, max_frags);
+        if (!frame.keyframe && !keyframe_pending_.exchange(true)) {
+            keyframe_requests_.fetch_add(1);
+            if (keyframe_cb_) keyframe_cb_();
+        }
+        return;
+    }
+
+    sendFragments(frame);
+
+    if (frame.keyframe) {
+        last_keyframe_.store(frame_number_.load());
+        have_keyframe_.store(true);
+        keyframe_pending_.store(false);
+    }
+    frame_number_.fetch_add(1);
+    frames_sent_.fetch_add(1);
+}
+
+// ---------------------------------------------------------------------------
+// sendFragments() -- as SessionManager::sendFragments(), for a whole frame
+// ---------------------------------------------------------------------------
+void ViewerLink::sendFragments(const LinkFrame& frame) {
+    const size_t frag_payload = fragment_payload_;
+    const size_t frag_total   = std::max<size_t>(1, (frame.size + frag_payload - 1) / frag_payload);
+    const uint32_t frame_num  = frame_number_.load();
+    const bool droppable = frame.layer > 0;
+
+    for (size_t batch_first = 0; batch_first < frag_total;
+         batch_first += MAX_BATCH_FRAGMENTS) {
+        const size_t batch_end = std::min(frag_total, batch_first + MAX_BATCH_FRAGMENTS);
+
+        batch_.clear();
+        const uint16_t first_seq = video_seq_;
+
+        for (size_t frag = batch_first; frag < batch_end; ++frag) {
+            size_t offset = frag * frag_payload;
+            size_t chunk_len = std::min(frag_payload, frame.size - offset);
+
+            cs::VideoPacketHeaderV2 hdr;
+            std::memset(&hdr, 0, sizeof(hdr));
+            hdr.setVersion(cs::videoHeaderVersion(conn_.wire_version));
+            hdr.setFrameType(0);     // 0 = progressive
+            hdr.setKeyframe(frame.keyframe);
+            hdr.setLtr(frame.ltr);
+            hdr.setTemporalLayer(frame.layer);
+            hdr.codec           = static_cast<uint8_t>(codec_);
+            hdr.sequence_number = video_seq_;
+            hdr.timestamp_us    = static_cast<uint32_t>(frame.timestamp_us & 0xFFFFFFFF);
+            hdr.frame_number    = frame_num;
+            hdr.fragment_index  = static_cast<uint16_t>(frag);
+            hdr.fragment_total  = static_cast<uint16_t>(frag_total);
+            hdr.payload_length  = static_cast<uint32_t>(chunk_len);
+
+            // Write header + payload fragment in place
+            cs::PacketBuffer buf = transport_->acquireBuffer(video_seq_);
+            size_t hdr_len = hdr.serializeTo(buf.data);
+            std::memcpy(buf.data + hdr_len, frame.data + offset, chunk_len);
+            batch_.push_back({buf.data, hdr_len + chunk_len, video_seq_, droppable});
+            ++video_seq_;
+        }
+
+        // --- FEC ---
+        const size_t data_total = batch_.size();
+        if (data_total > 1) {
+            size_t max_group = static_cast<size_t>(fec_->getGroupSize());
+            FecPlan plan;
+            const bool planned =
+                qos_->planFec(data_total, frame.keyframe, frame.fec_layer, max_group, plan);
+            if (planned) max_group = plan.group_size;
+
+            size_t num_groups = (data_total + max_group - 1) / max_group;
+            size_t base_size = data_total / num_groups;
+            size_t remainder = data_total % num_groups;
+
+            size_t first = 0;
+            for (size_t g = 0; g < num_groups; ++g) {
+                size_t count = base_size + (g < remainder ? 1 : 0);
+                size_t parity_count = planned
+                    ? std::min(plan.parity_count, count)
+                    : static_cast<size_t>(fec_->parityCountFor(static_cast<int>(count)));
+
+                fec_data_.clear();
+                fec_len_.clear();
+                size_t symbol_len = 0;
+                for (size_t i = first; i < first + count; ++i) {
+                    fec_data_.push_back(batch_[i].data);
+                    fec_len_.push_back(batch_[i].len);
+                    symbol_len = std::max(symbol_len, batch_[i].len);
+                }
+
+                fec_parity_.clear();
+                uint16_t first_parity_seq = video_seq_;
+                for (size_t i = 0; i < parity_count; ++i) {
+                    cs::PacketBuffer buf = transport_->acquireBuffer(
+                        static_cast<uint16_t>(first_parity_seq + i));
+                    fec_parity_.push_back(buf.payload<cs::FecPacketHeader>());
+                }
+
+                if (parity_count > 0 &&
+                    fec_->encode(fec_data_.data(), fec_len_.data(), count,
+                                 fec_parity_.data(), parity_count, symbol_len)) {
+                    cs::FecPacketHeader fh;
+                    fh.type          = static_cast<uint8_t>(cs::PacketType::FEC);
+                    fh.group_id      = fec_->currentGroupId();
+                    fh.data_count    = static_cast<uint8_t>(count);
+                    fh.parity_count  = static_cast<uint8_t>(parity_count);
+                    fh.frame_number  = static_cast<uint16_t>(frame_num & 0xFFFF);
+                    fh.base_sequence = static_cast<uint16_t>(first_seq + first);
+                    fh.symbol_length = static_cast<uint16_t>(symbol_len);
+
+                    for (size_t i = 0; i < parity_count; ++i) {
+                        fh.sequence_number = video_seq_++;
+                        fh.parity_index    = static_cast<uint8_t>(i);
+                        uint8_t* pkt = fec_parity_[i] - sizeof(cs::FecPacketHeader);
+                        fh.serializeTo(pkt);
+                        batch_.push_back({pkt, sizeof(cs::FecPacketHeader) + symbol_len,
+                                          fh.sequence_number, droppable});
+                    }
+                }
+                first += count;
+            }
+        }
+
+        // --- Send ---
+        transport_->sendBatch(batch_);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// sendAudio()
+// ---------------------------------------------------------------------------
+void ViewerLink::sendAudio(const uint8_t* pkt, size_t len) {
+    if (!running_.load()) return;
+    transport_->sendUncached(pkt, len);
+}
+
+// ---------------------------------------------------------------------------
+// getStats()
+// ---------------------------------------------------------------------------
+ViewerLink::Stats ViewerLink::getStats() const {
+    Stats st;
+    st.frames_sent       = frames_sent_.load();
+    st.frames_shed       = frames_shed_.load();
+    st.keyframe_requests = keyframe_requests_.load();
+    st.bytes_sent        = running_.load() && transport_ ? transport_->totalBytesSent() : 0;
+    return st;
+}
+
+// ---------------------------------------------------------------------------
+// onFrameLoss() -- a keyframe repairs whatever the viewer lost
+// ---------------------------------------------------------------------------
+void ViewerLink::onFrameLoss(uint32_t first, uint32_t last) {
+    const uint32_t next = frame_number_.load();
+    if (next == 0) return;
+
+    // Version-1 headers carry 16-bit frame numbers; unwrap them against
+    // the frame counter.
+    if (conn_.wire_version < 2) {
+        auto unwrap = [next](uint32_t f) {
+            int16_t delta = static_cast<int16_t>(static_cast<uint16_t>(f) -
+                                                 static_cast<uint16_t>(next));
+            return next + static_cast<uint32_t>(static_cast<int32_t>(delta));
+        };
+        first = unwrap(first);
+        last  = unwrap(last);
+    }
+    if (static_cast<int32_t>(last - first) < 0) return;
+
+    // The viewer repeats a report until it is repaired; a keyframe sent
+    // since the loss, or one already asked for, does that.
+    if (have_keyframe_.load() && static_cast<int32_t>(last - last_keyframe_.load()) < 0) return;
+    if (keyframe_pending_.exchange(true)) return;
+
+    keyframe_requests_.fetch_add(1);
+    CS_LOG(INFO, "Viewer '%s' lost frames %u-%u -- requesting IDR", id_.c_str(), first, last);
+    if (keyframe_cb_) keyframe_cb_();
+}
+
+// ---------------------------------------------------------------------------
+// onPacket()
+// ---------------------------------------------------------------------------
+void ViewerLink::onPacket(const uint8_t* data, size_t len) {
+    if (len == 0) return;
+
+    cs::PacketType ptype = cs::identifyPacket(data, len);
+
+    if (ptype == cs::PacketType::QOS_FEEDBACK) {
+        last_feedback_ns_.store(std::chrono::steady_clock::now().time_since_epoch().count());
+
+        cs::QosFeedback fb = cs::QosFeedback::deserialize(data, len);
+
+        QosFeedbackPacket ctrl_fb;
+        ctrl_fb.jitter_us = fb.avg_jitter_us;
+        ctrl_fb.last_seq  = fb.last_seq_received;
+        const uint64_t now_us = cs::getTimestampUs();
+        ctrl_fb.rtt_us    = fb.rttFromEcho(static_cast<uint32_t>(now_us & 0xFFFFFFFF));
+        if (fb.has_clock &&
+            clock_sync_.addExchange(fb.echo_timestamp_us, fb.echo_recv_us,
+                                    fb.echo_hold_us, now_us)) {
+            qos_->getBandwidthEstimator().setClockOffsetUs(clock_sync_.offsetUs(now_us));
+        }
+        float loss = fb.getPacketLossPercent() / 100.0f;
+        ctrl_fb.received_packets = 100;
+        ctrl_fb.lost_packets     = static_cast<uint32_t>(loss * 100.0f);
+        qos_->onFeedbackReceived(ctrl_fb);
+
+        // LTR acks are ignored: the encoder's references follow the
+        // session's own viewer.
+        if (!fb.nack_seqs.empty()) {
+            transport_->onNackReceived(fb.nack_seqs);
+        }
+
+        // Fresh RTT probe, on the audio lane (see SessionManager::feedbackLoop)
+        cs::RttProbePacket probe{};
+        probe.type         = static_cast<uint8_t>(cs::PacketType::RTT_PROBE);
+        probe.send_time_us = static_cast<uint32_t>(cs::getTimestampUs() & 0xFFFFFFFF);
+        probe.srtt_us      = qos_->getSmoothedRttUs();
+        probe.rttvar_us    = qos_->getRttVarUs();
+        uint8_t probe_buf[sizeof(cs::RttProbePacket) + sizeof(cs::RttProbeClock)];
+        size_t  probe_len = 0;
+        if (clock_sync_.hasEstimate()) {
+            cs::RttProbeClock clock{};
+            clock.offset_us = clock_sync_.offsetUs(cs::getTimestampUs());
+            clock.error_us  = clock_sync_.errorUs();
+            probe.flags |= cs::RTT_PROBE_FLAG_CLOCK;
+            probe_len = probe.serializeTo(probe_buf);
+            probe_len += clock.serializeTo(probe_buf + probe_len);
+        } else {
+            probe_len = probe.serializeTo(probe_buf);
+        }
+        transport_->sendUncached(probe_buf, probe_len, PacingLane::AUDIO);
+    } else if (ptype == cs::PacketType::FRAME_LOSS) {
+        cs::FrameLossPacket report;
+        if (cs::FrameLossPacket::deserialize(data, len, report)) {
+            onFrameLoss(report.first_frame, report.last_frame);
+        }
+    } else if (ptype == cs::PacketType::TRANSPORT_FEEDBACK) {
+        cs::TransportFeedback tf;
+        if (cs::TransportFeedback::deserialize(data, len, tf)) {
+            qos_->onTransportFeedback(tf);
+        }
+    } else if (ptype == cs::PacketType::NACK) {
+        // type(1) + count(2) + seq_list(count * 2)
+        if (len >= 3) {
+            uint16_t count = 0;
+            std::memcpy(&count, data + 1, 2);
+            count = ntohs(count);
+
+            std::vector<uint16_t> seqs;
+            for (size_t i = 0; i < count && 3 + (i + 1) * 2 <= len; ++i) {
+                uint16_t seq = 0;
+                std::memcpy(&seq, data + 3 + i * 2, 2);
+                seqs.push_back(ntohs(seq));
+            }
+            if (!seqs.empty()) {
+                transport_->onNackReceived(seqs);
+            }
+        }
+    }
+    // Input, clipboard and cursor requests belong to the session's viewer.
+}
+
+// ---------------------------------------------------------------------------
+// feedbackLoop()
+// ---------------------------------------------------------------------------
+void ViewerLink::feedbackLoop() {
+    cs::ScopedThreadRole role(cs::ThreadRole::FEEDBACK);
+    cs_set_nonblocking(conn_.socket);
+    transport_->setRecvCallback([this](const uint8_t* data, size_t len) {
+        onPacket(data, len);
+    });
+
+    while (!should_stop_.load()) {
+        if (!transport_->waitReadable(FEEDBACK_WAIT_MS)) continue;
+
+        size_t drained = 0;
+        while (drained < FEEDBACK_MAX_DRAIN && transport_->receiveOne()) {
+            ++drained;
+        }
+    }
+}
+
+} // namespace cs::host
@@ -0,0 +1,229 @@
+///////////////////////////////////////////////////////////////////////////////
+// viewer_link.h -- One more viewer of a session's stream
+//
+// A session group streams one capture and one encode to several viewers:
+// the session's own viewer, who drives the encoder and has input, cursor
+// and clipboard, and any number of watch-only viewers, each a ViewerLink.
+//
+// A link has everything per path to itself: socket, DTLS handshake and
+// media keys, UdpTransport (with its NACK cache and pacer), FEC and a QoS
+// controller with no encoder.  Its QoS cannot lower the shared bitrate;
+// instead the link sheds the temporal layers its path cannot carry, as
+// the session does for its own viewer, so one slow viewer does not
+// degrade the rest.  Each link numbers its wire frames itself, and a
+// frame it sheds takes no number, so the viewer sees no gap.
+//
+// A joining viewer starts at the next keyframe.  A link answers loss with
+// a keyframe rather than reference invalidation: the encoder's long-term
+// references are acknowledged by the session's viewer alone.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "cs/common.h"
+#include "cs/qos/clock_sync.h"
+#include "cs/qos/gaming_modes.h"
+#include "cs/transport/dtls_context.h"
+#include "cs/transport/media_cipher.h"
+#include "cs/transport/network_impairment.h"
+#include "cs/transport/packet.h"
+
+#include "encode/encoder_interface.h"
+#include "transport/udp_transport.h"
+#include "transport/fec.h"
+#include "qos/qos_controller.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// Packetization and feedback constants shared by every viewer's path
+// ---------------------------------------------------------------------------
+
+// Video fragment payload at the default packet size.  Leaves room for the
+// FEC header so a parity packet (header + one whole data packet) still fits
+// the same MTU as the data it protects.
+constexpr size_t DEFAULT_FRAGMENT_PAYLOAD = MAX_VIDEO_PAYLOAD - sizeof(cs::FecPacketHeader);
+
+// FEC group size at DEFAULT_FRAGMENT_PAYLOAD.  With other fragment sizes the
+// group is scaled to cover about the same number of bytes, so a group (which
+// can only be recovered once complete) spans a similar time on the wire.
+constexpr size_t DEFAULT_FEC_GROUP = 16;
+constexpr size_t MIN_FEC_GROUP     = 4;
+constexpr size_t MAX_FEC_GROUP     = 24;
+
+// Most fragments one frame may use with each video header version
+// (the fragment index/total fields are 8 bits in v1, 16 bits from v2).
+constexpr size_t MAX_FRAGMENTS_V1 = 0xFF;
+constexpr size_t MAX_FRAGMENTS_V2 = 0xFFFF;
+
+// How long to wait for path MTU probe acks before streaming starts.
+constexpr int PMTU_PROBE_TIMEOUT_MS = 250;
+
+// How long sent video stays retransmittable: several RTTs on a slow path,
+// well past any jitter buffer's patience.
+constexpr uint32_t NACK_CACHE_RETENTION_MS = 500;
+
+// Feedback loop: readiness wait backstop and datagrams handled per wakeup
+// (bounded so a flood cannot starve the stop check).
+constexpr int    FEEDBACK_WAIT_MS   = 100;
+constexpr size_t FEEDBACK_MAX_DRAIN = 256;
+
+/// FEC group size for |fragment_payload|-byte fragments.
+inline size_t fecGroupFor(size_t fragment_payload) {
+    const size_t group = (DEFAULT_FEC_GROUP * DEFAULT_FRAGMENT_PAYLOAD + fragment_payload / 2)
+                       / fragment_payload;
+    return std::clamp(group, MIN_FEC_GROUP, MAX_FEC_GROUP);
+}
+
+// ---------------------------------------------------------------------------
+// PeerInfo -- remote peer connection details
+// ---------------------------------------------------------------------------
+struct PeerInfo {
+    std::string ip;
+    uint16_t    port              = 0;
+    std::string dtls_fingerprint;
+    uint16_t    local_port        = 0;   // Port to bind (0 = OS picks)
+};
+
+// ---------------------------------------------------------------------------
+// ViewerConnection -- a viewer's socket once it is connected
+// ---------------------------------------------------------------------------
+struct ViewerConnection {
+    int                               socket       = -1;
+    ::sockaddr_in                     addr         = {};
+    uint8_t                           wire_version = 1;   // Negotiated protocol version
+    std::unique_ptr<cs::MediaCipher>  cipher;             // Null without DTLS
+};
+
+/// Bind a UDP socket and, with |dtls|, run the handshake with |peer| over
+/// it, agree the protocol version and derive the media keys.  Closes the
+/// socket and returns false on any failure.
+bool connectViewer(const PeerInfo& peer, cs::DtlsContext* dtls, ViewerConnection& conn);
+
+// ---------------------------------------------------------------------------
+// LinkFrame -- an encoded frame as the session hands it to its links
+// ---------------------------------------------------------------------------
+struct LinkFrame {
+    const uint8_t* data         = nullptr;
+    size_t         size         = 0;
+    uint64_t       timestamp_us = 0;
+    bool           keyframe     = false;
+    bool           ltr          = false;
+    uint8_t        layer        = 0;      // Temporal layer
+    int            fec_layer    = -1;     // Layer for FEC planning (-1 = no SVC)
+};
+
+// ---------------------------------------------------------------------------
+// ViewerLink
+// ---------------------------------------------------------------------------
+class ViewerLink {
+public:
+    /// A viewer that is presented |identity| (the session's), or a
+    /// DTLS identity of its own if that is null.
+    ViewerLink(std::string viewer_id, std::shared_ptr<const cs::DtlsIdentity> identity);
+    ~ViewerLink();
+
+    // Non-copyable
+    ViewerLink(const ViewerLink&) = delete;
+    ViewerLink& operator=(const ViewerLink&) = delete;
+
+    const std::string& getId() const { return id_; }
+
+    /// DTLS fingerprint the viewer verifies the handshake against.
+    std::string getFingerprint() const { return dtls_.getFingerprint(); }
+
+    /// Connect to |peer| and start receiving its feedback.  |preset| bounds
+    /// the link's QoS, which starts from |base|; |codec| labels the video.
+    bool start(const PeerInfo& peer, const cs::QosPreset& preset,
+               const EncoderConfig& base, cs::CodecType codec);
+
+    /// Stop the feedback thread and close the connection.
+    void stop();
+
+    bool isRunning() const { return running_.load(); }
+
+    /// Viewer feedback seen within |timeout|.
+    bool isAlive(std::chrono::steady_clock::duration timeout) const;
+
+    /// Emulate a bad network on this link's egress (see
+    /// network_impairment.h).  Takes effect on the next start().
+    void setImpairment(const cs::ImpairmentConfig& config) { impairment_ = config; }
+
+    /// Called (feedback thread) when the viewer needs a keyframe.
+    using KeyframeCallback = std::function<void()>;
+    void setKeyframeCallback(KeyframeCallback cb) { keyframe_cb_ = std::move(cb); }
+
+    /// Packetize and send |frame|, unless its layer is shed (session's
+    /// sender, one frame at a time).
+    void sendFrame(const LinkFrame& frame);
+
+    /// Send an audio packet (outside the video sequence space).
+    void sendAudio(const uint8_t* pkt, size_t len);
+
+    struct Stats {
+        uint64_t frames_sent       = 0;
+        uint64_t frames_shed       = 0;
+        uint64_t keyframe_requests = 0;
+        uint64_t bytes_sent        = 0;
+    };
+    Stats getStats() const;
+
+private:
+    /// Receive the viewer's feedback until stop() (feedback_thread_).
+    void feedbackLoop();
+
+    /// Handle one packet from the viewer.
+    void onPacket(const uint8_t* data, size_t len);
+
+    /// A frame loss report |first| .. |last| (wire frame numbers).
+    void onFrameLoss(uint32_t first, uint32_t last);
+
+    /// Fragment, protect and send |frame| as wire frame frame_number_.
+    void sendFragments(const LinkFrame& frame);
+
+    std::string                       id_;
+    cs::DtlsContext                   dtls_;
+    ViewerConnection                  conn_;
+    cs::CodecType                     codec_ = cs::CodecType::H264;
+    std::unique_ptr<UdpTransport>     transport_;
+    std::unique_ptr<FecEncoder>       fec_;
+    std::unique_ptr<QosController>    qos_;
+    cs::ClockSync                     clock_sync_;      // Viewer clock against ours
+    KeyframeCallback                  keyframe_cb_;
+    cs::ImpairmentConfig              impairment_;
+
+    std::atomic<bool>                 running_{false};
+    std::atomic<bool>                 should_stop_{false};
+    std::thread                       feedback_thread_;
+    std::atomic<int64_t>              last_feedback_ns_{0};   // steady_clock
+
+    // Send state (sender only, but for what the feedback thread reads).
+    size_t                            fragment_payload_ = DEFAULT_FRAGMENT_PAYLOAD;
+    uint16_t                          video_seq_        = 0;
+    std::atomic<uint32_t>             frame_number_{0};       // Next wire frame
+    std::atomic<bool>                 have_keyframe_{false};
+    std::atomic<uint32_t>             last_keyframe_{0};      // Wire number of the last keyframe
+    std::atomic<bool>                 keyframe_pending_{false};   // Asked for, not yet sent
+
+    // Packetization scratch (capacity kept between frames)
+    std::vector<PacketView>           batch_;
+    std::vector<const uint8_t*>       fec_data_;
+    std::vector<size_t>               fec_len_;
+    std::vector<uint8_t*>             fec_parity_;
+
+    std::atomic<uint64_t>             frames_sent_{0};
+    std::atomic<uint64_t>             frames_shed_{0};
+    std::atomic<uint64_t>             keyframe_requests_{0};
+};
+
+} // namespace cs::host
@@ -1,85 +1,122 @@
 ///////////////////////////////////////////////////////////////////////////////
-// fec.cpp -- XOR-based Forward Error Correction implementation
+// fec.cpp -- Reed-Solomon (Cauchy) Forward Error Correction implementation
 //
-// For the MVP we use a simple XOR scheme:
-//   - Data packets are grouped (default 5 per group).
-//   - FEC packet[i] = data[i*2] XOR data[i*2 + 1]  (pair-wise XOR).
-//   - Shorter packets are zero-padded to the length of the longest in the pair.
-//   - The number of FEC packets is determined by the redundancy ratio.
+// Thin wrapper around cs::ErasureCode:
+//   - k = number of data packets handed to encode() (one FEC group).
+//   - m = ceil(k * redundancy_ratio), clamped to [1, k] and k + m <= 255.
+//   - Parity packets are symbol_len = max(data packet length) bytes.
 //
-// This allows recovery of one lost packet per pair, which is adequate for
-// low-loss networks.  A future upgrade path is Reed-Solomon coding.
+// The group is addressed on the wire by its first data sequence number and
+// k, so the data packets themselves are not modified.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "fec.h"
 #include <cs/common.h>
+#include <cs/transport/erasure_code.h>
 
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 
 namespace cs::host {
 
-FecEncoder::FecEncoder() = default;
+FecEncoder::FecEncoder() {
+    CS_LOG(DEBUG, "FEC: Cauchy RS encoder using %s kernel",
+           cs::ErasureCode::kernelName());
+}
 
 // ---------------------------------------------------------------------------
-// encode -- generate FEC packets for a set of data packets
+// parityCountFor -- parity packets for k data packets at the current ratio
 // ---------------------------------------------------------------------------
 
+int FecEncoder::parityCountFor(int data_count) const {
+    if (data_count <= 0) return 0;
+    int m = static_cast<int>(std::ceil(data_count * redundancy_ratio_));
+    m = std::max(1, std::min(m, data_count));
+    int max_m = static_cast<int>(cs::ErasureCode::MAX_SHARDS) - 1 - data_count;
+    return std::min(m, max_m);
+}
+
+// ---------------------------------------------------------------------------
+// encode -- generate parity packets for one group of data packets
+// ---------------------------------------------------------------------------
+
+std::vector<std::vector<uint8_t>> FecEncoder::encode(
+    const std::vector<std::vector<uint8_t>>& data_packets,
+    int redundancy_count)
+{
+    return encode(data_packets, 0, data_packets.size(), redundancy_count);
+}
+
 std::vector<std::vector<uint8_t>> FecEncoder::encode(
     const std::vector<std::vector<uint8_t>>& data_packets,
+    size_t first, size_t count,
     int redundancy_count)
 {
     std::vector<std::vector<uint8_t>> fec_packets;
 
-    if (data_packets.empty()) return fec_packets;
+    if (count == 0 || first + count > data_packets.size()) return fec_packets;
+
+    const int k = static_cast<int>(count);
+    if (k >= static_cast<int>(cs::ErasureCode::MAX_SHARDS)) {
+        CS_LOG(WARN, "FEC: group of %d packets exceeds code limits", k);
+        return fec_packets;
+    }
 
     // Determine how many FEC packets to generate.
     int num_fec;
     if (redundancy_count > 0) {
-        num_fec = redundancy_count;
+        num_fec = std::min(redundancy_count,
+                           static_cast<int>(cs::ErasureCode::MAX_SHARDS) - 1 - k);
     } else {
-        num_fec = std::max(1, static_cast<int>(data_packets.size() * redundancy_ratio_));
+        num_fec = parityCountFor(k);
     }
-
-    // We generate FEC packets by XOR-ing consecutive pairs.
-    // If we have N data packets, we can make at most N/2 FEC packets via pairing.
-    int max_pairs = static_cast<int>(data_packets.size()) / 2;
-    if (max_pairs == 0) {
-        // Only one data packet -- XOR with itself is useless, just duplicate.
-        fec_packets.push_back(data_packets[0]);
-        group_id_++;
-        return fec_packets;
+    if (num_fec <= 0) return fec_packets;
+
+    size_t symbol_len = 0;
+    std::vector<const uint8_t*> data(static_cast<size_t>(k));
+    std::vector<size_t>         data_len(static_cast<size_t>(k));
+    for (int i = 0; i < k; ++i) {
+        data[i]     = data_packets[first + i].data();
+        data_len[i] = data_packets[first + i].size();
+        symbol_len  = std::max(symbol_len, data_len[i]);
     }
 
-    num_fec = std::min(num_fec, max_pairs);
-
-    for (int i = 0; i < num_fec; ++i) {
-        size_t idx_a = static_cast<size_t>(i * 2) % data_packets.size();
-        size_t idx_b = static_cast<size_t>(i * 2 + 1) % data_packets.size();
-
-        const auto& pkt_a = data_packets[idx_a];
-        const auto& pkt_b = data_packets[idx_b];
+    fec_packets.assign(static_cast<size_t>(num_fec),
+                       std::vector<uint8_t>(symbol_len));
+    std::vector<uint8_t*> parity(static_cast<size_t>(num_fec));
+    for (int j = 0; j < num_fec; ++j) {
+        parity[j] = fec_packets[j].data();
+    }
 
-        // FEC packet length = max of the two source packets.
-        size_t fec_len = std::max(pkt_a.size(), pkt_b.size());
-        std::vector<uint8_t> fec(fec_len, 0);
+    if (!encode(data.data(), data_len.data(), static_cast<size_t>(k),
+                parity.data(), static_cast<size_t>(num_fec), symbol_len)) {
+        fec_packets.clear();
+    }
+    return fec_packets;
+}
 
-        // XOR the two packets together.
-        for (size_t j = 0; j < pkt_a.size(); ++j) {
-            fec[j] ^= pkt_a[j];
-        }
-        for (size_t j = 0; j < pkt_b.size(); ++j) {
-            fec[j] ^= pkt_b[j];
-        }
+bool FecEncoder::encode(const uint8_t* const* data, const size_t* data_len,
+                        size_t data_count,
+                        uint8_t* const* parity, size_t parity_count,
+                        size_t symbol_len)
+{
+    if (data_count == 0 || parity_count == 0 ||
+        data_count + parity_count > cs::ErasureCode::MAX_SHARDS) {
+        CS_LOG(WARN, "FEC: invalid group (k=%zu, m=%zu)", data_count, parity_count);
+        return false;
+    }
 
-        fec_packets.push_back(std::move(fec));
+    if (!cs::ErasureCode::encode(data, data_len, data_count,
+                                 parity, parity_count, symbol_len)) {
+        CS_LOG(WARN, "FEC: encode failed (k=%zu, m=%zu)", data_count, parity_count);
+        return false;
     }
 
     group_id_++;
-    CS_LOG(TRACE, "FEC: generated %d packets from %zu data packets (group=%u)",
-           num_fec, data_packets.size(), group_id_ - 1);
-
-    return fec_packets;
+    CS_LOG(TRACE, "FEC: generated %zu parity packets for %zu data packets (group=%u)",
+           parity_count, data_count, group_id_);
+    return true;
 }
 
 // ---------------------------------------------------------------------------
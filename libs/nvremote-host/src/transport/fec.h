@@ -1,18 +1,17 @@
 ///////////////////////////////////////////////////////////////////////////////
-// fec.h -- XOR-based Forward Error Correction encoder
+// fec.h -- Reed-Solomon (Cauchy) Forward Error Correction encoder
 //
-// Provides a simple XOR-based FEC scheme for the MVP.  Data packets are
-// grouped (default group size = 5), and one or more FEC packets are
-// generated per group by XOR-ing pairs of data packets together.
+// Data packets are split into groups of up to group_size packets, and each
+// group of k packets is extended with m parity packets using the systematic
+// Cauchy erasure code in cs/transport/erasure_code.h.  Any m losses among
+// the k + m packets of a group can be recovered by the viewer.
 //
-// Each FEC packet can recover one lost data packet from its group,
-// provided all other data packets in the pair are received.
-//
-// The redundancy ratio controls how many FEC packets are generated
-// relative to data packets.  A ratio of 0.2 means ~20% overhead.
+// The redundancy ratio controls m relative to k: m = ceil(k * ratio),
+// at least 1.  A ratio of 0.2 means ~20% overhead.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -23,13 +22,34 @@ public:
     FecEncoder();
     ~FecEncoder() = default;
 
-    /// Generate FEC packets from a group of data packets.
-    /// Each FEC packet is the XOR of consecutive pairs in the group.
+    /// Generate parity packets for one group of data packets.
+    /// Every parity packet is as long as the longest data packet; shorter
+    /// data packets are treated as zero-padded.
     /// |redundancy_count| overrides the auto-calculated count if > 0.
     std::vector<std::vector<uint8_t>> encode(
         const std::vector<std::vector<uint8_t>>& data_packets,
         int redundancy_count = 0);
 
+    /// Same as above for the sub-range [first, first + count) of
+    /// |data_packets|, so a frame can be split into groups without copies.
+    std::vector<std::vector<uint8_t>> encode(
+        const std::vector<std::vector<uint8_t>>& data_packets,
+        size_t first, size_t count,
+        int redundancy_count = 0);
+
+    /// Zero-copy variant: encode |data_count| packets (data[i], data_len[i])
+    /// into |parity_count| caller-provided buffers of |symbol_len| bytes
+    /// each (e.g. slots of the transport's packet slab, just behind a
+    /// FecPacketHeader).  Allocates nothing.  Returns false on bad input.
+    bool encode(const uint8_t* const* data, const size_t* data_len,
+                size_t data_count,
+                uint8_t* const* parity, size_t parity_count,
+                size_t symbol_len);
+
+    /// Number of parity packets encode() will produce for |data_count|
+    /// data packets at the current redundancy ratio.
+    int parityCountFor(int data_count) const;
+
     /// Set the FEC redundancy ratio (0.0 to 1.0).
     /// 0.2 = 20% overhead = 1 FEC packet per 5 data packets.
     void setRedundancyRatio(float ratio);
@@ -37,18 +57,18 @@ public:
     /// Get the current redundancy ratio.
     float getRedundancyRatio() const { return redundancy_ratio_; }
 
-    /// Set the group size (number of data packets per FEC group).
+    /// Set the group size (maximum number of data packets per FEC group).
     void setGroupSize(int size);
 
     /// Get the current group size.
     int getGroupSize() const { return group_size_; }
 
-    /// Get the running group ID (incremented per encode() call).
+    /// Get the group ID assigned by the most recent encode() call.
     uint8_t currentGroupId() const { return group_id_; }
 
 private:
     float    redundancy_ratio_ = 0.2f;
-    int      group_size_       = 5;
+    int      group_size_       = 16;
     uint8_t  group_id_         = 0;
 };
 
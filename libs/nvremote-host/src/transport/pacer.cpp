@@ -0,0 +1,311 @@
+///////////////////////////////////////////////////////////////////////////////
+// pacer.cpp -- Token-bucket send pacer implementation
+///////////////////////////////////////////////////////////////////////////////
+
+#include "pacer.h"
+#include <cs/common.h>
+#include <cs/thread_policy.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// Constructor / Destructor
+// ---------------------------------------------------------------------------
+
+Pacer::Pacer(SendFunction send)
+    : send_(std::move(send))
+{
+    inflight_.reserve(MAX_BATCH_SEGMENTS);
+    views_.reserve(MAX_BATCH_SEGMENTS);
+}
+
+Pacer::~Pacer() {
+    stop();
+}
+
+// ---------------------------------------------------------------------------
+// start / stop
+// ---------------------------------------------------------------------------
+
+void Pacer::start() {
+    if (running_.exchange(true)) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_refill_us_ = getTimestampUs();
+        tokens_         = burst_bytes_;
+    }
+    // Copied lanes hold MTU-sized datagrams: warm the pool for a full bulk
+    // lane so the first paste does not allocate
+    cs::BufferPool::shared().reserve(MAX_MTU_SIZE, MAX_BULK_QUEUE_BYTES / MAX_MTU_SIZE);
+    thread_ = std::thread(&Pacer::run, this);
+    CS_LOG(INFO, "Pacer: started (rate=%u kbps, burst=%.0f bytes)",
+           rate_kbps_.load(), burst_bytes_);
+}
+
+void Pacer::stop() {
+    if (!running_.exchange(false)) return;
+
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    // Flush whatever is left so nothing is silently dropped.
+    std::vector<Entry> rest;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& lane : lanes_) {
+            for (auto& e : lane) rest.push_back(std::move(e));
+            lane.clear();
+        }
+        probes_.clear();   // Padding: not worth sending unpaced
+        queued_bytes_ = 0;
+        queued_count_ = 0;
+        bulk_bytes_   = 0;
+    }
+    for (size_t i = 0; i < rest.size(); i += MAX_BATCH_SEGMENTS) {
+        std::vector<Entry> chunk(
+            std::make_move_iterator(rest.begin() + i),
+            std::make_move_iterator(rest.begin() + std::min(rest.size(), i + MAX_BATCH_SEGMENTS)));
+        transmit(chunk);
+    }
+    CS_LOG(INFO, "Pacer: stopped");
+}
+
+// ---------------------------------------------------------------------------
+// setRate
+// ---------------------------------------------------------------------------
+
+void Pacer::setRate(uint32_t rate_kbps, size_t burst_bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        refill(getTimestampUs());
+        bytes_per_us_ = static_cast<double>(rate_kbps) / 8000.0;  // kbps -> B/us
+        burst_bytes_  = static_cast<double>(burst_bytes);
+        tokens_       = std::min(tokens_, burst_bytes_);
+    }
+    if (rate_kbps_.exchange(rate_kbps) != rate_kbps) {
+        CS_LOG(DEBUG, "Pacer: rate=%u kbps burst=%zu bytes", rate_kbps, burst_bytes);
+    }
+    cv_.notify_one();
+}
+
+// ---------------------------------------------------------------------------
+// enqueue
+// ---------------------------------------------------------------------------
+
+void Pacer::enqueue(PacingLane lane, const PacketView* packets, size_t count) {
+    if (!packets || count == 0) return;
+
+    const bool borrowed = lane == PacingLane::VIDEO;
+    const bool bulk     = lane == PacingLane::BULK;
+    std::vector<Entry> overflow;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& queue = lanes_[static_cast<size_t>(lane)];
+
+        for (size_t i = 0; i < count; ++i) {
+            if (bulk) {
+                if (bulk_bytes_ + packets[i].len > MAX_BULK_QUEUE_BYTES) {
+                    CS_LOG(WARN, "Pacer: bulk lane full, dropping %zu-byte packet",
+                           packets[i].len);
+                    continue;
+                }
+                bulk_bytes_ += packets[i].len;
+            }
+            Entry e;
+            e.len = packets[i].len;
+            e.seq = packets[i].seq;
+            if (borrowed) {
+                e.data = packets[i].data;
+            } else {
+                e.owned = cs::BufferPool::shared().copyOf(packets[i].data, packets[i].len);
+                e.data = e.owned.data();
+            }
+            queue.push_back(std::move(e));
+            queued_bytes_ += packets[i].len;
+            ++queued_count_;
+        }
+
+        // Borrowed slots are about to be reused -- send them now, unpaced.
+        if (borrowed) {
+            while (queue.size() > MAX_BORROWED_PACKETS) {
+                queued_bytes_ -= queue.front().len;
+                --queued_count_;
+                tokens_ -= static_cast<double>(queue.front().len);
+                overflow.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+    }
+
+    if (!overflow.empty()) {
+        CS_LOG(DEBUG, "Pacer: video lane overflow, flushing %zu packets unpaced",
+               overflow.size());
+        transmit(overflow);
+    }
+
+    cv_.notify_one();
+}
+
+// ---------------------------------------------------------------------------
+// enqueueProbe -- a probe cluster on its own clock
+// ---------------------------------------------------------------------------
+
+void Pacer::enqueueProbe(const PacketView* packets, size_t count, uint32_t rate_kbps) {
+    if (!packets || count == 0 || rate_kbps == 0) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (probes_.empty()) probe_next_us_ = getTimestampUs();
+        for (size_t i = 0; i < count; ++i) {
+            Entry e;
+            e.len   = packets[i].len;
+            e.seq   = packets[i].seq;
+            e.owned = cs::BufferPool::shared().copyOf(packets[i].data, packets[i].len);
+            e.data  = e.owned.data();
+            e.probe_bytes_per_us = static_cast<double>(rate_kbps) / 8000.0;
+            probes_.push_back(std::move(e));
+            ++queued_count_;
+        }
+    }
+    cv_.notify_one();
+}
+
+// ---------------------------------------------------------------------------
+// queuedBytes
+// ---------------------------------------------------------------------------
+
+size_t Pacer::queuedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_bytes_ - bulk_bytes_;
+}
+
+// ---------------------------------------------------------------------------
+// refill -- token bucket accounting (mutex_ held)
+// ---------------------------------------------------------------------------
+
+void Pacer::refill(uint64_t now_us) {
+    if (now_us > last_refill_us_) {
+        tokens_ += static_cast<double>(now_us - last_refill_us_) * bytes_per_us_;
+        tokens_  = std::min(tokens_, burst_bytes_);
+    }
+    last_refill_us_ = now_us;
+}
+
+// ---------------------------------------------------------------------------
+// takeReady -- move sendable packets into inflight_ (mutex_ held)
+// ---------------------------------------------------------------------------
+
+void Pacer::takeReady() {
+    const bool unlimited = bytes_per_us_ <= 0.0;
+
+    const size_t video = static_cast<size_t>(PacingLane::VIDEO);
+    const size_t bulk  = static_cast<size_t>(PacingLane::BULK);
+
+    for (size_t l = 0; l < PACING_LANE_COUNT; ++l) {
+        auto& queue = lanes_[l];
+        const bool paced = l >= video && !unlimited;
+
+        // Bulk waits for the video lane to empty and never digs into the
+        // tokens reserved for the next frame.
+        if (l == bulk && !lanes_[video].empty()) return;
+        const double reserve = (l == bulk && !unlimited) ? burst_bytes_ * BULK_TOKEN_RESERVE : 0.0;
+
+        while (!queue.empty() && inflight_.size() < MAX_BATCH_SEGMENTS) {
+            if (paced && tokens_ <= reserve) return;
+
+            Entry& e = queue.front();
+            if (!unlimited) tokens_ -= static_cast<double>(e.len);
+            queued_bytes_ -= e.len;
+            if (l == bulk) bulk_bytes_ -= e.len;
+            --queued_count_;
+            inflight_.push_back(std::move(e));
+            queue.pop_front();
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// takeProbes -- move due probes into inflight_ (mutex_ held)
+// ---------------------------------------------------------------------------
+
+void Pacer::takeProbes(uint64_t now_us) {
+    while (!probes_.empty() && probe_next_us_ <= now_us &&
+           inflight_.size() < MAX_BATCH_SEGMENTS) {
+        Entry& e = probes_.front();
+        probe_next_us_ += static_cast<uint64_t>(static_cast<double>(e.len) / e.probe_bytes_per_us);
+        --queued_count_;
+        inflight_.push_back(std::move(e));
+        probes_.pop_front();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// run -- drain thread
+// ---------------------------------------------------------------------------
+
+void Pacer::run() {
+    cs::ScopedThreadRole role(cs::ThreadRole::SEND);
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (running_.load()) {
+        if (queued_count_ == 0) {
+            cv_.wait(lock, [this] { return !running_.load() || queued_count_ > 0; });
+            continue;
+        }
+
+        const uint64_t now_us = getTimestampUs();
+        refill(now_us);
+        takeProbes(now_us);
+        takeReady();
+
+        if (inflight_.empty()) {
+            // Only paced video is waiting and the bucket is empty: sleep
+            // until it has refilled past zero (or a priority packet arrives).
+            // Bulk alone waits for the bucket to refill past its floor.
+            const bool bulk_only = lanes_[static_cast<size_t>(PacingLane::VIDEO)].empty();
+            double deficit = (bulk_only ? burst_bytes_ * BULK_TOKEN_RESERVE : 0.0) - tokens_ + 1.0;
+            uint64_t wait_us = bytes_per_us_ > 0.0
+                ? static_cast<uint64_t>(deficit / bytes_per_us_)
+                : 0;
+            if (!probes_.empty()) {
+                // The next probe may be due before the bucket refills
+                const uint64_t probe_us = probe_next_us_ > now_us ? probe_next_us_ - now_us : 0;
+                wait_us = queued_count_ > probes_.size() ? std::min(wait_us, probe_us) : probe_us;
+            }
+            wait_us = std::max(wait_us, MIN_WAIT_US);
+            cv_.wait_for(lock, std::chrono::microseconds(wait_us));
+            continue;
+        }
+
+        lock.unlock();
+        transmit(inflight_);
+        lock.lock();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// transmit
+// ---------------------------------------------------------------------------
+
+void Pacer::transmit(std::vector<Entry>& entries) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+
+    views_.clear();
+    for (const auto& e : entries) {
+        views_.push_back({e.data, e.len, e.seq});
+    }
+    if (send_ && !views_.empty()) {
+        send_(views_.data(), views_.size());
+    }
+    entries.clear();
+}
+
+} // namespace cs::host
@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+// pacer.h -- Token-bucket send pacer with priority lanes
+//
+// Spreads each frame's packets over time instead of writing them to the
+// socket back-to-back, so a large keyframe does not overflow the shallow
+// buffers of consumer routers and LTE links.  Packets are queued per lane
+// and a dedicated thread drains them:
+//
+//   - AUDIO, CONTROL and RETRANSMIT lanes are sent as soon as the thread
+//     wakes, ahead of any queued video.  They still consume tokens, so
+//     they delay video rather than exceed the configured rate.
+//   - The VIDEO lane is released only while the token bucket is positive.
+//     Tokens refill at the pacing rate and are capped at the burst size.
+//   - The BULK lane is released only when no video is queued and more than
+//     half a burst of tokens is left, so a clipboard paste never takes the
+//     tokens the next frame needs.  It is bounded; overflow is dropped.
+//
+// Bandwidth probes (enqueueProbe()) bypass the lanes and the token bucket:
+// a probe cluster is released on a clock of its own, at the rate being
+// probed, on top of whatever the lanes send.
+//
+// VIDEO-lane packets are borrowed (they point into the transport's packet
+// slab); all other lanes are copied on enqueue, into cs::BufferPool blocks.  To keep borrowed slots
+// from being reused while still queued, the VIDEO lane is bounded and the
+// oldest packets are flushed unpaced when the bound is exceeded.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "udp_transport.h"
+
+#include <cs/buffer_pool.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cs::host {
+
+class Pacer {
+public:
+    /// Writes a batch of packets to the socket (called from the pacer thread,
+    /// or from enqueue() when the VIDEO lane overflows).
+    using SendFunction = std::function<void(const PacketView* packets, size_t count)>;
+
+    /// Most borrowed packets that may be queued or in flight at once: the
+    /// slab must never hand a queued slot to the next batch, which can claim
+    /// up to 2 x MAX_BATCH_FRAGMENTS slots (data + FEC) ahead of the
+    /// sequence counter.
+    static constexpr size_t MAX_BORROWED_PACKETS =
+        PACKET_CACHE_SIZE - 2 * MAX_BATCH_FRAGMENTS - MAX_BATCH_SEGMENTS;
+
+    explicit Pacer(SendFunction send);
+    ~Pacer();
+
+    // Non-copyable
+    Pacer(const Pacer&) = delete;
+    Pacer& operator=(const Pacer&) = delete;
+
+    /// Start the drain thread (idempotent).
+    void start();
+
+    /// Stop the drain thread.  Anything still queued is sent unpaced first.
+    void stop();
+
+    /// Set the pacing rate and the token-bucket depth.  A rate of 0 means
+    /// unlimited: queued packets are released as fast as the thread runs.
+    void setRate(uint32_t rate_kbps, size_t burst_bytes);
+
+    /// Queue |count| packets on |lane|.
+    void enqueue(PacingLane lane, const PacketView* packets, size_t count);
+
+    /// Queue a probe cluster of |count| packets (copied), to be released
+    /// back to back at |rate_kbps| regardless of the token bucket.  Probes
+    /// queued while a cluster is still going follow it at their own rate.
+    void enqueueProbe(const PacketView* packets, size_t count, uint32_t rate_kbps);
+
+    /// Bytes currently waiting in all lanes but BULK.
+    size_t queuedBytes() const;
+
+    /// Current pacing rate in kbps (0 = unlimited).
+    uint32_t rateKbps() const { return rate_kbps_.load(); }
+
+private:
+    struct Entry {
+        const uint8_t*       data = nullptr;
+        size_t               len  = 0;
+        uint16_t             seq  = 0;
+        cs::PooledBuffer     owned;   // Backing store for copied lanes
+        double               probe_bytes_per_us = 0.0;   // Probes: the cluster's rate
+    };
+
+    /// Drain thread body.
+    void run();
+
+    /// Add tokens for the time elapsed since the last refill (mutex_ held).
+    void refill(uint64_t now_us);
+
+    /// Move ready packets into inflight_ (mutex_ held).
+    void takeReady();
+
+    /// Move the probes due at |now_us| into inflight_ (mutex_ held).
+    void takeProbes(uint64_t now_us);
+
+    /// Send and release the packets in |entries|.
+    void transmit(std::vector<Entry>& entries);
+
+    SendFunction send_;
+
+    mutable std::mutex      mutex_;
+    std::condition_variable cv_;
+    std::array<std::deque<Entry>, PACING_LANE_COUNT> lanes_;
+    size_t                  queued_bytes_ = 0;
+    size_t                  queued_count_ = 0;
+    size_t                  bulk_bytes_   = 0;   // Part of queued_bytes_ in the BULK lane
+
+    // Probe clusters (guarded by mutex_; counted in queued_count_ only)
+    std::deque<Entry>       probes_;
+    uint64_t                probe_next_us_ = 0;   // When the next probe is due
+
+    // Token bucket (guarded by mutex_)
+    double                  tokens_         = 0.0;   // bytes; may go negative
+    double                  bytes_per_us_   = 0.0;   // 0 = unlimited
+    double                  burst_bytes_    = 0.0;
+    uint64_t                last_refill_us_ = 0;
+    std::atomic<uint32_t>   rate_kbps_{0};
+
+    // Packets taken off the queues by the drain thread (reused).
+    std::vector<Entry>      inflight_;
+    std::vector<PacketView> views_;
+    std::mutex              send_mutex_;   // Serializes send_ callers
+
+    std::thread             thread_;
+    std::atomic<bool>       running_{false};
+
+    static constexpr uint64_t MIN_WAIT_US = 250;   // Timer granularity floor
+    static constexpr size_t   MAX_BULK_QUEUE_BYTES = 1024 * 1024;
+    static constexpr double   BULK_TOKEN_RESERVE   = 0.5;   // x burst kept for video
+};
+
+} // namespace cs::host
@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////////
+// send_shards.cpp -- Fork-join worker pool implementation
+///////////////////////////////////////////////////////////////////////////////
+
+#include "send_shards.h"
+#include <cs/common.h>
+#include <cs/thread_policy.h>
+#include <cs/trace.h>
+
+#include <algorithm>
+#include <string>
+
+namespace cs::host {
+
+// ---------------------------------------------------------------------------
+// Constructor / Destructor
+// ---------------------------------------------------------------------------
+
+SendShards::SendShards(size_t shards)
+    : shards_(std::clamp<size_t>(shards, 1, MAX_SHARDS))
+{
+    workers_.reserve(shards_ - 1);
+    for (size_t shard = 1; shard < shards_; ++shard) {
+        workers_.emplace_back(&SendShards::work, this, shard);
+    }
+    CS_LOG(INFO, "SendShards: %zu shards (%zu workers)", shards_, shards_ - 1);
+}
+
+SendShards::~SendShards() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_.store(true);
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// shardsFor / shardRange
+// ---------------------------------------------------------------------------
+
+size_t SendShards::shardsFor(size_t count) const {
+    return std::clamp<size_t>(count / MIN_SHARD_PACKETS, 1, shards_);
+}
+
+void SendShards::shardRange(size_t count, size_t shards, size_t shard,
+                            size_t* begin, size_t* end) {
+    *begin = count * shard / shards;
+    *end   = count * (shard + 1) / shards;
+}
+
+// ---------------------------------------------------------------------------
+// runErased -- publish a job, run shard 0, wait for the workers
+// ---------------------------------------------------------------------------
+
+void SendShards::runErased(size_t count, ShardFunction fn, void* context) {
+    const size_t shards = shardsFor(count);
+    if (shards == 1) {
+        fn(context, 0, 0, count);
+        return;
+    }
+
+    job_fn_      = fn;
+    job_context_ = context;
+    job_count_   = count;
+    job_shards_  = shards;
+    pending_.store(workers_.size(), std::memory_order_relaxed);
+    {
+        // Under the lock, so a worker between its check and its wait
+        // cannot miss the notify
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+    cv_.notify_all();
+
+    size_t begin = 0;
+    size_t end   = 0;
+    shardRange(count, shards, 0, &begin, &end);
+    fn(context, 0, begin, end);
+
+    // The other shards started with ours and are about as long; workers
+    // without one check in at once
+    while (pending_.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// work -- worker thread body
+// ---------------------------------------------------------------------------
+
+void SendShards::work(size_t shard) {
+    cs::ScopedThreadRole role(cs::ThreadRole::SEND);
+    const std::string name = "send-shard-" + std::to_string(shard);
+    cs::trace::setThreadName(name.c_str());
+
+    uint64_t seen = 0;
+    uint64_t last_job_us = cs::getTimestampUs();
+    for (;;) {
+        // Frames come back to back at high rates: spin a little before
+        // sleeping, so the next one starts without a wakeup
+        uint64_t generation = generation_.load(std::memory_order_acquire);
+        while (generation == seen && !stop_.load(std::memory_order_relaxed)) {
+            if (cs::getTimestampUs() - last_job_us < SPIN_US) {
+                std::this_thread::yield();
+            } else {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [&]() {
+                    return generation_.load(std::memory_order_acquire) != seen ||
+                           stop_.load(std::memory_order_relaxed);
+                });
+            }
+            generation = generation_.load(std::memory_order_acquire);
+        }
+        if (stop_.load(std::memory_order_relaxed)) return;
+        seen = generation;
+
+        // Every worker checks in, with a shard or not, so none is still
+        // reading this job when the next one is published
+        if (shard < job_shards_) {
+            size_t begin = 0;
+            size_t end   = 0;
+            shardRange(job_count_, job_shards_, shard, &begin, &end);
+            job_fn_(job_context_, shard, begin, end);
+        }
+        pending_.fetch_sub(1, std::memory_order_acq_rel);
+        last_job_us = cs::getTimestampUs();
+    }
+}
+
+} // namespace cs::host
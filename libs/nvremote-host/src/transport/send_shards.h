@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+// send_shards.h -- Fork-join worker pool for sealing and sending a batch
+//
+// At 4K120 and 150+ Mbps, sealing every datagram and writing it to the
+// socket on the one sending thread is the bottleneck, more so on small
+// cores (Jetson's A78).  SendShards splits a batch into contiguous shards
+// by position (the batch is in sequence order, so each shard is a run of
+// sequence numbers) and runs one shard on the calling thread and the rest
+// on workers, returning when all are done.  A frame therefore never
+// overlaps the next one on the wire, and within a shard packets keep their
+// order.
+//
+// Handoff is one generation counter: the caller publishes the job and
+// bumps it, and workers that spun on it (for SPIN_US after their last job)
+// start at once; idle ones sleep on a condition variable and are woken.
+// Nothing is allocated per run.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace cs::host {
+
+class SendShards {
+public:
+    /// Most shards a batch is split into (the caller + MAX_SHARDS - 1 workers).
+    static constexpr size_t MAX_SHARDS = 8;
+
+    /// Smallest shard worth a handoff; smaller batches use fewer shards.
+    static constexpr size_t MIN_SHARD_PACKETS = 16;
+
+    /// Start |shards| - 1 worker threads (|shards| is clamped to
+    /// [1, MAX_SHARDS]).  Worker k is named "send-shard-k" in traces.
+    explicit SendShards(size_t shards);
+    ~SendShards();
+
+    // Non-copyable
+    SendShards(const SendShards&) = delete;
+    SendShards& operator=(const SendShards&) = delete;
+
+    /// Number of shards a large batch is split into.
+    size_t shards() const { return shards_; }
+
+    /// Shards a batch of |count| packets is split into.
+    size_t shardsFor(size_t count) const;
+
+    /// Call |fn|(shard, begin, end) for each shard of |count| packets --
+    /// shard 0 on this thread, the others on workers -- and return when
+    /// all have returned.  Shard k covers [begin, end), in order.  Must be
+    /// called from one thread at a time.
+    template <typename Fn>
+    void run(size_t count, Fn&& fn) {
+        using F = std::remove_reference_t<Fn>;
+        runErased(count, [](void* context, size_t shard, size_t begin, size_t end) {
+            (*static_cast<F*>(context))(shard, begin, end);
+        }, &fn);
+    }
+
+private:
+    using ShardFunction = void (*)(void* context, size_t shard, size_t begin, size_t end);
+
+    /// run() without the template.
+    void runErased(size_t count, ShardFunction fn, void* context);
+
+    /// Range of shard |shard| of |count| packets in |shards| shards.
+    static void shardRange(size_t count, size_t shards, size_t shard,
+                           size_t* begin, size_t* end);
+
+    /// Worker thread body for shard |shard|.
+    void work(size_t shard);
+
+    static constexpr uint64_t SPIN_US = 200;   // Spin this long for the next job, then sleep
+
+    size_t shards_ = 1;
+
+    // Current job, published by generation_ (written only while no worker
+    // is running one)
+    ShardFunction job_fn_      = nullptr;
+    void*         job_context_ = nullptr;
+    size_t        job_count_   = 0;
+    size_t        job_shards_  = 0;
+
+    std::atomic<uint64_t>   generation_{0};
+    std::atomic<size_t>     pending_{0};      // Workers not done with the job
+    std::atomic<bool>       stop_{false};
+    std::mutex              mutex_;           // Sleeping workers wait on cv_
+    std::condition_variable cv_;
+    std::vector<std::thread> workers_;
+};
+
+} // namespace cs::host
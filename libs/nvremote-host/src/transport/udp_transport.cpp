@@ -8,7 +8,11 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "udp_transport.h"
+#include "pacer.h"
+#include "send_shards.h"
+#include <cs/buffer_pool.h>
 #include <cs/common.h>
+#include <cs/trace.h>
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -17,8 +21,91 @@
 #include <cstring>
 #include <algorithm>
 
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <linux/filter.h>
+#include <errno.h>
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103   // linux/udp.h, kernel 4.18+
+#endif
+#endif
+
 namespace cs::host {
 
+namespace {
+
+// Candidate datagram sizes for PMTU probing (wire bytes).  Covers IPv4
+// over WireGuard (1392 and below), TURN relays, plain Ethernet (1472) and
+// jumbo frames.  The caller's ceiling is always probed as well.
+constexpr size_t PMTU_PROBE_SIZES[] = { 1200, 1280, 1360, 1392, 1400, 1472, 4052, 8972 };
+constexpr int    PMTU_PROBE_COPIES  = 2;   // Each probe is sent twice against random loss
+
+// ---------------------------------------------------------------------------
+// gsoRunLength -- number of packets starting at |pkts| that can be sent as a
+// single segmentation-offload super-datagram.  The kernel splits the
+// payload at the first packet's size, so every packet must match it except
+// the last, which may be shorter.
+// ---------------------------------------------------------------------------
+size_t gsoRunLength(const PacketView* pkts, size_t count) {
+    if (count == 0) return 0;
+    const size_t seg = pkts[0].len;
+    size_t total = 0;
+    size_t n = 0;
+    while (n < count && n < MAX_BATCH_SEGMENTS &&
+           total + pkts[n].len <= MAX_BATCH_BYTES) {
+        if (pkts[n].len > seg) break;
+        total += pkts[n].len;
+        ++n;
+        if (pkts[n - 1].len < seg) break;   // a short segment ends the run
+    }
+    return std::max<size_t>(n, 1);
+}
+
+// ---------------------------------------------------------------------------
+// beginWrite / endWrite -- seqlock writer side of a cache entry
+// ---------------------------------------------------------------------------
+void beginWrite(CachedPacket& entry) {
+    const uint32_t v = entry.version.load(std::memory_order_relaxed);
+    if (v & 1) return;   // Already claimed by acquireBuffer()
+    entry.version.store(v + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void endWrite(CachedPacket& entry) {
+    entry.version.store(entry.version.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+}
+
+// CachedPacket::retransmit holds the seq in its top 16 bits.
+constexpr uint64_t RETRANSMIT_TIME_MASK = (1ULL << 48) - 1;
+
+// An IPv4 address and port in one atomic word: address << 16 | port, both
+// in network order.
+uint64_t packAddr(const ::sockaddr_in& addr) {
+    return static_cast<uint64_t>(addr.sin_addr.s_addr) << 16 | addr.sin_port;
+}
+
+::sockaddr_in unpackAddr(uint64_t packed) {
+    ::sockaddr_in addr = {};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = static_cast<uint32_t>(packed >> 16);
+    addr.sin_port        = static_cast<uint16_t>(packed & 0xFFFF);
+    return addr;
+}
+
+} // anonymous namespace
+
 // ===========================================================================
 // DtlsContext implementation
 // ===========================================================================
@@ -148,34 +235,633 @@ bool DtlsContext::decrypt(const uint8_t* in, size_t in_len, std::vector<uint8_t>
 // UdpTransport implementation
 // ===========================================================================
 
-UdpTransport::UdpTransport() = default;
+UdpTransport::UdpTransport()
+    : slab_(PACKET_CACHE_SIZE, MAX_MTU_SIZE + cs::MediaCipher::OVERHEAD)
+    , cache_(new CachedPacket[PACKET_CACHE_SIZE])
+{
+    // Packets start after the AEAD header so they can be sealed in place.
+    for (size_t i = 0; i < PACKET_CACHE_SIZE; ++i) {
+        cache_[i].data = slab_.slot(i) + cs::MediaCipher::HEADER_LEN;
+    }
+}
 
 UdpTransport::~UdpTransport() {
+    // Drain the pacer while the socket is still usable.
+    pacer_.reset();
+    shards_.reset();
+    for (auto& state : shard_state_) {
+        if (state.socket_fd >= 0) cs_close_socket(state.socket_fd);
+    }
+    impair_.reset();
+    closeWaitHandles();
     // We do not close socket_fd_ because we don't own it.
 }
 
+// ---------------------------------------------------------------------------
+// setPacingRate -- enable / retune / disable egress pacing
+// ---------------------------------------------------------------------------
+
+void UdpTransport::setPacingRate(uint32_t rate_kbps, size_t burst_bytes) {
+    if (rate_kbps == 0) {
+        if (pacing_enabled_.exchange(false)) {
+            // Let the drain thread flush the queues at full speed.
+            pacer_->setRate(0, 0);
+            CS_LOG(INFO, "UDP: pacing disabled");
+        }
+        return;
+    }
+
+    if (!pacer_) {
+        pacer_ = std::make_unique<Pacer>([this](const PacketView* packets, size_t count) {
+            transmit(packets, count);
+        });
+    }
+    pacer_->setRate(rate_kbps, burst_bytes);
+    pacer_->start();
+
+    if (!pacing_enabled_.exchange(true)) {
+        CS_LOG(INFO, "UDP: pacing enabled (%u kbps, burst %zu bytes)",
+               rate_kbps, burst_bytes);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// sendProbeCluster -- sealed padding at a probe rate
+// ---------------------------------------------------------------------------
+
+bool UdpTransport::sendProbeCluster(uint32_t rate_kbps, size_t bytes, std::vector<uint16_t>& seqs) {
+    seqs.clear();
+    if (socket_fd_ < 0 || !cipher_ || rate_kbps == 0 || bytes == 0) return false;
+
+    const size_t wire  = max_packet_size_ + cs::MediaCipher::OVERHEAD;
+    const size_t count = (bytes + wire - 1) / wire;
+    std::vector<uint8_t>    slab(count * wire, 0);
+    std::vector<PacketView> views;
+    views.reserve(count);
+    seqs.reserve(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t* pkt = slab.data() + i * wire;
+        uint8_t* plain = pkt + cs::MediaCipher::HEADER_LEN;
+        plain[0] = static_cast<uint8_t>(cs::PacketType::PADDING);
+        if (recorder_) recorder_->record(cs::RecordDirection::SENT, plain, max_packet_size_);
+
+        const size_t sealed_len = cipher_->seal(pkt, max_packet_size_);
+        if (sealed_len == 0) return false;
+        views.push_back({pkt, sealed_len, 0});
+        seqs.push_back(static_cast<uint16_t>(cs::MediaCipher::packetCounter(pkt)));
+    }
+
+    // The pacer releases probes on their own clock, so it runs even while
+    // the media are sent unpaced
+    if (!pacer_) {
+        pacer_ = std::make_unique<Pacer>([this](const PacketView* packets, size_t n) {
+            transmit(packets, n);
+        });
+    }
+    pacer_->start();
+    pacer_->enqueueProbe(views.data(), views.size(), rate_kbps);   // Copied on enqueue
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// setImpairment -- put a network emulator in front of the socket
+// ---------------------------------------------------------------------------
+
+void UdpTransport::setImpairment(const cs::ImpairmentConfig& config) {
+    impair_.reset();
+    if (!config.enabled()) return;
+
+    impair_ = std::make_unique<cs::NetworkImpairment>(config);
+    impair_->start([this](const cs::NetworkImpairment::Datagram& dgram) {
+        ::sendto(socket_fd_, reinterpret_cast<const char*>(dgram.buf.data()),
+                 static_cast<int>(dgram.len), 0,
+                 reinterpret_cast<const ::sockaddr*>(&dgram.to), sizeof(dgram.to));
+    });
+    CS_LOG(INFO, "UDP: impairment on egress (%s)", cs::describeImpairment(config).c_str());
+}
+
+// ---------------------------------------------------------------------------
+// pacerQueuedBytes
+// ---------------------------------------------------------------------------
+
+size_t UdpTransport::pacerQueuedBytes() const {
+    // pacing_enabled_ is set only once pacer_ exists.
+    return pacing_enabled_.load() ? pacer_->queuedBytes() : 0;
+}
+
 // ---------------------------------------------------------------------------
 // initialize -- bind to an existing connected socket
 // ---------------------------------------------------------------------------
 
 bool UdpTransport::initialize(int socket_fd, const ::sockaddr_in& peer_addr) {
     socket_fd_ = socket_fd;
-    peer_addr_ = peer_addr;
+    setPeerAddr(peer_addr);
+    path_migrations_.store(0);
+    secondary_.store(0);
+    validating_ = 0;
+    secondary_packets_.store(0);
     bytes_sent_ = 0;
 
     // Clear the packet cache.
-    for (auto& p : cache_) {
-        p.valid = false;
-        p.data.clear();
+    for (size_t i = 0; i < cache_slots_; ++i) {
+        CachedPacket& p = cache_[i];
+        p.valid      = false;
+        p.len        = 0;
+        p.sealed_len = 0;
+        p.retransmit.store(0);
     }
 
-    CS_LOG(INFO, "UDP transport: initialized (fd=%d, peer=%s:%d)",
+    detectSegmentationOffload();
+    openWaitHandles();
+
+    CS_LOG(INFO, "UDP transport: initialized (fd=%d, peer=%s:%d, gso=%s)",
            socket_fd,
-           inet_ntoa(peer_addr_.sin_addr),
-           ntohs(peer_addr_.sin_port));
+           inet_ntoa(peer_addr.sin_addr),
+           ntohs(peer_addr.sin_port),
+           gso_supported_ ? "yes" : "no");
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// detectSegmentationOffload -- probe UDP_SEGMENT / UDP_SEND_MSG_SIZE support
+// ---------------------------------------------------------------------------
+
+void UdpTransport::detectSegmentationOffload() {
+    gso_supported_ = false;
+#if defined(__linux__)
+    int val = 0;
+    socklen_t len = sizeof(val);
+    gso_supported_ = ::getsockopt(socket_fd_, SOL_UDP, UDP_SEGMENT, &val, &len) == 0;
+#elif defined(_WIN32) && defined(UDP_SEND_MSG_SIZE)
+    DWORD val = 0;
+    int len = sizeof(val);
+    gso_supported_ = ::getsockopt(static_cast<SOCKET>(socket_fd_), IPPROTO_UDP,
+                                  UDP_SEND_MSG_SIZE,
+                                  reinterpret_cast<char*>(&val), &len) == 0;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// sendBatch -- cache and send many packets with batched syscalls
+// ---------------------------------------------------------------------------
+
+bool UdpTransport::sendBatch(const PacketView* packets, size_t count) {
+    if (socket_fd_ < 0) return false;
+    if (!packets || count == 0) return true;
+    cs::trace::Scope trace(cs::trace::Stage::PACKET_BATCH);
+
+    // DTLS records go out through the one SSL object; only sealed or
+    // clear media can be sharded
+    if (shards_ && shard_cipher_ == cipher_ && (cipher_ || !dtls_ || !dtls_->isReady())) {
+        return sendBatchSharded(packets, count);
+    }
+
+    // Cache (and seal) everything, collecting the on-the-wire view of each
+    // packet from its slab slot -- the pacer borrows these, so the caller's
+    // buffers are never referenced later.
+    wire_views_.clear();
+    batch_entries_.clear();
+    ::sockaddr_in secondary = {};
+    const bool multipath = secondaryPath(&secondary);
+    bool ok = true;
+    const uint64_t now_us = cs::getTimestampUs();
+    for (size_t i = 0; i < count; ++i) {
+        const bool primary = !multipath || stageSecondary(packets[i], i);
+        const CachedPacket* entry =
+            cachePacket(packets[i].seq, packets[i].data, packets[i].len,
+                        packets[i].droppable, now_us);
+        batch_entries_.push_back(entry);
+        if (!entry) {
+            ok &= sendDirect(packets[i].data, packets[i].len);
+        } else if (primary) {
+            wire_views_.push_back(wireView(*entry));
+        }
+    }
+
+    if (pacing_enabled_.load()) {
+        pacer_->enqueue(PacingLane::VIDEO, wire_views_.data(), wire_views_.size());
+    } else {
+        ok = transmit(wire_views_.data(), wire_views_.size()) && ok;
+    }
+    if (multipath) sendStaged(batch_entries_.data(), batch_entries_.size(), secondary);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// transmit -- write packets to the socket now
+// ---------------------------------------------------------------------------
+
+bool UdpTransport::transmit(const PacketView* packets, size_t count) {
+    // SSL_write owns the socket I/O when DTLS is active; no batching there.
+    // Sealed media bypasses DTLS entirely.
+    if (!cipher_ && dtls_ && dtls_->isReady()) {
+        bool ok = true;
+        for (size_t i = 0; i < count; ++i) {
+            ok &= sendRaw(packets[i].data, packets[i].len);
+        }
+        return ok;
+    }
+
+    size_t sent = sendBatchRaw(packets, count);
+    if (sent < count) {
+        CS_LOG(WARN, "UDP: batch send incomplete (%zu of %zu packets)", sent, count);
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// sendBatchRaw -- platform-specific batched send
+// ---------------------------------------------------------------------------
+
+size_t UdpTransport::sendBatchRaw(const PacketView* packets, size_t count, int fd) {
+    size_t done = 0;
+
+    // The emulator takes datagrams one at a time.
+    if (impair_) {
+        const ::sockaddr_in peer = peerAddr();
+        while (done < count && sendDatagramTo(packets[done].data, packets[done].len, peer)) {
+            ++done;
+        }
+        return done;
+    }
+
+#if defined(__linux__)
+    constexpr size_t kMaxMsgs = 64;
+    constexpr size_t kMaxIovs = 256;
+    constexpr size_t kCtrlLen = CMSG_SPACE(sizeof(uint16_t));
+
+    mmsghdr msgs[kMaxMsgs];
+    iovec   iovs[kMaxIovs];
+    alignas(cmsghdr) char ctrl[kMaxMsgs][kCtrlLen];
+    size_t  msg_pkts[kMaxMsgs];
+    const uint64_t now_us = sent_cb_ ? cs::getTimestampUs() : 0;
+    ::sockaddr_in peer = peerAddr();
+    const int sock = fd >= 0 ? fd : socket_fd_;
+
+    while (done < count) {
+        size_t nmsg = 0;
+        size_t niov = 0;
+        size_t i = done;
+
+        std::memset(msgs, 0, sizeof(msgs));
+        while (i < count && nmsg < kMaxMsgs && niov < kMaxIovs) {
+            size_t run = gso_supported_ ? gsoRunLength(packets + i, count - i) : 1;
+            run = std::min(run, kMaxIovs - niov);
+
+            for (size_t j = 0; j < run; ++j) {
+                iovs[niov + j].iov_base = const_cast<uint8_t*>(packets[i + j].data);
+                iovs[niov + j].iov_len  = packets[i + j].len;
+            }
+
+            msghdr& mh = msgs[nmsg].msg_hdr;
+            mh.msg_name    = &peer;
+            mh.msg_namelen = sizeof(peer);
+            mh.msg_iov     = &iovs[niov];
+            mh.msg_iovlen  = run;
+
+            if (run > 1) {
+                mh.msg_control    = ctrl[nmsg];
+                mh.msg_controllen = kCtrlLen;
+                cmsghdr* cm = CMSG_FIRSTHDR(&mh);
+                cm->cmsg_level = SOL_UDP;
+                cm->cmsg_type  = UDP_SEGMENT;
+                cm->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+                uint16_t seg = static_cast<uint16_t>(packets[i].len);
+                std::memcpy(CMSG_DATA(cm), &seg, sizeof(seg));
+            }
+
+            msg_pkts[nmsg] = run;
+            niov += run;
+            i    += run;
+            ++nmsg;
+        }
+
+        int r = ::sendmmsg(sock, msgs, static_cast<unsigned int>(nmsg), 0);
+        if (r < 0) {
+            int err = errno;
+            if (gso_supported_ && (err == EIO || err == EINVAL)) {
+                // Device or path can't segment; retry this round without GSO.
+                CS_LOG(WARN, "UDP: GSO send failed (errno=%d), disabling GSO", err);
+                gso_supported_ = false;
+                continue;
+            }
+            if (err == EINTR) continue;
+            CS_LOG(DEBUG, "UDP: sendmmsg failed (errno=%d)", err);
+            break;
+        }
+
+        for (int m = 0; m < r; ++m) {
+            for (size_t j = 0; sent_cb_ && j < msg_pkts[m]; ++j) {
+                notifySent(packets[done + j].data, packets[done + j].len, now_us);
+            }
+            done        += msg_pkts[m];
+            bytes_sent_ += msgs[m].msg_len;
+        }
+        if (r == 0) break;
+    }
+
+#elif defined(_WIN32)
+    (void)fd;   // Shards share the session socket here
+  #ifdef UDP_SEND_MSG_SIZE
+    constexpr size_t kCtrlLen = WSA_CMSG_SPACE(sizeof(DWORD));
+    ::sockaddr_in peer = peerAddr();
+
+    while (gso_supported_ && done < count) {
+        size_t run = gsoRunLength(packets + done, count - done);
+        if (run == 1) {
+            if (!sendRaw(packets[done].data, packets[done].len)) break;
+            ++done;
+            continue;
+        }
+
+        WSABUF bufs[MAX_BATCH_SEGMENTS];
+        for (size_t j = 0; j < run; ++j) {
+            bufs[j].buf = reinterpret_cast<CHAR*>(const_cast<uint8_t*>(packets[done + j].data));
+            bufs[j].len = static_cast<ULONG>(packets[done + j].len);
+        }
+
+        alignas(WSACMSGHDR) char ctrl[kCtrlLen] = {};
+        WSAMSG msg = {};
+        msg.name          = reinterpret_cast<LPSOCKADDR>(&peer);
+        msg.namelen       = sizeof(peer);
+        msg.lpBuffers     = bufs;
+        msg.dwBufferCount = static_cast<DWORD>(run);
+        msg.Control.buf   = ctrl;
+        msg.Control.len   = static_cast<ULONG>(kCtrlLen);
+
+        WSACMSGHDR* cm = WSA_CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = IPPROTO_UDP;
+        cm->cmsg_type  = UDP_SEND_MSG_SIZE;
+        cm->cmsg_len   = WSA_CMSG_LEN(sizeof(DWORD));
+        DWORD seg = static_cast<DWORD>(packets[done].len);
+        std::memcpy(WSA_CMSG_DATA(cm), &seg, sizeof(seg));
+
+        DWORD bytes = 0;
+        if (::WSASendMsg(static_cast<SOCKET>(socket_fd_), &msg, 0, &bytes,
+                         nullptr, nullptr) != 0) {
+            CS_LOG(WARN, "UDP: USO send failed (error=%d), disabling USO",
+                   cs_socket_error());
+            gso_supported_ = false;
+            break;
+        }
+        bytes_sent_ += bytes;
+        if (sent_cb_) {
+            uint64_t now_us = cs::getTimestampUs();
+            for (size_t j = 0; j < run; ++j) {
+                notifySent(packets[done + j].data, packets[done + j].len, now_us);
+            }
+        }
+        done += run;
+    }
+  #endif
+    // Per-packet fallback (no USO, or USO failed part-way).
+    while (done < count) {
+        if (!sendRaw(packets[done].data, packets[done].len)) break;
+        ++done;
+    }
+
+#else
+    (void)fd;
+    while (done < count) {
+        if (!sendRaw(packets[done].data, packets[done].len)) break;
+        ++done;
+    }
+#endif
+
+    return done;
+}
+
+// ---------------------------------------------------------------------------
+// sendBatchSharded -- claim in order, then seal and send on every shard
+// ---------------------------------------------------------------------------
+
+bool UdpTransport::sendBatchSharded(const PacketView* packets, size_t count) {
+    // Claiming stays on this thread: it is cheap next to sealing, and it
+    // keeps the cache's single-writer rule and the recording's order.
+    shard_entries_.clear();
+    shard_primary_.clear();
+    batch_entries_.clear();
+    ::sockaddr_in secondary = {};
+    const bool multipath = secondaryPath(&secondary);
+    bool ok = true;
+    const uint64_t now_us = cs::getTimestampUs();
+    for (size_t i = 0; i < count; ++i) {
+        const bool primary = !multipath || stageSecondary(packets[i], i);
+        CachedPacket* entry = claimPacket(packets[i].seq, packets[i].data, packets[i].len,
+                                          packets[i].droppable, now_us);
+        batch_entries_.push_back(entry);
+        if (entry) {
+            shard_entries_.push_back(entry);
+            shard_primary_.push_back(primary);
+        } else {
+            ok &= sendDirect(packets[i].data, packets[i].len);
+        }
+    }
+
+    // Counters in sequence order, so the transport-wide sequence numbers
+    // congestion feedback reports follow the frame's packets
+    const size_t claimed = shard_entries_.size();
+    const uint64_t first_counter = cipher_ ? cipher_->reserveCounters(claimed) : 0;
+    const bool paced = pacing_enabled_.load();
+    wire_views_.resize(claimed);
+
+    shards_->run(claimed, [&](size_t shard, size_t begin, size_t end) {
+        ShardState& state = shard_state_[shard];
+        state.begin = begin;
+        state.count = 0;
+        state.ok    = true;
+        for (size_t i = begin; i < end; ++i) {
+            CachedPacket& entry = *shard_entries_[i];
+            if (cipher_) {
+                entry.sealed_len = state.sealer->seal(entry.data - cs::MediaCipher::HEADER_LEN,
+                                                      entry.len, first_counter + i);
+                entry.valid = entry.sealed_len > 0;
+            } else {
+                entry.valid = true;
+            }
+            endWrite(entry);
+            if (!entry.valid) {
+                state.ok = false;
+            } else if (shard_primary_[i]) {
+                wire_views_[begin + state.count++] = wireView(entry);
+            }
+        }
+
+        if (!paced && state.count > 0) {
+            const size_t sent = sendBatchRaw(&wire_views_[begin], state.count, state.socket_fd);
+            if (sent < state.count) {
+                CS_LOG(WARN, "UDP: shard %zu send incomplete (%zu of %zu packets)",
+                       shard, sent, state.count);
+                state.ok = false;
+            }
+        }
+    });
+
+    const size_t used = shards_->shardsFor(claimed);
+    for (size_t shard = 0; shard < used; ++shard) {
+        const ShardState& state = shard_state_[shard];
+        if (paced && state.count > 0) {
+            pacer_->enqueue(PacingLane::VIDEO, &wire_views_[state.begin], state.count);
+        }
+        ok &= state.ok;
+    }
+    if (multipath) sendStaged(batch_entries_.data(), batch_entries_.size(), secondary);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// stageSecondary / sendStaged -- the secondary path's share of a batch
+// ---------------------------------------------------------------------------
+
+bool UdpTransport::stageSecondary(const PacketView& packet, size_t index) {
+    const PathUse use = multipath_.use(packet.cls);
+    if (use == PathUse::PRIMARY) return true;
+
+    StagedCopy copy;
+    copy.index = index;
+    if (use == PathUse::BOTH) {
+        // Sealed now: caching seals a packet built in its slot in place
+        if (packet.len > max_packet_size_) return true;
+        copy.offset = secondary_arena_.size();
+        secondary_arena_.resize(copy.offset + packet.len + cs::MediaCipher::OVERHEAD);
+        uint8_t* buf = secondary_arena_.data() + copy.offset;
+        std::memcpy(buf + cs::MediaCipher::HEADER_LEN, packet.data, packet.len);
+        copy.len = cipher_->seal(buf, packet.len);
+        if (copy.len == 0) {
+            secondary_arena_.resize(copy.offset);
+            return true;
+        }
+    }
+    staged_.push_back(copy);
+    return use == PathUse::BOTH;
+}
+
+void UdpTransport::sendStaged(const CachedPacket* const* entries, size_t count,
+                              const ::sockaddr_in& to) {
+    for (const StagedCopy& copy : staged_) {
+        const CachedPacket* entry = copy.index < count ? entries[copy.index] : nullptr;
+        if (copy.len > 0) {
+            const int32_t twin = entry && entry->valid && entry->sealed_len > 0
+                ? static_cast<int32_t>(static_cast<uint16_t>(
+                      cs::MediaCipher::packetCounter(entry->data - cs::MediaCipher::HEADER_LEN)))
+                : -1;
+            sendSecondaryDatagram(secondary_arena_.data() + copy.offset, copy.len, to, twin, true);
+        } else if (entry && entry->valid) {
+            // Kept off the primary: fall back to it if the secondary refuses
+            const PacketView view = wireView(*entry);
+            if (!sendSecondaryDatagram(view.data, view.len, to, -1, true)) {
+                sendDatagram(view.data, view.len);
+            }
+        }
+    }
+    staged_.clear();
+    secondary_arena_.clear();
+}
+
+// ---------------------------------------------------------------------------
+// setSendShards / sendShards / openShardSocket
+// ---------------------------------------------------------------------------
+
+void UdpTransport::setSendShards(size_t shards, bool own_sockets) {
+    shards_.reset();
+    for (auto& state : shard_state_) {
+        if (state.socket_fd >= 0) cs_close_socket(state.socket_fd);
+    }
+    shard_state_.clear();
+    shard_cipher_ = cipher_;
+
+    shards = std::min(shards, SendShards::MAX_SHARDS);
+    if (shards <= 1) return;
+    if (!cipher_ && dtls_ && dtls_->isReady()) {
+        CS_LOG(WARN, "UDP: send shards need the media cipher, not DTLS -- not sharding");
+        return;
+    }
+
+    shard_state_.resize(shards);
+    for (size_t shard = 0; shard < shards; ++shard) {
+        ShardState& state = shard_state_[shard];
+        if (cipher_) {
+            state.sealer = cipher_->createSealContext();
+            if (!state.sealer) {
+                shard_state_.clear();
+                return;
+            }
+        }
+        if (own_sockets && shard > 0) state.socket_fd = openShardSocket();
+    }
+
+    const bool own = own_sockets && shard_state_[1].socket_fd >= 0;
+    if (own_sockets && !own) {
+        CS_LOG(INFO, "UDP: session socket is not SO_REUSEPORT -- shards share it");
+    }
+    shards_ = std::make_unique<SendShards>(shards);
+    CS_LOG(INFO, "UDP: sending on %zu shards (%s sockets)", shards, own ? "own" : "shared");
+}
+
+size_t UdpTransport::sendShards() const {
+    return shards_ ? shards_->shards() : 1;
+}
+
+int UdpTransport::openShardSocket() {
+#if defined(__linux__) && defined(SO_REUSEPORT) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    // Joining the session port needs the session socket in a reuseport group
+    int reuse = 0;
+    socklen_t reuse_len = sizeof(reuse);
+    if (::getsockopt(socket_fd_, SOL_SOCKET, SO_REUSEPORT, &reuse, &reuse_len) != 0 || !reuse) {
+        return -1;
+    }
+    ::sockaddr_in local = {};
+    socklen_t local_len = sizeof(local);
+    if (::getsockname(socket_fd_, reinterpret_cast<::sockaddr*>(&local), &local_len) != 0) {
+        return -1;
+    }
+
+    int fd = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) return -1;
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+    // The group would otherwise hash the viewer's feedback to any of its
+    // sockets: "return 0" hands every datagram to the first member, the
+    // session socket.  Without the steering the shard socket is unusable.
+    sock_filter steer[] = { { BPF_RET | BPF_K, 0, 0, 0 } };
+    sock_fprog program = { 1, steer };
+    if (::bind(fd, reinterpret_cast<const ::sockaddr*>(&local), local_len) != 0 ||
+        ::setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) != 0) {
+        CS_LOG(DEBUG, "UDP: shard socket setup failed (errno=%d)", errno);
+        ::close(fd);
+        return -1;
+    }
+
+    // Same DF behaviour as the session socket, which PMTU probing set
+    int pmtu_mode = 0;
+    socklen_t pmtu_len = sizeof(pmtu_mode);
+    if (::getsockopt(socket_fd_, IPPROTO_IP, IP_MTU_DISCOVER, &pmtu_mode, &pmtu_len) == 0) {
+        ::setsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, &pmtu_mode, sizeof(pmtu_mode));
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// acquireBuffer -- hand out the cache slot for |seq| to build a packet in
+// ---------------------------------------------------------------------------
+
+cs::PacketBuffer UdpTransport::acquireBuffer(uint16_t seq) {
+    // The entry stays write-locked until cachePacket() stores the packet, so
+    // a NACK reader never sees a half-built one.
+    auto& entry = cache_[seq % cache_slots_];
+    beginWrite(entry);
+    entry.valid      = false;   // Caller is about to overwrite the contents
+    entry.len        = 0;
+    entry.sealed_len = 0;
+    return cs::PacketBuffer{entry.data, max_packet_size_};
+}
+
 // ---------------------------------------------------------------------------
 // sendPacket -- send a pre-serialized packet and cache for NACK retransmission
 // ---------------------------------------------------------------------------
@@ -184,11 +870,18 @@ bool UdpTransport::sendPacket(const uint8_t* data, size_t len, uint16_t seq) {
     if (socket_fd_ < 0) return false;
     if (!data || len == 0) return false;
 
-    // Cache for potential NACK retransmission.
-    cachePacket(seq, data, len);
+    // Cache (and seal) for potential NACK retransmission.
+    const CachedPacket* entry = cachePacket(seq, data, len, false, cs::getTimestampUs());
+    if (!entry) return sendDirect(data, len);
+    PacketView view = wireView(*entry);
+
+    if (pacing_enabled_.load()) {
+        pacer_->enqueue(PacingLane::VIDEO, &view, 1);
+        return true;
+    }
 
     // Send.
-    if (!sendRaw(data, len)) {
+    if (!(cipher_ ? sendDatagram(view.data, view.len) : sendRaw(view.data, view.len))) {
         CS_LOG(WARN, "UDP: failed to send packet (seq=%u, len=%zu)", seq, len);
         return false;
     }
@@ -196,29 +889,172 @@ bool UdpTransport::sendPacket(const uint8_t* data, size_t len, uint16_t seq) {
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// sendUncached -- send a packet outside the video sequence space
+// ---------------------------------------------------------------------------
+
+bool UdpTransport::sendUncached(const uint8_t* data, size_t len, PacingLane lane) {
+    if (socket_fd_ < 0) return false;
+    if (!data || len == 0) return false;
+    if (recorder_) recorder_->record(cs::RecordDirection::SENT, data, len);
+
+    // Audio is media and gets sealed; control traffic stays on DTLS.
+    if (cipher_ && lane == PacingLane::AUDIO) {
+        if (len > max_packet_size_) {
+            CS_LOG(WARN, "UDP: dropping oversized audio packet (len=%zu)", len);
+            return false;
+        }
+        uint8_t sealed[MAX_PMTU_SIZE];
+        std::memcpy(sealed + cs::MediaCipher::HEADER_LEN, data, len);
+        size_t sealed_len = cipher_->seal(sealed, len);
+        if (sealed_len == 0) return false;
+
+        if (pacing_enabled_.load()) {
+            PacketView view{sealed, sealed_len, 0};
+            pacer_->enqueue(lane, &view, 1);   // Copied on enqueue
+            return true;
+        }
+        return sendDatagram(sealed, sealed_len);
+    }
+
+    if (pacing_enabled_.load()) {
+        PacketView view{data, len, 0};
+        pacer_->enqueue(lane, &view, 1);
+        return true;
+    }
+
+    if (!sendRaw(data, len)) {
+        CS_LOG(WARN, "UDP: failed to send unsequenced packet (len=%zu)", len);
+        return false;
+    }
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 // onNackReceived -- retransmit packets by sequence number
 // ---------------------------------------------------------------------------
 
 void UdpTransport::onNackReceived(const std::vector<uint16_t>& seqs) {
-    std::lock_guard<std::mutex> lock(cache_mutex_);
+    const uint64_t now_us     = cs::getTimestampUs();
+    const uint64_t holdoff_us = retransmit_holdoff_us_.load();
+
+    // Retransmits go out from a private copy, so the sending thread is free
+    // to reuse the slot as soon as the copy is validated.
+    uint8_t copy[MAX_PMTU_SIZE + cs::MediaCipher::OVERHEAD];
+    ::sockaddr_in secondary = {};
+    const PathUse path_use = secondaryPath(&secondary) ? multipath_.retransmit : PathUse::PRIMARY;
 
     for (uint16_t seq : seqs) {
-        size_t idx = seq % PACKET_CACHE_SIZE;
-        auto& cached = cache_[idx];
+        CachedPacket& cached = cache_[seq % cache_slots_];
 
-        if (cached.valid && cached.seq == seq) {
-            if (!sendRaw(cached.data.data(), cached.data.size())) {
-                CS_LOG(WARN, "UDP: NACK retransmit failed for seq=%u", seq);
-            } else {
-                CS_LOG(TRACE, "UDP: retransmitted seq=%u (%zu bytes)", seq, cached.data.size());
-            }
-        } else {
+        // Seqlock read: an odd version means the slot is being rewritten,
+        // i.e. this packet is being evicted.
+        const uint32_t version = cached.version.load(std::memory_order_acquire);
+        if ((version & 1) || !cached.valid || cached.seq != seq) {
+            nack_misses_.fetch_add(1, std::memory_order_relaxed);
             CS_LOG(DEBUG, "UDP: NACK for seq=%u but packet not in cache", seq);
+            continue;
+        }
+
+        // Nothing references an enhancement-layer frame; the viewer
+        // drops it instead of waiting for a repair.
+        if (cached.droppable) {
+            nack_suppressed_.fetch_add(1, std::memory_order_relaxed);
+            CS_LOG(TRACE, "UDP: NACK for droppable seq=%u, skipped", seq);
+            continue;
+        }
+
+        // Past the retention time the viewer has stopped waiting for it.
+        if (retention_us_ > 0 && now_us > cached.cached_us &&
+            now_us - cached.cached_us > retention_us_) {
+            nack_expired_.fetch_add(1, std::memory_order_relaxed);
+            CS_LOG(DEBUG, "UDP: NACK for seq=%u past retention, skipped", seq);
+            continue;
+        }
+
+        // A repeated NACK sent before our last retransmit could have
+        // reached the viewer says nothing new; resending would only
+        // duplicate the repair.
+        const uint64_t last = cached.retransmit.load(std::memory_order_relaxed);
+        if (last != 0 && (last >> 48) == seq &&
+            ((now_us - last) & RETRANSMIT_TIME_MASK) < holdoff_us) {
+            nack_suppressed_.fetch_add(1, std::memory_order_relaxed);
+            CS_LOG(TRACE, "UDP: NACK for seq=%u within holdoff, skipped", seq);
+            continue;
+        }
+
+        PacketView view = wireView(cached);
+        if (view.len > sizeof(copy)) continue;
+        std::memcpy(copy, view.data, view.len);
+        view.data = copy;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (cached.version.load(std::memory_order_relaxed) != version) {
+            nack_misses_.fetch_add(1, std::memory_order_relaxed);
+            CS_LOG(DEBUG, "UDP: NACK for seq=%u raced its eviction", seq);
+            continue;
+        }
+        cached.retransmit.store((static_cast<uint64_t>(seq) << 48) |
+                                (now_us & RETRANSMIT_TIME_MASK),
+                                std::memory_order_relaxed);
+        nack_hits_.fetch_add(1, std::memory_order_relaxed);
+
+        // Sealed packets are resent byte-for-byte; the viewer's replay
+        // window accepts them because the first copy never arrived, and
+        // drops whichever of two path copies comes second.
+        if (path_use != PathUse::PRIMARY &&
+            sendSecondaryDatagram(view.data, view.len, secondary, -1, false) &&
+            path_use == PathUse::SECONDARY) {
+            CS_LOG(TRACE, "UDP: retransmitted seq=%u on the secondary path", seq);
+        } else if (pacing_enabled_.load()) {
+            // Copied by the pacer on enqueue.
+            pacer_->enqueue(PacingLane::RETRANSMIT, &view, 1);
+        } else if (!(cipher_ ? sendDatagram(view.data, view.len)
+                             : sendRaw(view.data, view.len))) {
+            CS_LOG(WARN, "UDP: NACK retransmit failed for seq=%u", seq);
+        } else {
+            CS_LOG(TRACE, "UDP: retransmitted seq=%u (%zu bytes)", seq, view.len);
         }
     }
 }
 
+// ---------------------------------------------------------------------------
+// setCacheRetention -- size the NACK cache in time and bytes
+// ---------------------------------------------------------------------------
+
+void UdpTransport::setCacheRetention(uint32_t retention_ms, uint32_t peak_kbps) {
+    // Most packets are full-size; FEC parity and short frame tails make up
+    // roughly another half on top.
+    const uint64_t bytes   = static_cast<uint64_t>(peak_kbps) * retention_ms / 8;
+    const uint64_t packets = bytes / max_packet_size_ * 3 / 2;
+
+    const size_t slot_size = max_packet_size_ + cs::MediaCipher::OVERHEAD;
+    const size_t max_slots = std::min(MAX_CACHE_SLOTS, MAX_CACHE_BYTES / slot_size);
+    size_t slots = PACKET_CACHE_SIZE;
+    while (slots < packets && slots * 2 <= max_slots) slots *= 2;
+
+    resizeCache(slots, slot_size);
+    retention_us_ = static_cast<uint64_t>(retention_ms) * 1000;
+
+    CS_LOG(INFO, "UDP: NACK cache %zu packets (%zu KB), retention %u ms",
+           slots, slots * slab_.slotSize() / 1024, retention_ms);
+}
+
+// ---------------------------------------------------------------------------
+// getNackCacheStats
+// ---------------------------------------------------------------------------
+
+NackCacheStats UdpTransport::getNackCacheStats() const {
+    NackCacheStats st;
+    st.hits       = nack_hits_.load(std::memory_order_relaxed);
+    st.misses     = nack_misses_.load(std::memory_order_relaxed);
+    st.expired    = nack_expired_.load(std::memory_order_relaxed);
+    st.suppressed = nack_suppressed_.load(std::memory_order_relaxed);
+    st.slots      = cache_slots_;
+    st.bytes      = cache_slots_ * slab_.slotSize();
+    return st;
+}
+
 // ---------------------------------------------------------------------------
 // receiveOne -- receive and dispatch one incoming packet (non-blocking)
 // ---------------------------------------------------------------------------
@@ -234,6 +1070,23 @@ bool UdpTransport::receiveOne() {
                        reinterpret_cast<::sockaddr*>(&from), &fromLen);
     if (n <= 0) return false;
 
+    // Sealed with the viewer's media key: path challenges and responses
+    if (cipher_ && cs::MediaCipher::isSealed(buf, static_cast<size_t>(n))) {
+        size_t plain_len = 0;
+        if (!cipher_->open(buf, static_cast<size_t>(n), &plain_len)) return true;
+        const uint8_t* plain = buf + cs::MediaCipher::HEADER_LEN;
+        if (recorder_) recorder_->record(cs::RecordDirection::RECEIVED, plain, plain_len);
+        const cs::PacketType type = cs::identifyPacket(plain, plain_len);
+        if (type == cs::PacketType::PATH_CHALLENGE) {
+            answerPathChallenge(plain, plain_len, from);
+        } else if (type == cs::PacketType::PATH_RESPONSE) {
+            onPathResponse(plain, plain_len, from);
+        } else if (recv_cb_) {
+            recv_cb_(plain, plain_len);
+        }
+        return true;
+    }
+
     // If DTLS is active, decrypt first.
     if (dtls_ && dtls_->isReady()) {
         std::vector<uint8_t> plain;
@@ -241,21 +1094,363 @@ bool UdpTransport::receiveOne() {
             CS_LOG(DEBUG, "UDP: DTLS decrypt failed on incoming packet");
             return false;
         }
+        if (recorder_) recorder_->record(cs::RecordDirection::RECEIVED, plain.data(), plain.size());
         if (recv_cb_) recv_cb_(plain.data(), plain.size());
     } else {
+        if (recorder_) {
+            recorder_->record(cs::RecordDirection::RECEIVED, buf, static_cast<size_t>(n));
+        }
         if (recv_cb_) recv_cb_(buf, static_cast<size_t>(n));
     }
 
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// answerPathChallenge -- consent and migration (feedback thread)
+// ---------------------------------------------------------------------------
+
+void UdpTransport::answerPathChallenge(const uint8_t* data, size_t len,
+                                       const ::sockaddr_in& from) {
+    cs::PathChallengePacket challenge;
+    if (!cs::PathChallengePacket::deserialize(data, len, challenge)) return;
+
+    // A MIGRATE challenge only starts validating its address; the
+    // viewer's challenges from there, MIGRATE or not, retry ours
+    const uint64_t now = cs::getTimestampUs();
+    const ::sockaddr_in current = peerAddr();
+    const uint64_t packed = packAddr(from);
+    if (validating_ != 0 && now - validating_since_us_ > VALIDATE_TIMEOUT_US) {
+        validating_ = 0;
+    }
+    if (packed != packAddr(current) && (challenge.migrate() || packed == validating_)) {
+        validatePath(from, now);
+    } else if (!challenge.migrate() && packed != packAddr(current)) {
+        // The viewer's standby path: the secondary while it keeps asking
+        secondary_seen_us_.store(cs::getTimestampUs(), std::memory_order_relaxed);
+        if (secondary_.exchange(packed) != packed && multipath_.enabled()) {
+            char ip[INET_ADDRSTRLEN] = {};
+            ::inet_ntop(AF_INET, &from.sin_addr, ip, sizeof(ip));
+            CS_LOG(INFO, "UDP: secondary path to %s:%u", ip, ntohs(from.sin_port));
+        }
+    }
+
+    challenge.type = static_cast<uint8_t>(cs::PacketType::PATH_RESPONSE);
+    uint8_t sealed[sizeof(cs::PathChallengePacket) + cs::MediaCipher::OVERHEAD];
+    challenge.serializeTo(sealed + cs::MediaCipher::HEADER_LEN);
+    size_t sealed_len = cipher_->seal(sealed, sizeof(cs::PathChallengePacket));
+    if (sealed_len > 0) sendDatagramTo(sealed, sealed_len, from);
+}
+
+void UdpTransport::validatePath(const ::sockaddr_in& addr, uint64_t now_us) {
+    const uint64_t packed = packAddr(addr);
+    if (packed != validating_) {
+        validating_           = packed;
+        validating_since_us_  = now_us;
+        validate_first_nonce_ = validate_nonce_ + 1;
+    } else if (now_us - validate_sent_us_ < VALIDATE_RETRY_US) {
+        return;
+    }
+    validate_sent_us_ = now_us;
+
+    cs::PathChallengePacket challenge{};
+    challenge.type  = static_cast<uint8_t>(cs::PacketType::PATH_CHALLENGE);
+    challenge.nonce = ++validate_nonce_;
+    uint8_t sealed[sizeof(cs::PathChallengePacket) + cs::MediaCipher::OVERHEAD];
+    challenge.serializeTo(sealed + cs::MediaCipher::HEADER_LEN);
+    size_t sealed_len = cipher_->seal(sealed, sizeof(cs::PathChallengePacket));
+    if (sealed_len > 0) sendDatagramTo(sealed, sealed_len, addr);
+}
+
+void UdpTransport::onPathResponse(const uint8_t* data, size_t len, const ::sockaddr_in& from) {
+    cs::PathChallengePacket response;
+    if (!cs::PathChallengePacket::deserialize(data, len, response)) return;
+    // Any challenge to it counts: the viewer's retries can outrun an RTT
+    if (validating_ == 0 || packAddr(from) != validating_ ||
+        response.nonce < validate_first_nonce_ || response.nonce > validate_nonce_) {
+        return;
+    }
+    validating_ = 0;
+
+    const ::sockaddr_in current = peerAddr();
+    setPeerAddr(from);
+    uint64_t secondary = packAddr(from);
+    secondary_.compare_exchange_strong(secondary, 0);   // Now the primary
+    path_migrations_.fetch_add(1);
+    char old_ip[INET_ADDRSTRLEN] = {};
+    char new_ip[INET_ADDRSTRLEN] = {};
+    ::inet_ntop(AF_INET, &current.sin_addr, old_ip, sizeof(old_ip));
+    ::inet_ntop(AF_INET, &from.sin_addr, new_ip, sizeof(new_ip));
+    CS_LOG(INFO, "UDP: viewer moved from %s:%u to %s:%u",
+           old_ip, ntohs(current.sin_port), new_ip, ntohs(from.sin_port));
+    if (path_cb_) path_cb_(from);
+}
+
+// ---------------------------------------------------------------------------
+// peerAddr / setPeerAddr
+// ---------------------------------------------------------------------------
+
+::sockaddr_in UdpTransport::peerAddr() const {
+    return unpackAddr(peer_.load(std::memory_order_relaxed));
+}
+
+void UdpTransport::setPeerAddr(const ::sockaddr_in& addr) {
+    peer_.store(packAddr(addr), std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// secondaryPath / hasSecondaryPath
+// ---------------------------------------------------------------------------
+
+bool UdpTransport::secondaryPath(::sockaddr_in* addr) const {
+    if (!cipher_ || !multipath_.enabled()) return false;
+    const uint64_t packed = secondary_.load(std::memory_order_relaxed);
+    if (packed == 0 ||
+        cs::getTimestampUs() - secondary_seen_us_.load(std::memory_order_relaxed) >
+            SECONDARY_TIMEOUT_US) {
+        return false;
+    }
+    *addr = unpackAddr(packed);
+    return true;
+}
+
+bool UdpTransport::hasSecondaryPath() const {
+    ::sockaddr_in addr;
+    return secondaryPath(&addr);
+}
+
+// ---------------------------------------------------------------------------
+// setMaxDatagramSize -- apply the negotiated path MTU
+// ---------------------------------------------------------------------------
+
+void UdpTransport::setMaxDatagramSize(size_t wire_bytes) {
+    wire_bytes = std::clamp(wire_bytes, MIN_PMTU_SIZE, MAX_PMTU_SIZE);
+    const size_t overhead = cipher_ ? cs::MediaCipher::OVERHEAD : 0;
+
+    max_packet_size_ = wire_bytes - overhead;
+
+    // Slots always reserve AEAD head/tailroom so sealing stays in place.
+    resizeCache(cache_slots_, max_packet_size_ + cs::MediaCipher::OVERHEAD);
+
+    CS_LOG(INFO, "UDP: max datagram %zu bytes (packet %zu)", wire_bytes, max_packet_size_);
+}
+
+// ---------------------------------------------------------------------------
+// probePathMtu -- PLPMTUD-style search with viewer acks
+// ---------------------------------------------------------------------------
+
+size_t UdpTransport::probePathMtu(size_t ceiling, int timeout_ms) {
+    if (socket_fd_ < 0) return 0;
+    ceiling = std::clamp(ceiling, MIN_PMTU_SIZE, MAX_PMTU_SIZE);
+
+    setDontFragment();
+
+    std::vector<size_t> candidates;
+    for (size_t size : PMTU_PROBE_SIZES) {
+        if (size < ceiling) candidates.push_back(size);
+    }
+    candidates.push_back(ceiling);
+
+    // Send every candidate at once so the search costs a single round trip.
+    for (int copy = 0; copy < PMTU_PROBE_COPIES; ++copy) {
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            sendProbe(candidates[i], static_cast<uint16_t>(i));
+        }
+    }
+
+    const uint64_t start_us = cs::getTimestampUs();
+    uint64_t deadline_us = start_us + static_cast<uint64_t>(timeout_ms) * 1000;
+    bool got_ack = false;
+    size_t best = 0;
+
+    while (best < ceiling) {
+        uint64_t now_us = cs::getTimestampUs();
+        if (now_us >= deadline_us) break;
+
+        int wait_ms = static_cast<int>((deadline_us - now_us + 999) / 1000);
+        if (!waitReadable(wait_ms)) continue;
+
+        uint8_t buf[64];
+        int n;
+        while ((n = ::recv(socket_fd_, reinterpret_cast<char*>(buf), sizeof(buf), 0)) > 0) {
+            cs::PathProbePacket ack;
+            if (buf[0] != static_cast<uint8_t>(cs::PacketType::PMTU_ACK) ||
+                !cs::PathProbePacket::deserialize(buf, static_cast<size_t>(n), ack)) {
+                continue;   // Nothing else is expected before streaming
+            }
+            best = std::max(best, static_cast<size_t>(ack.probe_size));
+
+            // Probes that fit the path arrive together; once the first ack
+            // is in, allow about one more RTT for the larger ones.
+            if (!got_ack) {
+                got_ack = true;
+                uint64_t rtt_us = cs::getTimestampUs() - start_us;
+                deadline_us = std::min(deadline_us,
+                                       cs::getTimestampUs() + 2 * rtt_us + 10000);
+            }
+        }
+    }
+
+    CS_LOG(INFO, "UDP: path MTU probe -> %zu bytes (ceiling %zu)", best, ceiling);
+    return std::min(best, ceiling);
+}
+
+// ---------------------------------------------------------------------------
+// sendProbe -- one padded PMTU probe
+// ---------------------------------------------------------------------------
+
+bool UdpTransport::sendProbe(size_t wire_size, uint16_t probe_id) {
+    const size_t overhead = cipher_ ? cs::MediaCipher::OVERHEAD : 0;
+    const size_t offset   = cipher_ ? cs::MediaCipher::HEADER_LEN : 0;
+    if (wire_size < overhead + sizeof(cs::PathProbePacket)) return false;
+
+    std::vector<uint8_t> pkt(wire_size, 0);
+    cs::PathProbePacket probe = {};
+    probe.type       = static_cast<uint8_t>(cs::PacketType::PMTU_PROBE);
+    probe.probe_id   = probe_id;
+    probe.probe_size = static_cast<uint16_t>(wire_size);
+    probe.serializeTo(pkt.data() + offset);
+
+    if (cipher_ && cipher_->seal(pkt.data(), wire_size - overhead) != wire_size) {
+        return false;
+    }
+    // EMSGSIZE here just means the local interface MTU is smaller.
+    return sendDatagram(pkt.data(), pkt.size());
+}
+
+// ---------------------------------------------------------------------------
+// setDontFragment
+// ---------------------------------------------------------------------------
+
+void UdpTransport::setDontFragment() {
+#if defined(__linux__)
+    int val = IP_PMTUDISC_PROBE;
+    ::setsockopt(socket_fd_, IPPROTO_IP, IP_MTU_DISCOVER, &val, sizeof(val));
+#elif defined(_WIN32)
+    DWORD val = 1;
+    ::setsockopt(static_cast<SOCKET>(socket_fd_), IPPROTO_IP, IP_DONTFRAGMENT,
+                 reinterpret_cast<const char*>(&val), sizeof(val));
+#elif defined(IP_DONTFRAG)
+    int val = 1;
+    ::setsockopt(socket_fd_, IPPROTO_IP, IP_DONTFRAG, &val, sizeof(val));
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// openWaitHandles / closeWaitHandles
+// ---------------------------------------------------------------------------
+
+void UdpTransport::openWaitHandles() {
+    closeWaitHandles();
+
+#ifdef _WIN32
+    recv_event_ = ::WSACreateEvent();
+    wake_event_ = ::WSACreateEvent();
+    if (recv_event_ != WSA_INVALID_EVENT &&
+        ::WSAEventSelect(static_cast<SOCKET>(socket_fd_), recv_event_, FD_READ) != 0) {
+        CS_LOG(WARN, "UDP: WSAEventSelect failed (error=%d)", cs_socket_error());
+    }
+#elif defined(__linux__)
+    int efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    wake_fds_[0] = efd;
+    wake_fds_[1] = efd;
+#else
+    if (::pipe(wake_fds_) == 0) {
+        for (int fd : wake_fds_) {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    } else {
+        wake_fds_[0] = wake_fds_[1] = -1;
+    }
+#endif
+}
+
+void UdpTransport::closeWaitHandles() {
+#ifdef _WIN32
+    if (recv_event_ != WSA_INVALID_EVENT) {
+        ::WSAEventSelect(static_cast<SOCKET>(socket_fd_), nullptr, 0);
+        ::WSACloseEvent(recv_event_);
+        recv_event_ = WSA_INVALID_EVENT;
+    }
+    if (wake_event_ != WSA_INVALID_EVENT) {
+        ::WSACloseEvent(wake_event_);
+        wake_event_ = WSA_INVALID_EVENT;
+    }
+#else
+    if (wake_fds_[0] >= 0) ::close(wake_fds_[0]);
+    if (wake_fds_[1] >= 0 && wake_fds_[1] != wake_fds_[0]) ::close(wake_fds_[1]);
+    wake_fds_[0] = wake_fds_[1] = -1;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// waitReadable -- block until a datagram is pending or wakeup() is called
+// ---------------------------------------------------------------------------
+
+bool UdpTransport::waitReadable(int timeout_ms) {
+    if (socket_fd_ < 0) return false;
+
+#ifdef _WIN32
+    if (recv_event_ == WSA_INVALID_EVENT || wake_event_ == WSA_INVALID_EVENT) {
+        ::Sleep(1);   // No events: degrade to polling
+        return true;
+    }
+
+    WSAEVENT events[2] = {recv_event_, wake_event_};
+    DWORD r = ::WSAWaitForMultipleEvents(2, events, FALSE,
+                                         static_cast<DWORD>(timeout_ms), FALSE);
+    if (r == WSA_WAIT_EVENT_0) {
+        // Resets the event; FD_READ is re-armed once recv() drains the socket.
+        WSANETWORKEVENTS ne = {};
+        ::WSAEnumNetworkEvents(static_cast<SOCKET>(socket_fd_), recv_event_, &ne);
+        return true;
+    }
+    if (r == WSA_WAIT_EVENT_0 + 1) {
+        ::WSAResetEvent(wake_event_);
+    }
+    return false;
+#else
+    ::pollfd fds[2] = {};
+    fds[0].fd     = socket_fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd     = wake_fds_[0];
+    fds[1].events = POLLIN;
+    ::nfds_t nfds = wake_fds_[0] >= 0 ? 2 : 1;
+
+    int r = ::poll(fds, nfds, timeout_ms);
+    if (r <= 0) return false;
+
+    if (nfds == 2 && (fds[1].revents & POLLIN)) {
+        uint8_t drain[64];
+        while (::read(wake_fds_[0], drain, sizeof(drain)) > 0) {}
+    }
+    return (fds[0].revents & (POLLIN | POLLERR)) != 0;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// wakeup -- interrupt waitReadable()
+// ---------------------------------------------------------------------------
+
+void UdpTransport::wakeup() {
+#ifdef _WIN32
+    if (wake_event_ != WSA_INVALID_EVENT) ::WSASetEvent(wake_event_);
+#else
+    if (wake_fds_[1] >= 0) {
+        uint64_t one = 1;   // eventfd needs 8 bytes; a pipe takes any
+        ssize_t n = ::write(wake_fds_[1], &one, sizeof(one));
+        (void)n;
+    }
+#endif
+}
+
 // ---------------------------------------------------------------------------
 // sendRaw -- encrypt (if DTLS) and send on the UDP socket
 // ---------------------------------------------------------------------------
 
 bool UdpTransport::sendRaw(const uint8_t* data, size_t len) {
-    int sent;
-
+    cs::trace::Scope trace(cs::trace::Stage::PACKET_SEND);
     if (dtls_ && dtls_->isReady()) {
         // DTLS handles encryption and sending via the BIO.
         std::vector<uint8_t> dummy;
@@ -268,28 +1463,190 @@ bool UdpTransport::sendRaw(const uint8_t* data, size_t len) {
     }
 
     // Plaintext send.
-    sent = ::sendto(socket_fd_, reinterpret_cast<const char*>(data), static_cast<int>(len), 0,
-                    reinterpret_cast<const ::sockaddr*>(&peer_addr_), sizeof(peer_addr_));
+    return sendDatagram(data, len);
+}
+
+// ---------------------------------------------------------------------------
+// sendDatagramTo -- one sendto() with no DTLS processing
+// ---------------------------------------------------------------------------
+
+bool UdpTransport::sendDatagramTo(const uint8_t* data, size_t len, const ::sockaddr_in& to) {
+    if (impair_) {
+        // Lost or not, the datagram has left the host as far as we know.
+        const uint64_t now_us = cs::getTimestampUs();
+        impair_->submit(data, len, now_us, &to);
+        bytes_sent_ += len;
+        if (sent_cb_) notifySent(data, len, now_us);
+        return true;
+    }
+
+    int sent = ::sendto(socket_fd_, reinterpret_cast<const char*>(data), static_cast<int>(len), 0,
+                        reinterpret_cast<const ::sockaddr*>(&to), sizeof(to));
     if (sent < 0) {
         CS_LOG(DEBUG, "UDP: sendto failed (error=%d)", cs_socket_error());
         return false;
     }
 
     bytes_sent_ += static_cast<uint64_t>(sent);
+    if (sent_cb_) notifySent(data, len, cs::getTimestampUs());
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// notifySent -- feed transport-wide send times to congestion control
+// ---------------------------------------------------------------------------
+
+void UdpTransport::notifySent(const uint8_t* data, size_t len, uint64_t now_us) const {
+    if (!sent_cb_ || !cs::MediaCipher::isSealed(data, len)) return;
+    uint16_t transport_seq = static_cast<uint16_t>(cs::MediaCipher::packetCounter(data));
+    sent_cb_(transport_seq, len, now_us);
+}
+
+// ---------------------------------------------------------------------------
+// sendSecondaryDatagram -- one sendto() to the secondary path
+// ---------------------------------------------------------------------------
+
+bool UdpTransport::sendSecondaryDatagram(const uint8_t* data, size_t len,
+                                         const ::sockaddr_in& to, int32_t twin_seq,
+                                         bool report) {
+    const uint64_t now_us = cs::getTimestampUs();
+    if (impair_) {
+        impair_->submit(data, len, now_us, &to);
+    } else if (::sendto(socket_fd_, reinterpret_cast<const char*>(data), static_cast<int>(len),
+                        0, reinterpret_cast<const ::sockaddr*>(&to), sizeof(to)) < 0) {
+        CS_LOG(DEBUG, "UDP: secondary sendto failed (error=%d)", cs_socket_error());
+        return false;
+    }
+
+    bytes_sent_ += len;
+    secondary_packets_.fetch_add(1, std::memory_order_relaxed);
+    if (report && path_sent_cb_ && cs::MediaCipher::isSealed(data, len)) {
+        path_sent_cb_(static_cast<uint16_t>(cs::MediaCipher::packetCounter(data)), twin_seq,
+                      len, now_us);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// sendDirect -- send an uncacheable (oversized) packet immediately
+// ---------------------------------------------------------------------------
+
+bool UdpTransport::sendDirect(const uint8_t* data, size_t len) {
+    if (recorder_) recorder_->record(cs::RecordDirection::SENT, data, len);
+    if (!cipher_) return sendRaw(data, len);
+
+    cs::PooledBuffer sealed = cs::BufferPool::shared().acquire(len + cs::MediaCipher::OVERHEAD);
+    if (!sealed) return false;
+    std::memcpy(sealed.data() + cs::MediaCipher::HEADER_LEN, data, len);
+    size_t sealed_len = cipher_->seal(sealed.data(), len);
+    return sealed_len > 0 && sendDatagram(sealed.data(), sealed_len);
+}
+
+// ---------------------------------------------------------------------------
+// resizeCache -- reallocate the slab and reset every cache entry
+// ---------------------------------------------------------------------------
+
+void UdpTransport::resizeCache(size_t slots, size_t slot_size) {
+    slot_size = std::max(slot_size, slab_.slotSize());
+    if (slots != slab_.slotCount() || slot_size != slab_.slotSize()) {
+        slab_.resize(slots, slot_size);
+    }
+    if (slots != cache_slots_) {
+        cache_.reset(new CachedPacket[slots]);
+        cache_slots_ = slots;
+    }
+    for (size_t i = 0; i < slots; ++i) {
+        CachedPacket& entry = cache_[i];
+        entry.version.store(0);
+        entry.retransmit.store(0);
+        entry.data       = slab_.slot(i) + cs::MediaCipher::HEADER_LEN;
+        entry.len        = 0;
+        entry.sealed_len = 0;
+        entry.cached_us  = 0;
+        entry.seq        = 0;
+        entry.valid      = false;
+        entry.droppable  = false;
+    }
+}
+
 // ---------------------------------------------------------------------------
 // cachePacket -- store packet in ring buffer for NACK retransmission
 // ---------------------------------------------------------------------------
 
-void UdpTransport::cachePacket(uint16_t seq, const uint8_t* data, size_t len) {
-    std::lock_guard<std::mutex> lock(cache_mutex_);
-    size_t idx = seq % PACKET_CACHE_SIZE;
-    auto& entry = cache_[idx];
-    entry.seq = seq;
-    entry.data.assign(data, data + len);
+const CachedPacket* UdpTransport::cachePacket(uint16_t seq, const uint8_t* data,
+                                              size_t len, bool droppable, uint64_t now_us) {
+    auto& entry = cache_[seq % cache_slots_];
+    beginWrite(entry);
+    if (len > max_packet_size_) {
+        // Oversized packets are sent but cannot be retransmitted.
+        entry.valid = false;
+        endWrite(entry);
+        return nullptr;
+    }
+
+    if (recorder_) recorder_->record(cs::RecordDirection::SENT, data, len, now_us);
+
+    // Packets built in place via acquireBuffer() are already in the slot.
+    if (data != entry.data) {
+        std::memcpy(entry.data, data, len);
+    }
+    entry.seq        = seq;
+    entry.len        = len;
+    entry.sealed_len = 0;
+    entry.droppable  = droppable;
+    entry.cached_us  = now_us;
+
+    // Seal in place; the header lands in the headroom in front of |data|.
+    if (cipher_) {
+        entry.sealed_len = cipher_->seal(entry.data - cs::MediaCipher::HEADER_LEN, len);
+        if (entry.sealed_len == 0) {
+            entry.valid = false;
+            endWrite(entry);
+            return nullptr;
+        }
+    }
     entry.valid = true;
+    endWrite(entry);
+    return &entry;
+}
+
+// ---------------------------------------------------------------------------
+// claimPacket -- store a packet for a shard to seal
+// ---------------------------------------------------------------------------
+
+CachedPacket* UdpTransport::claimPacket(uint16_t seq, const uint8_t* data,
+                                        size_t len, bool droppable, uint64_t now_us) {
+    auto& entry = cache_[seq % cache_slots_];
+    beginWrite(entry);
+    if (len > max_packet_size_) {
+        entry.valid = false;
+        endWrite(entry);
+        return nullptr;
+    }
+
+    if (recorder_) recorder_->record(cs::RecordDirection::SENT, data, len, now_us);
+
+    if (data != entry.data) {
+        std::memcpy(entry.data, data, len);
+    }
+    entry.seq        = seq;
+    entry.len        = len;
+    entry.sealed_len = 0;
+    entry.droppable  = droppable;
+    entry.cached_us  = now_us;
+    entry.valid      = false;   // Until sealed; the version stays odd until then
+    return &entry;
+}
+
+// ---------------------------------------------------------------------------
+// wireView -- the bytes that go on the wire for a cached packet
+// ---------------------------------------------------------------------------
+
+PacketView UdpTransport::wireView(const CachedPacket& entry) const {
+    if (entry.sealed_len > 0) {
+        return PacketView{entry.data - cs::MediaCipher::HEADER_LEN, entry.sealed_len, entry.seq};
+    }
+    return PacketView{entry.data, entry.len, entry.seq};
 }
 
 } // namespace cs::host
@@ -6,15 +6,57 @@
 // and built by the session manager before handing packets to this layer.
 //
 // Also handles NACK-based retransmission from a ring-buffer packet cache.
+// The cache is a pre-allocated PacketSlab: callers obtain a slot with
+// acquireBuffer() and serialize straight into it, so the steady-state send
+// path performs no heap allocation and no copy beyond the payload itself.
+// It is sized from a retention time and peak bitrate rather than a fixed
+// packet count, and takes no lock: the sending thread is the only writer
+// and every slot is a seqlock, so NACK readers never stall the send path.
+//
+// Optionally, packets pass through a token-bucket Pacer (pacer.h) that
+// spreads each frame over time and keeps audio/control/retransmissions
+// ahead of queued video.
+//
+// Datagrams go to the transport's peer address, not a connected socket's:
+// the viewer's sealed path challenges are answered wherever they come
+// from, and one marked MIGRATE moves the stream to that address in place
+// (make-before-break on the viewer's side), keeping the cache, pacer and
+// sequence spaces.  As in QUIC path validation, the stream stays on the
+// old address until the new one answers a challenge of our own: a sealed
+// packet proves who sent it, not that its source address reaches them.
+//
+// For QoS testing, setImpairment() routes every datagram that bypasses
+// DTLS through a NetworkImpairment (cs/transport/network_impairment.h),
+// which drops, delays, reorders and rate-limits it before it reaches the
+// socket.  setRecorder() writes every packet sent and received, in the
+// clear, to a session recording (cs/transport/packet_recorder.h).
+//
+// setSendShards() spreads sendBatch() over several threads (send_shards.h):
+// the sending thread claims the cache slots and reserves a block of AEAD
+// counters in sequence order, then each shard seals its run of packets
+// with a MediaCipher::SealContext of its own and writes it to the socket,
+// or hands it to the pacer.  sendBatch() still returns only once the whole
+// batch has left, so frames never overlap on the wire.
+//
+// A viewer that keeps a standby path (a second interface) challenges us on
+// it too, without MIGRATE; that address becomes the secondary path while
+// its challenges keep coming.  setMultipathPolicy() then sends chosen
+// packet classes over it as well (a copy sealed with its own counter, so
+// feedback tells the paths apart) or instead (the cached packet itself).
+// The viewer drops whichever copy of a video sequence number comes second.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include <cs/transport/packet.h>
+#include <cs/transport/packet_buffer.h>
+#include <cs/transport/media_cipher.h>
+#include <cs/transport/network_impairment.h>
+#include <cs/transport/packet_recorder.h>
 
 #include <cstdint>
 #include <vector>
-#include <array>
-#include <mutex>
+#include <memory>
+#include <atomic>
 #include <functional>
 
 // Platform socket headers -- must be included before any namespace to avoid
@@ -37,10 +79,20 @@ namespace cs::host {
 // ---------------------------------------------------------------------------
 // Wire-format constants derived from packet.h
 // ---------------------------------------------------------------------------
-constexpr size_t   MAX_MTU_SIZE       = 1400;   // Total UDP payload limit
-constexpr size_t   MAX_VIDEO_PAYLOAD  = MAX_MTU_SIZE - sizeof(cs::VideoPacketHeader);  // 1384
-constexpr size_t   MAX_AUDIO_PAYLOAD  = MAX_MTU_SIZE - sizeof(cs::AudioPacketHeader);  // 1392
-constexpr size_t   PACKET_CACHE_SIZE  = 512;     // Ring buffer size for retransmission
+constexpr size_t   MAX_MTU_SIZE       = 1400;   // Default packet limit (until PMTU is probed)
+constexpr size_t   MIN_PMTU_SIZE      = 1200;   // Smallest datagram PMTU probing settles on
+constexpr size_t   MAX_PMTU_SIZE      = 8972;   // 9000-byte jumbo frame minus IPv4 + UDP
+constexpr size_t   MAX_VIDEO_PAYLOAD  = MAX_MTU_SIZE - sizeof(cs::VideoPacketHeaderV2);  // 1380
+constexpr size_t   MAX_AUDIO_PAYLOAD  = MAX_MTU_SIZE - sizeof(cs::AudioPacketHeader);    // 1392
+constexpr size_t   MAX_BATCH_FRAGMENTS = 255;    // Data packets per sendBatch(); larger frames
+                                                 // are packetized and sent in several batches
+constexpr size_t   PACKET_CACHE_SIZE  = 1024;    // Minimum ring buffer size for retransmission
+                                                 // (> one max-size batch: 255 data + 255 FEC,
+                                                 //  and a divisor of 65536 so seqs wrap cleanly)
+constexpr size_t   MAX_CACHE_SLOTS    = 32768;   // Half the 16-bit sequence space
+constexpr size_t   MAX_CACHE_BYTES    = 32u << 20;   // Slab memory cap (32 MiB)
+constexpr size_t   MAX_BATCH_SEGMENTS = 64;      // Max packets coalesced into one GSO/USO send
+constexpr size_t   MAX_BATCH_BYTES    = 65000;   // Max bytes per GSO/USO super-datagram
 
 // Compile-time checks: ensure packet.h enums have the expected values
 static_assert(static_cast<uint8_t>(cs::PacketType::VIDEO) == 0x10,
@@ -51,18 +103,120 @@ static_assert(static_cast<uint8_t>(cs::PacketType::FEC)   == 0xFC,
               "FEC packet type must be 0xFC");
 static_assert(sizeof(cs::VideoPacketHeader) == 16,
               "VideoPacketHeader must be 16 bytes");
+static_assert(sizeof(cs::VideoPacketHeaderV2) == 20,
+              "VideoPacketHeaderV2 must be 20 bytes");
 static_assert(sizeof(cs::AudioPacketHeader) == 8,
               "AudioPacketHeader must be 8 bytes");
 
 // ---------------------------------------------------------------------------
 // CachedPacket -- stored in the ring buffer for NACK retransmission
+//
+// Written only by the sending thread, read by NACK handling on others.
+// |version| is odd while the writer owns the entry (from acquireBuffer()
+// until the packet is cached); a reader that sees it odd, or changed across
+// its copy, treats the packet as already evicted.
 // ---------------------------------------------------------------------------
 struct CachedPacket {
-    std::vector<uint8_t> data;
-    uint16_t             seq    = 0;
-    bool                 valid  = false;
+    std::atomic<uint32_t> version{0};
+    std::atomic<uint64_t> retransmit{0};   // seq << 48 | last NACK retransmit time (us)
+    uint8_t*  data   = nullptr;   // Points into the transport's PacketSlab
+    size_t    len    = 0;
+    size_t    sealed_len = 0;     // > 0 when sealed in place (starts at data - HEADER_LEN)
+    uint64_t  cached_us = 0;      // When the packet was cached (first send)
+    uint16_t  seq    = 0;
+    bool      valid  = false;
+    bool      droppable = false;  // Never retransmitted (enhancement-layer video)
+};
+
+// ---------------------------------------------------------------------------
+// NackCacheStats -- retransmission cache counters
+// ---------------------------------------------------------------------------
+struct NackCacheStats {
+    uint64_t hits       = 0;   // NACKed packets retransmitted
+    uint64_t misses     = 0;   // NACKed packets already evicted
+    uint64_t expired    = 0;   // NACKed packets older than the retention time
+    uint64_t suppressed = 0;   // Droppable, or within the retransmit holdoff
+    size_t   slots      = 0;
+    size_t   bytes      = 0;   // Slab size
+};
+
+// ---------------------------------------------------------------------------
+// PacketClass / PathUse / MultipathPolicy -- which path a packet takes while
+// the viewer keeps a secondary one
+// ---------------------------------------------------------------------------
+enum class PacketClass : uint8_t {
+    DELTA    = 0,   // Video fragments of other frames
+    KEYFRAME = 1,   // Fragments of keyframes and recovery frames
+    FEC      = 2,   // FEC repair packets
+};
+
+enum class PathUse : uint8_t {
+    PRIMARY   = 0,   // The peer address only
+    BOTH      = 1,   // A copy on the secondary as well
+    SECONDARY = 2,   // The secondary instead (the primary while there is none)
 };
 
+struct MultipathPolicy {
+    PathUse delta      = PathUse::PRIMARY;
+    PathUse keyframe   = PathUse::PRIMARY;
+    PathUse fec        = PathUse::PRIMARY;
+    PathUse retransmit = PathUse::PRIMARY;   // NACK repairs
+
+    PathUse use(PacketClass cls) const {
+        switch (cls) {
+            case PacketClass::KEYFRAME: return keyframe;
+            case PacketClass::FEC:      return fec;
+            default:                    return delta;
+        }
+    }
+    bool enabled() const {
+        return delta != PathUse::PRIMARY || keyframe != PathUse::PRIMARY ||
+               fec != PathUse::PRIMARY || retransmit != PathUse::PRIMARY;
+    }
+
+    /// Keyframes, FEC and repairs on both paths.
+    static MultipathPolicy duplicate() {
+        return {PathUse::PRIMARY, PathUse::BOTH, PathUse::BOTH, PathUse::BOTH};
+    }
+
+    /// Keyframes on both; FEC and repairs on the secondary, so repair
+    /// traffic stays off the path whose loss it repairs.
+    static MultipathPolicy split() {
+        return {PathUse::PRIMARY, PathUse::BOTH, PathUse::SECONDARY, PathUse::SECONDARY};
+    }
+};
+
+// ---------------------------------------------------------------------------
+// PacketView -- non-owning reference to one pre-serialized packet in a batch
+// ---------------------------------------------------------------------------
+struct PacketView {
+    const uint8_t* data = nullptr;
+    size_t         len  = 0;
+    uint16_t       seq  = 0;
+    bool           droppable = false;   // sendBatch(): not worth a NACK retransmit
+    PacketClass    cls  = PacketClass::DELTA;   // sendBatch(): for the multipath policy
+};
+
+// ---------------------------------------------------------------------------
+// PacingLane -- send priority when pacing is enabled (lower value = first)
+//
+// Each class keeps its own sequence space: video and FEC use the cached
+// video sequence (NACKed and retransmitted from the slab), audio and
+// clipboard carry their own sequence numbers in their headers and are sent
+// uncached, so neither can overwrite a video slot.
+// ---------------------------------------------------------------------------
+enum class PacingLane : uint8_t {
+    CONTROL    = 0,   // Input echo and other interactive control traffic
+    AUDIO      = 1,   // Small and latency critical
+    RETRANSMIT = 2,   // NACK repairs -- the viewer is already waiting
+    VIDEO      = 3,   // Video fragments + FEC, released by the token bucket
+    BULK       = 4,   // Clipboard transfers: only bandwidth video leaves unused
+};
+constexpr size_t PACING_LANE_COUNT = 5;
+
+class Pacer;
+class SendShards;
+
 // ---------------------------------------------------------------------------
 // DtlsContext -- thin wrapper around an OpenSSL DTLS session.
 // The session manager sets this up separately; we just use it to encrypt.
@@ -103,6 +257,16 @@ public:
     /// Initialize with an existing connected UDP socket and peer address.
     bool initialize(int socket_fd, const ::sockaddr_in& peer_addr);
 
+    /// Claim the cache slot for |seq| and return a writable view of it
+    /// (maxPacketSize() bytes).  The slot is invalidated until the packet is
+    /// sent with sendPacket()/sendBatch() using the same seq; sending from
+    /// the slot itself skips the cache copy.  The view stays valid until
+    /// |seq| + cacheSlots() is acquired.
+    ///
+    /// acquireBuffer(), sendPacket() and sendBatch() write the cache and
+    /// must all be called from one thread.
+    cs::PacketBuffer acquireBuffer(uint16_t seq);
+
     /// Send a pre-serialized packet (header + payload already built by caller).
     /// The packet is cached by |seq| for NACK retransmission, then sent.
     bool sendPacket(const uint8_t* data, size_t len, uint16_t seq);
@@ -112,13 +276,126 @@ public:
         return sendPacket(pkt.data(), pkt.size(), seq);
     }
 
-    /// Handle NACK: retransmit cached packets by sequence number.
+    /// Send a packet that is not part of the video sequence space (audio,
+    /// clipboard, control).  It is not cached, so it can never overwrite a
+    /// video packet that is being built in, or retransmitted from, the slab.
+    /// |lane| selects its priority when pacing is enabled; BULK packets may
+    /// be dropped if video leaves them no room (their sender retries).
+    bool sendUncached(const uint8_t* data, size_t len,
+                      PacingLane lane = PacingLane::AUDIO);
+
+    /// Convenience: send an uncached packet from a vector.
+    bool sendUncached(const std::vector<uint8_t>& pkt,
+                      PacingLane lane = PacingLane::AUDIO) {
+        return sendUncached(pkt.data(), pkt.size(), lane);
+    }
+
+    /// Send a batch of pre-serialized packets to the peer with as few
+    /// syscalls as possible.  Every packet is cached by its seq first.
+    ///   - Linux:   sendmmsg(), coalescing runs of equal-sized packets into
+    ///              UDP_SEGMENT (GSO) super-datagrams when the kernel supports it.
+    ///   - Windows: WSASendMsg() with UDP_SEND_MSG_SIZE (USO) when available.
+    /// Falls back to one sendto() per packet otherwise (or when DTLS is set).
+    /// Returns true if every packet was handed to the kernel (or, with pacing
+    /// enabled, queued on the VIDEO lane).
+    bool sendBatch(const PacketView* packets, size_t count);
+
+    /// Convenience: send a batch from a vector.
+    bool sendBatch(const std::vector<PacketView>& packets) {
+        return sendBatch(packets.data(), packets.size());
+    }
+
+    /// Handle NACK: retransmit cached packets by sequence number.  A packet
+    /// retransmitted less than the holdoff ago is skipped: the viewer's NACK
+    /// crossed the earlier retransmit in flight.  Packets sent as droppable
+    /// are never retransmitted, nor are packets older than the retention
+    /// time.  Lock-free; may run concurrently with the sending thread.
     void onNackReceived(const std::vector<uint16_t>& seqs);
 
+    /// Size the retransmission cache to hold |retention_ms| of traffic at
+    /// |peak_kbps| (within MAX_CACHE_BYTES), and stop retransmitting packets
+    /// older than that.  Clears the cache, so like setMaxDatagramSize() it
+    /// must be called before streaming starts, after setMaxDatagramSize().
+    void setCacheRetention(uint32_t retention_ms, uint32_t peak_kbps);
+
+    /// Number of packets the retransmission cache holds.
+    size_t cacheSlots() const { return cache_slots_; }
+
+    /// Retransmission cache counters.
+    NackCacheStats getNackCacheStats() const;
+
+    /// Set the retransmit holdoff, normally the smoothed RTT.  0 disables it.
+    void setRetransmitHoldoffUs(uint32_t holdoff_us) { retransmit_holdoff_us_.store(holdoff_us); }
+
+    /// Pace egress at |rate_kbps| with a token bucket of |burst_bytes|.
+    /// A rate of 0 disables pacing: packets are written to the socket as
+    /// soon as they are sent (anything still queued is drained).
+    void setPacingRate(uint32_t rate_kbps, size_t burst_bytes);
+
+    /// Seal and send each sendBatch() on |shards| threads: the calling
+    /// thread and |shards| - 1 workers (1 = the calling thread alone).
+    /// With |own_sockets| (Linux), every worker shard writes to a socket of
+    /// its own, bound to the session's address with SO_REUSEPORT and with
+    /// incoming datagrams steered to the session socket -- only possible
+    /// when the session socket was created with SO_REUSEPORT; otherwise
+    /// the shards share it.  Must be called before streaming starts,
+    /// after setMediaCipher().
+    void setSendShards(size_t shards, bool own_sockets);
+
+    /// Threads a large sendBatch() is spread over (1 = not sharded).
+    size_t sendShards() const;
+
+    /// True while packets are routed through the pacer.
+    bool isPacing() const { return pacing_enabled_.load(); }
+
+    /// Bytes waiting in the pacer ahead of or in the VIDEO lane (0 when
+    /// pacing is off).  BULK traffic yields to video and is not counted.
+    size_t pacerQueuedBytes() const;
+
+    /// Send a bandwidth probe cluster: |bytes| of sealed padding packets
+    /// (PacketType::PADDING, full-sized), paced at |rate_kbps| on top of
+    /// the media and outside the token bucket.  Fills |seqs| with their
+    /// transport-wide sequence numbers.  Needs the media cipher (the
+    /// feedback only reports sealed packets); returns false without it.
+    bool sendProbeCluster(uint32_t rate_kbps, size_t bytes, std::vector<uint16_t>& seqs);
+
+    /// Discover the path MTU PLPMTUD-style (RFC 8899): send padded probes
+    /// with DF set for every candidate size up to |ceiling| wire bytes and
+    /// collect the viewer's acks for up to |timeout_ms|.  Returns the
+    /// largest acknowledged datagram size, or 0 if no probe was acked (e.g.
+    /// a peer that does not answer probes).  Call before streaming starts;
+    /// it reads the socket directly.
+    size_t probePathMtu(size_t ceiling, int timeout_ms);
+
+    /// Set the largest datagram to put on the wire (including AEAD overhead).
+    /// Resizes the packet slab if needed and clears the cache, so it must be
+    /// called before streaming starts (and after setMediaCipher()).
+    void setMaxDatagramSize(size_t wire_bytes);
+
+    /// Largest packet callers may build (whole packet before sealing).
+    size_t maxPacketSize() const { return max_packet_size_; }
+
     /// Set the DTLS context for encryption.  If null, packets are sent in
     /// the clear (useful for testing or when WireGuard already encrypts).
     void setDtlsContext(DtlsContext* ctx) { dtls_ = ctx; }
 
+    /// Set the AEAD media cipher.  When set, video, FEC and audio packets
+    /// are sealed in place in the packet slab and sent with plain sendto()
+    /// instead of through the DTLS record layer; control traffic keeps
+    /// using DTLS.  Must be set before streaming starts.
+    void setMediaCipher(cs::MediaCipher* cipher) { cipher_ = cipher; }
+
+    /// Emulate a bad network on egress (see network_impairment.h).  Datagrams
+    /// sent outside DTLS -- sealed media, FEC, probes, path responses -- are
+    /// handed to the emulator, which writes them to the socket when due; they
+    /// count as sent when handed over.  Must be called before streaming starts.
+    void setImpairment(const cs::ImpairmentConfig& config);
+
+    /// Record every packet sent (as built, before sealing) and received
+    /// (after opening) to |recorder|, which must outlive the transport.
+    /// Retransmissions are not recorded again.  nullptr stops recording.
+    void setRecorder(cs::PacketRecorder* recorder) { recorder_ = recorder; }
+
     /// Get total bytes sent.
     uint64_t totalBytesSent() const { return bytes_sent_; }
 
@@ -127,27 +404,243 @@ public:
     using RecvCallback = std::function<void(const uint8_t* data, size_t len)>;
     void setRecvCallback(RecvCallback cb) { recv_cb_ = std::move(cb); }
 
-    /// Receive and dispatch one incoming packet (non-blocking).
+    /// Callback invoked for every sealed datagram that reaches the socket,
+    /// with the low 16 bits of its AEAD packet counter (the transport-wide
+    /// sequence number), its wire size and the send time.  Called from the
+    /// sending thread, or from send shard workers when sharded; must be
+    /// set before streaming starts.
+    using SentCallback = std::function<void(uint16_t transport_seq, size_t bytes,
+                                            uint64_t send_time_us)>;
+    void setSentCallback(SentCallback cb) { sent_cb_ = std::move(cb); }
+
+    /// Which packet classes use the viewer's secondary path while it has
+    /// one (see MultipathPolicy).  Needs the media cipher.  Must be set
+    /// before streaming starts.
+    void setMultipathPolicy(const MultipathPolicy& policy) { multipath_ = policy; }
+
+    /// Callback invoked for every datagram sent on the secondary path, with
+    /// its transport-wide sequence number, that of the primary copy it
+    /// duplicates (-1 if it went on the secondary alone), its wire size and
+    /// the send time.  Retransmit copies, which reuse the original's
+    /// counter, are not reported.  Must be set before streaming starts.
+    using PathSentCallback = std::function<void(uint16_t transport_seq, int32_t twin_seq,
+                                                size_t bytes, uint64_t send_time_us)>;
+    void setPathSentCallback(PathSentCallback cb) { path_sent_cb_ = std::move(cb); }
+
+    /// True while the viewer's secondary path is alive.
+    bool hasSecondaryPath() const;
+
+    /// Datagrams sent on the secondary path.
+    uint64_t secondaryPackets() const { return secondary_packets_.load(); }
+
+    /// Called (feedback thread) when a MIGRATE path challenge has moved
+    /// the stream to |addr|, once |addr| answered our own challenge.
+    using PathChangeCallback = std::function<void(const ::sockaddr_in& addr)>;
+    void setPathChangeCallback(PathChangeCallback cb) { path_cb_ = std::move(cb); }
+
+    /// Times the viewer has moved the stream to another address.
+    uint64_t pathMigrations() const { return path_migrations_.load(); }
+
+    /// Receive and dispatch one incoming packet (non-blocking).  Sealed
+    /// packets are opened first; path challenges are answered here.
     /// Returns true if a packet was received.
     bool receiveOne();
 
+    /// Block until the socket is readable, wakeup() is called, or
+    /// |timeout_ms| elapses (poll() on an eventfd/pipe pair on POSIX,
+    /// WSAWaitForMultipleEvents on Windows).  Returns true if readable.
+    bool waitReadable(int timeout_ms);
+
+    /// Interrupt a thread blocked in waitReadable() (e.g. on shutdown).
+    void wakeup();
+
 private:
     /// Send a raw buffer (encrypt if DTLS is set, then UDP sendto).
     bool sendRaw(const uint8_t* data, size_t len);
 
-    /// Cache a packet for NACK retransmission.
-    void cachePacket(uint16_t seq, const uint8_t* data, size_t len);
+    /// Write packets to the socket now (DTLS or batched syscalls).
+    bool transmit(const PacketView* packets, size_t count);
+
+    /// Platform batch send (no DTLS).  Returns the number of packets sent.
+    /// |fd| is the socket sendmmsg() writes to on Linux (-1 = socket_fd_);
+    /// other platforms always use socket_fd_.
+    size_t sendBatchRaw(const PacketView* packets, size_t count, int fd = -1);
+
+    /// sendBatch() spread over shards_.
+    bool sendBatchSharded(const PacketView* packets, size_t count);
+
+    /// Open a socket for a worker shard sharing socket_fd_'s address
+    /// (SO_REUSEPORT), or -1 if that is not possible.
+    int openShardSocket();
+
+    /// One sendto() of an already-final datagram (no DTLS).
+    bool sendDatagram(const uint8_t* data, size_t len) {
+        return sendDatagramTo(data, len, peerAddr());
+    }
+    bool sendDatagramTo(const uint8_t* data, size_t len, const ::sockaddr_in& to);
+
+    /// The secondary path's address, if it is alive.
+    bool secondaryPath(::sockaddr_in* addr) const;
+
+    /// Set |packet|, batch entry |index|, aside for the secondary path per
+    /// multipath_, before it is cached (and sealed in place): BOTH seals a
+    /// copy into secondary_arena_.  Returns false if it stays off the
+    /// primary.
+    bool stageSecondary(const PacketView& packet, size_t index);
+
+    /// Send what stageSecondary() set aside for the batch whose cache
+    /// entries are |entries| (in order, nullptr where not cached) to |to|.
+    void sendStaged(const CachedPacket* const* entries, size_t count, const ::sockaddr_in& to);
+
+    /// One datagram to the secondary path at |to|; |twin_seq| as for
+    /// PathSentCallback, and |report| false for retransmit copies.
+    bool sendSecondaryDatagram(const uint8_t* data, size_t len, const ::sockaddr_in& to,
+                               int32_t twin_seq, bool report);
+
+    /// Answer a path challenge that opened, to |from|; validate the
+    /// address of a MIGRATE one.
+    void answerPathChallenge(const uint8_t* data, size_t len, const ::sockaddr_in& from);
+
+    /// Challenge |addr|, the address a MIGRATE challenge came from, at most
+    /// once per VALIDATE_RETRY_US.
+    void validatePath(const ::sockaddr_in& addr, uint64_t now_us);
+
+    /// Move the stream to the validating address if |data| answers one of
+    /// our challenges to it from there.
+    void onPathResponse(const uint8_t* data, size_t len, const ::sockaddr_in& from);
+
+    /// Current peer address, as one atomic load.
+    ::sockaddr_in peerAddr() const;
+    void setPeerAddr(const ::sockaddr_in& addr);
+
+    /// Report |data| to sent_cb_ if it is a sealed datagram.
+    void notifySent(const uint8_t* data, size_t len, uint64_t now_us) const;
+
+    /// Send a packet too large for the cache, sealing it first if needed.
+    bool sendDirect(const uint8_t* data, size_t len);
+
+    /// Store (and seal) into the cache slot for |seq| (sending thread).
+    /// Returns the entry, or nullptr if it cannot be cached.
+    const CachedPacket* cachePacket(uint16_t seq, const uint8_t* data, size_t len,
+                                    bool droppable, uint64_t now_us);
+
+    /// cachePacket() without sealing: the entry is left write-locked for
+    /// the shard that seals it to finish.  Returns nullptr (and leaves the
+    /// entry unlocked) if it cannot be cached.
+    CachedPacket* claimPacket(uint16_t seq, const uint8_t* data, size_t len,
+                              bool droppable, uint64_t now_us);
+
+    /// Reallocate the slab as |slots| slots of |slot_size| bytes and reset
+    /// every entry (streaming must be stopped).
+    void resizeCache(size_t slots, size_t slot_size);
+
+    /// The bytes that go on the wire for a cached packet.
+    PacketView wireView(const CachedPacket& entry) const;
+
+    /// Probe whether the socket supports UDP segmentation offload.
+    void detectSegmentationOffload();
+
+    /// Send one PMTU probe padded (and sealed) to exactly |wire_size| bytes.
+    bool sendProbe(size_t wire_size, uint16_t probe_id);
+
+    /// Set DF on outgoing datagrams without the kernel clamping to its
+    /// cached path MTU (IP_PMTUDISC_PROBE / IP_DONTFRAGMENT).
+    void setDontFragment();
+
+    /// Create / destroy the readiness wait primitives for socket_fd_.
+    void openWaitHandles();
+    void closeWaitHandles();
 
     int                 socket_fd_  = -1;
-    ::sockaddr_in       peer_addr_  = {};
+    std::atomic<uint64_t> peer_{0};         // sin_addr << 16 | sin_port, network order
     DtlsContext*        dtls_       = nullptr;
-    uint64_t            bytes_sent_ = 0;
+    cs::MediaCipher*    cipher_     = nullptr;
+    std::atomic<uint64_t> bytes_sent_{0};         // Shards add to it concurrently
+    std::atomic<bool>   gso_supported_{false};    // UDP_SEGMENT / UDP_SEND_MSG_SIZE
+    size_t              max_packet_size_ = MAX_MTU_SIZE;
+
+    // Receive readiness (waitReadable / wakeup)
+#ifdef _WIN32
+    WSAEVENT            recv_event_ = WSA_INVALID_EVENT;   // FD_READ on socket_fd_
+    WSAEVENT            wake_event_ = WSA_INVALID_EVENT;   // Signalled by wakeup()
+#else
+    int                 wake_fds_[2] = {-1, -1};   // eventfd (both ends) or pipe
+#endif
+
+    // Ring buffer for NACK retransmission; entry data lives in slab_, after
+    // HEADER_LEN bytes of headroom so packets can be sealed in place.  The
+    // slot count is a power of two, so seq % cache_slots_ wraps cleanly.
+    cs::PacketSlab                               slab_;
+    std::unique_ptr<CachedPacket[]>              cache_;
+    size_t                                       cache_slots_  = PACKET_CACHE_SIZE;
+    uint64_t                                     retention_us_ = 0;   // 0 = no age limit
+    std::atomic<uint32_t>                        retransmit_holdoff_us_{0};
 
-    // Ring buffer for NACK retransmission.
-    std::array<CachedPacket, PACKET_CACHE_SIZE> cache_;
-    std::mutex                                   cache_mutex_;
+    // NACK cache counters (onNackReceived)
+    std::atomic<uint64_t>                        nack_hits_{0};
+    std::atomic<uint64_t>                        nack_misses_{0};
+    std::atomic<uint64_t>                        nack_expired_{0};
+    std::atomic<uint64_t>                        nack_suppressed_{0};
+
+    // Optional egress pacing (created on first setPacingRate with rate > 0).
+    std::unique_ptr<Pacer>  pacer_;
+    std::atomic<bool>       pacing_enabled_{false};
+    std::vector<PacketView> wire_views_;    // sendBatch scratch (sender thread)
+
+    // Optional sharded sending (setSendShards).  Shard k seals with
+    // shard_state_[k].sealer and writes to its fd; shard 0 runs on the
+    // sending thread.
+    struct ShardState {
+        std::unique_ptr<cs::MediaCipher::SealContext> sealer;
+        int    socket_fd = -1;      // Own SO_REUSEPORT socket, or -1 = socket_fd_
+        size_t begin     = 0;       // This batch's views: wire_views_[begin, begin + count)
+        size_t count     = 0;
+        bool   ok        = true;
+    };
+    std::unique_ptr<SendShards>  shards_;
+    std::vector<ShardState>      shard_state_;
+    std::vector<CachedPacket*>   shard_entries_;   // sendBatchSharded scratch
+    cs::MediaCipher*             shard_cipher_ = nullptr;   // The sealers' cipher
+    std::vector<uint8_t>         shard_primary_;   // Per claimed entry: sent on the primary
+
+    // Multipath (setMultipathPolicy).  The secondary is packed like peer_
+    // (0 = none) and alive until SECONDARY_TIMEOUT_US after its last
+    // challenge.  Per batch, the staged copies are kept in order (sender
+    // thread); a copy with len 0 is the cached packet, moved off the primary.
+    struct StagedCopy {
+        size_t index  = 0;   // In the batch
+        size_t offset = 0;   // Sealed copy in secondary_arena_
+        size_t len    = 0;
+    };
+    MultipathPolicy              multipath_;
+    std::atomic<uint64_t>        secondary_{0};
+    std::atomic<uint64_t>        secondary_seen_us_{0};
+    std::atomic<uint64_t>        secondary_packets_{0};
+    std::vector<StagedCopy>      staged_;
+    std::vector<uint8_t>         secondary_arena_;
+    std::vector<const CachedPacket*> batch_entries_;   // sendBatch scratch
+    static constexpr uint64_t SECONDARY_TIMEOUT_US = 3'000'000;   // Three missed challenges
+
+    // Optional network emulation (setImpairment), ahead of the socket.
+    std::unique_ptr<cs::NetworkImpairment> impair_;
+
+    cs::PacketRecorder* recorder_ = nullptr;   // Session recording (setRecorder)
 
     RecvCallback        recv_cb_;
+    SentCallback        sent_cb_;
+    PathSentCallback    path_sent_cb_;
+    PathChangeCallback  path_cb_;
+    std::atomic<uint64_t> path_migrations_{0};
+
+    // Path validation (feedback thread).  validating_ is packed like peer_
+    // (0 = none) and given up VALIDATE_TIMEOUT_US after it was first asked.
+    uint64_t validating_           = 0;
+    uint64_t validating_since_us_  = 0;
+    uint64_t validate_first_nonce_ = 0;   // Of the first challenge sent to it
+    uint64_t validate_nonce_       = 0;   // Of the last one
+    uint64_t validate_sent_us_     = 0;
+    static constexpr uint64_t VALIDATE_RETRY_US   = 100'000;     // As the viewer's MIGRATE retries
+    static constexpr uint64_t VALIDATE_TIMEOUT_US = 3'000'000;
 };
 
 } // namespace cs::host
@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////////
+// fec_decoder_bench.cpp -- FEC group receive and recovery
+//
+// Each iteration delivers one group of Arg(0) MTU-sized video packets with
+// the host's default 20% parity.  Arg(1) data packets are lost before the
+// parity arrives, so the decoder rebuilds that many (0 measures the cost
+// of parity that turns out not to be needed).  Each group's packets and
+// parity are built with the timer paused.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "transport/fec_decoder.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr size_t PAYLOAD_LEN = 1180;
+
+void BM_FecDecoderGroup(benchmark::State& state) {
+    const size_t k    = static_cast<size_t>(state.range(0));
+    const size_t m    = (k + 4) / 5;
+    const size_t lost = static_cast<size_t>(state.range(1));
+    if (lost > m) {
+        state.SkipWithError("more losses than parity");
+        return;
+    }
+
+    cs::FecDecoder decoder;
+    uint64_t recovered = 0;
+    decoder.setRecoveryCallback([&recovered](const uint8_t*, size_t) { ++recovered; });
+
+    const size_t symbol = sizeof(cs::VideoPacketHeaderV2) + PAYLOAD_LEN;
+    std::vector<std::vector<uint8_t>> data(k, std::vector<uint8_t>(symbol, 0x6D));
+    std::vector<std::vector<uint8_t>> fec(m, std::vector<uint8_t>(sizeof(cs::FecPacketHeader) + symbol));
+    std::vector<const uint8_t*> data_ptrs;
+    std::vector<size_t>         data_lens(k, symbol);
+    std::vector<uint8_t*>       parity_ptrs;
+    for (auto& d : data) data_ptrs.push_back(d.data());
+    for (auto& p : fec) parity_ptrs.push_back(p.data() + sizeof(cs::FecPacketHeader));
+
+    cs::VideoPacketHeaderV2 vh{};
+    vh.setVersion(2);
+    vh.codec          = 1;
+    vh.fragment_total = static_cast<uint16_t>(k);
+    vh.payload_length = PAYLOAD_LEN;
+
+    cs::FecPacketHeader fh{};
+    fh.type          = static_cast<uint8_t>(cs::PacketType::FEC);
+    fh.data_count    = static_cast<uint8_t>(k);
+    fh.parity_count  = static_cast<uint8_t>(m);
+    fh.symbol_length = static_cast<uint16_t>(symbol);
+
+    uint16_t base  = 0;
+    uint8_t  group = 0;
+    uint32_t frame = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (size_t i = 0; i < k; ++i) {
+            vh.sequence_number = static_cast<uint16_t>(base + i);
+            vh.frame_number    = frame;
+            vh.fragment_index  = static_cast<uint16_t>(i);
+            vh.serializeTo(data[i].data());
+        }
+        cs::ErasureCode::encode(data_ptrs.data(), data_lens.data(), k,
+                                parity_ptrs.data(), m, symbol);
+        fh.group_id      = group;
+        fh.frame_number  = static_cast<uint16_t>(frame);
+        fh.base_sequence = base;
+        for (size_t j = 0; j < m; ++j) {
+            fh.sequence_number = static_cast<uint16_t>(base + k + j);
+            fh.parity_index    = static_cast<uint8_t>(j);
+            fh.serializeTo(fec[j].data());
+        }
+        state.ResumeTiming();
+
+        for (size_t i = lost; i < k; ++i) {
+            decoder.onVideoPacket(static_cast<uint16_t>(base + i), data[i].data(), symbol);
+        }
+        for (size_t j = 0; j < m; ++j) {
+            decoder.onFecPacket(fec[j].data(), fec[j].size());
+        }
+
+        base = static_cast<uint16_t>(base + k + m);
+        ++group;
+        ++frame;
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * (k + m)));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * k * symbol));
+    state.counters["recovered_per_group"] =
+        state.iterations() ? static_cast<double>(recovered) / state.iterations() : 0.0;
+}
+BENCHMARK(BM_FecDecoderGroup)
+    ->Args({5, 0})->Args({5, 1})
+    ->Args({10, 2})
+    ->Args({20, 1})->Args({20, 4})
+    ->Args({40, 8});
+
+} // namespace
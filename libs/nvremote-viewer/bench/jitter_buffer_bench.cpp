@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+// jitter_buffer_bench.cpp -- Frame reassembly under reorder and loss
+//
+// Each iteration pushes the fragments of two consecutive frames and pops
+// every frame that completes, in immediate-release mode (the playout
+// clock is not what is measured).  Arg(0) picks the arrival pattern:
+//   0  in order
+//   1  reordered: adjacent fragments swapped, the two frames interleaved
+//   2  loss repaired late: one fragment of the first frame arrives after
+//      the whole second frame, as its retransmit would
+// Arg(1) is the fragment count per frame.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "transport/jitter_buffer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr size_t FRAGMENT_LEN = 1180;
+
+enum Pattern { IN_ORDER = 0, REORDERED = 1, LOSS_REPAIRED = 2 };
+
+struct Fragment {
+    uint32_t frame;
+    uint16_t index;
+};
+
+std::vector<Fragment> schedule(Pattern pattern, uint16_t fragments) {
+    std::vector<Fragment> order;
+    for (uint32_t f = 0; f < 2; ++f) {
+        for (uint16_t i = 0; i < fragments; ++i) order.push_back({f, i});
+    }
+    switch (pattern) {
+        case IN_ORDER:
+            break;
+        case REORDERED:
+            for (size_t i = 0; i + 1 < order.size(); i += 2) std::swap(order[i], order[i + 1]);
+            for (size_t i = 1; i + fragments < order.size(); i += 4) {
+                std::swap(order[i], order[i + fragments]);
+            }
+            break;
+        case LOSS_REPAIRED: {
+            const Fragment lost = order[fragments / 2];
+            order.erase(order.begin() + fragments / 2);
+            order.push_back(lost);
+            break;
+        }
+    }
+    return order;
+}
+
+void BM_JitterBufferPushPop(benchmark::State& state) {
+    const auto     pattern   = static_cast<Pattern>(state.range(0));
+    const uint16_t fragments = static_cast<uint16_t>(state.range(1));
+    const std::vector<Fragment> order = schedule(pattern, fragments);
+    const std::vector<uint8_t>  payload(FRAGMENT_LEN, 0x3C);
+
+    cs::JitterBuffer jb;
+    jb.setImmediateRelease(true);
+
+    cs::VideoPacketHeaderV2 h{};
+    h.setVersion(2);
+    h.codec          = 1;
+    h.fragment_total = fragments;
+    h.payload_length = FRAGMENT_LEN;
+
+    uint32_t base_frame = 0;
+    uint16_t seq = 0;
+    uint64_t popped = 0;
+    cs::JitterBuffer::FrameView view;
+    cs::VideoPacketHeaderV2 out;
+
+    for (auto _ : state) {
+        for (const Fragment& frag : order) {
+            h.frame_number    = base_frame + frag.frame;
+            h.fragment_index  = frag.index;
+            h.sequence_number = seq++;
+            h.timestamp_us    = h.frame_number * 16667u;
+            h.setKeyframe(h.frame_number == 0);
+            jb.pushPacket(h, payload.data(), payload.size());
+        }
+        while (jb.popFrame(view, out)) {
+            benchmark::DoNotOptimize(view.data);
+            ++popped;
+        }
+        base_frame += 2;
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * 2));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * order.size() * FRAGMENT_LEN));
+    state.counters["popped_per_iter"] =
+        state.iterations() ? static_cast<double>(popped) / state.iterations() : 0.0;
+}
+BENCHMARK(BM_JitterBufferPushPop)
+    ->ArgsProduct({{IN_ORDER, REORDERED, LOSS_REPAIRED}, {4, 16, 64}});
+
+} // namespace
@@ -0,0 +1,66 @@
+///////////////////////////////////////////////////////////////////////////////
+// nack_sender_bench.cpp -- Loss tracking and gap detection
+//
+// One iteration is one 5 ms timer tick: Arg(0) packets arrive (the loss
+// rate in Arg(1), per mille, are missing; each comes back 32 packets
+// later, as a retransmit would), then checkForGaps() scans the window.
+// No socket is attached, so the scan runs in full but nothing is sent.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "transport/nack_sender.h"
+
+#include <cs/common.h>
+
+#include <benchmark/benchmark.h>
+
+#include <deque>
+
+namespace {
+
+constexpr uint16_t RETRANSMIT_DELAY = 32;
+
+void BM_NackTick(benchmark::State& state) {
+    const int64_t  per_tick  = state.range(0);
+    const uint32_t loss_pmil = static_cast<uint32_t>(state.range(1));
+
+    cs::globalLogLevel() = cs::LogLevel::WARN;
+    cs::NackSender nack;
+    nack.setRtt(20'000, 5'000);
+
+    uint16_t seq  = 0;
+    uint32_t rng  = 0xBEEFu;
+    std::deque<uint16_t> lost;
+
+    for (auto _ : state) {
+        for (int64_t i = 0; i < per_tick; ++i, ++seq) {
+            rng = rng * 1664525u + 1013904223u;
+            if ((rng >> 8) % 1000 < loss_pmil) {
+                lost.push_back(seq);
+            } else {
+                nack.onPacketReceived(seq);
+            }
+            if (!lost.empty() && static_cast<uint16_t>(seq - lost.front()) >= RETRANSMIT_DELAY) {
+                nack.onPacketReceived(lost.front());
+                lost.pop_front();
+            }
+        }
+        nack.checkForGaps();
+    }
+    state.SetItemsProcessed(state.iterations() * per_tick);
+}
+BENCHMARK(BM_NackTick)->ArgsProduct({{16, 64, 256}, {0, 10, 50}});
+
+void BM_NackOnPacketReceived(benchmark::State& state) {
+    cs::globalLogLevel() = cs::LogLevel::WARN;
+    cs::NackSender nack;
+    uint16_t seq = 0;
+    for (auto _ : state) {
+        nack.onPacketReceived(seq);
+        // Every 64th packet skips one sequence: a gap opens in the window
+        seq = static_cast<uint16_t>(seq + ((seq & 63) == 63 ? 2 : 1));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_NackOnPacketReceived);
+
+} // namespace
@@ -3,7 +3,8 @@
 //
 // Exports the following JavaScript API:
 //
-//   viewer.start({ sessionId, codec, windowHandle, ... })
+//   viewer.start({ sessionId, codec, windowHandle, displayWindows, ... })
+//                         -> Promise<{ rendererMs, decoderMs, ..., totalMs }>
 //   viewer.stop()
 //   viewer.getStats()  -> { bitrate, fps, packetLoss, ... }
 //   viewer.onDisconnect(callback)
@@ -12,6 +13,9 @@
 //   viewer.addRemoteCandidate({ type, ip, port, priority })
 //   viewer.connectP2P({ dtlsFingerprint: 'AA:BB:CC...' })
 //   viewer.disconnectP2P()
+//   viewer.dumpTrace('trace.json')  -> events written (no path: the JSON)
+//   viewer.statsBuffer()  -> ArrayBuffer the viewer writes stats and
+//                            per-frame timings into (qos/stats_ring.h)
 //
 // Uses Napi::ThreadSafeFunction for async callbacks from C++ threads
 // back to the JavaScript event loop.
@@ -22,7 +26,9 @@
 #include <string>
 
 #include "viewer.h"
+#include "qos/stats_ring.h"
 #include <cs/common.h>
+#include <cs/trace.h>
 
 namespace {
 
@@ -32,6 +38,9 @@ namespace {
 static std::unique_ptr<cs::Viewer> g_viewer;
 static Napi::ThreadSafeFunction g_disconnect_tsfn;
 static Napi::ThreadSafeFunction g_stats_tsfn;
+static bool g_starting = false;   // A StartWorker is queued (JS thread only)
+static Napi::Reference<Napi::ArrayBuffer> g_stats_buffer;   // Backs g_stats_ring
+static cs::StatsRing g_stats_ring;
 static cs::WinsockGuard g_winsock;
 
 // ---------------------------------------------------------------------------
@@ -55,19 +64,102 @@ static cs::QualityPreset parseQuality(const std::string& s) {
 }
 
 // ---------------------------------------------------------------------------
-// viewer.start(config)
+// Helper: parse AudioOutputMode from string
 // ---------------------------------------------------------------------------
+static cs::AudioOutputMode parseAudioMode(const std::string& s) {
+    if (s == "shared")      return cs::AudioOutputMode::SHARED;
+    if (s == "low_latency") return cs::AudioOutputMode::LOW_LATENCY;
+    if (s == "exclusive")   return cs::AudioOutputMode::EXCLUSIVE;
+    return cs::AudioOutputMode::LOW_LATENCY;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: parse UpscaleMode from string
+// ---------------------------------------------------------------------------
+static cs::UpscaleMode parseUpscaleMode(const std::string& s) {
+    if (s == "auto")   return cs::UpscaleMode::AUTO;
+    if (s == "off")    return cs::UpscaleMode::OFF;
+    if (s == "shader") return cs::UpscaleMode::SHADER;
+    return cs::UpscaleMode::AUTO;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: native window handle from a Buffer holding the pointer or a number
+// ---------------------------------------------------------------------------
+static void* parseWindowHandle(const Napi::Value& wh) {
+    void* ptr = nullptr;
+    if (wh.IsBuffer()) {
+        // Buffer containing a pointer-sized integer
+        auto buf = wh.As<Napi::Buffer<uint8_t>>();
+        if (buf.Length() >= sizeof(void*)) {
+            std::memcpy(&ptr, buf.Data(), sizeof(void*));
+        }
+    } else if (wh.IsNumber()) {
+        // Direct integer HWND value
+        auto val = wh.As<Napi::Number>().Int64Value();
+        ptr = reinterpret_cast<void*>(static_cast<intptr_t>(val));
+    }
+    return ptr;
+}
+
+// ---------------------------------------------------------------------------
+// viewer.start(config) -> Promise<timing>
+// Device init and the DTLS handshake run on a worker thread; the promise
+// resolves with the time each phase took once the pipeline is running.
+// ---------------------------------------------------------------------------
+class StartWorker : public Napi::AsyncWorker {
+public:
+    StartWorker(Napi::Env env, Napi::Promise::Deferred deferred,
+                cs::ViewerConfig config)
+        : Napi::AsyncWorker(env)
+        , deferred_(deferred)
+        , config_(std::move(config))
+    {}
+
+    void Execute() override {
+        if (!g_viewer->start(config_)) {
+            SetError("Failed to start viewer session");
+            return;
+        }
+        timing_ = g_viewer->getStartTiming();
+    }
+
+    void OnOK() override {
+        g_starting = false;
+        Napi::Env env = Env();
+        Napi::Object obj = Napi::Object::New(env);
+        obj.Set("rendererMs",  Napi::Number::New(env, timing_.renderer_ms));
+        obj.Set("decoderMs",   Napi::Number::New(env, timing_.decoder_ms));
+        obj.Set("audioMs",     Napi::Number::New(env, timing_.audio_ms));
+        obj.Set("transportMs", Napi::Number::New(env, timing_.transport_ms));
+        obj.Set("inputMs",     Napi::Number::New(env, timing_.input_ms));
+        obj.Set("totalMs",     Napi::Number::New(env, timing_.total_ms));
+        deferred_.Resolve(obj);
+    }
+
+    void OnError(const Napi::Error& err) override {
+        g_starting = false;
+        deferred_.Reject(err.Value());
+    }
+
+private:
+    Napi::Promise::Deferred deferred_;
+    cs::ViewerConfig config_;
+    cs::StartTiming timing_;
+};
+
 Napi::Value Start(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
+    auto deferred = Napi::Promise::Deferred::New(env);
 
     if (info.Length() < 1 || !info[0].IsObject()) {
-        Napi::TypeError::New(env, "Expected config object").ThrowAsJavaScriptException();
-        return env.Undefined();
+        deferred.Reject(Napi::TypeError::New(env, "Expected config object").Value());
+        return deferred.Promise();
     }
 
-    if (g_viewer && g_viewer->isRunning()) {
-        Napi::Error::New(env, "Viewer is already running. Call stop() first.").ThrowAsJavaScriptException();
-        return env.Undefined();
+    if (g_starting || (g_viewer && g_viewer->isRunning())) {
+        deferred.Reject(Napi::Error::New(env, "Viewer is already running. Call stop() first.").Value());
+        return deferred.Promise();
     }
 
     Napi::Object opts = info[0].As<Napi::Object>();
@@ -86,22 +178,24 @@ Napi::Value Start(const Napi::CallbackInfo& info) {
 
     // Window handle: Electron passes an ArrayBuffer containing the native HWND
     if (opts.Has("windowHandle")) {
-        Napi::Value wh = opts.Get("windowHandle");
-        if (wh.IsBuffer()) {
-            // Buffer containing a pointer-sized integer
-            auto buf = wh.As<Napi::Buffer<uint8_t>>();
-            if (buf.Length() >= sizeof(void*)) {
-                void* ptr = nullptr;
-                std::memcpy(&ptr, buf.Data(), sizeof(void*));
+        void* window = parseWindowHandle(opts.Get("windowHandle"));
 #ifdef _WIN32
-                config.window_handle = reinterpret_cast<HWND>(ptr);
+        config.window_handle = reinterpret_cast<HWND>(window);
+#else
+        (void)window;
 #endif
-            }
-        } else if (wh.IsNumber()) {
-            // Direct integer HWND value
-            auto val = wh.As<Napi::Number>().Int64Value();
+    }
+
+    // Windows for the host's extra displays, display 1 first
+    if (opts.Has("displayWindows") && opts.Get("displayWindows").IsArray()) {
+        Napi::Array arr = opts.Get("displayWindows").As<Napi::Array>();
+        for (uint32_t i = 0; i < arr.Length(); ++i) {
+            void* window = parseWindowHandle(arr.Get(i));
+            if (!window) continue;
 #ifdef _WIN32
-            config.window_handle = reinterpret_cast<HWND>(static_cast<intptr_t>(val));
+            config.display_windows.push_back(reinterpret_cast<HWND>(window));
+#else
+            config.display_windows.push_back(window);
 #endif
         }
     }
@@ -122,22 +216,44 @@ Napi::Value Start(const Napi::CallbackInfo& info) {
     if (opts.Has("dtlsFingerprint") && opts.Get("dtlsFingerprint").IsString()) {
         config.dtls_fingerprint = opts.Get("dtlsFingerprint").As<Napi::String>().Utf8Value();
     }
+    if (opts.Has("recvBufferKb") && opts.Get("recvBufferKb").IsNumber()) {
+        config.recv_buffer_kb = opts.Get("recvBufferKb").As<Napi::Number>().Uint32Value();
+    }
+    if (opts.Has("decodeDepth") && opts.Get("decodeDepth").IsNumber()) {
+        config.decode_depth = opts.Get("decodeDepth").As<Napi::Number>().Uint32Value();
+    }
+    if (opts.Has("audioMode") && opts.Get("audioMode").IsString()) {
+        config.audio_mode = parseAudioMode(opts.Get("audioMode").As<Napi::String>().Utf8Value());
+    }
     if (opts.Has("quality") && opts.Get("quality").IsString()) {
         config.quality = parseQuality(opts.Get("quality").As<Napi::String>().Utf8Value());
     }
+    if (opts.Has("upscale") && opts.Get("upscale").IsString()) {
+        config.upscale_mode = parseUpscaleMode(opts.Get("upscale").As<Napi::String>().Utf8Value());
+    }
+    if (opts.Has("impairment") && opts.Get("impairment").IsString()) {
+        config.impairment = opts.Get("impairment").As<Napi::String>().Utf8Value();
+    }
+    if (opts.Has("recordPath") && opts.Get("recordPath").IsString()) {
+        config.record_path = opts.Get("recordPath").As<Napi::String>().Utf8Value();
+    }
+    if (opts.Has("threads") && opts.Get("threads").IsString()) {
+        config.threads = opts.Get("threads").As<Napi::String>().Utf8Value();
+    }
 
     // Create viewer if needed
     if (!g_viewer) {
         g_viewer = std::make_unique<cs::Viewer>();
+        if (g_stats_ring.attached()) {
+            g_viewer->setStatsRing(&g_stats_ring);
+        }
     }
 
-    bool ok = g_viewer->start(config);
-    if (!ok) {
-        Napi::Error::New(env, "Failed to start viewer session").ThrowAsJavaScriptException();
-        return env.Undefined();
-    }
+    g_starting = true;
+    auto* worker = new StartWorker(env, deferred, std::move(config));
+    worker->Queue();
 
-    return Napi::Boolean::New(env, true);
+    return deferred.Promise();
 }
 
 // ---------------------------------------------------------------------------
@@ -180,6 +296,12 @@ Napi::Value GetStats(const Napi::CallbackInfo& info) {
     obj.Set("fps",            Napi::Number::New(env, stats.fps));
     obj.Set("packetLoss",     Napi::Number::New(env, stats.packet_loss));
     obj.Set("jitter",         Napi::Number::New(env, stats.jitter_ms));
+    obj.Set("jitterP50Ms",    Napi::Number::New(env, stats.jitter_p50_ms));
+    obj.Set("jitterP95Ms",    Napi::Number::New(env, stats.jitter_p95_ms));
+    obj.Set("jitterP99Ms",    Napi::Number::New(env, stats.jitter_p99_ms));
+    obj.Set("frameGapP50Ms",  Napi::Number::New(env, stats.frame_gap_p50_ms));
+    obj.Set("frameGapP95Ms",  Napi::Number::New(env, stats.frame_gap_p95_ms));
+    obj.Set("frameGapP99Ms",  Napi::Number::New(env, stats.frame_gap_p99_ms));
     obj.Set("rtt",            Napi::Number::New(env, stats.rtt_ms));
     obj.Set("codec",          Napi::String::New(env, stats.codec));
     obj.Set("resolution",     Napi::String::New(env,
@@ -187,12 +309,83 @@ Napi::Value GetStats(const Napi::CallbackInfo& info) {
     obj.Set("connectionType", Napi::String::New(env, stats.connection_type));
     obj.Set("decodeTimeMs",   Napi::Number::New(env, stats.decode_time_ms));
     obj.Set("renderTimeMs",   Napi::Number::New(env, stats.render_time_ms));
+    obj.Set("decodeTimeP50Ms", Napi::Number::New(env, stats.decode_time_p50_ms));
+    obj.Set("decodeTimeP95Ms", Napi::Number::New(env, stats.decode_time_p95_ms));
+    obj.Set("decodeTimeP99Ms", Napi::Number::New(env, stats.decode_time_p99_ms));
+    obj.Set("renderTimeP50Ms", Napi::Number::New(env, stats.render_time_p50_ms));
+    obj.Set("renderTimeP95Ms", Napi::Number::New(env, stats.render_time_p95_ms));
+    obj.Set("renderTimeP99Ms", Napi::Number::New(env, stats.render_time_p99_ms));
+    obj.Set("presentLatencyMs", Napi::Number::New(env, stats.present_latency_ms));
+    obj.Set("presentToPhotonMs", Napi::Number::New(env, stats.present_to_photon_ms));
+    obj.Set("upscaler",       Napi::String::New(env, stats.upscaler));
+    obj.Set("decoderReconfigs", Napi::Number::New(env, stats.decoder_reconfigs));
+    obj.Set("decoderReconfigMs", Napi::Number::New(env, stats.decoder_reconfig_ms));
+    obj.Set("decoderReconfigMaxMs", Napi::Number::New(env, stats.decoder_reconfig_max_ms));
+    obj.Set("renderDroppedFrames", Napi::Number::New(env, static_cast<double>(stats.render_dropped)));
+    obj.Set("pathMigrations", Napi::Number::New(env, static_cast<double>(stats.path_migrations)));
+    obj.Set("duplicatePackets", Napi::Number::New(env, static_cast<double>(stats.duplicate_packets)));
+    obj.Set("audioOutputLatencyMs", Napi::Number::New(env, stats.audio_output_latency_ms));
+    obj.Set("audioBufferMs",  Napi::Number::New(env, stats.audio_buffer_ms));
+    obj.Set("audioFecRecovered", Napi::Number::New(env, static_cast<double>(stats.audio_fec_recovered)));
+    obj.Set("audioConcealed", Napi::Number::New(env, static_cast<double>(stats.audio_concealed)));
+    obj.Set("audioUnderruns", Napi::Number::New(env, static_cast<double>(stats.audio_underruns)));
+    obj.Set("avOffsetMs",     Napi::Number::New(env, stats.av_offset_ms));
+    obj.Set("avAudioDelayMs", Napi::Number::New(env, stats.av_audio_delay_ms));
+    obj.Set("avVideoDelayMs", Napi::Number::New(env, stats.av_video_delay_ms));
+    obj.Set("clockSynced",    Napi::Boolean::New(env, stats.clock_synced));
+    obj.Set("clockErrorMs",   Napi::Number::New(env, stats.clock_error_ms));
+    obj.Set("firstPacketP50Ms",   Napi::Number::New(env, stats.first_packet_p50_ms));
+    obj.Set("firstPacketP99Ms",   Napi::Number::New(env, stats.first_packet_p99_ms));
+    obj.Set("frameCompleteP50Ms", Napi::Number::New(env, stats.frame_complete_p50_ms));
+    obj.Set("frameCompleteP99Ms", Napi::Number::New(env, stats.frame_complete_p99_ms));
+    obj.Set("glassToGlassP50Ms",  Napi::Number::New(env, stats.glass_to_glass_p50_ms));
+    obj.Set("glassToGlassP99Ms",  Napi::Number::New(env, stats.glass_to_glass_p99_ms));
+    obj.Set("inputToPhotonP50Ms", Napi::Number::New(env, stats.input_to_photon_p50_ms));
+    obj.Set("inputToPhotonP99Ms", Napi::Number::New(env, stats.input_to_photon_p99_ms));
     obj.Set("framesDecoded",  Napi::Number::New(env, static_cast<double>(stats.frames_decoded)));
     obj.Set("framesDropped",  Napi::Number::New(env, static_cast<double>(stats.frames_dropped)));
+    obj.Set("fecRecovered",   Napi::Number::New(env, static_cast<double>(stats.fec_recovered)));
+    obj.Set("fecUnrecoverable", Napi::Number::New(env, static_cast<double>(stats.fec_unrecoverable)));
+    obj.Set("jitterBufferMs", Napi::Number::New(env, stats.jitter_buffer_ms));
+    obj.Set("lateFrames",     Napi::Number::New(env, static_cast<double>(stats.late_frames)));
+    obj.Set("firstFrameMs",   Napi::Number::New(env, stats.first_frame_ms));
+    obj.Set("poolReservedBytes",  Napi::Number::New(env, static_cast<double>(stats.pool_reserved_bytes)));
+    obj.Set("poolHighWaterBytes", Napi::Number::New(env, static_cast<double>(stats.pool_high_water_bytes)));
+    obj.Set("poolSystemAllocs",   Napi::Number::New(env, static_cast<double>(stats.pool_system_allocs)));
 
     return obj;
 }
 
+// ---------------------------------------------------------------------------
+// viewer.statsBuffer() -> ArrayBuffer
+// One buffer for the addon's lifetime, allocated by V8 (Electron refuses
+// external buffers) and kept alive by a reference; the viewer writes into
+// its backing store, which does not move.  Read it with StatsRingReader.
+// ---------------------------------------------------------------------------
+Napi::Value StatsBuffer(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (g_stats_buffer.IsEmpty()) {
+        Napi::ArrayBuffer buf = Napi::ArrayBuffer::New(env, cs::StatsRing::bytes());
+        if (!g_stats_ring.attach(buf.Data(), buf.ByteLength())) {
+            Napi::Error::New(env, "Cannot lay out the stats buffer").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        g_stats_buffer = Napi::Persistent(buf);
+
+        // The threads writing into the buffer end before V8 frees it
+        env.AddCleanupHook([]() {
+            if (g_viewer) g_viewer->stop();
+        });
+
+        if (g_viewer) {
+            g_viewer->setStatsRing(&g_stats_ring);
+        }
+    }
+
+    return g_stats_buffer.Value();
+}
+
 // ---------------------------------------------------------------------------
 // viewer.onDisconnect(callback)
 // ---------------------------------------------------------------------------
@@ -254,7 +447,8 @@ Napi::Value SetQuality(const Napi::CallbackInfo& info) {
 // ---------------------------------------------------------------------------
 // viewer.setGamingMode(mode)
 // Maps gaming mode strings to quality presets:
-//   "competitive" -> PERFORMANCE (lowest latency)
+//   "competitive" -> PERFORMANCE (lowest latency, no jitter hold-back)
+//   "lan"         -> PERFORMANCE
 //   "balanced"    -> BALANCED
 //   "cinematic"   -> QUALITY (highest quality)
 // ---------------------------------------------------------------------------
@@ -270,7 +464,7 @@ Napi::Value SetGamingMode(const Napi::CallbackInfo& info) {
 
     // Map gaming mode to quality preset
     cs::QualityPreset preset = cs::QualityPreset::BALANCED;
-    if (mode == "competitive") {
+    if (mode == "competitive" || mode == "lan") {
         preset = cs::QualityPreset::PERFORMANCE;
     } else if (mode == "balanced") {
         preset = cs::QualityPreset::BALANCED;
@@ -455,6 +649,28 @@ Napi::Value DisconnectP2P(const Napi::CallbackInfo& info) {
     return env.Undefined();
 }
 
+// ---------------------------------------------------------------------------
+// viewer.dumpTrace([path])
+// The pipeline trace as Chrome trace JSON: written to |path| (returns the
+// number of events), or returned as a string.  Traced as process 2 so it
+// loads next to a host trace (process 1).
+// ---------------------------------------------------------------------------
+Napi::Value DumpTrace(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsString()) {
+        return Napi::String::New(env, cs::trace::exportChromeJson("nvremote-viewer", 2));
+    }
+
+    std::string path = info[0].As<Napi::String>().Utf8Value();
+    size_t events = 0;
+    if (!cs::trace::writeChromeTrace(path, "nvremote-viewer", 2, &events)) {
+        Napi::Error::New(env, "Cannot write trace to " + path).ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    return Napi::Number::New(env, static_cast<double>(events));
+}
+
 // ---------------------------------------------------------------------------
 // Module initialization
 // ---------------------------------------------------------------------------
@@ -471,6 +687,8 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
     exports.Set("addRemoteCandidate",   Napi::Function::New(env, AddRemoteCandidate));
     exports.Set("connectP2P",           Napi::Function::New(env, ConnectP2P));
     exports.Set("disconnectP2P",        Napi::Function::New(env, DisconnectP2P));
+    exports.Set("dumpTrace",            Napi::Function::New(env, DumpTrace));
+    exports.Set("statsBuffer",          Napi::Function::New(env, StatsBuffer));
 
     CS_LOG(INFO, "nvremote-viewer N-API addon loaded successfully");
     return exports;
@@ -0,0 +1,353 @@
+///////////////////////////////////////////////////////////////////////////////
+// audio_jitter_buffer.cpp -- Sequence-ordered audio playout with concealment
+///////////////////////////////////////////////////////////////////////////////
+
+#include "audio_jitter_buffer.h"
+
+#include "opus_decoder.h"
+
+#include <cs/common.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// Construction / reset
+// ---------------------------------------------------------------------------
+
+AudioJitterBuffer::AudioJitterBuffer(OpusDecoderWrapper& decoder)
+    : decoder_(decoder) {}
+
+void AudioJitterBuffer::reset() {
+    for (Slot& slot : slots_) slot.valid = false;
+    have_next_      = false;
+    playing_        = false;
+    next_seq_       = 0;
+    highest_seq_    = 0;
+    frame_samples_  = 0;
+    conceal_run_us_ = 0;
+    stretched_last_ = false;
+    expand_due_us_  = 0;
+    transit_count_  = 0;
+    transit_next_   = 0;
+    min_transit_    = 0;
+    depth_us_       = 0.0;
+    publishStats();
+}
+
+// ---------------------------------------------------------------------------
+// push
+// ---------------------------------------------------------------------------
+
+void AudioJitterBuffer::push(const AudioPacketHeader& header, const uint8_t* payload,
+                             size_t len, uint64_t arrival_us) {
+    if (len == 0 || len > MAX_PAYLOAD) return;
+    const uint16_t seq = header.sequence_number;
+
+    if (!have_next_) {
+        next_seq_    = seq;
+        next_ts_     = header.timestamp_us;
+        highest_seq_ = seq;
+        have_next_   = true;
+    }
+
+    const int16_t ahead = static_cast<int16_t>(seq - next_seq_);
+    if (ahead < 0) {
+        if (!playing_ && ahead > -static_cast<int16_t>(RING_PACKETS)) {
+            // Reordered ahead of the first packet: start from it instead
+            next_seq_ = seq;
+            next_ts_  = header.timestamp_us;
+        } else if (ahead <= -static_cast<int16_t>(RING_PACKETS)) {
+            // Far behind: the host started its sequence over
+            CS_LOG(INFO, "AudioJitterBuffer: sequence restarted at %u", seq);
+            reset();
+            next_seq_    = seq;
+            next_ts_     = header.timestamp_us;
+            highest_seq_ = seq;
+            have_next_   = true;
+        } else {
+            late_packets_++;
+            return;
+        }
+    } else if (ahead >= static_cast<int16_t>(RING_PACKETS)) {
+        // Further ahead than the ring holds: a long gap (the host paused
+        // audio, or the path was down).  Whatever is held is too old.
+        CS_LOG(INFO, "AudioJitterBuffer: skipped %d packets to %u", ahead, seq);
+        for (Slot& slot : slots_) slot.valid = false;
+        next_seq_    = seq;
+        next_ts_     = header.timestamp_us;
+        highest_seq_ = seq;
+        playing_     = false;
+    }
+
+    Slot& slot = slots_[seq % RING_PACKETS];
+    slot.valid = true;
+    slot.seq   = seq;
+    slot.len   = static_cast<uint16_t>(len);
+    slot.timestamp_us = header.timestamp_us;
+    std::memcpy(slot.data.data(), payload, len);
+
+    if (static_cast<int16_t>(seq - highest_seq_) > 0) highest_seq_ = seq;
+    if (const size_t samples = decoder_.packetSamples(payload, len)) frame_samples_ = samples;
+
+    updateDepth(header, arrival_us);
+    publishStats();
+}
+
+// ---------------------------------------------------------------------------
+// pull
+// ---------------------------------------------------------------------------
+
+bool AudioJitterBuffer::pull(std::vector<float>& pcm, uint32_t& timestamp_us) {
+    pcm.clear();
+    if (!have_next_ || frame_samples_ == 0) return false;
+
+    if (!playing_) {
+        if (bufferedUs() < targetUs()) return false;
+        playing_ = true;
+        conceal_run_us_ = 0;
+        expand_due_us_  = 0;   // Filled to the target, extra delay and all
+    }
+
+    const uint32_t rate     = decoder_.getSampleRate();
+    const uint16_t channels = decoder_.getChannels();
+    const size_t   block    = static_cast<size_t>(rate) * BLOCK_US / 1'000'000 * channels;
+    const uint64_t frame_us = static_cast<uint64_t>(frame_samples_) * 1'000'000 / rate;
+
+    timestamp_us = next_ts_;
+    while (pcm.size() < block) {
+        Slot& slot = slots_[next_seq_ % RING_PACKETS];
+        bool decoded = false;
+
+        if (slot.valid && slot.seq == next_seq_) {
+            if (pcm.empty()) timestamp_us = slot.timestamp_us;
+            decoded = decoder_.decode(slot.data.data(), slot.len, frame_);
+            slot.valid = false;
+            conceal_run_us_ = 0;
+            next_seq_++;
+            next_ts_ = slot.timestamp_us + static_cast<uint32_t>(frame_us);
+        } else if (static_cast<int16_t>(highest_seq_ - next_seq_) < 0) {
+            // Nothing buffered: the packet is late rather than lost.  Fill
+            // in for a while without giving up its turn, then stop and
+            // wait for the buffer to refill.
+            if (conceal_run_us_ >= MAX_CONCEAL_US) {
+                playing_ = false;
+                underruns_++;
+                break;
+            }
+            decoded = decoder_.decodePLC(frame_samples_, frame_);
+            concealed_++;
+            conceal_run_us_ += frame_us;
+        } else {
+            // Lost: later packets are here.  The next one carries this
+            // frame's FEC.
+            const uint16_t after = static_cast<uint16_t>(next_seq_ + 1);
+            const Slot& next = slots_[after % RING_PACKETS];
+            if (next.valid && next.seq == after) {
+                decoded = decoder_.decodeFec(next.data.data(), next.len, frame_samples_, frame_);
+                fec_recovered_++;
+            } else {
+                decoded = decoder_.decodePLC(frame_samples_, frame_);
+                concealed_++;
+            }
+            next_seq_++;
+            next_ts_ += static_cast<uint32_t>(frame_us);
+        }
+
+        if (decoded) pcm.insert(pcm.end(), frame_.begin(), frame_.end());
+    }
+
+    // Drain delay over the target, or build up extra delay, every other
+    // block at most
+    if (!pcm.empty() && !stretched_last_ && bufferedUs() > targetUs() + STRETCH_MARGIN_US) {
+        stretched_last_ = compress(pcm);
+        if (stretched_last_) stretched_++;
+    } else if (!pcm.empty() && !stretched_last_ && expand_due_us_ > 0) {
+        const uint64_t added_us = static_cast<uint64_t>(expand(pcm)) * 1'000'000 / rate;
+        expand_due_us_ -= std::min(expand_due_us_, added_us);
+        stretched_last_ = added_us > 0;
+        if (stretched_last_) stretched_++;
+    } else {
+        stretched_last_ = false;
+    }
+
+    publishStats();
+    return !pcm.empty();
+}
+
+// ---------------------------------------------------------------------------
+// setExtraDelayUs
+// ---------------------------------------------------------------------------
+
+void AudioJitterBuffer::setExtraDelayUs(uint32_t delay_us) {
+    // Delay taken away drains as any excess does; delay added is built up
+    // by expand() while playing, and by filling further otherwise.
+    if (playing_ && delay_us > extra_delay_us_) {
+        expand_due_us_ += delay_us - extra_delay_us_;
+    } else if (delay_us < extra_delay_us_) {
+        expand_due_us_ -= std::min<uint64_t>(expand_due_us_, extra_delay_us_ - delay_us);
+    }
+    extra_delay_us_ = delay_us;
+    publishStats();
+}
+
+// ---------------------------------------------------------------------------
+// findPeriod -- pitch period at the block's start
+// ---------------------------------------------------------------------------
+
+size_t AudioJitterBuffer::findPeriod(const std::vector<float>& pcm) const {
+    const uint32_t rate     = decoder_.getSampleRate();
+    const size_t   channels = decoder_.getChannels();
+    const size_t   frames   = pcm.size() / channels;
+    const size_t   overlap  = static_cast<size_t>(rate) * OVERLAP_US / 1'000'000;
+    const size_t   min_lag  = static_cast<size_t>(rate) * MIN_PERIOD_US / 1'000'000;
+    const size_t   max_lag  = static_cast<size_t>(rate) * MAX_PERIOD_US / 1'000'000;
+    if (overlap == 0 || frames < max_lag + overlap) return 0;
+
+    // The lag whose segment best matches the block's start (normalized
+    // cross-correlation of the channel sum) is one period of whatever
+    // the block holds.
+    auto mono = [&](size_t i) {
+        float sum = 0.0f;
+        for (size_t c = 0; c < channels; ++c) sum += pcm[i * channels + c];
+        return sum;
+    };
+    size_t best_lag  = min_lag;
+    double best_corr = -2.0;
+    for (size_t lag = min_lag; lag <= max_lag; ++lag) {
+        double xy = 0.0, yy = 0.0, xx = 0.0;
+        for (size_t i = 0; i < overlap; ++i) {
+            const double x = mono(i);
+            const double y = mono(i + lag);
+            xy += x * y;
+            xx += x * x;
+            yy += y * y;
+        }
+        const double corr = (xx > 0.0 && yy > 0.0) ? xy / std::sqrt(xx * yy) : 0.0;
+        if (corr > best_corr) {
+            best_corr = corr;
+            best_lag  = lag;
+        }
+    }
+    return best_lag;
+}
+
+// ---------------------------------------------------------------------------
+// compress -- drop one pitch period, cross-faded
+// ---------------------------------------------------------------------------
+
+bool AudioJitterBuffer::compress(std::vector<float>& pcm) const {
+    const size_t best_lag = findPeriod(pcm);
+    if (best_lag == 0) return false;
+    const size_t channels = decoder_.getChannels();
+    const size_t overlap  = static_cast<size_t>(decoder_.getSampleRate()) * OVERLAP_US / 1'000'000;
+
+    // Fade from the block's start into the same point one period on, then
+    // carry on from there: |best_lag| frames fewer.
+    for (size_t i = 0; i < overlap; ++i) {
+        const float w = static_cast<float>(i + 1) / static_cast<float>(overlap + 1);
+        for (size_t c = 0; c < channels; ++c) {
+            float& out = pcm[i * channels + c];
+            out = out * (1.0f - w) + pcm[(i + best_lag) * channels + c] * w;
+        }
+    }
+    pcm.erase(pcm.begin() + overlap * channels,
+              pcm.begin() + (overlap + best_lag) * channels);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// expand -- repeat one pitch period, cross-faded
+// ---------------------------------------------------------------------------
+
+size_t AudioJitterBuffer::expand(std::vector<float>& pcm) {
+    const size_t best_lag = findPeriod(pcm);
+    if (best_lag == 0) return 0;
+    const size_t channels = decoder_.getChannels();
+    const size_t overlap  = static_cast<size_t>(decoder_.getSampleRate()) * OVERLAP_US / 1'000'000;
+
+    // One period in, fade from where the block goes on back to its start
+    // (which resembles it), and play the first period again from there:
+    // |best_lag| frames more.  The period is never shorter than the fade.
+    insert_.assign(pcm.begin(), pcm.begin() + best_lag * channels);
+    for (size_t i = 0; i < overlap; ++i) {
+        const float w = static_cast<float>(i + 1) / static_cast<float>(overlap + 1);
+        for (size_t c = 0; c < channels; ++c) {
+            float& out = insert_[i * channels + c];
+            out = pcm[(i + best_lag) * channels + c] * (1.0f - w) + out * w;
+        }
+    }
+    pcm.insert(pcm.begin() + best_lag * channels, insert_.begin(), insert_.end());
+    return best_lag;
+}
+
+// ---------------------------------------------------------------------------
+// Delay
+// ---------------------------------------------------------------------------
+
+uint64_t AudioJitterBuffer::bufferedUs() const {
+    const int16_t held = static_cast<int16_t>(highest_seq_ - next_seq_);
+    if (!have_next_ || held < 0 || frame_samples_ == 0) return 0;
+    return static_cast<uint64_t>(held + 1) * frame_samples_ * 1'000'000 /
+           decoder_.getSampleRate();
+}
+
+uint64_t AudioJitterBuffer::targetUs() const {
+    const uint64_t frame_us = static_cast<uint64_t>(frame_samples_) * 1'000'000 /
+                              decoder_.getSampleRate();
+    return static_cast<uint64_t>(depth_us_) + frame_us + extra_delay_us_;
+}
+
+void AudioJitterBuffer::updateDepth(const AudioPacketHeader& header, uint64_t arrival_us) {
+    // Host and viewer clocks are unrelated, but their 32-bit difference
+    // moves only with network delay.
+    const uint32_t transit = static_cast<uint32_t>(arrival_us) - header.timestamp_us;
+    if (transit_count_ == 0) transit_ref_ = transit;
+    const int32_t rel = static_cast<int32_t>(transit - transit_ref_);
+
+    transits_[transit_next_] = rel;
+    transit_next_ = (transit_next_ + 1) % JITTER_WINDOW_PACKETS;
+    if (transit_count_ < JITTER_WINDOW_PACKETS) transit_count_++;
+
+    std::copy(transits_.begin(), transits_.begin() + transit_count_, scratch_.begin());
+    auto end = scratch_.begin() + transit_count_;
+    min_transit_ = *std::min_element(scratch_.begin(), end);
+    auto pct = scratch_.begin() +
+               static_cast<size_t>(JITTER_PERCENTILE * (transit_count_ - 1));
+    std::nth_element(scratch_.begin(), pct, end);
+
+    // Fast attack, slow decay.
+    const double target = std::clamp(static_cast<double>(*pct - min_transit_),
+                                     MIN_DEPTH_US, MAX_DEPTH_US);
+    if (target > depth_us_) {
+        depth_us_ = target;
+    } else {
+        depth_us_ -= (depth_us_ - target) * DEPTH_DECAY;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Stats
+// ---------------------------------------------------------------------------
+
+void AudioJitterBuffer::publishStats() {
+    target_ms_.store(static_cast<uint32_t>(targetUs() / 1000));
+    buffered_ms_.store(static_cast<uint32_t>(bufferedUs() / 1000));
+}
+
+AudioJitterBuffer::Stats AudioJitterBuffer::getStats() const {
+    Stats stats;
+    stats.target_ms     = target_ms_.load();
+    stats.buffered_ms   = buffered_ms_.load();
+    stats.fec_recovered = fec_recovered_.load();
+    stats.concealed     = concealed_.load();
+    stats.late_packets  = late_packets_.load();
+    stats.underruns     = underruns_.load();
+    stats.stretched     = stretched_.load();
+    return stats;
+}
+
+} // namespace cs
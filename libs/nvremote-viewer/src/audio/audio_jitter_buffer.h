@@ -0,0 +1,162 @@
+///////////////////////////////////////////////////////////////////////////////
+// audio_jitter_buffer.h -- Sequence-ordered audio playout with concealment
+//
+// Opus packets are held by sequence number and decoded in order, a block
+// (BLOCK_US) at a time, as the audio output takes them.  A packet that is
+// missing when its turn comes is rebuilt from the in-band FEC of the next
+// one if that has arrived, and concealed (Opus PLC) otherwise; packets
+// arriving after their turn are dropped.  When nothing at all is buffered
+// the output is concealed for up to MAX_CONCEAL_US, then stops until the
+// buffer has refilled to its target.
+//
+// The target delay adapts as the video jitter buffer's does: each packet's
+// transit (arrival minus the host's timestamp, across unsynchronized
+// clocks) is compared with the smallest in the last JITTER_WINDOW_PACKETS,
+// and the depth jumps up to the 95th percentile of that lateness at once
+// and decays slowly.  Delay over the target (after a burst, or once the
+// depth has decayed) is drained by time-stretching: a block is shortened
+// by one pitch period, found by correlation and cross-faded, which leaves
+// the pitch alone.  At most every other block is stretched.
+//
+// setExtraDelayUs() holds back more than the jitter calls for, to line
+// audio up with video (AvSync).  Delay added while playing is built up the
+// same way in reverse: a block is lengthened by repeating a pitch period.
+//
+// Storage is a fixed ring of RING_PACKETS slots indexed by sequence
+// number; push() and pull() run on the one (audio) thread, getStats() on
+// any.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <cs/transport/packet.h>
+
+namespace cs {
+
+class OpusDecoderWrapper;
+
+class AudioJitterBuffer {
+public:
+    /// Largest payload held: one Opus frame at any bitrate.
+    static constexpr size_t MAX_PAYLOAD = 1500;
+
+    /// Packets are decoded with |decoder|, which must outlive the buffer.
+    explicit AudioJitterBuffer(OpusDecoderWrapper& decoder);
+
+    // Non-copyable
+    AudioJitterBuffer(const AudioJitterBuffer&) = delete;
+    AudioJitterBuffer& operator=(const AudioJitterBuffer&) = delete;
+
+    /// Take a packet received at |arrival_us| (local clock).
+    void push(const AudioPacketHeader& header, const uint8_t* payload, size_t len,
+              uint64_t arrival_us);
+
+    /// Decode the next block of playout into |pcm| (interleaved), and set
+    /// |timestamp_us| to the host capture time of its first sample.
+    /// Returns false, with |pcm| empty, while the buffer is filling.
+    bool pull(std::vector<float>& pcm, uint32_t& timestamp_us);
+
+    /// Hold |delay_us| more than the jitter calls for (A/V sync).
+    void setExtraDelayUs(uint32_t delay_us);
+
+    /// Forget every packet and start over with the next one pushed.
+    void reset();
+
+    struct Stats {
+        uint32_t target_ms     = 0;   // Adaptive playout delay
+        uint32_t buffered_ms   = 0;   // Delay currently held
+        uint64_t fec_recovered = 0;   // Lost frames rebuilt from the next packet's FEC
+        uint64_t concealed     = 0;   // Frames synthesized by PLC
+        uint64_t late_packets  = 0;   // Arrived after their turn
+        uint64_t underruns     = 0;   // Times playout stopped to refill
+        uint64_t stretched     = 0;   // Blocks shortened to drain delay
+    };
+    Stats getStats() const;
+
+private:
+    struct Slot {
+        bool     valid   = false;
+        uint16_t seq     = 0;
+        uint16_t len     = 0;
+        uint32_t timestamp_us = 0;
+        std::array<uint8_t, MAX_PAYLOAD> data{};
+    };
+
+    /// Delay held from the next packet to play through the newest.
+    uint64_t bufferedUs() const;
+
+    /// Delay to hold: depth plus one frame, plus any extra delay.
+    uint64_t targetUs() const;
+
+    /// Frame-level jitter from one arrival.
+    void updateDepth(const AudioPacketHeader& header, uint64_t arrival_us);
+
+    /// Frames in one pitch period at the start of |pcm|, 0 if the block is
+    /// too short to search.
+    size_t findPeriod(const std::vector<float>& pcm) const;
+
+    /// Shorten |pcm| by one pitch period with a cross-fade.  False if the
+    /// block is too short to search.
+    bool compress(std::vector<float>& pcm) const;
+
+    /// Lengthen |pcm| by one pitch period with a cross-fade; returns the
+    /// frames added, 0 if the block is too short to search.
+    size_t expand(std::vector<float>& pcm);
+
+    void publishStats();
+
+    OpusDecoderWrapper& decoder_;
+
+    static constexpr uint16_t RING_PACKETS = 128;
+    std::array<Slot, RING_PACKETS> slots_{};
+
+    bool     have_next_       = false;   // next_seq_ is set
+    bool     playing_         = false;
+    uint16_t next_seq_        = 0;       // Next packet to play
+    uint16_t highest_seq_     = 0;       // Newest received
+    uint32_t next_ts_         = 0;       // Host capture time of next_seq_
+    size_t   frame_samples_   = 0;       // Per channel, of the last packet seen
+    uint64_t conceal_run_us_  = 0;       // Concealed while nothing was buffered
+    bool     stretched_last_  = false;
+    uint32_t extra_delay_us_  = 0;       // setExtraDelayUs()
+    uint64_t expand_due_us_   = 0;       // Extra delay yet to build up
+
+    std::vector<float> frame_;           // One decoded frame
+    std::vector<float> insert_;          // Period repeated by expand()
+
+    // Transit tracking (as JitterBuffer::onFrameComplete())
+    uint32_t transit_ref_   = 0;
+    uint32_t transit_count_ = 0;
+    uint32_t transit_next_  = 0;
+    int32_t  min_transit_   = 0;
+    double   depth_us_      = 0.0;
+    static constexpr uint32_t JITTER_WINDOW_PACKETS = 128;
+    std::array<int32_t, JITTER_WINDOW_PACKETS> transits_{};
+    std::array<int32_t, JITTER_WINDOW_PACKETS> scratch_{};
+
+    std::atomic<uint32_t> target_ms_{0};
+    std::atomic<uint32_t> buffered_ms_{0};
+    std::atomic<uint64_t> fec_recovered_{0};
+    std::atomic<uint64_t> concealed_{0};
+    std::atomic<uint64_t> late_packets_{0};
+    std::atomic<uint64_t> underruns_{0};
+    std::atomic<uint64_t> stretched_{0};
+
+    static constexpr uint64_t BLOCK_US          = 10'000;    // Decoded per pull()
+    static constexpr double   JITTER_PERCENTILE = 0.95;
+    static constexpr double   DEPTH_DECAY       = 0.01;      // Of the excess, per packet
+    static constexpr double   MIN_DEPTH_US      = 5'000.0;
+    static constexpr double   MAX_DEPTH_US      = 150'000.0;
+    static constexpr uint64_t STRETCH_MARGIN_US = 5'000;     // Over the target before draining
+    static constexpr uint64_t MAX_CONCEAL_US    = 60'000;    // Concealed on an empty buffer
+    static constexpr uint32_t OVERLAP_US        = 2'500;     // Cross-fade of a stretch
+    static constexpr uint32_t MIN_PERIOD_US     = 2'500;     // Pitch periods searched
+    static constexpr uint32_t MAX_PERIOD_US     = 5'000;
+};
+
+} // namespace cs
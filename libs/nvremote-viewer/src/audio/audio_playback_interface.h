@@ -12,6 +12,15 @@
 
 namespace cs {
 
+// ---------------------------------------------------------------------------
+// AudioOutputMode -- how the output stream shares the device
+// ---------------------------------------------------------------------------
+enum class AudioOutputMode : uint8_t {
+    SHARED      = 0,   // Mixed by the OS audio engine at its default period
+    LOW_LATENCY = 1,   // Mixed, at the smallest period the engine allows
+    EXCLUSIVE   = 2,   // The device to ourselves, at its minimum period
+};
+
 class IAudioPlayback {
 public:
     virtual ~IAudioPlayback() = default;
@@ -32,6 +41,14 @@ public:
     /// Get the current audio output latency in milliseconds.
     virtual float getLatencyMs() const = 0;
 
+    /// Decoded audio accepted by play() that the device has not yet taken,
+    /// in milliseconds.  The audio thread keeps this just above a period.
+    virtual float getQueuedMs() const { return getLatencyMs(); }
+
+    /// Fixed latency of the output path below the queued samples: device
+    /// period, engine and stream latency, in milliseconds.  0 if unknown.
+    virtual float getEndpointLatencyMs() const { return 0.0f; }
+
     /// Returns true if playback is initialized and active.
     virtual bool isInitialized() const = 0;
 };
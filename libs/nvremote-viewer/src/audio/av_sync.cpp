@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+// av_sync.cpp -- Audio/video synchronization on the host's media clock
+///////////////////////////////////////////////////////////////////////////////
+
+#include "av_sync.h"
+
+#include <cs/common.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// Configuration
+// ---------------------------------------------------------------------------
+
+void AvSync::setPolicy(uint32_t max_audio_delay_ms, uint32_t max_video_delay_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_audio_delay_us_ = max_audio_delay_ms * 1000;
+    max_video_delay_us_ = max_video_delay_ms * 1000;
+    last_update_us_ = 0;   // Apply the bounds at the next update()
+    CS_LOG(DEBUG, "AvSync: extra delay up to %u ms audio, %u ms video",
+           max_audio_delay_ms, max_video_delay_ms);
+}
+
+void AvSync::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    have_ref_   = false;
+    have_video_ = false;
+    have_audio_ = false;
+    last_update_us_ = 0;
+    audio_delay_us_.store(0);
+    video_delay_us_.store(0);
+    offset_ms_.store(0.0f);
+}
+
+// ---------------------------------------------------------------------------
+// Measurements
+// ---------------------------------------------------------------------------
+
+void AvSync::onVideoPresented(uint32_t timestamp_us, uint64_t shown_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    addSample(static_cast<uint32_t>(shown_us) - timestamp_us,
+              video_avg_us_, have_video_, last_video_us_, shown_us);
+}
+
+void AvSync::onAudioPlayed(uint32_t timestamp_us, uint64_t heard_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    addSample(static_cast<uint32_t>(heard_us) - timestamp_us,
+              audio_avg_us_, have_audio_, last_audio_us_, heard_us);
+}
+
+void AvSync::addSample(uint32_t delay, double& avg, bool& have, uint64_t& last_us,
+                       uint64_t at_us) {
+    if (!have_ref_) {
+        ref_      = delay;
+        have_ref_ = true;
+    }
+    const double rel = static_cast<double>(static_cast<int32_t>(delay - ref_));
+
+    // A stream that stopped for a while starts its average over
+    if (!have || at_us - last_us > STALE_US) {
+        avg  = rel;
+        have = true;
+    } else {
+        avg += (rel - avg) * SMOOTHING;
+    }
+    last_us = at_us;
+}
+
+// ---------------------------------------------------------------------------
+// update -- move the delays toward zero offset
+// ---------------------------------------------------------------------------
+
+bool AvSync::update(uint64_t now_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (last_update_us_ != 0 && now_us - last_update_us_ < SYNC_INTERVAL_US) return false;
+    last_update_us_ = now_us;
+
+    double audio = audio_delay_us_.load();
+    double video = video_delay_us_.load();
+
+    const bool playing = have_video_ && have_audio_ &&
+                         now_us - last_video_us_ < STALE_US &&
+                         now_us - last_audio_us_ < STALE_US;
+    if (!playing) {
+        // Nothing to line up: hold what is applied
+        offset_ms_.store(0.0f);
+    } else {
+        const double offset = audio_avg_us_ - video_avg_us_;
+        offset_ms_.store(static_cast<float>(offset / 1000.0));
+
+        if (std::fabs(offset) > DEADBAND_US) {
+            double step = std::clamp(offset * GAIN, -MAX_STEP_US, MAX_STEP_US);
+            if (step > 0.0) {
+                // Sound is late: take delay off audio, then hold video back
+                const double give = std::min(step, audio);
+                audio -= give;
+                video += step - give;
+            } else {
+                step = -step;
+                const double give = std::min(step, video);
+                video -= give;
+                audio += step - give;
+            }
+        }
+    }
+
+    const uint32_t audio_us = static_cast<uint32_t>(
+        std::min(audio, static_cast<double>(max_audio_delay_us_)));
+    const uint32_t video_us = static_cast<uint32_t>(
+        std::min(video, static_cast<double>(max_video_delay_us_)));
+    const bool changed = audio_us != audio_delay_us_.load() ||
+                         video_us != video_delay_us_.load();
+    audio_delay_us_.store(audio_us);
+    video_delay_us_.store(video_us);
+    return changed;
+}
+
+} // namespace cs
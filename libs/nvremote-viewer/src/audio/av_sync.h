@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+// av_sync.h -- Audio/video synchronization on the host's media clock
+//
+// The host stamps video frames and audio packets with their capture time on
+// one clock, so a frame and the audio captured with it carry the same
+// timestamp.  For each stream the viewer notes when a timestamp actually
+// reaches the user -- a frame when it is presented (plus the display's
+// present-to-photon time), audio when its block leaves the output (after
+// the queue ahead of it and the endpoint latency).  The difference between
+// those local times and the timestamps is each stream's end-to-end delay,
+// offset by the unknown host/viewer clock difference; the clocks cancel in
+// the difference of the two delays, which is the A/V offset.
+//
+// Every SYNC_INTERVAL_US the smoothed offset outside DEADBAND_US is
+// corrected by delaying whichever stream is ahead: extra audio playout
+// delay (the audio jitter buffer stretches to it), or extra video hold-back
+// (the video jitter buffer).  Delay on the lagging stream is given back
+// before any is added to the leading one, and each is bounded by the
+// policy, which the viewer sets from its QualityPreset -- Performance never
+// delays video, so audio follows it.
+//
+// onVideoPresented() runs on the render thread, everything else on the
+// audio thread; getters on any.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+namespace cs {
+
+class AvSync {
+public:
+    AvSync() = default;
+
+    // Non-copyable
+    AvSync(const AvSync&) = delete;
+    AvSync& operator=(const AvSync&) = delete;
+
+    /// Bound the extra delay each stream may be given.  Delay already held
+    /// beyond a new bound is dropped at the next update().
+    void setPolicy(uint32_t max_audio_delay_ms, uint32_t max_video_delay_ms);
+
+    /// The frame captured at |timestamp_us| (host, low 32 bits) reached the
+    /// screen at |shown_us| (local clock).
+    void onVideoPresented(uint32_t timestamp_us, uint64_t shown_us);
+
+    /// The audio captured at |timestamp_us| will be heard at |heard_us|.
+    void onAudioPlayed(uint32_t timestamp_us, uint64_t heard_us);
+
+    /// Re-evaluate the delays at |now_us|, at most every SYNC_INTERVAL_US.
+    /// True when either delay changed.
+    bool update(uint64_t now_us);
+
+    /// Extra delay to apply to each stream.
+    uint32_t getAudioDelayUs() const { return audio_delay_us_.load(); }
+    uint32_t getVideoDelayUs() const { return video_delay_us_.load(); }
+
+    /// Smoothed audio delay minus video delay: positive when sound is
+    /// heard after the picture it belongs to.  0 until both streams play.
+    float getOffsetMs() const { return offset_ms_.load(); }
+
+    /// Forget both streams' history and all delay.
+    void reset();
+
+private:
+    /// Fold |delay| (local minus host time, mod 2^32) into |avg|.
+    void addSample(uint32_t delay, double& avg, bool& have, uint64_t& last_us,
+                   uint64_t at_us);
+
+    mutable std::mutex mutex_;
+
+    // Delays are kept relative to the first one seen, so they stay small
+    // despite the unrelated 32-bit clocks.
+    bool     have_ref_     = false;
+    uint32_t ref_          = 0;
+    bool     have_video_   = false;
+    bool     have_audio_   = false;
+    double   video_avg_us_ = 0.0;
+    double   audio_avg_us_ = 0.0;
+    uint64_t last_video_us_  = 0;
+    uint64_t last_audio_us_  = 0;
+    uint64_t last_update_us_ = 0;
+
+    uint32_t max_audio_delay_us_ = 100'000;
+    uint32_t max_video_delay_us_ = 0;
+
+    std::atomic<uint32_t> audio_delay_us_{0};
+    std::atomic<uint32_t> video_delay_us_{0};
+    std::atomic<float>    offset_ms_{0.0f};
+
+    static constexpr double   SMOOTHING        = 1.0 / 16.0;   // Of each sample
+    static constexpr uint64_t SYNC_INTERVAL_US = 500'000;
+    static constexpr uint64_t STALE_US         = 1'000'000;    // Stream stopped
+    static constexpr double   DEADBAND_US      = 10'000.0;
+    static constexpr double   GAIN             = 0.5;          // Of the offset, per update
+    static constexpr double   MAX_STEP_US      = 20'000.0;
+};
+
+} // namespace cs
@@ -12,6 +12,8 @@
 
 #include <opus.h>
 
+#include <algorithm>
+
 namespace cs {
 
 // ---------------------------------------------------------------------------
@@ -99,11 +101,48 @@ bool OpusDecoderWrapper::decode(const uint8_t* data, size_t len, std::vector<flo
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// decodeFec
+// ---------------------------------------------------------------------------
+
+bool OpusDecoderWrapper::decodeFec(const uint8_t* next, size_t next_len, size_t samples,
+                                   std::vector<float>& pcm) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!initialized_ || !decoder_) {
+        return false;
+    }
+
+    // With decode_fec set, opus_decode_float() decodes the previous frame
+    // from |next|'s LBRR data, |samples| long; |next| itself is decoded
+    // normally afterwards.
+    const int decode_size = static_cast<int>(std::min<size_t>(samples, MAX_FRAME_SIZE));
+    pcm.resize(static_cast<size_t>(decode_size) * channels_);
+
+    int decoded = opus_decode_float(
+        decoder_,
+        next,
+        static_cast<opus_int32>(next_len),
+        pcm.data(),
+        decode_size,
+        1   // decode FEC
+    );
+
+    if (decoded < 0) {
+        CS_LOG(WARN, "OpusDecoder: FEC decode failed: %s", opus_strerror(decoded));
+        pcm.clear();
+        return false;
+    }
+
+    pcm.resize(static_cast<size_t>(decoded) * channels_);
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 // decodePLC
 // ---------------------------------------------------------------------------
 
-bool OpusDecoderWrapper::decodePLC(size_t frame_count, std::vector<float>& pcm) {
+bool OpusDecoderWrapper::decodePLC(size_t samples, std::vector<float>& pcm) {
     std::lock_guard<std::mutex> lock(mutex_);
 
     if (!initialized_ || !decoder_) {
@@ -113,14 +152,12 @@ bool OpusDecoderWrapper::decodePLC(size_t frame_count, std::vector<float>& pcm)
     // PLC: pass nullptr as data to opus_decode_float
     // This tells the decoder to generate concealment audio based on
     // its internal state from previous successfully decoded packets.
-    int decode_size = FRAME_SIZE * static_cast<int>(frame_count);
-    if (decode_size > MAX_FRAME_SIZE) {
-        decode_size = MAX_FRAME_SIZE;
-    }
+    // The length must be a whole multiple of 2.5 ms, like the frame lost.
+    const int decode_size = static_cast<int>(std::min<size_t>(samples, MAX_FRAME_SIZE));
 
     pcm.resize(static_cast<size_t>(decode_size) * channels_);
 
-    int samples = opus_decode_float(
+    int decoded = opus_decode_float(
         decoder_,
         nullptr,    // PLC mode
         0,
@@ -129,16 +166,27 @@ bool OpusDecoderWrapper::decodePLC(size_t frame_count, std::vector<float>& pcm)
         0
     );
 
-    if (samples < 0) {
-        CS_LOG(WARN, "OpusDecoder: PLC failed: %s", opus_strerror(samples));
+    if (decoded < 0) {
+        CS_LOG(WARN, "OpusDecoder: PLC failed: %s", opus_strerror(decoded));
         pcm.clear();
         return false;
     }
 
-    pcm.resize(static_cast<size_t>(samples) * channels_);
+    pcm.resize(static_cast<size_t>(decoded) * channels_);
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// packetSamples
+// ---------------------------------------------------------------------------
+
+size_t OpusDecoderWrapper::packetSamples(const uint8_t* data, size_t len) const {
+    if (!data || len == 0) return 0;
+    const int samples = opus_packet_get_nb_samples(data, static_cast<opus_int32>(len),
+                                                   static_cast<opus_int32>(sample_rate_));
+    return samples > 0 ? static_cast<size_t>(samples) : 0;
+}
+
 // ---------------------------------------------------------------------------
 // release
 // ---------------------------------------------------------------------------
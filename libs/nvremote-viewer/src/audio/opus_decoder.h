@@ -3,7 +3,8 @@
 //
 // Decodes Opus-compressed audio packets to PCM float samples.
 // Supports packet loss concealment (PLC) for graceful audio degradation
-// when packets are lost.
+// when packets are lost, and recovery of a lost frame from the in-band FEC
+// the host codes into the packet after it.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
@@ -37,11 +38,21 @@ public:
     /// @return true on success
     bool decode(const uint8_t* data, size_t len, std::vector<float>& pcm);
 
+    /// Rebuild the frame lost before |next| from the FEC data in |next|.
+    /// Where |next| carries none (CELT-only packets) this conceals.
+    /// @param samples  Samples per channel of the lost frame
+    /// @return true on success
+    bool decodeFec(const uint8_t* next, size_t next_len, size_t samples,
+                   std::vector<float>& pcm);
+
     /// Decode with packet loss concealment (when a packet is known to be lost).
-    /// @param frame_count  Number of frames to conceal (typically 1)
-    /// @param pcm          Output: synthesized float samples
+    /// @param samples  Samples per channel to conceal (the lost frame's)
+    /// @param pcm      Output: synthesized float samples
     /// @return true on success
-    bool decodePLC(size_t frame_count, std::vector<float>& pcm);
+    bool decodePLC(size_t samples, std::vector<float>& pcm);
+
+    /// Samples per channel in packet |data|, 0 if it is not valid Opus.
+    size_t packetSamples(const uint8_t* data, size_t len) const;
 
     /// Release the decoder. Safe to call multiple times.
     void release();
@@ -58,8 +69,6 @@ private:
     uint16_t channels_          = 2;
     bool     initialized_       = false;
 
-    // Frame size: 480 samples = 10ms at 48kHz
-    static constexpr int FRAME_SIZE = 480;
     // Maximum frame size for safety (120ms at 48kHz)
     static constexpr int MAX_FRAME_SIZE = 5760;
 
@@ -2,16 +2,18 @@
 // wasapi_playback.cpp -- Windows audio playback via WASAPI
 //
 // Plays decoded PCM audio through the default audio output device using
-// WASAPI in shared mode with event-driven buffering for low latency.
+// WASAPI, event-driven, shared, low-latency shared (IAudioClient3) or
+// exclusive.  The render thread runs under MMCSS and is the only one that
+// touches the device buffer.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "wasapi_playback.h"
 
 #include <cs/common.h>
+#include <cs/thread_policy.h>
 
 #ifdef _WIN32
 #include <functiondiscoverykeys_devpkey.h>
-#include <avrt.h>
 #include <cstring>
 #include <cmath>
 #include <algorithm>
@@ -27,11 +29,25 @@
 
 namespace cs {
 
+namespace {
+
+const char* modeName(AudioOutputMode mode) {
+    switch (mode) {
+        case AudioOutputMode::SHARED:      return "shared";
+        case AudioOutputMode::LOW_LATENCY: return "low-latency shared";
+        case AudioOutputMode::EXCLUSIVE:   return "exclusive";
+    }
+    return "unknown";
+}
+
+} // namespace
+
 // ---------------------------------------------------------------------------
 // Constructor / Destructor
 // ---------------------------------------------------------------------------
 
-WasapiPlayback::WasapiPlayback() = default;
+WasapiPlayback::WasapiPlayback(AudioOutputMode mode)
+    : requested_mode_(mode) {}
 
 WasapiPlayback::~WasapiPlayback() {
     stop();
@@ -50,7 +66,7 @@ bool WasapiPlayback::initialize(uint32_t sample_rate, uint16_t channels) {
     return false;
 #else
     if (initialized_) {
-        stop();
+        release();
     }
 
     sample_rate_ = sample_rate;
@@ -77,14 +93,6 @@ bool WasapiPlayback::initialize(uint32_t sample_rate, uint16_t channels) {
         return false;
     }
 
-    // Activate audio client
-    hr = device_->Activate(__uuidof(IAudioClient), CLSCTX_ALL,
-                            nullptr, reinterpret_cast<void**>(audio_client_.GetAddressOf()));
-    if (FAILED(hr)) {
-        CS_LOG(ERR, "WasapiPlayback: failed to activate audio client: 0x%08lx", hr);
-        return false;
-    }
-
     // Set up the desired format: float32, specified sample rate and channels
     std::memset(&wave_format_, 0, sizeof(wave_format_));
     wave_format_.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
@@ -99,6 +107,181 @@ bool WasapiPlayback::initialize(uint32_t sample_rate, uint16_t channels) {
         (SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT) : SPEAKER_FRONT_CENTER;
     wave_format_.SubFormat = KSDATAFORMAT_SUBTYPE_IEEE_FLOAT;
 
+    // Create an event for buffer notifications
+    buffer_event_ = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (!buffer_event_) {
+        CS_LOG(ERR, "WasapiPlayback: CreateEvent failed");
+        return false;
+    }
+
+    // Open in the requested mode, or the nearest one below it that the
+    // device and driver offer.
+    bool opened = false;
+    for (int m = static_cast<int>(requested_mode_); m >= 0 && !opened; --m) {
+        active_mode_ = static_cast<AudioOutputMode>(m);
+        switch (active_mode_) {
+            case AudioOutputMode::EXCLUSIVE:   opened = initExclusive();  break;
+            case AudioOutputMode::LOW_LATENCY: opened = initLowLatency(); break;
+            case AudioOutputMode::SHARED:      opened = initShared();     break;
+        }
+        if (!opened && active_mode_ != AudioOutputMode::SHARED) {
+            CS_LOG(INFO, "WasapiPlayback: %s mode unavailable, trying the next",
+                   modeName(active_mode_));
+        }
+    }
+    if (!opened || !finishInitialize()) {
+        release();
+        return false;
+    }
+
+    // The ring holds kMaxQueuedMs; the device buffer starts out silent so
+    // the first period does not play whatever the buffer held.
+    ring_.assign(static_cast<size_t>(sample_rate_) * channels_ * kMaxQueuedMs / 1000, 0.0f);
+    ring_read_  = 0;
+    ring_count_ = 0;
+
+    BYTE* prefill = nullptr;
+    if (SUCCEEDED(render_client_->GetBuffer(buffer_frames_, &prefill))) {
+        render_client_->ReleaseBuffer(buffer_frames_, AUDCLNT_BUFFERFLAGS_SILENT);
+    }
+
+    hr = audio_client_->Start();
+    if (FAILED(hr)) {
+        CS_LOG(ERR, "WasapiPlayback: Start failed: 0x%08lx", hr);
+        release();
+        return false;
+    }
+    started_ = true;
+
+    rendering_.store(true);
+    render_thread_ = std::thread(&WasapiPlayback::renderThread, this);
+    initialized_ = true;
+
+    CS_LOG(INFO, "WasapiPlayback: initialized %uHz %uch float32, %s, period=%u frames "
+                 "(%.2fms), endpoint latency %.2fms",
+           sample_rate, channels, modeName(active_mode_), period_frames_,
+           static_cast<float>(period_frames_) * 1000.0f / static_cast<float>(sample_rate_),
+           endpoint_latency_ms_);
+    return true;
+#endif
+}
+
+#ifdef _WIN32
+
+// ---------------------------------------------------------------------------
+// initExclusive -- the device to ourselves at its minimum period
+// ---------------------------------------------------------------------------
+
+bool WasapiPlayback::initExclusive() {
+    HRESULT hr = device_->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr,
+                                   reinterpret_cast<void**>(audio_client_.ReleaseAndGetAddressOf()));
+    if (FAILED(hr)) return false;
+
+    // No engine to convert: the device must take float32 as it is.
+    hr = audio_client_->IsFormatSupported(AUDCLNT_SHAREMODE_EXCLUSIVE,
+                                          &wave_format_.Format, nullptr);
+    if (hr != S_OK) {
+        audio_client_.Reset();
+        return false;
+    }
+
+    REFERENCE_TIME default_period = 0;
+    REFERENCE_TIME min_period = 0;
+    hr = audio_client_->GetDevicePeriod(&default_period, &min_period);
+    if (FAILED(hr)) {
+        audio_client_.Reset();
+        return false;
+    }
+
+    // Event-driven exclusive mode: buffer and period are the same, and
+    // the driver double-buffers behind it.
+    hr = audio_client_->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE,
+                                   AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+                                   min_period, min_period, &wave_format_.Format, nullptr);
+    if (hr == AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED) {
+        // The driver wants a period of whole aligned blocks; ask again for
+        // the buffer it rounded to, on a fresh client.
+        UINT32 aligned_frames = 0;
+        audio_client_->GetBufferSize(&aligned_frames);
+        min_period = static_cast<REFERENCE_TIME>(
+            10'000'000.0 * aligned_frames / sample_rate_ + 0.5);
+        hr = device_->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr,
+                               reinterpret_cast<void**>(audio_client_.ReleaseAndGetAddressOf()));
+        if (SUCCEEDED(hr)) {
+            hr = audio_client_->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE,
+                                           AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+                                           min_period, min_period, &wave_format_.Format, nullptr);
+        }
+    }
+    if (FAILED(hr)) {
+        CS_LOG(DEBUG, "WasapiPlayback: exclusive Initialize failed: 0x%08lx", hr);
+        audio_client_.Reset();
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// initLowLatency -- shared, at the engine's minimum period (IAudioClient3)
+// ---------------------------------------------------------------------------
+
+bool WasapiPlayback::initLowLatency() {
+    ComPtr<IAudioClient3> client3;
+    HRESULT hr = device_->Activate(__uuidof(IAudioClient3), CLSCTX_ALL, nullptr,
+                                   reinterpret_cast<void**>(client3.GetAddressOf()));
+    if (FAILED(hr)) return false;   // Before Windows 10
+
+    // A low-latency stream cannot be converted by the engine: it must be
+    // in the mix format, which has to be what the decoder produces.
+    WAVEFORMATEX* mix = nullptr;
+    hr = client3->GetMixFormat(&mix);
+    if (FAILED(hr)) return false;
+
+    bool is_float = mix->wFormatTag == WAVE_FORMAT_IEEE_FLOAT;
+    if (mix->wFormatTag == WAVE_FORMAT_EXTENSIBLE) {
+        is_float = reinterpret_cast<WAVEFORMATEXTENSIBLE*>(mix)->SubFormat ==
+                   KSDATAFORMAT_SUBTYPE_IEEE_FLOAT;
+    }
+    if (!is_float || mix->wBitsPerSample != 32 ||
+        mix->nSamplesPerSec != sample_rate_ || mix->nChannels != channels_) {
+        CS_LOG(DEBUG, "WasapiPlayback: mix format %lu Hz %u ch does not match the stream",
+               mix->nSamplesPerSec, mix->nChannels);
+        CoTaskMemFree(mix);
+        return false;
+    }
+
+    UINT32 default_frames = 0;
+    UINT32 fundamental_frames = 0;
+    UINT32 min_frames = 0;
+    UINT32 max_frames = 0;
+    hr = client3->GetSharedModeEnginePeriod(mix, &default_frames, &fundamental_frames,
+                                            &min_frames, &max_frames);
+    if (SUCCEEDED(hr)) {
+        hr = client3->InitializeSharedAudioStream(AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+                                                  min_frames, mix, nullptr);
+    }
+    CoTaskMemFree(mix);
+    if (FAILED(hr)) {
+        CS_LOG(DEBUG, "WasapiPlayback: InitializeSharedAudioStream failed: 0x%08lx", hr);
+        return false;
+    }
+
+    hr = client3.As(&audio_client_);
+    return SUCCEEDED(hr);
+}
+
+// ---------------------------------------------------------------------------
+// initShared -- shared, at the engine's default period
+// ---------------------------------------------------------------------------
+
+bool WasapiPlayback::initShared() {
+    HRESULT hr = device_->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr,
+                                   reinterpret_cast<void**>(audio_client_.ReleaseAndGetAddressOf()));
+    if (FAILED(hr)) {
+        CS_LOG(ERR, "WasapiPlayback: failed to activate audio client: 0x%08lx", hr);
+        return false;
+    }
+
     // Check if the format is supported
     WAVEFORMATEX* closest = nullptr;
     hr = audio_client_->IsFormatSupported(
@@ -121,14 +304,6 @@ bool WasapiPlayback::initialize(uint32_t sample_rate, uint16_t channels) {
         return false;
     }
 
-    // Create an event for buffer notifications
-    buffer_event_ = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-    if (!buffer_event_) {
-        CS_LOG(ERR, "WasapiPlayback: CreateEvent failed");
-        return false;
-    }
-
-    // Initialize the audio client with low-latency settings
     // Target buffer duration: 10ms (100000 * 100ns units = 10ms)
     REFERENCE_TIME requested_duration = 100000;  // 10ms in 100ns units
 
@@ -144,113 +319,158 @@ bool WasapiPlayback::initialize(uint32_t sample_rate, uint16_t channels) {
 
     if (FAILED(hr)) {
         CS_LOG(ERR, "WasapiPlayback: audio client Initialize failed: 0x%08lx", hr);
-        CloseHandle(buffer_event_);
-        buffer_event_ = nullptr;
         return false;
     }
+    return true;
+}
 
-    // Set the event handle
-    hr = audio_client_->SetEventHandle(buffer_event_);
+// ---------------------------------------------------------------------------
+// finishInitialize -- event, buffer, render client and latency
+// ---------------------------------------------------------------------------
+
+bool WasapiPlayback::finishInitialize() {
+    HRESULT hr = audio_client_->SetEventHandle(buffer_event_);
     if (FAILED(hr)) {
         CS_LOG(ERR, "WasapiPlayback: SetEventHandle failed: 0x%08lx", hr);
         return false;
     }
 
-    // Get the actual buffer size
     hr = audio_client_->GetBufferSize(&buffer_frames_);
     if (FAILED(hr)) {
         CS_LOG(ERR, "WasapiPlayback: GetBufferSize failed: 0x%08lx", hr);
         return false;
     }
 
-    // Get the render client
     hr = audio_client_->GetService(IID_PPV_ARGS(render_client_.GetAddressOf()));
     if (FAILED(hr)) {
         CS_LOG(ERR, "WasapiPlayback: GetService(IAudioRenderClient) failed: 0x%08lx", hr);
         return false;
     }
 
-    initialized_ = true;
+    // What the device takes per event: the whole buffer in exclusive
+    // mode, the engine period otherwise.
+    period_frames_ = buffer_frames_;
+    if (active_mode_ != AudioOutputMode::EXCLUSIVE) {
+        REFERENCE_TIME default_period = 0;
+        REFERENCE_TIME min_period = 0;
+        UINT32 current_frames = 0;
+        ComPtr<IAudioClient3> client3;
+        if (SUCCEEDED(audio_client_.As(&client3))) {
+            WAVEFORMATEX* current = nullptr;
+            if (SUCCEEDED(client3->GetCurrentSharedModeEnginePeriod(&current, &current_frames))) {
+                CoTaskMemFree(current);
+            }
+        }
+        if (current_frames == 0 &&
+            SUCCEEDED(audio_client_->GetDevicePeriod(&default_period, &min_period))) {
+            current_frames = static_cast<uint32_t>(default_period * sample_rate_ / 10'000'000);
+        }
+        if (current_frames > 0) period_frames_ = std::min(current_frames, buffer_frames_);
+    }
 
-    float latency_ms = static_cast<float>(buffer_frames_) / static_cast<float>(sample_rate_) * 1000.0f;
-    CS_LOG(INFO, "WasapiPlayback: initialized %uHz %uch float32, buffer=%u frames (%.1fms)",
-           sample_rate, channels, buffer_frames_, latency_ms);
+    // Below the buffer: one device period plus the latency WASAPI reports
+    // for the stream (engine and driver).
+    REFERENCE_TIME stream_latency = 0;
+    audio_client_->GetStreamLatency(&stream_latency);
+    endpoint_latency_ms_ = static_cast<float>(stream_latency) / 10'000.0f +
+                           static_cast<float>(period_frames_) * 1000.0f /
+                               static_cast<float>(sample_rate_);
     return true;
-#endif
 }
 
 // ---------------------------------------------------------------------------
-// play
+// renderThread -- fill the device buffer on each event
 // ---------------------------------------------------------------------------
 
-bool WasapiPlayback::play(const float* samples, size_t frame_count) {
-    std::lock_guard<std::mutex> lock(mutex_);
-
-#ifndef _WIN32
-    (void)samples; (void)frame_count;
-    return false;
-#else
-    if (!initialized_ || !audio_client_ || !render_client_) {
-        return false;
-    }
-
-    // Start the audio client on first play
-    if (!started_) {
-        HRESULT hr = audio_client_->Start();
-        if (FAILED(hr)) {
-            CS_LOG(ERR, "WasapiPlayback: Start failed: 0x%08lx", hr);
-            return false;
+void WasapiPlayback::renderThread() {
+    // By default MMCSS schedules the thread ahead of ordinary work, as the
+    // audio engine's own threads are.
+    cs::ScopedThreadRole role(cs::ThreadRole::AUDIO);
+
+    const bool exclusive = active_mode_ == AudioOutputMode::EXCLUSIVE;
+    while (rendering_.load()) {
+        DWORD wait_result = WaitForSingleObject(buffer_event_, 50);
+        if (wait_result == WAIT_TIMEOUT) continue;
+        if (wait_result != WAIT_OBJECT_0) {
+            CS_LOG(WARN, "WasapiPlayback: WaitForSingleObject returned %lu", wait_result);
+            break;
         }
-        started_ = true;
-    }
 
-    size_t remaining = frame_count;
-    const float* src = samples;
-
-    while (remaining > 0) {
-        // Get the amount of buffer space available
+        // Exclusive mode hands over the whole buffer each event; shared
+        // mode whatever the engine has consumed.
         UINT32 padding = 0;
-        HRESULT hr = audio_client_->GetCurrentPadding(&padding);
-        if (FAILED(hr)) {
-            CS_LOG(WARN, "WasapiPlayback: GetCurrentPadding failed: 0x%08lx", hr);
-            return false;
-        }
-
-        UINT32 available = buffer_frames_ - padding;
-        if (available == 0) {
-            // Wait for buffer space
-            DWORD wait_result = WaitForSingleObject(buffer_event_, 50);  // 50ms timeout
-            if (wait_result == WAIT_TIMEOUT) {
-                CS_LOG(WARN, "WasapiPlayback: buffer wait timeout");
-                return false;
-            }
-            continue;
-        }
-
-        UINT32 to_write = static_cast<UINT32>(std::min(
-            static_cast<size_t>(available), remaining));
+        if (!exclusive && FAILED(audio_client_->GetCurrentPadding(&padding))) continue;
+        const UINT32 writable = buffer_frames_ - padding;
+        if (writable == 0) continue;
 
         BYTE* buffer_data = nullptr;
-        hr = render_client_->GetBuffer(to_write, &buffer_data);
+        HRESULT hr = render_client_->GetBuffer(writable, &buffer_data);
         if (FAILED(hr)) {
             CS_LOG(WARN, "WasapiPlayback: GetBuffer failed: 0x%08lx", hr);
-            return false;
+            continue;
         }
-
-        // Copy PCM data (float32, channels_ samples per frame)
-        size_t bytes = static_cast<size_t>(to_write) * channels_ * sizeof(float);
-        std::memcpy(buffer_data, src, bytes);
-
-        hr = render_client_->ReleaseBuffer(to_write, 0);
+        const bool audible = takeFrames(reinterpret_cast<float*>(buffer_data), writable);
+        hr = render_client_->ReleaseBuffer(writable, audible ? 0 : AUDCLNT_BUFFERFLAGS_SILENT);
         if (FAILED(hr)) {
             CS_LOG(WARN, "WasapiPlayback: ReleaseBuffer failed: 0x%08lx", hr);
-            return false;
         }
+        device_queued_frames_.store(padding + writable);
+    }
+}
+
+bool WasapiPlayback::takeFrames(float* dst, uint32_t frames) {
+    const size_t wanted = static_cast<size_t>(frames) * channels_;
+    size_t taken = 0;
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex_);
+        taken = std::min(wanted, ring_count_);
+        const size_t first = std::min(taken, ring_.size() - ring_read_);
+        std::memcpy(dst, ring_.data() + ring_read_, first * sizeof(float));
+        std::memcpy(dst + first, ring_.data(), (taken - first) * sizeof(float));
+        ring_read_   = (ring_read_ + taken) % ring_.size();
+        ring_count_ -= taken;
+    }
+    std::memset(dst + taken, 0, (wanted - taken) * sizeof(float));
+    return taken > 0;
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// play
+// ---------------------------------------------------------------------------
+
+bool WasapiPlayback::play(const float* samples, size_t frame_count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+#ifndef _WIN32
+    (void)samples; (void)frame_count;
+    return false;
+#else
+    if (!initialized_ || ring_.empty()) {
+        return false;
+    }
 
-        src += static_cast<size_t>(to_write) * channels_;
-        remaining -= to_write;
+    // Queue for the render thread.  Past kMaxQueuedMs the oldest samples
+    // go: playing late is worse than skipping.
+    const size_t capacity = ring_.size();
+    size_t count = frame_count * channels_;
+    if (count > capacity) {
+        samples += count - capacity;
+        count = capacity;
     }
 
+    std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+    if (ring_count_ + count > capacity) {
+        const size_t dropped = ring_count_ + count - capacity;
+        ring_read_   = (ring_read_ + dropped) % capacity;
+        ring_count_ -= dropped;
+    }
+    const size_t write = (ring_read_ + ring_count_) % capacity;
+    const size_t first = std::min(count, capacity - write);
+    std::memcpy(ring_.data() + write, samples, first * sizeof(float));
+    std::memcpy(ring_.data(), samples + first, (count - first) * sizeof(float));
+    ring_count_ += count;
     return true;
 #endif
 }
@@ -261,8 +481,20 @@ bool WasapiPlayback::play(const float* samples, size_t frame_count) {
 
 void WasapiPlayback::stop() {
     std::lock_guard<std::mutex> lock(mutex_);
+#ifdef _WIN32
+    release();
+#endif
+    initialized_ = false;
+}
 
 #ifdef _WIN32
+void WasapiPlayback::release() {
+    rendering_.store(false);
+    if (render_thread_.joinable()) {
+        if (buffer_event_) SetEvent(buffer_event_);
+        render_thread_.join();
+    }
+
     if (audio_client_ && started_) {
         audio_client_->Stop();
         started_ = false;
@@ -277,33 +509,48 @@ void WasapiPlayback::stop() {
         CloseHandle(buffer_event_);
         buffer_event_ = nullptr;
     }
-#endif
 
+    {
+        std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+        ring_.clear();
+        ring_read_  = 0;
+        ring_count_ = 0;
+    }
+    device_queued_frames_.store(0);
     initialized_ = false;
 }
+#endif
 
 // ---------------------------------------------------------------------------
-// getLatencyMs
+// getLatencyMs -- queued in the ring and in the device buffer
 // ---------------------------------------------------------------------------
 
 float WasapiPlayback::getLatencyMs() const {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    if (!initialized_ || sample_rate_ == 0) {
+    if (!initialized_ || sample_rate_ == 0 || channels_ == 0) {
         return 0.0f;
     }
 
-#ifdef _WIN32
-    UINT32 padding = 0;
-    if (audio_client_) {
-        HRESULT hr = audio_client_->GetCurrentPadding(&padding);
-        if (SUCCEEDED(hr)) {
-            return static_cast<float>(padding) / static_cast<float>(sample_rate_) * 1000.0f;
-        }
+    size_t queued_frames = 0;
+    {
+        std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+        queued_frames = ring_count_ / channels_;
     }
-#endif
+    queued_frames += device_queued_frames_.load();
+    return static_cast<float>(queued_frames) / static_cast<float>(sample_rate_) * 1000.0f;
+}
 
-    return static_cast<float>(buffer_frames_) / static_cast<float>(sample_rate_) * 1000.0f;
+float WasapiPlayback::getQueuedMs() const {
+    if (sample_rate_ == 0 || channels_ == 0) return 0.0f;
+    std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+    return static_cast<float>(ring_count_ / channels_) /
+           static_cast<float>(sample_rate_) * 1000.0f;
+}
+
+float WasapiPlayback::getEndpointLatencyMs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return initialized_ ? endpoint_latency_ms_ : 0.0f;
 }
 
 // ---------------------------------------------------------------------------
@@ -2,7 +2,17 @@
 // wasapi_playback.h -- Windows audio playback via WASAPI
 //
 // Plays decoded PCM audio through the default audio output device using
-// Windows Audio Session API (WASAPI) in shared mode with low latency.
+// Windows Audio Session API (WASAPI), event-driven, in one of three modes:
+//
+//   SHARED       IAudioClient at the engine's default period (10 ms)
+//   LOW_LATENCY  IAudioClient3::InitializeSharedAudioStream at the engine's
+//                minimum period (down to 2-3 ms on most drivers)
+//   EXCLUSIVE    The device to ourselves at its minimum period, no engine
+//
+// A mode the device or driver does not offer falls back to the next one
+// down.  A render thread registered with MMCSS ("Pro Audio") fills the
+// device buffer on each event from a ring that play() writes; the ring is
+// short, and play() never blocks on the device.
 //
 // Input format: 48kHz stereo float32 (matching Opus decoder output).
 ///////////////////////////////////////////////////////////////////////////////
@@ -13,6 +23,7 @@
 #include <cstdint>
 #include <mutex>
 #include <atomic>
+#include <thread>
 #include <vector>
 
 #ifdef _WIN32
@@ -27,7 +38,8 @@ namespace cs {
 
 class WasapiPlayback : public IAudioPlayback {
 public:
-    WasapiPlayback();
+    /// Play in |mode|, or the nearest mode below it the device offers.
+    explicit WasapiPlayback(AudioOutputMode mode = AudioOutputMode::LOW_LATENCY);
     ~WasapiPlayback() override;
 
     // Non-copyable
@@ -38,10 +50,34 @@ public:
     bool play(const float* samples, size_t frame_count) override;
     void stop() override;
     float getLatencyMs() const override;
+    float getQueuedMs() const override;
+    float getEndpointLatencyMs() const override;
     bool isInitialized() const override;
 
+    /// Mode the stream was opened in (after any fallback).
+    AudioOutputMode getMode() const { return active_mode_; }
+
 private:
 #ifdef _WIN32
+    /// Open audio_client_ in each mode.  On failure the client is released
+    /// and the caller tries the next mode down.
+    bool initExclusive();
+    bool initLowLatency();
+    bool initShared();
+
+    /// Set the event, size the buffer and take the render client.
+    bool finishInitialize();
+
+    /// Fill the device buffer from the ring on each event (render_thread_).
+    void renderThread();
+
+    /// Copy up to |frames| queued frames into |dst|, zero the rest.  False
+    /// if nothing was queued.
+    bool takeFrames(float* dst, uint32_t frames);
+
+    /// Tear down without taking mutex_.
+    void release();
+
     ComPtr<IMMDeviceEnumerator> enumerator_;
     ComPtr<IMMDevice>           device_;
     ComPtr<IAudioClient>        audio_client_;
@@ -50,13 +86,32 @@ private:
     WAVEFORMATEXTENSIBLE        wave_format_  = {};
 #endif
 
+    const AudioOutputMode requested_mode_;
+    AudioOutputMode       active_mode_ = AudioOutputMode::SHARED;
+
     uint32_t sample_rate_    = 48000;
     uint16_t channels_       = 2;
     uint32_t buffer_frames_  = 0;   // Total buffer size in frames
+    uint32_t period_frames_  = 0;   // Frames the device takes per event
+    float    endpoint_latency_ms_ = 0.0f;
     bool     initialized_    = false;
     bool     started_        = false;
 
+    // Decoded PCM waiting for the device (play() -> render thread)
+    std::vector<float> ring_;
+    size_t             ring_read_  = 0;   // samples
+    size_t             ring_count_ = 0;
+    mutable std::mutex ring_mutex_;
+
+    std::thread            render_thread_;
+    std::atomic<bool>      rendering_{false};
+    std::atomic<uint32_t>  device_queued_frames_{0};
+
     mutable std::mutex mutex_;
+
+    // Queued PCM beyond this is dropped, oldest first: the ring absorbs
+    // decode bursts, it is not a playout buffer.
+    static constexpr uint32_t kMaxQueuedMs = 80;
 };
 
 } // namespace cs
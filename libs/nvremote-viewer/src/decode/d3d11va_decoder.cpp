@@ -5,6 +5,16 @@
 // sharing the D3D11 device with the renderer for zero-copy decoded
 // frame output. Decoded frames reference the same GPU texture array
 // used by the video processor, avoiding any CPU-side copies.
+//
+// Each DecodedFrame holds a reference to its pool surface, so the decoder
+// cannot recycle it until the renderer has let go of the frame.  The pool
+// is enlarged by MAX_HELD_FRAMES and MAX_DECODE_IN_FLIGHT to make up for
+// the surfaces held.  It is sized at the initialized resolution and kept
+// across in-band resolution changes that fit in it (hw_frame_pool.h).
+//
+// submit() runs FFmpeg's side of the decode and queues the surface in a
+// DecodePipeline fenced on the shared device; receive() returns it once
+// the GPU has written it.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "d3d11va_decoder.h"
@@ -12,7 +22,7 @@
 #include <cs/common.h>
 #include <cs/transport/packet.h>
 
-#include <chrono>
+#include <utility>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -30,18 +40,16 @@ extern "C" {
 
 namespace cs {
 
-// ---------------------------------------------------------------------------
-// Pixel format negotiation for D3D11VA
-// ---------------------------------------------------------------------------
-static enum AVPixelFormat d3d11va_get_format(AVCodecContext* /*ctx*/,
-                                              const enum AVPixelFormat* pix_fmts) {
-    for (const enum AVPixelFormat* p = pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
-        if (*p == AV_PIX_FMT_D3D11) {
-            return AV_PIX_FMT_D3D11;
-        }
-    }
-    CS_LOG(WARN, "D3D11VADecoder: AV_PIX_FMT_D3D11 not offered by decoder");
-    return AV_PIX_FMT_NONE;
+/// Move |frame|'s buffers into a new reference-counted AVFrame, leaving
+/// |frame| empty.  Returns null (and leaves |frame| alone) on failure.
+static std::shared_ptr<void> holdFrame(AVFrame* frame) {
+    AVFrame* held = av_frame_alloc();
+    if (!held) return nullptr;
+    av_frame_move_ref(held, frame);
+    return std::shared_ptr<void>(held, [](void* p) {
+        AVFrame* f = static_cast<AVFrame*>(p);
+        av_frame_free(&f);
+    });
 }
 
 // ---------------------------------------------------------------------------
@@ -108,7 +116,8 @@ bool D3D11VADecoder::initialize(uint8_t codec, uint32_t width, uint32_t height)
     codec_ctx_->thread_count = 1;
     codec_ctx_->flags |= AV_CODEC_FLAG_LOW_DELAY;
     codec_ctx_->flags2 |= AV_CODEC_FLAG2_FAST;
-    codec_ctx_->get_format = d3d11va_get_format;
+    // Surfaces held by frames in flight, queued for or being presented
+    codec_ctx_->extra_hw_frames = static_cast<int>(MAX_HELD_FRAMES + MAX_DECODE_IN_FLIGHT);
 
     // Create hardware device context wrapping our shared D3D11 device
     if (!createHwDeviceFromD3D11()) {
@@ -118,6 +127,7 @@ bool D3D11VADecoder::initialize(uint8_t codec, uint32_t width, uint32_t height)
     }
 
     codec_ctx_->hw_device_ctx = av_buffer_ref(hw_device_);
+    pool_.install(codec_ctx_, AV_PIX_FMT_D3D11, width, height);
 
     // Open codec
     int ret = avcodec_open2(codec_ctx_, codec_, nullptr);
@@ -140,6 +150,8 @@ bool D3D11VADecoder::initialize(uint8_t codec, uint32_t width, uint32_t height)
         return false;
     }
 
+    pipeline_.setD3D11Device(shared_device_);
+
     initialized_ = true;
     CS_LOG(INFO, "D3D11VADecoder initialized: %s %ux%u (zero-copy with renderer device)",
            avcodec_get_name(codec_id), width, height);
@@ -169,7 +181,6 @@ bool D3D11VADecoder::createHwDeviceFromD3D11() {
 
     // Get the immediate context
     shared_device_->GetImmediateContext(&d3d11_ctx->device_context);
-    shared_ctx_ = d3d11_ctx->device_context;
 
     // Initialize the device context
     int ret = av_hwdevice_ctx_init(hw_device_);
@@ -188,22 +199,28 @@ bool D3D11VADecoder::createHwDeviceFromD3D11() {
 }
 
 // ---------------------------------------------------------------------------
-// decode
+// submit / receive / getInFlight
 // ---------------------------------------------------------------------------
 
-bool D3D11VADecoder::decode(const uint8_t* data, size_t len, DecodedFrame& frame) {
+bool D3D11VADecoder::submit(const uint8_t* data, size_t len, uint64_t tag) {
     std::lock_guard<std::mutex> lock(mutex_);
 
     if (!initialized_ || !codec_ctx_) {
         return false;
     }
 
-    auto start = std::chrono::steady_clock::now();
+    uint64_t submit_us = getTimestampUs();
 
     packet_->data = const_cast<uint8_t*>(data);
     packet_->size = static_cast<int>(len);
 
+    const uint32_t sequences = pool_.getNegotiations();
     int ret = avcodec_send_packet(codec_ctx_, packet_);
+    if (pool_.noteUnit(sequences, submit_us, ret < 0 && ret != AVERROR(EAGAIN), reconfig_)) {
+        CS_LOG(INFO, "D3D11VADecoder: stream reconfigured to %dx%d in %.1f ms (pool %s)",
+               codec_ctx_->width, codec_ctx_->height, reconfig_.last_ms,
+               pool_.lastReused() ? "kept" : "reallocated");
+    }
     if (ret < 0 && ret != AVERROR(EAGAIN)) {
         if (ret != AVERROR_EOF) {
             char err_buf[AV_ERROR_MAX_STRING_SIZE];
@@ -213,32 +230,36 @@ bool D3D11VADecoder::decode(const uint8_t* data, size_t len, DecodedFrame& frame
         return false;
     }
 
+    // Low-delay streams give each unit's picture back straight away; the
+    // GPU may still be writing it.
+    DecodedFrame frame;
+    bool ok = false;
     ret = avcodec_receive_frame(codec_ctx_, frame_);
-    if (ret < 0) {
-        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
-            char err_buf[AV_ERROR_MAX_STRING_SIZE];
-            av_strerror(ret, err_buf, sizeof(err_buf));
-            CS_LOG(WARN, "D3D11VADecoder: receive_frame failed: %s", err_buf);
-        }
-        return false;
-    }
-
-    auto end = std::chrono::steady_clock::now();
-    double decode_ms = std::chrono::duration<double, std::milli>(end - start).count();
-
-    // Extract the D3D11 texture from the decoded frame
-    if (!extractFrame(frame_, frame)) {
+    if (ret >= 0) {
+        frame.timestamp_us = static_cast<uint64_t>(frame_->pts);
+        ok = extractFrame(frame_, frame);
+        // Empty unless the surface could not be held
         av_frame_unref(frame_);
-        return false;
+    } else if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+        char err_buf[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, err_buf, sizeof(err_buf));
+        CS_LOG(WARN, "D3D11VADecoder: receive_frame failed: %s", err_buf);
     }
 
-    frame.decode_time_ms = decode_ms;
-    frame.timestamp_us = static_cast<uint64_t>(frame_->pts);
-
-    av_frame_unref(frame_);
+    pipeline_.push(tag, submit_us, ok, std::move(frame));
     return true;
 }
 
+bool D3D11VADecoder::receive(DecodedFrame& frame, uint64_t& tag, bool& ok, uint32_t max_wait_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pipeline_.take(frame, tag, ok, max_wait_ms);
+}
+
+uint32_t D3D11VADecoder::getInFlight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pipeline_.size();
+}
+
 // ---------------------------------------------------------------------------
 // extractFrame
 // ---------------------------------------------------------------------------
@@ -255,6 +276,7 @@ bool D3D11VADecoder::extractFrame(AVFrame* hw_frame, DecodedFrame& out) {
         out.width = static_cast<uint32_t>(hw_frame->width);
         out.height = static_cast<uint32_t>(hw_frame->height);
         out.format = FrameFormat::NV12;
+        out.surface = holdFrame(hw_frame);
         return true;
     }
 #endif
@@ -274,6 +296,7 @@ bool D3D11VADecoder::extractFrame(AVFrame* hw_frame, DecodedFrame& out) {
     out.width = static_cast<uint32_t>(sw_frame_->width);
     out.height = static_cast<uint32_t>(sw_frame_->height);
     out.format = FrameFormat::NV12;
+    out.surface = holdFrame(sw_frame_);
     return true;
 }
 
@@ -286,6 +309,7 @@ void D3D11VADecoder::flush() {
     if (codec_ctx_) {
         avcodec_flush_buffers(codec_ctx_);
     }
+    pipeline_.clear();
 }
 
 // ---------------------------------------------------------------------------
@@ -295,27 +319,33 @@ void D3D11VADecoder::flush() {
 void D3D11VADecoder::release() {
     std::lock_guard<std::mutex> lock(mutex_);
 
+#ifdef _WIN32
+    pipeline_.setD3D11Device(nullptr);
+#else
+    pipeline_.clear();
+#endif
     if (packet_) { av_packet_free(&packet_); packet_ = nullptr; }
     if (sw_frame_) { av_frame_free(&sw_frame_); sw_frame_ = nullptr; }
     if (frame_) { av_frame_free(&frame_); frame_ = nullptr; }
     if (codec_ctx_) { avcodec_free_context(&codec_ctx_); codec_ctx_ = nullptr; }
+    pool_.reset();
     if (hw_device_) { av_buffer_unref(&hw_device_); hw_device_ = nullptr; }
 
-#ifdef _WIN32
-    if (staging_tex_) { staging_tex_->Release(); staging_tex_ = nullptr; }
-    // shared_ctx_ is obtained from the device context, released when device is destroyed
-    shared_ctx_ = nullptr;
     // Do not release shared_device_ -- we don't own it
-#endif
 
     codec_ = nullptr;
     initialized_ = false;
 }
 
 // ---------------------------------------------------------------------------
-// getName
+// getReconfigStats / getName
 // ---------------------------------------------------------------------------
 
+DecoderReconfigStats D3D11VADecoder::getReconfigStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reconfig_;
+}
+
 std::string D3D11VADecoder::getName() const {
     return "D3D11VADecoder(zero-copy)";
 }
@@ -4,11 +4,14 @@
 // Uses FFmpeg with specifically D3D11VA hardware acceleration configured.
 // Shares the D3D11 device with the renderer for zero-copy frame handoff:
 // the decoded texture lives on the same GPU device as the swap chain,
-// so rendering can happen without any CPU-side copy.
+// so rendering can happen without any CPU-side copy.  Each picture is
+// handed out only once the GPU has finished decoding it.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include "decoder_interface.h"
+#include "decode_pipeline.h"
+#include "hw_frame_pool.h"
 
 #include <mutex>
 #include <string>
@@ -33,9 +36,12 @@ public:
     ~D3D11VADecoder() override;
 
     bool initialize(uint8_t codec, uint32_t width, uint32_t height) override;
-    bool decode(const uint8_t* data, size_t len, DecodedFrame& frame) override;
+    bool submit(const uint8_t* data, size_t len, uint64_t tag) override;
+    bool receive(DecodedFrame& frame, uint64_t& tag, bool& ok, uint32_t max_wait_ms) override;
+    uint32_t getInFlight() const override;
     void flush() override;
     void release() override;
+    DecoderReconfigStats getReconfigStats() const override;
     std::string getName() const override;
 
 #ifdef _WIN32
@@ -67,15 +73,16 @@ private:
 #ifdef _WIN32
     // Shared D3D11 device from renderer
     ID3D11Device*        shared_device_ = nullptr;
-    ID3D11DeviceContext*  shared_ctx_   = nullptr;
-
-    // Staging texture for CPU-accessible copy (only used if direct sharing fails)
-    ID3D11Texture2D*      staging_tex_ = nullptr;
-    uint32_t staging_width_  = 0;
-    uint32_t staging_height_ = 0;
 #endif
 
-    std::mutex mutex_;
+    // Format negotiation; keeps the surface pool across sequence changes
+    HwFramePool          pool_;
+    DecoderReconfigStats reconfig_;
+
+    // Results of submitted units, handed out once the GPU is done
+    DecodePipeline pipeline_;
+
+    mutable std::mutex mutex_;
 };
 
 } // namespace cs
@@ -0,0 +1,158 @@
+///////////////////////////////////////////////////////////////////////////////
+// decode_pipeline.cpp -- In-flight decode results for the FFmpeg decoders
+//
+// The fence is signalled on the immediate context the hwaccel decodes on.
+// It is only flushed to the GPU when a wait actually needs it, so a result
+// that is already complete by the time it is taken costs no extra flush.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "decode_pipeline.h"
+
+#include <cs/common.h>
+
+#include <utility>
+
+#ifdef _WIN32
+#include <d3d11_4.h>
+#endif
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// Destructor
+// ---------------------------------------------------------------------------
+
+DecodePipeline::~DecodePipeline() {
+    clear();
+#ifdef _WIN32
+    releaseFence();
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// setD3D11Device / releaseFence
+// ---------------------------------------------------------------------------
+
+#ifdef _WIN32
+void DecodePipeline::setD3D11Device(ID3D11Device* device) {
+    clear();
+    releaseFence();
+    if (!device) return;
+
+    ID3D11Device5* device5 = nullptr;
+    if (FAILED(device->QueryInterface(__uuidof(ID3D11Device5),
+                                      reinterpret_cast<void**>(&device5)))) {
+        CS_LOG(INFO, "DecodePipeline: no D3D11 fences, decode results are not GPU-timed");
+        return;
+    }
+
+    ID3D11DeviceContext* context = nullptr;
+    device->GetImmediateContext(&context);
+    HRESULT hr = context->QueryInterface(__uuidof(ID3D11DeviceContext4),
+                                         reinterpret_cast<void**>(&context_));
+    context->Release();
+
+    if (SUCCEEDED(hr)) {
+        hr = device5->CreateFence(0, D3D11_FENCE_FLAG_NONE, __uuidof(ID3D11Fence),
+                                  reinterpret_cast<void**>(&fence_));
+    }
+    device5->Release();
+
+    if (SUCCEEDED(hr)) {
+        fence_event_ = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    }
+    if (FAILED(hr) || !fence_event_) {
+        CS_LOG(WARN, "DecodePipeline: fence setup failed, decode results are not GPU-timed");
+        releaseFence();
+    }
+}
+
+void DecodePipeline::releaseFence() {
+    if (fence_event_) { CloseHandle(fence_event_); fence_event_ = nullptr; }
+    if (fence_)       { fence_->Release(); fence_ = nullptr; }
+    if (context_)     { context_->Release(); context_ = nullptr; }
+    fence_value_ = 0;
+    flushed_value_ = 0;
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// push / take / clear
+// ---------------------------------------------------------------------------
+
+void DecodePipeline::push(uint64_t tag, uint64_t submit_us, bool ok, DecodedFrame&& frame) {
+    Pending entry;
+    entry.tag       = tag;
+    entry.submit_us = submit_us;
+    entry.ok        = ok;
+    entry.frame     = std::move(frame);
+
+#ifdef _WIN32
+    // Everything the hwaccel queued for this picture precedes the signal
+    if (ok && fence_) {
+        fence_value_++;
+        if (SUCCEEDED(context_->Signal(fence_, fence_value_))) {
+            entry.fence_value = fence_value_;
+        }
+    }
+#endif
+
+    pending_.push_back(std::move(entry));
+}
+
+bool DecodePipeline::take(DecodedFrame& frame, uint64_t& tag, bool& ok, uint32_t max_wait_ms) {
+    if (pending_.empty()) return false;
+
+    Pending& front = pending_.front();
+#ifdef _WIN32
+    if (front.fence_value != 0 && !waitForGpu(front, max_wait_ms)) {
+        return false;
+    }
+#else
+    (void)max_wait_ms;
+#endif
+
+    tag   = front.tag;
+    ok    = front.ok;
+    frame = std::move(front.frame);
+    if (ok) {
+        frame.decode_time_ms = static_cast<double>(getTimestampUs() - front.submit_us) / 1000.0;
+    }
+    pending_.pop_front();
+    return true;
+}
+
+void DecodePipeline::clear() {
+    pending_.clear();
+}
+
+// ---------------------------------------------------------------------------
+// waitForGpu
+// ---------------------------------------------------------------------------
+
+#ifdef _WIN32
+bool DecodePipeline::waitForGpu(const Pending& entry, uint32_t max_wait_ms) {
+    if (fence_->GetCompletedValue() >= entry.fence_value) return true;
+
+    // The signal may still sit in the context's command buffer
+    if (flushed_value_ < entry.fence_value) {
+        context_->Flush();
+        flushed_value_ = fence_value_;
+    }
+
+    // Re-checked after every wake: a registration left over from an
+    // earlier wait that timed out can set the event early.
+    const ULONGLONG deadline = GetTickCount64() + max_wait_ms;
+    while (fence_->GetCompletedValue() < entry.fence_value) {
+        ULONGLONG now = GetTickCount64();
+        if (now >= deadline) return false;
+        if (FAILED(fence_->SetEventOnCompletion(entry.fence_value, fence_event_))) {
+            return true;   // Cannot wait; hand it out ungated rather than stall
+        }
+        WaitForSingleObject(fence_event_, static_cast<DWORD>(deadline - now));
+    }
+    return true;
+}
+#endif
+
+} // namespace cs
@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+// decode_pipeline.h -- In-flight decode results for the FFmpeg decoders
+//
+// FFmpeg's hwaccels do the CPU side of a decode (parsing, building and
+// submitting the GPU commands) inside avcodec_send_packet(), and hand the
+// output surface back before the GPU has finished writing it.  The FFmpeg
+// decoders run that part in submit() and queue the result here.
+//
+// On Windows, with a D3D11 device that supports fences (Windows 10 1703
+// and later), each picture is held behind a fence signalled right after
+// it, so take() only returns a picture the GPU has finished and waits on
+// an event, not a poll.  decode_time_ms then covers the real GPU latency.
+// Otherwise a result is ready as soon as it is queued.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "decoder_interface.h"
+
+#include <cstdint>
+#include <deque>
+
+#ifdef _WIN32
+// ID3D11Device and HANDLE come with decoder_interface.h
+struct ID3D11DeviceContext4;
+struct ID3D11Fence;
+#endif
+
+namespace cs {
+
+class DecodePipeline {
+public:
+    DecodePipeline() = default;
+    ~DecodePipeline();
+
+    // Non-copyable
+    DecodePipeline(const DecodePipeline&) = delete;
+    DecodePipeline& operator=(const DecodePipeline&) = delete;
+
+#ifdef _WIN32
+    /// Fence results on |device|'s immediate context (null = no fencing).
+    void setD3D11Device(ID3D11Device* device);
+#endif
+
+    /// Queue the result of unit |tag|, submitted at |submit_us|.  A result
+    /// with a picture waits for the GPU work queued so far.
+    void push(uint64_t tag, uint64_t submit_us, bool ok, DecodedFrame&& frame);
+
+    /// Take the oldest result once it is ready, waiting up to
+    /// |max_wait_ms|.  Same contract as IDecoder::receive().
+    bool take(DecodedFrame& frame, uint64_t& tag, bool& ok, uint32_t max_wait_ms);
+
+    /// Results queued and not yet taken.
+    uint32_t size() const { return static_cast<uint32_t>(pending_.size()); }
+
+    /// Drop all queued results.
+    void clear();
+
+private:
+    struct Pending {
+        uint64_t     tag       = 0;
+        uint64_t     submit_us = 0;
+        bool         ok        = false;
+        DecodedFrame frame;
+#ifdef _WIN32
+        uint64_t     fence_value = 0;      // Picture written once fence_ reaches it
+#endif
+    };
+
+#ifdef _WIN32
+    /// Wait up to |max_wait_ms| for |entry|'s fence value.
+    bool waitForGpu(const Pending& entry, uint32_t max_wait_ms);
+
+    /// Drop the fence and context.
+    void releaseFence();
+
+    ID3D11DeviceContext4* context_     = nullptr;
+    ID3D11Fence*          fence_       = nullptr;
+    HANDLE                fence_event_ = nullptr;
+    uint64_t              fence_value_ = 0;      // Last value signalled
+    uint64_t              flushed_value_ = 0;    // Last value known submitted to the GPU
+#endif
+
+    std::deque<Pending> pending_;
+};
+
+} // namespace cs
@@ -5,10 +5,26 @@
 // (NVDEC/CUDA, D3D11VA, DXVA2, software). Each decoder takes compressed
 // NAL data and produces a DecodedFrame containing a D3D11 texture or
 // system-memory buffer ready for rendering.
+//
+// Hardware decoders hand out their own pool surfaces (a D3D11 texture
+// array slice, for instance) rather than copies.  DecodedFrame::surface
+// holds a reference that keeps the surface out of the pool until every
+// copy of the frame is gone, i.e. until the renderer has presented it.
+//
+// A stream whose sequence header changes in-band (the host stepping along
+// its resolution ladder) goes on through the same decoder: each backend
+// reconfigures itself without a release()/initialize(), keeping its device
+// and, where it can, its surface pool.  getReconfigStats() counts those.
+//
+// Decoding is pipelined: submit() queues an access unit and returns once
+// the CPU side is done, receive() hands results back in submission order
+// once the picture is actually ready.  The caller bounds how many units
+// are in flight at once (up to MAX_DECODE_IN_FLIGHT).
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <string>
 
 #ifdef _WIN32
@@ -28,6 +44,18 @@ enum class FrameFormat : uint8_t {
     YUV420 = 3,   // Planar I420 (software path)
 };
 
+/// Decoded frames the viewer keeps referenced at once after decode()
+/// returns them (the render queue's slots).  Decoders with a fixed surface
+/// pool add this many surfaces to what the codec itself needs.
+static constexpr uint32_t MAX_HELD_FRAMES = 3;
+
+/// Most access units the viewer keeps submitted but not yet received.
+/// Their surfaces are held too, so pools grow by this many as well.
+static constexpr uint32_t MAX_DECODE_IN_FLIGHT = 3;
+
+/// How long decode() waits for the picture of the unit it submitted.
+static constexpr uint32_t DECODE_WAIT_MS = 100;
+
 // ---------------------------------------------------------------------------
 // Decoded frame descriptor
 // ---------------------------------------------------------------------------
@@ -38,7 +66,12 @@ struct DecodedFrame {
     uint32_t    height;
     FrameFormat format;         // Typically NV12 from hardware decoders
     uint64_t    timestamp_us;   // Presentation timestamp in microseconds
-    double      decode_time_ms; // Time spent decoding this frame (performance metric)
+    double      decode_time_ms; // Submission to picture ready (performance metric)
+    uint64_t    first_arrival_us;   // Local clock: first packet of the frame in,
+    uint64_t    complete_us;        // its last packet in,
+    uint64_t    decoded_us;         // and the picture ready
+    std::shared_ptr<void> surface;  // Keeps |texture| valid; null if the decoder
+                                    // only guarantees it until the next decode()
 
     DecodedFrame()
         : texture(nullptr)
@@ -48,9 +81,22 @@ struct DecodedFrame {
         , format(FrameFormat::NV12)
         , timestamp_us(0)
         , decode_time_ms(0.0)
+        , first_arrival_us(0)
+        , complete_us(0)
+        , decoded_us(0)
     {}
 };
 
+// ---------------------------------------------------------------------------
+// In-band reconfigurations
+// ---------------------------------------------------------------------------
+struct DecoderReconfigStats {
+    uint32_t count       = 0;     // Sequence changes decoded through
+    uint32_t pool_kept   = 0;     // ... of which kept the surface pool
+    double   last_ms     = 0.0;   // Submit time of the unit that carried the last one
+    double   max_ms      = 0.0;
+};
+
 // ---------------------------------------------------------------------------
 // Abstract decoder interface
 // ---------------------------------------------------------------------------
@@ -62,18 +108,43 @@ public:
     /// Returns true on success.
     virtual bool initialize(uint8_t codec, uint32_t width, uint32_t height) = 0;
 
-    /// Decode a single NAL unit or access unit.
-    /// On success, populates `frame` and returns true.
-    /// Returns false if no frame is ready yet (e.g., B-frame reordering)
-    /// or if an error occurred.
-    virtual bool decode(const uint8_t* data, size_t len, DecodedFrame& frame) = 0;
+    /// Queue an access unit for decoding without waiting for its picture.
+    /// |data| need not outlive the call.  |tag| comes back with the result
+    /// from receive().  Returns false if the unit was rejected outright; it
+    /// then produces no result.
+    virtual bool submit(const uint8_t* data, size_t len, uint64_t tag) = 0;
+
+    /// Take the result of the oldest submitted unit, waiting up to
+    /// |max_wait_ms| for it.  Returns false if none was ready in time.
+    /// Otherwise |tag| names the unit and |ok| tells whether it produced a
+    /// picture, which is then in |frame| with decode_time_ms measured from
+    /// submit() to the picture being ready.
+    virtual bool receive(DecodedFrame& frame, uint64_t& tag, bool& ok,
+                         uint32_t max_wait_ms) = 0;
 
-    /// Flush any buffered frames out of the decoder pipeline.
+    /// Units submitted whose result receive() has not returned yet.
+    virtual uint32_t getInFlight() const = 0;
+
+    /// Decode a single access unit and wait for its picture.  Only
+    /// meaningful with nothing else in flight.  Returns false if no
+    /// picture came out of it.
+    bool decode(const uint8_t* data, size_t len, DecodedFrame& frame) {
+        uint64_t tag = 0;
+        bool ok = false;
+        if (!submit(data, len, 0)) return false;
+        return receive(frame, tag, ok, DECODE_WAIT_MS) && ok;
+    }
+
+    /// Drop everything in the decoder pipeline, including results not yet
+    /// received.
     virtual void flush() = 0;
 
     /// Release all resources. Safe to call multiple times.
     virtual void release() = 0;
 
+    /// In-band sequence changes so far.  Default: none tracked.
+    virtual DecoderReconfigStats getReconfigStats() const { return {}; }
+
     /// Return a human-readable name for this decoder backend.
     virtual std::string getName() const = 0;
 
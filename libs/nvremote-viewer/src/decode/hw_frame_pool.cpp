@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////////////
+// hw_frame_pool.cpp -- FFmpeg format negotiation with a surface pool that
+// outlives sequence changes
+//
+// FFmpeg unreferences ctx->hw_frames_ctx before every get_format() call, so
+// the pool keeps a reference of its own and hands out a new one each time.
+// The parameters FFmpeg would have used come from
+// avcodec_get_hw_frames_parameters(): the surface format and bind flags
+// stay its choice, only the size is raised, and a pool is reused only if
+// it has at least as many surfaces as the new sequence asks for.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "hw_frame_pool.h"
+
+#include <cs/common.h>
+
+#include <algorithm>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
+}
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// getFormat -- the get_format() callback
+// ---------------------------------------------------------------------------
+
+static enum AVPixelFormat getFormat(AVCodecContext* ctx, const enum AVPixelFormat* pix_fmts) {
+    auto* pool = static_cast<HwFramePool*>(ctx->opaque);
+    const auto desired = static_cast<AVPixelFormat>(pool->getHwFormat());
+
+    for (const enum AVPixelFormat* p = pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+        if (*p == desired) {
+            // Without a pool of ours FFmpeg allocates one as before
+            pool->attach(ctx);
+            return *p;
+        }
+    }
+
+    CS_LOG(WARN, "HwFramePool: desired hw pixel format not available, falling back");
+    return AV_PIX_FMT_NONE;
+}
+
+static uint32_t alignUp(uint32_t value, uint32_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// ---------------------------------------------------------------------------
+// Destructor / install / reset / disablePresize
+// ---------------------------------------------------------------------------
+
+HwFramePool::~HwFramePool() {
+    reset();
+}
+
+void HwFramePool::install(AVCodecContext* ctx, int hw_format,
+                          uint32_t max_width, uint32_t max_height) {
+    reset();
+    hw_format_    = hw_format;
+    max_width_    = max_width;
+    max_height_   = max_height;
+    presize_      = true;
+    negotiations_ = 0;
+    ctx->opaque     = this;
+    ctx->get_format = getFormat;
+}
+
+void HwFramePool::reset() {
+    if (frames_) {
+        av_buffer_unref(&frames_);
+        frames_ = nullptr;
+    }
+    oversized_   = false;
+    last_reused_ = false;
+}
+
+void HwFramePool::disablePresize() {
+    if (!presize_) return;
+    presize_ = false;
+    reset();
+    CS_LOG(WARN, "HwFramePool: hwaccel refused an oversized pool, sizing pools per sequence");
+}
+
+// ---------------------------------------------------------------------------
+// attach
+// ---------------------------------------------------------------------------
+
+bool HwFramePool::attach(AVCodecContext* ctx) {
+    negotiations_++;
+    last_reused_ = false;
+    if (hw_format_ != AV_PIX_FMT_D3D11 || !ctx->hw_device_ctx) return false;
+
+    AVBufferRef* wanted = nullptr;
+    int ret = avcodec_get_hw_frames_parameters(ctx, ctx->hw_device_ctx,
+                                               static_cast<AVPixelFormat>(hw_format_), &wanted);
+    if (ret < 0) {
+        CS_LOG(DEBUG, "HwFramePool: no frames parameters for this sequence, FFmpeg allocates");
+        return false;
+    }
+    auto* want = reinterpret_cast<AVHWFramesContext*>(wanted->data);
+
+    // The pool we have fits if it is as large, in the same format, with as
+    // many surfaces
+    if (frames_) {
+        auto* have = reinterpret_cast<AVHWFramesContext*>(frames_->data);
+        if (have->sw_format == want->sw_format &&
+            have->width >= want->width && have->height >= want->height &&
+            have->initial_pool_size >= want->initial_pool_size) {
+            oversized_ = have->width > want->width || have->height > want->height;
+            av_buffer_unref(&wanted);
+            ctx->hw_frames_ctx = av_buffer_ref(frames_);
+            if (!ctx->hw_frames_ctx) return false;
+            last_reused_ = true;
+            return true;
+        }
+        av_buffer_unref(&frames_);
+        frames_ = nullptr;
+    }
+
+    const int needed_width  = want->width;
+    const int needed_height = want->height;
+    if (presize_) {
+        want->width  = std::max(want->width,
+                                static_cast<int>(alignUp(max_width_, SURFACE_ALIGNMENT)));
+        want->height = std::max(want->height,
+                                static_cast<int>(alignUp(max_height_, SURFACE_ALIGNMENT)));
+    }
+
+    ret = av_hwframe_ctx_init(wanted);
+    if (ret < 0) {
+        char err_buf[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, err_buf, sizeof(err_buf));
+        CS_LOG(WARN, "HwFramePool: %dx%d pool creation failed: %s",
+               want->width, want->height, err_buf);
+        av_buffer_unref(&wanted);
+        return false;
+    }
+
+    frames_ = wanted;
+    ctx->hw_frames_ctx = av_buffer_ref(frames_);
+    if (!ctx->hw_frames_ctx) return false;
+    oversized_ = want->width > needed_width || want->height > needed_height;
+    CS_LOG(INFO, "HwFramePool: %d surfaces of %dx%d for a %dx%d sequence",
+           want->initial_pool_size, want->width, want->height,
+           ctx->coded_width, ctx->coded_height);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// noteUnit
+// ---------------------------------------------------------------------------
+
+bool HwFramePool::noteUnit(uint32_t negotiations_before, uint64_t submit_us, bool failed,
+                           DecoderReconfigStats& stats) {
+    if (negotiations_ == negotiations_before) return false;
+    if (failed && oversized_) {
+        // The next sequence header renegotiates at its own size
+        disablePresize();
+    }
+    if (negotiations_before == 0) return false;   // The stream's first sequence
+
+    const double ms = static_cast<double>(getTimestampUs() - submit_us) / 1000.0;
+    stats.count++;
+    if (last_reused_) stats.pool_kept++;
+    stats.last_ms = ms;
+    stats.max_ms  = std::max(stats.max_ms, ms);
+    return true;
+}
+
+} // namespace cs
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+// hw_frame_pool.h -- FFmpeg format negotiation with a surface pool that
+// outlives sequence changes
+//
+// When an in-band sequence header changes the coded size, FFmpeg calls
+// get_format() again and, left to itself, drops the hwaccel's frames
+// context and allocates a new one at the new size.  The FFmpeg decoders
+// install HwFramePool as their get_format() instead.  For D3D11 surfaces it
+// hands FFmpeg a frames context of its own, sized at the resolution the
+// decoder was initialized with (the session's, which the host's QoS
+// resolution ladder only steps down from), and hands out the same one
+// again while a new sequence fits in it.  A resolution step then costs
+// FFmpeg's decoder object and nothing else: the device, the pool's
+// textures and the renderer's video processor, which is keyed to the
+// texture size, all stay.
+//
+// A picture smaller than its surface sits in the surface's top-left
+// corner; DecodedFrame::width/height give the picture's own size.
+//
+// Other hwaccels (CUDA, DXVA2) get FFmpeg's pool, reallocated on every
+// change.  If a hwaccel will not take an oversized pool, disablePresize()
+// falls back to pools sized for each sequence exactly.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "decoder_interface.h"
+
+#include <cstdint>
+
+struct AVCodecContext;
+struct AVBufferRef;
+
+namespace cs {
+
+class HwFramePool {
+public:
+    HwFramePool() = default;
+    ~HwFramePool();
+
+    // Non-copyable
+    HwFramePool(const HwFramePool&) = delete;
+    HwFramePool& operator=(const HwFramePool&) = delete;
+
+    /// Negotiate |hw_format| (an AVPixelFormat) for |ctx|, pre-sizing
+    /// D3D11 pools for |max_width| x |max_height|.  Sets ctx->get_format
+    /// and ctx->opaque; call before avcodec_open2().
+    void install(AVCodecContext* ctx, int hw_format, uint32_t max_width, uint32_t max_height);
+
+    /// get_format() chose the hw format for a new sequence in |ctx|: point
+    /// ctx->hw_frames_ctx at a pool that fits it.  Returns false if the
+    /// pool is left to FFmpeg.
+    bool attach(AVCodecContext* ctx);
+
+    /// avcodec_send_packet() took a unit submitted at |submit_us|, with
+    /// |negotiations_before| sequences set up before it and |failed| if
+    /// FFmpeg rejected it.  If it brought a new sequence (but not the
+    /// first), counts it in |stats| and returns true.  A rejected unit on
+    /// an oversized pool turns pre-sizing off.
+    bool noteUnit(uint32_t negotiations_before, uint64_t submit_us, bool failed,
+                  DecoderReconfigStats& stats);
+
+    /// Pool for each sequence's own size from now on.
+    void disablePresize();
+
+    /// Drop the pool (frames still held keep their surfaces).
+    void reset();
+
+    /// The AVPixelFormat negotiated for.
+    int getHwFormat() const { return hw_format_; }
+
+    /// Sequences FFmpeg has set up so far (attach() calls).
+    uint32_t getNegotiations() const { return negotiations_; }
+
+    /// Whether the last negotiation kept the pool it already had.
+    bool lastReused() const { return last_reused_; }
+
+    /// Whether the current pool is larger than its sequence needs.
+    bool isOversized() const { return oversized_; }
+
+private:
+    /// Surface alignment FFmpeg's D3D11VA hwaccel needs at most (HEVC, AV1).
+    static constexpr uint32_t SURFACE_ALIGNMENT = 128;
+
+    AVBufferRef* frames_       = nullptr;   // Our own pool, or null
+    int          hw_format_    = -1;
+    uint32_t     max_width_    = 0;
+    uint32_t     max_height_   = 0;
+    bool         presize_      = true;
+    bool         oversized_    = false;
+    bool         last_reused_  = false;
+    uint32_t     negotiations_ = 0;
+};
+
+} // namespace cs
@@ -1,8 +1,17 @@
 ///////////////////////////////////////////////////////////////////////////////
 // nvdec_decoder.cpp -- Hardware-accelerated video decoder via FFmpeg hwaccel
 //
-// Attempts GPU decode in order: CUDA -> D3D11VA -> DXVA2 -> software.
-// Uses the FFmpeg libavcodec API for all paths.
+// Attempts GPU decode in order: shared D3D11VA -> CUDA -> D3D11VA ->
+// DXVA2 -> software.  Uses the FFmpeg libavcodec API for all paths.
+//
+// There is no CUDA -> D3D11 interop here, so CUDA frames always take a
+// copy through system memory.  With a renderer device set, D3D11VA on that
+// device comes first: it drives the same NVDEC engine on NVIDIA GPUs and
+// its surfaces go to the video processor as they are.
+//
+// submit() runs FFmpeg's side of the decode and queues the result in a
+// DecodePipeline; on the shared device it is fenced, so receive() hands
+// surfaces out once the GPU has written them.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "nvdec_decoder.h"
@@ -10,7 +19,7 @@
 #include <cs/common.h>
 #include <cs/transport/packet.h>
 
-#include <chrono>
+#include <utility>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -30,21 +39,16 @@ extern "C" {
 
 namespace cs {
 
-// ---------------------------------------------------------------------------
-// Pixel format negotiation callback for hwaccel
-// ---------------------------------------------------------------------------
-static enum AVPixelFormat getHwFormat(AVCodecContext* ctx, const enum AVPixelFormat* pix_fmts) {
-    // The user-data carries the desired hw pixel format
-    auto desired = static_cast<AVPixelFormat>(reinterpret_cast<intptr_t>(ctx->opaque));
-
-    for (const enum AVPixelFormat* p = pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
-        if (*p == desired) {
-            return *p;
-        }
-    }
-
-    CS_LOG(WARN, "NvdecDecoder: desired hw pixel format not available, falling back");
-    return AV_PIX_FMT_NONE;
+/// Move |frame|'s buffers into a new reference-counted AVFrame, leaving
+/// |frame| empty.  Returns null (and leaves |frame| alone) on failure.
+static std::shared_ptr<void> holdFrame(AVFrame* frame) {
+    AVFrame* held = av_frame_alloc();
+    if (!held) return nullptr;
+    av_frame_move_ref(held, frame);
+    return std::shared_ptr<void>(held, [](void* p) {
+        AVFrame* f = static_cast<AVFrame*>(p);
+        av_frame_free(&f);
+    });
 }
 
 // ---------------------------------------------------------------------------
@@ -106,6 +110,9 @@ bool NvdecDecoder::initialize(uint8_t codec, uint32_t width, uint32_t height) {
     codec_ctx_->flags |= AV_CODEC_FLAG_LOW_DELAY;
     codec_ctx_->flags2 |= AV_CODEC_FLAG2_FAST;
 
+    // Surfaces held by frames in flight, queued for or being presented
+    codec_ctx_->extra_hw_frames = static_cast<int>(MAX_HELD_FRAMES + MAX_DECODE_IN_FLIGHT);
+
     // Try hardware acceleration
     if (!configureHwAccel()) {
         CS_LOG(WARN, "NvdecDecoder: all HW backends failed, using software decode");
@@ -134,6 +141,11 @@ bool NvdecDecoder::initialize(uint8_t codec, uint32_t width, uint32_t height) {
         return false;
     }
 
+#ifdef _WIN32
+    // Only surfaces on the renderer's device are handed out as they are
+    pipeline_.setD3D11Device(hw_type_ == AV_HWDEVICE_TYPE_D3D11VA ? shared_device_ : nullptr);
+#endif
+
     initialized_ = true;
     CS_LOG(INFO, "NvdecDecoder initialized: backend=%s codec=%s %ux%u",
            backend_name_.c_str(), avcodec_get_name(codec_id), width, height);
@@ -147,12 +159,26 @@ bool NvdecDecoder::initialize(uint8_t codec, uint32_t width, uint32_t height) {
 bool NvdecDecoder::configureHwAccel() {
     // Try hardware accelerators in priority order
 
-    // 1. CUDA (NVIDIA GPUs)
+#ifdef _WIN32
+    // 1. D3D11VA on the renderer's device (zero-copy)
+    if (shared_device_) {
+        hw_device_ = tryCreateHwDevice(AV_HWDEVICE_TYPE_D3D11VA);
+        if (hw_device_) {
+            codec_ctx_->hw_device_ctx = av_buffer_ref(hw_device_);
+            pool_.install(codec_ctx_, AV_PIX_FMT_D3D11, width_, height_);
+            hw_type_ = AV_HWDEVICE_TYPE_D3D11VA;
+            backend_name_ = "D3D11VA(zero-copy)";
+            CS_LOG(INFO, "NvdecDecoder: using D3D11VA on the renderer device");
+            return true;
+        }
+    }
+#endif
+
+    // 2. CUDA (NVIDIA GPUs)
     hw_device_ = tryCreateHwDevice(AV_HWDEVICE_TYPE_CUDA);
     if (hw_device_) {
         codec_ctx_->hw_device_ctx = av_buffer_ref(hw_device_);
-        codec_ctx_->opaque = reinterpret_cast<void*>(static_cast<intptr_t>(AV_PIX_FMT_CUDA));
-        codec_ctx_->get_format = getHwFormat;
+        pool_.install(codec_ctx_, AV_PIX_FMT_CUDA, width_, height_);
         hw_type_ = AV_HWDEVICE_TYPE_CUDA;
         backend_name_ = "CUDA/NVDEC";
         CS_LOG(INFO, "NvdecDecoder: using CUDA hardware acceleration");
@@ -160,24 +186,23 @@ bool NvdecDecoder::configureHwAccel() {
     }
 
 #ifdef _WIN32
-    // 2. D3D11VA (Windows 8+, broad GPU support)
-    hw_device_ = tryCreateHwDevice(AV_HWDEVICE_TYPE_D3D11VA);
+    // 3. D3D11VA (Windows 8+, broad GPU support) -- already tried above
+    //    if there is a renderer device
+    hw_device_ = shared_device_ ? nullptr : tryCreateHwDevice(AV_HWDEVICE_TYPE_D3D11VA);
     if (hw_device_) {
         codec_ctx_->hw_device_ctx = av_buffer_ref(hw_device_);
-        codec_ctx_->opaque = reinterpret_cast<void*>(static_cast<intptr_t>(AV_PIX_FMT_D3D11));
-        codec_ctx_->get_format = getHwFormat;
+        pool_.install(codec_ctx_, AV_PIX_FMT_D3D11, width_, height_);
         hw_type_ = AV_HWDEVICE_TYPE_D3D11VA;
         backend_name_ = "D3D11VA";
         CS_LOG(INFO, "NvdecDecoder: using D3D11VA hardware acceleration");
         return true;
     }
 
-    // 3. DXVA2 (legacy, Windows 7+)
+    // 4. DXVA2 (legacy, Windows 7+)
     hw_device_ = tryCreateHwDevice(AV_HWDEVICE_TYPE_DXVA2);
     if (hw_device_) {
         codec_ctx_->hw_device_ctx = av_buffer_ref(hw_device_);
-        codec_ctx_->opaque = reinterpret_cast<void*>(static_cast<intptr_t>(AV_PIX_FMT_DXVA2_VLD));
-        codec_ctx_->get_format = getHwFormat;
+        pool_.install(codec_ctx_, AV_PIX_FMT_DXVA2_VLD, width_, height_);
         hw_type_ = AV_HWDEVICE_TYPE_DXVA2;
         backend_name_ = "DXVA2";
         CS_LOG(INFO, "NvdecDecoder: using DXVA2 hardware acceleration");
@@ -197,34 +222,29 @@ AVBufferRef* NvdecDecoder::tryCreateHwDevice(int hw_type) {
 
 #ifdef _WIN32
     // For D3D11VA, if we have a shared D3D11 device from the renderer,
-    // wrap it directly for zero-copy
+    // wrap it directly for zero-copy.  The context is allocated empty so
+    // FFmpeg never creates (and then drops) a device of its own.
     if (hw_type == AV_HWDEVICE_TYPE_D3D11VA && shared_device_) {
-        int ret = av_hwdevice_ctx_create(&device,
-                                         static_cast<AVHWDeviceType>(hw_type),
-                                         nullptr, nullptr, 0);
-        if (ret >= 0 && device) {
-            // Get the D3D11 device context and replace with our shared device
-            auto* hw_ctx = reinterpret_cast<AVHWDeviceContext*>(device->data);
-            auto* d3d11_ctx = static_cast<AVD3D11VADeviceContext*>(hw_ctx->hwctx);
-            // Release the auto-created device and use ours
-            if (d3d11_ctx->device) {
-                d3d11_ctx->device->Release();
-            }
-            d3d11_ctx->device = shared_device_;
-            shared_device_->AddRef();
-
-            if (d3d11_ctx->device_context) {
-                d3d11_ctx->device_context->Release();
-            }
-            shared_device_->GetImmediateContext(&d3d11_ctx->device_context);
-
-            ret = av_hwdevice_ctx_init(device);
-            if (ret < 0) {
-                av_buffer_unref(&device);
-                device = nullptr;
-            }
-            return device;
+        device = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_D3D11VA);
+        if (!device) {
+            return nullptr;
+        }
+
+        auto* hw_ctx = reinterpret_cast<AVHWDeviceContext*>(device->data);
+        auto* d3d11_ctx = static_cast<AVD3D11VADeviceContext*>(hw_ctx->hwctx);
+        d3d11_ctx->device = shared_device_;
+        shared_device_->AddRef();
+        shared_device_->GetImmediateContext(&d3d11_ctx->device_context);
+
+        int ret = av_hwdevice_ctx_init(device);
+        if (ret < 0) {
+            char err_buf[AV_ERROR_MAX_STRING_SIZE];
+            av_strerror(ret, err_buf, sizeof(err_buf));
+            CS_LOG(DEBUG, "NvdecDecoder: shared D3D11VA device init failed: %s", err_buf);
+            av_buffer_unref(&device);
+            return nullptr;
         }
+        return device;
     }
 #endif
 
@@ -244,23 +264,29 @@ AVBufferRef* NvdecDecoder::tryCreateHwDevice(int hw_type) {
 }
 
 // ---------------------------------------------------------------------------
-// decode
+// submit / receive / getInFlight
 // ---------------------------------------------------------------------------
 
-bool NvdecDecoder::decode(const uint8_t* data, size_t len, DecodedFrame& frame) {
+bool NvdecDecoder::submit(const uint8_t* data, size_t len, uint64_t tag) {
     std::lock_guard<std::mutex> lock(mutex_);
 
     if (!initialized_ || !codec_ctx_ || !frame_ || !packet_) {
         return false;
     }
 
-    auto start = std::chrono::steady_clock::now();
+    uint64_t submit_us = getTimestampUs();
 
     // Feed data to the decoder
     packet_->data = const_cast<uint8_t*>(data);
     packet_->size = static_cast<int>(len);
 
+    const uint32_t sequences = pool_.getNegotiations();
     int ret = avcodec_send_packet(codec_ctx_, packet_);
+    if (pool_.noteUnit(sequences, submit_us, ret < 0 && ret != AVERROR(EAGAIN), reconfig_)) {
+        CS_LOG(INFO, "NvdecDecoder: stream reconfigured to %dx%d in %.1f ms (pool %s)",
+               codec_ctx_->width, codec_ctx_->height, reconfig_.last_ms,
+               pool_.lastReused() ? "kept" : "reallocated");
+    }
     if (ret < 0) {
         if (ret == AVERROR(EAGAIN)) {
             // Decoder buffer full, try receiving first
@@ -274,44 +300,49 @@ bool NvdecDecoder::decode(const uint8_t* data, size_t len, DecodedFrame& frame)
         }
     }
 
-    // Try to receive a decoded frame
+    // Low-delay streams give each unit's picture back straight away
+    DecodedFrame frame;
+    bool ok = false;
     ret = avcodec_receive_frame(codec_ctx_, frame_);
-    if (ret < 0) {
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            return false;  // No frame ready yet
+    if (ret >= 0) {
+        frame.timestamp_us = static_cast<uint64_t>(frame_->pts);
+
+        // Transfer from hardware surface if needed
+        if (frame_->format == AV_PIX_FMT_CUDA ||
+            frame_->format == AV_PIX_FMT_D3D11 ||
+            frame_->format == AV_PIX_FMT_DXVA2_VLD) {
+            ok = transferHwFrame(frame_, frame);
+        } else {
+            // Software frame: store the raw data pointer
+            frame.texture = frame_->data[0];
+            frame.subresource = 0;
+            frame.width = static_cast<uint32_t>(frame_->width);
+            frame.height = static_cast<uint32_t>(frame_->height);
+            frame.format = mapPixelFormat(frame_->format);
+            frame.surface = holdFrame(frame_);
+            ok = true;
         }
+
+        // Empty unless the frame could not be held
+        av_frame_unref(frame_);
+    } else if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
         char err_buf[AV_ERROR_MAX_STRING_SIZE];
         av_strerror(ret, err_buf, sizeof(err_buf));
         CS_LOG(WARN, "NvdecDecoder: avcodec_receive_frame failed: %s", err_buf);
-        return false;
     }
 
-    auto decode_end = std::chrono::steady_clock::now();
-    double decode_ms = std::chrono::duration<double, std::milli>(decode_end - start).count();
-
-    // Transfer from hardware surface if needed
-    if (frame_->format == AV_PIX_FMT_CUDA ||
-        frame_->format == AV_PIX_FMT_D3D11 ||
-        frame_->format == AV_PIX_FMT_DXVA2_VLD) {
-
-        if (!transferHwFrame(frame_, frame)) {
-            av_frame_unref(frame_);
-            return false;
-        }
-    } else {
-        // Software frame: store the raw data pointer
-        frame.texture = frame_->data[0];
-        frame.subresource = 0;
-        frame.width = static_cast<uint32_t>(frame_->width);
-        frame.height = static_cast<uint32_t>(frame_->height);
-        frame.format = mapPixelFormat(frame_->format);
-    }
+    pipeline_.push(tag, submit_us, ok, std::move(frame));
+    return true;
+}
 
-    frame.decode_time_ms = decode_ms;
-    frame.timestamp_us = static_cast<uint64_t>(frame_->pts);
+bool NvdecDecoder::receive(DecodedFrame& frame, uint64_t& tag, bool& ok, uint32_t max_wait_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pipeline_.take(frame, tag, ok, max_wait_ms);
+}
 
-    av_frame_unref(frame_);
-    return true;
+uint32_t NvdecDecoder::getInFlight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pipeline_.size();
 }
 
 // ---------------------------------------------------------------------------
@@ -330,6 +361,7 @@ bool NvdecDecoder::transferHwFrame(AVFrame* hw_frame, DecodedFrame& out) {
         out.width = static_cast<uint32_t>(hw_frame->width);
         out.height = static_cast<uint32_t>(hw_frame->height);
         out.format = FrameFormat::NV12;
+        out.surface = holdFrame(hw_frame);
         return true;
     }
 #endif
@@ -344,75 +376,13 @@ bool NvdecDecoder::transferHwFrame(AVFrame* hw_frame, DecodedFrame& out) {
         return false;
     }
 
-#ifdef _WIN32
-    // Upload to a staging D3D11 texture if we have a shared device
-    if (shared_device_) {
-        uint32_t w = static_cast<uint32_t>(sw_frame_->width);
-        uint32_t h = static_cast<uint32_t>(sw_frame_->height);
-
-        // Recreate staging texture if size changed
-        if (!staging_tex_ || staging_width_ != w || staging_height_ != h) {
-            if (staging_tex_) {
-                staging_tex_->Release();
-                staging_tex_ = nullptr;
-            }
-
-            D3D11_TEXTURE2D_DESC desc = {};
-            desc.Width = w;
-            desc.Height = h;
-            desc.MipLevels = 1;
-            desc.ArraySize = 1;
-            desc.Format = DXGI_FORMAT_NV12;
-            desc.SampleDesc.Count = 1;
-            desc.Usage = D3D11_USAGE_DEFAULT;
-            desc.BindFlags = D3D11_BIND_DECODER;
-
-            HRESULT hr = shared_device_->CreateTexture2D(&desc, nullptr, &staging_tex_);
-            if (FAILED(hr)) {
-                CS_LOG(ERR, "NvdecDecoder: failed to create staging texture: 0x%08lx", hr);
-                av_frame_unref(sw_frame_);
-                return false;
-            }
-
-            staging_width_ = w;
-            staging_height_ = h;
-        }
-
-        // Copy NV12 data to the texture
-        if (!shared_ctx_) {
-            shared_device_->GetImmediateContext(&shared_ctx_);
-        }
-
-        D3D11_MAPPED_SUBRESOURCE mapped = {};
-        // We can't map a DEFAULT usage texture directly, so use UpdateSubresource
-        // For NV12: Y plane is WxH, UV plane is Wx(H/2)
-        // Copy Y plane
-        for (uint32_t row = 0; row < h; row++) {
-            // Using UpdateSubresource with the whole texture
-        }
-
-        // Alternative: create a staging texture with DYNAMIC usage
-        // For simplicity, just pass the sw_frame data pointer
-        out.texture = sw_frame_->data[0];
-        out.subresource = 0;
-        out.width = w;
-        out.height = h;
-        out.format = FrameFormat::NV12;
-
-        av_frame_unref(sw_frame_);
-        return true;
-    }
-#endif
-
-    // Pure software path
+    // System memory copy, held like a surface
     out.texture = sw_frame_->data[0];
     out.subresource = 0;
     out.width = static_cast<uint32_t>(sw_frame_->width);
     out.height = static_cast<uint32_t>(sw_frame_->height);
     out.format = mapPixelFormat(sw_frame_->format);
-
-    // Note: the caller must consume this frame before the next decode call
-    // because sw_frame_ will be overwritten.
+    out.surface = holdFrame(sw_frame_);
     return true;
 }
 
@@ -426,6 +396,7 @@ void NvdecDecoder::flush() {
     if (codec_ctx_) {
         avcodec_flush_buffers(codec_ctx_);
     }
+    pipeline_.clear();
 }
 
 // ---------------------------------------------------------------------------
@@ -435,6 +406,12 @@ void NvdecDecoder::flush() {
 void NvdecDecoder::release() {
     std::lock_guard<std::mutex> lock(mutex_);
 
+#ifdef _WIN32
+    pipeline_.setD3D11Device(nullptr);
+#else
+    pipeline_.clear();
+#endif
+
     if (packet_) {
         av_packet_free(&packet_);
         packet_ = nullptr;
@@ -455,22 +432,14 @@ void NvdecDecoder::release() {
         codec_ctx_ = nullptr;
     }
 
+    pool_.reset();
+
     if (hw_device_) {
         av_buffer_unref(&hw_device_);
         hw_device_ = nullptr;
     }
 
-#ifdef _WIN32
-    if (staging_tex_) {
-        staging_tex_->Release();
-        staging_tex_ = nullptr;
-    }
-    if (shared_ctx_) {
-        shared_ctx_->Release();
-        shared_ctx_ = nullptr;
-    }
     // Note: shared_device_ is not owned by us, don't release it
-#endif
 
     codec_ = nullptr;
     initialized_ = false;
@@ -479,9 +448,14 @@ void NvdecDecoder::release() {
 }
 
 // ---------------------------------------------------------------------------
-// getName
+// getReconfigStats / getName
 // ---------------------------------------------------------------------------
 
+DecoderReconfigStats NvdecDecoder::getReconfigStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reconfig_;
+}
+
 std::string NvdecDecoder::getName() const {
     return "NvdecDecoder(" + backend_name_ + ")";
 }
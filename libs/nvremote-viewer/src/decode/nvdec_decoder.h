@@ -2,17 +2,22 @@
 // nvdec_decoder.h -- Hardware-accelerated video decoder via FFmpeg hwaccel
 //
 // Attempts GPU decoding in the following order:
-//   1. CUDA (AV_HWDEVICE_TYPE_CUDA) -- best for NVIDIA GPUs
-//   2. D3D11VA (AV_HWDEVICE_TYPE_D3D11VA) -- broad Windows support
-//   3. DXVA2 (AV_HWDEVICE_TYPE_DXVA2) -- legacy fallback
-//   4. Software decode -- final fallback, always works
+//   1. D3D11VA on the renderer's device -- zero-copy, NVDEC on NVIDIA GPUs
+//   2. CUDA (AV_HWDEVICE_TYPE_CUDA) -- frames copied to system memory
+//   3. D3D11VA (AV_HWDEVICE_TYPE_D3D11VA) -- own device, no renderer set
+//   4. DXVA2 (AV_HWDEVICE_TYPE_DXVA2) -- legacy fallback
+//   5. Software decode -- final fallback, always works
 //
-// The decoded frames are transferred to D3D11 textures when possible
-// for zero-copy handoff to the renderer.
+// Every DecodedFrame holds a reference to the surface (or system memory
+// copy) it points at, so it stays valid until the renderer is done.
+//
+// In-band sequence changes are decoded through (see hw_frame_pool.h).
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include "decoder_interface.h"
+#include "decode_pipeline.h"
+#include "hw_frame_pool.h"
 
 #include <mutex>
 #include <string>
@@ -26,8 +31,6 @@ struct AVBufferRef;
 
 #ifdef _WIN32
 struct ID3D11Device;
-struct ID3D11DeviceContext;
-struct ID3D11Texture2D;
 #endif
 
 namespace cs {
@@ -38,9 +41,12 @@ public:
     ~NvdecDecoder() override;
 
     bool initialize(uint8_t codec, uint32_t width, uint32_t height) override;
-    bool decode(const uint8_t* data, size_t len, DecodedFrame& frame) override;
+    bool submit(const uint8_t* data, size_t len, uint64_t tag) override;
+    bool receive(DecodedFrame& frame, uint64_t& tag, bool& ok, uint32_t max_wait_ms) override;
+    uint32_t getInFlight() const override;
     void flush() override;
     void release() override;
+    DecoderReconfigStats getReconfigStats() const override;
     std::string getName() const override;
 
 #ifdef _WIN32
@@ -56,7 +62,8 @@ private:
     /// Configure the codec context for hardware acceleration.
     bool configureHwAccel();
 
-    /// Transfer a hardware frame to a staging texture accessible by the renderer.
+    /// Hand out a hardware frame: D3D11 surfaces directly, anything else
+    /// via a copy in system memory.
     bool transferHwFrame(AVFrame* hw_frame, DecodedFrame& out);
 
     /// Map an FFmpeg pixel format to our FrameFormat enum.
@@ -83,13 +90,16 @@ private:
     // D3D11 device sharing (set by renderer for zero-copy)
 #ifdef _WIN32
     ID3D11Device*        shared_device_  = nullptr;
-    ID3D11DeviceContext*  shared_ctx_    = nullptr;
-    ID3D11Texture2D*      staging_tex_  = nullptr;
-    uint32_t staging_width_  = 0;
-    uint32_t staging_height_ = 0;
 #endif
 
-    std::mutex mutex_;
+    // Format negotiation; keeps D3D11 surfaces across sequence changes
+    HwFramePool          pool_;
+    DecoderReconfigStats reconfig_;
+
+    // Results of submitted units, handed out once the GPU is done
+    DecodePipeline pipeline_;
+
+    mutable std::mutex mutex_;
 };
 
 } // namespace cs
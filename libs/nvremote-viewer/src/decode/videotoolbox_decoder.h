@@ -6,12 +6,18 @@
 //
 // Outputs CVPixelBufferRef (NV12) which can be imported into Metal
 // via CVMetalTextureCache for zero-copy rendering.
+//
+// Decoding is asynchronous: submit() returns once VideoToolbox has the
+// unit, and the output callback completes it later, on VideoToolbox's
+// thread.  receive() hands results back in submission order.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include "decoder_interface.h"
 
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <string>
 #include <vector>
 #include <mutex>
@@ -33,20 +39,34 @@ public:
     VideoToolboxDecoder& operator=(const VideoToolboxDecoder&) = delete;
 
     bool initialize(uint8_t codec, uint32_t width, uint32_t height) override;
-    bool decode(const uint8_t* data, size_t len, DecodedFrame& frame) override;
+    bool submit(const uint8_t* data, size_t len, uint64_t tag) override;
+    bool receive(DecodedFrame& frame, uint64_t& tag, bool& ok, uint32_t max_wait_ms) override;
+    uint32_t getInFlight() const override;
     void flush() override;
     void release() override;
+    DecoderReconfigStats getReconfigStats() const override;
     std::string getName() const override;
 
 private:
 #ifdef __APPLE__
-    /// Create the VTDecompressionSession from current SPS/PPS.
+    /// Move to the current SPS/PPS: hand them to the session if it
+    /// accepts them (|kept|), else create the session anew.
+    bool updateFormat(bool& kept);
+
+    /// Build a format description from the current SPS/PPS into |out|.
+    bool createFormatDescription(CMFormatDescriptionRef& out);
+
+    /// Create the VTDecompressionSession for format_desc_.
     bool createDecompressionSession();
 
     /// Parse H.264/H.265 NAL units to extract SPS/PPS.
     /// Returns true if parameter sets changed and session needs recreation.
     bool parseParameterSets(const uint8_t* data, size_t len);
 
+    /// Wait for VideoToolbox to deliver every submitted unit, then drop
+    /// the results not yet received.
+    void dropPending();
+
     /// Static callback from VideoToolbox when a frame is decoded.
     static void decompressionCallback(
         void* decompressionOutputRefCon,
@@ -69,9 +89,21 @@ private:
     std::vector<uint8_t> hevc_sps_;
     std::vector<uint8_t> hevc_pps_;
 
-    // Latest decoded pixel buffer (set by callback)
-    CVPixelBufferRef decoded_buffer_ = nullptr;
-    bool             decode_ok_      = false;
+    // Submitted units in submission order; the callback finds its entry
+    // by sequence number (passed as the source frame refcon).
+    struct Pending {
+        uint64_t         tag       = 0;
+        uint64_t         submit_us = 0;
+        uint64_t         done_us   = 0;
+        bool             done      = false;
+        bool             ok        = false;
+        CVPixelBufferRef buffer    = nullptr;   // Retained by the callback
+    };
+    std::deque<Pending>     pending_;
+    uint64_t                first_seq_ = 0;     // Sequence number of pending_.front()
+    uint64_t                next_seq_  = 0;
+    mutable std::mutex      pending_mutex_;
+    std::condition_variable pending_cv_;
 #endif
 
     uint8_t  codec_  = 0;
@@ -79,7 +111,9 @@ private:
     uint32_t height_ = 0;
     bool     initialized_ = false;
 
-    std::mutex mutex_;
+    DecoderReconfigStats reconfig_;
+
+    mutable std::mutex mutex_;
 };
 
 } // namespace cs
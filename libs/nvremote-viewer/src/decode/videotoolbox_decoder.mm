@@ -2,10 +2,22 @@
 // videotoolbox_decoder.mm -- macOS VideoToolbox hardware decoder
 //
 // Uses VTDecompressionSession for H.264/HEVC hardware decoding.
-// Outputs CVPixelBufferRef (NV12/420v) for zero-copy Metal rendering.
+// Outputs CVPixelBufferRef (NV12/420v) for zero-copy Metal rendering:
+// the buffers are IOSurface-backed and Metal-compatible, and the
+// DecodedFrame holds the only reference the decoder hands out.
 //
 // NAL unit format: Expects Annex B bitstream (start codes 00 00 00 01).
 // Extracts SPS/PPS from the stream to create CMFormatDescription.
+//
+// New parameter sets in the stream go to the running session if
+// VTDecompressionSessionCanAcceptFormatDescription() says it can take
+// them; only otherwise is the session rebuilt, after waiting out the units
+// still in it.  Its output buffers are pinned at the initialized size, so
+// the pixel buffer pool and the renderer's textures stay as they are.
+//
+// Units are decoded with kVTDecodeFrame_EnableAsynchronousDecompression
+// and not waited for: decode_time_ms is the time from submit() to the
+// output callback, i.e. the hardware decoder's own latency.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "videotoolbox_decoder.h"
@@ -13,6 +25,9 @@
 #include <cs/common.h>
 #include <cs/transport/packet.h>
 
+#include <algorithm>
+#include <chrono>
+
 #ifdef __APPLE__
 #import <Foundation/Foundation.h>
 #import <CoreVideo/CoreVideo.h>
@@ -81,23 +96,36 @@ bool VideoToolboxDecoder::initialize(uint8_t codec, uint32_t width, uint32_t hei
 }
 
 // ---------------------------------------------------------------------------
-// decode
+// submit
 // ---------------------------------------------------------------------------
 
-bool VideoToolboxDecoder::decode(const uint8_t* data, size_t len, DecodedFrame& frame) {
+bool VideoToolboxDecoder::submit(const uint8_t* data, size_t len, uint64_t tag) {
 #ifdef __APPLE__
     std::lock_guard<std::mutex> lock(mutex_);
 
     if (!initialized_ || !data || len == 0) return false;
 
+    uint64_t submit_us = getTimestampUs();
+
     // Parse NAL units to extract/update parameter sets
     bool params_changed = parseParameterSets(data, len);
 
-    // Create or recreate session if needed
+    // Create the session, or move it to the new parameter sets
     if (!session_ || params_changed) {
-        if (!createDecompressionSession()) {
+        const bool reconfigure = session_ != nullptr;
+        bool kept = false;
+        if (!updateFormat(kept)) {
             return false;
         }
+        if (reconfigure) {
+            const double ms = static_cast<double>(getTimestampUs() - submit_us) / 1000.0;
+            reconfig_.count++;
+            if (kept) reconfig_.pool_kept++;
+            reconfig_.last_ms = ms;
+            reconfig_.max_ms  = std::max(reconfig_.max_ms, ms);
+            CS_LOG(INFO, "VT: stream reconfigured in %.1f ms (session %s)",
+                   ms, kept ? "kept" : "recreated");
+        }
     }
 
     if (!session_) return false;
@@ -159,21 +187,27 @@ bool VideoToolboxDecoder::decode(const uint8_t* data, size_t len, DecodedFrame&
 
     if (avcc_data.empty()) return false;
 
-    // Create CMBlockBuffer from the AVCC data
+    // Create a CMBlockBuffer owning a copy of the AVCC data: the decode
+    // may still be reading it after this call returns.
     CMBlockBufferRef block_buffer = nullptr;
     OSStatus status = CMBlockBufferCreateWithMemoryBlock(
         kCFAllocatorDefault,
-        const_cast<uint8_t*>(avcc_data.data()),
+        nullptr,           // Allocate the block
         avcc_data.size(),
-        kCFAllocatorNull,  // Don't free the data
+        kCFAllocatorDefault,
         nullptr,
         0,
         avcc_data.size(),
-        0,
+        kCMBlockBufferAssureMemoryNowFlag,
         &block_buffer);
 
+    if (status == noErr && block_buffer) {
+        status = CMBlockBufferReplaceDataBytes(avcc_data.data(), block_buffer, 0, avcc_data.size());
+    }
+
     if (status != noErr || !block_buffer) {
         CS_LOG(WARN, "VT: CMBlockBufferCreateWithMemoryBlock failed: %d", (int)status);
+        if (block_buffer) CFRelease(block_buffer);
         return false;
     }
 
@@ -196,11 +230,16 @@ bool VideoToolboxDecoder::decode(const uint8_t* data, size_t len, DecodedFrame&
         return false;
     }
 
-    // Decode
-    decode_ok_ = false;
-    if (decoded_buffer_) {
-        CVPixelBufferRelease(decoded_buffer_);
-        decoded_buffer_ = nullptr;
+    // Queue the unit before decoding it: the callback can run before
+    // DecodeFrame returns.
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> plock(pending_mutex_);
+        seq = next_seq_++;
+        Pending entry;
+        entry.tag = tag;
+        entry.submit_us = submit_us;
+        pending_.push_back(entry);
     }
 
     VTDecodeFrameFlags flags = kVTDecodeFrame_EnableAsynchronousDecompression;
@@ -210,41 +249,84 @@ bool VideoToolboxDecoder::decode(const uint8_t* data, size_t len, DecodedFrame&
         session_,
         sample_buffer,
         flags,
-        nullptr,  // sourceFrameRefCon
+        reinterpret_cast<void*>(static_cast<uintptr_t>(seq)),  // sourceFrameRefCon
         &info_flags);
 
     CFRelease(sample_buffer);
 
     if (status != noErr) {
         CS_LOG(WARN, "VT: DecodeFrame failed: %d", (int)status);
+        // Rejected units produce no result, even if the callback saw them
+        std::lock_guard<std::mutex> plock(pending_mutex_);
+        if (!pending_.empty() && next_seq_ == seq + 1) {
+            if (pending_.back().buffer) CVPixelBufferRelease(pending_.back().buffer);
+            pending_.pop_back();
+            next_seq_ = seq;
+        }
         return false;
     }
 
-    // Wait for the decode to complete
-    VTDecompressionSessionWaitForAsynchronousFrames(session_);
+    return true;
+#else
+    (void)data; (void)len; (void)tag;
+    return false;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// receive / getInFlight
+// ---------------------------------------------------------------------------
 
-    if (!decode_ok_ || !decoded_buffer_) {
+bool VideoToolboxDecoder::receive(DecodedFrame& frame, uint64_t& tag, bool& ok,
+                                  uint32_t max_wait_ms) {
+#ifdef __APPLE__
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    if (!pending_cv_.wait_for(lock, std::chrono::milliseconds(max_wait_ms), [this]() {
+            return !pending_.empty() && pending_.front().done;
+        })) {
         return false;
     }
 
-    // Fill the output frame
-    frame.texture     = static_cast<void*>(decoded_buffer_);
-    frame.subresource = 0;
-    frame.width       = static_cast<uint32_t>(CVPixelBufferGetWidth(decoded_buffer_));
-    frame.height      = static_cast<uint32_t>(CVPixelBufferGetHeight(decoded_buffer_));
-    frame.format      = FrameFormat::NV12;
+    Pending entry = pending_.front();
+    pending_.pop_front();
+    first_seq_++;
+    lock.unlock();
 
-    // Transfer ownership: caller must ensure this pixel buffer stays alive
-    // until the Metal renderer has consumed it. The renderer will release it.
-    decoded_buffer_ = nullptr;
+    tag = entry.tag;
+    ok  = entry.ok && entry.buffer;
+    if (!ok) {
+        if (entry.buffer) CVPixelBufferRelease(entry.buffer);
+        return true;
+    }
 
+    frame.texture        = static_cast<void*>(entry.buffer);
+    frame.subresource    = 0;
+    frame.width          = static_cast<uint32_t>(CVPixelBufferGetWidth(entry.buffer));
+    frame.height         = static_cast<uint32_t>(CVPixelBufferGetHeight(entry.buffer));
+    frame.format         = FrameFormat::NV12;
+    frame.decode_time_ms = static_cast<double>(entry.done_us - entry.submit_us) / 1000.0;
+
+    // The callback's retain moves into the frame; the pixel buffer goes
+    // back to VideoToolbox's pool once the renderer has let go of it.
+    frame.surface = std::shared_ptr<void>(entry.buffer, [](void* p) {
+        CVPixelBufferRelease(static_cast<CVPixelBufferRef>(p));
+    });
     return true;
 #else
-    (void)data; (void)len; (void)frame;
+    (void)frame; (void)tag; (void)ok; (void)max_wait_ms;
     return false;
 #endif
 }
 
+uint32_t VideoToolboxDecoder::getInFlight() const {
+#ifdef __APPLE__
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    return static_cast<uint32_t>(pending_.size());
+#else
+    return 0;
+#endif
+}
+
 // ---------------------------------------------------------------------------
 // parseParameterSets
 // ---------------------------------------------------------------------------
@@ -302,22 +384,37 @@ bool VideoToolboxDecoder::parseParameterSets(const uint8_t* data, size_t len) {
 #endif
 
 // ---------------------------------------------------------------------------
-// createDecompressionSession
+// updateFormat / createFormatDescription / createDecompressionSession
 // ---------------------------------------------------------------------------
 
 #ifdef __APPLE__
-bool VideoToolboxDecoder::createDecompressionSession() {
-    // Tear down existing session
+bool VideoToolboxDecoder::updateFormat(bool& kept) {
+    kept = false;
+    CMFormatDescriptionRef desc = nullptr;
+    if (!createFormatDescription(desc)) return false;
+
+    // A session that takes the new description decodes on with the
+    // buffers it has: nothing to tear down, and no unit left to wait for
+    if (session_ && VTDecompressionSessionCanAcceptFormatDescription(session_, desc)) {
+        if (format_desc_) CFRelease(format_desc_);
+        format_desc_ = desc;
+        kept = true;
+        return true;
+    }
+
+    // Tear down existing session, letting units still in it complete
     if (session_) {
+        VTDecompressionSessionWaitForAsynchronousFrames(session_);
         VTDecompressionSessionInvalidate(session_);
         CFRelease(session_);
         session_ = nullptr;
     }
-    if (format_desc_) {
-        CFRelease(format_desc_);
-        format_desc_ = nullptr;
-    }
+    if (format_desc_) CFRelease(format_desc_);
+    format_desc_ = desc;
+    return createDecompressionSession();
+}
 
+bool VideoToolboxDecoder::createFormatDescription(CMFormatDescriptionRef& out) {
     bool is_hevc = (codec_ == static_cast<uint8_t>(CodecType::H265));
 
     if (is_hevc) {
@@ -336,7 +433,7 @@ bool VideoToolboxDecoder::createDecompressionSession() {
             param_sizes,
             4,  // NAL unit header length
             nullptr,
-            &format_desc_);
+            &out);
 
         if (status != noErr) {
             CS_LOG(ERR, "VT: CMVideoFormatDescriptionCreateFromHEVCParameterSets failed: %d", (int)status);
@@ -357,23 +454,37 @@ bool VideoToolboxDecoder::createDecompressionSession() {
             param_sets,
             param_sizes,
             4,  // NAL unit header length
-            &format_desc_);
+            &out);
 
         if (status != noErr) {
             CS_LOG(ERR, "VT: CMVideoFormatDescriptionCreateFromH264ParameterSets failed: %d", (int)status);
             return false;
         }
     }
+    return true;
+}
 
-    // Configure output pixel format: NV12 (kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange)
+bool VideoToolboxDecoder::createDecompressionSession() {
+    bool is_hevc = (codec_ == static_cast<uint8_t>(CodecType::H265));
+
+    // Configure output pixel format: NV12 (kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange).
+    // IOSurface backing is what lets CVMetalTextureCache wrap the planes
+    // without a copy.
     NSDictionary* dest_attrs = @{
         (__bridge NSString*)kCVPixelBufferPixelFormatTypeKey:
             @(kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange),
+        (__bridge NSString*)kCVPixelBufferIOSurfacePropertiesKey: @{},
         (__bridge NSString*)kCVPixelBufferMetalCompatibilityKey: @YES,
         (__bridge NSString*)kCVPixelBufferWidthKey: @(width_),
         (__bridge NSString*)kCVPixelBufferHeightKey: @(height_),
     };
 
+    // Ask for the hardware decoder explicitly; older macOS releases do not
+    // default to it for every codec.
+    NSDictionary* decoder_spec = @{
+        (__bridge NSString*)kVTVideoDecoderSpecification_EnableHardwareAcceleratedVideoDecoder: @YES,
+    };
+
     // Decoder callback
     VTDecompressionOutputCallbackRecord callback;
     callback.decompressionOutputCallback = decompressionCallback;
@@ -382,7 +493,7 @@ bool VideoToolboxDecoder::createDecompressionSession() {
     OSStatus status = VTDecompressionSessionCreate(
         kCFAllocatorDefault,
         format_desc_,
-        nullptr,   // videoDecoderSpecification
+        (__bridge CFDictionaryRef)decoder_spec,
         (__bridge CFDictionaryRef)dest_attrs,
         &callback,
         &session_);
@@ -392,8 +503,13 @@ bool VideoToolboxDecoder::createDecompressionSession() {
         return false;
     }
 
-    // Request real-time decoding (low latency)
+    // Real-time priority: decode each frame as soon as it is submitted, at
+    // the cost of power, and never trade latency for efficiency.
     VTSessionSetProperty(session_, kVTDecompressionPropertyKey_RealTime, kCFBooleanTrue);
+    if (@available(macOS 12.0, *)) {
+        VTSessionSetProperty(session_, kVTDecompressionPropertyKey_MaximizePowerEfficiency,
+                             kCFBooleanFalse);
+    }
 
     CS_LOG(INFO, "VT: decompression session created (%s, %ux%u)",
            is_hevc ? "HEVC" : "H.264", width_, height_);
@@ -408,7 +524,7 @@ bool VideoToolboxDecoder::createDecompressionSession() {
 #ifdef __APPLE__
 void VideoToolboxDecoder::decompressionCallback(
     void* decompressionOutputRefCon,
-    void* /*sourceFrameRefCon*/,
+    void* sourceFrameRefCon,
     OSStatus status,
     VTDecodeInfoFlags /*infoFlags*/,
     CVImageBufferRef imageBuffer,
@@ -416,16 +532,27 @@ void VideoToolboxDecoder::decompressionCallback(
     CMTime /*presentationDuration*/)
 {
     auto* self = static_cast<VideoToolboxDecoder*>(decompressionOutputRefCon);
+    auto seq = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(sourceFrameRefCon));
+    bool ok = status == noErr && imageBuffer;
+
+    {
+        std::lock_guard<std::mutex> lock(self->pending_mutex_);
+        // Units dropped by flush() are gone by now
+        if (seq < self->first_seq_ || seq - self->first_seq_ >= self->pending_.size()) {
+            return;
+        }
 
-    if (status != noErr || !imageBuffer) {
-        self->decode_ok_ = false;
-        return;
+        Pending& entry = self->pending_[static_cast<size_t>(seq - self->first_seq_)];
+        entry.done    = true;
+        entry.ok      = ok;
+        entry.done_us = getTimestampUs();
+        if (ok) {
+            // Retain the pixel buffer for the caller
+            CVPixelBufferRetain(imageBuffer);
+            entry.buffer = imageBuffer;
+        }
     }
-
-    // Retain the pixel buffer for the caller
-    CVPixelBufferRetain(imageBuffer);
-    self->decoded_buffer_ = imageBuffer;
-    self->decode_ok_ = true;
+    self->pending_cv_.notify_all();
 }
 #endif
 
@@ -436,11 +563,29 @@ void VideoToolboxDecoder::decompressionCallback(
 void VideoToolboxDecoder::flush() {
 #ifdef __APPLE__
     std::lock_guard<std::mutex> lock(mutex_);
+    dropPending();
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// dropPending
+// ---------------------------------------------------------------------------
+
+#ifdef __APPLE__
+void VideoToolboxDecoder::dropPending() {
+    // No callback may be outstanding for an entry about to go away
     if (session_) {
         VTDecompressionSessionWaitForAsynchronousFrames(session_);
     }
-#endif
+
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    for (Pending& entry : pending_) {
+        if (entry.buffer) CVPixelBufferRelease(entry.buffer);
+    }
+    pending_.clear();
+    first_seq_ = next_seq_;
 }
+#endif
 
 // ---------------------------------------------------------------------------
 // release
@@ -450,10 +595,7 @@ void VideoToolboxDecoder::release() {
 #ifdef __APPLE__
     std::lock_guard<std::mutex> lock(mutex_);
 
-    if (decoded_buffer_) {
-        CVPixelBufferRelease(decoded_buffer_);
-        decoded_buffer_ = nullptr;
-    }
+    dropPending();
 
     if (session_) {
         VTDecompressionSessionInvalidate(session_);
@@ -478,9 +620,14 @@ void VideoToolboxDecoder::release() {
 }
 
 // ---------------------------------------------------------------------------
-// getName
+// getReconfigStats / getName
 // ---------------------------------------------------------------------------
 
+DecoderReconfigStats VideoToolboxDecoder::getReconfigStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reconfig_;
+}
+
 std::string VideoToolboxDecoder::getName() const {
     return "VideoToolbox";
 }
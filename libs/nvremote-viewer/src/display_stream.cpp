@@ -0,0 +1,299 @@
+///////////////////////////////////////////////////////////////////////////////
+// display_stream.cpp -- One of the host's extra displays
+///////////////////////////////////////////////////////////////////////////////
+
+#include "display_stream.h"
+
+#ifdef _WIN32
+#include "decode/nvdec_decoder.h"
+#include "decode/d3d11va_decoder.h"
+#include "render/d3d11_renderer.h"
+#elif defined(__APPLE__)
+#include "decode/videotoolbox_decoder.h"
+#include "render/metal_renderer.h"
+#endif
+#include "render/frame_queue.h"
+#include "transport/jitter_buffer.h"
+#include "transport/nack_sender.h"
+
+#include <cs/common.h>
+#include <cs/thread_policy.h>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// Renderer and decoder selection
+// ---------------------------------------------------------------------------
+
+std::unique_ptr<IRenderer> createRenderer(void* window, uint32_t width, uint32_t height) {
+#ifdef _WIN32
+    auto d3d11 = std::make_unique<D3D11Renderer>();
+    if (!d3d11->initialize(window, width, height)) {
+        CS_LOG(ERR, "D3D11 renderer initialization failed");
+        return nullptr;
+    }
+    CS_LOG(INFO, "D3D11 renderer initialized: %ux%u", width, height);
+    return d3d11;
+#elif defined(__APPLE__)
+    auto metal = std::make_unique<MetalRenderer>();
+    if (!metal->initialize(window, width, height)) {
+        CS_LOG(ERR, "Metal renderer initialization failed");
+        return nullptr;
+    }
+    CS_LOG(INFO, "Metal renderer initialized: %ux%u", width, height);
+    return metal;
+#else
+    (void)window; (void)width; (void)height;
+    CS_LOG(ERR, "No renderer available on this platform");
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<IDecoder> createDecoder(uint8_t codec, uint32_t width, uint32_t height,
+                                        IRenderer* renderer) {
+#ifdef _WIN32
+    // Get D3D11 device for zero-copy sharing (renderer is D3D11Renderer on Windows)
+    ID3D11Device* shared_device = nullptr;
+    if (auto* d3d11_renderer = dynamic_cast<D3D11Renderer*>(renderer)) {
+        shared_device = d3d11_renderer->getDevice();
+    }
+
+    // Try D3D11VA decoder first (shares device with renderer for zero-copy)
+    auto d3d11va_dec = std::make_unique<D3D11VADecoder>();
+    if (shared_device) {
+        d3d11va_dec->setD3D11Device(shared_device);
+    }
+    if (d3d11va_dec->initialize(codec, width, height)) {
+        CS_LOG(INFO, "Decoder initialized: %s", d3d11va_dec->getName().c_str());
+        return d3d11va_dec;
+    }
+
+    // Fall back to generic NVDEC decoder (tries CUDA, then D3D11VA, then DXVA2, then software)
+    auto nvdec = std::make_unique<NvdecDecoder>();
+    if (shared_device) {
+        nvdec->setD3D11Device(shared_device);
+    }
+    if (nvdec->initialize(codec, width, height)) {
+        CS_LOG(INFO, "Decoder initialized: %s", nvdec->getName().c_str());
+        return nvdec;
+    }
+#elif defined(__APPLE__)
+    (void)renderer;
+    // VideoToolbox hardware decoder (H.264/HEVC via Apple Silicon)
+    auto vt_dec = std::make_unique<VideoToolboxDecoder>();
+    if (vt_dec->initialize(codec, width, height)) {
+        CS_LOG(INFO, "Decoder initialized: %s", vt_dec->getName().c_str());
+        return vt_dec;
+    }
+#else
+    (void)codec; (void)width; (void)height; (void)renderer;
+#endif
+
+    CS_LOG(ERR, "All decoder backends failed");
+    return nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// Constructor / Destructor
+// ---------------------------------------------------------------------------
+
+DisplayStream::DisplayStream(uint8_t stream_id)
+    : stream_id_(stream_id) {}
+
+DisplayStream::~DisplayStream() {
+    stop();
+}
+
+// ---------------------------------------------------------------------------
+// start / stop
+// ---------------------------------------------------------------------------
+
+bool DisplayStream::start(void* window, uint8_t codec, uint32_t width, uint32_t height,
+                          PresentMode present_mode, UpscaleMode upscale_mode,
+                          NackSender* nack_sender) {
+    if (running_.load()) return true;
+    if (!window) {
+        CS_LOG(ERR, "Display %u: no window handle", static_cast<unsigned>(stream_id_));
+        return false;
+    }
+
+    renderer_ = createRenderer(window, width, height);
+    if (!renderer_) return false;
+    renderer_->setPresentMode(present_mode);
+    renderer_->setUpscaleMode(upscale_mode);
+
+    decoder_ = createDecoder(codec, width, height, renderer_.get());
+    if (!decoder_) {
+        renderer_->release();
+        renderer_.reset();
+        return false;
+    }
+
+    // Extra displays are watched rather than played: release frames as
+    // soon as they are complete, like the Performance preset.
+    jitter_buffer_ = std::make_unique<JitterBuffer>();
+    jitter_buffer_->setImmediateRelease(true);
+    jitter_buffer_->setDepthRangeMs(0, 10);
+    render_queue_ = std::make_unique<FrameQueue>();
+    nack_sender_  = nack_sender;
+
+    awaiting_recovery_ = false;
+    in_flight_tag_ = 0;
+    running_.store(true);
+    decode_thread_ = std::thread(&DisplayStream::decodeThreadFunc, this);
+    render_thread_ = std::thread(&DisplayStream::renderThreadFunc, this);
+
+    CS_LOG(INFO, "Display %u started (%ux%u)", static_cast<unsigned>(stream_id_), width, height);
+    return true;
+}
+
+void DisplayStream::stop() {
+    if (!running_.exchange(false)) return;
+
+    if (jitter_buffer_) jitter_buffer_->interrupt();
+    if (render_queue_) render_queue_->interrupt();
+    if (decode_thread_.joinable()) decode_thread_.join();
+    if (render_thread_.joinable()) render_thread_.join();
+
+    if (renderer_) renderer_->release();
+    if (decoder_) decoder_->release();
+    render_queue_.reset();
+    renderer_.reset();
+    decoder_.reset();
+    nack_sender_ = nullptr;
+
+    CS_LOG(INFO, "Display %u stopped", static_cast<unsigned>(stream_id_));
+}
+
+// ---------------------------------------------------------------------------
+// onFragment
+// ---------------------------------------------------------------------------
+
+void DisplayStream::onFragment(const VideoPacketHeaderV2& header,
+                               const uint8_t* payload, size_t len) {
+    if (running_.load() && jitter_buffer_) {
+        jitter_buffer_->pushPacket(header, payload, len);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Decode thread
+// ---------------------------------------------------------------------------
+
+void DisplayStream::decodeThreadFunc() {
+    cs::ScopedThreadRole role(cs::ThreadRole::DECODE);
+    while (running_.load()) {
+        jitter_buffer_->waitForFrame(kDecodeIdleWakeMs);
+        if (!running_.load()) break;
+
+        JitterBuffer::FrameView frame;
+        VideoPacketHeaderV2 header;
+        while (jitter_buffer_->popFrame(frame, header)) {
+            if (!running_.load()) break;
+
+            checkFrameLoss();
+            if (skipUntilRecovered(header)) {
+                frames_dropped_++;
+                continue;
+            }
+
+            // One unit in flight: take the previous picture first
+            while (decoder_->getInFlight() > 0 && collectDecoded(kDecodeWaitMs)) {}
+
+            const uint64_t tag = next_tag_++;
+            in_flight_tag_   = tag;
+            in_flight_ts_us_ = header.timestamp_us;
+            if (!decoder_->submit(frame.data, frame.size, tag)) {
+                in_flight_tag_ = 0;
+                frames_dropped_++;
+            }
+        }
+
+        while (decoder_->getInFlight() > 0 && collectDecoded(kDecodeWaitMs)) {}
+        checkFrameLoss();
+    }
+}
+
+bool DisplayStream::collectDecoded(uint32_t max_wait_ms) {
+    DecodedFrame& decoded = render_queue_->writeSlot();
+    decoded = DecodedFrame();
+
+    uint64_t tag = 0;
+    bool ok = false;
+    if (!decoder_->receive(decoded, tag, ok, max_wait_ms)) return false;
+
+    if (!ok || tag != in_flight_tag_) {
+        decoded = DecodedFrame();
+        frames_dropped_++;
+        return true;
+    }
+    decoded.timestamp_us = in_flight_ts_us_;
+    frames_decoded_++;
+
+    if (render_queue_->publish()) {
+        renderer_->discardFrame(render_queue_->writeSlot());
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Frame loss recovery
+// ---------------------------------------------------------------------------
+
+void DisplayStream::checkFrameLoss() {
+    uint32_t first = 0;
+    uint32_t last  = 0;
+    if (!jitter_buffer_->takeLostFrames(first, last)) return;
+
+    if (!awaiting_recovery_) {
+        awaiting_recovery_ = true;
+        loss_first_ = first;
+        loss_last_  = last;
+        loss_time_  = std::chrono::steady_clock::now();
+    } else {
+        if (static_cast<int32_t>(first - loss_first_) < 0) loss_first_ = first;
+        if (static_cast<int32_t>(last - loss_last_) > 0)   loss_last_  = last;
+    }
+
+    if (nack_sender_) {
+        nack_sender_->reportFrameLoss(loss_first_, loss_last_, stream_id_);
+    }
+}
+
+bool DisplayStream::skipUntilRecovered(const VideoPacketHeaderV2& header) {
+    if (!awaiting_recovery_) return false;
+
+    // The host answers an extra display's loss with a keyframe; it does
+    // not mark recovery frames on these streams.
+    if (!header.keyframe() &&
+        std::chrono::steady_clock::now() - loss_time_ < kRecoveryTimeout) {
+        return true;
+    }
+
+    awaiting_recovery_ = false;
+    if (nack_sender_) {
+        nack_sender_->clearFrameLoss(stream_id_);
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// Render thread
+// ---------------------------------------------------------------------------
+
+void DisplayStream::renderThreadFunc() {
+    cs::ScopedThreadRole role(cs::ThreadRole::RENDER);
+    while (running_.load()) {
+        if (!renderer_->waitForBackBuffer(kRenderIdleWakeMs)) continue;
+        if (!renderer_->waitForPresent(kRenderIdleWakeMs)) {
+            render_queue_->waitForFrame(kRenderIdleWakeMs);
+        }
+        if (!running_.load()) break;
+
+        if (const DecodedFrame* frame = render_queue_->acquire()) {
+            renderer_->renderFrame(*frame);
+        }
+    }
+}
+
+} // namespace cs
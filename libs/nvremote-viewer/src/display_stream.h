@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+// display_stream.h -- One of the host's extra displays
+//
+// A host streaming several displays sends each as its own video stream,
+// told apart by the stream ID in the video header (wire v5).  Stream 0 is
+// the primary display and runs through the Viewer's own pipeline; every
+// other stream gets a DisplayStream: a jitter buffer, decoder and renderer
+// of its own, drawing into a window of its own.
+//
+// The streams share the connection: the receive thread, NACK sender, FEC
+// decoder and stats reporter are the Viewer's, and hand each of a stream's
+// fragments to onFragment().  Frame numbers are per stream, so a lost
+// frame is reported with the stream's ID; the stream then skips frames
+// until the host sends a keyframe.  Extra displays carry no cursor, and
+// decode one frame at a time.
+//
+// Thread model (per stream):
+//   - Decode thread: jitter buffer -> decoder -> render queue
+//   - Render thread: render queue -> present
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "decode/decoder_interface.h"
+#include "render/renderer_interface.h"
+
+#include <cs/transport/packet.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+namespace cs {
+
+class JitterBuffer;
+class NackSender;
+class FrameQueue;
+
+/// Open the platform's renderer on |window| at |width| x |height|, or null.
+std::unique_ptr<IRenderer> createRenderer(void* window, uint32_t width, uint32_t height);
+
+/// Open the best decoder for |codec| at |width| x |height|, sharing
+/// |renderer|'s device where the platform can, or null.
+std::unique_ptr<IDecoder> createDecoder(uint8_t codec, uint32_t width, uint32_t height,
+                                        IRenderer* renderer);
+
+// ---------------------------------------------------------------------------
+// DisplayStream
+// ---------------------------------------------------------------------------
+class DisplayStream {
+public:
+    explicit DisplayStream(uint8_t stream_id);
+    ~DisplayStream();
+
+    // Non-copyable
+    DisplayStream(const DisplayStream&) = delete;
+    DisplayStream& operator=(const DisplayStream&) = delete;
+
+    uint8_t getStreamId() const { return stream_id_; }
+
+    /// Open the renderer on |window| and a |codec| decoder, and start the
+    /// stream's threads.  Loss reports go through |nack_sender| (may be
+    /// null).
+    bool start(void* window, uint8_t codec, uint32_t width, uint32_t height,
+               PresentMode present_mode, UpscaleMode upscale_mode, NackSender* nack_sender);
+
+    /// Stop the threads and release the decoder and renderer.
+    void stop();
+
+    /// A video fragment of this stream (receive thread).
+    void onFragment(const VideoPacketHeaderV2& header, const uint8_t* payload, size_t len);
+
+    uint64_t getFramesDecoded() const { return frames_decoded_.load(); }
+    uint64_t getFramesDropped() const { return frames_dropped_.load(); }
+
+private:
+    void decodeThreadFunc();
+    void renderThreadFunc();
+
+    /// Report newly lost frames and start waiting for a keyframe.
+    void checkFrameLoss();
+
+    /// True if |header|'s frame still references a lost one.
+    bool skipUntilRecovered(const VideoPacketHeaderV2& header);
+
+    /// Take one decoded picture, waiting up to |max_wait_ms|, and hand it
+    /// to the render thread.  False if none was ready.
+    bool collectDecoded(uint32_t max_wait_ms);
+
+    const uint8_t                  stream_id_;
+    std::unique_ptr<IRenderer>     renderer_;
+    std::unique_ptr<IDecoder>      decoder_;
+    std::unique_ptr<JitterBuffer>  jitter_buffer_;
+    std::unique_ptr<FrameQueue>    render_queue_;
+    NackSender*                    nack_sender_ = nullptr;
+
+    std::thread                    decode_thread_;
+    std::thread                    render_thread_;
+    std::atomic<bool>              running_{false};
+
+    // Frame loss recovery (decode thread).  Without a keyframe within
+    // kRecoveryTimeout, decoding resumes anyway.
+    bool                                  awaiting_recovery_ = false;
+    uint32_t                              loss_first_ = 0;
+    uint32_t                              loss_last_  = 0;
+    std::chrono::steady_clock::time_point loss_time_;
+    uint64_t                              next_tag_ = 1;
+    uint64_t                              in_flight_tag_ = 0;
+    uint64_t                              in_flight_ts_us_ = 0;
+
+    std::atomic<uint64_t>          frames_decoded_{0};
+    std::atomic<uint64_t>          frames_dropped_{0};
+
+    static constexpr auto     kRecoveryTimeout  = std::chrono::seconds(1);
+    static constexpr uint32_t kDecodeIdleWakeMs = 500;
+    static constexpr uint32_t kDecodeWaitMs     = 100;
+    static constexpr uint32_t kRenderIdleWakeMs = 100;
+};
+
+} // namespace cs
@@ -2,7 +2,8 @@
 // clipboard_sync.cpp -- Clipboard text synchronization (viewer side)
 //
 // Polls clipboard for changes at ~5Hz with 200ms debounce.
-// Sends text changes to host via ClipboardPacketHeader + ACK protocol.
+// Sends text changes to host as chunked transfers, ticked every 2ms while
+// one is in flight.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "clipboard_sync.h"
@@ -23,7 +24,11 @@
 
 namespace cs {
 
-ClipboardSync::ClipboardSync() = default;
+ClipboardSync::ClipboardSync()
+    : transfer_(ClipboardDirection::VIEWER_TO_HOST,
+                [this](const std::vector<uint8_t>& data) {
+                    if (send_func_) send_func_(data);
+                }) {}
 
 ClipboardSync::~ClipboardSync() {
     stop();
@@ -54,11 +59,19 @@ void ClipboardSync::stop() {
 
 void ClipboardSync::monitorThread() {
     auto last_check = std::chrono::steady_clock::now();
+    auto last_poll = last_check;
+    bool sending = false;
 
     while (running_.load()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        std::this_thread::sleep_for(sending ? kTransferTick : kPollInterval);
         if (!running_.load()) break;
 
+        sending = transfer_.poll();
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_poll < kPollInterval) continue;
+        last_poll = now;
+
         // Check for local clipboard changes
         std::string current = getClipboardText();
 
@@ -74,7 +87,6 @@ void ClipboardSync::monitorThread() {
             }
 
             // Debounce
-            auto now = std::chrono::steady_clock::now();
             if (now - last_check < kDebounceMs) {
                 continue;
             }
@@ -82,57 +94,27 @@ void ClipboardSync::monitorThread() {
 
             last_text_ = current;
 
-            // Send to host if non-empty and within size limit
-            if (!current.empty() && current.size() <= kMaxClipboardBytes) {
-                sendToHost(current);
-            }
-        }
-
-        // Check for pending ACK retries
-        if (waiting_ack_.load() && retry_count_ < kMaxRetries) {
-            auto now = std::chrono::steady_clock::now();
-            if (now - last_send_time_ >= kRetryInterval) {
-                CS_LOG(DEBUG, "Clipboard: retrying send (attempt %d/%d, seq=%u)",
-                       retry_count_ + 1, kMaxRetries, pending_ack_seq_);
-                if (send_func_ && !pending_packet_.empty()) {
-                    send_func_(pending_packet_);
-                }
-                last_send_time_ = now;
-                retry_count_++;
+            // Send to host if non-empty and not already there
+            if (!current.empty() && transfer_.send(current)) {
+                sending = transfer_.poll();
             }
-        } else if (waiting_ack_.load() && retry_count_ >= kMaxRetries) {
-            CS_LOG(WARN, "Clipboard: give up after %d retries (seq=%u)", kMaxRetries, pending_ack_seq_);
-            waiting_ack_.store(false);
-            pending_packet_.clear();
         }
     }
 }
 
-void ClipboardSync::sendToHost(const std::string& text) {
-    ClipboardPacketHeader hdr = {};
-    hdr.type      = static_cast<uint8_t>(PacketType::CLIPBOARD);
-    hdr.direction = static_cast<uint8_t>(ClipboardDirection::VIEWER_TO_HOST);
-    hdr.sequence  = send_seq_++;
-    hdr.format    = static_cast<uint8_t>(ClipboardFormat::TEXT_UTF8);
-    std::memset(hdr.reserved, 0, sizeof(hdr.reserved));
-    hdr.length    = static_cast<uint32_t>(text.size());
-
-    pending_packet_ = hdr.serialize(
-        reinterpret_cast<const uint8_t*>(text.data()), text.size());
-
-    pending_ack_seq_ = hdr.sequence;
-    waiting_ack_.store(true);
-    retry_count_ = 0;
-    last_send_time_ = std::chrono::steady_clock::now();
+void ClipboardSync::onClipboardReceived(const uint8_t* data, size_t len) {
+    if (len == 0) return;
 
-    if (send_func_) {
-        send_func_(pending_packet_);
+    if (data[0] == static_cast<uint8_t>(PacketType::CLIP_CHUNK)) {
+        std::string text;
+        if (transfer_.onChunk(data, len, text)) {
+            CS_LOG(DEBUG, "Clipboard: received %zu bytes from host", text.size());
+            applyRemote(text);
+        }
+        return;
     }
 
-    CS_LOG(DEBUG, "Clipboard: sent %zu bytes to host (seq=%u)", text.size(), hdr.sequence);
-}
-
-void ClipboardSync::onClipboardReceived(const uint8_t* data, size_t len) {
+    // Legacy single packet
     ClipboardPacketHeader hdr;
     if (!ClipboardPacketHeader::deserialize(data, len, hdr)) return;
 
@@ -141,17 +123,11 @@ void ClipboardSync::onClipboardReceived(const uint8_t* data, size_t len) {
 
     size_t payload_offset = sizeof(ClipboardPacketHeader);
     if (len < payload_offset + hdr.length) return;
-    if (hdr.length > kMaxClipboardBytes) return;
+    if (hdr.length > kMaxLegacyBytes) return;
 
     std::string text(reinterpret_cast<const char*>(data + payload_offset), hdr.length);
-
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        last_origin_ = Origin::REMOTE;
-        last_text_ = text;
-    }
-
-    setClipboardText(text);
+    transfer_.noteShared(text);
+    applyRemote(text);
 
     // Send ACK
     ClipboardAckPacket ack = {};
@@ -166,16 +142,19 @@ void ClipboardSync::onClipboardReceived(const uint8_t* data, size_t len) {
     CS_LOG(DEBUG, "Clipboard: received %u bytes from host (seq=%u)", hdr.length, hdr.sequence);
 }
 
-void ClipboardSync::onAckReceived(const uint8_t* data, size_t len) {
-    ClipboardAckPacket ack;
-    if (!ClipboardAckPacket::deserialize(data, len, ack)) return;
-
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (waiting_ack_.load() && ack.ack_sequence == pending_ack_seq_) {
-        waiting_ack_.store(false);
-        pending_packet_.clear();
-        CS_LOG(DEBUG, "Clipboard: ACK received (seq=%u)", ack.ack_sequence);
+void ClipboardSync::applyRemote(const std::string& text) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_origin_ = Origin::REMOTE;
+        last_text_ = text;
     }
+
+    setClipboardText(text);
+}
+
+void ClipboardSync::onAckReceived(const uint8_t* data, size_t len) {
+    // Legacy acks answer nothing this side sends any more
+    transfer_.onAck(data, len);
 }
 
 // ---------------------------------------------------------------------------
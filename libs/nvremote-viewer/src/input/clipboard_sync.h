@@ -8,10 +8,14 @@
 // When we set the clipboard from a remote packet, we ignore the resulting
 // clipboard-change notification.
 //
-// Constraints: text-only, max 64KB, 200ms debounce, ACK-based reliability.
+// Constraints: text-only, up to ClipboardTransfer::MAX_TRANSFER_BYTES, 200ms
+// debounce.  Changes go out as chunked, compressed transfers with windowed
+// acks (cs/transport/clipboard_transfer.h); the viewer has no estimate of
+// its uplink's headroom, so they keep the transfer's default rate cap.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <cs/transport/clipboard_transfer.h>
 #include <cs/transport/packet.h>
 
 #include <cstdint>
@@ -42,7 +46,8 @@ public:
     /// Stop monitoring.
     void stop();
 
-    /// Called when we receive a clipboard packet from the host.
+    /// Called when we receive a clipboard packet (chunk, or legacy single
+    /// packet) from the host.
     void onClipboardReceived(const uint8_t* data, size_t len);
 
     /// Called when we receive a clipboard ACK from the host.
@@ -58,8 +63,8 @@ private:
     /// Set clipboard text locally (platform-specific).
     void setClipboardText(const std::string& text);
 
-    /// Send clipboard text to host with retry logic.
-    void sendToHost(const std::string& text);
+    /// Take |text| from the host as the local clipboard.
+    void applyRemote(const std::string& text);
 
     SendFunc send_func_;
     std::thread monitor_thread_;
@@ -72,23 +77,16 @@ private:
     enum class Origin { LOCAL, REMOTE };
     Origin last_origin_ = Origin::LOCAL;
 
-    // Sequence tracking
-    uint16_t send_seq_ = 0;
+    // Chunked transfers in both directions
+    ClipboardTransfer transfer_;
 
-    // Pending ACK
-    std::atomic<bool> waiting_ack_{false};
-    uint16_t pending_ack_seq_ = 0;
-    std::chrono::steady_clock::time_point last_send_time_;
-    int retry_count_ = 0;
-    std::vector<uint8_t> pending_packet_;
-
-    // Max payload size
-    static constexpr size_t kMaxClipboardBytes = 65536;
+    // Max payload size of a legacy single packet
+    static constexpr size_t kMaxLegacyBytes = 65536;
     // Debounce interval
     static constexpr auto kDebounceMs = std::chrono::milliseconds(200);
-    // Retry parameters
-    static constexpr int kMaxRetries = 3;
-    static constexpr auto kRetryInterval = std::chrono::milliseconds(200);
+    // Clipboard check interval, and transfer tick while one is in flight
+    static constexpr auto kPollInterval = std::chrono::milliseconds(200);
+    static constexpr auto kTransferTick = std::chrono::milliseconds(2);
 
     std::mutex mutex_;
 
@@ -1,17 +1,21 @@
 ///////////////////////////////////////////////////////////////////////////////
 // controller_capture.cpp -- XInput controller state capture
 //
-// Polls XInput at ~120Hz. Sends full-state ControllerPacket on change.
+// Polls XInput at a fixed rate and reports every connected controller's
+// state each poll, deadzones applied.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "controller_capture.h"
 
 #include <cs/common.h>
+#include <cs/thread_policy.h>
 
 #ifdef _WIN32
 #include <windows.h>
 #include <xinput.h>
+#include <timeapi.h>
 #pragma comment(lib, "xinput.lib")
+#pragma comment(lib, "winmm.lib")
 #endif
 
 #include <chrono>
@@ -19,9 +23,6 @@
 
 namespace cs {
 
-// Poll interval: ~8.3ms = 120Hz
-static constexpr auto kPollInterval = std::chrono::microseconds(8333);
-
 // Deadzone threshold for analog sticks (matching XInput defaults)
 static constexpr int16_t kLeftStickDeadzone  = 7849;
 static constexpr int16_t kRightStickDeadzone = 8689;
@@ -40,16 +41,17 @@ ControllerCapture::~ControllerCapture() {
     stop();
 }
 
-bool ControllerCapture::start(OnStateChange callback) {
+bool ControllerCapture::start(OnPoll callback, uint32_t rate_hz) {
     if (running_.load()) return false;
 
     callback_ = std::move(callback);
+    rate_hz_  = rate_hz > 0 ? rate_hz : DEFAULT_RATE_HZ;
     running_.store(true);
 
-    std::memset(last_state_, 0, sizeof(last_state_));
+    std::memset(connected_, 0, sizeof(connected_));
 
     thread_ = std::thread(&ControllerCapture::pollThread, this);
-    CS_LOG(INFO, "Controller capture started (120Hz polling)");
+    CS_LOG(INFO, "Controller capture started (%uHz polling)", rate_hz_);
     return true;
 }
 
@@ -66,89 +68,71 @@ bool ControllerCapture::hasController() const {
 }
 
 void ControllerCapture::pollThread() {
+    cs::ScopedThreadRole role(cs::ThreadRole::INPUT);
 #ifdef _WIN32
-    while (running_.load()) {
-        auto start = std::chrono::steady_clock::now();
+    // A poll every few milliseconds needs a finer timer than the default
+    timeBeginPeriod(1);
 
-        bool any_connected = false;
+    const auto interval = std::chrono::microseconds(1'000'000 / rate_hz_);
+    auto next = std::chrono::steady_clock::now();
+
+    while (running_.load()) {
+        ControllerPacket states[CONTROLLER_MAX];
+        size_t count = 0;
 
-        for (uint8_t i = 0; i < 4; i++) {
+        for (uint8_t i = 0; i < CONTROLLER_MAX; i++) {
             XINPUT_STATE state = {};
             DWORD result = XInputGetState(i, &state);
 
+            ControllerPacket& pkt = states[count];
+            pkt = {};
+            pkt.type          = static_cast<uint8_t>(PacketType::CONTROLLER);
+            pkt.controller_id = i;
+
             if (result != ERROR_SUCCESS) {
-                if (last_state_[i].connected) {
-                    last_state_[i].connected = false;
+                if (connected_[i]) {
+                    connected_[i] = false;
                     CS_LOG(INFO, "Controller %u disconnected", i);
+                    count++;   // Neutral state: release everything
                 }
                 continue;
             }
 
-            any_connected = true;
-
-            if (!last_state_[i].connected) {
-                last_state_[i].connected = true;
+            if (!connected_[i]) {
+                connected_[i] = true;
                 CS_LOG(INFO, "Controller %u connected", i);
             }
 
             // Apply deadzones
-            int16_t lx = applyDeadzone(state.Gamepad.sThumbLX, kLeftStickDeadzone);
-            int16_t ly = applyDeadzone(state.Gamepad.sThumbLY, kLeftStickDeadzone);
-            int16_t rx = applyDeadzone(state.Gamepad.sThumbRX, kRightStickDeadzone);
-            int16_t ry = applyDeadzone(state.Gamepad.sThumbRY, kRightStickDeadzone);
-            uint8_t lt = (state.Gamepad.bLeftTrigger  > kTriggerDeadzone) ? state.Gamepad.bLeftTrigger  : 0;
-            uint8_t rt = (state.Gamepad.bRightTrigger > kTriggerDeadzone) ? state.Gamepad.bRightTrigger : 0;
-            uint16_t buttons = state.Gamepad.wButtons;
-
-            // Check if state changed
-            auto& last = last_state_[i];
-            if (buttons == last.buttons &&
-                lt == last.left_trigger && rt == last.right_trigger &&
-                lx == last.thumb_lx && ly == last.thumb_ly &&
-                rx == last.thumb_rx && ry == last.thumb_ry) {
-                continue;  // No change
-            }
-
-            // Update last known state
-            last.buttons       = buttons;
-            last.left_trigger  = lt;
-            last.right_trigger = rt;
-            last.thumb_lx      = lx;
-            last.thumb_ly      = ly;
-            last.thumb_rx      = rx;
-            last.thumb_ry      = ry;
-
-            // Build and send packet
-            ControllerPacket pkt = {};
-            pkt.type           = static_cast<uint8_t>(PacketType::CONTROLLER);
-            pkt.controller_id  = i;
-            pkt.buttons        = buttons;
-            pkt.left_trigger   = lt;
-            pkt.right_trigger  = rt;
-            pkt.thumb_lx       = lx;
-            pkt.thumb_ly       = ly;
-            pkt.thumb_rx       = rx;
-            pkt.thumb_ry       = ry;
-
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                pkt.sequence = seq_++;
-            }
-
-            if (callback_) {
-                callback_(pkt);
-            }
+            pkt.thumb_lx      = applyDeadzone(state.Gamepad.sThumbLX, kLeftStickDeadzone);
+            pkt.thumb_ly      = applyDeadzone(state.Gamepad.sThumbLY, kLeftStickDeadzone);
+            pkt.thumb_rx      = applyDeadzone(state.Gamepad.sThumbRX, kRightStickDeadzone);
+            pkt.thumb_ry      = applyDeadzone(state.Gamepad.sThumbRY, kRightStickDeadzone);
+            pkt.left_trigger  = (state.Gamepad.bLeftTrigger  > kTriggerDeadzone) ? state.Gamepad.bLeftTrigger  : 0;
+            pkt.right_trigger = (state.Gamepad.bRightTrigger > kTriggerDeadzone) ? state.Gamepad.bRightTrigger : 0;
+            pkt.buttons       = state.Gamepad.wButtons;
+            count++;
         }
 
+        bool any_connected = false;
+        for (bool c : connected_) any_connected = any_connected || c;
         has_controller_.store(any_connected);
 
-        // Sleep until next poll interval
-        auto elapsed = std::chrono::steady_clock::now() - start;
-        auto remaining = kPollInterval - elapsed;
-        if (remaining.count() > 0) {
-            std::this_thread::sleep_for(remaining);
+        if (count > 0 && callback_) {
+            callback_(states, count);
+        }
+
+        // Fixed rate: a late poll does not push the later ones back
+        next += interval;
+        const auto now = std::chrono::steady_clock::now();
+        if (next > now) {
+            std::this_thread::sleep_until(next);
+        } else {
+            next = now;
         }
     }
+
+    timeEndPeriod(1);
 #else
     // Non-Windows: no XInput, thread exits immediately
     CS_LOG(WARN, "Controller capture not available on this platform");
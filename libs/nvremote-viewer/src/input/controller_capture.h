@@ -1,9 +1,11 @@
 ///////////////////////////////////////////////////////////////////////////////
 // controller_capture.h -- XInput controller state capture
 //
-// Polls XInput controllers at 120Hz on a dedicated thread.  Sends full
-// state packets on-change only (not deltas) so lost packets self-heal.
-// Supports up to 4 controllers (XInput hardware limit).
+// Polls XInput controllers at a fixed rate (250Hz by default) on a
+// dedicated thread and hands every poll's states to the callback, which
+// feeds InputSender's controller state stream: the sender, not the poll,
+// decides what is worth sending.  Supports up to 4 controllers (XInput
+// hardware limit).
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
@@ -11,7 +13,6 @@
 #include <atomic>
 #include <thread>
 #include <functional>
-#include <mutex>
 
 #include <cs/transport/packet.h>
 
@@ -26,11 +27,15 @@ public:
     ControllerCapture(const ControllerCapture&) = delete;
     ControllerCapture& operator=(const ControllerCapture&) = delete;
 
-    /// Callback invoked when controller state changes.
-    using OnStateChange = std::function<void(const ControllerPacket& pkt)>;
+    /// Callback invoked once per poll with the state of every connected
+    /// controller, plus a neutral state for one that has just gone away
+    /// (so that nothing stays held on the host).
+    using OnPoll = std::function<void(const ControllerPacket* states, size_t count)>;
 
-    /// Start polling. Returns true on success.
-    bool start(OnStateChange callback);
+    static constexpr uint32_t DEFAULT_RATE_HZ = 250;
+
+    /// Start polling at |rate_hz|. Returns true on success.
+    bool start(OnPoll callback, uint32_t rate_hz = DEFAULT_RATE_HZ);
 
     /// Stop polling thread.
     void stop();
@@ -41,26 +46,13 @@ public:
 private:
     void pollThread();
 
-    OnStateChange callback_;
+    OnPoll        callback_;
     std::thread   thread_;
     std::atomic<bool> running_{false};
     std::atomic<bool> has_controller_{false};
+    uint32_t      rate_hz_ = DEFAULT_RATE_HZ;
 
-    // Last known state per controller (for on-change detection)
-    struct ControllerState {
-        uint16_t buttons       = 0;
-        uint8_t  left_trigger  = 0;
-        uint8_t  right_trigger = 0;
-        int16_t  thumb_lx      = 0;
-        int16_t  thumb_ly      = 0;
-        int16_t  thumb_rx      = 0;
-        int16_t  thumb_ry      = 0;
-        bool     connected     = false;
-    };
-    ControllerState last_state_[4];
-
-    uint16_t seq_ = 0;
-    std::mutex mutex_;
+    bool connected_[CONTROLLER_MAX] = {};
 };
 
 } // namespace cs
@@ -1,23 +1,28 @@
 ///////////////////////////////////////////////////////////////////////////////
-// input_sender.cpp -- Serialize and send input events to the host
-//
-// Converts InputEvent structures into the wire format defined in
-// cs/transport/packet.h (InputPacketHeader + type-specific payload),
-// and sends them immediately over UDP for lowest possible latency.
+// input_sender.cpp -- Coalesce input events into batches and send them
 //
 // Wire format (after DTLS encryption):
-//   [InputPacketHeader]   4 bytes: ver_type(1) + input_type(1) + payload_length(2)
-//   [Payload]             variable: type-specific event data
+//   [InputPacketHeader]   4 bytes: ver_type(1) + input_type(1) = BATCH + payload_length(2)
+//   [InputBatchHeader]    16 bytes: sequence, summed motion, previous motion
+//   [InputBatchEvent]...  12 bytes each: buttons, keys, scrolls
 //
-// Each event is sent as a standalone datagram -- no batching.
+// A batch goes out when:
+//   - a button, key or scroll event arrives;
+//   - a mouse move arrives and the last batch is at least an interval old;
+//   - the flush thread finds motion left over an interval after the last
+//     batch, or events not yet sent EVENT_COPIES times after REPEAT_INTERVAL_US.
+// Each is one datagram from one fixed buffer; nothing is allocated per event.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "input_sender.h"
 #include "input_capture.h"
 
 #include "cs/common.h"
+#include "cs/thread_policy.h"
 #include "cs/transport/packet.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 
 #ifdef _WIN32
@@ -39,6 +44,12 @@ namespace cs {
 InputSender::InputSender() = default;
 
 InputSender::~InputSender() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
     // We do not own the socket -- do not close it.
 }
 
@@ -51,58 +62,56 @@ bool InputSender::initialize(int socket_fd, const ::sockaddr* peer, int peer_len
         return false;
     }
 
-    std::lock_guard<std::mutex> lock(mutex_);
-    socket_fd_ = socket_fd;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        socket_fd_ = socket_fd;
 
-    // Store a copy of the peer address
-    peer_addr_.resize(static_cast<size_t>(peer_len));
-    std::memcpy(peer_addr_.data(), peer, static_cast<size_t>(peer_len));
-    peer_addr_len_ = peer_len;
+        // Store a copy of the peer address
+        peer_addr_.resize(static_cast<size_t>(peer_len));
+        std::memcpy(peer_addr_.data(), peer, static_cast<size_t>(peer_len));
+        peer_addr_len_ = peer_len;
+    }
 
-    CS_LOG(INFO, "InputSender initialized (socket=%d, peer_len=%d)",
-           socket_fd_, peer_addr_len_);
+    if (!thread_.joinable()) {
+        thread_ = std::thread(&InputSender::flushThread, this);
+    }
+
+    CS_LOG(INFO, "InputSender initialized (socket=%d, peer_len=%d, batch=%u us)",
+           socket_fd, peer_len, interval_us_);
     return true;
 }
 
 // ---------------------------------------------------------------------------
-// serializeEvent() -- build wire-format packet from an InputEvent
+// setBatchIntervalUs()
 // ---------------------------------------------------------------------------
-std::vector<uint8_t> InputSender::serializeEvent(const InputEvent& event) const {
-    // Determine the input type and build the payload
-    InputType wire_type;
-    std::vector<uint8_t> payload;
-
-    switch (event.type) {
-        case InputEventType::MOUSE_MOVE: {
-            wire_type = InputType::MOUSE_MOVE;
-
-            MouseMoveEvent mv;
-            mv.dx      = event.mouse_move.dx;
-            mv.dy      = event.mouse_move.dy;
-            mv.buttons = event.mouse_move.buttons;
-
-            // Convert to network byte order
-            mv.toNetwork();
+void InputSender::setBatchIntervalUs(uint32_t interval_us) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        interval_us_ = interval_us;
+    }
+    cv_.notify_one();
+}
 
-            payload.resize(sizeof(MouseMoveEvent));
-            std::memcpy(payload.data(), &mv, sizeof(mv));
-            break;
-        }
+// ---------------------------------------------------------------------------
+// queueEvent() -- add a discrete event to the next batches
+// ---------------------------------------------------------------------------
+bool InputSender::queueEvent(const InputEvent& event, uint64_t now_us) {
+    PendingEvent pe;
+    std::memset(&pe.wire, 0, sizeof(pe.wire));
 
+    switch (event.type) {
         case InputEventType::MOUSE_BUTTON: {
-            wire_type = InputType::MOUSE_BUTTON;
+            pe.wire.input_type = static_cast<uint8_t>(InputType::MOUSE_BUTTON);
 
             MouseButtonEvent btn;
             btn.button = event.mouse_button.button;
             btn.action = event.mouse_button.action;
-
-            payload.resize(sizeof(MouseButtonEvent));
-            std::memcpy(payload.data(), &btn, sizeof(btn));
+            std::memcpy(pe.wire.data, &btn, sizeof(btn));
             break;
         }
 
         case InputEventType::KEY: {
-            wire_type = InputType::KEY;
+            pe.wire.input_type = static_cast<uint8_t>(InputType::KEY);
 
             KeyEvent key;
             key.keycode   = event.key.keycode;
@@ -111,14 +120,12 @@ std::vector<uint8_t> InputSender::serializeEvent(const InputEvent& event) const
 
             // Convert to network byte order
             key.toNetwork();
-
-            payload.resize(sizeof(KeyEvent));
-            std::memcpy(payload.data(), &key, sizeof(key));
+            std::memcpy(pe.wire.data, &key, sizeof(key));
             break;
         }
 
         case InputEventType::SCROLL: {
-            wire_type = InputType::SCROLL;
+            pe.wire.input_type = static_cast<uint8_t>(InputType::SCROLL);
 
             ScrollEvent scr;
             scr.dx = event.scroll.dx;
@@ -126,76 +133,341 @@ std::vector<uint8_t> InputSender::serializeEvent(const InputEvent& event) const
 
             // Convert to network byte order
             scr.toNetwork();
-
-            payload.resize(sizeof(ScrollEvent));
-            std::memcpy(payload.data(), &scr, sizeof(scr));
+            std::memcpy(pe.wire.data, &scr, sizeof(scr));
             break;
         }
 
         default:
             CS_LOG(WARN, "InputSender: unknown event type %u",
                    static_cast<unsigned>(event.type));
-            return {};
+            return false;
+    }
+
+    pe.wire.seq          = event_seq_++;
+    pe.wire.timestamp_us = static_cast<uint32_t>(now_us);
+    pe.wire.toNetwork();
+
+    // Full: the oldest has already gone out at least once, so only one of
+    // its repeats is lost
+    if (event_count_ == events_.size()) {
+        std::move(events_.begin() + 1, events_.end(), events_.begin());
+        event_count_--;
     }
+    events_[event_count_++] = pe;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// sendBatchLocked() -- one datagram with the motion and pending events
+// ---------------------------------------------------------------------------
+bool InputSender::sendBatchLocked(uint64_t now_us) {
+    // Motion beyond int16 stays pending for the next batch
+    const auto dx = static_cast<int16_t>(std::clamp<int32_t>(pending_dx_, INT16_MIN, INT16_MAX));
+    const auto dy = static_cast<int16_t>(std::clamp<int32_t>(pending_dy_, INT16_MIN, INT16_MAX));
+    pending_dx_ -= dx;
+    pending_dy_ -= dy;
+    motion_pending_ = pending_dx_ != 0 || pending_dy_ != 0;
+
+    InputBatchHeader batch;
+    batch.batch_seq    = ++batch_seq_;
+    batch.timestamp_us = static_cast<uint32_t>(now_us);
+    batch.dx           = dx;
+    batch.dy           = dy;
+    batch.prev_dx      = prev_dx_;
+    batch.prev_dy      = prev_dy_;
+    batch.buttons      = buttons_;
+    batch.event_count  = static_cast<uint8_t>(event_count_);
+    batch.toNetwork();
+
+    prev_dx_      = dx;
+    prev_dy_      = dy;
+    last_send_us_ = now_us;
+
+    {
+        std::lock_guard<std::mutex> lock(latency_mutex_);
+        batch_input_[batch_seq_ % BATCH_HISTORY] = BatchInput{batch_seq_, first_input_us_};
+    }
+    first_input_us_ = 0;
+
+    const size_t payload_len = sizeof(InputBatchHeader) + event_count_ * sizeof(InputBatchEvent);
 
-    // Build the InputPacketHeader
     InputPacketHeader hdr;
     std::memset(&hdr, 0, sizeof(hdr));
     hdr.setVersion(1);
     hdr.setType(static_cast<uint8_t>(PacketType::INPUT) & 0x3F);
-    hdr.input_type     = static_cast<uint8_t>(wire_type);
-    hdr.payload_length = static_cast<uint16_t>(payload.size());
+    hdr.input_type     = static_cast<uint8_t>(InputType::BATCH);
+    hdr.payload_length = static_cast<uint16_t>(payload_len);
+    hdr.toNetwork();
+
+    uint8_t* p = packet_.data();
+    std::memcpy(p, &hdr, sizeof(hdr));
+    p += sizeof(hdr);
+    std::memcpy(p, &batch, sizeof(batch));
+    p += sizeof(batch);
+
+    // Events still owed copies stay queued for the next batches
+    size_t kept = 0;
+    for (size_t i = 0; i < event_count_; ++i) {
+        std::memcpy(p, &events_[i].wire, sizeof(InputBatchEvent));
+        p += sizeof(InputBatchEvent);
+        if (++events_[i].copies < EVENT_COPIES) events_[kept++] = events_[i];
+    }
+    event_count_ = kept;
 
-    // Serialize header + payload
-    return hdr.serialize(payload.data(), payload.size());
+    const size_t len = sizeof(InputPacketHeader) + payload_len;
+    ssize_t sent = ::sendto(
+        socket_fd_.load(),
+        reinterpret_cast<const char*>(packet_.data()),
+        static_cast<int>(len),
+        0,
+        reinterpret_cast<const ::sockaddr*>(peer_addr_.data()),
+        peer_addr_len_);
+
+    if (sent < 0) {
+        CS_LOG(WARN, "InputSender: sendto failed (error %d)", cs_socket_error());
+        return false;
+    }
+    if (recorder_) recorder_->record(RecordDirection::SENT, packet_.data(), len);
+    sendSecondary(packet_.data(), len);
+
+    if (static_cast<size_t>(sent) != len) {
+        CS_LOG(WARN, "InputSender: partial send (%zd / %zu bytes)", sent, len);
+        return false;
+    }
+
+    packets_sent_.fetch_add(1, std::memory_order_relaxed);
+    return true;
 }
 
 // ---------------------------------------------------------------------------
-// sendInput() -- serialize and send immediately
+// sendInput() -- coalesce motion, send anything else at once
 // ---------------------------------------------------------------------------
 bool InputSender::sendInput(const InputEvent& event) {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    if (socket_fd_ < 0 || peer_addr_.empty()) {
+    if (socket_fd_.load() < 0 || peer_addr_.empty()) {
         CS_LOG(WARN, "InputSender: not initialized");
         return false;
     }
 
-    // Serialize the event into wire format
-    std::vector<uint8_t> packet = serializeEvent(event);
-    if (packet.empty()) {
+    events_sent_.fetch_add(1, std::memory_order_relaxed);
+    const uint64_t now = getTimestampUs();
+    if (first_input_us_ == 0) first_input_us_ = now;
+
+    if (event.type == InputEventType::MOUSE_MOVE) {
+        pending_dx_ += event.mouse_move.dx;
+        pending_dy_ += event.mouse_move.dy;
+        buttons_     = event.mouse_move.buttons;
+        motion_pending_ = true;
+
+        // The first move after a pause goes out at once
+        if (interval_us_ == 0 || now - last_send_us_ >= interval_us_) {
+            return sendBatchLocked(now);
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+    // A click lands after the motion that led up to it, in the same packet
+    if (!queueEvent(event, now)) {
         return false;
     }
 
-    // Send the packet immediately via UDP sendto
+    const bool ok = sendBatchLocked(now);
+    cv_.notify_one();
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// flushThread() -- motion left over when the mouse stops, and event repeats
+// ---------------------------------------------------------------------------
+void InputSender::flushThread() {
+    cs::ScopedThreadRole role(cs::ThreadRole::INPUT);
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!stop_) {
+        uint64_t deadline;
+        if (motion_pending_) {
+            deadline = last_send_us_ + interval_us_;
+        } else if (event_count_ > 0) {
+            deadline = last_send_us_ + REPEAT_INTERVAL_US;
+        } else {
+            cv_.wait(lock);
+            continue;
+        }
+
+        const uint64_t now = getTimestampUs();
+        if (now >= deadline) {
+            sendBatchLocked(now);
+            continue;
+        }
+        cv_.wait_for(lock, std::chrono::microseconds(deadline - now));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// sendControllerStates() -- one poll's unacknowledged controller state
+// ---------------------------------------------------------------------------
+void InputSender::sendControllerStates(const ControllerPacket* states, size_t count) {
+    std::lock_guard<std::mutex> lock(controller_mutex_);
+    const uint64_t now = getTimestampUs();
+
+    bool seen[CONTROLLER_MAX] = {};
+    for (size_t i = 0; i < count; ++i) {
+        const size_t id = states[i].controller_id & 0x03;
+        controllers_[id].latest = states[i];
+        controllers_[id].active = true;
+        seen[id] = true;
+    }
+
+    uint8_t* const start = controller_packet_.data() + sizeof(InputPacketHeader);
+    uint8_t* p = start;
+    for (size_t id = 0; id < CONTROLLER_MAX; ++id) {
+        ControllerStream& c = controllers_[id];
+        if (!c.active) continue;
+        c.connected = seen[id];
+
+        const bool full_due = c.connected && now - c.last_full_us >= CONTROLLER_KEYFRAME_US;
+        if (c.have_acked && !full_due &&
+            ControllerStateRecord::diff(c.latest, c.acked) == 0) {
+            continue;   // The host has it
+        }
+
+        ControllerPacket rec = c.latest;
+        rec.controller_id = static_cast<uint8_t>(id);
+        rec.sequence      = ++c.seq;
+
+        // A delta needs a base the host still holds
+        const bool base_ok = c.have_acked &&
+            static_cast<uint16_t>(rec.sequence - c.acked.sequence) < CONTROLLER_HISTORY;
+        const bool full = full_due || !base_ok;
+        p += ControllerStateRecord::encode(rec, full ? nullptr : &c.acked, p);
+        if (full) c.last_full_us = now;
+        c.sent[rec.sequence % CONTROLLER_HISTORY] = rec;
+    }
+    if (p == start) return;
+
+    const size_t payload_len = static_cast<size_t>(p - start);
+    InputPacketHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    hdr.setVersion(1);
+    hdr.setType(static_cast<uint8_t>(PacketType::INPUT) & 0x3F);
+    hdr.input_type     = static_cast<uint8_t>(InputType::CONTROLLER_STATE);
+    hdr.payload_length = static_cast<uint16_t>(payload_len);
+    hdr.toNetwork();
+    std::memcpy(controller_packet_.data(), &hdr, sizeof(hdr));
+
+    const size_t len = sizeof(InputPacketHeader) + payload_len;
+    std::lock_guard<std::mutex> send_lock(mutex_);
+    if (socket_fd_.load() < 0 || peer_addr_.empty()) return;
     ssize_t sent = ::sendto(
-        socket_fd_,
-        reinterpret_cast<const char*>(packet.data()),
-        static_cast<int>(packet.size()),
+        socket_fd_.load(),
+        reinterpret_cast<const char*>(controller_packet_.data()),
+        static_cast<int>(len),
         0,
         reinterpret_cast<const ::sockaddr*>(peer_addr_.data()),
         peer_addr_len_);
-
     if (sent < 0) {
-        CS_LOG(WARN, "InputSender: sendto failed (error %d)", cs_socket_error());
-        return false;
+        CS_LOG(WARN, "InputSender: controller sendto failed (error %d)", cs_socket_error());
+        return;
     }
+    if (recorder_) recorder_->record(RecordDirection::SENT, controller_packet_.data(), len);
+    sendSecondary(controller_packet_.data(), len);
+    packets_sent_.fetch_add(1, std::memory_order_relaxed);
+}
 
-    if (static_cast<size_t>(sent) != packet.size()) {
-        CS_LOG(WARN, "InputSender: partial send (%zd / %zu bytes)",
-               sent, packet.size());
-        return false;
+// ---------------------------------------------------------------------------
+// sendSecondary() -- the copy on the secondary path
+// ---------------------------------------------------------------------------
+void InputSender::sendSecondary(const uint8_t* data, size_t len) {
+    const int fd = secondary_fd_.load();
+    if (fd < 0) return;
+    // Best effort: the primary copy has gone out already
+    ::send(fd, reinterpret_cast<const char*>(data), static_cast<int>(len), 0);
+}
+
+// ---------------------------------------------------------------------------
+// onControllerAck() -- new delta bases
+// ---------------------------------------------------------------------------
+void InputSender::onControllerAck(const uint8_t* data, size_t len) {
+    ControllerAckPacket ack;
+    if (!ControllerAckPacket::deserialize(data, len, ack)) return;
+
+    std::lock_guard<std::mutex> lock(controller_mutex_);
+    for (size_t id = 0; id < CONTROLLER_MAX; ++id) {
+        if (!(ack.mask & (1u << id))) continue;
+        ControllerStream& c = controllers_[id];
+        const uint16_t seq = ack.seq[id];
+
+        // Only states we sent and still remember, newer than the base
+        const ControllerPacket& sent = c.sent[seq % CONTROLLER_HISTORY];
+        if (!c.active || sent.sequence != seq || seqNewer(seq, c.seq)) continue;
+        if (c.have_acked && !seqNewer(seq, c.acked.sequence)) continue;
+        c.acked      = sent;
+        c.have_acked = true;
     }
+}
 
-    packets_sent_.fetch_add(1, std::memory_order_relaxed);
-    return true;
+// ---------------------------------------------------------------------------
+// onInputEcho() -- the host names the first frame to show a batch
+// ---------------------------------------------------------------------------
+void InputSender::onInputEcho(const uint8_t* data, size_t len) {
+    InputEchoPacket echo;
+    if (!InputEchoPacket::deserialize(data, len, echo)) return;
+
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+    if (echo_count_ == echoes_.size()) {
+        // Frames are not being presented; the oldest goes unmeasured
+        std::move(echoes_.begin() + 1, echoes_.end(), echoes_.begin());
+        echo_count_--;
+    }
+    echoes_[echo_count_++] = Echo{echo.frame_timestamp_us, echo.batch_seq};
+}
+
+// ---------------------------------------------------------------------------
+// onFramePresented() -- input-to-photon samples for the batches it shows
+// ---------------------------------------------------------------------------
+void InputSender::onFramePresented(uint32_t frame_timestamp_us, uint64_t photon_us,
+                                   LatencyHistogram& out) {
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < echo_count_; ++i) {
+        const Echo e = echoes_[i];
+
+        // A later frame than the present one: wait for it.  An earlier one
+        // that was never presented is covered by this one.
+        if (static_cast<int32_t>(frame_timestamp_us - e.frame_timestamp_us) < 0) {
+            echoes_[kept++] = e;
+            continue;
+        }
+        if (have_shown_ && !seqNewer(e.batch_seq, shown_seq_)) continue;
+
+        uint16_t span = have_shown_ ? static_cast<uint16_t>(e.batch_seq - shown_seq_)
+                                    : static_cast<uint16_t>(BATCH_HISTORY);
+        span = static_cast<uint16_t>(std::min<size_t>(span, BATCH_HISTORY));
+        for (uint16_t k = 0; k < span; ++k) {
+            const auto seq = static_cast<uint16_t>(e.batch_seq - k);
+            BatchInput& b = batch_input_[seq % BATCH_HISTORY];
+            if (b.seq != seq || b.input_us == 0) continue;
+            if (photon_us > b.input_us) out.record(photon_us - b.input_us);
+            b.input_us = 0;
+        }
+        have_shown_ = true;
+        shown_seq_  = e.batch_seq;
+    }
+    echo_count_ = kept;
 }
 
 // ---------------------------------------------------------------------------
-// getPacketsSent()
+// getPacketsSent() / getEventsSent()
 // ---------------------------------------------------------------------------
 uint64_t InputSender::getPacketsSent() const {
     return packets_sent_.load(std::memory_order_relaxed);
 }
 
+uint64_t InputSender::getEventsSent() const {
+    return events_sent_.load(std::memory_order_relaxed);
+}
+
 } // namespace cs
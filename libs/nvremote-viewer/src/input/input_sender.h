@@ -1,20 +1,48 @@
 ///////////////////////////////////////////////////////////////////////////////
 // input_sender.h -- Serialize and send input events over UDP
 //
-// Takes InputEvent structures from InputCapture, serializes them into
-// the wire format (InputPacketHeader + payload), and sends them over
-// the established UDP socket with optional DTLS encryption.
+// Takes InputEvent structures from InputCapture and sends them to the host
+// as input batches (InputPacketHeader + InputBatchHeader + events, see
+// cs/transport/packet.h).
 //
-// Input is sent immediately (no batching) for lowest latency.
+// A high-rate mouse reports thousands of moves a second; sent one per
+// datagram they compete with NACKs on the uplink and for Wi-Fi airtime.
+// Relative motion is instead summed and sent at most once per batch
+// interval (1 ms by default) -- immediately when the mouse has been still
+// for longer, so a first move waits for nothing.  Buttons, keys and
+// scrolls go out at once, together with the motion that preceded them,
+// and are repeated in the next batches so that a lost packet loses none.
+//
+// Controller state shares the sender: each fixed-rate poll becomes at most
+// one packet of delta records against the state the host last acked (see
+// ControllerStateRecord in cs/transport/packet.h).
+//
+// The host answers with an InputEchoPacket naming the first frame captured
+// after a batch went in; when that frame is presented, each batch it
+// covers yields an input-to-photon sample, from the batch's first input.
+//
+// With a secondary socket (the receiver's answering standby path, see
+// UdpReceiver::setSecondaryCallback) every packet also goes out there; the
+// host drops the later copy by batch and controller sequence.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 #include "input_capture.h"
 
+#include <cs/latency_histogram.h>
+
+#include <cs/transport/packet.h>
+#include <cs/transport/packet_recorder.h>
+#include <cs/transport/sequence.h>
+
 // Platform socket headers -- needed so ::sockaddr resolves inside the namespace.
 #ifdef _WIN32
 #include <WinSock2.h>
@@ -38,23 +66,137 @@ public:
     /// Initialize with a socket and peer address.
     bool initialize(int socket_fd, const ::sockaddr* peer, int peer_len);
 
-    /// Send an input event to the host immediately.
-    /// Returns true on success.
+    /// Send on |socket_fd| from now on (the session moved to another path).
+    void setSocket(int socket_fd) { socket_fd_.store(socket_fd); }
+
+    /// Also send a copy of every packet on |socket_fd|, connected to the
+    /// host through another path (-1 = stop).
+    void setSecondarySocket(int socket_fd) { secondary_fd_.store(socket_fd); }
+
+    /// Record what this sends to |recorder| (see packet_recorder.h), which
+    /// must outlive it.  Must be set before sending starts.
+    void setRecorder(PacketRecorder* recorder) { recorder_ = recorder; }
+
+    /// Sum mouse motion over |interval_us| before sending it (0 = send
+    /// every move as it comes).
+    void setBatchIntervalUs(uint32_t interval_us);
+
+    /// Hand an input event to the sender: motion joins the next batch,
+    /// anything else is sent at once.  Returns false if a send failed.
     bool sendInput(const InputEvent& event);
 
     /// Get total input packets sent.
     uint64_t getPacketsSent() const;
 
+    /// Input events handed in, for comparison with the packets sent.
+    uint64_t getEventsSent() const;
+
+    /// Send what the host has not acknowledged of one controller poll's
+    /// |states|, in one packet (ControllerCapture's thread).
+    void sendControllerStates(const ControllerPacket* states, size_t count);
+
+    /// Called when a ControllerAckPacket arrives (receive thread).
+    void onControllerAck(const uint8_t* data, size_t len);
+
+    /// Called when an InputEchoPacket arrives (receive thread).
+    void onInputEcho(const uint8_t* data, size_t len);
+
+    /// Called when the frame captured at |frame_timestamp_us| (host clock,
+    /// as the wire carries it) has been presented, its light leaving the
+    /// display at |photon_us|: records into |out| how long each batch it
+    /// is the first to show took to get there (render thread).
+    void onFramePresented(uint32_t frame_timestamp_us, uint64_t photon_us,
+                          LatencyHistogram& out);
+
 private:
-    /// Serialize an InputEvent into the wire format.
-    std::vector<uint8_t> serializeEvent(const InputEvent& event) const;
+    struct PendingEvent {
+        InputBatchEvent wire;        // Network order
+        uint8_t         copies = 0;  // Batches it has gone out in
+    };
+
+    /// Wakes to send motion left over when the mouse stops, and repeats.
+    void flushThread();
+
+    /// Send the pending motion and events as one batch (mutex_ held).
+    bool sendBatchLocked(uint64_t now_us);
+
+    /// Send the copy of a packet on the secondary socket, if there is one.
+    void sendSecondary(const uint8_t* data, size_t len);
+
+    /// Queue a button, key or scroll event (mutex_ held).  Returns false
+    /// for any other type.
+    bool queueEvent(const InputEvent& event, uint64_t now_us);
 
-    int socket_fd_ = -1;
+    static constexpr uint32_t DEFAULT_BATCH_INTERVAL_US = 1'000;
+    static constexpr uint8_t  EVENT_COPIES              = 3;      // Batches each event rides in
+    static constexpr uint64_t REPEAT_INTERVAL_US        = 4'000;  // Between copies with no motion
+    static constexpr size_t   BATCH_HISTORY             = 256;    // Batches awaiting an echo
+    static constexpr uint64_t CONTROLLER_KEYFRAME_US    = 1'000'000;  // Full state at least this often
+    static constexpr size_t   CONTROLLER_HISTORY        = 32;     // States sent, awaiting an ack
+    static constexpr size_t   MAX_ECHOES                = 16;     // Echoes awaiting their frame
+
+    std::atomic<int> socket_fd_{-1};
+    std::atomic<int> secondary_fd_{-1};   // Connected; -1 = none
     std::vector<uint8_t> peer_addr_;
     int peer_addr_len_ = 0;
+    PacketRecorder* recorder_ = nullptr;   // Session recording (not owned)
 
     std::atomic<uint64_t> packets_sent_{0};
+    std::atomic<uint64_t> events_sent_{0};
     std::mutex mutex_;
+
+    // Batch state (mutex_ held)
+    uint32_t interval_us_    = DEFAULT_BATCH_INTERVAL_US;
+    int32_t  pending_dx_     = 0;
+    int32_t  pending_dy_     = 0;
+    bool     motion_pending_ = false;
+    uint8_t  buttons_        = 0;
+    int16_t  prev_dx_        = 0;
+    int16_t  prev_dy_        = 0;
+    uint16_t batch_seq_      = 0;
+    uint16_t event_seq_      = 0;
+    uint64_t last_send_us_   = 0;
+    uint64_t first_input_us_ = 0;      // Oldest input not yet in a batch (0 = none)
+    std::array<PendingEvent, INPUT_BATCH_MAX_EVENTS> events_{};
+    size_t   event_count_    = 0;
+    std::array<uint8_t, sizeof(InputPacketHeader) + sizeof(InputBatchHeader) +
+                        INPUT_BATCH_MAX_EVENTS * sizeof(InputBatchEvent)> packet_{};
+
+    // Input-to-photon (latency_mutex_ held; taken inside mutex_, never around it)
+    struct BatchInput {
+        uint16_t seq      = 0;
+        uint64_t input_us = 0;   // 0 = nothing new in it, or already counted
+    };
+    struct Echo {
+        uint32_t frame_timestamp_us;
+        uint16_t batch_seq;
+    };
+    std::array<BatchInput, BATCH_HISTORY> batch_input_{};
+    std::array<Echo, MAX_ECHOES> echoes_{};
+    size_t   echo_count_ = 0;
+    bool     have_shown_ = false;
+    uint16_t shown_seq_  = 0;        // Last batch counted
+    std::mutex latency_mutex_;
+
+    // Controller state stream (controller_mutex_ held; taken around mutex_)
+    struct ControllerStream {
+        ControllerPacket latest{};
+        ControllerPacket acked{};          // Base for deltas
+        std::array<ControllerPacket, CONTROLLER_HISTORY> sent{};   // By sequence
+        bool     active       = false;     // Seen at least once
+        bool     connected    = false;     // In the last poll
+        bool     have_acked   = false;
+        uint16_t seq          = 0;         // Last sequence sent
+        uint64_t last_full_us = 0;
+    };
+    std::array<ControllerStream, CONTROLLER_MAX> controllers_{};
+    std::array<uint8_t, sizeof(InputPacketHeader) +
+                        CONTROLLER_MAX * CONTROLLER_RECORD_MAX> controller_packet_{};
+    std::mutex controller_mutex_;
+
+    std::thread             thread_;
+    std::condition_variable cv_;
+    bool                    stop_ = false;
 };
 
 } // namespace cs
@@ -3,21 +3,28 @@
 //
 // Collects streaming statistics and sends QoS feedback to the host
 // every 200ms so it can adapt encoding parameters (bitrate, resolution,
-// keyframe interval) based on network conditions.
+// keyframe interval) based on network conditions, plus transport-wide
+// arrival feedback every 50ms.
+//
+// Loss and bandwidth are taken over the last second of receive_window_,
+// and percentiles over the last two seconds of each histogram, so both
+// follow the link as it is now rather than the whole session.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "stats_reporter.h"
 
 #include "../transport/nack_sender.h"
+#include "../transport/fec_decoder.h"
 
 #include <cs/common.h>
+#include <cs/qos/feedback_packet.h>
+#include <cs/thread_policy.h>
 #include <cs/transport/packet.h>
 
 #include <chrono>
 #include <cstring>
 #include <cmath>
 #include <algorithm>
-#include <numeric>
 
 namespace cs {
 
@@ -25,7 +32,8 @@ namespace cs {
 // Constructor / Destructor
 // ---------------------------------------------------------------------------
 
-StatsReporter::StatsReporter() = default;
+StatsReporter::StatsReporter()
+    : twcc_arrivals_(static_cast<size_t>(TWCC_MAX_PENDING), TWCC_NOT_RECEIVED) {}
 
 StatsReporter::~StatsReporter() {
     stop();
@@ -60,62 +68,162 @@ void StatsReporter::setNackSender(NackSender* nack_sender) {
 }
 
 // ---------------------------------------------------------------------------
-// onPacketReceived
+// setFecDecoder
 // ---------------------------------------------------------------------------
 
-void StatsReporter::onPacketReceived(const VideoPacketHeader& header, uint64_t recv_time_us) {
+void StatsReporter::setFecDecoder(FecDecoder* fec_decoder) {
     std::lock_guard<std::mutex> lock(mutex_);
+    fec_decoder_ = fec_decoder;
+}
 
-    PacketRecord record;
-    record.seq = header.sequence_number;
-    record.sender_timestamp_us = header.timestamp_us;
-    record.recv_time_us = recv_time_us;
-    record.payload_size = header.payload_length + static_cast<uint32_t>(sizeof(VideoPacketHeader));
+// ---------------------------------------------------------------------------
+// trackSequence -- loss and bandwidth accounting shared by video and FEC
+// packets (receive thread)
+// ---------------------------------------------------------------------------
 
-    // Track sequence numbers for packet loss
+void StatsReporter::trackSequence(uint16_t seq, size_t bytes, uint64_t recv_time_us) {
     if (first_packet_) {
-        expected_seq_ = header.sequence_number;
-        window_start_us_ = recv_time_us;
+        expected_seq_ = seq;
         first_packet_ = false;
     }
 
-    total_received_++;
-
-    // Count expected packets (handling wraparound)
-    int16_t delta = static_cast<int16_t>(header.sequence_number - expected_seq_);
-    if (delta > 0) {
-        total_expected_ += static_cast<uint64_t>(delta);
-        expected_seq_ = header.sequence_number + 1;
-    } else if (delta == 0) {
-        total_expected_++;
-        expected_seq_++;
+    // Count expected packets (handling wraparound): this one and the gap
+    // before it
+    uint64_t expected = 0;
+    int16_t delta = static_cast<int16_t>(seq - expected_seq_);
+    if (delta >= 0) {
+        expected = static_cast<uint64_t>(delta) + 1;
+        expected_seq_ = seq + 1;
     }
     // Negative delta = reordered/retransmitted packet, already counted
 
-    // Jitter calculation (RFC 3550 interarrival jitter)
+    receive_window_.add(recv_time_us, {1, expected, static_cast<uint64_t>(bytes)});
+    total_received_.store(total_received_.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+    total_bytes_.store(total_bytes_.load(std::memory_order_relaxed) + bytes,
+                       std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// onFecPacketReceived
+// ---------------------------------------------------------------------------
+
+void StatsReporter::onFecPacketReceived(uint16_t seq, size_t bytes,
+                                        uint64_t recv_time_us) {
+    trackSequence(seq, bytes, recv_time_us);
+}
+
+// ---------------------------------------------------------------------------
+// onPacketReceived
+// ---------------------------------------------------------------------------
+
+void StatsReporter::onPacketReceived(const VideoPacketHeaderV2& header, uint64_t recv_time_us) {
+    const size_t bytes = header.payload_length + header.wireSize();
+
+    // Track sequence numbers for packet loss
+    trackSequence(header.sequence_number, bytes, recv_time_us);
+    last_seq_.store(0x10000u | header.sequence_number, std::memory_order_relaxed);
+
+    // Jitter calculation (RFC 3550 interarrival jitter); D is also the
+    // one-way delay change the feedback thread filters
+    int64_t transit = static_cast<int64_t>(recv_time_us) -
+                      static_cast<int64_t>(header.timestamp_us);
     if (jitter_initialized_) {
-        int64_t transit = static_cast<int64_t>(recv_time_us) -
-                          static_cast<int64_t>(header.timestamp_us);
         int64_t d = transit - last_transit_;
+        last_delay_delta_us_.store(d, std::memory_order_relaxed);
+        has_delay_delta_.store(true, std::memory_order_relaxed);
+
         if (d < 0) d = -d;
         jitter_ += (static_cast<double>(d) - jitter_) / 16.0;
-        last_transit_ = transit;
+        jitter_us_.store(jitter_, std::memory_order_relaxed);
+        jitter_hist_.record(recv_time_us, static_cast<uint64_t>(d));
     } else {
-        last_transit_ = static_cast<int64_t>(recv_time_us) -
-                        static_cast<int64_t>(header.timestamp_us);
         jitter_initialized_ = true;
     }
+    last_transit_ = transit;
+
+    // Inter-frame gap, between the first packets of successive frames
+    if (!has_frame_ || static_cast<int32_t>(header.frame_number - last_frame_number_) > 0) {
+        if (has_frame_) frame_gap_hist_.record(recv_time_us, recv_time_us - last_frame_us_);
+        has_frame_         = true;
+        last_frame_number_ = header.frame_number;
+        last_frame_us_     = recv_time_us;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// onTransportArrivals
+// ---------------------------------------------------------------------------
+
+void StatsReporter::onTransportArrivals(const PacketArrival* arrivals, size_t count) {
+    std::lock_guard<std::mutex> lock(twcc_mutex_);
+
+    for (size_t i = 0; i < count; ++i) {
+        int64_t seq;
+        if (!twcc_started_) {
+            seq = arrivals[i].seq;
+            twcc_next_    = seq;
+            twcc_highest_ = seq;
+            twcc_started_ = true;
+        } else {
+            // Unwrap against the highest sequence seen so far.
+            int16_t delta = static_cast<int16_t>(
+                arrivals[i].seq - static_cast<uint16_t>(twcc_highest_));
+            seq = twcc_highest_ + delta;
+        }
+
+        // Already reported as lost (late or retransmitted copy).
+        if (seq < twcc_next_) continue;
+
+        // A long outage leaves a range too large to be worth describing:
+        // drop its start, keeping the ring's slots outside the range empty.
+        if (seq - twcc_next_ >= TWCC_MAX_PENDING) {
+            const int64_t next = seq - TWCC_MAX_PENDING + 1;
+            const int64_t stop = std::min(next, twcc_highest_ + 1);
+            for (int64_t s = twcc_next_; s < stop; ++s) {
+                twcc_arrivals_[static_cast<size_t>(s & (TWCC_MAX_PENDING - 1))] = TWCC_NOT_RECEIVED;
+            }
+            twcc_next_ = next;
+        }
+
+        twcc_highest_ = std::max(twcc_highest_, seq);
+        twcc_arrivals_[static_cast<size_t>(seq & (TWCC_MAX_PENDING - 1))] = arrivals[i].arrival_us;
+    }
+}
 
-    // Bandwidth tracking
-    window_bytes_ += record.payload_size;
+// ---------------------------------------------------------------------------
+// onRttProbe / getHostClock
+// ---------------------------------------------------------------------------
+
+void StatsReporter::onRttProbe(const uint8_t* data, size_t len) {
+    RttProbePacket probe;
+    if (!RttProbePacket::deserialize(data, len, probe)) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    echo_pending_      = true;
+    echo_timestamp_us_ = probe.send_time_us;
+    echo_recv_us_      = getTimestampUs();
+
+    if (probe.srtt_us > 0) {
+        host_srtt_us_.store(probe.srtt_us);
+        if (nack_sender_) nack_sender_->setRtt(probe.srtt_us, probe.rttvar_us);
+    }
 
-    // Store record
-    recent_packets_.push_back(record);
-    while (recent_packets_.size() > MAX_RECENT_PACKETS) {
-        recent_packets_.pop_front();
+    RttProbeClock clock;
+    if (RttProbeClock::deserialize(data, len, clock)) {
+        host_clock_.store(static_cast<uint64_t>(clock.error_us) << 32 | clock.offset_us);
+        has_host_clock_.store(true);
     }
 }
 
+bool StatsReporter::getHostClock(uint32_t& offset_us, uint32_t& error_us) const {
+    if (!has_host_clock_.load()) return false;
+    const uint64_t clock = host_clock_.load();
+    offset_us = static_cast<uint32_t>(clock);
+    error_us  = static_cast<uint32_t>(clock >> 32);
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 // start
 // ---------------------------------------------------------------------------
@@ -126,7 +234,8 @@ void StatsReporter::start() {
     running_.store(true);
     feedback_thread_ = std::thread(&StatsReporter::feedbackLoop, this);
 
-    CS_LOG(INFO, "StatsReporter: started (200ms feedback interval)");
+    CS_LOG(INFO, "StatsReporter: started (%ums QoS / %ums transport feedback)",
+           QOS_FEEDBACK_INTERVAL_MS, TRANSPORT_FEEDBACK_INTERVAL_MS);
 }
 
 // ---------------------------------------------------------------------------
@@ -148,36 +257,57 @@ void StatsReporter::stop() {
 // ---------------------------------------------------------------------------
 
 ViewerStats StatsReporter::getStats() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::lock_guard<std::mutex> slock(stats_mutex_);
+    const uint64_t now = getTimestampUs();
 
     ViewerStats stats;
-    stats.bitrate_kbps = calculateBandwidthKbps();
-    stats.packet_loss = calculatePacketLoss();
-    stats.jitter_ms = calculateJitterUs() / 1000.0;
-    stats.decode_time_ms = decode_time_ms_;
-    stats.render_time_ms = render_time_ms_;
-    stats.codec = codec_name_;
-    stats.resolution_width = resolution_width_;
-    stats.resolution_height = resolution_height_;
+    calculateWindow(now, stats.packet_loss, stats.bitrate_kbps);
+    stats.jitter_ms = jitter_us_.load() / 1000.0;
+    stats.decode_time_ms = decode_time_ms_.load();
+    stats.render_time_ms = render_time_ms_.load();
+    stats.present_latency_ms = present_latency_ms_.load();
     stats.frames_decoded = frames_decoded_.load();
     stats.frames_dropped = frames_dropped_.load();
-    stats.packets_received = total_received_;
-    stats.bytes_received = window_bytes_;
-
-    // Estimate FPS from recent frame timestamps
-    if (recent_packets_.size() >= 2) {
-        uint64_t time_span = recent_packets_.back().recv_time_us -
-                             recent_packets_.front().recv_time_us;
-        if (time_span > 0) {
-            double seconds = static_cast<double>(time_span) / 1e6;
-            stats.fps = static_cast<double>(frames_decoded_.load()) > 0 ?
-                        static_cast<double>(frames_decoded_.load()) / seconds : 0.0;
-            // Clamp to reasonable range
-            if (stats.fps > 300.0) stats.fps = 0.0;
+    stats.packets_received = total_received_.load();
+    stats.bytes_received = total_bytes_.load();
+    stats.rtt_ms = static_cast<double>(host_srtt_us_.load()) / 1000.0;
+    {
+        std::lock_guard<std::mutex> slock(stats_mutex_);
+        stats.codec = codec_name_;
+        stats.resolution_width = resolution_width_;
+        stats.resolution_height = resolution_height_;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (fec_decoder_) {
+            stats.fec_recovered     = fec_decoder_->getRecoveredCount();
+            stats.fec_unrecoverable = fec_decoder_->getUnrecoverableCount();
         }
     }
 
+    // FPS: frames decoded over the last second
+    WindowedCounters<1>::Values decoded;
+    uint64_t span_us = decoded_window_.sum(now, decoded);
+    if (span_us > 0) {
+        stats.fps = static_cast<double>(decoded[0]) * 1e6 / static_cast<double>(span_us);
+    }
+
+    const WindowPercentiles jitter = jitter_hist_.percentiles(now);
+    stats.jitter_p50_ms = jitter.p50_ms;
+    stats.jitter_p95_ms = jitter.p95_ms;
+    stats.jitter_p99_ms = jitter.p99_ms;
+    const WindowPercentiles gap = frame_gap_hist_.percentiles(now);
+    stats.frame_gap_p50_ms = gap.p50_ms;
+    stats.frame_gap_p95_ms = gap.p95_ms;
+    stats.frame_gap_p99_ms = gap.p99_ms;
+    const WindowPercentiles decode = decode_hist_.percentiles(now);
+    stats.decode_time_p50_ms = decode.p50_ms;
+    stats.decode_time_p95_ms = decode.p95_ms;
+    stats.decode_time_p99_ms = decode.p99_ms;
+    const WindowPercentiles render = render_hist_.percentiles(now);
+    stats.render_time_p50_ms = render.p50_ms;
+    stats.render_time_p95_ms = render.p95_ms;
+    stats.render_time_p99_ms = render.p99_ms;
+
     stats.connection_type = "p2p";
 
     return stats;
@@ -187,14 +317,22 @@ ViewerStats StatsReporter::getStats() const {
 // Stat update methods
 // ---------------------------------------------------------------------------
 
+static uint64_t msToUs(double ms) {
+    return static_cast<uint64_t>(std::max(ms, 0.0) * 1000.0);
+}
+
 void StatsReporter::setDecodeTimeMs(double ms) {
-    std::lock_guard<std::mutex> lock(stats_mutex_);
-    decode_time_ms_ = ms;
+    decode_time_ms_.store(ms);
+    decode_hist_.record(getTimestampUs(), msToUs(ms));
 }
 
 void StatsReporter::setRenderTimeMs(double ms) {
-    std::lock_guard<std::mutex> lock(stats_mutex_);
-    render_time_ms_ = ms;
+    render_time_ms_.store(ms);
+    render_hist_.record(getTimestampUs(), msToUs(ms));
+}
+
+void StatsReporter::setPresentLatencyMs(double ms) {
+    present_latency_ms_.store(ms);
 }
 
 void StatsReporter::setCodecName(const std::string& name) {
@@ -210,150 +348,192 @@ void StatsReporter::setResolution(uint32_t width, uint32_t height) {
 
 void StatsReporter::onFrameDecoded() {
     frames_decoded_.fetch_add(1);
+    decoded_window_.add(getTimestampUs(), {1});
 }
 
 void StatsReporter::onFrameDropped() {
     frames_dropped_.fetch_add(1);
 }
 
+void StatsReporter::onLtrDecoded(uint32_t frame_number) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    has_ltr_ack_   = true;
+    ltr_ack_frame_ = frame_number;
+}
+
 // ---------------------------------------------------------------------------
 // feedbackLoop
 // ---------------------------------------------------------------------------
 
 void StatsReporter::feedbackLoop() {
+    ScopedThreadRole role(ThreadRole::FEEDBACK);
+    constexpr uint32_t qos_every = QOS_FEEDBACK_INTERVAL_MS / TRANSPORT_FEEDBACK_INTERVAL_MS;
+    uint32_t tick = 0;
+
     while (running_.load()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        std::this_thread::sleep_for(std::chrono::milliseconds(TRANSPORT_FEEDBACK_INTERVAL_MS));
 
         if (!running_.load()) break;
 
-        sendFeedback();
+        sendTransportFeedback();
+        if (++tick % qos_every == 0) {
+            sendFeedback();
+            if (on_feedback_) on_feedback_();
+        }
     }
 }
 
 // ---------------------------------------------------------------------------
-// sendFeedback
+// sendTransportFeedback
 // ---------------------------------------------------------------------------
 
-void StatsReporter::sendFeedback() {
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    if (socket_fd_ < 0 || peer_addr_.empty()) {
+void StatsReporter::sendTransportFeedback() {
+    if (socket_fd_.load() < 0 || peer_addr_.empty()) {
         return;
     }
 
-    QosFeedbackPacket feedback = {};
-    feedback.type = static_cast<uint8_t>(PacketType::QOS_FEEDBACK);
-    feedback.flags = 0;
-
-    // Fill in stats
-    if (!recent_packets_.empty()) {
-        feedback.last_seq_received = recent_packets_.back().seq;
+    // Copy the arrivals out under the lock; serialize and send after it,
+    // with the receive thread free to record more.
+    size_t messages = 0;
+    {
+        std::lock_guard<std::mutex> lock(twcc_mutex_);
+        if (!twcc_started_) return;
+
+        while (twcc_next_ <= twcc_highest_) {
+            int64_t end = std::min<int64_t>(twcc_highest_ + 1,
+                twcc_next_ + static_cast<int64_t>(TWCC_MAX_PACKETS_PER_FEEDBACK));
+
+            if (messages == twcc_out_.size()) twcc_out_.emplace_back();
+            TransportFeedback& fb = twcc_out_[messages++];
+            fb.feedback_seq = twcc_feedback_seq_++;
+            fb.base_seq     = static_cast<uint16_t>(twcc_next_);
+            fb.packets.clear();
+            for (int64_t seq = twcc_next_; seq < end; ++seq) {
+                PacketArrival pa;
+                pa.seq = static_cast<uint16_t>(seq);
+                uint64_t& arrival = twcc_arrivals_[static_cast<size_t>(seq & (TWCC_MAX_PENDING - 1))];
+                if (arrival != TWCC_NOT_RECEIVED) {
+                    pa.received   = true;
+                    pa.arrival_us = arrival;
+                    arrival = TWCC_NOT_RECEIVED;
+                }
+                fb.packets.push_back(pa);
+            }
+            twcc_next_ = end;
+        }
     }
 
-    feedback.estimated_bw_kbps = static_cast<uint32_t>(calculateBandwidthKbps());
-
-    double loss = calculatePacketLoss();
-    feedback.packet_loss_x100 = static_cast<uint16_t>(loss * 10000.0);
-
-    double jitter_us = calculateJitterUs();
-    feedback.avg_jitter_us = static_cast<uint16_t>(
-        std::min(jitter_us, static_cast<double>(UINT16_MAX)));
-
-    feedback.delay_gradient_us = calculateDelayGradientUs();
-
-    // Include NACK sequences from the NACK sender
-    feedback.nack_count = 0;
-    feedback.nack_seq_0 = 0;
-    feedback.nack_seq_1 = 0;
-
-    if (nack_sender_) {
-        auto missing = nack_sender_->getMissingSequences();
-        feedback.nack_count = static_cast<uint16_t>(std::min(missing.size(), static_cast<size_t>(UINT16_MAX)));
-        if (missing.size() >= 1) feedback.nack_seq_0 = missing[0];
-        if (missing.size() >= 2) feedback.nack_seq_1 = missing[1];
+    for (size_t i = 0; i < messages; ++i) {
+        sendToHost(twcc_out_[i].serialize());
     }
+}
 
-    // Serialize and send
-    auto buf = feedback.serialize();
+// ---------------------------------------------------------------------------
+// sendToHost
+// ---------------------------------------------------------------------------
 
-    int sent = ::sendto(socket_fd_,
-                         reinterpret_cast<const char*>(buf.data()),
-                         static_cast<int>(buf.size()),
+void StatsReporter::sendToHost(const uint8_t* data, size_t len) {
+    // Feedback thread only
+    int sent = ::sendto(socket_fd_.load(),
+                         reinterpret_cast<const char*>(data),
+                         static_cast<int>(len),
                          0,
                          reinterpret_cast<const ::sockaddr*>(peer_addr_.data()),
                          peer_addr_len_);
 
     if (sent <= 0) {
         CS_LOG(WARN, "StatsReporter: sendto failed: %d", cs_socket_error());
+    } else if (recorder_) {
+        recorder_->record(RecordDirection::SENT, data, len);
     }
 }
 
 // ---------------------------------------------------------------------------
-// calculatePacketLoss
+// sendFeedback
 // ---------------------------------------------------------------------------
 
-double StatsReporter::calculatePacketLoss() const {
-    // Called under lock
-    if (total_expected_ == 0) return 0.0;
+void StatsReporter::sendFeedback() {
+    std::lock_guard<std::mutex> lock(mutex_);
 
-    uint64_t lost = (total_expected_ > total_received_) ?
-                    (total_expected_ - total_received_) : 0;
-    return static_cast<double>(lost) / static_cast<double>(total_expected_);
-}
+    if (socket_fd_.load() < 0 || peer_addr_.empty()) {
+        return;
+    }
 
-// ---------------------------------------------------------------------------
-// calculateJitterUs
-// ---------------------------------------------------------------------------
+    QosFeedback feedback;
 
-double StatsReporter::calculateJitterUs() const {
-    // Called under lock
-    return jitter_;
-}
+    // Fill in stats, from what the receive thread has published
+    const uint32_t last_seq = last_seq_.load(std::memory_order_relaxed);
+    if (last_seq != 0) {
+        feedback.last_seq_received = static_cast<uint16_t>(last_seq);
+    }
 
-// ---------------------------------------------------------------------------
-// calculateBandwidthKbps
-// ---------------------------------------------------------------------------
+    double loss = 0.0, bandwidth_kbps = 0.0;
+    calculateWindow(getTimestampUs(), loss, bandwidth_kbps);
+    feedback.estimated_bw_kbps = static_cast<uint32_t>(bandwidth_kbps);
+    feedback.packet_loss_x100 = static_cast<uint16_t>(loss * 10000.0);
+
+    double jitter_us = jitter_us_.load(std::memory_order_relaxed);
+    feedback.avg_jitter_us = static_cast<uint16_t>(
+        std::min(jitter_us, static_cast<double>(UINT16_MAX)));
 
-double StatsReporter::calculateBandwidthKbps() const {
-    // Called under lock
-    if (recent_packets_.size() < 2) return 0.0;
+    feedback.delay_gradient_us = calculateDelayGradientUs();
 
-    uint64_t time_span = recent_packets_.back().recv_time_us -
-                         recent_packets_.front().recv_time_us;
-    if (time_span == 0) return 0.0;
+    // Include NACK sequences from the NACK sender
+    if (nack_sender_) {
+        feedback.nack_seqs = nack_sender_->getMissingSequences();
+    }
 
-    // Sum bytes in the recent window
-    uint64_t total_bytes = 0;
-    for (const auto& pkt : recent_packets_) {
-        total_bytes += pkt.payload_size;
+    // Echo the latest RTT probe, with how long we sat on it
+    if (echo_pending_) {
+        uint64_t hold_us = getTimestampUs() - echo_recv_us_;
+        feedback.has_echo          = true;
+        feedback.echo_timestamp_us = echo_timestamp_us_;
+        feedback.echo_hold_us      = static_cast<uint32_t>(std::min<uint64_t>(hold_us, UINT32_MAX));
+        feedback.has_clock         = true;
+        feedback.echo_recv_us      = static_cast<uint32_t>(echo_recv_us_);
+        echo_pending_ = false;
     }
 
-    double seconds = static_cast<double>(time_span) / 1e6;
-    double bits = static_cast<double>(total_bytes) * 8.0;
-    return bits / seconds / 1000.0;  // kbps
+    // Acknowledge the newest long-term reference we hold
+    feedback.has_ltr_ack   = has_ltr_ack_;
+    feedback.ltr_ack_frame = ltr_ack_frame_;
+
+    // Serialize and send, from the stack
+    uint8_t buf[QosFeedback::MAX_WIRE_SIZE];
+    size_t len = feedback.serializeTo(buf);
+    if (len > 0) sendToHost(buf, len);
 }
 
 // ---------------------------------------------------------------------------
-// calculateDelayGradientUs
+// calculateWindow
 // ---------------------------------------------------------------------------
 
-int32_t StatsReporter::calculateDelayGradientUs() const {
-    // Simple Kalman filter on one-way delay measurements
-    // Called under lock
+void StatsReporter::calculateWindow(uint64_t now_us, double& loss,
+                                    double& bandwidth_kbps) const {
+    WindowedCounters<WINDOW_FIELDS>::Values totals;
+    uint64_t span_us = receive_window_.sum(now_us, totals);
+
+    const uint64_t expected = totals[WINDOW_EXPECTED];
+    const uint64_t received = totals[WINDOW_RECEIVED];
+    loss = (expected > received) ?
+           static_cast<double>(expected - received) / static_cast<double>(expected) : 0.0;
 
-    if (recent_packets_.size() < 2) return 0;
+    // bytes x 8000 / us = kbps
+    bandwidth_kbps = (span_us > 0) ?
+                     static_cast<double>(totals[WINDOW_BYTES]) * 8000.0 /
+                     static_cast<double>(span_us) : 0.0;
+}
 
-    // Calculate inter-packet delay differences
-    const auto& prev = recent_packets_[recent_packets_.size() - 2];
-    const auto& curr = recent_packets_.back();
+// ---------------------------------------------------------------------------
+// calculateDelayGradientUs
+// ---------------------------------------------------------------------------
 
-    // One-way delay: (recv_time - sender_timestamp)
-    int64_t prev_delay = static_cast<int64_t>(prev.recv_time_us) -
-                         static_cast<int64_t>(prev.sender_timestamp_us);
-    int64_t curr_delay = static_cast<int64_t>(curr.recv_time_us) -
-                         static_cast<int64_t>(curr.sender_timestamp_us);
+int32_t StatsReporter::calculateDelayGradientUs() {
+    // Simple Kalman filter on one-way delay measurements: the change in
+    // (recv_time - sender_timestamp) between the two newest video packets
+    if (!has_delay_delta_.load(std::memory_order_relaxed)) return 0;
 
-    double measurement = static_cast<double>(curr_delay - prev_delay);
+    double measurement = static_cast<double>(last_delay_delta_us_.load(std::memory_order_relaxed));
 
     // Kalman filter update
     double predict_error = kalman_error_ + KALMAN_Q;
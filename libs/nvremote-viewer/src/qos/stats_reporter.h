@@ -6,7 +6,24 @@
 // the host so it can adapt encoding parameters.
 //
 // Feedback is sent every 200ms using the QosFeedbackPacket format defined
-// in nvremote-common.
+// in nvremote-common.  Every 50ms a TransportFeedback message additionally
+// reports the arrival time (or loss) of each sealed packet by its
+// transport-wide sequence number, for the host's bandwidth estimator.
+//
+// Per-packet accounting is O(1) and takes no lock: the receive thread is the
+// only writer of the loss, jitter and bandwidth state and publishes it
+// through atomics and sliding windows (window_stats.h), and the decode and
+// render threads each own their histogram.  The feedback thread and
+// getStats() read snapshots.  Only the transport-wide arrivals, which the
+// feedback thread consumes, sit behind a lock of their own, taken once per
+// receive batch and, on the feedback side, only to copy the arrivals out.
+//
+// The host answers each report with an RttProbePacket.  The next report
+// echoes its timestamp and hold time so the host can measure RTT; the
+// host's SRTT / RTTVAR carried in the probe pace the NackSender's retries.
+// The echo also says when the probe arrived, from which the host estimates
+// our clock's offset from its own; the estimate comes back in later probes
+// (getHostClock()) and places host timestamps on our clock.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
@@ -14,7 +31,8 @@
 #include <mutex>
 #include <thread>
 #include <atomic>
-#include <deque>
+#include <functional>
+#include <string>
 #include <vector>
 
 // Platform socket headers -- needed so ::sockaddr resolves inside the namespace.
@@ -27,11 +45,15 @@
 #endif
 
 #include <cs/transport/packet.h>
+#include <cs/transport/packet_recorder.h>
+#include <cs/qos/transport_feedback.h>
 #include "../viewer.h"
+#include "window_stats.h"
 
 namespace cs {
 
 class NackSender;  // forward
+class FecDecoder;  // forward
 
 class StatsReporter {
 public:
@@ -45,11 +67,43 @@ public:
     /// Initialize with a socket and peer address for sending feedback.
     bool initialize(int socket_fd, const ::sockaddr* peer, int peer_len);
 
+    /// Send on |socket_fd| from now on (the session moved to another path).
+    void setSocket(int socket_fd) { socket_fd_.store(socket_fd); }
+
+    /// Record what this sends to |recorder| (see packet_recorder.h), which
+    /// must outlive it.  Must be set before sending starts.
+    void setRecorder(PacketRecorder* recorder) { recorder_ = recorder; }
+
     /// Set the NACK sender to query for missing sequences.
     void setNackSender(NackSender* nack_sender);
 
+    /// Set the FEC decoder to query for recovered/unrecoverable counters.
+    void setFecDecoder(FecDecoder* fec_decoder);
+
     /// Called for each received video packet to update statistics.
-    void onPacketReceived(const VideoPacketHeader& header, uint64_t recv_time_us);
+    void onPacketReceived(const VideoPacketHeaderV2& header, uint64_t recv_time_us);
+
+    /// Called for each received FEC packet.  FEC packets share the video
+    /// sequence space, so they must be counted to keep the loss rate honest.
+    void onFecPacketReceived(uint16_t seq, size_t bytes, uint64_t recv_time_us);
+
+    /// Called once per receive batch with the arrivals of sealed packets
+    /// (UdpReceiver's ArrivalCallback).
+    void onTransportArrivals(const PacketArrival* arrivals, size_t count);
+
+    /// Called for each RTT probe from the host: remembered for the echo in
+    /// the next QoS feedback, and its RTT estimate is passed to the
+    /// NackSender.
+    void onRttProbe(const uint8_t* data, size_t len);
+
+    /// The host's estimate of our clock minus its own, modulo 2^32 (a host
+    /// timestamp plus |offset_us| is the same instant on our clock), and a
+    /// bound on its error.  False until the host has sent one.  Lock-free.
+    bool getHostClock(uint32_t& offset_us, uint32_t& error_us) const;
+
+    /// Called on the feedback thread after each QoS feedback (every 200ms).
+    /// Set before start().
+    void setOnFeedback(std::function<void()> cb) { on_feedback_ = std::move(cb); }
 
     /// Start sending feedback every 200ms.
     void start();
@@ -60,24 +114,34 @@ public:
     /// Get a snapshot of current statistics.
     ViewerStats getStats() const;
 
-    /// Update decode time from the decoder.
+    /// Update decode time from the decoder, and count it into the decode
+    /// time percentiles.  Decode thread.
     void setDecodeTimeMs(double ms);
 
-    /// Update render time from the renderer.
+    /// Update render time from the renderer, and count it into the render
+    /// time percentiles.  Render thread.
     void setRenderTimeMs(double ms);
 
+    /// Update the time from a frame leaving the decoder to its present.
+    void setPresentLatencyMs(double ms);
+
     /// Update codec name.
     void setCodecName(const std::string& name);
 
     /// Update resolution.
     void setResolution(uint32_t width, uint32_t height);
 
-    /// Increment frames decoded counter.
+    /// Increment frames decoded counter.  Decode thread.
     void onFrameDecoded();
 
     /// Increment frames dropped counter.
     void onFrameDropped();
 
+    /// Called when a long-term reference frame (wire frame number) was
+    /// decoded with a clean reference chain.  Acknowledged to the host in
+    /// every following QoS feedback until a newer one arrives.
+    void onLtrDecoded(uint32_t frame_number);
+
 private:
     /// Background thread function.
     void feedbackLoop();
@@ -85,68 +149,110 @@ private:
     /// Calculate and send a QoS feedback packet.
     void sendFeedback();
 
-    /// Calculate packet loss rate over the recent window.
-    double calculatePacketLoss() const;
+    /// Report every transport sequence number since the last report.
+    void sendTransportFeedback();
+
+    /// Write one datagram to the host (feedback thread).
+    void sendToHost(const uint8_t* data, size_t len);
+    void sendToHost(const std::vector<uint8_t>& buf) { sendToHost(buf.data(), buf.size()); }
 
-    /// Calculate average jitter in microseconds.
-    double calculateJitterUs() const;
+    /// Count a video or FEC packet of |bytes| (receive thread).
+    void trackSequence(uint16_t seq, size_t bytes, uint64_t recv_time_us);
 
-    /// Estimate bandwidth in kbps over the recent window.
-    double calculateBandwidthKbps() const;
+    /// Packet loss rate and bandwidth in kbps over the window ending at
+    /// |now_us|.
+    void calculateWindow(uint64_t now_us, double& loss, double& bandwidth_kbps) const;
 
-    /// Calculate one-way delay gradient using a simple Kalman filter.
-    int32_t calculateDelayGradientUs() const;
+    /// Filter the latest one-way delay change with a simple Kalman filter
+    /// (feedback thread).
+    int32_t calculateDelayGradientUs();
 
     // Socket
-    int socket_fd_ = -1;
+    std::atomic<int> socket_fd_{-1};
     std::vector<uint8_t> peer_addr_;
     int peer_addr_len_ = 0;
+    PacketRecorder* recorder_ = nullptr;   // Session recording (not owned)
 
     // NACK sender reference (not owned)
     NackSender* nack_sender_ = nullptr;
 
-    // Packet arrival records for statistics calculation
-    struct PacketRecord {
-        uint16_t seq;
-        uint32_t sender_timestamp_us;
-        uint64_t recv_time_us;
-        uint32_t payload_size;
-    };
-    std::deque<PacketRecord> recent_packets_;
-    static constexpr size_t MAX_RECENT_PACKETS = 1000;
-
-    // Sequence tracking for packet loss
+    // FEC decoder reference (not owned)
+    FecDecoder* fec_decoder_ = nullptr;
+
+    // Receive thread only
     uint16_t expected_seq_       = 0;
-    uint64_t total_expected_     = 0;
-    uint64_t total_received_     = 0;
     bool     first_packet_       = true;
-
-    // Jitter calculation (RFC 3550 style)
-    double   jitter_             = 0.0;
+    double   jitter_             = 0.0;    // RFC 3550 interarrival jitter, us
     int64_t  last_transit_       = 0;
     bool     jitter_initialized_ = false;
-
-    // Bandwidth window
-    uint64_t window_start_us_    = 0;
-    uint64_t window_bytes_       = 0;
-
-    // One-way delay Kalman filter state
-    mutable double kalman_estimate_ = 0.0;
-    mutable double kalman_error_    = 1.0;
+    uint32_t last_frame_number_  = 0;
+    uint64_t last_frame_us_      = 0;      // First packet of the newest frame
+    bool     has_frame_          = false;
+
+    // Published by the receive thread
+    enum WindowField : size_t { WINDOW_RECEIVED, WINDOW_EXPECTED, WINDOW_BYTES, WINDOW_FIELDS };
+    WindowedCounters<WINDOW_FIELDS> receive_window_;
+    std::atomic<uint64_t> total_received_{0};
+    std::atomic<uint64_t> total_bytes_{0};
+    std::atomic<double>   jitter_us_{0.0};
+    std::atomic<uint32_t> last_seq_{0};            // Newest video seq, plus 0x10000 once set
+    std::atomic<int64_t>  last_delay_delta_us_{0}; // Between the two newest video packets
+    std::atomic<bool>     has_delay_delta_{false};
+    WindowedHistogram     jitter_hist_;            // |D| of each packet pair
+    WindowedHistogram     frame_gap_hist_;         // Between frames' first packets
+
+    // Transport-wide arrivals not yet reported, in a ring indexed by the
+    // unwrapped sequence number modulo TWCC_MAX_PENDING; [twcc_next_,
+    // twcc_highest_] is the range still to report.
+    static constexpr int64_t  TWCC_MAX_PENDING        = 8192;  // Older gaps are dropped
+    static constexpr uint64_t TWCC_NOT_RECEIVED       = UINT64_MAX;
+    static constexpr uint32_t TRANSPORT_FEEDBACK_INTERVAL_MS = 50;
+    static constexpr uint32_t QOS_FEEDBACK_INTERVAL_MS       = 200;
+    std::mutex            twcc_mutex_;
+    std::vector<uint64_t> twcc_arrivals_;          // TWCC_MAX_PENDING arrival times
+    int64_t  twcc_next_          = 0;
+    int64_t  twcc_highest_       = -1;
+    bool     twcc_started_       = false;
+    uint8_t  twcc_feedback_seq_  = 0;              // Feedback thread
+    std::vector<TransportFeedback> twcc_out_;      // Feedback thread
+
+    // Latest RTT probe, echoed once in the next QoS feedback.
+    bool     echo_pending_       = false;
+    uint32_t echo_timestamp_us_  = 0;      // Host clock
+    uint64_t echo_recv_us_       = 0;      // Our clock, when the probe arrived
+    std::atomic<uint32_t> host_srtt_us_{0};    // Host's smoothed RTT (for stats)
+
+    // Host clock estimate: offset (low 32 bits) and error (high), once set
+    std::atomic<bool>     has_host_clock_{false};
+    std::atomic<uint64_t> host_clock_{0};
+
+    // Newest cleanly decoded LTR frame, repeated so a lost report costs nothing.
+    bool     has_ltr_ack_        = false;
+    uint32_t ltr_ack_frame_      = 0;
+
+    // One-way delay Kalman filter state (feedback thread)
+    double kalman_estimate_ = 0.0;
+    double kalman_error_    = 1.0;
     static constexpr double KALMAN_Q = 0.001;  // Process noise
     static constexpr double KALMAN_R = 0.1;    // Measurement noise
 
-    // Stats snapshot (thread-safe)
+    // Decode and render thread stats, latest value and windowed
+    std::atomic<double>   decode_time_ms_{0.0};
+    std::atomic<double>   render_time_ms_{0.0};
+    std::atomic<double>   present_latency_ms_{0.0};
+    WindowedHistogram     decode_hist_;            // Decode thread
+    WindowedHistogram     render_hist_;            // Render thread
+    WindowedCounters<1>   decoded_window_;         // Decode thread, for fps
+    std::atomic<uint64_t> frames_decoded_{0};
+    std::atomic<uint64_t> frames_dropped_{0};
+
     mutable std::mutex stats_mutex_;
-    double   decode_time_ms_    = 0.0;
-    double   render_time_ms_    = 0.0;
     std::string codec_name_;
     uint32_t resolution_width_  = 0;
     uint32_t resolution_height_ = 0;
-    std::atomic<uint64_t> frames_decoded_{0};
-    std::atomic<uint64_t> frames_dropped_{0};
 
     // Thread
+    std::function<void()> on_feedback_;
     std::thread feedback_thread_;
     std::atomic<bool> running_{false};
 
@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+// stats_ring.cpp -- Stats and per-frame timings in memory JavaScript reads
+///////////////////////////////////////////////////////////////////////////////
+
+#include "stats_ring.h"
+#include "../viewer.h"
+
+#include <cstring>
+
+namespace cs {
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+              std::atomic<uint32_t>::is_always_lock_free,
+              "Header words are read as plain u32s from JavaScript");
+static_assert(StatsRing::HEADER_BYTES >= 7 * sizeof(uint32_t) &&
+              StatsRing::HEADER_BYTES % sizeof(double) == 0,
+              "Header must hold its words and keep the doubles aligned");
+
+// ---------------------------------------------------------------------------
+// attach
+// ---------------------------------------------------------------------------
+
+bool StatsRing::attach(void* mem, size_t len) {
+    if (!mem || len < bytes() || reinterpret_cast<uintptr_t>(mem) % alignof(double) != 0) {
+        return false;
+    }
+
+    std::memset(mem, 0, bytes());
+    base_ = static_cast<uint8_t*>(mem);
+    stats_seq_  = 0;
+    frame_head_ = 0;
+
+    word(H_VERSION).store(VERSION, std::memory_order_relaxed);
+    word(H_STATS_FIELDS).store(static_cast<uint32_t>(StatsField::COUNT), std::memory_order_relaxed);
+    word(H_FRAME_FIELDS).store(static_cast<uint32_t>(FrameField::COUNT), std::memory_order_relaxed);
+    word(H_FRAME_CAPACITY).store(FRAME_CAPACITY, std::memory_order_relaxed);
+    word(H_MAGIC).store(MAGIC, std::memory_order_release);   // Last: the layout is valid
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// writeStats
+// ---------------------------------------------------------------------------
+
+void StatsRing::writeStats(const ViewerStats& s, uint64_t now_us) {
+    if (!base_) return;
+
+    double v[static_cast<size_t>(StatsField::COUNT)];
+    auto set = [&v](StatsField f, double value) { v[static_cast<size_t>(f)] = value; };
+    set(StatsField::UPDATED_US,              static_cast<double>(now_us));
+    set(StatsField::BITRATE_KBPS,            s.bitrate_kbps);
+    set(StatsField::FPS,                     s.fps);
+    set(StatsField::PACKET_LOSS,             s.packet_loss);
+    set(StatsField::JITTER_MS,               s.jitter_ms);
+    set(StatsField::RTT_MS,                  s.rtt_ms);
+    set(StatsField::RESOLUTION_WIDTH,        s.resolution_width);
+    set(StatsField::RESOLUTION_HEIGHT,       s.resolution_height);
+    set(StatsField::DECODE_TIME_MS,          s.decode_time_ms);
+    set(StatsField::RENDER_TIME_MS,          s.render_time_ms);
+    set(StatsField::PRESENT_LATENCY_MS,      s.present_latency_ms);
+    set(StatsField::PRESENT_TO_PHOTON_MS,    s.present_to_photon_ms);
+    set(StatsField::FRAMES_DECODED,          static_cast<double>(s.frames_decoded));
+    set(StatsField::FRAMES_DROPPED,          static_cast<double>(s.frames_dropped));
+    set(StatsField::PACKETS_RECEIVED,        static_cast<double>(s.packets_received));
+    set(StatsField::BYTES_RECEIVED,          static_cast<double>(s.bytes_received));
+    set(StatsField::FEC_RECOVERED,           static_cast<double>(s.fec_recovered));
+    set(StatsField::FEC_UNRECOVERABLE,       static_cast<double>(s.fec_unrecoverable));
+    set(StatsField::JITTER_BUFFER_MS,        s.jitter_buffer_ms);
+    set(StatsField::LATE_FRAMES,             static_cast<double>(s.late_frames));
+    set(StatsField::RENDER_DROPPED,          static_cast<double>(s.render_dropped));
+    set(StatsField::PATH_MIGRATIONS,         static_cast<double>(s.path_migrations));
+    set(StatsField::AUDIO_OUTPUT_LATENCY_MS, s.audio_output_latency_ms);
+    set(StatsField::AUDIO_BUFFER_MS,         s.audio_buffer_ms);
+    set(StatsField::AUDIO_FEC_RECOVERED,     static_cast<double>(s.audio_fec_recovered));
+    set(StatsField::AUDIO_CONCEALED,         static_cast<double>(s.audio_concealed));
+    set(StatsField::AUDIO_UNDERRUNS,         static_cast<double>(s.audio_underruns));
+    set(StatsField::AV_OFFSET_MS,            s.av_offset_ms);
+    set(StatsField::AV_AUDIO_DELAY_MS,       s.av_audio_delay_ms);
+    set(StatsField::AV_VIDEO_DELAY_MS,       s.av_video_delay_ms);
+    set(StatsField::CLOCK_SYNCED,            s.clock_synced ? 1.0 : 0.0);
+    set(StatsField::CLOCK_ERROR_MS,          s.clock_error_ms);
+    set(StatsField::FIRST_PACKET_P50_MS,     s.first_packet_p50_ms);
+    set(StatsField::FIRST_PACKET_P99_MS,     s.first_packet_p99_ms);
+    set(StatsField::FRAME_COMPLETE_P50_MS,   s.frame_complete_p50_ms);
+    set(StatsField::FRAME_COMPLETE_P99_MS,   s.frame_complete_p99_ms);
+    set(StatsField::GLASS_TO_GLASS_P50_MS,   s.glass_to_glass_p50_ms);
+    set(StatsField::GLASS_TO_GLASS_P99_MS,   s.glass_to_glass_p99_ms);
+    set(StatsField::INPUT_TO_PHOTON_P50_MS,  s.input_to_photon_p50_ms);
+    set(StatsField::INPUT_TO_PHOTON_P99_MS,  s.input_to_photon_p99_ms);
+
+    // Seqlock: odd while the fields are in flux
+    word(H_STATS_SEQ).store(++stats_seq_, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(statsBase(), v, sizeof(v));
+    word(H_STATS_SEQ).store(++stats_seq_, std::memory_order_release);
+}
+
+// ---------------------------------------------------------------------------
+// writeFrame
+// ---------------------------------------------------------------------------
+
+void StatsRing::writeFrame(const FrameTiming& t) {
+    if (!base_) return;
+
+    double v[static_cast<size_t>(FrameField::COUNT)];
+    auto set = [&v](FrameField f, double value) { v[static_cast<size_t>(f)] = value; };
+    set(FrameField::SEQ,                static_cast<double>(frame_head_) + 1.0);
+    set(FrameField::CAPTURE_TS_US,      t.capture_ts_us);
+    set(FrameField::PRESENTED_US,       static_cast<double>(t.presented_us));
+    set(FrameField::FIRST_PACKET_MS,    t.first_packet_ms);
+    set(FrameField::FRAME_COMPLETE_MS,  t.frame_complete_ms);
+    set(FrameField::GLASS_TO_GLASS_MS,  t.glass_to_glass_ms);
+    set(FrameField::PRESENT_LATENCY_MS, t.present_latency_ms);
+    set(FrameField::RENDER_MS,          t.render_ms);
+
+    // SEQ is cleared first and set last, so a record read mid-write fails
+    // its SEQ check on one side or the other
+    double* slot = frameSlot(frame_head_);
+    const double writing = 0.0;
+    std::memcpy(&slot[0], &writing, sizeof(double));
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&slot[1], &v[1], sizeof(v) - sizeof(double));
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&slot[0], &v[0], sizeof(double));
+
+    word(H_FRAME_HEAD).store(++frame_head_, std::memory_order_release);
+}
+
+// ---------------------------------------------------------------------------
+// Layout
+// ---------------------------------------------------------------------------
+
+std::atomic<uint32_t>& StatsRing::word(size_t index) {
+    return *reinterpret_cast<std::atomic<uint32_t>*>(base_ + index * sizeof(uint32_t));
+}
+
+double* StatsRing::statsBase() {
+    return reinterpret_cast<double*>(base_ + HEADER_BYTES);
+}
+
+double* StatsRing::frameSlot(uint32_t n) {
+    return statsBase() + static_cast<size_t>(StatsField::COUNT) +
+           static_cast<size_t>(n % FRAME_CAPACITY) * static_cast<size_t>(FrameField::COUNT);
+}
+
+} // namespace cs
@@ -0,0 +1,162 @@
+///////////////////////////////////////////////////////////////////////////////
+// stats_ring.h -- Stats and per-frame timings in memory JavaScript reads
+//
+// The addon hands Electron an ArrayBuffer laid out as below and the viewer
+// threads write into it, so an overlay polling at display rate neither
+// calls into native code nor allocates.  Everything is little-endian and
+// 8-byte aligned; the JS reader (apps/client-desktop/src/main/stats-ring.ts)
+// mirrors these offsets and the field order, and must change with them.
+//
+//   header   HEADER_BYTES
+//     u32 magic           MAGIC
+//     u32 version         VERSION
+//     u32 stats_fields    StatsField::COUNT
+//     u32 frame_fields    FrameField::COUNT
+//     u32 frame_capacity  FRAME_CAPACITY
+//     u32 stats_seq       odd while the snapshot is being written
+//     u32 frame_head      records written so far (mod 2^32)
+//   stats    StatsField::COUNT doubles: the latest getStats() snapshot
+//   frames   FRAME_CAPACITY records of FrameField::COUNT doubles; record
+//            n is in slot n % FRAME_CAPACITY
+//
+// Both parts are single-writer: the snapshot is written by the stats
+// thread every QoS feedback interval, under a seqlock (a reader retries
+// when stats_seq was odd or changed while it read).  Frame records are
+// written by the render thread as each frame is presented; a record's
+// SEQ field is n + 1 once it is complete and 0 while it is written, and
+// frame_head is advanced after it, so a reader that fell more than
+// FRAME_CAPACITY behind or raced the writer sees the mismatch and skips.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace cs {
+
+struct ViewerStats;
+
+/// Snapshot fields, one double each, in buffer order.
+enum class StatsField : uint32_t {
+    UPDATED_US = 0,        // Viewer clock of the snapshot
+    BITRATE_KBPS,
+    FPS,
+    PACKET_LOSS,
+    JITTER_MS,
+    RTT_MS,
+    RESOLUTION_WIDTH,
+    RESOLUTION_HEIGHT,
+    DECODE_TIME_MS,
+    RENDER_TIME_MS,
+    PRESENT_LATENCY_MS,
+    PRESENT_TO_PHOTON_MS,
+    FRAMES_DECODED,
+    FRAMES_DROPPED,
+    PACKETS_RECEIVED,
+    BYTES_RECEIVED,
+    FEC_RECOVERED,
+    FEC_UNRECOVERABLE,
+    JITTER_BUFFER_MS,
+    LATE_FRAMES,
+    RENDER_DROPPED,
+    PATH_MIGRATIONS,
+    AUDIO_OUTPUT_LATENCY_MS,
+    AUDIO_BUFFER_MS,
+    AUDIO_FEC_RECOVERED,
+    AUDIO_CONCEALED,
+    AUDIO_UNDERRUNS,
+    AV_OFFSET_MS,
+    AV_AUDIO_DELAY_MS,
+    AV_VIDEO_DELAY_MS,
+    CLOCK_SYNCED,          // 0 or 1
+    CLOCK_ERROR_MS,
+    FIRST_PACKET_P50_MS,
+    FIRST_PACKET_P99_MS,
+    FRAME_COMPLETE_P50_MS,
+    FRAME_COMPLETE_P99_MS,
+    GLASS_TO_GLASS_P50_MS,
+    GLASS_TO_GLASS_P99_MS,
+    INPUT_TO_PHOTON_P50_MS,
+    INPUT_TO_PHOTON_P99_MS,
+    COUNT
+};
+
+/// Frame record fields, one double each, in buffer order.
+enum class FrameField : uint32_t {
+    SEQ = 0,               // Record number + 1 (0 = being written)
+    CAPTURE_TS_US,         // Host capture timestamp (low 32 bits)
+    PRESENTED_US,          // Viewer clock
+    FIRST_PACKET_MS,       // Capture to first packet (-1 = host clock unknown)
+    FRAME_COMPLETE_MS,     // Capture to last packet (-1 = unknown)
+    GLASS_TO_GLASS_MS,     // Capture to photons (-1 = unknown)
+    PRESENT_LATENCY_MS,    // Decoder output to present
+    RENDER_MS,             // Render call
+    COUNT
+};
+
+/// One presented frame's timings, as the render thread knows them.
+struct FrameTiming {
+    uint32_t capture_ts_us      = 0;
+    uint64_t presented_us       = 0;
+    double   first_packet_ms    = -1.0;
+    double   frame_complete_ms  = -1.0;
+    double   glass_to_glass_ms  = -1.0;
+    double   present_latency_ms = 0.0;
+    double   render_ms          = 0.0;
+};
+
+class StatsRing {
+public:
+    static constexpr uint32_t MAGIC          = 0x52535343;   // "CSSR"
+    static constexpr uint32_t VERSION        = 1;
+    static constexpr size_t   HEADER_BYTES   = 64;
+    static constexpr uint32_t FRAME_CAPACITY = 512;          // ~2 s at 240 fps
+
+    /// Bytes of memory the ring lays itself out in.
+    static constexpr size_t bytes() {
+        return HEADER_BYTES +
+               static_cast<size_t>(StatsField::COUNT) * sizeof(double) +
+               static_cast<size_t>(FRAME_CAPACITY) *
+                   static_cast<size_t>(FrameField::COUNT) * sizeof(double);
+    }
+
+    StatsRing() = default;
+
+    // Non-copyable
+    StatsRing(const StatsRing&) = delete;
+    StatsRing& operator=(const StatsRing&) = delete;
+
+    /// Lay the ring out in |len| bytes at |mem| (8-byte aligned, zeroed
+    /// here).  The memory must outlive the ring.  Returns false if |len| is
+    /// below bytes().
+    bool attach(void* mem, size_t len);
+
+    bool attached() const { return base_ != nullptr; }
+
+    /// Publish |stats| as the snapshot (stats thread).
+    void writeStats(const ViewerStats& stats, uint64_t now_us);
+
+    /// Append one frame's timings (render thread).
+    void writeFrame(const FrameTiming& timing);
+
+private:
+    // Header word offsets, in u32s
+    static constexpr size_t H_MAGIC          = 0;
+    static constexpr size_t H_VERSION        = 1;
+    static constexpr size_t H_STATS_FIELDS   = 2;
+    static constexpr size_t H_FRAME_FIELDS   = 3;
+    static constexpr size_t H_FRAME_CAPACITY = 4;
+    static constexpr size_t H_STATS_SEQ      = 5;
+    static constexpr size_t H_FRAME_HEAD     = 6;
+
+    std::atomic<uint32_t>& word(size_t index);
+    double* statsBase();
+    double* frameSlot(uint32_t n);
+
+    uint8_t* base_ = nullptr;
+    uint32_t stats_seq_  = 0;    // Writer's copies of the header counters
+    uint32_t frame_head_ = 0;
+};
+
+} // namespace cs
@@ -0,0 +1,167 @@
+///////////////////////////////////////////////////////////////////////////////
+// window_stats.h -- Sliding-window counters and latency histograms
+//
+// The receive path counts every packet, so what it updates has to cost a
+// few relaxed atomic stores, not a lock or an allocation.  A SlidingWindow
+// splits time into SLOT_US-wide slots in a ring of SLOTS; its one writer
+// counts into the slot the time falls in, clearing it first if it last held
+// a slot a whole window ago, and readers sum the slots still within the
+// window.  Each slot carries the slot number it holds as a sequence word,
+// seqlock style: the writer zeroes it while clearing, and a reader drops a
+// slot whose number changed while it was summing it.  Readers never hold
+// the writer up; a slot being counted into as it is read gives a snapshot
+// that is a few samples short, which a window of a second can afford.
+//
+// WindowedCounters sums a few counters (bytes, packets) over the last
+// second; WindowedHistogram keeps a LatencyHistogram per slot for
+// percentiles over the last two.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cs/latency_histogram.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// SlidingWindow -- ring of time slots, one writer
+//
+// |Payload| has reset() and addTo(std::array<uint64_t, N>&).
+// ---------------------------------------------------------------------------
+template <typename Payload, size_t N, size_t SLOTS, uint64_t SLOT_US>
+class SlidingWindow {
+public:
+    using Sums = std::array<uint64_t, N>;
+
+    SlidingWindow() = default;
+
+    // Non-copyable
+    SlidingWindow(const SlidingWindow&) = delete;
+    SlidingWindow& operator=(const SlidingWindow&) = delete;
+
+    /// The slot |now_us| falls in, to count into.  Writer only.
+    Payload& writeSlot(uint64_t now_us) {
+        const uint64_t number = now_us / SLOT_US + 1;   // 0 = being cleared
+        Slot& slot = slots_[number % SLOTS];
+        if (slot.number.load(std::memory_order_relaxed) != number) {
+            slot.number.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.payload.reset();
+            slot.number.store(number, std::memory_order_release);
+        }
+        if (first_us_.load(std::memory_order_relaxed) == 0) {
+            first_us_.store(now_us, std::memory_order_relaxed);
+        }
+        return slot.payload;
+    }
+
+    /// Add the slots within the window ending at |now_us| to |sums|.
+    /// Returns the time they cover in us: the window, or less if counting
+    /// began within it (0 before anything was counted).  Any thread.
+    uint64_t read(uint64_t now_us, Sums& sums) const {
+        const uint64_t newest = now_us / SLOT_US + 1;
+        for (const Slot& slot : slots_) {
+            const uint64_t number = slot.number.load(std::memory_order_acquire);
+            if (number == 0 || number > newest || newest - number >= SLOTS) continue;
+
+            Sums scratch{};
+            slot.payload.addTo(scratch);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.number.load(std::memory_order_relaxed) != number) continue;   // Cleared meanwhile
+            for (size_t i = 0; i < N; ++i) sums[i] += scratch[i];
+        }
+
+        const uint64_t first = first_us_.load(std::memory_order_relaxed);
+        if (first == 0 || now_us <= first) return 0;
+        return std::min<uint64_t>((SLOTS - 1) * SLOT_US + now_us % SLOT_US, now_us - first);
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> number{0};   // Slot number held, plus one
+        Payload               payload;
+    };
+
+    std::array<Slot, SLOTS> slots_;
+    std::atomic<uint64_t>   first_us_{0};   // First writeSlot() time
+};
+
+// ---------------------------------------------------------------------------
+// WindowedCounters -- |FIELDS| counters over the last second
+// ---------------------------------------------------------------------------
+template <size_t FIELDS>
+class WindowedCounters {
+public:
+    using Values = std::array<uint64_t, FIELDS>;
+
+    /// Count |values| at |now_us|.  Writer only.
+    void add(uint64_t now_us, const Values& values) {
+        Counters& slot = window_.writeSlot(now_us);
+        for (size_t i = 0; i < FIELDS; ++i) {
+            // One writer: a plain read-modify-write, no locked add
+            slot.values[i].store(slot.values[i].load(std::memory_order_relaxed) + values[i],
+                                 std::memory_order_relaxed);
+        }
+    }
+
+    /// The counters summed over the window ending at |now_us| into
+    /// |totals|; returns the time they cover in us (0 = nothing yet).
+    uint64_t sum(uint64_t now_us, Values& totals) const {
+        totals.fill(0);
+        return window_.read(now_us, totals);
+    }
+
+private:
+    struct Counters {
+        std::array<std::atomic<uint64_t>, FIELDS> values{};
+
+        void reset() {
+            for (auto& v : values) v.store(0, std::memory_order_relaxed);
+        }
+        void addTo(Values& sums) const {
+            for (size_t i = 0; i < FIELDS; ++i) sums[i] += values[i].load(std::memory_order_relaxed);
+        }
+    };
+
+    SlidingWindow<Counters, FIELDS, 10, 100'000> window_;   // 1 s in 100 ms slots
+};
+
+// ---------------------------------------------------------------------------
+// WindowedHistogram -- latency percentiles over the last two seconds
+// ---------------------------------------------------------------------------
+struct WindowPercentiles {
+    float p50_ms = 0.0f;
+    float p95_ms = 0.0f;
+    float p99_ms = 0.0f;
+};
+
+class WindowedHistogram {
+public:
+    /// Count one sample of |us| microseconds at |now_us|.  Writer only.
+    void record(uint64_t now_us, uint64_t us) {
+        window_.writeSlot(now_us).record(us);
+    }
+
+    /// p50 / p95 / p99 over the window ending at |now_us|; zeros with no
+    /// samples in it.  Any thread.
+    WindowPercentiles percentiles(uint64_t now_us) const {
+        LatencyHistogram::Counts counts{};
+        window_.read(now_us, counts);
+
+        WindowPercentiles out;
+        out.p50_ms = LatencyHistogram::percentileMs(counts, 0.50f);
+        out.p95_ms = LatencyHistogram::percentileMs(counts, 0.95f);
+        out.p99_ms = LatencyHistogram::percentileMs(counts, 0.99f);
+        return out;
+    }
+
+private:
+    SlidingWindow<LatencyHistogram, LatencyHistogram::NUM_BUCKETS, 4, 500'000> window_;   // 2 s
+};
+
+} // namespace cs
@@ -0,0 +1,169 @@
+///////////////////////////////////////////////////////////////////////////////
+// cursor_cache.cpp -- Cursor channel state (viewer side)
+//
+// Everything here runs under one mutex: packets arrive on the receive
+// thread, takeState() is called from the render thread.  Shape requests
+// are sent after the lock is dropped.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cursor_cache.h"
+
+#include <cs/common.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// setRequestFunc
+// ---------------------------------------------------------------------------
+
+void CursorCache::setRequestFunc(RequestFunc request_func) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    request_func_ = std::move(request_func);
+}
+
+// ---------------------------------------------------------------------------
+// onPosition
+// ---------------------------------------------------------------------------
+
+bool CursorCache::onPosition(const uint8_t* data, size_t len) {
+    CursorPositionPacket pos;
+    if (!CursorPositionPacket::deserialize(data, len, pos)) return false;
+
+    RequestFunc request;
+    bool changed = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // Reordered or duplicated: a newer position was already applied
+        if (have_seq_ && static_cast<int16_t>(pos.sequence - last_seq_) <= 0) return false;
+        last_seq_ = pos.sequence;
+        have_seq_ = true;
+
+        if (pos.x != state_.x || pos.y != state_.y || pos.visible() != state_.visible) {
+            state_.x       = pos.x;
+            state_.y       = pos.y;
+            state_.visible = pos.visible();
+            changed = true;
+        }
+
+        if (pos.shape_hash != shape_hash_) {
+            shape_hash_  = pos.shape_hash;
+            state_.shape = findShape(shape_hash_);
+            changed = true;
+        }
+
+        // A shape we never completed: ask again, but not on every position
+        if (shape_hash_ != 0 && !state_.shape && request_func_) {
+            const auto now = std::chrono::steady_clock::now();
+            if (shape_hash_ != requested_hash_ || now - last_request_ >= REQUEST_INTERVAL) {
+                requested_hash_ = shape_hash_;
+                last_request_   = now;
+                request         = request_func_;
+            }
+        }
+
+        dirty_ = dirty_ || changed;
+    }
+
+    if (request) {
+        CursorRequestPacket req = {};
+        req.type       = static_cast<uint8_t>(PacketType::CURSOR_REQUEST);
+        req.shape_hash = pos.shape_hash;
+        uint8_t buf[sizeof(CursorRequestPacket)];
+        request(buf, req.serializeTo(buf));
+        CS_LOG(DEBUG, "Cursor: requested shape %08x", pos.shape_hash);
+    }
+    return changed;
+}
+
+// ---------------------------------------------------------------------------
+// onShapeChunk
+// ---------------------------------------------------------------------------
+
+bool CursorCache::onShapeChunk(const uint8_t* data, size_t len) {
+    CursorShapeHeader hdr;
+    if (!CursorShapeHeader::deserialize(data, len, hdr)) return false;
+
+    const size_t total = static_cast<size_t>(hdr.width) * hdr.height * 4;
+    const size_t expected_chunks = (total + CURSOR_CHUNK_BYTES - 1) / CURSOR_CHUNK_BYTES;
+    if (hdr.shape_hash == 0 || hdr.width == 0 || hdr.height == 0 ||
+        hdr.width > CURSOR_MAX_EDGE || hdr.height > CURSOR_MAX_EDGE ||
+        hdr.chunk_count != expected_chunks || hdr.chunk_index >= hdr.chunk_count) {
+        return false;
+    }
+
+    const size_t offset      = static_cast<size_t>(hdr.chunk_index) * CURSOR_CHUNK_BYTES;
+    const size_t payload_len = std::min(CURSOR_CHUNK_BYTES, total - offset);
+    if (len - sizeof(CursorShapeHeader) < payload_len) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (findShape(hdr.shape_hash)) return false;    // Already complete (a re-send)
+
+    // A new shape replaces one still incomplete; its re-send restarts it
+    Assembly& a = assembly_;
+    if (a.image.hash != hdr.shape_hash) {
+        a.image.hash      = hdr.shape_hash;
+        a.image.width     = hdr.width;
+        a.image.height    = hdr.height;
+        a.image.hotspot_x = hdr.hotspot_x;
+        a.image.hotspot_y = hdr.hotspot_y;
+        a.image.bgra.assign(total, 0);
+        a.chunk_count     = hdr.chunk_count;
+        a.received        = 0;
+    } else if (hdr.width != a.image.width || hdr.height != a.image.height ||
+               hdr.hotspot_x != a.image.hotspot_x || hdr.hotspot_y != a.image.hotspot_y ||
+               hdr.chunk_count != a.chunk_count) {
+        // Same hash, another shape: a collision, or not from the host
+        CS_LOG(WARN, "Cursor: chunk %u does not match shape %08x", hdr.chunk_index,
+               hdr.shape_hash);
+        return false;
+    }
+    if (offset + payload_len > a.image.bgra.size()) return false;
+
+    std::memcpy(a.image.bgra.data() + offset, data + sizeof(CursorShapeHeader), payload_len);
+    a.received |= 1ull << hdr.chunk_index;
+
+    const uint64_t all = a.chunk_count >= 64 ? ~0ull : (1ull << a.chunk_count) - 1;
+    if (a.received != all) return false;
+
+    auto shape = std::make_shared<const CursorImage>(std::move(a.image));
+    shapes_[next_slot_] = shape;
+    next_slot_ = (next_slot_ + 1) % SHAPE_CACHE;
+    a = Assembly{};
+
+    CS_LOG(DEBUG, "Cursor: shape %08x complete (%ux%u)", shape->hash, shape->width, shape->height);
+
+    if (shape->hash != shape_hash_) return false;
+    state_.shape = std::move(shape);
+    dirty_ = true;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// takeState
+// ---------------------------------------------------------------------------
+
+bool CursorCache::takeState(CursorState& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!dirty_) return false;
+    out    = state_;
+    dirty_ = false;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// findShape
+// ---------------------------------------------------------------------------
+
+std::shared_ptr<const CursorImage> CursorCache::findShape(uint32_t hash) const {
+    for (const auto& shape : shapes_) {
+        if (shape && shape->hash == hash) return shape;
+    }
+    return nullptr;
+}
+
+} // namespace cs
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+// cursor_cache.h -- Cursor channel state (viewer side)
+//
+// Collects the host's cursor packets (wire v4, see cs/transport/packet.h)
+// on the receive thread and hands the render thread the latest pointer:
+// where it is, whether it shows, and its shape.
+//
+// Shapes arrive in chunks, are reassembled by hash, and are kept so a
+// shape the pointer takes again is not sent again.  A position naming a
+// shape that is not complete here asks the host for it, at most every
+// REQUEST_INTERVAL.  Positions older than the newest one seen (by
+// sequence) are dropped.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "renderer_interface.h"
+
+#include <cs/transport/packet.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// CursorState -- what the renderer should draw
+// ---------------------------------------------------------------------------
+struct CursorState {
+    std::shared_ptr<const CursorImage> shape;   // Null until the shape is known
+    int32_t x       = 0;                        // Hotspot, frame pixels
+    int32_t y       = 0;
+    bool    visible = false;
+};
+
+class CursorCache {
+public:
+    CursorCache() = default;
+    ~CursorCache() = default;
+
+    // Non-copyable
+    CursorCache(const CursorCache&) = delete;
+    CursorCache& operator=(const CursorCache&) = delete;
+
+    /// Callback to send a serialized shape request to the host.
+    using RequestFunc = std::function<void(const uint8_t* data, size_t len)>;
+
+    void setRequestFunc(RequestFunc request_func);
+
+    /// Handle a CURSOR_POS packet.  Returns true if what is drawn changed.
+    bool onPosition(const uint8_t* data, size_t len);
+
+    /// Handle a CURSOR_SHAPE chunk.  Returns true if it completed the
+    /// shape the pointer has.
+    bool onShapeChunk(const uint8_t* data, size_t len);
+
+    /// Copy the state to |out| if it changed since the last call.
+    bool takeState(CursorState& out);
+
+private:
+    static constexpr size_t SHAPE_CACHE       = 16;   // Twice the host's, so re-use never re-sends
+    static constexpr auto   REQUEST_INTERVAL  = std::chrono::milliseconds(200);
+
+    /// A complete cached shape by hash, or null.  Caller holds mutex_.
+    std::shared_ptr<const CursorImage> findShape(uint32_t hash) const;
+
+    /// Shape being reassembled.
+    struct Assembly {
+        CursorImage image;
+        uint8_t     chunk_count = 0;
+        uint64_t    received    = 0;     // Bit per chunk (at most 64)
+    };
+
+    mutable std::mutex mutex_;
+    RequestFunc        request_func_;
+
+    std::array<std::shared_ptr<const CursorImage>, SHAPE_CACHE> shapes_{};
+    size_t             next_slot_ = 0;
+    Assembly           assembly_;
+
+    CursorState        state_;
+    uint32_t           shape_hash_  = 0;      // Shape the pointer has (0 = none)
+    uint16_t           last_seq_    = 0;
+    bool               have_seq_    = false;
+    bool               dirty_       = false;
+
+    uint32_t           requested_hash_ = 0;
+    std::chrono::steady_clock::time_point last_request_{};
+};
+
+} // namespace cs
@@ -3,7 +3,15 @@
 //
 // Creates a D3D11 device and DXGI swap chain, then uses the built-in
 // D3D11 Video Processor to convert NV12 decoded textures to BGRA for
-// presentation. VSync is disabled for minimum latency.
+// presentation. Sync interval and tearing follow the PresentMode; the
+// default presents with tearing at the start of each refresh.
+//
+// The cursor quad is positioned by a constant buffer and generated from
+// SV_VertexID, so it needs no vertex buffer or input layout.
+//
+// The upscaling shader is a pixel shader over a full-screen triangle rather
+// than a compute shader: the flip-model back buffer is a render target and
+// cannot be bound for unordered access.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "d3d11_renderer.h"
@@ -11,13 +19,122 @@
 #include <cs/common.h>
 
 #include <chrono>
+#include <cstring>
+#include <utility>
 
 #ifdef _WIN32
 #include <d3d11_1.h>
+#include <d3dcompiler.h>
 #include <dxgi1_2.h>
 
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "dxgi.lib")
+#pragma comment(lib, "d3dcompiler.lib")
+
+// ---------------------------------------------------------------------------
+// Cursor overlay shaders: a textured quad over |rect| (left, top, right,
+// bottom in NDC), straight-alpha blended by the output merger.
+// ---------------------------------------------------------------------------
+static const char kCursorShader[] = R"(
+cbuffer CursorRect : register(b0) { float4 rect; };
+
+struct VSOut {
+    float4 pos : SV_Position;
+    float2 uv  : TEXCOORD0;
+};
+
+VSOut vs_main(uint id : SV_VertexID) {
+    float2 uv = float2(id & 1, id >> 1);   // Triangle strip corners
+    VSOut o;
+    o.pos = float4(lerp(rect.x, rect.z, uv.x), lerp(rect.y, rect.w, uv.y), 0.0, 1.0);
+    o.uv  = uv;
+    return o;
+}
+
+Texture2D    cursorTex     : register(t0);
+SamplerState cursorSampler : register(s0);
+
+float4 ps_main(VSOut i) : SV_Target {
+    return cursorTex.Sample(cursorSampler, i.uv);
+}
+)";
+
+// ---------------------------------------------------------------------------
+// Upscaling shaders: Lanczos-2 (4x4 taps) from the stream-size frame, the
+// result clamped to the 2x2 texels around the sample so the negative lobes
+// sharpen edges without ringing halos.
+// ---------------------------------------------------------------------------
+static const char kUpscaleShader[] = R"(
+cbuffer Source : register(b0) { float4 src_size; };   // width, height, 1/width, 1/height
+
+struct VSOut {
+    float4 pos : SV_Position;
+    float2 uv  : TEXCOORD0;
+};
+
+VSOut vs_main(uint id : SV_VertexID) {
+    float2 uv = float2((id << 1) & 2, id & 2);   // One triangle over the viewport
+    VSOut o;
+    o.pos = float4(uv.x * 2.0 - 1.0, 1.0 - uv.y * 2.0, 0.0, 1.0);
+    o.uv  = uv;
+    return o;
+}
+
+Texture2D<float4> frameTex : register(t0);
+
+float lanczos2(float x) {
+    x = abs(x);
+    if (x < 1e-5) return 1.0;
+    if (x >= 2.0) return 0.0;
+    float px = 3.14159265 * x;
+    return 2.0 * sin(px) * sin(px * 0.5) / (px * px);
+}
+
+float4 ps_main(VSOut i) : SV_Target {
+    float2 pos  = i.uv * src_size.xy - 0.5;
+    float2 base = floor(pos);
+    float2 f    = pos - base;
+    int2   last = int2(src_size.xy) - 1;
+
+    float3 sum  = 0.0;
+    float  wsum = 0.0;
+    float3 lo   = 1.0;
+    float3 hi   = 0.0;
+    [unroll] for (int y = -1; y <= 2; ++y) {
+        float wy = lanczos2(y - f.y);
+        [unroll] for (int x = -1; x <= 2; ++x) {
+            int2   t = clamp(int2(base) + int2(x, y), int2(0, 0), last);
+            float3 c = frameTex.Load(int3(t, 0)).rgb;
+            float  w = lanczos2(x - f.x) * wy;
+            sum  += c * w;
+            wsum += w;
+            if (x >= 0 && x <= 1 && y >= 0 && y <= 1) {
+                lo = min(lo, c);
+                hi = max(hi, c);
+            }
+        }
+    }
+    return float4(clamp(sum / wsum, lo, hi), 1.0);
+}
+)";
+
+// ---------------------------------------------------------------------------
+// NVIDIA RTX Video Super Resolution: a private video processor stream
+// extension the NVIDIA driver accepts from R530 on.
+// ---------------------------------------------------------------------------
+static const GUID kNvidiaPpeInterfaceGuid = {
+    0xd43ce1b3, 0x1f4b, 0x48ac, { 0xba, 0xee, 0xc3, 0xc2, 0x53, 0x75, 0xe6, 0xf7 }
+};
+
+struct NvidiaStreamExtension {
+    UINT version;
+    UINT method;
+    UINT enable;
+};
+
+static constexpr UINT kNvidiaVendorId          = 0x10DE;
+static constexpr UINT kNvidiaExtensionVersion  = 0x1;
+static constexpr UINT kNvidiaSuperResolution   = 0x2;
 #endif
 
 namespace cs {
@@ -116,6 +233,12 @@ bool D3D11Renderer::initialize(void* window_handle, uint32_t width, uint32_t hei
         return false;
     }
 
+    // Video Super Resolution is tried on NVIDIA adapters only; other
+    // drivers do not know the extension
+    DXGI_ADAPTER_DESC adapter_desc = {};
+    super_resolution_supported_ = SUCCEEDED(adapter->GetDesc(&adapter_desc)) &&
+                                  adapter_desc.VendorId == kNvidiaVendorId;
+
     ComPtr<IDXGIFactory2> factory;
     hr = adapter->GetParent(IID_PPV_ARGS(factory.GetAddressOf()));
     if (FAILED(hr)) {
@@ -123,6 +246,21 @@ bool D3D11Renderer::initialize(void* window_handle, uint32_t width, uint32_t hei
         return false;
     }
 
+    // Tearing presents need DXGI 1.5 and a driver / OS that allows them
+    ComPtr<IDXGIFactory5> factory5;
+    if (SUCCEEDED(factory.As(&factory5))) {
+        BOOL allow_tearing = FALSE;
+        if (SUCCEEDED(factory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING,
+                                                    &allow_tearing, sizeof(allow_tearing)))) {
+            tearing_supported_ = allow_tearing == TRUE;
+        }
+    }
+
+    swap_chain_flags_ = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+    if (tearing_supported_) {
+        swap_chain_flags_ |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+    }
+
     // Create swap chain
     DXGI_SWAP_CHAIN_DESC1 sc_desc = {};
     sc_desc.Width = width;
@@ -136,7 +274,7 @@ bool D3D11Renderer::initialize(void* window_handle, uint32_t width, uint32_t hei
     sc_desc.Scaling = DXGI_SCALING_STRETCH;
     sc_desc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
     sc_desc.AlphaMode = DXGI_ALPHA_MODE_IGNORE;
-    sc_desc.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;  // For VSync off
+    sc_desc.Flags = swap_chain_flags_;
 
     hr = factory->CreateSwapChainForHwnd(
         device_.Get(),
@@ -148,7 +286,9 @@ bool D3D11Renderer::initialize(void* window_handle, uint32_t width, uint32_t hei
     );
 
     if (FAILED(hr)) {
-        // Retry without tearing flag (older Windows versions)
+        // Retry as a plain flip-model chain (older Windows versions)
+        swap_chain_flags_ = 0;
+        tearing_supported_ = false;
         sc_desc.Flags = 0;
         sc_desc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
         hr = factory->CreateSwapChainForHwnd(
@@ -162,6 +302,19 @@ bool D3D11Renderer::initialize(void* window_handle, uint32_t width, uint32_t hei
         return false;
     }
 
+    // At most one frame queued for the display; the render thread waits on
+    // the latency object for it to be picked up instead of inside Present().
+    ComPtr<IDXGISwapChain2> swap_chain2;
+    if ((swap_chain_flags_ & DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT) &&
+        SUCCEEDED(swap_chain_.As(&swap_chain2))) {
+        swap_chain2->SetMaximumFrameLatency(1);
+        latency_waitable_ = swap_chain2->GetFrameLatencyWaitableObject();
+    }
+
+    LARGE_INTEGER qpc_frequency;
+    QueryPerformanceFrequency(&qpc_frequency);
+    qpc_frequency_ = qpc_frequency.QuadPart;
+
     // Disable Alt+Enter fullscreen toggle (Electron handles this)
     factory->MakeWindowAssociation(hwnd, DXGI_MWA_NO_ALT_ENTER);
 
@@ -195,7 +348,8 @@ bool D3D11Renderer::initialize(void* window_handle, uint32_t width, uint32_t hei
     }
 
     initialized_ = true;
-    CS_LOG(INFO, "D3D11Renderer: initialized %ux%u swap chain", width, height);
+    CS_LOG(INFO, "D3D11Renderer: initialized %ux%u swap chain (waitable=%d, tearing=%d)",
+           width, height, latency_waitable_ ? 1 : 0, tearing_supported_ ? 1 : 0);
     return true;
 }
 #endif
@@ -213,9 +367,12 @@ bool D3D11Renderer::createVideoProcessor(uint32_t input_width, uint32_t input_he
         return true;  // Already created for this size
     }
 
+    input_views_.clear();
     video_processor_.Reset();
     vp_enum_.Reset();
     vp_output_view_.Reset();
+    upscale_vp_view_.Reset();
+    super_resolution_enabled_ = false;
 
     // Create enumerator
     D3D11_VIDEO_PROCESSOR_CONTENT_DESC content_desc = {};
@@ -270,6 +427,8 @@ bool D3D11Renderer::createVideoProcessor(uint32_t input_width, uint32_t input_he
 
     vp_input_width_ = input_width;
     vp_input_height_ = input_height;
+    source_width_ = 0;    // The new processor has no source rect yet
+    source_height_ = 0;
 
     CS_LOG(DEBUG, "D3D11Renderer: video processor created %ux%u -> %ux%u",
            input_width, input_height, width_, height_);
@@ -280,34 +439,62 @@ bool D3D11Renderer::createVideoProcessor(uint32_t input_width, uint32_t input_he
 // renderWithVideoProcessor
 // ---------------------------------------------------------------------------
 
-bool D3D11Renderer::renderWithVideoProcessor(ID3D11Texture2D* input_tex, uint32_t subresource) {
+bool D3D11Renderer::renderWithVideoProcessor(ID3D11Texture2D* input_tex, uint32_t subresource,
+                                             uint32_t picture_width, uint32_t picture_height) {
     if (!video_device_ || !video_context_) return false;
 
     // Get texture description for dimensions
     D3D11_TEXTURE2D_DESC tex_desc;
     input_tex->GetDesc(&tex_desc);
 
-    // Ensure video processor is created for this input size
+    // Ensure video processor is created for this input size.  It is keyed
+    // to the surface, not the picture: a decoder pool pre-sized for the
+    // session keeps it across resolution changes.
     if (!createVideoProcessor(tex_desc.Width, tex_desc.Height)) {
         return false;
     }
 
-    // Create input view
-    D3D11_VIDEO_PROCESSOR_INPUT_VIEW_DESC input_view_desc = {};
-    input_view_desc.FourCC = 0;
-    input_view_desc.ViewDimension = D3D11_VPIV_DIMENSION_TEXTURE2D;
-    input_view_desc.Texture2D.MipSlice = 0;
-    input_view_desc.Texture2D.ArraySlice = subresource;
-
-    ComPtr<ID3D11VideoProcessorInputView> input_view;
-    HRESULT hr = video_device_->CreateVideoProcessorInputView(
-        input_tex, vp_enum_.Get(), &input_view_desc, input_view.GetAddressOf()
-    );
-    if (FAILED(hr)) {
-        CS_LOG(WARN, "D3D11Renderer: CreateVideoProcessorInputView failed: 0x%08lx", hr);
+    ID3D11VideoProcessorInputView* input_view = getInputView(input_tex, subresource);
+    if (!input_view) {
         return false;
     }
 
+    // The picture sits in the surface's top-left corner
+    const uint32_t src_width  = (picture_width  && picture_width  <= tex_desc.Width)
+                                ? picture_width  : tex_desc.Width;
+    const uint32_t src_height = (picture_height && picture_height <= tex_desc.Height)
+                                ? picture_height : tex_desc.Height;
+    if (src_width != source_width_ || src_height != source_height_) {
+        RECT source = { 0, 0, static_cast<LONG>(src_width), static_cast<LONG>(src_height) };
+        video_context_->VideoProcessorSetStreamSourceRect(
+            video_processor_.Get(), 0,
+            src_width != tex_desc.Width || src_height != tex_desc.Height, &source);
+        source_width_  = src_width;
+        source_height_ = src_height;
+    }
+
+    // Super resolution scales inside the blit to the back buffer; the
+    // shader path blits at stream size and scales in drawUpscaled()
+    Upscaler upscaler = chooseUpscaler(upscale_mode_, src_width, src_height,
+                                       width_, height_, super_resolution_supported_);
+    if (upscaler == Upscaler::SUPER_RESOLUTION && !setSuperResolution(true)) {
+        CS_LOG(INFO, "D3D11Renderer: Video Super Resolution unavailable, using the shader");
+        super_resolution_supported_ = false;
+        upscaler = Upscaler::SHADER;
+    }
+    if (upscaler != Upscaler::SUPER_RESOLUTION && super_resolution_enabled_) {
+        setSuperResolution(false);
+    }
+    if (upscaler == Upscaler::SHADER && !ensureUpscaleTarget(src_width, src_height)) {
+        upscaler = Upscaler::NONE;
+    }
+
+    if (upscaler != active_upscaler_) {
+        CS_LOG(INFO, "D3D11Renderer: upscaling %ux%u -> %ux%u with %s",
+               src_width, src_height, width_, height_, upscalerName(upscaler));
+        active_upscaler_ = upscaler;
+    }
+
     // Build stream data
     D3D11_VIDEO_PROCESSOR_STREAM stream = {};
     stream.Enable = TRUE;
@@ -315,12 +502,12 @@ bool D3D11Renderer::renderWithVideoProcessor(ID3D11Texture2D* input_tex, uint32_
     stream.InputFrameOrField = 0;
     stream.PastFrames = 0;
     stream.FutureFrames = 0;
-    stream.pInputSurface = input_view.Get();
+    stream.pInputSurface = input_view;
 
     // Blit (NV12 -> BGRA with scaling)
-    hr = video_context_->VideoProcessorBlt(
+    HRESULT hr = video_context_->VideoProcessorBlt(
         video_processor_.Get(),
-        vp_output_view_.Get(),
+        upscaler == Upscaler::SHADER ? upscale_vp_view_.Get() : vp_output_view_.Get(),
         0,      // Output frame
         1,      // Stream count
         &stream
@@ -331,8 +518,71 @@ bool D3D11Renderer::renderWithVideoProcessor(ID3D11Texture2D* input_tex, uint32_
         return false;
     }
 
+    if (upscaler == Upscaler::SHADER) {
+        drawUpscaled();
+    }
     return true;
 }
+
+// ---------------------------------------------------------------------------
+// setSuperResolution
+// ---------------------------------------------------------------------------
+
+bool D3D11Renderer::setSuperResolution(bool enable) {
+    if (!video_context_ || !video_processor_) return false;
+    if (super_resolution_enabled_ == enable) return true;
+
+    NvidiaStreamExtension extension = {
+        kNvidiaExtensionVersion, kNvidiaSuperResolution, enable ? 1u : 0u
+    };
+    HRESULT hr = video_context_->VideoProcessorSetStreamExtension(
+        video_processor_.Get(), 0, &kNvidiaPpeInterfaceGuid, sizeof(extension), &extension
+    );
+    if (FAILED(hr)) {
+        CS_LOG(DEBUG, "D3D11Renderer: super resolution extension refused: 0x%08lx", hr);
+        return false;
+    }
+    super_resolution_enabled_ = enable;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// getInputView
+// ---------------------------------------------------------------------------
+
+ID3D11VideoProcessorInputView* D3D11Renderer::getInputView(ID3D11Texture2D* input_tex,
+                                                          uint32_t subresource) {
+    for (const auto& entry : input_views_) {
+        if (entry.texture.Get() == input_tex && entry.subresource == subresource) {
+            return entry.view.Get();
+        }
+    }
+
+    // A decoder that reallocated its pool leaves stale entries behind
+    if (input_views_.size() >= INPUT_VIEW_CACHE_MAX) {
+        input_views_.clear();
+    }
+
+    D3D11_VIDEO_PROCESSOR_INPUT_VIEW_DESC input_view_desc = {};
+    input_view_desc.FourCC = 0;
+    input_view_desc.ViewDimension = D3D11_VPIV_DIMENSION_TEXTURE2D;
+    input_view_desc.Texture2D.MipSlice = 0;
+    input_view_desc.Texture2D.ArraySlice = subresource;
+
+    InputViewEntry entry;
+    HRESULT hr = video_device_->CreateVideoProcessorInputView(
+        input_tex, vp_enum_.Get(), &input_view_desc, entry.view.GetAddressOf()
+    );
+    if (FAILED(hr)) {
+        CS_LOG(WARN, "D3D11Renderer: CreateVideoProcessorInputView failed: 0x%08lx", hr);
+        return nullptr;
+    }
+
+    entry.texture = input_tex;
+    entry.subresource = subresource;
+    input_views_.push_back(std::move(entry));
+    return input_views_.back().view.Get();
+}
 #endif
 
 // ---------------------------------------------------------------------------
@@ -354,7 +604,11 @@ double D3D11Renderer::renderFrame(const DecodedFrame& frame) {
     // If the frame has a D3D11 texture (hardware decode path), use video processor
     if (frame.texture && frame.format == FrameFormat::NV12 && video_device_) {
         auto* tex = static_cast<ID3D11Texture2D*>(frame.texture);
-        rendered = renderWithVideoProcessor(tex, frame.subresource);
+        rendered = renderWithVideoProcessor(tex, frame.subresource, frame.width, frame.height);
+    }
+
+    if (rendered && cursor_visible_ && cursor_srv_) {
+        drawCursor();
     }
 
     if (!rendered) {
@@ -363,16 +617,21 @@ double D3D11Renderer::renderFrame(const DecodedFrame& frame) {
         context_->ClearRenderTargetView(rtv_.Get(), clear_color);
     }
 
-    // Present with no VSync (0) and allow tearing for lowest latency
-    UINT present_flags = DXGI_PRESENT_ALLOW_TEARING;
-    HRESULT hr = swap_chain_->Present(0, present_flags);
-    if (FAILED(hr)) {
-        // Retry without tearing flag
-        hr = swap_chain_->Present(0, 0);
-        if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET) {
-            CS_LOG(ERR, "D3D11Renderer: device lost during Present: 0x%08lx", hr);
-            // Would need to recreate device here
-        }
+    // VSYNC flips on the next vblank; the other modes present at once,
+    // tearing if the swap chain allows it.
+    UINT sync_interval = present_mode_ == PresentMode::VSYNC ? 1 : 0;
+    UINT present_flags = (sync_interval == 0 && tearing_supported_) ? DXGI_PRESENT_ALLOW_TEARING : 0;
+
+    LARGE_INTEGER present_qpc;
+    QueryPerformanceCounter(&present_qpc);
+    HRESULT hr = swap_chain_->Present(sync_interval, present_flags);
+    back_buffer_ready_ = false;
+
+    if (SUCCEEDED(hr)) {
+        updatePresentToPhoton(present_qpc.QuadPart);
+    } else if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET) {
+        CS_LOG(ERR, "D3D11Renderer: device lost during Present: 0x%08lx", hr);
+        // Would need to recreate device here
     }
 
     auto end = std::chrono::steady_clock::now();
@@ -385,6 +644,451 @@ double D3D11Renderer::renderFrame(const DecodedFrame& frame) {
 #endif
 }
 
+// ---------------------------------------------------------------------------
+// waitForPresent -- pace presents to the display's vertical blank
+// ---------------------------------------------------------------------------
+
+bool D3D11Renderer::waitForPresent(uint32_t max_wait_ms) {
+    (void)max_wait_ms;
+#ifdef _WIN32
+    // Looked up each time: the window may have moved to another monitor.
+    ComPtr<IDXGIOutput> output;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!initialized_ || !swap_chain_) return false;
+        // IMMEDIATE presents as frames arrive; VSYNC lets Present() sync
+        if (present_mode_ != PresentMode::VBLANK) return false;
+        if (FAILED(swap_chain_->GetContainingOutput(output.GetAddressOf()))) {
+            return false;   // Minimized or between outputs
+        }
+    }
+
+    // Presenting right after the blank puts any tear at the very top of
+    // the screen, where it is not visible, without queueing a frame.
+    return SUCCEEDED(output->WaitForVBlank());
+#else
+    return false;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// waitForBackBuffer
+// ---------------------------------------------------------------------------
+
+bool D3D11Renderer::waitForBackBuffer(uint32_t max_wait_ms) {
+#ifdef _WIN32
+    HANDLE waitable;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Each wait takes one signal, handed back by the next present
+        if (!latency_waitable_ || back_buffer_ready_) return true;
+        waitable = latency_waitable_;
+    }
+
+    if (WaitForSingleObjectEx(waitable, max_wait_ms, FALSE) != WAIT_OBJECT_0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    back_buffer_ready_ = true;
+    return true;
+#else
+    (void)max_wait_ms;
+    return true;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// setPresentMode / setUpscaleMode / getPresentToPhotonMs
+// ---------------------------------------------------------------------------
+
+void D3D11Renderer::setPresentMode(PresentMode mode) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    present_mode_ = mode;
+}
+
+void D3D11Renderer::setUpscaleMode(UpscaleMode mode) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    upscale_mode_ = mode;
+}
+
+Upscaler D3D11Renderer::getActiveUpscaler() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return active_upscaler_;
+}
+
+double D3D11Renderer::getPresentToPhotonMs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return present_to_photon_ms_;
+}
+
+// ---------------------------------------------------------------------------
+// setCursor
+// ---------------------------------------------------------------------------
+
+void D3D11Renderer::setCursor(const CursorImage* shape, int32_t x, int32_t y, bool visible) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cursor_x_       = x;
+    cursor_y_       = y;
+    cursor_visible_ = visible;
+
+#ifdef _WIN32
+    if (!shape) {
+        cursor_srv_.Reset();
+        cursor_hash_ = 0;
+        return;
+    }
+    if (shape->hash == cursor_hash_ || !initialized_ || !createCursorPipeline()) return;
+
+    // Shapes change rarely: each gets its own immutable texture
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width            = shape->width;
+    desc.Height           = shape->height;
+    desc.MipLevels        = 1;
+    desc.ArraySize        = 1;
+    desc.Format           = DXGI_FORMAT_B8G8R8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.Usage            = D3D11_USAGE_IMMUTABLE;
+    desc.BindFlags        = D3D11_BIND_SHADER_RESOURCE;
+
+    D3D11_SUBRESOURCE_DATA init = {};
+    init.pSysMem     = shape->bgra.data();
+    init.SysMemPitch = static_cast<UINT>(shape->width) * 4;
+
+    ComPtr<ID3D11Texture2D> texture;
+    HRESULT hr = device_->CreateTexture2D(&desc, &init, texture.GetAddressOf());
+    if (SUCCEEDED(hr)) {
+        cursor_srv_.Reset();
+        hr = device_->CreateShaderResourceView(texture.Get(), nullptr, cursor_srv_.GetAddressOf());
+    }
+    if (FAILED(hr)) {
+        CS_LOG(WARN, "D3D11Renderer: cursor texture creation failed: 0x%08lx", hr);
+        cursor_srv_.Reset();
+        cursor_hash_ = 0;
+        return;
+    }
+
+    cursor_hash_      = shape->hash;
+    cursor_width_     = shape->width;
+    cursor_height_    = shape->height;
+    cursor_hotspot_x_ = shape->hotspot_x;
+    cursor_hotspot_y_ = shape->hotspot_y;
+#else
+    (void)shape;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// createCursorPipeline / drawCursor
+// ---------------------------------------------------------------------------
+
+#ifdef _WIN32
+bool D3D11Renderer::createCursorPipeline() {
+    if (cursor_vs_) return true;
+    if (cursor_pipeline_failed_) return false;
+    cursor_pipeline_failed_ = true;   // Until everything below exists
+
+    ComPtr<ID3DBlob> vs_blob;
+    ComPtr<ID3DBlob> ps_blob;
+    ComPtr<ID3DBlob> errors;
+    HRESULT hr = D3DCompile(kCursorShader, sizeof(kCursorShader) - 1, "cursor", nullptr, nullptr,
+                            "vs_main", "vs_4_0", D3DCOMPILE_OPTIMIZATION_LEVEL3, 0,
+                            vs_blob.GetAddressOf(), errors.ReleaseAndGetAddressOf());
+    if (SUCCEEDED(hr)) {
+        hr = D3DCompile(kCursorShader, sizeof(kCursorShader) - 1, "cursor", nullptr, nullptr,
+                        "ps_main", "ps_4_0", D3DCOMPILE_OPTIMIZATION_LEVEL3, 0,
+                        ps_blob.GetAddressOf(), errors.ReleaseAndGetAddressOf());
+    }
+    if (FAILED(hr)) {
+        CS_LOG(WARN, "D3D11Renderer: cursor shader compilation failed: %s",
+               errors ? static_cast<const char*>(errors->GetBufferPointer()) : "unknown");
+        return false;
+    }
+
+    ComPtr<ID3D11VertexShader> vs;
+    ComPtr<ID3D11PixelShader>  ps;
+    hr = device_->CreateVertexShader(vs_blob->GetBufferPointer(), vs_blob->GetBufferSize(),
+                                     nullptr, vs.GetAddressOf());
+    if (SUCCEEDED(hr)) {
+        hr = device_->CreatePixelShader(ps_blob->GetBufferPointer(), ps_blob->GetBufferSize(),
+                                        nullptr, ps.GetAddressOf());
+    }
+
+    // Straight alpha: colour = src * a + dst * (1 - a); the back buffer's
+    // own alpha is ignored by the swap chain
+    D3D11_BLEND_DESC blend = {};
+    blend.RenderTarget[0].BlendEnable           = TRUE;
+    blend.RenderTarget[0].SrcBlend              = D3D11_BLEND_SRC_ALPHA;
+    blend.RenderTarget[0].DestBlend             = D3D11_BLEND_INV_SRC_ALPHA;
+    blend.RenderTarget[0].BlendOp               = D3D11_BLEND_OP_ADD;
+    blend.RenderTarget[0].SrcBlendAlpha         = D3D11_BLEND_ONE;
+    blend.RenderTarget[0].DestBlendAlpha        = D3D11_BLEND_ZERO;
+    blend.RenderTarget[0].BlendOpAlpha          = D3D11_BLEND_OP_ADD;
+    blend.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+    ComPtr<ID3D11BlendState> blend_state;
+    if (SUCCEEDED(hr)) hr = device_->CreateBlendState(&blend, blend_state.GetAddressOf());
+
+    D3D11_SAMPLER_DESC sampler = {};
+    sampler.Filter   = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+    sampler.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+    sampler.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+    sampler.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+    sampler.MaxLOD   = D3D11_FLOAT32_MAX;
+    ComPtr<ID3D11SamplerState> sampler_state;
+    if (SUCCEEDED(hr)) hr = device_->CreateSamplerState(&sampler, sampler_state.GetAddressOf());
+
+    D3D11_BUFFER_DESC cb = {};
+    cb.ByteWidth      = 4 * sizeof(float);
+    cb.Usage          = D3D11_USAGE_DYNAMIC;
+    cb.BindFlags      = D3D11_BIND_CONSTANT_BUFFER;
+    cb.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    ComPtr<ID3D11Buffer> rect_cb;
+    if (SUCCEEDED(hr)) hr = device_->CreateBuffer(&cb, nullptr, rect_cb.GetAddressOf());
+
+    if (FAILED(hr)) {
+        CS_LOG(WARN, "D3D11Renderer: cursor pipeline creation failed: 0x%08lx", hr);
+        return false;
+    }
+
+    cursor_vs_      = std::move(vs);
+    cursor_ps_      = std::move(ps);
+    cursor_blend_   = std::move(blend_state);
+    cursor_sampler_ = std::move(sampler_state);
+    cursor_rect_cb_ = std::move(rect_cb);
+    cursor_pipeline_failed_ = false;
+    return true;
+}
+
+void D3D11Renderer::drawCursor() {
+    if (!source_width_ || !source_height_ || !width_ || !height_) return;
+
+    // The video processor stretches the whole frame over the back buffer;
+    // the cursor scales with it
+    const float sx = static_cast<float>(width_)  / static_cast<float>(source_width_);
+    const float sy = static_cast<float>(height_) / static_cast<float>(source_height_);
+    const float left   = (static_cast<float>(cursor_x_) - cursor_hotspot_x_) * sx;
+    const float top    = (static_cast<float>(cursor_y_) - cursor_hotspot_y_) * sy;
+    const float right  = left + cursor_width_ * sx;
+    const float bottom = top  + cursor_height_ * sy;
+
+    const float rect[4] = {
+        left   / width_  * 2.0f - 1.0f,
+        1.0f - top    / height_ * 2.0f,
+        right  / width_  * 2.0f - 1.0f,
+        1.0f - bottom / height_ * 2.0f,
+    };
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (FAILED(context_->Map(cursor_rect_cb_.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+        return;
+    }
+    std::memcpy(mapped.pData, rect, sizeof(rect));
+    context_->Unmap(cursor_rect_cb_.Get(), 0);
+
+    D3D11_VIEWPORT viewport = {};
+    viewport.Width    = static_cast<float>(width_);
+    viewport.Height   = static_cast<float>(height_);
+    viewport.MaxDepth = 1.0f;
+
+    ID3D11RenderTargetView*   rtv     = rtv_.Get();
+    ID3D11ShaderResourceView* srv     = cursor_srv_.Get();
+    ID3D11SamplerState*       sampler = cursor_sampler_.Get();
+    ID3D11Buffer*             cb      = cursor_rect_cb_.Get();
+
+    context_->OMSetRenderTargets(1, &rtv, nullptr);
+    context_->OMSetBlendState(cursor_blend_.Get(), nullptr, 0xFFFFFFFF);
+    context_->RSSetViewports(1, &viewport);
+    context_->IASetInputLayout(nullptr);
+    context_->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    context_->VSSetShader(cursor_vs_.Get(), nullptr, 0);
+    context_->VSSetConstantBuffers(0, 1, &cb);
+    context_->PSSetShader(cursor_ps_.Get(), nullptr, 0);
+    context_->PSSetShaderResources(0, 1, &srv);
+    context_->PSSetSamplers(0, 1, &sampler);
+    context_->Draw(4, 0);
+
+    // The swap chain needs the back buffer unbound before Present()
+    ID3D11RenderTargetView* no_rtv = nullptr;
+    context_->OMSetRenderTargets(1, &no_rtv, nullptr);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// ensureUpscaleTarget / createUpscalePipeline / drawUpscaled
+// ---------------------------------------------------------------------------
+
+#ifdef _WIN32
+bool D3D11Renderer::ensureUpscaleTarget(uint32_t width, uint32_t height) {
+    if (!createUpscalePipeline()) return false;
+
+    if (!upscale_tex_ || upscale_width_ != width || upscale_height_ != height) {
+        upscale_vp_view_.Reset();
+        upscale_srv_.Reset();
+        upscale_tex_.Reset();
+        upscale_width_ = 0;
+        upscale_height_ = 0;
+
+        D3D11_TEXTURE2D_DESC desc = {};
+        desc.Width            = width;
+        desc.Height           = height;
+        desc.MipLevels        = 1;
+        desc.ArraySize        = 1;
+        desc.Format           = DXGI_FORMAT_B8G8R8A8_UNORM;
+        desc.SampleDesc.Count = 1;
+        desc.Usage            = D3D11_USAGE_DEFAULT;
+        desc.BindFlags        = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+        HRESULT hr = device_->CreateTexture2D(&desc, nullptr, upscale_tex_.GetAddressOf());
+        if (SUCCEEDED(hr)) {
+            hr = device_->CreateShaderResourceView(upscale_tex_.Get(), nullptr,
+                                                   upscale_srv_.GetAddressOf());
+        }
+        if (FAILED(hr)) {
+            CS_LOG(WARN, "D3D11Renderer: upscale texture creation failed: 0x%08lx", hr);
+            upscale_srv_.Reset();
+            upscale_tex_.Reset();
+            return false;
+        }
+
+        const float src_size[4] = {
+            static_cast<float>(width), static_cast<float>(height),
+            1.0f / static_cast<float>(width), 1.0f / static_cast<float>(height),
+        };
+        context_->UpdateSubresource(upscale_cb_.Get(), 0, nullptr, src_size, 0, 0);
+        upscale_width_ = width;
+        upscale_height_ = height;
+    }
+
+    // Output views belong to the enumerator, which resize() replaces
+    if (!upscale_vp_view_) {
+        D3D11_VIDEO_PROCESSOR_OUTPUT_VIEW_DESC output_desc = {};
+        output_desc.ViewDimension = D3D11_VPOV_DIMENSION_TEXTURE2D;
+        output_desc.Texture2D.MipSlice = 0;
+        HRESULT hr = video_device_->CreateVideoProcessorOutputView(
+            upscale_tex_.Get(), vp_enum_.Get(), &output_desc, upscale_vp_view_.GetAddressOf()
+        );
+        if (FAILED(hr)) {
+            CS_LOG(WARN, "D3D11Renderer: upscale output view creation failed: 0x%08lx", hr);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool D3D11Renderer::createUpscalePipeline() {
+    if (upscale_ps_) return true;
+    if (upscale_pipeline_failed_) return false;
+    upscale_pipeline_failed_ = true;   // Until everything below exists
+
+    ComPtr<ID3DBlob> vs_blob;
+    ComPtr<ID3DBlob> ps_blob;
+    ComPtr<ID3DBlob> errors;
+    HRESULT hr = D3DCompile(kUpscaleShader, sizeof(kUpscaleShader) - 1, "upscale", nullptr, nullptr,
+                            "vs_main", "vs_4_0", D3DCOMPILE_OPTIMIZATION_LEVEL3, 0,
+                            vs_blob.GetAddressOf(), errors.ReleaseAndGetAddressOf());
+    if (SUCCEEDED(hr)) {
+        hr = D3DCompile(kUpscaleShader, sizeof(kUpscaleShader) - 1, "upscale", nullptr, nullptr,
+                        "ps_main", "ps_4_0", D3DCOMPILE_OPTIMIZATION_LEVEL3, 0,
+                        ps_blob.GetAddressOf(), errors.ReleaseAndGetAddressOf());
+    }
+    if (FAILED(hr)) {
+        CS_LOG(WARN, "D3D11Renderer: upscale shader compilation failed: %s",
+               errors ? static_cast<const char*>(errors->GetBufferPointer()) : "unknown");
+        return false;
+    }
+
+    ComPtr<ID3D11VertexShader> vs;
+    ComPtr<ID3D11PixelShader>  ps;
+    hr = device_->CreateVertexShader(vs_blob->GetBufferPointer(), vs_blob->GetBufferSize(),
+                                     nullptr, vs.GetAddressOf());
+    if (SUCCEEDED(hr)) {
+        hr = device_->CreatePixelShader(ps_blob->GetBufferPointer(), ps_blob->GetBufferSize(),
+                                        nullptr, ps.GetAddressOf());
+    }
+
+    D3D11_BUFFER_DESC cb = {};
+    cb.ByteWidth = 4 * sizeof(float);
+    cb.Usage     = D3D11_USAGE_DEFAULT;
+    cb.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    ComPtr<ID3D11Buffer> src_cb;
+    if (SUCCEEDED(hr)) hr = device_->CreateBuffer(&cb, nullptr, src_cb.GetAddressOf());
+
+    if (FAILED(hr)) {
+        CS_LOG(WARN, "D3D11Renderer: upscale pipeline creation failed: 0x%08lx", hr);
+        return false;
+    }
+
+    upscale_vs_ = std::move(vs);
+    upscale_ps_ = std::move(ps);
+    upscale_cb_ = std::move(src_cb);
+    upscale_pipeline_failed_ = false;
+    return true;
+}
+
+void D3D11Renderer::drawUpscaled() {
+    D3D11_VIEWPORT viewport = {};
+    viewport.Width    = static_cast<float>(width_);
+    viewport.Height   = static_cast<float>(height_);
+    viewport.MaxDepth = 1.0f;
+
+    ID3D11RenderTargetView*   rtv = rtv_.Get();
+    ID3D11ShaderResourceView* srv = upscale_srv_.Get();
+    ID3D11Buffer*             cb  = upscale_cb_.Get();
+
+    context_->OMSetRenderTargets(1, &rtv, nullptr);
+    context_->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
+    context_->RSSetViewports(1, &viewport);
+    context_->IASetInputLayout(nullptr);
+    context_->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    context_->VSSetShader(upscale_vs_.Get(), nullptr, 0);
+    context_->PSSetShader(upscale_ps_.Get(), nullptr, 0);
+    context_->PSSetConstantBuffers(0, 1, &cb);
+    context_->PSSetShaderResources(0, 1, &srv);
+    context_->Draw(3, 0);
+
+    // The next blit writes upscale_tex_, and Present() needs the back
+    // buffer unbound
+    ID3D11ShaderResourceView* no_srv = nullptr;
+    ID3D11RenderTargetView*   no_rtv = nullptr;
+    context_->PSSetShaderResources(0, 1, &no_srv);
+    context_->OMSetRenderTargets(1, &no_rtv, nullptr);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// updatePresentToPhoton
+// ---------------------------------------------------------------------------
+
+#ifdef _WIN32
+void D3D11Renderer::updatePresentToPhoton(LONGLONG present_qpc) {
+    UINT present_count = 0;
+    if (SUCCEEDED(swap_chain_->GetLastPresentCount(&present_count))) {
+        present_history_[present_history_next_] = { present_count, present_qpc };
+        present_history_next_ = (present_history_next_ + 1) % PRESENT_HISTORY;
+    }
+
+    // The statistics name the last present that reached the screen and the
+    // refresh it was shown on.  They lag a frame or two, and fail outright
+    // (DISJOINT) while the window is occluded or being composed differently.
+    DXGI_FRAME_STATISTICS frame_stats = {};
+    if (FAILED(swap_chain_->GetFrameStatistics(&frame_stats)) || qpc_frequency_ <= 0) {
+        return;
+    }
+
+    for (auto& record : present_history_) {
+        if (record.qpc == 0 || record.present_count != frame_stats.PresentCount) continue;
+
+        LONGLONG delta = frame_stats.SyncQPCTime.QuadPart - record.qpc;
+        record.qpc = 0;  // Counted once
+        if (delta < 0) break;
+
+        double ms = static_cast<double>(delta) * 1000.0 / static_cast<double>(qpc_frequency_);
+        present_to_photon_ms_ = present_to_photon_ms_ == 0.0
+            ? ms
+            : present_to_photon_ms_ + (ms - present_to_photon_ms_) / 8.0;
+        break;
+    }
+}
+#endif
+
 // ---------------------------------------------------------------------------
 // resize
 // ---------------------------------------------------------------------------
@@ -406,7 +1110,7 @@ bool D3D11Renderer::resize(uint32_t width, uint32_t height) {
 
     // Resize swap chain buffers
     HRESULT hr = swap_chain_->ResizeBuffers(
-        2, width, height, DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING
+        2, width, height, DXGI_FORMAT_B8G8R8A8_UNORM, swap_chain_flags_
     );
     if (FAILED(hr)) {
         CS_LOG(ERR, "D3D11Renderer: ResizeBuffers failed: 0x%08lx", hr);
@@ -424,10 +1128,15 @@ bool D3D11Renderer::resize(uint32_t width, uint32_t height) {
     if (FAILED(hr)) return false;
 
     // Force video processor recreation on next frame
+    input_views_.clear();
+    upscale_vp_view_.Reset();
     video_processor_.Reset();
     vp_enum_.Reset();
+    super_resolution_enabled_ = false;
     vp_input_width_ = 0;
     vp_input_height_ = 0;
+    source_width_ = 0;
+    source_height_ = 0;
 
     CS_LOG(INFO, "D3D11Renderer: resize complete");
     return true;
@@ -445,20 +1154,48 @@ void D3D11Renderer::release() {
     std::lock_guard<std::mutex> lock(mutex_);
 
 #ifdef _WIN32
+    input_views_.clear();
     vp_output_view_.Reset();
     video_processor_.Reset();
     vp_enum_.Reset();
     video_context_.Reset();
     video_device_.Reset();
+    cursor_srv_.Reset();
+    cursor_rect_cb_.Reset();
+    cursor_sampler_.Reset();
+    cursor_blend_.Reset();
+    cursor_ps_.Reset();
+    cursor_vs_.Reset();
+    cursor_pipeline_failed_ = false;
+    cursor_hash_ = 0;
+    upscale_vp_view_.Reset();
+    upscale_srv_.Reset();
+    upscale_tex_.Reset();
+    upscale_cb_.Reset();
+    upscale_ps_.Reset();
+    upscale_vs_.Reset();
+    upscale_width_ = 0;
+    upscale_height_ = 0;
+    upscale_pipeline_failed_ = false;
+    super_resolution_supported_ = false;
+    super_resolution_enabled_ = false;
     rtv_.Reset();
     back_buffer_.Reset();
     swap_chain_.Reset();
+    if (latency_waitable_) {
+        CloseHandle(latency_waitable_);
+        latency_waitable_ = nullptr;
+    }
+    back_buffer_ready_ = false;
+    present_history_ = {};
     context_.Reset();
     device_.Reset();
     hwnd_ = nullptr;
 #endif
 
     initialized_ = false;
+    present_to_photon_ms_ = 0.0;
+    active_upscaler_ = Upscaler::NONE;
     CS_LOG(INFO, "D3D11Renderer: released");
 }
 
@@ -6,7 +6,23 @@
 // for NV12-to-BGRA color space conversion with GPU-accelerated scaling.
 //
 // The renderer creates and owns the D3D11 device, which it shares with
-// the decoder for zero-copy frame handoff.
+// the decoder for zero-copy frame handoff.  Decoder surfaces are read in
+// place; the input view for each (texture, array slice) is created once
+// and reused while the video processor lives.
+//
+// The flip-model swap chain is created frame-latency waitable with at most
+// one frame queued, so the render thread waits for the display instead of
+// blocking in Present().  Tearing presents are used where DXGI supports
+// them and the PresentMode allows it.
+//
+// A cursor from the cursor channel is drawn as an alpha-blended quad over
+// the video processor's output, scaled with the video.
+//
+// A frame smaller than the window is enlarged by the scaler chooseUpscaler()
+// picks: on NVIDIA adapters the driver's RTX Video Super Resolution, turned
+// on through a video processor stream extension, otherwise a Lanczos-2
+// pixel shader over the processor's output at stream size (see
+// drawUpscaled()).
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
@@ -14,14 +30,18 @@
 #include "render_surface.h"
 #include "../decode/decoder_interface.h"
 
+#include <array>
 #include <cstdint>
 #include <mutex>
 #include <string>
+#include <vector>
 
 #ifdef _WIN32
 #include <d3d11.h>
 #include <d3d11_1.h>
 #include <dxgi1_2.h>
+#include <dxgi1_3.h>
+#include <dxgi1_5.h>
 #include <wrl/client.h>
 
 using Microsoft::WRL::ComPtr;
@@ -46,6 +66,28 @@ public:
     /// Returns the time spent rendering in milliseconds.
     double renderFrame(const DecodedFrame& frame) override;
 
+    /// Wait for the vertical blank of the output the window is on.
+    /// DXGI has no timeout for that wait; it returns within one refresh.
+    bool waitForPresent(uint32_t max_wait_ms) override;
+
+    /// Wait on the swap chain's frame latency object.
+    bool waitForBackBuffer(uint32_t max_wait_ms) override;
+
+    /// Select sync interval, tearing and vblank pacing.
+    void setPresentMode(PresentMode mode) override;
+
+    /// Select the scaler policy for frames smaller than the window.
+    void setUpscaleMode(UpscaleMode mode) override;
+
+    /// The scaler used for the last frame.
+    Upscaler getActiveUpscaler() const override;
+
+    /// Present-to-display estimate from DXGI frame statistics.
+    double getPresentToPhotonMs() const override;
+
+    /// Upload a new cursor shape and move the cursor.
+    void setCursor(const CursorImage* shape, int32_t x, int32_t y, bool visible) override;
+
     /// Handle window resize.
     bool resize(uint32_t width, uint32_t height) override;
 
@@ -71,12 +113,46 @@ private:
     /// Create the video processor for NV12->BGRA conversion.
     bool createVideoProcessor(uint32_t input_width, uint32_t input_height);
 
-    /// Render using the video processor (NV12 input).
-    bool renderWithVideoProcessor(ID3D11Texture2D* input_tex, uint32_t subresource);
+    /// Render using the video processor (NV12 input): the
+    /// |picture_width| x |picture_height| top-left part of the surface
+    /// (0 = all of it).
+    bool renderWithVideoProcessor(ID3D11Texture2D* input_tex, uint32_t subresource,
+                                  uint32_t picture_width, uint32_t picture_height);
+
+    /// The cached input view for |input_tex| slice |subresource|, created
+    /// on first use.  Returns nullptr on failure.
+    ID3D11VideoProcessorInputView* getInputView(ID3D11Texture2D* input_tex, uint32_t subresource);
+
+    /// Turn the NVIDIA super-resolution stream extension on or off for
+    /// the current video processor.  Returns false if the driver refused.
+    bool setSuperResolution(bool enable);
+
+    /// Ensure upscale_tex_ and its views exist for a |width|x|height|
+    /// stream.  Returns false if the shader path is unavailable.
+    bool ensureUpscaleTarget(uint32_t width, uint32_t height);
+
+    /// Compile the upscaling shaders and create their constant buffer,
+    /// once.  Returns false if the shader path cannot be used.
+    bool createUpscalePipeline();
+
+    /// Draw upscale_tex_ over the whole back buffer through the Lanczos
+    /// shader.
+    void drawUpscaled();
 
     /// Ensure the staging/output texture matches the expected size.
     bool ensureOutputTexture(uint32_t width, uint32_t height);
 
+    /// Compile the cursor shaders and create the fixed cursor pipeline
+    /// state, once.  Returns false if the cursor cannot be drawn.
+    bool createCursorPipeline();
+
+    /// Blend the cursor over the back buffer.
+    void drawCursor();
+
+    /// Record the present just issued at |present_qpc| and fold the
+    /// latest frame statistics into present_to_photon_ms_.
+    void updatePresentToPhoton(LONGLONG present_qpc);
+
     // D3D11 core objects
     ComPtr<ID3D11Device>           device_;
     ComPtr<ID3D11DeviceContext>    context_;
@@ -90,11 +166,67 @@ private:
     ComPtr<ID3D11VideoProcessorOutputView> vp_output_view_;
     uint32_t vp_input_width_  = 0;
     uint32_t vp_input_height_ = 0;
+    uint32_t source_width_    = 0;   // Picture within the input surface
+    uint32_t source_height_   = 0;
+
+    // Input views over decoder surfaces; only valid with the enumerator
+    // they were created against, so cleared whenever it goes away.
+    struct InputViewEntry {
+        ComPtr<ID3D11Texture2D>                texture;
+        uint32_t                               subresource = 0;
+        ComPtr<ID3D11VideoProcessorInputView>  view;
+    };
+    static constexpr size_t INPUT_VIEW_CACHE_MAX = 32;  // > any decoder pool
+    std::vector<InputViewEntry> input_views_;
+
+    // Upscaling: the shader path converts into upscale_tex_ at stream
+    // size, then draws it over the back buffer
+    ComPtr<ID3D11Texture2D>                upscale_tex_;
+    ComPtr<ID3D11VideoProcessorOutputView> upscale_vp_view_;  // Against vp_enum_
+    ComPtr<ID3D11ShaderResourceView>       upscale_srv_;
+    ComPtr<ID3D11VertexShader>             upscale_vs_;
+    ComPtr<ID3D11PixelShader>              upscale_ps_;
+    ComPtr<ID3D11Buffer>                   upscale_cb_;       // Stream size
+    uint32_t upscale_width_  = 0;
+    uint32_t upscale_height_ = 0;
+    bool     upscale_pipeline_failed_ = false;
+    bool     super_resolution_supported_ = false;  // NVIDIA adapter, until the driver refuses
+    bool     super_resolution_enabled_   = false;  // Extension on for video_processor_
 
     // Render target (back buffer)
     ComPtr<ID3D11Texture2D>        back_buffer_;
     ComPtr<ID3D11RenderTargetView> rtv_;
 
+    // Cursor overlay
+    ComPtr<ID3D11VertexShader>       cursor_vs_;
+    ComPtr<ID3D11PixelShader>        cursor_ps_;
+    ComPtr<ID3D11BlendState>         cursor_blend_;
+    ComPtr<ID3D11SamplerState>       cursor_sampler_;
+    ComPtr<ID3D11Buffer>             cursor_rect_cb_;     // Quad in NDC
+    ComPtr<ID3D11ShaderResourceView> cursor_srv_;         // Current shape
+    bool     cursor_pipeline_failed_ = false;
+    uint32_t cursor_hash_      = 0;
+    uint16_t cursor_width_     = 0;
+    uint16_t cursor_height_    = 0;
+    uint16_t cursor_hotspot_x_ = 0;
+    uint16_t cursor_hotspot_y_ = 0;
+
+    // Swap chain configuration
+    UINT   swap_chain_flags_  = 0;        // Creation flags, also for ResizeBuffers
+    bool   tearing_supported_ = false;
+    HANDLE latency_waitable_  = nullptr;  // Frame latency object, or null
+    bool   back_buffer_ready_ = false;    // latency_waitable_ taken, not presented yet
+
+    // Recent presents, matched against DXGI_FRAME_STATISTICS::PresentCount
+    struct PresentRecord {
+        UINT     present_count = 0;
+        LONGLONG qpc           = 0;       // 0 = free / already matched
+    };
+    static constexpr size_t PRESENT_HISTORY = 8;
+    std::array<PresentRecord, PRESENT_HISTORY> present_history_{};
+    size_t   present_history_next_ = 0;
+    LONGLONG qpc_frequency_        = 0;
+
     // Window
     HWND hwnd_ = nullptr;
 #endif
@@ -104,6 +236,13 @@ private:
     uint32_t height_      = 0;
     bool     initialized_ = false;
     double   last_render_time_ms_ = 0.0;
+    PresentMode present_mode_     = PresentMode::VBLANK;
+    double   present_to_photon_ms_ = 0.0;
+    UpscaleMode upscale_mode_     = UpscaleMode::AUTO;
+    Upscaler active_upscaler_     = Upscaler::NONE;
+    int32_t  cursor_x_       = 0;             // Hotspot, frame pixels
+    int32_t  cursor_y_       = 0;
+    bool     cursor_visible_ = false;
 
     mutable std::mutex mutex_;
 };
@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////
+// frame_queue.cpp -- Triple-buffered hand-off from decode to render
+//
+// Publishing and taking a frame are index swaps under the mutex; the
+// frames themselves are never copied.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "frame_queue.h"
+
+#include <cs/common.h>
+
+#include <chrono>
+#include <utility>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// publish / acquire
+// ---------------------------------------------------------------------------
+
+bool FrameQueue::publish() {
+    bool replaced;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_us_[write_] = getTimestampUs();
+        std::swap(write_, ready_);
+        replaced = fresh_;
+        fresh_   = true;
+        if (replaced) dropped_++;
+    }
+    ready_cv_.notify_one();
+    return replaced;
+}
+
+const DecodedFrame* FrameQueue::acquire(uint64_t* ready_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!fresh_) return nullptr;
+
+    std::swap(ready_, present_);
+    fresh_ = false;
+    if (ready_us) *ready_us = ready_us_[present_];
+    return &slots_[present_];
+}
+
+// ---------------------------------------------------------------------------
+// waitForFrame / interrupt
+// ---------------------------------------------------------------------------
+
+bool FrameQueue::waitForFrame(uint32_t max_wait_ms) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_cv_.wait_for(lock, std::chrono::milliseconds(max_wait_ms),
+                       [this]() { return fresh_ || wake_; });
+    wake_ = false;
+    return fresh_;
+}
+
+void FrameQueue::interrupt() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wake_ = true;
+    }
+    ready_cv_.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// getDroppedFrames
+// ---------------------------------------------------------------------------
+
+uint64_t FrameQueue::getDroppedFrames() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_;
+}
+
+} // namespace cs
@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////////
+// frame_queue.h -- Triple-buffered hand-off from decode to render
+//
+// The decode thread writes each decoded frame into a slot it owns and
+// publishes it; the render thread takes the newest published frame when
+// it is ready to present.  Three fixed slots rotate between the two
+// (write, ready, presenting), so neither side ever waits for the other
+// and nothing is allocated per frame.
+//
+// Only the newest frame is worth presenting: a frame published while the
+// previous one is still waiting replaces it, and the replaced frame is
+// counted as dropped at render.  The publisher gets it back in its write
+// slot so it can release whatever the frame holds.
+//
+// A slot keeps its frame (and the decoder surface it references) until
+// the publisher overwrites it, which is never before the frame has been
+// presented or replaced.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "../decode/decoder_interface.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace cs {
+
+class FrameQueue {
+public:
+    FrameQueue() = default;
+    ~FrameQueue() = default;
+
+    // Non-copyable
+    FrameQueue(const FrameQueue&) = delete;
+    FrameQueue& operator=(const FrameQueue&) = delete;
+
+    /// The slot the next frame is decoded into.  Owned by the (single)
+    /// publishing thread; it stays put until publish().
+    DecodedFrame& writeSlot() { return slots_[write_]; }
+
+    /// Publish the frame in the write slot.  Returns true if it replaced
+    /// a frame that was never taken; that frame is then in writeSlot().
+    bool publish();
+
+    /// Take the newest published frame, or nullptr if none arrived since
+    /// the last call.  |ready_us| receives its publish time.  The frame
+    /// stays valid until the next acquire().
+    const DecodedFrame* acquire(uint64_t* ready_us = nullptr);
+
+    /// Block until a frame is published, interrupt() is called, or
+    /// |max_wait_ms| passes.  Returns true in the first case.
+    bool waitForFrame(uint32_t max_wait_ms);
+
+    /// Wake a thread blocked in waitForFrame() (or the next one to call it).
+    void interrupt();
+
+    /// Frames replaced before the renderer took them.
+    uint64_t getDroppedFrames() const;
+
+private:
+    static constexpr size_t SLOTS = MAX_HELD_FRAMES;
+    static_assert(SLOTS == 3, "write / ready / presenting");
+
+    std::array<DecodedFrame, SLOTS> slots_;
+    std::array<uint64_t, SLOTS>     ready_us_{};   // Publish time per slot
+
+    size_t write_   = 0;
+    size_t ready_   = 1;
+    size_t present_ = 2;
+    bool   fresh_   = false;      // ready_ holds a frame not yet taken
+    bool   wake_    = false;      // interrupt() pending
+
+    uint64_t dropped_ = 0;
+
+    mutable std::mutex mutex_;
+    std::condition_variable ready_cv_;
+};
+
+} // namespace cs
@@ -4,11 +4,27 @@
 // Presents decoded video frames (CVPixelBuffer NV12 from VideoToolbox) to
 // a CAMetalLayer attached to an NSView. Uses a compute shader for NV12-to-
 // BGRA conversion and CVMetalTextureCache for zero-copy from VideoToolbox.
+// Frames are borrowed: their surface reference keeps the pixel buffer
+// alive until the GPU has finished reading it.
+//
+// A CVDisplayLink ticks at the display's refresh so the render thread can
+// present in step with it (waitForPresent()), except in PresentMode
+// IMMEDIATE, where frames are presented as they arrive.
+//
+// A cursor from the cursor channel is blended in by the same kernel, as
+// it writes each drawable pixel.
+//
+// A frame smaller than the drawable is enlarged by the scaler
+// chooseUpscaler() picks: the MetalFX spatial scaler (macOS 13+) where the
+// GPU supports it, otherwise a Lanczos-2 kernel.  Either way the frame is
+// first converted at stream size, and the cursor is blended in by the pass
+// that writes the drawable, so it is not upscaled with the video.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include "renderer_interface.h"
 
+#include <condition_variable>
 #include <cstdint>
 #include <mutex>
 
@@ -39,6 +55,11 @@ public:
 
     bool initialize(void* window_handle, uint32_t width, uint32_t height) override;
     double renderFrame(const DecodedFrame& frame) override;
+    bool waitForPresent(uint32_t max_wait_ms) override;
+    void setPresentMode(PresentMode mode) override;
+    void setUpscaleMode(UpscaleMode mode) override;
+    Upscaler getActiveUpscaler() const override;
+    void setCursor(const CursorImage* shape, int32_t x, int32_t y, bool visible) override;
     bool resize(uint32_t width, uint32_t height) override;
     void release() override;
     double getLastRenderTimeMs() const override;
@@ -49,10 +70,59 @@ private:
     void* device_         = nullptr;  // id<MTLDevice>
     void* command_queue_  = nullptr;  // id<MTLCommandQueue>
     void* pipeline_       = nullptr;  // id<MTLComputePipelineState>
+    void* cursor_texture_ = nullptr;  // id<MTLTexture>: current shape, or 1x1 clear
     void* metal_layer_    = nullptr;  // CAMetalLayer*
     void* texture_cache_  = nullptr;  // CVMetalTextureCacheRef
+    void* display_link_   = nullptr;  // CVDisplayLinkRef
+
+    // Upscaling (see chooseUpscaler); the textures follow the stream and
+    // drawable sizes
+    void* upscale_pipeline_   = nullptr;  // id<MTLComputePipelineState>: lanczos_upscale
+    void* composite_pipeline_ = nullptr;  // id<MTLComputePipelineState>: composite_cursor
+    void* frame_texture_      = nullptr;  // id<MTLTexture>: frame at stream size
+    void* scaled_texture_     = nullptr;  // id<MTLTexture>: MetalFX output, drawable size
+    void* spatial_scaler_     = nullptr;  // id<MTLFXSpatialScaler>
+    uint32_t frame_tex_width_   = 0;
+    uint32_t frame_tex_height_  = 0;
+    uint32_t scaled_tex_width_  = 0;
+    uint32_t scaled_tex_height_ = 0;
+    bool     metalfx_supported_ = false;
+
+    /// Ensure frame_texture_ exists for a |src_w|x|src_h| stream and, for
+    /// |super_resolution|, the MetalFX scaler and its output for a
+    /// |dst_w|x|dst_h| drawable.  Returns false if that path is unavailable.
+    bool ensureUpscaleTargets(uint32_t src_w, uint32_t src_h, uint32_t dst_w, uint32_t dst_h,
+                              bool super_resolution);
+
+    /// Drop the upscaling textures and scaler.
+    void releaseUpscaleTargets();
+
+    /// CVDisplayLink output callback: one call per display refresh.
+    static CVReturn onDisplayRefresh(CVDisplayLinkRef link, const CVTimeStamp* now,
+                                     const CVTimeStamp* output_time, CVOptionFlags flags_in,
+                                     CVOptionFlags* flags_out, void* context);
 #endif
 
+    // Display refreshes seen; waitForPresent() waits for the next one.
+    std::mutex              vsync_mutex_;
+    std::condition_variable vsync_cv_;
+    uint64_t                vsync_count_  = 0;
+    bool                    vsync_active_ = false;
+    PresentMode             present_mode_ = PresentMode::VBLANK;
+
+    // Cursor, in frame pixels (hotspot at cursor_x_, cursor_y_)
+    uint32_t cursor_hash_      = 0;
+    uint16_t cursor_width_     = 0;
+    uint16_t cursor_height_    = 0;
+    uint16_t cursor_hotspot_x_ = 0;
+    uint16_t cursor_hotspot_y_ = 0;
+    int32_t  cursor_x_         = 0;
+    int32_t  cursor_y_         = 0;
+    bool     cursor_visible_   = false;
+
+    UpscaleMode upscale_mode_    = UpscaleMode::AUTO;
+    Upscaler    active_upscaler_ = Upscaler::NONE;
+
     uint32_t width_       = 0;
     uint32_t height_      = 0;
     bool     initialized_ = false;
@@ -4,6 +4,19 @@
 // Creates a Metal device, command queue, and CAMetalLayer. Renders NV12
 // CVPixelBuffers from VideoToolbox using a compute shader for NV12→BGRA
 // conversion. Uses CVMetalTextureCache for zero-copy texture import.
+//
+// The shader samples the two IOSurface planes directly (bilinear, so the
+// frame scales to the drawable in the same pass).  renderFrame() does not
+// wait for the GPU: the command buffer's completion handler drops the
+// plane textures and the frame's surface reference.
+//
+// The cursor is blended in the same pass.  With no cursor shown the
+// kernel is handed an empty rectangle (and a 1x1 clear texture).
+//
+// When upscaling, nv12_to_bgra writes frame_texture_ at stream size with
+// no cursor; lanczos_upscale (or MetalFX followed by composite_cursor)
+// then writes the drawable and blends the cursor there.  The passes share
+// one serial compute encoder where they can, which orders them.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "metal_renderer.h"
@@ -17,6 +30,13 @@
 #import <CoreVideo/CVMetalTextureCache.h>
 #import <Cocoa/Cocoa.h>
 
+#if __has_include(<MetalFX/MetalFX.h>)
+#import <MetalFX/MetalFX.h>
+#define CS_HAS_METALFX 1
+#else
+#define CS_HAS_METALFX 0
+#endif
+
 #include <chrono>
 
 // ---------------------------------------------------------------------------
@@ -26,27 +46,138 @@ static NSString* const kNV12ToBGRAShader = @R"(
 #include <metal_stdlib>
 using namespace metal;
 
+struct CursorParams {
+    float2 origin;      // Drawable pixel of the cursor's top-left corner
+    float2 size;        // Cursor size in drawable pixels (0 = none)
+};
+
+// Straight-alpha cursor over the video, scaled with it
+float3 blendCursor(float3 bgr, uint2 gid, texture2d<float, access::sample> cursorTexture,
+                   constant CursorParams& cursor) {
+    constexpr sampler cursorSampler(coord::normalized, filter::linear, address::clamp_to_edge);
+    float2 c = (float2(gid) + 0.5 - cursor.origin) / cursor.size;
+    if (all(c >= 0.0) && all(c < 1.0)) {
+        float4 px = cursorTexture.sample(cursorSampler, c);
+        bgr = mix(bgr, px.rgb, px.a);
+    }
+    return bgr;
+}
+
 kernel void nv12_to_bgra(
-    texture2d<float, access::read>  lumaTexture   [[texture(0)]],
-    texture2d<float, access::read>  chromaTexture  [[texture(1)]],
-    texture2d<float, access::write> outTexture     [[texture(2)]],
+    texture2d<float, access::sample> lumaTexture    [[texture(0)]],
+    texture2d<float, access::sample> chromaTexture  [[texture(1)]],
+    texture2d<float, access::write>  outTexture     [[texture(2)]],
+    texture2d<float, access::sample> cursorTexture  [[texture(3)]],
+    constant CursorParams&           cursor         [[buffer(0)]],
     uint2 gid [[thread_position_in_grid]])
 {
     if (gid.x >= outTexture.get_width() || gid.y >= outTexture.get_height()) return;
 
-    float y  = lumaTexture.read(gid).r;
-    float2 uv = chromaTexture.read(gid / 2).rg;
-    float cb = uv.x - 0.5;
-    float cr = uv.y - 0.5;
+    constexpr sampler planeSampler(coord::normalized, filter::linear, address::clamp_to_edge);
+    float2 pos = (float2(gid) + 0.5) / float2(outTexture.get_width(), outTexture.get_height());
+
+    // 420v is video range: Y in [16, 235], CbCr in [16, 240]
+    float y  = (lumaTexture.sample(planeSampler, pos).r - 16.0 / 255.0) * (255.0 / 219.0);
+    float2 uv = (chromaTexture.sample(planeSampler, pos).rg - 128.0 / 255.0) * (255.0 / 224.0);
+    float cb = uv.x;
+    float cr = uv.y;
 
     // BT.709 YCbCr -> RGB
     float r = y + 1.5748 * cr;
     float g = y - 0.1873 * cb - 0.4681 * cr;
     float b = y + 1.8556 * cb;
 
-    outTexture.write(float4(b, g, r, 1.0), gid);  // BGRA
+    float3 bgr = saturate(float3(b, g, r));
+    outTexture.write(float4(blendCursor(bgr, gid, cursorTexture, cursor), 1.0), gid);  // BGRA
+}
+
+// Lanczos-2 (4x4 taps) from the stream-size frame, clamped to the 2x2
+// texels around the sample so the negative lobes sharpen without ringing
+float lanczos2(float x) {
+    x = abs(x);
+    if (x < 1e-5) return 1.0;
+    if (x >= 2.0) return 0.0;
+    float px = M_PI_F * x;
+    return 2.0 * sin(px) * sin(px * 0.5) / (px * px);
+}
+
+kernel void lanczos_upscale(
+    texture2d<float, access::read>   frameTexture   [[texture(0)]],
+    texture2d<float, access::write>  outTexture     [[texture(2)]],
+    texture2d<float, access::sample> cursorTexture  [[texture(3)]],
+    constant CursorParams&           cursor         [[buffer(0)]],
+    uint2 gid [[thread_position_in_grid]])
+{
+    if (gid.x >= outTexture.get_width() || gid.y >= outTexture.get_height()) return;
+
+    float2 srcSize = float2(frameTexture.get_width(), frameTexture.get_height());
+    float2 outSize = float2(outTexture.get_width(), outTexture.get_height());
+    float2 pos  = (float2(gid) + 0.5) * srcSize / outSize - 0.5;
+    float2 base = floor(pos);
+    float2 f    = pos - base;
+    int2   last = int2(srcSize) - 1;
+
+    float3 sum  = 0.0;
+    float  wsum = 0.0;
+    float3 lo   = 1.0;
+    float3 hi   = 0.0;
+    for (int y = -1; y <= 2; ++y) {
+        float wy = lanczos2(float(y) - f.y);
+        for (int x = -1; x <= 2; ++x) {
+            uint2  t = uint2(clamp(int2(base) + int2(x, y), int2(0), last));
+            float3 c = frameTexture.read(t).rgb;
+            float  w = lanczos2(float(x) - f.x) * wy;
+            sum  += c * w;
+            wsum += w;
+            if (x >= 0 && x <= 1 && y >= 0 && y <= 1) {
+                lo = min(lo, c);
+                hi = max(hi, c);
+            }
+        }
+    }
+
+    float3 bgr = clamp(sum / wsum, lo, hi);
+    outTexture.write(float4(blendCursor(bgr, gid, cursorTexture, cursor), 1.0), gid);
+}
+
+// The MetalFX output, already drawable size, with the cursor over it
+kernel void composite_cursor(
+    texture2d<float, access::read>   frameTexture   [[texture(0)]],
+    texture2d<float, access::write>  outTexture     [[texture(2)]],
+    texture2d<float, access::sample> cursorTexture  [[texture(3)]],
+    constant CursorParams&           cursor         [[buffer(0)]],
+    uint2 gid [[thread_position_in_grid]])
+{
+    if (gid.x >= outTexture.get_width() || gid.y >= outTexture.get_height()) return;
+
+    float3 bgr = frameTexture.read(gid).rgb;
+    outTexture.write(float4(blendCursor(bgr, gid, cursorTexture, cursor), 1.0), gid);
 }
 )";
+
+// Compute pipeline for |name| in |library|, or nil (logged)
+static id<MTLComputePipelineState> makePipeline(id<MTLDevice> device, id<MTLLibrary> library,
+                                                NSString* name) {
+    id<MTLFunction> function = [library newFunctionWithName:name];
+    if (!function) {
+        CS_LOG(WARN, "Metal: kernel function %s not found", [name UTF8String]);
+        return nil;
+    }
+    NSError* error = nil;
+    id<MTLComputePipelineState> pso = [device newComputePipelineStateWithFunction:function
+                                                                           error:&error];
+    if (!pso) {
+        CS_LOG(WARN, "Metal: %s pipeline creation failed: %s", [name UTF8String],
+               error ? [[error localizedDescription] UTF8String] : "unknown");
+    }
+    return pso;
+}
+
+// Matches CursorParams in the shader
+struct CursorParams {
+    float origin[2];
+    float size[2];
+};
 #endif
 
 namespace cs {
@@ -151,6 +282,55 @@ bool MetalRenderer::initialize(void* window_handle, uint32_t width, uint32_t hei
     }
     pipeline_ = (__bridge_retained void*)pso;
 
+    // The upscaling kernels are optional: without them frames are stretched
+    // by nv12_to_bgra's bilinear sampling
+    id<MTLComputePipelineState> upscalePso   = makePipeline(device, library, @"lanczos_upscale");
+    id<MTLComputePipelineState> compositePso = makePipeline(device, library, @"composite_cursor");
+    if (upscalePso && compositePso) {
+        upscale_pipeline_   = (__bridge_retained void*)upscalePso;
+        composite_pipeline_ = (__bridge_retained void*)compositePso;
+    }
+
+#if CS_HAS_METALFX
+    if (@available(macOS 13.0, *)) {
+        metalfx_supported_ = [MTLFXSpatialScalerDescriptor supportsDevice:device];
+    }
+#endif
+
+    // Bound while no cursor shape is known
+    MTLTextureDescriptor* clearDesc =
+        [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatBGRA8Unorm
+                                                           width:1
+                                                          height:1
+                                                       mipmapped:NO];
+    id<MTLTexture> clearTex = [device newTextureWithDescriptor:clearDesc];
+    if (!clearTex) {
+        CS_LOG(ERR, "Metal: failed to create cursor texture");
+        release();
+        return false;
+    }
+    const uint32_t clearPixel = 0;
+    [clearTex replaceRegion:MTLRegionMake2D(0, 0, 1, 1) mipmapLevel:0
+                  withBytes:&clearPixel bytesPerRow:4];
+    cursor_texture_ = (__bridge_retained void*)clearTex;
+
+    // Display link for present pacing.  Without one, frames are presented
+    // as they arrive.
+    CVDisplayLinkRef link = nullptr;
+    if (CVDisplayLinkCreateWithActiveCGDisplays(&link) == kCVReturnSuccess && link) {
+        CVDisplayLinkSetOutputCallback(link, &MetalRenderer::onDisplayRefresh, this);
+        if (CVDisplayLinkStart(link) == kCVReturnSuccess) {
+            display_link_ = link;
+            std::lock_guard<std::mutex> vlock(vsync_mutex_);
+            vsync_active_ = true;
+        } else {
+            CVDisplayLinkRelease(link);
+            CS_LOG(WARN, "Metal: CVDisplayLinkStart failed, presents are not paced");
+        }
+    } else {
+        CS_LOG(WARN, "Metal: no display link, presents are not paced");
+    }
+
     initialized_ = true;
     CS_LOG(INFO, "Metal renderer initialized: %ux%u", width, height);
     return true;
@@ -174,25 +354,21 @@ double MetalRenderer::renderFrame(const DecodedFrame& frame) {
 
     CVPixelBufferRef pixel_buffer = static_cast<CVPixelBufferRef>(frame.texture);
     CVMetalTextureCacheRef cache = static_cast<CVMetalTextureCacheRef>(texture_cache_);
-    id<MTLDevice> device = (__bridge id<MTLDevice>)device_;
     id<MTLCommandQueue> queue = (__bridge id<MTLCommandQueue>)command_queue_;
     id<MTLComputePipelineState> pso = (__bridge id<MTLComputePipelineState>)pipeline_;
     CAMetalLayer* layer = (__bridge CAMetalLayer*)metal_layer_;
 
-    size_t frameWidth  = CVPixelBufferGetWidth(pixel_buffer);
-    size_t frameHeight = CVPixelBufferGetHeight(pixel_buffer);
-
     // Create Metal textures from the CVPixelBuffer planes (zero-copy)
     // Plane 0: Y (luma), 8-bit single channel
     CVMetalTextureRef lumaTextureRef = nullptr;
     CVReturn ret = CVMetalTextureCacheCreateTextureFromImage(
         kCFAllocatorDefault, cache, pixel_buffer, nullptr,
         MTLPixelFormatR8Unorm,
-        frameWidth, frameHeight, 0, &lumaTextureRef);
+        CVPixelBufferGetWidthOfPlane(pixel_buffer, 0),
+        CVPixelBufferGetHeightOfPlane(pixel_buffer, 0), 0, &lumaTextureRef);
 
     if (ret != kCVReturnSuccess || !lumaTextureRef) {
         CS_LOG(WARN, "Metal: failed to create luma texture: %d", ret);
-        CVPixelBufferRelease(pixel_buffer);
         return 0.0;
     }
 
@@ -201,12 +377,12 @@ double MetalRenderer::renderFrame(const DecodedFrame& frame) {
     ret = CVMetalTextureCacheCreateTextureFromImage(
         kCFAllocatorDefault, cache, pixel_buffer, nullptr,
         MTLPixelFormatRG8Unorm,
-        frameWidth / 2, frameHeight / 2, 1, &chromaTextureRef);
+        CVPixelBufferGetWidthOfPlane(pixel_buffer, 1),
+        CVPixelBufferGetHeightOfPlane(pixel_buffer, 1), 1, &chromaTextureRef);
 
     if (ret != kCVReturnSuccess || !chromaTextureRef) {
         CS_LOG(WARN, "Metal: failed to create chroma texture: %d", ret);
         CFRelease(lumaTextureRef);
-        CVPixelBufferRelease(pixel_buffer);
         return 0.0;
     }
 
@@ -219,10 +395,56 @@ double MetalRenderer::renderFrame(const DecodedFrame& frame) {
         CS_LOG(WARN, "Metal: no drawable available");
         CFRelease(lumaTextureRef);
         CFRelease(chromaTextureRef);
-        CVPixelBufferRelease(pixel_buffer);
         return 0.0;
     }
 
+    // One thread per drawable pixel, or per frame pixel when upscaling
+    const NSUInteger outWidth  = drawable.texture.width;
+    const NSUInteger outHeight = drawable.texture.height;
+    const uint32_t   srcWidth  = static_cast<uint32_t>(lumaTex.width);
+    const uint32_t   srcHeight = static_cast<uint32_t>(lumaTex.height);
+
+    Upscaler upscaler = upscale_pipeline_
+        ? chooseUpscaler(upscale_mode_, srcWidth, srcHeight, static_cast<uint32_t>(outWidth),
+                         static_cast<uint32_t>(outHeight), metalfx_supported_)
+        : Upscaler::NONE;
+    if (upscaler == Upscaler::SUPER_RESOLUTION &&
+        !ensureUpscaleTargets(srcWidth, srcHeight, static_cast<uint32_t>(outWidth),
+                              static_cast<uint32_t>(outHeight), true)) {
+        CS_LOG(INFO, "Metal: MetalFX unavailable, using the Lanczos kernel");
+        metalfx_supported_ = false;
+        upscaler = Upscaler::SHADER;
+    }
+    if (upscaler == Upscaler::SHADER &&
+        !ensureUpscaleTargets(srcWidth, srcHeight, 0, 0, false)) {
+        upscaler = Upscaler::NONE;
+    }
+    if (upscaler != active_upscaler_) {
+        CS_LOG(INFO, "Metal: upscaling %ux%u -> %lux%lu with %s", srcWidth, srcHeight,
+               static_cast<unsigned long>(outWidth), static_cast<unsigned long>(outHeight),
+               upscalerName(upscaler));
+        active_upscaler_ = upscaler;
+    }
+
+    // The cursor hotspot is in frame pixels; scale it as the frame is
+    CursorParams cursor = {};
+    if (cursor_visible_ && cursor_hash_ != 0) {
+        const float sx = static_cast<float>(outWidth)  / static_cast<float>(srcWidth);
+        const float sy = static_cast<float>(outHeight) / static_cast<float>(srcHeight);
+        cursor.origin[0] = (cursor_x_ - cursor_hotspot_x_) * sx;
+        cursor.origin[1] = (cursor_y_ - cursor_hotspot_y_) * sy;
+        cursor.size[0]   = cursor_width_  * sx;
+        cursor.size[1]   = cursor_height_ * sy;
+    }
+    const CursorParams noCursor = {};
+    id<MTLTexture> cursorTex = (__bridge id<MTLTexture>)cursor_texture_;
+    id<MTLTexture> frameTex  = (__bridge id<MTLTexture>)frame_texture_;
+
+    MTLSize threadsPerGroup = MTLSizeMake(16, 16, 1);
+    auto groupsFor = [](NSUInteger w, NSUInteger h) {
+        return MTLSizeMake((w + 15) / 16, (h + 15) / 16, 1);
+    };
+
     // Create command buffer and compute encoder
     id<MTLCommandBuffer> cmdBuf = [queue commandBuffer];
     id<MTLComputeCommandEncoder> encoder = [cmdBuf computeCommandEncoder];
@@ -230,27 +452,65 @@ double MetalRenderer::renderFrame(const DecodedFrame& frame) {
     [encoder setComputePipelineState:pso];
     [encoder setTexture:lumaTex   atIndex:0];
     [encoder setTexture:chromaTex atIndex:1];
-    [encoder setTexture:drawable.texture atIndex:2];
+    [encoder setTexture:cursorTex atIndex:3];
+    if (upscaler == Upscaler::NONE) {
+        // The shader scales from the frame
+        [encoder setTexture:drawable.texture atIndex:2];
+        [encoder setBytes:&cursor length:sizeof(cursor) atIndex:0];
+        [encoder dispatchThreadgroups:groupsFor(outWidth, outHeight)
+                threadsPerThreadgroup:threadsPerGroup];
+    } else {
+        [encoder setTexture:frameTex atIndex:2];
+        [encoder setBytes:&noCursor length:sizeof(noCursor) atIndex:0];
+        [encoder dispatchThreadgroups:groupsFor(srcWidth, srcHeight)
+                threadsPerThreadgroup:threadsPerGroup];
+    }
 
-    // Dispatch threads
-    MTLSize threadsPerGroup = MTLSizeMake(16, 16, 1);
-    MTLSize threadgroups = MTLSizeMake(
-        (frameWidth  + 15) / 16,
-        (frameHeight + 15) / 16,
-        1);
-    [encoder dispatchThreadgroups:threadgroups threadsPerThreadgroup:threadsPerGroup];
+    if (upscaler == Upscaler::SHADER) {
+        [encoder setComputePipelineState:(__bridge id<MTLComputePipelineState>)upscale_pipeline_];
+        [encoder setTexture:frameTex atIndex:0];
+        [encoder setTexture:drawable.texture atIndex:2];
+        [encoder setBytes:&cursor length:sizeof(cursor) atIndex:0];
+        [encoder dispatchThreadgroups:groupsFor(outWidth, outHeight)
+                threadsPerThreadgroup:threadsPerGroup];
+    }
     [encoder endEncoding];
 
+#if CS_HAS_METALFX
+    if (upscaler == Upscaler::SUPER_RESOLUTION) {
+        if (@available(macOS 13.0, *)) {
+            id<MTLFXSpatialScaler> scaler = (__bridge id<MTLFXSpatialScaler>)spatial_scaler_;
+            scaler.colorTexture  = frameTex;
+            scaler.outputTexture = (__bridge id<MTLTexture>)scaled_texture_;
+            [scaler encodeToCommandBuffer:cmdBuf];
+        }
+
+        id<MTLComputeCommandEncoder> composite = [cmdBuf computeCommandEncoder];
+        [composite setComputePipelineState:
+            (__bridge id<MTLComputePipelineState>)composite_pipeline_];
+        [composite setTexture:(__bridge id<MTLTexture>)scaled_texture_ atIndex:0];
+        [composite setTexture:drawable.texture atIndex:2];
+        [composite setTexture:cursorTex atIndex:3];
+        [composite setBytes:&cursor length:sizeof(cursor) atIndex:0];
+        [composite dispatchThreadgroups:groupsFor(outWidth, outHeight)
+                  threadsPerThreadgroup:threadsPerGroup];
+        [composite endEncoding];
+    }
+#endif
+
+    // The plane textures, and the pixel buffer behind them, must live until
+    // the GPU is done with them -- not just until this call returns.
+    std::shared_ptr<void> surface = frame.surface;
+    [cmdBuf addCompletedHandler:^(id<MTLCommandBuffer> /*buffer*/) {
+        CFRelease(lumaTextureRef);
+        CFRelease(chromaTextureRef);
+        (void)surface;
+    }];
+
     [cmdBuf presentDrawable:drawable];
     [cmdBuf commit];
-    [cmdBuf waitUntilCompleted];
 
-    // Cleanup
-    CFRelease(lumaTextureRef);
-    CFRelease(chromaTextureRef);
-    CVPixelBufferRelease(pixel_buffer);
-
-    // Flush texture cache periodically
+    // Let the cache drop textures whose command buffers have completed
     CVMetalTextureCacheFlush(cache, 0);
 
     auto end = std::chrono::steady_clock::now();
@@ -264,6 +524,200 @@ double MetalRenderer::renderFrame(const DecodedFrame& frame) {
 #endif
 }
 
+// ---------------------------------------------------------------------------
+// waitForPresent / setPresentMode / onDisplayRefresh -- pace presents to
+// the display link
+// ---------------------------------------------------------------------------
+
+bool MetalRenderer::waitForPresent(uint32_t max_wait_ms) {
+#ifdef __APPLE__
+    std::unique_lock<std::mutex> lock(vsync_mutex_);
+    if (!vsync_active_ || present_mode_ == PresentMode::IMMEDIATE) return false;
+    const uint64_t seen = vsync_count_;
+    return vsync_cv_.wait_for(lock, std::chrono::milliseconds(max_wait_ms), [&]() {
+        return vsync_count_ != seen || !vsync_active_;
+    }) && vsync_active_;
+#else
+    (void)max_wait_ms;
+    return false;
+#endif
+}
+
+void MetalRenderer::setPresentMode(PresentMode mode) {
+    // CAMetalLayer always presents on vblank, so VBLANK and VSYNC pace alike
+    std::lock_guard<std::mutex> lock(vsync_mutex_);
+    present_mode_ = mode;
+}
+
+#ifdef __APPLE__
+CVReturn MetalRenderer::onDisplayRefresh(CVDisplayLinkRef /*link*/, const CVTimeStamp* /*now*/,
+                                         const CVTimeStamp* /*output_time*/,
+                                         CVOptionFlags /*flags_in*/, CVOptionFlags* /*flags_out*/,
+                                         void* context) {
+    auto* self = static_cast<MetalRenderer*>(context);
+    {
+        std::lock_guard<std::mutex> lock(self->vsync_mutex_);
+        self->vsync_count_++;
+    }
+    self->vsync_cv_.notify_all();
+    return kCVReturnSuccess;
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// setUpscaleMode / getActiveUpscaler / ensureUpscaleTargets
+// ---------------------------------------------------------------------------
+
+void MetalRenderer::setUpscaleMode(UpscaleMode mode) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    upscale_mode_ = mode;
+}
+
+Upscaler MetalRenderer::getActiveUpscaler() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return active_upscaler_;
+}
+
+#ifdef __APPLE__
+bool MetalRenderer::ensureUpscaleTargets(uint32_t src_w, uint32_t src_h,
+                                         uint32_t dst_w, uint32_t dst_h,
+                                         bool super_resolution) {
+    id<MTLDevice> device = (__bridge id<MTLDevice>)device_;
+
+    // A command buffer still using a texture being replaced holds its own
+    // reference to it
+    if (!frame_texture_ || frame_tex_width_ != src_w || frame_tex_height_ != src_h) {
+        if (frame_texture_) CFRelease(frame_texture_);
+        frame_texture_ = nullptr;
+
+        MTLTextureDescriptor* desc =
+            [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatBGRA8Unorm
+                                                               width:src_w
+                                                              height:src_h
+                                                           mipmapped:NO];
+        desc.usage       = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite;
+        desc.storageMode = MTLStorageModePrivate;
+        id<MTLTexture> texture = [device newTextureWithDescriptor:desc];
+        if (!texture) {
+            CS_LOG(WARN, "Metal: upscale texture creation failed");
+            return false;
+        }
+        frame_texture_    = (__bridge_retained void*)texture;
+        frame_tex_width_  = src_w;
+        frame_tex_height_ = src_h;
+
+        // The scaler was made for the old stream size
+        if (spatial_scaler_) CFRelease(spatial_scaler_);
+        spatial_scaler_ = nullptr;
+    }
+    if (!super_resolution) return true;
+
+#if CS_HAS_METALFX
+    if (@available(macOS 13.0, *)) {
+        if (spatial_scaler_ && scaled_tex_width_ == dst_w && scaled_tex_height_ == dst_h) {
+            return true;
+        }
+        if (spatial_scaler_) CFRelease(spatial_scaler_);
+        if (scaled_texture_) CFRelease(scaled_texture_);
+        spatial_scaler_ = nullptr;
+        scaled_texture_ = nullptr;
+
+        MTLFXSpatialScalerDescriptor* sdesc = [[MTLFXSpatialScalerDescriptor alloc] init];
+        sdesc.inputWidth          = src_w;
+        sdesc.inputHeight         = src_h;
+        sdesc.outputWidth         = dst_w;
+        sdesc.outputHeight        = dst_h;
+        sdesc.colorTextureFormat  = MTLPixelFormatBGRA8Unorm;
+        sdesc.outputTextureFormat = MTLPixelFormatBGRA8Unorm;
+        sdesc.colorProcessingMode = MTLFXSpatialScalerColorProcessingModePerceptual;
+        id<MTLFXSpatialScaler> scaler = [sdesc newSpatialScalerWithDevice:device];
+        if (!scaler) {
+            CS_LOG(WARN, "Metal: MetalFX spatial scaler creation failed");
+            return false;
+        }
+
+        MTLTextureDescriptor* desc =
+            [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatBGRA8Unorm
+                                                               width:dst_w
+                                                              height:dst_h
+                                                           mipmapped:NO];
+        desc.usage       = scaler.outputTextureUsage | MTLTextureUsageShaderRead;
+        desc.storageMode = MTLStorageModePrivate;
+        id<MTLTexture> output = [device newTextureWithDescriptor:desc];
+        if (!output) {
+            CS_LOG(WARN, "Metal: MetalFX output texture creation failed");
+            return false;
+        }
+
+        spatial_scaler_    = (__bridge_retained void*)scaler;
+        scaled_texture_    = (__bridge_retained void*)output;
+        scaled_tex_width_  = dst_w;
+        scaled_tex_height_ = dst_h;
+        return true;
+    }
+#endif
+    (void)dst_w; (void)dst_h;
+    return false;
+}
+
+void MetalRenderer::releaseUpscaleTargets() {
+    if (spatial_scaler_) CFRelease(spatial_scaler_);
+    if (scaled_texture_) CFRelease(scaled_texture_);
+    if (frame_texture_)  CFRelease(frame_texture_);
+    spatial_scaler_    = nullptr;
+    scaled_texture_    = nullptr;
+    frame_texture_     = nullptr;
+    frame_tex_width_   = 0;
+    frame_tex_height_  = 0;
+    scaled_tex_width_  = 0;
+    scaled_tex_height_ = 0;
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// setCursor
+// ---------------------------------------------------------------------------
+
+void MetalRenderer::setCursor(const CursorImage* shape, int32_t x, int32_t y, bool visible) {
+#ifdef __APPLE__
+    std::lock_guard<std::mutex> lock(mutex_);
+    cursor_x_       = x;
+    cursor_y_       = y;
+    cursor_visible_ = visible && shape != nullptr;
+
+    if (!shape || shape->hash == cursor_hash_ || !initialized_) return;
+
+    // Shapes change rarely: each gets its own texture.  A command buffer
+    // still reading the previous one holds its own reference to it.
+    id<MTLDevice> device = (__bridge id<MTLDevice>)device_;
+    MTLTextureDescriptor* desc =
+        [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatBGRA8Unorm
+                                                           width:shape->width
+                                                          height:shape->height
+                                                       mipmapped:NO];
+    id<MTLTexture> texture = [device newTextureWithDescriptor:desc];
+    if (!texture) {
+        CS_LOG(WARN, "Metal: cursor texture creation failed");
+        cursor_visible_ = false;
+        return;
+    }
+    [texture replaceRegion:MTLRegionMake2D(0, 0, shape->width, shape->height)
+               mipmapLevel:0
+                 withBytes:shape->bgra.data()
+               bytesPerRow:static_cast<NSUInteger>(shape->width) * 4];
+
+    CFRelease(cursor_texture_);
+    cursor_texture_   = (__bridge_retained void*)texture;
+    cursor_hash_      = shape->hash;
+    cursor_width_     = shape->width;
+    cursor_height_    = shape->height;
+    cursor_hotspot_x_ = shape->hotspot_x;
+    cursor_hotspot_y_ = shape->hotspot_y;
+#else
+    (void)shape; (void)x; (void)y; (void)visible;
+#endif
+}
+
 // ---------------------------------------------------------------------------
 // resize
 // ---------------------------------------------------------------------------
@@ -296,6 +750,18 @@ void MetalRenderer::release() {
 #ifdef __APPLE__
     std::lock_guard<std::mutex> lock(mutex_);
 
+    if (display_link_) {
+        CVDisplayLinkRef link = static_cast<CVDisplayLinkRef>(display_link_);
+        CVDisplayLinkStop(link);
+        CVDisplayLinkRelease(link);
+        display_link_ = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> vlock(vsync_mutex_);
+        vsync_active_ = false;
+    }
+    vsync_cv_.notify_all();
+
     if (texture_cache_) {
         CFRelease(static_cast<CVMetalTextureCacheRef>(texture_cache_));
         texture_cache_ = nullptr;
@@ -306,6 +772,25 @@ void MetalRenderer::release() {
         pipeline_ = nullptr;
     }
 
+    releaseUpscaleTargets();
+    if (upscale_pipeline_) {
+        CFRelease(upscale_pipeline_);
+        upscale_pipeline_ = nullptr;
+    }
+    if (composite_pipeline_) {
+        CFRelease(composite_pipeline_);
+        composite_pipeline_ = nullptr;
+    }
+    metalfx_supported_ = false;
+    active_upscaler_   = Upscaler::NONE;
+
+    if (cursor_texture_) {
+        CFRelease(cursor_texture_);
+        cursor_texture_ = nullptr;
+    }
+    cursor_hash_    = 0;
+    cursor_visible_ = false;
+
     if (metal_layer_) {
         CFRelease(metal_layer_);
         metal_layer_ = nullptr;
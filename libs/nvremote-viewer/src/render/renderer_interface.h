@@ -7,15 +7,93 @@
 //
 // Platform-specific initialization (device sharing with decoders, shared
 // surfaces for offscreen rendering) is handled by concrete subclasses.
+//
+// The PresentMode trades tearing against latency; renderers that cannot
+// honour a mode present as close to it as they can.
+//
+// When the host sends the cursor beside the video (wire v4), renderers
+// draw it over each frame they present from the shape and position set
+// with setCursor().
+//
+// When the host drops resolution (QosController::tryReduceResolution) the
+// frame is smaller than the window.  chooseUpscaler() picks how the
+// renderer enlarges it from the stream-to-window ratio: the platform's
+// super-resolution scaler (NVIDIA VSR, MetalFX) where there is one, else
+// an edge-adaptive Lanczos shader, and below UPSCALE_MIN_RATIO the plain
+// bilinear stretch, which is indistinguishable there and costs nothing.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
 #include "../decode/decoder_interface.h"
 
 #include <cstdint>
+#include <vector>
 
 namespace cs {
 
+// ---------------------------------------------------------------------------
+// PresentMode -- when a rendered frame reaches the screen
+// ---------------------------------------------------------------------------
+enum class PresentMode : uint8_t {
+    IMMEDIATE = 0,  // Present as soon as decoded, tearing wherever scan-out is
+    VBLANK    = 1,  // Present at the start of each refresh; any tear is at the top
+    VSYNC     = 2,  // Flip on vblank, never tears; up to a refresh more latency
+};
+
+// ---------------------------------------------------------------------------
+// UpscaleMode -- how a frame smaller than the window is enlarged
+// ---------------------------------------------------------------------------
+enum class UpscaleMode : uint8_t {
+    AUTO   = 0,  // Super resolution where available, else the shader
+    OFF    = 1,  // Always the bilinear stretch
+    SHADER = 2,  // The Lanczos shader even where super resolution exists
+};
+
+/// The scaler a renderer is using for the frames it presents.
+enum class Upscaler : uint8_t {
+    NONE             = 0,  // Bilinear stretch (or no scaling at all)
+    SHADER           = 1,  // Lanczos-2 with de-ringing
+    SUPER_RESOLUTION = 2,  // NVIDIA VSR / MetalFX spatial scaler
+};
+
+/// Window-to-frame ratio below which the bilinear stretch is kept.
+constexpr float UPSCALE_MIN_RATIO = 1.1f;
+
+/// Pick the scaler for a |src_w|x|src_h| frame shown in a |dst_w|x|dst_h|
+/// window under |mode|; |super_resolution| says whether the renderer has a
+/// super-resolution scaler.  The ratio is that of the less-enlarged axis,
+/// so a stretch in one direction alone is not treated as an upscale.
+inline Upscaler chooseUpscaler(UpscaleMode mode, uint32_t src_w, uint32_t src_h,
+                               uint32_t dst_w, uint32_t dst_h, bool super_resolution) {
+    if (mode == UpscaleMode::OFF || src_w == 0 || src_h == 0) return Upscaler::NONE;
+    const float ratio_x = static_cast<float>(dst_w) / static_cast<float>(src_w);
+    const float ratio_y = static_cast<float>(dst_h) / static_cast<float>(src_h);
+    const float ratio = ratio_x < ratio_y ? ratio_x : ratio_y;
+    if (ratio < UPSCALE_MIN_RATIO) return Upscaler::NONE;
+    if (mode == UpscaleMode::AUTO && super_resolution) return Upscaler::SUPER_RESOLUTION;
+    return Upscaler::SHADER;
+}
+
+inline const char* upscalerName(Upscaler upscaler) {
+    switch (upscaler) {
+        case Upscaler::SHADER:           return "shader";
+        case Upscaler::SUPER_RESOLUTION: return "super_resolution";
+        default:                         return "none";
+    }
+}
+
+// ---------------------------------------------------------------------------
+// CursorImage -- a pointer shape from the cursor channel
+// ---------------------------------------------------------------------------
+struct CursorImage {
+    uint32_t             hash      = 0;    // Identifies the shape on the wire
+    uint16_t             width     = 0;
+    uint16_t             height    = 0;
+    uint16_t             hotspot_x = 0;
+    uint16_t             hotspot_y = 0;
+    std::vector<uint8_t> bgra;             // width * height BGRA8, straight alpha
+};
+
 class IRenderer {
 public:
     virtual ~IRenderer() = default;
@@ -28,6 +106,42 @@ public:
     /// Returns the time spent rendering in milliseconds.
     virtual double renderFrame(const DecodedFrame& frame) = 0;
 
+    /// Block until the display starts its next refresh, so that a frame
+    /// rendered now is presented in step with it.  Returns false at once
+    /// if the renderer cannot pace presents (frames are then presented as
+    /// they arrive), or if no refresh came within |max_wait_ms|.
+    virtual bool waitForPresent(uint32_t /*max_wait_ms*/) { return false; }
+
+    /// Block until a frame rendered now would not queue behind one the
+    /// display has not picked up yet.  Returns false if |max_wait_ms|
+    /// passed first; renderers without a present queue return true at once.
+    virtual bool waitForBackBuffer(uint32_t /*max_wait_ms*/) { return true; }
+
+    /// Select how frames are presented (see PresentMode).
+    virtual void setPresentMode(PresentMode /*mode*/) {}
+
+    /// Select how frames smaller than the window are enlarged (see
+    /// UpscaleMode).  Renderers without upscaling stages ignore this.
+    virtual void setUpscaleMode(UpscaleMode /*mode*/) {}
+
+    /// The scaler used for the last frame presented.
+    virtual Upscaler getActiveUpscaler() const { return Upscaler::NONE; }
+
+    /// Smoothed time from presenting a frame to the display refresh that
+    /// showed it, in milliseconds, or 0 if the renderer cannot tell.
+    virtual double getPresentToPhotonMs() const { return 0.0; }
+
+    /// Draw |shape| over the video from the next renderFrame() on, with
+    /// its hotspot at (x, y) in frame pixels.  A null shape or !visible
+    /// draws no cursor.  Renderers that cannot composite ignore this.
+    virtual void setCursor(const CursorImage* /*shape*/, int32_t /*x*/, int32_t /*y*/,
+                           bool /*visible*/) {}
+
+    /// Release a decoded frame that will never be rendered (replaced by a
+    /// newer one first).  Renderers that take ownership of what a frame
+    /// references in renderFrame() release it here instead.
+    virtual void discardFrame(const DecodedFrame& /*frame*/) {}
+
     /// Handle window resize.
     virtual bool resize(uint32_t width, uint32_t height) = 0;
 
@@ -0,0 +1,261 @@
+///////////////////////////////////////////////////////////////////////////////
+// fec_decoder.cpp -- Reed-Solomon FEC recovery implementation
+//
+// Recovery is attempted whenever a packet belonging to an open group
+// arrives (data or parity), so a lost fragment is rebuilt the moment the
+// k-th packet of its group is received -- typically well before a NACK
+// round-trip could complete.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "fec_decoder.h"
+
+#include <cs/common.h>
+#include <cs/transport/erasure_code.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace cs {
+
+// ---------------------------------------------------------------------------
+// Constructor / Destructor
+// ---------------------------------------------------------------------------
+
+FecDecoder::FecDecoder()
+    : ring_(RING_SIZE)
+    , shards_(ErasureCode::MAX_SHARDS)
+    , present_(new bool[ErasureCode::MAX_SHARDS])
+{
+    // Parity of a typical group (a few MTU-sized shards) plus its recovery
+    // block, for the groups a second of video keeps open
+    BufferPool::shared().reserve(WARM_GROUP_BYTES, WARM_GROUPS);
+}
+
+FecDecoder::~FecDecoder() = default;
+
+// ---------------------------------------------------------------------------
+// setRecoveryCallback
+// ---------------------------------------------------------------------------
+
+void FecDecoder::setRecoveryCallback(RecoveryCallback cb) {
+    on_recovered_ = std::move(cb);
+}
+
+// ---------------------------------------------------------------------------
+// findSlot
+// ---------------------------------------------------------------------------
+
+const FecDecoder::Slot* FecDecoder::findSlot(uint16_t seq) const {
+    const Slot& slot = ring_[seq % RING_SIZE];
+    return (slot.valid && slot.seq == seq) ? &slot : nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// onVideoPacket
+// ---------------------------------------------------------------------------
+
+void FecDecoder::onVideoPacket(uint16_t seq, const uint8_t* data, size_t len) {
+    if (!data || len == 0) return;
+
+    Slot& slot = ring_[seq % RING_SIZE];
+    slot.seq   = seq;
+    slot.valid = true;
+    slot.data.assign(data, data + len);
+
+    // A late (reordered or retransmitted) data packet may complete a group.
+    for (auto& entry : groups_) {
+        Group& group = entry.second;
+        if (group.done) continue;
+        uint16_t offset = static_cast<uint16_t>(seq - entry.first);
+        if (offset < group.data_count) {
+            tryRecover(entry.first, group);
+            break;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// onFecPacket
+// ---------------------------------------------------------------------------
+
+void FecDecoder::onFecPacket(const uint8_t* data, size_t len) {
+    FecPacketHeader fh;
+    if (!FecPacketHeader::deserialize(data, len, fh)) return;
+
+    const uint8_t* shard     = data + sizeof(FecPacketHeader);
+    size_t         shard_len = len - sizeof(FecPacketHeader);
+
+    if (fh.data_count == 0 || fh.parity_count == 0 ||
+        fh.parity_index >= fh.parity_count ||
+        shard_len != fh.symbol_length ||
+        static_cast<size_t>(fh.data_count) + fh.parity_count > ErasureCode::MAX_SHARDS) {
+        return;
+    }
+
+    uint64_t now = getTimestampUs();
+    expireGroups(now);
+
+    auto it = groups_.find(fh.base_sequence);
+    if (it != groups_.end() && it->second.group_id != fh.group_id) {
+        // Sequence space wrapped onto a stale group -- start over.
+        groups_.erase(it);
+        it = groups_.end();
+    }
+    if (it == groups_.end()) {
+        Group group;
+        group.group_id      = fh.group_id;
+        group.data_count    = fh.data_count;
+        group.parity_count  = fh.parity_count;
+        group.symbol_length = fh.symbol_length;
+        group.created_us    = now;
+        group.parity = BufferPool::shared().acquire(
+            static_cast<size_t>(fh.parity_count) * fh.symbol_length);
+        if (!group.parity) return;
+        it = groups_.emplace(fh.base_sequence, std::move(group)).first;
+    }
+
+    Group& group = it->second;
+    if (group.done || fh.parity_count != group.parity_count ||
+        fh.symbol_length != group.symbol_length) {
+        return;
+    }
+
+    if (!group.parity_present[fh.parity_index]) {
+        std::memcpy(group.parityShard(fh.parity_index), shard, shard_len);
+        group.parity_present[fh.parity_index] = true;
+    }
+
+    tryRecover(it->first, group);
+}
+
+// ---------------------------------------------------------------------------
+// tryRecover
+// ---------------------------------------------------------------------------
+
+void FecDecoder::tryRecover(uint16_t base_seq, Group& group) {
+    const size_t k   = group.data_count;
+    const size_t m   = group.parity_count;
+    const size_t sym = group.symbol_length;
+
+    size_t data_present   = 0;
+    size_t parity_present = 0;
+    for (size_t i = 0; i < k; ++i) {
+        if (findSlot(static_cast<uint16_t>(base_seq + i))) ++data_present;
+    }
+    parity_present = group.parity_present.count();
+
+    if (data_present == k) {
+        group.done = true;   // nothing lost
+        return;
+    }
+    if (data_present + parity_present < k) {
+        return;              // not yet decodable
+    }
+
+    // Assemble zero-padded shard buffers: the data shards and any missing
+    // parity shards in one pooled block, present parity in place.
+    PooledBuffer work = BufferPool::shared().acquire((k + m) * sym);
+    if (!work) return;
+    bool* present = present_.get();
+
+    for (size_t i = 0; i < k; ++i) {
+        shards_[i] = work.data() + i * sym;
+        const Slot* slot = findSlot(static_cast<uint16_t>(base_seq + i));
+        present[i] = slot != nullptr;
+        const size_t copied = slot ? std::min(slot->data.size(), sym) : 0;
+        if (copied) std::memcpy(shards_[i], slot->data.data(), copied);
+        std::memset(shards_[i] + copied, 0, sym - copied);
+    }
+    for (size_t j = 0; j < m; ++j) {
+        present[k + j] = group.parity_present[j];
+        if (present[k + j]) {
+            shards_[k + j] = group.parityShard(j);
+        } else {
+            shards_[k + j] = work.data() + (k + j) * sym;
+            std::memset(shards_[k + j], 0, sym);
+        }
+    }
+
+    if (!ErasureCode::decode(shards_.data(), present, k, m, sym)) {
+        CS_LOG(WARN, "FecDecoder: decode failed (base=%u, k=%zu, m=%zu)",
+               base_seq, k, m);
+        return;
+    }
+
+    group.done = true;
+
+    for (size_t i = 0; i < k; ++i) {
+        if (present[i]) continue;
+
+        // The rebuilt shard is a full video packet; trim the zero padding
+        // using its own payload_length.
+        VideoPacketHeaderV2 hdr;
+        size_t hdr_len = 0;
+        if (!parseVideoHeader(shards_[i], sym, hdr, &hdr_len)) continue;
+        size_t pkt_len = hdr_len + hdr.payload_length;
+        if (pkt_len > sym ||
+            hdr.sequence_number != static_cast<uint16_t>(base_seq + i)) {
+            CS_LOG(WARN, "FecDecoder: rebuilt packet failed validation (seq=%u)",
+                   static_cast<unsigned>(static_cast<uint16_t>(base_seq + i)));
+            continue;
+        }
+
+        Slot& slot = ring_[hdr.sequence_number % RING_SIZE];
+        slot.seq   = hdr.sequence_number;
+        slot.valid = true;
+        slot.data.assign(shards_[i], shards_[i] + pkt_len);
+
+        recovered_.fetch_add(1);
+        CS_LOG(TRACE, "FecDecoder: recovered seq=%u (group=%u)",
+               hdr.sequence_number, group.group_id);
+
+        if (on_recovered_) {
+            on_recovered_(slot.data.data(), slot.data.size());
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// expireGroups
+// ---------------------------------------------------------------------------
+
+void FecDecoder::expireGroups(uint64_t now_us) {
+    auto it = groups_.begin();
+    while (it != groups_.end()) {
+        Group& group = it->second;
+        bool expired = now_us - group.created_us > GROUP_TIMEOUT_US ||
+                       groups_.size() > MAX_GROUPS;
+        if (!expired) {
+            ++it;
+            continue;
+        }
+
+        if (!group.done) {
+            uint64_t missing = 0;
+            for (size_t i = 0; i < group.data_count; ++i) {
+                if (!findSlot(static_cast<uint16_t>(it->first + i))) ++missing;
+            }
+            if (missing > 0) {
+                unrecoverable_.fetch_add(missing);
+                CS_LOG(DEBUG, "FecDecoder: group %u expired with %llu packets missing",
+                       group.group_id, static_cast<unsigned long long>(missing));
+            }
+        }
+        it = groups_.erase(it);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// reset
+// ---------------------------------------------------------------------------
+
+void FecDecoder::reset() {
+    for (auto& slot : ring_) {
+        slot.valid = false;
+        slot.data.clear();
+    }
+    groups_.clear();
+}
+
+} // namespace cs
@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// fec_decoder.h -- Reed-Solomon FEC recovery in front of the jitter buffer
+//
+// Rebuilds lost video fragments from the 0xFC parity packets produced by
+// the host FecEncoder.  Each FEC group covers k consecutive video sequence
+// numbers starting at base_sequence and carries m parity packets; as soon
+// as any k of the k + m packets are present the missing data packets are
+// reconstructed and handed to the recovery callback as complete serialized
+// video packets (v1 or v2 video header + payload).
+//
+// Design:
+//   - Recent data packets are kept in a ring indexed by sequence number
+//     (copies are needed because parity usually arrives after the data).
+//   - Groups are keyed by base_sequence and expire after GROUP_TIMEOUT_US.
+//     A group's parity shards share one cs::BufferPool block, and recovery
+//     works in another, so repairs do not allocate per shard.
+//   - A group that expires with packets still missing counts those packets
+//     as unrecoverable.
+//
+// Called only from the receive thread; counters are atomic so the stats
+// reporter can read them from its own thread.
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <bitset>
+#include <functional>
+
+#include <cs/buffer_pool.h>
+#include <cs/transport/erasure_code.h>
+#include <cs/transport/packet.h>
+
+namespace cs {
+
+class FecDecoder {
+public:
+    /// Receives each rebuilt video packet (header + payload, network order).
+    using RecoveryCallback = std::function<void(const uint8_t* data, size_t len)>;
+
+    FecDecoder();
+    ~FecDecoder();
+
+    // Non-copyable
+    FecDecoder(const FecDecoder&) = delete;
+    FecDecoder& operator=(const FecDecoder&) = delete;
+
+    /// Set the callback invoked for every recovered video packet.
+    void setRecoveryCallback(RecoveryCallback cb);
+
+    /// Record a received video packet (serialized header + payload).
+    void onVideoPacket(uint16_t seq, const uint8_t* data, size_t len);
+
+    /// Process a received FEC packet (type 0xFC).
+    void onFecPacket(const uint8_t* data, size_t len);
+
+    /// Drop all stored packets and groups (e.g. on reconnect).
+    void reset();
+
+    /// Total data packets rebuilt from parity.
+    uint64_t getRecoveredCount() const { return recovered_.load(); }
+
+    /// Total data packets lost in groups that could not be repaired.
+    uint64_t getUnrecoverableCount() const { return unrecoverable_.load(); }
+
+private:
+    struct Slot {
+        uint16_t seq   = 0;
+        bool     valid = false;
+        std::vector<uint8_t> data;
+    };
+
+    struct Group {
+        uint8_t  group_id      = 0;
+        uint8_t  data_count    = 0;
+        uint8_t  parity_count  = 0;
+        uint16_t symbol_length = 0;
+        uint64_t created_us    = 0;
+        bool     done          = false;
+        cs::PooledBuffer parity;                     // m shards of symbol_length
+        std::bitset<ErasureCode::MAX_SHARDS> parity_present;
+
+        uint8_t* parityShard(size_t j) const { return parity.data() + j * symbol_length; }
+    };
+
+    /// Look up a stored data packet by sequence number.
+    const Slot* findSlot(uint16_t seq) const;
+
+    /// Attempt recovery of the group starting at |base_seq|.
+    void tryRecover(uint16_t base_seq, Group& group);
+
+    /// Expire old groups and account for unrecovered packets.
+    void expireGroups(uint64_t now_us);
+
+    static constexpr size_t   RING_SIZE        = 2048;
+    static constexpr uint64_t GROUP_TIMEOUT_US = 500'000;
+    static constexpr size_t   MAX_GROUPS       = 256;
+    static constexpr size_t   WARM_GROUP_BYTES = 16 * 1024;
+    static constexpr size_t   WARM_GROUPS      = 64;
+
+    std::vector<Slot>         ring_;
+    std::map<uint16_t, Group> groups_;   // base_sequence -> group
+    RecoveryCallback          on_recovered_;
+
+    // Recovery scratch, MAX_SHARDS entries (receive thread only)
+    std::vector<uint8_t*>     shards_;
+    std::unique_ptr<bool[]>   present_;
+
+    std::atomic<uint64_t> recovered_{0};
+    std::atomic<uint64_t> unrecoverable_{0};
+};
+
+} // namespace cs
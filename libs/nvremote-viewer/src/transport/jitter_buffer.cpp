@@ -4,17 +4,34 @@
 // Reassembles fragmented video frames from UDP packets and holds them
 // in a time-ordered buffer to smooth out network jitter before releasing
 // them for decoding.
+//
+// Frames in the window are found by walking frame numbers from the release
+// point to the newest frame seen, which is a handful of slots in normal
+// operation and never more than RING_FRAMES.
+//
+// waitForFrame() and popFrame() must agree on when a frame can be acted on:
+// nextEventUs() mirrors popFrame()'s decisions without changing anything.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "jitter_buffer.h"
 
 #include <cs/common.h>
+#include <cs/trace.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <limits>
 
 namespace cs {
 
+namespace {
+
+/// nextEventUs() result when only a new packet can make a frame ready.
+constexpr uint64_t NO_EVENT = std::numeric_limits<uint64_t>::max();
+
+} // anonymous namespace
+
 // ---------------------------------------------------------------------------
 // Constructor / Destructor
 // ---------------------------------------------------------------------------
@@ -27,148 +44,391 @@ JitterBuffer::~JitterBuffer() = default;
 // pushPacket
 // ---------------------------------------------------------------------------
 
-void JitterBuffer::pushPacket(const VideoPacketHeader& header,
+void JitterBuffer::pushPacket(const VideoPacketHeaderV2& header,
                                const uint8_t* payload, size_t len) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    bool changed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        changed = insertPacket(header, payload, len);
+    }
+    // Only once per frame, not per fragment.
+    if (changed) ready_cv_.notify_one();
+}
 
-    uint16_t frame_num = header.frame_number;
-    uint8_t frag_idx = header.fragment_index;
-    uint8_t frag_total = header.fragment_total;
+bool JitterBuffer::insertPacket(const VideoPacketHeaderV2& header,
+                                const uint8_t* payload, size_t len) {
+    uint32_t frame_num = header.frame_number;
+    uint16_t frag_idx = header.fragment_index;
+    uint16_t frag_total = header.fragment_total;
+
+    // Version-1 frame numbers are 16 bits; extend them to the 32-bit
+    // space around the release pointer so wraparound keeps frame order.
+    if (header.version() == 1 && !first_frame_) {
+        int16_t wrap = static_cast<int16_t>(static_cast<uint16_t>(frame_num) -
+                                            static_cast<uint16_t>(next_release_frame_));
+        frame_num = next_release_frame_ + static_cast<uint32_t>(static_cast<int32_t>(wrap));
+    }
 
-    // Sanity checks
-    if (frag_total == 0 || frag_idx >= frag_total) {
+    // Sanity checks.  A version-3 frame still being encoded on the host
+    // has no total yet; its last fragment carries one.
+    const bool open_total = frag_total == 0 && header.version() >= 3;
+    if (open_total ? frag_idx >= MAX_OPEN_FRAGMENTS
+                   : frag_total == 0 || frag_idx >= frag_total) {
         CS_LOG(WARN, "JitterBuffer: invalid fragment %u/%u for frame %u",
                frag_idx, frag_total, frame_num);
-        return;
+        return false;
     }
 
     // Initialize sequence tracking on first packet
     if (first_frame_) {
         next_release_frame_ = frame_num;
+        newest_frame_       = frame_num;
         first_frame_ = false;
     }
 
-    // Check if this frame is too old (behind the release pointer by more than
-    // half the sequence space). This handles 16-bit wraparound.
-    int16_t delta = static_cast<int16_t>(frame_num - next_release_frame_);
-    if (delta < -100) {
-        // Very old frame, discard
-        return;
+    // Frames behind the release pointer were already released or given up
+    // on.  A late fragment must not recreate one: a frame that can never be
+    // released would block skipping ahead.
+    int32_t delta = static_cast<int32_t>(frame_num - next_release_frame_);
+    if (delta < 0) {
+        return false;
+    }
+
+    // Beyond the ring: give up on the oldest frames to make room.
+    bool changed = false;
+    if (delta >= static_cast<int32_t>(RING_FRAMES)) {
+        const uint32_t new_base = frame_num - RING_FRAMES + 1;
+        CS_LOG(WARN, "JitterBuffer: buffer overflow, dropping frames %u-%u",
+               next_release_frame_, new_base - 1);
+        for (FrameSlot& slot : slots_) {
+            if (slot.in_use && !slot.held &&
+                static_cast<int32_t>(slot.frame_number - new_base) < 0) {
+                releaseSlot(slot);
+            }
+        }
+        frames_dropped_ += new_base - next_release_frame_;
+        markLost(next_release_frame_, new_base - 1);
+        next_release_frame_ = new_base;
+        changed = true;
+    }
+    if (static_cast<int32_t>(frame_num - newest_frame_) > 0) {
+        newest_frame_ = frame_num;
     }
 
-    // Find or create the frame assembly
-    auto& assembly = frames_[frame_num];
+    FrameSlot& slot = slotFor(frame_num);
+    if (slot.held) {
+        return changed;   // Still being decoded, RING_FRAMES frames back
+    }
+    if (slot.in_use && slot.frame_number != frame_num) {
+        releaseSlot(slot);
+    }
 
-    // First fragment for this frame: initialize
-    if (assembly.fragment_total == 0) {
-        assembly.header = header;
-        assembly.fragment_total = frag_total;
-        assembly.fragments.resize(frag_total);
-        assembly.first_arrival_us = getTimestampUs();
+    // First fragment for this frame: claim the slot
+    if (!slot.in_use) {
+        slot.in_use             = true;
+        slot.frame_number       = frame_num;
+        slot.header             = header;
+        slot.fragment_total     = frag_total;
+        slot.first_arrival_us   = getTimestampUs();
+        slot.received.assign((frag_total + 63u) / 64u, 0);
+    } else if (frag_total != 0 && frag_total != slot.fragment_total) {
+        if (slot.fragment_total != 0 || !learnTotal(slot, frag_total)) {
+            CS_LOG(WARN, "JitterBuffer: fragment total %u != %u for frame %u",
+                   frag_total, slot.fragment_total, frame_num);
+            return changed;
+        }
+    } else if (slot.fragment_total != 0 && frag_idx >= slot.fragment_total) {
+        return changed;   // Open fragment past the total learned since
+    }
+    if (frag_idx / 64u >= slot.received.size()) {
+        slot.received.resize(frag_idx / 64u + 1, 0);
     }
 
     // Avoid duplicate fragments
-    if (frag_idx < assembly.fragments.size() && !assembly.fragments[frag_idx].empty()) {
-        return;  // Already received this fragment
+    const uint64_t bit = 1ULL << (frag_idx % 64);
+    uint64_t& word = slot.received[frag_idx / 64];
+    if (word & bit) {
+        return changed;  // Already received this fragment
     }
 
     // Store the fragment
-    if (frag_idx < assembly.fragments.size()) {
-        assembly.fragments[frag_idx].assign(payload, payload + len);
-        assembly.fragments_received++;
+    if (!storeFragment(slot, frag_idx, payload, len)) {
+        return changed;
     }
+    word |= bit;
+    slot.fragments_received++;
 
     // Check if frame is now complete
-    if (!assembly.complete && assembly.isComplete()) {
-        assembly.complete = true;
+    if (!slot.complete && slot.fragment_total != 0 &&
+        slot.fragments_received == slot.fragment_total) {
+        finishFrame(slot);
+        slot.complete = true;
+        complete_count_++;
+        slot.complete_us = getTimestampUs();
+        cs::trace::instant(cs::trace::Stage::FRAME_COMPLETE, slot.header.timestamp_us);
+        onFrameComplete(slot, slot.complete_us);
+        changed = true;
+    }
+
+    // Expire old incomplete frames periodically.  Dropping one can uncover
+    // a complete frame to skip to.
+    if (expireOldFrames()) changed = true;
+    return changed;
+}
+
+// ---------------------------------------------------------------------------
+// storeFragment / finishFrame -- in-place assembly
+// ---------------------------------------------------------------------------
+
+bool JitterBuffer::storeFragment(FrameSlot& slot, uint16_t frag_idx,
+                                 const uint8_t* payload, size_t len) {
+    // The last fragment is the only short one; it waits in |tail| until
+    // completion, when the stride is certainly known.
+    if (frag_idx + 1u == slot.fragment_total) {
+        slot.tail.assign(payload, payload + len);
+        return true;
+    }
+
+    if (slot.stride == 0) {
+        if (len == 0) return false;
+        slot.stride = len;
+        if (slot.fragment_total != 0) {
+            const size_t body = static_cast<size_t>(slot.fragment_total - 1) * len;
+            if (slot.data.size() < body) slot.data.resize(body);
+        }
+    } else if (len != slot.stride) {
+        CS_LOG(WARN, "JitterBuffer: fragment %u of frame %u is %zu bytes, expected %zu",
+               frag_idx, slot.frame_number, len, slot.stride);
+        return false;
+    }
+
+    // Open frames grow as fragments arrive; resize() keeps that amortized.
+    const size_t end = (static_cast<size_t>(frag_idx) + 1) * slot.stride;
+    if (slot.data.size() < end) slot.data.resize(end);
+
+    std::memcpy(slot.data.data() + static_cast<size_t>(frag_idx) * slot.stride, payload, len);
+    return true;
+}
+
+bool JitterBuffer::learnTotal(FrameSlot& slot, uint16_t frag_total) {
+    // Every open fragment must come before the last one.
+    const uint32_t last = frag_total - 1u;
+    for (size_t w = last / 64u; w < slot.received.size(); ++w) {
+        uint64_t beyond = slot.received[w];
+        if (w == last / 64u) beyond &= ~0ULL << (last % 64u);
+        if (beyond != 0) return false;
+    }
+    slot.fragment_total = frag_total;
+    slot.received.resize((frag_total + 63u) / 64u, 0);
+    return true;
+}
+
+void JitterBuffer::finishFrame(FrameSlot& slot) {
+    const size_t body = static_cast<size_t>(slot.fragment_total - 1) * slot.stride;
+    slot.size = body + slot.tail.size();
+    if (slot.data.size() < slot.size) slot.data.resize(slot.size);
+    if (!slot.tail.empty()) {
+        std::memcpy(slot.data.data() + body, slot.tail.data(), slot.tail.size());
+    }
+}
+
+// ---------------------------------------------------------------------------
+// releaseSlot / advancePast
+// ---------------------------------------------------------------------------
+
+void JitterBuffer::releaseSlot(FrameSlot& slot) {
+    if (slot.complete) complete_count_--;
+    slot.in_use             = false;
+    slot.complete           = false;
+    slot.held               = false;
+    slot.fragments_received = 0;
+    slot.fragment_total     = 0;
+    slot.stride             = 0;
+    slot.size               = 0;
+    slot.tail.clear();
+    if (slot.data.size() > SLOT_RETAIN_BYTES) {
+        std::vector<uint8_t>().swap(slot.data);
     }
+}
 
-    // Expire old incomplete frames periodically
-    expireOldFrames();
+void JitterBuffer::advancePast(uint32_t frame) {
+    if (FrameSlot* slot = findFrame(frame)) releaseSlot(*slot);
+    next_release_frame_ = frame + 1;
 }
 
 // ---------------------------------------------------------------------------
 // popFrame
 // ---------------------------------------------------------------------------
 
-bool JitterBuffer::popFrame(std::vector<uint8_t>& frame_data, VideoPacketHeader& header) {
+bool JitterBuffer::popFrame(FrameView& frame, VideoPacketHeaderV2& header) {
     std::lock_guard<std::mutex> lock(mutex_);
 
+    // The caller is done with the previous view.
+    if (held_) {
+        releaseSlot(*held_);
+        held_ = nullptr;
+    }
+    if (first_frame_) return false;
+
     // Look for the next frame in sequence
-    auto it = frames_.find(next_release_frame_);
-    if (it == frames_.end()) {
+    FrameSlot* slot = findFrame(next_release_frame_);
+    if (!slot) {
         // Frame not yet received. Check if we should skip ahead
         // (if we have a complete frame further ahead and the current one is very late).
-        if (!frames_.empty()) {
-            auto first_it = frames_.begin();
-            int16_t gap = static_cast<int16_t>(first_it->first - next_release_frame_);
-            if (gap > 0 && gap < 100) {
-                // Check if the earliest frame we have is complete and old enough
-                uint64_t now = getTimestampUs();
-                uint64_t age_ms = (now - first_it->second.first_arrival_us) / 1000;
-                if (first_it->second.complete && age_ms > target_depth_ms_) {
-                    // Skip to this frame (dropping the missing ones)
-                    uint16_t skipped = first_it->first - next_release_frame_;
-                    frames_dropped_ += skipped;
-                    next_release_frame_ = first_it->first;
-                    it = first_it;
-                }
+        for (uint32_t f = next_release_frame_ + 1;
+             static_cast<int32_t>(f - newest_frame_) <= 0; ++f) {
+            FrameSlot* first = findFrame(f);
+            if (!first) continue;
+
+            // Check if the earliest frame we have is complete and old enough
+            uint64_t now = getTimestampUs();
+            uint64_t age_ms = (now - first->first_arrival_us) / 1000;
+            if (first->complete && age_ms >= SKIP_WAIT_MS &&
+                (immediate_ || isDue(*first, now))) {
+                // Skip to this frame (dropping the missing ones)
+                frames_dropped_ += f - next_release_frame_;
+                markLost(next_release_frame_, f - 1);
+                next_release_frame_ = f;
+                slot = first;
             }
+            break;
         }
 
-        if (it == frames_.end()) {
+        if (!slot) {
             return false;
         }
     }
 
     // Check if the frame is complete
-    if (!it->second.complete) {
+    if (!slot->complete) {
+        // An enhancement-layer frame will not be repaired by a retransmit,
+        // and its FEC went out before the next frame; once a later frame is
+        // complete, drop it.  Nothing references it, so this is no loss.
+        if (slot->header.temporalLayer() > 0 && hasCompleteAfter(slot->frame_number)) {
+            CS_LOG(DEBUG, "JitterBuffer: dropping incomplete layer-%u frame %u (%u/%u fragments)",
+                   slot->header.temporalLayer(), slot->frame_number,
+                   slot->fragments_received, slot->fragment_total);
+            frames_dropped_++;
+            advancePast(slot->frame_number);
+            return false;
+        }
+
         // Check if we should release it anyway (too old)
         uint64_t now = getTimestampUs();
-        uint64_t age_ms = (now - it->second.first_arrival_us) / 1000;
-        if (age_ms < max_frame_age_ms_) {
+        uint64_t age_ms = (now - slot->first_arrival_us) / 1000;
+        if (age_ms < maxFrameAgeMs()) {
             return false;  // Wait for more fragments
         }
 
         // Frame is too old and still incomplete, drop it
         CS_LOG(DEBUG, "JitterBuffer: dropping incomplete frame %u (%u/%u fragments, age=%llu ms)",
-               it->first, it->second.fragments_received, it->second.fragment_total,
+               slot->frame_number, slot->fragments_received, slot->fragment_total,
                static_cast<unsigned long long>(age_ms));
         frames_dropped_++;
-        frames_.erase(it);
-        next_release_frame_++;
+        markLost(slot->frame_number, slot->frame_number);
+        advancePast(slot->frame_number);
         return false;
     }
 
-    // Check jitter buffer depth: don't release if we haven't buffered enough
-    uint64_t now = getTimestampUs();
-    uint64_t age_ms = (now - it->second.first_arrival_us) / 1000;
-    // For very low latency (performance mode), release immediately when complete
-    // For balanced/quality, hold for target_depth_ms_
-    // Skip this delay if the buffer is getting full (>5 frames waiting)
-    uint32_t complete_count = 0;
-    for (const auto& f : frames_) {
-        if (f.second.complete) complete_count++;
-    }
-    if (age_ms < target_depth_ms_ && complete_count < 3) {
+    // Hold the frame until its playout time, unless in immediate mode or
+    // complete frames are backing up.
+    if (!immediate_ && complete_count_ < BACKLOG_FRAMES && !isDue(*slot, getTimestampUs())) {
         return false;  // Hold in buffer
     }
 
-    // Assemble the frame
-    if (!assembleFrame(it->second, frame_data)) {
-        CS_LOG(WARN, "JitterBuffer: frame assembly failed for frame %u", it->first);
-        frames_.erase(it);
-        next_release_frame_++;
+    // Frames are backing up (decode or network congestion): shed
+    // enhancement-layer frames to catch up without a decode error.
+    if (complete_count_ >= BACKLOG_FRAMES && slot->header.temporalLayer() > 0) {
+        CS_LOG(DEBUG, "JitterBuffer: backlog of %u frames, dropping layer-%u frame %u",
+               complete_count_, slot->header.temporalLayer(), slot->frame_number);
+        frames_dropped_++;
+        advancePast(slot->frame_number);
         return false;
     }
 
-    header = it->second.header;
-    frames_.erase(it);
-    next_release_frame_++;
+    // Hand out the slot itself; it stays reserved until the next call.
+    header = slot->header;
+    header.frame_number = slot->frame_number;   // Unwrapped for version-1 headers
+    frame.data = slot->data.data();
+    frame.size = slot->size;
+    frame.first_arrival_us = slot->first_arrival_us;
+    frame.complete_us      = slot->complete_us;
+    cs::trace::instant(cs::trace::Stage::FRAME_POP, slot->header.timestamp_us);
+
+    complete_count_--;
+    slot->complete = false;
+    slot->held     = true;
+    held_          = slot;
+    next_release_frame_ = slot->frame_number + 1;
 
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// waitForFrame / interrupt
+// ---------------------------------------------------------------------------
+
+bool JitterBuffer::waitForFrame(uint32_t max_wait_ms) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    const uint64_t limit = getTimestampUs() + static_cast<uint64_t>(max_wait_ms) * 1000;
+    for (;;) {
+        if (wake_) {
+            wake_ = false;
+            return false;
+        }
+        const uint64_t now  = getTimestampUs();
+        const uint64_t next = nextEventUs(now);
+        if (next <= now) return true;
+        if (now >= limit) return false;
+
+        // Sleep until the frame is due, or a packet changes the picture.
+        ready_cv_.wait_for(lock, std::chrono::microseconds(std::min(next, limit) - now));
+    }
+}
+
+void JitterBuffer::interrupt() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wake_ = true;
+    }
+    ready_cv_.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// nextEventUs -- when popFrame() will next have work
+// ---------------------------------------------------------------------------
+
+uint64_t JitterBuffer::nextEventUs(uint64_t now_us) const {
+    if (first_frame_) return NO_EVENT;
+
+    const FrameSlot* slot = findFrame(next_release_frame_);
+    if (!slot) {
+        // Skipping ahead waits for the first frame present to be complete.
+        for (uint32_t f = next_release_frame_ + 1;
+             static_cast<int32_t>(f - newest_frame_) <= 0; ++f) {
+            const FrameSlot* first = findFrame(f);
+            if (!first) continue;
+            if (!first->complete) return NO_EVENT;
+
+            uint64_t at = first->first_arrival_us + SKIP_WAIT_MS * 1000ull;
+            if (!immediate_) at = std::max(at, playoutTimeUs(*first, now_us));
+            return at;
+        }
+        return NO_EVENT;
+    }
+
+    if (!slot->complete) {
+        if (slot->header.temporalLayer() > 0 && hasCompleteAfter(slot->frame_number)) {
+            return now_us;
+        }
+        return slot->first_arrival_us + static_cast<uint64_t>(maxFrameAgeMs()) * 1000;
+    }
+
+    if (immediate_ || complete_count_ >= BACKLOG_FRAMES) return now_us;
+    return playoutTimeUs(*slot, now_us);
+}
+
 // ---------------------------------------------------------------------------
 // getBufferDepthMs
 // ---------------------------------------------------------------------------
@@ -176,21 +436,122 @@ bool JitterBuffer::popFrame(std::vector<uint8_t>& frame_data, VideoPacketHeader&
 uint32_t JitterBuffer::getBufferDepthMs() const {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    if (frames_.empty()) return 0;
+    if (first_frame_) return 0;
 
-    uint64_t now = getTimestampUs();
-    uint64_t oldest = frames_.begin()->second.first_arrival_us;
-    return static_cast<uint32_t>((now - oldest) / 1000);
+    // Age of the oldest frame still waiting
+    for (uint32_t f = next_release_frame_;
+         static_cast<int32_t>(f - newest_frame_) <= 0; ++f) {
+        if (const FrameSlot* slot = findFrame(f)) {
+            uint64_t now = getTimestampUs();
+            return static_cast<uint32_t>((now - slot->first_arrival_us) / 1000);
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// setDepthRangeMs / setImmediateRelease / setSyncDelayUs
+// ---------------------------------------------------------------------------
+
+void JitterBuffer::setDepthRangeMs(uint32_t min_ms, uint32_t max_ms) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        min_depth_ms_ = min_ms;
+        max_depth_ms_ = std::max(min_ms, max_ms);
+        depth_us_ = std::clamp(depth_us_, min_depth_ms_ * 1000.0, max_depth_ms_ * 1000.0);
+        CS_LOG(DEBUG, "JitterBuffer: depth range %u-%u ms", min_depth_ms_, max_depth_ms_);
+    }
+    ready_cv_.notify_all();   // Playout times moved
+}
+
+void JitterBuffer::setImmediateRelease(bool immediate) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        immediate_ = immediate;
+        CS_LOG(DEBUG, "JitterBuffer: immediate release %s", immediate ? "on" : "off");
+    }
+    ready_cv_.notify_all();
+}
+
+void JitterBuffer::setSyncDelayUs(uint32_t delay_us) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sync_delay_us_ = delay_us;
+    }
+    ready_cv_.notify_all();
 }
 
 // ---------------------------------------------------------------------------
-// setTargetDepthMs
+// getPlayoutDepthMs / getLateFrames / getRepairWindowMs
 // ---------------------------------------------------------------------------
 
-void JitterBuffer::setTargetDepthMs(uint32_t ms) {
+uint32_t JitterBuffer::getPlayoutDepthMs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return immediate_ ? 0 : static_cast<uint32_t>(depth_us_ / 1000.0);
+}
+
+uint64_t JitterBuffer::getLateFrames() const {
     std::lock_guard<std::mutex> lock(mutex_);
-    target_depth_ms_ = ms;
-    CS_LOG(DEBUG, "JitterBuffer: target depth set to %u ms", ms);
+    return late_frames_;
+}
+
+uint32_t JitterBuffer::getRepairWindowMs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return maxFrameAgeMs();
+}
+
+// ---------------------------------------------------------------------------
+// onFrameComplete -- frame-level jitter and the adaptive depth
+// ---------------------------------------------------------------------------
+
+void JitterBuffer::onFrameComplete(const FrameSlot& slot, uint64_t now_us) {
+    // Host and viewer clocks are unrelated, but their 32-bit difference
+    // moves only with network (and encode) delay.
+    const uint32_t transit = static_cast<uint32_t>(now_us) - slot.header.timestamp_us;
+    if (transit_count_ == 0) transit_ref_ = transit;
+    const int32_t rel = static_cast<int32_t>(transit - transit_ref_);
+
+    // A frame arriving after the time it would have been played out at
+    // with the current depth is late.
+    if (!immediate_ && transit_count_ > 0 &&
+        static_cast<double>(rel - min_transit_) > depth_us_) {
+        late_frames_++;
+    }
+
+    transits_[transit_next_] = rel;
+    transit_next_ = (transit_next_ + 1) % JITTER_WINDOW_FRAMES;
+    if (transit_count_ < JITTER_WINDOW_FRAMES) transit_count_++;
+
+    std::copy(transits_.begin(), transits_.begin() + transit_count_, scratch_.begin());
+    auto end = scratch_.begin() + transit_count_;
+    min_transit_ = *std::min_element(scratch_.begin(), end);
+    auto pct = scratch_.begin() +
+               static_cast<size_t>(JITTER_PERCENTILE * (transit_count_ - 1));
+    std::nth_element(scratch_.begin(), pct, end);
+
+    // Fast attack, slow decay.
+    const double target = std::clamp(static_cast<double>(*pct - min_transit_),
+                                     min_depth_ms_ * 1000.0, max_depth_ms_ * 1000.0);
+    if (target > depth_us_) {
+        depth_us_ = target;
+    } else {
+        depth_us_ -= (depth_us_ - target) * DEPTH_DECAY;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// playoutTimeUs -- capture time mapped to the local clock, plus the depth
+//                  and any sync delay
+// ---------------------------------------------------------------------------
+
+uint64_t JitterBuffer::playoutTimeUs(const FrameSlot& slot, uint64_t now_us) const {
+    if (transit_count_ == 0) return now_us;
+    const uint32_t due = slot.header.timestamp_us + transit_ref_ +
+                         static_cast<uint32_t>(min_transit_) +
+                         static_cast<uint32_t>(depth_us_) + sync_delay_us_;
+    // Local time is only known modulo 2^32 us; the due time is near now.
+    const int32_t wait = static_cast<int32_t>(due - static_cast<uint32_t>(now_us));
+    return wait > 0 ? now_us + static_cast<uint64_t>(wait) : now_us;
 }
 
 // ---------------------------------------------------------------------------
@@ -199,11 +560,7 @@ void JitterBuffer::setTargetDepthMs(uint32_t ms) {
 
 uint32_t JitterBuffer::getCompleteFrameCount() const {
     std::lock_guard<std::mutex> lock(mutex_);
-    uint32_t count = 0;
-    for (const auto& pair : frames_) {
-        if (pair.second.complete) count++;
-    }
-    return count;
+    return complete_count_;
 }
 
 // ---------------------------------------------------------------------------
@@ -216,73 +573,86 @@ uint64_t JitterBuffer::getFramesDropped() const {
 }
 
 // ---------------------------------------------------------------------------
-// expireOldFrames
+// takeLostFrames / markLost
 // ---------------------------------------------------------------------------
 
-void JitterBuffer::expireOldFrames() {
-    // Called under lock
-
-    uint64_t now = getTimestampUs();
-    uint64_t max_age_us = static_cast<uint64_t>(max_frame_age_ms_) * 1000;
-
-    auto it = frames_.begin();
-    while (it != frames_.end()) {
-        if (!it->second.complete) {
-            uint64_t age = now - it->second.first_arrival_us;
-            if (age > max_age_us) {
-                CS_LOG(DEBUG, "JitterBuffer: expiring frame %u (age=%llu us, %u/%u frags)",
-                       it->first, static_cast<unsigned long long>(age),
-                       it->second.fragments_received, it->second.fragment_total);
-                frames_dropped_++;
-                it = frames_.erase(it);
-                continue;
-            }
-        }
-        ++it;
-    }
+bool JitterBuffer::takeLostFrames(uint32_t& first, uint32_t& last) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!has_lost_) return false;
+    first = lost_first_;
+    last  = lost_last_;
+    has_lost_ = false;
+    return true;
+}
 
-    // Also limit total buffer size to prevent unbounded growth
-    while (frames_.size() > 100) {
-        auto oldest = frames_.begin();
-        CS_LOG(WARN, "JitterBuffer: buffer overflow, dropping frame %u", oldest->first);
-        frames_dropped_++;
-        frames_.erase(oldest);
+void JitterBuffer::markLost(uint32_t first, uint32_t last) {
+    if (!has_lost_) {
+        lost_first_ = first;
+        lost_last_  = last;
+        has_lost_   = true;
+        return;
     }
+    if (static_cast<int32_t>(first - lost_first_) < 0) lost_first_ = first;
+    if (static_cast<int32_t>(last - lost_last_) > 0)   lost_last_  = last;
 }
 
 // ---------------------------------------------------------------------------
-// assembleFrame
+// hasCompleteAfter
 // ---------------------------------------------------------------------------
 
-bool JitterBuffer::assembleFrame(const FrameAssembly& assembly,
-                                  std::vector<uint8_t>& out) const {
-    // Calculate total size
-    size_t total_size = 0;
-    for (const auto& frag : assembly.fragments) {
-        if (frag.empty()) {
-            // Should not happen if frame is complete, but be safe
-            CS_LOG(WARN, "JitterBuffer: missing fragment in 'complete' frame");
-            return false;
-        }
-        total_size += frag.size();
+bool JitterBuffer::hasCompleteAfter(uint32_t frame) const {
+    for (uint32_t f = frame + 1; static_cast<int32_t>(f - newest_frame_) <= 0; ++f) {
+        const FrameSlot* slot = findFrame(f);
+        if (slot && slot->complete) return true;
     }
+    return false;
+}
 
-    // Assemble in order
-    out.clear();
-    out.reserve(total_size);
+// ---------------------------------------------------------------------------
+// expireOldFrames
+// ---------------------------------------------------------------------------
 
-    for (const auto& frag : assembly.fragments) {
-        out.insert(out.end(), frag.begin(), frag.end());
-    }
+bool JitterBuffer::expireOldFrames() {
+    // Called under lock
 
-    return true;
+    bool expired = false;
+    uint64_t now = getTimestampUs();
+    uint64_t max_age_us = static_cast<uint64_t>(maxFrameAgeMs()) * 1000;
+
+    for (uint32_t f = next_release_frame_;
+         static_cast<int32_t>(f - newest_frame_) <= 0; ++f) {
+        FrameSlot* slot = findFrame(f);
+        if (!slot || slot->complete) continue;
+
+        uint64_t age = now - slot->first_arrival_us;
+        if (age > max_age_us) {
+            CS_LOG(DEBUG, "JitterBuffer: expiring frame %u (age=%llu us, %u/%u frags)",
+                   f, static_cast<unsigned long long>(age),
+                   slot->fragments_received, slot->fragment_total);
+            frames_dropped_++;
+            releaseSlot(*slot);
+            expired = true;
+        }
+    }
+    return expired;
 }
 
+// ---------------------------------------------------------------------------
+// flush
+// ---------------------------------------------------------------------------
+
 void JitterBuffer::flush() {
     std::lock_guard<std::mutex> lock(mutex_);
-    frames_.clear();
+    for (FrameSlot& slot : slots_) {
+        if (!slot.held && slot.in_use) releaseSlot(slot);
+    }
     first_frame_ = true;
     next_release_frame_ = 0;
+    newest_frame_ = 0;
+    has_lost_ = false;
+    transit_count_ = 0;
+    transit_next_  = 0;
+    min_transit_   = 0;
 }
 
 } // namespace cs
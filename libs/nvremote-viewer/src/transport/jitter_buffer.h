@@ -7,16 +7,51 @@
 //
 // Design:
 //   - Each video frame may be split into multiple fragments (packets).
-//   - Fragments carry frame_number, fragment_index, fragment_total.
+//   - Fragments carry frame_number, fragment_index, fragment_total
+//     (VideoPacketHeaderV2; v1 headers are widened by parseVideoHeader()
+//     and their 16-bit frame numbers unwrapped against the release point).
 //   - A frame is complete when all fragment_total fragments are received.
+//     On wire version 3 fragments sent while the host is still encoding
+//     the frame carry a total of 0; the frame stays open until the last
+//     fragment brings the real one.
 //   - Complete frames are released in frame_number order.
-//   - Incomplete frames older than the max age are dropped.
+//   - Incomplete frames older than the max age are dropped, and reported
+//     through takeLostFrames() so the viewer can ask the host to recover.
+//   - Enhancement-layer frames (temporal layer > 0) are never referenced
+//     and never retransmitted.  One still missing fragments is dropped as
+//     soon as a later frame is complete, and complete ones are skipped
+//     while frames back up; neither is reported as lost.  A frame none of
+//     whose packets arrived has no known layer and is reported as usual.
+//
+// Storage is a fixed ring of RING_FRAMES frame slots indexed by
+// frame_number % RING_FRAMES.  Each slot owns a contiguous buffer that is
+// reused from frame to frame: a fragment is copied straight to
+// fragment_index * stride (the payload size of every fragment but the
+// last), a bitmask records which have arrived, and popFrame() hands the
+// decoder a view of the slot instead of a copy.
+//
+// Playout depth adapts to the measured frame-level jitter.  Each frame's
+// transit (completion time minus the host's capture timestamp, across
+// unsynchronized clocks) is compared with the smallest transit in the last
+// JITTER_WINDOW_FRAMES frames; a complete frame is held until its capture
+// time plus that minimum plus the depth.  The depth jumps up to the 95th
+// percentile of recent lateness at once and decays back slowly.  In
+// immediate mode complete frames are released as soon as they are next in
+// order.
+//
+// The decode thread blocks in waitForFrame() rather than polling.  It is
+// woken when a frame completes or the window moves, and otherwise sleeps
+// until the next time-driven event (a held frame's playout time, the skip
+// or incomplete-frame timeout), so fragments that complete nothing cause no
+// wakeups.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <array>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
 #include <vector>
-#include <map>
 #include <mutex>
 
 #include <cs/transport/packet.h>
@@ -25,69 +60,224 @@ namespace cs {
 
 class JitterBuffer {
 public:
+    /// A released frame: points into the jitter buffer's slot, which stays
+    /// reserved for the caller until the next popFrame() call.
+    struct FrameView {
+        const uint8_t* data = nullptr;
+        size_t         size = 0;
+        uint64_t       first_arrival_us = 0;   // Local clock: first fragment in
+        uint64_t       complete_us      = 0;   // and the last
+    };
+
     JitterBuffer();
     ~JitterBuffer();
 
     /// Push a received video packet fragment into the buffer.
-    void pushPacket(const VideoPacketHeader& header, const uint8_t* payload, size_t len);
+    void pushPacket(const VideoPacketHeaderV2& header, const uint8_t* payload, size_t len);
 
     /// Pop the next complete frame (in frame_number order).
-    /// Returns true if a frame was available, filling frame_data and header.
-    bool popFrame(std::vector<uint8_t>& frame_data, VideoPacketHeader& header);
+    /// Returns true if a frame was available, filling |frame| and |header|.
+    /// The previously popped frame's view is invalidated.
+    bool popFrame(FrameView& frame, VideoPacketHeaderV2& header);
+
+    /// Block until popFrame() has something to do (a frame to release or
+    /// one to give up on), interrupt() is called, or |max_wait_ms| passes.
+    /// Returns true in the first case.
+    bool waitForFrame(uint32_t max_wait_ms);
+
+    /// Wake a thread blocked in waitForFrame() (or the next one to call it).
+    void interrupt();
 
     /// Get the current buffer depth in milliseconds (estimated from timestamps).
     uint32_t getBufferDepthMs() const;
 
-    /// Set the target jitter buffer depth in milliseconds.
-    /// Typical range: 10-50ms. Default: 20ms for low-latency gaming.
-    void setTargetDepthMs(uint32_t ms);
+    /// Bound the adaptive playout depth to [|min_ms|, |max_ms|].
+    /// Default: 0-40 ms.
+    void setDepthRangeMs(uint32_t min_ms, uint32_t max_ms);
+
+    /// Release complete frames without any hold-back (lowest latency, for
+    /// competitive / LAN play).  Jitter is still measured.
+    void setImmediateRelease(bool immediate);
+
+    /// Hold frames back |delay_us| beyond the adaptive depth, to line video
+    /// up with audio (AvSync).  Ignored in immediate mode.
+    void setSyncDelayUs(uint32_t delay_us);
+
+    /// Current playout hold-back in milliseconds (0 in immediate mode).
+    uint32_t getPlayoutDepthMs() const;
+
+    /// Frames that completed after their playout time.
+    uint64_t getLateFrames() const;
+
+    /// How long an incomplete frame is waited for before it is given up
+    /// on; a fragment repaired later than this is of no use.
+    uint32_t getRepairWindowMs() const;
 
     /// Get number of complete frames waiting in the buffer.
     uint32_t getCompleteFrameCount() const;
 
-    /// Get number of frames dropped due to age timeout.
+    /// Get number of frames dropped (age timeout, skipped over, or
+    /// enhancement-layer frames dropped early).
     uint64_t getFramesDropped() const;
 
+    /// Take the range of frames given up on since the last call (frame
+    /// numbers as returned by popFrame(), inclusive).  Returns false if no
+    /// frame was lost.
+    bool takeLostFrames(uint32_t& first, uint32_t& last);
+
     /// Flush all buffered frames (used on reconnect to clear stale data).
+    /// A frame popped but not yet replaced by the next popFrame() stays
+    /// valid.
     void flush();
 
 private:
-    /// Internal structure tracking the assembly state of one frame.
-    struct FrameAssembly {
-        VideoPacketHeader header;              // Header from the first fragment
-        std::vector<std::vector<uint8_t>> fragments;  // Indexed by fragment_index
+    /// Frames held at once; the window is [next_release_frame_,
+    /// next_release_frame_ + RING_FRAMES).
+    static constexpr uint32_t RING_FRAMES = 64;
+
+    /// Slot buffers larger than this (keyframes) are freed on release, so
+    /// every slot does not end up holding a keyframe's worth of memory.
+    static constexpr size_t SLOT_RETAIN_BYTES = 512 * 1024;
+
+    /// Highest fragment count accepted for a frame whose total is not known
+    /// yet (the 16-bit fragment index limit).
+    static constexpr uint32_t MAX_OPEN_FRAGMENTS = 0xFFFF;
+
+    /// Assembly state of one frame, reused for every frame mapping to it.
+    struct FrameSlot {
+        VideoPacketHeaderV2   header;              // Header from the first fragment
+        std::vector<uint8_t>  data;                // Fragment i at i * stride (never shrinks
+                                                   // below SLOT_RETAIN_BYTES)
+        std::vector<uint8_t>  tail;                // Last fragment, placed on completion
+        std::vector<uint64_t> received;            // Bitmask by fragment_index
+        uint32_t frame_number       = 0;
         uint32_t fragments_received = 0;
-        uint32_t fragment_total     = 0;
-        uint64_t first_arrival_us   = 0;       // Local timestamp of first fragment arrival
+        uint32_t fragment_total     = 0;           // 0 while an open frame's is unknown
+        size_t   stride             = 0;           // Payload size of non-last fragments
+        size_t   size               = 0;           // Frame size once complete
+        uint64_t first_arrival_us   = 0;           // Local timestamp of first fragment arrival
+        uint64_t complete_us        = 0;           // And of the one completing it
+        bool     in_use             = false;
         bool     complete           = false;
-
-        /// Returns true if all fragments have been received.
-        bool isComplete() const {
-            return fragments_received >= fragment_total && fragment_total > 0;
-        }
+        bool     held               = false;       // Popped; owned by the caller
     };
 
-    /// Expire frames older than the maximum allowed age.
-    void expireOldFrames();
+    FrameSlot& slotFor(uint32_t frame) { return slots_[frame % RING_FRAMES]; }
+    const FrameSlot& slotFor(uint32_t frame) const { return slots_[frame % RING_FRAMES]; }
+
+    /// The slot holding waiting frame |frame|, or nullptr (called under lock).
+    FrameSlot* findFrame(uint32_t frame) {
+        FrameSlot& slot = slotFor(frame);
+        return slot.in_use && !slot.held && slot.frame_number == frame ? &slot : nullptr;
+    }
+    const FrameSlot* findFrame(uint32_t frame) const {
+        return const_cast<JitterBuffer*>(this)->findFrame(frame);
+    }
 
-    /// Reassemble a complete frame into a contiguous byte buffer.
-    bool assembleFrame(const FrameAssembly& assembly, std::vector<uint8_t>& out) const;
+    /// Return a slot to the free state, keeping its buffers (called under lock).
+    void releaseSlot(FrameSlot& slot);
 
-    // Map of frame_number -> FrameAssembly, ordered by frame number
-    std::map<uint16_t, FrameAssembly> frames_;
+    /// pushPacket() body; returns true if a frame completed or the window
+    /// moved, so a waiter should re-check (called under lock).
+    bool insertPacket(const VideoPacketHeaderV2& header, const uint8_t* payload, size_t len);
+
+    /// Earliest local time at which popFrame() would act: <= |now_us| if it
+    /// would now, UINT64_MAX if only a new packet can change that (called
+    /// under lock).
+    uint64_t nextEventUs(uint64_t now_us) const;
+
+    /// Store one fragment into |slot|; returns false if it does not fit the
+    /// frame's layout (called under lock).
+    bool storeFragment(FrameSlot& slot, uint16_t frag_idx, const uint8_t* payload, size_t len);
+
+    /// Adopt |frag_total| for an open frame; returns false if fragments
+    /// already stored lie at or past the last one (called under lock).
+    bool learnTotal(FrameSlot& slot, uint16_t frag_total);
+
+    /// Put the last fragment in place and fix the frame size (called under lock).
+    void finishFrame(FrameSlot& slot);
+
+    /// Move the release point past |frame|, freeing its slot (called under lock).
+    void advancePast(uint32_t frame);
+
+    /// Expire frames older than the maximum allowed age; returns true if
+    /// any was (called under lock).
+    bool expireOldFrames();
+
+    /// Record frames |first| .. |last| as given up on (called under lock).
+    void markLost(uint32_t first, uint32_t last);
+
+    /// True if a complete frame is waiting after |frame| (called under lock).
+    bool hasCompleteAfter(uint32_t frame) const;
+
+    /// Fold a just-completed frame's transit into the jitter window and
+    /// update the depth (called under lock).
+    void onFrameComplete(const FrameSlot& slot, uint64_t now_us);
+
+    /// Local time at which |slot| is played out (called under lock).
+    uint64_t playoutTimeUs(const FrameSlot& slot, uint64_t now_us) const;
+
+    /// True once |slot|'s playout time has come (called under lock).
+    bool isDue(const FrameSlot& slot, uint64_t now_us) const {
+        return playoutTimeUs(slot, now_us) <= now_us;
+    }
+
+    /// How long an incomplete frame is waited for (called under lock).
+    uint32_t maxFrameAgeMs() const {
+        return BASE_FRAME_AGE_MS + static_cast<uint32_t>(depth_us_ / 1000.0);
+    }
+
+    std::array<FrameSlot, RING_FRAMES> slots_;
 
     // The next frame number we expect to release (for in-order delivery)
-    uint16_t next_release_frame_ = 0;
+    // and the newest frame seen, which bound the frames in use.
+    uint32_t next_release_frame_ = 0;
+    uint32_t newest_frame_       = 0;
     bool     first_frame_        = true;
 
+    uint32_t complete_count_     = 0;      // Complete frames in the ring
+    FrameSlot* held_             = nullptr;  // Slot behind the last popped view
+
     // Configuration
-    uint32_t target_depth_ms_ = 20;     // Target buffer depth
-    uint32_t max_frame_age_ms_ = 150;   // Drop frames older than this
+    uint32_t min_depth_ms_ = 0;
+    uint32_t max_depth_ms_ = 40;
+    bool     immediate_    = false;
+    uint32_t sync_delay_us_ = 0;
+
+    // Adaptive playout.  Transits are offsets from the first frame's, so
+    // they stay small despite the 32-bit, unrelated clocks.
+    static constexpr uint32_t JITTER_WINDOW_FRAMES   = 128;
+    static constexpr double   JITTER_PERCENTILE      = 0.95;
+    static constexpr double   DEPTH_DECAY            = 0.02;   // Of the excess, per frame
+    static constexpr uint32_t BASE_FRAME_AGE_MS      = 150;    // Repair time beyond the depth
+    static constexpr uint32_t SKIP_WAIT_MS           = 10;     // Before skipping a missing frame
+    std::array<int32_t, JITTER_WINDOW_FRAMES> transits_{};
+    std::array<int32_t, JITTER_WINDOW_FRAMES> scratch_{};
+    uint32_t transit_count_ = 0;
+    uint32_t transit_next_  = 0;
+    uint32_t transit_ref_   = 0;       // Transit of the first sample
+    int32_t  min_transit_   = 0;       // Over the window, relative to transit_ref_
+    double   depth_us_      = 0.0;
+    uint64_t late_frames_   = 0;
+
+    // Complete frames waiting at which the depth hold is skipped and
+    // enhancement-layer frames are dropped to catch up.
+    static constexpr uint32_t BACKLOG_FRAMES = 3;
 
     // Statistics
     uint64_t frames_dropped_ = 0;
 
+    // Frames given up on and not yet collected by takeLostFrames()
+    bool     has_lost_   = false;
+    uint32_t lost_first_ = 0;
+    uint32_t lost_last_  = 0;
+
     mutable std::mutex mutex_;
+
+    // Signalled when a frame completes or the window moves; waitForFrame()
+    // sleeps on it with mutex_.
+    std::condition_variable ready_cv_;
+    bool wake_ = false;                    // interrupt() pending
 };
 
 } // namespace cs
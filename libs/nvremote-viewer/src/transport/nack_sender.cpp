@@ -6,16 +6,37 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "nack_sender.h"
+#include "jitter_buffer.h"
 
 #include <cs/common.h>
+#include <cs/thread_policy.h>
 #include <cs/transport/packet.h>
 
 #include <chrono>
 #include <cstring>
 #include <algorithm>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace cs {
 
+namespace {
+
+/// Index of the lowest set bit of |v| (v != 0).
+inline uint32_t lowestBit(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, v);
+    return static_cast<uint32_t>(idx);
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(v));
+#endif
+}
+
+} // anonymous namespace
+
 // ---------------------------------------------------------------------------
 // Constructor / Destructor
 // ---------------------------------------------------------------------------
@@ -53,26 +74,48 @@ void NackSender::onPacketReceived(uint16_t seq) {
     std::lock_guard<std::mutex> lock(mutex_);
 
     if (first_packet_) {
-        highest_seq_ = seq;
+        received_.fill(0);
+        highest_seq_  = seq;
+        window_len_   = 1;
         first_packet_ = false;
     }
 
-    received_seqs_.insert(seq);
-
     // Update highest sequence number seen (handling wraparound)
     int16_t delta = static_cast<int16_t>(seq - highest_seq_);
     if (delta > 0) {
-        highest_seq_ = seq;
+        advanceTo(seq, getTimestampUs());
+    } else if (-delta >= window_len_) {
+        return;   // Older than the window
     }
 
-    // Remove from NACK tracking (it arrived, possibly via retransmit)
-    nack_retries_.erase(seq);
+    // Arrived, possibly via retransmit: stop requesting it
+    const uint32_t idx = seq % NACK_WINDOW;
+    received_[idx / 64] |= 1ULL << (idx % 64);
+    nack_state_[idx].active = false;
+}
+
+// ---------------------------------------------------------------------------
+// advanceTo -- slide the window forward to |seq|
+// ---------------------------------------------------------------------------
 
-    // Trim the received set to keep it bounded (only keep recent window)
-    // Keep last ~1000 sequence numbers
-    while (received_seqs_.size() > 1000) {
-        received_seqs_.erase(received_seqs_.begin());
+void NackSender::advanceTo(uint16_t seq, uint64_t now_us) {
+    // Each sequence entering the window takes the slot of one leaving it.
+    // All but |seq| itself are missing until they arrive.
+    const uint16_t steps = static_cast<uint16_t>(seq - highest_seq_);
+    const uint16_t count = std::min(steps, NACK_WINDOW);
+    for (uint16_t i = 0; i < count; ++i) {
+        const uint32_t idx = static_cast<uint16_t>(seq - i) % NACK_WINDOW;
+        received_[idx / 64] &= ~(1ULL << (idx % 64));
+
+        NackState& state = nack_state_[idx];
+        state.missing_since_us = now_us;
+        state.next_nack_us     = now_us;
+        state.retries          = 0;
+        state.active           = true;
     }
+
+    window_len_  = static_cast<uint16_t>(std::min<uint32_t>(NACK_WINDOW, window_len_ + steps));
+    highest_seq_ = seq;
 }
 
 // ---------------------------------------------------------------------------
@@ -112,6 +155,46 @@ void NackSender::setMaxRetries(int n) {
     max_retries_ = n;
 }
 
+// ---------------------------------------------------------------------------
+// setRtt
+// ---------------------------------------------------------------------------
+
+void NackSender::setRtt(uint32_t srtt_us, uint32_t rttvar_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    srtt_us_ = srtt_us;
+    retry_interval_us_ = std::max<uint64_t>(MIN_RETRY_INTERVAL_US,
+        static_cast<uint64_t>(srtt_us) + 4ull * rttvar_us);
+}
+
+// ---------------------------------------------------------------------------
+// setJitterBuffer
+// ---------------------------------------------------------------------------
+
+void NackSender::setJitterBuffer(const JitterBuffer* jitter_buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jitter_buffer_ = jitter_buffer;
+}
+
+// ---------------------------------------------------------------------------
+// reportFrameLoss / clearFrameLoss
+// ---------------------------------------------------------------------------
+
+void NackSender::reportFrameLoss(uint32_t first, uint32_t last, uint8_t stream) {
+    if (stream >= MAX_VIDEO_STREAMS) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    FrameLoss& loss = losses_[stream];
+    loss.first   = first;
+    loss.last    = last;
+    loss.pending = true;
+    sendFrameLossPacket(stream, getTimestampUs());
+}
+
+void NackSender::clearFrameLoss(uint8_t stream) {
+    if (stream >= MAX_VIDEO_STREAMS) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    losses_[stream].pending = false;
+}
+
 // ---------------------------------------------------------------------------
 // getMissingSequences
 // ---------------------------------------------------------------------------
@@ -120,8 +203,13 @@ std::vector<uint16_t> NackSender::getMissingSequences() const {
     std::lock_guard<std::mutex> lock(mutex_);
 
     std::vector<uint16_t> missing;
-    for (const auto& pair : nack_retries_) {
-        missing.push_back(pair.first);
+    if (first_packet_) return missing;
+
+    const uint16_t oldest = static_cast<uint16_t>(highest_seq_ - (window_len_ - 1));
+    for (uint16_t i = 0; i + 1u < window_len_; ++i) {
+        const uint16_t seq = static_cast<uint16_t>(oldest + i);
+        const NackState& state = nack_state_[seq % NACK_WINDOW];
+        if (state.active && state.retries > 0) missing.push_back(seq);
     }
     return missing;
 }
@@ -139,6 +227,7 @@ uint64_t NackSender::getNacksSent() const {
 // ---------------------------------------------------------------------------
 
 void NackSender::timerFunc() {
+    cs::ScopedThreadRole role(cs::ThreadRole::FEEDBACK);
     while (running_.load()) {
         std::this_thread::sleep_for(std::chrono::milliseconds(5));
 
@@ -155,69 +244,80 @@ void NackSender::timerFunc() {
 void NackSender::checkForGaps() {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    if (first_packet_ || received_seqs_.empty()) {
+    // Repeat an unanswered frame loss report; the first copy may have been
+    // lost, or the host's answer may be.
+    const uint64_t loss_interval_us = std::max(retry_interval_us_, MIN_LOSS_REPORT_INTERVAL_US);
+    for (size_t stream = 0; stream < losses_.size(); ++stream) {
+        if (!losses_[stream].pending) continue;
+        const uint64_t now_us = getTimestampUs();
+        if (now_us - losses_[stream].sent_us >= loss_interval_us) {
+            sendFrameLossPacket(static_cast<uint8_t>(stream), now_us);
+        }
+    }
+
+    if (first_packet_ || window_len_ <= 1) {
         return;
     }
 
-    // Find the lowest sequence number in our window
-    uint16_t lowest = *received_seqs_.begin();
+    // A retransmit requested now lands about SRTT from now; past the
+    // jitter buffer's repair window its frame has been given up on.
+    const uint64_t now_us    = getTimestampUs();
+    const uint64_t repair_us = jitter_buffer_
+        ? static_cast<uint64_t>(jitter_buffer_->getRepairWindowMs()) * 1000
+        : 0;
 
-    // Scan from lowest to highest_seq_ for missing sequences
+    // Scan from the oldest sequence in the window up to highest_seq_, one
+    // bitmap word (or the part of one inside the window) at a time.
     std::vector<uint16_t> missing;
+    const uint16_t oldest = static_cast<uint16_t>(highest_seq_ - (window_len_ - 1));
+    const uint32_t span   = window_len_ - 1u;      // highest_seq_ itself arrived
+    const size_t   limit  = static_cast<size_t>(max_nacks_per_check_);
+
+    for (uint32_t off = 0; off < span && missing.size() < limit; ) {
+        const uint16_t first = static_cast<uint16_t>(oldest + off);
+        const uint32_t idx   = first % NACK_WINDOW;
+        const uint32_t shift = idx % 64;
+        const uint32_t bits  = std::min(64u - shift, span - off);
+
+        uint64_t gaps = ~received_[idx / 64] >> shift;
+        if (bits < 64) gaps &= (1ULL << bits) - 1;
+
+        while (gaps != 0) {
+            const uint32_t b = lowestBit(gaps);
+            gaps &= gaps - 1;
+
+            NackState& state = nack_state_[idx + b];
+            if (!state.active) continue;
+
+            // Too late to be of use: give up on this sequence
+            if (repair_us > 0 && now_us + srtt_us_ > state.missing_since_us + repair_us) {
+                state.active = false;
+                continue;
+            }
 
-    // Only look at a reasonable window (don't scan the entire 16-bit space)
-    int16_t range = static_cast<int16_t>(highest_seq_ - lowest);
-    if (range < 0) range = 0;
-    if (range > 500) {
-        // Window too large, trim it
-        lowest = highest_seq_ - 500;
-    }
-
-    for (uint16_t seq = lowest; seq != highest_seq_; seq++) {
-        if (received_seqs_.find(seq) == received_seqs_.end()) {
-            // This sequence is missing
-
-            // Check if we've already NACKed it too many times
-            auto retry_it = nack_retries_.find(seq);
-            if (retry_it != nack_retries_.end()) {
-                if (retry_it->second >= max_retries_) {
-                    // Give up on this sequence
-                    nack_retries_.erase(retry_it);
-                    continue;
-                }
+            // The retransmit of the last request may still be in flight.
+            if (now_us < state.next_nack_us) continue;
+            if (state.retries >= max_retries_) {
+                state.active = false;
+                continue;
             }
 
-            missing.push_back(seq);
+            missing.push_back(static_cast<uint16_t>(first + b));
+            state.retries++;
+            state.next_nack_us = now_us + retry_interval_us_;
 
             // Limit NACKs per check cycle
-            if (missing.size() >= static_cast<size_t>(max_nacks_per_check_)) {
-                break;
-            }
+            if (missing.size() >= limit) break;
         }
+        off += bits;
     }
 
     if (missing.empty()) {
         return;
     }
 
-    // Update retry counts
-    for (uint16_t seq : missing) {
-        nack_retries_[seq]++;
-    }
-
     // Send NACK packet
     sendNackPacket(missing);
-
-    // Clean up stale NACK entries (very old sequences)
-    auto it = nack_retries_.begin();
-    while (it != nack_retries_.end()) {
-        int16_t age = static_cast<int16_t>(highest_seq_ - it->first);
-        if (age > 500) {
-            it = nack_retries_.erase(it);
-        } else {
-            ++it;
-        }
-    }
 }
 
 // ---------------------------------------------------------------------------
@@ -237,7 +337,7 @@ void NackSender::sendNackPacket(const std::vector<uint16_t>& missing_seqs) {
     size_t count = std::min(missing_seqs.size(), static_cast<size_t>(255));
     size_t packet_size = 2 + count * 2;
 
-    std::vector<uint8_t> packet(packet_size);
+    uint8_t packet[2 + 255 * 2];
     packet[0] = static_cast<uint8_t>(PacketType::NACK);
     packet[1] = static_cast<uint8_t>(count);
 
@@ -247,13 +347,14 @@ void NackSender::sendNackPacket(const std::vector<uint16_t>& missing_seqs) {
     }
 
     int sent = ::sendto(socket_fd_,
-                         reinterpret_cast<const char*>(packet.data()),
-                         static_cast<int>(packet.size()),
+                         reinterpret_cast<const char*>(packet),
+                         static_cast<int>(packet_size),
                          0,
                          reinterpret_cast<const ::sockaddr*>(peer_addr_.data()),
                          peer_addr_len_);
 
     if (sent > 0) {
+        if (recorder_) recorder_->record(RecordDirection::SENT, packet, packet_size);
         nacks_sent_.fetch_add(count);
         CS_LOG(TRACE, "NackSender: sent NACK for %zu sequences (first=%u)",
                count, missing_seqs[0]);
@@ -262,4 +363,40 @@ void NackSender::sendNackPacket(const std::vector<uint16_t>& missing_seqs) {
     }
 }
 
+// ---------------------------------------------------------------------------
+// sendFrameLossPacket
+// ---------------------------------------------------------------------------
+
+void NackSender::sendFrameLossPacket(uint8_t stream, uint64_t now_us) {
+    const FrameLoss& loss = losses_[stream];
+    losses_[stream].sent_us = now_us;
+    if (socket_fd_ < 0 || peer_addr_.empty()) {
+        return;
+    }
+
+    FrameLossPacket report{};
+    report.type        = static_cast<uint8_t>(PacketType::FRAME_LOSS);
+    report.first_frame = loss.first;
+    report.last_frame  = loss.last;
+    report.setStreamId(stream);
+
+    uint8_t packet[sizeof(FrameLossPacket)];
+    size_t len = report.serializeTo(packet);
+
+    int sent = ::sendto(socket_fd_,
+                         reinterpret_cast<const char*>(packet),
+                         static_cast<int>(len),
+                         0,
+                         reinterpret_cast<const ::sockaddr*>(peer_addr_.data()),
+                         peer_addr_len_);
+
+    if (sent > 0) {
+        if (recorder_) recorder_->record(RecordDirection::SENT, packet, len);
+        CS_LOG(DEBUG, "NackSender: reported lost frames %u-%u (stream %u)",
+               loss.first, loss.last, static_cast<unsigned>(stream));
+    } else {
+        CS_LOG(WARN, "NackSender: sendto failed: %d", cs_socket_error());
+    }
+}
+
 } // namespace cs
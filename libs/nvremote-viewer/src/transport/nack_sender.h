@@ -8,19 +8,35 @@
 // Limits:
 //   - Max 10 NACKs per frame to avoid overwhelming the sender
 //   - Max N retries per missing sequence number (configurable)
+//   - A sequence is re-requested only after SRTT + 4 x RTTVAR (min 5ms),
+//     so a retry never races the retransmit of the previous request
+//   - A sequence is given up on once a retransmit could no longer arrive
+//     before the jitter buffer stops waiting for its frame
 //   - Checks every 5ms on a background timer
+//
+// Received sequence numbers are a bitmap over the last NACK_WINDOW
+// sequences, indexed by seq % NACK_WINDOW (which divides the 16-bit
+// space, so wraparound needs no special case).  Recording a packet is a
+// bit set; the gap check walks the window a 64-bit word at a time and
+// only visits the sequences actually missing.
+//
+// Frames lost for good are reported with a frame loss packet (type=0xF6),
+// repeated every retry interval (min 20ms) until the viewer has recovered.
+// Each video stream (display) has its own frame numbers, so its own report.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <vector>
-#include <map>
-#include <set>
 #include <mutex>
 #include <thread>
 #include <atomic>
 #include <functional>
 
+#include <cs/transport/packet.h>
+#include <cs/transport/packet_recorder.h>
+
 // Platform socket headers -- needed so ::sockaddr resolves inside the namespace.
 #ifdef _WIN32
 #include <WinSock2.h>
@@ -32,6 +48,8 @@
 
 namespace cs {
 
+class JitterBuffer;  // forward
+
 class NackSender {
 public:
     NackSender();
@@ -44,6 +62,13 @@ public:
     /// Initialize with a socket and peer address for sending NACKs.
     bool initialize(int socket_fd, const ::sockaddr* peer, int peer_len);
 
+    /// Send on |socket_fd| from now on (the session moved to another path).
+    void setSocket(int socket_fd) { socket_fd_.store(socket_fd); }
+
+    /// Record what this sends to |recorder| (see packet_recorder.h), which
+    /// must outlive it.  Must be set before sending starts.
+    void setRecorder(PacketRecorder* recorder) { recorder_ = recorder; }
+
     /// Notify that a packet with the given sequence number was received.
     void onPacketReceived(uint16_t seq);
 
@@ -56,6 +81,25 @@ public:
     /// Set maximum number of retransmission requests per sequence number.
     void setMaxRetries(int n);
 
+    /// Set the path RTT estimate (the host's SRTT and RTTVAR) that spaces
+    /// out retries of the same sequence number.
+    void setRtt(uint32_t srtt_us, uint32_t rttvar_us);
+
+    /// Take the repair deadline from |jitter_buffer|: a sequence missing
+    /// for longer than its repair window, less the time a retransmit
+    /// takes, is no longer requested.  Without one, only max retries stop
+    /// requests.  Thread-safe.
+    void setJitterBuffer(const JitterBuffer* jitter_buffer);
+
+    /// Report frames |first| .. |last| of video stream |stream| as
+    /// unrecoverable.  The report is sent at once and repeated until
+    /// clearFrameLoss().
+    void reportFrameLoss(uint32_t first, uint32_t last, uint8_t stream = 0);
+
+    /// Stop repeating |stream|'s frame loss report (a keyframe or recovery
+    /// frame arrived).
+    void clearFrameLoss(uint8_t stream = 0);
+
     /// Get the list of currently missing (NACKed) sequence numbers.
     /// Used by the stats reporter to include in QoS feedback.
     std::vector<uint16_t> getMissingSequences() const;
@@ -63,34 +107,77 @@ public:
     /// Get total NACKs sent.
     uint64_t getNacksSent() const;
 
+    /// Detect gaps in the sequence number window and send NACKs.  Run by
+    /// the timer thread every 5ms; callable directly when it is not
+    /// started (benchmarks).
+    void checkForGaps();
+
 private:
     /// Background thread function: check for gaps every 5ms.
     void timerFunc();
 
-    /// Detect gaps in the sequence number window and send NACKs.
-    void checkForGaps();
-
     /// Build and send a NACK packet for the given missing sequences.
     void sendNackPacket(const std::vector<uint16_t>& missing_seqs);
 
+    /// Send |stream|'s pending frame loss report (mutex_ held).
+    void sendFrameLossPacket(uint8_t stream, uint64_t now_us);
+
+    /// Record the sequences up to and including |seq| (newer than
+    /// highest_seq_) as entering the window (mutex_ held).
+    void advanceTo(uint16_t seq, uint64_t now_us);
+
     // Socket
-    int socket_fd_ = -1;
+    std::atomic<int> socket_fd_{-1};
     std::vector<uint8_t> peer_addr_;
     int peer_addr_len_ = 0;
-
-    // Sequence tracking
-    // We track a sliding window of received sequence numbers
-    std::set<uint16_t> received_seqs_;
+    PacketRecorder* recorder_ = nullptr;   // Session recording (not owned)
+
+    // Sequence window that is tracked and scanned for gaps.  Matches the
+    // host's 1024-packet retransmission cache: a version-2 keyframe can
+    // span thousands of packets, and any loss the host can still resend
+    // must stay inside the window.  Must divide 65536.
+    static constexpr uint16_t NACK_WINDOW = 1024;
+    static constexpr size_t   WINDOW_WORDS = NACK_WINDOW / 64;
+
+    // Sequence tracking: bit seq % NACK_WINDOW is set once seq arrived.
+    // The window is the |window_len_| sequences ending at highest_seq_.
+    std::array<uint64_t, WINDOW_WORDS> received_{};
     uint16_t highest_seq_      = 0;
+    uint16_t window_len_       = 0;
     bool     first_packet_     = true;
 
-    // NACK tracking: seq -> retry count
-    std::map<uint16_t, int> nack_retries_;
+    // Per missing sequence, by seq % NACK_WINDOW.  Valid while the
+    // sequence is in the window and its received bit is clear.
+    struct NackState {
+        uint64_t missing_since_us = 0;     // When a later sequence arrived
+        uint64_t next_nack_us     = 0;     // Earliest (re-)request
+        int      retries          = 0;
+        bool     active           = false;  // Still being requested
+    };
+    std::array<NackState, NACK_WINDOW> nack_state_{};
+
+    const JitterBuffer* jitter_buffer_ = nullptr;
 
     // Configuration
     int max_retries_        = 3;
     int max_nacks_per_check_ = 10;
 
+    // Retry spacing: SRTT + 4 x RTTVAR, never below one timer tick.
+    // A retransmit requested now arrives about SRTT later.
+    uint64_t retry_interval_us_ = MIN_RETRY_INTERVAL_US;
+    uint64_t srtt_us_           = 0;
+    static constexpr uint64_t MIN_RETRY_INTERVAL_US = 5000;
+
+    // Pending frame loss report, per video stream
+    struct FrameLoss {
+        bool     pending = false;
+        uint32_t first   = 0;
+        uint32_t last    = 0;
+        uint64_t sent_us = 0;      // Last sent
+    };
+    std::array<FrameLoss, MAX_VIDEO_STREAMS> losses_{};
+    static constexpr uint64_t MIN_LOSS_REPORT_INTERVAL_US = 20000;
+
     // Thread
     std::thread timer_thread_;
     std::atomic<bool> running_{false};
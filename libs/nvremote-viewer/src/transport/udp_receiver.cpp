@@ -3,15 +3,23 @@
 //
 // Runs a non-blocking receive loop on a background thread:
 //   1. poll/select with 1ms timeout for responsiveness
-//   2. recv datagram
-//   3. If DTLS enabled: decrypt via OpenSSL memory BIOs
+//   2. recvmmsg / WSARecvMsg up to RECV_BATCH_SIZE datagrams into the ring;
+//      GRO / URO buffers are split back into datagrams
+//   3. Sealed media: open in place with the AEAD media cipher;
+//      anything else with DTLS enabled: decrypt via OpenSSL memory BIOs
+//      (the handshake offers the wire versions as ALPN protocols and
+//      resumes the last session with the same host identity)
 //   4. Identify packet type from header
-//   5. Dispatch to registered callback
+//   5. Dispatch the batch to the registered callback
+// and, between batches, challenges the paths it holds (CS06).
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "udp_receiver.h"
 
 #include <cs/common.h>
+#include <cs/thread_policy.h>
+#include <cs/trace.h>
+#include <cs/transport/dtls_context.h>
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -20,11 +28,58 @@
 #include <cstring>
 #include <algorithm>
 
+#ifdef _WIN32
+#include <mswsock.h>
+#endif
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#include <sys/uio.h>
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104   // linux/udp.h, kernel 5.0+
+#endif
+#endif
+
 namespace cs {
 
 // Maximum UDP datagram size we expect to receive
 static constexpr size_t MAX_DATAGRAM_SIZE = 65536;
 
+// Ring slot size without receive offload: one jumbo-frame datagram, the
+// largest size the host's path MTU probing can settle on.  Larger
+// datagrams are truncated and dropped (so their probes go unanswered).
+static constexpr size_t MAX_SEGMENT_SIZE = 9216;
+
+// The session of the last host the viewer connected to, by that host's
+// fingerprint.  A host keeps its identity for a while (DtlsIdentityPool),
+// and a receiver connecting to it again within that resumes the session:
+// one round trip and no key exchange.
+static std::mutex   g_resume_mutex;
+static std::string  g_resume_fingerprint;
+static SSL_SESSION* g_resume_session = nullptr;
+
+/// A reference to the session to resume with |fingerprint|, or nullptr.
+static SSL_SESSION* takeResumableSession(const std::string& fingerprint) {
+    std::lock_guard<std::mutex> lock(g_resume_mutex);
+    if (!g_resume_session || fingerprint != g_resume_fingerprint ||
+        SSL_SESSION_is_resumable(g_resume_session) != 1) {
+        return nullptr;
+    }
+    SSL_SESSION_up_ref(g_resume_session);
+    return g_resume_session;
+}
+
+/// Keep |session| (a reference the cache takes over) for |fingerprint|.
+static void keepResumableSession(const std::string& fingerprint, SSL_SESSION* session) {
+    std::lock_guard<std::mutex> lock(g_resume_mutex);
+    if (g_resume_session) SSL_SESSION_free(g_resume_session);
+    g_resume_session     = session;
+    g_resume_fingerprint = fingerprint;
+}
+
 // ---------------------------------------------------------------------------
 // Constructor / Destructor
 // ---------------------------------------------------------------------------
@@ -48,10 +103,12 @@ UdpReceiver::~UdpReceiver() {
 // initialize
 // ---------------------------------------------------------------------------
 
-bool UdpReceiver::initialize(int socket_fd, const std::string& dtls_fingerprint) {
+bool UdpReceiver::initialize(int socket_fd, const std::string& dtls_fingerprint,
+                             int recv_buffer_bytes) {
     std::lock_guard<std::mutex> lock(mutex_);
 
     socket_fd_ = socket_fd;
+    recv_buffer_bytes_ = recv_buffer_bytes;
     dtls_fingerprint_ = dtls_fingerprint;
     dtls_enabled_ = !dtls_fingerprint.empty();
 
@@ -63,6 +120,24 @@ bool UdpReceiver::initialize(int socket_fd, const std::string& dtls_fingerprint)
     // Set socket to non-blocking
     cs_set_nonblocking(socket_fd_);
 
+    // Size the kernel receive buffer so a keyframe burst is not dropped
+    // while the loop is busy decrypting and dispatching.
+    if (recv_buffer_bytes > 0) {
+        ::setsockopt(socket_fd_, SOL_SOCKET, SO_RCVBUF,
+                     reinterpret_cast<const char*>(&recv_buffer_bytes),
+                     sizeof(recv_buffer_bytes));
+        int actual = 0;
+        socklen_t len = sizeof(actual);
+        ::getsockopt(socket_fd_, SOL_SOCKET, SO_RCVBUF,
+                     reinterpret_cast<char*>(&actual), &len);
+        if (actual < recv_buffer_bytes) {
+            CS_LOG(WARN, "UdpReceiver: SO_RCVBUF is %d bytes (requested %d; "
+                   "raise net.core.rmem_max)", actual, recv_buffer_bytes);
+        } else {
+            CS_LOG(INFO, "UdpReceiver: SO_RCVBUF=%d bytes", actual);
+        }
+    }
+
     if (dtls_enabled_) {
         // Initialize OpenSSL DTLS context
         const SSL_METHOD* method = DTLS_client_method();
@@ -90,6 +165,25 @@ bool UdpReceiver::initialize(int socket_fd, const std::string& dtls_fingerprint)
 
         SSL_set_bio(ssl_, rbio_, wbio_);
         SSL_set_connect_state(ssl_);  // Client mode
+        setFastDtlsRetransmit(ssl_);
+
+        // Offer every wire version, newest first: a CS06 host picks one
+        // in the handshake and the tag exchange after it is skipped.
+        uint8_t alpn[(1 + PROTOCOL_VERSION_TAG_LEN) * PROTOCOL_WIRE_VERSION_MAX];
+        size_t alpn_len = 0;
+        for (uint8_t v = PROTOCOL_WIRE_VERSION_MAX; v >= 1; --v) {
+            alpn[alpn_len++] = static_cast<uint8_t>(PROTOCOL_VERSION_TAG_LEN);
+            std::memcpy(alpn + alpn_len, protocolVersionTag(v), PROTOCOL_VERSION_TAG_LEN);
+            alpn_len += PROTOCOL_VERSION_TAG_LEN;
+        }
+        if (SSL_set_alpn_protos(ssl_, alpn, static_cast<unsigned int>(alpn_len)) != 0) {
+            CS_LOG(WARN, "UdpReceiver: cannot offer wire versions in the handshake");
+        }
+
+        if (SSL_SESSION* session = takeResumableSession(dtls_fingerprint_)) {
+            SSL_set_session(ssl_, session);
+            SSL_SESSION_free(session);
+        }
 
         CS_LOG(INFO, "UdpReceiver: DTLS initialized, fingerprint=%s",
                dtls_fingerprint.substr(0, 20).c_str());
@@ -121,6 +215,19 @@ bool UdpReceiver::start(PacketCallback cb) {
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// setImpairment
+// ---------------------------------------------------------------------------
+
+void UdpReceiver::setImpairment(const ImpairmentConfig& config) {
+    impair_.reset();
+    if (!config.enabled()) return;
+
+    impair_ = std::make_unique<NetworkImpairment>(config);
+    impaired_.reserve(RECV_BATCH_SIZE);
+    CS_LOG(INFO, "UdpReceiver: impairment on ingress (%s)", describeImpairment(config).c_str());
+}
+
 // ---------------------------------------------------------------------------
 // stop
 // ---------------------------------------------------------------------------
@@ -131,6 +238,7 @@ void UdpReceiver::stop() {
     if (recv_thread_.joinable()) {
         recv_thread_.join();
     }
+    closePaths();
 
     CS_LOG(INFO, "UdpReceiver: stopped (packets=%llu bytes=%llu)",
            static_cast<unsigned long long>(packets_received_.load()),
@@ -163,6 +271,8 @@ uint64_t UdpReceiver::getBytesReceived() const {
 
 void UdpReceiver::receiveLoop() {
     CS_LOG(INFO, "UdpReceiver: receive loop started");
+    cs::ScopedThreadRole role(cs::ThreadRole::RECEIVE);
+    cs::trace::setThreadName("receive");
 
     // Perform DTLS handshake if enabled
     if (dtls_enabled_) {
@@ -173,78 +283,602 @@ void UdpReceiver::receiveLoop() {
         }
         CS_LOG(INFO, "UdpReceiver: DTLS handshake complete");
 
-        // Exchange protocol version tag (CS01) with the host
-        if (!exchangeProtocolVersion()) {
+        // Negotiate the wire version with the host: in the handshake, or
+        // with version tags (CS01 / CS02) after it from older hosts
+        if (const uint8_t version = handshakeWireVersion()) {
+            wire_version_ = version;
+            CS_LOG(INFO, "UdpReceiver: protocol version negotiated in the handshake: CS0%u",
+                   version);
+        } else if (!exchangeProtocolVersion()) {
             CS_LOG(ERR, "UdpReceiver: protocol version exchange failed");
             running_.store(false);
             return;
         }
+
+        if (!deriveMediaKeys()) {
+            CS_LOG(ERR, "UdpReceiver: failed to derive media keys");
+            running_.store(false);
+            return;
+        }
     }
 
-    std::vector<uint8_t> recv_buf(MAX_DATAGRAM_SIZE);
-    std::vector<uint8_t> plain_buf(MAX_DATAGRAM_SIZE);
+    // Offload is enabled only now: the handshake reads single datagrams.
+    setupBatchReceive();
+
+    // Path challenges are sealed, and answered by CS06 hosts only
+    active_ = Path();
+    active_.fd          = socket_fd_;
+    active_.answered_us = getTimestampUs();
+    next_nonce_ = active_.answered_us;
+    paths_enabled_.store(media_cipher_.isReady() && wire_version_ >= 6);
 
     while (running_.load()) {
-        // Use select with 1ms timeout for responsiveness
+        if (paths_enabled_.load()) maintainPaths(getTimestampUs());
+
+        // Use select with 1ms timeout for responsiveness.  Every socket
+        // the session may be reached on is read: a standby the host may
+        // already be sending to, an old active still draining.
+        const int fds[3] = {socket_fd_, standby_.fd, draining_fd_};
         fd_set read_fds;
         FD_ZERO(&read_fds);
-        FD_SET(static_cast<unsigned int>(socket_fd_), &read_fds);
+        int max_fd = -1;
+        for (int fd : fds) {
+            if (fd < 0) continue;
+            FD_SET(static_cast<unsigned int>(fd), &read_fds);
+            max_fd = std::max(max_fd, fd);
+        }
 
         struct timeval tv;
         tv.tv_sec = 0;
         tv.tv_usec = 1000;  // 1ms
-
-        int sel = ::select(socket_fd_ + 1, &read_fds, nullptr, nullptr, &tv);
-        if (sel <= 0) {
-            continue;  // Timeout or error, check running_ flag
+        if (impair_) {
+            // Wake for the next held datagram if it falls due sooner
+            const uint64_t now_us = getTimestampUs();
+            const uint64_t due_us = impair_->nextDueUs();
+            if (due_us < now_us + 1000) {
+                tv.tv_usec = due_us > now_us ? static_cast<long>(due_us - now_us) : 0;
+            }
         }
 
-        // Receive datagram
-        int n = ::recv(socket_fd_, reinterpret_cast<char*>(recv_buf.data()),
-                       static_cast<int>(recv_buf.size()), 0);
-        if (n <= 0) {
-            if (n == 0) {
-                CS_LOG(WARN, "UdpReceiver: connection closed");
-                break;
+        int sel = ::select(max_fd + 1, &read_fds, nullptr, nullptr, &tv);
+
+        // Drain a batch, then decrypt and dispatch it as a unit
+        for (int fd : fds) {
+            if (sel > 0 && fd >= 0 && FD_ISSET(fd, &read_fds) && receiveBatch(fd) > 0) {
+                if (impair_ && fd == socket_fd_) {
+                    holdBatch();
+                } else {
+                    processBatch(fd);
+                }
             }
-            int err = cs_socket_error();
-#ifdef _WIN32
-            if (err == WSAEWOULDBLOCK || err == WSAECONNRESET) continue;
-#else
-            if (err == EAGAIN || err == EWOULDBLOCK) continue;
+        }
+        if (impair_) processImpaired();
+    }
+
+    CS_LOG(INFO, "UdpReceiver: receive loop exited");
+}
+
+// ---------------------------------------------------------------------------
+// setupBatchReceive -- enable GRO / URO and allocate the receive ring
+// ---------------------------------------------------------------------------
+
+void UdpReceiver::setupBatchReceive() {
+#if defined(__linux__)
+    int one = 1;
+    offload_enabled_ = ::setsockopt(socket_fd_, SOL_UDP, UDP_GRO, &one, sizeof(one)) == 0;
+#elif defined(_WIN32)
+    GUID guid = WSAID_WSARECVMSG;
+    LPFN_WSARECVMSG fn = nullptr;
+    DWORD bytes = 0;
+    if (::WSAIoctl(static_cast<SOCKET>(socket_fd_), SIO_GET_EXTENSION_FUNCTION_POINTER,
+                   &guid, sizeof(guid), &fn, sizeof(fn), &bytes, nullptr, nullptr) == 0) {
+        wsa_recvmsg_ = reinterpret_cast<void*>(fn);
+    }
+  #ifdef UDP_RECV_MAX_COALESCED_SIZE
+    DWORD max_coalesced = static_cast<DWORD>(MAX_DATAGRAM_SIZE - 1);
+    offload_enabled_ = wsa_recvmsg_ &&
+        ::setsockopt(static_cast<SOCKET>(socket_fd_), IPPROTO_UDP, UDP_RECV_MAX_COALESCED_SIZE,
+                     reinterpret_cast<const char*>(&max_coalesced), sizeof(max_coalesced)) == 0;
+  #endif
 #endif
-            CS_LOG(WARN, "UdpReceiver: recv error %d", err);
+
+    // Coalesced buffers can hold many datagrams, so slots must be large.
+    slot_size_ = offload_enabled_ ? MAX_DATAGRAM_SIZE : MAX_SEGMENT_SIZE;
+    ring_.assign(RECV_BATCH_SIZE * slot_size_, 0);
+    if (dtls_enabled_) {
+        plain_arena_.assign(ring_.size(), 0);   // Plaintext never exceeds ciphertext
+    }
+    views_.reserve(RECV_BATCH_SIZE);
+    payloads_.reserve(RECV_BATCH_SIZE);
+    arrivals_.reserve(RECV_BATCH_SIZE);
+
+    CS_LOG(INFO, "UdpReceiver: batch receive (batch=%zu, offload=%s)",
+           RECV_BATCH_SIZE, offload_enabled_ ? "on" : "off");
+}
+
+// ---------------------------------------------------------------------------
+// receiveBatch -- platform-specific batched receive
+// ---------------------------------------------------------------------------
+
+size_t UdpReceiver::receiveBatch(int fd) {
+    const size_t before = views_.size();
+
+#if defined(__linux__)
+    constexpr size_t kCtrlLen = CMSG_SPACE(sizeof(int));
+
+    mmsghdr msgs[RECV_BATCH_SIZE];
+    iovec   iovs[RECV_BATCH_SIZE];
+    alignas(cmsghdr) char ctrl[RECV_BATCH_SIZE][kCtrlLen];
+
+    std::memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < RECV_BATCH_SIZE; ++i) {
+        iovs[i].iov_base = ring_.data() + i * slot_size_;
+        iovs[i].iov_len  = slot_size_;
+
+        msghdr& mh = msgs[i].msg_hdr;
+        mh.msg_iov    = &iovs[i];
+        mh.msg_iovlen = 1;
+        if (offload_enabled_) {
+            mh.msg_control    = ctrl[i];
+            mh.msg_controllen = kCtrlLen;
+        }
+    }
+
+    int r = ::recvmmsg(fd, msgs, RECV_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+    if (r < 0) {
+        int err = errno;
+        if (err != EAGAIN && err != EWOULDBLOCK && err != EINTR) {
+            CS_LOG(WARN, "UdpReceiver: recvmmsg error %d", err);
+        }
+        return 0;
+    }
+
+    for (int m = 0; m < r; ++m) {
+        msghdr& mh = msgs[m].msg_hdr;
+        if (mh.msg_flags & MSG_TRUNC) continue;   // Larger than a slot
+
+        size_t seg_size = 0;
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+            if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+                int seg = 0;
+                std::memcpy(&seg, CMSG_DATA(cm), sizeof(seg));
+                seg_size = static_cast<size_t>(seg);
+            }
+        }
+        appendSegments(static_cast<uint8_t*>(iovs[m].iov_base), msgs[m].msg_len, seg_size);
+    }
+
+#elif defined(_WIN32)
+    auto recv_msg = reinterpret_cast<LPFN_WSARECVMSG>(wsa_recvmsg_);
+
+    // No recvmmsg on Windows: drain the socket until it would block.
+    for (size_t i = 0; i < RECV_BATCH_SIZE; ++i) {
+        uint8_t* slot = ring_.data() + i * slot_size_;
+
+        if (!recv_msg) {
+            int n = ::recv(fd, reinterpret_cast<char*>(slot),
+                           static_cast<int>(slot_size_), 0);
+            if (n <= 0) break;   // WSAEWOULDBLOCK, WSAECONNRESET, ...
+            appendSegments(slot, static_cast<size_t>(n), 0);
             continue;
         }
 
-        const uint8_t* payload = recv_buf.data();
-        size_t payload_len = static_cast<size_t>(n);
+        WSABUF buf;
+        buf.buf = reinterpret_cast<CHAR*>(slot);
+        buf.len = static_cast<ULONG>(slot_size_);
+
+        alignas(WSACMSGHDR) char ctrl[WSA_CMSG_SPACE(sizeof(DWORD))] = {};
+        WSAMSG msg = {};
+        msg.lpBuffers     = &buf;
+        msg.dwBufferCount = 1;
+        msg.Control.buf   = ctrl;
+        msg.Control.len   = static_cast<ULONG>(sizeof(ctrl));
+
+        DWORD bytes = 0;
+        if (recv_msg(static_cast<SOCKET>(fd), &msg, &bytes, nullptr, nullptr) != 0) {
+            break;   // WSAEWOULDBLOCK, WSAECONNRESET, ...
+        }
+        if (msg.dwFlags & MSG_TRUNC) continue;
+
+        size_t seg_size = 0;
+  #ifdef UDP_COALESCED_INFO
+        for (WSACMSGHDR* cm = WSA_CMSG_FIRSTHDR(&msg); cm; cm = WSA_CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level == IPPROTO_UDP && cm->cmsg_type == UDP_COALESCED_INFO) {
+                DWORD seg = 0;
+                std::memcpy(&seg, WSA_CMSG_DATA(cm), sizeof(seg));
+                seg_size = static_cast<size_t>(seg);
+            }
+        }
+  #endif
+        appendSegments(slot, static_cast<size_t>(bytes), seg_size);
+    }
+
+#else
+    for (size_t i = 0; i < RECV_BATCH_SIZE; ++i) {
+        uint8_t* slot = ring_.data() + i * slot_size_;
+        int n = ::recv(fd, reinterpret_cast<char*>(slot),
+                       static_cast<int>(slot_size_), 0);
+        if (n <= 0) break;
+        appendSegments(slot, static_cast<size_t>(n), 0);
+    }
+#endif
+
+    return views_.size() - before;
+}
+
+// ---------------------------------------------------------------------------
+// appendSegments -- split a GRO / URO buffer back into datagrams
+// ---------------------------------------------------------------------------
+
+void UdpReceiver::appendSegments(uint8_t* data, size_t len, size_t seg_size) {
+    if (len == 0) return;
+    if (seg_size == 0 || seg_size >= len) {
+        views_.push_back({data, len});
+        return;
+    }
+    // Every segment is |seg_size| bytes except possibly the last.
+    for (size_t off = 0; off < len; off += seg_size) {
+        views_.push_back({data + off, std::min(seg_size, len - off)});
+    }
+}
+
+// ---------------------------------------------------------------------------
+// processBatch -- decrypt, account and dispatch one receive batch
+// ---------------------------------------------------------------------------
 
-        // DTLS decrypt if enabled
-        if (dtls_enabled_) {
-            int decrypted = dtlsDecrypt(recv_buf.data(), static_cast<size_t>(n),
-                                         plain_buf.data(), plain_buf.size());
+void UdpReceiver::processBatch(int fd) {
+    cs::trace::Scope trace(cs::trace::Stage::PACKET_RECV, static_cast<uint32_t>(views_.size()));
+    payloads_.clear();
+    arrivals_.clear();
+    size_t arena_used = 0;
+    size_t bytes      = 0;
+
+    // One arrival time per batch: the whole batch came off the socket in
+    // a single syscall.
+    const uint64_t now_us = getTimestampUs();
+
+    // Decrypt everything first so the callbacks run back-to-back.
+    for (const RecvView& v : views_) {
+        if (media_cipher_.isReady() && MediaCipher::isSealed(v.data, v.len)) {
+            // Sealed media is opened in place
+            size_t plain_len = 0;
+            if (!media_cipher_.open(v.data, v.len, &plain_len)) {
+                continue;  // Forged, corrupted or replayed
+            }
+            if (arrival_cb_) {
+                PacketArrival a;
+                a.seq        = static_cast<uint16_t>(MediaCipher::packetCounter(v.data));
+                a.received   = true;
+                a.arrival_us = now_us;
+                arrivals_.push_back(a);
+            }
+            payloads_.push_back({v.data + MediaCipher::HEADER_LEN, plain_len});
+        } else if (dtls_enabled_) {
+            uint8_t* out = plain_arena_.data() + arena_used;
+            int decrypted = dtlsDecrypt(v.data, v.len, out, plain_arena_.size() - arena_used);
             if (decrypted <= 0) {
                 continue;  // Decrypt failed or handshake packet
             }
-            payload = plain_buf.data();
-            payload_len = static_cast<size_t>(decrypted);
+            arena_used += static_cast<size_t>(decrypted);
+            payloads_.push_back({out, static_cast<size_t>(decrypted)});
+        } else {
+            payloads_.push_back(v);
         }
+        bytes += payloads_.back().len;
+    }
+    views_.clear();
 
-        // Update stats
-        packets_received_.fetch_add(1);
-        bytes_received_.fetch_add(payload_len);
+    if (!arrivals_.empty()) {
+        arrival_cb_(arrivals_.data(), arrivals_.size());
+    }
 
-        // Identify and dispatch
-        if (payload_len > 0 && callback_) {
-            PacketType pkt_type = identifyPacket(payload, payload_len);
-            if (static_cast<uint8_t>(pkt_type) != 0) {
-                callback_(pkt_type, payload, payload_len);
+    // Update stats
+    packets_received_.fetch_add(payloads_.size());
+    bytes_received_.fetch_add(bytes);
+
+    // Identify and dispatch
+    for (const RecvView& p : payloads_) {
+        if (p.len == 0) continue;
+        if (recorder_) recorder_->record(RecordDirection::RECEIVED, p.data, p.len, now_us);
+        PacketType pkt_type = identifyPacket(p.data, p.len, wire_version_);
+        if (pkt_type == PacketType::PMTU_PROBE) {
+            answerPathProbe(fd, p.data, p.len);
+            continue;
+        }
+        if (pkt_type == PacketType::PATH_RESPONSE) {
+            onPathResponse(fd, p.data, p.len, now_us);
+            continue;
+        }
+        if (pkt_type == PacketType::PATH_CHALLENGE) {
+            answerPathChallenge(fd, p.data, p.len);
+            continue;
+        }
+        if (pkt_type == PacketType::PADDING) {
+            continue;   // Bandwidth probe: its arrival above is all it carries
+        }
+        if (pkt_type == PacketType::VIDEO || pkt_type == PacketType::FEC) {
+            // Media on the standby path: the host sends over both
+            if (fd == standby_.fd && !standby_.migrate_us) setSecondary(fd);
+            if (isDuplicate(pkt_type, p.data, p.len)) {
+                duplicates_dropped_.fetch_add(1, std::memory_order_relaxed);
+                continue;
             }
         }
+        if (static_cast<uint8_t>(pkt_type) != 0 && callback_) {
+            callback_(pkt_type, p.data, p.len);
+        }
     }
+}
 
-    CS_LOG(INFO, "UdpReceiver: receive loop exited");
+// ---------------------------------------------------------------------------
+// isDuplicate -- one copy of each video sequence number
+// ---------------------------------------------------------------------------
+
+bool UdpReceiver::isDuplicate(PacketType type, const uint8_t* data, size_t len) {
+    // Both headers are packed: the sequence follows the flags and codec
+    // bytes of a video header, and the type byte of an FEC one
+    const size_t at = type == PacketType::VIDEO ? 2 : 1;
+    if (len < at + 2) return false;
+    const auto seq = static_cast<uint16_t>((data[at] << 8) | data[at + 1]);
+
+    if (!seen_any_) {
+        seen_any_     = true;
+        seen_highest_ = seq;
+        seen_.fill(0);
+    }
+    const auto ahead = static_cast<int16_t>(seq - seen_highest_);
+    if (ahead > 0) {
+        // Forget the numbers that fall out of the window
+        if (static_cast<size_t>(ahead) >= DEDUP_WINDOW) {
+            seen_.fill(0);
+        } else {
+            for (uint16_t s = static_cast<uint16_t>(seen_highest_ + 1); s != seq; ++s) {
+                seen_[(s % DEDUP_WINDOW) / 64] &= ~(1ull << (s % 64));
+            }
+            seen_[(seq % DEDUP_WINDOW) / 64] &= ~(1ull << (seq % 64));
+        }
+        seen_highest_ = seq;
+    } else if (static_cast<size_t>(-ahead) >= DEDUP_WINDOW) {
+        return false;   // Too old to tell; the jitter buffer decides
+    }
+
+    uint64_t& word = seen_[(seq % DEDUP_WINDOW) / 64];
+    const uint64_t bit = 1ull << (seq % 64);
+    if (word & bit) return true;
+    word |= bit;
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// holdBatch / processImpaired -- route the active socket through impair_
+// ---------------------------------------------------------------------------
+
+void UdpReceiver::holdBatch() {
+    const uint64_t now_us = getTimestampUs();
+    for (const RecvView& v : views_) {
+        impair_->submit(v.data, v.len, now_us);
+    }
+    views_.clear();
+}
+
+void UdpReceiver::processImpaired() {
+    if (impair_->takeDue(getTimestampUs(), impaired_) == 0) return;
+
+    // At most RECV_BATCH_SIZE views at a time: plain_arena_ is sized for
+    // one receive batch.
+    for (size_t i = 0; i < impaired_.size();) {
+        const size_t end = std::min(impaired_.size(), i + RECV_BATCH_SIZE);
+        for (; i < end; ++i) {
+            views_.push_back({impaired_[i].buf.data(), impaired_[i].len});
+        }
+        processBatch(socket_fd_);
+    }
+    impaired_.clear();
+}
+
+// ---------------------------------------------------------------------------
+// answerPathProbe -- ack a host PMTU probe that arrived intact
+// ---------------------------------------------------------------------------
+
+void UdpReceiver::answerPathProbe(int fd, const uint8_t* data, size_t len) {
+    PathProbePacket probe;
+    if (!PathProbePacket::deserialize(data, len, probe)) return;
+
+    probe.type = static_cast<uint8_t>(PacketType::PMTU_ACK);
+    uint8_t ack[sizeof(PathProbePacket)];
+    probe.serializeTo(ack);
+    ::send(fd, reinterpret_cast<const char*>(ack), sizeof(ack), 0);
+}
+
+// ---------------------------------------------------------------------------
+// Path management -- consent freshness and migration (CS06)
+// ---------------------------------------------------------------------------
+
+bool UdpReceiver::migrateTo(int socket_fd) {
+    if (socket_fd < 0 || !running_.load() || !paths_enabled_.load()) return false;
+
+    const int replaced = pending_fd_.exchange(socket_fd);
+    if (replaced >= 0) cs_close_socket(replaced);
+    return true;
+}
+
+void UdpReceiver::prepareSocket(int fd) {
+    cs_set_nonblocking(fd);
+    if (recv_buffer_bytes_ > 0) {
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+                     reinterpret_cast<const char*>(&recv_buffer_bytes_),
+                     sizeof(recv_buffer_bytes_));
+    }
+    if (!offload_enabled_) return;
+#if defined(__linux__)
+    int one = 1;
+    ::setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one));
+#elif defined(_WIN32) && defined(UDP_RECV_MAX_COALESCED_SIZE)
+    DWORD max_coalesced = static_cast<DWORD>(MAX_DATAGRAM_SIZE - 1);
+    ::setsockopt(static_cast<SOCKET>(fd), IPPROTO_UDP, UDP_RECV_MAX_COALESCED_SIZE,
+                 reinterpret_cast<const char*>(&max_coalesced), sizeof(max_coalesced));
+#endif
+}
+
+void UdpReceiver::maintainPaths(uint64_t now_us) {
+    // A socket handed over by migrateTo() replaces any standby, and asks
+    // the host over from its first challenge.
+    const int handed = pending_fd_.exchange(-1);
+    if (handed >= 0) {
+        setSecondary(-1);
+        if (standby_.fd >= 0) cs_close_socket(standby_.fd);
+        prepareSocket(handed);
+        standby_ = Path();
+        standby_.fd         = handed;
+        standby_.opened_us  = now_us;
+        standby_.migrate_us = now_us;
+        CS_LOG(INFO, "UdpReceiver: moving the session to fd=%d", handed);
+    }
+
+    // Keep a standby path through another interface
+    if (standby_.fd < 0 && standby_fn_ && now_us - last_scan_us_ >= STANDBY_SCAN_INTERVAL_US) {
+        last_scan_us_ = now_us;
+        const int fd = standby_fn_(socket_fd_);
+        if (fd >= 0) {
+            prepareSocket(fd);
+            standby_ = Path();
+            standby_.fd        = fd;
+            standby_.opened_us = now_us;
+            CS_LOG(INFO, "UdpReceiver: standby path on fd=%d", fd);
+        }
+    }
+
+    challengePath(active_, now_us, CONSENT_INTERVAL_US);
+    if (standby_.fd >= 0) {
+        challengePath(standby_, now_us,
+                      standby_.migrate_us ? MIGRATE_RETRY_US : CONSENT_INTERVAL_US);
+    }
+
+    // Consent of the active path.  A standby that is answering takes over;
+    // without one the owner is told, once, to find another path.
+    if (now_us - active_.answered_us > CONSENT_TIMEOUT_US && !standby_.migrate_us) {
+        if (standby_.fd >= 0 && standby_.answered_us != 0 &&
+            now_us - standby_.answered_us <= CONSENT_TIMEOUT_US) {
+            CS_LOG(WARN, "UdpReceiver: active path lost consent -- moving to standby fd=%d",
+                   standby_.fd);
+            standby_.migrate_us    = now_us;
+            standby_.challenged_us = 0;   // Ask at once
+            challengePath(standby_, now_us, MIGRATE_RETRY_US);
+        } else if (!consent_lost_reported_) {
+            consent_lost_reported_ = true;
+            CS_LOG(WARN, "UdpReceiver: active path lost consent, no standby path");
+            if (path_cb_) path_cb_(-1);
+        }
+    }
+
+    // A host that does not answer on the new path keeps the old one
+    if (standby_.migrate_us && now_us - standby_.migrate_us > MIGRATE_TIMEOUT_US) {
+        CS_LOG(WARN, "UdpReceiver: no answer on fd=%d -- migration given up", standby_.fd);
+        setSecondary(-1);
+        cs_close_socket(standby_.fd);
+        standby_ = Path();
+        if (path_cb_) path_cb_(-1);
+    }
+
+    // A standby that stops answering, or never did (an interface with no
+    // route to the host), makes room for the next one
+    if (standby_.fd >= 0 && !standby_.migrate_us &&
+        now_us - std::max(standby_.answered_us, standby_.opened_us) > CONSENT_TIMEOUT_US) {
+        setSecondary(-1);
+        cs_close_socket(standby_.fd);
+        standby_ = Path();
+    }
+
+    if (draining_fd_ >= 0 && now_us >= drain_until_us_) {
+        cs_close_socket(draining_fd_);
+        draining_fd_ = -1;
+    }
+}
+
+void UdpReceiver::challengePath(Path& path, uint64_t now_us, uint64_t interval_us) {
+    if (now_us - path.challenged_us < interval_us) return;
+    path.challenged_us = now_us;
+    path.nonce         = ++next_nonce_;
+
+    PathChallengePacket challenge{};
+    challenge.type  = static_cast<uint8_t>(PacketType::PATH_CHALLENGE);
+    challenge.flags = path.migrate_us ? PathChallengePacket::FLAG_MIGRATE : 0;
+    challenge.nonce = path.nonce;
+
+    uint8_t sealed[sizeof(PathChallengePacket) + MediaCipher::OVERHEAD];
+    challenge.serializeTo(sealed + MediaCipher::HEADER_LEN);
+    const size_t sealed_len = media_cipher_.seal(sealed, sizeof(PathChallengePacket));
+    if (sealed_len > 0) {
+        ::send(path.fd, reinterpret_cast<const char*>(sealed), static_cast<int>(sealed_len), 0);
+    }
+}
+
+void UdpReceiver::answerPathChallenge(int fd, const uint8_t* data, size_t len) {
+    // The host validating the address this socket sends from, before it
+    // moves the stream there
+    PathChallengePacket challenge;
+    if (!paths_enabled_.load() || !PathChallengePacket::deserialize(data, len, challenge)) return;
+
+    challenge.type = static_cast<uint8_t>(PacketType::PATH_RESPONSE);
+    uint8_t sealed[sizeof(PathChallengePacket) + MediaCipher::OVERHEAD];
+    challenge.serializeTo(sealed + MediaCipher::HEADER_LEN);
+    const size_t sealed_len = media_cipher_.seal(sealed, sizeof(PathChallengePacket));
+    if (sealed_len > 0) {
+        ::send(fd, reinterpret_cast<const char*>(sealed), static_cast<int>(sealed_len), 0);
+    }
+}
+
+void UdpReceiver::onPathResponse(int fd, const uint8_t* data, size_t len, uint64_t now_us) {
+    PathChallengePacket response;
+    if (!PathChallengePacket::deserialize(data, len, response)) return;
+
+    Path* path = fd == active_.fd ? &active_ : fd == standby_.fd ? &standby_ : nullptr;
+    if (!path) return;
+
+    // Any recent challenge counts: a migration retries faster than an RTT
+    if (path->nonce - response.nonce >= MAX_OUTSTANDING_CHALLENGES) return;
+    path->answered_us = now_us;
+
+    if (path == &active_) {
+        consent_lost_reported_ = false;
+    } else if (standby_.migrate_us && response.migrate()) {
+        switchToStandby(now_us);
+    }
+}
+
+void UdpReceiver::switchToStandby(uint64_t now_us) {
+    setSecondary(-1);
+    if (draining_fd_ >= 0) cs_close_socket(draining_fd_);
+    draining_fd_    = active_.fd;
+    drain_until_us_ = now_us + DRAIN_TIME_US;
+
+    active_ = standby_;
+    active_.migrate_us = 0;
+    standby_ = Path();
+    socket_fd_ = active_.fd;
+    consent_lost_reported_ = false;
+    path_migrations_.fetch_add(1);
+
+    CS_LOG(INFO, "UdpReceiver: session moved to fd=%d", socket_fd_);
+    if (path_cb_) path_cb_(socket_fd_);
+}
+
+void UdpReceiver::setSecondary(int fd) {
+    if (fd == secondary_fd_) return;
+    secondary_fd_ = fd;
+    if (fd >= 0) CS_LOG(INFO, "UdpReceiver: host sending on standby fd=%d too", fd);
+    if (secondary_cb_) secondary_cb_(fd);
+}
+
+void UdpReceiver::closePaths() {
+    paths_enabled_.store(false);
+    const int handed = pending_fd_.exchange(-1);
+    if (handed >= 0) cs_close_socket(handed);
+    setSecondary(-1);
+    if (standby_.fd >= 0) cs_close_socket(standby_.fd);
+    if (draining_fd_ >= 0) cs_close_socket(draining_fd_);
+    standby_ = Path();
+    draining_fd_ = -1;
 }
 
 // ---------------------------------------------------------------------------
@@ -279,12 +913,17 @@ bool UdpReceiver::performDtlsHandshake() {
         }
 
         if (ret == 1) {
-            // Handshake complete
+            // Handshake complete; a later connection to the same host
+            // identity resumes from here
+            const bool resumed = SSL_session_reused(ssl_) == 1;
+            keepResumableSession(dtls_fingerprint_, SSL_get1_session(ssl_));
+            if (resumed) CS_LOG(INFO, "UdpReceiver: DTLS session resumed");
             return true;
         }
 
         if (ssl_err == SSL_ERROR_WANT_READ) {
-            // Need to read from network
+            // Need to read from network, for no longer than the retransmit
+            // timer: through memory BIOs OpenSSL does not see it expire
             fd_set read_fds;
             FD_ZERO(&read_fds);
             FD_SET(static_cast<unsigned int>(socket_fd_), &read_fds);
@@ -292,6 +931,10 @@ bool UdpReceiver::performDtlsHandshake() {
             struct timeval tv;
             tv.tv_sec = 1;
             tv.tv_usec = 0;
+            struct timeval timer;
+            if (DTLSv1_get_timeout(ssl_, &timer) == 1 && timer.tv_sec < tv.tv_sec) {
+                tv = timer;
+            }
 
             int sel = ::select(socket_fd_ + 1, &read_fds, nullptr, nullptr, &tv);
             if (sel > 0) {
@@ -300,6 +943,8 @@ bool UdpReceiver::performDtlsHandshake() {
                 if (n > 0) {
                     BIO_write(rbio_, recv_buf.data(), n);
                 }
+            } else if (sel == 0) {
+                DTLSv1_handle_timeout(ssl_);   // Resend the last flight
             }
             continue;
         }
@@ -387,11 +1032,12 @@ bool UdpReceiver::dtlsEncryptAndSend(const uint8_t* plaintext, size_t len) {
 }
 
 // ---------------------------------------------------------------------------
-// exchangeProtocolVersion -- verify CS01 tag after DTLS handshake
+// exchangeProtocolVersion -- negotiate the wire version after DTLS handshake
 // ---------------------------------------------------------------------------
 
 bool UdpReceiver::exchangeProtocolVersion() {
-    // Host sends CS01 first, viewer receives and verifies, then sends CS01 back.
+    // Host sends the newest tag it speaks first; the viewer answers with the
+    // newest version both sides support, which then applies to the session.
     std::vector<uint8_t> recv_buf(MAX_DATAGRAM_SIZE);
     uint8_t plain_buf[64];
 
@@ -416,17 +1062,22 @@ bool UdpReceiver::exchangeProtocolVersion() {
         // Decrypt the version tag
         int decrypted = dtlsDecrypt(recv_buf.data(), static_cast<size_t>(n),
                                      plain_buf, sizeof(plain_buf));
-        if (decrypted == static_cast<int>(PROTOCOL_VERSION_TAG_LEN) &&
-            std::memcmp(plain_buf, PROTOCOL_VERSION_TAG, PROTOCOL_VERSION_TAG_LEN) == 0) {
-            CS_LOG(INFO, "UdpReceiver: received protocol version CS01 from host");
-
-            // Send our version tag back
-            if (!dtlsEncryptAndSend(PROTOCOL_VERSION_TAG, PROTOCOL_VERSION_TAG_LEN)) {
+        uint8_t host_version = decrypted > 0
+            ? parseProtocolVersionTag(plain_buf, static_cast<size_t>(decrypted))
+            : 0;
+        if (host_version > 0) {
+            uint8_t version = std::min(host_version, PROTOCOL_WIRE_VERSION_MAX);
+            CS_LOG(INFO, "UdpReceiver: received protocol version CS0%u from host",
+                   host_version);
+
+            // Answer with the version we will use
+            if (!dtlsEncryptAndSend(protocolVersionTag(version), PROTOCOL_VERSION_TAG_LEN)) {
                 CS_LOG(ERR, "UdpReceiver: failed to send protocol version response");
                 return false;
             }
 
-            CS_LOG(INFO, "UdpReceiver: protocol version verified: CS01");
+            wire_version_ = version;
+            CS_LOG(INFO, "UdpReceiver: protocol version negotiated: CS0%u", version);
             return true;
         }
 
@@ -437,4 +1088,34 @@ bool UdpReceiver::exchangeProtocolVersion() {
     return false;
 }
 
+uint8_t UdpReceiver::handshakeWireVersion() const {
+    if (!ssl_) return 0;
+    const unsigned char* proto = nullptr;
+    unsigned int len = 0;
+    SSL_get0_alpn_selected(ssl_, &proto, &len);
+    if (!proto) return 0;
+    const uint8_t version = parseProtocolVersionTag(proto, len);
+    return version <= PROTOCOL_WIRE_VERSION_MAX ? version : 0;
+}
+
+// ---------------------------------------------------------------------------
+// deriveMediaKeys -- RFC 5705 exporter -> MediaCipher
+// ---------------------------------------------------------------------------
+
+bool UdpReceiver::deriveMediaKeys() {
+    if (!ssl_) return false;
+
+    uint8_t km[MediaCipher::KEYING_MATERIAL_LEN];
+    if (SSL_export_keying_material(ssl_, km, sizeof(km), MediaCipher::EXPORTER_LABEL,
+                                   std::strlen(MediaCipher::EXPORTER_LABEL),
+                                   nullptr, 0, 0) != 1) {
+        CS_LOG(ERR, "UdpReceiver: SSL_export_keying_material failed");
+        return false;
+    }
+
+    bool ok = media_cipher_.initialize(km, sizeof(km), false);
+    OPENSSL_cleanse(km, sizeof(km));
+    return ok;
+}
+
 } // namespace cs
@@ -2,23 +2,52 @@
 // udp_receiver.h -- UDP packet receiver with DTLS decryption
 //
 // Runs a background receive loop that:
-//   1. Reads datagrams from the connected UDP socket
-//   2. Decrypts via DTLS (OpenSSL)
+//   1. Reads up to RECV_BATCH_SIZE datagrams per wakeup into a
+//      preallocated ring (recvmmsg + UDP GRO on Linux, WSARecvMsg + URO
+//      on Windows), splitting coalesced buffers back into datagrams
+//   2. Decrypts the whole batch (AEAD media cipher or DTLS)
 //   3. Identifies packet type from the header
-//   4. Dispatches to registered callbacks
+//   4. Dispatches the batch to registered callbacks
 //
 // The socket is assumed to already be connected (by the ICE layer).
+//
+// With a CS06 host the receiver also looks after the path (RFC 7675
+// consent freshness, make-before-break migration): every CONSENT_INTERVAL_US
+// it sends a sealed path challenge on the active socket and on a standby
+// one, if it holds one, connected through another interface.  When the
+// active path goes unanswered for CONSENT_TIMEOUT_US and the standby is
+// answering, a MIGRATE challenge moves the host over and the receiver
+// switches once the host answers there, still reading the old socket for
+// DRAIN_TIME_US: the host keeps sending on the old path until the new one
+// has answered a challenge of its own.  DTLS, media keys and every sequence space carry over, so
+// the stream goes on without a handshake or a keyframe.
+//
+// A host with a multipath policy also sends some packets over an answering
+// standby path.  Video and FEC carry the video sequence, so the later copy
+// from either socket is dropped before dispatch; setSecondaryCallback()
+// lets input go out over the standby path too.
+//
+// For QoS testing, setImpairment() holds what arrives on the active socket
+// in a NetworkImpairment (cs/transport/network_impairment.h) after the
+// handshake, and processes it when the emulator lets it through.
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <functional>
 #include <memory>
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <string>
+#include <vector>
 
 #include <cs/transport/packet.h>
+#include <cs/transport/media_cipher.h>
+#include <cs/transport/network_impairment.h>
+#include <cs/transport/packet_recorder.h>
+#include <cs/qos/transport_feedback.h>
 
 // Forward-declare OpenSSL types
 typedef struct ssl_st SSL;
@@ -31,6 +60,10 @@ namespace cs {
 /// Parameters: packet type, pointer to payload after header, length.
 using PacketCallback = std::function<void(PacketType type, const uint8_t* data, size_t len)>;
 
+/// Callback invoked once per receive batch with the transport-wide sequence
+/// number and arrival time of every sealed packet that opened successfully.
+using ArrivalCallback = std::function<void(const PacketArrival* arrivals, size_t count)>;
+
 class UdpReceiver {
 public:
     UdpReceiver();
@@ -40,27 +73,159 @@ public:
     UdpReceiver(const UdpReceiver&) = delete;
     UdpReceiver& operator=(const UdpReceiver&) = delete;
 
+    /// Datagrams read per receive syscall (and decrypted/dispatched together).
+    static constexpr size_t RECV_BATCH_SIZE          = 32;
+
+    /// Default socket receive buffer: ~300 ms of a 100 Mbps stream, enough
+    /// to absorb a keyframe burst while the loop is dispatching.
+    static constexpr int    DEFAULT_RECV_BUFFER_BYTES = 4 * 1024 * 1024;
+
     /// Initialize with a pre-connected socket and optional DTLS context.
     /// If dtls_fingerprint is empty, DTLS is disabled (plaintext mode for testing).
-    bool initialize(int socket_fd, const std::string& dtls_fingerprint = "");
+    /// |recv_buffer_bytes| sizes SO_RCVBUF; 0 keeps the OS default.
+    bool initialize(int socket_fd, const std::string& dtls_fingerprint = "",
+                    int recv_buffer_bytes = DEFAULT_RECV_BUFFER_BYTES);
 
     /// Start the receive loop on a background thread.
     bool start(PacketCallback cb);
 
+    /// Report per-packet arrivals (for transport-wide congestion feedback).
+    /// Must be set before start().
+    void setArrivalCallback(ArrivalCallback cb) { arrival_cb_ = std::move(cb); }
+
+    /// Emulate a bad network on ingress (see network_impairment.h): after
+    /// the handshake, datagrams from the active socket are lost, delayed,
+    /// reordered or rate-limited before they are processed.  Must be called
+    /// before start().
+    void setImpairment(const ImpairmentConfig& config);
+
+    /// Record every datagram received, after decryption, to |recorder|
+    /// (see packet_recorder.h), which must outlive the receiver.  Must be
+    /// called before start().
+    void setRecorder(PacketRecorder* recorder) { recorder_ = recorder; }
+
     /// Stop the receive loop and join the thread.
     void stop();
 
     /// Returns true if the receiver is running.
     bool isRunning() const;
 
+    /// Wire version negotiated with the host (1 until the exchange completes).
+    uint8_t getWireVersion() const { return wire_version_; }
+
+    // --- Path management (CS06) ---
+
+    /// Called (receive thread) with the socket the session now runs on
+    /// after a migration, or with -1 when the active path lost consent and
+    /// no standby could take over, or a migrateTo() went unanswered.  Must
+    /// be set before start().
+    using PathCallback = std::function<void(int socket_fd)>;
+    void setPathCallback(PathCallback cb) { path_cb_ = std::move(cb); }
+
+    /// Returns a socket connected to the host through another interface
+    /// than |active_fd|'s, or -1.  Asked (receive thread) every
+    /// STANDBY_SCAN_INTERVAL_US while there is no standby path.  Must be set
+    /// before start().
+    using StandbyFunc = std::function<int(int active_fd)>;
+    void setStandbyFunc(StandbyFunc fn) { standby_fn_ = std::move(fn); }
+
+    /// Called (receive thread) with the standby socket once the host sends
+    /// media on it (a multipath policy), and with -1 before it is closed or
+    /// becomes the active one.  Must be set before start().
+    void setSecondaryCallback(PathCallback cb) { secondary_cb_ = std::move(cb); }
+
+    /// Move the session to |socket_fd|, connected to the host's session
+    /// address, without a new handshake: the host is asked over with a
+    /// MIGRATE challenge and the receiver switches when it answers there.
+    /// Thread-safe.  The receiver closes every socket it is handed except
+    /// the one that ends up active; the caller owns that one (as it owns
+    /// the socket given to initialize() until a migration away from it).
+    /// False if the session cannot migrate (not running, or no media keys
+    /// or a host before CS06); the caller then reconnects from scratch.
+    bool migrateTo(int socket_fd);
+
+    /// Times the session moved to another path.
+    uint64_t getPathMigrations() const { return path_migrations_.load(); }
+
     // --- Statistics ---
     uint64_t getPacketsReceived() const;
     uint64_t getBytesReceived() const;
+    uint64_t getMediaAuthFailures() const { return media_cipher_.getAuthFailures(); }
+    uint64_t getMediaReplayDrops()  const { return media_cipher_.getReplayDrops(); }
+    uint64_t getDuplicatePackets()  const { return duplicates_dropped_.load(); }
 
 private:
+    /// One datagram (or one segment of a coalesced buffer) in the ring.
+    struct RecvView {
+        uint8_t* data = nullptr;
+        size_t   len  = 0;
+    };
+
     /// Main receive loop running on the background thread.
     void receiveLoop();
 
+    /// Enable receive offload where available and allocate the ring.
+    void setupBatchReceive();
+
+    /// Read up to RECV_BATCH_SIZE datagrams from |fd| into ring_, appending
+    /// one view per datagram to views_.  Returns the number of views added.
+    size_t receiveBatch(int fd);
+
+    /// Append the views for one received buffer, splitting it at |seg_size|
+    /// if the kernel coalesced several datagrams (0 = not coalesced).
+    void appendSegments(uint8_t* data, size_t len, size_t seg_size);
+
+    /// Decrypt and dispatch every view in views_ (read from |fd|), then
+    /// clear it.
+    void processBatch(int fd);
+
+    /// True if video or FEC packet |data| was seen already (the other
+    /// path's copy); otherwise marks its sequence number seen.
+    bool isDuplicate(PacketType type, const uint8_t* data, size_t len);
+
+    /// Hand views_ to impair_ instead of processing them, then clear it.
+    void holdBatch();
+
+    /// Process the datagrams impair_ has let through by now, in batches.
+    void processImpaired();
+
+    /// Reply to a host path MTU probe (PacketType::PMTU_PROBE) on |fd|.
+    void answerPathProbe(int fd, const uint8_t* data, size_t len);
+
+    /// One path the session can run on (receive thread).
+    struct Path {
+        int      fd            = -1;
+        uint64_t opened_us     = 0;
+        uint64_t nonce         = 0;     // Of the last challenge sent
+        uint64_t challenged_us = 0;     // When it was sent
+        uint64_t answered_us   = 0;     // Last response (0 = none yet)
+        uint64_t migrate_us    = 0;     // Challenges ask the host over since (0 = not)
+    };
+
+    /// Non-blocking, receive buffer and offload as on the first socket.
+    void prepareSocket(int fd);
+
+    /// Challenge the paths, watch consent, start and give up migrations.
+    void maintainPaths(uint64_t now_us);
+
+    /// Send a sealed path challenge on |path| if |interval_us| has passed.
+    void challengePath(Path& path, uint64_t now_us, uint64_t interval_us);
+
+    /// Answer a host path challenge that arrived on |fd|, on |fd|.
+    void answerPathChallenge(int fd, const uint8_t* data, size_t len);
+
+    /// A path response arrived on |fd|.
+    void onPathResponse(int fd, const uint8_t* data, size_t len, uint64_t now_us);
+
+    /// Make the standby path the active one.
+    void switchToStandby(uint64_t now_us);
+
+    /// Tell secondary_cb_ the standby socket it may send on is now |fd|.
+    void setSecondary(int fd);
+
+    /// Close the sockets the receiver owns (stop()).
+    void closePaths();
+
     /// Perform DTLS handshake (client side).
     bool performDtlsHandshake();
 
@@ -71,11 +236,44 @@ private:
     /// Encrypt and send data over the DTLS connection.
     bool dtlsEncryptAndSend(const uint8_t* plaintext, size_t len);
 
-    /// Exchange protocol version tag (CS01) with the host after DTLS handshake.
+    /// Negotiate the wire version (CS01 / CS02 tags) with the host after the
+    /// DTLS handshake, if the handshake did not settle it.
     bool exchangeProtocolVersion();
 
+    /// Wire version the host picked from our ALPN offer in the handshake,
+    /// or 0 if it predates that.
+    uint8_t handshakeWireVersion() const;
+
+    /// Export the media AEAD keys from the completed DTLS session.
+    bool deriveMediaKeys();
+
     // Socket
     int socket_fd_ = -1;
+    int recv_buffer_bytes_ = 0;
+
+    // Paths (receive thread, but for the hand-over slot)
+    std::atomic<bool> paths_enabled_{false};
+    Path              active_;
+    Path              standby_;
+    int               draining_fd_    = -1;   // Old active, read until drain_until_us_
+    uint64_t          drain_until_us_ = 0;
+    uint64_t          next_nonce_     = 0;
+    uint64_t          last_scan_us_   = 0;
+    bool              consent_lost_reported_ = false;
+    std::atomic<int>  pending_fd_{-1};        // From migrateTo()
+    std::atomic<uint64_t> path_migrations_{0};
+    PathCallback      path_cb_;
+    PathCallback      secondary_cb_;
+    int               secondary_fd_   = -1;   // Last handed to secondary_cb_
+    StandbyFunc       standby_fn_;
+
+    static constexpr uint64_t CONSENT_INTERVAL_US      = 1'000'000;
+    static constexpr uint64_t CONSENT_TIMEOUT_US       = 3'000'000;   // Unanswered for this long: lost
+    static constexpr uint64_t MIGRATE_RETRY_US         = 100'000;
+    static constexpr uint64_t MIGRATE_TIMEOUT_US       = 3'000'000;
+    static constexpr uint64_t DRAIN_TIME_US            = 1'000'000;
+    static constexpr uint64_t STANDBY_SCAN_INTERVAL_US = 5'000'000;
+    static constexpr uint64_t MAX_OUTSTANDING_CHALLENGES = 64;   // Answers accepted to this far back
 
     // DTLS
     SSL_CTX* ssl_ctx_ = nullptr;
@@ -87,8 +285,39 @@ private:
     ::BIO* rbio_ = nullptr;  // read BIO: network -> OpenSSL
     ::BIO* wbio_ = nullptr;  // write BIO: OpenSSL -> network
 
-    // Callback
-    PacketCallback callback_;
+    // AEAD data plane for media, keyed from the DTLS session
+    MediaCipher media_cipher_;
+
+    // Video header version negotiated by exchangeProtocolVersion()
+    uint8_t wire_version_ = 1;
+
+    // Batched receive ring (receive thread only)
+    std::vector<uint8_t>  ring_;           // RECV_BATCH_SIZE slots of slot_size_
+    size_t                slot_size_ = 0;
+    std::vector<uint8_t>  plain_arena_;    // DTLS plaintext for one batch
+    std::vector<RecvView> views_;          // Received datagrams
+    std::vector<RecvView> payloads_;       // Decrypted packets to dispatch
+    std::vector<PacketArrival> arrivals_;  // Sealed arrivals in this batch
+    bool                  offload_enabled_ = false;   // UDP GRO / URO
+
+    // Optional network emulation (setImpairment, receive thread after start)
+    std::unique_ptr<NetworkImpairment>     impair_;
+    std::vector<NetworkImpairment::Datagram> impaired_;   // Due this pass
+
+    // Video sequence numbers seen (receive thread): a bit per number in
+    // the DEDUP_WINDOW below seen_highest_
+    static constexpr size_t DEDUP_WINDOW = 1024;
+    std::array<uint64_t, DEDUP_WINDOW / 64> seen_{};
+    uint16_t              seen_highest_ = 0;
+    bool                  seen_any_     = false;
+    std::atomic<uint64_t> duplicates_dropped_{0};
+
+    PacketRecorder*       recorder_ = nullptr;        // Session recording (not owned)
+    void*                 wsa_recvmsg_ = nullptr;     // LPFN_WSARECVMSG (Windows)
+
+    // Callbacks
+    PacketCallback  callback_;
+    ArrivalCallback arrival_cb_;
 
     // Thread
     std::thread recv_thread_;
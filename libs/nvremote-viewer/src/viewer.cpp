@@ -4,31 +4,29 @@
 // Orchestrates the receive -> decode -> render pipeline:
 //   1. Receive thread: UDP -> DTLS decrypt -> jitter buffer + NACK + stats
 //   2. Decode thread:  jitter buffer -> decoder -> render queue
-//   3. Render thread:  render queue -> D3D11 present
+//   3. Render thread:  render queue -> D3D11 / Metal present at vblank
 //   4. Audio thread:   audio packets -> Opus decode -> WASAPI playback
+// Each of the host's extra displays has its own decode and render
+// threads (see display_stream.h).
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "viewer.h"
+#include "display_stream.h"
 
 #include "decode/decoder_interface.h"
-#ifdef _WIN32
-#include "decode/nvdec_decoder.h"
-#include "decode/d3d11va_decoder.h"
-#elif defined(__APPLE__)
-#include "decode/videotoolbox_decoder.h"
-#endif
 #include "render/renderer_interface.h"
-#ifdef _WIN32
-#include "render/d3d11_renderer.h"
-#elif defined(__APPLE__)
-#include "render/metal_renderer.h"
-#endif
+#include "render/frame_queue.h"
+#include "render/cursor_cache.h"
 #include "transport/udp_receiver.h"
 #include "transport/jitter_buffer.h"
 #include "transport/nack_sender.h"
+#include "transport/fec_decoder.h"
 #include "qos/stats_reporter.h"
+#include "qos/stats_ring.h"
 #include "audio/opus_decoder.h"
 #include "audio/audio_playback_interface.h"
+#include "audio/audio_jitter_buffer.h"
+#include "audio/av_sync.h"
 #ifdef _WIN32
 #include "audio/wasapi_playback.h"
 #elif defined(__APPLE__)
@@ -36,10 +34,15 @@
 #endif
 #include "input/input_capture.h"
 #include "input/input_sender.h"
+#include "input/controller_capture.h"
 #include "input/clipboard_sync.h"
 
+#include <cs/buffer_pool.h>
 #include <cs/common.h>
+#include <cs/thread_policy.h>
+#include <cs/trace.h>
 #include <cs/transport/packet.h>
+#include <cs/transport/packet_recorder.h>
 
 #include <chrono>
 #include <algorithm>
@@ -90,35 +93,77 @@ bool Viewer::start(const ViewerConfig& config) {
     config_ = config;
     quality_ = config.quality;
     stopping_.store(false);
-
-    // Initialize subsystems in dependency order
-    if (!initRenderer()) {
-        CS_LOG(ERR, "Failed to initialize renderer");
-        stop();
-        return false;
-    }
-
-    if (!initDecoder()) {
-        CS_LOG(ERR, "Failed to initialize decoder");
-        stop();
-        return false;
+    first_packet_latency_.reset();
+    frame_complete_latency_.reset();
+    glass_to_glass_latency_.reset();
+    input_to_photon_latency_.reset();
+
+    // Priority and CPUs of the threads started below
+    ThreadPolicies policies = defaultThreadPolicies();
+    std::string policy_error;
+    if (!parseThreadPolicies(config.threads, policies, &policy_error)) {
+        CS_LOG(WARN, "Ignoring thread policy spec: %s", policy_error.c_str());
     }
-
+    setThreadPolicies(policies);
+
+    start_time_ = std::chrono::steady_clock::now();
+    first_frame_us_.store(0);
+    StartTiming timing;
+    auto msSince = [](std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - t).count();
+    };
+
+    // Independent subsystems come up at once: the renderer and then the
+    // decoder on its device, the transport through its DTLS handshake,
+    // and audio.  None of them uses another's state until the packet
+    // flow starts below.  Audio stays on this thread, which keeps the
+    // COM apartment it joins.
+    bool video_ok = false;
+    std::thread video_init([&] {
+        auto t = std::chrono::steady_clock::now();
+        video_ok = initRenderer();
+        timing.renderer_ms = msSince(t);
+        if (!video_ok) {
+            CS_LOG(ERR, "Failed to initialize renderer");
+            return;
+        }
+        t = std::chrono::steady_clock::now();
+        video_ok = initDecoder();
+        timing.decoder_ms = msSince(t);
+        if (!video_ok) CS_LOG(ERR, "Failed to initialize decoder");
+    });
+
+    bool transport_ok = false;
+    std::thread transport_init([&] {
+        const auto t = std::chrono::steady_clock::now();
+        transport_ok = initTransport();
+        timing.transport_ms = msSince(t);
+        if (!transport_ok) CS_LOG(ERR, "Failed to initialize transport");
+    });
+
+    auto t = std::chrono::steady_clock::now();
     if (!initAudio()) {
         CS_LOG(WARN, "Failed to initialize audio (continuing without audio)");
         // Audio failure is non-fatal
     }
+    timing.audio_ms = msSince(t);
 
-    if (!initTransport()) {
-        CS_LOG(ERR, "Failed to initialize transport");
+    video_init.join();
+    transport_init.join();
+    if (!video_ok || !transport_ok || !startTransport()) {
         stop();
         return false;
     }
 
+    t = std::chrono::steady_clock::now();
     if (!initInput()) {
         CS_LOG(WARN, "Failed to initialize input (continuing without input)");
         // Input failure is non-fatal
     }
+    timing.input_ms = msSince(t);
+
+    initDisplays();
 
     // Set initial stats
     {
@@ -128,6 +173,8 @@ bool Viewer::start(const ViewerConfig& config) {
         stats_.resolution_height = config.height;
         stats_.connection_type = "p2p";
     }
+    decoded_width_  = config.width;
+    decoded_height_ = config.height;
 
     running_.store(true);
     conn_state_.store(ConnectionState::CONNECTED);
@@ -142,7 +189,15 @@ bool Viewer::start(const ViewerConfig& config) {
         audio_thread_ = std::thread(&Viewer::audioThreadFunc, this);
     }
 
-    CS_LOG(INFO, "Viewer session started successfully");
+    timing.total_ms = msSince(start_time_);
+    {
+        std::lock_guard<std::mutex> slock(stats_mutex_);
+        start_timing_ = timing;
+    }
+    CS_LOG(INFO, "Viewer session started in %.1f ms (renderer %.1f, decoder %.1f, "
+           "transport %.1f, audio %.1f, input %.1f)",
+           timing.total_ms, timing.renderer_ms, timing.decoder_ms,
+           timing.transport_ms, timing.audio_ms, timing.input_ms);
     return true;
 }
 
@@ -160,15 +215,19 @@ void Viewer::stop() {
     running_.store(false);
 
     // Wake up waiting threads
-    decode_queue_cv_.notify_all();
-    render_queue_cv_.notify_all();
-    audio_queue_cv_.notify_all();
+    if (jitter_buffer_) jitter_buffer_->interrupt();
+    if (render_queue_) render_queue_->interrupt();
+    audio_queue_.wake();
 
     // Stop subsystems (order matters: transport first to stop feeding data)
     if (receiver_) {
         receiver_->stop();
     }
 
+    for (auto& display : displays_) {
+        if (display) display->stop();
+    }
+
     if (nack_sender_) {
         nack_sender_->stop();
     }
@@ -186,21 +245,30 @@ void Viewer::stop() {
     // Release subsystems in reverse order
     if (clipboard_sync_) clipboard_sync_->stop();
     if (input_capture_) input_capture_->release();
+    if (controller_capture_) controller_capture_->stop();
     if (audio_playback_) audio_playback_->stop();
     if (renderer_) renderer_->release();
     if (decoder_) decoder_->release();
 
     // Reset unique_ptrs
+    displays_ = {};
     clipboard_sync_.reset();
+    cursor_cache_.reset();
+    controller_capture_.reset();
     input_sender_.reset();
     input_capture_.reset();
     audio_playback_.reset();
+    audio_jitter_.reset();
+    av_sync_.reset();
     opus_decoder_.reset();
     stats_reporter_.reset();
+    fec_decoder_.reset();
     nack_sender_.reset();
     jitter_buffer_.reset();
     receiver_.reset();
+    recorder_.reset();
     renderer_.reset();
+    render_queue_.reset();
     decoder_.reset();
 
     // Close P2P socket
@@ -237,17 +305,96 @@ ViewerStats Viewer::getStats() const {
         stats.fps = live.fps;
         stats.packet_loss = live.packet_loss;
         stats.jitter_ms = live.jitter_ms;
+        stats.jitter_p50_ms = live.jitter_p50_ms;
+        stats.jitter_p95_ms = live.jitter_p95_ms;
+        stats.jitter_p99_ms = live.jitter_p99_ms;
+        stats.frame_gap_p50_ms = live.frame_gap_p50_ms;
+        stats.frame_gap_p95_ms = live.frame_gap_p95_ms;
+        stats.frame_gap_p99_ms = live.frame_gap_p99_ms;
         stats.decode_time_ms = live.decode_time_ms;
+        stats.decode_time_p50_ms = live.decode_time_p50_ms;
+        stats.decode_time_p95_ms = live.decode_time_p95_ms;
+        stats.decode_time_p99_ms = live.decode_time_p99_ms;
         stats.render_time_ms = live.render_time_ms;
+        stats.render_time_p50_ms = live.render_time_p50_ms;
+        stats.render_time_p95_ms = live.render_time_p95_ms;
+        stats.render_time_p99_ms = live.render_time_p99_ms;
+        stats.present_latency_ms = live.present_latency_ms;
         stats.frames_decoded = live.frames_decoded;
         stats.frames_dropped = live.frames_dropped;
         stats.packets_received = live.packets_received;
         stats.bytes_received = live.bytes_received;
+        stats.fec_recovered = live.fec_recovered;
+        stats.fec_unrecoverable = live.fec_unrecoverable;
+        stats.rtt_ms = live.rtt_ms;
+    }
+    if (jitter_buffer_) {
+        stats.jitter_buffer_ms = jitter_buffer_->getPlayoutDepthMs();
+        stats.late_frames      = jitter_buffer_->getLateFrames();
+    }
+    if (render_queue_) {
+        stats.render_dropped = render_queue_->getDroppedFrames();
+    }
+    if (renderer_) {
+        stats.present_to_photon_ms = renderer_->getPresentToPhotonMs();
+        stats.upscaler = upscalerName(renderer_->getActiveUpscaler());
+    }
+    if (decoder_) {
+        const DecoderReconfigStats rs = decoder_->getReconfigStats();
+        stats.decoder_reconfigs       = rs.count;
+        stats.decoder_reconfig_ms     = rs.last_ms;
+        stats.decoder_reconfig_max_ms = rs.max_ms;
+    }
+    if (receiver_) {
+        stats.path_migrations = receiver_->getPathMigrations();
+        stats.duplicate_packets = receiver_->getDuplicatePackets();
     }
+    if (audio_playback_ && audio_playback_->isInitialized()) {
+        stats.audio_output_latency_ms = audio_playback_->getLatencyMs() +
+                                        audio_playback_->getEndpointLatencyMs();
+    }
+    if (audio_jitter_) {
+        const AudioJitterBuffer::Stats as = audio_jitter_->getStats();
+        stats.audio_buffer_ms     = as.target_ms;
+        stats.audio_fec_recovered = as.fec_recovered;
+        stats.audio_concealed     = as.concealed;
+        stats.audio_underruns     = as.underruns;
+    }
+    if (av_sync_) {
+        stats.av_offset_ms      = av_sync_->getOffsetMs();
+        stats.av_audio_delay_ms = av_sync_->getAudioDelayUs() / 1000;
+        stats.av_video_delay_ms = av_sync_->getVideoDelayUs() / 1000;
+    }
+    uint32_t clock_offset_us = 0, clock_error_us = 0;
+    if (stats_reporter_ && stats_reporter_->getHostClock(clock_offset_us, clock_error_us)) {
+        stats.clock_synced          = true;
+        stats.clock_error_ms        = clock_error_us / 1000.0;
+        stats.first_packet_p50_ms   = first_packet_latency_.percentileMs(0.50f);
+        stats.first_packet_p99_ms   = first_packet_latency_.percentileMs(0.99f);
+        stats.frame_complete_p50_ms = frame_complete_latency_.percentileMs(0.50f);
+        stats.frame_complete_p99_ms = frame_complete_latency_.percentileMs(0.99f);
+        stats.glass_to_glass_p50_ms = glass_to_glass_latency_.percentileMs(0.50f);
+        stats.glass_to_glass_p99_ms = glass_to_glass_latency_.percentileMs(0.99f);
+    }
+    // Viewer clock at both ends: needs no offset
+    stats.input_to_photon_p50_ms = input_to_photon_latency_.percentileMs(0.50f);
+    stats.input_to_photon_p99_ms = input_to_photon_latency_.percentileMs(0.99f);
+    if (const uint64_t first_us = first_frame_us_.load()) {
+        stats.first_frame_ms = first_us / 1000.0;
+    }
+    const BufferPool::Stats pool = BufferPool::shared().stats();
+    stats.pool_reserved_bytes   = pool.reserved_bytes;
+    stats.pool_high_water_bytes = pool.high_water_bytes;
+    stats.pool_system_allocs    = pool.system_allocs + pool.oversize_allocs;
 
     return stats;
 }
 
+StartTiming Viewer::getStartTiming() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return start_timing_;
+}
+
 // ---------------------------------------------------------------------------
 // setQuality
 // ---------------------------------------------------------------------------
@@ -256,20 +403,74 @@ void Viewer::setQuality(QualityPreset preset) {
     quality_ = preset;
 
     if (jitter_buffer_) {
-        switch (preset) {
+        configureJitterBuffer();
+    }
+    if (renderer_) {
+        configurePresentMode();
+    }
+
+    CS_LOG(INFO, "Quality preset set to %d", static_cast<int>(preset));
+}
+
+// ---------------------------------------------------------------------------
+// configureJitterBuffer
+// ---------------------------------------------------------------------------
+
+void Viewer::configureJitterBuffer() {
+    // Performance releases frames as soon as they are complete; the others
+    // hold back as much as the measured jitter calls for, within bounds.
+    switch (quality_) {
+        case QualityPreset::PERFORMANCE:
+            jitter_buffer_->setImmediateRelease(true);
+            jitter_buffer_->setDepthRangeMs(0, 10);
+            break;
+        case QualityPreset::BALANCED:
+            jitter_buffer_->setImmediateRelease(false);
+            jitter_buffer_->setDepthRangeMs(0, 40);
+            break;
+        case QualityPreset::QUALITY:
+            jitter_buffer_->setImmediateRelease(false);
+            jitter_buffer_->setDepthRangeMs(10, 100);
+            break;
+    }
+
+    // Lip sync: Performance never holds video back for audio, so audio
+    // follows the picture; the others may delay video a little, Quality
+    // most, before audio gives way.
+    if (av_sync_) {
+        switch (quality_) {
             case QualityPreset::PERFORMANCE:
-                jitter_buffer_->setTargetDepthMs(10);
+                av_sync_->setPolicy(kAvSyncMaxAudioDelayMs, 0);
                 break;
             case QualityPreset::BALANCED:
-                jitter_buffer_->setTargetDepthMs(20);
+                av_sync_->setPolicy(kAvSyncMaxAudioDelayMs, 20);
                 break;
             case QualityPreset::QUALITY:
-                jitter_buffer_->setTargetDepthMs(40);
+                av_sync_->setPolicy(kAvSyncMaxAudioDelayMs, 50);
                 break;
         }
     }
+}
 
-    CS_LOG(INFO, "Quality preset set to %d", static_cast<int>(preset));
+// ---------------------------------------------------------------------------
+// configurePresentMode
+// ---------------------------------------------------------------------------
+
+void Viewer::configurePresentMode() {
+    // Performance shows each frame the moment it is decoded, tearing and
+    // all; Balanced still tears, but only at the top of the screen; Quality
+    // never tears and pays up to a refresh for it.
+    switch (quality_) {
+        case QualityPreset::PERFORMANCE:
+            renderer_->setPresentMode(PresentMode::IMMEDIATE);
+            break;
+        case QualityPreset::BALANCED:
+            renderer_->setPresentMode(PresentMode::VBLANK);
+            break;
+        case QualityPreset::QUALITY:
+            renderer_->setPresentMode(PresentMode::VSYNC);
+            break;
+    }
 }
 
 // ---------------------------------------------------------------------------
@@ -286,6 +487,10 @@ void Viewer::setOnStatsUpdate(std::function<void(const ViewerStats&)> cb) {
     on_stats_update_ = std::move(cb);
 }
 
+void Viewer::setStatsRing(StatsRing* ring) {
+    stats_ring_.store(ring, std::memory_order_release);
+}
+
 void Viewer::setOnReconnectNeeded(std::function<void()> cb) {
     std::lock_guard<std::mutex> lock(mutex_);
     on_reconnect_needed_ = std::move(cb);
@@ -294,6 +499,15 @@ void Viewer::setOnReconnectNeeded(std::function<void()> cb) {
 void Viewer::onReconnected(int new_socket_fd, const std::string& dtls_fingerprint) {
     std::lock_guard<std::mutex> lock(mutex_);
 
+    // Same host, same keys: move the running session over to the new
+    // socket.  Only on the first attempt -- if that did not bring the
+    // stream back, the restart starts from scratch.
+    if (reconnect_attempts_.load() <= 1 && dtls_fingerprint == config_.dtls_fingerprint &&
+        receiver_ && receiver_->migrateTo(new_socket_fd)) {
+        CS_LOG(INFO, "Reconnecting in place on new socket fd=%d", new_socket_fd);
+        return;
+    }
+
     CS_LOG(INFO, "Reconnecting with new socket fd=%d", new_socket_fd);
 
     // Stop old transport
@@ -307,11 +521,18 @@ void Viewer::onReconnected(int new_socket_fd, const std::string& dtls_fingerprin
         stats_reporter_->stop();
     }
 
+    // Extra displays reported loss through the old NACK sender; they are
+    // started over on the new transport
+    for (auto& display : displays_) {
+        if (display) display->stop();
+    }
+    displays_ = {};
+
     // Close old socket
     if (p2p_socket_ >= 0) {
         cs_close_socket(p2p_socket_);
     }
-    p2p_socket_ = new_socket_fd;
+    p2p_socket_.store(new_socket_fd);
     config_.socket_fd = new_socket_fd;
     config_.dtls_fingerprint = dtls_fingerprint;
 
@@ -326,12 +547,13 @@ void Viewer::onReconnected(int new_socket_fd, const std::string& dtls_fingerprin
     }
 
     // Re-initialize transport with new socket
-    if (!initTransport()) {
+    if (!initTransport() || !startTransport()) {
         CS_LOG(ERR, "Reconnect: transport re-init failed");
         conn_state_.store(ConnectionState::DISCONNECTED);
         if (on_disconnect_) on_disconnect_();
         return;
     }
+    initDisplays();
 
     conn_state_.store(ConnectionState::CONNECTED);
     reconnect_attempts_ = 0;
@@ -612,109 +834,162 @@ void Viewer::disconnectP2P() {
 }
 
 // ---------------------------------------------------------------------------
-// Subsystem initialization
+// Path changes
 // ---------------------------------------------------------------------------
 
-bool Viewer::initRenderer() {
-    if (!config_.window_handle) {
-        CS_LOG(ERR, "No window handle provided");
-        return false;
+int Viewer::openStandbySocket(int active_fd) {
+    if (peer_addr_len_ == 0) return -1;
+
+    struct sockaddr_in active = {};
+    socklen_t len = sizeof(active);
+    if (::getsockname(active_fd, reinterpret_cast<::sockaddr*>(&active), &len) != 0) return -1;
+    char active_ip[INET_ADDRSTRLEN] = {};
+    ::inet_ntop(AF_INET, &active.sin_addr, active_ip, sizeof(active_ip));
+
+    const auto local_ips = getLocalIpAddresses();
+    for (size_t i = 0; i < local_ips.size(); ++i) {
+        const std::string& ip = local_ips[(standby_next_ + i) % local_ips.size()];
+        if (ip == active_ip) continue;
+
+        struct sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_port = 0;
+        if (::inet_pton(AF_INET, ip.c_str(), &local.sin_addr) != 1) continue;
+
+        int sock = static_cast<int>(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+        if (sock < 0) return -1;
+        if (::bind(sock, reinterpret_cast<::sockaddr*>(&local), sizeof(local)) != 0 ||
+            ::connect(sock, reinterpret_cast<const ::sockaddr*>(&peer_addr_), peer_addr_len_) != 0) {
+            cs_close_socket(sock);
+            continue;
+        }
+        cs_set_nonblocking(sock);
+
+        // The next scan starts past this address, so an interface with no
+        // route to the host does not hold the standby slot for good
+        standby_next_ = (standby_next_ + i + 1) % local_ips.size();
+        CS_LOG(DEBUG, "Standby path from %s", ip.c_str());
+        return sock;
     }
+    return -1;
+}
 
-#ifdef _WIN32
-    auto d3d11 = std::make_unique<D3D11Renderer>();
-    if (!d3d11->initialize(static_cast<void*>(config_.window_handle),
-                           config_.width, config_.height)) {
-        CS_LOG(ERR, "D3D11 renderer initialization failed");
-        return false;
+void Viewer::onPathChanged(int socket_fd) {
+    if (socket_fd < 0) {
+        if (conn_state_.load() == ConnectionState::CONNECTED) {
+            CS_LOG(WARN, "Path lost with no standby — requesting reconnect");
+            requestReconnect();
+        }
+        return;
     }
-    renderer_ = std::move(d3d11);
-    CS_LOG(INFO, "D3D11 renderer initialized: %ux%u", config_.width, config_.height);
-#elif defined(__APPLE__)
-    auto metal = std::make_unique<MetalRenderer>();
-    if (!metal->initialize(config_.window_handle,
-                           config_.width, config_.height)) {
-        CS_LOG(ERR, "Metal renderer initialization failed");
+
+    // Everything that sends to the host follows the receiver over; the
+    // old socket is the receiver's to close once it has drained.
+    p2p_socket_.store(socket_fd);
+    config_.socket_fd = socket_fd;
+    if (nack_sender_)    nack_sender_->setSocket(socket_fd);
+    if (stats_reporter_) stats_reporter_->setSocket(socket_fd);
+    if (input_sender_)   input_sender_->setSocket(socket_fd);
+
+    reconnect_attempts_.store(0);
+    last_packet_time_ = std::chrono::steady_clock::now();
+    conn_state_.store(ConnectionState::CONNECTED);
+    CS_LOG(INFO, "Session moved to socket fd=%d", socket_fd);
+}
+
+bool Viewer::requestReconnect() {
+    conn_state_.store(ConnectionState::RECONNECTING);
+    if (++reconnect_attempts_ > kMaxReconnectAttempts) {
+        CS_LOG(ERR, "Max reconnect attempts exceeded — disconnecting");
+        conn_state_.store(ConnectionState::DISCONNECTED);
+        if (on_disconnect_) on_disconnect_();
         return false;
     }
-    renderer_ = std::move(metal);
-    CS_LOG(INFO, "Metal renderer initialized: %ux%u", config_.width, config_.height);
-#else
-    CS_LOG(ERR, "No renderer available on this platform");
-    return false;
-#endif
-
+    if (on_reconnect_needed_) on_reconnect_needed_();
     return true;
 }
 
-bool Viewer::initDecoder() {
-    uint8_t codec = codecFromString(config_.codec);
+// ---------------------------------------------------------------------------
+// Subsystem initialization
+// ---------------------------------------------------------------------------
 
-#ifdef _WIN32
-    // Get D3D11 device for zero-copy sharing (renderer is D3D11Renderer on Windows)
-    ID3D11Device* shared_device = nullptr;
-    if (renderer_) {
-        auto* d3d11_renderer = dynamic_cast<D3D11Renderer*>(renderer_.get());
-        if (d3d11_renderer) {
-            shared_device = d3d11_renderer->getDevice();
-        }
+bool Viewer::initRenderer() {
+    if (!config_.window_handle) {
+        CS_LOG(ERR, "No window handle provided");
+        return false;
     }
 
-    // Try D3D11VA decoder first (shares device with renderer for zero-copy)
-    auto d3d11va_dec = std::make_unique<D3D11VADecoder>();
-    if (shared_device) {
-        d3d11va_dec->setD3D11Device(shared_device);
-    }
+    renderer_ = createRenderer(static_cast<void*>(config_.window_handle),
+                               config_.width, config_.height);
+    if (!renderer_) return false;
 
-    if (d3d11va_dec->initialize(codec, config_.width, config_.height)) {
-        decoder_ = std::move(d3d11va_dec);
-        CS_LOG(INFO, "Decoder initialized: %s", decoder_->getName().c_str());
-        return true;
-    }
+    configurePresentMode();
+    renderer_->setUpscaleMode(config_.upscale_mode);
+    render_queue_ = std::make_unique<FrameQueue>();
+    return true;
+}
 
-    // Fall back to generic NVDEC decoder (tries CUDA, then D3D11VA, then DXVA2, then software)
-    auto nvdec = std::make_unique<NvdecDecoder>();
-    if (shared_device) {
-        nvdec->setD3D11Device(shared_device);
+void Viewer::initDisplays() {
+    // Window i shows the host's display i + 1
+    const uint8_t codec = codecFromString(config_.codec);
+    const PresentMode mode = quality_ == QualityPreset::QUALITY ? PresentMode::VSYNC
+                                                                : PresentMode::VBLANK;
+    for (size_t i = 0; i < config_.display_windows.size() && i + 1 < displays_.size(); ++i) {
+        const uint8_t stream = static_cast<uint8_t>(i + 1);
+        auto display = std::make_unique<DisplayStream>(stream);
+        if (!display->start(static_cast<void*>(config_.display_windows[i]), codec,
+                            config_.width, config_.height, mode, config_.upscale_mode,
+                            nack_sender_.get())) {
+            CS_LOG(WARN, "Display %u unavailable (continuing without it)",
+                   static_cast<unsigned>(stream));
+            continue;
+        }
+        displays_[stream] = std::move(display);
     }
+}
 
-    if (nvdec->initialize(codec, config_.width, config_.height)) {
-        decoder_ = std::move(nvdec);
-        CS_LOG(INFO, "Decoder initialized: %s", decoder_->getName().c_str());
-        return true;
-    }
-#elif defined(__APPLE__)
-    // VideoToolbox hardware decoder (H.264/HEVC via Apple Silicon)
-    auto vt_dec = std::make_unique<VideoToolboxDecoder>();
-    if (vt_dec->initialize(codec, config_.width, config_.height)) {
-        decoder_ = std::move(vt_dec);
-        CS_LOG(INFO, "Decoder initialized: %s", decoder_->getName().c_str());
-        return true;
+bool Viewer::initDecoder() {
+    uint8_t codec = codecFromString(config_.codec);
+
+    static_assert(kMaxDecodeDepth == MAX_DECODE_IN_FLIGHT,
+                  "decode timeline must cover every unit the decoder can hold");
+    static_assert(kDecodeWaitMs == DECODE_WAIT_MS, "decode wait out of step");
+
+    // One unit in flight keeps decode latency to a single decode.  Above
+    // 1440p a decode takes long enough that overlapping two is worth the
+    // extra frame of queueing.
+    uint32_t depth = config_.decode_depth;
+    if (depth == 0) {
+        depth = (static_cast<uint64_t>(config_.width) * config_.height >
+                 2560ull * 1440ull) ? 2 : 1;
     }
-#endif
+    decode_depth_ = std::clamp<uint32_t>(depth, 1, kMaxDecodeDepth);
+    next_decode_tag_ = 1;
+    CS_LOG(INFO, "Decode depth: %u", decode_depth_);
 
-    CS_LOG(ERR, "All decoder backends failed");
-    return false;
+    decoder_ = createDecoder(codec, config_.width, config_.height, renderer_.get());
+    return decoder_ != nullptr;
 }
 
 bool Viewer::initTransport() {
-    // Create jitter buffer
-    jitter_buffer_ = std::make_unique<JitterBuffer>();
+    // Create jitter buffer.  On reconnect the flushed one is kept: the
+    // decode thread may be blocked in it.
+    if (!jitter_buffer_) {
+        jitter_buffer_ = std::make_unique<JitterBuffer>();
+    }
 
-    switch (quality_) {
-        case QualityPreset::PERFORMANCE:
-            jitter_buffer_->setTargetDepthMs(10);
-            break;
-        case QualityPreset::BALANCED:
-            jitter_buffer_->setTargetDepthMs(20);
-            break;
-        case QualityPreset::QUALITY:
-            jitter_buffer_->setTargetDepthMs(40);
-            break;
+    // Session recording, one file across reconnects
+    if (!recorder_ && !config_.record_path.empty()) {
+        recorder_ = std::make_unique<PacketRecorder>();
+        if (!recorder_->open(config_.record_path, RecordingRole::VIEWER)) {
+            recorder_.reset();
+        }
     }
 
     // Create NACK sender
     nack_sender_ = std::make_unique<NackSender>();
+    nack_sender_->setJitterBuffer(jitter_buffer_.get());
+    nack_sender_->setRecorder(recorder_.get());
     if (p2p_socket_ >= 0 && peer_addr_len_ > 0) {
         nack_sender_->initialize(p2p_socket_,
                                  reinterpret_cast<::sockaddr*>(&peer_addr_),
@@ -722,25 +997,87 @@ bool Viewer::initTransport() {
         nack_sender_->start();
     }
 
+    // Create FEC decoder (rebuilds lost fragments ahead of the jitter buffer)
+    fec_decoder_ = std::make_unique<FecDecoder>();
+    fec_decoder_->setRecoveryCallback([this](const uint8_t* data, size_t len) {
+        onRecoveredVideoPacket(data, len);
+    });
+
     // Create stats reporter
     stats_reporter_ = std::make_unique<StatsReporter>();
+    stats_reporter_->setRecorder(recorder_.get());
     if (p2p_socket_ >= 0 && peer_addr_len_ > 0) {
         stats_reporter_->initialize(p2p_socket_,
                                     reinterpret_cast<::sockaddr*>(&peer_addr_),
                                     peer_addr_len_);
         stats_reporter_->setNackSender(nack_sender_.get());
+        stats_reporter_->setFecDecoder(fec_decoder_.get());
         stats_reporter_->setCodecName(config_.codec);
         stats_reporter_->setResolution(config_.width, config_.height);
-        stats_reporter_->start();
+        stats_reporter_->setOnFeedback([this]() {
+            if (StatsRing* ring = stats_ring_.load(std::memory_order_acquire)) {
+                ring->writeStats(getStats(), getTimestampUs());
+            }
+        });
     }
 
+    // Cursor channel: shape requests go back like the other control traffic
+    cursor_cache_ = std::make_unique<CursorCache>();
+    cursor_cache_->setRequestFunc([this](const uint8_t* data, size_t len) {
+        if (p2p_socket_ >= 0 && peer_addr_len_ > 0) {
+            ::sendto(p2p_socket_,
+                     reinterpret_cast<const char*>(data),
+                     static_cast<int>(len), 0,
+                     reinterpret_cast<const ::sockaddr*>(&peer_addr_),
+                     peer_addr_len_);
+        }
+    });
+
     // Create UDP receiver
     receiver_ = std::make_unique<UdpReceiver>();
     if (p2p_socket_ >= 0) {
-        if (!receiver_->initialize(p2p_socket_, config_.dtls_fingerprint)) {
+        if (!receiver_->initialize(p2p_socket_, config_.dtls_fingerprint,
+                                   static_cast<int>(config_.recv_buffer_kb * 1024))) {
             CS_LOG(ERR, "Failed to initialize UDP receiver");
             return false;
         }
+    }
+    if (!config_.impairment.empty()) {
+        ImpairmentConfig impairment;
+        std::string error;
+        if (parseImpairmentSpec(config_.impairment, impairment, &error)) {
+            receiver_->setImpairment(impairment);
+        } else {
+            CS_LOG(WARN, "Ignoring impairment spec: %s", error.c_str());
+        }
+    }
+    receiver_->setRecorder(recorder_.get());
+
+    CS_LOG(INFO, "Transport initialized");
+    return true;
+}
+
+bool Viewer::startTransport() {
+    configureJitterBuffer();
+
+    if (stats_reporter_ && p2p_socket_ >= 0 && peer_addr_len_ > 0) {
+        stats_reporter_->start();
+    }
+
+    if (receiver_ && p2p_socket_ >= 0) {
+        // Per-packet arrivals drive the host's bandwidth estimator
+        StatsReporter* reporter = stats_reporter_.get();
+        receiver_->setArrivalCallback([reporter](const PacketArrival* arrivals, size_t count) {
+            reporter->onTransportArrivals(arrivals, count);
+        });
+
+        // Consent checks and in-place migration (CS06)
+        receiver_->setStandbyFunc([this](int active_fd) { return openStandbySocket(active_fd); });
+        receiver_->setPathCallback([this](int socket_fd) { onPathChanged(socket_fd); });
+        // Input also rides the standby path while the host sends on it
+        receiver_->setSecondaryCallback([this](int socket_fd) {
+            if (input_sender_) input_sender_->setSecondarySocket(socket_fd);
+        });
 
         // Start receiving packets
         if (!receiver_->start([this](PacketType type, const uint8_t* data, size_t len) {
@@ -748,15 +1085,33 @@ bool Viewer::initTransport() {
                 case PacketType::VIDEO:
                     onVideoPacket(data, len);
                     break;
+                case PacketType::FEC:
+                    onFecPacket(data, len);
+                    break;
                 case PacketType::AUDIO:
                     onAudioPacket(data, len);
                     break;
                 case PacketType::CLIPBOARD:
+                case PacketType::CLIP_CHUNK:
                     onClipboardPacket(data, len);
                     break;
                 case PacketType::CLIP_ACK:
+                case PacketType::CLIP_WINDOW_ACK:
                     onClipboardAck(data, len);
                     break;
+                case PacketType::RTT_PROBE:
+                    stats_reporter_->onRttProbe(data, len);
+                    break;
+                case PacketType::CURSOR_POS:
+                case PacketType::CURSOR_SHAPE:
+                    onCursorPacket(type, data, len);
+                    break;
+                case PacketType::INPUT_ECHO:
+                    if (input_sender_) input_sender_->onInputEcho(data, len);
+                    break;
+                case PacketType::CONTROLLER_ACK:
+                    if (input_sender_) input_sender_->onControllerAck(data, len);
+                    break;
                 default:
                     break;
             }
@@ -766,7 +1121,6 @@ bool Viewer::initTransport() {
         }
     }
 
-    CS_LOG(INFO, "Transport initialized");
     return true;
 }
 
@@ -777,8 +1131,14 @@ bool Viewer::initAudio() {
         return false;
     }
 
+    // Packets left over from an earlier session (the receive thread is
+    // not running yet)
+    while (audio_queue_.front()) audio_queue_.pop();
+    audio_jitter_ = std::make_unique<AudioJitterBuffer>(*opus_decoder_);
+    av_sync_      = std::make_unique<AvSync>();
+
 #ifdef _WIN32
-    audio_playback_ = std::make_unique<WasapiPlayback>();
+    audio_playback_ = std::make_unique<WasapiPlayback>(config_.audio_mode);
     if (!audio_playback_->initialize(48000, 2)) {
         CS_LOG(WARN, "Failed to initialize WASAPI playback");
         return false;
@@ -814,6 +1174,7 @@ bool Viewer::initInput() {
     // Create input sender
     if (p2p_socket_ >= 0 && peer_addr_len_ > 0) {
         input_sender_ = std::make_unique<InputSender>();
+        input_sender_->setRecorder(recorder_.get());
         input_sender_->initialize(p2p_socket_,
                                   reinterpret_cast<::sockaddr*>(&peer_addr_),
                                   peer_addr_len_);
@@ -826,6 +1187,14 @@ bool Viewer::initInput() {
         });
 
         input_capture_->setEnabled(true);
+
+        // Controllers stream at a fixed rate through the same sender
+        controller_capture_ = std::make_unique<ControllerCapture>();
+        controller_capture_->start([this](const ControllerPacket* states, size_t count) {
+            if (input_sender_) {
+                input_sender_->sendControllerStates(states, count);
+            }
+        });
     }
 
     CS_LOG(INFO, "Input capture initialized");
@@ -856,13 +1225,12 @@ bool Viewer::initInput() {
 // ---------------------------------------------------------------------------
 
 void Viewer::onVideoPacket(const uint8_t* data, size_t len) {
-    if (len < sizeof(VideoPacketHeader)) return;
+    VideoPacketHeaderV2 header;
+    size_t header_len = 0;
+    if (!parseVideoHeader(data, len, header, &header_len)) return;
 
-    VideoPacketHeader header;
-    if (!VideoPacketHeader::deserialize(data, len, header)) return;
-
-    const uint8_t* payload = data + sizeof(VideoPacketHeader);
-    size_t payload_len = len - sizeof(VideoPacketHeader);
+    const uint8_t* payload = data + header_len;
+    size_t payload_len = len - header_len;
 
     if (payload_len != header.payload_length) {
         // Truncated or invalid packet
@@ -879,15 +1247,69 @@ void Viewer::onVideoPacket(const uint8_t* data, size_t len) {
         stats_reporter_->onPacketReceived(header, now);
     }
 
-    // Feed NACK sender
+    // Keep a copy for FEC recovery of other packets in the same group
+    if (fec_decoder_) {
+        fec_decoder_->onVideoPacket(header.sequence_number, data, len);
+    }
+
+    deliverVideoFragment(header, payload, payload_len);
+}
+
+void Viewer::onFecPacket(const uint8_t* data, size_t len) {
+    FecPacketHeader fh;
+    if (!FecPacketHeader::deserialize(data, len, fh)) return;
+
+    last_packet_time_ = std::chrono::steady_clock::now();
+
+    if (stats_reporter_) {
+        stats_reporter_->onFecPacketReceived(fh.sequence_number, len,
+                                             getTimestampUs());
+    }
+
+    // FEC packets share the video sequence space; mark them received so
+    // the NACK sender doesn't request them as gaps.
+    if (nack_sender_) {
+        nack_sender_->onPacketReceived(fh.sequence_number);
+    }
+
+    if (fec_decoder_) {
+        fec_decoder_->onFecPacket(data, len);
+    }
+}
+
+void Viewer::onRecoveredVideoPacket(const uint8_t* data, size_t len) {
+    VideoPacketHeaderV2 header;
+    size_t header_len = 0;
+    if (!parseVideoHeader(data, len, header, &header_len)) return;
+
+    const uint8_t* payload = data + header_len;
+    size_t payload_len = len - header_len;
+    if (payload_len != header.payload_length) return;
+
+    // Not fed to the stats reporter: the host should see the real network
+    // loss so it can size FEC redundancy accordingly.
+    deliverVideoFragment(header, payload, payload_len);
+}
+
+void Viewer::deliverVideoFragment(const VideoPacketHeaderV2& header,
+                                  const uint8_t* payload, size_t payload_len) {
+    // Feed NACK sender (also cancels any pending NACK for this sequence)
     if (nack_sender_) {
         nack_sender_->onPacketReceived(header.sequence_number);
     }
 
+    // An extra display's fragment goes to its own pipeline; one this
+    // viewer has no window for is dropped
+    if (const uint8_t stream = header.streamId()) {
+        if (displays_[stream]) {
+            displays_[stream]->onFragment(header, payload, payload_len);
+        }
+        return;
+    }
+
     // Push into jitter buffer
     if (jitter_buffer_) {
         jitter_buffer_->pushPacket(header, payload, payload_len);
-        decode_queue_cv_.notify_one();
     }
 }
 
@@ -900,15 +1322,16 @@ void Viewer::onAudioPacket(const uint8_t* data, size_t len) {
     const uint8_t* payload = data + sizeof(AudioPacketHeader);
     size_t payload_len = len - sizeof(AudioPacketHeader);
 
-    // Queue for audio thread
-    {
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_.push_back({
-            std::vector<uint8_t>(payload, payload + payload_len),
-            header.timestamp_us
-        });
-    }
-    audio_queue_cv_.notify_one();
+    // Queue for the audio thread; a full queue drops the packet, which
+    // the jitter buffer then conceals
+    if (payload_len > kAudioMaxPayload) return;
+    AudioPacketSlot* slot = audio_queue_.beginPush();
+    if (!slot) return;
+    slot->header     = header;
+    slot->arrival_us = getTimestampUs();
+    slot->len        = static_cast<uint16_t>(payload_len);
+    std::memcpy(slot->data.data(), payload, payload_len);
+    audio_queue_.commitPush();
 }
 
 void Viewer::onClipboardPacket(const uint8_t* data, size_t len) {
@@ -923,21 +1346,30 @@ void Viewer::onClipboardAck(const uint8_t* data, size_t len) {
     }
 }
 
+void Viewer::onCursorPacket(PacketType type, const uint8_t* data, size_t len) {
+    if (!cursor_cache_) return;
+    const bool changed = type == PacketType::CURSOR_POS
+        ? cursor_cache_->onPosition(data, len)
+        : cursor_cache_->onShapeChunk(data, len);
+    // The render thread redraws the last frame under the moved cursor
+    if (changed && render_queue_) render_queue_->interrupt();
+}
+
 // ---------------------------------------------------------------------------
 // Pipeline threads
 // ---------------------------------------------------------------------------
 
 void Viewer::decodeThreadFunc() {
     CS_LOG(INFO, "Decode thread started");
+    cs::ScopedThreadRole role(cs::ThreadRole::DECODE);
+    cs::trace::setThreadName("decode");
 
     while (running_.load()) {
-        // Wait for data in the jitter buffer
-        {
-            std::unique_lock<std::mutex> lock(decode_queue_mutex_);
-            decode_queue_cv_.wait_for(lock, std::chrono::milliseconds(5), [this]() {
-                return !running_.load() ||
-                       (jitter_buffer_ && jitter_buffer_->getCompleteFrameCount() > 0);
-            });
+        // Wait for the jitter buffer to have a frame ready.  It wakes us
+        // when one completes or falls due; the idle limit only keeps the
+        // connection check below running while nothing arrives.
+        if (jitter_buffer_) {
+            jitter_buffer_->waitForFrame(kDecodeIdleWakeMs);
         }
 
         if (!running_.load()) break;
@@ -947,130 +1379,341 @@ void Viewer::decodeThreadFunc() {
             auto now = std::chrono::steady_clock::now();
             if (now - last_packet_time_ > kDeadConnectionTimeout) {
                 CS_LOG(WARN, "No packets for 10s — requesting reconnect");
-                conn_state_.store(ConnectionState::RECONNECTING);
-                reconnect_attempts_++;
+                if (!requestReconnect()) break;
+            }
+        }
 
-                if (reconnect_attempts_ > kMaxReconnectAttempts) {
-                    CS_LOG(ERR, "Max reconnect attempts exceeded — disconnecting");
-                    conn_state_.store(ConnectionState::DISCONNECTED);
-                    if (on_disconnect_) on_disconnect_();
-                    break;
-                }
+        if (!jitter_buffer_ || !decoder_ || !render_queue_) continue;
 
-                if (on_reconnect_needed_) on_reconnect_needed_();
+        // Pop complete frames from the jitter buffer; each is decoded
+        // straight out of its jitter buffer slot.
+        JitterBuffer::FrameView frame;
+        VideoPacketHeaderV2 header;
+
+        while (jitter_buffer_->popFrame(frame, header)) {
+            if (!running_.load()) break;
+
+            checkFrameLoss();
+            if (skipUntilRecovered(header)) {
+                if (stats_reporter_) {
+                    stats_reporter_->onFrameDropped();
+                }
+                continue;
             }
+
+            // Keep no more than decode_depth_ units in the decoder; at
+            // depth 1 this takes the previous picture before submitting.
+            while (decoder_->getInFlight() >= decode_depth_ &&
+                   collectDecoded(kDecodeWaitMs)) {}
+
+            submitFrame(frame.data, frame.size, header, frame.first_arrival_us, frame.complete_us);
+
+            // Anything already finished goes to the renderer right away
+            while (collectDecoded(0)) {}
         }
 
-        if (!jitter_buffer_ || !decoder_) continue;
+        // Nothing more to submit: drain what is still decoding
+        while (decoder_->getInFlight() > 0 && collectDecoded(kDecodeWaitMs)) {}
 
-        // Pop complete frames from the jitter buffer
-        std::vector<uint8_t> frame_data;
-        VideoPacketHeader header;
+        // A frame given up on without a successor ready still gets reported.
+        checkFrameLoss();
+    }
 
-        while (jitter_buffer_->popFrame(frame_data, header)) {
-            if (!running_.load()) break;
+    CS_LOG(INFO, "Decode thread exited");
+}
+
+// ---------------------------------------------------------------------------
+// Pipelined decode
+// ---------------------------------------------------------------------------
 
-            auto start = std::chrono::steady_clock::now();
+void Viewer::submitFrame(const uint8_t* data, size_t len, const VideoPacketHeaderV2& header,
+                         uint64_t first_arrival_us, uint64_t complete_us) {
+    cs::trace::Scope trace(cs::trace::Stage::DECODE_SUBMIT, header.timestamp_us);
+    uint64_t tag = next_decode_tag_++;
+
+    InFlightFrame& slot = in_flight_[tag % kMaxDecodeDepth];
+    slot.tag          = tag;
+    slot.timestamp_us = header.timestamp_us;
+    slot.first_arrival_us = first_arrival_us;
+    slot.complete_us  = complete_us;
+    slot.frame_number = header.frame_number;
+    slot.keyframe     = header.keyframe();
+    slot.ltr          = header.ltr();
+
+    if (!decoder_->submit(data, len, tag)) {
+        slot.tag = 0;
+        decode_clean_ = false;
+        if (stats_reporter_) {
+            stats_reporter_->onFrameDropped();
+        }
+    }
+}
 
-            DecodedFrame decoded;
-            bool ok = decoder_->decode(frame_data.data(), frame_data.size(), decoded);
+bool Viewer::collectDecoded(uint32_t max_wait_ms) {
+    // Decoded straight into the render queue's free slot.
+    DecodedFrame& decoded = render_queue_->writeSlot();
+    decoded = DecodedFrame();
 
-            auto end = std::chrono::steady_clock::now();
-            double decode_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    uint64_t tag = 0;
+    bool ok = false;
+    if (!decoder_->receive(decoded, tag, ok, max_wait_ms)) return false;
 
-            if (ok) {
-                decoded.timestamp_us = header.timestamp_us;
-                decoded.decode_time_ms = decode_ms;
+    const InFlightFrame& unit = in_flight_[tag % kMaxDecodeDepth];
+    if (unit.tag != tag) ok = false;    // Not a unit this session submitted
 
-                // Update stats
-                if (stats_reporter_) {
-                    stats_reporter_->setDecodeTimeMs(decode_ms);
-                    stats_reporter_->onFrameDecoded();
-                }
+    if (!ok) {
+        decoded = DecodedFrame();
+        decode_clean_ = false;
+        if (stats_reporter_) {
+            stats_reporter_->onFrameDropped();
+        }
+        return true;
+    }
 
-                // Push to render queue
-                {
-                    std::lock_guard<std::mutex> lock(render_queue_mutex_);
-                    pending_frame_ = std::make_unique<DecodedFrame>(decoded);
-                }
-                render_queue_cv_.notify_one();
-            } else {
-                if (stats_reporter_) {
-                    stats_reporter_->onFrameDropped();
-                }
-            }
+    decoded.timestamp_us     = unit.timestamp_us;
+    decoded.first_arrival_us = unit.first_arrival_us;
+    decoded.complete_us      = unit.complete_us;
+    decoded.decoded_us       = getTimestampUs();
+    cs::trace::instant(cs::trace::Stage::DECODED, unit.timestamp_us);
+
+    // Only an LTR decoded from an intact chain is safe for the
+    // host to predict from after a later loss.
+    if (unit.keyframe) decode_clean_ = true;
+
+    // A sequence change the decoder took in-band
+    if (decoded.width != decoded_width_ || decoded.height != decoded_height_) {
+        decoded_width_  = decoded.width;
+        decoded_height_ = decoded.height;
+        {
+            std::lock_guard<std::mutex> slock(stats_mutex_);
+            stats_.resolution_width  = decoded.width;
+            stats_.resolution_height = decoded.height;
+        }
+        if (stats_reporter_) {
+            stats_reporter_->setResolution(decoded.width, decoded.height);
         }
     }
 
-    CS_LOG(INFO, "Decode thread exited");
+    // Update stats
+    if (stats_reporter_) {
+        stats_reporter_->setDecodeTimeMs(decoded.decode_time_ms);
+        stats_reporter_->onFrameDecoded();
+        if (unit.ltr && decode_clean_) {
+            stats_reporter_->onLtrDecoded(unit.frame_number);
+        }
+    }
+
+    // Hand to the render thread.  A frame it never got to is
+    // superseded by this one and comes back to be released.
+    if (render_queue_->publish()) {
+        renderer_->discardFrame(render_queue_->writeSlot());
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Frame loss recovery
+// ---------------------------------------------------------------------------
+
+void Viewer::checkFrameLoss() {
+    uint32_t first = 0;
+    uint32_t last  = 0;
+    if (!jitter_buffer_->takeLostFrames(first, last)) return;
+
+    if (!awaiting_recovery_) {
+        awaiting_recovery_ = true;
+        loss_first_ = first;
+        loss_last_  = last;
+        loss_time_  = std::chrono::steady_clock::now();
+    } else {
+        if (static_cast<int32_t>(first - loss_first_) < 0) loss_first_ = first;
+        if (static_cast<int32_t>(last - loss_last_) > 0)   loss_last_  = last;
+    }
+
+    CS_LOG(DEBUG, "Frames %u-%u lost -- waiting for recovery", loss_first_, loss_last_);
+    if (nack_sender_) {
+        nack_sender_->reportFrameLoss(loss_first_, loss_last_);
+    }
+}
+
+bool Viewer::skipUntilRecovered(const VideoPacketHeaderV2& header) {
+    if (!awaiting_recovery_) return false;
+
+    // A recovery frame predicts only from frames before the loss, so it
+    // is decodable once it is newer than every lost frame.
+    bool resumes = header.keyframe() ||
+                   (header.recovery() &&
+                    static_cast<int32_t>(header.frame_number - loss_last_) > 0);
+    if (!resumes) {
+        if (std::chrono::steady_clock::now() - loss_time_ < kRecoveryTimeout) {
+            return true;
+        }
+        CS_LOG(WARN, "No recovery frame for lost frames %u-%u -- resuming decode",
+               loss_first_, loss_last_);
+        decode_clean_ = false;
+    }
+
+    awaiting_recovery_ = false;
+    if (nack_sender_) {
+        nack_sender_->clearFrameLoss();
+    }
+    return false;
 }
 
 void Viewer::renderThreadFunc() {
     CS_LOG(INFO, "Render thread started");
+    cs::ScopedThreadRole role(cs::ThreadRole::RENDER);
+    cs::trace::setThreadName("render");
 
-    while (running_.load()) {
-        std::unique_ptr<DecodedFrame> frame;
+    const DecodedFrame* last_frame = nullptr;   // On screen; valid until the next acquire()
 
-        // Wait for a decoded frame
-        {
-            std::unique_lock<std::mutex> lock(render_queue_mutex_);
-            render_queue_cv_.wait_for(lock, std::chrono::milliseconds(16), [this]() {
-                return !running_.load() || pending_frame_ != nullptr;
-            });
+    while (running_.load()) {
+        if (!renderer_ || !render_queue_) break;
+
+        // Never render into a frame the display has yet to pick up: with
+        // the swap chain queue full, the newest frame is taken only once
+        // it has room.
+        if (!renderer_->waitForBackBuffer(kRenderIdleWakeMs)) continue;
+
+        // Present at the start of each display refresh where the renderer
+        // can pace; otherwise as soon as a frame is decoded.  Either way
+        // only the newest frame is shown.
+        if (!renderer_->waitForPresent(kRenderIdleWakeMs)) {
+            render_queue_->waitForFrame(kRenderIdleWakeMs);
+        }
 
-            if (!running_.load()) break;
+        if (!running_.load()) break;
 
-            frame = std::move(pending_frame_);
+        uint64_t ready_us = 0;
+        const DecodedFrame* frame = render_queue_->acquire(&ready_us);
+
+        // The cursor moves without new video: then the frame on screen is
+        // presented again under it.  It stays in its slot until the next
+        // frame is taken, but a frame without a surface reference may
+        // already have been overwritten by the decoder.
+        CursorState cursor;
+        const bool cursor_changed = cursor_cache_ && cursor_cache_->takeState(cursor);
+        if (cursor_changed) {
+            renderer_->setCursor(cursor.shape.get(), cursor.x, cursor.y, cursor.visible);
+        }
+        if (frame) {
+            last_frame = frame;
+        } else {
+            if (cursor_changed && last_frame && last_frame->surface) {
+                renderer_->renderFrame(*last_frame);
+            }
+            continue;
         }
 
-        if (!frame || !renderer_) continue;
-
+        const uint64_t render_ticks = cs::trace::ticks();
         double render_ms = renderer_->renderFrame(*frame);
+        const uint64_t presented_us = getTimestampUs();
+        cs::trace::record(cs::trace::Stage::RENDER, static_cast<uint32_t>(frame->timestamp_us),
+                          render_ticks, cs::trace::ticks());
+        double latency_ms = static_cast<double>(presented_us - ready_us) / 1000.0;
+
+        const uint64_t photon_us = presented_us +
+            static_cast<uint64_t>(renderer_->getPresentToPhotonMs() * 1000.0);
+        if (first_frame_us_.load(std::memory_order_relaxed) == 0) {
+            const uint64_t first_us = std::max<uint64_t>(1, static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start_time_).count()));
+            first_frame_us_.store(first_us);
+            CS_LOG(INFO, "First frame presented %.1f ms after start", first_us / 1000.0);
+        }
+        if (av_sync_) {
+            av_sync_->onVideoPresented(static_cast<uint32_t>(frame->timestamp_us), photon_us);
+        }
+        FrameTiming timing;
+        recordFrameLatency(*frame, photon_us, timing);
+        if (input_sender_) {
+            input_sender_->onFramePresented(static_cast<uint32_t>(frame->timestamp_us),
+                                            photon_us, input_to_photon_latency_);
+        }
 
         if (stats_reporter_) {
             stats_reporter_->setRenderTimeMs(render_ms);
+            stats_reporter_->setPresentLatencyMs(latency_ms);
+        }
+        if (StatsRing* ring = stats_ring_.load(std::memory_order_acquire)) {
+            timing.capture_ts_us      = static_cast<uint32_t>(frame->timestamp_us);
+            timing.presented_us       = presented_us;
+            timing.present_latency_ms = latency_ms;
+            timing.render_ms          = render_ms;
+            ring->writeFrame(timing);
         }
     }
 
     CS_LOG(INFO, "Render thread exited");
 }
 
+// ---------------------------------------------------------------------------
+// recordFrameLatency -- a frame's stages since capture, on one clock
+// ---------------------------------------------------------------------------
+
+void Viewer::recordFrameLatency(const DecodedFrame& frame, uint64_t photon_us,
+                                FrameTiming& timing) {
+    uint32_t offset_us = 0, error_us = 0;
+    if (!stats_reporter_ || !stats_reporter_->getHostClock(offset_us, error_us)) return;
+
+    // Capture time on our clock, modulo 2^32 as the header carries it;
+    // a stage before it is within the offset's error: no delay
+    const uint32_t captured = static_cast<uint32_t>(frame.timestamp_us) + offset_us;
+    auto since = [captured](uint64_t local_us) {
+        const int32_t d = static_cast<int32_t>(static_cast<uint32_t>(local_us) - captured);
+        return static_cast<uint64_t>(std::max<int32_t>(d, 0));
+    };
+    if (frame.first_arrival_us) {
+        const uint64_t us = since(frame.first_arrival_us);
+        first_packet_latency_.record(us);
+        timing.first_packet_ms = us / 1000.0;
+    }
+    if (frame.complete_us) {
+        const uint64_t us = since(frame.complete_us);
+        frame_complete_latency_.record(us);
+        timing.frame_complete_ms = us / 1000.0;
+    }
+    const uint64_t us = since(photon_us);
+    glass_to_glass_latency_.record(us);
+    timing.glass_to_glass_ms = us / 1000.0;
+}
+
 void Viewer::audioThreadFunc() {
     CS_LOG(INFO, "Audio thread started");
+    cs::ScopedThreadRole role(cs::ThreadRole::AUDIO);
 
-    while (running_.load()) {
-        std::vector<AudioPacketData> packets;
+    // Decoded audio is handed to the output only as it needs it, about a
+    // device period ahead, so playout delay sits in the jitter buffer
+    // where it is measured and adapted.
+    const float lead_ms = std::max(kAudioMinLeadMs, audio_playback_->getEndpointLatencyMs());
+    const size_t channels = opus_decoder_->getChannels();
+    std::vector<float> pcm;
+    pcm.reserve(static_cast<size_t>(opus_decoder_->getSampleRate()) / 10 * channels);
 
-        // Wait for audio data
-        {
-            std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-            audio_queue_cv_.wait_for(lock, std::chrono::milliseconds(5), [this]() {
-                return !running_.load() || !audio_queue_.empty();
-            });
+    while (running_.load()) {
+        audio_queue_.waitForData(std::chrono::milliseconds(kAudioWakeMs));
+        if (!running_.load()) break;
 
-            if (!running_.load()) break;
+        while (AudioPacketSlot* slot = audio_queue_.front()) {
+            audio_jitter_->push(slot->header, slot->data.data(), slot->len, slot->arrival_us);
+            audio_queue_.pop();
+        }
 
-            packets = std::move(audio_queue_);
-            audio_queue_.clear();
+        uint32_t timestamp_us = 0;
+        while (audio_playback_->getQueuedMs() < lead_ms && audio_jitter_->pull(pcm, timestamp_us)) {
+            // Heard once what is queued ahead of it and the output path
+            // have played
+            const float ahead_ms = audio_playback_->getLatencyMs() +
+                                   audio_playback_->getEndpointLatencyMs();
+            av_sync_->onAudioPlayed(timestamp_us,
+                                    getTimestampUs() + static_cast<uint64_t>(ahead_ms * 1000.0f));
+            audio_playback_->play(pcm.data(), pcm.size() / channels);
         }
 
-        // Decode and play each audio packet
-        for (const auto& pkt : packets) {
-            if (!running_.load()) break;
-            if (!opus_decoder_ || !audio_playback_) continue;
-
-            std::vector<float> pcm;
-            if (opus_decoder_->decode(pkt.data.data(), pkt.data.size(), pcm)) {
-                size_t frame_count = pcm.size() / opus_decoder_->getChannels();
-                audio_playback_->play(pcm.data(), frame_count);
-            } else {
-                // Packet loss concealment
-                opus_decoder_->decodePLC(1, pcm);
-                if (!pcm.empty()) {
-                    size_t frame_count = pcm.size() / opus_decoder_->getChannels();
-                    audio_playback_->play(pcm.data(), frame_count);
-                }
-            }
+        // Delay whichever stream is ahead
+        if (av_sync_->update(getTimestampUs())) {
+            audio_jitter_->setExtraDelayUs(av_sync_->getAudioDelayUs());
+            if (jitter_buffer_) jitter_buffer_->setSyncDelayUs(av_sync_->getVideoDelayUs());
         }
     }
 
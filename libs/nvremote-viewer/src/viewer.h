@@ -9,13 +9,17 @@
 // Thread model:
 //   - Receive thread: UDP recv loop -> jitter buffer + NACK + stats
 //   - Decode thread:  pulls from jitter buffer -> decodes -> render queue
-//   - Render thread:  pulls decoded frames -> presents via D3D11
+//   - Render thread:  takes the newest decoded frame at each display
+//                     refresh -> presents via D3D11 / Metal
 //   - Audio thread:   receives audio packets -> Opus decode -> WASAPI play
 //   - Stats thread:   periodic QoS feedback to host
 //   - Input is captured on the window's message pump thread
+//   - Per extra display (wire v5): decode and render threads of its own
 ///////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include <array>
+#include <chrono>
 #include <cstdint>
 #include <string>
 #include <functional>
@@ -23,6 +27,7 @@
 #include <mutex>
 #include <atomic>
 #include <thread>
+#include <vector>
 #include <condition_variable>
 
 #ifdef _WIN32
@@ -30,8 +35,13 @@
 #endif
 
 #include <cs/common.h>
+#include <cs/latency_histogram.h>
+#include <cs/spsc_queue.h>
 #include <cs/transport/packet.h>
 
+#include "audio/audio_playback_interface.h"
+#include "render/renderer_interface.h"
+
 // Forward declarations for subsystems
 namespace cs {
 
@@ -40,12 +50,22 @@ class IRenderer;
 class UdpReceiver;
 class JitterBuffer;
 class NackSender;
+class PacketRecorder;
+class FecDecoder;
 class StatsReporter;
+class StatsRing;
+struct FrameTiming;
 class OpusDecoderWrapper;
+class AudioJitterBuffer;
+class AvSync;
 class IAudioPlayback;
 class InputCapture;
 class InputSender;
+class ControllerCapture;
 class ClipboardSync;
+class CursorCache;
+class FrameQueue;
+class DisplayStream;
 struct DecodedFrame;
 
 // ---------------------------------------------------------------------------
@@ -69,6 +89,13 @@ struct ViewerConfig {
     HWND        window_handle = nullptr;
 #else
     void*       window_handle = nullptr;
+#endif
+    // Windows for the host's extra displays, in display order (display 1
+    // first); displays without one are not shown
+#ifdef _WIN32
+    std::vector<HWND>  display_windows;
+#else
+    std::vector<void*> display_windows;
 #endif
     int         socket_fd     = -1;       // Pre-connected socket from ICE
     std::string peer_ip;
@@ -77,8 +104,35 @@ struct ViewerConfig {
     // DTLS parameters
     std::string dtls_fingerprint;
 
+    // Socket receive buffer in KiB (0 = OS default)
+    uint32_t    recv_buffer_kb = 4096;
+
+    // Access units in the decoder at once: 1 for the lowest latency, 2-3
+    // to overlap decodes at high resolutions (0 = chosen by resolution)
+    uint32_t    decode_depth = 0;
+
+    // Audio output: LOW_LATENCY and EXCLUSIVE fall back to the next mode
+    // down where the device does not offer them
+    AudioOutputMode audio_mode = AudioOutputMode::LOW_LATENCY;
+
     // Quality
     QualityPreset quality = QualityPreset::BALANCED;
+
+    // Scaler for frames smaller than the window, e.g. after the host
+    // drops resolution
+    UpscaleMode upscale_mode = UpscaleMode::AUTO;
+
+    // Emulated network impairment on ingress, a cs/transport/
+    // network_impairment.h spec (empty = none); for QoS testing
+    std::string impairment;
+
+    // Record the session's datagrams to this file for replay, a
+    // cs/transport/packet_recorder.h recording (empty = none)
+    std::string record_path;
+
+    // Priority, MMCSS and CPUs of the receive, decode, render, audio and
+    // other threads, a cs/thread_policy.h spec (empty = defaults)
+    std::string threads;
 };
 
 // ---------------------------------------------------------------------------
@@ -89,6 +143,12 @@ struct ViewerStats {
     double   fps               = 0.0;
     double   packet_loss       = 0.0;   // 0.0 to 1.0
     double   jitter_ms         = 0.0;
+    double   jitter_p50_ms     = 0.0;   // |D| between packets, over the last 2 s
+    double   jitter_p95_ms     = 0.0;
+    double   jitter_p99_ms     = 0.0;
+    double   frame_gap_p50_ms  = 0.0;   // between frames' first packets, last 2 s
+    double   frame_gap_p95_ms  = 0.0;
+    double   frame_gap_p99_ms  = 0.0;
     double   rtt_ms            = 0.0;
     std::string codec;
     uint32_t resolution_width  = 0;
@@ -96,10 +156,63 @@ struct ViewerStats {
     std::string connection_type;        // "p2p", "relay"
     double   decode_time_ms    = 0.0;
     double   render_time_ms    = 0.0;
+    double   decode_time_p50_ms = 0.0;  // over the last 2 s
+    double   decode_time_p95_ms = 0.0;
+    double   decode_time_p99_ms = 0.0;
+    double   render_time_p50_ms = 0.0;  // over the last 2 s
+    double   render_time_p95_ms = 0.0;
+    double   render_time_p99_ms = 0.0;
+    double   present_latency_ms = 0.0;  // decoder output to present
+    double   present_to_photon_ms = 0.0; // present to the refresh showing it (0 = unknown)
+    std::string upscaler;               // "none", "shader", "super_resolution"
+    uint32_t decoder_reconfigs   = 0;   // in-band resolution changes decoded through
+    double   decoder_reconfig_ms = 0.0; // submit time of the frame carrying the last one
+    double   decoder_reconfig_max_ms = 0.0;
     uint64_t frames_decoded    = 0;
     uint64_t frames_dropped    = 0;
     uint64_t packets_received  = 0;
     uint64_t bytes_received    = 0;
+    uint64_t fec_recovered     = 0;     // packets rebuilt from FEC parity
+    uint64_t fec_unrecoverable = 0;     // packets lost in groups FEC could not repair
+    uint32_t jitter_buffer_ms  = 0;     // current adaptive playout depth
+    uint64_t late_frames       = 0;     // frames completed after their playout time
+    uint64_t render_dropped    = 0;     // decoded frames replaced before presenting
+    uint64_t path_migrations   = 0;     // times the session moved to another path
+    uint64_t duplicate_packets = 0;     // video / FEC copies dropped (multipath)
+    double   audio_output_latency_ms = 0.0;  // decoded audio queued + output path to the device
+    uint32_t audio_buffer_ms   = 0;     // audio jitter buffer target delay
+    uint64_t audio_fec_recovered = 0;   // lost audio frames rebuilt from in-band FEC
+    uint64_t audio_concealed   = 0;     // audio frames synthesized by PLC
+    uint64_t audio_underruns   = 0;     // times audio playout stopped to refill
+    float    av_offset_ms      = 0.0f;  // sound heard minus picture shown (+ = audio late)
+    uint32_t av_audio_delay_ms = 0;     // extra audio playout delay for lip sync
+    uint32_t av_video_delay_ms = 0;     // extra video hold-back for lip sync
+    bool     clock_synced      = false; // host clock offset known (the rest need it)
+    double   clock_error_ms    = 0.0;   // bound on that offset's error
+    double   first_packet_p50_ms = 0.0; // host capture to a frame's first packet here
+    double   first_packet_p99_ms = 0.0;
+    double   frame_complete_p50_ms = 0.0;   // to its last packet
+    double   frame_complete_p99_ms = 0.0;
+    double   glass_to_glass_p50_ms = 0.0;   // to its light leaving the display
+    double   glass_to_glass_p99_ms = 0.0;
+    double   input_to_photon_p50_ms = 0.0;  // our input sent to the first frame showing it, lit
+    double   input_to_photon_p99_ms = 0.0;
+    double   first_frame_ms    = 0.0;   // start() called to the first frame presented (0 = none yet)
+    uint64_t pool_reserved_bytes   = 0; // cs::BufferPool block bytes allocated (process-wide)
+    uint64_t pool_high_water_bytes = 0; // Most block bytes in use at once
+    uint64_t pool_system_allocs    = 0; // Blocks allocated from the system, all time
+};
+
+// ---------------------------------------------------------------------------
+// Time spent in each phase of start()
+// ---------------------------------------------------------------------------
+struct StartTiming {
+    double renderer_ms  = 0.0;
+    double decoder_ms   = 0.0;   // After the renderer, on its device
+    double audio_ms     = 0.0;
+    double transport_ms = 0.0;   // DTLS handshake included
+    double input_ms     = 0.0;
+    double total_ms     = 0.0;   // start() called to the pipeline running
 };
 
 // ---------------------------------------------------------------------------
@@ -150,6 +263,9 @@ public:
     /// Get a snapshot of current statistics.
     ViewerStats getStats() const;
 
+    /// How long each phase of the last start() took.
+    StartTiming getStartTiming() const;
+
     /// Set quality preset (adjusts decode parameters and jitter buffer).
     void setQuality(QualityPreset preset);
 
@@ -159,13 +275,20 @@ public:
     /// Register a callback for periodic stats updates.
     void setOnStatsUpdate(std::function<void(const ViewerStats&)> cb);
 
+    /// Publish the stats snapshot (every QoS feedback) and each presented
+    /// frame's timings into |ring|, or stop with nullptr.  |ring| must be
+    /// attached and outlive the viewer or the next call.
+    void setStatsRing(StatsRing* ring);
+
     /// Register a callback for reconnect requests (fires when the viewer
     /// detects a dead connection and wants the signaling layer to initiate
     /// an ICE restart).
     void setOnReconnectNeeded(std::function<void()> cb);
 
     /// Called by the signaling layer after ICE restart completes and a new
-    /// P2P connection is ready. Resets transport with the new socket.
+    /// P2P connection is ready.  With the same DTLS fingerprint the session
+    /// is first moved to the new socket in place (no handshake, no
+    /// keyframe); failing that the transport is reset onto it.
     void onReconnected(int new_socket_fd, const std::string& dtls_fingerprint);
 
     // --- P2P Connection Management ---
@@ -184,12 +307,41 @@ public:
 
 private:
     // --- Subsystem initialization ---
+    /// Create the transport and complete the DTLS handshake; nothing is
+    /// received until startTransport().
     bool initTransport();
+
+    /// Apply the playout policy and start receiving and reporting stats.
+    bool startTransport();
     bool initDecoder();
+
+    /// Apply quality_'s playout policy to the jitter buffer and A/V sync.
+    void configureJitterBuffer();
     bool initRenderer();
+
+    /// Apply quality_'s present mode to the renderer.
+    void configurePresentMode();
     bool initAudio();
     bool initInput();
 
+    /// Start a DisplayStream for each of config_.display_windows.  A
+    /// display that fails to start is left out.
+    void initDisplays();
+
+    // --- Path changes (receive thread) ---
+    /// A socket connected to the host from another local address than
+    /// |active_fd|'s, or -1.  Local addresses are tried in turn.
+    int openStandbySocket(int active_fd);
+
+    /// The receiver moved the session to |socket_fd|, or lost the path
+    /// with no standby to take over (-1).
+    void onPathChanged(int socket_fd);
+
+    /// Mark the connection RECONNECTING and ask the signaling layer for an
+    /// ICE restart.  Returns false, having disconnected, once
+    /// kMaxReconnectAttempts is exceeded.
+    bool requestReconnect();
+
     // --- Thread entry points ---
     void receiveThreadFunc();
     void decodeThreadFunc();
@@ -198,9 +350,27 @@ private:
 
     // --- Packet dispatch ---
     void onVideoPacket(const uint8_t* data, size_t len);
+    void onFecPacket(const uint8_t* data, size_t len);
+    void onRecoveredVideoPacket(const uint8_t* data, size_t len);
+    void deliverVideoFragment(const VideoPacketHeaderV2& header,
+                              const uint8_t* payload, size_t payload_len);
     void onAudioPacket(const uint8_t* data, size_t len);
     void onClipboardPacket(const uint8_t* data, size_t len);
     void onClipboardAck(const uint8_t* data, size_t len);
+    void onCursorPacket(PacketType type, const uint8_t* data, size_t len);
+
+    // --- Frame loss recovery (decode thread) ---
+    void checkFrameLoss();
+    bool skipUntilRecovered(const VideoPacketHeaderV2& header);
+
+    // --- Pipelined decode (decode thread) ---
+    /// Submit one frame to the decoder and note it in the timeline.
+    void submitFrame(const uint8_t* data, size_t len, const VideoPacketHeaderV2& header,
+                     uint64_t first_arrival_us, uint64_t complete_us);
+
+    /// Take one decode result, waiting up to |max_wait_ms|, and hand its
+    /// picture to the render thread.  Returns false if none was ready.
+    bool collectDecoded(uint32_t max_wait_ms);
 
     // --- Codec type helper ---
     static uint8_t codecFromString(const std::string& name);
@@ -212,15 +382,23 @@ private:
     // --- Subsystems ---
     std::unique_ptr<IDecoder>           decoder_;
     std::unique_ptr<IRenderer>          renderer_;
+    std::unique_ptr<FrameQueue>         render_queue_;
+    std::unique_ptr<PacketRecorder>     recorder_;   // Outlives its users below
     std::unique_ptr<UdpReceiver>        receiver_;
     std::unique_ptr<JitterBuffer>       jitter_buffer_;
     std::unique_ptr<NackSender>         nack_sender_;
+    std::unique_ptr<FecDecoder>         fec_decoder_;
     std::unique_ptr<StatsReporter>      stats_reporter_;
     std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
     std::unique_ptr<IAudioPlayback>     audio_playback_;
     std::unique_ptr<InputCapture>       input_capture_;
     std::unique_ptr<InputSender>        input_sender_;
+    std::unique_ptr<ControllerCapture>  controller_capture_;   // Feeds input_sender_
     std::unique_ptr<ClipboardSync>      clipboard_sync_;
+    std::unique_ptr<CursorCache>        cursor_cache_;     // Cursor channel (wire v4)
+
+    // Extra displays by stream ID (wire v5); slot 0, the primary, is unused
+    std::array<std::unique_ptr<DisplayStream>, MAX_VIDEO_STREAMS> displays_;
 
     // --- Threads ---
     std::thread receive_thread_;
@@ -233,22 +411,71 @@ private:
     std::atomic<bool> stopping_{false};
     mutable std::mutex mutex_;
 
-    // --- Decode/render queue signaling ---
-    std::mutex decode_queue_mutex_;
-    std::condition_variable decode_queue_cv_;
-
-    std::mutex render_queue_mutex_;
-    std::condition_variable render_queue_cv_;
-    std::unique_ptr<DecodedFrame> pending_frame_;
+    // --- Frame loss recovery (decode thread only) ---
+    // After a loss, frames that still reference the lost ones are dropped
+    // until a keyframe or a recovery frame newer than loss_last_ arrives.
+    bool awaiting_recovery_ = false;
+    uint32_t loss_first_ = 0;
+    uint32_t loss_last_  = 0;
+    std::chrono::steady_clock::time_point loss_time_;
+    static constexpr auto kRecoveryTimeout = std::chrono::seconds(1);
+    // False from a decode that may have used a missing reference until the
+    // next keyframe; LTR frames are only acknowledged while it is true.
+    bool decode_clean_ = false;
+    // Size of the last picture decoded; the stream changes it in-band
+    uint32_t decoded_width_  = 0;
+    uint32_t decoded_height_ = 0;
+
+    // --- Decode timeline (decode thread only) ---
+    // What the decode thread needs to know about each unit once its
+    // picture comes out, indexed by decode tag.  The depth never exceeds
+    // the ring size, so a slot is not reused while its unit is in flight.
+    struct InFlightFrame {
+        uint64_t tag          = 0;
+        uint64_t timestamp_us = 0;
+        uint64_t first_arrival_us = 0;
+        uint64_t complete_us  = 0;
+        uint32_t frame_number = 0;
+        bool     keyframe     = false;
+        bool     ltr          = false;
+    };
+    static constexpr uint32_t kMaxDecodeDepth = 3;    // MAX_DECODE_IN_FLIGHT
+    std::array<InFlightFrame, kMaxDecodeDepth> in_flight_{};
+    uint64_t next_decode_tag_ = 1;
+    uint32_t decode_depth_    = 1;
 
     // --- Audio queue ---
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    struct AudioPacketData {
-        std::vector<uint8_t> data;
-        uint32_t timestamp_us;
+    // Packets from the receive thread to the audio thread, which orders
+    // them in audio_jitter_
+    static constexpr size_t   kAudioMaxPayload  = 1500;   // AudioJitterBuffer::MAX_PAYLOAD
+    static constexpr size_t   kAudioQueueSlots  = 128;
+    static constexpr uint32_t kAudioWakeMs      = 2;      // Output top-up interval
+    static constexpr float    kAudioMinLeadMs   = 5.0f;   // Decoded ahead of the device
+    struct AudioPacketSlot {
+        AudioPacketHeader header{};
+        uint64_t          arrival_us = 0;
+        uint16_t          len        = 0;
+        std::array<uint8_t, kAudioMaxPayload> data{};
     };
-    std::vector<AudioPacketData> audio_queue_;
+    SpscQueue<AudioPacketSlot, kAudioQueueSlots> audio_queue_;
+    std::unique_ptr<AudioJitterBuffer>          audio_jitter_;
+
+    // Lines audio up with video on the host's capture timestamps; extra
+    // audio delay is bounded the same under every preset
+    static constexpr uint32_t kAvSyncMaxAudioDelayMs = 100;
+    std::unique_ptr<AvSync>                     av_sync_;
+
+    // --- End-to-end latency ---
+    // Each presented frame's stages, from its host capture time placed on
+    // our clock (render thread records, getStats() reads); also noted in
+    // |timing| for the stats ring
+    void recordFrameLatency(const DecodedFrame& frame, uint64_t photon_us, FrameTiming& timing);
+    LatencyHistogram first_packet_latency_;
+    LatencyHistogram frame_complete_latency_;
+    LatencyHistogram glass_to_glass_latency_;
+    // Input sent to the photons of the first frame captured after the host
+    // injected it (render thread records via input_sender_)
+    LatencyHistogram input_to_photon_latency_;
 
     // --- Callbacks ---
     std::function<void()> on_disconnect_;
@@ -263,19 +490,33 @@ private:
     };
     std::atomic<ConnectionState> conn_state_{ConnectionState::CONNECTED};
     std::chrono::steady_clock::time_point last_packet_time_;
-    int reconnect_attempts_ = 0;
+    std::atomic<int> reconnect_attempts_{0};
     static constexpr int kMaxReconnectAttempts = 3;
     static constexpr auto kDeadConnectionTimeout = std::chrono::seconds(10);
+    static constexpr uint32_t kDecodeIdleWakeMs = 500;
+    static constexpr uint32_t kDecodeWaitMs = 100;     // DECODE_WAIT_MS
+    static constexpr uint32_t kRenderIdleWakeMs = 100;
     static constexpr auto kReconnectTotalTimeout = std::chrono::seconds(30);
 
     // --- P2P state ---
-    int p2p_socket_ = -1;
+    std::atomic<int> p2p_socket_{-1};     // Moves on a path migration
     struct sockaddr_storage peer_addr_;
     socklen_t peer_addr_len_ = 0;
+    size_t standby_next_ = 0;             // Next local address for a standby (receive thread)
 
     // --- Stats snapshot ---
     mutable std::mutex stats_mutex_;
     ViewerStats stats_;
+    StartTiming start_timing_;   // stats_mutex_
+
+    // Time to first frame: start() called, and the first present after it
+    // (render thread sets, 0 until then)
+    std::chrono::steady_clock::time_point start_time_;
+    std::atomic<uint64_t> first_frame_us_{0};
+
+    // Shared with JavaScript (not owned); written by the stats and render
+    // threads
+    std::atomic<StatsRing*> stats_ring_{nullptr};
 };
 
 } // namespace cs
@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////
+// cursor_cache_test.cpp -- Cursor shape reassembly from untrusted chunks
+//
+// Chunks are matched to the shape being reassembled by hash alone, so a
+// chunk with the same hash but other geometry (a collision, or not from
+// the host) must be turned down before anything is copied.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "render/cursor_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t HASH = 0x12345678;
+
+/// Chunk |index| of a |width| x |height| shape whose pixels are all |fill|.
+std::vector<uint8_t> shapeChunk(uint16_t width, uint16_t height, uint8_t index, uint8_t fill,
+                                uint32_t hash = HASH) {
+    const size_t total = static_cast<size_t>(width) * height * 4;
+    cs::CursorShapeHeader hdr{};
+    hdr.type        = static_cast<uint8_t>(cs::PacketType::CURSOR_SHAPE);
+    hdr.chunk_index = index;
+    hdr.chunk_count = static_cast<uint8_t>((total + cs::CURSOR_CHUNK_BYTES - 1) /
+                                           cs::CURSOR_CHUNK_BYTES);
+    hdr.width       = width;
+    hdr.height      = height;
+    hdr.shape_hash  = hash;
+
+    const size_t offset  = static_cast<size_t>(index) * cs::CURSOR_CHUNK_BYTES;
+    const size_t payload = std::min(cs::CURSOR_CHUNK_BYTES, total - offset);
+    std::vector<uint8_t> packet(sizeof(cs::CursorShapeHeader) + payload, fill);
+    hdr.serializeTo(packet.data());
+    return packet;
+}
+
+/// Point the cursor at shape |hash|, so completing it is reported.
+void pointAt(cs::CursorCache& cache, uint32_t hash) {
+    cs::CursorPositionPacket pos{};
+    pos.type       = static_cast<uint8_t>(cs::PacketType::CURSOR_POS);
+    pos.flags      = cs::CURSOR_FLAG_VISIBLE;
+    pos.sequence   = 1;
+    pos.shape_hash = hash;
+    uint8_t buf[sizeof(cs::CursorPositionPacket)];
+    cache.onPosition(buf, pos.serializeTo(buf));
+}
+
+TEST(CursorCache, ReassemblesChunks) {
+    cs::CursorCache cache;
+    pointAt(cache, HASH);
+    const std::vector<uint8_t> c0 = shapeChunk(16, 32, 0, 0xAB);   // 2 chunks
+    const std::vector<uint8_t> c1 = shapeChunk(16, 32, 1, 0xAB);
+    EXPECT_FALSE(cache.onShapeChunk(c0.data(), c0.size()));
+    EXPECT_TRUE(cache.onShapeChunk(c1.data(), c1.size()));
+
+    cs::CursorState state;
+    ASSERT_TRUE(cache.takeState(state));
+    ASSERT_TRUE(state.shape);
+    EXPECT_EQ(state.shape->width, 16);
+    EXPECT_EQ(state.shape->height, 32);
+    EXPECT_EQ(state.shape->bgra, std::vector<uint8_t>(16 * 32 * 4, 0xAB));
+}
+
+// A larger shape under the same hash would have written its later chunks
+// past the buffer sized from the first one
+TEST(CursorCache, SameHashOtherGeometryIsRejected) {
+    cs::CursorCache cache;
+    pointAt(cache, HASH);
+    const std::vector<uint8_t> first = shapeChunk(16, 32, 0, 0xAB);   // 2 chunks, 2048 bytes
+    EXPECT_FALSE(cache.onShapeChunk(first.data(), first.size()));
+
+    // Last chunk first: it lies wholly past the 2048 bytes held
+    for (int index = 3; index >= 0; --index) {
+        const std::vector<uint8_t> bigger =
+            shapeChunk(32, 32, static_cast<uint8_t>(index), 0xCD);   // 4096 bytes
+        EXPECT_FALSE(cache.onShapeChunk(bigger.data(), bigger.size()));
+    }
+    const std::vector<uint8_t> smaller = shapeChunk(8, 8, 0, 0xCD);
+    EXPECT_FALSE(cache.onShapeChunk(smaller.data(), smaller.size()));
+
+    // The shape first begun is still intact and completes as sent
+    const std::vector<uint8_t> last = shapeChunk(16, 32, 1, 0xAB);
+    EXPECT_TRUE(cache.onShapeChunk(last.data(), last.size()));
+    cs::CursorState state;
+    ASSERT_TRUE(cache.takeState(state));
+    ASSERT_TRUE(state.shape);
+    EXPECT_EQ(state.shape->width, 16);
+    EXPECT_EQ(state.shape->height, 32);
+    EXPECT_EQ(state.shape->bgra, std::vector<uint8_t>(16 * 32 * 4, 0xAB));
+}
+
+TEST(CursorCache, MismatchedHotspotIsRejected) {
+    cs::CursorCache cache;
+    pointAt(cache, HASH);
+    const std::vector<uint8_t> c0 = shapeChunk(16, 32, 0, 0xAB);
+    EXPECT_FALSE(cache.onShapeChunk(c0.data(), c0.size()));
+
+    std::vector<uint8_t> c1 = shapeChunk(16, 32, 1, 0xAB);
+    cs::CursorShapeHeader hdr{};
+    ASSERT_TRUE(cs::CursorShapeHeader::deserialize(c1.data(), c1.size(), hdr));
+    hdr.hotspot_x = 5;
+    hdr.serializeTo(c1.data());
+    EXPECT_FALSE(cache.onShapeChunk(c1.data(), c1.size()));
+}
+
+TEST(CursorCache, ShortOrInconsistentChunksAreRejected) {
+    cs::CursorCache cache;
+    std::vector<uint8_t> chunk = shapeChunk(16, 32, 0, 0xAB);
+    EXPECT_FALSE(cache.onShapeChunk(chunk.data(), chunk.size() - 1));   // Payload cut short
+
+    cs::CursorShapeHeader hdr{};
+    ASSERT_TRUE(cs::CursorShapeHeader::deserialize(chunk.data(), chunk.size(), hdr));
+    hdr.chunk_count = 1;   // Too few for the geometry
+    hdr.serializeTo(chunk.data());
+    EXPECT_FALSE(cache.onShapeChunk(chunk.data(), chunk.size()));
+}
+
+} // namespace
@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////
+// nack_sender_test.cpp -- NackSender's received bitmap and window
+//
+// No socket: checkForGaps() is driven directly and what it requested is
+// read back with getMissingSequences() (sequences requested at least
+// once and still missing).
+///////////////////////////////////////////////////////////////////////////////
+
+#include "transport/nack_sender.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr uint16_t WINDOW = 1024;            // NackSender::NACK_WINDOW
+constexpr size_t   NACKS_PER_CHECK = 10;
+
+/// Check until everything missing has been requested once.
+std::vector<uint16_t> requestAll(cs::NackSender& nack) {
+    size_t before = 0;
+    std::vector<uint16_t> missing;
+    do {
+        before = missing.size();
+        nack.checkForGaps();
+        missing = nack.getMissingSequences();
+    } while (missing.size() > before);
+    return missing;
+}
+
+TEST(NackSender, RequestsAGap) {
+    cs::NackSender nack;
+    for (uint16_t seq : {100, 101, 103, 104}) nack.onPacketReceived(seq);
+    nack.checkForGaps();
+    EXPECT_EQ(nack.getMissingSequences(), std::vector<uint16_t>({102}));
+
+    nack.onPacketReceived(102);   // The retransmit
+    EXPECT_TRUE(nack.getMissingSequences().empty());
+}
+
+TEST(NackSender, NothingMissingInOrder) {
+    cs::NackSender nack;
+    for (uint16_t seq = 0; seq < 3 * WINDOW; ++seq) nack.onPacketReceived(seq);
+    nack.checkForGaps();
+    EXPECT_TRUE(nack.getMissingSequences().empty());
+}
+
+TEST(NackSender, GapAcrossSequenceWrap) {
+    cs::NackSender nack;
+    for (uint16_t seq : {65533, 65534, 1, 2}) nack.onPacketReceived(seq);
+    EXPECT_EQ(requestAll(nack), std::vector<uint16_t>({65535, 0}));
+}
+
+TEST(NackSender, GapsAcrossBitmapWordsAndWrap) {
+    // Sequences 63/64 straddle a bitmap word; 1023/1024 straddle the end
+    // of the bitmap, where the index wraps to 0
+    cs::NackSender nack;
+    for (uint16_t seq = 60; seq <= 1030; ++seq) {
+        if (seq == 63 || seq == 64 || seq == 1023 || seq == 1024) continue;
+        nack.onPacketReceived(seq);
+    }
+    EXPECT_EQ(requestAll(nack), std::vector<uint16_t>({63, 64, 1023, 1024}));
+}
+
+TEST(NackSender, LimitsRequestsPerCheck) {
+    cs::NackSender nack;
+    nack.onPacketReceived(0);
+    nack.onPacketReceived(100);
+    nack.checkForGaps();
+    const std::vector<uint16_t> first = nack.getMissingSequences();
+    ASSERT_EQ(first.size(), NACKS_PER_CHECK);
+    EXPECT_EQ(first.front(), 1);   // Oldest first
+    EXPECT_EQ(requestAll(nack).size(), 99u);
+}
+
+TEST(NackSender, WindowCoversTheLastWindowSequences) {
+    // A jump wider than the window: only the newest WINDOW - 1 gaps are
+    // kept, and anything older is ignored when it turns up
+    cs::NackSender nack;
+    nack.onPacketReceived(0);
+    nack.onPacketReceived(2000);
+    const std::vector<uint16_t> missing = requestAll(nack);
+    ASSERT_EQ(missing.size(), WINDOW - 1u);
+    EXPECT_EQ(missing.front(), 2000 - (WINDOW - 1));
+    EXPECT_EQ(missing.back(), 1999);
+
+    nack.onPacketReceived(500);   // Older than the window
+    EXPECT_EQ(nack.getMissingSequences().size(), WINDOW - 1u);
+
+    nack.onPacketReceived(1999);
+    nack.onPacketReceived(2000 - (WINDOW - 1));
+    EXPECT_EQ(nack.getMissingSequences().size(), WINDOW - 3u);
+}
+
+TEST(NackSender, SlidingWindowForgetsOldGaps) {
+    cs::NackSender nack;
+    nack.onPacketReceived(10);
+    nack.onPacketReceived(12);   // 11 missing
+    nack.checkForGaps();
+    ASSERT_EQ(nack.getMissingSequences(), std::vector<uint16_t>({11}));
+
+    // 11 leaves the window; its slot is reused by 11 + WINDOW, which arrives
+    for (uint16_t seq = 13; seq <= 12 + WINDOW; ++seq) nack.onPacketReceived(seq);
+    nack.checkForGaps();
+    EXPECT_TRUE(nack.getMissingSequences().empty());
+}
+
+TEST(NackSender, GivesUpAfterMaxRetries) {
+    cs::NackSender nack;
+    nack.setMaxRetries(2);
+    nack.setRtt(20'000, 0);   // Retries 20 ms apart
+    for (uint16_t seq : {1, 3}) nack.onPacketReceived(seq);
+
+    nack.checkForGaps();
+    EXPECT_EQ(nack.getMissingSequences(), std::vector<uint16_t>({2}));
+    nack.checkForGaps();   // Too soon to ask again; still outstanding
+    EXPECT_EQ(nack.getMissingSequences(), std::vector<uint16_t>({2}));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+    nack.checkForGaps();   // Second request
+    EXPECT_EQ(nack.getMissingSequences(), std::vector<uint16_t>({2}));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+    nack.checkForGaps();   // Out of retries
+    EXPECT_TRUE(nack.getMissingSequences().empty());
+}
+
+} // namespace
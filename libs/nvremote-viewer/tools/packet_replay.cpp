@@ -0,0 +1,475 @@
+///////////////////////////////////////////////////////////////////////////////
+// packet_replay.cpp -- Replay a session recording through the viewer's
+//                      receive path, headless
+//
+// Reads a recording written by PacketRecorder (cs/transport/
+// packet_recorder.h) and feeds its video and FEC packets, in recorded
+// order, to the stages the viewer runs them through: FecDecoder,
+// NackSender and JitterBuffer, wired as Viewer wires them, and then the
+// platform's hardware decoder where there is one.  With a viewer's
+// recording the packets are the ones it received, losses and all; with a
+// host's they are the ones it sent, a lossless baseline for the same
+// session.
+//
+// At the original speed (--speed=1, or a factor) packets are fed at their
+// recorded times, so the jitter buffer's playout and the NACK timers see
+// the session's own timing.  --speed=max feeds them as fast as the
+// pipeline takes them, to replay a long session or measure the
+// pipeline's own throughput: the process clock (timestampOffsetUs() in
+// cs/common.h) is moved forward to each packet's recorded time before it
+// is fed, so repair windows, FEC group expiry and frame ageing see the
+// recorded gaps, and frames are released as soon as they are whole.  The
+// NACK thread's retry timers still run in real time there, so NACK counts
+// are only the session's at recorded timing.
+//
+// NACKs and frame-loss reports go to a local socket nobody reads.
+//
+// Usage: packet-replay <recording> [--name=value ...]
+//   speed    1 (the default), a factor, or max
+//   from     start this many seconds into the recording (chunk index seek)
+//   seconds  replay at most this much of the recording
+//   decode   0 to stop at the jitter buffer
+//   width, height   decoder's initial size (default 1920x1080)
+///////////////////////////////////////////////////////////////////////////////
+
+#include "decode/decoder_interface.h"
+#include "transport/fec_decoder.h"
+#include "transport/jitter_buffer.h"
+#include "transport/nack_sender.h"
+
+#ifdef _WIN32
+#include "decode/d3d11va_decoder.h"
+#include "decode/nvdec_decoder.h"
+#elif defined(__APPLE__)
+#include "decode/videotoolbox_decoder.h"
+#endif
+
+#include "cs/common.h"
+#include "cs/latency_histogram.h"
+#include "cs/transport/packet.h"
+#include "cs/transport/packet_recorder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+using namespace cs;
+
+namespace {
+
+// Frames further apart than this, in recording time, count as stalls
+constexpr uint64_t STALL_GAP_US = 50'000;
+
+// How long the tail is given to leave the jitter buffer at the end
+constexpr uint32_t DRAIN_MS = 500;
+
+// ---------------------------------------------------------------------------
+// Options
+// ---------------------------------------------------------------------------
+struct Options {
+    std::string path;
+    double      speed     = 1.0;     // 0 = as fast as possible
+    double      from      = 0.0;     // Seconds into the recording
+    double      seconds   = 0.0;     // 0 = to the end
+    bool        decode    = true;
+    uint32_t    width     = 1920;
+    uint32_t    height    = 1080;
+};
+
+void printUsage(const char* argv0) {
+    std::fprintf(stderr,
+        "Usage: %s <recording> [--speed=1|<factor>|max] [--from=<s>] [--seconds=<s>]\n"
+        "       [--decode=0|1] [--width=<px>] [--height=<px>]\n",
+        argv0);
+}
+
+bool parseOptions(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            if (!opt.path.empty()) {
+                std::fprintf(stderr, "Unrecognized argument: %s\n", arg.c_str());
+                return false;
+            }
+            opt.path = arg;
+            continue;
+        }
+        const size_t eq = arg.find('=');
+        if (eq == std::string::npos) {
+            std::fprintf(stderr, "Unrecognized argument: %s\n", arg.c_str());
+            return false;
+        }
+        const std::string name  = arg.substr(2, eq - 2);
+        const std::string value = arg.substr(eq + 1);
+        const char* v = value.c_str();
+
+        if      (name == "speed")   opt.speed   = value == "max" ? 0.0 : std::atof(v);
+        else if (name == "from")    opt.from    = std::atof(v);
+        else if (name == "seconds") opt.seconds = std::atof(v);
+        else if (name == "decode")  opt.decode  = std::atoi(v) != 0;
+        else if (name == "width")   opt.width   = static_cast<uint32_t>(std::atoi(v));
+        else if (name == "height")  opt.height  = static_cast<uint32_t>(std::atoi(v));
+        else {
+            std::fprintf(stderr, "Unknown option: --%s\n", name.c_str());
+            return false;
+        }
+    }
+    if (opt.path.empty()) {
+        std::fprintf(stderr, "No recording given\n");
+        return false;
+    }
+    if (opt.speed < 0.0 || opt.from < 0.0 || opt.seconds < 0.0) {
+        std::fprintf(stderr, "speed, from and seconds cannot be negative\n");
+        return false;
+    }
+    return true;
+}
+
+/// A UDP socket bound to 127.0.0.1 on an OS-chosen port, and its address.
+int bindLoopback(::sockaddr_in& addr) {
+    int fd = static_cast<int>(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+    if (fd < 0) return -1;
+
+    addr = {};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (::bind(fd, reinterpret_cast<::sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::getsockname(fd, reinterpret_cast<::sockaddr*>(&addr), &len) < 0) {
+        cs_close_socket(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// ---------------------------------------------------------------------------
+// openDecoder -- the backends createDecoder() tries, without a renderer
+// ---------------------------------------------------------------------------
+std::unique_ptr<IDecoder> openDecoder(uint8_t codec, uint32_t width, uint32_t height) {
+#ifdef _WIN32
+    auto d3d11va = std::make_unique<D3D11VADecoder>();
+    if (d3d11va->initialize(codec, width, height)) return d3d11va;
+    auto nvdec = std::make_unique<NvdecDecoder>();
+    if (nvdec->initialize(codec, width, height)) return nvdec;
+#elif defined(__APPLE__)
+    auto vt = std::make_unique<VideoToolboxDecoder>();
+    if (vt->initialize(codec, width, height)) return vt;
+#else
+    (void)codec; (void)width; (void)height;
+#endif
+    return nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// Replay -- the viewer's receive path for display 0, wired as Viewer wires it
+// ---------------------------------------------------------------------------
+class Replay {
+public:
+    ~Replay() { stop(); }
+
+    bool start(const Options& opt) {
+        opt_ = opt;
+
+        sink_fd_ = bindLoopback(sink_addr_);
+        if (sink_fd_ < 0) return false;
+
+        // At full speed the recorded gaps between frames are gone, so
+        // playout timing has nothing to work with: release on completion.
+        if (opt_.speed == 0.0) {
+            jitter_.setImmediateRelease(true);
+            jitter_.setDepthRangeMs(0, 10);
+        }
+
+        nack_.setJitterBuffer(&jitter_);
+        nack_.initialize(sink_fd_, reinterpret_cast<::sockaddr*>(&sink_addr_),
+                         static_cast<int>(sizeof(sink_addr_)));
+        nack_.start();
+
+        fec_.setRecoveryCallback([this](const uint8_t* data, size_t len) {
+            VideoPacketHeaderV2 header;
+            size_t header_len = 0;
+            if (!parseVideoHeader(data, len, header, &header_len)) return;
+            if (len - header_len != header.payload_length) return;
+            deliver(header, data + header_len, len - header_len);
+        });
+        return true;
+    }
+
+    void stop() {
+        jitter_.interrupt();
+        nack_.stop();
+        if (decoder_) decoder_->release();
+        decoder_.reset();
+        if (sink_fd_ >= 0) cs_close_socket(sink_fd_);
+        sink_fd_ = -1;
+    }
+
+    /// Hand one recorded packet to the pipeline at recording time |now_us|.
+    void feed(const uint8_t* data, size_t len, uint64_t now_us) {
+        now_us_ = now_us;
+        ++packets_;
+        bytes_ += len;
+        switch (identifyPacket(data, len)) {
+            case PacketType::VIDEO: onVideo(data, len); break;
+            case PacketType::FEC:   onFec(data, len); break;
+            default: ++other_packets_; break;
+        }
+    }
+
+    /// Pop and decode every frame the jitter buffer releases now.
+    void drain(uint64_t now_us) {
+        now_us_ = std::max(now_us_, now_us);
+        JitterBuffer::FrameView frame;
+        VideoPacketHeaderV2 header;
+        while (jitter_.popFrame(frame, header)) {
+            onFrame(frame, header);
+        }
+        uint32_t first = 0;
+        uint32_t last  = 0;
+        if (jitter_.takeLostFrames(first, last)) {
+            frames_lost_ += last - first + 1;
+            nack_.reportFrameLoss(first, last);
+        }
+    }
+
+    /// Wait up to |max_wait_ms| for a frame to come due, then drain.
+    void waitAndDrain(uint32_t max_wait_ms, uint64_t now_us) {
+        jitter_.waitForFrame(max_wait_ms);
+        drain(now_us);
+    }
+
+    void report() const {
+        std::printf("  packets   %llu (%llu video, %llu FEC, %llu other), %.2f MB\n",
+                    static_cast<unsigned long long>(packets_),
+                    static_cast<unsigned long long>(video_packets_),
+                    static_cast<unsigned long long>(fec_packets_),
+                    static_cast<unsigned long long>(other_packets_),
+                    static_cast<double>(bytes_) / 1e6);
+        if (other_streams_ > 0) {
+            std::printf("            %llu video packets of other displays skipped\n",
+                        static_cast<unsigned long long>(other_streams_));
+        }
+        std::printf("  frames    %llu complete (%llu keyframes), %llu lost\n",
+                    static_cast<unsigned long long>(frames_),
+                    static_cast<unsigned long long>(keyframes_),
+                    static_cast<unsigned long long>(frames_lost_));
+        std::printf("  repair    %llu FEC recovered, %llu unrecoverable, %llu NACKed\n",
+                    static_cast<unsigned long long>(fec_.getRecoveredCount()),
+                    static_cast<unsigned long long>(fec_.getUnrecoverableCount()),
+                    static_cast<unsigned long long>(nack_.getNacksSent()));
+        std::printf("  gaps      p50 %.1f ms, p99 %.1f ms, max %.1f ms, %llu over %.0f ms\n",
+                    gaps_.percentileMs(0.50f), gaps_.percentileMs(0.99f),
+                    static_cast<double>(max_gap_us_) / 1e3,
+                    static_cast<unsigned long long>(stalls_),
+                    static_cast<double>(STALL_GAP_US) / 1e3);
+        if (!opt_.decode) return;
+        if (decoder_) {
+            std::printf("  decode    %s: %llu pictures, %llu failed, p50 %.2f ms, p99 %.2f ms\n",
+                        decoder_->getName().c_str(),
+                        static_cast<unsigned long long>(decoded_),
+                        static_cast<unsigned long long>(decode_failed_),
+                        decode_times_.percentileMs(0.50f), decode_times_.percentileMs(0.99f));
+        } else {
+            std::printf("  decode    no decoder available, frames stop at the jitter buffer\n");
+        }
+    }
+
+    uint64_t packets() const { return packets_; }
+    uint64_t bytes() const { return bytes_; }
+
+private:
+    void onVideo(const uint8_t* data, size_t len) {
+        VideoPacketHeaderV2 header;
+        size_t header_len = 0;
+        if (!parseVideoHeader(data, len, header, &header_len)) return;
+        if (len - header_len != header.payload_length) return;
+        if (header.streamId() != 0) {
+            ++other_streams_;
+            return;
+        }
+        ++video_packets_;
+        fec_.onVideoPacket(header.sequence_number, data, len);
+        deliver(header, data + header_len, len - header_len);
+    }
+
+    void onFec(const uint8_t* data, size_t len) {
+        FecPacketHeader fh;
+        if (!FecPacketHeader::deserialize(data, len, fh)) return;
+        ++fec_packets_;
+        nack_.onPacketReceived(fh.sequence_number);
+        fec_.onFecPacket(data, len);
+    }
+
+    void deliver(const VideoPacketHeaderV2& header, const uint8_t* payload, size_t len) {
+        nack_.onPacketReceived(header.sequence_number);
+        jitter_.pushPacket(header, payload, len);
+    }
+
+    void onFrame(const JitterBuffer::FrameView& frame, const VideoPacketHeaderV2& header) {
+        ++frames_;
+        if (header.keyframe()) ++keyframes_;
+
+        // Frame-to-frame gaps in recording time: where the session stuttered
+        if (last_frame_us_ != 0) {
+            const uint64_t gap = now_us_ - std::min(now_us_, last_frame_us_);
+            gaps_.record(gap);
+            max_gap_us_ = std::max(max_gap_us_, gap);
+            if (gap > STALL_GAP_US) ++stalls_;
+        }
+        last_frame_us_ = now_us_;
+
+        if (!opt_.decode) return;
+        if (!decoder_ && !tried_decoder_) {
+            tried_decoder_ = true;
+            decoder_ = openDecoder(header.codecType(), opt_.width, opt_.height);
+        }
+        if (!decoder_) return;
+
+        DecodedFrame decoded;
+        if (decoder_->decode(frame.data, frame.size, decoded)) {
+            ++decoded_;
+            decode_times_.record(static_cast<uint64_t>(decoded.decode_time_ms * 1000.0));
+        } else {
+            ++decode_failed_;
+        }
+    }
+
+    Options               opt_;
+    int                   sink_fd_ = -1;
+    ::sockaddr_in         sink_addr_ = {};
+    JitterBuffer          jitter_;
+    NackSender            nack_;
+    FecDecoder            fec_;
+    std::unique_ptr<IDecoder> decoder_;
+    bool                  tried_decoder_ = false;
+
+    uint64_t              now_us_        = 0;   // Recording clock
+    uint64_t              packets_       = 0;
+    uint64_t              bytes_         = 0;
+    uint64_t              video_packets_ = 0;
+    uint64_t              fec_packets_   = 0;
+    uint64_t              other_packets_ = 0;
+    uint64_t              other_streams_ = 0;
+    uint64_t              frames_        = 0;
+    uint64_t              keyframes_     = 0;
+    uint64_t              frames_lost_   = 0;
+    uint64_t              decoded_       = 0;
+    uint64_t              decode_failed_ = 0;
+    uint64_t              last_frame_us_ = 0;
+    uint64_t              max_gap_us_    = 0;
+    uint64_t              stalls_        = 0;
+    LatencyHistogram      gaps_;
+    LatencyHistogram      decode_times_;
+};
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// main
+// ---------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    WinsockGuard winsock;
+    globalLogLevel() = LogLevel::WARN;
+
+    RecordingReader reader;
+    if (!reader.open(opt.path)) return 1;
+    if (reader.chunkCount() == 0 || reader.chunk(0).record_count == 0) {
+        std::fprintf(stderr, "%s holds no packets\n", opt.path.c_str());
+        return 1;
+    }
+
+    // A viewer's recording replays what it received; a host's what it sent
+    const bool host_recording =
+        reader.header().role == static_cast<uint8_t>(RecordingRole::HOST);
+    const RecordDirection replayed =
+        host_recording ? RecordDirection::SENT : RecordDirection::RECEIVED;
+
+    const uint64_t origin_us = reader.chunk(0).first_us;
+    const uint64_t start_us  = origin_us + static_cast<uint64_t>(opt.from * 1e6);
+    const uint64_t end_us    = opt.seconds > 0.0
+        ? start_us + static_cast<uint64_t>(opt.seconds * 1e6) : UINT64_MAX;
+    if (opt.from > 0.0) reader.seek(start_us);
+
+    Replay replay;
+    if (!replay.start(opt)) {
+        std::fprintf(stderr, "Failed to open the NACK sink socket\n");
+        return 1;
+    }
+
+    // Feed the records, at their recorded times unless at full speed
+    const uint64_t wall_start = getTimestampUs();
+    std::atomic<uint64_t>& clock_offset = timestampOffsetUs();
+    uint64_t last_us    = start_us;
+    uint64_t feedback   = 0;     // The other direction's NACKs, loss reports
+    uint64_t records    = 0;
+    PacketRecord rec;
+    while (reader.next(rec)) {
+        if (rec.timestamp_us > end_us) break;
+        ++records;
+        last_us = std::max(last_us, rec.timestamp_us);
+
+        if (rec.direction != replayed) {
+            const PacketType type = identifyPacket(rec.data, rec.len);
+            if (type == PacketType::NACK || type == PacketType::FRAME_LOSS) ++feedback;
+            continue;
+        }
+
+        // Into the replay; records of several threads can be a little out of order
+        const uint64_t rel_us = rec.timestamp_us > start_us ? rec.timestamp_us - start_us : 0;
+        if (opt.speed == 0.0) {
+            // Jump the clock to the packet's time on the replay's timeline
+            const uint64_t due = wall_start + rel_us;
+            const uint64_t now = getTimestampUs();
+            if (due > now) clock_offset.fetch_add(due - now);
+        } else {
+            const uint64_t due = wall_start +
+                static_cast<uint64_t>(static_cast<double>(rel_us) / opt.speed);
+            for (uint64_t now = getTimestampUs(); now < due; now = getTimestampUs()) {
+                const uint32_t wait_ms = static_cast<uint32_t>((due - now + 999) / 1000);
+                const uint64_t rec_now = start_us +
+                    static_cast<uint64_t>(static_cast<double>(now - wall_start) * opt.speed);
+                replay.waitAndDrain(std::min<uint32_t>(wait_ms, 20), rec_now);
+            }
+        }
+        replay.feed(rec.data, rec.len, rec.timestamp_us);
+        replay.drain(rec.timestamp_us);
+    }
+
+    const uint64_t wall_us =
+        std::max<uint64_t>(getTimestampUs() - clock_offset.load() - wall_start, 1);
+
+    // Let the tail out of the jitter buffer (at full speed it is out)
+    if (opt.speed > 0.0) {
+        const uint64_t tail_end = getTimestampUs() + DRAIN_MS * 1000ull;
+        while (getTimestampUs() < tail_end) {
+            replay.waitAndDrain(20, last_us);
+        }
+    }
+
+    // --- Report ---
+    const double span_s = static_cast<double>(last_us - start_us) / 1e6;
+    const double wall_s = static_cast<double>(wall_us) / 1e6;
+    std::printf("packet replay: %s (%s recording, %u chunks)\n", opt.path.c_str(),
+                host_recording ? "host" : "viewer", reader.chunkCount());
+    std::printf("  span      %.2f s from %.2f s, %llu records, replayed in %.2f s (%s)\n",
+                span_s, opt.from, static_cast<unsigned long long>(records), wall_s,
+                opt.speed > 0.0 ? "recorded timing" : "full speed");
+    std::printf("  rate      %.0f packets/s, %.1f Mbit/s\n",
+                static_cast<double>(replay.packets()) / wall_s,
+                static_cast<double>(replay.bytes()) * 8.0 / wall_s / 1e6);
+    std::printf("  recorded  %llu NACK / frame-loss reports %s\n",
+                static_cast<unsigned long long>(feedback),
+                host_recording ? "received" : "sent");
+    replay.report();
+    replay.stop();
+    return 0;
+}